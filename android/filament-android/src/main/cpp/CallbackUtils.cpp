@@ -19,6 +19,7 @@
 #include "CallbackUtils.h"
 
 struct {
+    JavaVM* vm;
 #ifdef ANDROID
     jclass handlerClass;
     jmethodID post;
@@ -27,31 +28,50 @@ struct {
     jmethodID execute;
 } gCallbackUtils;
 
-JniCallback* JniCallback::make(filament::Engine* engine,
+// returns the JNIEnv of the calling thread, which is attached to the VM if needed
+static JNIEnv* getCallbackEnv() {
+    JNIEnv* env = nullptr;
+    if (gCallbackUtils.vm->GetEnv((void**) &env, JNI_VERSION_1_6) != JNI_OK) {
+#ifdef ANDROID
+        gCallbackUtils.vm->AttachCurrentThread(&env, nullptr);
+#else
+        gCallbackUtils.vm->AttachCurrentThread((void**) &env, nullptr);
+#endif
+    }
+    return env;
+}
+
+static void postCallback(JNIEnv* env, jobject handler, jobject callback) {
+    if (handler && callback) {
+#ifdef ANDROID
+        if (env->IsInstanceOf(handler, gCallbackUtils.handlerClass)) {
+            env->CallBooleanMethod(handler, gCallbackUtils.post, callback);
+        }
+#endif
+        if (env->IsInstanceOf(handler, gCallbackUtils.executorClass)) {
+            env->CallVoidMethod(handler, gCallbackUtils.execute, callback);
+        }
+    }
+    env->DeleteGlobalRef(handler);
+    env->DeleteGlobalRef(callback);
+}
+
+// Note: these are heap allocated rather than taken from Engine::streamAlloc(), whose storage
+// is reclaimed when the command buffer is executed, which happens before filament is done
+// with the data.
+
+JniCallback* JniCallback::make(filament::Engine*,
         JNIEnv* env, jobject handler, jobject callback) {
-    void* that = engine->streamAlloc(sizeof(JniCallback), alignof(JniCallback));
-    return new (that) JniCallback(env, handler, callback);
+    return new JniCallback(env, handler, callback);
 }
 
 JniCallback::JniCallback(JNIEnv* env, jobject handler, jobject callback)
-        : mEnv(env)
-        , mHandler(env->NewGlobalRef(handler))
+        : mHandler(env->NewGlobalRef(handler))
         , mCallback(env->NewGlobalRef(callback)) {
 }
 
 JniCallback::~JniCallback() {
-    if (mHandler && mCallback) {
-#ifdef ANDROID
-        if (mEnv->IsInstanceOf(mHandler, gCallbackUtils.handlerClass)) {
-            mEnv->CallBooleanMethod(mHandler, gCallbackUtils.post, mCallback);
-        }
-#endif
-        if (mEnv->IsInstanceOf(mHandler, gCallbackUtils.executorClass)) {
-            mEnv->CallVoidMethod(mHandler, gCallbackUtils.execute, mCallback);
-        }
-    }
-    mEnv->DeleteGlobalRef(mHandler);
-    mEnv->DeleteGlobalRef(mCallback);
+    postCallback(getCallbackEnv(), mHandler, mCallback);
 }
 
 void JniCallback::invoke(void*, size_t, void* user) {
@@ -59,42 +79,36 @@ void JniCallback::invoke(void*, size_t, void* user) {
     delete data;
 }
 
-JniBufferCallback* JniBufferCallback::make(filament::Engine* engine,
+JniBufferCallback* JniBufferCallback::make(filament::Engine*,
         JNIEnv* env, jobject handler, jobject callback, AutoBuffer&& buffer) {
-    void* that = engine->streamAlloc(sizeof(JniBufferCallback), alignof(JniBufferCallback));
-    return new (that) JniBufferCallback(env, handler, callback, std::move(buffer));
+    return new JniBufferCallback(env, handler, callback, std::move(buffer));
 }
 
 JniBufferCallback::JniBufferCallback(JNIEnv* env, jobject handler, jobject callback,
         AutoBuffer&& buffer)
-        : mEnv(env)
-        , mHandler(env->NewGlobalRef(handler))
+        : mHandler(env->NewGlobalRef(handler))
         , mCallback(env->NewGlobalRef(callback))
         , mBuffer(std::move(buffer)){
 }
 
 JniBufferCallback::~JniBufferCallback() {
-    if (mHandler && mCallback) {
-#ifdef ANDROID
-        if (mEnv->IsInstanceOf(mHandler, gCallbackUtils.handlerClass)) {
-            mEnv->CallBooleanMethod(mHandler, gCallbackUtils.post, mCallback);
-        }
-#endif
-        if (mEnv->IsInstanceOf(mHandler, gCallbackUtils.executorClass)) {
-            mEnv->CallVoidMethod(mHandler, gCallbackUtils.execute, mCallback);
-        }
+    JNIEnv* env = getCallbackEnv();
+    {
+        // release the buffer before telling the application it can be reused
+        AutoBuffer buffer(std::move(mBuffer));
+        buffer.setEnv(env);
     }
-    mEnv->DeleteGlobalRef(mHandler);
-    mEnv->DeleteGlobalRef(mCallback);
+    postCallback(env, mHandler, mCallback);
 }
 
 void JniBufferCallback::invoke(void*, size_t, void* user) {
     JniBufferCallback* data = reinterpret_cast<JniBufferCallback*>(user);
-    // don't call delete here, because we don't own the storage
-    data->~JniBufferCallback();
+    delete data;
 }
 
 void registerCallbackUtils(JNIEnv *env) {
+    env->GetJavaVM(&gCallbackUtils.vm);
+
 #ifdef ANDROID
     gCallbackUtils.handlerClass = env->FindClass("android/os/Handler");
     gCallbackUtils.handlerClass = (jclass) env->NewGlobalRef(gCallbackUtils.handlerClass);
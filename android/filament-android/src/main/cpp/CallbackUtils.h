@@ -23,6 +23,13 @@
 
 #include <filament/Engine.h>
 
+/*
+ * The callbacks below are invoked on filament's main thread, which is not necessarily the
+ * thread they were created on. Direct buffers are passed to filament as is, without a copy,
+ * and the Java callback is posted to the given Handler or Executor once filament is done
+ * with the data, so the buffer can be recycled.
+ */
+
 struct JniCallback {
     static JniCallback* make(filament::Engine* engine,
             JNIEnv* env, jobject handler, jobject callback);
@@ -33,7 +40,6 @@ private:
     JniCallback(JNIEnv* env, jobject handler, jobject callback);
     ~JniCallback();
 
-    JNIEnv* mEnv;
     jobject mHandler;
     jobject mCallback;
 };
@@ -48,7 +54,6 @@ private:
     JniBufferCallback(JNIEnv* env, jobject handler, jobject callback, AutoBuffer&& buffer);
     ~JniBufferCallback();
 
-    JNIEnv* mEnv;
     jobject mHandler;
     jobject mCallback;
     AutoBuffer mBuffer;
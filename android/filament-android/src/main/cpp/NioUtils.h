@@ -52,6 +52,11 @@ public:
         return count << mShift;
     }
 
+    // the buffer must be released with the JNIEnv of the thread destroying it
+    void setEnv(JNIEnv* env) noexcept {
+        mEnv = env;
+    }
+
 private:
     void* mUserData = nullptr;
     size_t mSize = 0;
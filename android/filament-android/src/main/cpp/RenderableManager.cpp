@@ -227,6 +227,27 @@ Java_com_google_android_filament_RenderableManager_nSetAxisAlignedBoundingBox(JN
                                                                     {ex, ey, ez}});
 }
 
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_android_filament_RenderableManager_nSetAxisAlignedBoundingBoxes(JNIEnv* env,
+        jclass, jlong nativeRenderableManager, jintArray instances_, jint count, jobject boxes,
+        jint remaining) {
+    RenderableManager *rm = (RenderableManager *) nativeRenderableManager;
+    AutoBuffer nioBuffer(env, boxes, count * 6);
+    void* data = nioBuffer.getData();
+    size_t sizeInBytes = nioBuffer.getSize();
+    if (sizeInBytes > (remaining << nioBuffer.getShift())) {
+        // BufferOverflowException
+        return -1;
+    }
+    jint* instances = (jint*) env->GetPrimitiveArrayCritical(instances_, nullptr);
+    Box const* aabbs = static_cast<Box const*>(data);
+    for (jint j = 0; j < count; j++) {
+        rm->setAxisAlignedBoundingBox((RenderableManager::Instance) instances[j], aabbs[j]);
+    }
+    env->ReleasePrimitiveArrayCritical(instances_, instances, JNI_ABORT);
+    return 0;
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_RenderableManager_nSetLayerMask(JNIEnv*, jclass,
         jlong nativeRenderableManager, jint i, jint select, jint value) {
@@ -20,6 +20,8 @@
 #include <utils/Entity.h>
 #include <filament/TransformManager.h>
 
+#include "NioUtils.h"
+
 using namespace utils;
 using namespace filament;
 
@@ -86,6 +88,27 @@ Java_com_google_android_filament_TransformManager_nSetTransform(JNIEnv *env, jcl
     env->ReleaseFloatArrayElements(localTransform_, localTransform, JNI_ABORT);
 }
 
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_android_filament_TransformManager_nSetTransforms(JNIEnv *env, jclass type,
+        jlong nativeTransformManager, jintArray instances_, jint count,
+        jobject localTransforms, jint remaining) {
+    TransformManager *tm = (TransformManager *) nativeTransformManager;
+    AutoBuffer nioBuffer(env, localTransforms, count * 16);
+    void* data = nioBuffer.getData();
+    size_t sizeInBytes = nioBuffer.getSize();
+    if (sizeInBytes > (remaining << nioBuffer.getShift())) {
+        // BufferOverflowException
+        return -1;
+    }
+    jint *instances = (jint *) env->GetPrimitiveArrayCritical(instances_, NULL);
+    const math::mat4f *transforms = static_cast<const math::mat4f *>(data);
+    for (jint j = 0; j < count; j++) {
+        tm->setTransform((TransformManager::Instance) instances[j], transforms[j]);
+    }
+    env->ReleasePrimitiveArrayCritical(instances_, instances, JNI_ABORT);
+    return 0;
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_TransformManager_nGetTransform(JNIEnv *env, jclass type,
         jlong nativeTransformManager, jint i, jfloatArray outLocalTransform_) {
@@ -122,12 +122,13 @@ Java_com_google_android_filament_View_nGetAntiAliasing(JNIEnv*, jclass, jlong na
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_View_nSetDynamicResolutionOptions(JNIEnv *env, jclass,
         jlong nativeView, jboolean enabled, jboolean homogeneousScaling,
-        jfloat targetFrameTimeMilli, jfloat headRoomRatio, jfloat scaleRate,
+        jboolean temporalUpscaling, jfloat targetFrameTimeMilli, jfloat headRoomRatio, jfloat scaleRate,
         jfloat minScale, jfloat maxScale, jint history) {
     View* view = (View*) nativeView;
     View::DynamicResolutionOptions options;
     options.enabled = enabled;
     options.homogeneousScaling = homogeneousScaling;
+    options.temporalUpscaling = temporalUpscaling;
     options.targetFrameTimeMilli = targetFrameTimeMilli;
     options.headRoomRatio = headRoomRatio;
     options.scaleRate = scaleRate;
@@ -144,6 +145,20 @@ Java_com_google_android_filament_View_nSetDynamicLightingOptions(JNIEnv *env,
     view->setDynamicLightingOptions(zLightNear, zLightFar);
 }
 
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_android_filament_View_nSetDynamicLightingFroxelCount(JNIEnv *env,
+        jclass, jlong nativeView, jint froxelCount) {
+    View* view = (View*) nativeView;
+    view->setDynamicLightingFroxelCount((uint32_t) froxelCount);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_android_filament_View_nSetDynamicLightingMaxLightCount(JNIEnv *env,
+        jclass, jlong nativeView, jint maxLightCount) {
+    View* view = (View*) nativeView;
+    view->setDynamicLightingMaxLightCount((uint32_t) maxLightCount);
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_View_nSetDepthPrepass(JNIEnv *env,
         jclass, jlong nativeView, jint value) {
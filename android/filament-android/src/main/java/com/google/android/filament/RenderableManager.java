@@ -231,6 +231,22 @@ public class RenderableManager {
                 aabb.getHalfExtent()[0], aabb.getHalfExtent()[1], aabb.getHalfExtent()[2]);
     }
 
+    /**
+     * Sets the bounding boxes of several Renderables with a single native call
+     * @param instances Instances of the Renderables to update
+     * @param boxes A FloatBuffer containing instances.length boxes. Each box consists of 6 floats,
+     *              the center x,y,z followed by the half extent x,y,z.
+     *              Direct buffers avoid a copy.
+     */
+    public void setAxisAlignedBoundingBoxes(@NonNull @EntityInstance int[] instances,
+            @NonNull Buffer boxes) {
+        int result = nSetAxisAlignedBoundingBoxes(mNativeObject, instances, instances.length,
+                boxes, boxes.remaining());
+        if (result < 0) {
+            throw new BufferOverflowException();
+        }
+    }
+
     public void setLayerMask(@EntityInstance int i, @IntRange(from = 0, to = 255) int select,
             @IntRange(from = 0, to = 255) int value) {
         nSetLayerMask(mNativeObject, i, select, value);
@@ -347,6 +363,7 @@ public class RenderableManager {
     private static native int nSetBonesAsMatrices(long nativeObject, int i, Buffer matrices, int remaining, int boneCount, int offset);
     private static native int nSetBonesAsQuaternions(long nativeObject, int i, Buffer quaternions, int remaining, int boneCount, int offset);
     private static native void nSetAxisAlignedBoundingBox(long nativeRenderableManager, int i, float cx, float cy, float cz, float ex, float ey, float ez);
+    private static native int nSetAxisAlignedBoundingBoxes(long nativeRenderableManager, int[] instances, int count, Buffer boxes, int remaining);
     private static native void nSetLayerMask(long nativeRenderableManager, int i, int select, int value);
     private static native void nSetPriority(long nativeRenderableManager, int i, int priority);
     private static native void nSetCastShadows(long nativeRenderableManager, int i, boolean enabled);
@@ -42,6 +42,14 @@ public class Renderer {
         return nBeginFrame(getNativeObject(), swapChain.getNativeObject());
     }
 
+    /**
+     * Same as {@link #beginFrame(SwapChain)}, paced on the display's vsync.
+     * @param frameTimeNanos The vsync time given to Choreographer.FrameCallback.doFrame()
+     */
+    public boolean beginFrame(@NonNull SwapChain swapChain, long frameTimeNanos) {
+        return nBeginFrameVsync(getNativeObject(), swapChain.getNativeObject(), frameTimeNanos);
+    }
+
     public void endFrame() {
         nEndFrame(getNativeObject());
     }
@@ -86,6 +94,7 @@ public class Renderer {
     }
 
     private static native boolean nBeginFrame(long nativeRenderer, long nativeSwapChain);
+    private static native boolean nBeginFrameVsync(long nativeRenderer, long nativeSwapChain, long frameTimeNanos);
     private static native void nEndFrame(long nativeRenderer);
     private static native void nRender(long nativeRenderer, long nativeView);
     private static native int nReadPixels(long nativeRenderer, long nativeEngine,
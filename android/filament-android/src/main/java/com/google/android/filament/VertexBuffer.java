@@ -151,6 +151,11 @@ public class VertexBuffer {
     }
 
     /**
+     * Direct buffers are used in place, without a copy: the buffer must not be modified until
+     * the callback is invoked, at which point it can be reused. Other buffers are pinned or
+     * copied by the VM.
+     *
+     * The callback is posted to the handler, it can be used to recycle pooled buffers.
      * Valid handler types:
      * - Android: Handler, Executor
      * - Other: Executor
@@ -35,6 +35,7 @@ public class View {
     public static class DynamicResolutionOptions {
         public boolean enabled = false;
         public boolean homogeneousScaling = false;
+        public boolean temporalUpscaling = false;
         public float targetFrameTimeMilli = 1000.0f / 60.0f;
         public float headRoomRatio = 0.0f;
         public float scaleRate = 0.125f;
@@ -153,6 +154,7 @@ public class View {
         nSetDynamicResolutionOptions(getNativeObject(),
                 options.enabled,
                 options.homogeneousScaling,
+                options.temporalUpscaling,
                 options.targetFrameTimeMilli,
                 options.headRoomRatio,
                 options.scaleRate,
@@ -183,6 +185,14 @@ public class View {
         nSetDynamicLightingOptions(getNativeObject(), zLightNear, zLightFar);
     }
 
+    public void setDynamicLightingFroxelCount(int froxelCount) {
+        nSetDynamicLightingFroxelCount(getNativeObject(), froxelCount);
+    }
+
+    public void setDynamicLightingMaxLightCount(int maxLightCount) {
+        nSetDynamicLightingMaxLightCount(getNativeObject(), maxLightCount);
+    }
+
     long getNativeObject() {
         if (mNativeObject == 0) {
             throw new IllegalStateException("Calling method on destroyed View");
@@ -217,9 +227,11 @@ public class View {
     private static native void nSetAntiAliasing(long nativeView, int type);
     private static native int nGetAntiAliasing(long nativeView);
     private static native void nSetDynamicResolutionOptions(long nativeView,
-            boolean enabled, boolean homogeneousScaling,
+            boolean enabled, boolean homogeneousScaling, boolean temporalUpscaling,
             float targetFrameTimeMilli, float headRoomRatio, float scaleRate,
             float minScale, float maxScale, int history);
     private static native void nSetDynamicLightingOptions(long nativeView, float zLightNear, float zLightFar);
+    private static native void nSetDynamicLightingFroxelCount(long nativeView, int froxelCount);
+    private static native void nSetDynamicLightingMaxLightCount(long nativeView, int maxLightCount);
     private static native void nSetDepthPrepass(long nativeView, int value);
 }
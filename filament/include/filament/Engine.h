@@ -22,10 +22,15 @@
 #include <filament/SwapChain.h>
 
 #include <filament/driver/ExternalContext.h>
+#include <filament/driver/ProgramCache.h>
 
 #include <utils/compiler.h>
 #include <utils/EntityManager.h>
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filament {
 
 class Camera;
@@ -35,6 +40,7 @@ class IndexBuffer;
 class IndirectLight;
 class Material;
 class MaterialInstance;
+class MorphTargetBuffer;
 class Renderer;
 class Scene;
 class Skybox;
@@ -44,6 +50,7 @@ class VertexBuffer;
 class View;
 
 class LightManager;
+class ParticleManager;
 class RenderableManager;
 class TransformManager;
 
@@ -143,8 +150,167 @@ class TransformManager;
 class UTILS_PUBLIC Engine {
 public:
     using ExternalContext = driver::ExternalContext;
+    using ProgramCache = driver::ProgramCache;
     using Backend = driver::Backend;
 
+    /**
+     * Sizes of the command buffer, which holds the commands sent by the main thread to the
+     * render thread.
+     *
+     * @see Engine::create(), Engine::getCommandBufferStats()
+     */
+    struct CommandBufferOptions {
+        /**
+         * Space guaranteed to be available for the commands of a frame, in bytes. The main thread
+         * blocks at the end of a frame until that much space is available. This can't be lower
+         * than the default 1 MiB.
+         */
+        size_t minCommandBufferSize = 1 * 1024 * 1024;
+
+        /**
+         * Size of the command buffer, in bytes. It must be at least twice minCommandBufferSize,
+         * three times is recommended so the main thread can run ahead of the render thread.
+         */
+        size_t commandBufferSize = 3 * 1024 * 1024;
+
+        /**
+         * When larger than commandBufferSize, the command buffer is allowed to grow up to this
+         * size between two frames, if the main thread blocked several frames in a row.
+         */
+        size_t maxCommandBufferSize = 0;
+    };
+
+    /**
+     * How the render thread and the JobSystem worker threads are placed on the CPU cores.
+     *
+     * The cores are grouped in clusters of identical maximum frequency (e.g. big.LITTLE on
+     * Android). When all the cores are the same, the threads are never pinned.
+     *
+     * @see Engine::create()
+     */
+    enum class ThreadPolicy : uint8_t {
+        /**
+         * The render thread is pinned to the fastest cores. The worker threads aren't pinned.
+         */
+        DEFAULT,
+
+        /**
+         * The render thread is pinned to the fastest cores and the worker threads to all the
+         * cores but the slowest ones, there are as many worker threads as these cores minus one.
+         * This keeps the engine off the little cores, at the expense of power.
+         */
+        BIG_CORES,
+
+        /**
+         * No thread is pinned, the OS scheduler decides.
+         */
+        UNPINNED
+    };
+
+    /**
+     * Statistics about the command buffer.
+     *
+     * @see Engine::getCommandBufferStats()
+     */
+    struct CommandBufferStats {
+        size_t size = 0;                //!< current size of the command buffer, in bytes
+        size_t highWatermark = 0;       //!< most space used by the commands in flight, in bytes
+        uint64_t stallDuration = 0;     //!< total time the main thread blocked, in nanoseconds
+        uint32_t stallCount = 0;        //!< number of times the main thread blocked
+        uint32_t growthCount = 0;       //!< number of times the command buffer grew
+        uint64_t flushedSize = 0;       //!< total size of the commands flushed, in bytes
+    };
+
+    /**
+     * State changes of the last frame executed by the backend, by kind. Each change requested by
+     * the renderer is either issued to the graphics API, or filtered because that state was
+     * already set.
+     *
+     * @see Engine::getDriverStateStats()
+     */
+    struct DriverStateStats {
+        struct Counter {
+            uint32_t issued = 0;        //!< changes that reached the graphics API
+            uint32_t filtered = 0;      //!< redundant changes that were skipped
+        };
+        Counter programs;               //!< program bindings
+        Counter textures;               //!< texture bindings and active texture unit
+        Counter samplers;               //!< sampler bindings
+        Counter uniformBuffers;         //!< uniform buffer bindings
+        Counter buffers;                //!< all other buffer bindings
+        Counter framebuffers;           //!< framebuffer bindings
+        Counter vertexArrays;           //!< vertex array bindings and attribute arrays
+        Counter rasterState;            //!< raster state and enabled capabilities
+        Counter other;                  //!< viewport, scissor and clear values
+    };
+
+    /**
+     * Usage of one of the Engine's memory arenas since the Engine was created. These are
+     * tracked in release builds too, so the arenas can be sized from real workloads.
+     *
+     * @see Engine::getMemoryStats()
+     */
+    struct ArenaStats {
+        size_t size = 0;                //!< size of the arena, in bytes
+        size_t highWatermark = 0;       //!< most memory in use at once, in bytes
+        uint32_t allocationCount = 0;   //!< number of successful allocations
+        uint32_t overflowCount = 0;     //!< number of allocations that failed, the arena was full
+    };
+
+    /**
+     * GPU memory used by the backend for one category of resources, in bytes.
+     *
+     * @see Engine::getMemoryStats()
+     */
+    struct GpuMemoryCounter {
+        size_t size = 0;                //!< memory currently allocated
+        size_t peak = 0;                //!< most memory allocated at once
+    };
+
+    /**
+     * GPU memory used by the backend, by category. The sizes are computed from the dimensions
+     * and formats of the resources rather than queried from the GPU: compressed textures are
+     * counted as 1 byte per texel, and the alignment and padding of the allocations are ignored.
+     *
+     * @see Engine::getMemoryStats()
+     */
+    struct GpuMemoryStats {
+        GpuMemoryCounter textures;          //!< textures that are only sampled
+        GpuMemoryCounter renderTargets;     //!< attachments, textures or renderbuffers
+        GpuMemoryCounter vertexBuffers;
+        GpuMemoryCounter indexBuffers;
+        GpuMemoryCounter uniformBuffers;
+        GpuMemoryCounter storageBuffers;    //!< buffers read and written by compute programs
+        GpuMemoryCounter staging;           //!< upload buffers, only used by the Vulkan backend
+        GpuMemoryCounter renderTargetPool;  //!< post-process targets, part of renderTargets
+        size_t total = 0;                   //!< all the categories, except renderTargetPool
+        size_t peak = 0;                    //!< most memory allocated at once, in total
+    };
+
+    /**
+     * Usage of the Engine's memory arenas, and of the GPU memory.
+     *
+     * @see Engine::getMemoryStats()
+     */
+    struct MemoryStats {
+        ArenaStats perRenderPass;       //!< per frame data of the renderers
+        ArenaStats commands;            //!< draw commands of a frame, one allocation per frame
+        ArenaStats handles;             //!< backend objects, only tracked by the OpenGL backend
+        GpuMemoryStats gpu;             //!< only renderTargetPool with the NOOP backend
+    };
+
+    /**
+     * Time spent creating the Engine, in nanoseconds.
+     *
+     * @see Engine::getStartupStats()
+     */
+    struct StartupStats {
+        uint64_t driver = 0;            //!< creating the backend and its context
+        uint64_t resources = 0;         //!< creating the built-in buffers, textures and programs
+        uint64_t defaultMaterial = 0;   //!< creating the default material
+        uint64_t total = 0;             //!< all of Engine::create()
+    };
+
     /**
      * Creates an instance of Engine
      *
@@ -165,7 +331,30 @@ public:
      *                          when creating filament's internal context.
      *                          Setting this parameter will force filament to use the OpenGL
      *                          implementation (instead of Vulkaan for instance).
+     *                          On the web, with threads, this is instead the CSS selector
+     *                          of the canvas (a const char*), the WebGL context is created by
+     *                          the driver thread ("#canvas" when null).
      *
+     * @param commandBufferOptions  Sizes of the command buffer, or nullptr to use the default
+     *                              CommandBufferOptions.
+     *
+     * @param threadPolicy      How the render thread and the worker threads are placed on the
+     *                          CPU cores, see ThreadPolicy.
+     *
+     * @param jobSystem         A JobSystem to share with other Engines, or nullptr for the
+     *                          Engine to create its own. Sharing a JobSystem avoids a set of
+     *                          worker threads per Engine when a process hosts many of them.
+     *                          The worker threads of a shared JobSystem aren't affected by
+     *                          \p threadPolicy.
+     *
+     *                          The calling thread is adopted by \p jobSystem, which must have
+     *                          room for it (see utils::JobSystem's adoptableThreadsCount), and
+     *                          it isn't emancipated when the Engine is destroyed.
+     *                          Engines sharing a JobSystem must be rendered one at a time, from
+     *                          threads adopted by it.
+     *
+     *                          The lifetime of \p jobSystem must exceed the life time of
+     *                          the Engine object.
      *
      * @return A pointer to the newly created Engine, or nullptr if the Engine couldn't be created.
      *
@@ -180,7 +369,10 @@ public:
      * This method is thread-safe.
      */
     static Engine* create(Backend backend = Backend::DEFAULT,
-            ExternalContext* externalContext = nullptr, void* sharedGLContext = nullptr);
+            ExternalContext* externalContext = nullptr, void* sharedGLContext = nullptr,
+            CommandBufferOptions const* commandBufferOptions = nullptr,
+            ThreadPolicy threadPolicy = ThreadPolicy::DEFAULT,
+            utils::JobSystem* jobSystem = nullptr);
 
     /**
      * Destroy the Engine instance and all associated resources.
@@ -216,6 +408,21 @@ public:
 
     TransformManager& getTransformManager() noexcept;
 
+    /**
+     * The manager of the GPU particle emitters. Particles require compute programs, i.e.
+     * OpenGL ES 3.1, OpenGL 4.3 or Vulkan.
+     */
+    ParticleManager& getParticleManager() noexcept;
+
+    /**
+     * The JobSystem of the Engine, which applications can use for their own parallel work.
+     *
+     * Jobs must be run and waited on from a thread adopted by it, such as the thread that
+     * created the Engine. They share the worker threads with the rendering, so long running
+     * work shouldn't be scheduled while frames are being rendered.
+     */
+    utils::JobSystem& getJobSystem() noexcept;
+
     /**
      * Creates a SwapChain from the given Operating System's native window handle.
      *
@@ -229,6 +436,22 @@ public:
      */
     SwapChain* createSwapChain(void* nativeWindow, uint64_t flags = 0) noexcept;
 
+    /**
+     * Creates a headless SwapChain, i.e. an offscreen surface that isn't tied to a window.
+     * This is meant for rendering on servers, the frames are retrieved with
+     * Renderer::readPixels(), which doesn't stall the pipeline.
+     *
+     * @param width  Width of the surface in pixels.
+     * @param height Height of the surface in pixels.
+     * @param flags One or more configuration flags as defined in `SwapChain`.
+     *
+     * @return A pointer to the newly created SwapChain or nullptr if it couldn't be created.
+     *         This is not supported with the Vulkan backend.
+     *
+     * @see Renderer.beginFrame()
+     */
+    SwapChain* createSwapChain(uint32_t width, uint32_t height, uint64_t flags = 0) noexcept;
+
     /**
      * Creates a renderer associated to this engine.
      *
@@ -273,6 +496,7 @@ public:
     void destroy(const Fence* p);               //!< Destroys a Fence object.
     void destroy(const IndexBuffer* p);         //!< Destroys an IndexBuffer object.
     void destroy(const IndirectLight* p);       //!< Destroys an IndirectLight object.
+    void destroy(const MorphTargetBuffer* p);   //!< Destroys a MorphTargetBuffer object.
 
     /**
      * Destroys a Material object
@@ -293,6 +517,75 @@ public:
     void destroy(const View* p);                //!< Destroys a View object.
     void destroy(utils::Entity e);              //!< Destroys all filament-known components from this entity
 
+    /**
+     * Destroys several VertexBuffer, IndexBuffer or Texture objects at once. This is equivalent
+     * to calling destroy() for each object, but the commands in flight are only waited for once.
+     *
+     * @param p     array of objects to destroy, it can contain nullptr
+     * @param count number of objects in the array
+     */
+    void destroy(const VertexBuffer* const* p, size_t count);
+    void destroy(const IndexBuffer* const* p, size_t count);   //!< \copydoc destroy(const VertexBuffer* const*, size_t)
+    void destroy(const Texture* const* p, size_t count);       //!< \copydoc destroy(const VertexBuffer* const*, size_t)
+
+    /**
+     * Destroys all filament-known components of several entities.
+     *
+     * @param entities  array of entities
+     * @param count     number of entities in the array
+     */
+    void destroy(utils::Entity const* entities, size_t count);
+
+    /**
+     * Schedules the destruction of all filament-known components of several entities, e.g. when
+     * unloading a level, to spread the cost over several frames: the components are destroyed at
+     * the beginning of the next frames (see Renderer::beginFrame()), within the budget set by
+     * setDeferredDestroyBudget().
+     *
+     * @param entities  array of entities
+     * @param count     number of entities in the array
+     *
+     * @attention The entities must not be given filament components until they're destroyed. Their
+     *            renderables should be removed from the Scenes right away.
+     */
+    void destroyDeferred(utils::Entity const* entities, size_t count);
+
+    /**
+     * Sets the time spent destroying the entities scheduled by destroyDeferred(), per frame.
+     *
+     * @param budget    duration in nanoseconds, the default is 1 ms. At least a few entities are
+     *                  destroyed each frame, whatever the budget.
+     */
+    void setDeferredDestroyBudget(uint64_t budget) noexcept;
+
+    /**
+     * Sets the memory budget of the streaming textures, see Texture::Builder::streaming().
+     * When the levels needed by the visible renderables exceed the budget, the least recently
+     * drawn textures are requested coarser levels first, and their finer levels are evicted.
+     *
+     * @param budget    in bytes, 0 (the default) means no limit. The size of the textures
+     *                  using compressed formats is estimated at one byte per texel.
+     */
+    void setTextureStreamingBudget(size_t budget) noexcept;
+
+    /**
+     * Sets the cache of compiled shader programs, so they don't have to be compiled again the
+     * next time the application runs, which avoids hitches the first time a material variant is
+     * needed.
+     *
+     * Only the programs created after this call are cached, it should be called right after
+     * Engine::create(). This is ignored if the backend doesn't support it.
+     *
+     * With the Vulkan backend, the cache holds the pipeline cache under a single key per GPU. It
+     * is saved once no new pipeline was needed for a few frames, and when the Engine is destroyed.
+     *
+     * @param cache     the cache, or nullptr to stop using it. Its methods are called from the
+     *                  render thread. It must outlive the Engine.
+     *
+     * @see ProgramCache
+     */
+    void setProgramCache(ProgramCache* cache) noexcept;
+
     /**
      * Returns the default Material.
      *
@@ -337,6 +630,39 @@ public:
 
     DebugRegistry& getDebugRegistry() noexcept;
 
+    /**
+     * Returns statistics about the command buffer since the Engine was created. The main thread
+     * blocking (stallCount) means the render thread can't keep up, or that the command buffer
+     * is too small for the commands of a frame, see CommandBufferOptions.
+     */
+    CommandBufferStats getCommandBufferStats() const noexcept;
+
+    /**
+     * Returns the state changes of the last frame executed by the backend. This can be used to
+     * measure how effective the render order is at avoiding expensive state changes, e.g. with
+     * the "d.renderpass.state_sorting" debug property.
+     *
+     * @param stats Filled with the state changes of the last frame.
+     * @return false if the backend doesn't filter redundant state changes (currently only the
+     *         OpenGL backend does), in which case \p stats is left untouched.
+     */
+    bool getDriverStateStats(DriverStateStats* stats) noexcept;
+
+    /**
+     * Returns the usage of the Engine's memory arenas since it was created. A high watermark
+     * close to the size of an arena, or any overflow, means the arena is too small for the
+     * content. The handles are only tracked by the OpenGL backend, they're left empty otherwise.
+     * This must be called from the thread that renders, between frames.
+     */
+    MemoryStats getMemoryStats() noexcept;
+
+    /**
+     * Returns how long the creation of the Engine took, broken down by step. The post-process
+     * shaders are parsed in the background while the other resources are created, and the
+     * default material's depth programs are still being built when Engine::create() returns.
+     */
+    StartupStats getStartupStats() const noexcept;
+
 protected:
     //! \privatesection
     Engine() noexcept = default;
@@ -21,6 +21,8 @@
 
 #include <filament/FilamentAPI.h>
 
+#include <filament/driver/PixelBufferDescriptor.h>
+
 #include <utils/compiler.h>
 
 #include <math/mat4.h>
@@ -224,6 +226,64 @@ public:
      * @param rotation 3x3 rotation matrix. Must be a rigid-body transform.
      */
     void setRotation(math::mat3f const& rotation) noexcept;
+
+    /**
+     * Prefilters an environment into a reflections cubemap, on the GPU.
+     *
+     * This is the same GGX importance sampling that **cmgen** does offline, each face of each
+     * level of \p reflections is rendered by a full screen pass. The result can be passed to
+     * Builder::reflections().
+     *
+     * @param engine        Engine used to run the passes.
+     * @param environment   Cubemap of the linear HDR environment, in a floating point format and
+     *                      with a full mipmap chain (see Texture::generateMipmaps()).
+     * @param reflections   Cubemap receiving the prefiltered levels. It must be created with
+     *                      Texture::Usage::COLOR_ATTACHMENT and, like the output of **cmgen**,
+     *                      be 256x256 with 9 levels in `RGBA8` (`RGBM` encoded).
+     * @param sampleCount   Number of samples used for the first two levels, it doubles with
+     *                      each following level.
+     *
+     * @attention
+     * The passes are recorded in the engine's command stream like a frame's. On backends that
+     * can only render within a frame (Vulkan), this must be called between
+     * Renderer::beginFrame() and Renderer::endFrame().
+     */
+    static void prefilterReflections(Engine& engine, Texture const* environment,
+            Texture* reflections, uint32_t sampleCount = 64) noexcept;
+
+    /**
+     * Computes the irradiance of an environment as 3 bands of Spherical Harmonics, on the GPU.
+     *
+     * This is the same computation as `cmgen --sh-shader`. The coefficients are
+     * pre-convolved and pre-scaled as expected by Builder::irradiance().
+     *
+     * @param engine        Engine used to run the passes.
+     * @param environment   Cubemap of the linear HDR environment, see prefilterReflections().
+     * @param sh            Buffer receiving the 9 coefficients as a 9x1 image, it must be
+     *                      `Format::RGBA` and `Type::FLOAT`. The rgb components of each texel
+     *                      are a coefficient. The buffer's callback is invoked once it's filled.
+     *
+     * @attention
+     * See prefilterReflections().
+     */
+    static void computeIrradianceSH(Engine& engine, Texture const* environment,
+            driver::PixelBufferDescriptor&& sh) noexcept;
+
+    /**
+     * Generates the DFG lookup table used by the image based lighting, on the GPU.
+     *
+     * This is the same computation as `cmgen --ibl-dfg-multiscatter`, x is NoV and y
+     * the roughness.
+     *
+     * @param engine        Engine used to run the pass.
+     * @param dfg           2D texture receiving the table. It must be created with
+     *                      Texture::Usage::COLOR_ATTACHMENT, typically in `RG16F`.
+     * @param sampleCount   Number of samples per texel.
+     *
+     * @attention
+     * See prefilterReflections().
+     */
+    static void generateDFG(Engine& engine, Texture* dfg, uint32_t sampleCount = 1024) noexcept;
 };
 
 } // namespace filament
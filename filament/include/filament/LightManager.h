@@ -178,7 +178,9 @@ public:
      * Control the quality / performance of the shadow map associated to this light
      */
     struct ShadowOptions {
-        /** size of the shadow map in texels. Must be a power-of-two. */
+        /** size of the shadow map in texels. Must be a power-of-two.
+         * With adaptiveMapSize, this is the largest size of the shadow map.
+         */
         uint32_t mapSize = 1024;
 
         /** constant bias in world units (e.g. meters) by which shadow are moved away from the
@@ -212,6 +214,43 @@ public:
          * use the camera far distance.
          */
         float shadowFarHint = 100.0f;
+
+        /** Number of shadow cascades to use for this light. Must be between 1 and 4 (inclusive).
+         * A value greater than 1 turns on cascaded shadow mapping (CSM), the shadows close to
+         * the camera are then rendered in their own shadow map, at a higher resolution.
+         * Only applicable to Type.SUN or Type.DIRECTIONAL lights.
+         *
+         * The shadow maps of all cascades are stored side by side in a single texture of
+         * mapSize * shadowCascades by mapSize texels. The far cascades are updated every
+         * other frame.
+         */
+        uint8_t shadowCascades = 1;
+
+        /** The split positions of the shadow cascades, as fractions of the distance between the
+         * camera near plane and shadowFar (or the camera far plane). Only the first
+         * shadowCascades - 1 values are used, they must be increasing and between 0 and 1
+         * (exclusive).
+         */
+        float cascadeSplitPositions[3] = { 0.125f, 0.25f, 0.50f };
+
+        /** Whether the depth of the static shadow casters is kept from one frame to the next.
+         * Only the casters flagged with RenderableManager::Builder::dynamicShadowCaster() are
+         * then rendered each frame, on top of a copy of the cached static casters.
+         * The cache is reused as long as the light direction doesn't change, the cached light
+         * frustum still covers the visible shadow receivers at a similar resolution, and the
+         * static casters don't change. Only applicable to Type.SUN or Type.DIRECTIONAL lights,
+         * requires the OpenGL backend.
+         */
+        bool cacheStaticCasters = false;
+
+        /** Whether the size of the shadow map is picked each frame, as the smallest power of
+         * two (between 256 and mapSize) at which a texel covers about a pixel of the closest
+         * visible shadow receivers. Far shadows, or a view downscaled by the dynamic
+         * resolution, then render smaller shadow maps. The shadow maps of the different sizes
+         * are kept in a pool, a smaller size is only picked after being enough for a few
+         * frames. Only applicable to Type.SUN or Type.DIRECTIONAL lights.
+         */
+        bool adaptiveMapSize = false;
     };
 
     //! Use Builder to construct a Light object instance
@@ -238,7 +277,13 @@ public:
          * @return This Builder, for chaining calls.
          *
          * @warning
-         * - Only a Type.DIRECTIONAL or Type.SUN light can cast shadows
+         * - Only a Type.DIRECTIONAL, Type.SUN or Type.SPOT light can cast shadows, point
+         *   lights don't cast shadows yet.
+         * - Spot lights only cast shadows when the scene also has a directional light.
+         * - The shadow maps of the spot lights share a 2048x2048 atlas, each one is given
+         *   a part of it depending on how much of the screen the light covers, up to
+         *   ShadowOptions::mapSize texels. Only the 16 spot lights covering most of the screen
+         *   cast shadows, and only when their outer cone angle is at most 160 degrees.
          */
         Builder& castShadows(bool enable) noexcept;
 
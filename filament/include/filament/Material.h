@@ -77,6 +77,18 @@ public:
         Precision precision;
     };
 
+    /**
+     * Features passed to compile(). A material has a variant for each combination of them.
+     */
+    struct VariantFeatures {
+        static constexpr uint8_t DIRECTIONAL_LIGHTING  = 0x01;  //!< the scene has a sun
+        static constexpr uint8_t DYNAMIC_LIGHTING      = 0x02;  //!< point or spot lights
+        static constexpr uint8_t SHADOW_RECEIVER       = 0x04;  //!< renderables receive shadows
+        static constexpr uint8_t SKINNING              = 0x08;  //!< skinned renderables
+        static constexpr uint8_t MORPHING              = 0x10;  //!< renderables with morph targets
+        static constexpr uint8_t ALL                   = 0x1F;
+    };
+
     class Builder : public BuilderBase<BuilderDetails> {
         friend struct BuilderDetails;
     public:
@@ -91,6 +103,13 @@ public:
         // The RAM must stay valid until build() is called.
         Builder& package(const void* payload, size_t size);
 
+        // Same as package(), but the Material references the RAM instead of copying it, so the
+        // RAM must stay valid until the Material is destroyed. This is intended for packages in
+        // memory-mapped files: only the parts of the package that are used (e.g. the shaders
+        // of the variants that are drawn) are ever read, and the pages of a file mapped
+        // read-only are shared by all the processes mapping it.
+        Builder& externalPackage(const void* payload, size_t size);
+
         /**
          * Creates the Material object and returns a pointer to it.
          *
@@ -110,6 +129,18 @@ public:
 
     MaterialInstance* createInstance() const noexcept;
 
+    /**
+     * Creates the shader programs of this material ahead of time, e.g. while a loading screen is
+     * displayed, instead of the first time each variant is drawn.
+     *
+     * The programs are compiled by the driver thread as soon as it processes the commands of the
+     * current frame. The variants filtered out when the material was built are skipped.
+     *
+     * @param features  the VariantFeatures the material can be drawn with, all their
+     *                  combinations are compiled. The depth variants are always compiled.
+     */
+    void compile(uint8_t features = VariantFeatures::ALL) noexcept;
+
     const char* getName() const noexcept;
     Shading getShading()  const noexcept;
     Interpolation getInterpolation() const noexcept;
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_MORPHTARGETBUFFER_H
+#define TNT_FILAMENT_MORPHTARGETBUFFER_H
+
+#include <filament/FilamentAPI.h>
+
+#include <utils/compiler.h>
+
+#include <math/vec3.h>
+
+#include <stddef.h>
+
+namespace filament {
+
+namespace details {
+class FMorphTargetBuffer;
+} // namespace details
+
+class Engine;
+
+/**
+ * MorphTargetBuffer holds the position and normal deltas of a set of morph targets, they're
+ * blended on the GPU with the weights set by RenderableManager::setMorphWeights().
+ *
+ * The deltas are indexed by vertex, so a MorphTargetBuffer can only be used by renderables
+ * whose primitives don't share vertices of a VertexBuffer with a different layout.
+ *
+ * @see RenderableManager::Builder::morphing()
+ */
+class UTILS_PUBLIC MorphTargetBuffer : public FilamentAPI {
+    struct BuilderDetails;
+
+public:
+    class Builder : public BuilderBase<BuilderDetails> {
+        friend struct BuilderDetails;
+    public:
+        Builder() noexcept;
+        Builder(Builder const& rhs) noexcept;
+        Builder(Builder&& rhs) noexcept;
+        ~Builder() noexcept;
+        Builder& operator=(Builder const& rhs) noexcept;
+        Builder& operator=(Builder&& rhs) noexcept;
+
+        /**
+         * Number of vertices of each morph target, this must match the vertex count of the
+         * VertexBuffer it's used with.
+         */
+        Builder& vertexCount(size_t vertexCount) noexcept;
+
+        /**
+         * Number of morph targets, at most CONFIG_MAX_MORPH_TARGET_COUNT.
+         */
+        Builder& count(size_t count) noexcept;
+
+        /**
+         * Creates the MorphTargetBuffer object and returns a pointer to it.
+         *
+         * @param engine Reference to the filament::Engine to associate this MorphTargetBuffer
+         *               with.
+         *
+         * @return pointer to the newly created object or nullptr if exceptions are disabled and
+         *         an error occured.
+         *
+         * @exception utils::PostConditionPanic if a runtime error occured, such as running out of
+         *            memory or other resources.
+         * @exception utils::PreConditionPanic if a parameter to a builder function was invalid.
+         */
+        MorphTargetBuffer* build(Engine& engine);
+    private:
+        friend class details::FMorphTargetBuffer;
+    };
+
+    /**
+     * Sets the position deltas of a morph target, the data is copied.
+     *
+     * @param engine      Reference to the filament::Engine this MorphTargetBuffer belongs to.
+     * @param targetIndex Index of the morph target, must be < getCount().
+     * @param positions   Position deltas, one per vertex.
+     * @param count       Number of deltas in positions, at most getVertexCount().
+     */
+    void setPositionsAt(Engine& engine, size_t targetIndex,
+            math::float3 const* positions, size_t count);
+
+    /**
+     * Sets the normal deltas of a morph target, the data is copied.
+     *
+     * @param engine      Reference to the filament::Engine this MorphTargetBuffer belongs to.
+     * @param targetIndex Index of the morph target, must be < getCount().
+     * @param normals     Normal deltas, one per vertex.
+     * @param count       Number of deltas in normals, at most getVertexCount().
+     */
+    void setNormalsAt(Engine& engine, size_t targetIndex,
+            math::float3 const* normals, size_t count);
+
+    size_t getVertexCount() const noexcept;
+
+    size_t getCount() const noexcept;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_MORPHTARGETBUFFER_H
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_PARTICLEMANAGER_H
+#define TNT_FILAMENT_PARTICLEMANAGER_H
+
+#include <filament/Box.h>
+#include <filament/Color.h>
+#include <filament/FilamentAPI.h>
+
+#include <utils/compiler.h>
+#include <utils/Entity.h>
+#include <utils/EntityInstance.h>
+
+#include <math/vec2.h>
+#include <math/vec3.h>
+
+namespace filament {
+
+class Engine;
+class MaterialInstance;
+
+namespace details {
+class FEngine;
+class FParticleManager;
+} // namespace details
+
+/**
+ * ParticleManager allows to create a particle emitter component, which emits, simulates and
+ * draws its particles entirely on the GPU.
+ *
+ * The particles are emitted at the origin of the entity's transform, in a cone around a
+ * direction, and are then simulated in world space. Each frame, only the parameters of the
+ * emitters are uploaded: the simulation, the sorting of the particles and the quads facing the
+ * camera are computed by compute programs.
+ *
+ * An emitter is also a Renderable: its entity gets a Renderable component with a single
+ * primitive, which draws the quads of the particles with the given MaterialInstance. The quads
+ * have these vertex attributes:
+ *
+ * - POSITION, in the space of the entity
+ * - TANGENTS, the normal faces the camera
+ * - COLOR, interpolated between the start and end colors over the life of the particle
+ * - UV0, the corners of the quad, from 0 to 1
+ * - UV1, x is the age of the particle divided by its lifetime, y a random value in [0, 1)
+ *
+ * The material must require the attributes it uses. Blended materials should use sorted
+ * emitters, whose particles are drawn from back to front.
+ *
+ * ~~~~~~~~~~~{.cpp}
+ *  utils::Entity smoke = utils::EntityManager::get().create();
+ *  filament::ParticleManager::Builder(1000)
+ *          .material(smokeMaterialInstance)
+ *          .boundingBox({{ 0, 5, 0 }, { 5, 5, 5 }})
+ *          .emissionRate(200)
+ *          .lifetime(3, 5)
+ *          .direction({ 0, 1, 0 }, 0.3f)
+ *          .speed(1, 2)
+ *          .size(0.2f, 1.0f)
+ *          .color({ 1, 1, 1, 0.5f }, { 1, 1, 1, 0 })
+ *          .sorted(true)
+ *          .build(*engine, smoke);
+ *  scene->addEntity(smoke);
+ *
+ *  // each frame, before Renderer::beginFrame()
+ *  engine->getParticleManager().advance(deltaTime);
+ * ~~~~~~~~~~~
+ *
+ * @warning Particles require compute programs, i.e. OpenGL ES 3.1, OpenGL 4.3 or Vulkan.
+ *          Builder::build() fails otherwise.
+ */
+class UTILS_PUBLIC ParticleManager : public FilamentAPI {
+    struct BuilderDetails;
+
+public:
+    using Instance = utils::EntityInstance<ParticleManager>;
+
+    //! The maximum number of particles of a sorted emitter.
+    static constexpr size_t MAX_SORTED_PARTICLE_COUNT = 4096;
+
+    /**
+     * Returns whether a particular Entity is associated with a component of this ParticleManager
+     * @param e An Entity.
+     * @return true if this Entity has a component associated with this manager.
+     */
+    bool hasComponent(utils::Entity e) const noexcept;
+
+    /**
+     * Gets an Instance representing the particle emitter component associated with the given
+     * Entity.
+     * @param e An Entity.
+     * @return An Instance object, which represents the component associated with the Entity e.
+     * @note Use Instance::isValid() to make sure the component exists.
+     * @see hasComponent()
+     */
+    Instance getInstance(utils::Entity e) const noexcept;
+
+    /**
+     * Destroys the particle emitter component of the given entity, along with its Renderable
+     * component.
+     */
+    void destroy(utils::Entity e) noexcept;
+
+    //! Use Builder to construct a particle emitter
+    class Builder : public BuilderBase<BuilderDetails> {
+        friend struct BuilderDetails;
+    public:
+        enum Result { Error = -1, Success = 0  };
+
+        /**
+         * Creates a builder for an emitter of at most maxParticleCount live particles. When
+         * more particles are emitted, the oldest ones are replaced.
+         */
+        explicit Builder(size_t maxParticleCount) noexcept;
+        Builder(Builder const& rhs) noexcept;
+        Builder(Builder&& rhs) noexcept;
+        ~Builder() noexcept;
+        Builder& operator=(Builder const& rhs) noexcept;
+        Builder& operator=(Builder&& rhs) noexcept;
+
+        //! The material instance the particles are drawn with, this is required.
+        Builder& material(MaterialInstance const* materialInstance) noexcept;
+
+        /**
+         * The bounding box of the particles, in the space of the entity, which is used for
+         * culling. The particles are simulated in world space, so the box must cover them for
+         * all the positions of the emitter.
+         */
+        Builder& boundingBox(const Box& aabb) noexcept;
+
+        //! The number of particles emitted per second, 0 by default.
+        Builder& emissionRate(float particlesPerSecond) noexcept;
+
+        //! The range the lifetime of each particle is picked from, in seconds.
+        Builder& lifetime(float min, float max) noexcept;
+
+        /**
+         * The direction of the emitted particles, in the space of the entity, and the half
+         * angle of the cone around it in radians. The default is up, with no spread.
+         */
+        Builder& direction(math::float3 const& direction, float spreadAngle) noexcept;
+
+        //! The range the initial speed of each particle is picked from, in world units per second.
+        Builder& speed(float min, float max) noexcept;
+
+        //! The acceleration of all the particles in world space, e.g. the gravity.
+        Builder& acceleration(math::float3 const& acceleration) noexcept;
+
+        //! The fraction of the velocity of the particles lost per second, 0 by default.
+        Builder& drag(float drag) noexcept;
+
+        //! The size of the quads, at the birth and the death of the particles.
+        Builder& size(float start, float end) noexcept;
+
+        //! The color of the particles, at their birth and their death.
+        Builder& color(LinearColorA const& start, LinearColorA const& end) noexcept;
+
+        /**
+         * Whether the particles are drawn from back to front, which blended materials need.
+         * A sorted emitter can't have more than MAX_SORTED_PARTICLE_COUNT particles.
+         */
+        Builder& sorted(bool enable) noexcept;
+
+        //! Whether the particles cast shadows, false by default.
+        Builder& castShadows(bool enable) noexcept;
+
+        //! Whether the particles receive shadows, false by default.
+        Builder& receiveShadows(bool enable) noexcept;
+
+        /**
+         * Adds a particle emitter and a Renderable component to the entity, replacing the
+         * existing ones. Fails if the backend can't run compute programs.
+         */
+        Result build(Engine& engine, utils::Entity entity);
+
+    private:
+        friend class details::FEngine;
+        friend class details::FParticleManager;
+    };
+
+    /**
+     * Advances the simulation of all the emitters by deltaTime seconds, the simulation runs at
+     * the next Renderer::beginFrame(). The particles don't move when this isn't called.
+     */
+    void advance(float deltaTime) noexcept;
+
+    //! Emits count particles at the next simulation, on top of the emission rate.
+    void emit(Instance i, size_t count) noexcept;
+
+    void setEmissionRate(Instance i, float particlesPerSecond) noexcept;
+    void setLifetime(Instance i, float min, float max) noexcept;
+    void setDirection(Instance i, math::float3 const& direction, float spreadAngle) noexcept;
+    void setSpeed(Instance i, float min, float max) noexcept;
+    void setAcceleration(Instance i, math::float3 const& acceleration) noexcept;
+    void setDrag(Instance i, float drag) noexcept;
+    void setSize(Instance i, float start, float end) noexcept;
+    void setColor(Instance i, LinearColorA const& start, LinearColorA const& end) noexcept;
+
+    size_t getMaxParticleCount(Instance i) const noexcept;
+    float getEmissionRate(Instance i) const noexcept;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_PARTICLEMANAGER_H
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//! \file QualityGovernor.h
+
+#ifndef TNT_FILAMENT_QUALITYGOVERNOR_H
+#define TNT_FILAMENT_QUALITYGOVERNOR_H
+
+#include <filament/Renderer.h>
+
+#include <utils/compiler.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+class View;
+
+/**
+ * Keeps the frame rate of a View stable over long sessions, by stepping down a ladder of
+ * quality levels when the frames miss their budget or the device is about to throttle, and
+ * stepping back up when there's headroom again.
+ *
+ * The governor is fed the timings of the Renderer (see Renderer::setFrameStatsCallback()),
+ * and on Android it reads the thermal status of the device (AThermal, from API 30). The thermal
+ * headroom can also be given by the application, e.g. from PowerManager.getThermalHeadroom().
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * #include <filament/QualityGovernor.h>
+ * using namespace filament;
+ *
+ * QualityGovernor* governor = new QualityGovernor(view);
+ * renderer->setFrameStatsCallback([](Renderer::FrameStats const& stats, void* user) {
+ *     static_cast<QualityGovernor*>(user)->update(stats);
+ * }, governor);
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * A change of level only changes the settings of the View, it must be used on the thread that
+ * uses the View, the timings are delivered from Renderer::beginFrame().
+ */
+class UTILS_PUBLIC QualityGovernor {
+public:
+    /**
+     * The settings of the View at a level of the ladder.
+     */
+    struct QualityLevel {
+        float minScale = 0.5f;              //!< floor of the dynamic resolution, see DynamicResolutionOptions::minScale
+        uint8_t sampleCount = 1;            //!< see View::setSampleCount()
+        bool postProcessing = true;         //!< see View::setPostProcessingEnabled()
+        uint32_t maxShadowMapSize = 2048;   //!< see View::setMaxShadowMapSize()
+        uint32_t maxLightCount = 256;       //!< see View::setDynamicLightingMaxLightCount()
+    };
+
+    /**
+     * Thermal status of the device, like Android's PowerManager.THERMAL_STATUS_*.
+     */
+    enum class ThermalStatus : uint8_t {
+        UNKNOWN,        //!< not reported by the platform
+        NONE,
+        LIGHT,
+        MODERATE,       //!< the device throttles, the quality steps down
+        SEVERE,
+        CRITICAL,
+        EMERGENCY,
+        SHUTDOWN
+    };
+
+    struct Config {
+        float targetFrameTimeMilli = 1000.0f / 60.0f;   //!< frame budget
+        float stepDownLoad = 1.0f;      //!< steps down over this fraction of the budget
+        float stepUpLoad = 0.7f;        //!< steps up under this fraction of the budget
+        float stepDownHeadroom = 0.9f;  //!< steps down over this thermal headroom (1: throttling)
+        float stepUpHeadroom = 0.7f;    //!< steps up under this thermal headroom
+        uint32_t settleFrames = 64;     //!< frames ignored after a change, the percentiles' window
+        uint32_t stepUpFrames = 600;    //!< frames with headroom needed to step up
+    };
+
+    static constexpr size_t MAX_LEVEL_COUNT = 8;
+
+    /**
+     * Creates a governor for the View. Its ladder starts at the current settings of the View,
+     * and lowers them in 4 levels.
+     *
+     * @param view      View whose settings are changed, it must outlive the governor.
+     * @param config    Thresholds and delays of the changes of level.
+     */
+    QualityGovernor(View* view, Config const& config) noexcept;
+
+    /**
+     * Creates a governor for the View with the default Config.
+     */
+    explicit QualityGovernor(View* view) noexcept;
+
+    ~QualityGovernor() noexcept;
+
+    QualityGovernor(QualityGovernor const& rhs) = delete;
+    QualityGovernor& operator=(QualityGovernor const& rhs) = delete;
+
+    /**
+     * Replaces the ladder, and applies its highest quality level to the View.
+     *
+     * @param levels    The levels from the highest quality to the lowest.
+     * @param count     Number of levels, at most MAX_LEVEL_COUNT.
+     */
+    void setLevels(QualityLevel const* levels, size_t count) noexcept;
+
+    /**
+     * Steps the level down or up from the timings of a frame, and the thermal status of the
+     * device. Call it with the timings of each frame.
+     *
+     * The percentiles of the frame times are used, so a single long frame doesn't change the
+     * level. The quality steps down when the main thread, the render thread or the GPU take
+     * more than stepDownLoad of the budget, or when the thermal headroom is over
+     * stepDownHeadroom. It steps up after stepUpFrames frames under both stepUpLoad and
+     * stepUpHeadroom, a delay that doubles each time the level that was stepped up to didn't
+     * hold.
+     *
+     * @param stats Timings of a frame, see Renderer::setFrameStatsCallback().
+     */
+    void update(Renderer::FrameStats const& stats) noexcept;
+
+    /**
+     * Sets the thermal headroom of the device, for platforms where the governor can't read it,
+     * e.g. from PowerManager.getThermalHeadroom(). 0 is no load, 1 is throttling.
+     *
+     * @param headroom  The thermal headroom, or NaN to go back to the platform's.
+     */
+    void setThermalHeadroom(float headroom) noexcept;
+
+    /**
+     * @return the current level, 0 is the highest quality.
+     */
+    size_t getLevel() const noexcept { return mLevel; }
+
+    /**
+     * @return the number of levels of the ladder.
+     */
+    size_t getLevelCount() const noexcept { return mLevelCount; }
+
+    /**
+     * @return the last thermal status read, UNKNOWN if the platform doesn't report it.
+     */
+    ThermalStatus getThermalStatus() const noexcept { return mThermalStatus; }
+
+    /**
+     * @return the last thermal headroom read or set, NaN if it's unknown.
+     */
+    float getThermalHeadroom() const noexcept { return mThermalHeadroom; }
+
+private:
+    struct Thermal;
+
+    void pollThermal() noexcept;
+    void setLevel(size_t level) noexcept;
+
+    View* const mView;
+    Config const mConfig;
+    Thermal* mThermal = nullptr;
+    QualityLevel mLevels[MAX_LEVEL_COUNT];
+    size_t mLevelCount = 0;
+    size_t mLevel = 0;
+    uint32_t mFramesSinceChange = 0;
+    uint32_t mFramesWithHeadroom = 0;
+    uint32_t mStepUpFrames;
+    bool mLastChangeWasUp = false;
+    ThermalStatus mThermalStatus = ThermalStatus::UNKNOWN;
+    float mThermalHeadroom;
+    bool mThermalHeadroomSet = false;
+    int64_t mLastThermalPoll = 0;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_QUALITYGOVERNOR_H
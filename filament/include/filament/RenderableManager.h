@@ -42,6 +42,8 @@ class FRenderPrimitive;
 class FRenderableManager;
 } // namespace details
 
+class MorphTargetBuffer;
+
 class UTILS_PUBLIC RenderableManager : public FilamentAPI {
     struct BuilderDetails;
 
@@ -49,6 +51,9 @@ public:
     using Instance = utils::EntityInstance<RenderableManager>;
     using PrimitiveType = driver::PrimitiveType;
 
+    // maximum number of levels of detail of a Renderable, see Builder::levelOfDetail()
+    static constexpr size_t MAX_LEVEL_COUNT = 4;
+
     bool hasComponent(utils::Entity e) const noexcept;
 
     Instance getInstance(utils::Entity e) const noexcept;
@@ -82,13 +87,50 @@ public:
         Builder& culling(bool enable) noexcept; // true by default
         Builder& castShadows(bool enable) noexcept; // false by default
         Builder& receiveShadows(bool enable) noexcept; // true by default
+        // Whether the bounding box of this Renderable can hide other renderables, this is
+        // used by View::setOcclusionCulling(). The Renderable must fill its bounding box.
+        Builder& occluder(bool enable) noexcept; // false by default
+        // Whether this Renderable moves or changes often. The shadow maps caching their static
+        // casters (see LightManager::ShadowOptions::cacheStaticCasters) render the dynamic
+        // casters every frame on top of the cached ones, the others are cached.
+        Builder& dynamicShadowCaster(bool enable) noexcept; // false by default
         Builder& skinning(size_t boneCount) noexcept; // 0 by default, 255 max
         Builder& skinning(size_t boneCount, Bone const* transforms) noexcept;
         Builder& skinning(size_t boneCount, math::mat4f const* transforms) noexcept;
+        // Blends the bones as dual quaternions instead of blending the transformed vertices,
+        // which avoids the loss of volume around twisting joints. Bones must be rigid transforms.
+        Builder& dualQuaternionSkinning(bool enable) noexcept; // false by default
+        // Blends the morph targets of the given buffer on the GPU, with the weights set by
+        // setMorphWeights() -- all 0 initially. The buffer must outlive this renderable and its
+        // vertex count must match the vertex buffer of every primitive.
+        Builder& morphing(MorphTargetBuffer* morphTargetBuffer) noexcept; // nullptr by default
+        // The positions are quantized to [-1, 1] against the given box, typically in a SHORT4
+        // normalized attribute, which is more precise than half floats for the same size. They're
+        // decoded by the vertex shader as part of the world transform, so this can't be used
+        // with skinning or morphing.
+        Builder& quantizedPositions(const Box& bounds) noexcept; // disabled by default
 
         // Sets an ordering index for blended primitives that all live at the same Z value.
         Builder& blendOrder(size_t index, uint16_t order) noexcept; // 0 by default
 
+        /**
+         * Splits the primitives into levels of detail. By default, all the primitives belong
+         * to level 0, the most detailed one.
+         *
+         * @param level          Level of detail, between 1 and MAX_LEVEL_COUNT - 1. Levels
+         *                       must be declared without gaps.
+         * @param first          Index of the first primitive of this level, the level ends
+         *                       where the next one starts. Must be larger than the previous
+         *                       level's.
+         * @param screenCoverage This level is used once the Renderable's bounding sphere
+         *                       covers less than this fraction of the viewport's height. Must
+         *                       be smaller than the previous level's.
+         *
+         * The level is selected each frame during culling, with some hysteresis so that
+         * levels don't flicker when the coverage is close to a threshold.
+         */
+        Builder& levelOfDetail(uint8_t level, size_t first, float screenCoverage) noexcept;
+
         /**
          * Adds the Renderable component to an entity.
          *
@@ -136,17 +178,28 @@ public:
     void setReceiveShadows(Instance instance, bool enable) noexcept;
     bool isShadowCaster(Instance instance) const noexcept;
     bool isShadowReceiver(Instance instance) const noexcept;
+    void setOccluder(Instance instance, bool enable) noexcept;
+    bool isOccluder(Instance instance) const noexcept;
+    void setDynamicShadowCaster(Instance instance, bool enable) noexcept;
+    bool isDynamicShadowCaster(Instance instance) const noexcept;
 
     void setBones(Instance instance, Bone const* transforms, size_t boneCount = 1, size_t offset = 0) noexcept;
     void setBones(Instance instance, math::mat4f const* transforms, size_t boneCount = 1, size_t offset = 0) noexcept;
 
+    // sets the weights of the morph targets [offset, offset + count), see Builder::morphing()
+    void setMorphWeights(Instance instance, float const* weights, size_t count, size_t offset = 0) noexcept;
+
 
     // getters...
     const Box& getAxisAlignedBoundingBox(Instance instance) const noexcept;
 
-    // number of render primitives in this renderable
+    // number of render primitives in this renderable, for all levels of detail. The primitive
+    // indices below are the ones used with the Builder.
     size_t getPrimitiveCount(Instance instance) const noexcept;
 
+    // number of levels of detail of this renderable
+    size_t getLevelCount(Instance instance) const noexcept;
+
     // set/change the material of a given render primitive
     void setMaterialInstanceAt(Instance instance,
             size_t primitiveIndex, MaterialInstance const* materialInstance) noexcept;
@@ -157,10 +210,21 @@ public:
             PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices,
             size_t offset, size_t count) noexcept;
 
+    // same as above, the primitive only uses the vertices between minIndex and maxIndex,
+    // e.g. the vertices streamed in so far (see VertexBuffer::makeResident())
+    void setGeometryAt(Instance instance, size_t primitiveIndex,
+            PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices,
+            size_t offset, size_t minIndex, size_t maxIndex, size_t count) noexcept;
+
     // set/change the offset/count in the currently set index buffer of a given primitive
     void setGeometryAt(Instance instance, size_t primitiveIndex,
             PrimitiveType type, size_t offset, size_t count) noexcept;
 
+    // same as above, the primitive only uses the vertices between minIndex and maxIndex
+    void setGeometryAt(Instance instance, size_t primitiveIndex,
+            PrimitiveType type, size_t offset, size_t minIndex, size_t maxIndex,
+            size_t count) noexcept;
+
     // set the blend order of the given primitive, only the first 15 bits are used
     void setBlendOrderAt(Instance instance, size_t primitiveIndex, uint16_t order) noexcept;
 
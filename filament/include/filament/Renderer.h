@@ -64,6 +64,82 @@ class PixelBufferDescriptor;
  */
 class UTILS_PUBLIC Renderer : public FilamentAPI {
 public:
+    /**
+     * Timings of a frame, in milliseconds.
+     *
+     * @see setFrameStatsCallback()
+     */
+    struct FrameStats {
+        uint32_t frameId = 0;       //!< increases by one each time beginFrame() is called
+        float frameTime = 0;        //!< from beginFrame() to the GPU completing the frame
+        float mainThread = 0;       //!< spent in beginFrame(), render() and endFrame()
+        float prepare = 0;          //!< part of mainThread spent preparing the scenes
+        float culling = 0;          //!< part of mainThread spent culling renderables and lights
+        float commands = 0;         //!< part of mainThread spent generating the passes' commands
+        float froxelization = 0;    //!< assigning lights to froxels, in parallel with commands
+        float driverThread = 0;     //!< spent executing the frame's commands on the render thread
+        float gpu = 0;              //!< GPU time of the views, 0 if it can't be measured
+        float gpuShadows = 0;       //!< part of gpu spent rendering the shadow maps, see setFrameStatsGpuPasses()
+        float gpuColor = 0;         //!< part of gpu spent in the depth and color passes
+        float gpuPostProcess = 0;   //!< part of gpu spent post-processing
+
+        /**
+         * CPU hardware counters of a phase of the frame, see setFrameStatsCounters(). Only the
+         * thread running the phase is measured, not the jobs it spreads on other threads.
+         */
+        struct Counters {
+            uint64_t instructions = 0;  //!< instructions executed
+            float cpi = 0;              //!< cycles per instruction
+            float l1dMissRate = 0;      //!< fraction of the L1 data cache accesses that missed
+            float branchMissRate = 0;   //!< fraction of the branches that were mispredicted
+        };
+        Counters prepareCounters;       //!< preparing the scenes
+        Counters cullingCounters;       //!< culling renderables and lights
+        Counters froxelizationCounters; //!< assigning lights to froxels
+        Counters commandsCounters;      //!< generating the passes' commands
+        Counters driverThreadCounters;  //!< executing the frame's commands on the render thread
+
+        /**
+         * 50th, 90th and 99th percentiles of frameTime, mainThread, driverThread and gpu over
+         * the last 64 frames.
+         */
+        float frameTimePercentiles[3] = {};
+        float mainThreadPercentiles[3] = {};        //!< \copydoc frameTimePercentiles
+        float driverThreadPercentiles[3] = {};      //!< \copydoc frameTimePercentiles
+        float gpuPercentiles[3] = {};               //!< \copydoc frameTimePercentiles
+    };
+
+    using FrameStatsCallback = void(*)(FrameStats const& stats, void* user);
+
+    /**
+     * Work of a frame, see getRenderStats().
+     *
+     * The counters of the Renderer are those of the last frame that ended. The backend's are
+     * those of the last frame the render thread completed, which can be one or two frames
+     * older.
+     */
+    struct RenderStats {
+        uint32_t frameId = 0;               //!< frame of the Renderer's counters
+
+        // counted by the Renderer, summed over the views rendered
+        uint32_t visibleRenderables = 0;    //!< renderables drawn by the color passes
+        uint32_t shadowCasters = 0;         //!< renderables drawn by the shadow passes
+        uint32_t culledRenderables = 0;     //!< renderables culled, or not visible at all
+        uint32_t commandCount = 0;          //!< draw commands generated by the passes
+        uint32_t instancedDraws = 0;        //!< draws of several renderables at once
+        uint64_t commandStreamSize = 0;     //!< backend commands flushed, in bytes
+
+        // counted by the backend, 0 if it doesn't count them
+        uint32_t drawCount = 0;             //!< draw calls
+        uint64_t triangleCount = 0;         //!< triangles drawn, of all instances
+        uint32_t programChanges = 0;        //!< program (pipeline) changes
+        uint32_t textureBindings = 0;       //!< texture bindings
+        uint32_t uniformBufferBindings = 0; //!< uniform buffer bindings
+        uint64_t uniformBytes = 0;          //!< uniforms uploaded, in bytes
+        uint64_t bufferBytes = 0;           //!< vertices and indices uploaded, in bytes
+        uint64_t textureBytes = 0;          //!< texels uploaded, in bytes
+    };
+
      /**
       * Get the Engine that created this Renderer.
       *
@@ -185,10 +261,12 @@ public:
      * main thread, indicating that the read-back has completed. Typically, this will happen
      * after multiple calls to beginFrame(), render(), endFrame().
      *
-     * It is also possible to use a Fence to wait for the read-back.
+     * The content of `buffer` is only valid once its callback has been invoked, waiting on a Fence
+     * doesn't guarantee the read-back has completed.
      *
      * @remark
-     * readPixels() is intended for debugging and testing. It will impact performance significantly.
+     * On OpenGL the read-back doesn't stall the GPU, a few of them can be in flight at once.
+     * Other backends may impact performance significantly.
      *
      */
     void readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
@@ -225,6 +303,28 @@ public:
      */
     bool beginFrame(SwapChain* swapChain);
 
+    /**
+     * Set-up a frame for this Renderer, paced on the display's vsync.
+     *
+     * This is the same as beginFrame(SwapChain*), but the frame is also scheduled for
+     * presentation a fixed number of refresh periods after the given vsync. The refresh period
+     * is measured from the successive vsync timestamps and the number of periods is the number
+     * of frames the CPU is allowed to be ahead of the GPU. This keeps the frame cadence steady
+     * where presentation times are supported (EGL_ANDROID_presentation_time), and has no
+     * effect elsewhere.
+     *
+     * @param swapChain A pointer to the SwapChain instance to use.
+     * @param vsyncSteadyClockTimeNano The time of the vsync this frame is started on, in
+     *                                 nanoseconds on the steady clock. On Android this is
+     *                                 the frameTimeNanos given to Choreographer's
+     *                                 FrameCallback.
+     *
+     * @return
+     *      *false* the current frame must be skipped,
+     *      *true* the current frame can be drawn.
+     */
+    bool beginFrame(SwapChain* swapChain, uint64_t vsyncSteadyClockTimeNano);
+
     /**
      * Finishes the current frame and schedules it for display.
      *
@@ -237,6 +337,150 @@ public:
      * beginFrame()
      */
     void endFrame();
+
+    /**
+     * Returns whether the last frame presented by this Renderer is out of date. Applications
+     * rendering mostly static content can skip the frames (i.e. not call beginFrame()) while
+     * this returns false, which saves the CPU, GPU and power the frame would use.
+     *
+     * The Engine tracks the changes made through its API: transforms, renderables, lights,
+     * material instances, cameras, views, scenes, and the content of textures, buffers and
+     * streams. Any of them makes the next frame needed.
+     *
+     * @return true if a frame must be rendered to show the latest content, false if the last
+     *         frame presented is up to date.
+     *
+     * @remark
+     * After a change, the views using temporal upscaling need a few more frames to converge.
+     * While there are native or texture id Streams, whose producers post frames behind the
+     * Engine's back, this always returns true. Changes made outside of Filament, like the
+     * size of the window, aren't tracked.
+     *
+     * @remark
+     * The content of the swap chain isn't preserved once it's presented, so a skipped frame
+     * can't be presented again: the display keeps showing the last frame presented.
+     */
+    bool needsRedraw() const noexcept;
+
+    /**
+     * Enables or disables frame pipelining.
+     *
+     * When enabled, the final recording of the color pass driver commands, from several jobs,
+     * can continue after render() returns. This lets the calling thread move on to the next
+     * view or the next frame while the recording is still in progress. The commands of a frame
+     * are then handed off to the render thread in the next beginFrame(). This is the sync
+     * point where beginFrame() waits until the recording is complete.
+     *
+     * This increases the CPU throughput of large scenes on devices with many cores, at the
+     * cost of a frame of latency on the render thread. It also uses more memory. Disabled by
+     * default.
+     *
+     * @param enabled true to enable frame pipelining, false to disable it.
+     *
+     * @note
+     * Destroying an object, or flushing the Engine, waits until the recording is complete.
+     */
+    void setFramePipelining(bool enabled) noexcept;
+
+    /**
+     * @return true if frame pipelining is enabled.
+     */
+    bool isFramePipeliningEnabled() const noexcept;
+
+    /**
+     * Enables or disables partial updates.
+     *
+     * When enabled, a frame only redraws the part of the SwapChain covering the renderables
+     * that moved or changed since the previous frame, the rest of the previous frame is kept.
+     * This saves most of the GPU time and bandwidth of the frames where little changes, e.g.
+     * in UIs. The changed region is also passed to the compositor. Disabled by default.
+     *
+     * This needs a backend able to keep the content of the SwapChain, e.g. EGL with
+     * EGL_KHR_partial_update, otherwise the frames are redrawn entirely and only the
+     * compositor benefits from it (EGL_KHR_swap_buffers_with_damage, VK_KHR_incremental_present).
+     *
+     * @param enabled true to enable partial updates, false to disable them.
+     *
+     * @remark
+     * A frame is redrawn entirely when it renders more than one View, when its View has
+     * post-processing or shadows, or after any change other than the transform or the
+     * renderable components of the renderables, e.g. the camera, the lights, a material
+     * parameter or the content of a texture. The changed region is a single rectangle.
+     */
+    void setPartialUpdate(bool enabled) noexcept;
+
+    /**
+     * @return true if partial updates are enabled.
+     */
+    bool isPartialUpdateEnabled() const noexcept;
+
+    /**
+     * Sets a callback that receives the timings of each frame, e.g. for telemetry or to adjust
+     * the quality settings. The timings of a frame are only complete once the render thread
+     * and the GPU are done with it, so they're delivered a few frames later, from beginFrame().
+     *
+     * @param callback  function called with the timings of each frame, or nullptr to disable
+     *                  the timings (the default)
+     * @param user      user pointer passed to the callback
+     *
+     * @note
+     * The GPU time of a View is measured with timer queries, when the backend supports them.
+     */
+    void setFrameStatsCallback(FrameStatsCallback callback, void* user = nullptr) noexcept;
+
+    /**
+     * Enables measuring the CPU hardware counters (instructions, cycles, cache and branch
+     * misses) of the main phases of each frame, they're delivered with the timings of
+     * setFrameStatsCallback(). They're meant to catch regressions of the hot paths on real
+     * devices, and cost a few system calls per phase.
+     *
+     * @param enabled true to measure the counters, false to stop (the default)
+     *
+     * @note
+     * The counters are only supported on Linux and Android, when the kernel allows user space
+     * to use perf events. They're left to zero otherwise.
+     */
+    void setFrameStatsCounters(bool enabled) noexcept;
+
+    /**
+     * Enables measuring the GPU time of the shadow, color and post-processing passes of each
+     * View, they're delivered with the timings of setFrameStatsCallback(). Each pass uses its
+     * own timer query, whose result is read a few frames later without stalling.
+     *
+     * @param enabled true to measure the passes, false to stop (the default)
+     *
+     * @note
+     * The passes are measured when the backend supports nested timer queries, they're left to
+     * zero otherwise (e.g. with OpenGL implementations that have no timestamp queries).
+     */
+    void setFrameStatsGpuPasses(bool enabled) noexcept;
+
+    /**
+     * Returns the draws, state changes and uploads of the last frame. The counters are always
+     * on, the ones of the frame in progress are kept apart, so this can be called any time and
+     * doesn't wait for the render thread.
+     *
+     * @return The counters of the last frame, see RenderStats.
+     *
+     * @note
+     * The state changes are only counted by the OpenGL backend, see
+     * Engine::getDriverStateStats().
+     */
+    RenderStats getRenderStats() const noexcept;
+
+    /**
+     * Writes what the next View passed to render() draws into a text file, for offline
+     * analysis: its renderables after culling with their primitives and materials, the sorted
+     * commands of its color pass with their keys, the light counts of its froxels, and the
+     * timings and RenderStats of the last frame. The file is written when render() returns.
+     *
+     * @param path  Path of the file to write, it's overwritten if it exists.
+     *
+     * @note
+     * The timings are only available if setFrameStatsCallback() is used, see FrameStats.
+     * The format is described in FrameCapture.h, the frame_capture_viewer sample displays it.
+     */
+    void captureFrame(const char* path) noexcept;
 };
 
 } // namespace filament
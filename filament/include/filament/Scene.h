@@ -19,15 +19,22 @@
 #ifndef TNT_FILAMENT_SCENE_H
 #define TNT_FILAMENT_SCENE_H
 
+#include <filament/Box.h>
+#include <filament/EngineEnums.h>
 #include <filament/FilamentAPI.h>
 
 #include <utils/compiler.h>
 #include <utils/Entity.h>
 
+#include <math/vec3.h>
+
+#include <stdint.h>
+
 namespace filament {
 
 class IndirectLight;
 class Skybox;
+class Texture;
 
 /**
  * A Scene is a flat container of Renderable and Light instances.
@@ -61,6 +68,14 @@ class Skybox;
  */
 class UTILS_PUBLIC Scene : public FilamentAPI {
 public:
+    /**
+     * Called once the Renderer doesn't read the components of the Scene anymore for the frame
+     * being rendered, see setSnapshotCallback().
+     */
+    using SnapshotCallback = void(*)(Scene* scene, void* user);
+
+    //! Maximum number of reflection probes of a Scene, see setReflectionProbe().
+    static constexpr size_t MAX_REFLECTION_PROBES = CONFIG_MAX_REFLECTION_PROBES;
 
     /**
      * Set the SkyBox,
@@ -114,6 +129,102 @@ public:
      * @return The total number of Light objects in the Scene.
      */
     size_t getLightCount() const noexcept;
+
+    /**
+     * Enables or disables uniform batching.
+     *
+     * When enabled, the per-renderable uniforms of all the visible renderables are packed
+     * into a single uniform buffer, which is uploaded once per frame, instead of uploading
+     * each renderable's uniforms separately. This is beneficial for scenes with many
+     * renderables. Disabled by default.
+     *
+     * @param enabled true to enable uniform batching, false to disable it.
+     */
+    void setUniformBatching(bool enabled) noexcept;
+
+    /**
+     * @return true if uniform batching is enabled.
+     */
+    bool isUniformBatchingEnabled() const noexcept;
+
+    /**
+     * Enables or disables the snapshot mode.
+     *
+     * By default, the transform, renderable and light components of the Scene's entities must
+     * not be changed while Renderer::render() renders a View of the Scene. In snapshot mode,
+     * the Renderer copies what it needs from the components into data owned by the frame as it
+     * prepares the View: the uniforms of the renderables (as with uniform batching), their
+     * primitives at the selected level of detail, and the parameters of the lights. Once this
+     * is done, before the shadow and color passes are recorded, the callback is called and the
+     * components can be changed for the next frame, e.g. by a simulation thread, while the
+     * frame is being rendered.
+     *
+     * @param callback  function called from Renderer::render() once the components aren't read
+     *                  anymore, or nullptr to disable the snapshot mode (the default)
+     * @param user      user pointer passed to the callback
+     *
+     * @attention
+     *  The changes must be done before the next Renderer::render() of a View of the Scene
+     *  starts, and the callback is called for each View, the components can only be changed
+     *  after the last one. Only the components are snapshotted, the resources they reference
+     *  (e.g. MaterialInstance, VertexBuffer) must not be changed or destroyed while they're
+     *  used by the frame.
+     */
+    void setSnapshotCallback(SnapshotCallback callback, void* user = nullptr) noexcept;
+
+    /**
+     * @return true if the snapshot mode is enabled, see setSnapshotCallback().
+     */
+    bool isSnapshotModeEnabled() const noexcept;
+
+    /**
+     * Sets a local reflection probe, whose reflections replace the IndirectLight's on the
+     * renderables around it.
+     *
+     * A probe is an environment captured at a position, e.g. by rendering the Scene into the
+     * faces of a cubemap, and the box it reflects, e.g. a room. The reflections are corrected
+     * for the parallax of the box. A renderable uses the probe with the smallest box containing
+     * the center of its bounding box, its diffuse lighting is still the IndirectLight's.
+     *
+     * The environment is prefiltered on the GPU (see IndirectLight::prefilterReflections()),
+     * one roughness level per Renderer::render(), the probe is used once all the levels are.
+     *
+     * @param index         Index of the probe, less than MAX_REFLECTION_PROBES. It replaces the
+     *                      probe at that index, if any.
+     * @param environment   Cubemap captured at the probe's position, with all its mip levels
+     *                      and in the units of the IndirectLight's reflections. It must be kept
+     *                      until the probe is removed or set again.
+     * @param position      World-space position where the environment was captured.
+     * @param box           World-space box reflected by the probe, it must contain the position.
+     */
+    void setReflectionProbe(size_t index, Texture const* environment,
+            math::float3 const& position, Box const& box) noexcept;
+
+    /**
+     * Removes a reflection probe, the renderables around it use the IndirectLight again.
+     *
+     * @param index Index of the probe, less than MAX_REFLECTION_PROBES.
+     */
+    void removeReflectionProbe(size_t index) noexcept;
+
+    /**
+     * Prefilters the environment of a reflection probe again, after it was captured again in
+     * the same texture. The previous reflections are used meanwhile.
+     *
+     * @param index Index of the probe, less than MAX_REFLECTION_PROBES.
+     */
+    void invalidateReflectionProbe(size_t index) noexcept;
+
+    /**
+     * Returns the reflection probes whose box contains something that changed since they were
+     * set or invalidated, i.e. whose environment should be captured again. A change of the
+     * whole Scene (e.g. an entity added, or a light moved) makes all the probes stale.
+     *
+     * The application decides when to capture them again, e.g. one per frame.
+     *
+     * @return A bitmask with a bit set for each stale probe, bit i for the probe at index i.
+     */
+    uint32_t getStaleReflectionProbes() const noexcept;
 };
 
 } // namespace filament
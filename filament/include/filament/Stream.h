@@ -36,7 +36,18 @@ class UTILS_PUBLIC Stream : public FilamentAPI {
     struct BuilderDetails;
 
 public:
-    //! Use Builder to construct an Stream object instance
+    /**
+     * Called on the main thread when an image passed to setAcquiredImage() is no longer used
+     * by filament.
+     */
+    using Callback = void(*)(void* image, void* userData);
+
+    /**
+     * Use Builder to construct an Stream object instance.
+     *
+     * If neither stream() variant is called, the Stream is an acquired stream: its images are
+     * pushed by the client with setAcquiredImage() and sampled directly, without any copy.
+     */
     class Builder : public BuilderBase<BuilderDetails> {
         friend struct BuilderDetails;
     public:
@@ -120,6 +131,30 @@ public:
      */
     void setDimensions(uint32_t width, uint32_t height) noexcept;
 
+    /**
+     * Sets the image sampled by the textures attached to an acquired stream, starting with
+     * the next frame. This is the zero-copy path for camera frames: the image is bound to
+     * the textures as is, no intermediate copy is made.
+     *
+     * The Stream must be an acquired stream (see Builder). This function is a no-op otherwise.
+     *
+     * @param image     The platform image. With OpenGL ES this is an EGLImageKHR, on Android
+     *                  it is typically created from an AHardwareBuffer with
+     *                  eglGetNativeClientBufferANDROID() and eglCreateImageKHR().
+     * @param callback  Called on the main thread once the GPU is done with `image`, i.e. some
+     *                  time after the next call to setAcquiredImage() or after the Stream is
+     *                  destroyed. The image and its buffer can be reused after that.
+     * @param userData  Passed to `callback`.
+     * @param timestamp Timestamp of the image, returned by getTimestamp().
+     */
+    void setAcquiredImage(void* image, Callback callback, void* userData,
+            int64_t timestamp = 0) noexcept;
+
+    /**
+     * Returns the timestamp of the last image set with setAcquiredImage(), or 0.
+     */
+    int64_t getTimestamp() const noexcept;
+
     /**
      * Read-back the content of the last frame of a Stream since the last call to
      * Renderer.beginFrame().
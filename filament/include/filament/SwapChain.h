@@ -144,6 +144,31 @@ class UTILS_PUBLIC SwapChain : public FilamentAPI {
 public:
     static const uint64_t CONFIG_TRANSPARENT = driver::SWAP_CHAIN_CONFIG_TRANSPARENT;
 
+    /**
+     * Presents the most recent frame at vsync, the older frames that haven't been presented yet
+     * are dropped. The rendering is never throttled by the display, which lowers the latency at
+     * the cost of frames rendered for nothing. FIFO is used when the platform doesn't support
+     * it. With OpenGL this sets a swap interval of 0.
+     */
+    static const uint64_t CONFIG_PRESENT_MAILBOX = driver::SWAP_CHAIN_CONFIG_PRESENT_MAILBOX;
+
+    /**
+     * Presents the frames as soon as they're rendered, without waiting for vsync, which can
+     * tear. This is meant for throughput, e.g. for benchmarks or offscreen rendering. With
+     * OpenGL this sets a swap interval of 0.
+     */
+    static const uint64_t CONFIG_PRESENT_IMMEDIATE = driver::SWAP_CHAIN_CONFIG_PRESENT_IMMEDIATE;
+
+    /**
+     * Returns the flag that asks for at least `count` images in the swap chain (up to 15). More
+     * images let the GPU run further ahead of the display, fewer lower the latency. The count is
+     * clamped to what the platform supports. This is ignored by the OpenGL backend.
+     */
+    static constexpr uint64_t configMinImageCount(uint32_t count) noexcept {
+        return (uint64_t(count) << driver::SWAP_CHAIN_CONFIG_IMAGE_COUNT_SHIFT) &
+                driver::SWAP_CHAIN_CONFIG_IMAGE_COUNT_MASK;
+    }
+
     void* getNativeWindow() const noexcept;
 };
 
@@ -159,6 +159,20 @@ public:
          */
         Builder& usage(Usage usage) noexcept;
 
+        /**
+         * The levels of a streaming Texture are uploaded progressively, from the coarsest to the
+         * finest, e.g. for scenes whose textures don't all fit in memory at full resolution.
+         * Only the levels declared with makeResident() are sampled. Each frame, the Engine
+         * computes the finest level needed by the visible renderables using the Texture, from
+         * their size on screen, see getRequestedLevel().
+         * Defaults to false, i.e. all the levels are sampled as soon as they're uploaded.
+         *
+         * @param enabled Whether the texture is streaming.
+         * @return This Builder, for chaining calls.
+         * @see Engine::setTextureStreamingBudget()
+         */
+        Builder& streaming(bool enabled) noexcept;
+
         /**
          * Creates the Texture object and returns a pointer to it.
          *
@@ -345,6 +359,31 @@ public:
      * @attention This Texture instance must NOT use driver::SamplerType::SAMPLER_CUBEMAP or it has no effect
      */
     void generateMipmaps(Engine& engine) const noexcept;
+
+    /**
+     * Declares that the levels from \p baseLevel to the last one of a streaming Texture have
+     * been uploaded, only these levels are sampled. No-op if the Texture isn't streaming.
+     *
+     * @param engine        Engine this texture is associated to.
+     * @param baseLevel     Finest level that was uploaded, the coarser ones must be too.
+     */
+    void makeResident(Engine& engine, size_t baseLevel) noexcept;
+
+    /**
+     * Returns the finest level of a streaming Texture that is sampled, or getLevels() if none
+     * is. This can be coarser than the level passed to makeResident() when the Engine evicted
+     * levels to stay within the texture streaming budget, in which case these levels must be
+     * made resident again after they're requested. The GPU memory of evicted levels is not
+     * released by the backends.
+     */
+    size_t getResidentLevel() const noexcept;
+
+    /**
+     * Returns the finest level of a streaming Texture that the application should upload,
+     * computed at each frame from the size on screen of the renderables using the Texture and
+     * the Engine's texture streaming budget. It's the last level until the Texture is drawn.
+     */
+    size_t getRequestedLevel() const noexcept;
 };
 
 } // namespace filament
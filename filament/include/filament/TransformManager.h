@@ -116,7 +116,9 @@ public:
     /**
      * Set a local transform of a transform component.
      * @param ci              The instance of the transform component to set the local transform to.
-     * @param localTransform  The local transform (i.e. relative to the parent).
+     * @param localTransform  The local transform (i.e. relative to the parent). This must be an
+     *                        affine transform, its last row is ignored and assumed to be
+     *                        (0, 0, 0, 1).
      * @see getTransform()
      * @attention This operation can be slow if the hierarchy of transform is too deep, and this
      *            will be particularly bad when updating a lot of transforms. In that case,
@@ -128,10 +130,10 @@ public:
      * Returns the local transform of a transform component.
      * @param ci The instance of the transform component to query the local transform from.
      * @return The local transform of the component (i.e. relative to the parent). This always
-     *         returns the value set by setTransform().
+     *         returns the value set by setTransform(), with a last row of (0, 0, 0, 1).
      * @see setTransform()
      */
-    const math::mat4f& getTransform(Instance ci) const noexcept;
+    math::mat4f getTransform(Instance ci) const noexcept;
 
     /**
      * Return the world transform of a transform component.
@@ -141,7 +143,7 @@ public:
      *         transform.
      * @see setTransform()
      */
-    const math::mat4f& getWorldTransform(Instance ci) const noexcept;
+    math::mat4f getWorldTransform(Instance ci) const noexcept;
 
     /**
      * Opens a local transform transaction. During a transaction, getWorldTransform() can
@@ -170,6 +172,33 @@ public:
      * @see openLocalTransformTransaction(), setTransform()
      */
     void commitLocalTransformTransaction() noexcept;
+
+    /**
+     * Enables or disables lazy updates of the world transforms. When enabled, setTransform(),
+     * setParent() and destroy() only mark the affected transforms, their world transforms and
+     * those of their descendants are computed when they're next needed: when
+     * getWorldTransform() is called, or when a Scene is prepared for rendering. This way, each
+     * changed subtree is only updated once, no matter how many of its transforms were set.
+     *
+     * This is useful when many transforms of a hierarchy are updated each frame, for instance
+     * the bones of a skeleton, without having to manage a local transform transaction.
+     *
+     * @param enabled true to enable lazy updates. Disabling lazy updates computes the pending
+     *                world transforms immediately. Lazy updates are disabled by default.
+     *
+     * @note Computing the pending world transforms can reorder the transform components, like
+     *       commitLocalTransformTransaction() does, in which case previously retrieved Instances
+     *       must be retrieved again.
+     *
+     * @see isLazyUpdatesEnabled(), openLocalTransformTransaction()
+     */
+    void setLazyUpdatesEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns whether the world transforms are updated lazily.
+     * @see setLazyUpdatesEnabled()
+     */
+    bool isLazyUpdatesEnabled() const noexcept;
 };
 
 } // namespace filament
@@ -63,6 +63,14 @@ public:
         // no-op if attribute is an invalid enum
         Builder& normalized(VertexAttribute attribute) noexcept;
 
+        /**
+         * The content of a streaming VertexBuffer is uploaded progressively, e.g. for datasets
+         * too large to be uploaded at once. Initially, no vertex is resident and the primitives
+         * using vertices that are not resident are not drawn, see makeResident().
+         * Defaults to false, i.e. all the vertices are always considered resident.
+         */
+        Builder& streaming(bool enabled) noexcept;
+
         /**
          * Creates the VertexBuffer object and returns a pointer to it.
          *
@@ -96,6 +104,24 @@ public:
             BufferDescriptor&& buffer,
             uint32_t byteOffset = 0,
             uint32_t byteSize = 0);
+
+    /**
+     * Marks a range of vertices of a streaming VertexBuffer as resident, typically after its
+     * content was uploaded with setBufferAt(). A primitive is drawn only when all the vertices
+     * between its minIndex and maxIndex are resident. No-op if the buffer isn't streaming.
+     */
+    void makeResident(Engine& engine, size_t firstVertex, size_t vertexCount) noexcept;
+
+    /**
+     * Marks a range of vertices of a streaming VertexBuffer as not resident, for instance
+     * before reusing it for other content. The GPU memory is not released, streamed datasets
+     * larger than a memory budget can use a VertexBuffer of that size as a cache of pages.
+     * No-op if the buffer isn't streaming.
+     */
+    void evict(Engine& engine, size_t firstVertex, size_t vertexCount) noexcept;
+
+    // whether all the vertices of the given range are resident
+    bool isResident(size_t firstVertex, size_t vertexCount) const noexcept;
 };
 
 } // namespace filament
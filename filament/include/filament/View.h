@@ -31,6 +31,8 @@
 #include <math/vec2.h>
 #include <math/vec3.h>
 
+#include <limits>
+
 namespace filament {
 
 class Camera;
@@ -106,6 +108,7 @@ public:
         explicit DynamicResolutionOptions(bool enabled) : enabled(enabled) { }
 
         math::float2 minScale = math::float2(0.5f);     //!< minimum scale factors in x and y
+                                                        //!< (can be lower with temporalUpscaling)
         math::float2 maxScale = math::float2(1.0f);     //!< maximum scale factors in x and y
         float scaleRate = 0.125f;                       //!< rate at which the scale will change
         float targetFrameTimeMilli = 1000.0f / 60.0f;   //!< desired frame time, or budget.
@@ -114,12 +117,16 @@ public:
         uint8_t history = 9;                            //!< history size
         bool enabled = false;                           //!< enable or disable dynamic resolution
         bool homogeneousScaling = false;                //!< set to true to force homogeneous scaling
+        bool temporalUpscaling = false;                 //!< reconstruct the image from several
+                                                        //!< jittered frames instead of a blit,
+                                                        //!< also replaces FXAA
     };
 
     enum class DepthPrepass : int8_t {
         DEFAULT = -1,
         DISABLED,
         ENABLED,
+        AUTO,
     };
 
     /**
@@ -133,14 +140,96 @@ public:
      * state changes. With the depth pre-pass disabled, objects are draw only once, but it may
      * result in more state changes or more overdraw.
      *
-     * The best strategy may depend on the scene and/or GPU.
+     * The best strategy may depend on the scene and/or GPU. With DepthPrepass::AUTO, the GPU
+     * time of the color pass is measured with and without the depth pre-pass (a frame is
+     * rendered with the other strategy every so often), and the cheaper one is used. This
+     * requires timer queries, without them AUTO is the same as DEFAULT.
      *
      * @param prepass   DepthPrepass::DEFAULT uses the most appropriate strategy,
      *                  DepthPrepass::DISABLED disables the depth pre-pass,
-     *                  DepthPrepass::ENABLE enables the depth pre-pass.
+     *                  DepthPrepass::ENABLE enables the depth pre-pass,
+     *                  DepthPrepass::AUTO picks the cheaper strategy from measures.
      */
     void setDepthPrepass(DepthPrepass prepass) noexcept;
 
+    /**
+     * Enables or disables occlusion culling.
+     *
+     * When enabled, renderables entirely hidden behind occluders are not drawn. Occluders are
+     * renderables created with RenderableManager::Builder::occluder(true), their bounding box
+     * is rasterized in a low resolution hierarchical depth buffer which is then used to test
+     * the bounding box of all other renderables. This works best with large occluders, like
+     * the walls of an interior scene.
+     *
+     * Occlusion culling only affects the camera, shadow casters are not occlusion culled.
+     * It is disabled by default.
+     *
+     * @param enabled true to enable occlusion culling, false to disable it.
+     */
+    void setOcclusionCulling(bool enabled) noexcept;
+
+    //! Returns whether occlusion culling is enabled.
+    bool isOcclusionCullingEnabled() const noexcept;
+
+    /**
+     * Enables or disables GPU culling.
+     *
+     * When enabled and occlusion culling is enabled, the renderables in the frustum are
+     * occlusion culled by a compute program instead of the CPU, and the color pass draws them
+     * with indirect draw calls. Frustum culling is still done on the CPU. This makes the CPU
+     * cost of occlusion culling independent of the number of renderables in the frustum, which
+     * helps scenes with very many of them hidden. The CPU still generates a draw call for every
+     * renderable in the frustum.
+     *
+     * This is ignored when culling is disabled, or when the backend doesn't support compute
+     * programs. It is disabled by default.
+     *
+     * @param enabled true to enable GPU culling, false to disable it.
+     */
+    void setGpuCulling(bool enabled) noexcept;
+
+    //! Returns whether GPU culling is enabled.
+    bool isGpuCullingEnabled() const noexcept;
+
+    /**
+     * Enables or disables temporal culling.
+     *
+     * When enabled, the View keeps the frustum culling results of the camera and of the
+     * directional shadow cascades from one frame to the next. As long as the camera and the
+     * light don't move, only the renderables whose transform or renderable component changed
+     * are culled again, which makes the cost of culling depend on how many renderables move
+     * rather than on the size of the scene. The spot lights' shadow casters are always culled.
+     *
+     * This uses a few bytes of memory per renderable. It is disabled by default.
+     *
+     * @param enabled true to enable temporal culling, false to disable it.
+     */
+    void setTemporalCulling(bool enabled) noexcept;
+
+    //! Returns whether temporal culling is enabled.
+    bool isTemporalCullingEnabled() const noexcept;
+
+    /**
+     * Enables or disables order-independent transparency.
+     *
+     * When enabled, the surfaces of the materials using the TRANSPARENT blending mode are not
+     * sorted back to front. They're accumulated in a separate render target with weights that
+     * favor the closest and most opaque surfaces, then composited over the opaque surfaces.
+     * This removes the sorting artifacts of intersecting or interleaved transparent surfaces,
+     * and lets them be batched by material, at the cost of an approximate result when many
+     * layers overlap. The FADE blending mode is still sorted.
+     *
+     * This requires the post-processing pass and is ignored with multi-sample anti-aliasing,
+     * or when the backend can't render to several color buffers at once. It is disabled by
+     * default.
+     *
+     * @param enabled true to enable order-independent transparency, false to disable it.
+     */
+    void setOrderIndependentTransparency(bool enabled) noexcept;
+
+    //! Returns whether order-independent transparency is enabled.
+    bool isOrderIndependentTransparencyEnabled() const noexcept;
+
     /**
      * Sets the View's name. Only useful for debugging.
      * @param name Pointer to the View's name. The string is copied.
@@ -290,6 +379,23 @@ public:
      */
     void setShadowsEnabled(bool enabled) noexcept;
 
+    /**
+     * Limits the size of the shadow maps of this View, e.g. to lower the cost of the shadows
+     * on a device that's heating up. The directional shadow map and the spot lights' tiles
+     * are never larger than this, nor than their light's ShadowOptions::mapSize.
+     *
+     * @param size the largest size of the shadow maps in texels, a power of two. The default
+     *             doesn't limit them.
+     *
+     * @see QualityGovernor
+     */
+    void setMaxShadowMapSize(uint32_t size = std::numeric_limits<uint32_t>::max()) noexcept;
+
+    /**
+     * @return the value set by setMaxShadowMapSize().
+     */
+    uint32_t getMaxShadowMapSize() const noexcept;
+
     /**
      * Specifies which buffers can be discarded before rendering.
      *
@@ -379,6 +485,31 @@ public:
      */
     void setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept;
 
+    /**
+     * Sets the number of froxels used for dynamic lighting in this view.
+     *
+     * The view frustum is divided in froxels and each froxel keeps the list of the lights
+     * reaching it. The lists of all froxels share a buffer of 65536 entries, so with many
+     * lights, the froxels that don't fit lose their lights. Fewer froxels need fewer entries
+     * (each froxel covers more pixels and more lights) and can avoid that, more froxels cull
+     * the lights better when there are few of them.
+     *
+     * @param froxelCount Number of froxels, clamped to [1024, 8192]. (Default 8192).
+     */
+    void setDynamicLightingFroxelCount(uint32_t froxelCount) noexcept;
+
+    /**
+     * Sets the maximum number of point and spot lights used for dynamic lighting in this view.
+     *
+     * When more lights are visible, only the ones contributing the most to the image are kept,
+     * based on their intensity and on how much of the screen they cover. This bounds the cost
+     * of the dynamic lighting in scenes with many lights. Independently of this, lights covering
+     * less than a pixel are always dropped.
+     *
+     * @param maxLightCount Maximum number of lights, clamped to 256. (Default 256).
+     */
+    void setDynamicLightingMaxLightCount(uint32_t maxLightCount) noexcept;
+
     /**
      * Enable or disable post processing. Enabled by default.
      *
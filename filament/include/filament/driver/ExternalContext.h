@@ -61,6 +61,13 @@ public:
     virtual void terminate() noexcept = 0;
 
     virtual SwapChain* createSwapChain(void* nativeWindow, uint64_t& flags) noexcept = 0;
+
+    // Creates an offscreen surface of the given size, used for headless rendering. Returns
+    // null if this is not supported. It's destroyed with destroySwapChain().
+    virtual SwapChain* createHeadlessSwapChain(uint32_t width, uint32_t height,
+            uint64_t& flags) noexcept {
+        return nullptr;
+    }
     virtual void destroySwapChain(SwapChain* swapChain) noexcept = 0;
 
     // Called to make the OpenGL context active on the calling thread.
@@ -70,6 +77,17 @@ public:
     // swap draw buffers (i.e. for double-buffered rendering).
     virtual void commit(SwapChain* swapChain) noexcept = 0;
 
+    // Called before commit() with the time at which the current frame should be presented,
+    // on the steady clock. This is optional, presentation times are a hint.
+    virtual void setPresentationTime(int64_t presentationTimeInNanosecond) noexcept { }
+
+    // Called before drawing into the current swap chain with the region {left, bottom, width,
+    // height} that changed since the last frame presented. Returns true if the rest of the
+    // back buffer still holds the previous frames, in which case 'region' is updated to the
+    // region that must be redrawn (it includes the damage of the frames this back buffer
+    // missed). Returns false if the whole frame must be redrawn. This is optional.
+    virtual bool setDamage(int32_t region[4]) noexcept { return false; }
+
     virtual bool canCreateFence() noexcept { return false; }
     virtual Fence* createFence() noexcept = 0;
     virtual void destroyFence(Fence* fence) noexcept = 0;
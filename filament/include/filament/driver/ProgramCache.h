@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef TNT_FILAMENT_DRIVER_PROGRAMCACHE_H
+#define TNT_FILAMENT_DRIVER_PROGRAMCACHE_H
+
+#include <utils/compiler.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace driver {
+
+/**
+ * ProgramCache is implemented by the application to store the compiled shader programs between
+ * runs (e.g. on disk), which saves compiling them again the first time they're needed.
+ *
+ * The content is opaque and specific to the GPU driver that produced it, it's identified by a
+ * 64-bit key that accounts for the shaders and the GPU driver version. Content the driver
+ * doesn't accept anymore (e.g. after a driver update) is replaced automatically.
+ *
+ * get() only copies the content, so it can be served from a file mapped read-only in memory,
+ * which lets several processes using the same GPU driver share it.
+ *
+ * The methods are called from filament's render thread.
+ *
+ * @see Engine::setProgramCache()
+ */
+class UTILS_PUBLIC ProgramCache {
+public:
+    virtual ~ProgramCache() noexcept;
+
+    /**
+     * Retrieves the content stored for a key.
+     *
+     * @param key   key of the content
+     * @param data  where to copy the content, or nullptr to only query its size
+     * @param size  size of \p data in bytes, nothing is copied if it's smaller than the content
+     * @return the size of the content in bytes, or 0 if there is nothing stored for \p key
+     */
+    virtual size_t get(uint64_t key, void* data, size_t size) noexcept = 0;
+
+    /**
+     * Stores content for a key, replacing the previous content if any.
+     *
+     * @param key   key of the content
+     * @param data  the content, it's only valid for the duration of the call
+     * @param size  size of \p data in bytes
+     */
+    virtual void put(uint64_t key, void const* data, size_t size) noexcept = 0;
+};
+
+} // namespace driver
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_PROGRAMCACHE_H
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_AFFINETRANSFORM_H
+#define TNT_FILAMENT_AFFINETRANSFORM_H
+
+#include <utils/compiler.h>
+
+#include <math/mat3.h>
+#include <math/mat4.h>
+#include <math/vec3.h>
+
+#include <stddef.h>
+
+namespace filament {
+
+/*
+ * A 3x4 affine transform, i.e.: a mat4f whose last row is (0, 0, 0, 1). Only its 4 columns
+ * without their last component are stored, which takes 48 bytes instead of 64.
+ *
+ * This is how the transform manager and the scene store their transforms, conversions from and
+ * to mat4f happen at the API and uniform buffer boundaries.
+ */
+class AffineTransform {
+public:
+    AffineTransform() noexcept
+            : mColumns{ { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 0, 0, 0 } } {
+    }
+
+    // the last row of m is ignored
+    explicit AffineTransform(math::mat4f const& m) noexcept
+            : mColumns{ m[0].xyz, m[1].xyz, m[2].xyz, m[3].xyz } {
+    }
+
+    math::float3& operator[](size_t column) noexcept { return mColumns[column]; }
+    math::float3 const& operator[](size_t column) const noexcept { return mColumns[column]; }
+
+    math::mat3f upperLeft() const noexcept {
+        return { mColumns[0], mColumns[1], mColumns[2] };
+    }
+
+    math::float3 const& getTranslation() const noexcept { return mColumns[3]; }
+
+    math::mat4f asMat4f() const noexcept {
+        return { math::float4{ mColumns[0], 0 }, math::float4{ mColumns[1], 0 },
+                 math::float4{ mColumns[2], 0 }, math::float4{ mColumns[3], 1 } };
+    }
+
+    math::float3 transformPoint(math::float3 const& p) const noexcept {
+        return mColumns[0] * p.x + mColumns[1] * p.y + mColumns[2] * p.z + mColumns[3];
+    }
+
+    // written as multiply-adds of the columns of lhs so that it compiles to SIMD
+    friend AffineTransform operator*(AffineTransform const& UTILS_RESTRICT lhs,
+            AffineTransform const& UTILS_RESTRICT rhs) noexcept {
+        AffineTransform r(NO_INIT);
+        for (size_t i = 0; i < 4; i++) {
+            const math::float3 c = rhs[i];
+            r[i] = lhs[0] * c.x + lhs[1] * c.y + lhs[2] * c.z;
+        }
+        r[3] += lhs[3];
+        return r;
+    }
+
+private:
+    enum NoInit { NO_INIT };
+    explicit AffineTransform(NoInit) noexcept { }
+
+    math::float3 mColumns[4];
+};
+
+static_assert(sizeof(AffineTransform) == 48, "AffineTransform should be 48 bytes");
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_AFFINETRANSFORM_H
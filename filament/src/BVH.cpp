@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/BVH.h"
+
+#include <utils/Systrace.h>
+
+#include <math/vec4.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <assert.h>
+
+using namespace math;
+
+namespace filament {
+namespace details {
+
+void BVH::clear() noexcept {
+    mNodes.clear();
+    mSlots.clear();
+    mSlotToRow.clear();
+}
+
+void BVH::build(float3 const* UTILS_RESTRICT center, float3 const* UTILS_RESTRICT extent,
+        size_t count) noexcept {
+    SYSTRACE_CALL();
+
+    clear();
+    if (!count) {
+        return;
+    }
+
+    mSlots.resize(count);
+    mSlotToRow.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        mSlots[i] = i;
+        mSlotToRow[i] = i;
+    }
+
+    // a (roughly) balanced binary tree with leaves of LEAF_SIZE
+    mNodes.reserve(2 * ((count + LEAF_SIZE - 1) / LEAF_SIZE));
+    mNodes.push_back({ {}, 0, {}, uint32_t(count), 0 });
+
+    // nodes are split in the order they're created, so children always come after their parent
+    for (size_t n = 0; n < mNodes.size(); n++) {
+        const uint32_t first = mNodes[n].first;
+        const uint32_t c = mNodes[n].count;
+        if (c <= LEAF_SIZE) {
+            continue;
+        }
+
+        // split along the longest axis of the centers' bounds
+        float3 lo(std::numeric_limits<float>::max());
+        float3 hi(std::numeric_limits<float>::lowest());
+        for (uint32_t i = first; i < first + c; i++) {
+            lo = min(lo, center[mSlots[i]]);
+            hi = max(hi, center[mSlots[i]]);
+        }
+        const float3 size = hi - lo;
+        const size_t axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+        // the median split keeps the tree balanced, which bounds the traversal stack size
+        const uint32_t half = c / 2;
+        auto const begin = mSlots.begin() + first;
+        std::nth_element(begin, begin + half, begin + c,
+                [center, axis](uint32_t lhs, uint32_t rhs) {
+                    return center[lhs][axis] < center[rhs][axis];
+                });
+
+        const uint32_t child = uint32_t(mNodes.size());
+        mNodes[n].child = child;
+        mNodes.push_back({ {}, first, {}, half, 0 });
+        mNodes.push_back({ {}, first + half, {}, c - half, 0 });
+    }
+
+    refit(center, extent);
+}
+
+void BVH::setRows(uint32_t const* UTILS_RESTRICT slots, size_t count) noexcept {
+    assert(count == mSlotToRow.size());
+    uint32_t* const UTILS_RESTRICT slotToRow = mSlotToRow.data();
+    for (uint32_t i = 0; i < count; i++) {
+        slotToRow[slots[i]] = i;
+    }
+}
+
+void BVH::refit(float3 const* UTILS_RESTRICT center, float3 const* UTILS_RESTRICT extent) noexcept {
+    SYSTRACE_CALL();
+
+    uint32_t const* const UTILS_RESTRICT slots = mSlots.data();
+    uint32_t const* const UTILS_RESTRICT slotToRow = mSlotToRow.data();
+
+    // children are after their parent, so walking backward computes the bounds bottom-up
+    for (size_t n = mNodes.size(); n-- > 0;) {
+        Node& node = mNodes[n];
+        float3 lo, hi;
+        if (node.child) {
+            Node const& l = mNodes[node.child];
+            Node const& r = mNodes[node.child + 1];
+            lo = min(l.center - l.extent, r.center - r.extent);
+            hi = max(l.center + l.extent, r.center + r.extent);
+        } else {
+            lo = std::numeric_limits<float>::max();
+            hi = std::numeric_limits<float>::lowest();
+            for (uint32_t i = node.first, e = node.first + node.count; i < e; i++) {
+                const uint32_t row = slotToRow[slots[i]];
+                lo = min(lo, center[row] - extent[row]);
+                hi = max(hi, center[row] + extent[row]);
+            }
+        }
+        node.center = (hi + lo) * 0.5f;
+        node.extent = (hi - lo) * 0.5f;
+    }
+}
+
+BVH::Intersection BVH::classify(float4 const* UTILS_RESTRICT planes, Node const& node) noexcept {
+    // same convention as Culler: a point p is inside a plane when dot(plane.xyz, p) + plane.w < 0
+    Intersection result = Intersection::INSIDE;
+    for (size_t j = 0; j < 6; j++) {
+        const float d = dot(planes[j].xyz, node.center) + planes[j].w;
+        const float r = dot(abs(planes[j].xyz), node.extent);
+        if (d - r > 0) {
+            return Intersection::OUTSIDE;
+        }
+        if (d + r > 0) {
+            result = Intersection::INTERSECTS;
+        }
+    }
+    return result;
+}
+
+void BVH::cull(Culler::result_type* UTILS_RESTRICT results, Frustum const& frustum,
+        float3 const* UTILS_RESTRICT center, float3 const* UTILS_RESTRICT extent,
+        size_t bit) const noexcept {
+    SYSTRACE_CALL();
+
+    if (mNodes.empty()) {
+        return;
+    }
+
+    const CullParams params{ results, &frustum, center, extent, bit };
+    cullSubtree(params, 0, nullptr, nullptr);
+}
+
+void BVH::cull(utils::JobSystem& js, Culler::result_type* UTILS_RESTRICT results,
+        Frustum const& frustum, float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent, size_t bit) const noexcept {
+    SYSTRACE_CALL();
+
+    if (mNodes.empty()) {
+        return;
+    }
+
+    // the subtrees cover disjoint sets of rows, so the jobs never write the same results
+    const CullParams params{ results, &frustum, center, extent, bit };
+    if (mNodes[0].count < 2 * JOB_SIZE) {
+        cullSubtree(params, 0, nullptr, nullptr);
+        return;
+    }
+    utils::JobSystem::Job* parent = js.createJob();
+    cullSubtree(params, 0, &js, parent);
+    js.runAndWait(parent);
+}
+
+void BVH::cullSubtree(CullParams const& params, uint32_t root,
+        utils::JobSystem* js, utils::JobSystem::Job* parent) const noexcept {
+    Culler::result_type* const UTILS_RESTRICT results = params.results;
+    Frustum const& frustum = *params.frustum;
+    float3 const* const UTILS_RESTRICT center = params.center;
+    float3 const* const UTILS_RESTRICT extent = params.extent;
+    const size_t bit = params.bit;
+
+    float4 const* const UTILS_RESTRICT planes = frustum.getNormalizedPlanes();
+    uint32_t const* const UTILS_RESTRICT slots = mSlots.data();
+    uint32_t const* const UTILS_RESTRICT slotToRow = mSlotToRow.data();
+    const Culler::result_type visible = Culler::result_type(1u << bit);
+
+    // the tree is balanced, so its depth is at most log2 of the number of slots
+    uint32_t stack[64];
+    size_t sp = 0;
+    stack[sp++] = root;
+    while (sp) {
+        Node const& node = mNodes[stack[--sp]];
+        const Intersection intersection = classify(planes, node);
+        if (intersection == Intersection::OUTSIDE) {
+            continue;
+        }
+
+        if (intersection == Intersection::INSIDE) {
+            // accept the whole subtree
+            for (uint32_t i = node.first, e = node.first + node.count; i < e; i++) {
+                results[slotToRow[slots[i]]] |= visible;
+            }
+            continue;
+        }
+
+        if (node.child) {
+            // the right child of a large node is culled by another job, if there is one left
+            const uint32_t right = node.child + 1;
+            utils::JobSystem::Job* job = nullptr;
+            if (parent && mNodes[right].count >= JOB_SIZE) {
+                job = js->createJob(parent,
+                        [this, &params, right](utils::JobSystem& js, utils::JobSystem::Job* p) {
+                            cullSubtree(params, right, &js, p);
+                        });
+            }
+            if (job) {
+                js->run(job);
+            } else {
+                stack[sp++] = right;
+            }
+            stack[sp++] = node.child;
+            continue;
+        }
+
+        // this is a leaf that intersects the frustum, fallback to testing its AABBs
+        // Culler processes LEAF_SIZE AABBs at a time, pad with empty boxes
+        float3 c[LEAF_SIZE] = {};
+        float3 e[LEAF_SIZE] = {};
+        Culler::result_type r[LEAF_SIZE] = {};
+        for (uint32_t i = 0; i < node.count; i++) {
+            const uint32_t row = slotToRow[slots[node.first + i]];
+            c[i] = center[row];
+            e[i] = extent[row];
+        }
+        Culler::intersects(r, frustum, c, e, node.count, bit);
+        for (uint32_t i = 0; i < node.count; i++) {
+            results[slotToRow[slots[node.first + i]]] |= r[i];
+        }
+    }
+}
+
+} // namespace details
+} // namespace filament
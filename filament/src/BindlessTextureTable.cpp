@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "BindlessTextureTable.h"
+
+#include "details/Engine.h"
+
+#include <private/filament/UibGenerator.h>
+
+#include <utils/Log.h>
+
+namespace filament {
+
+using namespace utils;
+using namespace driver;
+using namespace details;
+
+void BindlessTextureTable::init(FEngine& engine) noexcept {
+    DriverApi& driver = engine.getDriverApi();
+    if (driver.isBindlessTextureSupported()) {
+        // nothing else uses this binding point, it stays bound
+        mUbh = driver.createUniformBuffer(UibGenerator::getBindlessTexturesUib().getSize());
+        driver.bindUniforms(BindingPoints::BINDLESS_TEXTURES, mUbh);
+    }
+}
+
+void BindlessTextureTable::terminate(DriverApi& driver) noexcept {
+    if (mUbh) {
+        driver.destroyUniformBuffer(mUbh);
+    }
+    mEntries.clear();
+    mFreeIndices.clear();
+}
+
+uint32_t BindlessTextureTable::getIndex(DriverApi& driver,
+        Handle<HwTexture> texture, SamplerParams params) noexcept {
+    assert(isSupported());
+
+    const uint64_t key = makeKey(texture, params);
+    auto pos = mEntries.find(key);
+    if (pos != mEntries.end()) {
+        return pos->second;
+    }
+
+    uint32_t index;
+    if (!mFreeIndices.empty()) {
+        index = mFreeIndices.back();
+        mFreeIndices.pop_back();
+    } else if (mCount < CONFIG_MAX_BINDLESS_TEXTURES) {
+        index = mCount++;
+    } else {
+        slog.e << "The table of bindless textures is full (" << CONFIG_MAX_BINDLESS_TEXTURES
+                << " textures)" << io::endl;
+        return 0;
+    }
+
+    driver.updateBindlessTexture(mUbh, index, texture, params);
+    mEntries[key] = index;
+    return index;
+}
+
+void BindlessTextureTable::remove(Handle<HwTexture> texture) noexcept {
+    for (auto it = mEntries.begin(); it != mEntries.end();) {
+        if ((it->first >> 32u) == texture.getId()) {
+            mFreeIndices.push_back(it->second);
+            it = mEntries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+} // namespace filament
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef TNT_FILAMENT_BINDLESSTEXTURETABLE_H
+#define TNT_FILAMENT_BINDLESSTEXTURETABLE_H
+
+#include "driver/DriverApiForward.h"
+#include "driver/Handle.h"
+
+#include <filament/driver/DriverEnums.h>
+
+#include <tsl/robin_map.h>
+
+#include <vector>
+
+namespace filament {
+
+namespace details {
+class FEngine;
+} // namespace details
+
+/*
+ * The table of the textures read through bindless handles by the materials built with
+ * MaterialBuilder::bindlessSamplers(). It's a uniform buffer shared by all the materials, the
+ * material instances only store the index of their textures. This is empty when the driver
+ * doesn't support bindless textures.
+ */
+class BindlessTextureTable {
+public:
+    void init(details::FEngine& engine) noexcept;
+
+    void terminate(driver::DriverApi& driver) noexcept;
+
+    bool isSupported() const noexcept { return bool(mUbh); }
+
+    // Returns the index of this texture and sampler pair, which is added to the table the
+    // first time. Index 0 is returned when the table is full.
+    uint32_t getIndex(driver::DriverApi& driver,
+            Handle<HwTexture> texture, driver::SamplerParams params) noexcept;
+
+    // Frees the entries of a texture, which is about to be destroyed.
+    void remove(Handle<HwTexture> texture) noexcept;
+
+private:
+    static uint64_t makeKey(Handle<HwTexture> texture, driver::SamplerParams params) noexcept {
+        return (uint64_t(texture.getId()) << 32u) | params.u;
+    }
+
+    Handle<HwUniformBuffer> mUbh;
+    tsl::robin_map<uint64_t, uint32_t> mEntries;
+    std::vector<uint32_t> mFreeIndices;
+    uint32_t mCount = 0;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_BINDLESSTEXTURETABLE_H
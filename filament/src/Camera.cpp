@@ -171,7 +171,7 @@ void FCamera::lookAt(const float3& eye, const float3& center, const float3& up)
     setModelMatrix(mat4f::lookAt(eye, center, up));
 }
 
-mat4f const& FCamera::getModelMatrix() const noexcept {
+mat4f FCamera::getModelMatrix() const noexcept {
     FTransformManager const& transformManager = mEngine.getTransformManager();
     return transformManager.getWorldTransform(transformManager.getInstance(mEntity));
 }
@@ -185,6 +185,10 @@ Frustum FCamera::getFrustum() const noexcept {
     return FCamera::getFrustum(mProjectionForCulling, getViewMatrix());
 }
 
+void FCamera::contentChanged() noexcept {
+    mEngine.contentChanged();
+}
+
 void FCamera::setExposure(float aperture, float shutterSpeed, float sensitivity) noexcept {
     mAperture = clamp(aperture, MIN_APERTURE, MAX_APERTURE);
     mShutterSpeed = clamp(shutterSpeed, MIN_SHUTTER_SPEED, MAX_SHUTTER_SPEED);
@@ -258,19 +262,23 @@ mat4  Camera::inverseProjection(const mat4 & p) noexcept {
 void Camera::setProjection(Camera::Projection projection, double left, double right, double bottom,
         double top, double near, double far) noexcept {
     upcast(this)->setProjection(projection, left, right, bottom, top, near, far);
+    upcast(this)->contentChanged();
 }
 
 void Camera::setProjection(double fov, double aspect, double near, double far,
         Camera::Fov direction) noexcept {
     upcast(this)->setProjection(fov, aspect, near, far, direction);
+    upcast(this)->contentChanged();
 }
 
 void Camera::setLensProjection(double focalLength, double near, double far) noexcept {
     upcast(this)->setLensProjection(focalLength, near, far);
+    upcast(this)->contentChanged();
 }
 
 void Camera::setCustomProjection(math::mat4 const& projection, double near, double far) noexcept {
     upcast(this)->setCustomProjection(projection, near, far);
+    upcast(this)->contentChanged();
 }
 
 const math::mat4& Camera::getProjectionMatrix() const noexcept {
@@ -331,6 +339,7 @@ utils::Entity Camera::getEntity() const noexcept {
 
 void Camera::setExposure(float aperture, float shutterSpeed, float ISO) noexcept {
     upcast(this)->setExposure(aperture, shutterSpeed, ISO);
+    upcast(this)->contentChanged();
 }
 
 float Camera::getAperture() const noexcept {
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/CullingCache.h"
+
+#include <filament/Box.h>
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+using namespace math;
+
+namespace filament {
+namespace details {
+
+void CullingCache::prepare(FScene const* scene) noexcept {
+    if (scene != mScene || (scene && scene->getGeneration() != mSceneGeneration)) {
+        mScene = scene;
+        mSceneGeneration = scene ? scene->getGeneration() : 0;
+        mCachedBits = 0;
+    }
+    mCulledBits = 0;
+}
+
+bool CullingCache::reuse(FScene::RenderableSoa& renderableData, Frustum const& frustum,
+        size_t bit) noexcept {
+    const uint32_t bitMask = 1u << bit;
+    if (!(mCachedBits & bitMask) || memcmp(frustum.getNormalizedPlanes(),
+            mFrusta[bit].getNormalizedPlanes(), sizeof(float4) * 6)) {
+        return false;
+    }
+
+    SYSTRACE_CALL();
+
+    auto const* instances = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* transformVersions = renderableData.data<FScene::TRANSFORM_VERSION>();
+    auto const* renderableVersions = renderableData.data<FScene::RENDERABLE_VERSION>();
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    Culler::result_type* visibleArray = renderableData.data<FScene::VISIBLE_MASK>();
+    Entry* const entries = mEntries.data();
+
+    for (size_t i = 0, c = renderableData.size(); i < c; i++) {
+        Entry& entry = entries[instances[i].asValue()];
+        if (UTILS_UNLIKELY(entry.transformVersion != transformVersions[i] ||
+                           entry.renderableVersion != renderableVersions[i])) {
+            // only the renderables that changed are culled again
+            const bool visible = Culler::intersects(frustum,
+                    Box{ worldAABBCenter[i], worldAABBExtent[i] });
+            entry.mask = Culler::result_type((entry.mask & ~bitMask) | (visible ? bitMask : 0u));
+        }
+        visibleArray[i] |= entry.mask & bitMask;
+    }
+    mCulledBits |= bitMask;
+    return true;
+}
+
+void CullingCache::store(FScene::RenderableSoa const& renderableData, Frustum const& frustum,
+        size_t bit) noexcept {
+    SYSTRACE_CALL();
+
+    auto const* instances = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    Culler::result_type const* visibleArray = renderableData.data<FScene::VISIBLE_MASK>();
+    const size_t count = renderableData.size();
+
+    uint32_t maxInstance = 0;
+    for (size_t i = 0; i < count; i++) {
+        maxInstance = std::max(maxInstance, instances[i].asValue());
+    }
+    if (mEntries.size() <= maxInstance) {
+        mEntries.resize(maxInstance + 1);
+    }
+
+    const uint32_t bitMask = 1u << bit;
+    Entry* const entries = mEntries.data();
+    for (size_t i = 0; i < count; i++) {
+        Entry& entry = entries[instances[i].asValue()];
+        entry.mask = Culler::result_type((entry.mask & ~bitMask) | (visibleArray[i] & bitMask));
+    }
+    mFrusta[bit] = frustum;
+    mCachedBits |= bitMask;
+    mCulledBits |= bitMask;
+}
+
+void CullingCache::commit(FScene::RenderableSoa const& renderableData) noexcept {
+    // the bits that weren't culled during this frame miss the changes of this frame
+    mCachedBits &= mCulledBits;
+    if (!mCachedBits) {
+        return;
+    }
+
+    auto const* instances = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* transformVersions = renderableData.data<FScene::TRANSFORM_VERSION>();
+    auto const* renderableVersions = renderableData.data<FScene::RENDERABLE_VERSION>();
+    Entry* const entries = mEntries.data();
+    for (size_t i = 0, c = renderableData.size(); i < c; i++) {
+        Entry& entry = entries[instances[i].asValue()];
+        entry.transformVersion = transformVersions[i];
+        entry.renderableVersion = renderableVersions[i];
+    }
+}
+
+void CullingCache::clear() noexcept {
+    mEntries.clear();
+    mCachedBits = 0;
+    mCulledBits = 0;
+    mScene = nullptr;
+    mSceneGeneration = 0;
+}
+
+} // namespace details
+} // namespace filament
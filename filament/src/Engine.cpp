@@ -23,6 +23,7 @@
 #include "details/IndexBuffer.h"
 #include "details/IndirectLight.h"
 #include "details/Material.h"
+#include "details/MorphTargetBuffer.h"
 #include "details/Renderer.h"
 #include "details/RenderPrimitive.h"
 #include "details/Scene.h"
@@ -43,7 +44,9 @@
 #include <filaflat/MaterialParser.h>
 #include <filaflat/ShaderBuilder.h>
 
+#include <utils/algorithm.h>
 #include <utils/compiler.h>
+#include <utils/CpuTopology.h>
 #include <utils/CString.h>
 #include <utils/Log.h>
 #include <utils/Panic.h>
@@ -52,6 +55,7 @@
 #include <math/fast.h>
 #include <math/scalar.h>
 
+#include <algorithm>
 #include <functional>
 
 #include <stdio.h>
@@ -71,8 +75,21 @@ namespace details {
 static std::unordered_map<Engine const*, std::unique_ptr<FEngine>> sEngines;
 static std::mutex sEnginesLock;
 
-FEngine* FEngine::create(Backend backend, ExternalContext* externalContext, void* sharedGLContext) {
-    FEngine* instance = new FEngine(backend, externalContext, sharedGLContext);
+FEngine* FEngine::create(Backend backend, ExternalContext* externalContext, void* sharedGLContext,
+        CommandBufferOptions const* commandBufferOptions, ThreadPolicy threadPolicy,
+        JobSystem* jobSystem) {
+    CommandBufferOptions options;
+    if (commandBufferOptions) {
+        options = *commandBufferOptions;
+    }
+    // RenderPass records its commands in batches of a fraction of the default minimum size
+    options.minCommandBufferSize = std::max(options.minCommandBufferSize,
+            CONFIG_MIN_COMMAND_BUFFERS_SIZE);
+    options.commandBufferSize = std::max(options.commandBufferSize,
+            2 * options.minCommandBufferSize);
+
+    FEngine* instance = new FEngine(backend, externalContext, sharedGLContext, options,
+            threadPolicy, jobSystem);
 
     slog.i << "FEngine (" << sizeof(void*) * 8 << " bits) created at " << instance << io::endl;
 
@@ -80,10 +97,12 @@ FEngine* FEngine::create(Backend backend, ExternalContext* externalContext, void
     // (this cannot be done safely in the ctor)
 
     // start the driver thread
+    const clock::time_point start = clock::now();
     instance->mDriverThread = std::thread(&FEngine::loop, instance);
 
     // wait for the driver to be ready
     instance->mDriverBarrier.await();
+    instance->mStartupStats.driver = uint64_t((clock::now() - start).count());
 
     if (UTILS_UNLIKELY(!instance->mDriver)) {
         // something went horribly wrong during driver initialization
@@ -93,6 +112,7 @@ FEngine* FEngine::create(Backend backend, ExternalContext* externalContext, void
 
     // now we can initialize the largest part of the engine
     instance->init();
+    instance->mStartupStats.total = uint64_t((clock::now() - start).count());
 
     return instance;
 }
@@ -101,8 +121,8 @@ UniformInterfaceBlock FEngine::PerViewUib::getUib() noexcept {
     return UibGenerator::getPerViewUib();
 }
 
-UniformInterfaceBlock FEngine::PerRenderableUib::getUib() noexcept {
-    return UibGenerator::getPerRenderableUib();
+UniformInterfaceBlock FEngine::PerInstanceUib::getUib() noexcept {
+    return UibGenerator::getPerInstanceUib();
 }
 
 UniformInterfaceBlock FEngine::PostProcessingUib::getUib() noexcept {
@@ -113,6 +133,10 @@ SamplerInterfaceBlock FEngine::PerViewSib::getSib() noexcept {
     return SibGenerator::getPerViewSib();
 }
 
+SamplerInterfaceBlock FEngine::PerRenderableSib::getSib() noexcept {
+    return SibGenerator::getPerRenderableSib();
+}
+
 SamplerInterfaceBlock FEngine::PostProcessSib::getSib() noexcept {
     return SibGenerator::getPostProcessSib();
 }
@@ -124,10 +148,52 @@ static const half4 sFullScreenTriangleVertices[3] = {
         { -1.0_h,  3.0_h, 1.0_h, 1.0_h }
 };
 
+// with reverse-Z, the far plane is at z=0 (the skybox relies on this)
+static const half4 sFullScreenTriangleVerticesReversedZ[3] = {
+        { -1.0_h, -1.0_h, 0.0_h, 1.0_h },
+        {  3.0_h, -1.0_h, 0.0_h, 1.0_h },
+        { -1.0_h,  3.0_h, 0.0_h, 1.0_h }
+};
+
 // these must be static because only a pointer is copied to the render stream
 static const uint16_t sFullScreenTriangleIndices[3] = { 0, 1, 2 };
 
-FEngine::FEngine(Backend backend, ExternalContext* externalContext, void* sharedGLContext) :
+// the threads are only pinned when the cores are not all the same
+static uint32_t getDriverAffinityMask(Engine::ThreadPolicy policy) noexcept {
+    CpuTopology const& topology = CpuTopology::get();
+    if (policy == Engine::ThreadPolicy::UNPINNED || !topology.isHeterogeneous()) {
+        return 0;
+    }
+    return topology.getBigCoresMask();
+}
+
+static uint32_t getWorkerAffinityMask(Engine::ThreadPolicy policy) noexcept {
+    CpuTopology const& topology = CpuTopology::get();
+    if (policy != Engine::ThreadPolicy::BIG_CORES || !topology.isHeterogeneous()) {
+        return 0;
+    }
+    return topology.getAllCoresMask() & ~topology.getLittleCoresMask();
+}
+
+static size_t getWorkerThreadCount(Engine::ThreadPolicy policy) noexcept {
+#if defined(__EMSCRIPTEN_PTHREADS__)
+    // A web worker can only start when the main thread yields, the threads must fit in the pool
+    // of workers started with the module, one of them being the driver thread.
+    const size_t hwThreads = std::max(2u, std::thread::hardware_concurrency());
+    return std::max(size_t(1), std::min(hwThreads, size_t(FILAMENT_WEBGL_PTHREAD_POOL_SIZE)) - 2);
+#else
+    const uint32_t mask = getWorkerAffinityMask(policy);
+    if (!mask) {
+        return 0; // JobSystem's default
+    }
+    // leave a core for the driver thread
+    return std::max(1u, utils::popcount(mask) - 1u);
+#endif
+}
+
+FEngine::FEngine(Backend backend, ExternalContext* externalContext, void* sharedGLContext,
+        CommandBufferOptions const& commandBufferOptions, ThreadPolicy threadPolicy,
+        JobSystem* jobSystem) :
         mBackend(backend),
         mExternalContext(externalContext),
         mSharedGLContext(sharedGLContext),
@@ -136,13 +202,22 @@ FEngine::FEngine(Backend backend, ExternalContext* externalContext, void* shared
         mTransformManager(),
         mLightManager(*this),
         mCameraManager(*this),
+        mParticleManager(*this),
         mPerViewUib(PerViewUib::getUib()),
         mPerRenderableUib(PerRenderableUib::getUib()),
+        mPerInstanceUib(PerInstanceUib::getUib()),
         mPerViewSib(PerViewSib::getSib()),
+        mPerRenderableSib(PerRenderableSib::getSib()),
         mPostProcessUib(PostProcessingUib::getUib()),
         mPostProcessSib(PostProcessSib::getSib()),
-        mCommandBufferQueue(CONFIG_MIN_COMMAND_BUFFERS_SIZE, CONFIG_COMMAND_BUFFERS_SIZE),
+        mDriverAffinityMask(getDriverAffinityMask(threadPolicy)),
+        mCommandBufferQueue(commandBufferOptions.minCommandBufferSize,
+                commandBufferOptions.commandBufferSize, commandBufferOptions.maxCommandBufferSize),
         mPerRenderPassAllocator("per-renderpass allocator", CONFIG_PER_RENDER_PASS_ARENA_SIZE),
+        mCommandsTracking("commands", CONFIG_PER_FRAME_COMMANDS_SIZE),
+        mOwnJobSystem(jobSystem ? nullptr : new JobSystem(getWorkerThreadCount(threadPolicy), 1,
+                getWorkerAffinityMask(threadPolicy))),
+        mJobSystem(jobSystem ? *jobSystem : *mOwnJobSystem),
         mEpoch(std::chrono::steady_clock::now()),
         mDriverBarrier(1)
 {
@@ -150,6 +225,7 @@ FEngine::FEngine(Backend backend, ExternalContext* externalContext, void* shared
 
     // we're assuming we're on the main thread here.
     // (it may not be the case)
+    // A shared JobSystem may already have adopted this thread, in which case this is a no-op.
     mJobSystem.adopt();
 }
 
@@ -159,17 +235,41 @@ FEngine::FEngine(Backend backend, ExternalContext* externalContext, void* shared
  */
 
 void FEngine::init() {
+    const clock::time_point start = clock::now();
+
     // this must be first.
     mCommandStream = CommandStream(*mDriver, mCommandBufferQueue.getCircularBuffer());
     DriverApi& driverApi = getDriverApi();
 
-    // Parse all post process shaders now, but create them lazily
-    mPostProcessParser = std::make_unique<filaflat::MaterialParser>(mBackend,
-            POST_PROCESS_PACKAGE, POST_PROCESS_PACKAGE_SIZE);
+    // reverse-Z only improves the depth precision if clip-space Z is [0, w], otherwise
+    // we keep the conventional depth mapping.
+    mReversedZ = driverApi.isClipSpaceZeroToOne();
+
+    // sorts the color commands by state change cost, see Engine::getDriverStateStats()
+    mDebugRegistry.registerProperty("d.renderpass.state_sorting", &debug.renderpass.state_sorting);
+
+    // counts the variants used by each material, see FMaterial::dumpVariantUsage()
+    mDebugRegistry.registerProperty("d.material.variant_usage", &debug.material.variant_usage);
 
-    UTILS_UNUSED_IN_RELEASE bool ppMaterialOk =
-            mPostProcessParser->parse() && mPostProcessParser->isPostProcessMaterial();
-    assert(ppMaterialOk);
+    // heatmaps of the overdraw, the froxels' lights and the shadow map density, see DebugView
+    mDebugRegistry.registerProperty("d.view.overdraw", &debug.view.overdraw);
+    mDebugRegistry.registerProperty("d.view.froxel_lights", &debug.view.froxel_lights);
+    mDebugRegistry.registerProperty("d.view.shadow_density", &debug.view.shadow_density);
+
+    // Parse all post process shaders now, but create them lazily. This doesn't need the
+    // driver, so it's done by a job while we create the other built-in resources.
+    JobSystem& js = mJobSystem;
+    JobSystem::Job* initJob = js.createJob();
+    js.run(jobs::createJob(js, initJob, [this]() {
+        // the package is static, it's referenced rather than copied
+        mPostProcessParser = std::make_unique<filaflat::MaterialParser>(mBackend,
+                POST_PROCESS_PACKAGE, POST_PROCESS_PACKAGE_SIZE,
+                filaflat::MaterialParser::ReferencePackage{});
+
+        UTILS_UNUSED_IN_RELEASE bool ppMaterialOk =
+                mPostProcessParser->parse() && mPostProcessParser->isPostProcessMaterial();
+        assert(ppMaterialOk);
+    }));
 
     mFullScreenTriangleVb = upcast(VertexBuffer::Builder()
             .vertexCount(3)
@@ -177,8 +277,9 @@ void FEngine::init() {
             .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::HALF4, 0)
             .build(*this));
 
-    mFullScreenTriangleVb->setBufferAt(*this, 0,
-            { sFullScreenTriangleVertices, sizeof(sFullScreenTriangleVertices) });
+    mFullScreenTriangleVb->setBufferAt(*this, 0, {
+            mReversedZ ? sFullScreenTriangleVerticesReversedZ : sFullScreenTriangleVertices,
+            sizeof(sFullScreenTriangleVertices) });
 
     mFullScreenTriangleIb = upcast(IndexBuffer::Builder()
             .indexCount(3)
@@ -195,6 +296,9 @@ void FEngine::init() {
     driverApi.setRenderPrimitiveRange(mFullScreenTriangleRph, Driver::PrimitiveType::TRIANGLES,
             0, 0, 2, (uint32_t)mFullScreenTriangleIb->getIndexCount());
 
+    // its content is never read, the first instance uses the per-renderable uniforms
+    mDefaultInstanceUbh = driverApi.createUniformBuffer(mPerInstanceUib.getSize());
+
     mDefaultIblTexture = upcast(Texture::Builder()
             .width(1).height(1).levels(1)
             .format(Texture::InternalFormat::RGBM)
@@ -217,14 +321,33 @@ void FEngine::init() {
 
     mPostProcessManager.init(*this);
     mRenderTargetPool.init(*this);
+    mBindlessTextureTable.init(*this);
     mLightManager.init(*this);
+    mTransformManager.setJobSystem(&mJobSystem);
     mDFG.reset(new DFG(*this));
 
+    const clock::time_point materialStart = clock::now();
+    mStartupStats.resources = uint64_t((materialStart - start).count());
+
     // Always initialize the default material, most materials' depth shaders fallback on it.
+    // Like the post-process package, it lives in the library's read-only data, so it's paged in
+    // as needed and shared by all the processes using the library.
     mDefaultMaterial = upcast(
             FMaterial::DefaultMaterialBuilder()
-                    .package(DEFAULT_MATERIAL_PACKAGE, DEFAULT_MATERIAL_PACKAGE_SIZE)
+                    .externalPackage(DEFAULT_MATERIAL_PACKAGE, DEFAULT_MATERIAL_PACKAGE_SIZE)
                     .build(*const_cast<FEngine*>(this)));
+
+    // The depth programs of the default material are shared by all the other materials, start
+    // building them in the background, the first material will only wait for what's left.
+    for (uint8_t i = 0; i < VARIANT_COUNT; i++) {
+        if (Variant(i).isDepthPass()) {
+            mDefaultMaterial->prepareProgram(i);
+        }
+    }
+
+    mStartupStats.defaultMaterial = uint64_t((clock::now() - materialStart).count());
+
+    js.runAndWait(initJob);
 }
 
 FEngine::~FEngine() noexcept {
@@ -235,24 +358,35 @@ void FEngine::shutdown() {
 #ifndef NDEBUG
     // print out some statistics about this run
     size_t wm = mCommandBufferQueue.getHigWatermark();
-    size_t wmpct = wm / (CONFIG_COMMAND_BUFFERS_SIZE / 100);
+    size_t wmpct = wm / (mCommandBufferQueue.getCircularBuffer().size() / 100);
     slog.d << "CircularBuffer: High watermark "
-           << wm / 1024 << " KiB (" << wmpct << "%)" << io::endl;
+           << wm / 1024 << " KiB (" << wmpct << "%), "
+           << mCommandBufferQueue.getStallCount() << " stalls" << io::endl;
 #endif
 
     DriverApi& driver = getDriverApi();
 
+    // we can't destroy anything while commands are still being recorded
+    waitForPendingCommands();
+
     /*
      * Destroy our own state first
      */
 
     mPostProcessManager.terminate(driver);  // free-up post-process manager resources
     mRenderTargetPool.terminate(driver);    // free-up all offscreen render targets
+    mBindlessTextureTable.terminate(driver);    // free-up the table of bindless textures
     mDFG->terminate();                      // free-up the DFG
+    mParticleManager.terminate();           // free-up all particle emitters
     mRenderableManager.terminate();         // free-up all renderables
     mLightManager.terminate();              // free-up all lights
     mCameraManager.terminate();             // free-up all cameras
 
+    for (Handle<HwUniformBuffer> ubh : mInstanceUbhs) {
+        driver.destroyUniformBuffer(ubh);
+    }
+    driver.destroyUniformBuffer(mDefaultInstanceUbh);
+
     driver.destroyRenderPrimitive(mFullScreenTriangleRph);
     destroy(mFullScreenTriangleIb);
     destroy(mFullScreenTriangleVb);
@@ -276,9 +410,16 @@ void FEngine::shutdown() {
     for (FMaterial const* material : mSkyboxMaterials) {
         destroy(material);
     }
+    for (FMaterialInstance const* mi : mDebugViewMaterialInstances) {
+        destroy(mi);
+    }
+    destroy(mDebugViewMaterial);
+    destroy(mGpuCullingMaterial);
+    destroy(mParticlesMaterial);
 
     cleanupResourceList(mIndexBuffers);
     cleanupResourceList(mVertexBuffers);
+    cleanupResourceList(mMorphTargetBuffers);
     cleanupResourceList(mTextures);
     cleanupResourceList(mMaterials);
     for (auto& item : mMaterialInstances) {
@@ -301,19 +442,110 @@ void FEngine::shutdown() {
     mDriverThread.join();
     mTerminated = true;
 
-    // detach this thread from the jobsystem
-    mJobSystem.emancipate();
+    // detach this thread from the jobsystem, a shared JobSystem can still be in use by the
+    // other Engines on this thread
+    if (mOwnJobSystem) {
+        mJobSystem.emancipate();
+    }
 }
 
 void FEngine::prepare() {
     SYSTRACE_CALL();
-    // prepare() is called once per Renderer frame. Ideally we would upload the content of
-    // UBOs that are visible only. It's not such a big issue because the actual upload() is
-    // skipped is the UBO hasn't changed. Still we could have a lot of these.
-    for (auto& materialInstanceList : mMaterialInstances) {
-        for (auto& item : materialInstanceList.second) {
-            item->commit(*this);
+
+    if (UTILS_UNLIKELY(getDeferredDestroyCount())) {
+        processDeferredDestroys();
+    }
+
+    // prepare() is called once per Renderer frame. Only the material instances modified since
+    // the previous frame upload their buffers, there could be many more of them.
+    for (FMaterialInstance const* mi : mDirtyMaterialInstances) {
+        mi->commit(*this);
+    }
+    mDirtyMaterialInstances.clear();
+
+    // the per-instance uniform buffers are updated (at most) once per frame
+    mInstanceUbhsUsed = 0;
+
+    // the views of the previous frame recorded the levels needed by the streaming textures
+    mTextureStreamer.update(*this);
+
+    // the particles are simulated once per frame, the views only sort and draw them
+    mParticleManager.prepare();
+}
+
+uint64_t FEngine::getContentVersion() const noexcept {
+    // all the versions only ever increase, so their sum changes whenever one of them does
+    FTransformManager const& tcm = mTransformManager;
+    FRenderableManager const& rcm = mRenderableManager;
+    FLightManager const& lcm = mLightManager;
+    return getResourceContentVersion() +
+           tcm.getVersion() + tcm.getStructureVersion() +
+           rcm.getVersion() + rcm.getStructureVersion() +
+           lcm.getVersion() + lcm.getStructureVersion() - mIgnoredContentChanges;
+}
+
+uint64_t FEngine::getGlobalContentVersion() const noexcept {
+    FTransformManager const& tcm = mTransformManager;
+    FRenderableManager const& rcm = mRenderableManager;
+    FLightManager const& lcm = mLightManager;
+    return getResourceContentVersion() +
+           tcm.getStructureVersion() + rcm.getStructureVersion() +
+           lcm.getVersion() + lcm.getStructureVersion();
+}
+
+void FEngine::removeDirtyMaterialInstance(FMaterialInstance const* mi) noexcept {
+    auto& list = mDirtyMaterialInstances;
+    auto pos = std::find(list.begin(), list.end(), mi);
+    if (pos != list.end()) {
+        *pos = list.back();
+        list.pop_back();
+    }
+}
+
+Handle<HwUniformBuffer> FEngine::acquireInstanceUniformBuffer() noexcept {
+    if (mInstanceUbhsUsed == mInstanceUbhs.size()) {
+        if (UTILS_UNLIKELY(mInstanceUbhs.size() == CONFIG_MAX_INSTANCED_DRAW_COUNT)) {
+            return {};
         }
+        mInstanceUbhs.push_back(getDriverApi().createUniformBuffer(mPerInstanceUib.getSize()));
+    }
+    return mInstanceUbhs[mInstanceUbhsUsed++];
+}
+
+size_t FEngine::RenderPrimitiveKey::Hasher::operator()(
+        RenderPrimitiveKey const& key) const noexcept {
+    size_t hash = key.vbh.getId();
+    for (uint32_t value : { uint32_t(key.ibh.getId()), key.enabledAttributes,
+            uint32_t(key.type), key.offset, key.minIndex, key.maxIndex, key.count }) {
+        hash = hash * 31u + value;
+    }
+    return hash;
+}
+
+Handle<HwRenderPrimitive> FEngine::acquireRenderPrimitive(
+        RenderPrimitiveKey const& key) noexcept {
+    auto pos = mRenderPrimitives.find(key);
+    if (pos != mRenderPrimitives.end()) {
+        pos.value().count++;
+        return pos->second.handle;
+    }
+    DriverApi& driver = getDriverApi();
+    Handle<HwRenderPrimitive> handle = driver.createRenderPrimitive();
+    if (key.vbh && key.ibh) {
+        driver.setRenderPrimitiveBuffer(handle, key.vbh, key.ibh, key.enabledAttributes);
+        driver.setRenderPrimitiveRange(handle, key.type,
+                key.offset, key.minIndex, key.maxIndex, key.count);
+    }
+    mRenderPrimitives[key] = { handle, 1 };
+    return handle;
+}
+
+void FEngine::releaseRenderPrimitive(RenderPrimitiveKey const& key) noexcept {
+    auto pos = mRenderPrimitives.find(key);
+    assert(pos != mRenderPrimitives.end());
+    if (--pos.value().count == 0) {
+        getDriverApi().destroyRenderPrimitive(pos->second.handle);
+        mRenderPrimitives.erase(pos);
     }
 }
 
@@ -332,13 +564,40 @@ void FEngine::gc() {
             JobSystem::DONT_SIGNAL);
 
     js.runAndWait(parent);
+
+    // this destroys driver objects, so it can't run in a job
+    mParticleManager.gc(mEntityManager);
 }
 
 void FEngine::flush() {
+    // the reserved parts of the command buffer must be filled before it's flushed
+    waitForPendingCommands();
     // flush the command buffer
     flushCommandBuffer(mCommandBufferQueue);
 }
 
+void FEngine::beginDeferredCommands() noexcept {
+    mDeferCommands = true;
+    if (!mPendingCommandsJob) {
+        // this job is only run by waitForPendingCommands(), so that it can be waited on
+        // even after all its children have completed.
+        mPendingCommandsJob = mJobSystem.createJob();
+    }
+}
+
+void FEngine::waitForPendingCommands() noexcept {
+    if (mPendingCommandsJob) {
+        SYSTRACE_CALL();
+        mJobSystem.runAndWait(mPendingCommandsJob);
+        mPendingCommandsJob = nullptr;
+        mPendingCommandsRecorded = false;
+        if (mDeferCommands) {
+            // we've been called in the middle of deferred commands (e.g. by a flush())
+            mPendingCommandsJob = mJobSystem.createJob();
+        }
+    }
+}
+
 // -----------------------------------------------------------------------------------------------
 // Render thread / command queue
 // -----------------------------------------------------------------------------------------------
@@ -348,7 +607,8 @@ int FEngine::loop() {
         mExternalContext = ExternalContext::create(&mBackend);
 #if !defined(NDEBUG)
         slog.d << "FEngine resolved backend: "
-               << (mBackend == driver::Backend::VULKAN ? "Vulkan" : "OpenGL") << io::endl;
+               << (mBackend == driver::Backend::VULKAN ? "Vulkan" :
+                   mBackend == driver::Backend::NOOP ? "Noop" : "OpenGL") << io::endl;
 #endif
     }
     mDriver = mExternalContext->createDriver(mSharedGLContext);
@@ -362,8 +622,16 @@ int FEngine::loop() {
     JobSystem::setThreadName("FEngine::loop");
     JobSystem::setThreadPriority(JobSystem::Priority::DISPLAY);
 
-    // FIXME: we should do this based on the CPUs we actually have
-    uint32_t affinityMask = (std::thread::hardware_concurrency() >= 6) ? 0xF0 : 0;
+    const uint32_t affinityMask = mDriverAffinityMask;
+
+#if CAPTURE_COMMAND_STREAM
+    CommandStreamCapture capture(CAPTURE_COMMAND_STREAM_PATH);
+    mDriver->setCapture(&capture);
+#endif
+
+#if PROFILE_COMMAND_STREAM
+    mDriver->setProfiler(&mCommandStreamProfiler);
+#endif
 
     auto& commandBufferQueue = mCommandBufferQueue;
     while (true) {
@@ -381,17 +649,114 @@ int FEngine::loop() {
         // execute all command buffers
         for (auto& item : buffers) {
             if (UTILS_LIKELY(item.begin)) {
+                mExecuteStart = std::chrono::steady_clock::now();
                 mCommandStream.execute(item.begin);
+                mDriverBusyTime += std::chrono::steady_clock::now() - mExecuteStart;
                 mCommandBufferQueue.releaseBuffer(item);
             }
         }
     }
 
+#if CAPTURE_COMMAND_STREAM
+    mDriver->setCapture(nullptr);
+#endif
+
+#if PROFILE_COMMAND_STREAM
+    mDriver->setProfiler(nullptr);
+#endif
+
     // terminate() is a synchronous API
     getDriverApi().terminate();
     return 0;
 }
 
+Engine::CommandBufferStats FEngine::getCommandBufferStats() const noexcept {
+    CommandBufferQueue const& queue = mCommandBufferQueue;
+    CommandBufferStats stats;
+    stats.size = queue.getCircularBuffer().size();
+    stats.highWatermark = queue.getHigWatermark();
+    stats.stallDuration = queue.getStallDuration();
+    stats.stallCount = queue.getStallCount();
+    stats.growthCount = queue.getGrowthCount();
+    stats.flushedSize = queue.getFlushedSize();
+    return stats;
+}
+
+template<typename TRACKING>
+static Engine::ArenaStats getArenaStats(TRACKING const& tracking) noexcept {
+    Engine::ArenaStats stats;
+    stats.size = tracking.getSize();
+    stats.highWatermark = tracking.getHighWatermark();
+    stats.allocationCount = tracking.getAllocationCount();
+    stats.overflowCount = tracking.getOverflowCount();
+    return stats;
+}
+
+Engine::MemoryStats FEngine::getMemoryStats() noexcept {
+    MemoryStats stats;
+    stats.perRenderPass = getArenaStats(mPerRenderPassAllocator.getListener());
+    for (FRenderer const* renderer : mRenderers) {
+        // renderers pipelining their frames use their own arenas, with the same size
+        for (size_t i = 0; i < 2 && renderer->getPipelinedArena(i); i++) {
+            const ArenaStats pipelined = getArenaStats(renderer->getPipelinedArena(i)->getListener());
+            stats.perRenderPass.highWatermark =
+                    std::max(stats.perRenderPass.highWatermark, pipelined.highWatermark);
+            stats.perRenderPass.allocationCount += pipelined.allocationCount;
+            stats.perRenderPass.overflowCount += pipelined.overflowCount;
+        }
+    }
+    stats.commands = getArenaStats(mCommandsTracking);
+
+    Driver::HandleArenaStats handles;
+    if (getDriverApi().getHandleArenaStats(&handles)) {
+        stats.handles.size = handles.size;
+        stats.handles.highWatermark = handles.highWatermark;
+        stats.handles.allocationCount = handles.allocationCount;
+        stats.handles.overflowCount = handles.overflowCount;
+    }
+
+    Driver::GpuMemoryStats gpu;
+    if (getDriverApi().getGpuMemoryStats(&gpu)) {
+        auto counter = [&gpu](Driver::GpuMemoryStats::Category category) {
+            return GpuMemoryCounter{ gpu.size[category], gpu.peak[category] };
+        };
+        stats.gpu.textures       = counter(Driver::GpuMemoryStats::TEXTURE);
+        stats.gpu.renderTargets  = counter(Driver::GpuMemoryStats::RENDER_TARGET);
+        stats.gpu.vertexBuffers  = counter(Driver::GpuMemoryStats::VERTEX_BUFFER);
+        stats.gpu.indexBuffers   = counter(Driver::GpuMemoryStats::INDEX_BUFFER);
+        stats.gpu.uniformBuffers = counter(Driver::GpuMemoryStats::UNIFORM_BUFFER);
+        stats.gpu.storageBuffers = counter(Driver::GpuMemoryStats::STORAGE_BUFFER);
+        stats.gpu.staging        = counter(Driver::GpuMemoryStats::STAGING);
+        for (size_t size : gpu.size) {
+            stats.gpu.total += size;
+        }
+        stats.gpu.peak = gpu.totalPeak;
+    }
+    RenderTargetPool::Statistics const& pool = mRenderTargetPool.getStatistics();
+    stats.gpu.renderTargetPool = { size_t(pool.sizeKB) * 1024, size_t(pool.peakSizeKB) * 1024 };
+    return stats;
+}
+
+bool FEngine::getDriverStateStats(DriverStateStats* stats) noexcept {
+    Driver::StateStats driverStats;
+    if (!getDriverApi().getStateStats(&driverStats)) {
+        return false;
+    }
+    auto counter = [&driverStats](Driver::StateStats::Type type) {
+        return DriverStateStats::Counter{ driverStats.issued[type], driverStats.filtered[type] };
+    };
+    stats->programs       = counter(Driver::StateStats::PROGRAM);
+    stats->textures       = counter(Driver::StateStats::TEXTURE);
+    stats->samplers       = counter(Driver::StateStats::SAMPLER);
+    stats->uniformBuffers = counter(Driver::StateStats::UNIFORM_BUFFER);
+    stats->buffers        = counter(Driver::StateStats::BUFFER);
+    stats->framebuffers   = counter(Driver::StateStats::FRAMEBUFFER);
+    stats->vertexArrays   = counter(Driver::StateStats::VERTEX_ARRAY);
+    stats->rasterState    = counter(Driver::StateStats::RASTER);
+    stats->other          = counter(Driver::StateStats::OTHER);
+    return true;
+}
+
 void FEngine::flushCommandBuffer(CommandBufferQueue& commandQueue) {
     getDriver().purge();
     commandQueue.flush();
@@ -407,6 +772,41 @@ const FMaterial* FEngine::getSkyboxMaterial(driver::TextureFormat format) const
     return material;
 }
 
+FMaterialInstance const* FEngine::getDebugViewMaterialInstanceSlow() const noexcept {
+    if (UTILS_UNLIKELY(mDebugViewMaterial == nullptr)) {
+        // the debug views are rarely used, their material is only built when needed
+        mDebugViewMaterial = upcast(Material::Builder().package(
+                (void*)DEBUG_VIEW_MATERIAL_PACKAGE, DEBUG_VIEW_MATERIAL_PACKAGE_SIZE)
+                        .build(*const_cast<FEngine*>(this)));
+        for (size_t i = 0; i < DEBUG_VIEW_COUNT; i++) {
+            FMaterialInstance* mi = mDebugViewMaterial->createInstance();
+            static_cast<MaterialInstance*>(mi)->setParameter("mode", int32_t(i));
+            // the instance is used by this frame, which is past FEngine::prepare()
+            mi->commit(*const_cast<FEngine*>(this));
+            mDebugViewMaterialInstances[i] = mi;
+        }
+    }
+    return mDebugViewMaterialInstances[size_t(getDebugView())];
+}
+
+FMaterial const* FEngine::getGpuCullingMaterial() const noexcept {
+    if (UTILS_UNLIKELY(mGpuCullingMaterial == nullptr)) {
+        mGpuCullingMaterial = upcast(Material::Builder().package(
+                (void*)GPU_CULLING_MATERIAL_PACKAGE, GPU_CULLING_MATERIAL_PACKAGE_SIZE)
+                        .build(*const_cast<FEngine*>(this)));
+    }
+    return mGpuCullingMaterial;
+}
+
+FMaterial const* FEngine::getParticlesMaterial() const noexcept {
+    if (UTILS_UNLIKELY(mParticlesMaterial == nullptr)) {
+        mParticlesMaterial = upcast(Material::Builder().package(
+                (void*)PARTICLES_MATERIAL_PACKAGE, PARTICLES_MATERIAL_PACKAGE_SIZE)
+                        .build(*const_cast<FEngine*>(this)));
+    }
+    return mParticlesMaterial;
+}
+
 
 Handle<HwProgram> FEngine::createPostProcessProgram(MaterialParser& parser,
         ShaderModel shaderModel, PostProcessStage stage) const noexcept {
@@ -471,6 +871,11 @@ FIndexBuffer* FEngine::createIndexBuffer(const IndexBuffer::Builder& builder) no
     return create(mIndexBuffers, builder);
 }
 
+FMorphTargetBuffer* FEngine::createMorphTargetBuffer(
+        const MorphTargetBuffer::Builder& builder) noexcept {
+    return create(mMorphTargetBuffers, builder);
+}
+
 FTexture* FEngine::createTexture(const Texture::Builder& builder) noexcept {
     return create(mTextures, builder);
 }
@@ -549,6 +954,18 @@ FSwapChain* FEngine::createSwapChain(void* nativeWindow, uint64_t flags) noexcep
     return p;
 }
 
+FSwapChain* FEngine::createSwapChain(uint32_t width, uint32_t height, uint64_t flags) noexcept {
+    if (!ASSERT_PRECONDITION_NON_FATAL(mBackend != Backend::VULKAN,
+            "headless SwapChains are not supported with the Vulkan backend")) {
+        return nullptr;
+    }
+    FSwapChain* p = mHeapAllocator.make<FSwapChain>(*this, width, height, flags);
+    if (p) {
+        mSwapChains.insert(p);
+    }
+    return p;
+}
+
 /*
  * Objects created with a component manager
  */
@@ -571,6 +988,10 @@ void FEngine::createLight(const LightManager::Builder& builder, Entity entity) {
     mLightManager.create(builder, entity);
 }
 
+bool FEngine::createParticles(const ParticleManager::Builder& builder, Entity entity) {
+    return mParticleManager.create(builder, entity);
+}
+
 // -----------------------------------------------------------------------------------------------
 
 template<typename T, typename L>
@@ -595,6 +1016,21 @@ void FEngine::cleanupResourceList(ResourceList<T, L>& list) {
 template<typename T, typename L>
 void FEngine::terminateAndDestroy(const T* ptr, ResourceList<T, L>& list) {
     if (ptr != nullptr) {
+        terminateAndDestroy(&ptr, 1, list);
+    }
+}
+
+template<typename P, typename T, typename L>
+void FEngine::terminateAndDestroy(const P* const* ptrs, size_t count, ResourceList<T, L>& list) {
+    if (count) {
+        // the pending commands could be referencing these objects
+        waitForPendingCommands();
+    }
+    for (size_t i = 0; i < count; i++) {
+        const T* ptr = upcast(ptrs[i]);
+        if (ptr == nullptr) {
+            continue;
+        }
         if (list.remove(ptr)) {
             const_cast<T*>(ptr)->terminate(*this);
             mHeapAllocator.destroy(const_cast<T*>(ptr));
@@ -620,6 +1056,10 @@ void FEngine::destroy(const FIndexBuffer* p) {
     terminateAndDestroy(p, mIndexBuffers);
 }
 
+void FEngine::destroy(const FMorphTargetBuffer* p) {
+    terminateAndDestroy(p, mMorphTargetBuffers);
+}
+
 inline void FEngine::destroy(const FRenderer* p) {
     terminateAndDestroy(p, mRenderers);
 }
@@ -685,12 +1125,57 @@ inline void FEngine::destroy(const FMaterialInstance* ptr) {
 }
 
 void FEngine::destroy(Entity e) {
+    // this also destroys the renderable of the emitter
+    mParticleManager.destroy(e);
     mRenderableManager.destroy(e);
     mLightManager.destroy(e);
     mTransformManager.destroy(e);
     mCameraManager.destroy(e);
 }
 
+void FEngine::destroy(const VertexBuffer* const* p, size_t count) {
+    terminateAndDestroy(p, count, mVertexBuffers);
+}
+
+void FEngine::destroy(const IndexBuffer* const* p, size_t count) {
+    terminateAndDestroy(p, count, mIndexBuffers);
+}
+
+void FEngine::destroy(const Texture* const* p, size_t count) {
+    terminateAndDestroy(p, count, mTextures);
+}
+
+void FEngine::destroy(Entity const* entities, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        destroy(entities[i]);
+    }
+}
+
+void FEngine::destroyDeferred(Entity const* entities, size_t count) {
+    mDeferredDestroys.insert(mDeferredDestroys.end(), entities, entities + count);
+}
+
+void FEngine::processDeferredDestroys() noexcept {
+    SYSTRACE_CALL();
+    // the clock is only checked after each batch of entities
+    constexpr size_t BATCH_SIZE = 64;
+    using clock = std::chrono::steady_clock;
+    const clock::time_point deadline = clock::now() + mDeferredDestroyBudget;
+    std::vector<Entity>& entities = mDeferredDestroys;
+    size_t current = mDeferredDestroyCurrent;
+    do {
+        const size_t count = std::min(BATCH_SIZE, entities.size() - current);
+        destroy(entities.data() + current, count);
+        current += count;
+    } while (current < entities.size() && clock::now() < deadline);
+
+    if (current == entities.size()) {
+        entities.clear();
+        current = 0;
+    }
+    mDeferredDestroyCurrent = current;
+}
+
 void* FEngine::streamAlloc(size_t size, size_t alignment) noexcept {
     // we allow this only for small allocations
     if (size > 1024) {
@@ -727,14 +1212,21 @@ EnginePerformanceTest::PFN EnginePerformanceTest::getDestroyUniverseApi() {
 
 } // namespace details
 
+UniformInterfaceBlock PerRenderableUib::getUib() noexcept {
+    return UibGenerator::getPerRenderableUib();
+}
+
 // ------------------------------------------------------------------------------------------------
 // Trampoline calling into private implementation
 // ------------------------------------------------------------------------------------------------
 
 using namespace details;
 
-Engine* Engine::create(Backend backend, ExternalContext* externalContext, void* sharedGLContext) {
-    std::unique_ptr<FEngine> engine(FEngine::create(backend, externalContext, sharedGLContext));
+Engine* Engine::create(Backend backend, ExternalContext* externalContext, void* sharedGLContext,
+        CommandBufferOptions const* commandBufferOptions, ThreadPolicy threadPolicy,
+        JobSystem* jobSystem) {
+    std::unique_ptr<FEngine> engine(FEngine::create(backend, externalContext, sharedGLContext,
+            commandBufferOptions, threadPolicy, jobSystem));
     if (UTILS_UNLIKELY(!engine)) {
         // something went wrong during the driver or engine initialization
         return nullptr;
@@ -799,6 +1291,10 @@ SwapChain* Engine::createSwapChain(void* nativeWindow, uint64_t flags) noexcept
     return upcast(this)->createSwapChain(nativeWindow, flags);
 }
 
+SwapChain* Engine::createSwapChain(uint32_t width, uint32_t height, uint64_t flags) noexcept {
+    return upcast(this)->createSwapChain(width, height, flags);
+}
+
 void Engine::destroy(const VertexBuffer* p) {
     upcast(this)->destroy(upcast(p));
 }
@@ -807,6 +1303,10 @@ void Engine::destroy(const IndexBuffer* p) {
     upcast(this)->destroy(upcast(p));
 }
 
+void Engine::destroy(const MorphTargetBuffer* p) {
+    upcast(this)->destroy(upcast(p));
+}
+
 void Engine::destroy(const IndirectLight* p) {
     upcast(this)->destroy(upcast(p));
 }
@@ -855,6 +1355,38 @@ void Engine::destroy(Entity e) {
     upcast(this)->destroy(e);
 }
 
+void Engine::destroy(const VertexBuffer* const* p, size_t count) {
+    upcast(this)->destroy(p, count);
+}
+
+void Engine::destroy(const IndexBuffer* const* p, size_t count) {
+    upcast(this)->destroy(p, count);
+}
+
+void Engine::destroy(const Texture* const* p, size_t count) {
+    upcast(this)->destroy(p, count);
+}
+
+void Engine::destroy(Entity const* entities, size_t count) {
+    upcast(this)->destroy(entities, count);
+}
+
+void Engine::destroyDeferred(Entity const* entities, size_t count) {
+    upcast(this)->destroyDeferred(entities, count);
+}
+
+void Engine::setDeferredDestroyBudget(uint64_t budget) noexcept {
+    upcast(this)->setDeferredDestroyBudget(budget);
+}
+
+void Engine::setTextureStreamingBudget(size_t budget) noexcept {
+    upcast(this)->setTextureStreamingBudget(budget);
+}
+
+void Engine::setProgramCache(ProgramCache* cache) noexcept {
+    upcast(this)->setProgramCache(cache);
+}
+
 RenderableManager& Engine::getRenderableManager() noexcept {
     return upcast(this)->getRenderableManager();
 }
@@ -863,10 +1395,18 @@ LightManager& Engine::getLightManager() noexcept {
     return upcast(this)->getLightManager();
 }
 
+ParticleManager& Engine::getParticleManager() noexcept {
+    return upcast(this)->getParticleManager();
+}
+
 TransformManager& Engine::getTransformManager() noexcept {
     return upcast(this)->getTransformManager();
 }
 
+JobSystem& Engine::getJobSystem() noexcept {
+    return upcast(this)->getJobSystem();
+}
+
 void* Engine::streamAlloc(size_t size, size_t alignment) noexcept {
     return upcast(this)->streamAlloc(size, alignment);
 }
@@ -875,5 +1415,21 @@ DebugRegistry& Engine::getDebugRegistry() noexcept {
     return upcast(this)->getDebugRegistry();
 }
 
+Engine::CommandBufferStats Engine::getCommandBufferStats() const noexcept {
+    return upcast(this)->getCommandBufferStats();
+}
+
+Engine::MemoryStats Engine::getMemoryStats() noexcept {
+    return upcast(this)->getMemoryStats();
+}
+
+Engine::StartupStats Engine::getStartupStats() const noexcept {
+    return upcast(this)->getStartupStats();
+}
+
+bool Engine::getDriverStateStats(DriverStateStats* stats) noexcept {
+    return upcast(this)->getDriverStateStats(stats);
+}
+
 
 } // namespace filament
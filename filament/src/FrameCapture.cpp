@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameCapture.h"
+
+#include "details/Froxelizer.h"
+#include "details/Material.h"
+#include "details/MaterialInstance.h"
+#include "details/RenderPrimitive.h"
+#include "details/Scene.h"
+#include "details/View.h"
+
+#include <utils/Log.h>
+
+#include <algorithm>
+
+#include <inttypes.h>
+
+using namespace math;
+using namespace utils;
+
+namespace filament {
+
+using namespace details;
+
+FrameCapture::FrameCapture(const char* path) noexcept
+        : mFile(fopen(path, "w")) {
+    if (!mFile) {
+        slog.e << "Couldn't open " << path << " to capture the frame" << io::endl;
+        return;
+    }
+    fprintf(mFile, "filament-frame-capture %u\n", VERSION);
+}
+
+FrameCapture::~FrameCapture() noexcept {
+    if (mFile) {
+        fclose(mFile);
+    }
+}
+
+void FrameCapture::writeView(FView const& view, uint32_t frameId,
+        Viewport const& viewport, Viewport const& scaledViewport) noexcept {
+    if (!mFile) {
+        return;
+    }
+    fprintf(mFile, "view %u %u %u %u %u %s\n", frameId, viewport.width, viewport.height,
+            scaledViewport.width, scaledViewport.height, view.getName() ? view.getName() : "");
+}
+
+void FrameCapture::writeStats(Renderer::FrameStats const& timings,
+        Renderer::RenderStats const& stats) noexcept {
+    if (!mFile) {
+        return;
+    }
+    auto timing = [this](const char* name, float ms) {
+        fprintf(mFile, "timing %s %f\n", name, ms);
+    };
+    timing("frameTime", timings.frameTime);
+    timing("mainThread", timings.mainThread);
+    timing("prepare", timings.prepare);
+    timing("culling", timings.culling);
+    timing("commands", timings.commands);
+    timing("froxelization", timings.froxelization);
+    timing("driverThread", timings.driverThread);
+    timing("gpu", timings.gpu);
+    timing("gpuShadows", timings.gpuShadows);
+    timing("gpuColor", timings.gpuColor);
+    timing("gpuPostProcess", timings.gpuPostProcess);
+
+    auto stat = [this](const char* name, uint64_t value) {
+        fprintf(mFile, "stat %s %" PRIu64 "\n", name, value);
+    };
+    stat("visibleRenderables", stats.visibleRenderables);
+    stat("shadowCasters", stats.shadowCasters);
+    stat("culledRenderables", stats.culledRenderables);
+    stat("commandCount", stats.commandCount);
+    stat("instancedDraws", stats.instancedDraws);
+    stat("commandStreamSize", stats.commandStreamSize);
+    stat("drawCount", stats.drawCount);
+    stat("triangleCount", stats.triangleCount);
+    stat("programChanges", stats.programChanges);
+    stat("textureBindings", stats.textureBindings);
+    stat("uniformBufferBindings", stats.uniformBufferBindings);
+    stat("uniformBytes", stats.uniformBytes);
+    stat("bufferBytes", stats.bufferBytes);
+    stat("textureBytes", stats.textureBytes);
+}
+
+void FrameCapture::writeRenderables(FView const& view) noexcept {
+    if (!mFile) {
+        return;
+    }
+    FScene::RenderableSoa const& soa = view.getScene()->getRenderableData();
+
+    // the primitives are only chosen for the renderables that survived culling
+    const size_t prepared = std::max(
+            view.getVisibleRenderables().last, view.getVisibleShadowCasters().last);
+
+    for (size_t i = 0, c = soa.size(); i < c; i++) {
+        const uint32_t instance = soa.elementAt<FScene::RENDERABLE_INSTANCE>(i).asValue();
+        float3 const& center = soa.elementAt<FScene::WORLD_AABB_CENTER>(i);
+        float3 const& extent = soa.elementAt<FScene::WORLD_AABB_EXTENT>(i);
+        Slice<FRenderPrimitive> const primitives = i < prepared ?
+                soa.elementAt<FScene::PRIMITIVES>(i) : Slice<FRenderPrimitive>();
+        fprintf(mFile, "renderable %u %u %u %zu %f %f %f %f %f %f\n", instance,
+                unsigned(soa.elementAt<FScene::VISIBLE_MASK>(i)),
+                unsigned(soa.elementAt<FScene::LAYERS>(i)), primitives.size(),
+                center.x, center.y, center.z, extent.x, extent.y, extent.z);
+
+        for (size_t p = 0; p < primitives.size(); p++) {
+            FRenderPrimitive const& primitive = primitives[p];
+            FMaterialInstance const* mi = primitive.getMaterialInstance();
+            FMaterial const* material = mi ? mi->getMaterial() : nullptr;
+            const bool empty = primitive.getPrimitiveType() == driver::PrimitiveType::NONE;
+            const uint32_t vertexCount = empty ?
+                    0 : primitive.getMaxIndex() - primitive.getMinIndex() + 1;
+            fprintf(mFile, "primitive %u %zu %u %u %u %s\n", instance, p,
+                    material ? material->getId() : 0u,
+                    unsigned(primitive.getPrimitiveType()), vertexCount,
+                    material ? material->getName().c_str() : "");
+        }
+    }
+}
+
+void FrameCapture::writeCommands(const char* pass,
+        Slice<RenderPass::Command> const& commands) noexcept {
+    if (!mFile) {
+        return;
+    }
+    for (RenderPass::Command const& command : commands) {
+        if (command.key == uint64_t(RenderPass::Pass::SENTINEL)) {
+            break;
+        }
+        FMaterialInstance const* mi = command.primitive.mi;
+        fprintf(mFile, "command %s %016" PRIx64 " %u %u %u\n", pass, command.key,
+                command.primitive.renderable.asValue(),
+                mi ? mi->getMaterial()->getId() : 0u,
+                unsigned(command.primitive.materialVariant.key));
+    }
+}
+
+void FrameCapture::writeFroxels(Froxelizer const& froxelizer) noexcept {
+    if (!mFile) {
+        return;
+    }
+    const size_t countX = froxelizer.getFroxelCountX();
+    const size_t countY = froxelizer.getFroxelCountY();
+    const size_t countZ = froxelizer.getFroxelCountZ();
+    fprintf(mFile, "froxels %zu %zu %zu\n", countX, countY, countZ);
+
+    Slice<Froxelizer::FroxelEntry> const& froxels = froxelizer.getFroxelBufferUser();
+    const size_t count = std::min(froxels.size(), countX * countY * countZ);
+    for (size_t i = 0; i < count; i++) {
+        Froxelizer::FroxelEntry const& entry = froxels[i];
+        if (entry.pointLightCount || entry.spotLightCount) {
+            fprintf(mFile, "froxel %zu %zu %zu %u %u\n",
+                    i % countX, (i / countX) % countY, i / (countX * countY),
+                    unsigned(entry.pointLightCount), unsigned(entry.spotLightCount));
+        }
+    }
+}
+
+} // namespace filament
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_FRAMECAPTURE_H
+#define TNT_FILAMENT_FRAMECAPTURE_H
+
+#include "RenderPass.h"
+
+#include <filament/Renderer.h>
+#include <filament/Viewport.h>
+
+#include <utils/Slice.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace filament {
+
+namespace details {
+class Froxelizer;
+class FView;
+} // namespace details
+
+/*
+ * FrameCapture writes what a View rendered into a text file (see Renderer::captureFrame()), so
+ * an expensive frame can be inspected offline, e.g. with the frame_capture_viewer sample.
+ *
+ * The file has one record per line, a keyword followed by its values separated by spaces.
+ * Names come last on their line and can contain spaces:
+ *
+ *   filament-frame-capture <version>
+ *   view <frameId> <width> <height> <scaled width> <scaled height> <name>
+ *   timing <name> <ms>                 timings of the last frame delivered by FrameStats
+ *   stat <name> <value>                RenderStats of the last frame that ended
+ *   renderable <instance> <visible mask> <layers> <primitive count>
+ *              <world aabb center x y z> <world aabb half-extent x y z>
+ *   primitive <renderable instance> <index> <material id> <primitive type> <vertex count>
+ *              <material name>
+ *   command <pass> <key> <renderable instance> <material id> <variant>
+ *   froxels <count x> <count y> <count z>
+ *   froxel <x> <y> <z> <point light count> <spot light count>
+ *
+ * Keys are written in hexadecimal (see RenderPass for their encoding), the commands are in
+ * their sorted order and only the froxels with lights are written.
+ */
+class FrameCapture {
+public:
+    // Opens 'path' for writing, nothing is written if it can't be opened.
+    explicit FrameCapture(const char* path) noexcept;
+    ~FrameCapture() noexcept;
+
+    FrameCapture(FrameCapture const& rhs) = delete;
+    FrameCapture& operator=(FrameCapture const& rhs) = delete;
+
+    bool isOpen() const noexcept { return mFile != nullptr; }
+
+    void writeView(details::FView const& view, uint32_t frameId,
+            Viewport const& viewport, Viewport const& scaledViewport) noexcept;
+
+    void writeStats(Renderer::FrameStats const& timings,
+            Renderer::RenderStats const& stats) noexcept;
+
+    // the renderables of the view's scene, after culling
+    void writeRenderables(details::FView const& view) noexcept;
+
+    // the sorted commands of a pass, up to the SENTINEL
+    void writeCommands(const char* pass,
+            utils::Slice<details::RenderPass::Command> const& commands) noexcept;
+
+    // the froxels' light counts, once the froxelization is done
+    void writeFroxels(details::Froxelizer const& froxelizer) noexcept;
+
+    static constexpr uint32_t VERSION = 1;
+
+private:
+    FILE* mFile = nullptr;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_FRAMECAPTURE_H
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameGraph.h"
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
+#include <assert.h>
+
+namespace filament {
+
+using namespace driver;
+
+// ------------------------------------------------------------------------------------------------
+
+FrameGraphResource FrameGraph::Builder::create(const char* name,
+        TargetDescriptor const& desc) noexcept {
+    std::vector<ResourceNode>& resources = mFrameGraph.mResources;
+    assert(resources.size() < FrameGraphResource::UNINITIALIZED);
+    FrameGraphResource resource{ uint16_t(resources.size()) };
+    resources.emplace_back(name, desc);
+    return resource;
+}
+
+FrameGraphResource FrameGraph::Builder::read(FrameGraphResource resource, bool sample) noexcept {
+    assert(resource.isValid());
+    mFrameGraph.mPasses[mPass].reads.push_back({ resource.index, sample });
+    return resource;
+}
+
+FrameGraphResource FrameGraph::Builder::write(FrameGraphResource resource) noexcept {
+    assert(resource.isValid());
+    mFrameGraph.mPasses[mPass].writes.push_back(resource.index);
+    return resource;
+}
+
+void FrameGraph::Builder::sideEffect() noexcept {
+    mFrameGraph.mPasses[mPass].sideEffect = true;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+RenderTargetPool::Target const& FrameGraph::Resources::getTarget(
+        FrameGraphResource resource) const noexcept {
+    ResourceNode const& node = mFrameGraph.mResources[resource.index];
+    if (node.isImported) {
+        return node.imported;
+    }
+    assert(node.target);
+    return *node.target;
+}
+
+RenderPassParams FrameGraph::Resources::getRenderPassParams(
+        FrameGraphResource resource) const noexcept {
+    ResourceNode const& node = mFrameGraph.mResources[resource.index];
+    RenderPassParams params = {};
+
+    // the content of a render target is never needed before the first pass using it
+    if (node.first == mPass) {
+        params.discardStart = node.isImported ? node.importedDiscardStart : TargetBufferFlags::ALL;
+    }
+
+    // depth and stencil are only ever needed by the passes rendering into the same target,
+    // and the color buffer by any pass using it (or by whom imported the target).
+    uint8_t discardEnd = TargetBufferFlags::NONE;
+    if (!mFrameGraph.isUsedAfter(resource.index, mPass, true)) {
+        discardEnd |= TargetBufferFlags::DEPTH_AND_STENCIL;
+    }
+    if (!node.isImported && !mFrameGraph.isUsedAfter(resource.index, mPass, false)) {
+        discardEnd |= TargetBufferFlags::COLOR;
+    }
+    params.discardEnd = discardEnd;
+    return params;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+FrameGraph::FrameGraph(RenderTargetPool& rtp) noexcept : mRenderTargetPool(rtp) {
+    mPasses.reserve(8);
+    mResources.reserve(8);
+}
+
+FrameGraph::~FrameGraph() noexcept {
+    // in case execute() wasn't called, or didn't finish
+    for (ResourceNode& node : mResources) {
+        if (node.target) {
+            mRenderTargetPool.put(node.target);
+        }
+    }
+}
+
+FrameGraphResource FrameGraph::import(const char* name, TargetDescriptor const& desc,
+        Handle<HwRenderTarget> target, TargetBufferFlags discardStart) noexcept {
+    assert(mResources.size() < FrameGraphResource::UNINITIALIZED);
+    FrameGraphResource resource{ uint16_t(mResources.size()) };
+    mResources.emplace_back(name, desc);
+    ResourceNode& node = mResources.back();
+    node.isImported = true;
+    node.importedDiscardStart = discardStart;
+    node.imported.target = target;
+    node.imported.w = desc.width;
+    node.imported.h = desc.height;
+    node.imported.attachments = desc.attachments;
+    node.imported.format = desc.format;
+    node.imported.samples = desc.samples;
+    node.imported.flags = RenderTargetPool::Target::NO_TEXTURE;
+    return resource;
+}
+
+bool FrameGraph::isUsedAfter(uint16_t resource, uint32_t pass, bool writesOnly) const noexcept {
+    for (uint32_t i = pass + 1, c = uint32_t(mPasses.size()); i < c; i++) {
+        PassNode const& node = mPasses[i];
+        if (node.culled) {
+            continue;
+        }
+        if (std::find(node.writes.begin(), node.writes.end(), resource) != node.writes.end()) {
+            return true;
+        }
+        if (!writesOnly && std::any_of(node.reads.begin(), node.reads.end(),
+                [resource](PassNode::Read const& read) { return read.index == resource; })) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FrameGraph::compile() noexcept {
+    SYSTRACE_CALL();
+
+    std::vector<PassNode>& passes = mPasses;
+    std::vector<ResourceNode>& resources = mResources;
+
+    // A resource is needed if it's read by a pass that's not culled, or if it's imported. A pass
+    // is needed if one of the resources it writes is needed, or if it has side effects.
+    for (ResourceNode& resource : resources) {
+        resource.refCount = resource.isImported ? 1u : 0u;
+    }
+    for (PassNode& pass : passes) {
+        pass.refCount = uint32_t(pass.writes.size()) + (pass.sideEffect ? 1u : 0u);
+        pass.culled = false;
+        for (PassNode::Read const& read : pass.reads) {
+            resources[read.index].refCount++;
+        }
+    }
+
+    // cull the passes that are not needed, this can make the resources they read unused
+    // in turn, and so on.
+    std::vector<uint16_t> unused;
+    auto cull = [&resources, &unused](PassNode& pass) {
+        pass.culled = true;
+        for (PassNode::Read const& read : pass.reads) {
+            if (--resources[read.index].refCount == 0) {
+                unused.push_back(read.index);
+            }
+        }
+    };
+    for (PassNode& pass : passes) {
+        if (!pass.refCount) {
+            cull(pass);
+        }
+    }
+    for (size_t i = 0, c = resources.size(); i < c; i++) {
+        if (!resources[i].refCount &&
+                std::find(unused.begin(), unused.end(), uint16_t(i)) == unused.end()) {
+            unused.push_back(uint16_t(i));
+        }
+    }
+    while (!unused.empty()) {
+        const uint16_t index = unused.back();
+        unused.pop_back();
+        for (PassNode& pass : passes) {
+            if (!pass.culled &&
+                    std::find(pass.writes.begin(), pass.writes.end(), index) != pass.writes.end()) {
+                if (--pass.refCount == 0) {
+                    cull(pass);
+                }
+            }
+        }
+    }
+
+    // compute the lifetime of the resources, as the range of passes using them
+    for (ResourceNode& resource : resources) {
+        resource.first = std::numeric_limits<uint32_t>::max();
+        resource.last = 0;
+        resource.sampled = false;
+    }
+    for (uint32_t i = 0, c = uint32_t(passes.size()); i < c; i++) {
+        PassNode const& pass = passes[i];
+        if (pass.culled) {
+            continue;
+        }
+        auto use = [i](ResourceNode& resource) {
+            resource.first = std::min(resource.first, i);
+            resource.last = std::max(resource.last, i);
+        };
+        for (PassNode::Read const& read : pass.reads) {
+            use(resources[read.index]);
+            resources[read.index].sampled |= read.sample;
+        }
+        for (uint16_t index : pass.writes) {
+            use(resources[index]);
+        }
+    }
+}
+
+void FrameGraph::execute(driver::DriverApi& driver) noexcept {
+    SYSTRACE_CALL();
+
+    std::vector<PassNode>& passes = mPasses;
+    std::vector<ResourceNode>& resources = mResources;
+    RenderTargetPool& rtp = mRenderTargetPool;
+
+    auto forEachResource = [&resources](PassNode const& pass, auto const& func) {
+        for (PassNode::Read const& read : pass.reads) {
+            func(resources[read.index]);
+        }
+        for (uint16_t index : pass.writes) {
+            func(resources[index]);
+        }
+    };
+
+    for (uint32_t i = 0, c = uint32_t(passes.size()); i < c; i++) {
+        PassNode& pass = passes[i];
+        if (pass.culled) {
+            continue;
+        }
+
+        // transient targets are acquired just before their first use...
+        forEachResource(pass, [&rtp, i](ResourceNode& resource) {
+            if (!resource.isImported && resource.first == i && !resource.target) {
+                TargetDescriptor const& desc = resource.desc;
+                // a target that's never sampled doesn't need a texture
+                resource.target = rtp.get(desc.attachments, desc.width, desc.height,
+                        desc.samples, desc.format,
+                        resource.sampled ? uint8_t(0) : RenderTargetPool::Target::NO_TEXTURE);
+            }
+        });
+
+        pass.executor->execute(Resources(*this, i), driver);
+
+        // ...and returned to the pool right after their last use, so that a later pass can
+        // reuse them.
+        forEachResource(pass, [&rtp, i](ResourceNode& resource) {
+            if (!resource.isImported && resource.last == i && resource.target) {
+                rtp.put(resource.target);
+                resource.target = nullptr;
+            }
+        });
+    }
+}
+
+} // namespace filament
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_FRAMEGRAPH_H
+#define TNT_FILAMENT_FRAMEGRAPH_H
+
+#include "RenderTargetPool.h"
+
+#include "driver/DriverApiForward.h"
+#include "driver/Handle.h"
+
+#include <filament/driver/DriverEnums.h>
+
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * A virtual render target of a FrameGraph, it's only valid within the FrameGraph that
+ * created it.
+ */
+struct FrameGraphResource {
+    static constexpr uint16_t UNINITIALIZED = std::numeric_limits<uint16_t>::max();
+    uint16_t index = UNINITIALIZED;
+    bool isValid() const noexcept { return index != UNINITIALIZED; }
+};
+
+/*
+ * A FrameGraph describes the passes of a frame along with the render targets they read and
+ * write. Once all the passes are added, compile() culls the passes whose results are never
+ * used and computes the lifetime of each render target. execute() then runs the remaining
+ * passes in the order they were added.
+ *
+ * Render targets created by the graph are transient: they're acquired from the
+ * RenderTargetPool just before their first use and returned to it right after their last
+ * use, so that a later pass in the same frame can reuse the same memory. The discard flags
+ * of each pass are derived from these lifetimes.
+ *
+ * Render targets that outlive the graph (e.g. the view's render target) must be imported.
+ * Passes that write to an imported target, or that have side effects, are never culled.
+ */
+class FrameGraph {
+public:
+    using TargetBufferFlags = driver::TargetBufferFlags;
+
+    struct TargetDescriptor {
+        TargetBufferFlags attachments = TargetBufferFlags::COLOR;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint8_t samples = 1;
+        driver::TextureFormat format = driver::TextureFormat::RGBA8;
+    };
+
+    // used by a pass' setup function to declare what it reads and writes
+    class Builder {
+    public:
+        // creates a transient render target
+        FrameGraphResource create(const char* name, TargetDescriptor const& desc) noexcept;
+
+        // the pass reads the color buffer of 'resource', by sampling it (in which case it
+        // needs a texture), or by blitting it.
+        FrameGraphResource read(FrameGraphResource resource, bool sample = true) noexcept;
+
+        // the pass renders into 'resource'
+        FrameGraphResource write(FrameGraphResource resource) noexcept;
+
+        // the pass can't be culled, e.g. because it renders into a target the graph doesn't know
+        void sideEffect() noexcept;
+
+    private:
+        friend class FrameGraph;
+        Builder(FrameGraph& fg, uint32_t pass) noexcept : mFrameGraph(fg), mPass(pass) { }
+        FrameGraph& mFrameGraph;
+        const uint32_t mPass;
+    };
+
+    // used by a pass' execute function to access its render targets
+    class Resources {
+    public:
+        RenderTargetPool::Target const& getTarget(FrameGraphResource resource) const noexcept;
+
+        // discardStart and discardEnd flags of this pass, for a render target it writes
+        driver::RenderPassParams getRenderPassParams(FrameGraphResource resource) const noexcept;
+
+    private:
+        friend class FrameGraph;
+        Resources(FrameGraph const& fg, uint32_t pass) noexcept : mFrameGraph(fg), mPass(pass) { }
+        FrameGraph const& mFrameGraph;
+        const uint32_t mPass;
+    };
+
+    explicit FrameGraph(RenderTargetPool& rtp) noexcept;
+    ~FrameGraph() noexcept;
+
+    FrameGraph(FrameGraph const&) = delete;
+    FrameGraph& operator=(FrameGraph const&) = delete;
+
+    // Adds a pass. 'setup' is called immediately with a Builder and the pass' Data, which
+    // typically holds the FrameGraphResources used by the pass. 'execute' is called by
+    // execute() with the Resources, the Data and the DriverApi, unless the pass is culled.
+    template<typename Data, typename Setup, typename Execute>
+    Data const& addPass(const char* name, Setup const& setup, Execute&& execute) {
+        using ExecutorType = Executor<Data, typename std::decay<Execute>::type>;
+        ExecutorType* executor = new ExecutorType(std::forward<Execute>(execute));
+        mPasses.emplace_back(name, std::unique_ptr<ExecutorBase>(executor));
+        Builder builder(*this, uint32_t(mPasses.size() - 1));
+        setup(builder, executor->mData);
+        return executor->mData;
+    }
+
+    // Imports a render target managed outside of the graph. 'discardStart' is used for the
+    // first pass writing into it.
+    FrameGraphResource import(const char* name, TargetDescriptor const& desc,
+            Handle<HwRenderTarget> target, TargetBufferFlags discardStart) noexcept;
+
+    void compile() noexcept;
+
+    void execute(driver::DriverApi& driver) noexcept;
+
+    // whether the pass at 'pass' (in the order they were added) is culled, valid after compile()
+    bool isCulled(uint32_t pass) const noexcept { return mPasses[pass].culled; }
+
+private:
+    struct ExecutorBase {
+        virtual ~ExecutorBase() noexcept = default;
+        virtual void execute(Resources const& resources, driver::DriverApi& driver) noexcept = 0;
+    };
+
+    template<typename Data, typename T>
+    struct Executor final : public ExecutorBase {
+        Data mData = {};
+        T mExecute;
+        explicit Executor(T execute) noexcept : mExecute(std::move(execute)) { }
+        void execute(Resources const& resources, driver::DriverApi& driver) noexcept override {
+            mExecute(resources, mData, driver);
+        }
+    };
+
+    struct ResourceNode {
+        ResourceNode(const char* name, TargetDescriptor const& desc) noexcept
+                : name(name), desc(desc) { }
+        const char* name;
+        TargetDescriptor desc;
+        RenderTargetPool::Target const* target = nullptr;  // set during execute()
+        RenderTargetPool::Target imported;                  // only used for imported targets
+        uint8_t importedDiscardStart = TargetBufferFlags::NONE;
+        bool isImported = false;
+        bool sampled = false;       // whether a live pass samples it, i.e. it needs a texture
+        uint32_t refCount = 0;      // number of live readers, used by compile()
+        uint32_t first = 0;         // first live pass using this resource
+        uint32_t last = 0;          // last live pass using this resource
+    };
+
+    struct PassNode {
+        PassNode(const char* name, std::unique_ptr<ExecutorBase> executor) noexcept
+                : name(name), executor(std::move(executor)) { }
+        const char* name;
+        std::unique_ptr<ExecutorBase> executor;
+        struct Read {
+            uint16_t index;
+            bool sample;
+        };
+        std::vector<Read> reads;
+        std::vector<uint16_t> writes;
+        uint32_t refCount = 0;      // number of used resources written, used by compile()
+        bool sideEffect = false;
+        bool culled = false;
+    };
+
+    // whether a live pass after 'pass' writes (or reads, unless 'writesOnly') 'resource'
+    bool isUsedAfter(uint16_t resource, uint32_t pass, bool writesOnly) const noexcept;
+
+    RenderTargetPool& mRenderTargetPool;
+    std::vector<PassNode> mPasses;
+    std::vector<ResourceNode> mResources;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_FRAMEGRAPH_H
@@ -33,39 +33,22 @@ using namespace utils;
 
 FrameInfoManager::FrameInfoManager(FEngine& engine)
         : mEngine(engine),
-          mPoolArena("FrameInfo", sizeof(FrameInfo) * POOL_COUNT) {
-    mFrameInfoHistory.resize(HISTORY_COUNT);
+          mPoolArena("FrameInfo", sizeof(FrameInfo) * POOL_COUNT),
+          mSyncThread(*this) {
 }
 
 FrameInfoManager::~FrameInfoManager() noexcept = default;
 
 void FrameInfo::beginFrame(FrameInfoManager* mgr) {
-    Fence* fence = mgr->getEngine().createFence(Fence::Type::HARD);
-    mgr->push([this, fence]() {
-        Fence::waitAndDestroy(fence, Fence::Mode::DONT_FLUSH);
-        laps[START] = clock::now();
-    });
+    mgr->mSyncThread.push({ this, mgr->mEngine.createFence(Fence::Type::HARD), START });
 }
 
 void FrameInfo::lap(FrameInfoManager* mgr, lap_id id) {
-    Fence* fence = mgr->getEngine().createFence(Fence::Type::HARD);
-    mgr->push([this, fence, id]() {
-        Fence::waitAndDestroy(fence, Fence::Mode::DONT_FLUSH);
-        laps[id] = clock::now();
-    });
+    mgr->mSyncThread.push({ this, mgr->mEngine.createFence(Fence::Type::HARD), id });
 }
 
 void FrameInfo::endFrame(FrameInfoManager* mgr) {
-    Fence* fence = mgr->getEngine().createFence(Fence::Type::HARD);
-    mgr->push([this, mgr, fence]() {
-        char buf[256];
-        snprintf(buf, 256, "GPU time [id=%u]", frame);
-        SYSTRACE_NAME(buf);
-
-        Fence::waitAndDestroy(fence, Fence::Mode::DONT_FLUSH);
-        laps[FINISH] = clock::now();
-        mgr->finish(this);
-    });
+    mgr->mSyncThread.push({ this, mgr->mEngine.createFence(Fence::Type::HARD), FINISH });
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -94,9 +77,8 @@ void FrameInfoManager::cancelFrame() {
     FrameInfo* info = mCurrentFrameInfo;
     if (info) {
         mCurrentFrameInfo = nullptr;
-        push([this, info]() {
-            mPoolArena.free(info);
-        });
+        // the jobs already pushed for this frame still refer to it
+        mSyncThread.push({ info, nullptr, FrameInfo::FINISH });
     }
 }
 
@@ -109,23 +91,153 @@ void FrameInfoManager::finish(FrameInfo* info) noexcept {
     SYSTRACE_CONTEXT();
     SYSTRACE_ASYNC_END("frame latency", info->frame);
 
-    // store the new frame info into the history array
+    // store the new frame info into the history, in place of the oldest one
     std::unique_lock<std::mutex> lock(mLock);
-    auto& history = mFrameInfoHistory;
-    if (history.size() >= HISTORY_COUNT) {
-        // if the history has grown enough, remove the oldest element
-        history.erase(history.begin());
-    }
-    // add a copy of the new element to the history
-    history.push_back(*info);
+    mFrameInfoHistory[mHistoryIndex] = *info;
+    mHistoryIndex = (mHistoryIndex + 1) % HISTORY_COUNT;
     lock.unlock();
 
+    if (mFrameStats) {
+        const duration frameTime = info->laps[FrameInfo::FINISH] - info->laps[FrameInfo::START];
+        mFrameStats->add(info->frame, FrameStatsManager::FRAME_TIME, frameTime.count());
+    }
+
     // return the item to the pool without the lock held
     mPoolArena.free(info);
 }
 
 // ------------------------------------------------------------------------------------------------
 
+void FrameStatsManager::beginFrame(uint32_t frameId) noexcept {
+    std::unique_lock<std::mutex> lock(mLock);
+    Frame const completed = mFrames[(frameId - LATENCY) % FRAME_COUNT];
+    Frame& frame = mFrames[frameId % FRAME_COUNT];
+    frame.frameId = frameId;
+    frame.timings = {};
+    frame.counters = {};
+    lock.unlock();
+
+    if (!completed.frameId || completed.frameId != frameId - LATENCY || !mCallback) {
+        // this frame wasn't recorded
+        return;
+    }
+
+    auto const& t = completed.timings;
+    Renderer::FrameStats stats;
+    stats.frameId = completed.frameId;
+    stats.frameTime = float(t[FRAME_TIME]);
+    stats.mainThread = float(t[MAIN_THREAD]);
+    stats.prepare = float(t[PREPARE]);
+    stats.culling = float(t[CULLING]);
+    stats.commands = float(t[COMMANDS]);
+    stats.froxelization = float(t[FROXELIZATION]);
+    stats.driverThread = float(t[DRIVER_THREAD]);
+    stats.gpu = float(t[GPU]);
+    stats.gpuShadows = float(t[GPU_SHADOWS]);
+    stats.gpuColor = float(t[GPU_COLOR]);
+    stats.gpuPostProcess = float(t[GPU_POST_PROCESS]);
+
+    auto counters = [](PhaseCounters const& c) {
+        auto ratio = [](uint64_t n, uint64_t d) { return d ? float(double(n) / double(d)) : 0.0f; };
+        Renderer::FrameStats::Counters result;
+        result.instructions = c.instructions;
+        result.cpi = ratio(c.cycles, c.instructions);
+        result.l1dMissRate = ratio(c.l1dMisses, c.l1dReferences);
+        result.branchMissRate = ratio(c.branchMisses, c.branches);
+        return result;
+    };
+    auto const& c = completed.counters;
+    stats.prepareCounters = counters(c[PHASE_PREPARE]);
+    stats.cullingCounters = counters(c[PHASE_CULLING]);
+    stats.froxelizationCounters = counters(c[PHASE_FROXELIZATION]);
+    stats.commandsCounters = counters(c[PHASE_COMMANDS]);
+    stats.driverThreadCounters = counters(c[PHASE_DRIVER_THREAD]);
+
+    auto update = [](Series<float, 1, 64>& series, float value, float* percentiles) {
+        series.push(value);
+        percentiles[0] = series.percentile(0.50f);
+        percentiles[1] = series.percentile(0.90f);
+        percentiles[2] = series.percentile(0.99f);
+    };
+    update(mFrameTime, stats.frameTime, stats.frameTimePercentiles);
+    update(mMainThread, stats.mainThread, stats.mainThreadPercentiles);
+    update(mDriverThread, stats.driverThread, stats.driverThreadPercentiles);
+    update(mGpu, stats.gpu, stats.gpuPercentiles);
+
+    mLastFrameStats = stats;
+    mCallback(stats, mUser);
+}
+
+void FrameStatsManager::add(uint32_t frameId, Timing timing, double ms) noexcept {
+    std::lock_guard<std::mutex> lock(mLock);
+    Frame& frame = mFrames[frameId % FRAME_COUNT];
+    // late measures of a frame that's been delivered are dropped once it's overwritten
+    if (frame.frameId == frameId) {
+        frame.timings[timing] += ms;
+    }
+}
+
+void FrameStatsManager::add(uint32_t frameId, Phase phase,
+        Profiler::Counters const& counters) noexcept {
+    std::lock_guard<std::mutex> lock(mLock);
+    Frame& frame = mFrames[frameId % FRAME_COUNT];
+    if (frame.frameId == frameId) {
+        PhaseCounters& c = frame.counters[phase];
+        c.instructions  += counters.getInstructions();
+        c.cycles        += counters.getCpuCycles();
+        c.l1dReferences += counters.getL1DReferences();
+        c.l1dMisses     += counters.getL1DMisses();
+        c.branches      += counters.getBranchInstructions();
+        c.branchMisses  += counters.getBranchMisses();
+    }
+}
+
+void FrameStatsManager::readCounters(Profiler::Counters* counters) noexcept {
+    *counters = Profiler::Counters();
+    Profiler& profiler = Profiler::getForCurrentThread();
+    if (profiler.isValid()) {
+        // the counters are never stopped, so this only starts them the first time
+        profiler.start();
+        profiler.readCounters(counters);
+    }
+}
+
+void FrameStatsManager::beginDriverCounters() noexcept {
+    mDriverCountersStarted = isCountersEnabled();
+    if (mDriverCountersStarted) {
+        readCounters(&mDriverCountersStart);
+    }
+}
+
+void FrameStatsManager::endDriverCounters(uint32_t frameId) noexcept {
+    if (mDriverCountersStarted) {
+        mDriverCountersStarted = false;
+        Profiler::Counters end;
+        readCounters(&end);
+        add(frameId, PHASE_DRIVER_THREAD, end - mDriverCountersStart);
+    }
+}
+
+FrameStatsManager::CountersScope::CountersScope(FrameStatsManager* stats, uint32_t frameId,
+        Phase phase) noexcept
+        : mStats(stats && stats->isCountersEnabled() ? stats : nullptr),
+          mFrameId(frameId), mPhase(phase) {
+    if (UTILS_UNLIKELY(mStats)) {
+        readCounters(&mStart);
+    }
+}
+
+void FrameStatsManager::CountersScope::end() noexcept {
+    if (UTILS_UNLIKELY(mStats)) {
+        Profiler::Counters end;
+        readCounters(&end);
+        mStats->add(mFrameId, mPhase, end - mStart);
+        mStats = nullptr;
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+
 FrameInfoManager::SyncThread::~SyncThread() {
     if (mThread.joinable()) {
         requestExitAndWait();
@@ -144,29 +256,58 @@ void FrameInfoManager::SyncThread::requestExitAndWait() {
     mThread.join();
 }
 
-void FrameInfoManager::SyncThread::enqueue(SyncThread::Job&& job) {
-    std::unique_lock<std::mutex> lock(mLock);
-    mQueue.push_back(std::forward<SyncThread::Job>(job));
-    lock.unlock();
-    mCondition.notify_one();
+void FrameInfoManager::SyncThread::push(Job const& job) noexcept {
+    const uint32_t head = mHead.load(std::memory_order_relaxed);
+    assert(head - mTail.load(std::memory_order_acquire) < QUEUE_SIZE);
+    mQueue[head % QUEUE_SIZE] = job;
+    // seq_cst store and load, so that either we see the SyncThread idle, or it sees the new head
+    mHead.store(head + 1);
+    if (mIdle.load()) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mCondition.notify_one();
+    }
+}
+
+void FrameInfoManager::SyncThread::execute(Job const& job) noexcept {
+    FrameInfo* const info = job.info;
+    if (UTILS_UNLIKELY(!job.fence)) {
+        // canceled frame
+        mManager.mPoolArena.free(info);
+        return;
+    }
+    if (job.lap == FrameInfo::FINISH) {
+        char buf[256];
+        snprintf(buf, 256, "GPU time [id=%u]", info->frame);
+        SYSTRACE_NAME(buf);
+        FFence::waitAndDestroy(job.fence, Fence::Mode::DONT_FLUSH);
+        info->laps[FrameInfo::FINISH] = FrameInfo::clock::now();
+        mManager.finish(info);
+    } else {
+        FFence::waitAndDestroy(job.fence, Fence::Mode::DONT_FLUSH);
+        info->laps[job.lap] = FrameInfo::clock::now();
+    }
 }
 
 void FrameInfoManager::SyncThread::loop() {
     JobSystem::setThreadPriority(JobSystem::Priority::URGENT_DISPLAY);
     JobSystem::setThreadName("SyncThread");
-    auto& queue = mQueue;
-    bool exitRequested;
-    do {
-        std::unique_lock<std::mutex> lock(mLock);
-        mCondition.wait(lock, [this, &queue]() -> bool { return mExitRequested || !queue.empty(); });
-        exitRequested = mExitRequested;
-        if (!queue.empty()) {
-            Job job(queue.front());
-            queue.pop_front();
-            lock.unlock();
-            job();
+    uint32_t tail = mTail.load(std::memory_order_relaxed);
+    while (true) {
+        if (tail == mHead.load(std::memory_order_acquire)) {
+            std::unique_lock<std::mutex> lock(mLock);
+            mIdle.store(true);
+            mCondition.wait(lock, [this, tail]() -> bool {
+                return mExitRequested || tail != mHead.load();
+            });
+            mIdle.store(false);
+            if (mExitRequested) {
+                break;
+            }
+            continue;
         }
-    } while (!exitRequested);
+        execute(mQueue[tail % QUEUE_SIZE]);
+        mTail.store(++tail, std::memory_order_release);
+    }
 }
 
 } // namespace filament
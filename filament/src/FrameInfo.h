@@ -20,9 +20,14 @@
 #include "details/Engine.h"
 
 #include <filament/Fence.h>
+#include <filament/Renderer.h>
 
 #include <utils/Allocator.h>
+#include <utils/Profiler.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <deque>
 #include <chrono>
 #include <condition_variable>
@@ -41,6 +46,7 @@ namespace filament {
 using namespace details;
 
 class FrameInfoManager;
+class FrameStatsManager;
 
 class FrameInfo {
 public:
@@ -119,50 +125,70 @@ public:
 
     duration getLastFrameTime() const noexcept {
         std::unique_lock<std::mutex> lock(mLock);
-        FrameInfo const& info = mFrameInfoHistory.front();
+        // this is the oldest frame of the history
+        FrameInfo const& info = mFrameInfoHistory[mHistoryIndex];
         return info.laps[FrameInfo::FINISH] - info.laps[FrameInfo::START];
     }
 
+    // oldest first
     std::vector<FrameInfo> getHistory() const noexcept {
         std::unique_lock<std::mutex> lock(mLock);
-        return mFrameInfoHistory;
+        std::vector<FrameInfo> history;
+        history.reserve(HISTORY_COUNT);
+        for (size_t i = 0; i < HISTORY_COUNT; i++) {
+            history.push_back(mFrameInfoHistory[(mHistoryIndex + i) % HISTORY_COUNT]);
+        }
+        return history;
     }
 
     // no user serviceable part below...
 
-    template<typename CALLABLE, typename ... ARGS>
-    void push(CALLABLE&& func, ARGS&&... args) {
-        mSyncThread.push(std::forward<CALLABLE>(func), std::forward<ARGS>(args)...);
-    }
-
     static constexpr size_t getHistorySize() noexcept {
         return HISTORY_COUNT;
     }
 
+    // the frame times are also reported to 'stats', if not null
+    void setFrameStats(FrameStatsManager* stats) noexcept {
+        mFrameStats = stats;
+    }
+
 private:
 
+    /*
+     * The SyncThread waits for the fences of the frames in order and records when they're
+     * signaled. The jobs are PODs in a fixed-size single-producer (the main thread)
+     * single-consumer ring, the lock is only taken to wake up the SyncThread when it's idle.
+     */
     class SyncThread {
     public:
-        using Job = std::function<void()>;
+        struct Job {
+            FrameInfo* info;
+            FFence* fence;          // null when the frame is canceled
+            FrameInfo::lap_id lap;  // FINISH completes the frame
+        };
+
+        // there is at most one job per lap of each FrameInfo of the pool
+        static constexpr size_t QUEUE_SIZE = POOL_COUNT * FrameInfo::MAX_LAPS_IDS;
 
-        SyncThread() = default;
+        explicit SyncThread(FrameInfoManager& manager) noexcept : mManager(manager) { }
         ~SyncThread();
 
         void run();
         void requestExitAndWait();
 
-        template<typename CALLABLE, typename ... ARGS>
-        void push(CALLABLE&& func, ARGS&&... args) {
-            enqueue(Job(std::bind(std::forward<CALLABLE>(func), std::forward<ARGS>(args)...)));
-        }
+        void push(Job const& job) noexcept;
 
     private:
-        void enqueue(SyncThread::Job&& job);
         void loop();
+        void execute(Job const& job) noexcept;
+        FrameInfoManager& mManager;
         std::thread mThread;
-        mutable std::mutex mLock;
-        mutable std::condition_variable mCondition;
-        std::deque<Job> mQueue;
+        std::array<Job, QUEUE_SIZE> mQueue;
+        std::atomic<uint32_t> mHead = { 0 };     // written by the main thread
+        std::atomic<uint32_t> mTail = { 0 };     // written by the SyncThread
+        std::atomic<bool> mIdle = { false };
+        std::mutex mLock;
+        std::condition_variable mCondition;
         bool mExitRequested = false;
     };
 
@@ -176,7 +202,9 @@ private:
     FrameInfo* mCurrentFrameInfo = nullptr;
 
     mutable std::mutex mLock;
-    std::vector<FrameInfo> mFrameInfoHistory;
+    std::array<FrameInfo, HISTORY_COUNT> mFrameInfoHistory;
+    size_t mHistoryIndex = 0;   // next entry to overwrite, i.e. the oldest frame
+    FrameStatsManager* mFrameStats = nullptr;
 };
 
 
@@ -186,9 +214,13 @@ public:
     Series() {
         mIn.resize(MEDIAN);
         mOut.resize(HISTORY);
+        mValues.resize(HISTORY);
     }
 
     void push(T value, float b = 1.0f - math::fast::exp(-0.125f)) noexcept {
+        mCount = std::min(mCount + 1, HISTORY);
+        mValues.push_back(value);
+        mValues.pop_front();
         mIn.push_back(value);
         mIn.pop_front();
         std::array<T, MEDIAN> median;
@@ -205,11 +237,150 @@ public:
     T const& oldest() const noexcept { return mOut.front(); }
     T const& latest() const noexcept { return mOut.back(); }
 
+    // p-th percentile, with p in [0, 1], of the last HISTORY values pushed (not filtered)
+    T percentile(float p) const noexcept {
+        std::array<T, HISTORY> sorted;
+        std::copy(mValues.end() - mCount, mValues.end(), sorted.begin());
+        std::sort(sorted.begin(), sorted.begin() + mCount);
+        return mCount ? sorted[std::min(size_t(p * mCount), mCount - 1)] : T{};
+    }
+
     std::deque<T> mIn;
     std::deque<T> mOut;
+    std::deque<T> mValues;
+    size_t mCount = 0;
     T mLowPass = {};
 };
 
+/*
+ * FrameStatsManager collects the timings reported by Renderer::setFrameStatsCallback(). They
+ * come from the main thread, the driver thread, the views' GPU timers and the SyncThread, so a
+ * frame is only delivered LATENCY frames after it began.
+ */
+class FrameStatsManager {
+public:
+    enum Timing : uint8_t {
+        FRAME_TIME,
+        MAIN_THREAD,
+        PREPARE,
+        CULLING,
+        COMMANDS,
+        FROXELIZATION,
+        DRIVER_THREAD,
+        GPU,
+        GPU_SHADOWS,            // the GPU passes follow GPU, in the order of FView::GpuPass
+        GPU_COLOR,
+        GPU_POST_PROCESS,
+        TIMING_COUNT
+    };
+
+    // phases measured with the CPU hardware counters, see CountersScope
+    enum Phase : uint8_t {
+        PHASE_PREPARE,
+        PHASE_CULLING,
+        PHASE_FROXELIZATION,
+        PHASE_COMMANDS,
+        PHASE_DRIVER_THREAD,
+        PHASE_COUNT
+    };
+
+    /*
+     * Measures the hardware counters of the calling thread from its construction to end(), and
+     * adds them to a phase of a frame. This does nothing if 'stats' is null or if the counters
+     * are disabled. The work other threads do for the phase, i.e. jobs, isn't counted.
+     */
+    class CountersScope {
+    public:
+        CountersScope(FrameStatsManager* stats, uint32_t frameId, Phase phase) noexcept;
+        ~CountersScope() noexcept { end(); }
+        void end() noexcept;
+
+    private:
+        FrameStatsManager* mStats;
+        uint32_t mFrameId;
+        Phase mPhase;
+        utils::Profiler::Counters mStart;
+    };
+
+    // this covers the latency of the GPU timers (see FView::GPU_TIMER_COUNT)
+    static constexpr uint32_t LATENCY = 4;
+
+    void setCallback(Renderer::FrameStatsCallback callback, void* user) noexcept {
+        mCallback = callback;
+        mUser = user;
+    }
+
+    bool isEnabled() const noexcept { return mCallback != nullptr; }
+
+    // the last timings delivered to the callback, only used by the main thread
+    Renderer::FrameStats const& getLastFrameStats() const noexcept { return mLastFrameStats; }
+
+    void setCountersEnabled(bool enabled) noexcept {
+        mCountersEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    // only used by the main thread
+    void setGpuPassesEnabled(bool enabled) noexcept { mGpuPassesEnabled = enabled; }
+    bool isGpuPassesEnabled() const noexcept { return mGpuPassesEnabled; }
+
+    // this can be called from any thread
+    bool isCountersEnabled() const noexcept {
+        return mCountersEnabled.load(std::memory_order_relaxed);
+    }
+
+    // Called by the main thread, starts recording 'frameId' and delivers the frame that began
+    // LATENCY frames before.
+    void beginFrame(uint32_t frameId) noexcept;
+
+    // adds 'ms' to a timing of the given frame, this can be called from any thread
+    void add(uint32_t frameId, Timing timing, double ms) noexcept;
+
+    // adds hardware counters to a phase of the given frame, this can be called from any thread
+    void add(uint32_t frameId, Phase phase, utils::Profiler::Counters const& counters) noexcept;
+
+    // The driver thread's counters of a frame are measured between these two calls, which are
+    // made by the driver thread.
+    void beginDriverCounters() noexcept;
+    void endDriverCounters(uint32_t frameId) noexcept;
+
+private:
+    // reads the counters of the calling thread, they start counting on the first call
+    static void readCounters(utils::Profiler::Counters* counters) noexcept;
+
+    struct PhaseCounters {
+        uint64_t instructions = 0;
+        uint64_t cycles = 0;
+        uint64_t l1dReferences = 0;
+        uint64_t l1dMisses = 0;
+        uint64_t branches = 0;
+        uint64_t branchMisses = 0;
+    };
+
+    static constexpr size_t FRAME_COUNT = 8;
+    static_assert(FRAME_COUNT > LATENCY, "frames are overwritten before they're delivered");
+
+    struct Frame {
+        uint32_t frameId = 0;
+        // double, because the driver thread reports its total busy time (see add())
+        std::array<double, TIMING_COUNT> timings = {};
+        std::array<PhaseCounters, PHASE_COUNT> counters = {};
+    };
+
+    std::mutex mLock;
+    std::array<Frame, FRAME_COUNT> mFrames;
+    Renderer::FrameStatsCallback mCallback = nullptr;
+    void* mUser = nullptr;
+    Renderer::FrameStats mLastFrameStats;
+    std::atomic<bool> mCountersEnabled = { false };
+    bool mGpuPassesEnabled = false;
+    utils::Profiler::Counters mDriverCountersStart;     // only used by the driver thread
+    bool mDriverCountersStarted = false;                // only used by the driver thread
+    Series<float, 1, 64> mFrameTime;
+    Series<float, 1, 64> mMainThread;
+    Series<float, 1, 64> mDriverThread;
+    Series<float, 1, 64> mGpu;
+};
+
 
 } // namespace filament
 
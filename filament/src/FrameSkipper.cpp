@@ -22,9 +22,8 @@ namespace filament {
 namespace details {
 
 FrameSkipper::FrameSkipper(FEngine& engine, size_t latency) noexcept
-    : mEngine(engine) {
-    latency = std::max(latency, size_t(1));
-    mFences.resize(latency);
+    : mEngine(engine), mLatency(std::max(latency, size_t(1))) {
+    mFences.resize(mLatency);
 }
 
 FrameSkipper::~FrameSkipper() noexcept {
@@ -23,6 +23,7 @@
 
 #include <filament/Viewport.h>
 
+#include <utils/algorithm.h>
 #include <utils/Allocator.h>
 #include <utils/BinaryTreeArray.h>
 #include <utils/Systrace.h>
@@ -35,6 +36,12 @@
 
 #include <stddef.h>
 
+#if defined(__ARM_NEON)
+#   include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+#   include <wasm_simd128.h>
+#endif
+
 using namespace math;
 using namespace utils;
 
@@ -76,10 +83,15 @@ constexpr size_t RECORD_BUFFER_WIDTH_MASK   = RECORD_BUFFER_WIDTH - 1u;
 constexpr size_t RECORD_BUFFER_HEIGHT       = 2048;
 constexpr size_t RECORD_BUFFER_ENTRY_COUNT  = RECORD_BUFFER_WIDTH * RECORD_BUFFER_HEIGHT; // 64K
 
+// The X planes are tested 4 at a time, this many extra planes are allocated so that the last
+// group of 4 can always be loaded.
+constexpr size_t PLANES_X_PADDING = 3;
+
 // Buffer needed for Froxelizer internal data structures (~256 KiB)
 constexpr size_t PER_FROXELDATA_ARENA_SIZE = sizeof(float4) *
                                                  (FROXEL_BUFFER_ENTRY_COUNT_MAX +
                                                   FROXEL_BUFFER_ENTRY_COUNT_MAX + 3 +
+                                                  PLANES_X_PADDING +
                                                   FEngine::CONFIG_FROXEL_SLICE_COUNT / 4 + 1);
 
 
@@ -90,6 +102,29 @@ static constexpr size_t LIGHT_PER_GROUP = sizeof(Froxelizer::LightGroupType) * 8
 static constexpr size_t GROUP_COUNT =
         (CONFIG_MAX_LIGHT_COUNT + LIGHT_PER_GROUP - 1) / LIGHT_PER_GROUP;
 
+// up to this many lights, froxelization runs on the calling thread, the cost of the jobs isn't
+// worth it
+static constexpr size_t SINGLE_THREADED_MAX_LIGHT_COUNT = 16;
+
+// above this many lights, the light records are assigned and compressed in parallel; below,
+// the work is too small for the extra pass it needs
+static constexpr size_t PARALLEL_RECORDS_MIN_LIGHT_COUNT = 64;
+
+// number of jobs used to assign and compress the light records in parallel
+static constexpr size_t RECORDS_JOB_COUNT = 8;
+
+// above this many lights moving, all the lights are froxelized again (in parallel) rather than
+// only the ones that moved
+static constexpr size_t INCREMENTAL_MAX_LIGHT_COUNT = SINGLE_THREADED_MAX_LIGHT_COUNT;
+
+// Buffer needed for the state kept from one frame to the next, i.e. the light bits of each
+// froxel and the content of the froxel and record buffers (~352 KiB)
+constexpr size_t PERSISTENT_ARENA_SIZE =
+        sizeof(Froxelizer::LightGroupType) * (FROXEL_BUFFER_ENTRY_COUNT_MAX + 1) * GROUP_COUNT +
+        sizeof(Froxelizer::FroxelEntry) * FROXEL_BUFFER_ENTRY_COUNT_MAX +
+        sizeof(Froxelizer::RecordBufferType) * RECORD_BUFFER_ENTRY_COUNT +
+        3 * CACHELINE_SIZE;
+
 
 // record buffer cannot be larger than 65K entries because we're using uint16_t to store indices
 // so its maximum size is 128 KiB
@@ -97,7 +132,25 @@ static_assert(RECORD_BUFFER_ENTRY_COUNT <= 65536,
         "RecordBuffer cannot be larger than 65536 entries");
 
 Froxelizer::Froxelizer(FEngine& engine)
-        : mArena("froxel", PER_FROXELDATA_ARENA_SIZE) {
+        : mArena("froxel", PERSISTENT_ARENA_SIZE + PER_FROXELDATA_ARENA_SIZE),
+          mReversedZ(engine.isReversedZ()) {
+
+    // These are allocated first, so that update() never rewinds them. The buffers are uploaded
+    // from a copy, they're not shared with the driver.
+    mFroxelShardedData = {
+            mArena.alloc<FroxelThreadData>(GROUP_COUNT, CACHELINE_SIZE),
+            uint32_t(GROUP_COUNT) };
+    mFroxelBufferUser = {
+            mArena.alloc<FroxelEntry>(FROXEL_BUFFER_ENTRY_COUNT_MAX, CACHELINE_SIZE),
+            FROXEL_BUFFER_ENTRY_COUNT_MAX };
+    mRecordBufferUser = {
+            mArena.alloc<RecordBufferType>(RECORD_BUFFER_ENTRY_COUNT, CACHELINE_SIZE),
+            RECORD_BUFFER_ENTRY_COUNT };
+    assert(mFroxelShardedData.begin());
+    assert(mFroxelBufferUser.begin());
+    assert(mRecordBufferUser.begin());
+    memset(mFroxelBufferUser.data(), 0, mFroxelBufferUser.sizeInBytes());
+    memset(mRecordBufferUser.data(), 0, mRecordBufferUser.sizeInBytes());
 
     DriverApi& driverApi = engine.getDriverApi();
 
@@ -107,6 +160,10 @@ Froxelizer::Froxelizer(FEngine& engine)
     mRecordsBuffer = GPUBuffer(driverApi, { type, 1 }, RECORD_BUFFER_WIDTH, RECORD_BUFFER_HEIGHT);
     mFroxelBuffer  = GPUBuffer(driverApi, { GPUBuffer::ElementType::UINT16, 2 },
             FROXEL_BUFFER_WIDTH, FROXEL_BUFFER_HEIGHT);
+
+    // the first commit() uploads everything, after that only what changed
+    mRecordsBuffer.invalidate();
+    mFroxelBuffer.invalidate();
 }
 
 Froxelizer::~Froxelizer() {
@@ -121,6 +178,9 @@ void Froxelizer::terminate(DriverApi& driverApi) noexcept {
     mPlanesY = nullptr;
     mPlanesX = nullptr;
     mDistancesZ = nullptr;
+    mFroxelShardedData.clear();
+    mFroxelBufferUser.clear();
+    mRecordBufferUser.clear();
 
     mRecordsBuffer.terminate(driverApi);
     mFroxelBuffer.terminate(driverApi);
@@ -134,6 +194,14 @@ void Froxelizer::setOptions(float zLightNear, float zLightFar) noexcept {
     }
 }
 
+void Froxelizer::setFroxelCount(size_t froxelCount) noexcept {
+    froxelCount = math::clamp(froxelCount,
+            FROXEL_BUFFER_ENTRY_COUNT_MIN, FROXEL_BUFFER_ENTRY_COUNT_MAX);
+    if (UTILS_UNLIKELY(mFroxelCountMax != froxelCount)) {
+        mFroxelCountMax = uint16_t(froxelCount);
+        mDirtyFlags |= VIEWPORT_CHANGED;
+    }
+}
 
 void Froxelizer::setViewport(Viewport const& viewport) noexcept {
     if (UTILS_UNLIKELY(mViewport != viewport)) {
@@ -158,24 +226,11 @@ bool Froxelizer::prepare(
 
     bool uniformsNeedUpdating = false;
     if (UTILS_UNLIKELY(mDirtyFlags)) {
+        // all the lights must be froxelized again
+        mFroxelsValid = false;
         uniformsNeedUpdating = update();
     }
 
-    /*
-     * Allocations that need to persists until the driver consumes them are done from
-     * the command stream.
-     */
-
-    // froxel buffer (~32 KiB)
-    mFroxelBufferUser = {
-            driverApi.allocatePod<FroxelEntry>(FROXEL_BUFFER_ENTRY_COUNT_MAX, CACHELINE_SIZE),
-            FROXEL_BUFFER_ENTRY_COUNT_MAX };
-
-    // record buffer (~64 KiB)
-    mRecordBufferUser = {
-            driverApi.allocatePod<RecordBufferType>(RECORD_BUFFER_ENTRY_COUNT, CACHELINE_SIZE),
-            RECORD_BUFFER_ENTRY_COUNT };
-
     /*
      * Temporary allocations for processing all froxel data
      */
@@ -185,35 +240,20 @@ bool Froxelizer::prepare(
             arena.allocate<LightRecord>(FROXEL_BUFFER_ENTRY_COUNT_MAX, CACHELINE_SIZE),
             FROXEL_BUFFER_ENTRY_COUNT_MAX };
 
-    // froxel thread data (~256 KiB)
-    mFroxelShardedData = {
-            arena.allocate<FroxelThreadData>(GROUP_COUNT, CACHELINE_SIZE),
-            uint32_t(GROUP_COUNT)
-    };
-
-    assert(mFroxelBufferUser.begin());
-    assert(mRecordBufferUser.begin());
     assert(mLightRecords.begin());
-    assert(mFroxelShardedData.begin());
-
-#ifndef NDEBUG
-    memset(mFroxelBufferUser.data(),    0x55, mFroxelBufferUser.sizeInBytes());
-    memset(mRecordBufferUser.data(),    0xEB, mRecordBufferUser.sizeInBytes());
-    memset(mFroxelShardedData.data(),   0xFD, mFroxelShardedData.sizeInBytes());
-#endif
 
     return uniformsNeedUpdating;
 }
 
 void Froxelizer::computeFroxelLayout(
         uint2* dim, uint16_t* countX, uint16_t* countY, uint16_t* countZ,
-        Viewport const& viewport) noexcept {
+        Viewport const& viewport, size_t froxelCount) noexcept {
 
     if (SUPPORTS_NON_SQUARE_FROXELS == false) {
-        // calculate froxel dimension from FROXEL_BUFFER_ENTRY_COUNT_MAX and viewport
+        // calculate froxel dimension from froxelCount and viewport
         // - Start from the maximum number of froxels we can use in the x-y plane
         size_t froxelSliceCount = FEngine::CONFIG_FROXEL_SLICE_COUNT;
-        size_t froxelPlaneCount = FROXEL_BUFFER_ENTRY_COUNT_MAX / froxelSliceCount;
+        size_t froxelPlaneCount = froxelCount / froxelSliceCount;
         // - compute the number of square froxels we need in width and height, rounded down
         //   solving: |  froxelCountX * froxelCountY == froxelPlaneCount
         //            |  froxelCountX / froxelCountY == width / height
@@ -255,7 +295,8 @@ bool Froxelizer::update() noexcept {
 
         uint2 froxelDimension;
         uint16_t froxelCountX, froxelCountY, froxelCountZ;
-        computeFroxelLayout(&froxelDimension, &froxelCountX, &froxelCountY, &froxelCountZ, viewport);
+        computeFroxelLayout(&froxelDimension, &froxelCountX, &froxelCountY, &froxelCountZ,
+                viewport, mFroxelCountMax);
 
         mFroxelDimension = froxelDimension;
         mClipToFroxelX = (0.5f * viewport.width)  / froxelDimension.x;
@@ -270,7 +311,7 @@ bool Froxelizer::update() noexcept {
                << froxelDimension.x << "x" << froxelDimension.y << io::endl
                << "Froxel: " << froxelCountX << "x" << froxelCountY << "x" << froxelSliceCount
                << " = " << (froxelCountX * froxelCountY * froxelSliceCount)
-               << " (" << FROXEL_BUFFER_ENTRY_COUNT_MAX - froxelCountX * froxelCountY * froxelSliceCount << " lost)"
+               << " (" << mFroxelCountMax - froxelCountX * froxelCountY * froxelSliceCount << " lost)"
                << io::endl;
 #endif
 
@@ -292,7 +333,7 @@ bool Froxelizer::update() noexcept {
         }
 
         mDistancesZ      = mArena.alloc<float>(froxelCountZ + 1);
-        mPlanesX         = mArena.alloc<float4>(froxelCountX + 1);
+        mPlanesX         = mArena.alloc<float4>(froxelCountX + 1 + PLANES_X_PADDING);
         mPlanesY         = mArena.alloc<float4>(froxelCountY + 1);
         mBoundingSpheres = mArena.alloc<float4>(froxelCount);
 
@@ -353,6 +394,8 @@ bool Froxelizer::update() noexcept {
             p1 = mat4f::project(invProjection, p1);
             mPlanesX[i] = float4(normalize(cross(p1.xyz, p0.xyz)), 0);
         }
+        // the padding planes are loaded but their result is always ignored
+        std::fill_n(mPlanesX + mFroxelCountX + 1, PLANES_X_PADDING, float4{});
 
         for (size_t i = 0, n = mFroxelCountY; i <= n; ++i) {
             float y = (i * froxelHeightInClipSpace) - 1.0f;
@@ -471,6 +514,11 @@ bool Froxelizer::update() noexcept {
             mParamsZ[1] = (1.0f + Pw) / (Pz * mZLightFar);
             mParamsZ[2] = mLinearizer;
         }
+        if (mReversedZ) {
+            // with reverse-Z, fz is replaced by 1-fz
+            mParamsZ[1] += mParamsZ[0];
+            mParamsZ[0] = -mParamsZ[0];
+        }
         uniformsNeedUpdating = true;
     }
     assert(mZLightNear >= mNear);
@@ -524,22 +572,80 @@ std::pair<size_t, size_t> Froxelizer::clipToIndices(float2 const& clip) const no
 
 
 void Froxelizer::commit(driver::DriverApi& driverApi) {
-    // send data to GPU
-    mFroxelBuffer.commit(driverApi, mFroxelBufferUser);
-    mRecordsBuffer.commit(driverApi, mRecordBufferUser);
-#ifndef NDEBUG
-    mFroxelBufferUser.clear();
-    mRecordBufferUser.clear();
-    mFroxelShardedData.clear();
-#endif
+    // send the rows that changed to the GPU, nothing when the froxels and lights didn't change
+    mFroxelBuffer.commitCopy(driverApi, mFroxelBufferUser.data());
+    mRecordsBuffer.commitCopy(driverApi, mRecordBufferUser.data());
 }
 
 void Froxelizer::froxelizeLights(FEngine& engine,
         CameraInfo const& UTILS_RESTRICT camera,
         const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
     // note: this is called asynchronously
-    froxelizeLoop(engine, camera, lightData);
-    froxelizeAssignRecordsCompress();
+    SYSTRACE_CALL();
+
+    auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
+    auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
+    auto const* UTILS_RESTRICT spotCones    = lightData.data<FScene::SPOT_CONE>();
+    const mat3f& vn = camera.view.upperLeft();
+
+    // Find the lights that changed in view-space since the last froxelization, which is all of
+    // them when the camera moved. The light at index i is in the bit i / GROUP_COUNT of the
+    // group i % GROUP_COUNT, so a light that only changed index counts as a change too.
+    const size_t lightCount = lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT;
+    const size_t previousLightCount = mLightCount;
+    std::array<uint16_t, INCREMENTAL_MAX_LIGHT_COUNT> changedLights;
+    size_t changedCount = 0;
+    for (size_t i = 0; i < lightCount; i++) {
+        const size_t j = i + FScene::DIRECTIONAL_LIGHTS_COUNT;
+        // a zero cone, e.g. left unset by the caller, is a point light's
+        const float invSin = spotCones[j].y > 0 ? spotCones[j].y :
+                std::numeric_limits<float>::infinity();
+        const LightParams light = {
+                .position = (camera.view * float4{ spheres[j].xyz, 1 }).xyz, // to view-space
+                .cosSqr = spotCones[j].x,               // spot only
+                .axis = vn * directions[j],             // spot only
+                .invSin = invSin,                       // spot only
+                .radius = spheres[j].w,
+        };
+        if (i >= previousLightCount || memcmp(&light, &mLightParams[i], sizeof(light))) {
+            mLightParams[i] = light;
+            if (changedCount < changedLights.size()) {
+                changedLights[changedCount] = uint16_t(i);
+            }
+            changedCount++;
+        }
+    }
+    mLightCount = lightCount;
+
+    SYSTRACE_VALUE32("froxelizeLights changed", changedCount);
+
+    JobSystem& js = engine.getJobSystem();
+    if (!mFroxelsValid || changedCount > INCREMENTAL_MAX_LIGHT_COUNT) {
+        froxelizeLoop(js, lightCount);
+        mFroxelsValid = true;
+    } else {
+        if (!changedCount && lightCount >= previousLightCount) {
+            // the froxels, the records and the buffers are all still valid
+            return;
+        }
+        // only the froxels of the lights that moved or disappeared are updated
+        for (size_t i = lightCount; i < previousLightCount; i++) {
+            froxelizeClearLight(i);
+        }
+        for (size_t k = 0; k < changedCount; k++) {
+            const size_t i = changedLights[k];
+            const size_t group = i % GROUP_COUNT;
+            const size_t bit   = i / GROUP_COUNT;
+            LightParams const& light = mLightParams[i];
+            froxelizeClearLight(i);
+            FroxelThreadData& threadData = mFroxelShardedData[group];
+            const bool isSpot = light.invSin != std::numeric_limits<float>::infinity();
+            threadData[0] |= LightGroupType(isSpot) << bit;
+            froxelizePointAndSpotLight(threadData, bit, mProjection, light);
+        }
+    }
+
+    froxelizeAssignRecordsCompress(js, lightCount);
 
 #ifndef NDEBUG
     if (lightData.size()) {
@@ -565,36 +671,18 @@ void Froxelizer::froxelizeLights(FEngine& engine,
 #endif
 }
 
-void Froxelizer::froxelizeLoop(FEngine& engine,
-        const CameraInfo& UTILS_RESTRICT camera,
-        const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
+void Froxelizer::froxelizeLoop(JobSystem& js, size_t lightCount) noexcept {
     SYSTRACE_CALL();
 
     Slice<FroxelThreadData> froxelThreadData = mFroxelShardedData;
     memset(froxelThreadData.data(), 0, froxelThreadData.sizeInBytes());
 
-    auto& lcm = engine.getLightManager();
-    auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
-    auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
-    auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
-
-    auto process = [ this, &froxelThreadData,
-                     spheres, directions, instances, &camera, &lcm ]
-            (size_t count, size_t offset, size_t stride) {
+    auto process = [ this, &froxelThreadData ](size_t count, size_t offset, size_t stride) {
 
         const mat4f& projection = mProjection;
-        const mat3f& vn = camera.view.upperLeft();
 
         for (size_t i = offset; i < count; i += stride) {
-            const size_t j = i + FScene::DIRECTIONAL_LIGHTS_COUNT;
-            FLightManager::Instance li = instances[j];
-            LightParams light = {
-                    .position = (camera.view * float4{ spheres[j].xyz, 1 }).xyz, // to view-space
-                    .cosSqr = lcm.getCosOuterSquared(li),   // spot only
-                    .axis = vn * directions[j],             // spot only
-                    .invSin = lcm.getSinInverse(li),        // spot only
-                    .radius = spheres[j].w,
-            };
+            LightParams const& light = mLightParams[i];
 
             const size_t group = i % GROUP_COUNT;
             const size_t bit   = i / GROUP_COUNT;
@@ -607,25 +695,33 @@ void Froxelizer::froxelizeLoop(FEngine& engine,
         }
     };
 
-    // we do 64 lights per job
-    JobSystem& js = engine.getJobSystem();
+    // Each job processes the lights of one group (i.e. the lights i, i + GROUP_COUNT, ...),
+    // there are no jobs for the groups without lights, and none at all with few lights.
+    const size_t jobCount = lightCount <= SINGLE_THREADED_MAX_LIGHT_COUNT ?
+            0 : std::min(lightCount, GROUP_COUNT);
+    SYSTRACE_VALUE32("froxelizeLoop lights", lightCount);
+    SYSTRACE_VALUE32("froxelizeLoop jobs", jobCount);
 
-    constexpr bool SINGLE_THREADED = false;
-    if (!SINGLE_THREADED) {
+    if (jobCount) {
         auto parent = js.createJob();
-        for (size_t i = 0; i < GROUP_COUNT; i++) {
-            js.run(jobs::createJob(js, parent, std::cref(process),
-                    lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT, i, GROUP_COUNT));
+        for (size_t i = 0; i < jobCount; i++) {
+            js.run(jobs::createJob(js, parent, std::cref(process), lightCount, i, GROUP_COUNT));
         }
         js.runAndWait(parent);
     } else {
-        js.runAndWait(jobs::createJob(js, nullptr, std::cref(process),
-                lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT, 0, 1)
-        );
+        process(lightCount, 0, 1);
+    }
+}
+
+void Froxelizer::froxelizeClearLight(size_t i) noexcept {
+    // this includes the first entry, which is the type of the light
+    const LightGroupType mask = ~(LightGroupType(1) << (i / GROUP_COUNT));
+    for (LightGroupType& bits : mFroxelShardedData[i % GROUP_COUNT]) {
+        bits &= mask;
     }
 }
 
-void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
+void Froxelizer::froxelizeAssignRecordsCompress(JobSystem& js, size_t lightCount) noexcept {
 
     SYSTRACE_CALL();
 
@@ -649,19 +745,109 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
 
     // this gets very well vectorized...
     utils::Slice<LightRecord> records(mLightRecords);
-    for (size_t j = 1, jc = FROXEL_BUFFER_ENTRY_COUNT_MAX; j < jc; j++) {
-        for (size_t i = 0; i < LightRecord::bitset::WORLD_COUNT; i++) {
-            using container_type = LightRecord::bitset::container_type;
-            constexpr size_t r = sizeof(container_type) / sizeof(LightGroupType);
-            container_type b = froxelThreadData[i * r][j];
-            for (size_t k = 0; k < r; k++) {
-                b |= (container_type(froxelThreadData[i * r + k][j]) << (LIGHT_PER_GROUP * k));
+    auto convert = [&froxelThreadData, &records](uint32_t first, uint32_t count) {
+        for (size_t j = first + 1, jc = first + count + 1; j < jc; j++) {
+            for (size_t i = 0; i < LightRecord::bitset::WORLD_COUNT; i++) {
+                using container_type = LightRecord::bitset::container_type;
+                constexpr size_t r = sizeof(container_type) / sizeof(LightGroupType);
+                container_type b = froxelThreadData[i * r][j];
+                for (size_t k = 0; k < r; k++) {
+                    b |= (container_type(froxelThreadData[i * r + k][j]) << (LIGHT_PER_GROUP * k));
+                }
+                records[j - 1].lights.getBitsAt(i) = b;
             }
-            records[j - 1].lights.getBitsAt(i) = b;
         }
+    };
+
+    const size_t froxelCount = getFroxelCount();
+    const bool parallel = lightCount > PARALLEL_RECORDS_MIN_LIGHT_COUNT;
+    SYSTRACE_VALUE32("froxelizeAssignRecordsCompress parallel", parallel);
+
+    size_t offset;
+    DirtyRange dirtyFroxels;
+    DirtyRange dirtyRecords;
+    if (!parallel) {
+        convert(0, FROXEL_BUFFER_ENTRY_COUNT_MAX - 1);
+        offset = froxelizeAssignRecords(0, froxelCount, 0, spotLights, true,
+                &dirtyFroxels, &dirtyRecords);
+    } else {
+        js.runAndWait(jobs::parallel_for(js, nullptr, 0, FROXEL_BUFFER_ENTRY_COUNT_MAX - 1,
+                std::cref(convert), jobs::CountSplitter<256, RECORDS_JOB_COUNT>()));
+
+        // The froxels are split in ranges of whole rows, each range is compressed on its own.
+        // The record buffer offset of each range is the prefix sum of the record counts of the
+        // ranges before it, which we compute first.
+        const size_t rowCount = (froxelCount + mFroxelCountX - 1) / mFroxelCountX;
+        const size_t rowsPerJob = (rowCount + RECORDS_JOB_COUNT - 1) / RECORDS_JOB_COUNT;
+        const size_t froxelsPerJob = rowsPerJob * mFroxelCountX;
+        std::array<size_t, RECORDS_JOB_COUNT + 1> offsets = {};
+        std::array<DirtyRange, RECORDS_JOB_COUNT> jobDirtyFroxels;
+        std::array<DirtyRange, RECORDS_JOB_COUNT> jobDirtyRecords;
+
+        auto count = [this, &offsets, &spotLights, froxelCount, froxelsPerJob](size_t k) {
+            const size_t first = std::min(froxelCount, k * froxelsPerJob);
+            const size_t last = std::min(froxelCount, first + froxelsPerJob);
+            offsets[k + 1] = froxelizeAssignRecords(first, last, 0, spotLights, false,
+                    nullptr, nullptr);
+        };
+        auto assign = [this, &offsets, &spotLights, &jobDirtyFroxels, &jobDirtyRecords,
+                froxelCount, froxelsPerJob](size_t k) {
+            const size_t first = std::min(froxelCount, k * froxelsPerJob);
+            const size_t last = std::min(froxelCount, first + froxelsPerJob);
+            froxelizeAssignRecords(first, last, offsets[k], spotLights, true,
+                    &jobDirtyFroxels[k], &jobDirtyRecords[k]);
+        };
+
+        auto parent = js.createJob();
+        for (size_t k = 0; k < RECORDS_JOB_COUNT; k++) {
+            js.run(jobs::createJob(js, parent, std::cref(count), k));
+        }
+        js.runAndWait(parent);
+
+        for (size_t k = 0; k < RECORDS_JOB_COUNT; k++) {
+            offsets[k + 1] += offsets[k];
+        }
+
+        parent = js.createJob();
+        for (size_t k = 0; k < RECORDS_JOB_COUNT; k++) {
+            js.run(jobs::createJob(js, parent, std::cref(assign), k));
+        }
+        js.runAndWait(parent);
+
+        offset = std::min(offsets[RECORDS_JOB_COUNT], RECORD_BUFFER_ENTRY_COUNT);
+        for (size_t k = 0; k < RECORDS_JOB_COUNT; k++) {
+            dirtyFroxels.add(jobDirtyFroxels[k]);
+            dirtyRecords.add(jobDirtyRecords[k]);
+        }
+    }
+    // when the record buffer is full, the lights of the remaining froxels are dropped
+    SYSTRACE_VALUE32("froxelizeAssignRecordsCompress records", offset);
+    SYSTRACE_VALUE32("froxelizeAssignRecordsCompress overflow",
+            offset >= RECORD_BUFFER_ENTRY_COUNT);
+
+    SYSTRACE_VALUE32("froxelizeAssignRecordsCompress dirty froxels",
+            dirtyFroxels.empty() ? 0 : dirtyFroxels.last - dirtyFroxels.first);
+    SYSTRACE_VALUE32("froxelizeAssignRecordsCompress dirty records",
+            dirtyRecords.empty() ? 0 : dirtyRecords.last - dirtyRecords.first);
+
+    // only the rows that changed are uploaded, the records past 'offset' aren't used
+    if (!dirtyFroxels.empty()) {
+        const size_t row = dirtyFroxels.first >> FROXEL_BUFFER_WIDTH_SHIFT;
+        mFroxelBuffer.invalidate(row,
+                ((dirtyFroxels.last + FROXEL_BUFFER_WIDTH_MASK) >> FROXEL_BUFFER_WIDTH_SHIFT) - row);
     }
+    if (!dirtyRecords.empty()) {
+        const size_t row = dirtyRecords.first >> RECORD_BUFFER_WIDTH_SHIFT;
+        mRecordsBuffer.invalidate(row,
+                ((dirtyRecords.last + RECORD_BUFFER_WIDTH_MASK) >> RECORD_BUFFER_WIDTH_SHIFT) - row);
+    }
+}
 
-    uint16_t offset = 0;
+size_t Froxelizer::froxelizeAssignRecords(size_t first, size_t last, size_t offset,
+        LightRecord::bitset const& spotLights, bool write,
+        DirtyRange* dirtyFroxels, DirtyRange* dirtyRecords) noexcept {
+
+    utils::Slice<LightRecord> records(mLightRecords);
     FroxelEntry* const UTILS_RESTRICT froxels = mFroxelBufferUser.data();
 
     const size_t froxelCountX = mFroxelCountX;
@@ -673,25 +859,50 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
         return i;
     };
 
+    // the froxels and records keep their content from the previous frame, only the ones that
+    // change are written and reported
+    auto setFroxel = [froxels, dirtyFroxels](size_t i, uint32_t u32) {
+        if (froxels[i].u32 != u32) {
+            froxels[i].u32 = u32;
+            dirtyFroxels->add(i, i + 1);
+        }
+    };
+
     RecordBufferType* const UTILS_RESTRICT froxelRecords = mRecordBufferUser.data();
 
+    // the records of a froxel are assembled here first, up to 255 point and 255 spot lights
+    RecordBufferType froxelRecord[512];
+
     // how many froxel record entries were reused (for debugging)
     UTILS_UNUSED size_t reused = 0;
 
-    for (size_t i = 0, c = getFroxelCount(); i < c;) {
+    for (size_t i = first, c = last; i < c;) {
         LightRecord b = records[i];
         if (b.lights.none()) {
-            froxels[remap(i++)].u32 = 0;
+            if (write) {
+                setFroxel(remap(i), 0);
+            }
+            i++;
             continue;
         }
 
         // We have a limitation of 255 spot + 255 point lights per froxel.
-        FroxelEntry entry = {
-                .offset = offset,
-                .pointLightCount = (uint8_t)std::min(size_t(255), (b.lights & ~spotLights).count()),
-                .spotLightCount  = (uint8_t)std::min(size_t(255), (b.lights &  spotLights).count())
-        };
-        const size_t lightCount = entry.count[0] + entry.count[1];
+        const size_t pointLightCount = std::min(size_t(255), (b.lights & ~spotLights).count());
+        const size_t spotLightCount = std::min(size_t(255), (b.lights & spotLights).count());
+        const size_t lightCount = pointLightCount + spotLightCount;
+
+        if (!write) {
+            // only count the records, skip the froxels sharing them
+            offset += lightCount;
+            do {
+                i++;
+                if (i >= c) break;
+                if (records[i].lights != b.lights && i >= first + froxelCountX) {
+                    b = records[i - froxelCountX];
+                }
+            } while(records[i].lights == b.lights);
+            continue;
+        }
 
         if (UTILS_UNLIKELY(offset + lightCount >= RECORD_BUFFER_ENTRY_COUNT)) {
 #ifndef NDEBUG
@@ -699,15 +910,21 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
 #endif
             // note: instead of dropping froxels we could look for similar records we've already
             // filed up.
-            do { // this compiles to memset() when remap() is identity
-                froxels[remap(i++)].u32 = 0;
+            do {
+                setFroxel(remap(i++), 0);
             } while(i < c);
-            goto out_of_memory;
+            return RECORD_BUFFER_ENTRY_COUNT;
         }
 
+        FroxelEntry entry = {
+                .offset = uint16_t(offset),
+                .pointLightCount = uint8_t(pointLightCount),
+                .spotLightCount  = uint8_t(spotLightCount)
+        };
+
         // iterate the bitfield
-        auto beginPoint = froxelRecords + offset;
-        auto beginSpot  = froxelRecords + offset + entry.count[0];
+        auto beginPoint = froxelRecord;
+        auto beginSpot  = froxelRecord + entry.count[0];
         b.lights.forEachSetBit([&spotLights,
                 point = beginPoint, spot = beginSpot, beginPoint, beginSpot]
                 (size_t l) mutable {
@@ -727,6 +944,11 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
             p += (p - s < 255) ? 1 : 0;
         });
 
+        if (memcmp(froxelRecords + offset, froxelRecord, lightCount * sizeof(RecordBufferType))) {
+            memcpy(froxelRecords + offset, froxelRecord, lightCount * sizeof(RecordBufferType));
+            dirtyRecords->add(offset, offset + lightCount);
+        }
+
         offset += lightCount;
 
 #ifndef NDEBUG
@@ -736,25 +958,19 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
 #ifndef NDEBUG
             if (lightCount) { reused++; }
 #endif
-            froxels[remap(i++)].u32 = entry.u32;
+            setFroxel(remap(i++), entry.u32);
             if (i >= c) break;
 
-            if (records[i].lights != b.lights && i >= froxelCountX) {
+            if (records[i].lights != b.lights && i >= first + froxelCountX) {
                 // if this froxel record doesn't match the previous one on its left,
                 // we re-try with the record above it, which saves many froxel records
-                // (north of 10% in practice).
+                // (north of 10% in practice). Only the froxels of this range can be used.
                 b = records[i - froxelCountX];
                 entry.u32 = froxels[remap(i - froxelCountX)].u32;
             }
         } while(records[i].lights == b.lights);
     }
-out_of_memory:
-
-    // froxel buffer is always fully invalidated
-    mFroxelBuffer.invalidate();
-
-    // needed record buffer size may change at each frame
-    mRecordsBuffer.invalidate(0, (offset + RECORD_BUFFER_WIDTH_MASK) >> RECORD_BUFFER_WIDTH_SHIFT);
+    return offset;
 }
 
 static inline float2 project(mat4f const& p, float3 const& v) noexcept {
@@ -779,6 +995,46 @@ static inline float2 project(mat4f const& p, float3 const& v) noexcept {
     return float2{ x, y } * (1 / w);
 }
 
+// Tests the circle 'c' (radius squared) against the 4 planes of the form {x,0,z,0} starting at
+// 'planes'. Returns a mask where bit k is set if the circle intersects planes[k], this is the
+// same as testing spherePlaneDistanceSquared(c, planes[k].x, planes[k].z) > 0 for each plane.
+static inline uint32_t spherePlanesIntersection4(
+        float4 const* UTILS_RESTRICT planes, float4 const& c) noexcept {
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    // deinterleave the 4 planes, val[0] holds the x components and val[2] the z components
+    const float32x4x4_t p = vld4q_f32(&planes[0].x);
+    const float32x4_t d = vmlaq_n_f32(vmulq_n_f32(p.val[0], c.x), p.val[2], c.z);
+    const float32x4_t rr = vmlsq_f32(vdupq_n_f32(c.w), d, d);
+    const uint32x4_t bits = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(vcgtq_f32(rr, vdupq_n_f32(0.0f)), bits));
+#elif defined(__wasm_simd128__)
+    // transpose the 4 planes to get their x and z components in a vector each
+    const v128_t p0 = wasm_v128_load(&planes[0]);
+    const v128_t p1 = wasm_v128_load(&planes[1]);
+    const v128_t p2 = wasm_v128_load(&planes[2]);
+    const v128_t p3 = wasm_v128_load(&planes[3]);
+    const v128_t xz01 = wasm_i32x4_shuffle(p0, p1, 0, 2, 4, 6);
+    const v128_t xz23 = wasm_i32x4_shuffle(p2, p3, 0, 2, 4, 6);
+    const v128_t x = wasm_i32x4_shuffle(xz01, xz23, 0, 2, 4, 6);
+    const v128_t z = wasm_i32x4_shuffle(xz01, xz23, 1, 3, 5, 7);
+    const v128_t d = wasm_f32x4_add(
+            wasm_f32x4_mul(x, wasm_f32x4_splat(c.x)), wasm_f32x4_mul(z, wasm_f32x4_splat(c.z)));
+    const v128_t rr = wasm_f32x4_sub(wasm_f32x4_splat(c.w), wasm_f32x4_mul(d, d));
+    const v128_t bits = wasm_v128_and(wasm_f32x4_gt(rr, wasm_f32x4_splat(0.0f)),
+            wasm_i32x4_make(1, 2, 4, 8));
+    return uint32_t(wasm_i32x4_extract_lane(bits, 0) | wasm_i32x4_extract_lane(bits, 1) |
+                    wasm_i32x4_extract_lane(bits, 2) | wasm_i32x4_extract_lane(bits, 3));
+#else
+    // no early exit, this gets vectorized
+    uint32_t mask = 0;
+    for (size_t k = 0; k < 4; k++) {
+        const float d = c.x * planes[k].x + c.z * planes[k].z;
+        mask |= uint32_t(c.w - d * d > 0) << k;
+    }
+    return mask;
+#endif
+}
+
 void Froxelizer::froxelizePointAndSpotLight(
         FroxelThreadData& froxelThread, size_t bit,
         mat4f const& UTILS_RESTRICT p,
@@ -860,20 +1116,50 @@ void Froxelizer::froxelizePointAndSpotLight(
                     cy = spherePlaneIntersection(cz, plane.y, plane.z);
                 }
                 if (cy.w > 0) { // intersection of light with this horizontal plane
-                    size_t bx, ex; // horizontal begin/end indices
-                    // find the begin index (left side)
-                    for (bx = x0; bx <= xcenter; ++bx) {
-                        if (spherePlaneDistanceSquared(cy, planesX[bx].x, planesX[bx].z) > 0) {
-                            // intersection
-                            break;
+                    // horizontal begin/end indices, when no plane intersects
+                    size_t bx = std::max(x0, xcenter + 1);
+                    size_t ex = std::min(x1 - 1, xcenter);
+
+                    if (UTILS_LIKELY(mVectorizedPlaneTests)) {
+                        // find the begin index (left side), the first intersecting plane
+                        // in [x0, xcenter], testing 4 planes at a time
+                        for (size_t b = x0; b <= xcenter; b += 4) {
+                            const uint32_t valid =
+                                    (1u << std::min(size_t(4), xcenter + 1 - b)) - 1u;
+                            const uint32_t mask =
+                                    spherePlanesIntersection4(planesX + b, cy) & valid;
+                            if (mask) {
+                                bx = b + utils::ctz(mask);
+                                break;
+                            }
                         }
-                    }
 
-                    // find the end index (right side), x1 is past the end
-                    for (ex = x1; --ex > xcenter;) {
-                        if (spherePlaneDistanceSquared(cy, planesX[ex].x, planesX[ex].z) > 0) {
-                            // intersection
-                            break;
+                        // find the end index (right side), the last intersecting plane in
+                        // [xcenter + 1, x1 - 1] (x1 is past the end), testing 4 planes at a time
+                        for (size_t e = x1 - 1; e > xcenter;) {
+                            const size_t b = std::max(xcenter + 1, e - std::min(e, size_t(3)));
+                            const uint32_t valid = (1u << (e + 1 - b)) - 1u;
+                            const uint32_t mask =
+                                    spherePlanesIntersection4(planesX + b, cy) & valid;
+                            if (mask) {
+                                ex = b + (31u - utils::clz(mask));
+                                break;
+                            }
+                            e = b - 1;
+                        }
+                    } else {
+                        // same as above, one plane at a time
+                        for (size_t b = x0; b <= xcenter; ++b) {
+                            if (spherePlaneDistanceSquared(cy, planesX[b].x, planesX[b].z) > 0) {
+                                bx = b;
+                                break;
+                            }
+                        }
+                        for (size_t e = x1 - 1; e > xcenter; --e) {
+                            if (spherePlaneDistanceSquared(cy, planesX[e].x, planesX[e].z) > 0) {
+                                ex = e;
+                                break;
+                            }
                         }
                     }
                     ++ex;
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/GpuCuller.h"
+
+#include "details/Engine.h"
+#include "details/Material.h"
+#include "details/MaterialInstance.h"
+#include "details/OcclusionCuller.h"
+#include "details/RenderPrimitive.h"
+
+#include <filament/MaterialEnums.h>
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace math;
+using namespace utils;
+
+namespace filament {
+
+using namespace driver;
+
+namespace details {
+
+GpuCuller::GpuCuller() noexcept = default;
+
+GpuCuller::~GpuCuller() noexcept = default;
+
+void GpuCuller::terminate(FEngine& engine) {
+    DriverApi& driver = engine.getDriverApi();
+    if (mDrawsSbh) {
+        driver.destroyStorageBuffer(mDrawsSbh);
+        driver.destroyStorageBuffer(mIndirectSbh);
+    }
+    if (mDepthSbh) {
+        driver.destroyStorageBuffer(mDepthSbh);
+    }
+    if (mMaterialInstance) {
+        engine.destroy(mMaterialInstance);
+    }
+    mDrawsSbh = {};
+    mIndirectSbh = {};
+    mDepthSbh = {};
+    mMaterialInstance = nullptr;
+    mCapacity = 0;
+    mSlots.clear();
+    mSlotCount = 0;
+    mUploadedDraws.clear();
+}
+
+bool GpuCuller::isSupported(FEngine& engine) noexcept {
+    return engine.getDriverApi().isComputeSupported();
+}
+
+void GpuCuller::prepare(OcclusionCuller const* occlusionCuller) noexcept {
+    mOcclusionCuller = occlusionCuller;
+}
+
+bool GpuCuller::cull(FEngine& engine, FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        Slice<RenderPass::Command> commands,
+        RenderPass::InstancedDraw const* instancedDraws) noexcept {
+    SYSTRACE_CALL();
+
+    if (!mOcclusionCuller) {
+        // the commands are already frustum culled
+        return false;
+    }
+
+    if (UTILS_UNLIKELY(!mMaterialInstance)) {
+        mMaterialInstance = engine.getGpuCullingMaterial()->createInstance();
+    }
+    Handle<HwProgram> const ph = mMaterialInstance->getMaterial()->getComputeProgram();
+    if (UTILS_UNLIKELY(!ph)) {
+        return false;
+    }
+
+    // the commands only know their renderable, not where it is in the SoA
+    auto const* const UTILS_RESTRICT instances = soa.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT visibility = soa.data<FScene::VISIBILITY_STATE>();
+    auto const* const UTILS_RESTRICT centers = soa.data<FScene::WORLD_AABB_CENTER>();
+    auto const* const UTILS_RESTRICT extents = soa.data<FScene::WORLD_AABB_EXTENT>();
+    auto const* const UTILS_RESTRICT primitives = soa.data<FScene::PRIMITIVES>();
+    for (uint32_t i : vr) {
+        const size_t instance = instances[i].asValue();
+        if (instance >= mSoaIndices.size()) {
+            mSoaIndices.resize(instance + 1);
+        }
+        mSoaIndices[instance] = i;
+    }
+    allocateSlots(soa, vr);
+
+    // commands are sorted, so all SENTINELs are at the end
+    RenderPass::Command* const first = commands.begin();
+    RenderPass::Command* const last = std::lower_bound(commands.begin(), commands.end(),
+            uint64_t(RenderPass::Pass::SENTINEL),
+            [](RenderPass::Command const& c, RenderPass::CommandKey key) { return c.key < key; });
+
+    // the slots that aren't drawn this frame keep their content, so they're not uploaded
+    mDraws.assign(mUploadedDraws.begin(),
+            mUploadedDraws.begin() + std::min(mUploadedDraws.size(), size_t(mSlotCount)));
+    mDraws.resize(mSlotCount);
+    size_t drawCount = 0;
+    for (RenderPass::Command* c = first; c != last; ++c) {
+        RenderPass::PrimitiveInfo& info = c->primitive;
+        if (info.instancedDraw) {
+            // instanced runs are drawn directly
+            c += instancedDraws[info.instancedDraw - 1].count - 1;
+            continue;
+        }
+
+        // the depth and color commands of a primitive share its slot
+        const size_t instance = info.renderable.asValue();
+        const uint32_t i = mSoaIndices[instance];
+        auto const& list = primitives[i];
+        auto const pos = std::find_if(list.begin(), list.end(), [&info](FRenderPrimitive const& p) {
+            return p.getHwHandle() == info.primitiveHandle;
+        });
+        if (UTILS_UNLIKELY(pos == list.end())) {
+            continue;
+        }
+
+        const uint32_t slot = mSlots[instance].first + uint32_t(pos - list.begin());
+        mDraws[slot] = {
+                float4{ centers[i], 0 }, float4{ extents[i], 0 },
+                pos->getIndexCount(), pos->getIndexOffset(),
+                uint32_t(visibility[i].culling), 0 };
+        info.indirectDraw = slot + 1;
+        drawCount++;
+    }
+
+    SYSTRACE_VALUE32("gpuCulledDrawCount", drawCount);
+    if (!drawCount) {
+        return false;
+    }
+
+    const uint32_t count = mSlotCount;
+    reserve(engine, count);
+    updateDraws(engine, mDraws);
+    updateDepth(engine);
+
+    MaterialInstance* const mi = mMaterialInstance;
+    mi->setParameter("clipFromWorld", mOcclusionCuller->getClipFromWorld());
+    mi->setParameter("drawCount", int32_t(count));
+    mMaterialInstance->commit(engine);
+
+    DriverApi& driver = engine.getDriverApi();
+    driver.bindUniforms(BindingPoints::PER_MATERIAL_INSTANCE, mMaterialInstance->getUniformBuffer());
+    driver.bindStorageBuffer(0, mDrawsSbh);
+    driver.bindStorageBuffer(1, mIndirectSbh);
+    driver.bindStorageBuffer(2, mDepthSbh);
+    driver.dispatchCompute(ph, (count + 63) / 64, 1, 1);
+    driver.memoryBarrier(BARRIER_INDIRECT_COMMANDS);
+    return true;
+}
+
+void GpuCuller::allocateSlots(FScene::RenderableSoa const& soa, Range<uint32_t> vr) noexcept {
+    auto const* const UTILS_RESTRICT instances = soa.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT primitives = soa.data<FScene::PRIMITIVES>();
+
+    // the slots of the renderables that are gone are only reclaimed when they take more than
+    // half of the buffers, then all the slots are assigned again and uploaded
+    uint32_t used = 0;
+    for (uint32_t i : vr) {
+        used += uint32_t(primitives[i].size());
+    }
+    if (mSlotCount > 2 * used + 64) {
+        mSlots.clear();
+        mSlotCount = 0;
+    }
+
+    for (uint32_t i : vr) {
+        const size_t instance = instances[i].asValue();
+        if (instance >= mSlots.size()) {
+            mSlots.resize(instance + 1);
+        }
+        // a renderable keeps its slots, unless it now has more primitives
+        SlotRange& range = mSlots[instance];
+        const uint32_t count = uint32_t(primitives[i].size());
+        if (range.count < count) {
+            range = { mSlotCount, count };
+            mSlotCount += count;
+        }
+    }
+}
+
+void GpuCuller::reserve(FEngine& engine, uint32_t count) noexcept {
+    if (count <= mCapacity) {
+        return;
+    }
+    DriverApi& driver = engine.getDriverApi();
+    if (mDrawsSbh) {
+        driver.destroyStorageBuffer(mDrawsSbh);
+        driver.destroyStorageBuffer(mIndirectSbh);
+    }
+    // grow geometrically, the scenes that grow usually keep growing
+    mCapacity = std::max(count, mCapacity * 2);
+    mDrawsSbh = driver.createStorageBuffer(mCapacity * sizeof(Draw));
+    mIndirectSbh = driver.createStorageBuffer(mCapacity * sizeof(Driver::DrawIndirectCommand));
+    // the new buffer holds nothing
+    mUploadedDraws.clear();
+}
+
+void GpuCuller::updateDraws(FEngine& engine, std::vector<Draw> const& draws) noexcept {
+    // only the range of slots that changed is uploaded
+    const size_t count = draws.size();
+    const size_t uploaded = std::min(count, mUploadedDraws.size());
+    size_t begin = 0;
+    while (begin < uploaded && !memcmp(&draws[begin], &mUploadedDraws[begin], sizeof(Draw))) {
+        begin++;
+    }
+    size_t end = count;
+    if (count == uploaded) {
+        while (end > begin && !memcmp(&draws[end - 1], &mUploadedDraws[end - 1], sizeof(Draw))) {
+            end--;
+        }
+    }
+
+    if (begin < end) {
+        const size_t size = (end - begin) * sizeof(Draw);
+        void* const data = malloc(size);
+        memcpy(data, draws.data() + begin, size);
+        engine.getDriverApi().updateStorageBuffer(mDrawsSbh,
+                { data, size, [](void* buffer, size_t, void*) { free(buffer); }},
+                uint32_t(begin * sizeof(Draw)));
+    }
+
+    // the slots past 'count' are not used anymore
+    mUploadedDraws.assign(draws.begin(), draws.end());
+}
+
+void GpuCuller::updateDepth(FEngine& engine) noexcept {
+    DriverApi& driver = engine.getDriverApi();
+    const size_t size = mOcclusionCuller->getDepthBufferSize() * sizeof(float);
+    if (!mDepthSbh) {
+        // the size of the depth buffer never changes
+        mDepthSbh = driver.createStorageBuffer(size);
+    }
+    // the occluders are rasterized again each frame
+    void* const data = malloc(size);
+    memcpy(data, mOcclusionCuller->getDepthBuffer(), size);
+    driver.updateStorageBuffer(mDepthSbh,
+            { data, size, [](void* buffer, size_t, void*) { free(buffer); }}, 0);
+}
+
+} // namespace details
+} // namespace filament
@@ -51,7 +51,7 @@ void GpuLightBuffer::commit(FEngine& engine) noexcept {
 
 void GpuLightBuffer::commitSlow(FEngine& engine) noexcept {
     DriverApi& driverApi = engine.getDriverApi();
-    driverApi.updateUniformBuffer(mLightUbh, UniformBuffer(mLightsUb));
+    driverApi.updateUniformBuffer(mLightUbh, mLightsUb.copyDirtyRange());
     mLightsUb.clean();
 }
 
@@ -76,6 +76,7 @@ void FIndexBuffer::setBuffer(FEngine& engine,
     }
 
     engine.getDriverApi().loadIndexBuffer(mHandle, std::move(buffer), byteOffset, byteSize);
+    engine.contentChanged();
 }
 
 } // namespace details
@@ -109,7 +109,8 @@ IndirectLight* IndirectLight::Builder::build(Engine& engine) {
 
 namespace details {
 
-FIndirectLight::FIndirectLight(FEngine& engine, const Builder& builder) noexcept {
+FIndirectLight::FIndirectLight(FEngine& engine, const Builder& builder) noexcept
+        : mEngine(engine) {
 
     if (builder->mReflectionsMap) {
         mReflectionsMapHandle = upcast(builder->mReflectionsMap)->getHwHandle();
@@ -130,6 +131,64 @@ FIndirectLight::FIndirectLight(FEngine& engine, const Builder& builder) noexcept
     }
 }
 
+static bool isValidEnvironment(FTexture const* environment) noexcept {
+    return ASSERT_PRECONDITION_NON_FATAL(environment && environment->isCubemap(),
+            "environment must be a cubemap");
+}
+
+static bool isValidTarget(FTexture const* target) noexcept {
+    return ASSERT_PRECONDITION_NON_FATAL(target &&
+            target->getUsage() == Texture::Usage::COLOR_ATTACHMENT,
+            "target texture must be created with Texture::Usage::COLOR_ATTACHMENT");
+}
+
+void FIndirectLight::prefilterReflections(FEngine& engine, FTexture const* environment,
+        FTexture const* reflections, uint32_t sampleCount) noexcept {
+    if (!isValidEnvironment(environment) || !isValidTarget(reflections)) {
+        return;
+    }
+    if (!ASSERT_PRECONDITION_NON_FATAL(reflections->isCubemap(),
+            "reflection map must a cubemap")) {
+        return;
+    }
+    engine.getPostProcessManager().prefilterReflections(environment, reflections, sampleCount);
+}
+
+void FIndirectLight::computeIrradianceSH(FEngine& engine, FTexture const* environment,
+        driver::PixelBufferDescriptor&& sh) noexcept {
+    if (!isValidEnvironment(environment)) {
+        return;
+    }
+    if (!ASSERT_PRECONDITION_NON_FATAL(sh.size >= 9 * 4 * sizeof(float) &&
+            sh.format == driver::PixelDataFormat::RGBA && sh.type == driver::PixelDataType::FLOAT,
+            "sh must hold 9 RGBA FLOAT texels")) {
+        return;
+    }
+    engine.getPostProcessManager().computeIrradianceSH(environment, std::move(sh));
+}
+
+void FIndirectLight::generateDFG(FEngine& engine, FTexture const* dfg,
+        uint32_t sampleCount) noexcept {
+    if (!isValidTarget(dfg)) {
+        return;
+    }
+    if (!ASSERT_PRECONDITION_NON_FATAL(dfg->getTarget() == Texture::Sampler::SAMPLER_2D,
+            "DFG LUT must be a 2D texture")) {
+        return;
+    }
+    engine.getPostProcessManager().generateDFG(dfg, sampleCount);
+}
+
+void FIndirectLight::setIntensity(float intensity) noexcept {
+    mIntensity = intensity;
+    mEngine.contentChanged();
+}
+
+void FIndirectLight::setRotation(math::mat3f const& rotation) noexcept {
+    mRotation = rotation;
+    mEngine.contentChanged();
+}
+
 void FIndirectLight::terminate(FEngine& engine) {
     if (FEngine::CONFIG_IBL_USE_IRRADIANCE_MAP) {
         FEngine::DriverApi& driver = engine.getDriverApi();
@@ -155,4 +214,19 @@ void IndirectLight::setRotation(math::mat3f const& rotation) noexcept {
     upcast(this)->setRotation(rotation);
 }
 
+void IndirectLight::prefilterReflections(Engine& engine, Texture const* environment,
+        Texture* reflections, uint32_t sampleCount) noexcept {
+    FIndirectLight::prefilterReflections(upcast(engine), upcast(environment), upcast(reflections),
+            sampleCount);
+}
+
+void IndirectLight::computeIrradianceSH(Engine& engine, Texture const* environment,
+        driver::PixelBufferDescriptor&& sh) noexcept {
+    FIndirectLight::computeIrradianceSH(upcast(engine), upcast(environment), std::move(sh));
+}
+
+void IndirectLight::generateDFG(Engine& engine, Texture* dfg, uint32_t sampleCount) noexcept {
+    FIndirectLight::generateDFG(upcast(engine), upcast(dfg), sampleCount);
+}
+
 } // namespace filament
@@ -31,8 +31,13 @@
 
 #include <filaflat/MaterialParser.h>
 
+#include <utils/algorithm.h>
+#include <utils/Log.h>
 #include <utils/Panic.h>
+#include <utils/ThreadLocal.h>
 
+#include <atomic>
+#include <mutex>
 #include <sstream>
 
 using namespace utils;
@@ -49,6 +54,7 @@ struct Material::BuilderDetails {
     size_t mSize = 0;
     filaflat::MaterialParser* mMaterialParser = nullptr;
     bool mDefaultMaterial = false;
+    bool mExternalPackage = false;
 };
 
 FMaterial::DefaultMaterialBuilder::DefaultMaterialBuilder() : Material::Builder() {
@@ -66,12 +72,22 @@ BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder&& rhs
 Material::Builder& Material::Builder::package(const void* payload, size_t size) {
     mImpl->mPayload = payload;
     mImpl->mSize = size;
+    mImpl->mExternalPackage = false;
+    return *this;
+}
+
+Material::Builder& Material::Builder::externalPackage(const void* payload, size_t size) {
+    mImpl->mPayload = payload;
+    mImpl->mSize = size;
+    mImpl->mExternalPackage = true;
     return *this;
 }
 
 Material* Material::Builder::build(Engine& engine) {
-    MaterialParser* materialParser = new MaterialParser(
-            upcast(engine).getBackend(), mImpl->mPayload, mImpl->mSize);
+    MaterialParser* materialParser = mImpl->mExternalPackage ?
+            new MaterialParser(upcast(engine).getBackend(), mImpl->mPayload, mImpl->mSize,
+                    MaterialParser::ReferencePackage{}) :
+            new MaterialParser(upcast(engine).getBackend(), mImpl->mPayload, mImpl->mSize);
     bool materialOK = materialParser->parse() && materialParser->isShadingMaterial();
     if (!ASSERT_POSTCONDITION_NON_FATAL(materialOK, "could not parse the material package")) {
         return nullptr;
@@ -94,6 +110,18 @@ Material* Material::Builder::build(Engine& engine) {
         return nullptr;
     }
 
+    // only the desktop OpenGL shaders of these materials read bindless textures
+    bool bindless = false;
+    materialParser->hasBindlessSamplers(&bindless);
+    if (!ASSERT_POSTCONDITION_NON_FATAL(!bindless ||
+            upcast(engine).getBackend() != Backend::OPENGL ||
+            sm != uint32_t(ShaderModel::GL_CORE_41) ||
+            upcast(engine).getBindlessTextureTable().isSupported(),
+            "the material '%s' requires bindless textures (GL_ARB_bindless_texture)",
+            name.c_str_safe())) {
+        return nullptr;
+    }
+
     mImpl->mMaterialParser = materialParser;
 
     return upcast(engine).createMaterial(*this);
@@ -101,6 +129,20 @@ Material* Material::Builder::build(Engine& engine) {
 
 namespace details {
 
+// the shaders of a variant built by a job, waiting for the engine's thread to create the program
+struct FMaterial::PendingProgram {
+    Program program;
+    bool succeeded = false;
+    std::atomic<bool> ready = { false };
+};
+
+// the engine's ShaderBuilders can only be used by its thread, the jobs each use their thread's
+static filaflat::ShaderBuilder& getThreadShaderBuilder(ShaderType type) noexcept {
+    static UTILS_DECLARE_TLS(filaflat::ShaderBuilder) vsBuilder;
+    static UTILS_DECLARE_TLS(filaflat::ShaderBuilder) fsBuilder;
+    return type == ShaderType::VERTEX ? vsBuilder : fsBuilder;
+}
+
 FMaterial::FMaterial(FEngine& engine, const Material::Builder& builder)
         : mEngine(engine),
           mMaterialId(engine.getMaterialId())
@@ -117,6 +159,9 @@ FMaterial::FMaterial(FEngine& engine, const Material::Builder& builder)
     UTILS_UNUSED_IN_RELEASE bool uibOK = parser->getUIB(&mUniformInterfaceBlock);
     assert(uibOK);
 
+    // Push constants are optional.
+    parser->getPushConstants(&mPushConstantBlock);
+
     // Sampler bindings are only required for Vulkan.
     UTILS_UNUSED_IN_RELEASE bool sbOK = parser->getSamplerBindingMap(&mSamplerBindings);
     assert(engine.getBackend() == Backend::OPENGL || sbOK);
@@ -134,6 +179,10 @@ FMaterial::FMaterial(FEngine& engine, const Material::Builder& builder)
     }
     mIsVariantLit = mShading != Shading::UNLIT || mHasShadowMultiplier;
 
+    parser->hasBindlessSamplers(&mHasBindlessSamplers);
+    mHasBindlessSamplers = mHasBindlessSamplers && engine.getBackend() == Backend::OPENGL &&
+            engine.getDriver().getShaderModel() == ShaderModel::GL_CORE_41;
+
     // create raster state
     using BlendFunction = Driver::RasterState::BlendFunction;
     using DepthFunc = Driver::RasterState::DepthFunc;
@@ -209,6 +258,7 @@ FMaterial::FMaterial(FEngine& engine, const Material::Builder& builder)
                 cachedPrograms[i] = engine.getDefaultMaterial()->getProgram(i);
             }
         }
+        mSharedDepthInstance = engine.getDefaultMaterial()->getDefaultInstance();
     }
 
     bool colorWrite;
@@ -226,6 +276,19 @@ FMaterial::~FMaterial() noexcept {
 }
 
 void FMaterial::terminate(FEngine& engine) {
+    if (engine.debug.material.variant_usage) {
+        dumpVariantUsage();
+    }
+
+    // the jobs building our shaders must be done before we go away
+    if (mPendingProgramsJob) {
+        engine.getJobSystem().runAndWait(mPendingProgramsJob);
+        mPendingProgramsJob = nullptr;
+    }
+    for (auto& pending : mPendingPrograms) {
+        pending.reset();
+    }
+
     DriverApi& driverApi = engine.getDriverApi();
     auto& cachedPrograms = mCachedPrograms;
     for (size_t i = 0, n = cachedPrograms.size(); i < n; ++i) {
@@ -240,7 +303,14 @@ void FMaterial::terminate(FEngine& engine) {
         }
         driverApi.destroyProgram(cachedPrograms[i]);
     }
+    driverApi.destroyProgram(mComputeProgram);
     mDefaultInstance.terminate(engine);
+
+    // the programs that were just created may reference the shaders in the parser's memory, it
+    // is freed by the driver thread once it has created them
+    filaflat::MaterialParser* const parser = mMaterialParser;
+    mMaterialParser = nullptr;
+    driverApi.queueCommand([parser]() { delete parser; });
 }
 
 FMaterialInstance* FMaterial::createInstance() const noexcept {
@@ -248,7 +318,7 @@ FMaterialInstance* FMaterial::createInstance() const noexcept {
 }
 
 bool FMaterial::hasParameter(const char* name) const noexcept {
-    if (!mUniformInterfaceBlock.hasUniform(name)) {
+    if (!mUniformInterfaceBlock.hasUniform(name) && !mPushConstantBlock.hasUniform(name)) {
         return mSamplerInterfaceBlock.hasSampler(name);
     }
     return true;
@@ -259,15 +329,38 @@ Handle<HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
 
     assert(!Variant::isReserved(variantKey));
 
+    std::unique_ptr<PendingProgram>& pending = mPendingPrograms[variantKey];
+    if (UTILS_UNLIKELY(pending)) {
+        // a job is already reading this program, wait for it rather than reading it again
+        if (!pending->ready.load(std::memory_order_acquire)) {
+            mEngine.getJobSystem().runAndWait(mPendingProgramsJob);
+            mPendingProgramsJob = nullptr;
+        }
+        const bool succeeded = pending->succeeded;
+        if (UTILS_LIKELY(succeeded)) {
+            auto program = mEngine.getDriverApi().createProgram(std::move(pending->program));
+            assert(program);
+            mCachedPrograms[variantKey] = program;
+        }
+        pending.reset();
+        if (UTILS_LIKELY(succeeded)) {
+            return mCachedPrograms[variantKey];
+        }
+        // otherwise the shaders are read again below, which reports the missing shader
+    }
+
     uint8_t vertexVariantKey = Variant::filterVariantVertex(variantKey);
     uint8_t fragmentVariantKey = Variant::filterVariantFragment(variantKey);
 
+    filaflat::ShaderBuilder& vsBuilder = mEngine.getVertexShaderBuilder();
+    filaflat::ShaderBuilder& fsBuilder = mEngine.getFragmentShaderBuilder();
+
+    std::unique_lock<Mutex> lock(mParserLock);
+
     /*
      * Vertex shader
      */
 
-    filaflat::ShaderBuilder& vsBuilder = mEngine.getVertexShaderBuilder();
-
     UTILS_UNUSED_IN_RELEASE bool vsOK = mMaterialParser->getShader(sm,
             vertexVariantKey, ShaderType::VERTEX, vsBuilder);
 
@@ -276,14 +369,10 @@ Handle<HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
             "GLSL or SPIR-V chunks for the vertex shader (variant=0x%x, filtered=0x%x).",
             mName.c_str(), variantKey, vertexVariantKey);
 
-    CString vs(vsBuilder.getShader(), (CString::size_type) vsBuilder.size());
-
     /*
      * Fragment shader
      */
 
-    filaflat::ShaderBuilder& fsBuilder = mEngine.getFragmentShaderBuilder();
-
     UTILS_UNUSED_IN_RELEASE bool fsOK = mMaterialParser->getShader(sm,
             fragmentVariantKey, ShaderType::FRAGMENT, fsBuilder);
 
@@ -291,45 +380,270 @@ Handle<HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
             "The material '%s' has not been compiled to include the required "
             "GLSL or SPIR-V chunks for the fragment shader (variant=0x%x, filterer=0x%x).",
             mName.c_str(), variantKey, fragmentVariantKey);
-    CString fs(fsBuilder.getShader(), (CString::size_type) fsBuilder.size());
 
+    lock.unlock();
+
+    auto program = mEngine.getDriverApi().createProgram(
+            makeProgram(variantKey, vsBuilder, fsBuilder));
+    assert(program);
+
+    mCachedPrograms[variantKey] = program;
+    return program;
+}
+
+Handle<HwProgram> FMaterial::getComputeProgram() const noexcept {
+    if (UTILS_LIKELY(mComputeProgram) || !mHasComputeShader) {
+        return mComputeProgram;
+    }
+
+    DriverApi& driverApi = mEngine.getDriverApi();
+    if (!driverApi.isComputeSupported()) {
+        mHasComputeShader = false;
+        return {};
+    }
+
+    const ShaderModel sm = mEngine.getDriver().getShaderModel();
+    filaflat::ShaderBuilder& csBuilder = mEngine.getVertexShaderBuilder();
+
+    std::unique_lock<Mutex> lock(mParserLock);
+    if (!mMaterialParser->getShader(sm, 0, ShaderType::COMPUTE, csBuilder) ||
+            csBuilder.size() == 0) {
+        // the material doesn't have a compute block
+        mHasComputeShader = false;
+        return {};
+    }
+    Program pb;
+    setProgramShader(pb, Program::Shader::COMPUTE, csBuilder);
+    lock.unlock();
+
+    pb      .diagnostics(mName, 0)
+            .addUniformBlock(BindingPoints::PER_VIEW, &UibGenerator::getPerViewUib())
+            .addUniformBlock(BindingPoints::PER_MATERIAL_INSTANCE, &mUniformInterfaceBlock);
+
+    mComputeProgram = driverApi.createComputeProgram(std::move(pb));
+    assert(mComputeProgram);
+    return mComputeProgram;
+}
+
+void FMaterial::setProgramShader(Program& program, Program::Shader shader,
+        filaflat::ShaderBuilder const& builder) noexcept {
+    if (builder.isReference()) {
+        // the SPIR-V in the package, the parser is kept until the driver created the program
+        program.shaderReference(shader, builder.getShader(), builder.size());
+    } else {
+        program.shader(shader, CString(builder.getShader(), (CString::size_type) builder.size()));
+    }
+}
+
+Program FMaterial::makeProgram(uint8_t variantKey,
+        filaflat::ShaderBuilder const& vsBuilder,
+        filaflat::ShaderBuilder const& fsBuilder) const noexcept {
     Program pb;
+    setProgramShader(pb, Program::Shader::VERTEX, vsBuilder);
+    setProgramShader(pb, Program::Shader::FRAGMENT, fsBuilder);
     pb      .diagnostics(mName, variantKey)
-            .withVertexShader(vs)
-            .withFragmentShader(fs)
             .withSamplerBindings(&mSamplerBindings)
             .addUniformBlock(BindingPoints::PER_VIEW, &UibGenerator::getPerViewUib())
             .addUniformBlock(BindingPoints::LIGHTS, &UibGenerator::getLightsUib())
             .addUniformBlock(BindingPoints::PER_RENDERABLE, &UibGenerator::getPerRenderableUib())
+            .addUniformBlock(BindingPoints::PER_INSTANCE, &UibGenerator::getPerInstanceUib())
             .addUniformBlock(BindingPoints::PER_MATERIAL_INSTANCE, &mUniformInterfaceBlock)
             .addSamplerBlock(BindingPoints::PER_VIEW, &SibGenerator::getPerViewSib())
-            .addSamplerBlock(BindingPoints::PER_MATERIAL_INSTANCE, &mSamplerInterfaceBlock);
+            .addSamplerBlock(BindingPoints::PER_MATERIAL_INSTANCE, &mSamplerInterfaceBlock)
+            .specializationConstant(Variant::DYNAMIC_LIGHTING_CONSTANT_ID,
+                    Variant(variantKey).hasDynamicLighting());
 
     if (Variant(variantKey).hasSkinning()) {
         pb.addUniformBlock(BindingPoints::PER_RENDERABLE_BONES, &UibGenerator::getPerRenderableBonesUib());
     }
+    if (Variant(variantKey).hasMorphing()) {
+        pb.addSamplerBlock(BindingPoints::PER_RENDERABLE, &SibGenerator::getPerRenderableSib());
+    }
+    if (!mPushConstantBlock.isEmpty()) {
+        pb.withPushConstants(&mPushConstantBlock);
+    }
+    if (mHasBindlessSamplers) {
+        pb.addUniformBlock(BindingPoints::BINDLESS_TEXTURES,
+                &UibGenerator::getBindlessTexturesUib());
+    }
+    return pb;
+}
 
-    auto program = mEngine.getDriverApi().createProgram(std::move(pb));
-    assert(program);
+void FMaterial::prepareProgram(uint8_t variantKey) const noexcept {
+    assert( variantKey == Variant::filterVariant(variantKey, isVariantLit()) );
 
-    mCachedPrograms[variantKey] = program;
-    return program;
+    // all the draws go through here (once per run of commands using the same variant)
+    if (UTILS_UNLIKELY(mEngine.debug.material.variant_usage)) {
+        mVariantUsage[variantKey]++;
+    }
+
+    if (UTILS_LIKELY(mCachedPrograms[variantKey])) {
+        return;
+    }
+
+    std::unique_ptr<PendingProgram>& pending = mPendingPrograms[variantKey];
+    if (!pending) {
+        // Reading the shaders from the package (and decompressing them) is the expensive part,
+        // it's done by a job so the commands of this frame don't wait for it.
+        JobSystem& js = mEngine.getJobSystem();
+        if (!mPendingProgramsJob) {
+            mPendingProgramsJob = js.createJob();
+        }
+        pending.reset(new PendingProgram);
+        const ShaderModel sm = mEngine.getDriver().getShaderModel();
+        PendingProgram* const result = pending.get();
+        JobSystem::Job* job = jobs::createJob(js, mPendingProgramsJob,
+                [this, sm, variantKey, result]() {
+            filaflat::ShaderBuilder& vsBuilder = getThreadShaderBuilder(ShaderType::VERTEX);
+            filaflat::ShaderBuilder& fsBuilder = getThreadShaderBuilder(ShaderType::FRAGMENT);
+            std::unique_lock<Mutex> lock(mParserLock);
+            result->succeeded =
+                    mMaterialParser->getShader(sm, Variant::filterVariantVertex(variantKey),
+                            ShaderType::VERTEX, vsBuilder) && vsBuilder.size() > 0 &&
+                    mMaterialParser->getShader(sm, Variant::filterVariantFragment(variantKey),
+                            ShaderType::FRAGMENT, fsBuilder) && fsBuilder.size() > 0;
+            lock.unlock();
+            if (result->succeeded) {
+                result->program = makeProgram(variantKey, vsBuilder, fsBuilder);
+            }
+            result->ready.store(true, std::memory_order_release);
+        });
+        js.run(job);
+        return;
+    }
+
+    if (pending->ready.load(std::memory_order_acquire)) {
+        if (UTILS_LIKELY(pending->succeeded)) {
+            auto program = mEngine.getDriverApi().createProgram(std::move(pending->program));
+            assert(program);
+            mCachedPrograms[variantKey] = program;
+            pending.reset();
+        } else {
+            // this reports the missing shader
+            getProgramSlow(variantKey);
+        }
+    }
+}
+
+void FMaterial::dumpVariantUsage() const noexcept {
+    io::ostream& out = slog.i;
+    out << "Variant usage of material \"" << mName.c_str() << "\":" << io::endl;
+
+    uint8_t usedFeatures = 0;
+    for (uint8_t k = 0; k < VARIANT_COUNT; k++) {
+        if (!mVariantUsage[k]) {
+            continue;
+        }
+        out << "    variant 0x" << io::hex << uint32_t(k) << io::dec << ": " << mVariantUsage[k] << io::endl;
+        // the depth variant belongs to the default material unless we have a custom one
+        if (!Variant(k).isDepthPass() || mHasCustomDepthShader) {
+            usedFeatures |= k;
+        }
+    }
+
+    // The features that matc can filter out (see MaterialBuilder::variantFilter()) and that
+    // none of the used variants has. This is only as good as the content that was rendered.
+    static constexpr struct { uint8_t bit; const char* name; } FEATURES[] = {
+            { Variant::DIRECTIONAL_LIGHTING, "directionalLighting" },
+            { Variant::DYNAMIC_LIGHTING,     "dynamicLighting" },
+            { Variant::SHADOW_RECEIVER,      "shadowReceiver" },
+            { Variant::SKINNING,             "skinning" },
+            { Variant::MORPHING,             "morphing" },
+    };
+    const char* separator = "";
+    out << "    unused features: --variant-filter=";
+    for (auto const& feature : FEATURES) {
+        if (!(usedFeatures & feature.bit)) {
+            out << separator << feature.name;
+            separator = ",";
+        }
+    }
+    out << io::endl;
+}
+
+Handle<HwProgram> FMaterial::getFallbackProgram(uint8_t variantKey) const noexcept {
+    // The depth variants are never replaced. Other variants can be replaced by one with fewer
+    // lighting features, but the skinning and morphing must match since they affect the vertex
+    // positions.
+    if (Variant(variantKey).isDepthPass()) {
+        return {};
+    }
+    Handle<HwProgram> fallback;
+    int fallbackFeatureCount = -1;
+    const uint8_t lightingFeatures = variantKey & uint8_t(~Variant::GEOMETRY_MASK);
+    for (uint8_t k = 0; k < VARIANT_COUNT; k++) {
+        const uint8_t features = k & uint8_t(~Variant::GEOMETRY_MASK);
+        const bool sameGeometry =
+                (k & Variant::GEOMETRY_MASK) == (variantKey & Variant::GEOMETRY_MASK);
+        if ((features & ~lightingFeatures) || !sameGeometry ||
+                Variant::isReserved(k) || Variant(k).isDepthPass() || !mCachedPrograms[k]) {
+            continue;
+        }
+        const int featureCount = int(utils::popcount(unsigned(features)));
+        if (featureCount > fallbackFeatureCount) {
+            fallbackFeatureCount = featureCount;
+            fallback = mCachedPrograms[k];
+        }
+    }
+    return fallback;
+}
+
+void FMaterial::compile(uint8_t features) const noexcept {
+    static_assert(Material::VariantFeatures::DIRECTIONAL_LIGHTING == Variant::DIRECTIONAL_LIGHTING &&
+            Material::VariantFeatures::DYNAMIC_LIGHTING == Variant::DYNAMIC_LIGHTING &&
+            Material::VariantFeatures::SHADOW_RECEIVER == Variant::SHADOW_RECEIVER &&
+            Material::VariantFeatures::SKINNING == Variant::SKINNING &&
+            Material::VariantFeatures::MORPHING == Variant::MORPHING,
+            "Material::VariantFeatures doesn't match Variant");
+
+    const ShaderModel sm = mEngine.getDriver().getShaderModel();
+    filaflat::ShaderBuilder& vsBuilder = mEngine.getVertexShaderBuilder();
+    filaflat::ShaderBuilder& fsBuilder = mEngine.getFragmentShaderBuilder();
+
+    for (uint8_t k = 0; k < VARIANT_COUNT; k++) {
+        if (Variant::isReserved(k)) {
+            continue;
+        }
+        // the depth variants are needed whenever there are shadows or a depth prepass
+        const uint8_t allowed = Variant(k).isDepthPass() ? (features | Variant::DEPTH_VARIANT)
+                                                         : features;
+        if (k & ~allowed) {
+            continue;
+        }
+        const uint8_t variantKey = Variant::filterVariant(k, isVariantLit());
+        if (mCachedPrograms[variantKey]) {
+            continue;
+        }
+        // skip the variants that were filtered out when the material was built, instead of
+        // failing like getProgramSlow() does
+        std::unique_lock<Mutex> lock(mParserLock);
+        if (!mMaterialParser->getShader(sm, Variant::filterVariantVertex(variantKey),
+                    ShaderType::VERTEX, vsBuilder) ||
+            !mMaterialParser->getShader(sm, Variant::filterVariantFragment(variantKey),
+                    ShaderType::FRAGMENT, fsBuilder)) {
+            continue;
+        }
+        lock.unlock();
+        getProgramSlow(variantKey);
+    }
 }
 
 size_t FMaterial::getParameters(ParameterInfo* parameters, size_t count) const noexcept {
     count = std::min(count, getParameterCount());
 
-    const auto& uniforms = mUniformInterfaceBlock.getUniformInfoList();
     size_t i = 0;
-    size_t uniformCount = std::min(count, uniforms.size());
-    for ( ; i < uniformCount; i++) {
-        ParameterInfo& info = parameters[i];
-        const auto& uniformInfo = uniforms[i];
-        info.name = uniformInfo.name.c_str();
-        info.isSampler = false;
-        info.type = uniformInfo.type;
-        info.count = uniformInfo.size;
-        info.precision = uniformInfo.precision;
+    for (UniformInterfaceBlock const* block : { &mUniformInterfaceBlock, &mPushConstantBlock }) {
+        const auto& uniforms = block->getUniformInfoList();
+        size_t uniformCount = std::min(count, i + uniforms.size());
+        for (size_t j = 0; i < uniformCount; i++, j++) {
+            ParameterInfo& info = parameters[i];
+            const auto& uniformInfo = uniforms[j];
+            info.name = uniformInfo.name.c_str();
+            info.isSampler = false;
+            info.type = uniformInfo.type;
+            info.count = uniformInfo.size;
+            info.precision = uniformInfo.precision;
+        }
     }
 
     const auto& samplers = mSamplerInterfaceBlock.getSamplerInfoList();
@@ -358,6 +672,10 @@ MaterialInstance* Material::createInstance() const noexcept {
     return upcast(this)->createInstance();
 }
 
+void Material::compile(uint8_t features) noexcept {
+    upcast(this)->compile(features);
+}
+
 const char* Material::getName() const noexcept {
     return upcast(this)->getName().c_str();
 }
@@ -22,6 +22,10 @@
 #include "details/Material.h"
 #include "details/Texture.h"
 
+#include <utils/Hash.h>
+
+#include <string>
+
 using namespace math;
 
 namespace filament {
@@ -37,17 +41,36 @@ FMaterialInstance::FMaterialInstance(FEngine& engine, FMaterial const* material)
     mMaterial = material;
     mMaterialSortingKey = RenderPass::makeMaterialSortingKey(
             material->getId(), material->generateMaterialInstanceId());
+    updateStateSortingKey();
 
     if (!material->getUniformInterfaceBlock().isEmpty()) {
         mUniforms = UniformBuffer(upcast(material)->getDefaultInstance()->mUniforms);
-        mUbHandle = driver.createUniformBuffer(mUniforms.getSize());
+    }
+
+    if (!material->getPushConstantBlock().isEmpty()) {
+        mPushConstants = UniformBuffer(upcast(material)->getDefaultInstance()->mPushConstants);
+        mCommittedPushConstants = UniformBuffer(mPushConstants);
     }
 
     if (!material->getSamplerInterfaceBlock().isEmpty()) {
         mSamplers = SamplerBuffer(material->getDefaultInstance()->getSamplerBuffer());
-        mSbHandle = driver.createSamplerBuffer(mSamplers.getSize());
     }
 
+    // the push constants are sent by use(), so these instances can't be drawn in place of
+    // each other, and keep their own buffers
+    mIsSharable = mPushConstants.getSize() == 0;
+    if (!mIsSharable) {
+        if (mUniforms.getSize()) {
+            mUbHandle = driver.createUniformBuffer(mUniforms.getSize());
+        }
+        if (mSamplers.getSize()) {
+            mSbHandle = driver.createSamplerBuffer(mSamplers.getSize());
+        }
+    }
+
+    // the buffers are uploaded, or shared, by the next FEngine::prepare()
+    markDirty();
+
     if (material->getBlendingMode() == BlendingMode::MASKED) {
         static_cast<MaterialInstance*>(this)->setParameter(
                 "maskThreshold", material->getMaskThreshold());
@@ -60,17 +83,26 @@ void FMaterialInstance::initDefaultInstance(FEngine& engine, FMaterial const* ma
     mMaterial = material;
     mMaterialSortingKey = RenderPass::makeMaterialSortingKey(
             material->getId(), material->generateMaterialInstanceId());
+    updateStateSortingKey();
 
     if (!material->getUniformInterfaceBlock().isEmpty()) {
         mUniforms = UniformBuffer(material->getUniformInterfaceBlock());
         mUbHandle = driver.createUniformBuffer(mUniforms.getSize());
     }
 
+    if (!material->getPushConstantBlock().isEmpty()) {
+        mPushConstants = UniformBuffer(material->getPushConstantBlock());
+        mCommittedPushConstants = UniformBuffer(mPushConstants);
+    }
+
     if (!material->getSamplerInterfaceBlock().isEmpty()) {
         mSamplers = SamplerBuffer(material->getSamplerInterfaceBlock());
         mSbHandle = driver.createSamplerBuffer(mSamplers.getSize());
     }
 
+    // the buffers are uploaded by the next FEngine::prepare()
+    markDirty();
+
     if (material->getBlendingMode() == BlendingMode::MASKED) {
         static_cast<MaterialInstance*>(this)->setParameter(
                 "maskThreshold", material->getMaskThreshold());
@@ -80,27 +112,230 @@ void FMaterialInstance::initDefaultInstance(FEngine& engine, FMaterial const* ma
 FMaterialInstance::~FMaterialInstance() noexcept = default;
 
 void FMaterialInstance::terminate(FEngine& engine) {
-    FEngine::DriverApi& driver = engine.getDriverApi();
-    driver.destroyUniformBuffer(mUbHandle);
-    driver.destroySamplerBuffer(mSbHandle);
+    if (mIsDirty) {
+        engine.removeDirtyMaterialInstance(this);
+    }
+    releaseBuffers(engine);
 }
 
 void FMaterialInstance::commitSlow(FEngine& engine) const {
+    if (mIsSharable) {
+        // only the engine's list of dirty instances commits them, and they're never const
+        const_cast<FMaterialInstance*>(this)->share(engine);
+        return;
+    }
+    upload(engine.getDriverApi());
+}
+
+void FMaterialInstance::upload(FEngine::DriverApi& driver) const {
     // update uniforms if needed
-    FEngine::DriverApi& driver = engine.getDriverApi();
     if (mUniforms.isDirty()) {
-        driver.updateUniformBuffer(mUbHandle, UniformBuffer(mUniforms));
+        driver.updateUniformBuffer(mUbHandle, mUniforms.copyDirtyRange());
         mUniforms.clean();
     }
     if (mSamplers.isDirty()) {
         driver.updateSamplerBuffer(mSbHandle, SamplerBuffer(mSamplers));
         mSamplers.clean();
+        updateStateSortingKey();
+    }
+    if (mPushConstants.isDirty()) {
+        // the commands of the previous frame may still be recorded from the committed copy
+        const size_t size = mPushConstants.getSize();
+        memcpy(mCommittedPushConstants.invalidateUniforms(0, size),
+                mPushConstants.getBuffer(), size);
+        mCommittedPushConstants.clean();
+        mPushConstants.clean();
     }
 }
 
+/*
+ * The instances with the same parameters, e.g. thousands of instances with the same color,
+ * share the buffers of an instance owned by the engine, and are drawn in its place (see
+ * getBatchInstance()). The engine's instances are found by the hash of their parameters, and
+ * are destroyed with their last user. Setting a parameter leaves the shared buffers untouched,
+ * the instance moves to the buffers matching its new parameters when it's committed, unless it
+ * was their only user, which then updates them in place.
+ */
+void FMaterialInstance::share(FEngine& engine) {
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    tsl::robin_map<uint64_t, FMaterialInstance*>& instances = engine.getSharedMaterialInstances();
+    if (mSamplers.isDirty()) {
+        updateStateSortingKey();
+    }
+
+    FMaterialInstance* shared = mShared;
+    if (shared && hasSameParameters(*shared)) {
+        // the parameters were set to the values they already had
+        mUniforms.clean();
+        mSamplers.clean();
+        return;
+    }
+
+    const uint64_t key = hashParameters();
+    auto pos = instances.find(key);
+    if (pos == instances.end() && shared && shared->mShareCount == 1) {
+        // the shared instance has this instance's previous parameters, so only the modified
+        // ones are copied
+        instances.erase(shared->mShareKey);
+        if (mUniforms.isDirty()) {
+            const size_t offset = mUniforms.getDirtyOffset();
+            const size_t size = mUniforms.getDirtySize();
+            memcpy(shared->mUniforms.invalidateUniforms(offset, size),
+                    static_cast<char const*>(mUniforms.getBuffer()) + offset, size);
+        }
+        if (mSamplers.isDirty()) {
+            shared->mSamplers = mSamplers;
+        }
+        shared->upload(driver);
+        shared->mShareKey = key;
+        instances.insert({ key, shared });
+        mUniforms.clean();
+        mSamplers.clean();
+        return;
+    }
+
+    if (UTILS_UNLIKELY(pos != instances.end() && !hasSameParameters(*pos->second))) {
+        // different parameters with the same hash, this instance keeps its own buffers
+        if (shared || !(mUbHandle || mSbHandle)) {
+            releaseBuffers(engine);
+            createBuffers(driver);
+        }
+        upload(driver);
+        return;
+    }
+
+    releaseBuffers(engine);
+    if (pos == instances.end()) {
+        // the engine's instances aren't in its lists, and are only used through their users
+        void* const p = engine.getHeapAllocator().alloc(
+                sizeof(FMaterialInstance), alignof(FMaterialInstance));
+        shared = new(p) FMaterialInstance();
+        shared->mMaterial = mMaterial;
+        shared->mMaterialSortingKey = RenderPass::makeMaterialSortingKey(
+                mMaterial->getId(), mMaterial->generateMaterialInstanceId());
+        shared->mUniforms = UniformBuffer(mUniforms);
+        shared->mSamplers = mSamplers;
+        shared->mShareKey = key;
+        shared->createBuffers(driver);
+        pos = instances.insert({ key, shared }).first;
+    }
+    shared = pos->second;
+    shared->mShareCount++;
+    mShared = shared;
+    engine.materialSharingChanged();
+    mUbHandle = shared->mUbHandle;
+    mSbHandle = shared->mSbHandle;
+    mUniforms.clean();
+    mSamplers.clean();
+}
+
+void FMaterialInstance::createBuffers(FEngine::DriverApi& driver) {
+    // the new buffers get all the parameters
+    if (mUniforms.getSize()) {
+        mUbHandle = driver.createUniformBuffer(mUniforms.getSize());
+        driver.updateUniformBuffer(mUbHandle, UniformBuffer(mUniforms));
+        mUniforms.clean();
+    }
+    if (mSamplers.getSize()) {
+        mSbHandle = driver.createSamplerBuffer(mSamplers.getSize());
+        driver.updateSamplerBuffer(mSbHandle, SamplerBuffer(mSamplers));
+        mSamplers.clean();
+    }
+    updateStateSortingKey();
+}
+
+void FMaterialInstance::releaseBuffers(FEngine& engine) {
+    FMaterialInstance* const shared = mShared;
+    if (shared) {
+        // the shared instances are never dirty, and don't use their material here, which can
+        // already be gone when the engine shuts down
+        if (--shared->mShareCount == 0) {
+            engine.getSharedMaterialInstances().erase(shared->mShareKey);
+            shared->releaseBuffers(engine);
+            engine.getHeapAllocator().destroy(shared);
+        }
+        // the cached commands can still point to the shared instance
+        engine.materialSharingChanged();
+    } else {
+        FEngine::DriverApi& driver = engine.getDriverApi();
+        driver.destroyUniformBuffer(mUbHandle);
+        driver.destroySamplerBuffer(mSbHandle);
+    }
+    mShared = nullptr;
+    mUbHandle.clear();
+    mSbHandle.clear();
+}
+
+uint64_t FMaterialInstance::hashParameters() const noexcept {
+    static_assert(sizeof(SamplerBuffer::Sampler) % 4 == 0,
+            "Hashing requires a size that is a multiple of 4.");
+    // the material id seeds both halves, murmur3() can't hash empty buffers
+    const uint32_t seed = mMaterial->getId();
+    const size_t uniformWords = mUniforms.getSize() / 4;
+    const size_t samplerWords = mSamplers.getSize() * sizeof(SamplerBuffer::Sampler) / 4;
+    const uint32_t uniforms = uniformWords ? utils::hash::murmur3(
+            static_cast<uint32_t const*>(mUniforms.getBuffer()), uniformWords, seed) : seed;
+    const uint32_t samplers = samplerWords ? utils::hash::murmur3(
+            reinterpret_cast<uint32_t const*>(mSamplers.getBuffer()), samplerWords, seed) : seed;
+    return (uint64_t(uniforms) << 32u) | samplers;
+}
+
+bool FMaterialInstance::hasSameParameters(FMaterialInstance const& rhs) const noexcept {
+    const size_t uniformSize = mUniforms.getSize();
+    const size_t samplerSize = mSamplers.getSize() * sizeof(SamplerBuffer::Sampler);
+    return mMaterial == rhs.mMaterial &&
+            uniformSize == rhs.mUniforms.getSize() &&
+            mSamplers.getSize() == rhs.mSamplers.getSize() &&
+            (!uniformSize ||
+                    !memcmp(mUniforms.getBuffer(), rhs.mUniforms.getBuffer(), uniformSize)) &&
+            (!samplerSize ||
+                    !memcmp(mSamplers.getBuffer(), rhs.mSamplers.getBuffer(), samplerSize));
+}
+
+void FMaterialInstance::setPushConstants(FEngine::DriverApi& driver) const {
+    Driver::PushConstants constants;
+    constants.size = uint32_t(mCommittedPushConstants.getSize());
+    assert(constants.size <= sizeof(constants.data));
+    memcpy(constants.data, mCommittedPushConstants.getBuffer(), constants.size);
+    driver.setPushConstants(constants);
+}
+
+void FMaterialInstance::markDirty() noexcept {
+    mMaterial->getEngine().contentChanged();
+    if (!mIsDirty) {
+        mIsDirty = true;
+        mMaterial->getEngine().addDirtyMaterialInstance(this);
+    }
+}
+
+void FMaterialInstance::updateStateSortingKey() const noexcept {
+    // fold the textures of this instance into a few bits, instances using the same textures
+    // end-up next to each other with STATE_SORTING
+    uint32_t hash = 0;
+    SamplerBuffer::Sampler const* samplers = mSamplers.getBuffer();
+    for (size_t i = 0, c = mSamplers.getSize(); i < c; i++) {
+        hash = hash * 31u + samplers[i].t.getId();
+    }
+    hash ^= (hash >> 16u);
+    hash ^= (hash >> 8u);
+    mMaterialStateSortingKey = RenderPass::makeMaterialStateSortingKey(
+            mMaterial->getId(), hash,
+            uint32_t(mMaterialSortingKey & RenderPass::MATERIAL_INSTANCE_ID_MASK));
+}
+
 template <typename T>
 inline void FMaterialInstance::setParameter(const char* name, T value) noexcept {
-    mUniforms.setUniform<T>(mMaterial->getUniformInterfaceBlock(), name, 0, value);
+    UniformInterfaceBlock const& pushConstants = mMaterial->getPushConstantBlock();
+    if (UTILS_UNLIKELY(pushConstants.hasUniform(name))) {
+        mPushConstants.setUniform<T>(size_t(pushConstants.getUniformOffset(name, 0)), value);
+        markDirty();
+        return;
+    }
+    ssize_t offset = mMaterial->getUniformInterfaceBlock().getUniformOffset(name, 0);
+    if (offset >= 0) {
+        mUniforms.setUniform<T>(size_t(offset), value);
+        markDirty();
+    }
 }
 
 template <typename T>
@@ -108,13 +343,28 @@ inline void FMaterialInstance::setParameter(const char* name, const T* value, si
     ssize_t offset = mMaterial->getUniformInterfaceBlock().getUniformOffset(name, 0);
     if (offset >= 0) {
         mUniforms.setUniformArray<T>(size_t(offset), value, count);
+        markDirty();
     }
 }
 
 void FMaterialInstance::setParameter(const char* name,
         Texture const* texture, TextureSampler const& sampler) noexcept {
+    Handle<HwTexture> const th = upcast(texture)->getHwHandle();
     mSamplers.setSampler(mMaterial->getSamplerInterfaceBlock(), name, 0,
-            { upcast(texture)->getHwHandle(), sampler.getSamplerParams() });
+            { th, sampler.getSamplerParams() });
+    if (mMaterial->hasBindlessSamplers()) {
+        // the shaders read the texture from the table, unless it's an external sampler
+        std::string indexName(std::string(name) + "BindlessIndex");
+        ssize_t offset = mMaterial->getUniformInterfaceBlock().getUniformOffset(
+                indexName.c_str(), 0);
+        if (offset >= 0) {
+            FEngine& engine = mMaterial->getEngine();
+            uint32_t index = engine.getBindlessTextureTable().getIndex(
+                    engine.getDriverApi(), th, sampler.getSamplerParams());
+            mUniforms.setUniform(size_t(offset), index);
+        }
+    }
+    markDirty();
 }
 
 } // namespace details
@@ -191,10 +441,12 @@ void MaterialInstance::setParameter(const char* name, RgbaType type, float4 colo
 void MaterialInstance::setScissor(uint32_t left, uint32_t bottom, uint32_t width,
         uint32_t height) noexcept {
     upcast(this)->setScissor(left, bottom, width, height);
+    upcast(getMaterial())->getEngine().contentChanged();
 }
 
 void MaterialInstance::unsetScissor() noexcept {
     upcast(this)->unsetScissor();
+    upcast(getMaterial())->getEngine().contentChanged();
 }
 
 } // namespace filament
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/MorphTargetBuffer.h"
+
+#include "details/Engine.h"
+
+#include "driver/SamplerBuffer.h"
+
+#include "FilamentAPI-impl.h"
+
+#include <utils/Panic.h>
+
+#include <algorithm>
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace filament {
+
+using namespace details;
+using namespace driver;
+using namespace math;
+
+struct MorphTargetBuffer::BuilderDetails {
+    size_t mVertexCount = 0;
+    size_t mCount = 0;
+};
+
+using BuilderType = MorphTargetBuffer;
+BuilderType::Builder::Builder() noexcept = default;
+BuilderType::Builder::~Builder() noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder&& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder&& rhs) noexcept = default;
+
+MorphTargetBuffer::Builder& MorphTargetBuffer::Builder::vertexCount(size_t vertexCount) noexcept {
+    mImpl->mVertexCount = vertexCount;
+    return *this;
+}
+
+MorphTargetBuffer::Builder& MorphTargetBuffer::Builder::count(size_t count) noexcept {
+    mImpl->mCount = count;
+    return *this;
+}
+
+MorphTargetBuffer* MorphTargetBuffer::Builder::build(Engine& engine) {
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mVertexCount > 0, "vertexCount cannot be 0")) {
+        return nullptr;
+    }
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mCount > 0, "count cannot be 0")) {
+        return nullptr;
+    }
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mCount <= CONFIG_MAX_MORPH_TARGET_COUNT,
+            "count cannot be more than %u", (unsigned)CONFIG_MAX_MORPH_TARGET_COUNT)) {
+        return nullptr;
+    }
+
+    return upcast(engine).createMorphTargetBuffer(*this);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+namespace details {
+
+constexpr uint32_t FMorphTargetBuffer::MAX_WIDTH;
+
+FMorphTargetBuffer::FMorphTargetBuffer(FEngine& engine, const MorphTargetBuffer::Builder& builder)
+        : mVertexCount(uint32_t(builder->mVertexCount)),
+          mCount(uint32_t(builder->mCount)) {
+    FEngine::DriverApi& driver = engine.getDriverApi();
+
+    mWidth = std::min(mVertexCount, MAX_WIDTH);
+    mRowsPerTarget = (mVertexCount + mWidth - 1) / mWidth;
+
+    const uint32_t height = mRowsPerTarget * mCount;
+    mPositionsHandle = driver.createTexture(SamplerType::SAMPLER_2D, 1,
+            TextureFormat::RGBA32F, 1, mWidth, height, 1, TextureUsage::DEFAULT);
+    mNormalsHandle = driver.createTexture(SamplerType::SAMPLER_2D, 1,
+            TextureFormat::RGBA32F, 1, mWidth, height, 1, TextureUsage::DEFAULT);
+
+    // the default sampler parameters (nearest, clamp) are what texelFetch() needs
+    SamplerBuffer sb(engine.getPerRenderableSib());
+    sb.setSampler(FEngine::PerRenderableSib::MORPH_TARGET_POSITIONS, mPositionsHandle, {});
+    sb.setSampler(FEngine::PerRenderableSib::MORPH_TARGET_NORMALS, mNormalsHandle, {});
+    mSbHandle = driver.createSamplerBuffer(sb.getSize());
+    driver.updateSamplerBuffer(mSbHandle, std::move(sb));
+}
+
+void FMorphTargetBuffer::terminate(FEngine& engine) {
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    driver.destroySamplerBuffer(mSbHandle);
+    driver.destroyTexture(mPositionsHandle);
+    driver.destroyTexture(mNormalsHandle);
+}
+
+void FMorphTargetBuffer::setPositionsAt(FEngine& engine, size_t targetIndex,
+        float3 const* positions, size_t count) {
+    upload(engine, mPositionsHandle, targetIndex, positions, count);
+}
+
+void FMorphTargetBuffer::setNormalsAt(FEngine& engine, size_t targetIndex,
+        float3 const* normals, size_t count) {
+    upload(engine, mNormalsHandle, targetIndex, normals, count);
+}
+
+void FMorphTargetBuffer::upload(FEngine& engine, Handle<HwTexture> texture, size_t targetIndex,
+        float3 const* deltas, size_t count) {
+    if (!ASSERT_PRECONDITION_NON_FATAL(targetIndex < mCount, "targetIndex must be < count")) {
+        return;
+    }
+    if (!ASSERT_PRECONDITION_NON_FATAL(count <= mVertexCount,
+            "count must be <= vertexCount")) {
+        return;
+    }
+
+    // RGB32F textures can't be sampled everywhere, so the deltas are expanded to float4, the
+    // rows of the target are uploaded whole and the texels past the last vertex are zero.
+    const size_t texelCount = mWidth * mRowsPerTarget;
+    const size_t size = texelCount * sizeof(float4);
+    float4* const data = (float4*)malloc(size);
+    for (size_t i = 0; i < count; i++) {
+        data[i] = float4{ deltas[i], 0 };
+    }
+    memset(data + count, 0, (texelCount - count) * sizeof(float4));
+
+    engine.getDriverApi().load2DImage(texture, 0,
+            0, uint32_t(targetIndex * mRowsPerTarget), mWidth, mRowsPerTarget,
+            PixelBufferDescriptor(data, size, PixelDataFormat::RGBA, PixelDataType::FLOAT,
+                    [](void* buffer, size_t, void*) { free(buffer); }));
+    engine.contentChanged();
+}
+
+} // namespace details
+
+// ------------------------------------------------------------------------------------------------
+// Trampoline calling into private implementation
+// ------------------------------------------------------------------------------------------------
+
+using namespace details;
+
+void MorphTargetBuffer::setPositionsAt(Engine& engine, size_t targetIndex,
+        float3 const* positions, size_t count) {
+    upcast(this)->setPositionsAt(upcast(engine), targetIndex, positions, count);
+}
+
+void MorphTargetBuffer::setNormalsAt(Engine& engine, size_t targetIndex,
+        float3 const* normals, size_t count) {
+    upcast(this)->setNormalsAt(upcast(engine), targetIndex, normals, count);
+}
+
+size_t MorphTargetBuffer::getVertexCount() const noexcept {
+    return upcast(this)->getVertexCount();
+}
+
+size_t MorphTargetBuffer::getCount() const noexcept {
+    return upcast(this)->getCount();
+}
+
+} // namespace filament
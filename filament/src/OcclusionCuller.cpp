@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/OcclusionCuller.h"
+
+#include <utils/Systrace.h>
+
+#include <math/vec2.h>
+#include <math/vec4.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+
+using namespace math;
+
+namespace filament {
+namespace details {
+
+OcclusionCuller::OcclusionCuller() noexcept {
+    uint32_t offset = 0;
+    for (size_t i = 0; i < LEVEL_COUNT; i++) {
+        mLevelOffset[i] = offset;
+        offset += width(i) * height(i);
+    }
+}
+
+void OcclusionCuller::prepare(mat4f const& clipFromWorld) noexcept {
+    if (mDepth.empty()) {
+        // allocate storage only when occlusion culling is actually used
+        mDepth.resize(mLevelOffset[LEVEL_COUNT - 1] + width(LEVEL_COUNT - 1) * height(LEVEL_COUNT - 1));
+    }
+    mClipFromWorld = clipFromWorld;
+    mHasOccluders = false;
+    std::fill(mDepth.begin(), mDepth.begin() + WIDTH * HEIGHT, std::numeric_limits<float>::infinity());
+}
+
+bool OcclusionCuller::project(mat4f const& clipFromBox,
+        float3 const& center, float3 const& extent, float3 corners[8]) noexcept {
+    mat4f const& m = clipFromBox;
+    for (size_t i = 0; i < 8; i++) {
+        const float3 p = center + extent * float3{
+                (i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f };
+        const float4 c = m * float4{ p, 1 };
+        if (c.w <= std::numeric_limits<float>::epsilon()) {
+            return false;
+        }
+        const float3 ndc = c.xyz / c.w;
+        corners[i] = { (ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT, ndc.z };
+    }
+    return true;
+}
+
+void OcclusionCuller::rasterize(float3 const& center, float3 const& extent) noexcept {
+    float3 corners[8];
+    if (project(center, extent, corners)) {
+        rasterize(corners);
+    }
+    // we can't use occluders crossing the camera plane
+}
+
+void OcclusionCuller::rasterize(mat4f const& worldFromLocal,
+        float3 const& center, float3 const& extent) noexcept {
+    float3 corners[8];
+    if (project(mClipFromWorld * worldFromLocal, center, extent, corners)) {
+        rasterize(corners);
+    }
+}
+
+void OcclusionCuller::rasterize(float3 const corners[8]) noexcept {
+    // we don't know the actual depth of the occluder inside its silhouette, so we
+    // conservatively use its farthest depth.
+    float depth = corners[0].z;
+    for (size_t i = 1; i < 8; i++) {
+        depth = std::max(depth, corners[i].z);
+    }
+
+    // The projection of a box is the convex hull of its projected corners, rasterizing the hull
+    // (rather than the faces) avoids holes along the edges shared by the faces.
+    float2 points[8];
+    for (size_t i = 0; i < 8; i++) {
+        points[i] = corners[i].xy;
+    }
+    std::sort(std::begin(points), std::end(points), [](float2 const& lhs, float2 const& rhs) {
+        return lhs.x < rhs.x || (lhs.x == rhs.x && lhs.y < rhs.y);
+    });
+
+    // Andrew's monotone chain, the hull is counter-clockwise
+    auto ccw = [](float2 const& o, float2 const& a, float2 const& b) {
+        return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+    };
+    float2 hull[16];
+    size_t k = 0;
+    for (size_t i = 0; i < 8; i++) {
+        while (k >= 2 && ccw(hull[k - 2], hull[k - 1], points[i]) <= 0) k--;
+        hull[k++] = points[i];
+    }
+    for (size_t i = 7, t = k + 1; i > 0; i--) {
+        while (k >= t && ccw(hull[k - 2], hull[k - 1], points[i - 1]) <= 0) k--;
+        hull[k++] = points[i - 1];
+    }
+    const size_t count = k - 1; // the last point is the first one
+    if (count < 3) {
+        return;
+    }
+
+    // A pixel is entirely covered if the edge functions at its center are larger than half
+    // the pixel's extent along each edge's normal.
+    float2 n[16];
+    float bias[16];
+    for (size_t i = 0; i < count; i++) {
+        const float2 d = hull[i + 1] - hull[i];
+        n[i] = { -d.y, d.x };
+        bias[i] = 0.5f * (std::abs(d.x) + std::abs(d.y));
+    }
+
+    const int32_t x0 = std::max(0,               int32_t(std::floor(points[0].x)));
+    const int32_t x1 = std::min(int32_t(WIDTH),  int32_t(std::ceil (points[7].x)));
+    float ymin = points[0].y;
+    float ymax = points[0].y;
+    for (size_t i = 1; i < 8; i++) {
+        ymin = std::min(ymin, points[i].y);
+        ymax = std::max(ymax, points[i].y);
+    }
+    const int32_t y0 = std::max(0,               int32_t(std::floor(ymin)));
+    const int32_t y1 = std::min(int32_t(HEIGHT), int32_t(std::ceil (ymax)));
+
+    float* const UTILS_RESTRICT buffer = level(0);
+    for (int32_t y = y0; y < y1; y++) {
+        for (int32_t x = x0; x < x1; x++) {
+            const float2 p = { float(x) + 0.5f, float(y) + 0.5f };
+            bool inside = true;
+            for (size_t i = 0; i < count && inside; i++) {
+                inside = dot(n[i], p - hull[i]) >= bias[i];
+            }
+            if (inside) {
+                float& d = buffer[y * WIDTH + x];
+                d = std::min(d, depth);
+                mHasOccluders = true;
+            }
+        }
+    }
+}
+
+void OcclusionCuller::buildHierarchy() noexcept {
+    SYSTRACE_CALL();
+
+    if (!mHasOccluders) {
+        return;
+    }
+
+    for (size_t i = 1; i < LEVEL_COUNT; i++) {
+        float const* const UTILS_RESTRICT src = level(i - 1);
+        float* const UTILS_RESTRICT dst = level(i);
+        const uint32_t sw = width(i - 1);
+        const uint32_t sh = height(i - 1);
+        const uint32_t w = width(i);
+        const uint32_t h = height(i);
+        for (uint32_t y = 0; y < h; y++) {
+            const uint32_t sy0 = 2 * y;
+            const uint32_t sy1 = std::min(2 * y + 1, sh - 1);
+            for (uint32_t x = 0; x < w; x++) {
+                const uint32_t sx0 = 2 * x;
+                const uint32_t sx1 = std::min(2 * x + 1, sw - 1);
+                dst[y * w + x] = std::max(
+                        std::max(src[sy0 * sw + sx0], src[sy0 * sw + sx1]),
+                        std::max(src[sy1 * sw + sx0], src[sy1 * sw + sx1]));
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::isOccluded(float3 const& center, float3 const& extent) const noexcept {
+    float3 corners[8];
+    if (!mHasOccluders || !project(center, extent, corners)) {
+        return false;
+    }
+
+    float3 lo = corners[0];
+    float3 hi = corners[0];
+    for (size_t i = 1; i < 8; i++) {
+        lo = min(lo, corners[i]);
+        hi = max(hi, corners[i]);
+    }
+
+    if (hi.x < 0 || hi.y < 0 || lo.x >= WIDTH || lo.y >= HEIGHT) {
+        // off-screen, this is handled by frustum culling
+        return false;
+    }
+
+    const uint32_t x0 = uint32_t(std::max(0.0f, lo.x));
+    const uint32_t y0 = uint32_t(std::max(0.0f, lo.y));
+    const uint32_t x1 = uint32_t(std::min(float(WIDTH  - 1), hi.x));
+    const uint32_t y1 = uint32_t(std::min(float(HEIGHT - 1), hi.y));
+
+    // pick the level where the footprint covers at most 2x2 texels (3x3 when not aligned)
+    size_t l = 0;
+    const uint32_t size = std::max(x1 - x0, y1 - y0);
+    while ((size >> l) > 1 && l < LEVEL_COUNT - 1) {
+        l++;
+    }
+
+    float const* const UTILS_RESTRICT buffer = level(l);
+    const uint32_t w = width(l);
+    for (uint32_t y = y0 >> l; y <= (y1 >> l); y++) {
+        for (uint32_t x = x0 >> l; x <= (x1 >> l); x++) {
+            if (buffer[y * w + x] >= lo.z) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void OcclusionCuller::cull(Culler::result_type* UTILS_RESTRICT results,
+        float3 const* UTILS_RESTRICT center, float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) const noexcept {
+    const Culler::result_type mask = Culler::result_type(1u << bit);
+    for (size_t i = 0; i < count; i++) {
+        if ((results[i] & mask) && isOccluded(center[i], extent[i])) {
+            results[i] &= ~mask;
+        }
+    }
+}
+
+} // namespace details
+} // namespace filament
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_PERRENDERABLEUIB_H
+#define TNT_FILAMENT_PERRENDERABLEUIB_H
+
+#include <filament/EngineEnums.h>
+#include <filament/UniformInterfaceBlock.h>
+
+#include <math/mat4.h>
+#include <math/vec4.h>
+
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * The per-renderable uniforms, see UibGenerator::getPerRenderableUib(). FRenderableManager
+ * stores these directly in its components, so this lives outside of FEngine (which is where
+ * the other uniform blocks are described).
+ */
+struct PerRenderableUib {
+    static UniformInterfaceBlock getUib() noexcept;
+    // IMPORTANT NOTE: Respect std140 layout, don't update without updating getUib()
+    math::mat4f worldFromModelMatrix;
+    math::float4 worldFromModelNormalMatrix[3]; // actually a mat3 (std140 requires float4 alignment)
+    uint32_t skinningDualQuaternion;
+    uint32_t morphTargetCount;
+    uint32_t reflectionProbe;   // 1 + index of the reflection probe, 0 for the IBL
+    uint32_t padding0;          // std140 requires float4 alignment
+    math::float4 morphWeights[CONFIG_MAX_MORPH_TARGET_COUNT / 4]; // 4 weights per float4
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_PERRENDERABLEUIB_H
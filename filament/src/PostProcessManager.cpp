@@ -18,6 +18,7 @@
 #include "RenderTargetPool.h"
 
 #include "details/Engine.h"
+#include "details/Texture.h"
 
 #include <utils/Log.h>
 
@@ -48,7 +49,8 @@ void PostProcessManager::terminate(driver::DriverApi& driver) noexcept {
 }
 
 void PostProcessManager::setSource(uint32_t viewportWidth, uint32_t viewportHeight,
-        const RenderTargetPool::Target* pos) const noexcept {
+        const RenderTargetPool::Target* pos, const RenderTargetPool::Target* history,
+        math::float2 historyScale, math::float2 jitter) const noexcept {
     FEngine& engine = *mEngine;
     DriverApi& driver = engine.getDriverApi();
 
@@ -59,6 +61,9 @@ void PostProcessManager::setSource(uint32_t viewportWidth, uint32_t viewportHeig
     params.filterMin = SamplerMinFilter::LINEAR;
     SamplerBuffer sb(engine.getPostProcessSib());
     sb.setSampler(FEngine::PostProcessSib::COLOR_BUFFER, pos->texture, params);
+    if (history) {
+        sb.setSampler(FEngine::PostProcessSib::HISTORY, history->texture, params);
+    }
 
     auto duration = engine.getTime();
     float fraction = (duration.count() % 1000000000) / 1000000000.0f;
@@ -73,8 +78,14 @@ void PostProcessManager::setSource(uint32_t viewportWidth, uint32_t viewportHeig
     const float yOffset = pos->h - viewportHeight;
     ub.setUniform(offsetof(FEngine::PostProcessingUib, yOffset), yOffset);
 
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, jitter), jitter);
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, historyScale), historyScale);
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, historyWeight),
+            history ? TEMPORAL_HISTORY_WEIGHT : 0.0f);
+
     driver.updateSamplerBuffer(mPostProcessSbh, std::move(sb));
-    driver.updateUniformBuffer(mPostProcessUbh, UniformBuffer(ub));
+    driver.updateUniformBuffer(mPostProcessUbh, ub.copyDirtyRange());
+    ub.clean();
 }
 
 void PostProcessManager::blit(driver::TextureFormat format) noexcept {
@@ -85,96 +96,309 @@ void PostProcessManager::pass(driver::TextureFormat format, Handle<HwProgram> pr
     mCommands.push_back({program, format});
 }
 
-void PostProcessManager::finish(driver::TargetBufferFlags discarded,
-        Handle<HwRenderTarget> viewRenderTarget,
-        Viewport const& vp,
+void PostProcessManager::inPlace(Handle<HwProgram> program) noexcept {
+    assert(program);
+    Command command{ program };
+    command.inPlace = true;
+    mCommands.push_back(command);
+}
+
+void PostProcessManager::temporal(Handle<HwProgram> program,
+        RenderTargetPool::Target const* history,
         RenderTargetPool::Target const* previous,
+        math::float2 jitter) noexcept {
+    assert(history);
+    mCommands.push_back({program, history->format, history, previous, jitter});
+}
+
+void PostProcessManager::finish(FrameGraph& fg,
+        FrameGraphResource input,
+        FrameGraphResource output,
+        Viewport const& vp,
         Viewport const& svp) {
 
-    assert(viewRenderTarget);
-    assert(previous);
+    assert(input.isValid());
+    assert(output.isValid());
 
-    FEngine& engine = *mEngine;
-    DriverApi& driver = engine.getDriverApi();
-    RenderTargetPool& rtp = engine.getRenderTargetPool();
-    Handle<HwRenderPrimitive> const& fullScreenRenderPrimitive = engine.getFullScreenRenderPrimitive();
     std::vector<Command>& commands = mCommands;
-
     if (UTILS_UNLIKELY(commands.empty())) {
-        rtp.put(previous);
         return;
     }
 
+    struct PostProcessPassData {
+        FrameGraphResource input;
+        FrameGraphResource output;
+    };
+
+    FrameGraphResource previous = input;
+    Viewport srcViewport{ 0, 0, svp.width, svp.height };
+    for (size_t i = 0, c = commands.size(); i < c; i++) {
+        const Command command = commands[i];
+
+        // The last command is special, it always draw to the viewRenderTarget and uses
+        // the non scaled viewport. The temporal upscaling pass renders at the size of the
+        // non scaled viewport too.
+        const bool last = i == c - 1;
+        assert(!last || !command.history);
+        assert(!last || !command.inPlace);
+        const Viewport dstViewport =
+                last ? vp :
+                command.history ? Viewport{ 0, 0, vp.width, vp.height } :
+                command.inPlace ? srcViewport :
+                Viewport{ 0, 0, srcViewport.width, srcViewport.height };
+
+        // the history must outlive the graph, so it's imported
+        FrameGraphResource history;
+        if (command.history) {
+            history = fg.import("Temporal History",
+                    { TargetBufferFlags::COLOR, vp.width, vp.height, 1, command.format },
+                    command.history->target, TargetBufferFlags::ALL);
+        }
+
+        auto const& data = fg.addPass<PostProcessPassData>(
+                command.inPlace ? "Post Process In Place" :
+                command.program ? "Post Process Pass" : "Post Process Blit",
+                [&](FrameGraph::Builder& builder, PostProcessPassData& data) {
+                    // the source of this pass needs a texture only if it's sampled by a program
+                    data.input = builder.read(previous,
+                            bool(command.program) && !command.inPlace);
+                    if (command.inPlace) {
+                        data.output = builder.write(previous);
+                    } else if (last) {
+                        data.output = builder.write(output);
+                    } else if (history.isValid()) {
+                        data.output = builder.write(history);
+                    } else {
+                        data.output = builder.create("Post Process Target",
+                                { TargetBufferFlags::COLOR,
+                                  dstViewport.width, dstViewport.height, 1, command.format });
+                        data.output = builder.write(data.output);
+                    }
+                },
+                [this, command, dstViewport, srcViewport](FrameGraph::Resources const& resources,
+                        PostProcessPassData const& data, DriverApi& driver) {
+                    RenderTargetPool::Target const& src = resources.getTarget(data.input);
+                    RenderTargetPool::Target const& dst = resources.getTarget(data.output);
+                    driver.pushGroupMarker("Post Processing");
+                    if (command.program) {
+                        RenderPassParams params = resources.getRenderPassParams(data.output);
+                        params.left = dstViewport.left;
+                        params.bottom = dstViewport.bottom;
+                        params.width = dstViewport.width;
+                        params.height = dstViewport.height;
+                        params.dependencies = RenderPassParams::DEPENDENCY_BY_REGION;
+
+                        // set the source for this pass (i.e. previous target)
+                        RenderTargetPool::Target const* previousHistory = command.previousHistory;
+                        math::float2 historyScale = {};
+                        if (previousHistory) {
+                            historyScale = math::float2{ dstViewport.width, dstViewport.height } /
+                                    math::float2{ previousHistory->w, previousHistory->h };
+                        }
+                        setSource(srcViewport.width, srcViewport.height, &src,
+                                previousHistory, historyScale, command.jitter);
+
+                        // draw a full screen triangle
+                        Driver::RasterState rs;
+                        rs.culling = Driver::RasterState::CullingMode::NONE;
+                        rs.colorWrite = true;
+                        rs.depthFunc = Driver::RasterState::DepthFunc::A;
+                        driver.beginRenderPass(dst.target, params);
+                        driver.draw(command.program, rs, mEngine->getFullScreenRenderPrimitive());
+                        driver.endRenderPass();
+                    } else {
+                        driver.blit(TargetBufferFlags::COLOR,
+                                dst.target, dstViewport.left, dstViewport.bottom,
+                                dstViewport.width, dstViewport.height,
+                                src.target, 0, 0, srcViewport.width, srcViewport.height);
+                    }
+                    driver.popGroupMarker();
+                });
+        previous = data.output;
+        srcViewport = Viewport{ 0, 0, dstViewport.width, dstViewport.height };
+    }
+
+    // clear our command buffer
+    commands.clear();
+}
+
+void PostProcessManager::resolveAccumulation(Handle<HwRenderTarget> target,
+        RenderPassParams const& params,
+        Handle<HwTexture> color, Handle<HwTexture> weights) noexcept {
+    FEngine& engine = *mEngine;
+    DriverApi& driver = engine.getDriverApi();
+    Handle<HwProgram> program =
+            engine.getPostProcessProgram(PostProcessStage::ACCUMULATED_TRANSPARENCY);
+
+    // the texels are fetched, the filtering doesn't matter
+    driver::SamplerParams sp;
+    SamplerBuffer sb(engine.getPostProcessSib());
+    sb.setSampler(FEngine::PostProcessSib::COLOR_BUFFER, color, sp);
+    sb.setSampler(FEngine::PostProcessSib::HISTORY, weights, sp);
+    driver.updateSamplerBuffer(mPostProcessSbh, std::move(sb));
+
+    // the program outputs the premultiplied average color of the accumulated surfaces
     Driver::RasterState rs;
     rs.culling = Driver::RasterState::CullingMode::NONE;
     rs.colorWrite = true;
     rs.depthFunc = Driver::RasterState::DepthFunc::A;
+    rs.blendFunctionSrcRGB = rs.blendFunctionSrcAlpha = Driver::RasterState::BlendFunction::ONE;
+    rs.blendFunctionDstRGB = rs.blendFunctionDstAlpha =
+            Driver::RasterState::BlendFunction::ONE_MINUS_SRC_ALPHA;
+    driver.pushGroupMarker("Accumulated Transparency");
+    driver.beginRenderPass(target, params);
+    driver.draw(program, rs, engine.getFullScreenRenderPrimitive());
+    driver.endRenderPass();
+    driver.popGroupMarker();
+}
+
+void PostProcessManager::setIblSource(FTexture const* environment) const noexcept {
+    FEngine& engine = *mEngine;
+    DriverApi& driver = engine.getDriverApi();
 
+    // filtered importance sampling relies on the mip levels of the environment
+    driver::SamplerParams params;
+    params.filterMag = SamplerMagFilter::LINEAR;
+    params.filterMin = SamplerMinFilter::LINEAR_MIPMAP_LINEAR;
+    SamplerBuffer sb(engine.getPostProcessSib());
+    sb.setSampler(FEngine::PostProcessSib::ENVIRONMENT, environment->getHwHandle(), params);
+    driver.updateSamplerBuffer(mPostProcessSbh, std::move(sb));
+
+    UniformBuffer& ub = mPostProcessUb;
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, iblSourceSize),
+            float(environment->getWidth()));
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, iblSourceMaxLevel),
+            float(environment->getLevels() - 1));
+}
+
+void PostProcessManager::iblPass(Handle<HwProgram> program, Handle<HwRenderTarget> target,
+        uint32_t width, uint32_t height) noexcept {
     RenderPassParams params = {};
+    params.width = width;
+    params.height = height;
     params.discardStart = TargetBufferFlags::ALL;
     params.discardEnd = TargetBufferFlags::DEPTH_AND_STENCIL;
-    params.left = 0;
-    params.bottom = 0;
-    params.width = svp.width;
-    params.height = svp.height;
-    params.dependencies = RenderPassParams::DEPENDENCY_BY_REGION;
-
-    for (size_t i = 0, c = commands.size() - 1; i < c; i++) {
-        // if the next command is a blit, it we don't need a texture
-        uint8_t flags = !commands[i + 1].program ? RenderTargetPool::Target::NO_TEXTURE : uint8_t();
-
-        // create a render target for this pass
-        RenderTargetPool::Target const* target = rtp.get(
-                TargetBufferFlags::COLOR, svp.width, svp.height, 1, commands[i].format, flags);
-
-        assert(target);
-
-        if (commands[i].program) {
-            // set the source for this pass (i.e. previous target)
-            setSource(params.width, params.height, previous);
-
-            // draw a full screen triangle
-            driver.beginRenderPass(target->target, params);
-            driver.draw(commands[i].program, rs, fullScreenRenderPrimitive);
-            driver.endRenderPass();
-        } else {
-            driver.blit(TargetBufferFlags::COLOR,
-                    target->target, 0, 0, svp.width, svp.height,
-                    previous->target, 0, 0, svp.width, svp.height);
+    iblPass(program, target, params);
+}
+
+void PostProcessManager::iblPass(Handle<HwProgram> program, Handle<HwRenderTarget> target,
+        RenderPassParams const& params) noexcept {
+    FEngine& engine = *mEngine;
+    DriverApi& driver = engine.getDriverApi();
+
+    UniformBuffer& ub = mPostProcessUb;
+    driver.updateUniformBuffer(mPostProcessUbh, ub.copyDirtyRange());
+    ub.clean();
+
+    // draw a full screen triangle, over the viewport
+    Driver::RasterState rs;
+    rs.culling = Driver::RasterState::CullingMode::NONE;
+    rs.colorWrite = true;
+    rs.depthFunc = Driver::RasterState::DepthFunc::A;
+    driver.beginRenderPass(target, params);
+    driver.draw(program, rs, engine.getFullScreenRenderPrimitive());
+    driver.endRenderPass();
+}
+
+void PostProcessManager::prefilterReflections(FTexture const* environment,
+        FTexture const* reflections, uint32_t sampleCount) noexcept {
+    FEngine& engine = *mEngine;
+    DriverApi& driver = engine.getDriverApi();
+    Handle<HwProgram> program =
+            engine.getPostProcessProgram(PostProcessStage::IBL_ROUGHNESS_PREFILTER);
+
+    driver.pushGroupMarker("IBL Prefilter");
+    setIblSource(environment);
+
+    // same roughness and sample count progression as cmgen
+    UniformBuffer& ub = mPostProcessUb;
+    const size_t levels = reflections->getLevels();
+    for (size_t level = 0; level < levels; level++) {
+        if (level >= 2) {
+            // wider filters need more samples, but there are 4x less texels per level
+            sampleCount *= 2;
+        }
+        const float roughness = levels > 1 ? float(level) / (levels - 1) : 0.0f;
+        const uint32_t dim = uint32_t(reflections->getWidth(level));
+        ub.setUniform(offsetof(FEngine::PostProcessingUib, iblRoughness), roughness * roughness);
+        ub.setUniform(offsetof(FEngine::PostProcessingUib, iblSampleCount), float(sampleCount));
+        for (size_t face = 0; face < 6; face++) {
+            ub.setUniform(offsetof(FEngine::PostProcessingUib, iblFace), float(face));
+            Handle<HwRenderTarget> target = driver.createRenderTarget(TargetBufferFlags::COLOR,
+                    dim, dim, 1, reflections->getFormat(),
+                    { reflections->getHwHandle(), uint8_t(level), TextureCubemapFace(face) },
+                    {}, {});
+            iblPass(program, target, dim, dim);
+            driver.destroyRenderTarget(target);
         }
-        // return the previous target to the pool
-        rtp.put(previous);
-        previous = target;
     }
+    driver.popGroupMarker();
+}
 
-    assert(!commands.empty());
-    assert(previous);
-
-    // The last command is special, it always draw to the viewRenderTarget and uses
-    // the non scaled viewport.
-    if (commands.back().program) {
-        params.discardStart = discarded;
-        params.discardEnd = TargetBufferFlags::DEPTH_AND_STENCIL;
-        params.left = vp.left;
-        params.bottom = vp.bottom;
-        params.width = vp.width;
-        params.height = vp.height;
-
-        setSource(params.width, params.height, previous);
-        driver.beginRenderPass(viewRenderTarget, params);
-        driver.draw(commands.back().program, rs, fullScreenRenderPrimitive);
-        driver.endRenderPass();
-
-    } else {
-        driver.blit(TargetBufferFlags::COLOR,
-                viewRenderTarget, vp.left, vp.bottom, vp.width, vp.height,
-                previous->target, 0, 0, svp.width, svp.height);
-    }
+void PostProcessManager::prefilterReflectionProbe(FTexture const* environment,
+        Handle<HwRenderTarget> target, Viewport const& viewport,
+        float roughness, uint32_t sampleCount) noexcept {
+    FEngine& engine = *mEngine;
+    DriverApi& driver = engine.getDriverApi();
+    Handle<HwProgram> program =
+            engine.getPostProcessProgram(PostProcessStage::IBL_PROBE_PREFILTER);
 
-    rtp.put(previous);
+    driver.pushGroupMarker("Reflection Probe Prefilter");
+    setIblSource(environment);
 
-    // clear our command buffer
-    commands.clear();
+    UniformBuffer& ub = mPostProcessUb;
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, iblRoughness), roughness);
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, iblSampleCount), float(sampleCount));
+
+    // the other tiles of the level are kept
+    RenderPassParams params = {};
+    params.left = viewport.left;
+    params.bottom = viewport.bottom;
+    params.width = viewport.width;
+    params.height = viewport.height;
+    params.discardEnd = TargetBufferFlags::DEPTH_AND_STENCIL;
+    iblPass(program, target, params);
+    driver.popGroupMarker();
+}
+
+void PostProcessManager::computeIrradianceSH(FTexture const* environment,
+        PixelBufferDescriptor&& sh) noexcept {
+    FEngine& engine = *mEngine;
+    DriverApi& driver = engine.getDriverApi();
+    Handle<HwProgram> program = engine.getPostProcessProgram(PostProcessStage::IBL_IRRADIANCE_SH);
+
+    driver.pushGroupMarker("IBL Irradiance SH");
+    setIblSource(environment);
+
+    // one texel per coefficient
+    constexpr uint32_t count = 9;
+    Handle<HwTexture> texture = driver.createTexture(SamplerType::SAMPLER_2D, 1,
+            TextureFormat::RGBA16F, 1, count, 1, 1, TextureUsage::COLOR_ATTACHMENT);
+    Handle<HwRenderTarget> target = driver.createRenderTarget(TargetBufferFlags::COLOR,
+            count, 1, 1, TextureFormat::RGBA16F, { texture }, {}, {});
+    iblPass(program, target, count, 1);
+    driver.readPixels(target, 0, 0, count, 1, std::move(sh));
+    driver.destroyRenderTarget(target);
+    driver.destroyTexture(texture);
+    driver.popGroupMarker();
+}
+
+void PostProcessManager::generateDFG(FTexture const* dfg, uint32_t sampleCount) noexcept {
+    FEngine& engine = *mEngine;
+    DriverApi& driver = engine.getDriverApi();
+    Handle<HwProgram> program = engine.getPostProcessProgram(PostProcessStage::IBL_DFG);
+
+    driver.pushGroupMarker("IBL DFG");
+    UniformBuffer& ub = mPostProcessUb;
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, iblSampleCount), float(sampleCount));
+
+    const uint32_t width = uint32_t(dfg->getWidth());
+    const uint32_t height = uint32_t(dfg->getHeight());
+    Handle<HwRenderTarget> target = driver.createRenderTarget(TargetBufferFlags::COLOR,
+            width, height, 1, dfg->getFormat(), { dfg->getHwHandle() }, {}, {});
+    iblPass(program, target, width, height);
+    driver.destroyRenderTarget(target);
+    driver.popGroupMarker();
 }
 
 } // namespace filament
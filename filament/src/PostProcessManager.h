@@ -17,6 +17,7 @@
 #ifndef TNT_FILAMENT_POSTPROCESS_MANAGER_H
 #define TNT_FILAMENT_POSTPROCESS_MANAGER_H
 
+#include "FrameGraph.h"
 #include "RenderTargetPool.h"
 
 #include "driver/DriverApiForward.h"
@@ -26,6 +27,9 @@
 #include <filament/Viewport.h>
 
 #include <filament/driver/DriverEnums.h>
+#include <filament/driver/PixelBufferDescriptor.h>
+
+#include <math/vec2.h>
 
 #include <vector>
 
@@ -33,6 +37,7 @@ namespace filament {
 
 namespace details {
 class FEngine;
+class FTexture;
 class FView;
 } // namespace details
 
@@ -40,8 +45,11 @@ class PostProcessManager {
 public:
     void init(details::FEngine& engine) noexcept;
     void terminate(driver::DriverApi& driver) noexcept;
+    // 'history', 'historyScale' and 'jitter' are only used by the temporal upscaling pass
     void setSource(uint32_t viewportWidth, uint32_t viewportHeight,
-            const RenderTargetPool::Target* pos) const noexcept;
+            const RenderTargetPool::Target* pos,
+            const RenderTargetPool::Target* history = nullptr,
+            math::float2 historyScale = {}, math::float2 jitter = {}) const noexcept;
 
     // start() is a scam, it does nothing
     void start() noexcept { }
@@ -52,19 +60,73 @@ public:
     // a blit pass, using the given format as target
     void blit(driver::TextureFormat format = driver::TextureFormat::RGBA8) noexcept;
 
-    void finish(driver::TargetBufferFlags discarded,
-            Handle<HwRenderTarget> viewRenderTarget,
+    // A fullscreen pass rendering into the target of the previous pass, 'program' reads the pixel
+    // it replaces with framebuffer fetch (see DriverApi::isFramebufferFetchSupported()), so the
+    // target stays in the tile memory from one pass to the next. This can't be the last pass.
+    void inPlace(Handle<HwProgram> program) noexcept;
+
+    // A temporal upscaling pass into 'history', which has the size of the non scaled viewport
+    // and must be kept until the next frame. 'previous' is the history of the previous frame,
+    // or null. 'jitter' is the sub-pixel jitter of the current frame. This can't be the last
+    // pass.
+    void temporal(Handle<HwProgram> program,
+            RenderTargetPool::Target const* history,
+            RenderTargetPool::Target const* previous,
+            math::float2 jitter) noexcept;
+
+    // Composites the transparent surfaces accumulated by the color pass over 'target', in a
+    // render pass with the given parameters. 'color' and 'weights' are the accumulation
+    // target's textures, see RenderPass::ACCUMULATED_TRANSPARENCY. This happens right away.
+    void resolveAccumulation(Handle<HwRenderTarget> target,
+            driver::RenderPassParams const& params,
+            Handle<HwTexture> color, Handle<HwTexture> weights) noexcept;
+
+    // adds the passes recorded since start() to the FrameGraph, the first one reads 'input'
+    // and the last one writes into 'output' using the non scaled viewport
+    void finish(FrameGraph& fg,
+            FrameGraphResource input,
+            FrameGraphResource output,
             Viewport const& vp,
-            RenderTargetPool::Target const* linearTarget,
             Viewport const& svp);
 
+    // The IBL prefiltering passes (see IndirectLight) render right away into their destination,
+    // outside of the FrameGraph. 'environment' is a cubemap with a full mip chain.
+    void prefilterReflections(details::FTexture const* environment,
+            details::FTexture const* reflections, uint32_t sampleCount) noexcept;
+
+    // 'sh' receives the 9 coefficients as RGBA texels
+    void computeIrradianceSH(details::FTexture const* environment,
+            driver::PixelBufferDescriptor&& sh) noexcept;
+
+    void generateDFG(details::FTexture const* dfg, uint32_t sampleCount) noexcept;
+
+    // Prefilters a level of a reflection probe (see ReflectionProbes) into the octahedral tile
+    // at 'viewport' of 'target', which renders into that level of the atlas. The other tiles are
+    // kept. 'roughness' is the linear roughness of the level.
+    void prefilterReflectionProbe(details::FTexture const* environment,
+            Handle<HwRenderTarget> target, Viewport const& viewport,
+            float roughness, uint32_t sampleCount) noexcept;
 
 private:
+    void setIblSource(details::FTexture const* environment) const noexcept;
+    void iblPass(Handle<HwProgram> program, Handle<HwRenderTarget> target,
+            uint32_t width, uint32_t height) noexcept;
+    void iblPass(Handle<HwProgram> program, Handle<HwRenderTarget> target,
+            driver::RenderPassParams const& params) noexcept;
+
     details::FEngine* mEngine = nullptr;
 
+    // how much of the history is kept each frame by the temporal upscaler
+    static constexpr float TEMPORAL_HISTORY_WEIGHT = 0.9f;
+
     struct Command {
         Handle<HwProgram> program = {};
         driver::TextureFormat format;
+        // the following are only set for the temporal upscaling pass
+        RenderTargetPool::Target const* history = nullptr;
+        RenderTargetPool::Target const* previousHistory = nullptr;
+        math::float2 jitter = {};
+        bool inPlace = false;       // see inPlace()
     };
 
     std::vector<Command> mCommands;
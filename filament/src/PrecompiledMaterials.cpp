@@ -33,5 +33,23 @@ const uint8_t DEFAULT_MATERIAL_PACKAGE[] = {
 };
 const size_t DEFAULT_MATERIAL_PACKAGE_SIZE = sizeof(DEFAULT_MATERIAL_PACKAGE);
 
+// This package is generated with matc and contains the debug views shader code.
+const uint8_t DEBUG_VIEW_MATERIAL_PACKAGE[] = {
+#include "generated/material/debugView.inc"
+};
+const size_t DEBUG_VIEW_MATERIAL_PACKAGE_SIZE = sizeof(DEBUG_VIEW_MATERIAL_PACKAGE);
+
+// This package is generated with matc and contains the GPU culling compute shader code.
+const uint8_t GPU_CULLING_MATERIAL_PACKAGE[] = {
+#include "generated/material/gpuCulling.inc"
+};
+const size_t GPU_CULLING_MATERIAL_PACKAGE_SIZE = sizeof(GPU_CULLING_MATERIAL_PACKAGE);
+
+// This package is generated with matc and contains the particles compute shader code.
+const uint8_t PARTICLES_MATERIAL_PACKAGE[] = {
+#include "generated/material/particles.inc"
+};
+const size_t PARTICLES_MATERIAL_PACKAGE_SIZE = sizeof(PARTICLES_MATERIAL_PACKAGE);
+
 } // namespace details
 } //namespace filament
@@ -29,6 +29,15 @@ extern const size_t POST_PROCESS_PACKAGE_SIZE;
 extern const uint8_t DEFAULT_MATERIAL_PACKAGE[];
 extern const size_t DEFAULT_MATERIAL_PACKAGE_SIZE;
 
+extern const uint8_t DEBUG_VIEW_MATERIAL_PACKAGE[];
+extern const size_t DEBUG_VIEW_MATERIAL_PACKAGE_SIZE;
+
+extern const uint8_t GPU_CULLING_MATERIAL_PACKAGE[];
+extern const size_t GPU_CULLING_MATERIAL_PACKAGE_SIZE;
+
+extern const uint8_t PARTICLES_MATERIAL_PACKAGE[];
+extern const size_t PARTICLES_MATERIAL_PACKAGE_SIZE;
+
 } // namespace details
 } //namespace filament
 
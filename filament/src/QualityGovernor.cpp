@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filament/QualityGovernor.h>
+
+#include <filament/View.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#if defined(__ANDROID__)
+#include <dlfcn.h>
+#endif
+
+using namespace math;
+
+namespace filament {
+
+constexpr size_t QualityGovernor::MAX_LEVEL_COUNT;
+
+// Android rate-limits the thermal headroom queries, they return NaN when polled more often
+static constexpr int64_t THERMAL_POLL_INTERVAL_NS = 1000000000;
+
+// the headroom is forecast this far ahead, so that the quality steps down before throttling
+static constexpr int THERMAL_FORECAST_SECONDS = 10;
+
+// longest delay before stepping up, in multiples of Config::stepUpFrames
+static constexpr uint32_t MAX_STEP_UP_DELAY = 8;
+
+#if defined(__ANDROID__)
+
+// AThermal is only available from API 30 (and its headroom from API 31), so it's looked up at
+// runtime rather than linked.
+struct QualityGovernor::Thermal {
+    struct AThermalManager;
+    using AcquireManager = AThermalManager* (*)();
+    using ReleaseManager = void (*)(AThermalManager*);
+    using GetCurrentThermalStatus = int (*)(AThermalManager*);
+    using GetThermalHeadroom = float (*)(AThermalManager*, int);
+
+    Thermal() noexcept {
+        mLibrary = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+        if (!mLibrary) {
+            return;
+        }
+        auto acquire = (AcquireManager)dlsym(mLibrary, "AThermal_acquireManager");
+        mRelease = (ReleaseManager)dlsym(mLibrary, "AThermal_releaseManager");
+        mGetStatus = (GetCurrentThermalStatus)dlsym(mLibrary, "AThermal_getCurrentThermalStatus");
+        mGetHeadroom = (GetThermalHeadroom)dlsym(mLibrary, "AThermal_getThermalHeadroom");
+        if (acquire && mRelease && mGetStatus) {
+            mManager = acquire();
+        }
+    }
+
+    ~Thermal() noexcept {
+        if (mManager) {
+            mRelease(mManager);
+        }
+        if (mLibrary) {
+            dlclose(mLibrary);
+        }
+    }
+
+    ThermalStatus getStatus() const noexcept {
+        // ATHERMAL_STATUS_ERROR is -1, the other statuses follow ThermalStatus
+        const int status = mManager ? mGetStatus(mManager) : -1;
+        return ThermalStatus(std::min(std::max(status + 1, 0), int(ThermalStatus::SHUTDOWN)));
+    }
+
+    float getHeadroom() const noexcept {
+        return (mManager && mGetHeadroom) ? mGetHeadroom(mManager, THERMAL_FORECAST_SECONDS) :
+                std::numeric_limits<float>::quiet_NaN();
+    }
+
+private:
+    void* mLibrary = nullptr;
+    AThermalManager* mManager = nullptr;
+    ReleaseManager mRelease = nullptr;
+    GetCurrentThermalStatus mGetStatus = nullptr;
+    GetThermalHeadroom mGetHeadroom = nullptr;
+};
+
+#else
+
+// the other platforms don't report their thermal status
+struct QualityGovernor::Thermal {
+    ThermalStatus getStatus() const noexcept {
+        return ThermalStatus::UNKNOWN;
+    }
+
+    float getHeadroom() const noexcept {
+        return std::numeric_limits<float>::quiet_NaN();
+    }
+};
+
+#endif
+
+QualityGovernor::QualityGovernor(View* view, Config const& config) noexcept
+        : mView(view), mConfig(config), mThermal(new Thermal()),
+          mStepUpFrames(config.stepUpFrames),
+          mThermalHeadroom(std::numeric_limits<float>::quiet_NaN()) {
+    // the ladder starts at the View's settings, and lowers them at each level
+    View::DynamicResolutionOptions const options = view->getDynamicResolutionOptions();
+    const uint32_t maxShadowMapSize = view->getMaxShadowMapSize();
+    QualityLevel levels[4];
+    for (size_t i = 0; i < 4; i++) {
+        levels[i].minScale = std::min(options.minScale.x, options.minScale.y) *
+                std::pow(0.8f, float(i));
+        levels[i].sampleCount = uint8_t(std::max(1u, uint32_t(view->getSampleCount()) >> i));
+        levels[i].maxShadowMapSize = i == 0 ? maxShadowMapSize :
+                std::max(256u, std::min(maxShadowMapSize, 2048u) >> i);
+        levels[i].maxLightCount = std::max(32u, 256u >> i);
+    }
+    setLevels(levels, 4);
+}
+
+QualityGovernor::QualityGovernor(View* view) noexcept
+        : QualityGovernor(view, Config()) {
+}
+
+QualityGovernor::~QualityGovernor() noexcept {
+    delete mThermal;
+}
+
+void QualityGovernor::setLevels(QualityLevel const* levels, size_t count) noexcept {
+    mLevelCount = std::min(count, MAX_LEVEL_COUNT);
+    std::copy_n(levels, mLevelCount, mLevels);
+    mStepUpFrames = mConfig.stepUpFrames;
+    mLastChangeWasUp = false;
+    if (mLevelCount) {
+        setLevel(0);
+    }
+}
+
+void QualityGovernor::setThermalHeadroom(float headroom) noexcept {
+    mThermalHeadroomSet = !std::isnan(headroom);
+    mThermalHeadroom = headroom;
+}
+
+void QualityGovernor::pollThermal() noexcept {
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (now - mLastThermalPoll < THERMAL_POLL_INTERVAL_NS) {
+        return;
+    }
+    mLastThermalPoll = now;
+    mThermalStatus = mThermal->getStatus();
+    if (!mThermalHeadroomSet) {
+        mThermalHeadroom = mThermal->getHeadroom();
+    }
+}
+
+void QualityGovernor::update(Renderer::FrameStats const& stats) noexcept {
+    if (mLevelCount == 0) {
+        return;
+    }
+    pollThermal();
+
+    // the percentiles only reflect the current level once the window is past the last change
+    mFramesSinceChange++;
+    if (mFramesSinceChange < mConfig.settleFrames) {
+        return;
+    }
+
+    // the slowest of the main thread, the render thread and the GPU sets the frame rate
+    const float load = std::max({ stats.mainThreadPercentiles[1],
+            stats.driverThreadPercentiles[1], stats.gpuPercentiles[1] }) /
+                    mConfig.targetFrameTimeMilli;
+    const bool hot = mThermalStatus >= ThermalStatus::MODERATE ||
+            mThermalHeadroom > mConfig.stepDownHeadroom;
+    const bool cool = mThermalStatus <= ThermalStatus::LIGHT &&
+            !(mThermalHeadroom >= mConfig.stepUpHeadroom);   // NaN is cool
+
+    if ((load > mConfig.stepDownLoad || hot) && mLevel + 1 < mLevelCount) {
+        // the level that was just stepped up to doesn't hold, it'll be tried later
+        if (mLastChangeWasUp) {
+            mStepUpFrames = std::min(mStepUpFrames * 2, mConfig.stepUpFrames * MAX_STEP_UP_DELAY);
+        }
+        mLastChangeWasUp = false;
+        setLevel(mLevel + 1);
+        return;
+    }
+
+    mFramesWithHeadroom = (load < mConfig.stepUpLoad && cool) ? mFramesWithHeadroom + 1 : 0;
+    if (mFramesWithHeadroom >= mStepUpFrames && mLevel > 0) {
+        mLastChangeWasUp = true;
+        setLevel(mLevel - 1);
+    }
+}
+
+void QualityGovernor::setLevel(size_t level) noexcept {
+    mLevel = level;
+    mFramesSinceChange = 0;
+    mFramesWithHeadroom = 0;
+
+    QualityLevel const& settings = mLevels[level];
+    View* const view = mView;
+    View::DynamicResolutionOptions options = view->getDynamicResolutionOptions();
+    options.minScale = float2(settings.minScale);
+    view->setDynamicResolutionOptions(options);
+    view->setSampleCount(settings.sampleCount);
+    view->setPostProcessingEnabled(settings.postProcessing);
+    view->setMaxShadowMapSize(settings.maxShadowMapSize);
+    view->setDynamicLightingMaxLightCount(settings.maxLightCount);
+}
+
+} // namespace filament
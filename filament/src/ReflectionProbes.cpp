@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/ReflectionProbes.h"
+
+#include "PostProcessManager.h"
+
+#include "details/Engine.h"
+#include "details/Texture.h"
+
+#include <filament/Viewport.h>
+#include <filament/driver/DriverEnums.h>
+
+#include <utils/algorithm.h>
+
+#include <limits>
+
+using namespace math;
+using namespace utils;
+
+namespace filament {
+using namespace driver;
+
+namespace details {
+
+static constexpr uint32_t ALL_LEVELS = (1u << CONFIG_REFLECTION_PROBE_LEVELS) - 1u;
+
+static_assert(CONFIG_MAX_REFLECTION_PROBES % CONFIG_REFLECTION_PROBE_ATLAS_COLUMNS == 0,
+        "the reflection probes must fill the rows of the atlas");
+static_assert((CONFIG_REFLECTION_PROBE_SIZE >> (CONFIG_REFLECTION_PROBE_LEVELS - 1)) >= 2,
+        "the tiles of the last level of the atlas are too small to be filtered");
+
+static inline bool intersects(Aabb const& a, Aabb const& b) noexcept {
+    return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+           a.min.y <= b.max.y && a.max.y >= b.min.y &&
+           a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+static inline bool contains(Aabb const& box, float3 const& p) noexcept {
+    return p.x >= box.min.x && p.x <= box.max.x &&
+           p.y >= box.min.y && p.y <= box.max.y &&
+           p.z >= box.min.z && p.z <= box.max.z;
+}
+
+ReflectionProbes::ReflectionProbes() noexcept = default;
+
+void ReflectionProbes::terminate(DriverApi& driver) noexcept {
+    for (Handle<HwRenderTarget> target : mAtlasRenderTargets) {
+        if (target) {
+            driver.destroyRenderTarget(target);
+        }
+    }
+    if (mAtlasHandle) {
+        driver.destroyTexture(mAtlasHandle);
+    }
+}
+
+void ReflectionProbes::set(size_t index, FTexture const* environment,
+        float3 const& position, Box const& box) noexcept {
+    Probe& probe = mProbes[index];
+    probe.environment = environment;
+    probe.position = position;
+    probe.box = { box.getMin(), box.getMax() };
+    probe.volume = 8.0f * box.halfExtent.x * box.halfExtent.y * box.halfExtent.z;
+    probe.pendingLevels = ALL_LEVELS;
+    // the tile holds the reflections of something else until it's prefiltered
+    mReadyProbes &= ~(1u << index);
+    mStaleProbes &= ~(1u << index);
+}
+
+void ReflectionProbes::remove(size_t index) noexcept {
+    mProbes[index] = {};
+    mReadyProbes &= ~(1u << index);
+    mStaleProbes &= ~(1u << index);
+}
+
+void ReflectionProbes::invalidate(size_t index) noexcept {
+    Probe& probe = mProbes[index];
+    if (probe.environment) {
+        // the previous reflections are used until the new ones are prefiltered
+        probe.pendingLevels = ALL_LEVELS;
+        mStaleProbes &= ~(1u << index);
+    }
+}
+
+void ReflectionProbes::update(Aabb const& damage, bool damageUnbounded,
+        mat4f const& worldOriginTransform) noexcept {
+    mProbesFromWorld = inverse(worldOriginTransform);
+
+    if (!damageUnbounded && damage.isEmpty()) {
+        return;
+    }
+
+    Aabb box;
+    if (!damageUnbounded) {
+        Box b = rigidTransform(Box().set(damage.min, damage.max), mProbesFromWorld);
+        box = { b.getMin(), b.getMax() };
+    }
+    for (size_t i = 0; i < CONFIG_MAX_REFLECTION_PROBES; i++) {
+        Probe const& probe = mProbes[i];
+        if (probe.environment && (damageUnbounded || intersects(probe.box, box))) {
+            mStaleProbes |= 1u << i;
+        }
+    }
+}
+
+uint32_t ReflectionProbes::select(float3 const& position) const noexcept {
+    const float3 p = (mProbesFromWorld * float4{ position, 1 }).xyz;
+    uint32_t selected = 0;
+    float volume = std::numeric_limits<float>::max();
+    for (uint32_t ready = mReadyProbes; ready; ready &= ready - 1u) {
+        const uint32_t i = ctz(ready);
+        Probe const& probe = mProbes[i];
+        if (probe.volume < volume && contains(probe.box, p)) {
+            volume = probe.volume;
+            selected = i + 1;
+        }
+    }
+    return selected;
+}
+
+bool ReflectionProbes::isPrefilterPending() const noexcept {
+    for (Probe const& probe : mProbes) {
+        if (probe.pendingLevels) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ReflectionProbes::prefilter(FEngine& engine) noexcept {
+    for (size_t i = 0; i < CONFIG_MAX_REFLECTION_PROBES; i++) {
+        const size_t index = (mNextProbe + i) % CONFIG_MAX_REFLECTION_PROBES;
+        Probe& probe = mProbes[index];
+        if (!probe.pendingLevels) {
+            continue;
+        }
+
+        DriverApi& driver = engine.getDriverApi();
+        if (!mAtlasHandle) {
+            const TextureFormat format = CONFIG_IBL_RGBM ? TextureFormat::RGBA8 :
+                    TextureFormat::RGBA16F;
+            mAtlasHandle = driver.createTexture(SamplerType::SAMPLER_2D,
+                    CONFIG_REFLECTION_PROBE_LEVELS, format, 1, ATLAS_WIDTH, ATLAS_HEIGHT, 1,
+                    TextureUsage::COLOR_ATTACHMENT);
+            for (size_t level = 0; level < CONFIG_REFLECTION_PROBE_LEVELS; level++) {
+                mAtlasRenderTargets[level] = driver.createRenderTarget(TargetBufferFlags::COLOR,
+                        ATLAS_WIDTH >> level, ATLAS_HEIGHT >> level, 1, format,
+                        { mAtlasHandle, uint8_t(level) }, {}, {});
+            }
+        }
+
+        // same roughness and sample count progression as the IBL prefilter
+        const uint32_t level = ctz(probe.pendingLevels);
+        const uint32_t dim = CONFIG_REFLECTION_PROBE_SIZE >> level;
+        const Viewport viewport(
+                int32_t(index % CONFIG_REFLECTION_PROBE_ATLAS_COLUMNS * dim),
+                int32_t(index / CONFIG_REFLECTION_PROBE_ATLAS_COLUMNS * dim), dim, dim);
+        const float roughness = float(level) / (CONFIG_REFLECTION_PROBE_LEVELS - 1);
+        const uint32_t sampleCount = level < 2 ? SAMPLE_COUNT : SAMPLE_COUNT << (level - 1);
+        engine.getPostProcessManager().prefilterReflectionProbe(probe.environment,
+                mAtlasRenderTargets[level], viewport, roughness * roughness, sampleCount);
+
+        // the levels of a probe are done before moving on to the next one
+        probe.pendingLevels &= ~(1u << level);
+        if (!probe.pendingLevels) {
+            mReadyProbes |= 1u << index;
+            mNextProbe = index + 1;
+        } else {
+            mNextProbe = index;
+        }
+        return true;
+    }
+    return false;
+}
+
+void ReflectionProbes::prepare(UniformBuffer& u, SamplerBuffer& sb, size_t index) const noexcept {
+    u.setUniform(offsetof(FEngine::PerViewUib, reflectionProbesFromWorldMatrix), mProbesFromWorld);
+    for (uint32_t ready = mReadyProbes; ready; ready &= ready - 1u) {
+        const uint32_t i = ctz(ready);
+        Probe const& probe = mProbes[i];
+        const float3 data[3] = { probe.box.min, probe.box.max, probe.position };
+        u.setUniformArray(offsetof(FEngine::PerViewUib, reflectionProbes) +
+                i * 3 * sizeof(float4), data, 3);
+    }
+
+    if (sb.getBuffer()[index].t.getId() != mAtlasHandle.getId()) {
+        SamplerParams params;
+        params.filterMag = SamplerMagFilter::LINEAR;
+        params.filterMin = SamplerMinFilter::LINEAR_MIPMAP_LINEAR;
+        sb.setSampler(index, { mAtlasHandle, params });
+    }
+}
+
+} // namespace details
+} // namespace filament
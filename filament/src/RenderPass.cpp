@@ -17,9 +17,11 @@
 #include "RenderPass.h"
 
 #include "details/Culler.h"
+#include "details/GpuCuller.h"
 #include "details/Material.h"
 #include "details/MaterialInstance.h"
 #include "details/RenderPrimitive.h"
+#include "details/ShadowAtlas.h"
 #include "details/ShadowMap.h"
 #include "details/View.h"
 
@@ -29,6 +31,11 @@
 #include <utils/JobSystem.h>
 #include <utils/Systrace.h>
 
+#include <algorithm>
+
+#include <stddef.h>
+#include <string.h>
+
 using namespace utils;
 using namespace math;
 
@@ -44,33 +51,132 @@ UTILS_ALWAYS_INLINE // this allows the compiler to devirtualize some calls
 inline              // this removes the code from the compilation unit
 void RenderPass::render(
         FEngine& engine, JobSystem& js,
-        FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        FScene const& scene, Range<uint32_t> vr,
         uint32_t commandTypeFlags, RenderFlags renderFlags,
         const CameraInfo& camera, Viewport const& viewport,
-        GrowingSlice<Command>& commands) noexcept {
+        GrowingSlice<Command>& commands, ArenaScope& arena,
+        CommandCache* cache) noexcept {
+    FScene::RenderableSoa const& soa = scene.getRenderableData();
 
     SYSTRACE_CONTEXT();
 
     // trace the number of visible renderables
     SYSTRACE_VALUE32("visibleRenderables", vr.size());
 
+    // we extract camera position/forward outside of the loop, because these are not cheap.
+    const float3 cameraPosition(camera.getPosition());
+    const float3 cameraForwardVector(camera.getForwardVector());
+
+    // the cache can only be used if the commands depend on the same parameters as last frame
+    const bool useCache = cache && cache->update(&soa, commandTypeFlags, renderFlags,
+            cameraPosition, cameraForwardVector, engine.getResidencyVersion(),
+            engine.getMaterialSharingVersion());
+
+    if (!useCache || !generateCommandsFromCache(*cache, js, arena, soa, vr,
+            commandTypeFlags, renderFlags, cameraPosition, cameraForwardVector, commands)) {
+
+        generateSortedCommands(js, arena, const_cast<FScene::RenderableSoa&>(soa), vr,
+                commandTypeFlags, renderFlags, cameraPosition, cameraForwardVector, commands);
+
+        if (useCache) {
+            // the parameters didn't change since last frame, so they probably won't next frame
+            RenderPass::updateCommandCache(*cache, soa, vr, commands);
+        }
+    }
+
+    if (UTILS_UNLIKELY(mDebugView)) {
+        // this is done after the cache is updated, which keeps the materials of the scene
+        applyDebugView(commands, mDebugView, mDebugViewAdditive);
+    }
+
+    // this uploads the per-instance uniforms, so it must happen before the render pass starts
+    InstancedDraw const* const instancedDraws =
+            RenderPass::prepareInstancedDraws(engine, arena, commands,
+                    (renderFlags & HAS_BATCHED_UNIFORMS) ? &scene : nullptr);
+
+    // this dispatches the culling program, which must also happen before the render pass starts
+    Handle<HwStorageBuffer> indirectDraws;
+    if (UTILS_UNLIKELY(mGpuCuller) && mGpuCuller->cull(engine, soa, vr, commands, instancedDraws)) {
+        indirectDraws = mGpuCuller->getIndirectBuffer();
+    }
+
+    // the ACCUMULATED commands are drawn last, in the accumulation render target
+    Command* const accumulated = std::lower_bound(commands.begin(), commands.end(),
+            uint64_t(Pass::ACCUMULATED), [](Command const& c, CommandKey key) { return c.key < key; });
+    mHasAccumulatedCommands = accumulated != commands.end() &&
+            accumulated->key != uint64_t(Pass::SENTINEL);
+
+    // Take care not to upload data within the render pass (synchronize can commit froxel data)
+    driver::DriverApi& driver = engine.getDriverApi();
+    beginRenderPass(driver, viewport, camera);
+
+    // Now, execute all commands
+    RenderPass::recordDriverCommands(engine, js, arena, driver,
+            Slice<Command>(commands.begin(), accumulated), instancedDraws, indirectDraws);
+
+    endRenderPass(driver, viewport);
+
+    if (mHasAccumulatedCommands) {
+        beginAccumulationPass(driver, viewport);
+        RenderPass::recordDriverCommands(engine, js, arena, driver,
+                Slice<Command>(accumulated, commands.end()), instancedDraws, indirectDraws);
+        endAccumulationPass(driver, viewport);
+    }
+
+    // Kick the GPU since we're done with this render target
+    driver.flush();
+    // Wake-up the driver thread, unless commands are still being recorded (this would wait)
+    if (!engine.hasPendingCommands()) {
+        engine.flush();
+    }
+}
+
+void RenderPass::applyDebugView(Slice<Command> commands,
+        FMaterialInstance const* mi, bool additive) noexcept {
+    for (Command& command : commands) {
+        const CommandKey pass = command.key & PASS_MASK;
+        if (pass != uint64_t(Pass::COLOR) && pass != uint64_t(Pass::BLENDED)) {
+            // the depth commands already use their material's depth variant
+            continue;
+        }
+        // only the variant's skinning and morphing are kept, like for the unlit materials
+        command.primitive.mi = mi;
+        command.primitive.materialVariant.key =
+                Variant::filterVariant(command.primitive.materialVariant.key, false);
+        Driver::RasterState& rs = command.primitive.rasterState;
+        if (additive) {
+            rs.blendEquationRGB = rs.blendEquationAlpha = BlendEquation::ADD;
+            rs.blendFunctionSrcRGB = rs.blendFunctionSrcAlpha = BlendFunction::ONE;
+            rs.blendFunctionDstRGB = rs.blendFunctionDstAlpha = BlendFunction::ONE;
+        } else {
+            rs.disableBlending();
+        }
+    }
+}
+
+void RenderPass::generateSortedCommands(JobSystem& js, ArenaScope& arena,
+        FScene::RenderableSoa& soa, Range<uint32_t> vr,
+        uint32_t commandTypeFlags, RenderFlags renderFlags,
+        float3 cameraPosition, float3 cameraForwardVector,
+        GrowingSlice<Command>& commands) noexcept {
+    SYSTRACE_CALL();
+
     // up-to-date summed primitive counts needed for generateCommands()
-    updateSummedPrimitiveCounts(const_cast<FScene::RenderableSoa&>(soa), vr);
+    updateSummedPrimitiveCounts(soa, vr);
 
     // compute how much maximum storage we need for this pass
     uint32_t growBy = FScene::getPrimitiveCount(soa, vr.last);
     // double the color pass for transparents that need to render twice
     const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
     const bool depthPass  = bool(commandTypeFlags & (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
-    growBy *= uint32_t(colorPass * 2 + depthPass);
+    const uint32_t commandsPerPrimitive = uint32_t(colorPass * 2 + depthPass);
+    growBy *= commandsPerPrimitive;
     Command* const curr = commands.grow(growBy);
 
-    // we extract camera position/forward outside of the loop, because these are not cheap.
-    const float3 cameraPosition(camera.getPosition());
-    const float3 cameraForwardVector(camera.getForwardVector());
-    auto work = [commandTypeFlags, curr, &soa, renderFlags, cameraPosition, cameraForwardVector]
-            (uint32_t startIndex, uint32_t indexCount) {
-        RenderPass::generateCommands(commandTypeFlags, curr,
+    auto work = [commandTypeFlags, curr, commandsPerPrimitive, &soa, renderFlags,
+            cameraPosition, cameraForwardVector](uint32_t startIndex, uint32_t indexCount) {
+        const uint32_t offset = FScene::getPrimitiveCount(soa, startIndex) * commandsPerPrimitive;
+        RenderPass::generateCommands(commandTypeFlags, curr + offset,
                 soa, { startIndex, startIndex + indexCount }, renderFlags,
                 cameraPosition, cameraForwardVector);
     };
@@ -88,68 +194,678 @@ void RenderPass::render(
     // command buffer.
     commands.grow(1)->key = uint64_t(Pass::SENTINEL);
 
-    { // sort all commands
-        SYSTRACE_NAME("sort commands");
-        std::sort(commands.begin(), commands.end());
+    // sort all commands
+    RenderPass::sortCommands(js, arena, commands);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+void RenderPass::CommandCache::clear() noexcept {
+    mCommands.clear();
+    for (Entry& entry : mEntries) {
+        entry.cached = false;
     }
+}
 
-    // Take care not to upload data within the render pass (synchronize can commit froxel data)
-    driver::DriverApi& driver = engine.getDriverApi();
-    beginRenderPass(driver, viewport, camera);
+bool RenderPass::CommandCache::update(FScene::RenderableSoa const* soa, uint32_t commandTypeFlags,
+        RenderFlags renderFlags, float3 cameraPosition, float3 cameraForward,
+        uint32_t residencyVersion, uint32_t materialSharingVersion) noexcept {
+    const bool unchanged = mSoa == soa &&
+            mCommandTypeFlags == commandTypeFlags &&
+            mRenderFlags == renderFlags &&
+            mCameraPosition == cameraPosition &&
+            mCameraForward == cameraForward &&
+            mResidencyVersion == residencyVersion &&
+            // the commands point to the shared material instances, which can be gone
+            mMaterialSharingVersion == materialSharingVersion;
+    if (!unchanged) {
+        mSoa = soa;
+        mCommandTypeFlags = commandTypeFlags;
+        mRenderFlags = renderFlags;
+        mCameraPosition = cameraPosition;
+        mCameraForward = cameraForward;
+        mResidencyVersion = residencyVersion;
+        mMaterialSharingVersion = materialSharingVersion;
+        clear();
+    }
+    return unchanged;
+}
 
-    // Now, execute all commands
-    RenderPass::recordDriverCommands(driver, commands);
+UTILS_NOINLINE
+bool RenderPass::generateCommandsFromCache(CommandCache& cache, JobSystem& js,
+        ArenaScope& arena, FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        uint32_t commandTypeFlags, RenderFlags renderFlags,
+        float3 cameraPosition, float3 cameraForward,
+        GrowingSlice<Command>& commands) noexcept {
+    SYSTRACE_CALL();
 
-    endRenderPass(driver, viewport);
+    if (cache.mCommands.empty()) {
+        return false;
+    }
 
-    // Kick the GPU since we're done with this render target
-    driver.flush();
-    // Wake-up the driver thread
-    engine.flush();
+    using Entry = CommandCache::Entry;
+
+    // all the scratch memory is released when we return
+    ArenaScope scope(arena.getAllocator());
+
+    // Past this many changes, it's faster to generate and sort all the commands again
+    const uint32_t maxChangeCount = std::max(1u, uint32_t(vr.size()) / 4);
+    uint32_t* const rows = scope.allocate<uint32_t>(maxChangeCount);
+    uint32_t* const discarded = scope.allocate<uint32_t>(maxChangeCount);
+    if (UTILS_UNLIKELY(!rows || !discarded)) {
+        return false;
+    }
+
+    auto const* const UTILS_RESTRICT soaInstance          = soa.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT soaRenderableVersion = soa.data<FScene::RENDERABLE_VERSION>();
+    auto const* const UTILS_RESTRICT soaTransformVersion  = soa.data<FScene::TRANSFORM_VERSION>();
+    auto const* const UTILS_RESTRICT soaPrimitives        = soa.data<FScene::PRIMITIVES>();
+    auto const* const UTILS_RESTRICT soaLevels            = soa.data<FScene::LEVEL_OF_DETAIL>();
+    auto const* const UTILS_RESTRICT soaUbh               = soa.data<FScene::UBH>();
+
+    const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
+    const bool depthPass  = bool(commandTypeFlags & (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
+    const uint32_t commandsPerPrimitive = uint32_t(colorPass * 2 + depthPass);
+
+    // find the renderables whose commands must be generated, and the commands to discard
+    std::vector<Entry>& entries = cache.mEntries;
+    const uint32_t stamp = ++cache.mStamp;
+    uint32_t rowCount = 0;
+    uint32_t discardedCount = 0;
+    uint32_t generatedCount = 0;
+    for (uint32_t i : vr) {
+        const uint32_t instance = soaInstance[i];
+        if (UTILS_UNLIKELY(instance >= entries.size())) {
+            entries.resize(instance + 1);
+        }
+        Entry& entry = entries[instance];
+        Slice<FRenderPrimitive> const& primitives = soaPrimitives[i];
+        const bool unchanged = entry.cached &&
+                entry.renderableVersion == soaRenderableVersion[i] &&
+                entry.transformVersion == soaTransformVersion[i] &&
+                entry.level == soaLevels[i] &&
+                entry.primitiveCount == primitives.size() &&
+                entry.ubh.getId() == soaUbh[i].getId();
+        if (UTILS_UNLIKELY(!unchanged)) {
+            if (rowCount == maxChangeCount || discardedCount == maxChangeCount) {
+                return false;
+            }
+            rows[rowCount++] = i;
+            generatedCount += uint32_t(primitives.size()) * commandsPerPrimitive;
+            if (entry.cached) {
+                discarded[discardedCount++] = instance;
+            }
+            entry.renderableVersion = soaRenderableVersion[i];
+            entry.transformVersion = soaTransformVersion[i];
+            entry.level = soaLevels[i];
+            entry.primitiveCount = uint32_t(primitives.size());
+            entry.ubh = soaUbh[i];
+            entry.cached = true;
+        }
+        entry.stamp = stamp;
+    }
+
+    // the commands of the renderables that are not visible anymore are discarded as well
+    for (uint32_t instance = 0, n = uint32_t(entries.size()); instance < n; instance++) {
+        Entry& entry = entries[instance];
+        if (UTILS_UNLIKELY(entry.cached && entry.stamp != stamp)) {
+            if (discardedCount == maxChangeCount) {
+                return false;
+            }
+            discarded[discardedCount++] = instance;
+            entry.cached = false;
+        }
+    }
+
+    std::vector<Command>& cached = cache.mCommands;
+
+    if (!rowCount && !discardedCount) {
+        // nothing changed, the commands are already sorted
+        Command* const curr = commands.grow(uint32_t(cached.size() + 1));
+        std::copy(cached.begin(), cached.end(), curr);
+        curr[cached.size()].key = uint64_t(Pass::SENTINEL);
+        return true;
+    }
+
+    Command* const kept = scope.allocate<Command>(cached.size(), CACHELINE_SIZE);
+    Command* const generated = scope.allocate<Command>(generatedCount, CACHELINE_SIZE);
+    if (UTILS_UNLIKELY(!kept || (generatedCount && !generated))) {
+        return false;
+    }
+
+    // Commands are identified by their renderable instance (uniform buffers can be shared when
+    // they're batched by the scene). The bitmask quickly rejects most of the commands we keep.
+    uint64_t bloom[16] = {};
+    for (uint32_t i = 0; i < discardedCount; i++) {
+        bloom[(discarded[i] >> 6u) & 0xFu] |= 1llu << (discarded[i] & 0x3Fu);
+    }
+    std::sort(discarded, discarded + discardedCount);
+
+    Command* last = kept;
+    for (Command const& command : cached) {
+        const uint32_t id = command.primitive.renderable.asValue();
+        const bool maybeDiscarded = bool(bloom[(id >> 6u) & 0xFu] & (1llu << (id & 0x3Fu)));
+        if (!maybeDiscarded || !std::binary_search(discarded, discarded + discardedCount, id)) {
+            *last++ = command;
+        }
+    }
+    const size_t keptCount = size_t(last - kept);
+
+    // generate the commands of the renderables that changed
+    Command* curr = generated;
+    for (uint32_t r = 0; r < rowCount; r++) {
+        const uint32_t i = rows[r];
+        RenderPass::generateCommands(commandTypeFlags, curr, soa, { i, i + 1 }, renderFlags,
+                cameraPosition, cameraForward);
+        curr += soaPrimitives[i].size() * commandsPerPrimitive;
+    }
+    curr = std::remove_if(generated, curr, [](Command const& command) {
+        return command.key == uint64_t(Pass::SENTINEL);
+    });
+    const size_t generatedKeptCount = size_t(curr - generated);
+    RenderPass::sortCommands(js, scope, { generated, uint32_t(generatedKeptCount) });
+
+    // and merge them with the commands we kept
+    const size_t count = keptCount + generatedKeptCount;
+    Command* const result = commands.grow(uint32_t(count + 1));
+    std::merge(kept, kept + keptCount, generated, generated + generatedKeptCount, result);
+    result[count].key = uint64_t(Pass::SENTINEL);
+
+    cached.assign(result, result + count);
+    return true;
 }
 
-UTILS_NOINLINE // no need to be inlined
-void RenderPass::recordDriverCommands(
-        FEngine::DriverApi& UTILS_RESTRICT driver,  // using restrict here is very important
+UTILS_NOINLINE
+void RenderPass::updateCommandCache(CommandCache& cache,
+        FScene::RenderableSoa const& soa, Range<uint32_t> vr,
         Slice<Command> const& commands) noexcept {
     SYSTRACE_CALL();
 
-    if (!commands.empty()) {
-        FMaterialInstance const* UTILS_RESTRICT previousMi = nullptr;
-        FMaterial const* UTILS_RESTRICT ma = nullptr;
-        Command const* UTILS_RESTRICT c;
-        for (c = commands.cbegin(); c->key != -1LLU; ++c) {
-            /*
-             * Be careful when changing code below, this is the hot inner-loop
-             */
-
-            // per-renderable uniform
-            PrimitiveInfo const& UTILS_RESTRICT info = c->primitive;
-            driver.bindUniforms(BindingPoints::PER_RENDERABLE, info.perRenderableUniforms);
-            if (info.perRenderableBones) {
-                driver.bindUniforms(BindingPoints::PER_RENDERABLE_BONES, info.perRenderableBones);
+    using Entry = CommandCache::Entry;
+
+    // commands are sorted, so all SENTINELs are at the end
+    Command const* const last = std::lower_bound(commands.cbegin(), commands.cend(),
+            uint64_t(Pass::SENTINEL), [](Command const& c, CommandKey key) { return c.key < key; });
+    cache.clear();
+    cache.mCommands.assign(commands.cbegin(), last);
+
+    auto const* const UTILS_RESTRICT soaInstance          = soa.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT soaRenderableVersion = soa.data<FScene::RENDERABLE_VERSION>();
+    auto const* const UTILS_RESTRICT soaTransformVersion  = soa.data<FScene::TRANSFORM_VERSION>();
+    auto const* const UTILS_RESTRICT soaPrimitives        = soa.data<FScene::PRIMITIVES>();
+    auto const* const UTILS_RESTRICT soaLevels            = soa.data<FScene::LEVEL_OF_DETAIL>();
+    auto const* const UTILS_RESTRICT soaUbh               = soa.data<FScene::UBH>();
+
+    std::vector<Entry>& entries = cache.mEntries;
+    const uint32_t stamp = ++cache.mStamp;
+    for (uint32_t i : vr) {
+        const uint32_t instance = soaInstance[i];
+        if (UTILS_UNLIKELY(instance >= entries.size())) {
+            entries.resize(instance + 1);
+        }
+        Entry& entry = entries[instance];
+        entry.renderableVersion = soaRenderableVersion[i];
+        entry.transformVersion = soaTransformVersion[i];
+        entry.level = soaLevels[i];
+        entry.primitiveCount = uint32_t(soaPrimitives[i].size());
+        entry.ubh = soaUbh[i];
+        entry.stamp = stamp;
+        entry.cached = true;
+    }
+}
+
+UTILS_NOINLINE // no need to be inlined
+void RenderPass::sortCommands(JobSystem& js, ArenaScope& arena, Slice<Command> commands) noexcept {
+    SYSTRACE_NAME("sort commands");
+
+    const uint32_t count = uint32_t(commands.size());
+    if (count < RADIX_SORT_MIN_COMMANDS_COUNT) {
+        std::sort(commands.begin(), commands.end());
+        return;
+    }
+
+    // all the scratch memory is released when we return
+    ArenaScope scope(arena.getAllocator());
+
+    const uint32_t chunkCount = std::min(RADIX_SORT_MAX_CHUNKS,
+            (count + RADIX_SORT_CHUNK_SIZE - 1) / RADIX_SORT_CHUNK_SIZE);
+    const uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+    Command* const scratch = scope.allocate<Command>(count, CACHELINE_SIZE);
+    uint32_t* const histograms = scope.allocate<uint32_t>(
+            chunkCount * RADIX_SORT_BUCKET_COUNT, CACHELINE_SIZE);
+    CommandKey* const keyBits = scope.allocate<CommandKey>(chunkCount * 2, CACHELINE_SIZE);
+    if (UTILS_UNLIKELY(!scratch || !histograms || !keyBits)) {
+        // the arena is too small, this shouldn't happen with the default configuration
+        std::sort(commands.begin(), commands.end());
+        return;
+    }
+
+    // runs work(chunk, first, last) for each chunk, in parallel
+    auto forEachChunk = [&js, chunkCount, chunkSize, count](auto const& work) {
+        auto chunks = [&work, chunkSize, count](uint32_t start, uint32_t n) {
+            for (uint32_t c = start; c < start + n; c++) {
+                work(c, c * chunkSize, std::min(count, (c + 1) * chunkSize));
+            }
+        };
+        auto job = jobs::parallel_for(js, nullptr, 0, chunkCount,
+                std::cref(chunks), jobs::CountSplitter<1>());
+        js.runAndWait(job);
+    };
+
+    // find which bits of the keys are not the same for all commands, ignoring SENTINELs
+    Command const* const UTILS_RESTRICT input = commands.data();
+    forEachChunk([input, keyBits](uint32_t c, uint32_t first, uint32_t last) {
+        CommandKey any = 0;
+        CommandKey all = ~CommandKey(0);
+        for (uint32_t i = first; i < last; i++) {
+            const CommandKey key = input[i].key;
+            const CommandKey m = select(key != uint64_t(Pass::SENTINEL));
+            any |= key & m;
+            all &= key | ~m;
+        }
+        keyBits[c * 2 + 0] = any;
+        keyBits[c * 2 + 1] = all;
+    });
+
+    CommandKey any = 0;
+    CommandKey all = ~CommandKey(0);
+    for (uint32_t c = 0; c < chunkCount; c++) {
+        any |= keyBits[c * 2 + 0];
+        all &= keyBits[c * 2 + 1];
+    }
+    const CommandKey varying = any & ~all;
+
+    // Depending on the pass, most of the key fields are constant (e.g. the pass itself, the
+    // priority, the Z-bucket without depth prepass), so we only sort the bytes that change.
+    // SENTINELs are handled separately so they don't make every byte appear to change.
+    uint32_t shifts[sizeof(CommandKey)];
+    uint32_t passCount = 0;
+    for (uint32_t shift = 0; shift < sizeof(CommandKey) * 8; shift += 8) {
+        if ((varying >> shift) & 0xFFu) {
+            shifts[passCount++] = shift;
+        }
+    }
+    if (!passCount) {
+        // all keys are the same, we still need to move the SENTINELs last
+        shifts[passCount++] = 0;
+    }
+
+    Command* src = commands.data();
+    Command* dst = scratch;
+    for (uint32_t p = 0; p < passCount; p++) {
+        const uint32_t shift = shifts[p];
+
+        forEachChunk([src, histograms, shift](uint32_t c, uint32_t first, uint32_t last) {
+            uint32_t* const UTILS_RESTRICT h = histograms + c * RADIX_SORT_BUCKET_COUNT;
+            std::fill_n(h, RADIX_SORT_BUCKET_COUNT, 0u);
+            for (uint32_t i = first; i < last; i++) {
+                h[radixDigit(src[i].key, shift)]++;
+            }
+        });
+
+        // exclusive prefix sum, bucket-major so that each chunk writes after the previous
+        // chunks in every bucket, which keeps the sort stable.
+        uint32_t sum = 0;
+        for (uint32_t b = 0; b < RADIX_SORT_BUCKET_COUNT; b++) {
+            for (uint32_t c = 0; c < chunkCount; c++) {
+                uint32_t& h = histograms[c * RADIX_SORT_BUCKET_COUNT + b];
+                const uint32_t n = h;
+                h = sum;
+                sum += n;
             }
+        }
 
-            FMaterialInstance const* const UTILS_RESTRICT mi = info.mi;
-            if (UTILS_UNLIKELY(mi != previousMi)) {
-                // this is always taken the first time
-                previousMi = mi;
-                mi->use(driver);
-                ma = mi->getMaterial();
+        forEachChunk([src, dst, histograms, shift](uint32_t c, uint32_t first, uint32_t last) {
+            uint32_t* const UTILS_RESTRICT h = histograms + c * RADIX_SORT_BUCKET_COUNT;
+            Command const* const UTILS_RESTRICT s = src;
+            Command* const UTILS_RESTRICT d = dst;
+            for (uint32_t i = first; i < last; i++) {
+                d[h[radixDigit(s[i].key, shift)]++] = s[i];
             }
+        });
 
-            Handle<HwProgram> const ph = ma->getProgram(info.materialVariant.key);
-            driver.draw(ph, info.rasterState, info.primitiveHandle);
+        std::swap(src, dst);
+    }
+
+    if (src != commands.data()) {
+        std::copy(src, src + count, commands.data());
+    }
+}
+
+UTILS_ALWAYS_INLINE // this function exists only to make the code more readable. we want it inlined.
+inline              // and we don't need it in the compilation unit
+uint32_t RenderPass::getInstanceCount(Command const* first, Command const* last) noexcept {
+    PrimitiveInfo const& info = first->primitive;
+    if (info.bonesSlot || info.materialVariant.hasMorphing()) {
+        // skinned renderables can't share their bones, nor morphing ones their weights
+        return 1;
+    }
+    last = std::min(last, first + CONFIG_MAX_INSTANCE_COUNT);
+    Command const* c = first + 1;
+    for (; c != last; ++c) {
+        PrimitiveInfo const& other = c->primitive;
+        if (other.mi != info.mi ||
+            other.primitiveHandle.getId() != info.primitiveHandle.getId() ||
+            other.bonesSlot ||
+            other.materialVariant.hasMorphing() ||
+            other.rasterState.u != info.rasterState.u ||
+            other.materialVariant.key != info.materialVariant.key) {
+            break;
         }
+    }
+    return uint32_t(c - first);
+}
+
+RenderPass::InstancedDraw const* RenderPass::prepareInstancedDraws(FEngine& engine,
+        ArenaScope& arena, Slice<Command> commands, FScene const* batchedUniforms) noexcept {
+    SYSTRACE_CALL();
+
+    // commands are sorted, so all SENTINELs are at the end
+    Command* const first = commands.begin();
+    Command* const last = std::lower_bound(commands.begin(), commands.end(),
+            uint64_t(Pass::SENTINEL), [](Command const& c, CommandKey key) { return c.key < key; });
 
-        SYSTRACE_VALUE32("commandCount", c - commands.cbegin());
+    // this must outlive recordDriverCommands()
+    InstancedDraw* const instancedDraws =
+            arena.allocate<InstancedDraw>(FEngine::CONFIG_MAX_INSTANCED_DRAW_COUNT);
+    if (UTILS_UNLIKELY(!instancedDraws)) {
+        return nullptr;
+    }
+
+    FRenderableManager const& rcm = engine.getRenderableManager();
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    constexpr uint32_t CHUNK = JOBS_PARALLEL_FOR_DRIVER_COMMANDS_COUNT;
+    constexpr size_t NORMAL_MATRIX_SIZE = 3 * sizeof(float4); // std140 mat3
+
+    // the ACCUMULATED commands are recorded separately, see render()
+    Command* const accumulated = std::lower_bound(first, last,
+            uint64_t(Pass::ACCUMULATED), [](Command const& c, CommandKey key) { return c.key < key; });
+
+    uint32_t drawCount = 0;
+    for (Command* c = first; c < last && drawCount < FEngine::CONFIG_MAX_INSTANCED_DRAW_COUNT;) {
+        // runs can't span several of the chunks recorded in parallel by recordDriverCommands()
+        Command* const base = c < accumulated ? first : accumulated;
+        Command* const end = c < accumulated ? accumulated : last;
+        const size_t chunkEnd = (size_t(c - base) / CHUNK + 1) * CHUNK;
+        uint32_t count = getInstanceCount(c, base + std::min(chunkEnd, size_t(end - base)));
+
+        // in snapshot mode, the RenderableManager's uniforms can already be the next frame's
+        auto getUniforms = [&rcm, batchedUniforms](Command const& command)
+                -> FEngine::PerRenderableUib const& {
+            const FRenderableManager::Instance ri = command.primitive.renderable;
+            return batchedUniforms ?
+                    batchedUniforms->getBatchedUniforms(ri) : rcm.getUniforms(ri);
+        };
+
+        // the instances use the reflection probe of the first one
+        if (count > 1) {
+            const uint32_t reflectionProbe = getUniforms(c[0]).reflectionProbe;
+            for (uint32_t i = 1; i < count; i++) {
+                if (getUniforms(c[i]).reflectionProbe != reflectionProbe) {
+                    count = i;
+                    break;
+                }
+            }
+        }
+
+        if (count > 1) {
+            Handle<HwUniformBuffer> ubh = engine.acquireInstanceUniformBuffer();
+            if (UTILS_UNLIKELY(!ubh)) {
+                break;
+            }
+
+            // instance 0 uses the per-renderable uniforms of the first command
+            UniformBuffer uniforms(engine.getPerInstanceUib());
+            for (uint32_t i = 1; i < count; i++) {
+                FEngine::PerRenderableUib const& src = getUniforms(c[i]);
+                memcpy(uniforms.invalidateUniforms(
+                        offsetof(FEngine::PerInstanceUib, worldFromModelMatrix) + i * sizeof(mat4f),
+                        sizeof(mat4f)),
+                        &src.worldFromModelMatrix, sizeof(mat4f));
+                memcpy(uniforms.invalidateUniforms(
+                        offsetof(FEngine::PerInstanceUib, worldFromModelNormalMatrix) + i * NORMAL_MATRIX_SIZE,
+                        NORMAL_MATRIX_SIZE),
+                        src.worldFromModelNormalMatrix, NORMAL_MATRIX_SIZE);
+            }
+            driver.updateUniformBuffer(ubh, std::move(uniforms));
+
+            instancedDraws[drawCount] = { ubh, count };
+            c->primitive.instancedDraw = uint16_t(++drawCount);
+        }
+        c += count;
+    }
+
+    SYSTRACE_VALUE32("instancedDrawCount", drawCount);
+    return instancedDraws;
+}
+
+void RenderPass::recordDriverCommands(FEngine& engine, JobSystem& js, ArenaScope& arena,
+        FEngine::DriverApi& driver, Slice<Command> const& commands,
+        InstancedDraw const* instancedDraws, Handle<HwStorageBuffer> indirectDraws) noexcept {
+    SYSTRACE_CALL();
+
+    // commands are sorted, so all SENTINELs are at the end
+    Command const* const first = commands.cbegin();
+    Command const* const last = std::lower_bound(commands.cbegin(), commands.cend(),
+            uint64_t(Pass::SENTINEL), [](Command const& c, CommandKey key) { return c.key < key; });
+    const uint32_t count = uint32_t(last - first);
+    SYSTRACE_VALUE32("commandCount", count);
+
+    { // Programs are created lazily in the engine's command stream, this can't happen from the
+      // jobs recording the commands. Until a program is ready, its draws use a similar variant
+      // or are skipped.
+        SYSTRACE_NAME("prepare programs");
+        FMaterial const* previousMa = nullptr;
+        uint8_t previousKey = 0;
+        for (Command const* c = first; c != last; ++c) {
+            PrimitiveInfo const& info = c->primitive;
+            FMaterial const* const ma = info.mi->getMaterial();
+            if (ma != previousMa || info.materialVariant.key != previousKey) {
+                previousMa = ma;
+                previousKey = info.materialVariant.key;
+                ma->prepareProgram(previousKey);
+            }
+        }
+    }
+
+    // the draws that aren't instanced don't read the per-instance uniforms, but their block
+    // must be bound all the same. The instanced draws bind their own.
+    driver.bindUniforms(BindingPoints::PER_INSTANCE, engine.getDefaultInstanceUniformBuffer());
+
+    if (engine.getPendingCommandsJob()) {
+        // the recording can outlive this call, so its scratch memory must live in 'arena'
+        recordDriverCommandsParallel(engine, js, arena, driver, first, last,
+                instancedDraws, indirectDraws);
+    } else {
+        // all the scratch memory is released when we return
+        ArenaScope scope(arena.getAllocator());
+        recordDriverCommandsParallel(engine, js, scope, driver, first, last,
+                instancedDraws, indirectDraws);
+    }
+}
+
+void RenderPass::recordDriverCommandsParallel(FEngine& engine, JobSystem& js,
+        ArenaScope& scratch, FEngine::DriverApi& driver, Command const* first, Command const* last,
+        InstancedDraw const* instancedDraws, Handle<HwStorageBuffer> indirectDraws) noexcept {
+    constexpr uint32_t CHUNK = JOBS_PARALLEL_FOR_DRIVER_COMMANDS_COUNT;
+    const uint32_t count = uint32_t(last - first);
+    const uint32_t chunkCount = (count + CHUNK - 1) / CHUNK;
+    const Handle<HwUniformBuffer> bonePalette = engine.getRenderableManager().getBonePaletteUbh();
+
+    size_t* const offsets = chunkCount > 1 ? scratch.allocate<size_t>(chunkCount + 1) : nullptr;
+    if (!offsets) {
+        // not enough commands to make it worth it (or no memory)
+        RenderPass::recordDriverCommands(driver, bonePalette, instancedDraws, indirectDraws,
+                first, last);
+        return;
+    }
+
+    // space taken by the driver commands we record, see recordDriverCommands() below
+    using Cmd = FEngine::DriverApi;
+    constexpr size_t bindUniformsSize =
+            Cmd::getCommandSize<decltype(&Driver::bindUniforms), &Driver::bindUniforms>();
+    constexpr size_t bindUniformsRangeSize =
+            Cmd::getCommandSize<decltype(&Driver::bindUniformsRange), &Driver::bindUniformsRange>();
+    constexpr size_t bindSamplersSize =
+            Cmd::getCommandSize<decltype(&Driver::bindSamplers), &Driver::bindSamplers>();
+    constexpr size_t setViewportScissorSize =
+            Cmd::getCommandSize<decltype(&Driver::setViewportScissor), &Driver::setViewportScissor>();
+    constexpr size_t drawSize =
+            Cmd::getCommandSize<decltype(&Driver::draw), &Driver::draw>();
+    constexpr size_t drawInstancedSize =
+            Cmd::getCommandSize<decltype(&Driver::drawInstanced), &Driver::drawInstanced>();
+    constexpr size_t drawIndirectSize =
+            Cmd::getCommandSize<decltype(&Driver::drawIndirect), &Driver::drawIndirect>();
+    constexpr size_t setPushConstantsSize =
+            Cmd::getCommandSize<decltype(&Driver::setPushConstants), &Driver::setPushConstants>();
+    // upper bound of FMaterialInstance::use()
+    constexpr size_t useSize = bindUniformsSize + bindSamplersSize + setPushConstantsSize +
+            setViewportScissorSize;
+
+    { // compute an upper bound of the command stream space needed by each chunk
+        SYSTRACE_NAME("prepare driver commands");
+        size_t offset = 0;
+        for (uint32_t i = 0; i < chunkCount; i++) {
+            offsets[i] = offset;
+            offset += Cmd::getJumpSize();
+            // the first command of each chunk always uses its material instance
+            FMaterialInstance const* previousMi = nullptr;
+            for (Command const* c = first + i * CHUNK, *e = std::min(c + CHUNK, last); c != e; ++c) {
+                PrimitiveInfo const& info = c->primitive;
+                offset += info.batchedUniforms ? bindUniformsRangeSize : bindUniformsSize;
+                offset += info.indirectDraw ? drawIndirectSize : drawSize;
+                offset += info.bonesSlot ? bindUniformsRangeSize : 0;
+                offset += info.materialVariant.hasMorphing() ? bindSamplersSize : 0;
+                offset += info.instancedDraw ? bindUniformsSize + drawInstancedSize : 0;
+                if (info.mi != previousMi) {
+                    previousMi = info.mi;
+                    offset += useSize;
+                }
+            }
+        }
+        offsets[chunkCount] = offset;
+    }
+
+    for (uint32_t begin = 0; begin < chunkCount;) {
+        // the chunks that fit in the space guaranteed to be available after a flush
+        uint32_t end = begin + 1;
+        while (end < chunkCount &&
+               offsets[end + 1] - offsets[begin] <= PARALLEL_DRIVER_COMMANDS_BATCH_SIZE) {
+            end++;
+        }
+
+        // this also waits for the commands deferred previously
+        engine.flush();
+        char* const base = static_cast<char*>(
+                driver.reserve(offsets[end] - offsets[begin])) - offsets[begin];
+
+        // each chunk is recorded in its own slice of the reserved space, and ends with a jump
+        // to the next slice (or the end of the reserved space for the last chunk).
+        auto work = [&driver, bonePalette, instancedDraws, indirectDraws, first, last, offsets, base](
+                uint32_t start, uint32_t n) {
+            for (uint32_t i = start; i < start + n; i++) {
+                char* const sliceBegin = base + offsets[i];
+                char* const sliceEnd = base + offsets[i + 1];
+                CircularBuffer buffer(sliceBegin, size_t(sliceEnd - sliceBegin));
+                FEngine::DriverApi stream(driver, buffer);
+                Command const* const c = first + i * CHUNK;
+                RenderPass::recordDriverCommands(stream, bonePalette, instancedDraws,
+                        indirectDraws, c, std::min(c + CHUNK, last));
+                stream.jump(sliceEnd);
+                assert(buffer.getHead() <= sliceEnd);
+            }
+        };
+        auto const* const functor = scratch.make<decltype(work)>(work);
+
+        // When commands are deferred, the jobs keep running after we return and the driver
+        // commands that follow are written after the reserved space. They're waited for by the
+        // next flush.
+        JobSystem::Job* const pending = engine.getPendingCommandsJob();
+        auto job = jobs::parallel_for(js, pending, begin, end - begin,
+                std::cref(*functor), jobs::CountSplitter<1>());
+        if (pending) {
+            js.run(job);
+            engine.setPendingCommandsRecorded();
+        } else {
+            js.runAndWait(job);
+        }
+
+        begin = end;
+    }
+}
+
+UTILS_NOINLINE // no need to be inlined
+void RenderPass::recordDriverCommands(
+        FEngine::DriverApi& UTILS_RESTRICT driver,  // using restrict here is very important
+        Handle<HwUniformBuffer> bonePalette,
+        InstancedDraw const* UTILS_RESTRICT instancedDraws,
+        Handle<HwStorageBuffer> indirectDraws,
+        Command const* first, Command const* last) noexcept {
+    FMaterialInstance const* UTILS_RESTRICT previousMi = nullptr;
+    FMaterial const* UTILS_RESTRICT ma = nullptr;
+    for (Command const* UTILS_RESTRICT c = first; c != last; ++c) {
+        /*
+         * Be careful when changing code below, this is the hot inner-loop
+         */
+
+        // per-renderable uniform
+        PrimitiveInfo const& UTILS_RESTRICT info = c->primitive;
+        if (info.batchedUniforms) {
+            driver.bindUniformsRange(BindingPoints::PER_RENDERABLE, info.perRenderableUniforms,
+                    info.renderable.asValue() * FScene::BATCHED_UNIFORMS_STRIDE,
+                    sizeof(FEngine::PerRenderableUib));
+        } else {
+            driver.bindUniforms(BindingPoints::PER_RENDERABLE, info.perRenderableUniforms);
+        }
+        if (info.bonesSlot) {
+            driver.bindUniformsRange(BindingPoints::PER_RENDERABLE_BONES, bonePalette,
+                    (info.bonesSlot - 1) * FRenderableManager::BONE_PALETTE_STRIDE,
+                    FRenderableManager::BONE_PALETTE_STRIDE);
+        }
+        if (UTILS_UNLIKELY(info.materialVariant.hasMorphing())) {
+            driver.bindSamplers(BindingPoints::PER_RENDERABLE, info.morphTargets);
+        }
+
+        FMaterialInstance const* const UTILS_RESTRICT mi = info.mi;
+        if (UTILS_UNLIKELY(mi != previousMi)) {
+            // this is always taken the first time
+            previousMi = mi;
+            mi->use(driver);
+            ma = mi->getMaterial();
+        }
+
+        Handle<HwProgram> const ph = ma->getProgramOrFallback(info.materialVariant.key);
+        if (UTILS_UNLIKELY(info.instancedDraw)) {
+            // the following commands are drawn as instances of this one
+            InstancedDraw const& instancedDraw = instancedDraws[info.instancedDraw - 1];
+            if (UTILS_UNLIKELY(!ph)) {
+                c += instancedDraw.count - 1;
+                continue;
+            }
+            driver.bindUniforms(BindingPoints::PER_INSTANCE, instancedDraw.uniforms);
+            driver.drawInstanced(ph, info.rasterState, info.primitiveHandle, instancedDraw.count);
+            c += instancedDraw.count - 1;
+            continue;
+        }
+        if (UTILS_UNLIKELY(!ph)) {
+            // the program is still being built and there is no variant to replace it
+            continue;
+        }
+        if (info.indirectDraw) {
+            // the draw was written by the GpuCuller, with no instance if it was culled
+            constexpr uint32_t stride = sizeof(Driver::DrawIndirectCommand);
+            driver.drawIndirect(ph, info.rasterState, info.primitiveHandle, indirectDraws,
+                    (info.indirectDraw - 1) * stride, 1, stride);
+            continue;
+        }
+        driver.draw(ph, info.rasterState, info.primitiveHandle);
     }
 }
 
 /* static */
 UTILS_ALWAYS_INLINE // this function exists only to make the code more readable. we want it inlined.
 inline              // and we don't need it in the compilation unit
-void RenderPass::setupColorCommand(Command& cmdDraw, bool hasDepthPass,
+void RenderPass::setupColorCommand(Command& cmdDraw, bool hasDepthPass, bool stateSorting,
         FMaterialInstance const* const UTILS_RESTRICT mi) noexcept {
 
     FMaterial const * const UTILS_RESTRICT ma = mi->getMaterial();
@@ -166,7 +882,8 @@ void RenderPass::setupColorCommand(Command& cmdDraw, bool hasDepthPass,
     uint64_t keyDraw = cmdDraw.key;
     keyDraw &= ~(PASS_MASK | BLENDING_MASK | MATERIAL_MASK);
     keyDraw |= uint64_t(Pass::COLOR);
-    keyDraw |= mi->getSortingKey(); // already all set-up for direct or'ing
+    // already all set-up for direct or'ing
+    keyDraw |= stateSorting ? mi->getStateSortingKey() : mi->getSortingKey();
     keyDraw |= makeField(variant, MATERIAL_VARIANT_KEY_MASK, MATERIAL_VARIANT_KEY_SHIFT);
     keyDraw |= makeField(ma->getRasterState().alphaToCoverage, BLENDING_MASK, BLENDING_SHIFT);
 
@@ -205,13 +922,7 @@ void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const comm
     // (in principle, we could have split this method into two, at the cost of going through
     // the list twice)
 
-    // compute how much maximum storage we need
-    uint32_t offset = FScene::getPrimitiveCount(soa, range.first);
-    // double the color pass for transparents that need to render twice
-    const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
-    const bool depthPass  = bool(commandTypeFlags & (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
-    offset *= uint32_t(colorPass * 2 + depthPass);
-    Command* const curr = commands + offset;
+    Command* const curr = commands;
 
     /*
      *
@@ -268,23 +979,35 @@ void RenderPass::generateCommandsImpl(uint32_t,
     auto const* const UTILS_RESTRICT soaVisibility      = soa.data<FScene::VISIBILITY_STATE>();
     auto const* const UTILS_RESTRICT soaPrimitives      = soa.data<FScene::PRIMITIVES>();
     auto const* const UTILS_RESTRICT soaUbh             = soa.data<FScene::UBH>();
-    auto const* const UTILS_RESTRICT soaBonesUbh        = soa.data<FScene::BONES_UBH>();
+    auto const* const UTILS_RESTRICT soaBonesSlot       = soa.data<FScene::BONES_SLOT>();
+    auto const* const UTILS_RESTRICT soaMorphTargets    = soa.data<FScene::MORPH_TARGETS>();
+    auto const* const UTILS_RESTRICT soaInstance        = soa.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT soaVisibleMask     = soa.data<FScene::VISIBLE_MASK>();
 
     const bool hasShadowing = renderFlags & HAS_SHADOWING;
+    const uint8_t visibleMask = uint8_t(renderFlags >> VISIBLE_MASK_SHIFT);
+    const bool staticCastersOnly = renderFlags & STATIC_CASTERS_ONLY;
+    const bool dynamicCastersOnly = renderFlags & DYNAMIC_CASTERS_ONLY;
+    const bool reversedZ = renderFlags & HAS_REVERSED_Z;
+    const bool stateSorting = renderFlags & STATE_SORTING;
+    const bool accumulateTransparency = renderFlags & ACCUMULATED_TRANSPARENCY;
+    const uint8_t batchedUniforms = uint8_t(bool(renderFlags & HAS_BATCHED_UNIFORMS));
     Variant materialVariant;
     materialVariant.setDirectionalLighting(renderFlags & HAS_DIRECTIONAL_LIGHT);
     materialVariant.setDynamicLighting(renderFlags & HAS_DYNAMIC_LIGHTING);
     materialVariant.setShadowReceiver(false); // this is set per Renderable
 
     Command cmdColor;
+    cmdColor.primitive.batchedUniforms = batchedUniforms;
 
     Command cmdDepth;
     cmdDepth.primitive.materialVariant = { Variant::DEPTH_VARIANT };
     cmdDepth.primitive.rasterState = Driver::RasterState();
     cmdDepth.primitive.rasterState.colorWrite = false;
     cmdDepth.primitive.rasterState.depthWrite = true;
-    cmdDepth.primitive.rasterState.depthFunc = Driver::RasterState::DepthFunc::L;
+    cmdDepth.primitive.rasterState.depthFunc = reverseDepthFunc(SamplerCompareFunc::L, reversedZ);
     cmdDepth.primitive.rasterState.alphaToCoverage = false;
+    cmdDepth.primitive.batchedUniforms = batchedUniforms;
 
     for (uint32_t i = range.first; i < range.last; ++i) {
         // Signed distance from camera to object's center. Positive distances are in front of
@@ -319,9 +1042,12 @@ void RenderPass::generateCommandsImpl(uint32_t,
 
         cmdColor.key = makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
         cmdColor.primitive.perRenderableUniforms = soaUbh[i];
-        cmdColor.primitive.perRenderableBones = soaBonesUbh[i];
+        cmdColor.primitive.bonesSlot = soaBonesSlot[i];
+        cmdColor.primitive.morphTargets = soaMorphTargets[i];
+        cmdColor.primitive.renderable = soaInstance[i];
         materialVariant.setShadowReceiver(soaVisibility[i].receiveShadows & hasShadowing);
         materialVariant.setSkinning(soaVisibility[i].skinning);
+        materialVariant.setMorphing(soaVisibility[i].morphing);
 
         // we're assuming we're always doing the depth (either way, it's correct)
         // this will generate front to back rendering
@@ -329,11 +1055,19 @@ void RenderPass::generateCommandsImpl(uint32_t,
         cmdDepth.key |= makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
         cmdDepth.key |= makeField(distanceBits, DISTANCE_BITS_MASK, DISTANCE_BITS_SHIFT);
         cmdDepth.primitive.perRenderableUniforms = soaUbh[i];
-        cmdDepth.primitive.perRenderableBones = soaBonesUbh[i];
+        cmdDepth.primitive.bonesSlot = soaBonesSlot[i];
+        cmdDepth.primitive.morphTargets = soaMorphTargets[i];
+        cmdDepth.primitive.renderable = soaInstance[i];
         cmdDepth.primitive.materialVariant.setSkinning(soaVisibility[i].skinning);
+        cmdDepth.primitive.materialVariant.setMorphing(soaVisibility[i].morphing);
 
         const bool shadowCaster = soaVisibility[i].castShadows & hasShadowing;
         const bool writeDepthForShadows = shadowPass & shadowCaster;
+        // the casters outside of this pass' shadow map (e.g. cascade) are skipped, and so are
+        // the static or dynamic ones when the static casters are cached
+        const bool dynamicCaster = soaVisibility[i].dynamicShadowCaster;
+        const bool inShadowMap = (!visibleMask | bool(soaVisibleMask[i] & visibleMask))
+                & !(staticCastersOnly & dynamicCaster) & !(dynamicCastersOnly & !dynamicCaster);
 
         const Slice<FRenderPrimitive>& primitives = soaPrimitives[i];
 
@@ -342,14 +1076,44 @@ void RenderPass::generateCommandsImpl(uint32_t,
          * When modifying this code, always ensure it stays efficient.
          */
         for (auto const& primitive : primitives) {
-            FMaterialInstance const* const mi = primitive.getMaterialInstance();
+            // the instances with the same parameters are drawn as one, see getBatchInstance()
+            FMaterialInstance const* const mi =
+                    primitive.getMaterialInstance()->getBatchInstance();
+            // the empty / no-op primitives and the ones that are not resident are not drawn
+            const bool skipped = (primitive.getPrimitiveType() == PrimitiveType::NONE) |
+                    !primitive.isResident();
             if (colorPass) {
                 cmdColor.primitive.primitiveHandle = primitive.getHwHandle();
                 cmdColor.primitive.materialVariant = materialVariant;
-                RenderPass::setupColorCommand(cmdColor, depthPass, mi);
+                RenderPass::setupColorCommand(cmdColor, depthPass, stateSorting, mi);
+                cmdColor.primitive.rasterState.depthFunc = reverseDepthFunc(
+                        cmdColor.primitive.rasterState.depthFunc, reversedZ);
 
                 const bool blendPass = Pass(cmdColor.key & PASS_MASK) == Pass::BLENDED;
-                if (blendPass) {
+                if (blendPass && accumulateTransparency &&
+                        mi->getMaterial()->getBlendingMode() == BlendingMode::TRANSPARENT) {
+                    // accumulated transparency: the order doesn't matter, so these commands
+                    // are sorted by material like the opaque ones, and drawn once.
+                    cmdColor.key &= PRIORITY_MASK;
+                    cmdColor.key |= uint64_t(Pass::ACCUMULATED);
+                    cmdColor.key |= stateSorting ? mi->getStateSortingKey() : mi->getSortingKey();
+                    cmdColor.key |= makeField(cmdColor.primitive.materialVariant.key,
+                            MATERIAL_VARIANT_KEY_MASK, MATERIAL_VARIANT_KEY_SHIFT);
+
+                    // the weighted colors are summed, and the alpha is the product of the
+                    // (1 - alpha) of all the surfaces, i.e. the background's visibility
+                    Driver::RasterState& rs = cmdColor.primitive.rasterState;
+                    rs.blendEquationRGB = rs.blendEquationAlpha = BlendEquation::ADD;
+                    rs.blendFunctionSrcRGB = rs.blendFunctionDstRGB = BlendFunction::ONE;
+                    rs.blendFunctionSrcAlpha = BlendFunction::ZERO;
+                    rs.blendFunctionDstAlpha = BlendFunction::ONE_MINUS_SRC_ALPHA;
+                    rs.depthWrite = false;
+                    rs.culling = (mi->getMaterial()->getTransparencyMode() ==
+                            TransparencyMode::TWO_PASSES_TWO_SIDES) ? CullingMode::NONE : rs.culling;
+
+                    curr->key = uint64_t(Pass::SENTINEL);
+                    ++curr;
+                } else if (blendPass) {
                     // TODO: at least for transparent objects, AABB should be per primitive
                     // blend pass:
                     // this will sort back-to-front for blended, and honor explicit ordering
@@ -384,7 +1148,7 @@ void RenderPass::generateCommandsImpl(uint32_t,
                     key |= makeField(1, BLEND_TWO_PASS_MASK, BLEND_TWO_PASS_SHIFT);
 
                     // handle the case where this primitive is empty / no-op
-                    key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
+                    key |= select(skipped);
 
                     // correct for TransparencyMode::DEFAULT -- i.e. cancel the command
                     key |= select(mode == TransparencyMode::DEFAULT);
@@ -403,7 +1167,8 @@ void RenderPass::generateCommandsImpl(uint32_t,
                     cmdColor.primitive.rasterState.colorWrite &= ~select(mode == TransparencyMode::TWO_PASSES_ONE_SIDE);
                     cmdColor.primitive.rasterState.depthFunc =
                             (mode == TransparencyMode::TWO_PASSES_ONE_SIDE) ?
-                            SamplerCompareFunc::LE : cmdColor.primitive.rasterState.depthFunc;
+                            reverseDepthFunc(SamplerCompareFunc::LE, reversedZ) :
+                            cmdColor.primitive.rasterState.depthFunc;
                 } else {
                     // color pass, opaque objects...
                     if (!depthPass) {
@@ -422,7 +1187,7 @@ void RenderPass::generateCommandsImpl(uint32_t,
 
                 *curr = cmdColor;
                 // handle the case where this primitive is empty / no-op
-                curr->key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
+                curr->key |= select(skipped);
                 ++curr;
             }
 
@@ -431,7 +1196,15 @@ void RenderPass::generateCommandsImpl(uint32_t,
 
                 // unconditionally write the command
                 cmdDepth.primitive.primitiveHandle = primitive.getHwHandle();
-                cmdDepth.primitive.mi = mi;
+
+                // Most materials share the default material's depth variants, their commands
+                // then all use the default material's instance, so that the material's uniforms
+                // and samplers aren't bound for each of them. The cost of the depth and shadow
+                // passes then depends on the number of primitives, not on the materials.
+                // (the scissor is set by the material instance, so it must be honored)
+                FMaterialInstance const* const sharedMi =
+                        mi->getMaterial()->getSharedDepthInstance();
+                cmdDepth.primitive.mi = (sharedMi && !mi->hasScissor()) ? sharedMi : mi;
                 cmdDepth.primitive.rasterState.culling = rs.culling;
                 *curr = cmdDepth;
 
@@ -444,10 +1217,10 @@ void RenderPass::generateCommandsImpl(uint32_t,
                 bool issueDepth =
                         (rs.depthWrite & !(colorPass & (rs.alphaToCoverage | rs.hasBlending())))
                         | writeDepthForShadows;
-                curr->key |= select(!issueDepth);
+                curr->key |= select(!(issueDepth & inShadowMap));
 
                 // handle the case where this primitive is empty / no-op
-                curr->key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
+                curr->key |= select(skipped);
                 ++curr;
             }
         }
@@ -472,43 +1245,46 @@ void RenderPass::updateSummedPrimitiveCounts(
 // inlining and devirtualization.
 // ------------------------------------------------------------------------------------------------
 
-FRenderer::ColorPass::ColorPass(const char* name,
-        JobSystem& js, JobSystem::Job* jobFroxelize,FView* view, Handle<HwRenderTarget> const rth)
-        : RenderPass(name), js(js), jobFroxelize(jobFroxelize), view(view), rth(rth) {
+FRenderer::ColorPass::ColorPass(const char* name, FEngine& engine,
+        JobSystem& js, FView* view, Handle<HwRenderTarget> const rth,
+        RenderPassParams const& discard, AccumulationTarget const* accumulation, bool reversedZ)
+        : RenderPass(name), engine(engine), js(js), view(view), rth(rth),
+          accumulation(accumulation),
+          discardStart(discard.discardStart), discardEnd(discard.discardEnd),
+          reversedZ(reversedZ) {
 }
 
 void FRenderer::ColorPass::beginRenderPass(
         driver::DriverApi& driver, Viewport const& viewport, const CameraInfo& camera) noexcept {
-    // wait for froxelization to finish
+    // wait for froxelization to finish, it started in FView::prepare()
     // (this could even be a special command between the depth and color passes)
-    js.wait(jobFroxelize);
-    view->commitFroxels(driver);
+    view->commitFroxels(js, driver);
 
-    // We won't need the depth or stencil buffers after this pass.
+    // What can be discarded before and after this pass is decided by the FrameGraph
+    // the depth buffer is needed by the accumulation pass, which then ends this pass' work
     RenderPassParams params = {};
-    params.discardEnd = TargetBufferFlags::DEPTH_AND_STENCIL;
+    params.discardStart = discardStart;
+    params.discardEnd = hasAccumulatedCommands() ? TargetBufferFlags::NONE : discardEnd;
     params.left = viewport.left;
     params.bottom = viewport.bottom;
     params.width = viewport.width;
     params.height = viewport.height;
-    params.clearColor = view->getClearColor();
-    params.clearDepth = 1.0;
+    // the debug views draw their values in black
+    params.clearColor = getDebugView() ? float4(0.0f) : view->getClearColor();
+    params.clearDepth = reversedZ ? 0.0 : 1.0;    // the far plane
 
     if (view->hasPostProcessPass()) {
         // When using a post-process pass, composition of Views is done during the post-process
         // pass, which means it's NOT done here. For this reason, we need to clear the depth/stencil
         // buffers unconditionally. The color buffer must be cleared to what the user asked for,
         // since it's akin to a drawing command.
-        // Also, all buffers can be invalidated before rendering.
         if (view->getClearTargetColor()) {
             params.clear = TargetBufferFlags::ALL;
         } else {
             params.clear = TargetBufferFlags::DEPTH_AND_STENCIL;
         }
-        params.discardStart = TargetBufferFlags::ALL;
         driver.beginRenderPass(rth, params);
     } else {
-        params.discardStart = view->getDiscardedTargetBuffers();
         if (view->getClearTargetColor()) {
             params.clear |= TargetBufferFlags::COLOR;
         }
@@ -536,33 +1312,75 @@ void FRenderer::ColorPass::endRenderPass(DriverApi& driver, Viewport const& view
     }
 }
 
-void FRenderer::ColorPass::renderColorPass(FEngine& engine, JobSystem& js,
-        Handle<HwRenderTarget> const rth, FView* view, Viewport const& scaledViewport,
-        GrowingSlice<Command>& commands) noexcept {
+void FRenderer::ColorPass::beginAccumulationPass(
+        DriverApi& driver, Viewport const& viewport) noexcept {
+    // the accumulated surfaces are tested against the depth buffer of the color pass
+    driver.blit(TargetBufferFlags::DEPTH,
+            accumulation->target, viewport.left, viewport.bottom, viewport.width, viewport.height,
+            rth, viewport.left, viewport.bottom, viewport.width, viewport.height);
+
+    // no color accumulated and nothing in front of the background, i.e. a revealage of 1
+    RenderPassParams params = {};
+    params.clear = TargetBufferFlags::COLOR;
+    params.clearColor = float4{ 0.0f, 0.0f, 0.0f, 1.0f };
+    params.discardStart = TargetBufferFlags(TargetBufferFlags::COLOR | TargetBufferFlags::STENCIL);
+    params.discardEnd = TargetBufferFlags::DEPTH_AND_STENCIL;
+    params.left = viewport.left;
+    params.bottom = viewport.bottom;
+    params.width = viewport.width;
+    params.height = viewport.height;
+    driver.beginRenderPass(accumulation->target, params);
+}
+
+void FRenderer::ColorPass::endAccumulationPass(
+        DriverApi& driver, Viewport const& viewport) noexcept {
+    driver.endRenderPass();
+
+    // the accumulated surfaces are composited over the color buffer, which ends the color pass
+    RenderPassParams params = {};
+    params.discardStart = TargetBufferFlags::DEPTH_AND_STENCIL;
+    params.discardEnd = discardEnd;
+    params.left = viewport.left;
+    params.bottom = viewport.bottom;
+    params.width = viewport.width;
+    params.height = viewport.height;
+    engine.getPostProcessManager().resolveAccumulation(rth, params,
+            accumulation->color, accumulation->weights);
+}
 
-    // start the froxelization immediately, it has no dependencies
-    JobSystem::Job* jobFroxelize = js.createJob(nullptr,
-            [&engine, view](JobSystem&, JobSystem::Job*) { view->froxelize(engine); });
-    js.run(jobFroxelize);
+void FRenderer::ColorPass::renderColorPass(FEngine& engine, JobSystem& js,
+        Handle<HwRenderTarget> const rth, RenderPassParams const& discard,
+        FView* view, Viewport const& scaledViewport,
+        AccumulationTarget const* accumulation,
+        GrowingSlice<Command>& commands, ArenaScope& arena) noexcept {
 
     CameraInfo const& cameraInfo = view->getCameraInfo();
-    auto& soa = view->getScene()->getRenderableData();
     auto vr = view->getVisibleRenderables();
 
-    // populate the RenderPrimitive array with the proper LOD
-    view->updatePrimitivesLod(engine, cameraInfo, soa, vr);
-
     DriverApi& driver = engine.getDriverApi();
-    view->prepareCamera(cameraInfo, scaledViewport);
+    const bool reversedZ = engine.isReversedZ();
+    view->prepareCamera(cameraInfo, scaledViewport, view->getTemporalJitter(), reversedZ);
+    view->setAccumulatedTransparency(accumulation != nullptr);
     view->commitUniforms(driver);
 
     RenderPass::RenderFlags flags = 0;
     if (view->hasShadowing())           flags |= RenderPass::HAS_SHADOWING;
     if (view->hasDirectionalLight())    flags |= RenderPass::HAS_DIRECTIONAL_LIGHT;
     if (view->hasDynamicLighting())     flags |= RenderPass::HAS_DYNAMIC_LIGHTING;
+    if (view->getScene()->hasBatchedUniforms()) flags |= RenderPass::HAS_BATCHED_UNIFORMS;
+    if (reversedZ)                      flags |= RenderPass::HAS_REVERSED_Z;
+    if (engine.debug.renderpass.state_sorting) flags |= RenderPass::STATE_SORTING;
+    if (accumulation)                   flags |= RenderPass::ACCUMULATED_TRANSPARENCY;
+
+    // with AUTO, the strategy of this frame is picked from measures, see FView::updateScale()
+    View::DepthPrepass depthPrepass = view->getDepthPrepass();
+    if (depthPrepass == View::DepthPrepass::AUTO) {
+        depthPrepass = view->getAutoDepthPrepass();
+    }
 
     CommandTypeFlags commandType;
-    switch (view->getDepthPrepass()) {
+    switch (depthPrepass) {
+        case View::DepthPrepass::AUTO:  // not measured
         case View::DepthPrepass::DEFAULT:
             // TODO: better default strategy (can even change on a per-frame basis)
 #ifdef ANDROID
@@ -579,57 +1397,138 @@ void FRenderer::ColorPass::renderColorPass(FEngine& engine, JobSystem& js,
             break;
     }
 
-    ColorPass colorPass("ColorPass", js, jobFroxelize, view, rth);
+    ColorPass colorPass("ColorPass", engine, js, view, rth, discard, accumulation, reversedZ);
+
+    // the debug views are shown by the post-process pass, see FRenderer::renderJob()
+    FMaterialInstance const* const debugView = view->hasPostProcessPass() ?
+            engine.getDebugViewMaterialInstance() : nullptr;
+    if (UTILS_UNLIKELY(debugView)) {
+        // all the layers are counted, which the depth pre-pass would prevent
+        const bool overdraw = engine.getDebugView() == FEngine::DebugView::OVERDRAW;
+        if (overdraw) {
+            commandType = COLOR;
+        }
+        colorPass.setDebugView(debugView, overdraw);
+    }
+    // null unless the view's renderables are culled on the GPU
+    colorPass.setGpuCuller(view->getGpuCuller());
     driver.pushGroupMarker("Color Pass");
-    colorPass.render(engine, js, soa, vr, commandType, flags, cameraInfo, scaledViewport, commands);
+    colorPass.render(engine, js, *view->getScene(), vr, commandType, flags, cameraInfo, scaledViewport,
+            commands, arena, &view->getColorPassCommandCache());
     driver.popGroupMarker();
 }
 
 // ------------------------------------------------------------------------------------------------
 
 FRenderer::ShadowPass::ShadowPass(const char* name,
-        ShadowMap const& shadowMap) noexcept
-        : RenderPass(name), shadowMap(shadowMap) {
+        ShadowMap const& shadowMap, size_t cascade, bool staticCache) noexcept
+        : RenderPass(name), shadowMap(&shadowMap), shadowAtlas(nullptr), index(cascade),
+          staticCache(staticCache) {
+}
+
+FRenderer::ShadowPass::ShadowPass(const char* name,
+        ShadowAtlas const& shadowAtlas, size_t shadow) noexcept
+        : RenderPass(name), shadowMap(nullptr), shadowAtlas(&shadowAtlas), index(shadow),
+          staticCache(false) {
 }
 
 void FRenderer::ShadowPass::beginRenderPass(driver::DriverApi& driver, Viewport const&, const CameraInfo&) noexcept {
-    shadowMap.beginRenderPass(driver);
+    if (shadowMap) {
+        shadowMap->beginRenderPass(driver, index, staticCache);
+    } else {
+        shadowAtlas->beginRenderPass(driver, index);
+    }
 }
 
 void FRenderer::ShadowPass::renderShadowMap(FEngine& engine, JobSystem& js,
-        FView* view, GrowingSlice<Command>& commands) noexcept {
+        FView* view, GrowingSlice<Command>& commands, ArenaScope& arena) noexcept {
 
     auto& soa = view->getScene()->getRenderableData();
     auto vr = view->getVisibleShadowCasters();
     ShadowMap const& shadowMap = view->getShadowMap();
-    Viewport const& viewport = shadowMap.getViewport();
-    FCamera const& camera = shadowMap.getCamera();
-
-    CameraInfo cameraInfo = {
-            .projection         = mat4f{ camera.getProjectionMatrix() },
-            .cullingProjection  = mat4f{ camera.getCullingProjectionMatrix() },
-            .model              = camera.getModelMatrix(),
-            .view               = camera.getViewMatrix(),
-            .zn                 = camera.getNear(),
-            .zf                 = camera.getCullingFar(),
-    };
-
-    // populate the RenderPrimitive array with the proper LOD
-    view->updatePrimitivesLod(engine, cameraInfo, soa, vr);
-
+    ShadowAtlas const& shadowAtlas = view->getShadowAtlas();
     driver::DriverApi& driver = engine.getDriverApi();
-    view->prepareCamera(cameraInfo, viewport);
-    view->commitUniforms(driver);
 
     RenderPass::RenderFlags flags = 0;
     if (view->hasShadowing())           flags |= RenderPass::HAS_SHADOWING;
     if (view->hasDirectionalLight())    flags |= RenderPass::HAS_DIRECTIONAL_LIGHT;
     if (view->hasDynamicLighting())     flags |= RenderPass::HAS_DYNAMIC_LIGHTING;
+    if (view->getScene()->hasBatchedUniforms()) flags |= RenderPass::HAS_BATCHED_UNIFORMS;
+
+    auto render = [&](ShadowPass& shadowPass, FCamera const& camera, Viewport const& viewport,
+            RenderPass::RenderFlags passFlags) {
+        if (!commands.empty()) {
+            // the previous shadow map can still be recorded from the command buffer, wait
+            // before reusing it
+            engine.waitForPendingCommands();
+            commands.clear();
+        }
 
-    ShadowPass shadowPass("ShadowPass", shadowMap);
-    driver.pushGroupMarker("Shadow map Pass");
-    shadowPass.render(engine, js, soa, vr, CommandTypeFlags::SHADOW, flags, cameraInfo, viewport, commands);
-    driver.popGroupMarker();
+        CameraInfo cameraInfo = {
+                .projection         = mat4f{ camera.getProjectionMatrix() },
+                .cullingProjection  = mat4f{ camera.getCullingProjectionMatrix() },
+                .model              = camera.getModelMatrix(),
+                .view               = camera.getViewMatrix(),
+                .zn                 = camera.getNear(),
+                .zf                 = camera.getCullingFar(),
+        };
+
+        view->prepareCamera(cameraInfo, viewport);
+        view->commitUniforms(driver);
+
+        // Only the passes rendering all the visible shadow casters can cache their commands,
+        // the cache can't tell when a renderable moves to another shadow map.
+        driver.pushGroupMarker("Shadow map Pass");
+        shadowPass.render(engine, js, *view->getScene(), vr, CommandTypeFlags::SHADOW, flags | passFlags,
+                cameraInfo, viewport, commands, arena,
+                passFlags ? nullptr : &view->getShadowPassCommandCache());
+        driver.popGroupMarker();
+    };
+
+    // With several cascades, each one renders the casters in its own frustum (they're all in
+    // the range of visible shadow casters), and so do the spot lights.
+    if (view->hasDirectionalShadows()) {
+        const size_t cascadeCount = shadowMap.getCascadeCount();
+        const bool filter = cascadeCount > 1 || shadowAtlas.getShadowCount() > 0;
+        for (size_t c = 0; c < cascadeCount; c++) {
+            if (!shadowMap.isCascadeUpdated(c)) {
+                continue;
+            }
+            const RenderPass::RenderFlags cascadeFlags = filter ? RenderPass::RenderFlags(
+                    (1u << (FView::VISIBLE_SHADOW_CASCADE_BIT + c)) << RenderPass::VISIBLE_MASK_SHIFT)
+                    : RenderPass::RenderFlags(0);
+            FCamera const& camera = shadowMap.getCamera(c);
+            Viewport const& viewport = shadowMap.getViewport(c);
+            if (shadowMap.hasStaticCache()) {
+                // the static casters are only rendered when they changed, the dynamic ones are
+                // rendered every frame on top of a copy of them
+                if (shadowMap.isStaticCacheUpdated(c)) {
+                    ShadowPass staticPass("ShadowPass", shadowMap, c, true);
+                    render(staticPass, camera, viewport,
+                            cascadeFlags | RenderPass::STATIC_CASTERS_ONLY);
+                }
+                shadowMap.copyStaticCache(driver, c);
+                ShadowPass shadowPass("ShadowPass", shadowMap, c);
+                render(shadowPass, camera, viewport,
+                        cascadeFlags | RenderPass::DYNAMIC_CASTERS_ONLY);
+            } else {
+                ShadowPass shadowPass("ShadowPass", shadowMap, c);
+                render(shadowPass, camera, viewport, cascadeFlags);
+            }
+        }
+    }
+
+    // The spot lights' shadow maps are only rendered when they changed, their casters are
+    // culled right before, see prepareShadowing()
+    for (size_t i = 0, c = shadowAtlas.getShadowCount(); i < c; i++) {
+        if (shadowAtlas.isShadowUpdated(i)) {
+            FCamera const& camera = shadowAtlas.getCamera(i);
+            FView::prepareVisibleSpotShadowCasters(soa, vr, camera.getFrustum());
+            ShadowPass shadowPass("ShadowPass", shadowAtlas, i);
+            render(shadowPass, camera, shadowAtlas.getViewport(i), RenderPass::RenderFlags(
+                    (1u << FView::VISIBLE_SPOT_SHADOW_BIT) << RenderPass::VISIBLE_MASK_SHIFT));
+        }
+    }
 }
 
 void FRenderer::ShadowPass::endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept {
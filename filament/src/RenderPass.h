@@ -19,6 +19,7 @@
 
 #include <filament/Viewport.h>
 
+#include "details/Allocators.h"
 #include "details/Camera.h"
 #include "details/Material.h"
 #include "details/Scene.h"
@@ -30,6 +31,8 @@
 #include <utils/compiler.h>
 #include <utils/Slice.h>
 
+#include <vector>
+
 namespace utils {
 class JobSystem;
 }
@@ -37,6 +40,8 @@ class JobSystem;
 namespace filament {
 namespace details {
 
+class GpuCuller;
+
 class RenderPass {
 public:
     static constexpr uint64_t DISTANCE_BITS_MASK            = 0xFFFFFFFFllu;
@@ -80,6 +85,7 @@ public:
         DEPTH    = 0llu << PASS_SHIFT,
         COLOR    = 1llu << PASS_SHIFT,
         BLENDED  = 2llu << PASS_SHIFT,
+        ACCUMULATED = 3llu << PASS_SHIFT,   // see ACCUMULATED_TRANSPARENCY
         SENTINEL = 0xffffffffffffffffllu
     };
 
@@ -131,6 +137,14 @@ public:
     // | correctness                                                          |
     //
     //
+    // ACCUMULATED command (order-independent transparency)
+    // |    8   | 3 | 3 | 2|       16       |               32               |
+    // +--------+---+---+--+----------------+--------------------------------+
+    // |00000011|000|ppp|00|0000000000000000|          material-id           |
+    // +--------+---+---+--+----------------+--------------------------------+
+    // | correctness    |        optimizations (truncation allowed)          |
+    //
+    //
     // SENTINEL command
     // |                                   64                                  |
     // +--------.--------.--------.--------.--------.--------.--------.--------+
@@ -155,6 +169,21 @@ public:
         return (key << MATERIAL_SHIFT) & MATERIAL_MASK;
     }
 
+    // With STATE_SORTING, the instance field is split so that the instances using the same
+    // textures are drawn together, because on GL binding textures costs more than binding
+    // uniform buffers (programs, the material and variant bits, stay the most significant):
+    //
+    // |    11     |  5  |    8    |    8     |
+    // +-----------+-----+---------+----------+
+    // | material  | var | samplers| instance |
+    // +-----------+-----+---------+----------+
+    //
+    static CommandKey makeMaterialStateSortingKey(uint32_t materialId, uint32_t samplersHash,
+            uint32_t instanceId) noexcept {
+        const uint32_t instance = ((samplersHash & 0xFFu) << 8u) | (instanceId & 0xFFu);
+        return makeMaterialSortingKey(materialId, instance);
+    }
+
     template<typename T>
     static CommandKey makeField(T value, uint64_t mask, int shift) noexcept {
         assert(!((uint64_t(value) << shift) & ~mask));
@@ -172,19 +201,31 @@ public:
         return boolish ? -1llu : 0llu;
     }
 
-    struct PrimitiveInfo { // 28 bytes
+    // with reverse-Z, L and G (and LE and GE) are swapped, the other functions are unchanged.
+    // This relies on the values of SamplerCompareFunc (LE=0, GE=1, L=2, G=3).
+    static driver::SamplerCompareFunc reverseDepthFunc(
+            driver::SamplerCompareFunc func, bool reversedZ) noexcept {
+        const bool swap = reversedZ & (func < driver::SamplerCompareFunc::E);
+        return driver::SamplerCompareFunc(uint8_t(func) ^ uint8_t(swap));
+    }
+
+    struct PrimitiveInfo { // 40 bytes
         FMaterialInstance const* mi = nullptr;              // 8 bytes (4)
         Handle<HwRenderPrimitive> primitiveHandle;          // 4 bytes
         Handle<HwUniformBuffer> perRenderableUniforms;      // 4 bytes
-        Handle<HwUniformBuffer> perRenderableBones;         // 4 bytes
+        uint32_t bonesSlot = 0;                             // 4 bytes, 1 + slot in the bone palette, 0 if not skinned
+        Handle<HwSamplerBuffer> morphTargets;               // 4 bytes, only valid if morphing
         Driver::RasterState rasterState;                    // 4 bytes
         Variant materialVariant;                            // 1 byte
-        uint8_t reserved[3] = { };                          // 3 bytes (that helps the compiler)
+        uint8_t batchedUniforms = 0;                        // 1 byte, see FScene::updateUBOs()
+        uint16_t instancedDraw = 0;                         // 2 bytes, see prepareInstancedDraws()
+        FRenderableManager::Instance renderable;            // 4 bytes
+        uint32_t indirectDraw = 0;                          // 4 bytes, 1 + slot in the GpuCuller's buffers, 0 if drawn directly
     };
 
-    struct alignas(8) Command {     // 32 bytes
+    struct alignas(8) Command {     // 48 bytes
         CommandKey key = 0;         //  8 bytes
-        PrimitiveInfo primitive;    // 24 bytes
+        PrimitiveInfo primitive;    // 40 bytes
         bool operator < (Command const& rhs) const noexcept { return key < rhs.key; }
         // placement new declared as "throw" to avoid the compiler's null-check
         inline void* operator new (std::size_t size, void* ptr) {
@@ -196,10 +237,72 @@ public:
             "Command isn't trivially destructible");
 
 
-    using RenderFlags = uint8_t;
+    using RenderFlags = uint32_t;
     static constexpr RenderFlags HAS_SHADOWING          = 0x01;
     static constexpr RenderFlags HAS_DIRECTIONAL_LIGHT  = 0x02;
     static constexpr RenderFlags HAS_DYNAMIC_LIGHTING   = 0x04;
+    static constexpr RenderFlags HAS_BATCHED_UNIFORMS   = 0x08;
+    static constexpr RenderFlags HAS_REVERSED_Z         = 0x10;   // see FEngine::isReversedZ()
+    // the shadow pass only renders the casters (not) flagged as dynamic shadow casters
+    static constexpr RenderFlags STATIC_CASTERS_ONLY    = 0x20;
+    static constexpr RenderFlags DYNAMIC_CASTERS_ONLY   = 0x40;
+    // the color commands are sorted by state change cost, see makeMaterialStateSortingKey()
+    static constexpr RenderFlags STATE_SORTING          = 0x80;
+    // the transparent surfaces (BlendingMode::TRANSPARENT) are not sorted by distance, they're
+    // accumulated in a separate pass instead, see beginAccumulationPass()
+    static constexpr RenderFlags ACCUMULATED_TRANSPARENCY = 0x100;
+    // the shadow pass only renders the casters with one of the VISIBLE_MASK bits stored in the
+    // top byte (e.g. the casters of a shadow cascade), or all of them if it's 0
+    static constexpr uint8_t     VISIBLE_MASK_SHIFT     = 24;
+
+
+    /*
+     * The sorted commands of a pass, kept from one frame to the next (typically one per View and
+     * pass). As long as the camera and the pass settings don't change, only the commands of the
+     * renderables that changed, or became visible, are generated again. They're merged with the
+     * commands kept from the previous frame, which makes static scenes much cheaper.
+     */
+    class CommandCache {
+    public:
+        // drops all the cached commands
+        void clear() noexcept;
+
+    private:
+        friend class RenderPass;
+
+        struct Entry {
+            // the data the commands of this renderable were generated from
+            uint32_t renderableVersion = 0;
+            uint32_t transformVersion = 0;
+            // the primitives are compared by level of detail, because they can be copies, see
+            // Scene::setSnapshotCallback()
+            uint8_t level = 0;
+            uint32_t primitiveCount = 0;
+            Handle<HwUniformBuffer> ubh;
+            // last frame this renderable was visible
+            uint32_t stamp = 0;
+            // whether this renderable's commands are in mCommands
+            bool cached = false;
+        };
+
+        // records the parameters of this frame, returns true if they're the same as the
+        // previous frame's, in which case the cache can be used. Otherwise it's cleared.
+        bool update(FScene::RenderableSoa const* soa, uint32_t commandTypeFlags,
+                RenderFlags renderFlags, math::float3 cameraPosition,
+                math::float3 cameraForward, uint32_t residencyVersion,
+                uint32_t materialSharingVersion) noexcept;
+
+        FScene::RenderableSoa const* mSoa = nullptr;
+        uint32_t mCommandTypeFlags = 0;
+        RenderFlags mRenderFlags = 0;
+        math::float3 mCameraPosition;
+        math::float3 mCameraForward;
+        uint32_t mResidencyVersion = 0;
+        uint32_t mMaterialSharingVersion = 0;
+        uint32_t mStamp = 0;
+        std::vector<Command> mCommands;     // sorted, without SENTINELs
+        std::vector<Entry> mEntries;        // indexed by renderable instance
+    };
 
 
     RenderPass(const char* name) noexcept : mName(name) { }
@@ -207,13 +310,53 @@ public:
     virtual ~RenderPass() noexcept;
 
     // appends rendering commands for the given view
+    // 'cache' is optional, if provided it's used to avoid generating the same commands again
     void render(
             FEngine& engine, utils::JobSystem& js,
-            FScene::RenderableSoa const& soa, utils::Range<uint32_t> visibleRenderables,
+            FScene const& scene, utils::Range<uint32_t> visibleRenderables,
             uint32_t commandTypeFlags, RenderFlags renderFlags,
             const CameraInfo& camera, Viewport const& viewport,
+            utils::GrowingSlice<Command>& commands, ArenaScope& arena,
+            CommandCache* cache) noexcept;
+
+    // Sorts commands by key with a parallel LSD radix sort, the order of commands with the
+    // same key is preserved. Passes are only done for the bytes of the keys that are not the
+    // same for all commands. The scratch memory comes from 'arena' and is released on return.
+    static void sortCommands(utils::JobSystem& js, ArenaScope& arena,
+            utils::Slice<Command> commands) noexcept;
+
+    // Generates the commands of the visible renderables and sorts them, which is what render()
+    // does when the commands can't come from the cache. 'commands' grows by the commands
+    // needed, which end with a SENTINEL.
+    static void generateSortedCommands(utils::JobSystem& js, ArenaScope& arena,
+            FScene::RenderableSoa& soa, utils::Range<uint32_t> visibleRenderables,
+            uint32_t commandTypeFlags, RenderFlags renderFlags,
+            math::float3 cameraPosition, math::float3 cameraForwardVector,
             utils::GrowingSlice<Command>& commands) noexcept;
 
+    // The color commands of the passes rendered next are drawn with 'mi' instead of their
+    // material, additively if 'additive' is true (see FEngine::DebugView). nullptr disables it.
+    void setDebugView(FMaterialInstance const* mi, bool additive) noexcept {
+        mDebugView = mi;
+        mDebugViewAdditive = additive;
+    }
+
+    // The color commands of the passes rendered next are culled by 'culler' and drawn with
+    // drawIndirect(), see GpuCuller. nullptr disables it.
+    void setGpuCuller(GpuCuller* culler) noexcept { mGpuCuller = culler; }
+
+    // A run of commands drawn with a single instanced draw call
+    struct InstancedDraw {
+        Handle<HwUniformBuffer> uniforms;   // per-instance uniforms of instances 1 to count-1
+        uint32_t count;
+    };
+
+protected:
+    FMaterialInstance const* getDebugView() const noexcept { return mDebugView; }
+
+    // whether the pass being rendered has ACCUMULATED commands, valid from beginRenderPass()
+    bool hasAccumulatedCommands() const noexcept { return mHasAccumulatedCommands; }
+
 private:
     // Called just before rendering, make sure all needed asynchronous tasks are finished.
     // Set-up the render-target as needed. At least call driver.beginRenderPass().
@@ -225,6 +368,13 @@ private:
     // but at least call driver.endRenderPass().
     virtual void endRenderPass(driver::DriverApi& driver, Viewport const& viewport) noexcept = 0;
 
+    // Called after endRenderPass() if there are ACCUMULATED commands, around them. Must set-up
+    // the accumulation render-target and composite it when done.
+    virtual void beginAccumulationPass(driver::DriverApi& driver,
+            Viewport const& viewport) noexcept { }
+    virtual void endAccumulationPass(driver::DriverApi& driver,
+            Viewport const& viewport) noexcept { }
+
 private:
     friend class FRenderer;
 
@@ -237,6 +387,38 @@ private:
     static_assert(JOBS_PARALLEL_FOR_COMMANDS_SIZE % utils::CACHELINE_SIZE == 0,
             "Size of Commands jobs must be multiple of a cache-line size");
 
+    // below this count, std::sort() is faster than the radix sort
+    static constexpr uint32_t RADIX_SORT_MIN_COMMANDS_COUNT = 1024;
+    // commands processed per radix sort job
+    static constexpr uint32_t RADIX_SORT_CHUNK_SIZE = 2048;
+    static constexpr uint32_t RADIX_SORT_MAX_CHUNKS = 16;
+    // one bucket per 8-bits digit value, plus one for SENTINEL commands, which always go last
+    static constexpr uint32_t RADIX_SORT_BUCKET_COUNT = 257;
+
+    static inline uint32_t radixDigit(CommandKey key, uint32_t shift) noexcept {
+        return key == uint64_t(Pass::SENTINEL) ?
+               RADIX_SORT_BUCKET_COUNT - 1 : uint32_t(key >> shift) & 0xFFu;
+    }
+
+    // commands recorded per driver commands job
+    static constexpr uint32_t JOBS_PARALLEL_FOR_DRIVER_COMMANDS_COUNT = 512;
+    // driver commands space recorded in parallel between flushes of the command stream
+    static constexpr size_t PARALLEL_DRIVER_COMMANDS_BATCH_SIZE = FEngine::CONFIG_MIN_COMMAND_BUFFERS_SIZE / 2;
+
+    // Generates the commands from 'cache', only the commands of the renderables that changed
+    // are generated. Returns false if the commands must be generated again entirely instead.
+    static bool generateCommandsFromCache(CommandCache& cache, utils::JobSystem& js,
+            ArenaScope& arena, FScene::RenderableSoa const& soa, utils::Range<uint32_t> vr,
+            uint32_t commandTypeFlags, RenderFlags renderFlags,
+            math::float3 cameraPosition, math::float3 cameraForward,
+            utils::GrowingSlice<Command>& commands) noexcept;
+
+    // replaces the content of 'cache' with the (sorted) commands generated for 'vr'
+    static void updateCommandCache(CommandCache& cache,
+            FScene::RenderableSoa const& soa, utils::Range<uint32_t> vr,
+            utils::Slice<Command> const& commands) noexcept;
+
+    // 'commands' is where the commands of range.first are written
     static inline void generateCommands(uint32_t commandTypeFlags, Command* const commands,
             FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, RenderFlags renderFlags,
             math::float3 cameraPosition, math::float3 cameraForward) noexcept;
@@ -246,16 +428,51 @@ private:
             utils::Range<uint32_t> range, RenderFlags renderFlags, math::float3 cameraPosition,
             math::float3 cameraForward) noexcept;
 
-    static void setupColorCommand(Command& cmdDraw, bool hasDepthPass,
+    static void setupColorCommand(Command& cmdDraw, bool hasDepthPass, bool stateSorting,
             FMaterialInstance const* const mi) noexcept;
 
+    // replaces the material of the color commands with the debug view's, the keys are kept
+    static void applyDebugView(utils::Slice<Command> commands,
+            FMaterialInstance const* mi, bool additive) noexcept;
+
+    // Finds the runs of commands that differ only by their renderable and uploads their
+    // per-instance uniforms. The first command of each run is tagged with the index (plus one)
+    // of its InstancedDraw in the returned array. This must be called outside of a render pass.
+    // The uniforms are read from the scene when they're batched, see FScene::updateUBOs().
+    static InstancedDraw const* prepareInstancedDraws(FEngine& engine, ArenaScope& arena,
+            utils::Slice<Command> commands, FScene const* batchedUniforms) noexcept;
+
+    // returns the number of commands starting at 'first' that can be drawn as instances of it
+    static inline uint32_t getInstanceCount(Command const* first, Command const* last) noexcept;
+
+    // Records the driver commands for 'commands' in 'driver'. When there are enough commands,
+    // they're split in chunks that are recorded in parallel, each in its own slice of the
+    // command stream. If the engine defers commands, the recording can outlive this call, in
+    // which case 'arena' and 'commands' must remain valid until the engine's pending commands
+    // are waited for.
+    static void recordDriverCommands(FEngine& engine, utils::JobSystem& js, ArenaScope& arena,
+            FEngine::DriverApi& driver, utils::Slice<Command> const& commands,
+            InstancedDraw const* instancedDraws, Handle<HwStorageBuffer> indirectDraws) noexcept;
+
+    static void recordDriverCommandsParallel(FEngine& engine, utils::JobSystem& js,
+            ArenaScope& scratch, FEngine::DriverApi& driver, Command const* first,
+            Command const* last, InstancedDraw const* instancedDraws,
+            Handle<HwStorageBuffer> indirectDraws) noexcept;
+
+    // records the commands in [first, last) serially
     static void recordDriverCommands(FEngine::DriverApi& driver,
-            utils::Slice<Command> const& commands) noexcept;
+            Handle<HwUniformBuffer> bonePalette, InstancedDraw const* instancedDraws,
+            Handle<HwStorageBuffer> indirectDraws,
+            Command const* first, Command const* last) noexcept;
 
     static void updateSummedPrimitiveCounts(
             FScene::RenderableSoa& renderableData, utils::Range<uint32_t> vr) noexcept;
 
     const char* const mName;
+    FMaterialInstance const* mDebugView = nullptr;
+    bool mDebugViewAdditive = false;
+    GpuCuller* mGpuCuller = nullptr;
+    bool mHasAccumulatedCommands = false;
 };
 
 } // namespace details
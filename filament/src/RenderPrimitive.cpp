@@ -24,12 +24,11 @@
 namespace filament {
 namespace details {
 
-void FRenderPrimitive::init(driver::DriverApi& driver,
+void FRenderPrimitive::init(FEngine& engine,
         const RenderableManager::Builder::Entry& entry) noexcept {
 
     assert(entry.materialInstance);
 
-    mHandle = driver.createRenderPrimitive();
     mMaterialInstance = upcast(entry.materialInstance);
     mBlendOrder = entry.blendOrder;
 
@@ -37,49 +36,53 @@ void FRenderPrimitive::init(driver::DriverApi& driver,
         FVertexBuffer* vertexBuffer = upcast(entry.vertices);
         FIndexBuffer* indexBuffer = upcast(entry.indices);
 
-        AttributeBitset enabledAttributes = vertexBuffer->getDeclaredAttributes();
-
-        auto const& ebh = vertexBuffer->getHwHandle();
-        auto const& ibh = indexBuffer->getHwHandle();
-
-        driver.setRenderPrimitiveBuffer(mHandle, ebh, ibh, (uint32_t)enabledAttributes.getValue());
-        driver.setRenderPrimitiveRange(mHandle, entry.type,
-                (uint32_t)entry.offset, (uint32_t)entry.minIndex, (uint32_t)entry.maxIndex,
-                (uint32_t)entry.count);
-
+        mVertexBuffer = vertexBuffer->getHwHandle();
+        mIndexBuffer = indexBuffer->getHwHandle();
         mPrimitiveType = entry.type;
-        mEnabledAttributes = enabledAttributes;
+        mEnabledAttributes = vertexBuffer->getDeclaredAttributes();
+        mStreamingVertices = vertexBuffer->isStreaming() ? vertexBuffer : nullptr;
+        mMinIndex = uint32_t(entry.minIndex);
+        mMaxIndex = uint32_t(entry.maxIndex);
+        mIndexOffset = uint32_t(entry.offset);
+        mIndexCount = uint32_t(entry.count);
     }
+
+    mHandle = engine.acquireRenderPrimitive(getKey());
 }
 
 void FRenderPrimitive::terminate(FEngine& engine) {
-    FEngine::DriverApi& driver = engine.getDriverApi();
-    driver.destroyRenderPrimitive(mHandle);
+    engine.releaseRenderPrimitive(getKey());
 }
 
 void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType type,
         FVertexBuffer* vertices, FIndexBuffer* indices, size_t offset,
         size_t minIndex, size_t maxIndex, size_t count) noexcept {
-    AttributeBitset enabledAttributes = vertices->getDeclaredAttributes();
-    auto const& ebh = vertices->getHwHandle();
-    auto const& ibh = indices->getHwHandle();
-
-    FEngine::DriverApi& driver = engine.getDriverApi();
-
-    driver.setRenderPrimitiveBuffer(mHandle, ebh, ibh, (uint32_t)enabledAttributes.getValue());
-    driver.setRenderPrimitiveRange(mHandle, type,
-            (uint32_t)offset, (uint32_t)minIndex, (uint32_t)maxIndex, (uint32_t)count);
+    engine.releaseRenderPrimitive(getKey());
 
+    mVertexBuffer = vertices->getHwHandle();
+    mIndexBuffer = indices->getHwHandle();
     mPrimitiveType = type;
-    mEnabledAttributes = enabledAttributes;
+    mEnabledAttributes = vertices->getDeclaredAttributes();
+    mStreamingVertices = vertices->isStreaming() ? vertices : nullptr;
+    mMinIndex = uint32_t(minIndex);
+    mMaxIndex = uint32_t(maxIndex);
+    mIndexOffset = uint32_t(offset);
+    mIndexCount = uint32_t(count);
+
+    mHandle = engine.acquireRenderPrimitive(getKey());
 }
 
 void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType type, size_t offset,
         size_t minIndex, size_t maxIndex, size_t count) noexcept {
-    FEngine::DriverApi& driver = engine.getDriverApi();
-    driver.setRenderPrimitiveRange(mHandle, type,
-            (uint32_t)offset, (uint32_t)minIndex, (uint32_t)maxIndex, (uint32_t)count);
+    engine.releaseRenderPrimitive(getKey());
+
     mPrimitiveType = type;
+    mMinIndex = uint32_t(minIndex);
+    mMaxIndex = uint32_t(maxIndex);
+    mIndexOffset = uint32_t(offset);
+    mIndexCount = uint32_t(count);
+
+    mHandle = engine.acquireRenderPrimitive(getKey());
 }
 
 } // namespace details
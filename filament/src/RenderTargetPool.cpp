@@ -16,6 +16,7 @@
 
 #include "RenderTargetPool.h"
 
+#include "details/DebugRegistry.h"
 #include "details/Engine.h"
 #include "details/Texture.h"
 
@@ -30,6 +31,14 @@ using namespace details;
 void RenderTargetPool::init(FEngine& engine) noexcept {
     mEngine = &engine;
     mPool.reserve(16);
+
+    FDebugRegistry& debugRegistry = engine.getDebugRegistry();
+    debugRegistry.registerProperty("d.rendertargetpool.budget_mb", &mBudgetMB);
+    debugRegistry.registerProperty("d.rendertargetpool.hits", &mStatistics.hits);
+    debugRegistry.registerProperty("d.rendertargetpool.misses", &mStatistics.misses);
+    debugRegistry.registerProperty("d.rendertargetpool.evictions", &mStatistics.evictions);
+    debugRegistry.registerProperty("d.rendertargetpool.size_kb", &mStatistics.sizeKB);
+    debugRegistry.registerProperty("d.rendertargetpool.peak_size_kb", &mStatistics.peakSizeKB);
 }
 
 void RenderTargetPool::terminate(DriverApi& driver) noexcept {
@@ -46,46 +55,64 @@ RenderTargetPool::Target const* RenderTargetPool::get(
     // samples can't be less than 1
     samples = std::max(uint8_t(1), samples);
 
-    // round all allocations to 32x32 pixels, to avoid too many small resize
-    uint32_t target_w = (w + 31u) & ~31u;
-    uint32_t target_h = (h + 31u) & ~31u;
+    // round all allocations to the size class, to avoid too many small resize
+    const bool exactSize = (flags & Target::EXACT_SIZE) != 0;
+    uint32_t target_w = exactSize ? w : (w + POOL_SIZE_CLASS - 1u) & ~(POOL_SIZE_CLASS - 1u);
+    uint32_t target_h = exactSize ? h : (h + POOL_SIZE_CLASS - 1u) & ~(POOL_SIZE_CLASS - 1u);
     Entry entry = { attachments, target_w, target_h, samples, format, flags };
 
     FEngine& engine = *mEngine;
     DriverApi& driver = engine.getDriverApi();
-    
-    // Since we order the cache by width then by height, we can get a cached
-    // entry with a smaller height. Only reuse if both dimensions are higher.
-    auto pos = find(&entry);
-    Entry const* const it = pos != mPool.end() ? *pos : nullptr;
-    if (UTILS_LIKELY(it &&
-                     it->attachments == attachments &&
-                     it->samples == samples &&
-                     it->format == format &&
-                     it->flags == flags &&
-                     it->w >= target_w &&
-                     it->h >= target_h)) {
-        if (2 * it->w * it->h >= 3 * target_w * target_h) {
-            // the surface we found is 1.5x larger than requested
+
+    // Since we order the cache by width then by height, the entries following 'pos' have
+    // the same format and are at least as wide. Only reuse if both dimensions are higher.
+    for (auto pos = find(&entry); pos != mPool.end(); ++pos) {
+        Entry const* const it = *pos;
+        if (it->attachments != attachments ||
+            it->samples != samples ||
+            it->format != format ||
+            it->flags != flags) {
+            break;
+        }
+        if (exactSize && (it->w != target_w || it->h != target_h)) {
+            // the entries are sorted by size, there is no exact match
+            break;
+        }
+        if (2 * it->w >= 3 * target_w) {
+            // the surfaces left are 1.5x larger than requested
             // there is a performance cost, especially on tilers, it's better to not allow
             // too much of a size difference
-            goto not_found;
+            break;
+        }
+        if (it->h >= target_h && 2 * it->w * it->h < 3 * target_w * target_h) {
+            // update last usage age, remove the entry from the pool and return it
+            it->age = mCacheAge;
+            mPool.erase(pos);
+            mStatistics.hits++;
+            return it;
         }
-
-        // update last usage age, remove the entry from the pool and return it
-        (*pos)->age = mCacheAge;
-        mPool.erase(pos);
-        return it;
     }
 
-    not_found:
-
     if (flags & RenderTargetPool::Target::NO_TEXTURE) {
         entry.target = driver.createRenderTarget(
                 entry.attachments, target_w, target_h, samples, format, {}, {}, {});
+    } else if (isDepthOnly(entry.attachments)) {
+        // e.g. shadow maps, which are sampled with depth comparisons
+        entry.texture = driver.createTexture(Driver::SamplerType::SAMPLER_2D, 1,
+                format, samples, target_w, target_h, 1,
+                Driver::TextureUsage::DEPTH_ATTACHMENT);
+
+        entry.target = driver.createRenderTarget(
+                entry.attachments, target_w, target_h, samples, format,
+                {}, { entry.texture }, {});
     } else {
+        // when possible, the samples only exist in the tile memory and the texture receives
+        // the resolved image
+        const uint8_t textureSamples =
+                driver.isMultisampledRenderToTextureSupported() ? uint8_t(1) : samples;
         entry.texture = driver.createTexture(Driver::SamplerType::SAMPLER_2D, 1,
-                format, samples, target_w, target_h, 1, Driver::TextureUsage::COLOR_ATTACHMENT);
+                format, textureSamples, target_w, target_h, 1,
+                Driver::TextureUsage::COLOR_ATTACHMENT);
 
         entry.target = driver.createRenderTarget(
                 entry.attachments, target_w, target_h, samples, format,
@@ -96,6 +123,9 @@ RenderTargetPool::Target const* RenderTargetPool::get(
     entry.age = mCacheAge;
 
     mPoolSize += getSize(&entry);
+    mStatistics.misses++;
+    mStatistics.sizeKB = int(mPoolSize / 1024);
+    mStatistics.peakSizeKB = std::max(mStatistics.peakSizeKB, mStatistics.sizeKB);
 
     // entry not found, create one
     return mEntryArena.make<Entry>(entry);
@@ -142,8 +172,9 @@ void RenderTargetPool::gc() noexcept {
 
     DriverApi& driver = mEngine->getDriverApi();
     auto& cache = mPool;
+    const size_t budget = getMemoryBudget();
     size_t count = cache.size();
-    while (count && (count > POOL_MAX_ENTRY_COUNT || mPoolSize > POOL_MAX_SIZE)) {
+    while (count && (count > POOL_MAX_ENTRY_COUNT || mPoolSize > budget)) {
 
         // find the least recently used entry (linear search here)
         auto pos = std::min_element(cache.begin(), cache.end(),
@@ -160,6 +191,7 @@ void RenderTargetPool::gc() noexcept {
         // lastly, remove entry from cache
         cache.erase(pos);
         count--;
+        mStatistics.evictions++;
     }
 
     if (UTILS_UNLIKELY(mDeepPurgeCountDown-- == 0)) {
@@ -171,6 +203,7 @@ void RenderTargetPool::gc() noexcept {
                     bool remove = entry->age <= age;
                     if (remove) {
                         destroyEntry(driver, entry);
+                        mStatistics.evictions++;
                     }
                     return remove;
                 });
@@ -186,6 +219,7 @@ void RenderTargetPool::destroyEntry(DriverApi& driver, Entry const* entry) noexc
     driver.destroyRenderTarget(entry->target);
     driver.destroyTexture(entry->texture);
     mPoolSize -= getSize(entry);
+    mStatistics.sizeKB = int(mPoolSize / 1024);
     mEntryArena.destroy(entry);
     assert(mPoolSize >= 0);
 }
@@ -196,7 +230,9 @@ size_t RenderTargetPool::getSize(Entry const* entry) noexcept {
         size += FTexture::getFormatSize(entry->format);
     }
 
-    if (entry->attachments & TargetBufferFlags::DEPTH) {
+    if (isDepthOnly(entry->attachments)) {
+        size += FTexture::getFormatSize(entry->format);
+    } else if (entry->attachments & TargetBufferFlags::DEPTH) {
         size += 3;
     }
 
@@ -26,6 +26,8 @@
 
 #include <utils/Allocator.h>
 
+#include <algorithm>
+#include <limits>
 #include <vector>
 
 namespace filament {
@@ -38,10 +40,15 @@ class RenderTargetPool {
     // entries older than this are purged
     static constexpr uint32_t POOL_ENTRY_MAX_AGE = 60 * 60;     // ~1 min
 
-    // e.g. layer sizes
+    // default memory budget, in MiB. e.g. layer sizes
     // 1440 x 2560 is ~ 29 MB for color buffer
     // 1280 x 720  is ~  7 MB for color buffer
-    static constexpr size_t POOL_MAX_SIZE = 128 * 1024 * 1024;
+    static constexpr int POOL_DEFAULT_BUDGET_MB = 128;
+
+    // allocations are rounded up to a multiple of this size, so that small changes of the
+    // requested size (e.g. with dynamic resolution) reuse the same target. Callers render
+    // into a sub-viewport of the target.
+    static constexpr uint32_t POOL_SIZE_CLASS = 64;
 
     // 2 pages is way enough for the entry sturctures (should be about 400)
     static constexpr size_t POOL_ENTRY_ARENA_SIZE = 8192;
@@ -63,8 +70,13 @@ public:
         uint8_t samples = 1;
         uint8_t flags = 0;
         static constexpr uint8_t NO_TEXTURE = 0x1;
+        // the size isn't rounded to the size class and only a target of the exact same size
+        // is reused, e.g. for shadow maps which are sampled whole
+        static constexpr uint8_t EXACT_SIZE = 0x2;
     };
 
+    // Targets with DEPTH but without COLOR attachments get a depth texture, of 'format'.
+
     Target const* get(driver::TargetBufferFlags attachments,
             uint32_t width, uint32_t height, uint8_t samples, TextureFormat format,
             uint8_t flags = 0) const noexcept;
@@ -74,6 +86,27 @@ public:
     // remove older items in the cache. call this once per frame.
     void gc() noexcept;
 
+    // The least recently used targets are destroyed at gc() time while the memory used by
+    // all the targets (including the ones in use) is over this budget.
+    void setMemoryBudget(size_t bytes) noexcept {
+        mBudgetMB = int(std::min(bytes / (1024 * 1024), size_t(std::numeric_limits<int>::max())));
+    }
+
+    size_t getMemoryBudget() const noexcept {
+        return size_t(std::max(mBudgetMB, 0)) * 1024 * 1024;
+    }
+
+    // cumulative statistics, also available as "d.rendertargetpool.*" in the DebugRegistry
+    struct Statistics {
+        int hits = 0;       // get() returned a pooled target
+        int misses = 0;     // get() created a new target
+        int evictions = 0;  // targets destroyed by gc()
+        int sizeKB = 0;     // memory currently used by all the targets
+        int peakSizeKB = 0; // most memory used by all the targets at once
+    };
+
+    Statistics const& getStatistics() const noexcept { return mStatistics; }
+
 private:
     struct Entry : public Target {
         Entry() = default;
@@ -93,6 +126,11 @@ private:
     // we divide by two, so we have plenty of room
     static constexpr size_t POOL_MAX_ENTRY_COUNT = (POOL_ENTRY_ARENA_SIZE / sizeof(Entry)) / 2;
 
+    static bool isDepthOnly(driver::TargetBufferFlags attachments) noexcept {
+        return (attachments & driver::TargetBufferFlags::DEPTH) &&
+               !(attachments & driver::TargetBufferFlags::COLOR);
+    }
+
     static size_t getSize(Entry const* entry) noexcept;
     void destroyEntry(driver::DriverApi& driver, Entry const* entry) noexcept;
     std::vector<Entry const*>::iterator find(Entry const* entry) const noexcept;
@@ -100,6 +138,8 @@ private:
     details::FEngine* mEngine = nullptr;
     mutable std::vector<Entry const*> mPool;
     mutable size_t mPoolSize = 0;
+    mutable Statistics mStatistics;
+    int mBudgetMB = POOL_DEFAULT_BUDGET_MB;
     // at 60 fps, 32 bit gives us 828 days without overflow
     uint32_t mDeepPurgeCountDown = POOL_ENTRY_MAX_AGE;
     uint32_t mCacheAge = POOL_ENTRY_MAX_AGE;
@@ -16,6 +16,8 @@
 
 #include "details/Renderer.h"
 
+#include "FrameCapture.h"
+#include "FrameGraph.h"
 #include "RenderPass.h"
 
 #include "details/Engine.h"
@@ -34,6 +36,10 @@
 
 #include <assert.h>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 using namespace math;
 using namespace utils;
 
@@ -51,6 +57,7 @@ FRenderer::FRenderer(FEngine& engine) :
         mIsRGB8Supported(false),
         mPerRenderPassArena(engine.getPerRenderPassAllocator())
 {
+    mFrameInfoManager.setFrameStats(&mFrameStats);
 }
 
 void FRenderer::init() noexcept {
@@ -64,14 +71,6 @@ void FRenderer::init() noexcept {
 FRenderer::~FRenderer() noexcept {
     // There shouldn't be any resource left when we get here, but if there is, make sure
     // to free what we can (it would probably mean something when wrong).
-#ifndef NDEBUG
-    size_t wm = getCommandsHighWatermark();
-    size_t wmpct = wm / (CONFIG_PER_FRAME_COMMANDS_SIZE / 100);
-    slog.d << "Renderer: Commands High watermark "
-    << wm / 1024 << " KiB (" << wmpct << "%), "
-    << wm / sizeof(Command) << " commands, " << sizeof(Command) << " bytes/command"
-    << io::endl;
-#endif
 }
 
 void FRenderer::terminate(FEngine& engine) {
@@ -79,6 +78,7 @@ void FRenderer::terminate(FEngine& engine) {
     // shut down threads if we created any.
     DriverApi& driver = engine.getDriverApi();
     driver.destroyRenderTarget(mRenderTarget);
+    destroyAccumulationTarget(driver);
 
     // before we can destroy this Renderer's resources, we must make sure
     // that all pending commands have been executed (as they could reference data in this
@@ -87,16 +87,64 @@ void FRenderer::terminate(FEngine& engine) {
     mFrameInfoManager.terminate();
 }
 
+FRenderer::AccumulationTarget const* FRenderer::getAccumulationTarget(DriverApi& driver,
+        uint32_t width, uint32_t height) noexcept {
+    AccumulationTarget& acc = mAccumulationTarget;
+    if (acc.target && width <= acc.width && height <= acc.height) {
+        return &acc;
+    }
+
+    // it only grows, in steps that avoid reallocating it for every small viewport change
+    width = (std::max(width, acc.width) + 63u) & ~63u;
+    height = (std::max(height, acc.height) + 63u) & ~63u;
+    destroyAccumulationTarget(driver);
+
+    acc.color = driver.createTexture(SamplerType::SAMPLER_2D, 1,
+            TextureFormat::RGBA16F, 1, width, height, 1, TextureUsage::COLOR_ATTACHMENT);
+    acc.weights = driver.createTexture(SamplerType::SAMPLER_2D, 1,
+            TextureFormat::R16F, 1, width, height, 1, TextureUsage::COLOR_ATTACHMENT);
+    acc.target = driver.createMultipleRenderTarget(TargetBufferFlags::COLOR_AND_DEPTH,
+            width, height, 1, { acc.color }, { acc.weights }, {});
+    acc.width = width;
+    acc.height = height;
+    return &acc;
+}
+
+void FRenderer::destroyAccumulationTarget(DriverApi& driver) noexcept {
+    AccumulationTarget& acc = mAccumulationTarget;
+    if (acc.target) {
+        driver.destroyRenderTarget(acc.target);
+        driver.destroyTexture(acc.color);
+        driver.destroyTexture(acc.weights);
+    }
+    acc = {};
+}
+
 void FRenderer::render(FView const* view) {
     SYSTRACE_CALL();
 
     assert(mSwapChain);
 
     if (UTILS_LIKELY(view && view->getScene())) {
+        FEngine& engine = mEngine;
+
+        // the temporal upscaler needs a few frames to converge after a change
+        mFrameTemporalUpscaling |= view->hasTemporalUpscaling();
+
+        // the renderer's own changes, made while rendering, are left out of both versions
+        mFrameViewCount++;
+        mFrameGlobalChanges = engine.getGlobalContentVersion() != mDamageGlobalVersion;
+
+        mRenderContentVersion = engine.getContentVersion();
+        if (mFramePipelining) {
+            renderPipelined(const_cast<FView*>(view));
+            renderDone();
+            return;
+        }
+
         // per-renderpass data
         ArenaScope rootArena(mPerRenderPassArena);
 
-        FEngine& engine = mEngine;
         JobSystem& js = engine.getJobSystem();
 
         // create a master job so no other job can escape
@@ -111,9 +159,52 @@ void FRenderer::render(FView const* view) {
         // and wait for all jobs to finish as a safety (this should be a no-op)
         js.runAndWait(masterJob);
         js.reset();
+
+        renderDone();
     }
 }
 
+void FRenderer::snapshotTaken(FView* view) noexcept {
+    // The components can change from here on, from the snapshot callback or from another
+    // thread, so only the changes made before are the renderer's own.
+    FEngine& engine = mEngine;
+    engine.ignoreContentChanges(mRenderContentVersion);
+    mRenderGlobalVersion = engine.getGlobalContentVersion();
+    mRenderResourceVersion = engine.getResourceContentVersion();
+    view->getScene()->snapshotTaken();
+}
+
+void FRenderer::renderDone() noexcept {
+    // after the snapshot, the renderer still changes the resources but not the components
+    FEngine& engine = mEngine;
+    const uint64_t ownChanges = engine.getResourceContentVersion() - mRenderResourceVersion;
+    engine.ignoreResourceContentChanges(mRenderResourceVersion);
+    mDamageGlobalVersion = mRenderGlobalVersion + ownChanges;
+}
+
+void FRenderer::renderPipelined(FView* view) {
+    FEngine& engine = mEngine;
+
+    const size_t index = mPipelinedArenaIndex;
+    mPipelinedArenaIndex ^= 1u;
+    if (mPipelinedArenaPending[index]) {
+        // this arena is still used by the commands of the render() before the previous one
+        engine.waitForPendingCommands();
+        mPipelinedArenaPending[0] = mPipelinedArenaPending[1] = false;
+    }
+
+    // per-renderpass data, it's not reused before the commands recorded from it are complete
+    ArenaScope rootArena(*mPipelinedArenas[index]);
+
+    // We don't use a master job here, because the jobs recording the driver commands outlive
+    // this call. All the other jobs are waited for explicitly.
+    engine.beginDeferredCommands();
+    renderJob(rootArena, view);
+    engine.endDeferredCommands();
+
+    mPipelinedArenaPending[index] = engine.hasPendingCommands();
+}
+
 void FRenderer::renderJob(ArenaScope& arena, FView* view) {
     FEngine& engine = getEngine();
     JobSystem& js = engine.getJobSystem();
@@ -126,7 +217,8 @@ void FRenderer::renderJob(ArenaScope& arena, FView* view) {
 
     Viewport const& vp = view->getViewport();
     const bool hasPostProcess = view->hasPostProcessPass();
-    float2 scale = view->updateScale(mFrameInfoManager.getLastFrameTime());
+    view->setFrameStats(mFrameStatsRecording ? &mFrameStats : nullptr, mFrameId);
+    float2 scale = view->updateScale(driver, mFrameInfoManager.getLastFrameTime());
     bool mUseFXAA = view->getAntiAliasing() == View::AntiAliasing::FXAA;
     if (!hasPostProcess) {
         // dynamic scaling and FXAA are part of the post-process phase and can't happen if
@@ -138,11 +230,49 @@ void FRenderer::renderJob(ArenaScope& arena, FView* view) {
     const bool scaled = any(notEqual(scale, float2(1.0f)));
     Viewport svp = vp.scale(scale);
     if (svp.empty()) {
+        // nothing reads the components of the scene
+        snapshotTaken(view);
         return;
     }
 
+    // A level of a reflection probe is prefiltered per render(), before the view picks the
+    // probes that are ready. It changes the lighting of the whole frame.
+    ReflectionProbes& probes = view->getScene()->getReflectionProbes();
+    mFrameGlobalChanges |= probes.prefilter(engine);
+    mFrameReflectionProbesPending |= probes.isPrefilterPending();
+
+    // this also starts the froxelization, which runs in parallel with the shadow passes
     view->prepare(engine, driver, arena, svp);
-    // TODO: froxelization could actually start now, instead of in ColorPass::renderColorPass()
+
+    // the quads of the particles face this view's camera
+    engine.getParticleManager().prepareView(*view);
+    countRenderables(view);
+
+    // in snapshot mode, the passes don't read the components anymore, the application can
+    // change them for the next frame
+    const bool snapshot = view->hasSceneSnapshot();
+    if (snapshot) {
+        snapshotTaken(view);
+    }
+
+    if (mPartialUpdate) {
+        // this must come before drawing into the swap chain
+        setFrameDamage(driver, view, vp, hasPostProcess);
+    }
+
+    // the capture is written as the passes run, it's closed when this returns
+    std::unique_ptr<FrameCapture> capture;
+    if (UTILS_UNLIKELY(!mCapturePath.empty())) {
+        capture.reset(new FrameCapture(mCapturePath.c_str()));
+        mCapturePath = {};
+        capture->writeView(*view, mFrameId, vp, svp);
+        capture->writeStats(mFrameStats.getLastFrameStats(), mLastFrameRenderStats);
+        capture->writeRenderables(*view);
+    }
+    FrameCapture* const frameCapture = capture.get();
+    const auto commandsStart = std::chrono::steady_clock::now();
+    FrameStatsManager::CountersScope commandsCounters(mFrameStatsRecording ? &mFrameStats : nullptr,
+            mFrameId, FrameStatsManager::PHASE_COMMANDS);
 
     /*
      * Allocate command buffer.
@@ -153,15 +283,41 @@ void FRenderer::renderJob(ArenaScope& arena, FView* view) {
     GrowingSlice<Command> commands(
             arena.allocate<Command>(commandsCount, CACHELINE_SIZE), commandsCount);
 
+    /*
+     * The passes of the frame are described by a FrameGraph, which takes care of allocating
+     * the intermediate render targets and choosing what can be discarded.
+     */
+
+    FrameGraph fg(rtp);
+
     /*
      * Shadow pass
      */
 
     if (view->hasShadowing()) {
-        ShadowPass::renderShadowMap(engine, js, view, commands);
-        recordHighWatermark(commands); // for debugging
-        // reset the command buffer
-        commands.clear();
+        struct ShadowPassData { };
+        fg.addPass<ShadowPassData>("Shadow Pass",
+                [](FrameGraph::Builder& builder, ShadowPassData&) {
+                    // the shadow map isn't managed by the graph
+                    builder.sideEffect();
+                },
+                [this, &engine, &js, view, &commands, &arena](
+                        FrameGraph::Resources const&, ShadowPassData const&, DriverApi& driver) {
+                    Handle<HwTimerQuery> query = view->getPassTimerQuery(FView::GpuPass::SHADOWS);
+                    if (query) {
+                        driver.beginTimerQuery(query);
+                    }
+                    ShadowPass::renderShadowMap(engine, js, view, commands, arena);
+                    if (query) {
+                        driver.endTimerQuery(query);
+                    }
+                    recordCommands(commands);
+                    // the shadow map can still be recorded from the command buffer, wait before
+                    // reusing it
+                    engine.waitForPendingCommands();
+                    // reset the command buffer
+                    commands.clear();
+                });
     }
 
     /*
@@ -171,69 +327,217 @@ void FRenderer::renderJob(ArenaScope& arena, FView* view) {
     const uint8_t useMSAA = view->getSampleCount();
     const TextureFormat hdrFormat = getHdrFormat();
     const TextureFormat ldrFormat = getLdrFormat();
-    RenderTargetPool::Target const* colorTarget = nullptr;
+
+    // FIXME: viewRenderTarget doesn't have a depth-buffer, so when skipping post-process, don't rely on it
+    const Handle<HwRenderTarget> viewRenderTarget = getRenderTarget();
+    const FrameGraphResource output = fg.import("View Target",
+            { TargetBufferFlags::COLOR, vp.width, vp.height, 1, ldrFormat },
+            viewRenderTarget, view->getDiscardedTargetBuffers());
 
     if (UTILS_LIKELY(hasPostProcess)) {
-        // allocate the target we need for rendering the scene
-        colorTarget = rtp.get(TargetBufferFlags::COLOR_AND_DEPTH,
-                svp.width, svp.height, useMSAA, hdrFormat);
         svp.left = svp.bottom = 0;
     }
 
-    // FIXME: viewRenderTarget doesn't have a depth-buffer, so when skipping post-process, don't rely on it
-    const Handle<HwRenderTarget> viewRenderTarget = getRenderTarget();
-    ColorPass::renderColorPass(engine, js,
-            colorTarget ? colorTarget->target : viewRenderTarget, view, svp, commands);
+    // The transparent surfaces are accumulated in a separate target, then composited over the
+    // color buffer, which must be an intermediate target with a depth buffer to copy.
+    AccumulationTarget const* accumulation = nullptr;
+    if (view->isOrderIndependentTransparencyEnabled() && hasPostProcess && useMSAA <= 1 &&
+            !engine.hasDebugView() && driver.isMultipleRenderTargetsSupported()) {
+        accumulation = getAccumulationTarget(driver, svp.width, svp.height);
+    }
+
+    struct ColorPassData {
+        FrameGraphResource color;
+    };
+    auto const& colorPass = fg.addPass<ColorPassData>("Color Pass",
+            [&](FrameGraph::Builder& builder, ColorPassData& data) {
+                if (UTILS_LIKELY(hasPostProcess)) {
+                    // the target we need for rendering the scene
+                    data.color = builder.create("Color Buffer",
+                            { TargetBufferFlags::COLOR_AND_DEPTH,
+                              svp.width, svp.height, useMSAA, hdrFormat });
+                    data.color = builder.write(data.color);
+                } else {
+                    data.color = builder.write(output);
+                }
+            },
+            [&engine, &js, view, svp, accumulation, &commands, &arena, hasPostProcess,
+                    frameCapture](
+                    FrameGraph::Resources const& resources,
+                    ColorPassData const& data, DriverApi& driver) {
+                Handle<HwTimerQuery> query = view->getPassTimerQuery(FView::GpuPass::COLOR);
+                if (query) {
+                    driver.beginTimerQuery(query);
+                }
+                ColorPass::renderColorPass(engine, js,
+                        resources.getTarget(data.color).target,
+                        resources.getRenderPassParams(data.color),
+                        view, svp, accumulation, commands, arena);
+                if (query) {
+                    driver.endTimerQuery(query);
+                }
+                if (UTILS_UNLIKELY(frameCapture)) {
+                    // the color pass waited for the froxelization
+                    frameCapture->writeCommands("color", commands);
+                    frameCapture->writeFroxels(view->getFroxelizer());
+                }
+                // the post-processing passes are the last ones, they end with fg.execute()
+                Handle<HwTimerQuery> postProcess =
+                        view->getPassTimerQuery(FView::GpuPass::POST_PROCESS);
+                if (hasPostProcess && postProcess) {
+                    driver.beginTimerQuery(postProcess);
+                }
+            });
 
     /*
      * Post Processing...
      */
 
-    if (UTILS_LIKELY(hasPostProcess)) {
-        driver.pushGroupMarker("Post Processing");
+    // the output of the temporal upscaler, kept for the next frame
+    RenderTargetPool::Target const* temporalHistory = nullptr;
+    if (view->hasTemporalUpscaling() && !engine.hasDebugView()) {
+        temporalHistory = rtp.get(TargetBufferFlags::COLOR, vp.width, vp.height, 1,
+                TextureFormat::RGBA8);
+    }
 
+    if (UTILS_LIKELY(hasPostProcess)) {
         ppm.start();
 
-        if (useMSAA > 1) {
+        if (useMSAA > 1 && !driver.isMultisampledRenderToTextureSupported()) {
             // Note: MSAA, when used is applied before tone-mapping (which is not ideal)
             // (tone mapping currently only works without multi-sampling)
             // this blit does a MSAA resolve
+            // When the color buffer is resolved on-tile, the next pass samples it directly.
             ppm.blit(hdrFormat);
         }
 
         const bool translucent = mSwapChain->isTransparent();
-        Handle<HwProgram> toneMappingProgram = engine.getPostProcessProgram(
-                translucent ? PostProcessStage::TONE_MAPPING_TRANSLUCENT
-                            : PostProcessStage::TONE_MAPPING_OPAQUE);
-        ppm.pass(mUseFXAA ? TextureFormat::RGBA8 : ldrFormat, toneMappingProgram);
-
-        if (mUseFXAA) {
-            Handle<HwProgram> antiAliasingProgram = engine.getPostProcessProgram(
-                    translucent ? PostProcessStage::ANTI_ALIASING_TRANSLUCENT
-                                : PostProcessStage::ANTI_ALIASING_OPAQUE);
-            ppm.pass(ldrFormat, antiAliasingProgram);
-        }
 
-        if (scaled) {
-            // because it's the last command, the TextureFormat is not relevant
+        // When the tone mapped image isn't the view's output, the color buffer can be tone
+        // mapped in place, right after the color pass and without leaving the tile memory.
+        // This saves writing and reading back an intermediate target. A multisampled color
+        // buffer would run the tone mapping per sample.
+        const bool toneMapInPlace = useMSAA <= 1 && driver.isFramebufferFetchSupported();
+        const PostProcessStage inPlaceToneMapping = translucent ?
+                PostProcessStage::TONE_MAPPING_FRAMEBUFFER_FETCH_TRANSLUCENT :
+                PostProcessStage::TONE_MAPPING_FRAMEBUFFER_FETCH_OPAQUE;
+
+        if (UTILS_UNLIKELY(engine.hasDebugView())) {
+            // the color pass wrote the values of the debug view, they replace the tone mapping
+            ppm.pass(ldrFormat, engine.getPostProcessProgram(PostProcessStage::DEBUG_HEATMAP));
+            if (scaled) {
+                ppm.blit();
+            }
+        } else if (temporalHistory) {
+            // Temporal upscaling works on the tone mapped image, it reconstructs the
+            // full resolution image from the jittered frames, which also anti-aliases it.
+            if (toneMapInPlace) {
+                ppm.inPlace(engine.getPostProcessProgram(inPlaceToneMapping));
+            } else {
+                Handle<HwProgram> toneMappingProgram = engine.getPostProcessProgram(
+                        translucent ? PostProcessStage::TONE_MAPPING_TRANSLUCENT
+                                    : PostProcessStage::TONE_MAPPING_OPAQUE);
+                ppm.pass(TextureFormat::RGBA8, toneMappingProgram);
+            }
+            ppm.temporal(engine.getPostProcessProgram(PostProcessStage::TEMPORAL_UPSCALING),
+                    temporalHistory, view->getTemporalHistory(), view->getTemporalJitter());
             ppm.blit();
+        } else if (mUseFXAA) {
+            // Tone mapping, anti-aliasing and scaling are fused in a single pass, which saves
+            // writing and reading back one or two full-size render targets.
+            Handle<HwProgram> program = engine.getPostProcessProgram(
+                    translucent ? PostProcessStage::TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT
+                                : PostProcessStage::TONE_MAPPING_ANTI_ALIASING_OPAQUE);
+            ppm.pass(ldrFormat, program);
+        } else if (scaled && toneMapInPlace) {
+            // the upscaling blit reads the tone mapped color buffer
+            ppm.inPlace(engine.getPostProcessProgram(inPlaceToneMapping));
+            ppm.blit();
+        } else {
+            Handle<HwProgram> toneMappingProgram = engine.getPostProcessProgram(
+                    translucent ? PostProcessStage::TONE_MAPPING_TRANSLUCENT
+                                : PostProcessStage::TONE_MAPPING_OPAQUE);
+            ppm.pass(ldrFormat, toneMappingProgram);
+
+            if (scaled) {
+                // because it's the last command, the TextureFormat is not relevant
+                ppm.blit();
+            }
         }
-        ppm.finish(view->getDiscardedTargetBuffers(), viewRenderTarget, vp, colorTarget, svp);
+        ppm.finish(fg, colorPass.color, output, vp, svp);
+    }
+
+    fg.compile();
 
-        driver.popGroupMarker();
+    // measures the GPU time of this view, for dynamic resolution
+    Handle<HwTimerQuery> timerQuery = view->getTimerQuery();
+    if (timerQuery) {
+        driver.beginTimerQuery(timerQuery);
     }
 
-    // for debugging
-    recordHighWatermark(commands);
+    fg.execute(driver);
+
+    Handle<HwTimerQuery> postProcessQuery = view->getPassTimerQuery(FView::GpuPass::POST_PROCESS);
+    if (hasPostProcess && postProcessQuery) {
+        driver.endTimerQuery(postProcessQuery);
+    }
+
+    if (timerQuery) {
+        driver.endTimerQuery(timerQuery);
+    }
+
+    // this frame's history is used by the next one, the previous one is released
+    view->setTemporalHistory(rtp, temporalHistory);
+
+    recordCommands(commands);
+
+    if (UTILS_UNLIKELY(mFrameStatsRecording)) {
+        const std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - commandsStart;
+        mFrameStats.add(mFrameId, FrameStatsManager::COMMANDS, elapsed.count());
+        commandsCounters.end();
+    }
+
+    if (!snapshot) {
+        // the snapshot didn't fit in the arena, the components were read until now
+        snapshotTaken(view);
+    }
 }
 
-bool FRenderer::beginFrame(FSwapChain* swapChain) {
+bool FRenderer::beginFrame(FSwapChain* swapChain, uint64_t vsyncSteadyClockTimeNano) {
     SYSTRACE_CALL();
 
     assert(swapChain);
 
+    FEngine& engine = getEngine();
+    FEngine::DriverApi& driver = engine.getDriverApi();
+
+    if (mFramePipelining) {
+        // This is the sync point of frame pipelining: the previous frame's commands must all be
+        // recorded, they're only flushed now.
+        engine.flush();
+        mPipelinedArenaPending[0] = mPipelinedArenaPending[1] = false;
+    }
+
     mFrameId++;
     mFrameInfoManager.beginFrame(mFrameId);
+    mRenderStats = { mFrameId };
+
+    mFrameStatsRecording = mFrameStats.isEnabled();
+    if (UTILS_UNLIKELY(mFrameStatsRecording)) {
+        // this delivers a previous frame, i.e. it calls the user's callback
+        mFrameStats.beginFrame(mFrameId);
+        mFrameStart = std::chrono::steady_clock::now();
+
+        // the driver thread's busy time is measured between two commands, see endFrameStats()
+        FrameStatsManager* const stats = &mFrameStats;
+        const uint32_t frameId = mFrameId;
+        driver.queueCommand([&engine, stats, frameId]() {
+            const std::chrono::duration<double, std::milli> busy = engine.getDriverBusyTime();
+            stats->add(frameId, FrameStatsManager::DRIVER_THREAD, -busy.count());
+            stats->beginDriverCounters();
+        });
+    }
 
     { // scope for frame id trace
         char buf[64];
@@ -241,9 +545,6 @@ bool FRenderer::beginFrame(FSwapChain* swapChain) {
         SYSTRACE_NAME(buf);
     }
 
-    FEngine& engine = getEngine();
-    FEngine::DriverApi& driver = engine.getDriverApi();
-
     // NOTE: this makes synchronous calls to the driver
     driver.updateStreams(&driver);
 
@@ -256,16 +557,49 @@ bool FRenderer::beginFrame(FSwapChain* swapChain) {
     if (mFrameSkipper.skipFrameNeeded()) {
         mFrameInfoManager.cancelFrame();
         driver.endFrame(mFrameId);
+        if (UTILS_UNLIKELY(mFrameStatsRecording)) {
+            endFrameStats(driver);
+        }
         engine.flush();
         return false;
     }
 
+    if (vsyncSteadyClockTimeNano) {
+        updateVsync(vsyncSteadyClockTimeNano);
+        if (mVsyncPeriod) {
+            // the frame is presented once the frames ahead of it are, which is as far as the
+            // FrameSkipper lets the CPU get ahead of the GPU
+            driver.setPresentationTime(int64_t(vsyncSteadyClockTimeNano +
+                    mFrameSkipper.getLatency() * mVsyncPeriod));
+        }
+    }
+
     // ask the engine to do what it needs to (e.g. updates light buffer, materials...)
     engine.prepare();
 
+    // what this frame renders, it's presented by endFrame()
+    mFrameContentVersion = engine.getContentVersion();
+    mFrameTemporalUpscaling = false;
+    mFrameReflectionProbesPending = false;
+    mFrameViewCount = 0;
+
     return true;
 }
 
+void FRenderer::updateVsync(uint64_t vsync) noexcept {
+    if (mVsyncTime && vsync > mVsyncTime) {
+        const uint64_t delta = vsync - mVsyncTime;
+        if (!mVsyncPeriod || delta < mVsyncPeriod * 2 / 3) {
+            // first estimate, or the refresh rate went up
+            mVsyncPeriod = delta;
+        } else if (delta < mVsyncPeriod * 3 / 2) {
+            // deltas spanning several periods (i.e. missed vsyncs) are ignored
+            mVsyncPeriod = (mVsyncPeriod * 7 + delta) / 8;
+        }
+    }
+    mVsyncTime = vsync;
+}
+
 void FRenderer::endFrame() {
     SYSTRACE_CALL();
 
@@ -283,11 +617,25 @@ void FRenderer::endFrame() {
 
     driver.endFrame(mFrameId);
 
+    if (UTILS_UNLIKELY(mFrameStatsRecording)) {
+        endFrameStats(driver);
+    }
+
     if (mSwapChain) {
         mSwapChain->commit(driver);
         mSwapChain = nullptr;
     }
 
+    if (mFrameContentVersion != mPresentedContentVersion) {
+        // the temporal upscaler converges over a full cycle of its jitter
+        mConvergenceFramesLeft = mFrameTemporalUpscaling ? FView::TEMPORAL_JITTER_COUNT - 1 : 0;
+        mPresentedContentVersion = mFrameContentVersion;
+    } else if (mConvergenceFramesLeft) {
+        mConvergenceFramesLeft--;
+    }
+    mLastFrameViewCount = mFrameViewCount;
+    mReflectionProbesPending = mFrameReflectionProbesPending;
+
     // Run the component managers' GC in parallel
     // WARNING: while doing this we can't access any component manager
     auto& js = engine.getJobSystem();
@@ -296,11 +644,19 @@ void FRenderer::endFrame() {
     js.run(job);
 
     rtp.gc();           // gc post-processing targets (this can generate driver commands)
-    engine.flush();     // flush command stream
+    if (!mFramePipelining) {
+        engine.flush(); // flush command stream (otherwise it happens in the next beginFrame())
+    }
 
     // make sure we're done with the gcs
     js.wait(job);
 
+    // without frame pipelining the commands of this frame were just flushed, otherwise these
+    // are the previous frame's
+    const uint64_t flushedSize = engine.getCommandBufferStats().flushedSize;
+    mRenderStats.commandStreamSize = flushedSize - mFlushedSize;
+    mFlushedSize = flushedSize;
+    mLastFrameRenderStats = mRenderStats;
 
 #if EXTRA_TIMING_INFO
     if (UTILS_UNLIKELY(frameInfoManager.isLapRecordsEnabled())) {
@@ -316,6 +672,140 @@ void FRenderer::endFrame() {
 #endif
 }
 
+static inline bool isEqual(mat4f const& lhs, mat4f const& rhs) noexcept {
+    return all(equal(lhs[0], rhs[0])) && all(equal(lhs[1], rhs[1])) &&
+           all(equal(lhs[2], rhs[2])) && all(equal(lhs[3], rhs[3]));
+}
+
+void FRenderer::setFrameDamage(DriverApi& driver, FView const* view, Viewport const& vp,
+        bool hasPostProcess) noexcept {
+    FScene const* const scene = view->getScene();
+    CameraInfo const& camera = view->getCameraInfo();
+    const mat4f clipFromWorld = camera.projection * camera.view;
+
+    // The damage is relative to the last frame presented, so it must have rendered the same
+    // view alone, into the same swap chain, from the same point of view, and only the
+    // renderables may have changed since. The post-processing passes and the shadows spread
+    // the changes across the whole frame.
+    Aabb damage;
+    const bool bounded = scene->getDamage(damage) &&
+            mFrameViewCount == 1 && mLastFrameViewCount == 1 && !mFrameGlobalChanges &&
+            !hasPostProcess && !view->hasShadowing() &&
+            scene == mDamageScene && mSwapChain == mDamageSwapChain && vp == mDamageViewport &&
+            isEqual(clipFromWorld, mDamageClipFromWorld);
+
+    mDamageScene = scene;
+    mDamageSwapChain = mSwapChain;
+    mDamageViewport = vp;
+    mDamageClipFromWorld = clipFromWorld;
+
+    if (!bounded) {
+        // without a damage, the whole frame is redrawn
+        return;
+    }
+
+    int32_t left = vp.left;
+    int32_t bottom = vp.bottom;
+    int32_t right = vp.left;
+    int32_t top = vp.bottom;
+    if (damage.min.x <= damage.max.x) {
+        // project the corners of the damaged box in the viewport
+        float2 lo = std::numeric_limits<float>::max();
+        float2 hi = std::numeric_limits<float>::lowest();
+        for (size_t i = 0; i < 8; i++) {
+            const float3 p = { (i & 1u) ? damage.max.x : damage.min.x,
+                               (i & 2u) ? damage.max.y : damage.min.y,
+                               (i & 4u) ? damage.max.z : damage.min.z };
+            const float4 c = clipFromWorld * float4{ p, 1 };
+            if (c.w <= 0) {
+                // the box crosses the camera plane, it could cover anything
+                return;
+            }
+            lo = min(lo, c.xy / c.w);
+            hi = max(hi, c.xy / c.w);
+        }
+        const float2 size(vp.width, vp.height);
+        lo = saturate(lo * 0.5f + 0.5f) * size;
+        hi = saturate(hi * 0.5f + 0.5f) * size;
+        if (lo.x < hi.x && lo.y < hi.y) {
+            // one more pixel on each side accounts for the rounding of the rasterization
+            left   = vp.left   + std::max(int32_t(std::floor(lo.x)) - 1, 0);
+            bottom = vp.bottom + std::max(int32_t(std::floor(lo.y)) - 1, 0);
+            right  = vp.left   + std::min(int32_t(std::ceil(hi.x)) + 1, int32_t(vp.width));
+            top    = vp.bottom + std::min(int32_t(std::ceil(hi.y)) + 1, int32_t(vp.height));
+        }
+    }
+    driver.setFrameDamage(left, bottom, uint32_t(right - left), uint32_t(top - bottom));
+}
+
+void FRenderer::countRenderables(FView const* view) noexcept {
+    // prepare() partitioned the renderables: the visible ones, then the shadow casters
+    Range<uint32_t> const& renderables = view->getVisibleRenderables();
+    Range<uint32_t> const& casters = view->getVisibleShadowCasters();
+    const size_t count = view->getScene()->getRenderableData().size();
+    mRenderStats.visibleRenderables += renderables.size();
+    mRenderStats.shadowCasters += casters.size();
+    mRenderStats.culledRenderables += count - std::max(renderables.last, casters.last);
+}
+
+bool FRenderer::needsRedraw() const noexcept {
+    FEngine const& engine = mEngine;
+    return engine.getContentVersion() != mPresentedContentVersion ||
+           mConvergenceFramesLeft || mReflectionProbesPending || engine.hasProducerStreams();
+}
+
+Renderer::RenderStats FRenderer::getRenderStats() const noexcept {
+    RenderStats stats = mLastFrameRenderStats;
+    FEngine::DriverApi& driver = mEngine.getDriverApi();
+    Driver::RenderStats driverStats;
+    if (driver.getRenderStats(&driverStats)) {
+        stats.drawCount = driverStats.drawCount;
+        stats.triangleCount = driverStats.triangleCount;
+        stats.uniformBytes = driverStats.uniformBytes;
+        stats.bufferBytes = driverStats.bufferBytes;
+        stats.textureBytes = driverStats.textureBytes;
+    }
+    Driver::StateStats stateStats;
+    if (driver.getStateStats(&stateStats)) {
+        stats.programChanges = stateStats.issued[Driver::StateStats::PROGRAM];
+        stats.textureBindings = stateStats.issued[Driver::StateStats::TEXTURE];
+        stats.uniformBufferBindings = stateStats.issued[Driver::StateStats::UNIFORM_BUFFER];
+    }
+    return stats;
+}
+
+void FRenderer::endFrameStats(DriverApi& driver) noexcept {
+    FEngine& engine = mEngine;
+    FrameStatsManager* const stats = &mFrameStats;
+    const uint32_t frameId = mFrameId;
+    driver.queueCommand([&engine, stats, frameId]() {
+        const std::chrono::duration<double, std::milli> busy = engine.getDriverBusyTime();
+        stats->add(frameId, FrameStatsManager::DRIVER_THREAD, busy.count());
+        stats->endDriverCounters(frameId);
+    });
+
+    // the end of the main thread's work is approximated, endFrame() still has a little to do
+    const std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - mFrameStart;
+    stats->add(frameId, FrameStatsManager::MAIN_THREAD, elapsed.count());
+    mFrameStatsRecording = false;
+}
+
+void FRenderer::setFramePipelining(bool enabled) noexcept {
+    if (enabled && !mPipelinedArenas[0]) {
+        for (auto& arena : mPipelinedArenas) {
+            arena = std::make_unique<LinearAllocatorArena>("pipelined per-renderpass allocator",
+                    FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+        }
+    }
+    if (!enabled && mFramePipelining) {
+        // the commands recorded so far are flushed, as they would be by endFrame()
+        mEngine.flush();
+        mPipelinedArenaPending[0] = mPipelinedArenaPending[1] = false;
+    }
+    mFramePipelining = enabled;
+}
+
 void FRenderer::readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
         driver::PixelBufferDescriptor&& buffer) {
 
@@ -373,6 +863,10 @@ bool Renderer::beginFrame(SwapChain* swapChain) {
     return upcast(this)->beginFrame(upcast(swapChain));
 }
 
+bool Renderer::beginFrame(SwapChain* swapChain, uint64_t vsyncSteadyClockTimeNano) {
+    return upcast(this)->beginFrame(upcast(swapChain), vsyncSteadyClockTimeNano);
+}
+
 void Renderer::readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
         driver::PixelBufferDescriptor&& buffer) {
     upcast(this)->readPixels(xoffset, yoffset, width, height, std::move(buffer));
@@ -382,4 +876,44 @@ void Renderer::endFrame() {
     upcast(this)->endFrame();
 }
 
+void Renderer::setFramePipelining(bool enabled) noexcept {
+    upcast(this)->setFramePipelining(enabled);
+}
+
+bool Renderer::isFramePipeliningEnabled() const noexcept {
+    return upcast(this)->isFramePipeliningEnabled();
+}
+
+void Renderer::setFrameStatsCallback(FrameStatsCallback callback, void* user) noexcept {
+    upcast(this)->setFrameStatsCallback(callback, user);
+}
+
+void Renderer::setFrameStatsCounters(bool enabled) noexcept {
+    upcast(this)->setFrameStatsCounters(enabled);
+}
+
+void Renderer::setFrameStatsGpuPasses(bool enabled) noexcept {
+    upcast(this)->setFrameStatsGpuPasses(enabled);
+}
+
+bool Renderer::needsRedraw() const noexcept {
+    return upcast(this)->needsRedraw();
+}
+
+void Renderer::setPartialUpdate(bool enabled) noexcept {
+    upcast(this)->setPartialUpdate(enabled);
+}
+
+bool Renderer::isPartialUpdateEnabled() const noexcept {
+    return upcast(this)->isPartialUpdateEnabled();
+}
+
+Renderer::RenderStats Renderer::getRenderStats() const noexcept {
+    return upcast(this)->getRenderStats();
+}
+
+void Renderer::captureFrame(const char* path) noexcept {
+    upcast(this)->captureFrame(path);
+}
+
 } // namespace filament
@@ -24,18 +24,28 @@
 #include "details/IndirectLight.h"
 #include "details/GpuLightBuffer.h"
 #include "details/Skybox.h"
+#include "details/Texture.h"
 
 #include <utils/compiler.h>
 #include <utils/EntityManager.h>
+#include <utils/JobSystem.h>
+#include <utils/Panic.h>
 #include <utils/Range.h>
+#include <utils/Systrace.h>
 #include <utils/Zip2Iterator.h>
 
 #include <algorithm>
+#include <mutex>
+
+#include <string.h>
 
 using namespace math;
 using namespace utils;
 
 namespace filament {
+
+constexpr size_t Scene::MAX_REFLECTION_PROBES;
+
 namespace details {
 
 // ------------------------------------------------------------------------------------------------
@@ -44,15 +54,76 @@ FScene::FScene(FEngine& engine) :
         mEngine(engine),
         mIndirectLight(engine.getDefaultIndirectLight()),
         mGpuLightData(engine) {
+    engine.getEntityManager().registerListener(this);
 }
 
 FScene::~FScene() noexcept = default;
 
+static inline bool isEqual(mat4f const& lhs, mat4f const& rhs) noexcept {
+    return all(equal(lhs[0], rhs[0])) && all(equal(lhs[1], rhs[1])) &&
+           all(equal(lhs[2], rhs[2])) && all(equal(lhs[3], rhs[3]));
+}
 
 void FScene::prepare(const math::mat4f& worldOriginTansform) {
-    // TODO: can we skip this in most cases? Since we rely on indices staying the same,
-    //       we could only skip, if nothing changed in the RCM.
+    FEngine& engine = mEngine;
+    FRenderableManager& rcm = engine.getRenderableManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    FLightManager& lcm = engine.getLightManager();
+
+    // world transforms left pending by lazy updates are computed once for the whole frame,
+    // this must happen first because it can change the transform manager's structure
+    tcm.resolvePendingTransforms();
+
+    /*
+     * The renderable SoA is kept from one frame to the next. Because it mirrors
+     * instances of the transform and renderable managers, it must be rebuilt when their
+     * structure changes (components added, removed or moved), when the set of entities
+     * changes or when the world origin changes. Otherwise, only the entries whose transform
+     * or renderable component changed since the last call are patched in place, and when
+     * nothing changed at all, there is nothing to do.
+     *
+     * Note that the renderable SoA is reordered by FView, so we can't rely on its order.
+     */
+
+    const bool entitiesDestroyed = mEntitiesDestroyed.exchange(false, std::memory_order_relaxed);
+    const bool rebuild = mEntitiesDirty || entitiesDestroyed ||
+            tcm.getStructureVersion() != mTransformStructureVersion ||
+            rcm.getStructureVersion() != mRenderableStructureVersion ||
+            lcm.getStructureVersion() != mLightStructureVersion ||
+            !isEqual(worldOriginTansform, mWorldOriginTransform);
+
+    const bool update = !rebuild &&
+            (tcm.getVersion() != mTransformVersion || rcm.getVersion() != mRenderableVersion);
+
+    mDamage = {};
+    mDamageUnbounded = rebuild;
+
+    if (rebuild) {
+        gatherRenderables(worldOriginTansform);
+        mGeneration++;
+    } else if (update) {
+        updateRenderables(worldOriginTansform);
+    }
+
+    prepareBvh(rebuild, update);
+
+    mWorldOriginTransform = worldOriginTansform;
+    mTransformVersion = tcm.getVersion();
+    mTransformStructureVersion = tcm.getStructureVersion();
+    mRenderableVersion = rcm.getVersion();
+    mRenderableStructureVersion = rcm.getStructureVersion();
+    mLightStructureVersion = lcm.getStructureVersion();
+    mEntitiesDirty = false;
+
+    // the light SoA is trimmed down by each View, so it must be gathered each time
+    gatherLights(worldOriginTansform);
 
+    // the reflection probes whose box changed must be captured again by the application
+    mReflectionProbes.update(mDamage, mDamageUnbounded, worldOriginTansform);
+}
+
+UTILS_NOINLINE
+void FScene::gatherRenderables(const math::mat4f& worldOriginTansform) noexcept {
     FEngine& engine = mEngine;
     EntityManager& em = engine.getEntityManager();
     FRenderableManager& rcm = engine.getRenderableManager();
@@ -60,7 +131,7 @@ void FScene::prepare(const math::mat4f& worldOriginTansform) {
     FLightManager& lcm = engine.getLightManager();
     // go through the list of entities, and gather the data of those that are renderables
     auto& sceneData = mRenderableData;
-    auto& lightData = mLightData;
+    auto& lights = mLightInstances;
     auto const& entities = mEntities;
 
 
@@ -68,28 +139,19 @@ void FScene::prepare(const math::mat4f& worldOriginTansform) {
     // component can be added after the entity is added to the scene.
 
     // for the purpose of allocation, we'll assume all our entities are renderables
-    size_t capacity = entities.size();
-    // we need the capacity to be multiple of 16 for SIMD loops
-    capacity = (capacity + 0xF) & ~0xF;
-    // we need 1 extra entry at the end for teh summed primitive count
-    capacity = capacity + 1;
+    // we need 1 extra entry at the end for the summed primitive count, and the capacity to be
+    // padded for SIMD loops
+    const size_t capacity = RenderableSoa::getPaddedSize(entities.size() + 1);
 
     sceneData.clear();
     if (sceneData.capacity() < capacity) {
         sceneData.setCapacity(capacity);
     }
 
-    lightData.clear();
-    if (lightData.capacity() < capacity) {
-        lightData.setCapacity(capacity);
-    }
-    // the first entries are reserved for the directional lights (currently only one)
-    lightData.resize(DIRECTIONAL_LIGHTS_COUNT);
-
-
-    // find the max intensity directional light index in our local array
-    float maxIntensity = 0;
+    lights.clear();
 
+    // The entity set can only be walked sequentially, so we only resolve the component
+    // instances here; the per-renderable data is computed in parallel below.
     for (Entity e : entities) {
         if (!em.isAlive(e))
             continue;
@@ -101,71 +163,384 @@ void FScene::prepare(const math::mat4f& worldOriginTansform) {
         if (!ri & !li)
             continue;
 
-        // get the world transform
         auto ti = tcm.getInstance(e);
-        const mat4f worldTransform = worldOriginTansform * tcm.getWorldTransform(ti);
 
         // don't even draw this object if it doesn't have a transform (which shouldn't happen
         // because one is always created when creating a Renderable component).
         if (ri && ti) {
-            // compute the world AABB so we can perform culling
-            const Box worldAABB = rigidTransform(rcm.getAABB(ri), worldTransform);
-
             // we know there is enough space in the array
             sceneData.push_back_unsafe(
-                    ri,
-                    worldTransform,
-                    rcm.getVisibility(ri),
-                    rcm.getUbh(ri),
-                    rcm.getBonesUbh(ri),
-                    worldAABB.center,
-                    0,
-                    rcm.getLayerMask(ri),
-                    worldAABB.halfExtent,
-                    {}, {});
+                    ri, {}, {}, {}, {}, {}, {}, 0, {}, {}, {}, {},
+                    ti,
+                    tcm.getVersion(ti),
+                    rcm.getVersion(ri),
+                    0, 0);
         }
 
         if (li) {
-            // find the dominant directional light
-            if (UTILS_UNLIKELY(lcm.isDirectionalLight(li))) {
-                // we don't store the directional lights, because we only have a single one
-                if (lcm.getIntensity(li) >= maxIntensity) {
-                    float3 d = lcm.getLocalDirection(li);
-                    // using the inverse-transpose handles non-uniform scaling
-                    d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
-                    lightData.elementAt<FScene::DIRECTION>(0)       = d;
-                    lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = li;
-                }
-            } else {
-                const float4 p = worldTransform * float4{ lcm.getLocalPosition(li), 1 };
-                float3 d = 0;
-                if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
-                    d = lcm.getLocalDirection(li);
-                    // using the inverse-transpose handles non-uniform scaling
-                    d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
-                }
-                lightData.push_back_unsafe(
-                        float4{ p.xyz, lcm.getRadius(li) }, d, li, {}, {});
+            lights.push_back({ li, ti });
+        }
+    }
+
+    auto work = [this, &worldOriginTansform](uint32_t start, uint32_t count) {
+        prepareRenderables(start, count, worldOriginTansform, true);
+    };
+    JobSystem& js = engine.getJobSystem();
+    auto job = jobs::parallel_for(js, nullptr, 0, (uint32_t)sceneData.size(),
+            std::cref(work), jobs::CountSplitter<JOBS_PARALLEL_FOR_RENDERABLES_COUNT, 8>());
+    js.runAndWait(job);
+}
+
+UTILS_NOINLINE
+void FScene::updateRenderables(const math::mat4f& worldOriginTansform) noexcept {
+    auto work = [this, &worldOriginTansform](uint32_t start, uint32_t count) {
+        prepareRenderables(start, count, worldOriginTansform, false);
+    };
+    JobSystem& js = mEngine.getJobSystem();
+    auto job = jobs::parallel_for(js, nullptr, 0, (uint32_t)mRenderableData.size(),
+            std::cref(work), jobs::CountSplitter<JOBS_PARALLEL_FOR_RENDERABLES_COUNT, 8>());
+    js.runAndWait(job);
+}
+
+/*
+ * Transforms an array of local AABBs by their world transform. This is the same computation
+ * as rigidTransform(), written so the compiler can process 4 boxes at a time.
+ */
+static void transformAABBs(
+        float3* UTILS_RESTRICT worldAABBCenter,
+        float3* UTILS_RESTRICT worldAABBExtent,
+        AffineTransform const* UTILS_RESTRICT worldTransforms,
+        Box const* UTILS_RESTRICT boxes,
+        size_t count) noexcept {
+    #pragma clang loop vectorize_width(4)
+    for (size_t i = 0; i < count; i++) {
+        AffineTransform const& m = worldTransforms[i];
+        const float3 c = boxes[i].center;
+        const float3 e = boxes[i].halfExtent;
+        // clang doesn't seem to generate vector * scalar instructions, so we spell them out
+        worldAABBCenter[i] = m[0] * c.x + m[1] * c.y + m[2] * c.z + m[3];
+        worldAABBExtent[i] = abs(m[0]) * e.x + abs(m[1]) * e.y + abs(m[2]) * e.z;
+    }
+}
+
+// this runs on multiple threads, each call processes a distinct range of the renderable SoA
+void FScene::prepareRenderables(uint32_t start, uint32_t count,
+        const math::mat4f& worldOriginTansform, bool all) noexcept {
+    FEngine& engine = mEngine;
+    FRenderableManager const& rcm = engine.getRenderableManager();
+    FTransformManager const& tcm = engine.getTransformManager();
+    auto& sceneData = mRenderableData;
+
+    auto const* const UTILS_RESTRICT renderableInstances = sceneData.data<RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT transformInstances  = sceneData.data<TRANSFORM_INSTANCE>();
+    auto* const UTILS_RESTRICT worldTransforms           = sceneData.data<WORLD_TRANSFORM>();
+    auto* const UTILS_RESTRICT visibility                = sceneData.data<VISIBILITY_STATE>();
+    auto* const UTILS_RESTRICT ubhs                      = sceneData.data<UBH>();
+    uint32_t* const UTILS_RESTRICT bonesSlots            = sceneData.data<BONES_SLOT>();
+    auto* const UTILS_RESTRICT morphTargets              = sceneData.data<MORPH_TARGETS>();
+    float3* const UTILS_RESTRICT worldAABBCenter         = sceneData.data<WORLD_AABB_CENTER>();
+    uint8_t* const UTILS_RESTRICT layers                 = sceneData.data<LAYERS>();
+    float3* const UTILS_RESTRICT worldAABBExtent         = sceneData.data<WORLD_AABB_EXTENT>();
+    uint32_t* const UTILS_RESTRICT transformVersions     = sceneData.data<TRANSFORM_VERSION>();
+    uint32_t* const UTILS_RESTRICT renderableVersions    = sceneData.data<RENDERABLE_VERSION>();
+
+    const AffineTransform worldOrigin(worldOriginTansform);
+
+    if (all) {
+        // everything needs updating, process the range in batches so that the AABBs
+        // can be transformed by our SIMD-friendly loop.
+        Box boxes[JOBS_PARALLEL_FOR_RENDERABLES_COUNT];
+        for (uint32_t first = start, last = start + count; first < last;) {
+            const uint32_t c = std::min(last - first, uint32_t(JOBS_PARALLEL_FOR_RENDERABLES_COUNT));
+            for (uint32_t j = 0; j < c; j++) {
+                const size_t i = first + j;
+                auto ri = renderableInstances[i];
+                auto ti = transformInstances[i];
+                worldTransforms[i] = worldOrigin * tcm.getAffineWorldTransform(ti);
+                visibility[i] = rcm.getVisibility(ri);
+                ubhs[i] = rcm.getUbh(ri);
+                bonesSlots[i] = rcm.getBonesSlot(ri);
+                morphTargets[i] = rcm.getMorphTargetsSbh(ri);
+                layers[i] = rcm.getLayerMask(ri);
+                boxes[j] = rcm.getAABB(ri);
             }
+            transformAABBs(worldAABBCenter + first, worldAABBExtent + first,
+                    worldTransforms + first, boxes, c);
+            first += c;
+        }
+        return;
+    }
+
+    // only a few renderables are expected to change from one frame to the next
+    Aabb damage;
+    bool damaged = false;
+    for (size_t i = start, c = start + count; i < c; i++) {
+        auto ri = renderableInstances[i];
+        auto ti = transformInstances[i];
+        const uint32_t transformVersion = tcm.getVersion(ti);
+        const uint32_t renderableVersion = rcm.getVersion(ri);
+        if (UTILS_LIKELY(transformVersion == transformVersions[i] &&
+                         renderableVersion == renderableVersions[i])) {
+            continue;
         }
+
+        // the renderable is damaged where it was and where it is now
+        damage.min = min(damage.min, worldAABBCenter[i] - worldAABBExtent[i]);
+        damage.max = max(damage.max, worldAABBCenter[i] + worldAABBExtent[i]);
+
+        worldTransforms[i]      = worldOrigin * tcm.getAffineWorldTransform(ti);
+        visibility[i]           = rcm.getVisibility(ri);
+        ubhs[i]                 = rcm.getUbh(ri);
+        bonesSlots[i]           = rcm.getBonesSlot(ri);
+        morphTargets[i]         = rcm.getMorphTargetsSbh(ri);
+        layers[i]               = rcm.getLayerMask(ri);
+        transformVersions[i]    = transformVersion;
+        renderableVersions[i]   = renderableVersion;
+
+        const Box aabb = rcm.getAABB(ri);
+        transformAABBs(worldAABBCenter + i, worldAABBExtent + i, worldTransforms + i, &aabb, 1);
+
+        damage.min = min(damage.min, worldAABBCenter[i] - worldAABBExtent[i]);
+        damage.max = max(damage.max, worldAABBCenter[i] + worldAABBExtent[i]);
+        damaged = true;
+    }
+
+    if (damaged) {
+        std::lock_guard<utils::Mutex> guard(mDamageLock);
+        mDamage.min = min(mDamage.min, damage.min);
+        mDamage.max = max(mDamage.max, damage.max);
     }
 }
 
-void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables) const noexcept {
+void FScene::prepareBvh(bool rebuild, bool refit) noexcept {
+    auto& sceneData = mRenderableData;
+    const size_t count = sceneData.size();
+    if (count < BVH_MIN_RENDERABLE_COUNT) {
+        mBvh.clear();
+        return;
+    }
+
+    float3 const* const worldAABBCenter = sceneData.data<WORLD_AABB_CENTER>();
+    float3 const* const worldAABBExtent = sceneData.data<WORLD_AABB_EXTENT>();
+
+    if (rebuild || mBvh.getCount() != count) {
+        // the BVH assigns slots in the order of the SoA
+        uint32_t* const slots = sceneData.data<BVH_SLOT>();
+        for (uint32_t i = 0; i < count; i++) {
+            slots[i] = i;
+        }
+        mBvh.build(worldAABBCenter, worldAABBExtent, count);
+        return;
+    }
+
+    // the SoA may have been reordered since the last call (e.g. by FView).
+    // Note that the BVH is only refit, not rebuilt, as renderables move, so its quality
+    // degrades until the next rebuild.
+    mBvh.setRows(sceneData.data<BVH_SLOT>(), count);
+    if (refit) {
+        mBvh.refit(worldAABBCenter, worldAABBExtent);
+    }
+}
+
+void FScene::gatherLights(const math::mat4f& worldOriginTansform) noexcept {
+    FEngine& engine = mEngine;
+    FTransformManager& tcm = engine.getTransformManager();
+    FLightManager& lcm = engine.getLightManager();
+    auto& lightData = mLightData;
+    auto const& lights = mLightInstances;
+
+    // we need the capacity to be padded for SIMD loops
+    const size_t capacity = LightSoa::getPaddedSize(lights.size() + DIRECTIONAL_LIGHTS_COUNT);
+
+    lightData.clear();
+    if (lightData.capacity() < capacity) {
+        lightData.setCapacity(capacity);
+    }
+    // the first entries are reserved for the directional lights (currently only one)
+    lightData.resize(DIRECTIONAL_LIGHTS_COUNT);
+
+
+    // find the max intensity directional light index in our local array
+    float maxIntensity = 0;
+
+    // the versions only ever increase, so their sum changes when one of the lights moves
+    uint64_t transformVersion = 0;
+
+    for (LightInstances const& instances : lights) {
+        auto li = instances.li;
+        auto ti = instances.ti;
+        transformVersion += tcm.getVersion(ti);
+
+        // get the world transform
+        const mat4f worldTransform = worldOriginTansform * tcm.getWorldTransform(ti);
+
+        // find the dominant directional light
+        if (UTILS_UNLIKELY(lcm.isDirectionalLight(li))) {
+            // we don't store the directional lights, because we only have a single one
+            if (lcm.getIntensity(li) >= maxIntensity) {
+                float3 d = lcm.getLocalDirection(li);
+                // using the inverse-transpose handles non-uniform scaling
+                d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+                lightData.elementAt<FScene::DIRECTION>(0)       = d;
+                lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = li;
+            }
+        } else {
+            const float4 p = worldTransform * float4{ lcm.getLocalPosition(li), 1 };
+            float3 d = 0;
+            if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
+                d = lcm.getLocalDirection(li);
+                // using the inverse-transpose handles non-uniform scaling
+                d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+            }
+            lightData.push_back_unsafe(
+                    float4{ p.xyz, lcm.getRadius(li) }, d, li, {}, {}, float2{ -1, 0 },
+                    float2{ lcm.getCosOuterSquared(li), lcm.getSinInverse(li) });
+        }
+    }
+
+    // a light that moved can change the lighting of the whole scene
+    if (transformVersion != mLightTransformVersion) {
+        mLightTransformVersion = transformVersion;
+        mDamageUnbounded = true;
+    }
+}
+
+void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables) noexcept {
     FRenderableManager& rcm = mEngine.getRenderableManager();
+    ReflectionProbes const& probes = mReflectionProbes;
+    const bool hasProbes = probes.hasProbes();
     auto& sceneData = mRenderableData;
     for (uint32_t i : visibleRenderables) {
         auto ri = sceneData.elementAt<RENDERABLE_INSTANCE>(i);
-        rcm.updateLocalUBO(ri, sceneData.elementAt<WORLD_TRANSFORM>(i));
+        // the renderable uses the probe around the center of its bounding box
+        const uint32_t probe = hasProbes ?
+                probes.select(sceneData.elementAt<WORLD_AABB_CENTER>(i)) : 0;
+        rcm.updateLocalUBO(ri, sceneData.elementAt<WORLD_TRANSFORM>(i), probe);
+    }
+    // in snapshot mode, the batched uniforms are the copy read by the passes
+    mHasBatchedUniforms = mUniformBatching || isSnapshotModeEnabled();
+    if (mHasBatchedUniforms) {
+        updateBatchedUniforms(visibleRenderables);
     }
 }
 
+static_assert(sizeof(FEngine::PerRenderableUib) <= FScene::BATCHED_UNIFORMS_STRIDE,
+        "the per-renderable uniforms don't fit in BATCHED_UNIFORMS_STRIDE");
+
+UTILS_NOINLINE
+void FScene::updateBatchedUniforms(utils::Range<uint32_t> visibleRenderables) noexcept {
+    SYSTRACE_CALL();
+
+    FRenderableManager const& rcm = mEngine.getRenderableManager();
+    FEngine::DriverApi& driver = mEngine.getDriverApi();
+    auto& sceneData = mRenderableData;
+    auto const* const UTILS_RESTRICT instances = sceneData.data<RENDERABLE_INSTANCE>();
+    auto* const UTILS_RESTRICT ubhs = sceneData.data<UBH>();
+
+    // the uniforms are indexed by renderable instance, so they stay at the same place from
+    // one frame to the next (which keeps the cached commands valid).
+    uint32_t maxInstance = 0;
+    for (uint32_t i : visibleRenderables) {
+        maxInstance = std::max(maxInstance, uint32_t(instances[i].asValue()));
+    }
+    const size_t size = (maxInstance + 1) * BATCHED_UNIFORMS_STRIDE;
+    if (UTILS_UNLIKELY(size > mBatchedUniforms.getSize())) {
+        // grow geometrically, because destroying a uniform buffer can stall the GPU
+        const size_t capacity = std::max(size, mBatchedUniforms.getSize() * 2);
+        if (mBatchedUbh) {
+            driver.destroyUniformBuffer(mBatchedUbh);
+        }
+        mBatchedUniforms = UniformBuffer(capacity);
+        mBatchedUbh = driver.createUniformBuffer(capacity);
+    }
+
+    for (uint32_t i : visibleRenderables) {
+        auto ri = instances[i];
+        memcpy(mBatchedUniforms.invalidateUniforms(
+                        ri.asValue() * BATCHED_UNIFORMS_STRIDE, sizeof(FEngine::PerRenderableUib)),
+                &rcm.getUniforms(ri), sizeof(FEngine::PerRenderableUib));
+        ubhs[i] = mBatchedUbh;
+    }
+
+    // a single upload for all renderables, instead of one per renderable
+    driver.updateUniformBuffer(mBatchedUbh, mBatchedUniforms.copyDirtyRange());
+    mBatchedUniforms.clean();
+}
+
+void FScene::setUniformBatching(bool enabled) noexcept {
+    if (mUniformBatching != enabled) {
+        mUniformBatching = enabled;
+        // the UBH column must be gathered again
+        mEntitiesDirty = true;
+    }
+}
+
+void FScene::setSnapshotCallback(SnapshotCallback callback, void* user) noexcept {
+    if (isSnapshotModeEnabled() != (callback != nullptr)) {
+        // the snapshot mode uses the batched uniforms, the UBH column must be gathered again
+        mEntitiesDirty = true;
+    }
+    mSnapshotCallback = callback;
+    mSnapshotUser = user;
+}
+
+static bool isValidReflectionProbe(size_t index) noexcept {
+    return ASSERT_PRECONDITION_NON_FATAL(index < CONFIG_MAX_REFLECTION_PROBES,
+            "reflection probe %u out of range (must be < %u)",
+            unsigned(index), unsigned(CONFIG_MAX_REFLECTION_PROBES));
+}
+
+void FScene::setReflectionProbe(size_t index, FTexture const* environment,
+        float3 const& position, Box const& box) noexcept {
+    if (!isValidReflectionProbe(index)) {
+        return;
+    }
+    if (!ASSERT_PRECONDITION_NON_FATAL(environment && environment->isCubemap(),
+            "the environment of a reflection probe must be a cubemap")) {
+        return;
+    }
+    mReflectionProbes.set(index, environment, position, box);
+    mEngine.contentChanged();
+}
+
+void FScene::removeReflectionProbe(size_t index) noexcept {
+    if (!isValidReflectionProbe(index)) {
+        return;
+    }
+    mReflectionProbes.remove(index);
+    mEngine.contentChanged();
+}
+
+void FScene::invalidateReflectionProbe(size_t index) noexcept {
+    if (!isValidReflectionProbe(index)) {
+        return;
+    }
+    mReflectionProbes.invalidate(index);
+    mEngine.contentChanged();
+}
+
 void FScene::terminate(FEngine& engine) {
+    engine.getEntityManager().unregisterListener(this);
     // free-up the lights buffer
     mGpuLightData.terminate(engine);
+    mReflectionProbes.terminate(engine.getDriverApi());
+    if (mBatchedUbh) {
+        engine.getDriverApi().destroyUniformBuffer(mBatchedUbh);
+    }
+}
+
+void FScene::onEntitiesDestroyed(size_t, Entity const*) noexcept {
+    // we can't access mEntities here, so we just force a rebuild during the next prepare()
+    mEntitiesDestroyed.store(true, std::memory_order_relaxed);
+}
+
+void FScene::onAllEntitiesDestroyed() noexcept {
+    mEntitiesDestroyed.store(true, std::memory_order_relaxed);
 }
 
 void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootArena) noexcept {
+    SYSTRACE_CONTEXT();
+
     FLightManager& lcm = mEngine.getLightManager();
     GpuLightBuffer& gpuLightData = mGpuLightData;
     FScene::LightSoa& lightData = getLightData();
@@ -194,7 +569,10 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
             [](auto const& lhs, auto const& rhs) { return lhs.second < rhs.second; });
 
     // drop excess lights
-    lightData.resize(std::min(lightData.size(), CONFIG_MAX_LIGHT_COUNT + DIRECTIONAL_LIGHTS_COUNT));
+    const size_t maxLightCount = CONFIG_MAX_LIGHT_COUNT + DIRECTIONAL_LIGHTS_COUNT;
+    SYSTRACE_VALUE32("droppedLights",
+            lightData.size() > maxLightCount ? lightData.size() - maxLightCount : 0);
+    lightData.resize(std::min(lightData.size(), maxLightCount));
 
     // compute the light ranges (needed when building light trees)
     float2* const zrange = lightData.data<FScene::SCREEN_SPACE_Z_RANGE>();
@@ -202,6 +580,7 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
 
     auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
     auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
+    auto const* UTILS_RESTRICT shadowParams = lightData.data<FScene::SHADOW_PARAMS>();
     for (size_t i = DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; ++i) {
         GpuLightBuffer::LightIndex gpuIndex = GpuLightBuffer::LightIndex(i - DIRECTIONAL_LIGHTS_COUNT);
         GpuLightBuffer::LightParameters& lp = gpuLightData.getLightParameters(gpuIndex);
@@ -210,6 +589,7 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
         lp.colorIntensity       = { lcm.getColor(li), lcm.getIntensity(li) };
         lp.directionIES         = { directions[i], 0 };
         lp.spotScaleOffset.xy   = { lcm.getSpotParams(li).scaleOffset };
+        lp.spotScaleOffset.zw   = shadowParams[i];
     }
 
     gpuLightData.invalidate(0, lightData.size() - DIRECTIONAL_LIGHTS_COUNT);
@@ -269,11 +649,13 @@ void FScene::computeLightRanges(
 }
 
 void FScene::addEntity(Entity entity) {
-    mEntities.insert(entity);
+    mEntitiesDirty |= mEntities.insert(entity).second;
+    mEngine.contentChanged();
 }
 
 void FScene::remove(Entity entity) {
-    mEntities.erase(entity);
+    mEntitiesDirty |= mEntities.erase(entity) != 0;
+    mEngine.contentChanged();
 }
 
 size_t FScene::getRenderableCount() const noexcept {
@@ -300,6 +682,11 @@ size_t FScene::getLightCount() const noexcept {
     return count;
 }
 
+void FScene::setIndirectLight(FIndirectLight const* ibl) noexcept {
+    mIndirectLight = ibl;
+    mEngine.contentChanged();
+}
+
 void FScene::setSkybox(FSkybox const* skybox) noexcept {
     std::swap(mSkybox, skybox);
     if (skybox) {
@@ -322,21 +709,43 @@ void FScene::computeBounds(
     float3 const* const UTILS_RESTRICT worldAABBExtent = soa.data<WORLD_AABB_EXTENT>();
     uint8_t const* const UTILS_RESTRICT layers = soa.data<LAYERS>();
     State const* const UTILS_RESTRICT visibility = soa.data<VISIBILITY_STATE>();
-    size_t c = soa.size();
-    for (size_t i = 0; i < c; i++) {
-        if (layers[i] & visibleLayers) {
-            const Aabb aabb{ worldAABBCenter[i] - worldAABBExtent[i],
-                             worldAABBCenter[i] + worldAABBExtent[i] };
-            if (visibility[i].castShadows) {
-                castersBox.min = min(castersBox.min, aabb.min);
-                castersBox.max = max(castersBox.max, aabb.max);
-            }
-            if (visibility[i].receiveShadows) {
-                receiversBox.min = min(receiversBox.min, aabb.min);
-                receiversBox.max = max(receiversBox.max, aabb.max);
+
+    struct Bounds {
+        Aabb casters;
+        Aabb receivers;
+    };
+
+    auto work = [=](uint32_t start, uint32_t count, Bounds& bounds) {
+        for (size_t i = start, c = start + count; i < c; i++) {
+            if (layers[i] & visibleLayers) {
+                const Aabb aabb{ worldAABBCenter[i] - worldAABBExtent[i],
+                                 worldAABBCenter[i] + worldAABBExtent[i] };
+                if (visibility[i].castShadows) {
+                    bounds.casters.min = min(bounds.casters.min, aabb.min);
+                    bounds.casters.max = max(bounds.casters.max, aabb.max);
+                }
+                if (visibility[i].receiveShadows) {
+                    bounds.receivers.min = min(bounds.receivers.min, aabb.min);
+                    bounds.receivers.max = max(bounds.receivers.max, aabb.max);
+                }
             }
         }
-    }
+    };
+
+    auto merge = [](Bounds& result, Bounds const& bounds) {
+        result.casters.min = min(result.casters.min, bounds.casters.min);
+        result.casters.max = max(result.casters.max, bounds.casters.max);
+        result.receivers.min = min(result.receivers.min, bounds.receivers.min);
+        result.receivers.max = max(result.receivers.max, bounds.receivers.max);
+    };
+
+    // every partial starts from the incoming boxes, which is harmless since min/max are idempotent
+    JobSystem& js = mEngine.getJobSystem();
+    const Bounds bounds = jobs::parallel_reduce(js, nullptr, 0, (uint32_t)soa.size(),
+            Bounds{ castersBox, receiversBox }, work, merge,
+            jobs::CountSplitter<JOBS_PARALLEL_FOR_RENDERABLES_COUNT * 16, 6>());
+    castersBox = bounds.casters;
+    receiversBox = bounds.receivers;
 }
 
 } // namespace details
@@ -371,4 +780,37 @@ size_t Scene::getLightCount() const noexcept {
     return upcast(this)->getLightCount();
 }
 
+void Scene::setUniformBatching(bool enabled) noexcept {
+    upcast(this)->setUniformBatching(enabled);
+}
+
+bool Scene::isUniformBatchingEnabled() const noexcept {
+    return upcast(this)->isUniformBatchingEnabled();
+}
+
+void Scene::setSnapshotCallback(SnapshotCallback callback, void* user) noexcept {
+    upcast(this)->setSnapshotCallback(callback, user);
+}
+
+bool Scene::isSnapshotModeEnabled() const noexcept {
+    return upcast(this)->isSnapshotModeEnabled();
+}
+
+void Scene::setReflectionProbe(size_t index, Texture const* environment,
+        math::float3 const& position, Box const& box) noexcept {
+    upcast(this)->setReflectionProbe(index, upcast(environment), position, box);
+}
+
+void Scene::removeReflectionProbe(size_t index) noexcept {
+    upcast(this)->removeReflectionProbe(index);
+}
+
+void Scene::invalidateReflectionProbe(size_t index) noexcept {
+    upcast(this)->invalidateReflectionProbe(index);
+}
+
+uint32_t Scene::getStaleReflectionProbes() const noexcept {
+    return upcast(this)->getStaleReflectionProbes();
+}
+
 } // namespace filament
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/ShadowAtlas.h"
+
+#include "components/LightManager.h"
+
+#include "details/Culler.h"
+#include "details/Engine.h"
+#include "details/ShadowMap.h"
+
+#include <filament/driver/DriverEnums.h>
+
+#include <math/scalar.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <string.h>
+
+using namespace math;
+using namespace utils;
+
+namespace filament {
+using namespace driver;
+
+namespace details {
+
+// the widest cone that fits in the light's projection is 2 * 80 degrees
+static constexpr float MAX_TAN_OUTER_CONE = 5.671f;
+
+// returns the position, in units of MIN_TILE_DIMENSION, of the tile at 'offset' along the
+// Z-order curve of the atlas
+static inline uint2 decodeMorton(uint32_t offset) noexcept {
+    uint2 p = 0;
+    for (uint32_t bit = 0; offset >> (2 * bit); bit++) {
+        p.x |= ((offset >> (2 * bit)) & 1u) << bit;
+        p.y |= ((offset >> (2 * bit + 1)) & 1u) << bit;
+    }
+    return p;
+}
+
+ShadowAtlas::ShadowAtlas(FEngine& engine) noexcept :
+        mEngine(engine),
+        mClipSpaceFlipped(engine.getBackend() == Backend::VULKAN) {
+    for (FCamera*& camera : mCameras) {
+        camera = mEngine.createCamera(EntityManager::get().create());
+    }
+}
+
+ShadowAtlas::~ShadowAtlas() {
+    for (FCamera* camera : mCameras) {
+        mEngine.destroy(camera->getEntity());
+    }
+}
+
+void ShadowAtlas::terminate(DriverApi& driverApi) noexcept {
+    if (mShadowMapRenderTarget) {
+        driverApi.destroyRenderTarget(mShadowMapRenderTarget);
+    }
+    if (mShadowMapHandle) {
+        driverApi.destroyTexture(mShadowMapHandle);
+    }
+}
+
+void ShadowAtlas::update(FScene::LightSoa& lightData, details::CameraInfo const& camera,
+        Frustum const& cullingFrustum, uint32_t maxMapSize) noexcept {
+    FLightManager const& lcm = mEngine.getLightManager();
+
+    auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
+    auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
+    auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
+    auto      * UTILS_RESTRICT shadowParams = lightData.data<FScene::SHADOW_PARAMS>();
+
+    // keep the shadows of the last frame, to find the ones that don't need to be rendered
+    std::swap(mShadows, mPreviousShadows);
+    mPreviousShadowCount = mShadowCount;
+
+    /*
+     * 1) Select the visible shadow casting spot lights covering most of the screen
+     */
+
+    const mat4f& projection = camera.cullingProjection;
+    const bool perspective = std::abs(projection[2].w) > std::numeric_limits<float>::epsilon();
+
+    std::array<uint32_t, CONFIG_MAX_SHADOW_CASTING_SPOTS> lights;
+    std::array<float, CONFIG_MAX_SHADOW_CASTING_SPOTS> coverages;
+    size_t count = 0;
+    for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; i++) {
+        FLightManager::Instance li = instances[i];
+        if (!lcm.isSpotLight(li) || !lcm.isShadowCaster(li) || !lcm.isLightCaster(li) ||
+                lcm.getIntensity(li) <= 0.0f || !Culler::intersects(cullingFrustum, spheres[i])) {
+            continue;
+        }
+
+        // fraction of the screen height covered by the light's sphere of influence
+        const float r = spheres[i].w;
+        const float z = -(camera.view * float4{ spheres[i].xyz, 1 }).z;
+        float coverage = 1.0f;
+        if (!perspective) {
+            coverage = std::min(1.0f, r * projection[1].y);
+        } else if (z > r) {
+            coverage = std::min(1.0f, r * projection[1].y / z);
+        }
+
+        // insertion in the list of selected lights, sorted by decreasing coverage
+        size_t j = std::min(count, CONFIG_MAX_SHADOW_CASTING_SPOTS - 1);
+        if (count == CONFIG_MAX_SHADOW_CASTING_SPOTS && coverage <= coverages[j]) {
+            continue;
+        }
+        for ( ; j > 0 && coverages[j - 1] < coverage; j--) {
+            coverages[j] = coverages[j - 1];
+            lights[j] = lights[j - 1];
+        }
+        coverages[j] = coverage;
+        lights[j] = uint32_t(i);
+        count = std::min(count + 1, CONFIG_MAX_SHADOW_CASTING_SPOTS);
+    }
+    mShadowCount = count;
+
+    /*
+     * 2) Size the tiles from the coverage, halving the largest ones until they all fit
+     */
+
+    size_t area = 0;
+    for (size_t s = 0; s < count; s++) {
+        const uint32_t mapSize = std::min({ lcm.getShadowMapSize(instances[lights[s]]),
+                ATLAS_DIMENSION, maxMapSize });
+        const float target = mapSize * coverages[s];
+        uint32_t dim = MIN_TILE_DIMENSION;
+        while (dim < target && dim < mapSize) {
+            dim *= 2;
+        }
+        mShadows[s].dimension = dim;
+        area += dim * dim;
+    }
+
+    // the tiles are packed by decreasing size, which leaves no holes
+    std::array<uint8_t, CONFIG_MAX_SHADOW_CASTING_SPOTS> order;
+    for (size_t s = 0; s < count; s++) {
+        order[s] = uint8_t(s);
+    }
+    std::stable_sort(order.begin(), order.begin() + count, [this](uint8_t lhs, uint8_t rhs) {
+        return mShadows[lhs].dimension > mShadows[rhs].dimension;
+    });
+
+    while (area > ATLAS_DIMENSION * ATLAS_DIMENSION) {
+        const uint32_t largest = mShadows[order[0]].dimension;
+        assert(largest > MIN_TILE_DIMENSION);
+        for (size_t s = 0; s < count && mShadows[order[s]].dimension == largest; s++) {
+            mShadows[order[s]].dimension /= 2;
+            area -= 3 * (largest / 2) * (largest / 2);
+        }
+    }
+
+    /*
+     * 3) Place the tiles and compute the light projections
+     */
+
+    uint32_t offset = 0;
+    for (size_t k = 0; k < count; k++) {
+        const size_t s = order[k];
+        const size_t i = lights[s];
+        FLightManager::Instance li = instances[i];
+        Shadow& shadow = mShadows[s];
+        shadow.light = li;
+
+        // each shadow map has a 1-texel border for when we index outside of it
+        const uint32_t dim = shadow.dimension;
+        const uint2 tile = decodeMorton(offset) * MIN_TILE_DIMENSION;
+        offset += (dim / MIN_TILE_DIMENSION) * (dim / MIN_TILE_DIMENSION);
+        shadow.viewport = { int32_t(tile.x + 1), int32_t(tile.y + 1), dim - 2, dim - 2 };
+
+        // the light looks down its direction, its projection encloses the cone
+        const float3 position = spheres[i].xyz;
+        const float3 direction = directions[i];
+        const float3 up = std::abs(direction.y) < 0.9f ? float3{ 0, 1, 0 } : float3{ 1, 0, 0 };
+        const mat4f M = mat4f::lookAt(position, position + direction, up);
+        const mat4f Mv = FCamera::rigidTransformInverse(M);
+
+        const float cosOuter = std::sqrt(lcm.getCosOuterSquared(li));
+        const float sinOuter = 1.0f / lcm.getSinInverse(li);
+        const float t = clamp(sinOuter / std::max(cosOuter, 1.0f / MAX_TAN_OUTER_CONE),
+                1.0f / 1024.0f, MAX_TAN_OUTER_CONE);
+        const float zf = spheres[i].w;
+        const float zn = std::max(0.01f, zf * (1.0f / 256.0f));
+        const mat4f Mp = mat4f::frustum(-t * zn, t * zn, -t * zn, t * zn, zn, zf);
+
+        const mat4f S = Mp * Mv;
+        shadow.lightSpace = getTextureCoordsMapping(shadow) * S;
+        shadow.sceneRange = zf - zn;
+        shadow.casters = 0;
+        shadow.updated = true;
+        mCameras[s]->setCustomProjection(mat4(S), zn, zf);
+
+        // the normal bias is scaled by the size of a texel at the fragment's distance
+        const float texelSizeAtUnitDistance = 2.0f * t / shadow.viewport.width;
+        shadowParams[i] = { float(s), lcm.getShadowNormalBias(li) * texelSizeAtUnitDistance };
+    }
+}
+
+void ShadowAtlas::setCasters(size_t shadow, uint64_t casters) noexcept {
+    Shadow& current = mShadows[shadow];
+    current.casters = casters;
+    current.updated = true;
+    if (!mShadowMapHandle) {
+        // the atlas is allocated this frame, everything must be rendered
+        return;
+    }
+    for (size_t i = 0; i < mPreviousShadowCount; i++) {
+        Shadow const& previous = mPreviousShadows[i];
+        if (previous.light == current.light) {
+            // the light space matrix captures both the light and its place in the atlas
+            current.updated = previous.casters != casters ||
+                    memcmp(&previous.lightSpace, &current.lightSpace, sizeof(mat4f)) != 0;
+            break;
+        }
+    }
+}
+
+void ShadowAtlas::prepare(DriverApi& driver, SamplerBuffer& sb, size_t index) noexcept {
+    if (!mShadowMapHandle) {
+        mShadowMapHandle = driver.createTexture(
+                Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::DEPTH16, 1,
+                ATLAS_DIMENSION, ATLAS_DIMENSION, 1, TextureUsage::DEPTH_ATTACHMENT);
+
+        mShadowMapRenderTarget = driver.createRenderTarget(
+                TargetBufferFlags::SHADOW, ATLAS_DIMENSION, ATLAS_DIMENSION, 1,
+                Driver::TextureFormat::DEPTH16, {}, { mShadowMapHandle }, {});
+    }
+    if (sb.getBuffer()[index].t.getId() != mShadowMapHandle.getId()) {
+        sb.setSampler(index, { mShadowMapHandle, ShadowMap::getSamplerParams() });
+    }
+}
+
+void ShadowAtlas::beginRenderPass(DriverApi& driver, size_t shadow) const noexcept {
+    Viewport const& viewport = mShadows[shadow].viewport;
+
+    // only clear this shadow map (and its border), the other ones may be kept
+    RenderPassParams params = {};
+    params.clear = TargetBufferFlags::SHADOW;
+    params.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
+    params.clearDepth = 1.0;
+    params.left = viewport.left - 1;
+    params.bottom = viewport.bottom - 1;
+    params.width = params.height = mShadows[shadow].dimension;
+    driver.beginRenderPass(mShadowMapRenderTarget, params);
+
+    driver.viewport(viewport.left, viewport.bottom, viewport.width, viewport.height);
+}
+
+mat4f ShadowAtlas::getTextureCoordsMapping(Shadow const& shadow) const noexcept {
+    // remapping from NDC to texture coordinates (i.e. [-1,1] -> [0, 1])
+    const mat4f Mt(mClipSpaceFlipped ? mat4f::row_major_init{
+            0.5f,   0,    0,  0.5f,
+              0, -0.5f,   0,  0.5f,
+              0,    0,  0.5f, 0.5f,
+              0,    0,    0,    1
+    } : mat4f::row_major_init{
+            0.5f,   0,    0,  0.5f,
+              0,  0.5f,   0,  0.5f,
+              0,    0,  0.5f, 0.5f,
+              0,    0,    0,    1
+    });
+
+    // then to the viewport of the shadow map in the atlas, i.e. inside its border
+    const float s = float(shadow.viewport.width) / ATLAS_DIMENSION;
+    const float ox = float(shadow.viewport.left) / ATLAS_DIMENSION;
+    const float oy = float(shadow.viewport.bottom) / ATLAS_DIMENSION;
+    const mat4f Mv(mat4f::row_major_init{
+             s, 0, 0, ox,
+             0, s, 0, oy,
+             0, 0, 1, 0,
+             0, 0, 0, 1
+    });
+
+    return Mv * Mt;
+}
+
+} // namespace details
+} // namespace filament
@@ -40,10 +40,26 @@ static constexpr bool USE_DEPTH_CLAMP = false;
 // currently disabled because it creates shadow acnee problems at a distance
 static constexpr bool ENABLE_LISPSM = true;
 
+// The cached static casters are kept as long as the light direction doesn't change by more than
+// about 0.25 degree, and the texels of the cached shadow map aren't more than 1.5 times as large
+// as the ones of a new shadow map would be.
+static constexpr float STATIC_CACHE_MIN_COS_ANGLE = 0.99999f;
+static constexpr float STATIC_CACHE_MAX_TEXEL_SIZE_RATIO = 1.5f;
+
+// With adaptiveMapSize, the shadow map is never smaller than this (unless mapSize is). It grows
+// as soon as the receivers need more texels, but only shrinks after a smaller size was enough
+// for this many frames, since each change re-renders all the cascades.
+static constexpr uint32_t ADAPTIVE_MIN_DIMENSION = 256;
+static constexpr uint32_t ADAPTIVE_DOWNSIZE_FRAME_COUNT = 30;
+
 ShadowMap::ShadowMap(FEngine& engine) noexcept :
         mEngine(engine),
-        mClipSpaceFlipped(engine.getBackend() == Backend::VULKAN) {
-    mCamera = mEngine.createCamera(EntityManager::get().create());
+        mClipSpaceFlipped(engine.getBackend() == Backend::VULKAN),
+        // the Vulkan backend doesn't implement blit() yet
+        mCanBlitDepth(engine.getBackend() == Backend::OPENGL) {
+    for (Cascade& cascade : mCascades) {
+        cascade.camera = mEngine.createCamera(EntityManager::get().create());
+    }
     mDebugCamera = mEngine.createCamera(EntityManager::get().create());
     FDebugRegistry& debugRegistry = engine.getDebugRegistry();
     debugRegistry.registerProperty("d.shadowmap.focus_shadowcasters", &engine.debug.shadowmap.focus_shadowcasters);
@@ -56,113 +72,173 @@ ShadowMap::ShadowMap(FEngine& engine) noexcept :
 }
 
 ShadowMap::~ShadowMap() {
-    mEngine.destroy(mCamera->getEntity());
+    for (Cascade& cascade : mCascades) {
+        mEngine.destroy(cascade.camera->getEntity());
+    }
     mEngine.destroy(mDebugCamera->getEntity());
 }
 
-void ShadowMap::prepare(DriverApi& driver, SamplerBuffer& sb) noexcept {
+void ShadowMap::prepare(DriverApi&, SamplerBuffer& sb) noexcept {
     assert(mShadowMapDimension);
 
-    uint32_t dim = mShadowMapDimension;
-    uint32_t currentDimension = mViewport.width + 2;
-    if (currentDimension == dim) {
-        // nothing to do here.
-        assert(mShadowMapHandle);
-        return;
+    // The textures come from the pool, so that the sizes picked with adaptiveMapSize (or by
+    // other views) are reused instead of being reallocated. They must be of the exact size
+    // requested, the shadow maps are sampled whole.
+    RenderTargetPool& pool = mEngine.getRenderTargetPool();
+    const uint32_t dim = mShadowMapDimension;
+    const uint32_t width = dim * mCascadeCount;
+    const bool reallocate = mTextureDimension != dim || mTextureCascadeCount != mCascadeCount;
+
+    // the cache of the static casters has the same layout as the shadow map
+    if (mStaticCacheTarget && (reallocate || !mCacheStaticCasters)) {
+        pool.put(mStaticCacheTarget);
+        mStaticCacheTarget = nullptr;
+    }
+    if (!mStaticCacheTarget && mCacheStaticCasters) {
+        mStaticCacheTarget = pool.get(TargetBufferFlags::SHADOW, width, dim, 1,
+                Driver::TextureFormat::DEPTH16, RenderTargetPool::Target::EXACT_SIZE);
     }
 
-    // destroy the current rendertarget and texture
-    if (mShadowMapRenderTarget) {
-        driver.destroyRenderTarget(mShadowMapRenderTarget);
+    if (!reallocate) {
+        assert(mShadowMapTarget);
+        // the view binds the spot lights' shadow atlas instead when this light is off
+        Handle<HwTexture> const texture = mShadowMapTarget->texture;
+        if (sb.getBuffer()[FEngine::PerViewSib::SHADOW_MAP].t.getId() != texture.getId()) {
+            sb.setSampler(FEngine::PerViewSib::SHADOW_MAP, { texture, getSamplerParams() });
+        }
+        return;
     }
-    if (mShadowMapHandle) {
-        driver.destroyTexture(mShadowMapHandle);
+
+    // return the current target to the pool
+    if (mShadowMapTarget) {
+        pool.put(mShadowMapTarget);
     }
 
     // allocate new ones...
-    // we set a viewport with a 1-texel border for when we index outside of the texture
-    // DON'T CHANGE this unless computeLightSpaceMatrix() is updated too.
-    // see: computeLightSpaceMatrix()
-    mViewport = { 1, 1, dim - 2, dim - 2 };
+    // the shadow maps of the cascades are side by side in the texture, each has a 1-texel
+    // border for when we index outside of it (see the viewports set in update()).
+    // DON'T CHANGE this unless getTextureCoordsMapping() and getAtlasMapping() are updated too.
+    mTextureDimension = dim;
+    mTextureCascadeCount = mCascadeCount;
 
-    mShadowMapHandle = driver.createTexture(
-            Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::DEPTH16, 1, dim, dim, 1,
-            TextureUsage::DEPTH_ATTACHMENT);
+    mShadowMapTarget = pool.get(TargetBufferFlags::SHADOW, width, dim, 1,
+            Driver::TextureFormat::DEPTH16, RenderTargetPool::Target::EXACT_SIZE);
 
-    mShadowMapRenderTarget = driver.createRenderTarget(
-            TargetBufferFlags::SHADOW, dim, dim, 1, Driver::TextureFormat::DEPTH16,
-            {}, { mShadowMapHandle }, {});
+    sb.setSampler(FEngine::PerViewSib::SHADOW_MAP,
+            { mShadowMapTarget->texture, getSamplerParams() });
+}
 
+SamplerParams ShadowMap::getSamplerParams() noexcept {
     SamplerParams s;
     s.filterMag = SamplerMagFilter::LINEAR;
     s.filterMin = SamplerMinFilter::LINEAR;
     s.compareFunc = SamplerCompareFunc::LE;
     s.compareMode = SamplerCompareMode::COMPARE_TO_TEXTURE;
     s.depthStencil = true;
-    sb.setSampler(FEngine::PerViewSib::SHADOW_MAP, { mShadowMapHandle, s });
+    return s;
 }
 
-void ShadowMap::terminate(DriverApi& driverApi) noexcept {
-    if (mShadowMapRenderTarget) {
-        driverApi.destroyRenderTarget(mShadowMapRenderTarget);
+void ShadowMap::terminate(DriverApi&) noexcept {
+    RenderTargetPool& pool = mEngine.getRenderTargetPool();
+    if (mShadowMapTarget) {
+        pool.put(mShadowMapTarget);
+        mShadowMapTarget = nullptr;
     }
-    if (mShadowMapHandle) {
-        driverApi.destroyTexture(mShadowMapHandle);
+    if (mStaticCacheTarget) {
+        pool.put(mStaticCacheTarget);
+        mStaticCacheTarget = nullptr;
     }
 }
 
-void ShadowMap::beginRenderPass(DriverApi& driver) const noexcept {
+void ShadowMap::beginRenderPass(DriverApi& driver, size_t cascade,
+        bool staticCache) const noexcept {
     RenderPassParams params = {};
     params.clear = TargetBufferFlags::SHADOW;
-    params.discardStart = TargetBufferFlags::DEPTH;
     params.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
     params.clearDepth = 1.0;
     params.width = params.height = mShadowMapDimension;
-    // Disable scissor and viewport to avoid bugs in some drivers where the GPU memory is reloaded
-    // needlessly.
-    params.clear |= RenderPassParams::IGNORE_SCISSOR | RenderPassParams::IGNORE_VIEWPORT;
-    driver.beginRenderPass(mShadowMapRenderTarget, params);
+    if (mCacheStaticCasters && !staticCache) {
+        // the dynamic casters are rendered on top of the copy of the static ones, keep the
+        // depth (the SHADOW bits without DEPTH still select the shadow pass' states)
+        params.clear = TargetBufferFlags::SHADOW & ~TargetBufferFlags::DEPTH;
+        params.left = int32_t(cascade * mShadowMapDimension);
+        params.bottom = 0;
+    } else if (mCascadeCount == 1) {
+        params.discardStart = TargetBufferFlags::DEPTH;
+        // Disable scissor and viewport to avoid bugs in some drivers where the GPU memory is
+        // reloaded needlessly.
+        params.clear |= RenderPassParams::IGNORE_SCISSOR | RenderPassParams::IGNORE_VIEWPORT;
+    } else {
+        // only clear this cascade's shadow map (and its border), the shadow maps of the
+        // cascades not rendered this frame must be kept.
+        params.left = int32_t(cascade * mShadowMapDimension);
+        params.bottom = 0;
+    }
+    driver.beginRenderPass(staticCache ? mStaticCacheTarget->target : mShadowMapTarget->target,
+            params);
+
+    Viewport const& viewport = mCascades[cascade].viewport;
+    driver.viewport(viewport.left, viewport.bottom, viewport.width, viewport.height);
+}
+
+void ShadowMap::copyStaticCache(DriverApi& driver, size_t cascade) const noexcept {
+    // the whole shadow map of the cascade, including its border
+    const int32_t left = int32_t(cascade * mShadowMapDimension);
+    const uint32_t dim = mShadowMapDimension;
+    driver.blit(TargetBufferFlags::DEPTH,
+            mShadowMapTarget->target, left, 0, dim, dim,
+            mStaticCacheTarget->target, left, 0, dim, dim);
+}
 
-    driver.viewport(mViewport.left, mViewport.bottom,
-            mViewport.width, mViewport.height);
+void ShadowMap::setStaticCasters(size_t cascade, uint64_t casters) noexcept {
+    Cascade& c = mCascades[cascade];
+    c.staticCacheUpdated = !c.staticCacheValid || c.staticCasters != casters;
+    c.staticCasters = casters;
+    c.staticCacheValid = true;
 }
 
 void ShadowMap::update(
         const FScene::LightSoa& lightData, size_t index, FScene const* scene,
-        details::CameraInfo const& camera, uint8_t visibleLayers) noexcept {
+        details::CameraInfo const& camera, Viewport const& viewport,
+        uint8_t visibleLayers, uint32_t maxMapSize) noexcept {
     // this is the hard part here, find a good frustum for our camera
 
     auto& lcm = mEngine.getLightManager();
 
     FLightManager::Instance li = lightData.elementAt<FScene::LIGHT_INSTANCE>(index);
-    mShadowMapDimension = std::max(1u, lcm.getShadowMapSize(li));
+
+    using Type = FLightManager::Type;
+    const Type type = lcm.getType(li);
+    const bool isDirectional = type == Type::SUN || type == Type::DIRECTIONAL;
 
     FLightManager::ShadowParams params = lcm.getShadowParams(li);
-    mat4f projection(camera.cullingProjection);
-    if (params.shadowFar > 0.0f) {
-        float n = camera.zn;
-        float f = params.shadowFar;
-        if (std::abs(projection[2].w) <= std::numeric_limits<float>::epsilon()) {
-            // perspective projection
-            projection[2].z =     (f + n) / (n - f);
-            projection[3].z = (2 * f * n) / (n - f);
-        } else {
-            // ortho projection
-            projection[2].z =    2.0f / (n - f);
-            projection[3].z = (f + n) / (n - f);
+    mCascadeCount = isDirectional ? params.shadowCascades : uint8_t(1);
+
+    // With adaptiveMapSize, mapSize is the largest size and the size measured during the
+    // previous frames is used, since the light frustums depend on it.
+    const uint32_t maxDimension = std::max(1u, std::min(lcm.getShadowMapSize(li), maxMapSize));
+    mAdaptiveMapSize = params.adaptiveMapSize && isDirectional;
+    if (mAdaptiveMapSize) {
+        if (!mAdaptiveDimension) {
+            mAdaptiveDimension = maxDimension;
         }
+        mShadowMapDimension = clamp(mAdaptiveDimension,
+                std::min(ADAPTIVE_MIN_DIMENSION, maxDimension), maxDimension);
+    } else {
+        mShadowMapDimension = maxDimension;
+        mAdaptiveDimension = 0;
     }
 
     CameraInfo cameraInfo = {
-            .projection = projection,
+            .projection = camera.cullingProjection,
             .model = camera.model,
             .view = camera.view,
+            .worldOrigin = camera.worldOrigin,
             .zn = camera.zn,
             .zf = camera.zf,
             .dzn = std::max(0.0f, params.shadowNearHint - camera.zn),
             .dzf = std::max(0.0f, camera.zf - params.shadowFarHint),
-            .frustum = Frustum(projection * camera.view),
-            .worldOrigin = camera.worldOrigin
+            .viewportHeight = viewport.height,
     };
 
     // debugging...
@@ -174,32 +250,136 @@ void ShadowMap::update(
     if (dzf > 0)    dzf =-cameraInfo.dzf / dz;
     else            cameraInfo.dzf =-dzf * dz;
 
+    // The first cascade is rendered every frame, the others every other frame, alternating
+    // between the odd and even ones. All cascades are rendered when the texture is
+    // (re)allocated, since their content is lost.
+    const bool updateAll = mTextureDimension != mShadowMapDimension
+            || mTextureCascadeCount != mCascadeCount;
+    mFrameCount++;
+
+    // The static casters can only be cached when the depth can be copied. Their cache is lost
+    // with the textures, or when it wasn't allocated yet.
+    mCacheStaticCasters = params.cacheStaticCasters && isDirectional && mCanBlitDepth;
+    if (updateAll || !mCacheStaticCasters || !mStaticCacheTarget) {
+        for (Cascade& cascade : mCascades) {
+            cascade.staticCacheValid = false;
+        }
+    }
 
-    using Type = FLightManager::Type;
-    switch (lcm.getType(li)) {
-        case Type::SUN:
-        case Type::DIRECTIONAL:
-            computeShadowCameraDirectional(
-                    lightData.elementAt<FScene::DIRECTION>(index), scene, cameraInfo,
-                    visibleLayers);
-            break;
-        case Type::FOCUSED_SPOT:
-        case Type::SPOT:
-            break;
-        case Type::POINT:
-            break;
+    // the cascades split the range between the camera near plane and shadowFar
+    const float zn = camera.zn;
+    const float zf = params.shadowFar > 0.0f ? params.shadowFar : camera.zf;
+
+    mHasVisibleShadows = false;
+    for (size_t c = 0; c < mCascadeCount; c++) {
+        Cascade& cascade = mCascades[c];
+        const bool isLast = c == mCascadeCount - 1u;
+        const float n = c ? zn + (zf - zn) * params.cascadeSplitPositions[c - 1] : zn;
+        const float f = isLast ? zf : zn + (zf - zn) * params.cascadeSplitPositions[c];
+
+        // the last cascade covers everything behind the previous ones (see getShadowCascade())
+        cascade.split = isLast ? std::numeric_limits<float>::max() : f;
+        cascade.viewport = { int32_t(c * mShadowMapDimension + 1), 1,
+                mShadowMapDimension - 2, mShadowMapDimension - 2 };
+        cascade.updated = updateAll || c == 0 || ((mFrameCount + c) & 1u) == 0;
+        if (!cascade.updated) {
+            mHasVisibleShadows |= cascade.hasVisibleShadows;
+            continue;
+        }
+
+        mat4f projection(camera.cullingProjection);
+        if (params.shadowFar > 0.0f || mCascadeCount > 1) {
+            if (std::abs(projection[2].w) <= std::numeric_limits<float>::epsilon()) {
+                // perspective projection
+                projection[2].z =     (f + n) / (n - f);
+                projection[3].z = (2 * f * n) / (n - f);
+            } else {
+                // ortho projection
+                projection[2].z =    2.0f / (n - f);
+                projection[3].z = (f + n) / (n - f);
+            }
+        }
+        cameraInfo.projection = projection;
+        cameraInfo.frustum = Frustum(projection * camera.view);
+
+        cascade.hasVisibleShadows = false;
+        switch (type) {
+            case Type::SUN:
+            case Type::DIRECTIONAL:
+                computeShadowCameraDirectional(
+                        lightData.elementAt<FScene::DIRECTION>(index), scene, cameraInfo,
+                        visibleLayers, c);
+                break;
+            case Type::FOCUSED_SPOT:
+            case Type::SPOT:
+                break;
+            case Type::POINT:
+                break;
+        }
+        mHasVisibleShadows |= cascade.hasVisibleShadows;
+    }
+
+    if (mAdaptiveMapSize) {
+        updateAdaptiveDimension(maxDimension);
+    }
+}
+
+float ShadowMap::computeDesiredDimension(CameraInfo const& camera, float texelSizeWs,
+        size_t vertexCount) const noexcept {
+    // the closest visible receivers need the smallest texels
+    float z = std::numeric_limits<float>::max();
+    for (size_t i = 0; i < vertexCount; i++) {
+        z = std::min(z, -mat4f::project(camera.view, mWsClippedShadowReceiverVolume[i]).z);
+    }
+    z = std::max(z, camera.zn);
+
+    // the size of a pixel at that distance, the viewport is already scaled by the dynamic
+    // resolution, so fewer texels are needed when the view is downscaled
+    const mat4f& p = camera.projection;
+    const bool isPerspective = p[2].w != 0.0f;
+    const float pixelSizeWs = (isPerspective ? 2.0f * z : 2.0f)
+            / (p[1].y * float(std::max(1u, camera.viewportHeight)));
+
+    // the texels count of the shadow map scales with its size, the ratio doesn't
+    return float(mShadowMapDimension) * texelSizeWs / pixelSizeWs;
+}
+
+void ShadowMap::updateAdaptiveDimension(uint32_t maxDimension) noexcept {
+    // the cascades share the texture, the one that needs the most texels decides
+    float desired = 0.0f;
+    for (size_t c = 0; c < mCascadeCount; c++) {
+        Cascade const& cascade = mCascades[c];
+        if (cascade.hasVisibleShadows) {
+            desired = std::max(desired, cascade.desiredDimension);
+        }
+    }
+
+    // the sizes are powers of two, so that few of them are pooled
+    uint32_t dim = std::min(ADAPTIVE_MIN_DIMENSION, maxDimension);
+    while (dim < maxDimension && float(dim) < desired) {
+        dim *= 2;
+    }
+
+    if (dim >= mShadowMapDimension) {
+        mAdaptiveDimension = dim;
+        mAdaptiveDownsizeFrames = 0;
+    } else if (++mAdaptiveDownsizeFrames >= ADAPTIVE_DOWNSIZE_FRAME_COUNT) {
+        mAdaptiveDimension = dim;
+        mAdaptiveDownsizeFrames = 0;
     }
 }
 
 void ShadowMap::computeShadowCameraDirectional(
         math::float3 const& dir, FScene const* scene, CameraInfo const& camera,
-        uint8_t visibleLayers) noexcept {
+        uint8_t visibleLayers, size_t index) noexcept {
+
+    Cascade& cascade = mCascades[index];
 
     // scene bounds in world space
     Aabb wsShadowCastersVolume, wsShadowReceiversVolume;
     scene->computeBounds(wsShadowCastersVolume, wsShadowReceiversVolume, visibleLayers);
     if (wsShadowCastersVolume.isEmpty() || wsShadowReceiversVolume.isEmpty()) {
-        mHasVisibleShadows = false;
+        cascade.hasVisibleShadows = false;
         return;
     }
 
@@ -212,9 +392,12 @@ void ShadowMap::computeShadowCameraDirectional(
     size_t vertexCount = intersectFrustumWithBox(mWsClippedShadowReceiverVolume,
             camera.frustum, wsViewFrustumCorners, wsShadowReceiversVolume);
 
-    mHasVisibleShadows = vertexCount >= 2;
-    if (mHasVisibleShadows) {
-        const bool USE_LISPSM = ENABLE_LISPSM && mEngine.debug.shadowmap.lispsm;
+    cascade.hasVisibleShadows = vertexCount >= 2;
+    if (cascade.hasVisibleShadows) {
+        // with several cascades, the resolution is already distributed along the view
+        // direction by the cascades themselves.
+        const bool USE_LISPSM = ENABLE_LISPSM && mEngine.debug.shadowmap.lispsm
+                && mCascadeCount == 1;
 
         /*
          * Compute the light's model matrix
@@ -331,9 +514,9 @@ void ShadowMap::computeShadowCameraDirectional(
 
         // For directional lights, we further constraint the light frustum to the
         // intersection of the shadow casters & receivers in light-space.
-        // However, since this relies on the 1-texel shadow map border, this wouldn't directly
-        // work if we were storing several shadow maps in a single texture.
-        if (mEngine.debug.shadowmap.focus_shadowcasters) {
+        // However, since this relies on the 1-texel shadow map border, this doesn't work when
+        // the shadow maps of several cascades are stored in a single texture.
+        if (mEngine.debug.shadowmap.focus_shadowcasters && mCascadeCount == 1) {
             intersectWithShadowCasters(lsLightFrustum, WLMpMv, wsShadowCastersVolume);
         }
 
@@ -341,7 +524,7 @@ void ShadowMap::computeShadowCameraDirectional(
                            (lsLightFrustum.min.y >= lsLightFrustum.max.y))) {
             // this could happen if the only thing visible is a perfectly horizontal or
             // vertical thin line
-            mHasVisibleShadows = false;
+            cascade.hasVisibleShadows = false;
             return;
         }
 
@@ -376,15 +559,93 @@ void ShadowMap::computeShadowCameraDirectional(
 
         // Final shadowmap texture transform
         const mat4f St = mat4f(MbMt * S);
+        const float texelSizeWs = texelSizeWorldSpace(St, float3{ 0.5f });
+        if (mAdaptiveMapSize) {
+            // measured even when the cached light frustum is kept below
+            cascade.desiredDimension = computeDesiredDimension(camera, texelSizeWs, vertexCount);
+        }
+
+        if (cascade.staticCacheValid) {
+            if (canKeepStaticCache(cascade, dir, znear, zfar, texelSizeWs, vertexCount)) {
+                // keep the light frustum the cached static casters were rendered with
+                return;
+            }
+            cascade.staticCacheValid = false;
+        }
+        cascade.staticCacheDirection = dir;
+        cascade.staticCacheNear = znear;
+        cascade.staticCacheFar = zfar;
+
+        cascade.texelSizeWs = texelSizeWs;
+        cascade.lightSpace = getAtlasMapping(index) * St;
+        cascade.sceneRange = (zfar - znear);
+        cascade.camera->setCustomProjection(mat4(S), znear, zfar);
+
+        if (index == 0) {
+            // for the debug camera, we need to undo the world origin
+            mDebugCamera->setCustomProjection(mat4(S * camera.worldOrigin), znear, zfar);
+        }
+    }
+}
+
+bool ShadowMap::computeShadowReceiversVolume(Frustum& volume, float3 const& dir,
+        Aabb const& wsVisibleReceivers, Aabb const& wsShadowCasters) noexcept {
+    // same light space as computeShadowCameraDirectional(), without the rotation around z
+    const mat4f M = mat4f::lookAt(float3{ 0, 0, 0 }, dir, float3{ 0, 1, 0 });
+    const mat4f Mv = FCamera::rigidTransformInverse(M);
+
+    // bounds of the visible receivers in light space
+    Aabb lsReceivers;
+    const float3 bmin = wsVisibleReceivers.min;
+    const float3 bmax = wsVisibleReceivers.max;
+    for (size_t i = 0; i < 8; i++) {
+        const float3 corner{ (i & 1u) ? bmax.x : bmin.x, (i & 2u) ? bmax.y : bmin.y,
+                (i & 4u) ? bmax.z : bmin.z };
+        const float3 v = mat4f::project(Mv, corner);
+        lsReceivers.min = min(lsReceivers.min, v);
+        lsReceivers.max = max(lsReceivers.max, v);
+    }
+
+    // the volume extends from the farthest receivers to the closest casters, the light looks
+    // down the -z axis
+    const float znear = -std::max(computeNearFar(Mv, wsShadowCasters).x, lsReceivers.max.z);
+    const float zfar = -lsReceivers.min.z;
+    if (!(lsReceivers.min.x < lsReceivers.max.x && lsReceivers.min.y < lsReceivers.max.y
+            && znear < zfar)) {
+        return false;
+    }
 
-        mTexelSizeWs = texelSizeWorldSpace(St, float3{ 0.5f });
-        mLightSpace = St;
-        mSceneRange = (zfar - znear);
-        mCamera->setCustomProjection(mat4(S), znear, zfar);
+    volume = Frustum(mat4f::ortho(
+            lsReceivers.min.x, lsReceivers.max.x, lsReceivers.min.y, lsReceivers.max.y,
+            znear, zfar) * Mv);
+    return true;
+}
+
+bool ShadowMap::canKeepStaticCache(Cascade const& cascade, float3 const& direction,
+        float znear, float zfar, float texelSizeWs, size_t vertexCount) const noexcept {
+    if (dot(cascade.staticCacheDirection, direction) < STATIC_CACHE_MIN_COS_ANGLE) {
+        return false;
+    }
+
+    // The z axis of the light space is the light direction, so the depth ranges can be compared.
+    // The cached one must contain the casters and receivers the new one would.
+    if (znear < cascade.staticCacheNear || zfar > cascade.staticCacheFar) {
+        return false;
+    }
+
+    if (cascade.texelSizeWs > texelSizeWs * STATIC_CACHE_MAX_TEXEL_SIZE_RATIO) {
+        return false;
+    }
 
-        // for the debug camera, we need to undo the world origin
-        mDebugCamera->setCustomProjection(mat4(S * camera.worldOrigin), znear, zfar);
+    // finally, the cached light frustum must still cover the visible shadow receivers
+    const mat4f S(cascade.camera->getProjectionMatrix());
+    for (size_t i = 0; i < vertexCount; ++i) {
+        const float3 v = mat4f::project(S, mWsClippedShadowReceiverVolume[i]);
+        if (std::abs(v.x) > 1.0f || std::abs(v.y) > 1.0f) {
+            return false;
+        }
     }
+    return true;
 }
 
 mat4f ShadowMap::applyLISPSM(CameraInfo const& camera, float dzn, float dzf, mat4f const& LMpMv,
@@ -490,6 +751,20 @@ mat4f ShadowMap::getTextureCoordsMapping() const noexcept {
     return Mb * Mt;
 }
 
+mat4f ShadowMap::getAtlasMapping(size_t cascade) const noexcept {
+    // remaps the texture coordinates of the cascade's shadow map to its place in the texture,
+    // the shadow maps of the cascades are side by side.
+    const float s = 1.0f / mCascadeCount;
+    const float o = cascade * s;
+    const mat4f Ma(mat4f::row_major_init{
+             s, 0, 0, o,
+             0, 1, 0, 0,
+             0, 0, 1, 0,
+             0, 0, 0, 1
+    });
+    return Ma;
+}
+
 // This construct a frustum (similar to glFrustum or math::frustum), except
 // it looks towards the +y axis, and assumes -1,1 for the left/right and bottom/top planes.
 mat4f ShadowMap::warpFrustum(float n, float f) noexcept {
@@ -90,14 +90,21 @@ FStream::FStream(FEngine& engine, const Builder& builder) noexcept
     if (mNativeStream) {
         // Note: this is a synchronous call. On Android, this calls back into Java.
         mStreamHandle = engine.getDriverApi().createStream(mNativeStream);
+        engine.producerStreamCreated();
     } else if (mExternalTextureId) {
         mStreamHandle = engine.getDriverApi().createStreamFromTextureId(
                 mExternalTextureId, mWidth, mHeight);
+        engine.producerStreamCreated();
+    } else {
+        mStreamHandle = engine.getDriverApi().createStreamAcquired();
     }
 }
 
 void FStream::terminate(FEngine& engine) noexcept {
     engine.getDriverApi().destroyStream(mStreamHandle);
+    if (!isAcquiredStream()) {
+        engine.producerStreamDestroyed();
+    }
 }
 
 void FStream::setDimensions(uint32_t width, uint32_t height) noexcept {
@@ -110,6 +117,33 @@ void FStream::setDimensions(uint32_t width, uint32_t height) noexcept {
         FFence::waitAndDestroy(mEngine.createFence(Fence::Type::SOFT), Fence::Mode::FLUSH);
     }
     mEngine.getDriverApi().setStreamDimensions(mStreamHandle, mWidth, mHeight);
+    mEngine.contentChanged();
+}
+
+void FStream::setAcquiredImage(void* image, Callback callback, void* userData,
+        int64_t timestamp) noexcept {
+    if (!ASSERT_PRECONDITION_NON_FATAL(isAcquiredStream(),
+            "setAcquiredImage() can only be used with acquired streams")) {
+        return;
+    }
+
+    // the driver releases the image with a BufferDescriptor callback, which has a
+    // different signature than ours
+    struct Release {
+        Callback callback;
+        void* userData;
+    };
+    BufferDescriptor descriptor(image, 0, [](void* image, size_t, void* user) {
+        Release* release = static_cast<Release*>(user);
+        if (release->callback) {
+            release->callback(image, release->userData);
+        }
+        delete release;
+    }, new Release{ callback, userData });
+
+    mTimestamp = timestamp;
+    mEngine.getDriverApi().setAcquiredImage(mStreamHandle, std::move(descriptor));
+    mEngine.contentChanged();
 }
 
 void FStream::readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
@@ -150,6 +184,15 @@ void Stream::setDimensions(uint32_t width, uint32_t height) noexcept {
     upcast(this)->setDimensions(width, height);
 }
 
+void Stream::setAcquiredImage(void* image, Callback callback, void* userData,
+        int64_t timestamp) noexcept {
+    upcast(this)->setAcquiredImage(image, callback, userData, timestamp);
+}
+
+int64_t Stream::getTimestamp() const noexcept {
+    return upcast(this)->getTimestamp();
+}
+
 void Stream::readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
         driver::PixelBufferDescriptor&& buffer) noexcept {
     upcast(this)->readPixels(xoffset, yoffset, width, height, std::move(buffer));
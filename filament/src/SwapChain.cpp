@@ -27,6 +27,11 @@ FSwapChain::FSwapChain(FEngine& engine, void* nativeWindow, uint64_t flags)
     mSwapChain = engine.getDriverApi().createSwapChain(nativeWindow, mConfigFlags);
 }
 
+FSwapChain::FSwapChain(FEngine& engine, uint32_t width, uint32_t height, uint64_t flags) {
+    mConfigFlags = flags;
+    mSwapChain = engine.getDriverApi().createSwapChainHeadless(width, height, mConfigFlags);
+}
+
 void FSwapChain::terminate(FEngine& engine) noexcept {
     engine.getDriverApi().destroySwapChain(mSwapChain);
 }
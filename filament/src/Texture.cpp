@@ -36,6 +36,7 @@ struct Texture::BuilderDetails {
     Sampler mTarget = Sampler::SAMPLER_2D;
     InternalFormat mFormat = InternalFormat::RGBA8;
     Usage mUsage = Usage::DEFAULT;
+    bool mStreaming = false;
 };
 
 using BuilderType = Texture;
@@ -82,11 +83,21 @@ Texture::Builder& Texture::Builder::usage(Texture::Usage usage) noexcept {
     return *this;
 }
 
+Texture::Builder& Texture::Builder::streaming(bool enabled) noexcept {
+    mImpl->mStreaming = enabled;
+    return *this;
+}
+
 Texture* Texture::Builder::build(Engine& engine) {
     if (!ASSERT_POSTCONDITION_NON_FATAL(Texture::isTextureFormatSupported(engine, mImpl->mFormat),
             "Texture format %u not supported on this platform", mImpl->mFormat)) {
         return nullptr;
     }
+    if (!ASSERT_PRECONDITION_NON_FATAL(!mImpl->mStreaming ||
+            mImpl->mTarget != Sampler::SAMPLER_EXTERNAL,
+            "external textures can't be streaming")) {
+        return nullptr;
+    }
     return upcast(engine).createTexture(*this);
 }
 
@@ -107,11 +118,27 @@ FTexture::FTexture(FEngine& engine, const Builder& builder) {
     FEngine::DriverApi& driver = engine.getDriverApi();
     mHandle = driver.createTexture(
             mTarget, mLevels, mFormat, mSampleCount, mWidth, mHeight, mDepth, mUsage);
+
+    if (builder->mStreaming) {
+        // nothing is resident, the coarsest level is requested until the texture is drawn
+        mStreaming = true;
+        mResidentLevel = mLevels;
+        mRequestedLevel = uint8_t(mLevels - 1);
+        mNeededLevel = mLevels;
+        engine.getTextureStreamer().add(this);
+    }
 }
 
 // frees driver resources, object becomes invalid
 void FTexture::terminate(FEngine& engine) {
     FEngine::DriverApi& driver = engine.getDriverApi();
+    if (mStreaming) {
+        engine.getTextureStreamer().remove(this);
+    }
+    BindlessTextureTable& bindlessTextures = engine.getBindlessTextureTable();
+    if (bindlessTextures.isSupported()) {
+        bindlessTextures.remove(mHandle);
+    }
     driver.destroyTexture(mHandle);
 }
 
@@ -138,6 +165,7 @@ void FTexture::setImage(FEngine& engine,
         if (buffer.buffer) {
             engine.getDriverApi().load2DImage(mHandle,
                     uint8_t(level), xoffset, yoffset, width, height, std::move(buffer));
+            engine.contentChanged();
         }
     }
 }
@@ -148,6 +176,7 @@ void FTexture::setImage(FEngine& engine, size_t level,
         if (buffer.buffer) {
             engine.getDriverApi().loadCubeImage(mHandle, uint8_t(level),
                     std::move(buffer), faceOffsets);
+            engine.contentChanged();
         }
     }
 }
@@ -155,6 +184,7 @@ void FTexture::setImage(FEngine& engine, size_t level,
 void FTexture::setExternalImage(FEngine& engine, void* image) noexcept {
     if (mTarget == Sampler::SAMPLER_EXTERNAL) {
         engine.getDriverApi().setExternalImage(mHandle, image);
+        engine.contentChanged();
     }
 }
 
@@ -170,15 +200,50 @@ void FTexture::setExternalStream(FEngine& engine, FStream* stream) noexcept {
         mStream = nullptr;
         engine.getDriverApi().setExternalStream(mHandle, Handle<HwStream>());
     }
+    engine.contentChanged();
 }
 
 void FTexture::generateMipmaps(FEngine& engine) const noexcept {
     if ((mTarget == Sampler::SAMPLER_2D || mTarget == Sampler::SAMPLER_CUBEMAP)
             && mLevels > 1) {
         engine.getDriverApi().generateMipmaps(mHandle);
+        engine.contentChanged();
+    }
+}
+
+void FTexture::makeResident(FEngine& engine, size_t baseLevel) noexcept {
+    if (!ASSERT_PRECONDITION_NON_FATAL(baseLevel < mLevels, "baseLevel must be < levels")) {
+        return;
+    }
+    if (mStreaming && mResidentLevel != baseLevel) {
+        mResidentLevel = uint8_t(baseLevel);
+        engine.getDriverApi().setTextureBaseLevel(mHandle, mResidentLevel);
+        engine.contentChanged();
     }
 }
 
+void FTexture::requestSize(float pixels) noexcept {
+    // the level whose size is the closest to the number of pixels, rounding towards finer
+    // levels, e.g. a 1024 texels texture drawn over 300 pixels needs level 1 (512 texels)
+    const float size = float(std::max(mWidth, mHeight));
+    uint8_t level = 0;
+    if (pixels < size) {
+        level = uint8_t(std::min(std::ilogbf(size / std::max(pixels, 1.0f)), int(mLevels - 1)));
+    }
+    mNeededLevel = std::min(mNeededLevel, level);
+}
+
+size_t FTexture::getLevelsSize(size_t baseLevel) const noexcept {
+    // compressed formats don't have a size per texel, they're counted as 1 byte per texel
+    const size_t texelSize = std::max(size_t(1), getFormatSize(mFormat));
+    const size_t faces = isCubemap() ? 6 : 1;
+    size_t size = 0;
+    for (size_t level = baseLevel; level < mLevels; level++) {
+        size += getWidth(level) * getHeight(level) * getDepth(level) * faces * texelSize;
+    }
+    return size;
+}
+
 bool FTexture::isTextureFormatSupported(FEngine& engine, InternalFormat format) noexcept {
     return engine.getDriverApi().isTextureFormatSupported(format);
 }
@@ -308,6 +373,18 @@ Texture::InternalFormat Texture::getFormat() const noexcept {
     return upcast(this)->getFormat();
 }
 
+void Texture::makeResident(Engine& engine, size_t baseLevel) noexcept {
+    upcast(this)->makeResident(upcast(engine), baseLevel);
+}
+
+size_t Texture::getResidentLevel() const noexcept {
+    return upcast(this)->getResidentLevel();
+}
+
+size_t Texture::getRequestedLevel() const noexcept {
+    return upcast(this)->getRequestedLevel();
+}
+
 void Texture::setImage(Engine& engine, size_t level,
         Texture::PixelBufferDescriptor&& buffer) const noexcept {
     upcast(this)->setImage(upcast(engine),
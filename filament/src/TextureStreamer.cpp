@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TextureStreamer.h"
+
+#include "details/Engine.h"
+#include "details/Texture.h"
+
+#include <algorithm>
+
+namespace filament {
+
+using namespace details;
+
+void TextureStreamer::add(FTexture* texture) noexcept {
+    mTextures[texture->getHwHandle().getId()] = texture;
+}
+
+void TextureStreamer::remove(FTexture* texture) noexcept {
+    mTextures.erase(texture->getHwHandle().getId());
+}
+
+void TextureStreamer::update(FEngine& engine) noexcept {
+    const uint32_t now = ++mUpdateCount;
+    if (mTextures.empty()) {
+        return;
+    }
+
+    // the textures drawn since the last update request the level they needed, the others keep
+    // their previous request
+    std::vector<FTexture*>& textures = mSortedTextures;
+    textures.clear();
+    size_t total = 0;
+    for (auto const& entry : mTextures) {
+        FTexture* const texture = entry.second;
+        if (texture->mNeededLevel < texture->mLevels) {
+            texture->mRequestedLevel = texture->mNeededLevel;
+            texture->mNeededLevel = texture->mLevels;
+            texture->mLastUse = now;
+        }
+        total += texture->getLevelsSize(texture->mRequestedLevel);
+        textures.push_back(texture);
+    }
+
+    if (mBudget && total > mBudget) {
+        // least recently drawn first, they're given their coarsest level before the others
+        // lose any level
+        std::sort(textures.begin(), textures.end(), [](FTexture const* lhs, FTexture const* rhs) {
+            return lhs->mLastUse < rhs->mLastUse;
+        });
+        for (FTexture* texture : textures) {
+            size_t size = texture->getLevelsSize(texture->mRequestedLevel);
+            while (total > mBudget && texture->mRequestedLevel + 1 < texture->mLevels) {
+                texture->mRequestedLevel++;
+                const size_t coarserSize = texture->getLevelsSize(texture->mRequestedLevel);
+                total -= size - coarserSize;
+                size = coarserSize;
+            }
+            if (total <= mBudget) {
+                break;
+            }
+        }
+    }
+
+    // the levels finer than the requested one are evicted
+    for (FTexture* texture : textures) {
+        if (texture->mResidentLevel < texture->mRequestedLevel) {
+            texture->makeResident(engine, texture->mRequestedLevel);
+        }
+    }
+}
+
+} // namespace filament
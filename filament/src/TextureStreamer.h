@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_TEXTURESTREAMER_H
+#define TNT_FILAMENT_TEXTURESTREAMER_H
+
+#include "driver/Handle.h"
+
+#include <tsl/robin_map.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+namespace details {
+class FEngine;
+class FTexture;
+} // namespace details
+
+/*
+ * Decides which levels of the streaming textures (see Texture::Builder::streaming()) are
+ * requested from the application. The views record the finest level each texture needs for the
+ * renderables they draw, update() turns these into the requested levels once per frame. When
+ * these don't fit in the budget, the least recently drawn textures are given coarser levels
+ * first, and the levels finer than the requested one are evicted (they're not sampled anymore).
+ */
+class TextureStreamer {
+public:
+    void add(details::FTexture* texture) noexcept;
+    void remove(details::FTexture* texture) noexcept;
+
+    bool empty() const noexcept { return mTextures.empty(); }
+
+    // the streaming texture using this handle, or nullptr
+    details::FTexture* find(Handle<HwTexture> handle) const noexcept {
+        auto pos = mTextures.find(handle.getId());
+        return pos != mTextures.end() ? pos->second : nullptr;
+    }
+
+    // in bytes, 0 means no limit
+    void setBudget(size_t budget) noexcept { mBudget = budget; }
+    size_t getBudget() const noexcept { return mBudget; }
+
+    // called once per frame, before the views record the levels they need
+    void update(details::FEngine& engine) noexcept;
+
+private:
+    tsl::robin_map<HandleBase::HandleId, details::FTexture*> mTextures;
+    std::vector<details::FTexture*> mSortedTextures; // only used by update()
+    size_t mBudget = 0;
+    uint32_t mUpdateCount = 0;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_TEXTURESTREAMER_H
@@ -22,6 +22,8 @@
 
 #include <utils/Panic.h>
 
+#include <algorithm>
+
 namespace filament {
 
 using namespace details;
@@ -31,6 +33,7 @@ struct VertexBuffer::BuilderDetails {
     AttributeBitset mDeclaredAttributes;
     uint32_t mVertexCount = 0;
     uint8_t mBufferCount = 0;
+    bool mStreaming = false;
 };
 
 using BuilderType = VertexBuffer;
@@ -94,6 +97,11 @@ VertexBuffer::Builder& VertexBuffer::Builder::normalized(VertexAttribute attribu
     return *this;
 }
 
+VertexBuffer::Builder& VertexBuffer::Builder::streaming(bool enabled) noexcept {
+    mImpl->mStreaming = enabled;
+    return *this;
+}
+
 VertexBuffer* VertexBuffer::Builder::build(Engine& engine) {
     if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mVertexCount > 0, "vertexCount cannot be 0")) {
         return nullptr;
@@ -111,7 +119,8 @@ VertexBuffer* VertexBuffer::Builder::build(Engine& engine) {
 namespace details {
 
 FVertexBuffer::FVertexBuffer(FEngine& engine, const VertexBuffer::Builder& builder)
-        : mVertexCount(builder->mVertexCount), mBufferCount(builder->mBufferCount) {
+        : mVertexCount(builder->mVertexCount), mBufferCount(builder->mBufferCount),
+          mStreaming(builder->mStreaming) {
     std::copy(std::begin(builder->mAttributes), std::end(builder->mAttributes), mAttributes.begin());
 
     mDeclaredAttributes = builder->mDeclaredAttributes;
@@ -161,12 +170,84 @@ void FVertexBuffer::setBufferAt(FEngine& engine, uint8_t bufferIndex,
     if (bufferIndex < mBufferCount) {
         engine.getDriverApi().loadVertexBuffer(mHandle, bufferIndex,
                 std::move(buffer), byteOffset, byteSize);
+        engine.contentChanged();
     } else {
         ASSERT_PRECONDITION_NON_FATAL(bufferIndex < mBufferCount,
                 "bufferIndex must be < bufferCount");
     }
 }
 
+void FVertexBuffer::makeResident(FEngine& engine,
+        uint32_t firstVertex, uint32_t vertexCount) noexcept {
+    if (!ASSERT_PRECONDITION_NON_FATAL(firstVertex + vertexCount <= mVertexCount,
+            "firstVertex + vertexCount must be <= vertexCount")) {
+        return;
+    }
+    if (!mStreaming || !vertexCount) {
+        return;
+    }
+
+    // the ranges overlapping or touching the new one are merged into it
+    using Range = utils::Range<uint32_t>;
+    Range range{ firstVertex, firstVertex + vertexCount };
+    std::vector<Range>& ranges = mResidentRanges;
+    auto begin = std::lower_bound(ranges.begin(), ranges.end(), range.first,
+            [](Range const& r, uint32_t v) { return r.last < v; });
+    auto end = std::upper_bound(begin, ranges.end(), range.last,
+            [](uint32_t v, Range const& r) { return v < r.first; });
+    if (begin != end) {
+        range.first = std::min(range.first, begin->first);
+        range.last = std::max(range.last, (end - 1)->last);
+    }
+    ranges.insert(ranges.erase(begin, end), range);
+
+    // the cached commands depend on the residency of the primitives
+    engine.residencyChanged();
+}
+
+void FVertexBuffer::evict(FEngine& engine,
+        uint32_t firstVertex, uint32_t vertexCount) noexcept {
+    if (!ASSERT_PRECONDITION_NON_FATAL(firstVertex + vertexCount <= mVertexCount,
+            "firstVertex + vertexCount must be <= vertexCount")) {
+        return;
+    }
+    if (!mStreaming || !vertexCount) {
+        return;
+    }
+
+    // the ranges overlapping the evicted one are trimmed, or split in two
+    using Range = utils::Range<uint32_t>;
+    const uint32_t last = firstVertex + vertexCount;
+    std::vector<Range>& ranges = mResidentRanges;
+    auto begin = std::lower_bound(ranges.begin(), ranges.end(), firstVertex,
+            [](Range const& r, uint32_t v) { return r.last <= v; });
+    auto end = std::lower_bound(begin, ranges.end(), last,
+            [](Range const& r, uint32_t v) { return r.first < v; });
+    if (begin == end) {
+        return;
+    }
+    const Range head{ begin->first, firstVertex };
+    const Range tail{ last, (end - 1)->last };
+    auto pos = ranges.erase(begin, end);
+    if (tail.first < tail.last) {
+        pos = ranges.insert(pos, tail);
+    }
+    if (head.first < head.last) {
+        ranges.insert(pos, head);
+    }
+
+    engine.residencyChanged();
+}
+
+bool FVertexBuffer::isResidentSlow(uint32_t firstVertex, uint32_t vertexCount) const noexcept {
+    using Range = utils::Range<uint32_t>;
+    std::vector<Range> const& ranges = mResidentRanges;
+    auto pos = std::lower_bound(ranges.begin(), ranges.end(), firstVertex,
+            [](Range const& r, uint32_t v) { return r.last <= v; });
+    return pos != ranges.end() &&
+           pos->first <= firstVertex && firstVertex + vertexCount <= pos->last;
+}
+
 } // namespace details
 
 // ------------------------------------------------------------------------------------------------
@@ -185,4 +266,16 @@ void VertexBuffer::setBufferAt(Engine& engine, uint8_t bufferIndex,
             std::move(buffer), byteOffset, byteSize);
 }
 
+void VertexBuffer::makeResident(Engine& engine, size_t firstVertex, size_t vertexCount) noexcept {
+    upcast(this)->makeResident(upcast(engine), uint32_t(firstVertex), uint32_t(vertexCount));
+}
+
+void VertexBuffer::evict(Engine& engine, size_t firstVertex, size_t vertexCount) noexcept {
+    upcast(this)->evict(upcast(engine), uint32_t(firstVertex), uint32_t(vertexCount));
+}
+
+bool VertexBuffer::isResident(size_t firstVertex, size_t vertexCount) const noexcept {
+    return upcast(this)->isResident(uint32_t(firstVertex), uint32_t(vertexCount));
+}
+
 } // namespace filament
@@ -23,8 +23,12 @@
 #include "details/IndirectLight.h"
 #include "details/MaterialInstance.h"
 #include "details/Renderer.h"
+#include "details/RenderPrimitive.h"
 #include "details/Scene.h"
 #include "details/Skybox.h"
+#include "details/Texture.h"
+
+#include "FrameInfo.h"
 
 #include <filament/Exposure.h>
 
@@ -51,13 +55,21 @@ static constexpr size_t VISIBLE_SHADOW_CASTER_BIT = 1u;
 static constexpr uint8_t VISIBLE_RENDERABLE = 1u << VISIBLE_RENDERABLE_BIT;
 static constexpr uint8_t VISIBLE_SHADOW_CASTER = 1u << VISIBLE_SHADOW_CASTER_BIT;
 static constexpr uint8_t VISIBLE_ALL = VISIBLE_RENDERABLE | VISIBLE_SHADOW_CASTER;
+static constexpr uint8_t VISIBLE_SHADOW_CASCADES =
+        ((1u << CONFIG_MAX_SHADOW_CASCADES) - 1u) << FView::VISIBLE_SHADOW_CASCADE_BIT;
+static constexpr uint8_t VISIBLE_SPOT_SHADOW_CASTER = 1u << FView::VISIBLE_SPOT_SHADOW_CASTER_BIT;
+static constexpr uint8_t VISIBLE_SPOT_SHADOW = 1u << FView::VISIBLE_SPOT_SHADOW_BIT;
+static constexpr uint8_t VISIBLE_SHADOW_MAPS = VISIBLE_SHADOW_CASCADES | VISIBLE_SPOT_SHADOW_CASTER;
 
 FView::FView(FEngine& engine)
-    : mFroxelizer(engine),
+    : mEngine(engine),
+      mFroxelizer(engine),
       mPerViewUb(engine.getPerViewUib()),
       mPerViewSb(engine.getPerViewSib()),
-      mClipSpace01(engine.getBackend() == Backend::VULKAN),
-      mDirectionalShadowMap(engine) {
+      mClipSpaceFlipY(engine.getBackend() == Backend::VULKAN),
+      mClipSpace01(engine.getDriverApi().isClipSpaceZeroToOne()),
+      mDirectionalShadowMap(engine),
+      mShadowAtlas(engine) {
     DriverApi& driverApi = engine.getDriverApi();
 
     mPerViewUbh = driverApi.createUniformBuffer(mPerViewUb.getSize());
@@ -72,7 +84,17 @@ FView::FView(FEngine& engine)
                 engine.getDFG()->getTexture(), sampler.getSamplerParams());
     }
 
-    mIsDynamicResolutionSupported = driverApi.isFrameTimeSupported();
+    mHasTimerQueries = driverApi.isTimerQuerySupported();
+    if (mHasTimerQueries) {
+        for (GpuTimer& timer : mGpuTimers) {
+            timer.query = driverApi.createTimerQuery();
+            for (auto& pass : timer.passes) {
+                pass = driverApi.createTimerQuery();
+            }
+        }
+    }
+
+    mIsDynamicResolutionSupported = mHasTimerQueries || driverApi.isFrameTimeSupported();
 
     driverApi.updateSamplerBuffer(mPerViewSbh, SamplerBuffer(mPerViewSb));
 }
@@ -85,11 +107,25 @@ void FView::terminate(FEngine& engine) {
     driverApi.destroyUniformBuffer(mPerViewUbh);
     driverApi.destroySamplerBuffer(mPerViewSbh);
     mDirectionalShadowMap.terminate(driverApi);
+    mShadowAtlas.terminate(driverApi);
     mFroxelizer.terminate(driverApi);
+    mGpuCuller.terminate(engine);
+    setTemporalHistory(engine.getRenderTargetPool(), nullptr);
+    for (GpuTimer& timer : mGpuTimers) {
+        driverApi.destroyTimerQuery(timer.query);
+        for (auto& pass : timer.passes) {
+            driverApi.destroyTimerQuery(pass);
+        }
+    }
+}
+
+void FView::settingsChanged() noexcept {
+    mEngine.contentChanged();
 }
 
 void FView::setViewport(Viewport const& viewport) noexcept {
     mViewport = viewport;
+    settingsChanged();
 }
 
 void FView::setDynamicResolutionOptions(DynamicResolutionOptions const& options) noexcept {
@@ -131,52 +167,162 @@ void FView::setDynamicResolutionOptions(DynamicResolutionOptions const& options)
 
         // reset the history, so we start from a known (and current) state
         mFrameTimeHistory.clear();
+        for (GpuTimer& timer : mGpuTimers) {
+            timer.pending = false;
+            timer.passesPending = 0;
+        }
         mScale = 1.0f;
         mDynamicWorkloadScale = 1.0f;
     }
+    settingsChanged();
 }
 
 void FView::setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept {
     mFroxelizer.setOptions(zLightNear, zLightFar);
+    settingsChanged();
+}
+
+void FView::setDynamicLightingFroxelCount(uint32_t froxelCount) noexcept {
+    mFroxelizer.setFroxelCount(froxelCount);
+    settingsChanged();
+}
+
+void FView::setDynamicLightingMaxLightCount(uint32_t maxLightCount) noexcept {
+    mMaxLightCount = uint16_t(std::min(size_t(maxLightCount), CONFIG_MAX_LIGHT_COUNT));
+    settingsChanged();
 }
 
 
-math::float2 FView::updateScale(duration frameTime) noexcept {
+// radical inverse in the given base, i.e. the Halton sequence
+static float halton(uint32_t i, uint32_t base) noexcept {
+    float f = 1.0f;
+    float r = 0.0f;
+    while (i > 0) {
+        f /= base;
+        r += f * (i % base);
+        i /= base;
+    }
+    return r;
+}
+
+math::float2 FView::updateScale(DriverApi& driver, duration frameTime) noexcept {
     DynamicResolutionOptions const& options = mDynamicResolution;
-    if (options.enabled) {
+    const uint32_t frame = ++mFrameCount;
+
+    // the temporal upscaler needs a different sub-pixel jitter each frame, we use a Halton
+    // (2,3) sequence which covers the pixel evenly
+    if (hasTemporalUpscaling()) {
+        mTemporalJitterIndex = (mTemporalJitterIndex + 1) % TEMPORAL_JITTER_COUNT;
+        mTemporalJitter = float2{
+                halton(mTemporalJitterIndex + 1, 2),
+                halton(mTemporalJitterIndex + 1, 3) } - 0.5f;
+    } else {
+        mTemporalJitter = 0.0f;
+    }
 
-        if (UTILS_UNLIKELY(frameTime.count() <= std::numeric_limits<float>::epsilon())) {
-            mScale = 1.0f;
-            return mScale;
+    // dynamic scaling is part of the post-process phase and can't happen if it's disabled
+    const bool dynamicResolution = options.enabled && mHasPostProcessPass;
+
+    // keep an history of frame times, along with the scale they were measured at
+    auto& history = mFrameTimeHistory;
+    if (mHasTimerQueries) {
+        // the GPU time of this view is only available a few frames later
+        for (GpuTimer& timer : mGpuTimers) {
+            uint64_t elapsed;
+            if (timer.pending && driver.getTimerQueryValue(timer.query, &elapsed)) {
+                timer.pending = false;
+                if (dynamicResolution) {
+                    auto it = std::find_if(history.begin(), history.end(),
+                            [&timer](FrameTimeSample const& sample) {
+                                return int32_t(sample.frame - timer.frame) < 0;
+                            });
+                    history.insert(it, { duration(elapsed * 1e-6f), timer.area, timer.frame });
+                }
+                // the renderer could have changed since the query was issued
+                if (timer.stats && timer.stats == mFrameStats) {
+                    timer.stats->add(timer.statsFrameId, FrameStatsManager::GPU, elapsed * 1e-6);
+                }
+            }
+            for (size_t i = 0; i < GPU_PASS_COUNT; i++) {
+                if ((timer.passesPending & (1u << i)) &&
+                        driver.getTimerQueryValue(timer.passes[i], &elapsed)) {
+                    timer.passesPending &= ~(1u << i);
+                    if (i == size_t(GpuPass::COLOR) && mDepthPrepass == DepthPrepass::AUTO) {
+                        addDepthPrepassSample(timer.depthPrepass, elapsed * 1e-6f / timer.area);
+                    }
+                    if (timer.stats && timer.stats == mFrameStats) {
+                        timer.stats->add(timer.statsFrameId,
+                                FrameStatsManager::Timing(FrameStatsManager::GPU_SHADOWS + i),
+                                elapsed * 1e-6);
+                    }
+                }
+            }
+        }
+    }
+
+    updateAutoDepthPrepass(frame);
+
+    if (dynamicResolution) {
+        if (!mHasTimerQueries && frameTime.count() > std::numeric_limits<float>::epsilon()) {
+            history.push_front({ frameTime, mScale.x * mScale.y, frame - 1 });
         }
 
-        // keep an history of frame times
-        auto& history = mFrameTimeHistory;
-        history.push_front(frameTime);
-        if (history.size() > options.history) {
+        while (history.size() > options.history) {
             history.pop_back();
-        } else if (UTILS_UNLIKELY(history.size() < 3)) {
+        }
+
+        if (UTILS_UNLIKELY(history.size() < 3)) {
             // don't make any decision if we don't have enough data
             mScale = 1.0f;
+            mDynamicWorkloadScale = 1.0f;
+            setGpuTimer(frame);
             return mScale;
         }
 
-        // apply a median filter to get a good representation of the frame time of the last
-        // N frames.
-        std::array<duration, 30> median; // NOLINT -- it's initialized below
-        size_t size = std::min(history.size(), median.size());
-        std::uninitialized_copy_n(history.begin(), size, median.begin());
+        // The cost of a frame is roughly proportional to the number of pixels rendered, so
+        // we normalize each measure by the area it was rendered at. This way, measures
+        // taken before the last scale change are still meaningful.
+        std::array<float, 30> cost; // NOLINT -- it's initialized below
+        std::array<float, 30> median; // NOLINT -- it's initialized below
+        const size_t size = std::min(history.size(), median.size());
+        float meanFrame = 0;
+        for (size_t i = 0; i < size; i++) {
+            cost[i] = history[i].time.count() / history[i].area;
+            meanFrame += int32_t(history[i].frame - frame);
+        }
+        meanFrame /= size;
+
+        // apply a median filter to get a good representation of the cost of the last N frames
+        std::copy_n(cost.begin(), size, median.begin());
         std::sort(median.begin(), median.begin() + size);
-        duration filteredFrameTime = median[size / 2];
+        const float filteredCost = median[size / 2];
+
+        // Measures lag a few frames behind, so we extrapolate the trend (least-squares slope
+        // of the cost per frame) up to the current frame. This lets us scale down before the
+        // frame time goes over the target, instead of after.
+        float num = 0;
+        float den = 0;
+        for (size_t i = 0; i < size; i++) {
+            const float dx = int32_t(history[i].frame - frame) - meanFrame;
+            num += dx * (cost[i] - filteredCost);
+            den += dx * dx;
+        }
+        const float slope = den > 0 ? num / den : 0.0f;
+        const float predictedCost = clamp(filteredCost - slope * meanFrame,
+                filteredCost * 0.5f, filteredCost * 2.0f);
 
-        // how much we need to scale the current workload to fit in our target, at this instant
+        // the workload (i.e. area) we can afford to fit in our target
         const float targetWithHeadroom = options.targetFrameTimeMilli * (1 - options.headRoomRatio);
-        const float workloadScale = targetWithHeadroom / filteredFrameTime.count();
+        const float x = targetWithHeadroom / predictedCost;
 
-        // low-pass: y += b * (x - y)
-        const float oneOverTau = options.scaleRate;
-        const float x = mScale.x * mScale.y * workloadScale;
-        mDynamicWorkloadScale += (1.0f - std::exp(-oneOverTau)) * (x - mDynamicWorkloadScale);
+        if (x < mDynamicWorkloadScale) {
+            // we're about to miss the target, react immediately
+            mDynamicWorkloadScale = x;
+        } else {
+            // low-pass: y += b * (x - y)
+            const float oneOverTau = options.scaleRate;
+            mDynamicWorkloadScale += (1.0f - std::exp(-oneOverTau)) * (x - mDynamicWorkloadScale);
+        }
 
         // scaling factor we need to apply on the whole surface
         const float scale = mDynamicWorkloadScale;
@@ -219,9 +365,9 @@ math::float2 FView::updateScale(duration frameTime) noexcept {
         static int sLogCounter = 15;
         if (!--sLogCounter) {
             sLogCounter = 15;
-            slog.d << frameTime.count()
-                   << ", " << filteredFrameTime.count()
-                   << ", " << workloadScale
+            slog.d << history.front().time.count()
+                   << ", " << filteredCost
+                   << ", " << predictedCost
                    << ", " << mDynamicWorkloadScale
                    << ", " << mScale.x
                    << ", " << mScale.y
@@ -231,24 +377,93 @@ math::float2 FView::updateScale(duration frameTime) noexcept {
                    << io::endl;
         }
 #endif
+        setGpuTimer(frame);
     } else {
         mScale = 1.0f;
+        if (mFrameStats || mDepthPrepass == DepthPrepass::AUTO) {
+            // the frame stats (and DepthPrepass::AUTO) need the GPU time even without dynamic
+            // resolution
+            setGpuTimer(frame);
+        } else {
+            for (GpuTimer& timer : mGpuTimers) {
+                timer.pending = false;
+                timer.passesPending = 0;
+            }
+        }
     }
     return mScale;
 }
 
+void FView::setGpuTimer(uint32_t frame) noexcept {
+    if (mHasTimerQueries) {
+        mGpuTimerIndex = uint32_t((mGpuTimerIndex + 1) % GPU_TIMER_COUNT);
+        GpuTimer& timer = mGpuTimers[mGpuTimerIndex];
+        timer.area = mScale.x * mScale.y;
+        timer.frame = frame;
+        timer.stats = mFrameStats;
+        timer.statsFrameId = mFrameStatsId;
+        timer.pending = true;
+        timer.passesPending = 0;
+        timer.depthPrepass = mAutoDepthPrepass == DepthPrepass::ENABLED;
+        if (mFrameStats && mFrameStats->isGpuPassesEnabled()) {
+            timer.passesPending = (1u << size_t(GpuPass::SHADOWS)) | (1u << size_t(GpuPass::COLOR));
+            if (hasPostProcessPass()) {
+                timer.passesPending |= 1u << size_t(GpuPass::POST_PROCESS);
+            }
+        }
+        if (mAutoDepthPrepass != DepthPrepass::DEFAULT) {
+            timer.passesPending |= 1u << size_t(GpuPass::COLOR);
+        }
+    }
+}
+
+void FView::setDepthPrepass(DepthPrepass prepass) noexcept {
+    if (prepass == DepthPrepass::AUTO && mDepthPrepass != DepthPrepass::AUTO) {
+        // start over, the measures could be of another scene
+        mDepthPrepassCost = {};
+        mDepthPrepassKept = false;
+    }
+    mDepthPrepass = prepass;
+}
+
+void FView::addDepthPrepassSample(bool depthPrepass, float cost) noexcept {
+    float& average = mDepthPrepassCost[depthPrepass];
+    average = average > 0.0f ? average + DEPTH_PREPASS_COST_RATE * (cost - average) : cost;
+
+    const float kept = mDepthPrepassCost[mDepthPrepassKept];
+    const float other = mDepthPrepassCost[!mDepthPrepassKept];
+    if (other > 0.0f && other < kept * (1.0f - DEPTH_PREPASS_HYSTERESIS)) {
+        mDepthPrepassKept = !mDepthPrepassKept;
+    }
+}
+
+void FView::updateAutoDepthPrepass(uint32_t frame) noexcept {
+    if (mDepthPrepass != DepthPrepass::AUTO || !mHasTimerQueries) {
+        mAutoDepthPrepass = DepthPrepass::DEFAULT;
+        return;
+    }
+    // The pass without the pre-pass is kept first. The other one is measured every
+    // DEPTH_PREPASS_PROBE_PERIOD frames, which also rebuilds the color pass' cached commands.
+    const bool probe = (frame % DEPTH_PREPASS_PROBE_PERIOD) == 0;
+    const bool depthPrepass = probe ? !mDepthPrepassKept : mDepthPrepassKept;
+    mAutoDepthPrepass = depthPrepass ? DepthPrepass::ENABLED : DepthPrepass::DISABLED;
+}
+
 void FView::setClearColor(float4 const& clearColor) noexcept {
     mClearColor = clearColor;
+    settingsChanged();
 }
 
 void FView::setClearTargets(bool color, bool depth, bool stencil) noexcept {
     mClearTargetColor = color;
     mClearTargetDepth = depth;
     mClearTargetStencil = stencil;
+    settingsChanged();
 }
 
 void FView::setVisibleLayers(uint8_t select, uint8_t values) noexcept {
     mVisibleLayers = (mVisibleLayers & ~select) | (values & select);
+    settingsChanged();
 }
 
 bool FView::isSkyboxVisible() const noexcept {
@@ -256,8 +471,35 @@ bool FView::isSkyboxVisible() const noexcept {
     return skybox != nullptr && (skybox->getLayerMask() & mVisibleLayers);
 }
 
+// Identifies the visible shadow casters with one of the 'mask' bits set, along with their
+// versions, to find out whether a shadow map rendered with them can be kept. The key doesn't
+// depend on the order of the renderables.
+static uint64_t computeShadowCastersKey(FScene::RenderableSoa const& renderableData,
+        uint8_t mask, uint8_t visibleLayers, bool staticCastersOnly) noexcept {
+    uint8_t const* layers = renderableData.data<FScene::LAYERS>();
+    auto const* visibility = renderableData.data<FScene::VISIBILITY_STATE>();
+    auto const* instances = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* transformVersions = renderableData.data<FScene::TRANSFORM_VERSION>();
+    auto const* renderableVersions = renderableData.data<FScene::RENDERABLE_VERSION>();
+    uint8_t const* visibleMask = renderableData.data<FScene::VISIBLE_MASK>();
+
+    uint64_t casters = 0;
+    for (size_t j = 0, n = renderableData.size(); j < n; j++) {
+        FRenderableManager::Visibility v = visibility[j];
+        if ((!v.culling || (visibleMask[j] & mask))
+                && (layers[j] & visibleLayers) && v.castShadows
+                && !(staticCastersOnly && v.dynamicShadowCaster)) {
+            uint64_t key = (uint64_t(instances[j].asValue()) << 32u) ^
+                    (uint64_t(transformVersions[j]) << 16u) ^ renderableVersions[j];
+            casters += key * 0x9E3779B97F4A7C15llu;
+        }
+    }
+    return casters;
+}
+
 void FView::prepareShadowing(FEngine& engine, driver::DriverApi& driver,
-        FScene::RenderableSoa& renderableData, FScene::LightSoa const& lightData) noexcept {
+        FScene::RenderableSoa& renderableData, FScene::LightSoa& lightData,
+        Viewport const& viewport) noexcept {
     SYSTRACE_CALL();
 
     // setup shadow mapping
@@ -265,7 +507,9 @@ void FView::prepareShadowing(FEngine& engine, driver::DriverApi& driver,
 
     auto& lcm = engine.getLightManager();
     UniformBuffer& u = getUb();
+    SamplerBuffer& sb = getUs();
     FScene* const scene = mScene;
+    JobSystem& js = engine.getJobSystem();
 
     // dominant directional light is always as index 0
     FLightManager::Instance directionalLight = lightData.elementAt<FScene::LIGHT_INSTANCE>(0);
@@ -273,26 +517,117 @@ void FView::prepareShadowing(FEngine& engine, driver::DriverApi& driver,
     if (UTILS_UNLIKELY(mHasShadowing)) {
         // compute the frustum for this light
         ShadowMap& shadowMap = mDirectionalShadowMap;
-        shadowMap.update(lightData, 0, scene, mViewingCameraInfo, mVisibleLayers);
+        shadowMap.update(lightData, 0, scene, mViewingCameraInfo, viewport, mVisibleLayers,
+                mMaxShadowMapSize);
         if (shadowMap.hasVisibleShadows()) {
-            // Cull shadow casters
-            Frustum const& frustum = shadowMap.getCamera().getFrustum();
-            prepareVisibleShadowCasters(engine.getJobSystem(), renderableData, frustum);
+            // Cull shadow casters, with several cascades each one only renders its own
+            const size_t cascadeCount = shadowMap.getCascadeCount();
+            for (size_t c = 0; c < cascadeCount; c++) {
+                if (shadowMap.isCascadeUpdated(c)) {
+                    prepareVisibleShadowCasters(js, renderableData,
+                            shadowMap.getCamera(c).getFrustum(), VISIBLE_SHADOW_CASCADE_BIT + c);
+                    if (shadowMap.hasStaticCache()) {
+                        shadowMap.setStaticCasters(c, computeShadowCastersKey(renderableData,
+                                uint8_t(1u << (VISIBLE_SHADOW_CASCADE_BIT + c)), mVisibleLayers,
+                                true));
+                    }
+                }
+            }
 
-            // allocates shadowmap driver resources
-            shadowMap.prepare(driver, getUs());
+            // The shadow casters which can't cast shadows on the visible receivers are
+            // culled as well. This isn't done when the static casters are cached, the cache
+            // must have all the casters of the light frustum to be kept while the camera moves.
+            if (!shadowMap.hasStaticCache()) {
+                uint8_t casterMask = 0;
+                for (size_t c = 0; c < cascadeCount; c++) {
+                    casterMask |= shadowMap.isCascadeUpdated(c) ?
+                            uint8_t(1u << (VISIBLE_SHADOW_CASCADE_BIT + c)) : uint8_t(0);
+                }
+                cullShadowCastersWithReceivers(js, renderableData,
+                        lightData.elementAt<FScene::DIRECTION>(0), casterMask);
+            }
 
-            mat4f const& lightFromWorldMatrix = shadowMap.getLightSpaceMatrix();
-            u.setUniform(offsetof(FEngine::PerViewUib, lightFromWorldMatrix), lightFromWorldMatrix);
+            // allocates shadowmap driver resources
+            shadowMap.prepare(driver, sb);
 
             // the 2x bias is needed in opengl because the depth maps to -1/1. It may not be
             // needed with other APIs, but at least it won't worsen the acnee there.
-            const float sceneRange = shadowMap.getSceneRange();
-            const float texelSizeWorldSpace = shadowMap.getTexelSizeWorldSpace();
+            // The constant bias is part of each cascade's light space matrix, the cascades
+            // past the last one are never selected by the shader.
             const float constantBias = lcm.getShadowConstantBias(directionalLight);
             const float normalBias = lcm.getShadowNormalBias(directionalLight);
-            u.setUniform(offsetof(FEngine::PerViewUib, shadowBias),
-                    float3{ 2 * constantBias / sceneRange, normalBias * texelSizeWorldSpace, 0 });
+            float4 cascadeSplits{ std::numeric_limits<float>::max() };
+            float4 shadowNormalBias{ 0 };
+            for (size_t c = 0; c < cascadeCount; c++) {
+                mat4f lightFromWorldMatrix(shadowMap.getLightSpaceMatrix(c));
+                lightFromWorldMatrix[3].z -= 2 * constantBias / shadowMap.getSceneRange(c);
+                u.setUniform(offsetof(FEngine::PerViewUib, lightFromWorldMatrix) +
+                        c * sizeof(mat4f), lightFromWorldMatrix);
+                cascadeSplits[c] = shadowMap.getCascadeSplit(c);
+                shadowNormalBias[c] = normalBias * shadowMap.getTexelSizeWorldSpace(c);
+            }
+            u.setUniform(offsetof(FEngine::PerViewUib, cascadeSplits), cascadeSplits);
+            u.setUniform(offsetof(FEngine::PerViewUib, shadowNormalBias), shadowNormalBias);
+        }
+    }
+
+    // Spot lights shadows. They're only received by the shadow receiver variant of the
+    // materials, which requires the directional lighting variant.
+    ShadowAtlas& shadowAtlas = mShadowAtlas;
+    mHasSpotShadows = false;
+    if (mShadowingEnabled && directionalLight) {
+        shadowAtlas.update(lightData, mViewingCameraInfo, mCullingFrustum, mMaxShadowMapSize);
+        mHasSpotShadows = shadowAtlas.getShadowCount() > 0;
+    }
+    if (UTILS_UNLIKELY(mHasSpotShadows)) {
+        uint8_t* visibleMask = renderableData.data<FScene::VISIBLE_MASK>();
+
+        for (size_t i = 0, c = shadowAtlas.getShadowCount(); i < c; i++) {
+            // cull and identify the light's shadow casters
+            for (size_t j = 0, n = renderableData.size(); j < n; j++) {
+                visibleMask[j] &= ~VISIBLE_SPOT_SHADOW;
+            }
+            prepareVisibleShadowCasters(js, renderableData,
+                    shadowAtlas.getCamera(i).getFrustum(), VISIBLE_SPOT_SHADOW_BIT);
+            shadowAtlas.setCasters(i, computeShadowCastersKey(renderableData,
+                    VISIBLE_SPOT_SHADOW, mVisibleLayers, false));
+
+            // the shadow maps that are kept don't need their casters
+            if (shadowAtlas.isShadowUpdated(i)) {
+                for (size_t j = 0, n = renderableData.size(); j < n; j++) {
+                    visibleMask[j] |= (visibleMask[j] & VISIBLE_SPOT_SHADOW) ?
+                            VISIBLE_SPOT_SHADOW_CASTER : uint8_t(0);
+                }
+            }
+
+            // the constant bias is part of the light space matrix
+            const FLightManager::Instance li = shadowAtlas.getLight(i);
+            const float bias = 2 * lcm.getShadowConstantBias(li) / shadowAtlas.getSceneRange(i);
+            mat4f lightFromWorldMatrix(shadowAtlas.getLightSpaceMatrix(i));
+            for (size_t k = 0; k < 4; k++) {
+                lightFromWorldMatrix[k].z -= bias * lightFromWorldMatrix[k].w;
+            }
+            u.setUniform(offsetof(FEngine::PerViewUib, spotLightFromWorldMatrix) +
+                    i * sizeof(mat4f), lightFromWorldMatrix);
+        }
+
+        // allocates the atlas driver resources
+        shadowAtlas.prepare(driver, sb, FEngine::PerViewSib::SPOT_SHADOW_MAP);
+
+        if (!hasDirectionalShadows()) {
+            // The materials also sample the directional light's shadow map, make them use
+            // the atlas with a transform that puts every fragment in front of it.
+            shadowAtlas.prepare(driver, sb, FEngine::PerViewSib::SHADOW_MAP);
+            const mat4f inFrontOfShadowMap(mat4f::row_major_init{
+                    0, 0, 0,  0,
+                    0, 0, 0,  0,
+                    0, 0, 0, -1,
+                    0, 0, 0,  1
+            });
+            u.setUniform(offsetof(FEngine::PerViewUib, lightFromWorldMatrix), inFrontOfShadowMap);
+            u.setUniform(offsetof(FEngine::PerViewUib, cascadeSplits),
+                    float4{ std::numeric_limits<float>::max() });
+            u.setUniform(offsetof(FEngine::PerViewUib, shadowNormalBias), float4{ 0 });
         }
     }
 }
@@ -336,6 +671,12 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
                 FIndirectLight::DEFAULT_INTENSITY * exposure);
     }
 
+    // Reflection probes, they replace the IBL's reflections of the renderables around them
+    ReflectionProbes const& probes = scene->getReflectionProbes();
+    if (probes.hasProbes()) {
+        probes.prepare(u, mPerViewSb, FEngine::PerViewSib::REFLECTION_PROBES);
+    }
+
     // Directional light (always at index 0)
     auto& lcm = engine.getLightManager();
     FLightManager::Instance directionalLight = lightData.elementAt<FScene::LIGHT_INSTANCE>(0);
@@ -381,6 +722,8 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
 void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& arena,
         Viewport const& viewport) noexcept {
     JobSystem& js = engine.getJobSystem();
+    using clock = std::chrono::steady_clock;
+    const clock::time_point prepareStart = clock::now();
 
     /*
      * Prepare the scene -- this is where we gather all the objects added to the scene,
@@ -433,15 +776,24 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
             // world origin transform, use only for debugging
             .worldOrigin        = worldOriginCamera
     };
-    mCullingFrustum = FCamera::getFrustum(
-            mCullingCamera->getCullingProjectionMatrix(),
-            FCamera::getViewMatrix(worldOriginScene * mCullingCamera->getModelMatrix()));
+    const mat4f cullingView = FCamera::getViewMatrix(
+            worldOriginScene * mCullingCamera->getModelMatrix());
+    mCullingFrustum = FCamera::getFrustum(mCullingCamera->getCullingProjectionMatrix(), cullingView);
+
+    // with GPU culling, the renderables are occlusion culled by the color pass, see GpuCuller
+    mGpuCullingActive = mGpuCulling && isCullingEnabled() && GpuCuller::isSupported(engine);
 
     /*
      * Gather all information needed to render this scene. Apply the world origin to all
      * objects in the scene.
      */
+    FrameStatsManager::CountersScope prepareCounters(mFrameStats, mFrameStatsId,
+            FrameStatsManager::PHASE_PREPARE);
     scene->prepare(worldOriginScene);
+    prepareCounters.end();
+    const clock::time_point cullingStart = clock::now();
+    FrameStatsManager::CountersScope cullingCounters(mFrameStats, mFrameStatsId,
+            FrameStatsManager::PHASE_CULLING);
 
     /*
      * Culling: as soon as possible we perform our camera-culling
@@ -450,15 +802,44 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
 
     FScene::RenderableSoa& renderableData = scene->getRenderableData();
     Slice<Culler::result_type> cullingMask = renderableData.slice<FScene::VISIBLE_MASK>();
-    std::fill(cullingMask.begin(), cullingMask.end(), 0); // TODO: can we avoid this fill?
+    // TODO: can we avoid this fill?
+    renderableData.fill<FScene::VISIBLE_MASK>(0, 0, renderableData.size());
+    if (mTemporalCulling) {
+        mCullingCache.prepare(scene);
+    } else {
+        mCullingCache.clear();
+    }
     prepareVisibleRenderables(js, renderableData);
 
     /*
-     * Shadowing: compute the shadow camera and cull shadow casters
-     * (this will set the VISIBLE_SHADOW_CASTER bit)
+     * Occlusion culling: this clears the VISIBLE_RENDERABLE bit of the renderables hidden
+     * by occluders
+     */
+
+    const bool occlusionCulling = mOcclusionCulling && isCullingEnabled();
+    if (UTILS_UNLIKELY(occlusionCulling)) {
+        prepareOcclusionCulling(js, renderableData,
+                mat4f{ mCullingCamera->getCullingProjectionMatrix() * cullingView });
+    }
+    if (UTILS_UNLIKELY(mGpuCullingActive)) {
+        mGpuCuller.prepare(
+                occlusionCulling && mOcclusionCuller.hasOccluders() ? &mOcclusionCuller : nullptr);
+    }
+
+    /*
+     * Shadowing: compute the shadow cameras and cull shadow casters
+     * (this will set the VISIBLE_SHADOW_CASCADE and VISIBLE_SPOT_SHADOW_CASTER bits, which
+     * become the VISIBLE_SHADOW_CASTER bit below)
      */
 
-    prepareShadowing(engine, driver, renderableData, scene->getLightData());
+    prepareShadowing(engine, driver, renderableData, scene->getLightData(), viewport);
+    if (mTemporalCulling) {
+        mCullingCache.commit(renderableData);
+    }
+    if (!hasShadowing()) {
+        // there is no shadow pass to measure this frame
+        mGpuTimers[mGpuTimerIndex].passesPending &= ~(1u << size_t(GpuPass::SHADOWS));
+    }
 
     /*
      * partition the array of renderable w.r.t their visibility:
@@ -489,13 +870,25 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
     // update those UBOs
     scene->updateUBOs(merged);
 
+    // select the levels of detail, they're used by both the color and shadow passes
+    const bool snapshot = scene->isSnapshotModeEnabled();
+    mHasSceneSnapshot = updatePrimitivesLod(js, engine, mViewingCameraInfo, arena, snapshot,
+            renderableData, merged) && snapshot;
+
+    if (UTILS_UNLIKELY(!engine.getTextureStreamer().empty())) {
+        updateStreamingTextures(engine, mViewingCameraInfo, viewport, renderableData,
+                mVisibleRenderables);
+    }
+
     /*
      * Light culling
      *
      * TODO: this could be done in parallel with culling above
      */
 
-    prepareVisibleLights(engine.getLightManager(), js, scene->getLightData());
+    prepareVisibleLights(engine.getLightManager(), js, arena, viewport, scene->getLightData());
+    const clock::time_point cullingEnd = clock::now();
+    cullingCounters.end();
 
     /*
      * Prepare lighting -- this is where we update the lights UBOs, set-up the IBL,
@@ -505,6 +898,18 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
 
     prepareLighting(engine, driver, arena, viewport);
 
+    /*
+     * Start the froxelization now, it only relies on prepareLighting() and runs in parallel
+     * with the shadow passes and the commands generation. commitFroxels() waits for it.
+     */
+
+    if (mHasDynamicLighting) {
+        mFroxelizeJob = js.createJob(nullptr,
+                [&engine, this, stats = mFrameStats, frameId = mFrameStatsId](
+                        JobSystem&, JobSystem::Job*) { froxelize(engine, stats, frameId); });
+        js.run(mFroxelizeJob);
+    }
+
     /*
      * Update driver state
      */
@@ -512,12 +917,21 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
     float fraction = (engine.getTime().count() % 1000000000) / 1000000000.0f;
     getUb().setUniform(offsetof(FEngine::PerViewUib, time), fraction);
 
-    // upload the renderables's dirty UBOs
+    // upload the renderables's dirty UBOs (the scene already did it when they're batched)
     engine.getRenderableManager().prepare(driver,
-            renderableData.data<FScene::RENDERABLE_INSTANCE>(), merged);
+            renderableData.data<FScene::RENDERABLE_INSTANCE>(), merged,
+            !scene->hasBatchedUniforms());
 
     // set uniforms and samplers
     bindPerViewUniformsAndSamplers(driver);
+
+    if (UTILS_UNLIKELY(mFrameStats)) {
+        using ms = std::chrono::duration<double, std::milli>;
+        const ms culling = cullingEnd - cullingStart;
+        const ms prepare = (clock::now() - prepareStart) - culling;
+        mFrameStats->add(mFrameStatsId, FrameStatsManager::CULLING, culling.count());
+        mFrameStats->add(mFrameStatsId, FrameStatsManager::PREPARE, prepare.count());
+    }
 }
 
 void FView::computeVisibilityMasks(
@@ -528,15 +942,20 @@ void FView::computeVisibilityMasks(
     // __restrict__ seems to only be taken into account as function parameters. This is very
     // important here, otherwise, this loop doesn't get vectorized.
     // This is vectorized 16x.
-    count = (count + 0xF) & ~0xF; // capacity guaranteed to be multiple of 16
+    count = FScene::RenderableSoa::getPaddedSize(count); // the capacity is padded by FScene
     for (size_t i = 0; i < count; ++i) {
         Culler::result_type mask = visibleMask[i];
         FRenderableManager::Visibility v = visibility[i];
         bool inVisibleLayer = layers[i] & visibleLayers;
         bool visRenderables   = (!v.culling || (mask & VISIBLE_RENDERABLE))    && inVisibleLayer;
-        bool visShadowCasters = (!v.culling || (mask & VISIBLE_SHADOW_CASTER)) && inVisibleLayer && v.castShadows;
+        bool visShadowCasters = (!v.culling || (mask & VISIBLE_SHADOW_MAPS))
+                && inVisibleLayer && v.castShadows;
+        // the bits of each shadow map are only looked at for the shadow casters, a renderable
+        // that isn't culled is in all of them
+        uint8_t shadowMaps = v.culling ? uint8_t(mask & VISIBLE_SHADOW_MAPS) : VISIBLE_SHADOW_MAPS;
         visibleMask[i] = Culler::result_type(visRenderables) |
-                         Culler::result_type(visShadowCasters << 1);
+                         Culler::result_type(visShadowCasters << 1) |
+                         Culler::result_type(shadowMaps);
     }
 }
 
@@ -546,27 +965,45 @@ UTILS_NOINLINE
         FScene::RenderableSoa::iterator end,
         uint8_t mask) noexcept {
     return std::partition(begin, end, [mask](auto it) {
-        return it.template get<FScene::VISIBLE_MASK>() == mask;
+        return (it.template get<FScene::VISIBLE_MASK>() & VISIBLE_ALL) == mask;
     });
 }
 
-void FView::prepareCamera(const CameraInfo& camera, const Viewport& viewport) const noexcept {
+void FView::prepareCamera(const CameraInfo& camera, const Viewport& viewport,
+        float2 jitter, bool reversedZ) const noexcept {
     SYSTRACE_CALL();
 
+    const float w = viewport.width;
+    const float h = viewport.height;
+
     const mat4f viewFromWorld(camera.view);
     const mat4f worldFromView(camera.model);
-    const mat4f projectionMatrix(camera.projection);
+
+    // the jitter is applied in clip space, i.e. after the projection
+    const mat4f projectionMatrix(
+            mat4f::translate(float4{ 2.0f * jitter.x / w, 2.0f * jitter.y / h, 0.0f, 1.0f }) *
+            mat4f(camera.projection));
 
     // In Vulkan, clip-space Z is [0,w] rather than [-w,+w] and Y is flipped.
     // See https://matthewwellings.com/blog/the-new-vulkan-coordinate-system/
+    // OpenGL uses [0,w] as well when clip control is available.
+    // With reverse-Z, Z is also inverted so that the near plane is at w and the far plane is at
+    // 0, which spreads the precision of a floating-point depth buffer evenly across the depth
+    // range. The far plane is only at infinity with the perspective projections built by
+    // FCamera::setProjection(), the orthographic and custom projections keep theirs.
+    assert(!reversedZ || mClipSpace01);
+    const float sy = mClipSpaceFlipY ? -1.0f : 1.0f;
+    const float sz = mClipSpace01 ? (reversedZ ? -0.5f : 0.5f) : 1.0f;
+    const float tz = mClipSpace01 ? 0.5f : 0.0f;
     const math::mat4f correction(math::mat4f::row_major_init{
-            1.0f,  0.0f, 0.0f, 0.0f,
-            0.0f, -1.0f, 0.0f, 0.0f,
-            0.0f,  0.0f, 0.5f, 0.5f,
-            0.0f,  0.0f, 0.0f, 1.0f,
+            1.0f, 0.0f, 0.0f, 0.0f,
+            0.0f,   sy, 0.0f, 0.0f,
+            0.0f, 0.0f,   sz,   tz,
+            0.0f, 0.0f, 0.0f, 1.0f,
     });
 
-    const mat4f clipFromView(mClipSpace01 ? correction * projectionMatrix : projectionMatrix);
+    const mat4f clipFromView((mClipSpaceFlipY || mClipSpace01) ?
+            correction * projectionMatrix : projectionMatrix);
     const mat4f viewFromClip(Camera::inverseProjection(clipFromView));
     const mat4f clipFromWorld(clipFromView * viewFromWorld);
 
@@ -577,26 +1014,41 @@ void FView::prepareCamera(const CameraInfo& camera, const Viewport& viewport) co
     u.setUniform(offsetof(FEngine::PerViewUib, viewFromClipMatrix), viewFromClip);      // 1/projection
     u.setUniform(offsetof(FEngine::PerViewUib, clipFromWorldMatrix), clipFromWorld);    // projection * view
 
-    const float w = viewport.width;
-    const float h = viewport.height;
     u.setUniform(offsetof(FEngine::PerViewUib, resolution), float4{ w, h, 1.0f / w, 1.0f / h });
     u.setUniform(offsetof(FEngine::PerViewUib, origin), float2{ viewport.left, viewport.bottom });
 
     u.setUniform(offsetof(FEngine::PerViewUib, cameraPosition), float3{camera.getPosition()});
 }
 
-void FView::froxelize(FEngine& engine) const noexcept {
+void FView::setAccumulatedTransparency(bool accumulated) const noexcept {
+    getUb().setUniform(offsetof(FEngine::PerViewUib, orderIndependentTransparency),
+            accumulated ? 1.0f : 0.0f);
+}
+
+void FView::froxelize(FEngine& engine,
+        FrameStatsManager* stats, uint32_t frameId) const noexcept {
     SYSTRACE_CALL();
 
     if (mHasDynamicLighting) {
+        using clock = std::chrono::steady_clock;
+        const clock::time_point start = clock::now();
+        FrameStatsManager::CountersScope counters(stats, frameId,
+                FrameStatsManager::PHASE_FROXELIZATION);
+
         // froxelize lights
         mFroxelizer.froxelizeLights(engine, mViewingCameraInfo, mScene->getLightData());
+        counters.end();
+
+        if (UTILS_UNLIKELY(stats)) {
+            const std::chrono::duration<double, std::milli> elapsed = clock::now() - start;
+            stats->add(frameId, FrameStatsManager::FROXELIZATION, elapsed.count());
+        }
     }
 }
 
 void FView::commitUniforms(driver::DriverApi& driverApi) const noexcept {
     if (mPerViewUb.isDirty()) {
-        driverApi.updateUniformBuffer(mPerViewUbh, UniformBuffer(mPerViewUb));
+        driverApi.updateUniformBuffer(mPerViewUbh, mPerViewUb.copyDirtyRange());
         mPerViewUb.clean();
     }
 
@@ -606,7 +1058,11 @@ void FView::commitUniforms(driver::DriverApi& driverApi) const noexcept {
     }
 }
 
-void FView::commitFroxels(driver::DriverApi& driverApi) const noexcept {
+void FView::commitFroxels(JobSystem& js, driver::DriverApi& driverApi) const noexcept {
+    if (mFroxelizeJob) {
+        js.wait(mFroxelizeJob);
+        mFroxelizeJob = nullptr;
+    }
     if (mHasDynamicLighting) {
         mFroxelizer.commit(driverApi);
     }
@@ -617,26 +1073,165 @@ void FView::prepareVisibleRenderables(JobSystem& js,
         FScene::RenderableSoa& renderableData) const noexcept {
     SYSTRACE_CALL();
     if (UTILS_LIKELY(isCullingEnabled())) {
-        cullRenderables(js, renderableData, mCullingFrustum, VISIBLE_RENDERABLE_BIT);
+        cullRenderablesCached(js, renderableData, mCullingFrustum, VISIBLE_RENDERABLE_BIT);
     } else {
-        std::fill(renderableData.begin<FScene::VISIBLE_MASK>(),
-                  renderableData.end<FScene::VISIBLE_MASK>(), VISIBLE_RENDERABLE);
+        renderableData.fill<FScene::VISIBLE_MASK>(VISIBLE_RENDERABLE, 0, renderableData.size());
     }
 }
 
 UTILS_NOINLINE
 void FView::prepareVisibleShadowCasters(JobSystem& js,
-        FScene::RenderableSoa& renderableData, Frustum const& lightFrustum) const noexcept {
+        FScene::RenderableSoa& renderableData, Frustum const& lightFrustum,
+        size_t bit) const noexcept {
     SYSTRACE_CALL();
-    cullRenderables(js, renderableData, lightFrustum, VISIBLE_SHADOW_CASTER_BIT);
+    if (bit == VISIBLE_SPOT_SHADOW_BIT) {
+        // this bit is culled with the frustum of each spot light in turn, it can't be cached
+        cullRenderables(js, renderableData, mScene->getBvh(), lightFrustum, bit);
+    } else {
+        cullRenderablesCached(js, renderableData, lightFrustum, bit);
+    }
 }
 
-void FView::cullRenderables(JobSystem& js,
-        FScene::RenderableSoa& renderableData, Frustum const& frustum, size_t bit) noexcept {
+UTILS_NOINLINE
+void FView::cullShadowCastersWithReceivers(JobSystem& js,
+        FScene::RenderableSoa& renderableData, float3 const& lightDirection,
+        uint8_t casterMask) const noexcept {
+    SYSTRACE_CALL();
 
     float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
     float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
     uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
+    auto const  * visibility      = renderableData.data<FScene::VISIBILITY_STATE>();
+    uint8_t const* layers         = renderableData.data<FScene::LAYERS>();
+    const uint8_t visibleLayers = mVisibleLayers;
+
+    // bounds of the visible shadow receivers and of the shadow casters
+    Aabb wsVisibleReceivers;
+    Aabb wsShadowCasters;
+    for (size_t i = 0, c = renderableData.size(); i < c; i++) {
+        FRenderableManager::Visibility v = visibility[i];
+        if (!(layers[i] & visibleLayers)) {
+            continue;
+        }
+        const bool caster = v.castShadows && (visibleArray[i] & casterMask);
+        const bool receiver = v.receiveShadows && (visibleArray[i] & VISIBLE_RENDERABLE);
+        if (!v.culling && (v.castShadows || v.receiveShadows)) {
+            // its bounds may not be set, we can't tell where it is
+            return;
+        }
+        const Aabb aabb{ worldAABBCenter[i] - worldAABBExtent[i],
+                         worldAABBCenter[i] + worldAABBExtent[i] };
+        if (caster) {
+            wsShadowCasters.min = min(wsShadowCasters.min, aabb.min);
+            wsShadowCasters.max = max(wsShadowCasters.max, aabb.max);
+        }
+        if (receiver) {
+            wsVisibleReceivers.min = min(wsVisibleReceivers.min, aabb.min);
+            wsVisibleReceivers.max = max(wsVisibleReceivers.max, aabb.max);
+        }
+    }
+
+    Frustum volume;
+    if (!ShadowMap::computeShadowReceiversVolume(volume, lightDirection,
+            wsVisibleReceivers, wsShadowCasters)) {
+        return;
+    }
+
+    // the spot lights' bit is free until they're culled
+    for (size_t i = 0, c = renderableData.size(); i < c; i++) {
+        visibleArray[i] &= ~VISIBLE_SPOT_SHADOW;
+    }
+    cullRenderables(js, renderableData, mScene->getBvh(), volume, VISIBLE_SPOT_SHADOW_BIT);
+    for (size_t i = 0, c = renderableData.size(); i < c; i++) {
+        const uint8_t culled = (visibleArray[i] & VISIBLE_SPOT_SHADOW) ? uint8_t(0) : casterMask;
+        visibleArray[i] &= ~uint8_t(VISIBLE_SPOT_SHADOW | culled);
+    }
+}
+
+UTILS_NOINLINE
+void FView::prepareVisibleSpotShadowCasters(FScene::RenderableSoa& renderableData,
+        Range range, Frustum const& lightFrustum) noexcept {
+    SYSTRACE_CALL();
+
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
+    auto const  * visibility      = renderableData.data<FScene::VISIBILITY_STATE>();
+
+    // Culler processes multiples of MODULO entries, starting at an aligned index guarantees
+    // that we stay within the SoA's capacity
+    const uint32_t first = range.first & ~uint32_t(Culler::MODULO - 1);
+    const uint32_t count = uint32_t(Culler::round(range.last - first));
+    for (uint32_t i = first; i < first + count; i++) {
+        visibleArray[i] = uint8_t(visibleArray[i] & ~VISIBLE_SPOT_SHADOW) |
+                (visibility[i].culling ? uint8_t(0) : VISIBLE_SPOT_SHADOW);
+    }
+    Culler::intersects(visibleArray + first, lightFrustum,
+            worldAABBCenter + first, worldAABBExtent + first, count, VISIBLE_SPOT_SHADOW_BIT);
+}
+
+UTILS_NOINLINE
+void FView::prepareOcclusionCulling(JobSystem& js,
+        FScene::RenderableSoa& renderableData, mat4f const& clipFromWorld) noexcept {
+    SYSTRACE_CALL();
+
+    OcclusionCuller& occlusionCuller = mOcclusionCuller;
+    occlusionCuller.prepare(clipFromWorld);
+
+    FRenderableManager const& rcm = mEngine.getRenderableManager();
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
+    auto const  * visibility      = renderableData.data<FScene::VISIBILITY_STATE>();
+    auto const  * instances       = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    auto const  * worldTransforms = renderableData.data<FScene::WORLD_TRANSFORM>();
+
+    // Occluders are usually few, rasterize those in view. The world AABB of a rotated occluder
+    // is larger than the occluder, so its local AABB is used instead.
+    for (size_t i = 0, c = renderableData.size(); i < c; i++) {
+        if (visibility[i].occluder && (visibleArray[i] & VISIBLE_RENDERABLE)) {
+            Box const& box = rcm.getAABB(instances[i]);
+            occlusionCuller.rasterize(worldTransforms[i].asMat4f(), box.center, box.halfExtent);
+        }
+    }
+
+    if (!occlusionCuller.hasOccluders()) {
+        return;
+    }
+
+    occlusionCuller.buildHierarchy();
+
+    if (mGpuCullingActive) {
+        // the hierarchy is used by the GpuCuller instead
+        return;
+    }
+
+    // occlusion culling job (this runs on multiple threads)
+    auto functor = [&occlusionCuller, worldAABBCenter, worldAABBExtent, visibleArray]
+            (uint32_t index, uint32_t c) {
+        occlusionCuller.cull(visibleArray + index,
+                worldAABBCenter + index, worldAABBExtent + index, c, VISIBLE_RENDERABLE_BIT);
+    };
+
+    // chunks write their own cache lines of the visibility mask
+    auto job = jobs::parallel_for(js, nullptr, 0, (uint32_t)renderableData.size(),
+            std::ref(functor), jobs::AlignedSplitter<64,
+                    FScene::RenderableSoa::getCacheLineElementCount(), 8>());
+    js.runAndWait(job);
+}
+
+void FView::cullRenderables(JobSystem& js, FScene::RenderableSoa& renderableData,
+        BVH const* bvh, Frustum const& frustum, size_t bit) noexcept {
+
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
+
+    if (bvh) {
+        // large scene, reject or accept whole groups of renderables at a time
+        bvh->cull(js, visibleArray, frustum, worldAABBCenter, worldAABBExtent, bit);
+        return;
+    }
 
     // culling job (this runs on multiple threads)
     auto functor = [&frustum, worldAABBCenter, worldAABBExtent, visibleArray, bit]
@@ -648,13 +1243,33 @@ void FView::cullRenderables(JobSystem& js,
                 worldAABBExtent + index, c, bit);
     };
 
-    // launch the computation on multiple threads
+    constexpr size_t CACHELINE_COUNT = FScene::RenderableSoa::getCacheLineElementCount();
+    constexpr size_t CULLING_ALIGNMENT =
+            Culler::MODULO > CACHELINE_COUNT ? Culler::MODULO : CACHELINE_COUNT;
+
+    // launch the computation on multiple threads. Culler rounds the count up to a multiple of
+    // MODULO, so chunks must start on such a multiple to not overlap. Aligning them on the
+    // cache lines of the visibility mask also avoids false sharing.
     auto job = jobs::parallel_for(js, nullptr, 0, (uint32_t)renderableData.size(),
-            std::ref(functor), jobs::CountSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>());
+            std::ref(functor), jobs::AlignedSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT,
+                    CULLING_ALIGNMENT, 8>());
     js.runAndWait(job);
 }
 
-void FView::prepareVisibleLights(FLightManager& lcm, utils::JobSystem&, FScene::LightSoa& lightData) const {
+void FView::cullRenderablesCached(JobSystem& js, FScene::RenderableSoa& renderableData,
+        Frustum const& frustum, size_t bit) const noexcept {
+    if (mTemporalCulling && mCullingCache.reuse(renderableData, frustum, bit)) {
+        return;
+    }
+    cullRenderables(js, renderableData, mScene->getBvh(), frustum, bit);
+    if (mTemporalCulling) {
+        mCullingCache.store(renderableData, frustum, bit);
+    }
+}
+
+void FView::prepareVisibleLights(FLightManager& lcm, utils::JobSystem&, ArenaScope& arena,
+        Viewport const& viewport, FScene::LightSoa& lightData) const {
+    SYSTRACE_CALL();
 
     auto const* UTILS_RESTRICT sphereArray     = lightData.data<FScene::POSITION_RADIUS>();
     auto const* UTILS_RESTRICT directions      = lightData.data<FScene::DIRECTION>();
@@ -699,6 +1314,8 @@ void FView::prepareVisibleLights(FLightManager& lcm, utils::JobSystem&, FScene::
         }
     }
 
+    visibleLightCount = selectVisibleLights(lcm, arena, viewport, lightData, visibleLightCount);
+
     // Partition array such that all visible lights appear first
     UTILS_UNUSED_IN_RELEASE auto last =
             std::partition(lightData.begin() + FScene::DIRECTIONAL_LIGHTS_COUNT, lightData.end(),
@@ -711,13 +1328,201 @@ void FView::prepareVisibleLights(FLightManager& lcm, utils::JobSystem&, FScene::
     mHasDynamicLighting = visibleLightCount > FScene::DIRECTIONAL_LIGHTS_COUNT;
 }
 
-void FView::updatePrimitivesLod(FEngine& engine, const CameraInfo&,
+size_t FView::selectVisibleLights(FLightManager& lcm, ArenaScope& rootArena,
+        Viewport const& viewport, FScene::LightSoa& lightData, size_t visibleLightCount) const {
+
+    /*
+     * Each visible light is ranked by an estimate of its contribution to the image: its
+     * intensity times the screen area its sphere of influence projects to. Lights covering
+     * less than a pixel are dropped, and only the mMaxLightCount first lights are kept.
+     * The lights kept in the previous frame are favored, so that lights with a similar rank
+     * don't flicker from a frame to the next.
+     */
+
+    // lights kept in the previous frame stay until they're half this size
+    constexpr float MIN_PIXEL_RADIUS = 1.0f;
+    // rank boost of the lights kept in the previous frame
+    constexpr float HYSTERESIS = 1.5f;
+
+    auto const* UTILS_RESTRICT sphereArray     = lightData.data<FScene::POSITION_RADIUS>();
+    auto const* UTILS_RESTRICT instanceArray   = lightData.data<FScene::LIGHT_INSTANCE>();
+    auto      * UTILS_RESTRICT visibleArray    = lightData.data<FScene::VISIBILITY>();
+
+    ArenaScope arena(rootArena.getAllocator());
+    const size_t count = lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT;
+    auto* const UTILS_RESTRICT ranks = arena.allocate<std::pair<float, uint32_t>>(count);
+
+    CameraInfo const& camera = mViewingCameraInfo;
+    const mat4f& p = camera.projection;
+    // pixels per unit of clip-space, vertically
+    const float pixelScale = 0.5f * viewport.height;
+    std::vector<uint32_t> const& previous = mSelectedLights;
+
+    size_t rankCount = 0;
+    for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT; i < lightData.size(); i++) {
+        if (!visibleArray[i]) {
+            continue;
+        }
+        const FLightManager::Instance li = instanceArray[i];
+        const bool wasSelected = std::binary_search(
+                previous.begin(), previous.end(), li.asValue());
+
+        const float4 sphere = sphereArray[i];
+        const float3 center = (camera.view * float4{ sphere.xyz, 1.0f }).xyz;
+        float area = 1.0f; // fraction of the screen, when the camera is in the light
+        if (dot(center, center) > sphere.w * sphere.w) {
+            // this handles both perspective (w = -z) and orthographic (w = 1) projections
+            const float w = std::max(std::numeric_limits<float>::min(),
+                    p[2].w * center.z + p[3].w);
+            const float radius = p[1].y * sphere.w / w; // in clip-space
+            if (radius * pixelScale < MIN_PIXEL_RADIUS * (wasSelected ? 0.5f : 1.0f)) {
+                visibleArray[i] = 0;
+                visibleLightCount--;
+                continue;
+            }
+            area = std::min(1.0f, float(M_PI / 4) * radius * radius);
+        }
+        const float rank = area * lcm.getIntensity(li) * (wasSelected ? HYSTERESIS : 1.0f);
+        ranks[rankCount++] = { rank, uint32_t(i) };
+    }
+
+    const size_t maxLightCount = mMaxLightCount;
+    if (rankCount > maxLightCount) {
+        std::nth_element(ranks, ranks + maxLightCount, ranks + rankCount,
+                [](auto const& lhs, auto const& rhs) { return lhs.first > rhs.first; });
+        for (size_t i = maxLightCount; i < rankCount; i++) {
+            visibleArray[ranks[i].second] = 0;
+        }
+        visibleLightCount -= rankCount - maxLightCount;
+        rankCount = maxLightCount;
+    }
+    SYSTRACE_VALUE32("selectedLights", rankCount);
+
+    // remember which lights we kept, for the next frame
+    std::vector<uint32_t>& selected = mSelectedLights;
+    selected.resize(rankCount);
+    for (size_t i = 0; i < rankCount; i++) {
+        selected[i] = instanceArray[ranks[i].second].asValue();
+    }
+    std::sort(selected.begin(), selected.end());
+
+    return visibleLightCount;
+}
+
+bool FView::updatePrimitivesLod(JobSystem& js, FEngine& engine, const CameraInfo& camera,
+        ArenaScope& arena, bool snapshot,
         FScene::RenderableSoa& renderableData, Range visibles) noexcept {
+    SYSTRACE_CALL();
+
     FRenderableManager const& rcm = engine.getRenderableManager();
-    for (uint32_t index : visibles) {
-        uint8_t level = 0; // TODO: pick the proper level of detail
-        auto ri = renderableData.elementAt<FScene::RENDERABLE_INSTANCE>(index);
-        renderableData.elementAt<FScene::PRIMITIVES>(index) = rcm.getRenderPrimitives(ri, level);
+    auto const* instances         = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    uint8_t* levels               = renderableData.data<FScene::LEVEL_OF_DETAIL>();
+    auto* primitives              = renderableData.data<FScene::PRIMITIVES>();
+
+    // The screen coverage is the fraction of the viewport's height covered by the bounding
+    // sphere, i.e. radius * P[1][1] / distance with a perspective projection. We use the
+    // distance rather than the depth so that levels don't change when the camera rotates.
+    const float scale = camera.projection[1][1];
+    const bool perspective = camera.projection[2][3] != 0;
+    const float3 position = camera.getPosition();
+    const float near = camera.zn;
+
+    auto functor = [&rcm, instances, worldAABBCenter, worldAABBExtent, levels, primitives,
+            scale, perspective, position, near](uint32_t index, uint32_t c) {
+        for (uint32_t i = index, last = index + c; i < last; i++) {
+            auto ri = instances[i];
+            FRenderableManager::LevelsOfDetail const* lods = rcm.getLevelsOfDetail(ri);
+            uint8_t level = 0;
+            if (UTILS_UNLIKELY(lods)) {
+                const float radius = length(worldAABBExtent[i]);
+                const float distance = perspective ?
+                        std::max(length(worldAABBCenter[i] - position), near) : 1.0f;
+                level = FRenderableManager::selectLevel(*lods, radius * scale / distance, levels[i]);
+            }
+            levels[i] = level;
+            primitives[i] = rcm.getRenderPrimitives(ri, level);
+        }
+    };
+
+    auto job = jobs::parallel_for(js, nullptr, visibles.first, uint32_t(visibles.size()),
+            std::ref(functor), jobs::CountSplitter<64, 8>());
+    js.runAndWait(job);
+
+    if (!snapshot || visibles.empty()) {
+        return true;
+    }
+
+    // In snapshot mode, the primitives are copied into the frame's arena, so that the passes
+    // don't read the RenderableManager, whose components can be changed for the next frame.
+    uint32_t* const offsets = arena.allocate<uint32_t>(visibles.size() + 1);
+    if (!offsets) {
+        return false;
+    }
+    offsets[0] = 0;
+    for (uint32_t i = 0, c = uint32_t(visibles.size()); i < c; i++) {
+        offsets[i + 1] = offsets[i] + uint32_t(primitives[visibles.first + i].size());
+    }
+    FRenderPrimitive* const copies =
+            arena.allocate<FRenderPrimitive>(offsets[visibles.size()]);
+    if (!copies) {
+        return false;
+    }
+
+    auto copy = [primitives, offsets, copies, first = visibles.first](uint32_t index, uint32_t c) {
+        for (uint32_t i = index, last = index + c; i < last; i++) {
+            utils::Slice<FRenderPrimitive>& slice = primitives[i];
+            FRenderPrimitive* const dst = copies + offsets[i - first];
+            std::uninitialized_copy(slice.cbegin(), slice.cend(), dst);
+            slice.set(dst, slice.size());
+        }
+    };
+
+    job = jobs::parallel_for(js, nullptr, visibles.first, uint32_t(visibles.size()),
+            std::ref(copy), jobs::CountSplitter<64, 8>());
+    js.runAndWait(job);
+    return true;
+}
+
+void FView::updateStreamingTextures(FEngine& engine, const CameraInfo& camera,
+        Viewport const& viewport, FScene::RenderableSoa const& renderableData,
+        Range visibles) noexcept {
+    SYSTRACE_CALL();
+
+    TextureStreamer const& streamer = engine.getTextureStreamer();
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    auto const* primitives        = renderableData.data<FScene::PRIMITIVES>();
+
+    // Same screen coverage as updatePrimitivesLod(), converted to the diameter of the bounding
+    // sphere in pixels. This assumes the textures are mapped once over the renderable.
+    const float scale = camera.projection[1][1] * float(viewport.height);
+    const bool perspective = camera.projection[2][3] != 0;
+    const float3 position = camera.getPosition();
+    const float near = camera.zn;
+
+    for (uint32_t i = visibles.first; i < visibles.last; i++) {
+        const float radius = length(worldAABBExtent[i]);
+        const float distance = perspective ?
+                std::max(length(worldAABBCenter[i] - position), near) : 1.0f;
+        const float pixels = radius * scale / distance;
+        for (FRenderPrimitive const& primitive : primitives[i]) {
+            FMaterialInstance const* const mi = primitive.getMaterialInstance();
+            if (!mi) {
+                continue;
+            }
+            SamplerBuffer const& samplers = mi->getSamplerBuffer();
+            SamplerBuffer::Sampler const* const buffer = samplers.getBuffer();
+            for (size_t j = 0, n = samplers.getSize(); j < n; j++) {
+                if (buffer[j].t) {
+                    FTexture* const texture = streamer.find(buffer[j].t);
+                    if (texture) {
+                        texture->requestSize(pixels);
+                    }
+                }
+            }
+        }
     }
 }
 
@@ -800,6 +1605,14 @@ void View::setShadowsEnabled(bool enabled) noexcept {
     upcast(this)->setShadowsEnabled(enabled);
 }
 
+void View::setMaxShadowMapSize(uint32_t size) noexcept {
+    upcast(this)->setMaxShadowMapSize(size);
+}
+
+uint32_t View::getMaxShadowMapSize() const noexcept {
+    return upcast(this)->getMaxShadowMapSize();
+}
+
 void View::setRenderTarget(TargetBufferFlags discard) noexcept {
     upcast(this)->setRenderTarget(discard);
 }
@@ -836,9 +1649,49 @@ void View::setDepthPrepass(View::DepthPrepass prepass) noexcept {
     upcast(this)->setDepthPrepass(prepass);
 }
 
+void View::setOcclusionCulling(bool enabled) noexcept {
+    upcast(this)->setOcclusionCulling(enabled);
+}
+
+bool View::isOcclusionCullingEnabled() const noexcept {
+    return upcast(this)->isOcclusionCullingEnabled();
+}
+
+void View::setGpuCulling(bool enabled) noexcept {
+    upcast(this)->setGpuCulling(enabled);
+}
+
+bool View::isGpuCullingEnabled() const noexcept {
+    return upcast(this)->isGpuCullingEnabled();
+}
+
+void View::setTemporalCulling(bool enabled) noexcept {
+    upcast(this)->setTemporalCulling(enabled);
+}
+
+bool View::isTemporalCullingEnabled() const noexcept {
+    return upcast(this)->isTemporalCullingEnabled();
+}
+
+void View::setOrderIndependentTransparency(bool enabled) noexcept {
+    upcast(this)->setOrderIndependentTransparency(enabled);
+}
+
+bool View::isOrderIndependentTransparencyEnabled() const noexcept {
+    return upcast(this)->isOrderIndependentTransparencyEnabled();
+}
+
 void View::setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept {
     upcast(this)->setDynamicLightingOptions(zLightNear, zLightFar);
 }
 
+void View::setDynamicLightingFroxelCount(uint32_t froxelCount) noexcept {
+    upcast(this)->setDynamicLightingFroxelCount(froxelCount);
+}
+
+void View::setDynamicLightingMaxLightCount(uint32_t maxLightCount) noexcept {
+    upcast(this)->setDynamicLightingMaxLightCount(maxLightCount);
+}
+
 
 } // namespace filament
@@ -32,6 +32,7 @@ namespace details {
 
 FCameraManager::FCameraManager(FEngine& engine) noexcept
         : mEngine(engine) {
+    mManager.trackDestroyedEntities(EntityManager::get());
 }
 
 FCameraManager::~FCameraManager() noexcept {
@@ -76,6 +76,7 @@ private:
 
     struct CameraManagerImpl : public Base {
         using Base::gc;
+        using Base::trackDestroyedEntities;
         using Base::swap;
         using Base::hasComponent;
     } mManager;
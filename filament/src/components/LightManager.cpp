@@ -138,6 +138,7 @@ namespace details {
 
 FLightManager::FLightManager(FEngine& engine) noexcept : mEngine(engine) {
     // DON'T use engine here in the ctor, because it's not fully constructed yet.
+    mManager.trackDestroyedEntities(EntityManager::get());
 }
 
 FLightManager::~FLightManager() {
@@ -157,6 +158,7 @@ void FLightManager::create(const FLightManager::Builder& builder, utils::Entity
     }
     Instance i = manager.addComponent(entity);
     assert(i);
+    mStructureVersion++;
 
     if (i) {
         // This needs to happen before we call the set() methods below
@@ -173,6 +175,18 @@ void FLightManager::create(const FLightManager::Builder& builder, utils::Entity
         shadowParams.shadowFar = std::max(builder->mShadowOptions.shadowFar, 0.0f);
         shadowParams.shadowNearHint = std::max(builder->mShadowOptions.shadowNearHint, 0.0f);
         shadowParams.shadowFarHint = std::max(builder->mShadowOptions.shadowFarHint, 0.0f);
+        shadowParams.shadowCascades = uint8_t(clamp(
+                size_t(builder->mShadowOptions.shadowCascades), size_t(1), CONFIG_MAX_SHADOW_CASCADES));
+        // split positions must be increasing, otherwise the next cascades are empty
+        float previousSplit = 0.0f;
+        for (size_t c = 0; c < CONFIG_MAX_SHADOW_CASCADES - 1; c++) {
+            const float split = clamp(builder->mShadowOptions.cascadeSplitPositions[c],
+                    previousSplit, 1.0f);
+            shadowParams.cascadeSplitPositions[c] = split;
+            previousSplit = split;
+        }
+        shadowParams.cacheStaticCasters = builder->mShadowOptions.cacheStaticCasters;
+        shadowParams.adaptiveMapSize = builder->mShadowOptions.adaptiveMapSize;
 
         // set default values by calling the setters
         setLocalPosition(i, builder->mPosition);
@@ -198,6 +212,7 @@ void FLightManager::destroy(utils::Entity e) noexcept {
     if (i) {
         auto& manager = mManager;
         manager.removeComponent(e);
+        mStructureVersion++;
     }
 }
 
@@ -216,18 +231,21 @@ void FLightManager::terminate() noexcept {
 }
 
 void FLightManager::setLocalPosition(Instance i, const math::float3& position) noexcept {
+    mVersion++;
     assert(i);
     auto& manager = mManager;
     manager[i].position = position;
 }
 
 void FLightManager::setLocalDirection(Instance i, float3 direction) noexcept {
+    mVersion++;
     assert(i);
     auto& manager = mManager;
     manager[i].direction = direction;
 }
 
 void FLightManager::setColor(Instance i, const LinearColor& color) noexcept {
+    mVersion++;
     if (i) {
         auto& manager = mManager;
         manager[i].color = color;
@@ -235,6 +253,7 @@ void FLightManager::setColor(Instance i, const LinearColor& color) noexcept {
 }
 
 void FLightManager::setIntensity(Instance i, float intensity) noexcept {
+    mVersion++;
     auto& manager = mManager;
     if (i) {
         Type type = getLightType(i).type;
@@ -272,6 +291,7 @@ void FLightManager::setIntensity(Instance i, float intensity) noexcept {
 }
 
 void FLightManager::setFalloff(Instance i, float falloff) noexcept {
+    mVersion++;
     auto& manager = mManager;
     if (i && !isDirectionalLight(i)) {
         float sqFalloff = falloff * falloff;
@@ -282,6 +302,7 @@ void FLightManager::setFalloff(Instance i, float falloff) noexcept {
 }
 
 void FLightManager::setSpotLightCone(Instance i, float inner, float outer) noexcept {
+    mVersion++;
     auto& manager = mManager;
     if (i && isSpotLight(i)) {
         // clamp the inner/outer angles to pi
@@ -314,6 +335,7 @@ void FLightManager::setSpotLightCone(Instance i, float inner, float outer) noexc
 }
 
 void FLightManager::setSunAngularRadius(Instance i, float angularRadius) noexcept {
+    mVersion++;
     auto& manager = mManager;
     if (i && isSunLight(i)) {
         angularRadius = clamp(angularRadius, 0.25f, 20.0f);
@@ -322,6 +344,7 @@ void FLightManager::setSunAngularRadius(Instance i, float angularRadius) noexcep
 }
 
 void FLightManager::setSunHaloSize(Instance i, float haloSize) noexcept {
+    mVersion++;
     auto& manager = mManager;
     if (i && isSunLight(i)) {
         manager[i].sunHaloSize = haloSize;
@@ -329,6 +352,7 @@ void FLightManager::setSunHaloSize(Instance i, float haloSize) noexcept {
 }
 
 void FLightManager::setSunHaloFalloff(Instance i, float haloFalloff) noexcept {
+    mVersion++;
     auto& manager = mManager;
     if (i && isSunLight(i)) {
         manager[i].sunHaloFalloff = haloFalloff;
@@ -21,6 +21,7 @@
 
 #include "driver/DriverApiForward.h"
 
+#include <filament/EngineEnums.h>
 #include <filament/LightManager.h>
 
 #include <utils/Entity.h>
@@ -28,6 +29,8 @@
 
 #include <math/mat4.h>
 
+#include <atomic>
+
 namespace filament {
 namespace details {
 
@@ -60,9 +63,20 @@ public:
     void prepare(driver::DriverApi& driver) const noexcept;
 
     void gc(utils::EntityManager& em) noexcept {
+        const size_t count = mManager.getComponentCount();
         mManager.gc(em);
+        mStructureVersion += uint32_t(count != mManager.getComponentCount());
+    }
+
+    // changes when components are added, removed or moved, i.e. when previously
+    // retrieved Instances must be considered invalid.
+    uint32_t getStructureVersion() const noexcept {
+        return mStructureVersion.load(std::memory_order_relaxed);
     }
 
+    // changes whenever the parameters of a light change
+    uint32_t getVersion() const noexcept { return mVersion.load(std::memory_order_relaxed); }
+
     struct LightType {
         Type type : 3;
         uint8_t shadowMapBits : 4;
@@ -84,6 +98,10 @@ public:
         float shadowFar;
         float shadowNearHint;
         float shadowFarHint;
+        uint8_t shadowCascades;
+        float cascadeSplitPositions[CONFIG_MAX_SHADOW_CASCADES - 1];
+        bool cacheStaticCasters;
+        bool adaptiveMapSize;
     };
 
     UTILS_NOINLINE void setLocalPosition(Instance i, const math::float3& position) noexcept;
@@ -219,12 +237,12 @@ private:
         FALLOFF,
     };
 
-    using Base = utils::SingleInstanceComponentManager<  // 120 bytes
+    using Base = utils::SingleInstanceComponentManager<  // 144 bytes
             LightType,      //  1
             math::float3,   // 12
             math::float3,   // 12
             math::float3,   // 12
-            ShadowParams,   // 12
+            ShadowParams,   // 36
             SpotParams,     // 24
             float,          //  4
             float,          //  4
@@ -235,6 +253,7 @@ private:
 
     struct Sim : public Base {
         using Base::gc;
+        using Base::trackDestroyedEntities;
         using Base::swap;
 
         struct Proxy {
@@ -269,6 +288,8 @@ private:
 
     Sim mManager;
     FEngine& mEngine;
+    std::atomic<uint32_t> mVersion = { 0 };
+    std::atomic<uint32_t> mStructureVersion = { 0 };
 };
 
 FILAMENT_UPCAST(LightManager)
@@ -0,0 +1,604 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FilamentAPI-impl.h"
+
+#include "components/ParticleManager.h"
+
+#include "details/Camera.h"
+#include "details/Engine.h"
+#include "details/IndexBuffer.h"
+#include "details/Material.h"
+#include "details/MaterialInstance.h"
+#include "details/Scene.h"
+#include "details/VertexBuffer.h"
+#include "details/View.h"
+
+#include <filament/IndexBuffer.h>
+#include <filament/RenderableManager.h>
+#include <filament/VertexBuffer.h>
+
+#include <utils/Log.h>
+#include <utils/Panic.h>
+#include <utils/Systrace.h>
+
+#include <math/mat4.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <math.h>
+#include <stdlib.h>
+
+using namespace math;
+using namespace utils;
+
+namespace filament {
+
+using namespace driver;
+using namespace details;
+
+// ------------------------------------------------------------------------------------------------
+
+struct ParticleManager::BuilderDetails {
+    size_t mMaxParticleCount = 0;
+    MaterialInstance const* mMaterialInstance = nullptr;
+    Box mBoundingBox = { float3{ 0 }, float3{ 1 } };
+    float mEmissionRate = 0;
+    float2 mLifetime = { 1, 1 };
+    float3 mDirection = { 0, 1, 0 };
+    float mSpreadAngle = 0;
+    float2 mSpeed = { 1, 1 };
+    float3 mAcceleration = {};
+    float mDrag = 0;
+    float2 mSize = { 0.1f, 0.1f };
+    LinearColorA mStartColor = LinearColorA{ 1 };
+    LinearColorA mEndColor = LinearColorA{ 1 };
+    bool mSorted = false;
+    bool mCastShadows = false;
+    bool mReceiveShadows = false;
+
+    explicit BuilderDetails(size_t maxParticleCount) noexcept
+            : mMaxParticleCount(maxParticleCount) { }
+    // this is only needed for the explicit instantiation below
+    BuilderDetails() = default;
+};
+
+using BuilderType = ParticleManager;
+BuilderType::Builder::Builder(size_t maxParticleCount) noexcept
+        : BuilderBase<ParticleManager::BuilderDetails>(maxParticleCount) {}
+BuilderType::Builder::~Builder() noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder&& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder&& rhs) noexcept = default;
+
+ParticleManager::Builder& ParticleManager::Builder::material(
+        MaterialInstance const* materialInstance) noexcept {
+    mImpl->mMaterialInstance = materialInstance;
+    return *this;
+}
+
+ParticleManager::Builder& ParticleManager::Builder::boundingBox(const Box& aabb) noexcept {
+    mImpl->mBoundingBox = aabb;
+    return *this;
+}
+
+ParticleManager::Builder& ParticleManager::Builder::emissionRate(float particlesPerSecond) noexcept {
+    mImpl->mEmissionRate = particlesPerSecond;
+    return *this;
+}
+
+ParticleManager::Builder& ParticleManager::Builder::lifetime(float min, float max) noexcept {
+    mImpl->mLifetime = { min, max };
+    return *this;
+}
+
+ParticleManager::Builder& ParticleManager::Builder::direction(
+        float3 const& direction, float spreadAngle) noexcept {
+    mImpl->mDirection = direction;
+    mImpl->mSpreadAngle = spreadAngle;
+    return *this;
+}
+
+ParticleManager::Builder& ParticleManager::Builder::speed(float min, float max) noexcept {
+    mImpl->mSpeed = { min, max };
+    return *this;
+}
+
+ParticleManager::Builder& ParticleManager::Builder::acceleration(
+        float3 const& acceleration) noexcept {
+    mImpl->mAcceleration = acceleration;
+    return *this;
+}
+
+ParticleManager::Builder& ParticleManager::Builder::drag(float drag) noexcept {
+    mImpl->mDrag = drag;
+    return *this;
+}
+
+ParticleManager::Builder& ParticleManager::Builder::size(float start, float end) noexcept {
+    mImpl->mSize = { start, end };
+    return *this;
+}
+
+ParticleManager::Builder& ParticleManager::Builder::color(
+        LinearColorA const& start, LinearColorA const& end) noexcept {
+    mImpl->mStartColor = start;
+    mImpl->mEndColor = end;
+    return *this;
+}
+
+ParticleManager::Builder& ParticleManager::Builder::sorted(bool enable) noexcept {
+    mImpl->mSorted = enable;
+    return *this;
+}
+
+ParticleManager::Builder& ParticleManager::Builder::castShadows(bool enable) noexcept {
+    mImpl->mCastShadows = enable;
+    return *this;
+}
+
+ParticleManager::Builder& ParticleManager::Builder::receiveShadows(bool enable) noexcept {
+    mImpl->mReceiveShadows = enable;
+    return *this;
+}
+
+ParticleManager::Builder::Result ParticleManager::Builder::build(Engine& engine, Entity entity) {
+    return upcast(engine).createParticles(*this, entity) ? Success : Error;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+namespace details {
+
+FParticleManager::FParticleManager(FEngine& engine) noexcept : mEngine(engine) {
+    // DON'T use engine here in the ctor, because it's not fully constructed yet.
+    mManager.trackDestroyedEntities(EntityManager::get());
+}
+
+FParticleManager::~FParticleManager() noexcept {
+    // all components should have been destroyed when we get here
+    // (terminate should have been called from Engine's shutdown())
+    assert(mManager.getComponentCount() == 0);
+}
+
+void FParticleManager::terminate() noexcept {
+    auto& manager = mManager;
+    if (!manager.empty()) {
+#ifndef NDEBUG
+        slog.d << "cleaning up " << manager.getComponentCount()
+               << " leaked Particle components" << io::endl;
+#endif
+        while (!manager.empty()) {
+            Instance ci = manager.end() - 1;
+            destroy(manager.getEntity(ci));
+        }
+    }
+    for (FMaterialInstance* mi : mMaterialInstances) {
+        mEngine.destroy(mi);
+    }
+    mMaterialInstances.clear();
+    mMaterialInstancesUsed = 0;
+}
+
+void FParticleManager::gc(utils::EntityManager& em) noexcept {
+    auto& manager = mManager;
+    manager.gc(em, 4, [this](Entity e) {
+        destroy(e);
+    });
+}
+
+bool FParticleManager::create(const Builder& builder, Entity entity) {
+    FEngine& engine = mEngine;
+    DriverApi& driver = engine.getDriverApi();
+    auto& manager = mManager;
+
+    if (!driver.isComputeSupported()) {
+        slog.e << "Particles require compute programs, which this backend can't run"
+               << io::endl;
+        return false;
+    }
+    ASSERT_PRECONDITION(builder->mMaterialInstance, "Particles need a material instance");
+    ASSERT_PRECONDITION(builder->mMaxParticleCount > 0, "Particles need a maximum count");
+    ASSERT_PRECONDITION(!builder->mSorted ||
+            builder->mMaxParticleCount <= MAX_SORTED_PARTICLE_COUNT,
+            "Sorted particles can't be more than %u", unsigned(MAX_SORTED_PARTICLE_COUNT));
+
+    if (UTILS_UNLIKELY(manager.hasComponent(entity))) {
+        destroy(entity);
+    }
+    Instance i = manager.addComponent(entity);
+    assert(i);
+
+    const uint32_t capacity = uint32_t(builder->mMaxParticleCount);
+    const uint32_t vertexCount = capacity * 4;
+
+    Emitter& emitter = manager.elementAt<EMITTER>(i);
+    emitter = {};
+    emitter.capacity = capacity;
+    emitter.sorted = builder->mSorted;
+
+    // the content of the vertex buffer is copied from the vertices written by the compute program
+    emitter.vertexBuffer = upcast(VertexBuffer::Builder()
+            .vertexCount(vertexCount)
+            .bufferCount(1)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT4,  0, VERTEX_SIZE)
+            .attribute(VertexAttribute::TANGENTS, 0, VertexBuffer::AttributeType::FLOAT4, 16, VERTEX_SIZE)
+            .attribute(VertexAttribute::COLOR,    0, VertexBuffer::AttributeType::FLOAT4, 32, VERTEX_SIZE)
+            .attribute(VertexAttribute::UV0,      0, VertexBuffer::AttributeType::FLOAT2, 48, VERTEX_SIZE)
+            .attribute(VertexAttribute::UV1,      0, VertexBuffer::AttributeType::FLOAT2, 56, VERTEX_SIZE)
+            .build(engine));
+
+    // two triangles per particle, this never changes
+    const bool shortIndices = vertexCount <= 65536;
+    const size_t indexCount = capacity * 6;
+    const size_t indexSize = shortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+    void* const indices = malloc(indexCount * indexSize);
+    for (uint32_t p = 0; p < capacity; p++) {
+        const uint32_t quad[6] = { p * 4, p * 4 + 1, p * 4 + 2, p * 4 + 2, p * 4 + 1, p * 4 + 3 };
+        for (size_t k = 0; k < 6; k++) {
+            if (shortIndices) {
+                static_cast<uint16_t*>(indices)[p * 6 + k] = uint16_t(quad[k]);
+            } else {
+                static_cast<uint32_t*>(indices)[p * 6 + k] = quad[k];
+            }
+        }
+    }
+    emitter.indexBuffer = upcast(IndexBuffer::Builder()
+            .indexCount(uint32_t(indexCount))
+            .bufferType(shortIndices ? IndexBuffer::IndexType::USHORT : IndexBuffer::IndexType::UINT)
+            .build(engine));
+    emitter.indexBuffer->setBuffer(engine, { indices, indexCount * indexSize,
+            [](void* buffer, size_t, void*) { free(buffer); }});
+
+    // all the particles start dead
+    const size_t particlesSize = capacity * sizeof(Particle);
+    Particle* const particles = static_cast<Particle*>(malloc(particlesSize));
+    std::fill_n(particles, capacity, Particle{ float4{ 0, 0, 0, -1 }, float4{ 0 }});
+    emitter.particles = driver.createStorageBuffer(particlesSize);
+    driver.updateStorageBuffer(emitter.particles, { particles, particlesSize,
+            [](void* buffer, size_t, void*) { free(buffer); }}, 0);
+    if (emitter.sorted) {
+        emitter.order = driver.createStorageBuffer(capacity * sizeof(uint32_t));
+    }
+    emitter.vertices = driver.createStorageBuffer(vertexCount * VERTEX_SIZE);
+
+    setEmissionRate(i, builder->mEmissionRate);
+    setLifetime(i, builder->mLifetime.x, builder->mLifetime.y);
+    setDirection(i, builder->mDirection, builder->mSpreadAngle);
+    setSpeed(i, builder->mSpeed.x, builder->mSpeed.y);
+    setAcceleration(i, builder->mAcceleration);
+    setDrag(i, builder->mDrag);
+    setSize(i, builder->mSize.x, builder->mSize.y);
+    setColor(i, builder->mStartColor, builder->mEndColor);
+
+    RenderableManager::Builder(1)
+            .boundingBox(builder->mBoundingBox)
+            .material(0, builder->mMaterialInstance)
+            .geometry(0, RenderableManager::PrimitiveType::TRIANGLES,
+                    emitter.vertexBuffer, emitter.indexBuffer)
+            .castShadows(builder->mCastShadows)
+            .receiveShadows(builder->mReceiveShadows)
+            .build(engine, entity);
+
+    // the particles are emitted from the origin of the entity
+    FTransformManager& tcm = engine.getTransformManager();
+    if (!tcm.hasComponent(entity)) {
+        tcm.create(entity);
+    }
+    return true;
+}
+
+void FParticleManager::destroy(Entity e) noexcept {
+    auto& manager = mManager;
+    Instance i = manager.getInstance(e);
+    if (i) {
+        FEngine& engine = mEngine;
+        DriverApi& driver = engine.getDriverApi();
+        Emitter& emitter = manager.elementAt<EMITTER>(i);
+
+        // the renderable draws the vertex buffer
+        engine.getRenderableManager().destroy(e);
+        engine.destroy(emitter.vertexBuffer);
+        engine.destroy(emitter.indexBuffer);
+        driver.destroyStorageBuffer(emitter.particles);
+        if (emitter.order) {
+            driver.destroyStorageBuffer(emitter.order);
+        }
+        driver.destroyStorageBuffer(emitter.vertices);
+        emitter = {};
+        manager.removeComponent(e);
+    }
+}
+
+FMaterialInstance* FParticleManager::acquireMaterialInstance() noexcept {
+    if (mMaterialInstancesUsed == mMaterialInstances.size()) {
+        mMaterialInstances.push_back(mEngine.getParticlesMaterial()->createInstance());
+    }
+    return mMaterialInstances[mMaterialInstancesUsed++];
+}
+
+void FParticleManager::dispatch(FMaterialInstance* mi, Emitter const& emitter,
+        Pass pass) noexcept {
+    DriverApi& driver = mEngine.getDriverApi();
+    Handle<HwProgram> const ph = mi->getMaterial()->getComputeProgram();
+
+    static_cast<MaterialInstance*>(mi)->setParameter("particleCount", int32_t(emitter.capacity));
+    static_cast<MaterialInstance*>(mi)->setParameter("pass", int32_t(pass));
+    mi->commit(mEngine);
+
+    driver.bindUniforms(BindingPoints::PER_MATERIAL_INSTANCE, mi->getUniformBuffer());
+    driver.bindStorageBuffer(0, emitter.particles);
+    // the order isn't read without sorting, but something must be bound
+    driver.bindStorageBuffer(1, emitter.order ? emitter.order : emitter.particles);
+    driver.bindStorageBuffer(2, emitter.vertices);
+    // the sort is done by a single work group
+    driver.dispatchCompute(ph,
+            pass == Pass::SORT ? 1 : (emitter.capacity + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+}
+
+void FParticleManager::prepare() noexcept {
+    SYSTRACE_CALL();
+
+    // the material instances of the previous frame can be used again
+    mMaterialInstancesUsed = 0;
+
+    const float dt = mPendingTime;
+    mPendingTime = 0;
+    if (mManager.empty() || dt <= 0 || !mEngine.getParticlesMaterial()->getComputeProgram()) {
+        return;
+    }
+
+    FTransformManager const& tcm = mEngine.getTransformManager();
+    auto& manager = mManager;
+    for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
+        Params const& params = manager.elementAt<PARAMS>(i);
+        Emitter& emitter = manager.elementAt<EMITTER>(i);
+
+        // the fraction of a particle not emitted this frame is emitted later
+        const float emission = emitter.pendingEmission + params.emissionRate * dt;
+        uint32_t count = uint32_t(emission);
+        emitter.pendingEmission = emission - float(count);
+        count = std::min(count + emitter.burst, emitter.capacity);
+        emitter.burst = 0;
+        const uint32_t first = emitter.nextSlot;
+        emitter.nextSlot = (first + count) % emitter.capacity;
+
+        auto ti = tcm.getInstance(manager.getEntity(i));
+        const mat4f worldFromEmitter = ti ? tcm.getWorldTransform(ti) : mat4f{};
+
+        FMaterialInstance* const fmi = acquireMaterialInstance();
+        MaterialInstance* const mi = fmi;
+        mi->setParameter("worldFromEmitter", worldFromEmitter);
+        mi->setParameter("direction", params.direction);
+        mi->setParameter("acceleration", params.acceleration);
+        mi->setParameter("speed", params.speed);
+        mi->setParameter("lifetime", params.lifetime);
+        mi->setParameter("drag", params.drag);
+        mi->setParameter("deltaTime", dt);
+        mi->setParameter("emitFirst", int32_t(first));
+        mi->setParameter("emitCount", int32_t(count));
+        mi->setParameter("seed", int32_t(mSeed++));
+        dispatch(fmi, emitter, Pass::SIMULATE);
+    }
+
+    // the particles are read by prepareView()
+    mEngine.getDriverApi().memoryBarrier(BARRIER_STORAGE_BUFFER);
+}
+
+void FParticleManager::prepareView(FView const& view) noexcept {
+    FScene const* const scene = view.getScene();
+    if (mManager.empty() || !scene || !mEngine.getParticlesMaterial()->getComputeProgram()) {
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    // The visible renderables are followed by the shadow casters that are only visible from the
+    // lights. The quads of both are needed.
+    FRenderableManager const& rcm = mEngine.getRenderableManager();
+    FScene::RenderableSoa const& soa = scene->getRenderableData();
+    auto const* const instances = soa.data<FScene::RENDERABLE_INSTANCE>();
+    const uint32_t end = std::max(
+            view.getVisibleRenderables().last, view.getVisibleShadowCasters().last);
+    mVisibleEmitters.clear();
+    for (uint32_t j = 0; j < end; j++) {
+        Instance i = mManager.getInstance(rcm.getEntity(instances[j]));
+        if (i) {
+            mVisibleEmitters.push_back(i);
+        }
+    }
+    if (mVisibleEmitters.empty()) {
+        return;
+    }
+
+    // the particles are in world space, the camera is relative to the world origin
+    CameraInfo const& camera = view.getCameraInfo();
+    const mat4f cameraModel = inverse(camera.worldOrigin) * camera.model;
+    const float4 cameraPosition{ cameraModel[3].xyz, 1 };
+    const float4 cameraRight{ normalize(cameraModel[0].xyz), 0 };
+    const float4 cameraUp{ normalize(cameraModel[1].xyz), 0 };
+
+    FTransformManager const& tcm = mEngine.getTransformManager();
+    auto& manager = mManager;
+    auto setParameters = [&](MaterialInstance* mi, Instance i) {
+        Params const& params = manager.elementAt<PARAMS>(i);
+        Emitter const& emitter = manager.elementAt<EMITTER>(i);
+        auto ti = tcm.getInstance(manager.getEntity(i));
+        const mat4f worldFromEmitter = ti ? tcm.getWorldTransform(ti) : mat4f{};
+        uint32_t sortCount = 0;
+        if (emitter.sorted) {
+            // the bitonic sort needs a power of two
+            sortCount = 1;
+            while (sortCount < emitter.capacity) {
+                sortCount *= 2;
+            }
+        }
+        mi->setParameter("emitterFromWorld", inverse(worldFromEmitter));
+        mi->setParameter("cameraPosition", cameraPosition);
+        mi->setParameter("cameraRight", cameraRight);
+        mi->setParameter("cameraUp", cameraUp);
+        mi->setParameter("size", params.size);
+        mi->setParameter("startColor", params.startColor);
+        mi->setParameter("endColor", params.endColor);
+        mi->setParameter("sortCount", int32_t(sortCount));
+    };
+
+    DriverApi& driver = mEngine.getDriverApi();
+    bool sorted = false;
+    for (Instance i : mVisibleEmitters) {
+        Emitter const& emitter = manager.elementAt<EMITTER>(i);
+        if (emitter.sorted) {
+            FMaterialInstance* const mi = acquireMaterialInstance();
+            setParameters(mi, i);
+            dispatch(mi, emitter, Pass::SORT);
+            sorted = true;
+        }
+    }
+    if (sorted) {
+        driver.memoryBarrier(BARRIER_STORAGE_BUFFER);
+    }
+
+    for (Instance i : mVisibleEmitters) {
+        FMaterialInstance* const mi = acquireMaterialInstance();
+        setParameters(mi, i);
+        dispatch(mi, manager.elementAt<EMITTER>(i), Pass::EXPAND);
+    }
+    driver.memoryBarrier(BARRIER_VERTEX_ATTRIBUTES);
+
+    for (Instance i : mVisibleEmitters) {
+        Emitter const& emitter = manager.elementAt<EMITTER>(i);
+        driver.copyStorageBufferToVertexBuffer(emitter.vertices, 0,
+                emitter.vertexBuffer->getHwHandle(), 0, 0, emitter.capacity * 4 * VERTEX_SIZE);
+    }
+}
+
+void FParticleManager::emit(Instance i, size_t count) noexcept {
+    Emitter& emitter = mManager.elementAt<EMITTER>(i);
+    emitter.burst = uint32_t(std::min(emitter.burst + count, size_t(emitter.capacity)));
+}
+
+void FParticleManager::setEmissionRate(Instance i, float particlesPerSecond) noexcept {
+    mManager.elementAt<PARAMS>(i).emissionRate = std::max(0.0f, particlesPerSecond);
+}
+
+void FParticleManager::setLifetime(Instance i, float min, float max) noexcept {
+    // a particle is dead once its age reaches its lifetime
+    min = std::max(min, std::numeric_limits<float>::min());
+    mManager.elementAt<PARAMS>(i).lifetime = { min, std::max(min, max) };
+}
+
+void FParticleManager::setDirection(Instance i, float3 const& direction,
+        float spreadAngle) noexcept {
+    const float cosSpread = std::cos(clamp(spreadAngle, 0.0f, float(M_PI)));
+    mManager.elementAt<PARAMS>(i).direction = { normalize(direction), cosSpread };
+}
+
+void FParticleManager::setSpeed(Instance i, float min, float max) noexcept {
+    mManager.elementAt<PARAMS>(i).speed = { min, max };
+}
+
+void FParticleManager::setAcceleration(Instance i, float3 const& acceleration) noexcept {
+    mManager.elementAt<PARAMS>(i).acceleration = { acceleration, 0 };
+}
+
+void FParticleManager::setDrag(Instance i, float drag) noexcept {
+    mManager.elementAt<PARAMS>(i).drag = std::max(0.0f, drag);
+}
+
+void FParticleManager::setSize(Instance i, float start, float end) noexcept {
+    mManager.elementAt<PARAMS>(i).size = { start, end };
+}
+
+void FParticleManager::setColor(Instance i, LinearColorA const& start,
+        LinearColorA const& end) noexcept {
+    Params& params = mManager.elementAt<PARAMS>(i);
+    params.startColor = start;
+    params.endColor = end;
+}
+
+} // namespace details
+
+// ------------------------------------------------------------------------------------------------
+// Trampoline calling into private implementation
+// ------------------------------------------------------------------------------------------------
+
+using namespace details;
+
+bool ParticleManager::hasComponent(Entity e) const noexcept {
+    return upcast(this)->hasComponent(e);
+}
+
+ParticleManager::Instance ParticleManager::getInstance(Entity e) const noexcept {
+    return upcast(this)->getInstance(e);
+}
+
+void ParticleManager::destroy(Entity e) noexcept {
+    upcast(this)->destroy(e);
+}
+
+void ParticleManager::advance(float deltaTime) noexcept {
+    upcast(this)->advance(deltaTime);
+}
+
+void ParticleManager::emit(Instance i, size_t count) noexcept {
+    upcast(this)->emit(i, count);
+}
+
+void ParticleManager::setEmissionRate(Instance i, float particlesPerSecond) noexcept {
+    upcast(this)->setEmissionRate(i, particlesPerSecond);
+}
+
+void ParticleManager::setLifetime(Instance i, float min, float max) noexcept {
+    upcast(this)->setLifetime(i, min, max);
+}
+
+void ParticleManager::setDirection(Instance i, float3 const& direction,
+        float spreadAngle) noexcept {
+    upcast(this)->setDirection(i, direction, spreadAngle);
+}
+
+void ParticleManager::setSpeed(Instance i, float min, float max) noexcept {
+    upcast(this)->setSpeed(i, min, max);
+}
+
+void ParticleManager::setAcceleration(Instance i, float3 const& acceleration) noexcept {
+    upcast(this)->setAcceleration(i, acceleration);
+}
+
+void ParticleManager::setDrag(Instance i, float drag) noexcept {
+    upcast(this)->setDrag(i, drag);
+}
+
+void ParticleManager::setSize(Instance i, float start, float end) noexcept {
+    upcast(this)->setSize(i, start, end);
+}
+
+void ParticleManager::setColor(Instance i, LinearColorA const& start,
+        LinearColorA const& end) noexcept {
+    upcast(this)->setColor(i, start, end);
+}
+
+size_t ParticleManager::getMaxParticleCount(Instance i) const noexcept {
+    return upcast(this)->getMaxParticleCount(i);
+}
+
+float ParticleManager::getEmissionRate(Instance i) const noexcept {
+    return upcast(this)->getEmissionRate(i);
+}
+
+} // namespace filament
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_COMPONENTS_PARTICLEMANAGER_H
+#define TNT_FILAMENT_COMPONENTS_PARTICLEMANAGER_H
+
+#include "upcast.h"
+
+#include "driver/Handle.h"
+
+#include <filament/ParticleManager.h>
+
+#include <utils/compiler.h>
+#include <utils/Entity.h>
+#include <utils/SingleInstanceComponentManager.h>
+
+#include <math/vec2.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <vector>
+
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+class FEngine;
+class FIndexBuffer;
+class FMaterialInstance;
+class FVertexBuffer;
+class FView;
+
+/*
+ * The particle emitters, which are simulated and drawn entirely by the compute programs of
+ * particles.mat. Only the parameters of the emitters are uploaded each frame.
+ *
+ * prepare() simulates the particles of all the emitters once per frame, in world space.
+ * prepareView() then sorts the particles of the emitters visible in a view and writes their quads,
+ * facing the view's camera, in a storage buffer that is copied into the vertex buffer of the
+ * emitter's Renderable. The vertex buffer can't be written by the compute programs directly.
+ */
+class UTILS_PRIVATE FParticleManager : public ParticleManager {
+public:
+    using Instance = ParticleManager::Instance;
+
+    // std430 layout of particles.mat's Particle
+    struct Particle {
+        math::float4 position;      // xyz, w is the age, negative if the particle is dead
+        math::float4 velocity;      // xyz, w is the lifetime
+    };
+    static_assert(sizeof(Particle) == 32, "Particle must match particles.mat");
+
+    // Must match particles.mat
+    enum class Pass : int32_t {
+        SIMULATE,
+        SORT,
+        EXPAND
+    };
+    static constexpr uint32_t GROUP_SIZE = 128;
+
+    // POSITION, TANGENTS and COLOR are float4, UV0 and UV1 are float2
+    static constexpr uint32_t VERTEX_SIZE = 64;
+
+    explicit FParticleManager(FEngine& engine) noexcept;
+    ~FParticleManager() noexcept;
+
+    // free-up all resources
+    void terminate() noexcept;
+
+    // this must be called on the engine's thread, it destroys driver objects
+    void gc(utils::EntityManager& em) noexcept;
+
+    /*
+    * Component Manager APIs
+    */
+
+    bool hasComponent(utils::Entity e) const noexcept {
+        return mManager.hasComponent(e);
+    }
+
+    Instance getInstance(utils::Entity e) const noexcept {
+        return Instance(mManager.getInstance(e));
+    }
+
+    bool create(const Builder& builder, utils::Entity entity);
+
+    void destroy(utils::Entity e) noexcept;
+
+    // Simulates the emitters over the time given to advance() since the previous frame. This is
+    // called once per frame by FEngine::prepare(), outside of a render pass.
+    void prepare() noexcept;
+
+    // Sorts the particles of the emitters drawn by the view and writes their quads. This must be
+    // called after FView::prepare() and before the passes of the view.
+    void prepareView(FView const& view) noexcept;
+
+    void advance(float deltaTime) noexcept { mPendingTime += deltaTime; }
+
+    void emit(Instance i, size_t count) noexcept;
+    void setEmissionRate(Instance i, float particlesPerSecond) noexcept;
+    void setLifetime(Instance i, float min, float max) noexcept;
+    void setDirection(Instance i, math::float3 const& direction, float spreadAngle) noexcept;
+    void setSpeed(Instance i, float min, float max) noexcept;
+    void setAcceleration(Instance i, math::float3 const& acceleration) noexcept;
+    void setDrag(Instance i, float drag) noexcept;
+    void setSize(Instance i, float start, float end) noexcept;
+    void setColor(Instance i, LinearColorA const& start, LinearColorA const& end) noexcept;
+
+    size_t getMaxParticleCount(Instance i) const noexcept {
+        return mManager.elementAt<EMITTER>(i).capacity;
+    }
+
+    float getEmissionRate(Instance i) const noexcept {
+        return mManager.elementAt<PARAMS>(i).emissionRate;
+    }
+
+private:
+    struct Params {
+        math::float4 direction;     // in the space of the entity, w is the cos of the spread
+        math::float4 acceleration;  // w unused
+        LinearColorA startColor;
+        LinearColorA endColor;
+        math::float2 lifetime;
+        math::float2 speed;
+        math::float2 size;
+        float drag;
+        float emissionRate;
+    };
+
+    struct Emitter {
+        FVertexBuffer* vertexBuffer = nullptr;
+        FIndexBuffer* indexBuffer = nullptr;
+        Handle<HwStorageBuffer> particles;
+        Handle<HwStorageBuffer> order;          // only for the sorted emitters
+        Handle<HwStorageBuffer> vertices;
+        uint32_t capacity = 0;
+        uint32_t nextSlot = 0;                  // where the next particle is emitted
+        float pendingEmission = 0;              // the fraction of a particle left to emit
+        uint32_t burst = 0;                     // see emit()
+        bool sorted = false;
+    };
+
+    // the material instances are only used once per frame, so that their uniforms are the ones
+    // of their dispatch (the uniform buffers are updated when the frame is submitted on Vulkan)
+    FMaterialInstance* acquireMaterialInstance() noexcept;
+
+    void dispatch(FMaterialInstance* mi, Emitter const& emitter, Pass pass) noexcept;
+
+    enum {
+        PARAMS,
+        EMITTER
+    };
+
+    using Base = utils::SingleInstanceComponentManager<Params, Emitter>;
+
+    struct ParticleManagerImpl : public Base {
+        using Base::gc;
+        using Base::trackDestroyedEntities;
+        using Base::swap;
+        using Base::hasComponent;
+    } mManager;
+
+    FEngine& mEngine;
+    float mPendingTime = 0;
+    uint32_t mSeed = 0;
+
+    std::vector<FMaterialInstance*> mMaterialInstances;
+    size_t mMaterialInstancesUsed = 0;
+
+    // scratch list of the emitters drawn by a view, see prepareView()
+    std::vector<Instance> mVisibleEmitters;
+};
+
+FILAMENT_UPCAST(ParticleManager)
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_COMPONENTS_PARTICLEMANAGER_H
@@ -22,11 +22,14 @@
 #include "details/VertexBuffer.h"
 #include "details/IndexBuffer.h"
 #include "details/Material.h"
+#include "details/MorphTargetBuffer.h"
 #include "details/RenderPrimitive.h"
 
 #include <utils/Log.h>
 #include <utils/Panic.h>
 
+#include <string.h>
+
 using namespace math;
 using namespace utils;
 
@@ -44,12 +47,22 @@ struct RenderableManager::BuilderDetails {
     bool mCulling : 1;
     bool mCastShadows : 1;
     bool mReceiveShadows : 1;
+    bool mOccluder : 1;
+    bool mDynamicShadowCaster : 1;
+    bool mDualQuaternionSkinning : 1;
     uint8_t mSkinningBoneCount = 0;
     Bone const* mBones = nullptr;
     math::mat4f const* mBoneMatrices = nullptr;
+    FMorphTargetBuffer const* mMorphTargetBuffer = nullptr;
+    Box mQuantizationBounds;
+    bool mQuantizedPositions = false;
+    uint8_t mLevelCount = 1;
+    size_t mLevelFirst[MAX_LEVEL_COUNT] = {};
+    float mLevelScreenCoverage[MAX_LEVEL_COUNT] = {};
 
     explicit BuilderDetails(size_t count)
-            : mEntriesCount(count), mCulling(true), mCastShadows(false), mReceiveShadows(true) {
+            : mEntriesCount(count), mCulling(true), mCastShadows(false), mReceiveShadows(true),
+              mOccluder(false), mDynamicShadowCaster(false), mDualQuaternionSkinning(false) {
     }
     // this is only needed for the explicit instantiation below
     BuilderDetails() = default;
@@ -133,6 +146,16 @@ RenderableManager::Builder& RenderableManager::Builder::receiveShadows(bool enab
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::occluder(bool enable) noexcept {
+    mImpl->mOccluder = enable;
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::dynamicShadowCaster(bool enable) noexcept {
+    mImpl->mDynamicShadowCaster = enable;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::skinning(size_t boneCount) noexcept {
     mImpl->mSkinningBoneCount = (uint8_t)std::min(size_t(255), boneCount);
     return *this;
@@ -152,6 +175,25 @@ RenderableManager::Builder& RenderableManager::Builder::skinning(
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::dualQuaternionSkinning(
+        bool enable) noexcept {
+    mImpl->mDualQuaternionSkinning = enable;
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::morphing(
+        MorphTargetBuffer* morphTargetBuffer) noexcept {
+    mImpl->mMorphTargetBuffer = upcast(morphTargetBuffer);
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::quantizedPositions(
+        const Box& bounds) noexcept {
+    mImpl->mQuantizationBounds = bounds;
+    mImpl->mQuantizedPositions = true;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::blendOrder(size_t index, uint16_t blendOrder) noexcept {
     if (index < mImpl->mEntriesCount) {
         mImpl->mEntries[index].blendOrder = blendOrder;
@@ -159,6 +201,16 @@ RenderableManager::Builder& RenderableManager::Builder::blendOrder(size_t index,
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::levelOfDetail(
+        uint8_t level, size_t first, float screenCoverage) noexcept {
+    if (level > 0 && level < MAX_LEVEL_COUNT) {
+        mImpl->mLevelFirst[level] = first;
+        mImpl->mLevelScreenCoverage[level] = screenCoverage;
+        mImpl->mLevelCount = std::max(mImpl->mLevelCount, uint8_t(level + 1));
+    }
+    return *this;
+}
+
 RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& engine, Entity entity) {
     bool isEmpty = true;
     for (size_t i = 0, c = mImpl->mEntriesCount; i < c; i++) {
@@ -212,6 +264,26 @@ RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& eng
         isEmpty = false;
     }
 
+    // levels of detail must be non-empty consecutive ranges with decreasing screen coverages
+    for (size_t l = 1, c = mImpl->mLevelCount; l < c; l++) {
+        const size_t first = mImpl->mLevelFirst[l];
+        const float coverage = mImpl->mLevelScreenCoverage[l];
+        const bool valid = first > mImpl->mLevelFirst[l - 1] && first < mImpl->mEntriesCount &&
+                coverage > 0 && (l == 1 || coverage < mImpl->mLevelScreenCoverage[l - 1]);
+        if (!ASSERT_PRECONDITION_NON_FATAL(valid,
+                "[entity=%u] invalid level of detail %u (first=%u, screenCoverage=%f)",
+                entity.getId(), l, first, coverage)) {
+            return Error;
+        }
+    }
+
+    // the bones and the morph targets apply to the decoded positions
+    if (!ASSERT_PRECONDITION_NON_FATAL(!mImpl->mQuantizedPositions ||
+            (!mImpl->mSkinningBoneCount && !mImpl->mMorphTargetBuffer),
+            "[entity=%u] quantized positions can't be skinned or morphed", entity.getId())) {
+        return Error;
+    }
+
     if (!ASSERT_POSTCONDITION_NON_FATAL(
             !mImpl->mAABB.isEmpty() ||
             (!mImpl->mCulling && (!(mImpl->mReceiveShadows || mImpl->mCastShadows)) ||
@@ -233,6 +305,7 @@ namespace details {
 
 FRenderableManager::FRenderableManager(FEngine& engine) noexcept : mEngine(engine) {
     // DON'T use engine here in the ctor, because it's not fully constructed yet.
+    mManager.trackDestroyedEntities(EntityManager::get());
 }
 
 FRenderableManager::~FRenderableManager() {
@@ -255,14 +328,16 @@ void FRenderableManager::create(
     if (UTILS_UNLIKELY(ci)) {
         canReuse = true;
         destroyComponentPrimitives(engine, manager[ci].primitives);
-        std::unique_ptr<Bones> const& bones = manager[ci].bones;
-        if (bones && !builder->mSkinningBoneCount) {
-            driver.destroyUniformBuffer(bones->handle);
+        Bones& bones = manager[ci].bones;
+        if (bones.count && !builder->mSkinningBoneCount) {
+            freeBonesSlot(bones.slot);
+            bones = {};
         }
     }
 
     ci = manager.addComponent(entity);
     assert(ci);
+    mStructureVersion++;
 
     if (ci) {
         // create and initialize all needed RenderPrimitives
@@ -270,42 +345,68 @@ void FRenderableManager::create(
         Builder::Entry const * const entries = builder->mEntries;
         FRenderPrimitive* rp = new FRenderPrimitive[builder->mEntriesCount];
         for (size_t i = 0, c = builder->mEntriesCount; i < c; ++i) {
-            rp[i].init(driver, entries[i]);
+            rp[i].init(engine, entries[i]);
         }
         setPrimitives(ci, { rp, size_type(builder->mEntriesCount) });
 
+        std::unique_ptr<LevelsOfDetail>& levels = manager[ci].levels;
+        levels.reset();
+        if (builder->mLevelCount > 1) {
+            levels.reset(new LevelsOfDetail);
+            levels->count = builder->mLevelCount;
+            for (size_t l = 0, c = builder->mLevelCount; l < c; l++) {
+                levels->first[l] = uint32_t(builder->mLevelFirst[l]);
+                levels->screenCoverage[l] = builder->mLevelScreenCoverage[l];
+            }
+            levels->first[builder->mLevelCount] = uint32_t(builder->mEntriesCount);
+        }
+
         setAxisAlignedBoundingBox(ci, builder->mAABB);
         setLayerMask(ci, builder->mLayerMask);
         setPriority(ci, builder->mPriority);
         setCastShadows(ci, builder->mCastShadows);
         setReceiveShadows(ci, builder->mReceiveShadows);
         setCulling(ci, builder->mCulling);
+        setOccluder(ci, builder->mOccluder);
+        setDynamicShadowCaster(ci, builder->mDynamicShadowCaster);
         static_cast<Visibility&>(manager[ci].visibility).skinning = builder->mSkinningBoneCount > 0;
+        static_cast<Visibility&>(manager[ci].visibility).morphing = builder->mMorphTargetBuffer != nullptr;
+        static_cast<Visibility&>(manager[ci].visibility).quantizedPositions = builder->mQuantizedPositions;
+        manager[ci].positionDecoding = PositionDecoding{
+                builder->mQuantizationBounds.center, builder->mQuantizationBounds.halfExtent };
 
         if (!canReuse) {
-            getUniformBuffer(ci) = UniformBuffer(engine.getPerRenderableUib());
-            setUniformHandle(ci, driver.createUniformBuffer(getUniformBuffer(ci).getSize()));
-            if (builder->mSkinningBoneCount) {
-                std::unique_ptr<Bones>& bones = manager[ci].bones;
-
-                bones.reset(new Bones); // FIXME: maybe use a pool allocator
-                bones->bones = UniformBuffer(CONFIG_MAX_BONE_COUNT * sizeof(Bone));
-                bones->handle = driver.createUniformBuffer(CONFIG_MAX_BONE_COUNT * sizeof(Bone));
-            }
+            setUniformHandle(ci, driver.createUniformBuffer(sizeof(PerRenderableUib)));
+        }
+
+        // all the uniforms are reset (including the morph weights), in case they're reused
+        PerRenderableUib& uniforms = manager[ci].uniforms;
+        uniforms = {};
+        uniforms.skinningDualQuaternion =
+                uint32_t(builder->mSkinningBoneCount && builder->mDualQuaternionSkinning);
+
+        MorphTargets& morphTargets = manager[ci].morphTargets;
+        morphTargets = {};
+        if (builder->mMorphTargetBuffer) {
+            morphTargets.sbh = builder->mMorphTargetBuffer->getHwHandle();
+            morphTargets.count = uint32_t(builder->mMorphTargetBuffer->getCount());
         }
+        uniforms.morphTargetCount = morphTargets.count;
+
         if (builder->mSkinningBoneCount) {
-            std::unique_ptr<Bones> const& bones = manager[ci].bones;
-            assert(bones);
-            bones->count = builder->mSkinningBoneCount;
+            Bones& bones = manager[ci].bones;
+            if (!bones.count) {
+                bones.slot = allocateBonesSlot();
+            }
+            bones.count = builder->mSkinningBoneCount;
+            bones.dualQuaternion = builder->mDualQuaternionSkinning;
             if (builder->mBones) {
                 setBones(ci, builder->mBones, builder->mSkinningBoneCount);
             } else if (builder->mBoneMatrices) {
                 setBones(ci, builder->mBoneMatrices, builder->mSkinningBoneCount);
             } else {
-                // initialize the bones to identity
-                Bone* UTILS_RESTRICT out =
-                        (Bone*)bones->bones.invalidateUniforms(0, bones->count * sizeof(Bone));
-                std::fill_n(out, bones->count, Bone{});
+                // initialize the bones to identity, which is the same in both formats
+                std::fill_n(invalidateBones(bones, 0, bones.count), bones.count, Bone{});
             }
         }
     }
@@ -317,6 +418,7 @@ void FRenderableManager::destroy(utils::Entity e) noexcept {
     if (ci) {
         destroyComponent(ci);
         mManager.removeComponent(e);
+        mStructureVersion++;
     }
 }
 
@@ -334,6 +436,10 @@ void FRenderableManager::terminate() noexcept {
             manager.removeComponent(manager.getEntity(ci));
         }
     }
+    if (mBonePaletteUbh) {
+        mEngine.getDriverApi().destroyUniformBuffer(mBonePaletteUbh);
+        mBonePaletteUbh.clear();
+    }
 }
 
 // This is basically a Renderable's destructor.
@@ -347,13 +453,51 @@ void FRenderableManager::destroyComponent(Instance ci) noexcept {
     // See create(RenderableManager::Builder&, Entity)
     destroyComponentPrimitives(engine, manager[ci].primitives);
 
-    // destroy the bones structures if any
-    std::unique_ptr<Bones> const& bones = manager[ci].bones;
-    if (bones) {
-        driver.destroyUniformBuffer(bones->handle);
+    // release the bones slot if any
+    Bones& bones = manager[ci].bones;
+    if (bones.count) {
+        freeBonesSlot(bones.slot);
+        bones = {};
     }
 }
 
+uint32_t FRenderableManager::allocateBonesSlot() noexcept {
+    if (!mFreeBoneSlots.empty()) {
+        const uint32_t slot = mFreeBoneSlots.back();
+        mFreeBoneSlots.pop_back();
+        return slot;
+    }
+
+    const uint32_t slot = mBoneSlotCount++;
+    const size_t size = mBoneSlotCount * BONE_PALETTE_STRIDE;
+    if (UTILS_UNLIKELY(size > mBonePalette.getSize())) {
+        // grow geometrically, the whole palette is uploaded again into the new buffer
+        FEngine::DriverApi& driver = mEngine.getDriverApi();
+        const size_t capacity = std::max(size, mBonePalette.getSize() * 2);
+        UniformBuffer palette(capacity);
+        if (mBonePalette.getSize()) {
+            memcpy(palette.invalidateUniforms(0, mBonePalette.getSize()),
+                    mBonePalette.getBuffer(), mBonePalette.getSize());
+        }
+        mBonePalette = std::move(palette);
+        if (mBonePaletteUbh) {
+            driver.destroyUniformBuffer(mBonePaletteUbh);
+        }
+        mBonePaletteUbh = driver.createUniformBuffer(capacity);
+    }
+    return slot;
+}
+
+void FRenderableManager::freeBonesSlot(uint32_t slot) noexcept {
+    mFreeBoneSlots.push_back(slot);
+}
+
+FRenderableManager::Bone* FRenderableManager::invalidateBones(
+        Bones const& bones, size_t offset, size_t count) noexcept {
+    return static_cast<Bone*>(mBonePalette.invalidateUniforms(
+            bones.slot * BONE_PALETTE_STRIDE + offset * sizeof(Bone), count * sizeof(Bone)));
+}
+
 void FRenderableManager::destroyComponentPrimitives(
         FEngine& engine, Slice<FRenderPrimitive>& primitives) noexcept {
     for (auto& primitive : primitives) {
@@ -366,34 +510,46 @@ void FRenderableManager::destroyComponentPrimitives(
 void FRenderableManager::prepare(
         driver::DriverApi& UTILS_RESTRICT driver,
         Instance const* UTILS_RESTRICT instances,
-        utils::Range<uint32_t> list) const noexcept {
+        utils::Range<uint32_t> list, bool uniforms) const noexcept {
     auto& manager = mManager;
-    UniformBuffer           const * const UTILS_RESTRICT uniforms = manager.raw_array<UNIFORMS>();
+    PerRenderableUib        const * const UTILS_RESTRICT ubs      = manager.raw_array<UNIFORMS>();
     Handle<HwUniformBuffer> const * const UTILS_RESTRICT ubhs     = manager.raw_array<UNIFORMS_HANDLE>();
-    std::unique_ptr<Bones>  const * const UTILS_RESTRICT bones    = manager.raw_array<BONES>();
-    for (uint32_t index : list) {
-        size_t i = instances[index].asValue();
-        assert(i);  // we should never get the null instance here
-        if (uniforms[i].isDirty()) {
-            // update per-renderable uniform buffer
-            driver.updateUniformBuffer(ubhs[i], UniformBuffer(uniforms[i]));
-            uniforms[i].clean(); // clean AFTER we send to the driver
-        }
-        if (UTILS_UNLIKELY(bones[i])) {
-            if (bones[i]->bones.isDirty()) {
-                driver.updateUniformBuffer(bones[i]->handle, UniformBuffer(bones[i]->bones));
-                bones[i]->bones.clean();
-            }
+    if (uniforms) {
+        // The renderables in the list are the visible ones, their world transform was just
+        // updated by updateLocalUBO(), so there is no point in tracking which ones are dirty.
+        for (uint32_t index : list) {
+            size_t i = instances[index].asValue();
+            assert(i);  // we should never get the null instance here
+            UniformBuffer ub(sizeof(PerRenderableUib));
+            memcpy(ub.invalidateUniforms(0, sizeof(PerRenderableUib)),
+                    &ubs[i], sizeof(PerRenderableUib));
+            driver.updateUniformBuffer(ubhs[i], std::move(ub));
         }
     }
+
+    // all the bones that changed are uploaded at once
+    if (mBonePalette.isDirty()) {
+        driver.updateUniformBuffer(mBonePaletteUbh, mBonePalette.copyDirtyRange());
+        mBonePalette.clean();
+    }
 }
 
-void FRenderableManager::updateLocalUBO(Instance instance, const math::mat4f& model) noexcept {
+void FRenderableManager::updateLocalUBO(Instance instance, const AffineTransform& model,
+        uint32_t reflectionProbe) noexcept {
     if (instance) {
-        auto& uniforms = getUniformBuffer(instance);
-
-        // update our uniform buffer
-        uniforms.setUniform(offsetof(FEngine::PerRenderableUib, worldFromModelMatrix), model);
+        PerRenderableUib& uniforms = mManager[instance].uniforms;
+        uniforms.reflectionProbe = reflectionProbe;
+
+        uniforms.worldFromModelMatrix = model.asMat4f();
+        if (UTILS_UNLIKELY(getVisibility(instance).quantizedPositions)) {
+            // the positions are decoded by the vertex shader, with the world transform
+            PositionDecoding const& decoding = mManager[instance].positionDecoding;
+            mat4f& m = uniforms.worldFromModelMatrix;
+            m[0] *= decoding.scale.x;
+            m[1] *= decoding.scale.y;
+            m[2] *= decoding.scale.z;
+            m[3] = float4{ model.transformPoint(decoding.offset), 1 };
+        }
 
         // Using the inverse-transpose handles non-uniform scaling, but DOESN'T guarantee that
         // the transformed normals will have unit-length, therefore they need to be normalized
@@ -401,16 +557,19 @@ void FRenderableManager::updateLocalUBO(Instance instance, const math::mat4f& mo
         // interpolation).
         // Note: if the model matrix is known to be a rigid-transform, we could just use it directly.
         mat3f nm = transpose(inverse(model.upperLeft()));
-        uniforms.setUniform(offsetof(FEngine::PerRenderableUib, worldFromModelNormalMatrix), nm);
+        for (size_t i = 0; i < 3; i++) {
+            uniforms.worldFromModelNormalMatrix[i] = float4{ nm[i], 0 };
+        }
     }
 }
 
-void FRenderableManager::setMaterialInstanceAt(Instance instance, uint8_t level,
+void FRenderableManager::setMaterialInstanceAt(Instance instance,
         size_t primitiveIndex, FMaterialInstance const* mi) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].setMaterialInstance(upcast(mi));
+            markDirty(instance);
 #ifndef NDEBUG
             AttributeBitset required = mi->getMaterial()->getRequiredAttributes();
             AttributeBitset declared = primitives[primitiveIndex].getEnabledAttributes();
@@ -425,9 +584,9 @@ void FRenderableManager::setMaterialInstanceAt(Instance instance, uint8_t level,
 }
 
 MaterialInstance* FRenderableManager::getMaterialInstanceAt(
-        Instance instance, uint8_t level, size_t primitiveIndex) const noexcept {
+        Instance instance, size_t primitiveIndex) const noexcept {
     if (instance) {
-        const Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        const Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             // We store the material instance as const because we don't want to change it internally
             // but when the user queries it, we want to allow them to call setParameter()
@@ -437,20 +596,21 @@ MaterialInstance* FRenderableManager::getMaterialInstanceAt(
     return nullptr;
 }
 
-void FRenderableManager::setBlendOrderAt(Instance instance, uint8_t level,
+void FRenderableManager::setBlendOrderAt(Instance instance,
         size_t primitiveIndex, uint16_t order) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].setBlendOrder(order);
+            markDirty(instance);
         }
     }
 }
 
 AttributeBitset FRenderableManager::getEnabledAttributesAt(
-        Instance instance, uint8_t level, size_t primitiveIndex) const noexcept {
+        Instance instance, size_t primitiveIndex) const noexcept {
     if (instance) {
-        Slice<FRenderPrimitive> const& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> const& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             return primitives[primitiveIndex].getEnabledAttributes();
         }
@@ -458,39 +618,95 @@ AttributeBitset FRenderableManager::getEnabledAttributesAt(
     return AttributeBitset{};
 }
 
-void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
+void FRenderableManager::setGeometryAt(Instance instance, size_t primitiveIndex,
         PrimitiveType type, FVertexBuffer* vertices, FIndexBuffer* indices,
-        size_t offset, size_t count) noexcept {
+        size_t offset, size_t minIndex, size_t maxIndex, size_t count) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].set(mEngine, type, vertices, indices, offset,
-                    0, vertices->getVertexCount() - 1, count);
+                    minIndex, maxIndex, count);
+            markDirty(instance);
+        }
+    }
+}
+
+void FRenderableManager::setGeometryAt(Instance instance, size_t primitiveIndex,
+        PrimitiveType type, size_t offset, size_t minIndex, size_t maxIndex,
+        size_t count) noexcept {
+    if (instance) {
+        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
+        if (primitiveIndex < primitives.size()) {
+            primitives[primitiveIndex].set(mEngine, type, offset, minIndex, maxIndex, count);
+            markDirty(instance);
         }
     }
 }
 
-void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
+void FRenderableManager::setGeometryAt(Instance instance, size_t primitiveIndex,
         PrimitiveType type, size_t offset, size_t count) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> const& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
-            primitives[primitiveIndex].set(mEngine, type, offset, 0, 0, count);
+            FRenderPrimitive const& primitive = primitives[primitiveIndex];
+            setGeometryAt(instance, primitiveIndex, type, offset,
+                    primitive.getMinIndex(), primitive.getMaxIndex(), count);
         }
     }
 }
 
+Slice<FRenderPrimitive> FRenderableManager::getRenderPrimitives(
+        Instance instance, uint8_t level) const noexcept {
+    Slice<FRenderPrimitive> primitives = mManager[instance].primitives;
+    std::unique_ptr<LevelsOfDetail> const& levels = mManager[instance].levels;
+    if (levels) {
+        assert(level < levels->count);
+        using size_type = Slice<FRenderPrimitive>::size_type;
+        primitives.set(primitives.data() + levels->first[level],
+                size_type(levels->first[level + 1] - levels->first[level]));
+    }
+    return primitives;
+}
+
+uint8_t FRenderableManager::selectLevel(LevelsOfDetail const& lods,
+        float screenCoverage, uint8_t current) noexcept {
+    const uint8_t count = lods.count;
+    uint8_t level = std::min(current, uint8_t(count - 1));
+    // move to a more detailed level only when the coverage is clearly above its threshold...
+    while (level > 0 &&
+           screenCoverage >= lods.screenCoverage[level] * (1.0f + LEVEL_HYSTERESIS)) {
+        level--;
+    }
+    // ...and to a less detailed one only when it's clearly below
+    while (level + 1 < count &&
+           screenCoverage < lods.screenCoverage[level + 1] * (1.0f - LEVEL_HYSTERESIS)) {
+        level++;
+    }
+    return level;
+}
+
+// A rigid transform as a unit dual quaternion: the rotation q and 0.5 * t * q, stored like a Bone
+static inline void toDualQuaternion(RenderableManager::Bone& bone) noexcept {
+    const quatf q = bone.unitQuaternion;
+    const quatf dual = 0.5f * quatf(bone.translation, 0) * q;
+    bone.translation = dual.xyz;
+    bone.reserved = dual.w;
+}
+
 void FRenderableManager::setBones(Instance ci,
         Bone const* UTILS_RESTRICT transforms, size_t boneCount, size_t offset) noexcept {
     if (ci) {
-        std::unique_ptr<Bones> const& bones = mManager[ci].bones;
-        assert(bones && offset + boneCount <= bones->count);
-        if (bones) {
-            boneCount = std::min(boneCount, bones->count - offset);
-            Bone* UTILS_RESTRICT out = (Bone*)bones->bones.invalidateUniforms(
-                    offset * sizeof(Bone),
-                    boneCount * sizeof(Bone));
+        Bones const& bones = mManager[ci].bones;
+        assert(bones.count && offset + boneCount <= bones.count);
+        if (bones.count) {
+            boneCount = std::min(boneCount, bones.count - offset);
+            Bone* UTILS_RESTRICT out = invalidateBones(bones, offset, boneCount);
             std::copy_n(transforms, boneCount, out);
+            if (bones.dualQuaternion) {
+                for (size_t i = 0; i < boneCount; ++i) {
+                    toDualQuaternion(out[i]);
+                }
+            }
         }
     }
 }
@@ -498,22 +714,38 @@ void FRenderableManager::setBones(Instance ci,
 void FRenderableManager::setBones(Instance ci,
         math::mat4f const* UTILS_RESTRICT transforms, size_t boneCount, size_t offset) noexcept {
     if (ci) {
-        std::unique_ptr<Bones> const& bones = mManager[ci].bones;
-        assert(bones && offset + boneCount <= bones->count);
-        if (bones) {
-            boneCount = std::min(boneCount, bones->count - offset);
-            Bone* UTILS_RESTRICT out = (Bone*)bones->bones.invalidateUniforms(
-                    offset * sizeof(Bone),
-                    boneCount * sizeof(Bone));
-            for (size_t i = 0, c = bones->count; i < c; ++i) {
+        Bones const& bones = mManager[ci].bones;
+        assert(bones.count && offset + boneCount <= bones.count);
+        if (bones.count) {
+            boneCount = std::min(boneCount, bones.count - offset);
+            Bone* UTILS_RESTRICT out = invalidateBones(bones, offset, boneCount);
+            for (size_t i = 0; i < boneCount; ++i) {
                 mat4f const& m = transforms[i];
                 out[i].unitQuaternion = m.toQuaternion();
                 out[i].translation = m[3].xyz;
+                out[i].reserved = 0;
+                if (bones.dualQuaternion) {
+                    toDualQuaternion(out[i]);
+                }
             }
         }
     }
 }
 
+void FRenderableManager::setMorphWeights(Instance ci,
+        float const* UTILS_RESTRICT weights, size_t count, size_t offset) noexcept {
+    if (ci) {
+        MorphTargets const& morphTargets = mManager[ci].morphTargets;
+        assert(offset + count <= morphTargets.count);
+        if (offset < morphTargets.count) {
+            count = std::min(count, morphTargets.count - offset);
+            // the weights are packed 4 per float4, so they're contiguous in the UBO
+            PerRenderableUib& uniforms = mManager[ci].uniforms;
+            memcpy(&uniforms.morphWeights[0][0] + offset, weights, count * sizeof(float));
+        }
+    }
+}
+
 } // namespace details
 
 
@@ -564,42 +796,77 @@ bool RenderableManager::isShadowReceiver(Instance instance) const noexcept {
     return upcast(this)->isShadowReceiver(instance);
 }
 
+void RenderableManager::setOccluder(Instance instance, bool enable) noexcept {
+    upcast(this)->setOccluder(instance, enable);
+}
+
+bool RenderableManager::isOccluder(Instance instance) const noexcept {
+    return upcast(this)->isOccluder(instance);
+}
+
+void RenderableManager::setDynamicShadowCaster(Instance instance, bool enable) noexcept {
+    upcast(this)->setDynamicShadowCaster(instance, enable);
+}
+
+bool RenderableManager::isDynamicShadowCaster(Instance instance) const noexcept {
+    return upcast(this)->isDynamicShadowCaster(instance);
+}
+
 const Box& RenderableManager::getAxisAlignedBoundingBox(Instance instance) const noexcept {
     return upcast(this)->getAxisAlignedBoundingBox(instance);
 }
 
 size_t RenderableManager::getPrimitiveCount(Instance instance) const noexcept {
-    return upcast(this)->getPrimitiveCount(instance, 0);
+    return upcast(this)->getPrimitiveCount(instance);
+}
+
+size_t RenderableManager::getLevelCount(Instance instance) const noexcept {
+    return upcast(this)->getLevelCount(instance);
 }
 
 void RenderableManager::setMaterialInstanceAt(Instance instance,
         size_t primitiveIndex, MaterialInstance const* materialInstance) noexcept {
-    upcast(this)->setMaterialInstanceAt(instance, 0, primitiveIndex, upcast(materialInstance));
+    upcast(this)->setMaterialInstanceAt(instance, primitiveIndex, upcast(materialInstance));
 }
 
 MaterialInstance* RenderableManager::getMaterialInstanceAt(
         Instance instance, size_t primitiveIndex) const noexcept {
-    return upcast(this)->getMaterialInstanceAt(instance, 0, primitiveIndex);
+    return upcast(this)->getMaterialInstanceAt(instance, primitiveIndex);
 }
 
 void RenderableManager::setBlendOrderAt(Instance instance, size_t primitiveIndex, uint16_t order) noexcept {
-    upcast(this)->setBlendOrderAt(instance, 0, primitiveIndex, order);
+    upcast(this)->setBlendOrderAt(instance, primitiveIndex, order);
 }
 
 AttributeBitset RenderableManager::getEnabledAttributesAt(Instance instance, size_t primitiveIndex) const noexcept {
-    return upcast(this)->getEnabledAttributesAt(instance, 0, primitiveIndex);
+    return upcast(this)->getEnabledAttributesAt(instance, primitiveIndex);
 }
 
 void RenderableManager::setGeometryAt(Instance instance, size_t primitiveIndex,
         PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices,
         size_t offset, size_t count) noexcept {
-    upcast(this)->setGeometryAt(instance, 0, primitiveIndex,
-            type, upcast(vertices), upcast(indices), offset, count);
+    upcast(this)->setGeometryAt(instance, primitiveIndex,
+            type, upcast(vertices), upcast(indices), offset,
+            0, vertices->getVertexCount() - 1, count);
+}
+
+void RenderableManager::setGeometryAt(Instance instance, size_t primitiveIndex,
+        PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices,
+        size_t offset, size_t minIndex, size_t maxIndex, size_t count) noexcept {
+    upcast(this)->setGeometryAt(instance, primitiveIndex,
+            type, upcast(vertices), upcast(indices), offset, minIndex, maxIndex, count);
 }
 
 void RenderableManager::setGeometryAt(RenderableManager::Instance instance, size_t primitiveIndex,
         RenderableManager::PrimitiveType type, size_t offset, size_t count) noexcept {
-    upcast(this)->setGeometryAt(instance, 0, primitiveIndex, type, offset, count);
+    upcast(this)->setGeometryAt(instance, primitiveIndex, type, offset, count);
+}
+
+void RenderableManager::setGeometryAt(Instance instance, size_t primitiveIndex,
+        PrimitiveType type, size_t offset, size_t minIndex, size_t maxIndex,
+        size_t count) noexcept {
+    upcast(this)->setGeometryAt(instance, primitiveIndex,
+            type, offset, minIndex, maxIndex, count);
 }
 
 void RenderableManager::setBones(Instance instance,
@@ -612,4 +879,9 @@ void RenderableManager::setBones(Instance instance,
     upcast(this)->setBones(instance, transforms, boneCount, offset);
 }
 
+void RenderableManager::setMorphWeights(Instance instance,
+        float const* weights, size_t count, size_t offset) noexcept {
+    upcast(this)->setMorphWeights(instance, weights, count, offset);
+}
+
 } // namespace filament
@@ -19,11 +19,15 @@
 
 #include "upcast.h"
 
+#include "AffineTransform.h"
+#include "PerRenderableUib.h"
+
 #include "driver/DriverApiForward.h"
 #include "driver/UniformBuffer.h"
 #include "driver/Handle.h"
 
 #include <filament/Box.h>
+#include <filament/EngineEnums.h>
 #include <filament/RenderableManager.h>
 
 #include <utils/Entity.h>
@@ -31,6 +35,9 @@
 #include <utils/Slice.h>
 #include <utils/Range.h>
 
+#include <atomic>
+#include <vector>
+
 namespace filament {
 namespace details {
 
@@ -47,6 +54,10 @@ public:
         bool receiveShadows : 1;
         bool culling        : 1;
         bool skinning       : 1;
+        bool occluder       : 1;
+        bool dynamicShadowCaster : 1;
+        bool morphing       : 1;
+        bool quantizedPositions : 1;
     };
 
     FRenderableManager(FEngine& engine) noexcept;
@@ -67,29 +78,32 @@ public:
         return mManager.getInstance(e);
     }
 
+    utils::Entity getEntity(Instance i) const noexcept {
+        return mManager.getEntity(i);
+    }
+
     void create(const RenderableManager::Builder& builder, utils::Entity entity);
 
     void destroy(utils::Entity e) noexcept;
 
     // - instances is a list of Instance (typically the list from a given scene)
     // - list is a list of index in 'instances' (typically the visible ones)
+    // uploads the uniforms of the given renderables, 'uniforms' can be false when the
+    // per-renderable uniforms are uploaded by other means (i.e. batched by FScene). The dirty
+    // part of the bone palette is uploaded as well, for all renderables.
     void prepare(driver::DriverApi& driver,
             RenderableManager::Instance const* instances,
-            utils::Range<uint32_t> list) const noexcept;
+            utils::Range<uint32_t> list, bool uniforms = true) const noexcept;
 
     void gc(utils::EntityManager& em) noexcept {
+        const size_t count = mManager.getComponentCount();
         mManager.gc(em);
+        mStructureVersion += uint32_t(count != mManager.getComponentCount());
     }
 
-    utils::Slice<const UniformBuffer> getUniformBuffers() const noexcept {
-        return mManager.slice<UNIFORMS>();
-    }
-
-    utils::Slice<const Handle<HwUniformBuffer>> getUniformBufferHandles() const noexcept {
-        return mManager.slice<UNIFORMS_HANDLE>();
-    }
-
-    void updateLocalUBO(Instance instance, const math::mat4f& model) noexcept;
+    // 'reflectionProbe' is 1 + the index of the reflection probe of the renderable, 0 for the IBL
+    void updateLocalUBO(Instance instance, const AffineTransform& model,
+            uint32_t reflectionProbe) noexcept;
     inline void setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept;
 
     inline void setLayerMask(Instance instance, uint8_t select, uint8_t values) noexcept;
@@ -102,15 +116,20 @@ public:
     inline void setLayerMask(Instance instance, uint8_t enable) noexcept;
     inline void setReceiveShadows(Instance instance, bool enable) noexcept;
     inline void setCulling(Instance instance, bool enable) noexcept;
+    inline void setOccluder(Instance instance, bool enable) noexcept;
+    inline void setDynamicShadowCaster(Instance instance, bool enable) noexcept;
     inline void setUniformHandle(Instance instance, Handle<HwUniformBuffer> const& handle) noexcept;
     inline void setPrimitives(Instance instance, utils::Slice<FRenderPrimitive> const& primitives) noexcept;
     inline void setBones(Instance instance, Bone const* transforms, size_t boneCount, size_t offset = 0) noexcept;
     inline void setBones(Instance instance, math::mat4f const* transforms, size_t boneCount, size_t offset = 0) noexcept;
+    void setMorphWeights(Instance instance, float const* weights, size_t count, size_t offset = 0) noexcept;
 
 
     inline bool isShadowCaster(Instance instance) const noexcept;
     inline bool isShadowReceiver(Instance instance) const noexcept;
     inline bool isCullingEnabled(Instance instance) const noexcept;
+    inline bool isOccluder(Instance instance) const noexcept;
+    inline bool isDynamicShadowCaster(Instance instance) const noexcept;
 
     inline Box const& getAABB(Instance instance) const noexcept;
     inline Box const& getAxisAlignedBoundingBox(Instance instance) const noexcept { return getAABB(instance); }
@@ -118,48 +137,144 @@ public:
     inline uint8_t getLayerMask(Instance instance) const noexcept;
     inline uint8_t getPriority(Instance instance) const noexcept;
 
-    inline UniformBuffer const& getUniformBuffer(Instance instance) const noexcept;
-    inline UniformBuffer& getUniformBuffer(Instance instance) noexcept;
+    // the renderable's per-renderable uniforms, as they're laid out in the UBO
+    inline PerRenderableUib const& getUniforms(Instance instance) const noexcept;
 
     inline Handle<HwUniformBuffer> getUbh(Instance instance) const noexcept;
-    inline Handle<HwUniformBuffer> getBonesUbh(Instance instance) const noexcept;
 
+    /*
+     * The bones of all the skinned renderables are stored in a single uniform buffer, the bone
+     * palette, which is uploaded at once. Each skinned renderable owns a slot of
+     * BONE_PALETTE_STRIDE bytes in the palette, which is bound as its bones uniform block.
+     */
+    static constexpr size_t BONE_PALETTE_STRIDE = CONFIG_MAX_BONE_COUNT * sizeof(Bone);
+
+    // 1 + the renderable's slot in the bone palette, or 0 if it's not skinned
+    inline uint32_t getBonesSlot(Instance instance) const noexcept;
+
+    // this handle changes when the palette grows, so it must not be cached
+    Handle<HwUniformBuffer> getBonePaletteUbh() const noexcept { return mBonePaletteUbh; }
 
-    inline size_t getLevelCount(Instance instance) const noexcept { return 1; }
-    inline size_t getPrimitiveCount(Instance instance, uint8_t level) const noexcept;
-    void setMaterialInstanceAt(Instance instance, uint8_t level,
+    // samplers of the renderable's morph targets, only valid if it's morphing
+    inline Handle<HwSamplerBuffer> getMorphTargetsSbh(Instance instance) const noexcept;
+
+
+    /*
+     * Change tracking
+     *
+     * Each instance records the version of the last change to the data that is mirrored
+     * by FScene (bounding box, layers, visibility and uniform buffer handles), or that
+     * the cached draw commands depend on (primitives, their material instance and blend
+     * order). The structure version changes when components are added, removed or moved,
+     * i.e. when previously retrieved Instances must be considered invalid.
+     */
+
+    uint32_t getVersion() const noexcept { return mVersion.load(std::memory_order_relaxed); }
+
+    uint32_t getVersion(Instance instance) const noexcept {
+        return mManager[instance].version;
+    }
+
+    uint32_t getStructureVersion() const noexcept {
+        return mStructureVersion.load(std::memory_order_relaxed);
+    }
+
+    /*
+     * Levels of detail
+     *
+     * The primitives of a renderable are split in consecutive ranges, one per level. The
+     * level used for rendering is selected by FView during culling, see selectLevel().
+     * Accessors taking a primitive index use the index given to the Builder,
+     * i.e. they're not relative to a level.
+     */
+
+    struct LevelsOfDetail {
+        uint8_t count = 1;
+        // first primitive of each level, the last entry is the primitive count
+        uint32_t first[MAX_LEVEL_COUNT + 1] = {};
+        // level i is used below screenCoverage[i] of the viewport height ([0] is unused)
+        float screenCoverage[MAX_LEVEL_COUNT] = {};
+    };
+
+    // relative margin around the thresholds, to avoid switching levels back and forth
+    static constexpr float LEVEL_HYSTERESIS = 0.1f;
+
+    // Returns the level to use given the screen coverage of a renderable and the level used
+    // previously.
+    static uint8_t selectLevel(LevelsOfDetail const& lods,
+            float screenCoverage, uint8_t current) noexcept;
+
+    inline size_t getLevelCount(Instance instance) const noexcept;
+    inline LevelsOfDetail const* getLevelsOfDetail(Instance instance) const noexcept;
+    inline size_t getPrimitiveCount(Instance instance) const noexcept;
+    void setMaterialInstanceAt(Instance instance,
             size_t primitiveIndex, FMaterialInstance const* materialInstance) noexcept;
-    MaterialInstance* getMaterialInstanceAt(Instance instance, uint8_t level, size_t primitiveIndex) const noexcept;
-    void setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
+    MaterialInstance* getMaterialInstanceAt(Instance instance, size_t primitiveIndex) const noexcept;
+    void setGeometryAt(Instance instance, size_t primitiveIndex,
             PrimitiveType type, FVertexBuffer* vertices, FIndexBuffer* indices,
-            size_t offset, size_t count) noexcept;
-    void setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
+            size_t offset, size_t minIndex, size_t maxIndex, size_t count) noexcept;
+    void setGeometryAt(Instance instance, size_t primitiveIndex,
+            PrimitiveType type, size_t offset, size_t minIndex, size_t maxIndex,
+            size_t count) noexcept;
+    // keeps the range of vertices used by the primitive
+    void setGeometryAt(Instance instance, size_t primitiveIndex,
             PrimitiveType type, size_t offset, size_t count) noexcept;
-    void setBlendOrderAt(Instance instance, uint8_t level, size_t primitiveIndex, uint16_t blendOrder) noexcept;
-    AttributeBitset getEnabledAttributesAt(Instance instance, uint8_t level, size_t primitiveIndex) const noexcept;
-    inline utils::Slice<FRenderPrimitive> const& getRenderPrimitives(Instance instance, uint8_t level) const noexcept;
-    inline utils::Slice<FRenderPrimitive>& getRenderPrimitives(Instance instance, uint8_t level) noexcept;
+    void setBlendOrderAt(Instance instance, size_t primitiveIndex, uint16_t blendOrder) noexcept;
+    AttributeBitset getEnabledAttributesAt(Instance instance, size_t primitiveIndex) const noexcept;
+    // all the primitives, for all levels
+    inline utils::Slice<FRenderPrimitive> const& getRenderPrimitives(Instance instance) const noexcept;
+    inline utils::Slice<FRenderPrimitive>& getRenderPrimitives(Instance instance) noexcept;
+    // the primitives of the given level
+    utils::Slice<FRenderPrimitive> getRenderPrimitives(Instance instance, uint8_t level) const noexcept;
 
 
 private:
+    inline void markDirty(Instance instance) noexcept;
     void destroyComponent(Instance ci) noexcept;
     static void destroyComponentPrimitives(FEngine& engine,
             utils::Slice<FRenderPrimitive>& primitives) noexcept;
 
     struct Bones {
-        filament::Handle<HwUniformBuffer> handle;
-        UniformBuffer bones;
-        uint8_t count;
+        uint32_t slot = 0;              // slot in the bone palette, valid if count isn't 0
+        uint16_t count = 0;             // 0 unless the renderable is skinned
+        bool dualQuaternion = false;    // bones are stored as dual quaternions
+    };
+
+    // decoded position = offset + scale * quantized position
+    struct PositionDecoding {
+        math::float3 offset;
+        math::float3 scale;
     };
 
+    struct MorphTargets {
+        Handle<HwSamplerBuffer> sbh;    // owned by the FMorphTargetBuffer
+        uint32_t count = 0;
+    };
+
+    uint32_t allocateBonesSlot() noexcept;
+    void freeBonesSlot(uint32_t slot) noexcept;
+    Bone* invalidateBones(Bones const& bones, size_t offset, size_t count) noexcept;
+
+    /*
+     * Each column is stored in its own array. The columns read every frame for every visible
+     * renderable (by FScene and the render passes) come first and are stored inline, so that
+     * iterating over them doesn't chase pointers. The data only needed when a renderable is
+     * created or modified comes last.
+     */
     enum {
+        // hot data
         AABB,               // user data
         LAYERS,             // user data
         VISIBILITY,         // user data
         PRIMITIVES,         // user data
         UNIFORMS,           // filament data, UBO data where world-transform is stored
         UNIFORMS_HANDLE,    // filament data, handle to the driver's UBO
-        BONES,              // filament data, UBO storing a pointer to the bones information
+        POSITION_DECODING,  // user data, only used if the positions are quantized
+        BONES,              // filament data, count is 0 unless the renderable is skinned
+        MORPH_TARGETS,      // user data, count is 0 unless the renderable is morphing
+        VERSION,            // filament data, version of the last change to the data
+        // cold data
+        LEVELS,             // user data, null unless there are several levels of detail
     };
 
     using Base = utils::SingleInstanceComponentManager<
@@ -167,13 +282,18 @@ private:
             uint8_t,
             Visibility,
             utils::Slice<FRenderPrimitive>,
-            UniformBuffer,
+            PerRenderableUib,
             filament::Handle<HwUniformBuffer>,
-            std::unique_ptr<Bones>
+            PositionDecoding,
+            Bones,
+            MorphTargets,
+            uint32_t,
+            std::unique_ptr<LevelsOfDetail>
     >;
 
     struct Sim : public Base {
         using Base::gc;
+        using Base::trackDestroyedEntities;
         using Base::swap;
 
         struct Proxy {
@@ -190,7 +310,11 @@ private:
                 Field<PRIMITIVES>       primitives;
                 Field<UNIFORMS>         uniforms;
                 Field<UNIFORMS_HANDLE>  uniformsHandle;
+                Field<POSITION_DECODING> positionDecoding;
                 Field<BONES>            bones;
+                Field<MORPH_TARGETS>    morphTargets;
+                Field<VERSION>          version;
+                Field<LEVELS>           levels;
             };
         };
 
@@ -204,13 +328,26 @@ private:
 
     Sim mManager;
     FEngine& mEngine;
+    // read by FEngine::getContentVersion() from the thread rendering a snapshot
+    std::atomic<uint32_t> mVersion = { 0 };
+    std::atomic<uint32_t> mStructureVersion = { 0 };
+
+    UniformBuffer mBonePalette;
+    Handle<HwUniformBuffer> mBonePaletteUbh;
+    uint32_t mBoneSlotCount = 0;
+    std::vector<uint32_t> mFreeBoneSlots;
 };
 
 FILAMENT_UPCAST(RenderableManager)
 
+void FRenderableManager::markDirty(Instance instance) noexcept {
+    mManager[instance].version = ++mVersion;
+}
+
 void FRenderableManager::setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept {
     if (instance) {
         mManager[instance].aabb = aabb;
+        markDirty(instance);
     }
 }
 
@@ -219,12 +356,14 @@ void FRenderableManager::setLayerMask(Instance instance,
     if (instance) {
         uint8_t& layers = mManager[instance].layers;
         layers = (layers & ~select) | (values & select);
+        markDirty(instance);
     }
 }
 
 void FRenderableManager::setLayerMask(Instance instance, uint8_t layerMask) noexcept {
     if (instance) {
         mManager[instance].layers = layerMask;
+        markDirty(instance);
     }
 }
 
@@ -232,6 +371,7 @@ void FRenderableManager::setPriority(Instance instance, uint8_t priority) noexce
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.priority = priority;
+        markDirty(instance);
     }
 }
 
@@ -239,6 +379,7 @@ void FRenderableManager::setCastShadows(Instance instance, bool enable) noexcept
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.castShadows = enable;
+        markDirty(instance);
     }
 }
 
@@ -246,6 +387,7 @@ void FRenderableManager::setReceiveShadows(Instance instance, bool enable) noexc
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.receiveShadows = enable;
+        markDirty(instance);
     }
 }
 
@@ -253,6 +395,23 @@ void FRenderableManager::setCulling(Instance instance, bool enable) noexcept {
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.culling = enable;
+        markDirty(instance);
+    }
+}
+
+void FRenderableManager::setOccluder(Instance instance, bool enable) noexcept {
+    if (instance) {
+        Visibility& visibility = mManager[instance].visibility;
+        visibility.occluder = enable;
+        markDirty(instance);
+    }
+}
+
+void FRenderableManager::setDynamicShadowCaster(Instance instance, bool enable) noexcept {
+    if (instance) {
+        Visibility& visibility = mManager[instance].visibility;
+        visibility.dynamicShadowCaster = enable;
+        markDirty(instance);
     }
 }
 
@@ -260,6 +419,7 @@ void FRenderableManager::setUniformHandle(Instance instance,
         Handle<HwUniformBuffer> const& handle) noexcept {
     if (instance) {
         mManager[instance].uniformsHandle = handle;
+        markDirty(instance);
     }
 }
 
@@ -287,6 +447,14 @@ bool FRenderableManager::isCullingEnabled(Instance instance) const noexcept {
     return getVisibility(instance).culling;
 }
 
+bool FRenderableManager::isOccluder(Instance instance) const noexcept {
+    return getVisibility(instance).occluder;
+}
+
+bool FRenderableManager::isDynamicShadowCaster(Instance instance) const noexcept {
+    return getVisibility(instance).dynamicShadowCaster;
+}
+
 uint8_t FRenderableManager::getLayerMask(Instance instance) const noexcept {
     return mManager[instance].layers;
 }
@@ -299,11 +467,7 @@ Box const& FRenderableManager::getAABB(Instance instance) const noexcept {
     return mManager[instance].aabb;
 }
 
-UniformBuffer const& FRenderableManager::getUniformBuffer(Instance instance) const noexcept {
-    return mManager[instance].uniforms;
-}
-
-UniformBuffer& FRenderableManager::getUniformBuffer(Instance instance) noexcept {
+PerRenderableUib const& FRenderableManager::getUniforms(Instance instance) const noexcept {
     return mManager[instance].uniforms;
 }
 
@@ -311,23 +475,39 @@ Handle<HwUniformBuffer> FRenderableManager::getUbh(Instance instance) const noex
     return mManager[instance].uniformsHandle;
 }
 
-Handle<HwUniformBuffer> FRenderableManager::getBonesUbh(Instance instance) const noexcept {
-    std::unique_ptr<Bones> const& bones = mManager[instance].bones;
-    return bones ? bones->handle : Handle<HwUniformBuffer>{};
+uint32_t FRenderableManager::getBonesSlot(Instance instance) const noexcept {
+    Bones const& bones = mManager[instance].bones;
+    return bones.count ? bones.slot + 1 : 0;
+}
+
+Handle<HwSamplerBuffer> FRenderableManager::getMorphTargetsSbh(Instance instance) const noexcept {
+    MorphTargets const& morphTargets = mManager[instance].morphTargets;
+    return morphTargets.sbh;
+}
+
+size_t FRenderableManager::getLevelCount(Instance instance) const noexcept {
+    std::unique_ptr<LevelsOfDetail> const& levels = mManager[instance].levels;
+    return levels ? levels->count : 1;
+}
+
+FRenderableManager::LevelsOfDetail const* FRenderableManager::getLevelsOfDetail(
+        Instance instance) const noexcept {
+    std::unique_ptr<LevelsOfDetail> const& levels = mManager[instance].levels;
+    return levels.get();
 }
 
 utils::Slice<FRenderPrimitive> const& FRenderableManager::getRenderPrimitives(
-        Instance instance, uint8_t level) const noexcept {
+        Instance instance) const noexcept {
     return mManager[instance].primitives;
 }
 
 utils::Slice<FRenderPrimitive>& FRenderableManager::getRenderPrimitives(
-        Instance instance, uint8_t level) noexcept {
+        Instance instance) noexcept {
     return mManager[instance].primitives;
 }
 
-size_t FRenderableManager::getPrimitiveCount(Instance instance, uint8_t level) const noexcept {
-    return getRenderPrimitives(instance, level).size();
+size_t FRenderableManager::getPrimitiveCount(Instance instance) const noexcept {
+    return getRenderPrimitives(instance).size();
 }
 
 } // namespace details
@@ -16,13 +16,25 @@
 
 #include "components/TransformManager.h"
 
+#include <utils/JobSystem.h>
+
+#include <functional>
+
 using namespace utils;
 using namespace math;
 
 namespace filament {
 namespace details {
 
-FTransformManager::FTransformManager() noexcept = default;
+// smallest number of dirty nodes for which a transaction is committed in parallel
+static constexpr size_t PARALLEL_COMMIT_MIN_COUNT = 1024;
+// smallest level of the hierarchy that is worth splitting into jobs
+static constexpr size_t PARALLEL_COMMIT_MIN_LEVEL_COUNT = 256;
+static constexpr size_t JOBS_PARALLEL_FOR_TRANSFORMS_COUNT = 128;
+
+FTransformManager::FTransformManager() noexcept {
+    mManager.trackDestroyedEntities(EntityManager::get());
+}
 
 FTransformManager::~FTransformManager() noexcept = default;
 
@@ -44,6 +56,7 @@ void FTransformManager::create(Entity entity, Instance parent, const mat4f& loca
     Instance i = manager.addComponent(entity);
     assert(i);
     assert(i != parent);
+    mStructureVersion++;
 
     if (i && i != parent) {
         manager[i].parent = 0;
@@ -82,11 +95,17 @@ void FTransformManager::destroy(Entity e) noexcept {
         Instance child = manager[i].firstChild;
         while (child) {
             manager[child].parent = 0;
+            if (UTILS_UNLIKELY(mLocalTransformTransactionOpen || mLazyUpdates)) {
+                // their world transform becomes their local transform when committing
+                manager[child].dirty = true;
+                mHasPendingTransforms = true;
+            }
             child = manager[child].next;
         }
 
         // 2) remove the component
         Instance moved = manager.removeComponent(e);
+        mStructureVersion++;
 
         // 3) update the references to the entry now with Instance i
         if (moved != i) {
@@ -100,7 +119,7 @@ void FTransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
     if (ci) {
         auto& manager = mManager;
         // store our local transform
-        manager[ci].local = model;
+        manager[ci].local = AffineTransform(model);
         updateNodeTransform(ci);
     }
 }
@@ -110,31 +129,29 @@ void FTransformManager::updateNodeTransform(Instance i) noexcept {
     auto& manager = mManager;
     assert(i);
 
-    if (UTILS_UNLIKELY(mLocalTransformTransactionOpen)) {
+    if (UTILS_UNLIKELY(mLocalTransformTransactionOpen || mLazyUpdates)) {
         // don't update the world transform until commitLocalTransformTransaction() is called
-        Instance ci = manager[i].firstChild;
-        while (ci) {
-            Instance child = manager[ci].firstChild;
-            ci = manager[ci].next;
-            if (child) {
-                updateNodeTransform(child);
-            }
-        }
+        // or the pending transforms are resolved, which also updates the descendants of the dirty
+        // nodes. This way, each changed subtree is only visited once.
+        manager[i].dirty = true;
+        mHasPendingTransforms = true;
         return;
     }
 
     // find our parent's world transform, if any
     // note: by using the raw_array() we don't need to check that parent is valid.
     Instance parent = manager[i].parent;
-    mat4f const& pt = manager.raw_array<WORLD>()[parent];
+    AffineTransform const& pt = manager.raw_array<WORLD>()[parent];
 
     // compute our world transform
-    manager[i].world = pt * static_cast<mat4f const&>(manager[i].local);
+    const uint32_t version = ++mVersion;
+    manager[i].world = pt * static_cast<AffineTransform const&>(manager[i].local);
+    manager[i].version = version;
 
     // update our children's world transforms
     Instance child = manager[i].firstChild;
     if (UTILS_UNLIKELY(child)) { // assume we don't have a hierarchy in the common case
-        transformChildren(manager, child);
+        transformChildren(manager, child, version);
     }
 }
 
@@ -145,23 +162,133 @@ void FTransformManager::openLocalTransformTransaction() noexcept {
 void FTransformManager::commitLocalTransformTransaction() noexcept {
     if (mLocalTransformTransactionOpen) {
         mLocalTransformTransactionOpen = false;
-        auto& manager = mManager;
+        resolveDirtyNodes();
+    }
+}
 
-        // swapNode() below needs some temporary storage which we provide here
-        auto& soa = manager.getSoA();
-        soa.ensureCapacity(soa.size() + 1);
+void FTransformManager::setLazyUpdatesEnabled(bool enabled) noexcept {
+    mLazyUpdates = enabled;
+    if (!enabled) {
+        resolvePendingTransforms();
+    }
+}
+
+const AffineTransform& FTransformManager::resolveWorldTransform(Instance ci) noexcept {
+    if (mLocalTransformTransactionOpen) {
+        return mManager[ci].world;
+    }
+    Entity e = mManager.getEntity(ci);
+    resolveDirtyNodes();
+    return mManager[mManager.getInstance(e)].world;
+}
+
+void FTransformManager::resolveDirtyNodes() noexcept {
+    mHasPendingTransforms = false;
+    auto& manager = mManager;
 
-        mat4f const* const UTILS_RESTRICT world = manager.raw_array<WORLD>();
-        for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
-            // Ensure that children are always sorted after their parent.
-            if (UTILS_UNLIKELY(Instance(manager[i].parent) > i)) {
-                swapNode(i, manager[i].parent);
+    // swapNode() below needs some temporary storage which we provide here
+    auto& soa = manager.getSoA();
+    soa.ensureCapacity(soa.size() + 1);
+
+    // the world transforms of the dirty nodes and their descendants are recomputed below
+    const uint32_t version = ++mVersion;
+
+    // Ensure that children are always sorted after their parent. Because parents are
+    // visited first, the same pass propagates the dirty flags to the descendants, and
+    // computes the depth of each node, counting the dirty nodes of each level.
+    Instance const* const parents = soa.data<PARENT>();
+    bool* const dirty = soa.data<DIRTY>();
+    auto& depths = mDepths;
+    auto& levelCounts = mLevelOffsets;
+    depths.resize(soa.size());
+    levelCounts.clear();
+    size_t dirtyCount = 0;
+    for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
+        if (UTILS_UNLIKELY(Instance(manager[i].parent) > i)) {
+            swapNode(i, manager[i].parent);
+        }
+        const Instance parent = parents[i];
+        assert(parent < i);
+        const uint32_t depth = parent ? depths[parent] + 1 : 0;
+        depths[i] = depth;
+        dirty[i] = dirty[i] || dirty[parent];
+        if (dirty[i]) {
+            if (UTILS_UNLIKELY(depth >= levelCounts.size())) {
+                levelCounts.resize(depth + 1, 0);
             }
-            Instance parent = manager[i].parent;
-            assert(parent < i);
-            manager[i].world = world[parent] * static_cast<mat4f const&>(manager[i].local);
+            levelCounts[depth]++;
+            dirtyCount++;
+        }
+    }
+
+    if (mJobSystem && dirtyCount >= PARALLEL_COMMIT_MIN_COUNT) {
+        commitDirtyNodesByLevel(dirtyCount, version);
+        return;
+    }
+
+    AffineTransform const* const UTILS_RESTRICT local = soa.data<LOCAL>();
+    AffineTransform* const UTILS_RESTRICT world = soa.data<WORLD>();
+    uint32_t* const UTILS_RESTRICT versions = soa.data<VERSION>();
+    for (size_t i = manager.begin(), e = manager.end(); i != e; ++i) {
+        if (dirty[i]) {
+            world[i] = world[parents[i]] * local[i];
+            versions[i] = version;
+            dirty[i] = false;
+        }
+    }
+}
+
+void FTransformManager::commitDirtyNodesByLevel(size_t dirtyCount, uint32_t version) noexcept {
+    auto& soa = mManager.getSoA();
+    bool* const UTILS_RESTRICT dirty = soa.data<DIRTY>();
+    uint32_t const* const UTILS_RESTRICT depths = mDepths.data();
+
+    // bucket the dirty nodes by depth, in instance order within a level. Each level only depends
+    // on the previous ones, so its nodes can be processed in parallel.
+    // mLevelOffsets holds the number of dirty nodes per level, it's turned into the offset of
+    // each level, then to the end of each level as the nodes are bucketed.
+    auto& levelEnds = mLevelOffsets;
+    uint32_t offset = 0;
+    for (uint32_t& level : levelEnds) {
+        const uint32_t count = level;
+        level = offset;
+        offset += count;
+    }
+    auto& nodes = mDirtyNodes;
+    nodes.resize(dirtyCount);
+    for (size_t i = mManager.begin(), e = mManager.end(); i != e; ++i) {
+        if (dirty[i]) {
+            nodes[levelEnds[depths[i]]++] = uint32_t(i);
+            dirty[i] = false;
         }
     }
+
+    Instance const* const UTILS_RESTRICT parents = soa.data<PARENT>();
+    AffineTransform const* const UTILS_RESTRICT local = soa.data<LOCAL>();
+    AffineTransform* const UTILS_RESTRICT world = soa.data<WORLD>();
+    uint32_t* const UTILS_RESTRICT versions = soa.data<VERSION>();
+    uint32_t const* const UTILS_RESTRICT dirtyNodes = nodes.data();
+    auto work = [=](uint32_t start, uint32_t count) {
+        for (uint32_t k = start, e = start + count; k < e; k++) {
+            const uint32_t i = dirtyNodes[k];
+            world[i] = world[parents[i]] * local[i];
+            versions[i] = version;
+        }
+    };
+
+    JobSystem& js = *mJobSystem;
+    uint32_t start = 0;
+    for (uint32_t end : levelEnds) {
+        const uint32_t count = end - start;
+        if (count >= PARALLEL_COMMIT_MIN_LEVEL_COUNT) {
+            auto job = jobs::parallel_for(js, nullptr, start, count, std::cref(work),
+                    jobs::CountSplitter<JOBS_PARALLEL_FOR_TRANSFORMS_COUNT>());
+            js.runAndWait(job);
+        } else {
+            work(start, count);
+        }
+        start = end;
+    }
 }
 
 // Inserts a parentless node in the hierarchy
@@ -194,9 +321,14 @@ void FTransformManager::swapNode(Instance i, Instance j) noexcept {
 
     auto& manager = mManager;
 
+    // instances i and j now refer to different entities
+    mStructureVersion++;
+
     // swap the content of the nodes directly
     std::swap(manager.elementAt<LOCAL>(i), manager.elementAt<LOCAL>(j));
     std::swap(manager.elementAt<WORLD>(i), manager.elementAt<WORLD>(j));
+    std::swap(manager.elementAt<VERSION>(i), manager.elementAt<VERSION>(j));
+    std::swap(manager.elementAt<DIRTY>(i), manager.elementAt<DIRTY>(j));
     manager.swap(i, j); // this swaps the data relative to SingleInstanceComponentManager
 
     // now swap the linked-list references, to do that correctly we must use a temporary
@@ -283,18 +415,19 @@ void FTransformManager::updateNode(Instance i) noexcept {
     validateNode(next);
 }
 
-void FTransformManager::transformChildren(Sim& manager, Instance ci) noexcept {
+void FTransformManager::transformChildren(Sim& manager, Instance ci, uint32_t version) noexcept {
     while (ci) {
         // update child's world transform
         Instance parent = manager[ci].parent;
-        mat4f const& pt = manager[parent].world;
-        mat4f const& local = manager[ci].local;
+        AffineTransform const& pt = manager[parent].world;
+        AffineTransform const& local = manager[ci].local;
         manager[ci].world = pt * local;
+        manager[ci].version = version;
 
         // assume we don't have a deep hierarchy
         Instance child = manager[ci].firstChild;
         if (UTILS_UNLIKELY(child)) {
-            transformChildren(manager, child);
+            transformChildren(manager, child, version);
         }
 
         // process our next child
@@ -380,11 +513,11 @@ void TransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
     upcast(this)->setTransform(ci, model);
 }
 
-const mat4f& TransformManager::getTransform(Instance ci) const noexcept {
+mat4f TransformManager::getTransform(Instance ci) const noexcept {
     return upcast(this)->getTransform(ci);
 }
 
-const mat4f& TransformManager::getWorldTransform(Instance ci) const noexcept {
+mat4f TransformManager::getWorldTransform(Instance ci) const noexcept {
     return upcast(this)->getWorldTransform(ci);
 }
 
@@ -400,4 +533,12 @@ void TransformManager::commitLocalTransformTransaction() noexcept {
     upcast(this)->commitLocalTransformTransaction();
 }
 
+void TransformManager::setLazyUpdatesEnabled(bool enabled) noexcept {
+    upcast(this)->setLazyUpdatesEnabled(enabled);
+}
+
+bool TransformManager::isLazyUpdatesEnabled() const noexcept {
+    return upcast(this)->isLazyUpdatesEnabled();
+}
+
 } // namespace filament
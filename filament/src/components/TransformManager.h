@@ -19,6 +19,8 @@
 
 #include "upcast.h"
 
+#include "AffineTransform.h"
+
 #include <filament/TransformManager.h>
 
 #include <utils/compiler.h>
@@ -28,6 +30,13 @@
 
 #include <math/mat4.h>
 
+#include <atomic>
+#include <vector>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filament {
 namespace details {
 
@@ -41,6 +50,9 @@ public:
     // free-up all resources
     void terminate() noexcept;
 
+    // when set, large transactions are committed in parallel, one level of the hierarchy at a time
+    void setJobSystem(utils::JobSystem* js) noexcept { mJobSystem = js; }
+
 
     /*
     * Component Manager APIs
@@ -66,22 +78,65 @@ public:
 
     void commitLocalTransformTransaction() noexcept;
 
+    void setLazyUpdatesEnabled(bool enabled) noexcept;
+
+    bool isLazyUpdatesEnabled() const noexcept { return mLazyUpdates; }
+
+    // computes the world transforms left pending by lazy updates, this is a no-op if there are
+    // none or if a local transform transaction is open. Called before preparing the scenes.
+    void resolvePendingTransforms() noexcept {
+        if (UTILS_UNLIKELY(mHasPendingTransforms && !mLocalTransformTransactionOpen)) {
+            resolveDirtyNodes();
+        }
+    }
+
     void gc(utils::EntityManager& em) noexcept;
 
-    utils::Slice<const math::mat4f> getWorldTransforms() const noexcept {
+    utils::Slice<const AffineTransform> getWorldTransforms() const noexcept {
+        const_cast<FTransformManager*>(this)->resolvePendingTransforms();
         return mManager.slice<WORLD>();
     }
 
     void setTransform(Instance ci, const math::mat4f& model) noexcept;
 
-    const math::mat4f& getTransform(Instance ci) const noexcept {
-        return mManager[ci].local;
+    math::mat4f getTransform(Instance ci) const noexcept {
+        return static_cast<AffineTransform const&>(mManager[ci].local).asMat4f();
     }
 
-    const math::mat4f& getWorldTransform(Instance ci) const noexcept {
+    math::mat4f getWorldTransform(Instance ci) const noexcept {
+        return getAffineWorldTransform(ci).asMat4f();
+    }
+
+    const AffineTransform& getAffineWorldTransform(Instance ci) const noexcept {
+        if (UTILS_UNLIKELY(mHasPendingTransforms)) {
+            // resolving can reorder the instances, ci must be looked up again
+            return const_cast<FTransformManager*>(this)->resolveWorldTransform(ci);
+        }
         return mManager[ci].world;
     }
 
+    /*
+     * Change tracking
+     *
+     * Each instance records the version of the last change to its world transform. The
+     * version of the manager itself is the largest version of all its instances. The
+     * structure version changes when instances are added, removed or moved, i.e. when
+     * previously retrieved Instances must be considered invalid.
+     *
+     * With lazy updates, versions only change when the pending transforms are resolved, the
+     * instances changed since a given version are then exactly the resolved dirty subtrees.
+     */
+
+    uint32_t getVersion() const noexcept { return mVersion.load(std::memory_order_relaxed); }
+
+    uint32_t getVersion(Instance ci) const noexcept {
+        return mManager[ci].version;
+    }
+
+    uint32_t getStructureVersion() const noexcept {
+        return mStructureVersion.load(std::memory_order_relaxed);
+    }
+
 private:
     struct Sim;
 
@@ -91,29 +146,38 @@ private:
     void updateNodeTransform(Instance i) noexcept;
     void insertNode(Instance i, Instance p) noexcept;
     void swapNode(Instance i, Instance j) noexcept;
-    static void transformChildren(Sim& manager, Instance firstChild) noexcept;
+    static void transformChildren(Sim& manager, Instance firstChild, uint32_t version) noexcept;
+    void resolveDirtyNodes() noexcept;
+    const AffineTransform& resolveWorldTransform(Instance ci) noexcept;
+    void commitDirtyNodesByLevel(size_t dirtyCount, uint32_t version) noexcept;
 
 
     enum {
         LOCAL,          // local transform (relative to parent), world if no parent
         WORLD,          // world transform
+        // note: transforms are stored as 3x4 affine transforms, the last row is always 0,0,0,1
         PARENT,         // instance to the parent
         FIRST_CHILD,    // instance to our first child
         NEXT,           // instance to our next sibling
         PREV,           // instance to our previous sibling
+        VERSION,        // version of the last change to the world transform
+        DIRTY,          // world transform must be recomputed (transaction or lazy updates)
     };
 
     using Base = utils::SingleInstanceComponentManager<
-            math::mat4f,
-            math::mat4f,
+            AffineTransform,
+            AffineTransform,
+            Instance,
             Instance,
             Instance,
             Instance,
-            Instance
+            uint32_t,
+            bool
     >;
 
     struct Sim : public Base {
         using Base::gc;
+        using Base::trackDestroyedEntities;
         using Base::swap;
 
         typename Base::SoA& getSoA() { return mData; }
@@ -132,6 +196,8 @@ private:
                 Field<FIRST_CHILD>  firstChild;
                 Field<NEXT>         next;
                 Field<PREV>         prev;
+                Field<VERSION>      version;
+                Field<DIRTY>        dirty;
             };
         };
 
@@ -144,7 +210,18 @@ private:
     };
 
     Sim mManager;
+    // the renderer reads them while the transforms change in snapshot mode, see FEngine
+    std::atomic<uint32_t> mVersion = { 0 };
+    std::atomic<uint32_t> mStructureVersion = { 0 };
     bool mLocalTransformTransactionOpen = false;
+    bool mLazyUpdates = false;
+    bool mHasPendingTransforms = false;     // some nodes are dirty
+
+    utils::JobSystem* mJobSystem = nullptr;
+    // scratch storage for commitLocalTransformTransaction(), kept to avoid reallocations
+    std::vector<uint32_t> mDepths;
+    std::vector<uint32_t> mLevelOffsets;
+    std::vector<uint32_t> mDirtyNodes;
 };
 
 FILAMENT_UPCAST(TransformManager)
@@ -24,7 +24,8 @@ namespace details {
 
 // per render pass allocations
 // Froxelization needs about 1 MiB. Command buffer needs about 1 MiB.
-static constexpr size_t CONFIG_PER_RENDER_PASS_ARENA_SIZE    = 2 * 1024 * 1024;
+// Sorting the commands needs as much scratch space as the command buffer.
+static constexpr size_t CONFIG_PER_RENDER_PASS_ARENA_SIZE    = 3 * 1024 * 1024;
 
 // size of the high-level draw commands buffer (comes from the per-render pass allocator)
 static constexpr size_t CONFIG_PER_FRAME_COMMANDS_SIZE = 1 * 1024 * 1024;
@@ -52,12 +53,20 @@ using HeapAllocatorArena = utils::Arena<
 
 using LinearAllocatorArena = utils::Arena<
         utils::LinearAllocator,
-        utils::LockingPolicy::NoLock>;
+        utils::LockingPolicy::NoLock,
+        utils::TrackingPolicy::Statistics>;
 
 #endif
 
 using ArenaScope = utils::ArenaScope<LinearAllocatorArena>;
 
+// tracks the size of the high-level draw commands buffer of each frame
+#ifndef NDEBUG
+using CommandsTracking = utils::TrackingPolicy::HighWatermark;
+#else
+using CommandsTracking = utils::TrackingPolicy::Statistics;
+#endif
+
 } // namespace details
 } // namespace filament
 
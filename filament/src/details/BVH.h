@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_BVH_H
+#define TNT_FILAMENT_DETAILS_BVH_H
+
+#include "details/Culler.h"
+
+#include <filament/Frustum.h>
+
+#include <utils/compiler.h>
+#include <utils/JobSystem.h>
+
+#include <math/vec3.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * A bounding volume hierarchy over an array of AABBs, used to accelerate frustum culling of
+ * large scenes.
+ *
+ * The AABBs are identified by a "slot", which is their index in the arrays passed to build().
+ * Because the arrays can be reordered after the hierarchy is built (FView partitions the
+ * renderable SoA every frame), setRows() must be called to tell the BVH where each slot
+ * currently lives before refit() or cull() are used.
+ *
+ * Each node covers a contiguous range of slots, which allows accepting a whole subtree
+ * without visiting its children.
+ */
+class BVH {
+public:
+    // leaves hold at most this many AABBs, they're tested with Culler
+    static constexpr size_t LEAF_SIZE = Culler::MODULO;
+
+    // the subtrees with at least this many AABBs are culled by their own job
+    static constexpr size_t JOB_SIZE = 4096;
+
+    BVH() noexcept = default;
+    BVH(BVH const& rhs) = delete;
+    BVH& operator=(BVH const& rhs) = delete;
+
+    // discards the hierarchy
+    void clear() noexcept;
+
+    // builds the hierarchy, slots are assigned in the order of the arrays
+    void build(math::float3 const* center, math::float3 const* extent, size_t count) noexcept;
+
+    // updates the slot to row mapping, slots[i] is the slot of the AABB at row i
+    void setRows(uint32_t const* slots, size_t count) noexcept;
+
+    // recomputes the bounds of all nodes after the AABBs have moved
+    void refit(math::float3 const* center, math::float3 const* extent) noexcept;
+
+    // sets 'bit' in 'results' for each AABB intersecting the frustum.
+    // 'results' is indexed by row and must be cleared by the caller.
+    void cull(Culler::result_type* results, Frustum const& frustum,
+            math::float3 const* center, math::float3 const* extent, size_t bit) const noexcept;
+
+    // same as above, the large subtrees intersecting the frustum are culled in parallel
+    void cull(utils::JobSystem& js, Culler::result_type* results, Frustum const& frustum,
+            math::float3 const* center, math::float3 const* extent, size_t bit) const noexcept;
+
+    size_t getCount() const noexcept { return mSlotToRow.size(); }
+
+    bool empty() const noexcept { return mNodes.empty(); }
+
+private:
+    struct Node {
+        math::float3 center;
+        uint32_t first = 0;         // first entry in mSlots covered by this node
+        math::float3 extent;
+        uint32_t count = 0;         // number of entries in mSlots covered by this node
+        uint32_t child = 0;         // index of the first of two children, 0 for leaves
+    };
+
+    enum class Intersection : uint8_t { OUTSIDE, INTERSECTS, INSIDE };
+
+    struct CullParams {
+        Culler::result_type* results;
+        Frustum const* frustum;
+        math::float3 const* center;
+        math::float3 const* extent;
+        size_t bit;
+    };
+
+    static inline Intersection classify(math::float4 const* UTILS_RESTRICT planes,
+            Node const& node) noexcept;
+
+    // culls the subtree of 'root', its subtrees larger than JOB_SIZE are handed to jobs that
+    // are children of 'parent', unless 'parent' is null
+    void cullSubtree(CullParams const& params, uint32_t root,
+            utils::JobSystem* js, utils::JobSystem::Job* parent) const noexcept;
+
+    std::vector<Node> mNodes;           // children are always after their parent
+    std::vector<uint32_t> mSlots;       // slots, in the order of the leaves
+    std::vector<uint32_t> mSlotToRow;   // current row of each slot
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_BVH_H
@@ -78,7 +78,7 @@ public:
     void lookAt(const math::float3& eye, const math::float3& center, const math::float3& up = { 0, 1, 0 })  noexcept;
 
     // returns the view matrix
-    math::mat4f const& getModelMatrix() const noexcept;
+    math::mat4f getModelMatrix() const noexcept;
 
     // returns the inverse of the view matrix
     math::mat4f getViewMatrix() const noexcept;
@@ -114,6 +114,10 @@ public:
     // returns a Frustum object in world space
     Frustum getFrustum() const noexcept;
 
+    // reports a change made through the public API to the engine, see FRenderer::needsRedraw().
+    // The setters don't, the cameras of the shadow maps are updated every frame.
+    void contentChanged() noexcept;
+
     // sets this camera's exposure (default is f/16, 1/125s, 100 ISO)
     void setExposure(float aperture, float shutterSpeed, float sensitivity) noexcept;
 
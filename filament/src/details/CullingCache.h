@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_CULLINGCACHE_H
+#define TNT_FILAMENT_DETAILS_CULLINGCACHE_H
+
+#include "details/Culler.h"
+#include "details/Scene.h"
+
+#include <filament/Frustum.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * The frustum culling results of a View, kept from one frame to the next.
+ *
+ * Each bit of the VISIBLE_MASK is cached along with the frustum it was culled with. When a bit
+ * is culled again with the same frustum, only the renderables whose transform or renderable
+ * component changed since, i.e. whose world AABB may have moved, are tested again. The other
+ * renderables reuse their last result, so the cost of culling follows what moves rather than
+ * the size of the scene.
+ *
+ * The results are kept by renderable instance, because the SoA is reordered every frame, and
+ * they're dropped when the scene rebuilds its SoA. A bit that isn't culled during a frame is
+ * dropped as well.
+ */
+class CullingCache {
+public:
+    // starts a frame, the cache is only kept if the scene's SoA wasn't rebuilt since the last one
+    void prepare(FScene const* scene) noexcept;
+
+    // sets 'bit' of the VISIBLE_MASK of the renderables within 'frustum', and returns true if
+    // the bit was cached for this frustum. Otherwise nothing is done and the caller must cull
+    // the renderables, then call store().
+    bool reuse(FScene::RenderableSoa& renderableData, Frustum const& frustum,
+            size_t bit) noexcept;
+
+    // caches 'bit' of the VISIBLE_MASK, after the renderables were culled with 'frustum'
+    void store(FScene::RenderableSoa const& renderableData, Frustum const& frustum,
+            size_t bit) noexcept;
+
+    // ends the frame, must be called after the last bit was culled
+    void commit(FScene::RenderableSoa const& renderableData) noexcept;
+
+    // drops everything
+    void clear() noexcept;
+
+private:
+    static constexpr size_t BIT_COUNT = sizeof(Culler::result_type) * 8;
+
+    // the VISIBLE_MASK of a renderable, and the versions of its components it was culled at
+    struct Entry {
+        uint32_t transformVersion = 0;
+        uint32_t renderableVersion = 0;
+        Culler::result_type mask = 0;
+    };
+
+    std::vector<Entry> mEntries;        // indexed by renderable instance
+    Frustum mFrusta[BIT_COUNT];
+    uint32_t mCachedBits = 0;           // bits whose frustum and results are valid
+    uint32_t mCulledBits = 0;           // bits culled during this frame
+    FScene const* mScene = nullptr;
+    uint32_t mSceneGeneration = 0;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_CULLINGCACHE_H
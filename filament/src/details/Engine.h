@@ -18,11 +18,14 @@
 #define TNT_FILAMENT_DETAILS_ENGINE_H
 
 #include "upcast.h"
+#include "BindlessTextureTable.h"
 #include "PostProcessManager.h"
 #include "RenderTargetPool.h"
+#include "TextureStreamer.h"
 
 #include "components/CameraManager.h"
 #include "components/LightManager.h"
+#include "components/ParticleManager.h"
 #include "components/TransformManager.h"
 #include "components/RenderableManager.h"
 
@@ -33,6 +36,7 @@
 #include "details/Skybox.h"
 
 #include "driver/CommandStream.h"
+#include "driver/CommandStreamProfiler.h"
 #include "driver/CommandBufferQueue.h"
 #include "driver/DriverApi.h"
 
@@ -40,6 +44,7 @@
 #include <filament/VertexBuffer.h>
 #include <filament/IndirectLight.h>
 #include <filament/Material.h>
+#include <filament/MorphTargetBuffer.h>
 #include <filament/Texture.h>
 #include <filament/Skybox.h>
 #include <filament/Stream.h>
@@ -55,9 +60,13 @@
 #include <math/mat4.h>
 #include <math/quat.h>
 
+#include <tsl/robin_map.h>
+
+#include <atomic>
 #include <chrono>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 namespace filament {
 
@@ -69,6 +78,7 @@ namespace details {
 
 class FFence;
 class FMaterialInstance;
+class FMorphTargetBuffer;
 class FRenderer;
 class FScene;
 class FSwapChain;
@@ -102,6 +112,7 @@ public:
     static constexpr float  CONFIG_Z_LIGHT_FAR             = 100;
     static constexpr size_t CONFIG_FROXEL_SLICE_COUNT      = 16;
     static constexpr bool   CONFIG_IBL_USE_IRRADIANCE_MAP  = false;
+    static constexpr size_t CONFIG_MAX_INSTANCED_DRAW_COUNT = 256;   // per frame
 
     static constexpr size_t CONFIG_PER_RENDER_PASS_ARENA_SIZE   = details::CONFIG_PER_RENDER_PASS_ARENA_SIZE;
     static constexpr size_t CONFIG_PER_FRAME_COMMANDS_SIZE      = details::CONFIG_PER_FRAME_COMMANDS_SIZE;
@@ -117,7 +128,8 @@ public:
         math::mat4f clipFromViewMatrix;
         math::mat4f viewFromClipMatrix;
         math::mat4f clipFromWorldMatrix;
-        math::mat4f lightFromWorldMatrix;
+        math::mat4f lightFromWorldMatrix[CONFIG_MAX_SHADOW_CASCADES]; // includes the constant bias
+        math::mat4f spotLightFromWorldMatrix[CONFIG_MAX_SHADOW_CASTING_SPOTS]; // idem
 
         math::float4 resolution; // width, height, 1/width, 1/height
 
@@ -131,7 +143,8 @@ public:
         math::float3 lightDirection;
         uint32_t fParamsX; // stride-x
 
-        math::float3 shadowBias; // constant bias, normal bias, unused
+        math::float2 padding0;
+        float orderIndependentTransparency; // 1 if the transparent surfaces are accumulated
         float oneOverFroxelDimensionY;
 
         math::float4 zParams; // froxel Z parameters
@@ -144,14 +157,24 @@ public:
         float exposure;
         float ev100;
 
+        math::float4 cascadeSplits;     // view-space distance at which each shadow cascade ends
+        math::float4 shadowNormalBias;  // world-space normal bias of each shadow cascade
+
         alignas(16) math::float4 iblSH[9]; // actually float3 entries (std140 requires float4 alignment)
+
+        // the probes are placed in the space of the application, without the world origin
+        math::mat4f reflectionProbesFromWorldMatrix;
+        math::float4 reflectionProbes[CONFIG_MAX_REFLECTION_PROBES * 3]; // box min, box max, position
     };
 
-    struct PerRenderableUib {
+    // stored by FRenderableManager, so it lives in its own header
+    using PerRenderableUib = filament::PerRenderableUib;
+
+    struct PerInstanceUib {
         static UniformInterfaceBlock getUib() noexcept;
         // these fields are only used to call offsetof() and make it easy to visualize the UBO
-        math::mat4f worldFromModelMatrix;
-        math::mat3f worldFromModelNormalMatrix;
+        math::mat4f worldFromModelMatrix[CONFIG_MAX_INSTANCE_COUNT];
+        math::float4 worldFromModelNormalMatrix[CONFIG_MAX_INSTANCE_COUNT * 3]; // actually mat3 entries (std140 requires float4 alignment)
     };
 
     struct PostProcessingUib {
@@ -159,6 +182,15 @@ public:
         math::float2 uvScale;
         float time;             // time in seconds, with a 1 second period, used for dithering
         float yOffset;
+        math::float2 jitter;        // offset of the current frame's samples, in texels
+        math::float2 historyScale;  // viewport size / history texture size
+        float historyWeight;        // 0 when there is no valid history
+        // the following are only used by the IBL prefiltering passes
+        float iblFace;              // face being rendered, see TextureCubemapFace
+        float iblRoughness;         // linear roughness of the level being rendered
+        float iblSampleCount;
+        float iblSourceSize;        // size of the base level of the environment
+        float iblSourceMaxLevel;    // index of the last level of the environment
     };
 
     struct PerViewSib {
@@ -169,33 +201,54 @@ public:
         static constexpr size_t FROXELS        = 2;
         static constexpr size_t IBL_DFG_LUT    = 3;
         static constexpr size_t IBL_SPECULAR   = 4;
-        static constexpr size_t IBL_IRRADIANCE = 5;
+        static constexpr size_t SPOT_SHADOW_MAP = 5;
+        static constexpr size_t REFLECTION_PROBES = 6;
+        static constexpr size_t IBL_IRRADIANCE = 7;
+    };
+
+    struct PerRenderableSib {
+        static SamplerInterfaceBlock getSib() noexcept;
+        // indices of each samplers in this SamplerInterfaceBlock (see: getSib())
+        static constexpr size_t MORPH_TARGET_POSITIONS = 0;
+        static constexpr size_t MORPH_TARGET_NORMALS   = 1;
     };
 
     struct PostProcessSib {
         static SamplerInterfaceBlock getSib() noexcept;
         // indices of each samplers in this SamplerInterfaceBlock (see: getSib())
         static constexpr size_t COLOR_BUFFER   = 0;
+        static constexpr size_t HISTORY        = 1;
+        static constexpr size_t ENVIRONMENT    = 2;
     };
 
 public:
     static FEngine* create(Backend backend = Backend::DEFAULT,
-            ExternalContext* externalContext = nullptr, void* sharedGLContext = nullptr);
+            ExternalContext* externalContext = nullptr, void* sharedGLContext = nullptr,
+            CommandBufferOptions const* commandBufferOptions = nullptr,
+            ThreadPolicy threadPolicy = ThreadPolicy::DEFAULT,
+            utils::JobSystem* jobSystem = nullptr);
 
     ~FEngine() noexcept;
 
     Driver& getDriver() const noexcept { return *mDriver; }
     DriverApi& getDriverApi() noexcept { return mCommandStream; }
+
+    // time spent in each driver command, only measured with PROFILE_COMMAND_STREAM
+    CommandStreamProfiler const& getCommandStreamProfiler() const noexcept {
+        return mCommandStreamProfiler;
+    }
     DFG* getDFG() const noexcept { return mDFG.get(); }
 
 
     // Uniforms...
     const UniformInterfaceBlock& getPerViewUib() const noexcept { return mPerViewUib; }
     const UniformInterfaceBlock& getPerRenderableUib() const noexcept { return mPerRenderableUib; }
+    const UniformInterfaceBlock& getPerInstanceUib() const noexcept { return mPerInstanceUib; }
     const UniformInterfaceBlock& getPerPostProcessUib() const noexcept { return mPostProcessUib; }
 
     // Samplers...
     const SamplerInterfaceBlock& getPerViewSib() const noexcept { return mPerViewSib; }
+    const SamplerInterfaceBlock& getPerRenderableSib() const noexcept { return mPerRenderableSib; }
     const SamplerInterfaceBlock& getPostProcessSib() const noexcept { return mPostProcessSib; }
 
     // the per-frame Area is used by all Renderer, so they must run in sequence and
@@ -210,6 +263,40 @@ public:
     const FMaterial* getSkyboxMaterial(driver::TextureFormat format) const noexcept;
     const FIndirectLight* getDefaultIndirectLight() const noexcept { return mDefaultIbl; }
 
+    // The debug views replace the materials of the color pass, see debug.view below.
+    // Must match debugView.mat
+    enum class DebugView : uint8_t {
+        OVERDRAW,           // number of fragments drawn in each pixel
+        FROXEL_LIGHTS,      // number of point and spot lights in each froxel
+        SHADOW_DENSITY      // shadow map texels per pixel
+    };
+    static constexpr size_t DEBUG_VIEW_COUNT = 3;
+
+    bool hasDebugView() const noexcept {
+        return debug.view.overdraw | debug.view.froxel_lights | debug.view.shadow_density;
+    }
+
+    // Returns the material instance of the first debug view enabled, or nullptr
+    FMaterialInstance const* getDebugViewMaterialInstance() const noexcept {
+        if (UTILS_LIKELY(!hasDebugView())) {
+            return nullptr;
+        }
+        return getDebugViewMaterialInstanceSlow();
+    }
+    FMaterialInstance const* getDebugViewMaterialInstanceSlow() const noexcept;
+    DebugView getDebugView() const noexcept {
+        return debug.view.overdraw ? DebugView::OVERDRAW :
+               debug.view.froxel_lights ? DebugView::FROXEL_LIGHTS : DebugView::SHADOW_DENSITY;
+    }
+
+    // The material whose compute shader culls the commands drawn with GPU culling, see
+    // GpuCuller. It's built the first time it's needed.
+    FMaterial const* getGpuCullingMaterial() const noexcept;
+
+    // The material whose compute shader simulates and draws the particles, see
+    // FParticleManager. It's built the first time it's needed.
+    FMaterial const* getParticlesMaterial() const noexcept;
+
     Handle <HwProgram> getPostProcessProgramSlow(PostProcessStage stage) const noexcept;
     Handle<HwProgram> getPostProcessProgram(PostProcessStage stage) const noexcept {
         Handle<HwProgram> program = mPostProcessPrograms[uint8_t(stage)];
@@ -223,6 +310,100 @@ public:
         return mFullScreenTriangleRph;
     }
 
+    // Returns a per-instance uniform buffer not used yet this frame, or a null handle if they
+    // are all taken. Buffers are recycled in prepare().
+    Handle<HwUniformBuffer> acquireInstanceUniformBuffer() noexcept;
+
+    // The per-instance uniform buffer bound for the draws that aren't instanced, all the vertex
+    // shaders declare the per-instance uniform block.
+    Handle<HwUniformBuffer> getDefaultInstanceUniformBuffer() const noexcept {
+        return mDefaultInstanceUbh;
+    }
+
+    // The draws of the same range of the same buffers share their HwRenderPrimitive, so that
+    // RenderPass::getInstanceCount() can batch them. The buffers must outlive the primitives.
+    struct RenderPrimitiveKey {
+        Handle<HwVertexBuffer> vbh;
+        Handle<HwIndexBuffer> ibh;
+        uint32_t enabledAttributes;
+        driver::PrimitiveType type;
+        uint32_t offset;
+        uint32_t minIndex;
+        uint32_t maxIndex;
+        uint32_t count;
+        bool operator==(RenderPrimitiveKey const& rhs) const noexcept {
+            return vbh.getId() == rhs.vbh.getId() && ibh.getId() == rhs.ibh.getId() &&
+                    enabledAttributes == rhs.enabledAttributes && type == rhs.type &&
+                    offset == rhs.offset && minIndex == rhs.minIndex &&
+                    maxIndex == rhs.maxIndex && count == rhs.count;
+        }
+        struct Hasher {
+            size_t operator()(RenderPrimitiveKey const& key) const noexcept;
+        };
+    };
+    Handle<HwRenderPrimitive> acquireRenderPrimitive(RenderPrimitiveKey const& key) noexcept;
+    void releaseRenderPrimitive(RenderPrimitiveKey const& key) noexcept;
+    size_t getRenderPrimitiveCount() const noexcept { return mRenderPrimitives.size(); }
+
+    // Material instances whose buffers changed, they're committed by the next prepare()
+    void addDirtyMaterialInstance(FMaterialInstance const* mi) {
+        mDirtyMaterialInstances.push_back(mi);
+    }
+    void removeDirtyMaterialInstance(FMaterialInstance const* mi) noexcept;
+
+    // The instances owning the buffers shared by the material instances with the same
+    // parameters, keyed by the hash of the parameters, see FMaterialInstance::share()
+    tsl::robin_map<uint64_t, FMaterialInstance*>& getSharedMaterialInstances() noexcept {
+        return mSharedMaterialInstances;
+    }
+
+    // Changes whenever the residency of a streaming vertex buffer changes, which invalidates
+    // the cached commands, see FVertexBuffer::makeResident()
+    uint32_t getResidencyVersion() const noexcept { return mResidencyVersion; }
+    void residencyChanged() noexcept { mResidencyVersion++; }
+
+    // Changes whenever a material instance starts or stops using the buffers of a shared
+    // instance, which invalidates the cached commands, see FMaterialInstance::share()
+    uint32_t getMaterialSharingVersion() const noexcept { return mMaterialSharingVersion; }
+    void materialSharingChanged() noexcept { mMaterialSharingVersion++; }
+
+    // Changes whenever something that can affect the rendered images changes: the versions of
+    // the transform, renderable and light managers, and everything else reported with
+    // contentChanged() (material instances, cameras, views, scenes, uploads...).
+    // See FRenderer::needsRedraw().
+    uint64_t getContentVersion() const noexcept;
+    void contentChanged() noexcept { mContentVersion.fetch_add(1, std::memory_order_relaxed); }
+
+    // The part of the content version that isn't the components': in snapshot mode, the
+    // application can change the components while a frame renders, but not the rest (see
+    // Scene::setSnapshotCallback()).
+    uint64_t getResourceContentVersion() const noexcept {
+        return mContentVersion.load(std::memory_order_relaxed) + mResidencyVersion;
+    }
+
+    // Same as getContentVersion(), without the changes of the transforms and renderables
+    // (which FScene tracks per renderable) nor the ignored changes. See FRenderer's partial
+    // updates.
+    uint64_t getGlobalContentVersion() const noexcept;
+
+    // The changes made while rendering (e.g. the shadow cameras, the parameters of the compute
+    // passes) are the renderer's own, they're left out of the content version.
+    void ignoreContentChanges(uint64_t since) noexcept {
+        mIgnoredContentChanges += getContentVersion() - since;
+    }
+
+    // Same as ignoreContentChanges() for the changes of the resources only, 'since' is a
+    // getResourceContentVersion(). This is used once the components can change again.
+    void ignoreResourceContentChanges(uint64_t since) noexcept {
+        mIgnoredContentChanges += getResourceContentVersion() - since;
+    }
+
+    // Native and texture id streams get new frames from their producer, which the engine
+    // doesn't see. While there are any, the content is assumed to change every frame.
+    void producerStreamCreated() noexcept { mProducerStreamCount++; }
+    void producerStreamDestroyed() noexcept { mProducerStreamCount--; }
+    bool hasProducerStreams() const noexcept { return mProducerStreamCount != 0; }
+
     FVertexBuffer* getFullScreenVertexBuffer() const noexcept {
         return mFullScreenTriangleVb;
     }
@@ -239,6 +420,22 @@ public:
         return mPostProcessManager;
     }
 
+    BindlessTextureTable& getBindlessTextureTable() noexcept {
+        return mBindlessTextureTable;
+    }
+
+    TextureStreamer const& getTextureStreamer() const noexcept {
+        return mTextureStreamer;
+    }
+
+    TextureStreamer& getTextureStreamer() noexcept {
+        return mTextureStreamer;
+    }
+
+    void setTextureStreamingBudget(size_t budget) noexcept {
+        mTextureStreamer.setBudget(budget);
+    }
+
     RenderTargetPool const& getRenderTargetPool() const noexcept {
         return mRenderTargetPool;
     }
@@ -259,6 +456,10 @@ public:
         return mCameraManager;
     }
 
+    FParticleManager& getParticleManager() noexcept {
+        return mParticleManager;
+    }
+
     FTransformManager& getTransformManager() noexcept {
         return mTransformManager;
     }
@@ -275,6 +476,12 @@ public:
         return mBackend;
     }
 
+    // Whether the color passes use reverse-Z, i.e. the near plane is at depth 1 and the far
+    // plane at depth 0. Only enabled when the clip-space depth range is [0, w].
+    bool isReversedZ() const noexcept {
+        return mReversedZ;
+    }
+
     duration getTime() const noexcept {
         return clock::now() - getEpoch();
     }
@@ -292,6 +499,7 @@ public:
 
     FVertexBuffer* createVertexBuffer(const VertexBuffer::Builder& builder) noexcept;
     FIndexBuffer* createIndexBuffer(const IndexBuffer::Builder& builder) noexcept;
+    FMorphTargetBuffer* createMorphTargetBuffer(const MorphTargetBuffer::Builder& builder) noexcept;
     FIndirectLight* createIndirectLight(const IndirectLight::Builder& builder) noexcept;
     FMaterial* createMaterial(const Material::Builder& builder) noexcept;
     FTexture* createTexture(const Texture::Builder& builder) noexcept;
@@ -300,6 +508,7 @@ public:
 
     void createRenderable(const RenderableManager::Builder& builder, utils::Entity entity);
     void createLight(const LightManager::Builder& builder, utils::Entity entity);
+    bool createParticles(const ParticleManager::Builder& builder, utils::Entity entity);
 
     FRenderer* createRenderer() noexcept;
     FMaterialInstance* createMaterialInstance(const FMaterial* material) noexcept;
@@ -309,11 +518,13 @@ public:
     FCamera* createCamera(utils::Entity entity) noexcept;
     FFence* createFence(Fence::Type type = Fence::Type::SOFT) noexcept;
     FSwapChain* createSwapChain(void* nativeWindow, uint64_t flags) noexcept;
+    FSwapChain* createSwapChain(uint32_t width, uint32_t height, uint64_t flags) noexcept;
 
     void destroy(const FVertexBuffer* p);
     void destroy(const FFence* p);
     void destroy(const FIndexBuffer* p);
     void destroy(const FIndirectLight* p);
+    void destroy(const FMorphTargetBuffer* p);
     void destroy(const FMaterial* p);
     void destroy(const FMaterialInstance* p);
     void destroy(const FRenderer* p);
@@ -324,10 +535,42 @@ public:
     void destroy(const FSwapChain* p);
     void destroy(const FView* p);
     void destroy(utils::Entity e);
+    void destroy(const VertexBuffer* const* p, size_t count);
+    void destroy(const IndexBuffer* const* p, size_t count);
+    void destroy(const Texture* const* p, size_t count);
+    void destroy(utils::Entity const* entities, size_t count);
+
+    void destroyDeferred(utils::Entity const* entities, size_t count);
+    void setProgramCache(ProgramCache* cache) noexcept {
+        getDriverApi().setProgramCache(cache);
+    }
 
-    // flush the current buffer
+    void setDeferredDestroyBudget(uint64_t budget) noexcept {
+        mDeferredDestroyBudget = std::chrono::nanoseconds(budget);
+    }
+    size_t getDeferredDestroyCount() const noexcept {
+        return mDeferredDestroys.size() - mDeferredDestroyCurrent;
+    }
+
+    // flush the current buffer, this waits for the pending commands first
     void flush();
 
+    // Driver commands can be recorded by jobs in space reserved in the command stream, and
+    // these jobs may outlive the call that started them (see FRenderer's frame pipelining).
+    // Between beginDeferredCommands() and endDeferredCommands(), getPendingCommandsJob()
+    // returns the parent such jobs must use. They're all complete once waitForPendingCommands()
+    // returns, which is required before the command buffer is flushed or an object that
+    // these commands might reference is destroyed.
+    // beginDeferredCommands() must be called while the JobSystem has no master job.
+    void beginDeferredCommands() noexcept;
+    void endDeferredCommands() noexcept { mDeferCommands = false; }
+    utils::JobSystem::Job* getPendingCommandsJob() const noexcept {
+        return mDeferCommands ? mPendingCommandsJob : nullptr;
+    }
+    bool hasPendingCommands() const noexcept { return mPendingCommandsRecorded; }
+    void setPendingCommandsRecorded() noexcept { mPendingCommandsRecorded = true; }
+    void waitForPendingCommands() noexcept;
+
     void prepare();
     void gc();
 
@@ -343,8 +586,30 @@ public:
         return mDebugRegistry;
     }
 
+    CommandBufferStats getCommandBufferStats() const noexcept;
+
+    bool getDriverStateStats(DriverStateStats* stats) noexcept;
+
+    MemoryStats getMemoryStats() noexcept;
+
+    StartupStats getStartupStats() const noexcept { return mStartupStats; }
+
+    // records the size of the draw commands of a frame, see getMemoryStats()
+    void recordCommandsSize(void* commands, size_t size) noexcept {
+        mCommandsTracking.onAlloc(commands, size, alignof(std::max_align_t), 0);
+        mCommandsTracking.onReset();
+    }
+
+    // Time the driver thread spent executing commands since it started. This must be called
+    // from a command, e.g. with DriverApi::queueCommand().
+    std::chrono::steady_clock::duration getDriverBusyTime() const noexcept {
+        return mDriverBusyTime + (std::chrono::steady_clock::now() - mExecuteStart);
+    }
+
 private:
-    FEngine(Backend backend, ExternalContext* externalContext, void* sharedGLContext);
+    FEngine(Backend backend, ExternalContext* externalContext, void* sharedGLContext,
+            CommandBufferOptions const& commandBufferOptions, ThreadPolicy threadPolicy,
+            utils::JobSystem* jobSystem);
     void init();
 
     int loop();
@@ -353,6 +618,11 @@ private:
     template<typename T, typename L>
     void terminateAndDestroy(const T* p, ResourceList<T, L>& list);
 
+    template<typename P, typename T, typename L>
+    void terminateAndDestroy(const P* const* p, size_t count, ResourceList<T, L>& list);
+
+    void processDeferredDestroys() noexcept;
+
     template<typename T, typename L>
     void cleanupResourceList(ResourceList<T, L>& list);
 
@@ -362,6 +632,7 @@ private:
     std::unique_ptr<Driver> mDriver;
 
     Backend mBackend;
+    bool mReversedZ = false;
     ExternalContext* mExternalContext = nullptr;
     void* mSharedGLContext = nullptr;
     bool mTerminated = false;
@@ -371,12 +642,15 @@ private:
 
     PostProcessManager mPostProcessManager;
     RenderTargetPool mRenderTargetPool;
+    BindlessTextureTable mBindlessTextureTable;
+    TextureStreamer mTextureStreamer;
 
     utils::EntityManager& mEntityManager;
     FRenderableManager mRenderableManager;
     FTransformManager mTransformManager;
     FLightManager mLightManager;
     FCameraManager mCameraManager;
+    FParticleManager mParticleManager;
 
     ResourceList<FRenderer> mRenderers{ "Renderer" };
     ResourceList<FView> mViews{ "View" };
@@ -386,15 +660,30 @@ private:
     ResourceList<FStream> mStreams{ "Stream" };
     ResourceList<FIndexBuffer> mIndexBuffers{ "IndexBuffer" };
     ResourceList<FVertexBuffer> mVertexBuffers{ "VertexBuffer" };
+    ResourceList<FMorphTargetBuffer> mMorphTargetBuffers{ "MorphTargetBuffer" };
     ResourceList<FIndirectLight> mIndirectLights{ "IndirectLight" };
     ResourceList<FMaterial> mMaterials{ "Material" };
     ResourceList<FTexture> mTextures{ "Texture" };
     ResourceList<FSkybox> mSkyboxes{ "Skybox" };
 
     mutable uint32_t mMaterialId = 0;
+    uint32_t mResidencyVersion = 0;
+    uint32_t mMaterialSharingVersion = 0;
+    std::atomic<uint64_t> mContentVersion = { 0 };
+    uint64_t mIgnoredContentChanges = 0;
+    uint32_t mProducerStreamCount = 0;
 
     // FMaterialInstance are handled directly by FMaterial
     std::unordered_map<const FMaterial*, ResourceList<FMaterialInstance>> mMaterialInstances;
+    std::vector<FMaterialInstance const*> mDirtyMaterialInstances;
+    tsl::robin_map<uint64_t, FMaterialInstance*> mSharedMaterialInstances;
+
+    struct SharedRenderPrimitive {
+        Handle<HwRenderPrimitive> handle;
+        uint32_t count;
+    };
+    tsl::robin_map<RenderPrimitiveKey, SharedRenderPrimitive,
+            RenderPrimitiveKey::Hasher> mRenderPrimitives;
 
     std::unique_ptr<DFG> mDFG;
 
@@ -404,26 +693,57 @@ private:
     // Per-Renderable Uniform interface block
     UniformInterfaceBlock mPerRenderableUib;
 
+    // Per-instance Uniform interface block, and the buffers used by the instanced draws
+    UniformInterfaceBlock mPerInstanceUib;
+    std::vector<Handle<HwUniformBuffer>> mInstanceUbhs;
+    size_t mInstanceUbhsUsed = 0;
+    Handle<HwUniformBuffer> mDefaultInstanceUbh;
+
+    // entities scheduled by destroyDeferred(), the ones before mDeferredDestroyCurrent are gone
+    std::vector<utils::Entity> mDeferredDestroys;
+    size_t mDeferredDestroyCurrent = 0;
+    std::chrono::nanoseconds mDeferredDestroyBudget = std::chrono::milliseconds(1);
+
     // Per-view Sampler interface block
     SamplerInterfaceBlock mPerViewSib;
 
+    // Per-renderable Sampler interface block, holds the morph targets
+    SamplerInterfaceBlock mPerRenderableSib;
+
     // post-process interface blocks
     UniformInterfaceBlock mPostProcessUib;
     SamplerInterfaceBlock mPostProcessSib;
 
     std::thread mDriverThread;
+    uint32_t mDriverAffinityMask = 0;   // CPUs the driver thread runs on, 0 for any
     CommandBufferQueue mCommandBufferQueue;
     DriverApi mCommandStream;
+    CommandStreamProfiler mCommandStreamProfiler;
+
+    // only accessed by the driver thread, see getDriverBusyTime()
+    std::chrono::steady_clock::time_point mExecuteStart;
+    std::chrono::steady_clock::duration mDriverBusyTime = {};
 
     LinearAllocatorArena mPerRenderPassAllocator;
+    CommandsTracking mCommandsTracking;
     HeapAllocatorArena mHeapAllocator;
 
-    utils::JobSystem mJobSystem;
+    // null when the JobSystem is shared with other Engines
+    std::unique_ptr<utils::JobSystem> mOwnJobSystem;
+    utils::JobSystem& mJobSystem;
+    utils::JobSystem::Job* mPendingCommandsJob = nullptr;
+    bool mPendingCommandsRecorded = false;
+    bool mDeferCommands = false;
 
     Epoch mEpoch;
+    StartupStats mStartupStats;
 
     mutable FMaterial const* mDefaultMaterial = nullptr;
     mutable FMaterial const* mSkyboxMaterials[2] = { nullptr, nullptr };
+    mutable FMaterial const* mDebugViewMaterial = nullptr;
+    mutable FMaterialInstance* mDebugViewMaterialInstances[DEBUG_VIEW_COUNT] = {};
+    mutable FMaterial const* mGpuCullingMaterial = nullptr;
+    mutable FMaterial const* mParticlesMaterial = nullptr;
 
     mutable FTexture* mDefaultIblTexture = nullptr;
     mutable FIndirectLight* mDefaultIbl = nullptr;
@@ -447,6 +767,17 @@ public:
             float dzn = -1.0f;
             float dzf =  1.0f;
         } shadowmap;
+        struct {
+            bool state_sorting = false;
+        } renderpass;
+        struct {
+            bool variant_usage = false;
+        } material;
+        struct {
+            bool overdraw = false;
+            bool froxel_lights = false;
+            bool shadow_density = false;
+        } view;
     } debug;
 };
 
@@ -35,8 +35,12 @@ public:
 
     bool skipFrameNeeded() const noexcept;
 
+    // number of frames the CPU can be ahead of the GPU
+    size_t getLatency() const noexcept { return mLatency; }
+
 private:
     FEngine& mEngine;
+    size_t mLatency;
     mutable std::deque<FFence *> mFences;
     mutable int mExtraSkipCount = 0;
 };
@@ -34,6 +34,9 @@
 #include <math/mat4.h>
 #include <math/vec4.h>
 
+#include <algorithm>
+#include <array>
+#include <limits>
 #include <vector>
 
 namespace filament {
@@ -83,6 +86,10 @@ public:
 // froxels are not used, so we can store more.
 static constexpr size_t FROXEL_BUFFER_ENTRY_COUNT_MAX = 8192;
 
+// Min number of froxels that can be selected with setFroxelCount(), below this the froxels
+// get so large that they don't cull the lights anymore.
+static constexpr size_t FROXEL_BUFFER_ENTRY_COUNT_MIN = 1024;
+
 class Froxelizer {
 public:
     explicit Froxelizer(FEngine& engine);
@@ -98,8 +105,13 @@ public:
 
     void setOptions(float zLightNear, float zLightFar) noexcept;
 
+    // Sets the number of froxels to use, clamped to
+    // [FROXEL_BUFFER_ENTRY_COUNT_MIN, FROXEL_BUFFER_ENTRY_COUNT_MAX].
+    void setFroxelCount(size_t froxelCount) noexcept;
+
     /*
-     * Allocate per-frame data structures for froxelization.
+     * Allocate per-frame data structures for froxelization, and updates the froxels if the
+     * viewport or the projection changed.
      *
      * driverApi         used to allocate memory in the stream
      * arena             use to allocate per-frame memory
@@ -120,6 +132,9 @@ public:
     size_t getFroxelCount() const noexcept { return mFroxelCount; }
 
     // update Records and Froxels texture with lights data. this is thread-safe.
+    // The froxels, the lights and the buffers are kept from one frame to the next: while the
+    // froxels don't change, only the lights that moved (in view-space) are froxelized again,
+    // and only the rows of the buffers that changed are uploaded by commit().
     void froxelizeLights(FEngine& engine, CameraInfo const& camera,
             const FScene::LightSoa& lightData) noexcept;
 
@@ -131,7 +146,7 @@ public:
         u.setUniform(offsetof(FEngine::PerViewUib, oneOverFroxelDimensionY), mOneOverDimension.y);
     }
 
-    // send froxel data to GPU
+    // send the froxel data that changed to the GPU
     void commit(driver::DriverApi& driverApi);
 
 
@@ -160,6 +175,10 @@ public:
     const utils::Slice<FroxelEntry>& getFroxelBufferUser() const { return mFroxelBufferUser; }
     const utils::Slice<RecordBufferType>& getRecordBufferUser() const { return mRecordBufferUser; }
 
+    // The X planes are tested 4 at a time by default, this tests them one at a time instead,
+    // for comparing both paths in benchmarks. The froxels are the same either way.
+    void setVectorizedPlaneTests(bool enabled) noexcept { mVectorizedPlaneTests = enabled; }
+
     // this is chosen so froxelizePointAndSpotLight() vectorizes 4 froxel tests / spotlight
     // with 256 lights this implies 8 jobs (256 / 32) for froxelization.
     using LightGroupType = uint32_t;
@@ -180,6 +199,20 @@ private:
         float radius;
     };
 
+    // a range of froxels or records that changed, [first, last)
+    struct DirtyRange {
+        size_t first = std::numeric_limits<size_t>::max();
+        size_t last = 0;
+        void add(size_t f, size_t l) noexcept {
+            first = std::min(first, f);
+            last = std::max(last, l);
+        }
+        void add(DirtyRange const& r) noexcept {
+            if (!r.empty()) add(r.first, r.last);
+        }
+        bool empty() const noexcept { return first >= last; }
+    };
+
     struct LightTreeNode {
         float min;          // lights z-range min
         float max;          // lights z-range max
@@ -199,10 +232,21 @@ private:
     void setProjection(const math::mat4f& projection, float near, float far) noexcept;
     bool update() noexcept;
 
-    void froxelizeLoop(FEngine& engine,
-            const CameraInfo& camera, const FScene::LightSoa& lightData) noexcept;
+    // froxelizes the lights in [0, lightCount) from mLightParams
+    void froxelizeLoop(utils::JobSystem& js, size_t lightCount) noexcept;
+
+    // removes light 'i' from all the froxels
+    void froxelizeClearLight(size_t i) noexcept;
 
-    void froxelizeAssignRecordsCompress() noexcept;
+    void froxelizeAssignRecordsCompress(utils::JobSystem& js, size_t lightCount) noexcept;
+
+    // Assigns the light records of the froxels in [first, last), starting at 'offset' in the
+    // record buffer, and returns the offset after the last record. Only the record count is
+    // computed, without writing anything, when 'write' is false. Otherwise, the froxels and
+    // the records that changed are added to the dirty ranges.
+    size_t froxelizeAssignRecords(size_t first, size_t last, size_t offset,
+            LightRecord::bitset const& spotLights, bool write,
+            DirtyRange* dirtyFroxels, DirtyRange* dirtyRecords) noexcept;
 
     void froxelizePointAndSpotLight(FroxelThreadData& froxelThread, size_t bit,
             math::mat4f const& projection, const LightParams& light) const noexcept;
@@ -221,10 +265,11 @@ private:
 
     static void computeFroxelLayout(
             math::uint2* dim, uint16_t* countX, uint16_t* countY, uint16_t* countZ,
-            Viewport const& viewport) noexcept;
+            Viewport const& viewport, size_t froxelCount) noexcept;
 
-    // internal state dependant on the viewport and needed for froxelizing
-    LinearAllocatorArena mArena;                    // ~256 KiB
+    // internal state dependant on the viewport and needed for froxelizing, preceded by the
+    // state kept from one frame to the next
+    LinearAllocatorArena mArena;                    // ~608 KiB
 
     float* mDistancesZ = nullptr;                   // max 2.1 MiB (actual: resolution dependant)
     math::float4* mPlanesX = nullptr;
@@ -236,7 +281,13 @@ private:
 
     // max 32 KiB  (actual: resolution dependant)
     utils::Slice<RecordBufferType> mRecordBufferUser;   //  64 KiB
-    utils::Slice<LightRecord> mLightRecords;            // 256 KiB w/ 256 lights
+    utils::Slice<LightRecord> mLightRecords;            // 256 KiB w/ 256 lights, per frame
+
+    // the view-space lights that mFroxelShardedData was computed with
+    std::array<LightParams, CONFIG_MAX_LIGHT_COUNT> mLightParams;   // 9 KiB
+    size_t mLightCount = 0;
+    bool mFroxelsValid = false;     // false when the froxels changed since mFroxelShardedData
+    bool mVectorizedPlaneTests = true;
 
     uint16_t mFroxelCountX = 0;
     uint16_t mFroxelCountY = 0;
@@ -257,9 +308,11 @@ private:
     Viewport mViewport;
     math::float4 mParamsZ = {};
     math::uint3 mParamsF = {};
+    const bool mReversedZ;     // the color pass' depth is reversed
     float mNear = 0.0f;        // camera near
     float mZLightFar = FEngine::CONFIG_Z_LIGHT_FAR;
     float mZLightNear = FEngine::CONFIG_Z_LIGHT_NEAR;  // light near (first slice)
+    uint16_t mFroxelCountMax = FROXEL_BUFFER_ENTRY_COUNT_MAX;  // as set by setFroxelCount()
 
     // track if we need to update our internal state before froxelizing
     uint8_t mDirtyFlags = 0;
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_GPUCULLER_H
+#define TNT_FILAMENT_DETAILS_GPUCULLER_H
+
+#include "RenderPass.h"
+
+#include "details/Scene.h"
+
+#include "driver/Handle.h"
+
+#include <utils/compiler.h>
+#include <utils/Range.h>
+#include <utils/Slice.h>
+
+#include <math/mat4.h>
+#include <math/vec4.h>
+
+#include <vector>
+
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+class FEngine;
+class FMaterialInstance;
+class OcclusionCuller;
+
+/*
+ * Occlusion culling of the commands of a pass, done by a compute program (see gpuCulling.mat),
+ * the commands are then drawn with drawIndirect(). The commands are frustum culled on the CPU
+ * beforehand, like without GPU culling.
+ *
+ * Each primitive of each renderable has a slot, which holds the bounds of the renderable and
+ * the index range of the primitive. The program tests the bounds of each slot and writes its
+ * Driver::DrawIndirectCommand, with no instance if the slot is culled. A renderable keeps its
+ * slots from one frame to the next, regardless of the order of the commands, and only the range
+ * of slots that changed since the previous frame is uploaded, so static scenes upload nothing.
+ *
+ * The occluders are tested against the depth buffer of the view's OcclusionCuller, which is
+ * rasterized on the CPU and uploaded with all its levels (compute programs can't sample
+ * textures yet).
+ */
+class GpuCuller {
+public:
+    // std430 layout of gpuCulling.mat's Draw
+    struct Draw {
+        math::float4 center;        // w unused
+        math::float4 extent;        // w unused
+        uint32_t indexCount;
+        uint32_t firstIndex;
+        uint32_t culling;           // 0 if the renderable is never culled
+        uint32_t reserved;
+    };
+    static_assert(sizeof(Draw) == 48, "Draw must match gpuCulling.mat");
+
+    GpuCuller() noexcept;
+    GpuCuller(GpuCuller const& rhs) = delete;
+    GpuCuller& operator=(GpuCuller const& rhs) = delete;
+    ~GpuCuller() noexcept;
+
+    void terminate(FEngine& engine);
+
+    // whether the backend can run the culling program
+    static bool isSupported(FEngine& engine) noexcept;
+
+    // sets what the commands are culled against, 'occlusionCuller' is null when occlusion
+    // culling is disabled (or there are no occluders), then there is nothing to cull
+    void prepare(OcclusionCuller const* occlusionCuller) noexcept;
+
+    // Assigns a slot to the commands that aren't instanced, uploads the slots that changed and
+    // dispatches the culling program, which writes getIndirectBuffer(). This must be called
+    // outside of a render pass. Returns false if the commands must be drawn directly instead,
+    // e.g. when there are no occluders or the program couldn't be created.
+    bool cull(FEngine& engine, FScene::RenderableSoa const& soa, utils::Range<uint32_t> vr,
+            utils::Slice<RenderPass::Command> commands,
+            RenderPass::InstancedDraw const* instancedDraws) noexcept;
+
+    Handle<HwStorageBuffer> getIndirectBuffer() const noexcept { return mIndirectSbh; }
+
+private:
+    // the slots of the primitives of a renderable instance
+    struct SlotRange {
+        uint32_t first = 0;
+        uint32_t count = 0;
+    };
+
+    // assigns slots to the primitives of the renderables of 'vr' that don't have enough
+    void allocateSlots(FScene::RenderableSoa const& soa, utils::Range<uint32_t> vr) noexcept;
+
+    // grows the buffers so that they can hold 'count' slots
+    void reserve(FEngine& engine, uint32_t count) noexcept;
+
+    // uploads the slots of 'draws' that differ from what the draws buffer holds
+    void updateDraws(FEngine& engine, std::vector<Draw> const& draws) noexcept;
+
+    void updateDepth(FEngine& engine) noexcept;
+
+    FMaterialInstance* mMaterialInstance = nullptr;
+    Handle<HwStorageBuffer> mDrawsSbh;
+    Handle<HwStorageBuffer> mIndirectSbh;
+    Handle<HwStorageBuffer> mDepthSbh;
+    uint32_t mCapacity = 0;                 // in slots
+
+    OcclusionCuller const* mOcclusionCuller = nullptr;
+
+    // slots of each renderable, indexed by renderable instance
+    std::vector<SlotRange> mSlots;
+    uint32_t mSlotCount = 0;
+
+    // content of the draws buffer, indexed by slot
+    std::vector<Draw> mUploadedDraws;
+
+    // scratch, kept from one frame to the next to avoid allocations
+    std::vector<Draw> mDraws;
+    std::vector<uint32_t> mSoaIndices;      // indexed by renderable instance
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_GPUCULLER_H
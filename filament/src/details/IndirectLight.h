@@ -31,6 +31,7 @@ namespace filament {
 namespace details {
 
 class FEngine;
+class FTexture;
 
 class FIndirectLight : public IndirectLight {
 public:
@@ -38,17 +39,24 @@ public:
 
     FIndirectLight(FEngine& engine, const Builder& builder) noexcept;
 
+    static void prefilterReflections(FEngine& engine, FTexture const* environment,
+            FTexture const* reflections, uint32_t sampleCount) noexcept;
+    static void computeIrradianceSH(FEngine& engine, FTexture const* environment,
+            driver::PixelBufferDescriptor&& sh) noexcept;
+    static void generateDFG(FEngine& engine, FTexture const* dfg, uint32_t sampleCount) noexcept;
+
     void terminate(FEngine& engine);
 
     Handle<HwTexture> getReflectionMap() const noexcept { return mReflectionsMapHandle; }
     Handle<HwTexture> getIrradianceMap() const noexcept { return mIrradianceMapHandle; }
     math::float3 const* getSH() const noexcept{ return mIrradianceCoefs.data(); }
     float getIntensity() const noexcept { return mIntensity; }
-    void setIntensity(float intensity) noexcept { mIntensity = intensity; }
-    void setRotation(math::mat3f const& rotation) noexcept { mRotation = rotation; }
+    void setIntensity(float intensity) noexcept;
+    void setRotation(math::mat3f const& rotation) noexcept;
     const math::mat3f& getRotation() const { return mRotation; }
 
 private:
+    FEngine& mEngine;
     Handle<HwTexture> mReflectionsMapHandle;
     Handle<HwTexture> mIrradianceMapHandle;
     std::array<math::float3, 9> mIrradianceCoefs;
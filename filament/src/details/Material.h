@@ -28,6 +28,10 @@
 #include <filaflat/ShaderBuilder.h>
 
 #include <utils/compiler.h>
+#include <utils/JobSystem.h>
+#include <utils/Mutex.h>
+
+#include <memory>
 
 
 namespace filaflat {
@@ -35,6 +39,9 @@ namespace filaflat {
 }
 
 namespace filament {
+
+class Program;
+
 namespace details {
 
 class  FEngine;
@@ -58,6 +65,11 @@ public:
         return mUniformInterfaceBlock;
     }
 
+    // return the layout of the parameters set at draw time, empty if the material has none
+    const UniformInterfaceBlock& getPushConstantBlock() const noexcept {
+        return mPushConstantBlock;
+    }
+
     // return the uniform interface block for this material
     const SamplerInterfaceBlock& getSamplerInterfaceBlock() const noexcept {
         return mSamplerInterfaceBlock;
@@ -71,8 +83,18 @@ public:
     FMaterialInstance const* getDefaultInstance() const noexcept { return &mDefaultInstance; }
     FMaterialInstance* getDefaultInstance() noexcept { return &mDefaultInstance; }
 
+    // When the depth variants are shared with the default material (i.e. there is no custom
+    // depth shader), the default material's instance, which can replace any of our instances
+    // in the depth and shadow passes. Null otherwise.
+    FMaterialInstance const* getSharedDepthInstance() const noexcept {
+        return mSharedDepthInstance;
+    }
+
     FEngine& getEngine() const noexcept  { return mEngine; }
 
+    // Creates the programs of all the variants using the given subset of Variant bits
+    void compile(uint8_t features) const noexcept;
+
     Handle<HwProgram> getProgramSlow(uint8_t variantKey) const noexcept;
     Handle<HwProgram> getProgram(uint8_t variantKey) const noexcept {
 
@@ -83,6 +105,23 @@ public:
         return UTILS_LIKELY(entry) ? entry : getProgramSlow(variantKey);
     }
 
+    // Must be called on the engine's thread before getProgramOrFallback(). If the program of
+    // this variant doesn't exist yet, its shaders are built by a job running on the JobSystem
+    // and the program is created by a later call, once they're ready.
+    void prepareProgram(uint8_t variantKey) const noexcept;
+
+    // Returns the program of this variant if it exists, otherwise the program of the closest
+    // variant that does (i.e. the one with the most features, but only those of this variant),
+    // or a null handle. This doesn't create programs and can be used from any thread.
+    Handle<HwProgram> getProgramOrFallback(uint8_t variantKey) const noexcept {
+        Handle<HwProgram> const entry = mCachedPrograms[variantKey];
+        return UTILS_LIKELY(entry) ? entry : getFallbackProgram(variantKey);
+    }
+
+    // Returns the program of the compute shader of this material, built on first use, or a
+    // null handle if the material doesn't have one or the backend doesn't support compute.
+    Handle<HwProgram> getComputeProgram() const noexcept;
+
     bool isVariantLit() const noexcept { return mIsVariantLit; }
 
     const utils::CString& getName() const noexcept { return mName; }
@@ -103,19 +142,38 @@ public:
     bool isDoubleSided() const noexcept { return mDoubleSided; }
     float getMaskThreshold() const noexcept { return mMaskTreshold; }
     bool hasShadowMultiplier() const noexcept { return mHasShadowMultiplier; }
+    // whether the shaders used on this platform read the textures through bindless handles
+    bool hasBindlessSamplers() const noexcept { return mHasBindlessSamplers; }
     AttributeBitset getRequiredAttributes() const noexcept { return mRequiredAttributes; }
 
     size_t getParameterCount() const noexcept {
         return mUniformInterfaceBlock.getUniformInfoList().size() +
+                mPushConstantBlock.getUniformInfoList().size() +
                 mSamplerInterfaceBlock.getSamplerInfoList().size();
     }
     size_t getParameters(ParameterInfo* parameters, size_t count) const noexcept;
 
     uint32_t generateMaterialInstanceId() const noexcept { return mMaterialInstanceId++; }
 
+    // Logs how many times each variant was prepared for drawing while the
+    // "d.material.variant_usage" debug property was set, and the matc variant filter that
+    // removes the variants that were never used.
+    void dumpVariantUsage() const noexcept;
+
 private:
+    struct PendingProgram;
+
+    Handle<HwProgram> getFallbackProgram(uint8_t variantKey) const noexcept;
+    Program makeProgram(uint8_t variantKey,
+            filaflat::ShaderBuilder const& vsBuilder,
+            filaflat::ShaderBuilder const& fsBuilder) const noexcept;
+    static void setProgramShader(Program& program, Program::Shader shader,
+            filaflat::ShaderBuilder const& builder) noexcept;
+
     // try to order by frequency of use
     mutable std::array<Handle<HwProgram>, VARIANT_COUNT> mCachedPrograms;
+    mutable Handle<HwProgram> mComputeProgram;
+    mutable bool mHasComputeShader = true; // until we know better
     Driver::RasterState mRasterState;
     Shading mShading;
     bool mIsVariantLit;
@@ -128,12 +186,15 @@ private:
     CullingMode mCullingMode;
     float mMaskTreshold;
     bool mHasShadowMultiplier = false;
+    bool mHasBindlessSamplers = false;
     bool mHasCustomDepthShader = false;
     bool mIsDefaultMaterial = false;
+    FMaterialInstance const* mSharedDepthInstance = nullptr;
 
     FMaterialInstance mDefaultInstance;
     SamplerInterfaceBlock mSamplerInterfaceBlock;
     UniformInterfaceBlock mUniformInterfaceBlock;
+    UniformInterfaceBlock mPushConstantBlock;
     SamplerBindingMap mSamplerBindings;
 
     utils::CString mName;
@@ -141,6 +202,15 @@ private:
     const uint32_t mMaterialId;
     mutable uint32_t mMaterialInstanceId = 0;
     filaflat::MaterialParser* mMaterialParser = nullptr;
+
+    // the parser is used by the jobs building the shaders and by the engine's thread
+    mutable utils::Mutex mParserLock;
+    // the job building the shaders in the background is a child of this one
+    mutable utils::JobSystem::Job* mPendingProgramsJob = nullptr;
+    mutable std::array<std::unique_ptr<PendingProgram>, VARIANT_COUNT> mPendingPrograms;
+
+    // number of prepareProgram() calls per variant, only counted when requested
+    mutable std::array<uint32_t, VARIANT_COUNT> mVariantUsage = {};
 };
 
 
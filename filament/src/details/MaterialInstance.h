@@ -42,8 +42,11 @@ public:
 
     void terminate(FEngine& engine);
 
+    // called by FEngine::prepare() for the instances that were marked dirty
     void commit(FEngine& engine) const {
-        if (UTILS_UNLIKELY(mUniforms.isDirty() || mSamplers.isDirty())) {
+        mIsDirty = false;
+        if (UTILS_UNLIKELY(mUniforms.isDirty() || mSamplers.isDirty() ||
+                mPushConstants.isDirty() || (mIsSharable && !mShared))) {
             commitSlow(engine);
         }
     }
@@ -55,6 +58,9 @@ public:
         if (mSbHandle) {
             driver.bindSamplers(BindingPoints::PER_MATERIAL_INSTANCE, mSbHandle);
         }
+        if (UTILS_UNLIKELY(mCommittedPushConstants.getSize())) {
+            setPushConstants(driver);
+        }
         driver.setViewportScissor(
                 mScissorRect[0], mScissorRect[1],
                 uint32_t(mScissorRect[2]), uint32_t(mScissorRect[3]));
@@ -73,8 +79,22 @@ public:
 
     uint64_t getSortingKey() const noexcept { return mMaterialSortingKey; }
 
+    // sorting key grouping the instances that use the same textures, see STATE_SORTING
+    uint64_t getStateSortingKey() const noexcept { return mMaterialStateSortingKey; }
+
     SamplerBuffer const& getSamplerBuffer() const noexcept { return mSamplers; }
 
+    // for the passes that don't draw, e.g. compute dispatches, where use() can't be called
+    Handle<HwUniformBuffer> getUniformBuffer() const noexcept { return mUbHandle; }
+
+    // The instance drawn in place of this one. The instances with the same parameters share the
+    // buffers of an instance owned by the engine, their commands all use it so that they're
+    // sorted and batched together (the scissor is set by the material instance, so it must be
+    // honored).
+    FMaterialInstance const* getBatchInstance() const noexcept {
+        return (mShared && !hasScissor()) ? mShared : this;
+    }
+
     void setScissor(int32_t left, int32_t bottom, uint32_t width, uint32_t height) noexcept {
         mScissorRect[0] = left;
         mScissorRect[1] = bottom;
@@ -87,6 +107,11 @@ public:
         mScissorRect[2] = mScissorRect[3] = std::numeric_limits<int32_t>::max();
     }
 
+    bool hasScissor() const noexcept {
+        return (mScissorRect[0] | mScissorRect[1]) ||
+               (mScissorRect[2] & mScissorRect[3]) != std::numeric_limits<int32_t>::max();
+    }
+
 private:
     friend class FMaterial;
     friend class MaterialInstance;
@@ -95,16 +120,36 @@ private:
     void initDefaultInstance(FEngine& engine, FMaterial const* material);
 
     void commitSlow(FEngine& engine) const;
+    void upload(FEngine::DriverApi& driver) const;
+    void share(FEngine& engine);
+    void createBuffers(FEngine::DriverApi& driver);
+    void releaseBuffers(FEngine& engine);
+    uint64_t hashParameters() const noexcept;
+    bool hasSameParameters(FMaterialInstance const& rhs) const noexcept;
+    void setPushConstants(FEngine::DriverApi& driver) const;
+    void markDirty() noexcept;
+    void updateStateSortingKey() const noexcept;
 
     // keep these grouped, they're accessed together in the render-loop
     FMaterial const* mMaterial = nullptr;
-    Handle<HwUniformBuffer> mUbHandle;
+    Handle<HwUniformBuffer> mUbHandle;      // borrowed from mShared if set
     Handle<HwSamplerBuffer> mSbHandle;
 
     UniformBuffer mUniforms;
     SamplerBuffer mSamplers;
+    UniformBuffer mPushConstants;   // never uploaded, copied by commit() and sent by use()
+    mutable UniformBuffer mCommittedPushConstants;  // read by use(), possibly from a job
 
     uint64_t mMaterialSortingKey = 0;
+    mutable uint64_t mMaterialStateSortingKey = 0;  // updated when the samplers are committed
+    mutable bool mIsDirty = false;      // in the engine's list of instances to commit
+
+    // the instances without push constants share their buffers with the instances that have
+    // the same parameters, see share()
+    bool mIsSharable = false;
+    FMaterialInstance* mShared = nullptr;   // the engine's instance owning the buffers
+    uint64_t mShareKey = 0;                 // of the engine's instances, hash of the parameters
+    uint32_t mShareCount = 0;               // of the engine's instances, number of users
 
     // Scissor rectangle is specified as: Left Bottom Width Height.
     int32_t mScissorRect[4] = {
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_MORPHTARGETBUFFER_H
+#define TNT_FILAMENT_DETAILS_MORPHTARGETBUFFER_H
+
+#include "upcast.h"
+
+#include "driver/Handle.h"
+
+#include <filament/MorphTargetBuffer.h>
+
+#include <utils/compiler.h>
+
+namespace filament {
+namespace details {
+
+class FEngine;
+
+/*
+ * The deltas are stored in two RGBA32F textures (positions and normals), read in the vertex
+ * shader with texelFetch() by vertex index. Each target occupies mRowsPerTarget rows of
+ * mWidth texels, target t starts at row t * mRowsPerTarget.
+ */
+class FMorphTargetBuffer : public MorphTargetBuffer {
+public:
+    // texture width limit, widths of 2048 are supported everywhere
+    static constexpr uint32_t MAX_WIDTH = 2048;
+
+    FMorphTargetBuffer(FEngine& engine, const Builder& builder);
+
+    // frees driver resources, object becomes invalid
+    void terminate(FEngine& engine);
+
+    void setPositionsAt(FEngine& engine, size_t targetIndex,
+            math::float3 const* positions, size_t count);
+
+    void setNormalsAt(FEngine& engine, size_t targetIndex,
+            math::float3 const* normals, size_t count);
+
+    size_t getVertexCount() const noexcept { return mVertexCount; }
+    size_t getCount() const noexcept { return mCount; }
+
+    Handle<HwSamplerBuffer> getHwHandle() const noexcept { return mSbHandle; }
+
+private:
+    friend class MorphTargetBuffer;
+
+    void upload(FEngine& engine, Handle<HwTexture> texture, size_t targetIndex,
+            math::float3 const* deltas, size_t count);
+
+    Handle<HwTexture> mPositionsHandle;
+    Handle<HwTexture> mNormalsHandle;
+    Handle<HwSamplerBuffer> mSbHandle;
+    uint32_t mVertexCount;
+    uint32_t mCount;
+    uint32_t mWidth;
+    uint32_t mRowsPerTarget;
+};
+
+FILAMENT_UPCAST(MorphTargetBuffer)
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_MORPHTARGETBUFFER_H
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
+#define TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
+
+#include "details/Culler.h"
+
+#include <utils/compiler.h>
+
+#include <math/mat4.h>
+#include <math/vec3.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * Occlusion culling using a low resolution hierarchical depth buffer (Hi-Z).
+ *
+ * The depth buffer is rasterized on the CPU from the bounding boxes of the renderables flagged
+ * as occluders, which are assumed to be solid. Then a mip chain keeping the farthest depth of
+ * each 2x2 block is built, and renderables are tested against the level where their screen
+ * footprint covers only a few texels.
+ *
+ * The test is conservative: occluders only cover the pixels entirely inside their silhouette
+ * and are rasterized at their farthest depth.
+ *
+ * Depths are in NDC, i.e. larger values are farther from the camera.
+ */
+class OcclusionCuller {
+public:
+    // size of the level 0 of the depth buffer
+    static constexpr uint32_t WIDTH  = 256;
+    static constexpr uint32_t HEIGHT = 128;
+    static constexpr size_t LEVEL_COUNT = 9; // down to 1x1
+
+    OcclusionCuller() noexcept;
+    OcclusionCuller(OcclusionCuller const& rhs) = delete;
+    OcclusionCuller& operator=(OcclusionCuller const& rhs) = delete;
+
+    // starts a new frame, clears the depth buffer
+    void prepare(math::mat4f const& clipFromWorld) noexcept;
+
+    // rasterizes an occluder in the depth buffer, from its world-space bounding box
+    void rasterize(math::float3 const& center, math::float3 const& extent) noexcept;
+
+    // rasterizes an occluder in the depth buffer, from its local bounding box, which fits it
+    // more tightly than its world-space bounding box once rotated
+    void rasterize(math::mat4f const& worldFromLocal,
+            math::float3 const& center, math::float3 const& extent) noexcept;
+
+    // builds the mip chain, must be called after all occluders are rasterized
+    void buildHierarchy() noexcept;
+
+    // returns whether the box is entirely hidden by the occluders
+    bool isOccluded(math::float3 const& center, math::float3 const& extent) const noexcept;
+
+    // clears 'bit' in 'results' for the boxes that are occluded
+    void cull(Culler::result_type* results,
+            math::float3 const* center, math::float3 const* extent,
+            size_t count, size_t bit) const noexcept;
+
+    // whether any occluder was rasterized since prepare()
+    bool hasOccluders() const noexcept { return mHasOccluders; }
+
+    // the matrix given to prepare()
+    math::mat4f const& getClipFromWorld() const noexcept { return mClipFromWorld; }
+
+    // all the levels of the depth buffer, one after the other, valid after buildHierarchy()
+    float const* getDepthBuffer() const noexcept { return mDepth.data(); }
+    size_t getDepthBufferSize() const noexcept { return mDepth.size(); }   // in floats
+
+private:
+    // projects the 8 corners of a box in screen space, returns false if the box crosses the
+    // camera plane
+    bool project(math::float3 const& center, math::float3 const& extent,
+            math::float3 corners[8]) const noexcept {
+        return project(mClipFromWorld, center, extent, corners);
+    }
+    static bool project(math::mat4f const& clipFromBox,
+            math::float3 const& center, math::float3 const& extent,
+            math::float3 corners[8]) noexcept;
+
+    void rasterize(math::float3 const corners[8]) noexcept;
+
+    float* level(size_t i) noexcept { return mDepth.data() + mLevelOffset[i]; }
+    float const* level(size_t i) const noexcept { return mDepth.data() + mLevelOffset[i]; }
+
+    static uint32_t width(size_t i) noexcept { return std::max(1u, WIDTH >> i); }
+    static uint32_t height(size_t i) noexcept { return std::max(1u, HEIGHT >> i); }
+
+    math::mat4f mClipFromWorld;
+    std::vector<float> mDepth;
+    uint32_t mLevelOffset[LEVEL_COUNT];
+    bool mHasOccluders = false;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
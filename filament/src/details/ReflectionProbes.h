@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_REFLECTIONPROBES_H
+#define TNT_FILAMENT_DETAILS_REFLECTIONPROBES_H
+
+#include "driver/DriverApiForward.h"
+#include "driver/Handle.h"
+#include "driver/SamplerBuffer.h"
+#include "driver/UniformBuffer.h"
+
+#include <filament/Box.h>
+#include <filament/EngineEnums.h>
+
+#include <math/mat4.h>
+#include <math/vec3.h>
+
+#include <array>
+
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+class FEngine;
+class FTexture;
+
+/*
+ * The local reflection probes of a scene, their prefiltered reflections packed in a single
+ * texture.
+ *
+ * Each probe is an environment cubemap captured by the application at a position, and the box
+ * it reflects (e.g. a room), which corrects the reflections for their parallax. The cubemap is
+ * prefiltered into an octahedral tile of the atlas, one level per frame so that the cost of a
+ * frame stays bounded. A probe is used once all its levels are prefiltered.
+ *
+ * A probe becomes stale when something changes inside its box. The engine can't capture it
+ * again, the application does it when it sees fit, and calls invalidate() (or set() with a new
+ * cubemap) to prefilter it again.
+ */
+class ReflectionProbes {
+public:
+    // dimensions of the atlas texture, in texels
+    static constexpr uint32_t ATLAS_WIDTH =
+            CONFIG_REFLECTION_PROBE_SIZE * CONFIG_REFLECTION_PROBE_ATLAS_COLUMNS;
+    static constexpr uint32_t ATLAS_HEIGHT = CONFIG_REFLECTION_PROBE_SIZE *
+            (CONFIG_MAX_REFLECTION_PROBES / CONFIG_REFLECTION_PROBE_ATLAS_COLUMNS);
+
+    // samples of the two sharpest levels, it doubles at each of the next ones
+    static constexpr uint32_t SAMPLE_COUNT = 32;
+
+    ReflectionProbes() noexcept;
+
+    void terminate(driver::DriverApi& driver) noexcept;
+
+    // The environment must be a cubemap with all its levels, the box and position are in
+    // world space (without the world origin).
+    void set(size_t index, FTexture const* environment,
+            math::float3 const& position, Box const& box) noexcept;
+    void remove(size_t index) noexcept;
+    void invalidate(size_t index) noexcept;
+
+    // Bitmask of the probes whose box changed since they were last set or invalidated.
+    uint32_t getStaleProbes() const noexcept { return mStaleProbes; }
+
+    // Marks the probes whose box intersects the damage of the scene (see FScene::getDamage())
+    // as stale. Both are in the space of the world origin, see FScene::prepare().
+    void update(Aabb const& damage, bool damageUnbounded,
+            math::mat4f const& worldOriginTransform) noexcept;
+
+    // Returns 1 + the index of the probe whose box is the smallest to contain the point (in the
+    // space of the world origin), or 0 if there isn't any. Valid after calling update().
+    uint32_t select(math::float3 const& position) const noexcept;
+
+    // Whether some probes are in use. Valid after calling update().
+    bool hasProbes() const noexcept { return mReadyProbes != 0; }
+
+    // Prefilters a level of a probe, outside of a render pass. Returns whether it did.
+    bool prefilter(FEngine& engine) noexcept;
+
+    // Whether some levels are left to prefilter.
+    bool isPrefilterPending() const noexcept;
+
+    // Sets the uniforms of the probes and binds the atlas to 'index' of the sampler buffer.
+    void prepare(UniformBuffer& u, SamplerBuffer& sb, size_t index) const noexcept;
+
+private:
+    struct Probe {
+        FTexture const* environment = nullptr;
+        math::float3 position = {};
+        Aabb box;
+        float volume = 0.0f;
+        uint32_t pendingLevels = 0;     // bitmask of the levels to prefilter
+    };
+
+    std::array<Probe, CONFIG_MAX_REFLECTION_PROBES> mProbes;
+    uint32_t mReadyProbes = 0;          // bitmask of the probes with all their levels
+    uint32_t mStaleProbes = 0;
+    size_t mNextProbe = 0;              // the probes take turns to be prefiltered
+    math::mat4f mProbesFromWorld;       // inverse of the world origin
+
+    // set-up in prefilter()
+    Handle<HwTexture> mAtlasHandle;
+    std::array<Handle<HwRenderTarget>, CONFIG_REFLECTION_PROBE_LEVELS> mAtlasRenderTargets;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_REFLECTIONPROBES_H
@@ -20,6 +20,7 @@
 #include "components/RenderableManager.h"
 
 #include "details/MaterialInstance.h"
+#include "details/VertexBuffer.h"
 
 #include "driver/Handle.h"
 
@@ -37,7 +38,7 @@ class FRenderPrimitive {
 public:
     FRenderPrimitive() noexcept = default;
 
-    void init(driver::DriverApi& driver, const RenderableManager::Builder::Entry& entry) noexcept;
+    void init(FEngine& engine, const RenderableManager::Builder::Entry& entry) noexcept;
 
     void set(FEngine& engine, RenderableManager::PrimitiveType type,
             FVertexBuffer* vertices, FIndexBuffer* indices, size_t offset,
@@ -46,7 +47,7 @@ public:
     void set(FEngine& engine, RenderableManager::PrimitiveType type,
             size_t offset, size_t minIndex, size_t maxIndex, size_t count) noexcept;
 
-    // frees driver resources, object becomes invalid
+    // releases the shared HwRenderPrimitive, object becomes invalid
     void terminate(FEngine& engine);
 
     const FMaterialInstance* getMaterialInstance() const noexcept { return mMaterialInstance; }
@@ -54,6 +55,14 @@ public:
     driver::PrimitiveType getPrimitiveType() const noexcept { return mPrimitiveType; }
     AttributeBitset getEnabledAttributes() const noexcept { return mEnabledAttributes; }
     uint16_t getBlendOrder() const noexcept { return mBlendOrder; }
+    uint32_t getMinIndex() const noexcept { return mMinIndex; }
+    uint32_t getMaxIndex() const noexcept { return mMaxIndex; }
+    // range of the index buffer drawn, in indices
+    uint32_t getIndexOffset() const noexcept { return mIndexOffset; }
+    uint32_t getIndexCount() const noexcept { return mIndexCount; }
+
+    // whether all the vertices used by this primitive are resident, see FVertexBuffer
+    inline bool isResident() const noexcept;
 
     void setMaterialInstance(FMaterialInstance const* mi) noexcept { mMaterialInstance = mi; }
     void setBlendOrder(uint16_t order) noexcept {
@@ -61,13 +70,31 @@ public:
     }
 
 private:
+    FEngine::RenderPrimitiveKey getKey() const noexcept {
+        return { mVertexBuffer, mIndexBuffer, uint32_t(mEnabledAttributes.getValue()),
+                 mPrimitiveType, mIndexOffset, mMinIndex, mMaxIndex, mIndexCount };
+    }
+
     FMaterialInstance const* mMaterialInstance = nullptr;
-    Handle<HwRenderPrimitive> mHandle;
+    // only set if the vertex buffer is streaming
+    FVertexBuffer const* mStreamingVertices = nullptr;
+    Handle<HwRenderPrimitive> mHandle;      // shared, see FEngine::acquireRenderPrimitive()
+    Handle<HwVertexBuffer> mVertexBuffer;
+    Handle<HwIndexBuffer> mIndexBuffer;
     driver::PrimitiveType mPrimitiveType = driver::PrimitiveType::NONE;
     AttributeBitset mEnabledAttributes;
     uint16_t mBlendOrder = 0;
+    uint32_t mMinIndex = 0;
+    uint32_t mMaxIndex = 0;
+    uint32_t mIndexOffset = 0;
+    uint32_t mIndexCount = 0;
 };
 
+bool FRenderPrimitive::isResident() const noexcept {
+    return !mStreamingVertices ||
+           mStreamingVertices->isResident(mMinIndex, mMaxIndex - mMinIndex + 1);
+}
+
 } // namespace details
 } // namespace filament
 
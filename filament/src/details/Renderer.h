@@ -34,8 +34,12 @@
 
 #include <utils/compiler.h>
 #include <utils/Allocator.h>
+#include <utils/CString.h>
 #include <utils/Slice.h>
 
+#include <chrono>
+#include <memory>
+
 namespace filament {
 
 class Driver;
@@ -44,8 +48,10 @@ class View;
 namespace details {
 
 class FEngine;
+class FScene;
 class FView;
 class ShadowMap;
+class ShadowAtlas;
 
 /*
  * A concrete implementation of the Renderer Interface.
@@ -63,9 +69,40 @@ public:
     void render(FView const* view);
     void renderJob(ArenaScope& arena, FView* view);
 
-    bool beginFrame(FSwapChain* swapChain);
+    bool beginFrame(FSwapChain* swapChain, uint64_t vsyncSteadyClockTimeNano = 0);
     void endFrame();
 
+    void setFramePipelining(bool enabled) noexcept;
+    bool isFramePipeliningEnabled() const noexcept { return mFramePipelining; }
+
+    // the per-renderpass arenas used when frame pipelining is enabled, see getMemoryStats()
+    LinearAllocatorArena const* getPipelinedArena(size_t index) const noexcept {
+        return mPipelinedArenas[index].get();
+    }
+
+    void setFrameStatsCallback(FrameStatsCallback callback, void* user) noexcept {
+        mFrameStats.setCallback(callback, user);
+    }
+
+    void setFrameStatsCounters(bool enabled) noexcept {
+        mFrameStats.setCountersEnabled(enabled);
+    }
+
+    void setFrameStatsGpuPasses(bool enabled) noexcept {
+        mFrameStats.setGpuPassesEnabled(enabled);
+    }
+
+    RenderStats getRenderStats() const noexcept;
+
+    bool needsRedraw() const noexcept;
+
+    void setPartialUpdate(bool enabled) noexcept { mPartialUpdate = enabled; }
+    bool isPartialUpdateEnabled() const noexcept { return mPartialUpdate; }
+
+    void captureFrame(const char* path) noexcept {
+        mCapturePath = utils::CString(path);
+    }
+
     void readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
             driver::PixelBufferDescriptor&& buffer);
 
@@ -75,46 +112,89 @@ public:
 private:
     using Command = RenderPass::Command;
 
+    void renderPipelined(FView* view);
+
+    // called by renderJob() once the components of the view's scene aren't read anymore
+    void snapshotTaken(FView* view) noexcept;
+
+    // ignores the content changes made by the renderer, at the end of render()
+    void renderDone() noexcept;
+
+    void endFrameStats(driver::DriverApi& driver) noexcept;
+    void countRenderables(FView const* view) noexcept;
+    void updateVsync(uint64_t vsync) noexcept;
+    void setFrameDamage(driver::DriverApi& driver, FView const* view, Viewport const& vp,
+            bool hasPostProcess) noexcept;
+
+    // The transparent surfaces accumulated by the color pass, see View::setOrderIndependentTransparency()
+    struct AccumulationTarget {
+        Handle<HwRenderTarget> target;
+        Handle<HwTexture> color;    // RGBA16F, sum of the weighted colors and product of (1-alpha)
+        Handle<HwTexture> weights;  // R16F, sum of the weights
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
+
+    // returns the accumulation target, (re)created if it's smaller than width x height
+    AccumulationTarget const* getAccumulationTarget(driver::DriverApi& driver,
+            uint32_t width, uint32_t height) noexcept;
+    void destroyAccumulationTarget(driver::DriverApi& driver) noexcept;
+
     // this class is defined in RenderPass.cpp
     class ColorPass final : public RenderPass {
         using DriverApi = driver::DriverApi;
+        FEngine& engine;
         utils::JobSystem& js;
-        utils::JobSystem::Job* jobFroxelize = nullptr;
         FView* const view;
         Handle<HwRenderTarget> const rth;
+        AccumulationTarget const* const accumulation;
+        const uint8_t discardStart;
+        const uint8_t discardEnd;
+        const bool reversedZ;
         void beginRenderPass(driver::DriverApi& driver, Viewport const& viewport, const CameraInfo& camera) noexcept override;
         void endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept override;
+        void beginAccumulationPass(DriverApi& driver, Viewport const& viewport) noexcept override;
+        void endAccumulationPass(DriverApi& driver, Viewport const& viewport) noexcept override;
     public:
-        ColorPass(const char* name, utils::JobSystem& js, utils::JobSystem::Job* jobFroxelize,
-                FView* view, Handle<HwRenderTarget> rth);
+        ColorPass(const char* name, FEngine& engine, utils::JobSystem& js,
+                FView* view, Handle<HwRenderTarget> rth, driver::RenderPassParams const& discard,
+                AccumulationTarget const* accumulation, bool reversedZ);
+        // only the discardStart and discardEnd fields of 'discard' are used
+        // 'accumulation' is null unless the transparent surfaces are accumulated
         static void renderColorPass(FEngine& engine, utils::JobSystem& js,
-                Handle<HwRenderTarget> rth,
+                Handle<HwRenderTarget> rth, driver::RenderPassParams const& discard,
                 FView* view, Viewport const& scaledViewport,
-                utils::GrowingSlice<Command>& commands) noexcept;
+                AccumulationTarget const* accumulation,
+                utils::GrowingSlice<Command>& commands, ArenaScope& arena) noexcept;
     };
 
     // this class is defined in RenderPass.cpp
     class ShadowPass final : public RenderPass {
         using DriverApi = driver::DriverApi;
-        ShadowMap const& shadowMap;
+        // a shadow pass renders either a cascade of the shadow map or a tile of the atlas
+        ShadowMap const* const shadowMap;
+        ShadowAtlas const* const shadowAtlas;
+        const size_t index;
+        const bool staticCache;     // renders the static casters in the shadow map's cache
         void beginRenderPass(driver::DriverApi& driver, Viewport const& viewport, const CameraInfo& camera) noexcept override;
         void endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept override;
     public:
-        ShadowPass(const char* name, ShadowMap const& shadowMap) noexcept;
+        ShadowPass(const char* name, ShadowMap const& shadowMap, size_t cascade,
+                bool staticCache = false) noexcept;
+        ShadowPass(const char* name, ShadowAtlas const& shadowAtlas, size_t shadow) noexcept;
         static void renderShadowMap(FEngine& engine, utils::JobSystem& js,
-                FView* view, utils::GrowingSlice<Command>& commands) noexcept;
+                FView* view, utils::GrowingSlice<Command>& commands, ArenaScope& arena) noexcept;
     };
 
     Handle<HwRenderTarget> getRenderTarget() const noexcept { return mRenderTarget; }
 
-    void recordHighWatermark(utils::Slice<Command> const& commands) noexcept {
-#ifndef NDEBUG
-        mCommandsHighWatermark = std::max(mCommandsHighWatermark, size_t(commands.size()));
-#endif
-    }
-
-    size_t getCommandsHighWatermark() const noexcept {
-        return mCommandsHighWatermark * sizeof(RenderPass::Command);
+    // the commands of a pass, for the memory and render stats
+    void recordCommands(utils::Slice<Command> const& commands) noexcept {
+        mEngine.recordCommandsSize(commands.data(), commands.size() * sizeof(Command));
+        mRenderStats.commandCount += commands.size();
+        for (Command const& command : commands) {
+            mRenderStats.instancedDraws += command.primitive.instancedDraw ? 1 : 0;
+        }
     }
 
     driver::TextureFormat getHdrFormat() const noexcept {
@@ -132,17 +212,55 @@ private:
     // keep a reference to our engine
     FEngine& mEngine;
     FrameSkipper mFrameSkipper;
+    uint64_t mVsyncTime = 0;        // last vsync passed to beginFrame(), in ns
+    uint64_t mVsyncPeriod = 0;      // estimated refresh period, in ns
     Handle<HwRenderTarget> mRenderTarget;
+    AccumulationTarget mAccumulationTarget;     // created the first time it's needed
     FSwapChain* mSwapChain = nullptr;
-    size_t mCommandsHighWatermark = 0;
     uint32_t mFrameId = 0;
     FrameInfoManager mFrameInfoManager;
+    FrameStatsManager mFrameStats;
+    std::chrono::steady_clock::time_point mFrameStart;
+    bool mFrameStatsRecording = false;  // whether the current frame's timings are recorded
+    RenderStats mRenderStats;           // counters of the current frame
+    RenderStats mLastFrameRenderStats;  // counters of the last frame that ended
+    uint64_t mFlushedSize = 0;          // command stream flushed until the last frame ended
+    utils::CString mCapturePath;        // the next render() is captured there, see FrameCapture
+    uint64_t mFrameContentVersion = 0;  // engine's content version rendered by the current frame
+    uint64_t mPresentedContentVersion = ~0ull;  // content version of the last frame presented
+    uint32_t mConvergenceFramesLeft = 0;        // frames the temporal upscaler still needs
+    bool mFrameTemporalUpscaling = false;       // the current frame uses temporal upscaling
+    bool mFrameReflectionProbesPending = false; // the current frame left probes to prefilter
+    bool mReflectionProbesPending = false;      // idem, for the last frame that ended
+
+    // Partial updates: what the last frame rendered, to find out what changed since.
+    // See setFrameDamage().
+    FScene const* mDamageScene = nullptr;
+    FSwapChain const* mDamageSwapChain = nullptr;
+    Viewport mDamageViewport;
+    math::mat4f mDamageClipFromWorld;
+    uint64_t mDamageGlobalVersion = 0;      // engine's global content version after render()
+    uint64_t mRenderContentVersion = 0;     // engine's content version when render() started
+    uint64_t mRenderResourceVersion = 0;    // engine's resource content version at the snapshot
+    uint64_t mRenderGlobalVersion = 0;      // engine's global content version at the snapshot
+    uint32_t mFrameViewCount = 0;           // views rendered by the current frame
+    uint32_t mLastFrameViewCount = 0;       // views rendered by the last frame that ended
+    bool mFrameGlobalChanges = true;        // see FEngine::getGlobalContentVersion()
+    bool mPartialUpdate = false;
     bool mIsRGB16FSupported : 1;
     bool mIsRGB8Supported : 1;
 
     // per-frame arena for this Renderer
     LinearAllocatorArena& mPerRenderPassArena;
 
+    // With frame pipelining, the driver commands of a render() can still be recorded after it
+    // returns, so it can't reuse the arena of the previous render(). These are allocated the
+    // first time frame pipelining is enabled.
+    std::unique_ptr<LinearAllocatorArena> mPipelinedArenas[2];
+    bool mPipelinedArenaPending[2] = { false, false };
+    uint8_t mPipelinedArenaIndex = 0;
+    bool mFramePipelining = false;
+
 #if EXTRA_TIMING_INFO
     Series<float> mRendering;
     Series<float> mPostProcess;
@@ -22,21 +22,30 @@
 #include "components/RenderableManager.h"
 #include "components/TransformManager.h"
 
+#include "details/BVH.h"
 #include "details/Culler.h"
 #include "details/GpuLightBuffer.h"
+#include "details/ReflectionProbes.h"
 
 #include "Allocators.h"
 
+#include "driver/UniformBuffer.h"
+
 #include <filament/Box.h>
 #include <filament/Scene.h>
 
 #include <utils/compiler.h>
 #include <utils/Entity.h>
+#include <utils/EntityManager.h>
+#include <utils/Mutex.h>
 #include <utils/Slice.h>
 #include <utils/StructureOfArrays.h>
 #include <utils/Range.h>
 
+#include <atomic>
 #include <cstddef>
+#include <vector>
+
 #include <tsl/robin_set.h>
 
 namespace filament {
@@ -47,10 +56,11 @@ class FEngine;
 class FIndirectLight;
 class FRenderer;
 class FSkybox;
+class FTexture;
 class GpuLightBuffer;
 
 
-class FScene : public Scene {
+class FScene : public Scene, private utils::EntityManager::Listener {
 public:
 
     /*
@@ -60,7 +70,7 @@ public:
     void setSkybox(FSkybox const* skybox) noexcept;
     FSkybox const* getSkybox() const noexcept { return mSkybox; }
 
-    void setIndirectLight(FIndirectLight const* ibl) noexcept { mIndirectLight = ibl; }
+    void setIndirectLight(FIndirectLight const* ibl) noexcept;
     FIndirectLight const* getIndirectLight() const noexcept { return mIndirectLight; }
 
     void addEntity(utils::Entity entity);
@@ -69,6 +79,20 @@ public:
     size_t getRenderableCount() const noexcept;
     size_t getLightCount() const noexcept;
 
+    void setUniformBatching(bool enabled) noexcept;
+    bool isUniformBatchingEnabled() const noexcept { return mUniformBatching; }
+
+    void setSnapshotCallback(SnapshotCallback callback, void* user) noexcept;
+    bool isSnapshotModeEnabled() const noexcept { return mSnapshotCallback != nullptr; }
+
+    void setReflectionProbe(size_t index, FTexture const* environment,
+            math::float3 const& position, Box const& box) noexcept;
+    void removeReflectionProbe(size_t index) noexcept;
+    void invalidateReflectionProbe(size_t index) noexcept;
+    uint32_t getStaleReflectionProbes() const noexcept {
+        return mReflectionProbes.getStaleProbes();
+    }
+
 public:
     /*
      * Filaments-scope Public API
@@ -78,6 +102,10 @@ public:
     // for that in a few places.
     static constexpr size_t DIRECTIONAL_LIGHTS_COUNT = 1;
 
+    // Distance between the uniforms of two renderables in the batched uniform buffer, this is
+    // the largest offset alignment allowed for uniform buffers by GL and Vulkan.
+    static constexpr size_t BATCHED_UNIFORMS_STRIDE = 256;
+
     explicit FScene(FEngine& engine);
     ~FScene() noexcept;
     void terminate(FEngine& engine);
@@ -86,16 +114,32 @@ public:
     void prepareDynamicLights(const CameraInfo& camera, ArenaScope& arena) noexcept;
     void computeBounds(Aabb& castersBox, Aabb& receiversBox, uint32_t visibleLayers) const noexcept;
 
+    // The world-space box covering the renderables that changed during the last prepare(),
+    // before and after the change. Returns false if the whole scene must be considered
+    // changed, e.g. because it was rebuilt or a light moved.
+    bool getDamage(Aabb& damage) const noexcept {
+        damage = mDamage;
+        return !mDamageUnbounded;
+    }
+
+    // Changes each time prepare() rebuilds the renderable SoA, after which the data of a
+    // renderable instance must not be assumed to be the same as before.
+    uint32_t getGeneration() const noexcept { return mGeneration; }
+
+    ReflectionProbes& getReflectionProbes() noexcept { return mReflectionProbes; }
+    ReflectionProbes const& getReflectionProbes() const noexcept { return mReflectionProbes; }
+
     /*
      * Storage for per-frame renderable data
      */
 
     enum {
         RENDERABLE_INSTANCE,    //  4 instance of the Renderable component
-        WORLD_TRANSFORM,        // 16 instance of the Transform component
+        WORLD_TRANSFORM,        // 12 world transform of the renderable
         VISIBILITY_STATE,       //  1 visibility data of the component
         UBH,                    //  4 uniform buffer handle
-        BONES_UBH,              //  4 bones uniform buffer handle
+        BONES_SLOT,             //  4 1 + slot in the bone palette, 0 if not skinned
+        MORPH_TARGETS,          //  4 sampler buffer handle of the morph targets
         WORLD_AABB_CENTER,      // 12 world-space bounding box center of the renderable
         VISIBLE_MASK,           //  1 each bit represents a visibility in a pass
 
@@ -106,25 +150,42 @@ public:
         // These are temporaries and should be stored out of line
         PRIMITIVES,             //  8 level-of-detail'ed primitives
         SUMMED_PRIMITIVE_COUNT, //  4 summed visible primitive counts
+
+        // These are used to patch the data above in place from one frame to the next
+        TRANSFORM_INSTANCE,     //  4 instance of the Transform component
+        TRANSFORM_VERSION,      //  4 version of the world transform used above
+        RENDERABLE_VERSION,     //  4 version of the Renderable component used above
+        BVH_SLOT,               //  4 slot of this renderable in the BVH
+        LEVEL_OF_DETAIL,        //  1 level of detail used last frame, for hysteresis
     };
 
     using RenderableSoa = utils::StructureOfArrays<
             utils::EntityInstance<RenderableManager>,
-            math::mat4f,
+            AffineTransform,
             FRenderableManager::Visibility,
             Handle<HwUniformBuffer>,
-            Handle<HwUniformBuffer>,
+            uint32_t,
+            Handle<HwSamplerBuffer>,
             math::float3,
             Culler::result_type,
             uint8_t,
             math::float3,
             utils::Slice<FRenderPrimitive>,
-            uint32_t
+            uint32_t,
+            FTransformManager::Instance,
+            uint32_t,
+            uint32_t,
+            uint32_t,
+            uint8_t
     >;
 
     RenderableSoa const& getRenderableData() const noexcept { return mRenderableData; }
     RenderableSoa& getRenderableData() noexcept { return mRenderableData; }
 
+    // The BVH over the renderables' world AABB, or nullptr if the scene is too small to
+    // benefit from it. It's only valid until the renderable SoA is reordered.
+    BVH const* getBvh() const noexcept { return mBvh.empty() ? nullptr : &mBvh; }
+
     static inline uint32_t getPrimitiveCount(RenderableSoa const& soa,
             uint32_t first, uint32_t last) noexcept {
         // the caller must guarantee that last is dereferencable
@@ -146,7 +207,9 @@ public:
         DIRECTION,
         LIGHT_INSTANCE,
         VISIBILITY,
-        SCREEN_SPACE_Z_RANGE
+        SCREEN_SPACE_Z_RANGE,
+        SHADOW_PARAMS,          // index of the spot shadow map (or -1), normal bias per distance
+        SPOT_CONE               // cos(outer)^2 and 1/sin(outer) of spot lights
     };
 
     using LightSoa = utils::StructureOfArrays<
@@ -154,15 +217,61 @@ public:
             math::float3,
             FLightManager::Instance,
             Culler::result_type,
+            math::float2,
+            math::float2,
             math::float2
     >;
 
     LightSoa const& getLightData() const noexcept { return mLightData; }
     LightSoa& getLightData() noexcept { return mLightData; }
 
-    void updateUBOs(utils::Range<uint32_t> visibleRenderables) const noexcept;
+    // Updates the per-renderable uniforms of the given renderables. When uniform batching is
+    // enabled, they're also packed in a single uniform buffer, uploaded at once and referenced
+    // by the UBH column -- each renderable's uniforms are at its instance times
+    // BATCHED_UNIFORMS_STRIDE.
+    void updateUBOs(utils::Range<uint32_t> visibleRenderables) noexcept;
+
+    // whether the UBH column refers to the batched uniform buffer, as of the last updateUBOs()
+    bool hasBatchedUniforms() const noexcept { return mHasBatchedUniforms; }
+
+    // The uniforms of a renderable as of the last updateUBOs(), they're only available when
+    // hasBatchedUniforms() is true. Unlike the RenderableManager's, they're owned by the scene,
+    // so they can be read once the components are changed for the next frame.
+    PerRenderableUib const& getBatchedUniforms(
+            FRenderableManager::Instance ri) const noexcept {
+        return *reinterpret_cast<PerRenderableUib const*>(
+                static_cast<char const*>(mBatchedUniforms.getBuffer()) +
+                        ri.asValue() * BATCHED_UNIFORMS_STRIDE);
+    }
+
+    // Calls the snapshot callback, once the View rendering this scene doesn't read the
+    // components anymore. See Scene::setSnapshotCallback().
+    void snapshotTaken() noexcept {
+        if (UTILS_UNLIKELY(mSnapshotCallback)) {
+            mSnapshotCallback(this, mSnapshotUser);
+        }
+    }
 
 private:
+    // number of renderables processed by each job in prepare(), it's also the batch size of
+    // the AABB transform loop.
+    static constexpr size_t JOBS_PARALLEL_FOR_RENDERABLES_COUNT = 64;
+
+    // below this number of renderables, linear culling is faster than using a BVH
+    static constexpr size_t BVH_MIN_RENDERABLE_COUNT = 1024;
+
+    // utils::EntityManager::Listener, this can be called from any thread
+    void onEntitiesDestroyed(size_t n, utils::Entity const* entities) noexcept override;
+    void onAllEntitiesDestroyed() noexcept override;
+
+    void gatherRenderables(const math::mat4f& worldOriginTransform) noexcept;
+    void updateRenderables(const math::mat4f& worldOriginTransform) noexcept;
+    void prepareRenderables(uint32_t start, uint32_t count,
+            const math::mat4f& worldOriginTransform, bool all) noexcept;
+    void gatherLights(const math::mat4f& worldOriginTransform) noexcept;
+    void prepareBvh(bool rebuild, bool refit) noexcept;
+    void updateBatchedUniforms(utils::Range<uint32_t> visibleRenderables) noexcept;
+
     static inline void computeLightRanges(math::float2* zrange,
             CameraInfo const& camera, const math::float4* spheres, size_t count) noexcept;
 
@@ -173,6 +282,7 @@ private:
     FSkybox const* mSkybox = nullptr;
     FIndirectLight const* mIndirectLight = nullptr;
     GpuLightBuffer mGpuLightData;
+    ReflectionProbes mReflectionProbes;
 
     // list of Entities in the scene. We use a robin_set<> so we can do efficient removes
     // (a vector<> could work, but removes would be O(n)). robin_set<> iterates almost as
@@ -180,6 +290,42 @@ private:
     tsl::robin_set<utils::Entity> mEntities;
     RenderableSoa mRenderableData;
     LightSoa mLightData;
+    BVH mBvh;
+
+    // all per-renderable uniforms, used when uniform batching is enabled
+    UniformBuffer mBatchedUniforms;
+    Handle<HwUniformBuffer> mBatchedUbh;
+    bool mUniformBatching = false;
+    bool mHasBatchedUniforms = false;
+
+    // snapshot mode, see Scene::setSnapshotCallback()
+    SnapshotCallback mSnapshotCallback = nullptr;
+    void* mSnapshotUser = nullptr;
+
+    // Lights found in mEntities during the last gatherRenderables(). Lights are few, so
+    // they're re-gathered every time from this list (the light SoA is trimmed by each View).
+    struct LightInstances {
+        FLightManager::Instance li;
+        FTransformManager::Instance ti;
+    };
+    std::vector<LightInstances> mLightInstances;
+
+    // State used by prepare() to find out what changed since the last call
+    math::mat4f mWorldOriginTransform;
+    uint32_t mTransformVersion = 0;
+    uint32_t mTransformStructureVersion = 0;
+    uint32_t mRenderableVersion = 0;
+    uint32_t mRenderableStructureVersion = 0;
+    uint32_t mLightStructureVersion = 0;
+    uint64_t mLightTransformVersion = 0;
+    bool mEntitiesDirty = true;
+    uint32_t mGeneration = 0;
+    std::atomic<bool> mEntitiesDestroyed = { false };
+
+    // what changed during the last prepare(), see getDamage()
+    utils::Mutex mDamageLock;
+    Aabb mDamage;
+    bool mDamageUnbounded = true;
 };
 
 FILAMENT_UPCAST(Scene)
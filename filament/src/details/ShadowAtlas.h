@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_SHADOWATLAS_H
+#define TNT_FILAMENT_DETAILS_SHADOWATLAS_H
+
+#include "components/LightManager.h"
+
+#include "details/Camera.h"
+#include "details/Scene.h"
+
+#include "driver/DriverApiForward.h"
+#include "driver/SamplerBuffer.h"
+
+#include <filament/EngineEnums.h>
+#include <filament/Viewport.h>
+
+#include <math/mat4.h>
+
+#include <array>
+
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * The shadow maps of the spot lights, packed in a single texture.
+ *
+ * Each shadow casting spot light gets a square tile of the atlas, whose size depends on how
+ * much of the screen the light covers. A tile is only rendered again when the light, the tile
+ * or the light's shadow casters changed since the last time it was rendered.
+ */
+class ShadowAtlas {
+public:
+    // dimension of the (square) atlas texture, in texels
+    static constexpr uint32_t ATLAS_DIMENSION = 2048;
+
+    // the smallest tile of the atlas, in texels
+    static constexpr uint32_t MIN_TILE_DIMENSION = 64;
+
+    explicit ShadowAtlas(FEngine& engine) noexcept;
+    ~ShadowAtlas();
+
+    void terminate(driver::DriverApi& driverApi) noexcept;
+
+    // Selects the visible shadow casting spot lights (at most CONFIG_MAX_SHADOW_CASTING_SPOTS,
+    // the ones covering most of the screen first), gives each one a tile of the atlas and
+    // computes its light camera. The SHADOW_PARAMS of these lights are set accordingly.
+    // Call once per frame. The tiles are never larger than maxMapSize.
+    void update(FScene::LightSoa& lightData, details::CameraInfo const& camera,
+            Frustum const& cullingFrustum, uint32_t maxMapSize) noexcept;
+
+    // Number of spot lights with a shadow map. Valid after calling update().
+    size_t getShadowCount() const noexcept { return mShadowCount; }
+
+    // Sets a key identifying the shadow casters of the shadow map (e.g. from their versions),
+    // its tile is rendered again if they changed. Call after update().
+    void setCasters(size_t shadow, uint64_t casters) noexcept;
+
+    // Whether the shadow map must be rendered this frame. Valid after calling setCasters().
+    bool isShadowUpdated(size_t shadow) const noexcept { return mShadows[shadow].updated; }
+
+    // Allocates the atlas texture and binds it to 'index' of the sampler buffer.
+    void prepare(driver::DriverApi& driver, SamplerBuffer& buffer, size_t index) noexcept;
+
+    // Returns the viewport of the shadow map in the atlas. Valid after calling update().
+    Viewport const& getViewport(size_t shadow) const noexcept {
+        return mShadows[shadow].viewport;
+    }
+
+    // Returns the transform to use in the shader to access the shadow map, without bias.
+    // Valid after calling update().
+    math::mat4f const& getLightSpaceMatrix(size_t shadow) const noexcept {
+        return mShadows[shadow].lightSpace;
+    }
+
+    // Returns the depth range of the light projection. Valid after calling update().
+    float getSceneRange(size_t shadow) const noexcept { return mShadows[shadow].sceneRange; }
+
+    // Returns the light owning the shadow map. Valid after calling update().
+    FLightManager::Instance getLight(size_t shadow) const noexcept {
+        return mShadows[shadow].light;
+    }
+
+    // Returns the light projection of the shadow map. Valid after calling update().
+    FCamera const& getCamera(size_t shadow) const noexcept { return *mCameras[shadow]; }
+
+    // Set-up the render target, call before rendering the shadow map.
+    void beginRenderPass(driver::DriverApi& driverApi, size_t shadow) const noexcept;
+
+private:
+    struct Shadow {
+        FLightManager::Instance light;
+        math::mat4f lightSpace;
+        Viewport viewport;
+        float sceneRange = 0.0f;
+        uint32_t dimension = 0;     // of the tile, in texels
+        uint64_t casters = 0;
+        bool updated = false;
+    };
+
+    math::mat4f getTextureCoordsMapping(Shadow const& shadow) const noexcept;
+
+    // the shadows of this frame, and the ones of the previous frame, to find out what changed
+    std::array<Shadow, CONFIG_MAX_SHADOW_CASTING_SPOTS> mShadows;
+    std::array<Shadow, CONFIG_MAX_SHADOW_CASTING_SPOTS> mPreviousShadows;
+    std::array<FCamera*, CONFIG_MAX_SHADOW_CASTING_SPOTS> mCameras = {};
+    size_t mShadowCount = 0;
+    size_t mPreviousShadowCount = 0;
+
+    // set-up in prepare()
+    Handle<HwTexture> mShadowMapHandle;
+    Handle<HwRenderTarget> mShadowMapRenderTarget;
+
+    FEngine& mEngine;
+    const bool mClipSpaceFlipped;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_SHADOWATLAS_H
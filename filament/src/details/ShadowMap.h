@@ -17,6 +17,8 @@
 #ifndef TNT_FILAMENT_DETAILS_SHADOWMAP_H
 #define TNT_FILAMENT_DETAILS_SHADOWMAP_H
 
+#include "RenderTargetPool.h"
+
 #include "components/LightManager.h"
 
 #include "details/Camera.h"
@@ -30,6 +32,8 @@
 #include <math/mat4.h>
 #include <math/vec4.h>
 
+#include <array>
+
 namespace filament {
 namespace details {
 
@@ -41,35 +45,88 @@ public:
     void terminate(driver::DriverApi& driverApi) noexcept;
 
     // Call once per frame if the light, scene (or visible layers) or camera changes.
-    // This computes the light's camera.
+    // This computes the light's camera of each cascade rendered this frame. The viewport is
+    // the one the view is rendered at, after the dynamic resolution scale. The shadow map is
+    // never larger than maxMapSize, see View::setMaxShadowMapSize().
     void update(
             const FScene::LightSoa& lightData, size_t index, FScene const* scene,
-            details::CameraInfo const& camera, uint8_t visibleLayers) noexcept;
+            details::CameraInfo const& camera, Viewport const& viewport,
+            uint8_t visibleLayers, uint32_t maxMapSize) noexcept;
+
+    // Size of the shadow map of each cascade, in texels. Valid after calling update().
+    uint32_t getShadowMapDimension() const noexcept { return mShadowMapDimension; }
 
     // Do we have visible shadows. Valid after calling update().
     bool hasVisibleShadows() const noexcept { return mHasVisibleShadows; }
 
-    // Allocates shadow texture based on user parameters (e.g. dimensions)
+    // Number of cascades of the shadow map. Valid after calling update().
+    size_t getCascadeCount() const noexcept { return mCascadeCount; }
+
+    // Whether the cascade is rendered this frame, the far cascades are only rendered every
+    // other frame. Valid after calling update().
+    bool isCascadeUpdated(size_t cascade) const noexcept { return mCascades[cascade].updated; }
+
+    // Whether the depth of the static shadow casters is cached, in which case each cascade is
+    // rendered in two passes: the static casters in the cache (only when it's updated) and the
+    // dynamic casters on top of a copy of the cache. Valid after calling update().
+    bool hasStaticCache() const noexcept { return mCacheStaticCasters; }
+
+    // Sets a key identifying the cascade's static shadow casters (e.g. from their versions),
+    // the cache is rendered again if they changed. Call after update() when hasStaticCache().
+    void setStaticCasters(size_t cascade, uint64_t casters) noexcept;
+
+    // Whether the cascade's static casters must be rendered in the cache this frame.
+    // Valid after calling setStaticCasters().
+    bool isStaticCacheUpdated(size_t cascade) const noexcept {
+        return mCascades[cascade].staticCacheUpdated;
+    }
+
+    // Allocates shadow texture based on user parameters (e.g. dimensions), from the
+    // engine's RenderTargetPool
     void prepare(driver::DriverApi& driver, SamplerBuffer& buffer) noexcept;
 
-    // Returns the shadow map's viewport. Valid after prepare().
-    Viewport const& getViewport() const noexcept { return mViewport; }
+    // The sampler parameters of the shadow maps, for comparisons
+    static driver::SamplerParams getSamplerParams() noexcept;
 
-    // Computes the transform to use in the shader to access the shadow map.
+    // Returns the viewport of the cascade's shadow map. Valid after calling update().
+    Viewport const& getViewport(size_t cascade) const noexcept {
+        return mCascades[cascade].viewport;
+    }
+
+    // Computes the transform to use in the shader to access the cascade's shadow map.
     // Valid after calling update().
-    math::mat4f const& getLightSpaceMatrix() const noexcept { return mLightSpace; }
+    math::mat4f const& getLightSpaceMatrix(size_t cascade) const noexcept {
+        return mCascades[cascade].lightSpace;
+    }
+
+    // return the size of a texel of the cascade in world space (pre-warping)
+    float getTexelSizeWorldSpace(size_t cascade) const noexcept {
+        return mCascades[cascade].texelSizeWs;
+    }
 
-    // return the size of a texel in world space (pre-warping)
-    float getTexelSizeWorldSpace() const noexcept { return mTexelSizeWs; }
+    // Returns the cascade's depth range. Valid after calling update().
+    float getSceneRange(size_t cascade) const noexcept { return mCascades[cascade].sceneRange; }
 
-    // Returns the shadow map's depth range. Valid after init().
-    float getSceneRange() const noexcept { return mSceneRange; }
+    // Returns the view-space distance at which the cascade ends. Valid after calling update().
+    float getCascadeSplit(size_t cascade) const noexcept { return mCascades[cascade].split; }
 
-    // Returns the light's projection. Valid after calling update().
-    FCamera const& getCamera() const noexcept { return *mCamera; }
+    // Returns the cascade's light projection. Valid after calling update().
+    FCamera const& getCamera(size_t cascade) const noexcept { return *mCascades[cascade].camera; }
 
-    // Set-up the render target, call before rendering the shadow map.
-    void beginRenderPass(driver::DriverApi& driverApi) const noexcept;
+    // Computes the volume the visible shadow receivers sweep towards a directional light, up to
+    // the shadow casters. The casters outside of it can't cast shadows on anything visible.
+    // Returns false if the volume is empty or degenerate.
+    static bool computeShadowReceiversVolume(Frustum& volume, math::float3 const& direction,
+            Aabb const& wsVisibleReceivers, Aabb const& wsShadowCasters) noexcept;
+
+    // Set-up the render target, call before rendering the cascade's shadow map, or its static
+    // casters in the cache.
+    void beginRenderPass(driver::DriverApi& driverApi, size_t cascade,
+            bool staticCache = false) const noexcept;
+
+    // Copies the cascade's cached static casters to its shadow map, call before rendering
+    // the dynamic casters, outside of a render pass.
+    void copyStaticCache(driver::DriverApi& driverApi, size_t cascade) const noexcept;
 
     // use only for debugging
     FCamera const& getDebugCamera() const noexcept { return *mDebugCamera; }
@@ -84,6 +141,7 @@ private:
         float zf = 0;
         float dzn = 0;
         float dzf = 0;
+        uint32_t viewportHeight = 0;
         Frustum frustum;
         float getNear() const noexcept { return zn; }
         float getFar() const noexcept { return zf; }
@@ -104,9 +162,40 @@ private:
     // 8 corners, 12 segments w/ 2 intersection max -- all of this twice (8 + 12 * 2) * 2 (768 bytes)
     using FrustumBoxIntersection = std::array<math::float3, 64>;
 
+    struct Cascade {
+        FCamera* camera = nullptr;
+        math::mat4f lightSpace;
+        Viewport viewport;
+        float sceneRange = 0.0f;
+        float texelSizeWs = 0.0f;
+        float desiredDimension = 0.0f;  // with adaptiveMapSize, see computeDesiredDimension()
+        float split = 0.0f;
+        bool hasVisibleShadows = false;
+        bool updated = false;
+
+        // the light frustum the static casters were cached with
+        math::float3 staticCacheDirection;
+        float staticCacheNear = 0.0f;
+        float staticCacheFar = 0.0f;
+        uint64_t staticCasters = 0;
+        bool staticCacheValid = false;
+        bool staticCacheUpdated = false;
+    };
+
+    bool canKeepStaticCache(Cascade const& cascade, math::float3 const& direction,
+            float znear, float zfar, float texelSizeWs, size_t vertexCount) const noexcept;
+
+    // The size of the shadow map at which a texel of the cascade covers about a pixel of the
+    // closest visible receivers.
+    float computeDesiredDimension(CameraInfo const& camera, float texelSizeWs,
+            size_t vertexCount) const noexcept;
+
+    // Picks the size of the next frames' shadow map from the cascades' desired sizes.
+    void updateAdaptiveDimension(uint32_t maxDimension) noexcept;
+
     void computeShadowCameraDirectional(
             math::float3 const& direction, FScene const* scene, CameraInfo const& camera,
-            uint8_t visibleLayers) noexcept;
+            uint8_t visibleLayers, size_t index) noexcept;
 
     static math::mat4f applyLISPSM(
             CameraInfo const& camera, float dzn, float dzf, const math::mat4f& LMpMv,
@@ -150,6 +239,8 @@ private:
 
     math::mat4f getTextureCoordsMapping() const noexcept;
 
+    math::mat4f getAtlasMapping(size_t cascade) const noexcept;
+
     float texelSizeWorldSpace(const math::mat4f& lightSpaceMatrix) const noexcept;
     float texelSizeWorldSpace(const math::mat4f& lightSpaceMatrix, math::float3 const& str) const noexcept;
 
@@ -167,20 +258,29 @@ private:
             { 2, 6, 7, 3 },  // top
     };
 
-    FCamera* mCamera = nullptr;
     FCamera* mDebugCamera = nullptr;
-    math::mat4f mLightSpace;
-    float mSceneRange = 0.0f;
-    float mTexelSizeWs = 0.0f;
 
-    // set-up in prepare()
-    Viewport mViewport;
-    Handle<HwTexture> mShadowMapHandle;
-    Handle<HwRenderTarget> mShadowMapRenderTarget;
+    // the cascades not rendered this frame keep their state from the last time they were
+    std::array<Cascade, CONFIG_MAX_SHADOW_CASCADES> mCascades;
+
+    // set-up in prepare(), the targets belong to the engine's RenderTargetPool
+    RenderTargetPool::Target const* mShadowMapTarget = nullptr;
+    RenderTargetPool::Target const* mStaticCacheTarget = nullptr;
+    uint32_t mTextureDimension = 0;
+    uint8_t mTextureCascadeCount = 0;
 
     // set-up in update()
     uint32_t mShadowMapDimension = 0;
+    uint8_t mCascadeCount = 1;
     bool mHasVisibleShadows = false;
+    bool mCacheStaticCasters = false;
+    bool mAdaptiveMapSize = false;
+    uint32_t mFrameCount = 0;
+
+    // the size picked by updateAdaptiveDimension() for the next frames, and the number of
+    // consecutive frames a smaller one was enough
+    uint32_t mAdaptiveDimension = 0;
+    uint32_t mAdaptiveDownsizeFrames = 0;
 
     // use a member here (instead of stack) because we don't want to pay the
     // initialization of the float3 each time
@@ -188,6 +288,7 @@ private:
 
     FEngine& mEngine;
     const bool mClipSpaceFlipped;
+    const bool mCanBlitDepth;
 };
 
 } // namespace details
@@ -44,7 +44,14 @@ public:
 
     bool isNativeStream() const noexcept { return mNativeStream != nullptr; }
 
-    bool isExternalTextureId() const noexcept { return !isNativeStream(); }
+    bool isExternalTextureId() const noexcept { return mExternalTextureId != 0; }
+
+    bool isAcquiredStream() const noexcept { return !isNativeStream() && !isExternalTextureId(); }
+
+    void setAcquiredImage(void* image, Callback callback, void* userData,
+            int64_t timestamp) noexcept;
+
+    int64_t getTimestamp() const noexcept { return mTimestamp; }
 
     uint32_t getWidth() const noexcept { return mWidth; }
 
@@ -57,6 +64,7 @@ private:
     intptr_t mExternalTextureId;
     uint32_t mWidth;
     uint32_t mHeight;
+    int64_t mTimestamp = 0;
 };
 
 FILAMENT_UPCAST(Stream)
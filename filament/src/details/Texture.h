@@ -26,6 +26,9 @@
 #include <utils/compiler.h>
 
 namespace filament {
+
+class TextureStreamer;
+
 namespace details {
 
 class FEngine;
@@ -50,6 +53,7 @@ public:
     size_t getLevels() const noexcept { return mLevels; }
     Sampler getTarget() const noexcept { return mTarget; }
     InternalFormat getFormat() const noexcept { return mFormat; }
+    Usage getUsage() const noexcept { return mUsage; }
 
     void setImage(FEngine& engine, size_t level,
             uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
@@ -71,10 +75,23 @@ public:
 
     FStream const* getStream() const noexcept { return mStream; }
 
+    bool isStreaming() const noexcept { return mStreaming; }
+    void makeResident(FEngine& engine, size_t baseLevel) noexcept;
+    size_t getResidentLevel() const noexcept { return mResidentLevel; }
+    size_t getRequestedLevel() const noexcept { return mRequestedLevel; }
+
+    // Records that this streaming texture is drawn over about this many pixels (e.g. the
+    // screen-space diameter of a renderable) this frame, see TextureStreamer.
+    void requestSize(float pixels) noexcept;
+
+    // estimate of the memory used by the levels from baseLevel to the last one, in bytes
+    size_t getLevelsSize(size_t baseLevel) const noexcept;
+
     static size_t getFormatSize(InternalFormat format) noexcept;
 
 private:
     friend class Texture;
+    friend class filament::TextureStreamer;
     Handle<HwTexture> mHandle;
     uint32_t mWidth = 1;
     uint32_t mHeight = 1;
@@ -85,6 +102,13 @@ private:
     uint8_t mSampleCount = 1;
     FStream* mStream = nullptr;
     Usage mUsage = Usage::DEFAULT;
+
+    // only used by streaming textures, a level equal to mLevels means none
+    bool mStreaming = false;
+    uint8_t mResidentLevel = 0;     // finest level the application uploaded
+    uint8_t mRequestedLevel = 0;    // finest level TextureStreamer grants this texture
+    uint8_t mNeededLevel = 0;       // finest level the views needed since the last update
+    uint32_t mLastUse = 0;          // last TextureStreamer update this texture was drawn
 };
 
 
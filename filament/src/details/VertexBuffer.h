@@ -25,9 +25,11 @@
 
 #include <utils/bitset.h>
 #include <utils/compiler.h>
+#include <utils/Range.h>
 
 #include <array>
 #include <type_traits>
+#include <vector>
 
 namespace filament {
 namespace details {
@@ -54,14 +56,28 @@ public:
             driver::BufferDescriptor&& buffer,
             uint32_t byteOffset = 0, uint32_t byteSize = 0);
 
+    bool isStreaming() const noexcept { return mStreaming; }
+
+    void makeResident(FEngine& engine, uint32_t firstVertex, uint32_t vertexCount) noexcept;
+    void evict(FEngine& engine, uint32_t firstVertex, uint32_t vertexCount) noexcept;
+
+    bool isResident(uint32_t firstVertex, uint32_t vertexCount) const noexcept {
+        return !mStreaming || isResidentSlow(firstVertex, vertexCount);
+    }
+
 private:
     friend class VertexBuffer;
 
+    bool isResidentSlow(uint32_t firstVertex, uint32_t vertexCount) const noexcept;
+
     Handle<HwVertexBuffer> mHandle;
     std::array<Builder::AttributeData, MAX_ATTRIBUTE_BUFFERS_COUNT> mAttributes;
     AttributeBitset mDeclaredAttributes;
     uint32_t mVertexCount = 0;
     uint8_t mBufferCount = 0;
+    bool mStreaming = false;
+    // sorted, disjoint and non-adjacent ranges of resident vertices, only used when streaming
+    std::vector<utils::Range<uint32_t>> mResidentRanges;
 };
 
 FILAMENT_UPCAST(VertexBuffer)
@@ -21,9 +21,16 @@
 
 #include "upcast.h"
 
+#include "RenderPass.h"
+#include "RenderTargetPool.h"
+
 #include "details/Allocators.h"
 #include "details/Camera.h"
+#include "details/CullingCache.h"
 #include "details/Froxelizer.h"
+#include "details/GpuCuller.h"
+#include "details/OcclusionCuller.h"
+#include "details/ShadowAtlas.h"
 #include "details/ShadowMap.h"
 #include "details/Scene.h"
 
@@ -38,12 +45,16 @@
 #include <utils/Range.h>
 
 #include <deque>
+#include <vector>
 
 namespace utils {
 class JobSystem;
 } // namespace utils;
 
 namespace filament {
+
+class FrameStatsManager;
+
 namespace details {
 
 class FEngine;
@@ -64,12 +75,25 @@ public:
     void prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& arena,
             Viewport const& viewport) noexcept;
 
-    void setScene(FScene* scene) { mScene = scene; }
+    // The timings of the next prepare() and of the GPU work of the current frame are reported
+    // to 'stats' (if not null) for 'frameId'.
+    void setFrameStats(FrameStatsManager* stats, uint32_t frameId) noexcept {
+        mFrameStats = stats;
+        mFrameStatsId = frameId;
+    }
+
+    void setScene(FScene* scene) { mScene = scene; settingsChanged(); }
     FScene const* getScene() const noexcept { return mScene; }
     FScene* getScene() noexcept { return mScene; }
 
-    void setCullingCamera(FCamera* camera) noexcept { mCullingCamera = camera; }
-    void setViewingCamera(FCamera* camera) noexcept { mViewingCamera = camera; }
+    void setCullingCamera(FCamera* camera) noexcept {
+        mCullingCamera = camera;
+        settingsChanged();
+    }
+    void setViewingCamera(FCamera* camera) noexcept {
+        mViewingCamera = camera;
+        settingsChanged();
+    }
 
     CameraInfo const& getCameraInfo() const noexcept { return mViewingCameraInfo; }
 
@@ -96,7 +120,7 @@ public:
     }
     bool isSkyboxVisible() const noexcept;
 
-    void setCulling(bool culling) noexcept { mCulling = culling; }
+    void setCulling(bool culling) noexcept { mCulling = culling; settingsChanged(); }
     bool isCullingEnabled() const noexcept { return mCulling; }
 
     void setVisibleLayers(uint8_t select, uint8_t values) noexcept;
@@ -113,45 +137,112 @@ public:
         return mName.c_str();
     }
 
-    void prepareCamera(const CameraInfo& camera, const Viewport& viewport) const noexcept;
+    // 'jitter' is a sub-pixel offset of the projection, in pixels. With 'reversedZ' the near
+    // plane maps to a depth of 1 and the far plane to 0, see FEngine::isReversedZ().
+    void prepareCamera(const CameraInfo& camera, const Viewport& viewport,
+            math::float2 jitter = {}, bool reversedZ = false) const noexcept;
     void prepareShadowing(FEngine& engine, driver::DriverApi& driver,
-            FScene::RenderableSoa& renderableData, FScene::LightSoa const& lightData) noexcept;
+            FScene::RenderableSoa& renderableData, FScene::LightSoa& lightData,
+            Viewport const& viewport) noexcept;
     void prepareLighting(
             FEngine& engine, FEngine::DriverApi& driver, ArenaScope& arena, Viewport const& viewport) noexcept;
-    void froxelize(FEngine& engine) const noexcept;
+    void froxelize(FEngine& engine, FrameStatsManager* stats, uint32_t frameId) const noexcept;
     void commitUniforms(driver::DriverApi& driverApi) const noexcept;
-    void commitFroxels(driver::DriverApi& driverApi) const noexcept;
+    // waits for the froxelization started by prepare() and uploads its result
+    void commitFroxels(utils::JobSystem& js, driver::DriverApi& driverApi) const noexcept;
 
     bool hasDirectionalLight() const noexcept { return mHasDirectionalLight; }
     bool hasDynamicLighting() const noexcept { return mHasDynamicLighting; }
-    bool hasShadowing() const noexcept { return mHasShadowing & mDirectionalShadowMap.hasVisibleShadows(); }
+    bool hasShadowing() const noexcept { return hasDirectionalShadows() | mHasSpotShadows; }
+    bool hasDirectionalShadows() const noexcept {
+        return mHasShadowing & mDirectionalShadowMap.hasVisibleShadows();
+    }
 
     void prepareVisibleRenderables(utils::JobSystem& js, FScene::RenderableSoa& renderableData) const noexcept;
 
+    // culls the shadow casters of 'lightFrustum', setting 'bit' of their VISIBLE_MASK
     void prepareVisibleShadowCasters(utils::JobSystem& js, FScene::RenderableSoa& renderableData,
-                                     Frustum const& lightFrustum) const noexcept;
-
-    void updatePrimitivesLod(
-            FEngine& engine, const CameraInfo& camera,
+                                     Frustum const& lightFrustum, size_t bit) const noexcept;
+
+    // clears the 'casterMask' bits of the VISIBLE_MASK of the shadow casters that can't cast
+    // shadows on the visible receivers, i.e. outside of the volume the receivers sweep towards
+    // the light.
+    void cullShadowCastersWithReceivers(utils::JobSystem& js,
+            FScene::RenderableSoa& renderableData, math::float3 const& lightDirection,
+            uint8_t casterMask) const noexcept;
+
+    // culls the shadow casters of a spot light among 'range', setting the
+    // VISIBLE_SPOT_SHADOW_BIT of their VISIBLE_MASK. Unlike prepareVisibleShadowCasters(),
+    // this can be used after the SoA is partitioned.
+    static void prepareVisibleSpotShadowCasters(FScene::RenderableSoa& renderableData,
+            Range range, Frustum const& lightFrustum) noexcept;
+
+    // bit of the VISIBLE_MASK set for the shadow casters of the first cascade of the shadow
+    // map, the next cascades use the next bits.
+    static constexpr size_t VISIBLE_SHADOW_CASCADE_BIT = 2u;
+
+    // bit of the VISIBLE_MASK set for the shadow casters of the spot lights rendered this frame
+    static constexpr size_t VISIBLE_SPOT_SHADOW_CASTER_BIT = 6u;
+
+    // bit of the VISIBLE_MASK set for the shadow casters of a single spot light, it's only
+    // valid until the next spot light is culled (it's also used temporarily before that, by
+    // cullShadowCastersWithReceivers())
+    static constexpr size_t VISIBLE_SPOT_SHADOW_BIT = 7u;
+
+    void prepareOcclusionCulling(utils::JobSystem& js, FScene::RenderableSoa& renderableData,
+                                 math::mat4f const& clipFromWorld) noexcept;
+
+    // selects the level of detail of the visible renderables, from their screen coverage as
+    // seen from 'camera', and sets their PRIMITIVES accordingly
+    // Returns false if the primitives should have been copied into the arena (see
+    // Scene::setSnapshotCallback()) but it's full, the RenderableManager's are used then.
+    static bool updatePrimitivesLod(utils::JobSystem& js,
+            FEngine& engine, const CameraInfo& camera, ArenaScope& arena, bool snapshot,
             FScene::RenderableSoa& renderableData, Range visibles) noexcept;
 
+    // records the levels of the streaming textures needed by the visible renderables, from
+    // their size on screen, see TextureStreamer
+    static void updateStreamingTextures(FEngine& engine, const CameraInfo& camera,
+            Viewport const& viewport, FScene::RenderableSoa const& renderableData,
+            Range visibles) noexcept;
+
     static void cullRenderables(utils::JobSystem& js, FScene::RenderableSoa& renderableData,
-                                Frustum const& frustum, size_t bit) noexcept;
+                                BVH const* bvh, Frustum const& frustum, size_t bit) noexcept;
+
+    // like cullRenderables(), but reuses the results of the last frame with temporal culling
+    void cullRenderablesCached(utils::JobSystem& js, FScene::RenderableSoa& renderableData,
+            Frustum const& frustum, size_t bit) const noexcept;
+
+    void setShadowsEnabled(bool enabled) noexcept {
+        mShadowingEnabled = enabled;
+        settingsChanged();
+    }
+
+    void setMaxShadowMapSize(uint32_t size) noexcept {
+        mMaxShadowMapSize = std::max(1u, size);
+        settingsChanged();
+    }
 
-    void setShadowsEnabled(bool enabled) noexcept { mShadowingEnabled = enabled; }
+    uint32_t getMaxShadowMapSize() const noexcept {
+        return mMaxShadowMapSize;
+    }
 
     ShadowMap const& getShadowMap() const { return mDirectionalShadowMap; }
 
+    ShadowAtlas const& getShadowAtlas() const { return mShadowAtlas; }
+
     FCamera const* getDirectionalLightCamera() const noexcept {
         return &mDirectionalShadowMap.getDebugCamera();
     }
 
     void setRenderTarget(TargetBufferFlags discard) noexcept {
         mDiscardedTargetBuffers = discard;
+        settingsChanged();
     }
 
     void setSampleCount(uint8_t count) noexcept {
         mSampleCount = uint8_t(count < 1u ? 1u : count);
+        settingsChanged();
     }
 
     uint8_t getSampleCount() const noexcept {
@@ -160,6 +251,7 @@ public:
 
     void setAntiAliasing(AntiAliasing type) noexcept {
         mAntiAliasing = type;
+        settingsChanged();
     }
 
     AntiAliasing getAntiAliasing() const noexcept {
@@ -172,7 +264,34 @@ public:
         return mHasPostProcessPass;
     }
 
-    math::float2 updateScale(std::chrono::duration<float, std::milli> frameTime) noexcept;
+    // Computes the scale of the next frame. The GPU time of the previous frames is used when
+    // timer queries are supported, 'frameTime' otherwise.
+    math::float2 updateScale(driver::DriverApi& driver,
+            std::chrono::duration<float, std::milli> frameTime) noexcept;
+
+    // timer query that must enclose all the GPU work of this view for the current frame, or
+    // null if dynamic resolution doesn't need it. Updated by updateScale().
+    Handle<HwTimerQuery> getTimerQuery() const noexcept {
+        GpuTimer const& timer = mGpuTimers[mGpuTimerIndex];
+        return timer.pending ? timer.query : Handle<HwTimerQuery>{};
+    }
+
+    // the passes whose GPU time is reported to the frame stats, their timer queries are nested
+    // in the view's
+    enum class GpuPass : uint8_t {
+        SHADOWS,
+        COLOR,
+        POST_PROCESS
+    };
+    static constexpr size_t GPU_PASS_COUNT = 3;
+
+    // timer query of a pass of this view for the current frame, or null if the frame stats
+    // don't measure the passes. Updated by updateScale().
+    Handle<HwTimerQuery> getPassTimerQuery(GpuPass pass) const noexcept {
+        GpuTimer const& timer = mGpuTimers[mGpuTimerIndex];
+        return timer.passesPending & (1u << size_t(pass)) ?
+                timer.passes[size_t(pass)] : Handle<HwTimerQuery>{};
+    }
 
     void setDynamicResolutionOptions(View::DynamicResolutionOptions const& options) noexcept;
 
@@ -180,20 +299,93 @@ public:
         return mDynamicResolution;
     }
 
+    bool hasTemporalUpscaling() const noexcept {
+        return mHasPostProcessPass &&
+               mDynamicResolution.enabled && mDynamicResolution.temporalUpscaling;
+    }
+
+    // number of frames in a cycle of the temporal jitter
+    static constexpr uint32_t TEMPORAL_JITTER_COUNT = 16;
+
+    // sub-pixel jitter of the current frame, in pixels of the scaled viewport. Updated by
+    // updateScale().
+    math::float2 getTemporalJitter() const noexcept { return mTemporalJitter; }
+
+    // output of the temporal upscaler for the previous frame, or null. The view owns it and
+    // returns it to the RenderTargetPool when it's replaced or when the view is destroyed.
+    RenderTargetPool::Target const* getTemporalHistory() const noexcept {
+        return mTemporalHistory;
+    }
+
+    void setTemporalHistory(RenderTargetPool& rtp,
+            RenderTargetPool::Target const* history) noexcept {
+        if (mTemporalHistory) {
+            rtp.put(mTemporalHistory);
+        }
+        mTemporalHistory = history;
+    }
+
     void setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept;
+    void setDynamicLightingFroxelCount(uint32_t froxelCount) noexcept;
+    void setDynamicLightingMaxLightCount(uint32_t maxLightCount) noexcept;
 
     void setPostProcessingEnabled(bool enabled) noexcept {
         mHasPostProcessPass = enabled;
+        settingsChanged();
     }
 
-    void setDepthPrepass(DepthPrepass prepass) noexcept {
-        mDepthPrepass = prepass;
-    }
+    void setDepthPrepass(DepthPrepass prepass) noexcept;
 
     DepthPrepass getDepthPrepass() const noexcept {
         return mDepthPrepass;
     }
 
+    // With DepthPrepass::AUTO, whether the color pass of the current frame has a depth
+    // pre-pass, or DEFAULT if it's not known (no measure). Updated by updateScale().
+    DepthPrepass getAutoDepthPrepass() const noexcept {
+        return mAutoDepthPrepass;
+    }
+
+    void setOcclusionCulling(bool enabled) noexcept {
+        mOcclusionCulling = enabled;
+    }
+
+    bool isOcclusionCullingEnabled() const noexcept {
+        return mOcclusionCulling;
+    }
+
+    void setGpuCulling(bool enabled) noexcept {
+        mGpuCulling = enabled;
+    }
+
+    bool isGpuCullingEnabled() const noexcept {
+        return mGpuCulling;
+    }
+
+    void setTemporalCulling(bool enabled) noexcept {
+        mTemporalCulling = enabled;
+    }
+
+    bool isTemporalCullingEnabled() const noexcept {
+        return mTemporalCulling;
+    }
+
+    void setOrderIndependentTransparency(bool enabled) noexcept {
+        mOrderIndependentTransparency = enabled;
+    }
+
+    bool isOrderIndependentTransparencyEnabled() const noexcept {
+        return mOrderIndependentTransparency;
+    }
+
+    // whether the color pass rendered next accumulates the transparent surfaces
+    void setAccumulatedTransparency(bool accumulated) const noexcept;
+
+    // the culler of the color pass, nullptr unless GPU culling is used this frame
+    GpuCuller* getGpuCuller() noexcept {
+        return mGpuCullingActive ? &mGpuCuller : nullptr;
+    }
+
     Range const& getVisibleRenderables() const noexcept {
         return mVisibleRenderables;
     }
@@ -202,12 +394,35 @@ public:
         return mVisibleShadowCasters;
     }
 
+    // whether the last prepare() copied all it needs from the components of the scene, see
+    // Scene::setSnapshotCallback()
+    bool hasSceneSnapshot() const noexcept {
+        return mHasSceneSnapshot;
+    }
+
+    // the froxels are only valid after commitFroxels()
+    Froxelizer const& getFroxelizer() const noexcept {
+        return mFroxelizer;
+    }
+
+    // commands kept from one frame to the next, for each pass
+    RenderPass::CommandCache& getColorPassCommandCache() noexcept { return mColorPassCommandCache; }
+    RenderPass::CommandCache& getShadowPassCommandCache() noexcept { return mShadowPassCommandCache; }
+
     FCamera& getCameraUser() noexcept { return *mCullingCamera; }
     void setCameraUser(FCamera* camera) noexcept { setCullingCamera(camera); }
 
 private:
-    void prepareVisibleLights(
-            FLightManager& lcm, utils::JobSystem& js, FScene::LightSoa& lightData) const;
+    // the settings that change the image are reported to the engine, see FRenderer::needsRedraw()
+    void settingsChanged() noexcept;
+
+    void prepareVisibleLights(FLightManager& lcm, utils::JobSystem& js, ArenaScope& arena,
+            Viewport const& viewport, FScene::LightSoa& lightData) const;
+
+    // Drops the visible lights that contribute the least to the image, see
+    // setDynamicLightingMaxLightCount(). Returns the new visible light count.
+    size_t selectVisibleLights(FLightManager& lcm, ArenaScope& arena, Viewport const& viewport,
+            FScene::LightSoa& lightData, size_t visibleLightCount) const;
 
     void computeVisibilityMasks(
             uint8_t visibleLayers, uint8_t const* layers,
@@ -224,6 +439,14 @@ private:
     static FScene::RenderableSoa::iterator partition(
             FScene::RenderableSoa::iterator begin, FScene::RenderableSoa::iterator end, uint8_t mask) noexcept;
 
+    // selects the GPU timer measuring 'frame', which is rendered at mScale
+    void setGpuTimer(uint32_t frame) noexcept;
+
+    // DepthPrepass::AUTO: records the GPU cost of a color pass, per unit of area, and picks
+    // the strategy of 'frame'
+    void addDepthPrepassSample(bool depthPrepass, float cost) noexcept;
+    void updateAutoDepthPrepass(uint32_t frame) noexcept;
+
 
     // these are accessed in the render loop, keep together
     Handle<HwSamplerBuffer> mPerViewSbh;
@@ -235,6 +458,7 @@ private:
     SamplerBuffer& getUs() const noexcept { return mPerViewSb; }
     Handle<HwSamplerBuffer> getUsh() const noexcept { return mPerViewSbh; }
 
+    FEngine& mEngine;
     FScene* mScene = nullptr;
     FCamera* mCullingCamera = nullptr;
     FCamera* mViewingCamera = nullptr;
@@ -243,6 +467,11 @@ private:
     Frustum mCullingFrustum;
 
     mutable Froxelizer mFroxelizer;
+    mutable utils::JobSystem::Job* mFroxelizeJob = nullptr;
+
+    // dynamic lights budget, and the lights (instances) selected in the last frame
+    uint16_t mMaxLightCount = CONFIG_MAX_LIGHT_COUNT;
+    mutable std::vector<uint32_t> mSelectedLights;
 
     Viewport mViewport;
     LinearColorA mClearColor;
@@ -255,30 +484,87 @@ private:
     uint8_t mSampleCount = 1;
     AntiAliasing mAntiAliasing = AntiAliasing::FXAA;
     bool mShadowingEnabled = true;
+    uint32_t mMaxShadowMapSize = std::numeric_limits<uint32_t>::max();
     bool mHasPostProcessPass = true;
     DepthPrepass mDepthPrepass = DepthPrepass::DEFAULT;
+    bool mOcclusionCulling = false;
+    OcclusionCuller mOcclusionCuller;
+    bool mGpuCulling = false;
+    bool mGpuCullingActive = false;     // mGpuCulling, if culling is enabled and supported
+    bool mOrderIndependentTransparency = false;
+    GpuCuller mGpuCuller;
+    bool mTemporalCulling = false;
+    mutable CullingCache mCullingCache;
+
+    RenderPass::CommandCache mColorPassCommandCache;
+    RenderPass::CommandCache mShadowPassCommandCache;
 
     using duration = std::chrono::duration<float, std::milli>;
     DynamicResolutionOptions mDynamicResolution;
-    std::deque<duration> mFrameTimeHistory;
+
+    struct FrameTimeSample {
+        duration time;      // GPU time of the view, or frame time
+        float area;         // mScale.x * mScale.y of the frame that was measured
+        uint32_t frame;     // mFrameCount of the frame that was measured
+    };
+    std::deque<FrameTimeSample> mFrameTimeHistory;
+
+    // GPU timers are used round-robin, their result is typically available 2 or 3 frames later
+    static constexpr size_t GPU_TIMER_COUNT = 4;
+    struct GpuTimer {
+        Handle<HwTimerQuery> query;
+        std::array<Handle<HwTimerQuery>, GPU_PASS_COUNT> passes;
+        uint8_t passesPending = 0;              // one bit per GpuPass
+        bool depthPrepass = false;              // the color pass had a depth pre-pass
+        float area = 1.0f;
+        uint32_t frame = 0;
+        FrameStatsManager* stats = nullptr;     // where the measure is also reported
+        uint32_t statsFrameId = 0;
+        bool pending = false;
+    };
+    std::array<GpuTimer, GPU_TIMER_COUNT> mGpuTimers;
+    uint32_t mGpuTimerIndex = 0;
+    uint32_t mFrameCount = 0;
+
+    FrameStatsManager* mFrameStats = nullptr;
+    uint32_t mFrameStatsId = 0;
+
+    // DepthPrepass::AUTO: every DEPTH_PREPASS_PROBE_PERIOD frames, a frame uses the strategy
+    // that is not kept, to measure it again. The kept one changes when the other is cheaper
+    // by more than DEPTH_PREPASS_HYSTERESIS.
+    static constexpr uint32_t DEPTH_PREPASS_PROBE_PERIOD = 30;
+    static constexpr float DEPTH_PREPASS_HYSTERESIS = 0.1f;
+    static constexpr float DEPTH_PREPASS_COST_RATE = 0.25f;    // of the moving averages
+    std::array<float, 2> mDepthPrepassCost = {};    // without and with, 0 until measured
+    bool mDepthPrepassKept = false;
+    DepthPrepass mAutoDepthPrepass = DepthPrepass::DEFAULT;
 
     math::float2 mScale = 1.0f;
     float mDynamicWorkloadScale = 1.0f;
     bool mIsDynamicResolutionSupported = false;
+    bool mHasTimerQueries = false;
+
+    uint32_t mTemporalJitterIndex = 0;
+    math::float2 mTemporalJitter = {};
+    RenderTargetPool::Target const* mTemporalHistory = nullptr;
 
     mutable UniformBuffer mPerViewUb;
     mutable SamplerBuffer mPerViewSb;
 
     utils::CString mName;
+    const bool mClipSpaceFlipY;
     const bool mClipSpace01;
 
     // the following values are set by prepare()
     Range mVisibleRenderables;
     Range mVisibleShadowCasters;
+    bool mHasSceneSnapshot = false;
     mutable bool mHasDirectionalLight = false;
     mutable bool mHasDynamicLighting = false;
     mutable bool mHasShadowing = false;
+    mutable bool mHasSpotShadows = false;
     mutable ShadowMap mDirectionalShadowMap;
+    ShadowAtlas mShadowAtlas;
 };
 
 FILAMENT_UPCAST(View)
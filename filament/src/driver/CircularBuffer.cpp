@@ -24,6 +24,7 @@
 #    define HAS_MMAP 0
 #endif
 
+#include <assert.h>
 #include <stdio.h>
 
 #include <utils/ashmem.h>
@@ -35,6 +36,24 @@ using namespace utils;
 namespace filament {
 
 CircularBuffer::CircularBuffer(size_t size) {
+    init(size);
+}
+
+CircularBuffer::CircularBuffer(void* begin, size_t size) noexcept
+        : mSize(size), mTail(begin), mHead(begin) {
+}
+
+CircularBuffer::~CircularBuffer() noexcept {
+    terminate();
+}
+
+void CircularBuffer::resize(size_t size) noexcept {
+    assert(mData && empty());
+    terminate();
+    init(size);
+}
+
+void CircularBuffer::init(size_t size) noexcept {
 #if HAS_MMAP
     mData = alloc(size);
 #else
@@ -46,7 +65,7 @@ CircularBuffer::CircularBuffer(size_t size) {
     mHead = mData;
 }
 
-CircularBuffer::~CircularBuffer() noexcept {
+void CircularBuffer::terminate() noexcept {
 #if HAS_MMAP
     if (mData) {
         munmap(mData, mSize * 2 + BLOCK_SIZE);
@@ -57,6 +76,8 @@ CircularBuffer::~CircularBuffer() noexcept {
 #else
     free(mData);
 #endif
+    mData = nullptr;
+    mUsesAshmem = -1;
 }
 
 // If the system support mmap(), use it for creating a "hard circular buffer" where two virtual
@@ -37,6 +37,11 @@ public:
     //      to set it to 3*requiredSize to avoid blocking the render thread (usually the UI thread).
     explicit CircularBuffer(size_t bufferSize);
 
+    // Creates a buffer recording into [begin, begin + size), which is not owned. This is used
+    // to record commands into space reserved in another CircularBuffer; circularize() must not
+    // be called on such a buffer.
+    CircularBuffer(void* begin, size_t size) noexcept;
+
     // can't be moved or copy-constructed
     CircularBuffer(CircularBuffer const& rhs) = delete;
     CircularBuffer(CircularBuffer&& rhs) noexcept = delete;
@@ -66,7 +71,13 @@ public:
     // call at least once every getRequiredSize() bytes allocated from the buffer
     void circularize() noexcept;
 
+    // Replaces the storage with a buffer of 'bufferSize' bytes. The buffer must be empty and
+    // nothing recorded in it can be in use anymore.
+    void resize(size_t bufferSize) noexcept;
+
 private:
+    void init(size_t size) noexcept;
+    void terminate() noexcept;
     void* alloc(size_t size) noexcept;
 
     // pointer to the beginning of the circular buffer (constant)
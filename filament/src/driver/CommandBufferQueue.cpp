@@ -16,6 +16,9 @@
 
 #include "driver/CommandBufferQueue.h"
 
+#include <algorithm>
+#include <chrono>
+
 #include <assert.h>
 
 #include <utils/Log.h>
@@ -27,21 +30,50 @@ using namespace utils;
 
 namespace filament {
 
-CommandBufferQueue::CommandBufferQueue(size_t requiredSize, size_t bufferSize)
-        : mRequiredSize((requiredSize + CircularBuffer::BLOCK_MASK) & ~CircularBuffer::BLOCK_MASK),
-          mCircularBuffer(bufferSize),
+static constexpr size_t roundToBlock(size_t size) noexcept {
+    return (size + CircularBuffer::BLOCK_MASK) & ~CircularBuffer::BLOCK_MASK;
+}
+
+CommandBufferQueue::CommandBufferQueue(size_t requiredSize, size_t bufferSize,
+        size_t maxBufferSize)
+        : mRequiredSize(roundToBlock(requiredSize)),
+          mMaxSize(roundToBlock(maxBufferSize)),
+          mCircularBuffer(roundToBlock(bufferSize)),
           mFreeSpace(mCircularBuffer.size()) {
     assert(mCircularBuffer.size() > requiredSize);
+    static_assert(!(SLICE_COUNT & (SLICE_COUNT - 1)), "SLICE_COUNT must be a power of two");
 }
 
 CommandBufferQueue::~CommandBufferQueue() {
-    assert(!mCommandBuffersToExecute.size());
+    assert(mHead.load() == mTail.load());
 }
 
-void CommandBufferQueue::requestExit() {
+template<typename P>
+void CommandBufferQueue::wait(std::atomic<bool>& sleeping, P predicate) noexcept {
+    for (uint32_t i = 0; i < SPIN_COUNT; i++) {
+        if (predicate()) {
+            return;
+        }
+        UTILS_PAUSE();
+    }
     std::unique_lock<utils::Mutex> lock(mLock);
-    mExitRequested = true;
-    mCondition.notify_one();
+    // the other thread checks 'sleeping' after updating the state predicate() depends on, and
+    // takes the lock before notifying, so no wake-up can be missed.
+    sleeping.store(true);
+    mCondition.wait(lock, predicate);
+    sleeping.store(false, std::memory_order_relaxed);
+}
+
+void CommandBufferQueue::wake(std::atomic<bool> const& sleeping) noexcept {
+    if (UTILS_UNLIKELY(sleeping.load())) {
+        std::lock_guard<utils::Mutex> lock(mLock);
+        mCondition.notify_all();
+    }
+}
+
+void CommandBufferQueue::requestExit() noexcept {
+    mExitRequested.store(true);
+    wake(mConsumerSleeping);
 }
 
 void CommandBufferQueue::flush() noexcept {
@@ -64,56 +96,103 @@ void CommandBufferQueue::flush() noexcept {
 
     // size of this slice
     uint32_t used = uint32_t(intptr_t(head) - intptr_t(tail));
+    mFlushedSize += used;
 
     circularBuffer.circularize();
 
-    std::unique_lock<utils::Mutex> lock(mLock);
-    mCommandBuffersToExecute.push_back({ tail, head });
-
     // circular buffer is too small, we corrupted the stream
-    assert(used <= mFreeSpace);
+    assert(used <= mFreeSpace.load());
+
+    using clock = std::chrono::steady_clock;
+    clock::time_point stallStart{};
+    bool stalled = false;
+
+    // all the Slices are in flight, that's very unlikely since they're usually a frame each
+    const uint32_t index = mHead.load(std::memory_order_relaxed);
+    if (UTILS_UNLIKELY(index - mTail.load() == SLICE_COUNT)) {
+        SYSTRACE_NAME("waiting: CommandBufferQueue::flush() slice");
+        stallStart = clock::now();
+        stalled = true;
+        wait(mProducerSleeping, [this, index]() -> bool {
+            return index - mTail.load() < SLICE_COUNT;
+        });
+    }
+
+    mSlices[index % SLICE_COUNT] = { tail, head };
+    mHead.store(index + 1);
+    wake(mConsumerSleeping);
 
-    // wait until there is enough space in the buffer
-    mFreeSpace -= used;
+    const size_t freeSpace = mFreeSpace.fetch_sub(used) - used;
     const size_t requiredSize = mRequiredSize;
 
-#ifndef NDEBUG
-    size_t totalUsed = circularBuffer.size() - mFreeSpace;
+    size_t totalUsed = circularBuffer.size() - freeSpace;
     mHighWatermark = std::max(mHighWatermark, totalUsed);
+#ifndef NDEBUG
     if (UTILS_UNLIKELY(totalUsed > requiredSize)) {
         slog.d << "CommandStream used too much space: " << totalUsed
             << ", out of " << requiredSize << " (will block)" << io::endl;
     }
 #endif
 
-    if (UTILS_LIKELY(mFreeSpace >= requiredSize)) {
-        // ideally (and usually) we don't have to wait, this is the common case, so special case
-        // the unlock-before-notify, optimization.
-        lock.unlock();
-        mCondition.notify_one();
-    } else {
+    // ideally (and usually) we don't have to wait
+    if (UTILS_UNLIKELY(freeSpace < requiredSize)) {
         // unfortunately, there is not enough space left, we'll have to wait.
-        mCondition.notify_one(); // too bad there isn't a notify-and-wait
         SYSTRACE_NAME("waiting: CircularBuffer::flush()");
-        mCondition.wait(lock, [this, requiredSize]() -> bool {
-            return mFreeSpace >= requiredSize;
+        if (!stalled) {
+            stallStart = clock::now();
+            stalled = true;
+        }
+        wait(mProducerSleeping, [this, requiredSize]() -> bool {
+            return mFreeSpace.load() >= requiredSize;
         });
     }
-}
 
-std::vector<CommandBufferQueue::Slice> CommandBufferQueue::waitForCommands() const {
-    std::unique_lock<utils::Mutex> lock(mLock);
-    while (mCommandBuffersToExecute.empty() && !mExitRequested) {
-        mCondition.wait(lock);
+    if (UTILS_UNLIKELY(stalled)) {
+        mStallDuration += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock::now() - stallStart).count();
+        mStallCount++;
+        mConsecutiveStallCount++;
+        if (mConsecutiveStallCount >= GROWTH_STALL_COUNT && circularBuffer.size() < mMaxSize) {
+            grow();
+        }
+    } else {
+        mConsecutiveStallCount = 0;
     }
-    return std::move(mCommandBuffersToExecute);
 }
 
-void CommandBufferQueue::releaseBuffer(CommandBufferQueue::Slice const& buffer) {
-    std::unique_lock<utils::Mutex> lock(mLock);
-    mFreeSpace += uintptr_t(buffer.end) - uintptr_t(buffer.begin);
-    lock.unlock();
-    mCondition.notify_one();
+void CommandBufferQueue::grow() noexcept {
+    SYSTRACE_CALL();
+
+    // the driver must be done with all the commands in the buffer before we can replace it
+    const uint32_t head = mHead.load(std::memory_order_relaxed);
+    wait(mProducerSleeping, [this, head]() -> bool {
+        return mTail.load() == head;
+    });
+
+    const size_t size = std::min(mCircularBuffer.size() * 2, mMaxSize);
+    mCircularBuffer.resize(size);
+    mFreeSpace.store(size);
+    mConsecutiveStallCount = 0;
+    mGrowthCount++;
+
+    slog.d << "CommandBufferQueue: CircularBuffer grown to " << size / 1024 << " KiB" << io::endl;
+}
+
+CommandBufferQueue::Slices CommandBufferQueue::waitForCommands() noexcept {
+    const uint32_t first = mNextToExecute;
+    wait(mConsumerSleeping, [this, first]() -> bool {
+        return mHead.load() != first || mExitRequested.load();
+    });
+    // this synchronizes with flush(), so the content of the Slices is visible
+    const uint32_t last = mHead.load(std::memory_order_acquire);
+    mNextToExecute = last;
+    return { mSlices, first, last };
+}
+
+void CommandBufferQueue::releaseBuffer(CommandBufferQueue::Slice const& buffer) noexcept {
+    mFreeSpace.fetch_add(uintptr_t(buffer.end) - uintptr_t(buffer.begin));
+    mTail.fetch_add(1);
+    wake(mProducerSleeping);
 }
 
 } // namespace filament
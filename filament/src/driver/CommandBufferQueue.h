@@ -23,55 +23,136 @@
 #include <utils/Condition.h>
 #include <utils/Mutex.h>
 
-#include <vector>
+#include <atomic>
+
+#include <stdint.h>
 
 namespace filament {
 
 /*
  * A produdcer-consumer command queue that uses a CircularBuffer as main storage
+ *
+ * The Slices are handed from the producer (flush()) to the consumer (waitForCommands()) through
+ * a lock-free single-producer / single-consumer ring. Either thread spins for a little while
+ * before going to sleep when it needs to wait, and the other thread only wakes it up if it's
+ * actually sleeping.
  */
 class CommandBufferQueue {
+public:
     struct Slice {
         void* begin;
         void* end;
     };
 
-    const size_t mRequiredSize;
-
-    CircularBuffer mCircularBuffer;
-
-    // space available in the circular buffer
-
-    mutable utils::Mutex mLock;
-    mutable utils::Condition mCondition;
-    mutable std::vector<Slice> mCommandBuffersToExecute;
-    size_t mFreeSpace = 0;
-    size_t mHighWatermark = 0;
-    bool mExitRequested = false;
+    // maximum number of Slices in flight, must be a power of two
+    static constexpr uint32_t SLICE_COUNT = 32;
+
+    // The Slices returned by waitForCommands(), in order
+    class Slices {
+    public:
+        class const_iterator {
+        public:
+            const_iterator(Slice const* ring, uint32_t index) noexcept
+                    : mRing(ring), mIndex(index) { }
+            Slice const& operator*() const noexcept { return mRing[mIndex % SLICE_COUNT]; }
+            const_iterator& operator++() noexcept { ++mIndex; return *this; }
+            bool operator!=(const_iterator const& rhs) const noexcept {
+                return mIndex != rhs.mIndex;
+            }
+        private:
+            Slice const* mRing;
+            uint32_t mIndex;
+        };
+
+        Slices(Slice const* ring, uint32_t first, uint32_t last) noexcept
+                : mRing(ring), mFirst(first), mLast(last) { }
+        const_iterator begin() const noexcept { return { mRing, mFirst }; }
+        const_iterator end() const noexcept { return { mRing, mLast }; }
+        size_t size() const noexcept { return mLast - mFirst; }
+
+    private:
+        Slice const* mRing;
+        uint32_t mFirst;
+        uint32_t mLast;
+    };
 
-public:
     // requiredSize: guaranteed available space after flush()
-    CommandBufferQueue(size_t requiredSize, size_t bufferSize);
+    // maxBufferSize: when larger than bufferSize, the buffer grows up to this size after
+    //                flush() blocked several times in a row
+    CommandBufferQueue(size_t requiredSize, size_t bufferSize, size_t maxBufferSize = 0);
     ~CommandBufferQueue();
 
     CircularBuffer& getCircularBuffer() { return mCircularBuffer; }
+    CircularBuffer const& getCircularBuffer() const { return mCircularBuffer; }
 
-    size_t getHigWatermark() noexcept { return mHighWatermark; }
+    // statistics, only valid on the producer thread
+    size_t getHigWatermark() const noexcept { return mHighWatermark; }
+    uint32_t getStallCount() const noexcept { return mStallCount; }
+    uint64_t getStallDuration() const noexcept { return mStallDuration; } // in ns
+    uint32_t getGrowthCount() const noexcept { return mGrowthCount; }
+    uint64_t getFlushedSize() const noexcept { return mFlushedSize; }     // in bytes
 
-    // wait for commands to be available and returns an array containing these commands
-    std::vector<Slice> waitForCommands() const;
+    // wait for commands to be available and returns the Slices containing these commands, they
+    // stay valid until they're released. An empty list is returned when exit is requested.
+    Slices waitForCommands() noexcept;
 
     // return the memory used by this command buffer to the circular buffer
     // WARNING: releaseBuffer() must be called in sequence of the Slices returned by
     // waitForCommands()
-    void releaseBuffer(Slice const& buffer);
+    void releaseBuffer(Slice const& buffer) noexcept;
 
     // all commands buffers (Slices) written to this point are returned by waitForCommand(). This
     // call blocks until the CircularBuffer has at least mRequiredSize bytes available.
     void flush() noexcept;
 
     // returns from waitForcommands() immediately.
-    void requestExit();
+    void requestExit() noexcept;
+
+private:
+    // number of times we check for the condition before going to sleep
+    static constexpr uint32_t SPIN_COUNT = 1024;
+
+    // waits until predicate() is true, 'sleeping' is set while sleeping
+    template<typename P>
+    void wait(std::atomic<bool>& sleeping, P predicate) noexcept;
+
+    // wakes the thread up, if it's sleeping
+    void wake(std::atomic<bool> const& sleeping) noexcept;
+
+    // doubles the size of the circular buffer, up to mMaxSize
+    void grow() noexcept;
+
+    // number of consecutive flush() that blocked before the buffer grows
+    static constexpr uint32_t GROWTH_STALL_COUNT = 3;
+
+    const size_t mRequiredSize;
+    const size_t mMaxSize;
+
+    CircularBuffer mCircularBuffer;
+
+    // the Slices in flight, written by flush() and released by releaseBuffer()
+    Slice mSlices[SLICE_COUNT];
+    std::atomic<uint32_t> mHead = { 0 };    // next Slice written by flush()
+    std::atomic<uint32_t> mTail = { 0 };    // next Slice released by releaseBuffer()
+    uint32_t mNextToExecute = 0;            // next Slice returned by waitForCommands()
+
+    // space available in the circular buffer
+    std::atomic<size_t> mFreeSpace;
+    std::atomic<bool> mExitRequested = { false };
+
+    // only used when a thread needs to sleep
+    utils::Mutex mLock;
+    utils::Condition mCondition;
+    std::atomic<bool> mProducerSleeping = { false };
+    std::atomic<bool> mConsumerSleeping = { false };
+
+    // statistics
+    size_t mHighWatermark = 0;
+    uint64_t mFlushedSize = 0;      // of all the slices since the queue was created
+    uint64_t mStallDuration = 0;
+    uint32_t mStallCount = 0;
+    uint32_t mConsecutiveStallCount = 0;
+    uint32_t mGrowthCount = 0;
 };
 
 } // namespace filament
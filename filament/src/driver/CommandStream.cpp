@@ -21,7 +21,9 @@
 #include <utils/Profiler.h>
 #include <utils/Systrace.h>
 
+#include <algorithm>
 #include <functional>
+#include <iterator>
 
 namespace filament {
 
@@ -60,6 +62,16 @@ CommandStream::CommandStream(Driver& driver, CircularBuffer& buffer) noexcept
 {
 }
 
+CommandStream::CommandStream(CommandStream const& rhs, CircularBuffer& buffer) noexcept
+        : mDispatcher(rhs.mDispatcher),
+          mDriver(rhs.mDriver),
+          mCurrentBuffer(&buffer)
+#ifndef NDEBUG
+          , mThreadId(std::this_thread::get_id())
+#endif
+{
+}
+
 void CommandStream::execute(void* buffer) {
     SYSTRACE_CALL();
     Profiler::Counters c0;
@@ -78,6 +90,12 @@ void CommandStream::execute(void* buffer) {
         base = base->execute(driver);
     }
 
+#if PROFILE_COMMAND_STREAM
+    if (CommandStreamProfiler* const profiler = driver.getProfiler()) {
+        profiler->flush();
+    }
+#endif
+
     if (SYSTRACE_TAG) {
         // we want to remove all this when tracing is completely disabled
         Profiler& profiler = Profiler::get();
@@ -134,6 +152,31 @@ void CommandType<void (Driver::*)(ARGS...)>::Command<METHOD>::log() noexcept  {
 
 // ------------------------------------------------------------------------------------------------
 
+void BindingCache::clear() noexcept {
+    std::fill(std::begin(mUniforms), std::end(mUniforms),
+            UniformBinding{ HandleBase::nullid, 0, 0 });
+    std::fill(std::begin(mSamplers), std::end(mSamplers), HandleBase::nullid);
+    std::fill(std::begin(mStorage), std::end(mStorage), HandleBase::nullid);
+}
+
+void BindingCache::destroyUniformBuffer(HandleId id) noexcept {
+    for (UniformBinding& binding : mUniforms) {
+        if (binding.id == id) {
+            binding.id = HandleBase::nullid;
+        }
+    }
+}
+
+void BindingCache::destroySamplerBuffer(HandleId id) noexcept {
+    std::replace(std::begin(mSamplers), std::end(mSamplers), id, HandleBase::nullid);
+}
+
+void BindingCache::destroyStorageBuffer(HandleId id) noexcept {
+    std::replace(std::begin(mStorage), std::end(mStorage), id, HandleBase::nullid);
+}
+
+// ------------------------------------------------------------------------------------------------
+
 void CustomCommand::execute(Driver&, CommandBase* base, intptr_t* next) noexcept {
     *next = CustomCommand::align(sizeof(CustomCommand));
     static_cast<CustomCommand*>(base)->mCommand();
@@ -487,6 +530,10 @@ io::ostream& operator<<(io::ostream& out, const Driver::TargetBufferInfo& tbi) {
            << "face=" << tbi.face << "}";
 }
 
+io::ostream& operator<<(io::ostream& out, const Driver::PushConstants& pc) {
+    return out << "PushConstants{size=" << pc.size << "}";
+}
+
 UTILS_PRIVATE
 io::ostream& operator<<(io::ostream& out, filament::driver::BufferDescriptor const& b) {
     out << "BufferDescriptor { buffer=" << b.buffer
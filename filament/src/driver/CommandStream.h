@@ -18,6 +18,8 @@
 #define TNT_FILAMENT_DRIVER_COMMANDSTREAM_H
 
 #include "driver/CircularBuffer.h"
+#include "driver/CommandStreamCapture.h"
+#include "driver/CommandStreamProfiler.h"
 #include "driver/Driver.h"
 
 #include <utils/compiler.h>
@@ -34,6 +36,16 @@
 // Set to true to print every commands out on log.d. This requires RTTI and DEBUG
 #define DEBUG_COMMAND_STREAM false
 
+// Set to true to record every commands executed into CAPTURE_COMMAND_STREAM_PATH, so they can be
+// replayed with CommandStreamReplay (see CommandStreamCapture.h and test/filament_replay.cpp)
+#ifndef CAPTURE_COMMAND_STREAM
+#define CAPTURE_COMMAND_STREAM false
+#endif
+#define CAPTURE_COMMAND_STREAM_PATH "filament.fcap"
+
+// Set to true to measure the time spent in each command, see CommandStreamProfiler
+#define PROFILE_COMMAND_STREAM false
+
 namespace filament {
 
 class CommandBase;
@@ -56,14 +68,21 @@ public:
 #define DECL_DRIVER_API(methodName, paramsDecl, params)                     Execute methodName##_;
 #define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)     Execute methodName##_;
 #include "driver/DriverAPI.inc"
+
+    // the compact encoding of draw(), see CompactCommand<>
+    Execute compactRasterState_;
+    Execute compactDraw_;
 };
 
 // ------------------------------------------------------------------------------------------------
 
 class CommandBase {
-    static constexpr size_t FILAMENT_OBJECT_ALIGNMENT = alignof(std::max_align_t);
-
 protected:
+    // The commands are packed back to back, so they all share the same alignment. The arguments
+    // of the commands are PODs and handles, 8 bytes is enough for all of them and keeps the
+    // small commands (most of them) from being padded to 16 or 32 bytes.
+    static constexpr size_t FILAMENT_OBJECT_ALIGNMENT = 8;
+
     using Execute = Dispatcher::Execute;
 
     constexpr CommandBase(Execute execute) noexcept : mExecute(execute) {}
@@ -124,10 +143,15 @@ struct CommandType<void (Driver::*)(ARGS...)> {
         using SavedParameters = std::tuple<typename std::decay<ARGS>::type...>;
         SavedParameters mArgs;
 
+        static_assert(alignof(SavedParameters) <= FILAMENT_OBJECT_ALIGNMENT,
+                "the arguments of a command can't be aligned to more than 8 bytes");
+
         void log() noexcept;
         template<std::size_t... I> void log(std::index_sequence<I...>) noexcept;
 
     public:
+        SavedParameters const& getArgs() const noexcept { return mArgs; }
+
         template<typename M, typename D>
         static inline void execute(M&& method, D&& driver, CommandBase* base, intptr_t* next) noexcept {
             Command* self = static_cast<Command*>(base);
@@ -158,6 +182,152 @@ struct CommandType<void (Driver::*)(ARGS...)> {
 
 // ------------------------------------------------------------------------------------------------
 
+/*
+ * BindingCache remembers the buffers last bound to each binding point by a CommandStream, so
+ * that binding the same buffer again isn't recorded at all. The cache only knows the commands
+ * recorded by its stream, so it's cleared whenever other commands could be executed in between,
+ * i.e. at render pass boundaries and when space is reserve()'d for other streams. Destroying a
+ * buffer clears its bindings, since its handle id can be reused.
+ */
+class BindingCache {
+public:
+    using HandleId = HandleBase::HandleId;
+
+    BindingCache() noexcept { clear(); }
+
+    void clear() noexcept;
+
+    // These return true if the binding is unchanged, and remember it otherwise. nullid stands for
+    // an unknown binding, so unbinding a buffer is always recorded.
+    bool bindUniforms(size_t index, HandleId id, size_t offset, size_t size) noexcept {
+        if (index >= Program::NUM_UNIFORM_BINDINGS) {
+            return false;
+        }
+        UniformBinding& binding = mUniforms[index];
+        if (id != HandleBase::nullid &&
+                binding.id == id && binding.offset == offset && binding.size == size) {
+            return true;
+        }
+        binding = { id, offset, size };
+        return false;
+    }
+
+    bool bindSamplers(size_t index, HandleId id) noexcept {
+        return bind(mSamplers, index, id);
+    }
+
+    bool bindStorageBuffer(size_t index, HandleId id) noexcept {
+        return bind(mStorage, index, id);
+    }
+
+    void destroyUniformBuffer(HandleId id) noexcept;
+    void destroySamplerBuffer(HandleId id) noexcept;
+    void destroyStorageBuffer(HandleId id) noexcept;
+
+private:
+    struct UniformBinding {
+        HandleId id;
+        size_t offset;
+        size_t size;        // ~0 for the whole buffer
+    };
+
+    template<size_t N>
+    static bool bind(HandleId (&bindings)[N], size_t index, HandleId id) noexcept {
+        if (index >= N) {
+            return false;
+        }
+        if (id != HandleBase::nullid && bindings[index] == id) {
+            return true;
+        }
+        bindings[index] = id;
+        return false;
+    }
+
+    UniformBinding mUniforms[Program::NUM_UNIFORM_BINDINGS];
+    HandleId mSamplers[Program::NUM_SAMPLER_BINDINGS];
+    HandleId mStorage[Driver::MAX_STORAGE_BUFFER_BINDINGS];
+};
+
+/*
+ * BindingFilter<Cmd>::skip() is called with the parameters of each command before it's
+ * recorded, and returns true if it can be dropped. Only the commands that bind buffers or
+ * invalidate the BindingCache are specialized.
+ */
+template<typename Cmd>
+struct BindingFilter {
+    template<typename... A>
+    static constexpr bool skip(BindingCache&, A const& ...) noexcept { return false; }
+};
+
+#define BINDING_FILTER(methodName)                                                              \
+    template<>                                                                                  \
+    struct BindingFilter<CommandType<decltype(&Driver::methodName)>::Command<&Driver::methodName>>
+
+BINDING_FILTER(bindUniforms) {
+    static bool skip(BindingCache& cache, size_t index, Driver::UniformBufferHandle ubh) noexcept {
+        return cache.bindUniforms(index, ubh.getId(), 0, ~size_t(0));
+    }
+};
+
+BINDING_FILTER(bindUniformsRange) {
+    static bool skip(BindingCache& cache, size_t index, Driver::UniformBufferHandle ubh,
+            size_t offset, size_t size) noexcept {
+        return cache.bindUniforms(index, ubh.getId(), offset, size);
+    }
+};
+
+BINDING_FILTER(bindSamplers) {
+    static bool skip(BindingCache& cache, size_t index, Driver::SamplerBufferHandle sbh) noexcept {
+        return cache.bindSamplers(index, sbh.getId());
+    }
+};
+
+BINDING_FILTER(bindStorageBuffer) {
+    static bool skip(BindingCache& cache, size_t index, Driver::StorageBufferHandle sbh) noexcept {
+        return cache.bindStorageBuffer(index, sbh.getId());
+    }
+};
+
+BINDING_FILTER(destroyUniformBuffer) {
+    static bool skip(BindingCache& cache, Driver::UniformBufferHandle ubh) noexcept {
+        cache.destroyUniformBuffer(ubh.getId());
+        return false;
+    }
+};
+
+BINDING_FILTER(destroySamplerBuffer) {
+    static bool skip(BindingCache& cache, Driver::SamplerBufferHandle sbh) noexcept {
+        cache.destroySamplerBuffer(sbh.getId());
+        return false;
+    }
+};
+
+BINDING_FILTER(destroyStorageBuffer) {
+    static bool skip(BindingCache& cache, Driver::StorageBufferHandle sbh) noexcept {
+        cache.destroyStorageBuffer(sbh.getId());
+        return false;
+    }
+};
+
+BINDING_FILTER(beginRenderPass) {
+    static bool skip(BindingCache& cache, Driver::RenderTargetHandle,
+            Driver::RenderPassParams const&) noexcept {
+        cache.clear();
+        return false;
+    }
+};
+
+BINDING_FILTER(endRenderPass) {
+    static bool skip(BindingCache& cache, int) noexcept {
+        cache.clear();
+        return false;
+    }
+};
+
+#undef BINDING_FILTER
+
+// ------------------------------------------------------------------------------------------------
+
 class CustomCommand : public CommandBase {
     std::function<void()> mCommand;
     static void execute(Driver&, CommandBase* self, intptr_t* next) noexcept;
@@ -181,6 +351,46 @@ public:
 
 // ------------------------------------------------------------------------------------------------
 
+/*
+ * The compact encoding of draw(): the raster state is recorded only when it changes, by a
+ * CompactRasterStateCommand which the following CompactDrawCommands use. This makes a draw 16
+ * bytes instead of 24, the raster state rarely changes between draws since they're sorted by
+ * material.
+ */
+class CompactRasterStateCommand : public CommandBase {
+public:
+    Driver::RasterState rs;
+    inline CompactRasterStateCommand(Execute execute, Driver::RasterState rs) noexcept
+            : CommandBase(execute), rs(rs) { }
+};
+
+class CompactDrawCommand : public CommandBase {
+public:
+    Driver::ProgramHandle ph;
+    Driver::RenderPrimitiveHandle rph;
+    inline CompactDrawCommand(Execute execute,
+            Driver::ProgramHandle ph, Driver::RenderPrimitiveHandle rph) noexcept
+            : CommandBase(execute), ph(ph), rph(rph) { }
+};
+
+// ------------------------------------------------------------------------------------------------
+
+#if CAPTURE_COMMAND_STREAM
+    #define CAPTURE_COMMAND(driver, methodName, command)                                        \
+        if (CommandStreamCapture* const capture = (driver).getCapture()) {                      \
+            capture->capture(CommandId::methodName, (command)->getArgs());                      \
+        }
+#else
+    #define CAPTURE_COMMAND(driver, methodName, command)
+#endif
+
+#if PROFILE_COMMAND_STREAM
+    #define PROFILE_COMMAND(driver, methodName)                                                 \
+        CommandStreamProfiler::Scope profile((driver).getProfiler(), CommandId::methodName)
+#else
+    #define PROFILE_COMMAND(driver, methodName)
+#endif
+
 template<typename ConcreteDriver>
 class ConcreteDispatcher final : public Dispatcher {
 public:
@@ -190,14 +400,38 @@ public:
 #define DECL_DRIVER_API(methodName, paramsDecl, params)                 methodName##_ = methodName;
 #define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params) methodName##_ = methodName;
 #include "driver/DriverAPI.inc"
+        compactRasterState_ = compactRasterState;
+        compactDraw_ = compactDraw;
     }
 private:
+    static void compactRasterState(Driver& driver, CommandBase* base, intptr_t* next) noexcept {
+        *next = CommandBase::align(sizeof(CompactRasterStateCommand));
+        driver.getCommandRasterState() = static_cast<CompactRasterStateCommand*>(base)->rs;
+    }
+
+    static void compactDraw(Driver& driver, CommandBase* base, intptr_t* next) {
+        CompactDrawCommand const* self = static_cast<CompactDrawCommand*>(base);
+        *next = CommandBase::align(sizeof(CompactDrawCommand));
+        ConcreteDriver& concreteDriver = static_cast<ConcreteDriver&>(driver);
+        const Driver::RasterState rs = driver.getCommandRasterState();
+#if CAPTURE_COMMAND_STREAM
+        // captured as a regular draw
+        if (CommandStreamCapture* const capture = driver.getCapture()) {
+            capture->capture(CommandId::draw, std::make_tuple(self->ph, rs, self->rph));
+        }
+#endif
+        PROFILE_COMMAND(driver, draw);
+        concreteDriver.draw(self->ph, rs, self->rph);
+    }
+
 #define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
 #define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
     static void methodName(Driver& driver, CommandBase* base, intptr_t* next) {                 \
         using Type = CommandType<decltype(&Driver::methodName)>;                                \
         using Cmd = typename Type::template Command<&Driver::methodName>;                       \
         ConcreteDriver& concreteDriver = static_cast<ConcreteDriver&>(driver);                  \
+        CAPTURE_COMMAND(driver, methodName, static_cast<Cmd*>(base));                           \
+        PROFILE_COMMAND(driver, methodName);                                                    \
         Cmd::execute(&ConcreteDriver::methodName, concreteDriver, base, next);                  \
      }
 #define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)                         \
@@ -205,6 +439,8 @@ private:
         using Type = CommandType<decltype(&Driver::methodName)>;                                \
         using Cmd = typename Type::template Command<&Driver::methodName>;                       \
         ConcreteDriver& concreteDriver = static_cast<ConcreteDriver&>(driver);                  \
+        CAPTURE_COMMAND(driver, methodName, static_cast<Cmd*>(base));                           \
+        PROFILE_COMMAND(driver, methodName);                                                    \
         Cmd::execute(&ConcreteDriver::methodName, concreteDriver, base, next);                  \
      }
 #include "driver/DriverAPI.inc"
@@ -220,6 +456,30 @@ private:
     #define DEBUG_COMMAND(methodName, params...) mDriver->debugCommand(#methodName)
 #endif
 
+class CommandStream;
+
+/*
+ * CompactCommand<Cmd>::record() is called with the parameters of each command that wasn't
+ * filtered, and returns true if it recorded them with a more compact encoding than Cmd.
+ * getSize() is the largest space the command takes in the stream.
+ */
+template<typename Cmd>
+struct CompactCommand {
+    template<typename... A>
+    static constexpr bool record(CommandStream&, A const& ...) noexcept { return false; }
+    static constexpr size_t getSize() noexcept { return CommandBase::align(sizeof(Cmd)); }
+};
+
+template<>
+struct CompactCommand<CommandType<decltype(&Driver::draw)>::Command<&Driver::draw>> {
+    static inline bool record(CommandStream& stream, Driver::ProgramHandle ph,
+            Driver::RasterState rs, Driver::RenderPrimitiveHandle rph) noexcept;
+    static constexpr size_t getSize() noexcept {
+        return CommandBase::align(sizeof(CompactRasterStateCommand)) +
+               CommandBase::align(sizeof(CompactDrawCommand));
+    }
+};
+
 class CommandStream {
 public:
 #define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
@@ -227,6 +487,12 @@ public:
         DEBUG_COMMAND(methodName, params);                                                      \
         using CmdType = CommandType<decltype(&Driver::methodName)>;                             \
         using Cmd = CmdType::Command<&Driver::methodName>;                                      \
+        if (UTILS_UNLIKELY(BindingFilter<Cmd>::skip(mBindingCache, params))) {                  \
+            return;                                                                             \
+        }                                                                                       \
+        if (CompactCommand<Cmd>::record(*this, params)) {                                       \
+            return;                                                                             \
+        }                                                                                       \
         void* const p = allocateCommand(CommandBase::align(sizeof(Cmd)));                       \
         new(p) Cmd(mDispatcher->methodName##_, params);                                         \
     }
@@ -261,6 +527,10 @@ public:
     CommandStream() noexcept { }
     CommandStream(Driver& driver, CircularBuffer& buffer) noexcept;
 
+    // Creates a stream recording into 'buffer', for the same driver as 'rhs'. This is used to
+    // fill the space reserved in 'rhs' with reserve(), typically from another thread.
+    CommandStream(CommandStream const& rhs, CircularBuffer& buffer) noexcept;
+
     // This is for debugging only. Currently CircularBuffer can only be written from a
     // single thread. In debug builds we assert this condition.
     // Call this first in the render loop.
@@ -293,6 +563,37 @@ public:
     inline PodType* allocatePod(
             size_t count = 1, size_t alignment = alignof(PodType)) noexcept;
 
+    /*
+     * Reserves 'size' bytes of commands in this stream. The reserved space must be filled with
+     * commands followed by a jump() to its end, or to the next slice of the reserved space.
+     * This allows several threads to record commands in their own slice of the stream, the
+     * slices are executed in order.
+     */
+    inline void* reserve(size_t size) noexcept {
+        // the commands recorded in the reserved space can change the bindings and raster state
+        mBindingCache.clear();
+        mHasRasterState = false;
+        return allocateCommand(CommandBase::align(size));
+    }
+
+    // records a command that continues the execution of the stream at 'next'
+    inline void jump(void* next) noexcept {
+        new(allocateCommand(getJumpSize())) NoopCommand(next);
+    }
+
+    // space taken in the stream by a jump()
+    static constexpr size_t getJumpSize() noexcept {
+        return CommandBase::align(sizeof(NoopCommand));
+    }
+
+    // largest space taken in the stream by a call to METHOD, e.g.:
+    // getCommandSize<decltype(&Driver::draw), &Driver::draw>()
+    template<typename M, M METHOD>
+    static constexpr size_t getCommandSize() noexcept {
+        using Cmd = typename CommandType<M>::template Command<METHOD>;
+        return CompactCommand<Cmd>::getSize();
+    }
+
 private:
     // Dispatcher could be a value (instead of pointer), which saves a load when writing commands
     // at the expense of a larger CommandStream object (about ~400 bytes)
@@ -300,6 +601,16 @@ private:
     Driver* mDriver = nullptr;
     CircularBuffer* UTILS_RESTRICT mCurrentBuffer = nullptr;
 
+    // the bindings recorded by this stream, to drop the redundant ones
+    BindingCache mBindingCache;
+
+    // the raster state of the last CompactRasterStateCommand recorded by this stream
+    Driver::RasterState mRasterState;
+    bool mHasRasterState = false;
+
+    template<typename Cmd>
+    friend struct CompactCommand;
+
 #ifndef NDEBUG
     // just for debugging...
     std::thread::id mThreadId;
@@ -333,6 +644,20 @@ PodType* CommandStream::allocatePod(size_t count, size_t alignment) noexcept {
     return static_cast<PodType*>(allocate(count * sizeof(PodType), alignment));
 }
 
+bool CompactCommand<CommandType<decltype(&Driver::draw)>::Command<&Driver::draw>>::record(
+        CommandStream& stream, Driver::ProgramHandle ph,
+        Driver::RasterState rs, Driver::RenderPrimitiveHandle rph) noexcept {
+    if (!stream.mHasRasterState || stream.mRasterState != rs) {
+        stream.mRasterState = rs;
+        stream.mHasRasterState = true;
+        void* const p = stream.allocateCommand(CommandBase::align(sizeof(CompactRasterStateCommand)));
+        new(p) CompactRasterStateCommand(stream.mDispatcher->compactRasterState_, rs);
+    }
+    void* const p = stream.allocateCommand(CommandBase::align(sizeof(CompactDrawCommand)));
+    new(p) CompactDrawCommand(stream.mDispatcher->compactDraw_, ph, rph);
+    return true;
+}
+
 } // namespace filament
 
 #endif // TNT_FILAMENT_DRIVER_COMMANDSTREAM_H
@@ -0,0 +1,503 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/CommandStreamCapture.h"
+
+#include "driver/CommandStream.h"
+
+#include <utils/Log.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace utils;
+
+namespace filament {
+
+struct CaptureHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sizeOfSizeT;   // captures can't be replayed on platforms with a different size_t
+};
+
+struct CommandHeader {
+    CommandId id;
+    uint32_t size;          // in bytes, of the arguments that follow
+};
+
+// ------------------------------------------------------------------------------------------------
+// CommandStreamCapture
+// ------------------------------------------------------------------------------------------------
+
+CommandStreamCapture::CommandStreamCapture(const char* path) noexcept
+        : mFile(fopen(path, "wb")) {
+    if (!mFile) {
+        slog.e << "Couldn't open " << path << " to capture the commands" << io::endl;
+        return;
+    }
+    const CaptureHeader header{ MAGIC, VERSION, uint32_t(sizeof(size_t)) };
+    fwrite(&header, sizeof(header), 1, mFile);
+}
+
+CommandStreamCapture::~CommandStreamCapture() noexcept {
+    if (mFile) {
+        fclose(mFile);
+    }
+}
+
+void CommandStreamCapture::commit(CommandId id) noexcept {
+    const CommandHeader header{ id, uint32_t(mData.size()) };
+    fwrite(&header, sizeof(header), 1, mFile);
+    fwrite(mData.data(), 1, mData.size(), mFile);
+}
+
+void CommandStreamCapture::writeBytes(void const* data, size_t size) noexcept {
+    uint8_t const* const p = static_cast<uint8_t const*>(data);
+    mData.insert(mData.end(), p, p + size);
+}
+
+void CommandStreamCapture::write(const char* string) noexcept {
+    const uint32_t length = string ? uint32_t(strlen(string)) : 0;
+    write(length);
+    writeBytes(string, length);
+}
+
+void CommandStreamCapture::write(CString const& string) noexcept {
+    write(uint32_t(string.size()));
+    writeBytes(string.c_str(), string.size());
+}
+
+void CommandStreamCapture::write(Driver::TargetBufferInfo const& info) noexcept {
+    write(info.handle);
+    write(info.level);
+    write(info.layer);  // aliases the face
+}
+
+void CommandStreamCapture::write(Driver::FaceOffsets const& offsets) noexcept {
+    writeBytes(offsets.offsets, sizeof(offsets.offsets));
+}
+
+void CommandStreamCapture::write(Driver::BufferDescriptor const& buffer) noexcept {
+    write(buffer.size);
+    writeBytes(buffer.buffer, buffer.size);
+}
+
+void CommandStreamCapture::write(Driver::PixelBufferDescriptor const& buffer) noexcept {
+    write(static_cast<Driver::BufferDescriptor const&>(buffer));
+    write(buffer.left);
+    write(buffer.top);
+    write(driver::PixelDataType(buffer.type));
+    write(uint8_t(buffer.alignment));
+    if (buffer.type == driver::PixelDataType::COMPRESSED) {
+        write(buffer.imageSize);
+        write(buffer.compressedFormat);
+    } else {
+        write(buffer.stride);
+        write(buffer.format);
+    }
+}
+
+void CommandStreamCapture::write(UniformBuffer const& buffer) noexcept {
+    // only the modified range is used by the driver
+    write(buffer.getOffset() + buffer.getDirtyOffset());
+    write(buffer.getDirtySize());
+    writeBytes(static_cast<char const*>(buffer.getBuffer()) + buffer.getDirtyOffset(),
+            buffer.getDirtySize());
+}
+
+void CommandStreamCapture::write(SamplerBuffer const& buffer) noexcept {
+    write(buffer.getSize());
+    for (size_t i = 0, c = buffer.getSize(); i < c; i++) {
+        SamplerBuffer::Sampler const& sampler = buffer.getBuffer()[i];
+        write(sampler.t);
+        write(sampler.s);
+    }
+}
+
+void CommandStreamCapture::write(UniformInterfaceBlock const& block) noexcept {
+    write(block.getName());
+    auto const& list = block.getUniformInfoList();
+    write(uint32_t(list.size()));
+    for (auto const& info : list) {
+        write(info.name);
+        write(info.size);
+        write(info.type);
+        write(info.precision);
+    }
+}
+
+void CommandStreamCapture::write(SamplerInterfaceBlock const& block) noexcept {
+    write(block.getName());
+    auto const& list = block.getSamplerInfoList();
+    write(uint32_t(list.size()));
+    for (auto const& info : list) {
+        write(info.name);
+        write(info.type);
+        write(info.format);
+        write(info.precision);
+        write(info.multisample);
+    }
+}
+
+void CommandStreamCapture::write(Program const& program) noexcept {
+    write(program.getName());
+    write(program.getVariant());
+    for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
+        size_t size;
+        const char* source = program.getShader(Program::Shader(i), &size);
+        write(CString(source, CString::size_type(size)));
+    }
+    for (UniformInterfaceBlock const* block : program.getUniformInterfaceBlocks()) {
+        write(block != nullptr);
+        if (block) {
+            write(*block);
+        }
+    }
+    for (SamplerInterfaceBlock const* block : program.getSamplerInterfaceBlocks()) {
+        write(block != nullptr);
+        if (block) {
+            write(*block);
+        }
+    }
+    SamplerBindingMap const* const bindings = program.getSamplerBindings();
+    write(bindings != nullptr);
+    if (bindings) {
+        auto const& list = bindings->getBindingList();
+        write(uint32_t(list.size()));
+        writeBytes(list.data(), list.size() * sizeof(SamplerBindingInfo));
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// CommandStreamReplay
+// ------------------------------------------------------------------------------------------------
+
+template<typename... ARGS>
+struct CommandReplay<void (Driver::*)(ARGS...)> {
+    template<void (Driver::*METHOD)(ARGS...)>
+    static void replay(CommandStreamReplay& replay, Dispatcher::Execute execute) noexcept {
+        // the braced-init-list guarantees the arguments are read in order
+        std::tuple<std::decay_t<ARGS>...> args{
+                replay.read(CommandStreamReplay::Tag<std::decay_t<ARGS>>{})... };
+        if (UTILS_UNLIKELY(replay.mError)) {
+            return;
+        }
+        replay.patch(args);
+        run<METHOD>(replay, execute, std::move(args));
+    }
+
+    template<void (Driver::*METHOD)(ARGS...)>
+    static void run(CommandStreamReplay& replay, Dispatcher::Execute execute,
+            std::tuple<std::decay_t<ARGS>...>&& args) noexcept {
+        using Cmd = typename CommandType<void (Driver::*)(ARGS...)>::template Command<METHOD>;
+
+        // the command destroys itself once executed
+        std::aligned_storage_t<sizeof(Cmd), alignof(Cmd)> storage;
+        CommandBase* const cmd = new(&storage) Cmd(execute, std::move(args));
+        cmd->execute(replay.mDriver);
+    }
+};
+
+CommandStreamReplay::CommandStreamReplay(Driver& driver, void* nativeWindow,
+        uint32_t width, uint32_t height) noexcept
+        : mDriver(driver), mNativeWindow(nativeWindow), mWidth(width), mHeight(height) {
+}
+
+CommandStreamReplay::~CommandStreamReplay() noexcept = default;
+
+bool CommandStreamReplay::open(const char* path) noexcept {
+    FILE* const file = fopen(path, "rb");
+    if (!file) {
+        slog.e << "Couldn't open the capture " << path << io::endl;
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    mData.resize(size_t(ftell(file)));
+    fseek(file, 0, SEEK_SET);
+    const bool read = fread(mData.data(), 1, mData.size(), file) == mData.size();
+    fclose(file);
+
+    CaptureHeader header{};
+    mCurrent = 0;
+    mEnd = mData.size();
+    mError = !read;
+    readBytes(&header, sizeof(header));
+    if (mError || header.magic != CommandStreamCapture::MAGIC ||
+            header.version != CommandStreamCapture::VERSION ||
+            header.sizeOfSizeT != sizeof(size_t)) {
+        slog.e << path << " isn't a capture, or was made on an incompatible platform" << io::endl;
+        mData.clear();
+        mCurrent = mEnd = 0;
+        return false;
+    }
+    mHandles.clear();
+    return true;
+}
+
+bool CommandStreamReplay::replayCommand(CommandId* commandId) noexcept {
+    CommandHeader header{};
+    mEnd = mData.size();
+    readBytes(&header, sizeof(header));
+    if (mError || header.id >= CommandId::COUNT || header.size > mData.size() - mCurrent) {
+        return false;
+    }
+    mEnd = mCurrent + header.size;
+
+    if (header.id == CommandId::createSwapChain && !mNativeWindow) {
+        replayHeadlessSwapChain();
+    } else {
+        switch (header.id) {
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
+            case CommandId::methodName:                                                         \
+                CommandReplay<decltype(&Driver::methodName)>::replay<&Driver::methodName>(      \
+                        *this, mDriver.getDispatcher().methodName##_);                          \
+                break;
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)                         \
+            case CommandId::methodName:                                                         \
+                mCreatedHandle = mDriver.methodName##Synchronous().getId();                     \
+                CommandReplay<decltype(&Driver::methodName)>::replay<&Driver::methodName>(      \
+                        *this, mDriver.getDispatcher().methodName##_);                          \
+                break;
+#include "driver/DriverAPI.inc"
+            default:
+                break;
+        }
+    }
+
+    // the strings (e.g. markers) are only needed until the end of the frame
+    if (header.id == CommandId::endFrame) {
+        mStrings.clear();
+    }
+
+    if (UTILS_UNLIKELY(mError || mCurrent != mEnd)) {
+        slog.e << "The capture is corrupted" << io::endl;
+        mError = true;
+        return false;
+    }
+    if (commandId) {
+        *commandId = header.id;
+    }
+    return true;
+}
+
+void CommandStreamReplay::replayHeadlessSwapChain() noexcept {
+    // there is no window to present to, the frames are rendered offscreen instead
+    mCreatedHandle = mDriver.createSwapChainHeadlessSynchronous().getId();
+    const Driver::SwapChainHandle sch = read(Tag<Driver::SwapChainHandle>{});
+    const uint64_t flags = read(Tag<uint64_t>{});
+    if (UTILS_LIKELY(!mError)) {
+        CommandReplay<decltype(&Driver::createSwapChainHeadless)>::run<
+                &Driver::createSwapChainHeadless>(*this,
+                        mDriver.getDispatcher().createSwapChainHeadless_,
+                        std::make_tuple(sch, mWidth, mHeight, flags));
+    }
+}
+
+bool CommandStreamReplay::replayFrame() noexcept {
+    CommandId id;
+    while (replayCommand(&id)) {
+        if (id == CommandId::endFrame) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CommandStreamReplay::readBytes(void* data, size_t size) noexcept {
+    if (UTILS_UNLIKELY(mError || size > mEnd - mCurrent)) {
+        mError = true;
+        memset(data, 0, size);
+        return;
+    }
+    memcpy(data, mData.data() + mCurrent, size);
+    mCurrent += size;
+}
+
+void* CommandStreamReplay::readBuffer(size_t* size) noexcept {
+    *size = read(Tag<size_t>{});
+    void* const buffer = *size <= mEnd - mCurrent ? malloc(*size) : nullptr;
+    if (UTILS_UNLIKELY(!buffer)) {
+        mError = true;
+        *size = 0;
+        return nullptr;
+    }
+    readBytes(buffer, *size);
+    return buffer;
+}
+
+HandleBase::HandleId CommandStreamReplay::remap(HandleBase::HandleId id) noexcept {
+    if (mCreatedHandle != HandleBase::nullid) {
+        // this is the handle returned when the command was captured
+        const HandleBase::HandleId created = mCreatedHandle;
+        mCreatedHandle = HandleBase::nullid;
+        mHandles[id] = created;
+        return created;
+    }
+    auto const pos = mHandles.find(id);
+    return pos != mHandles.end() ? pos->second : HandleBase::nullid;
+}
+
+const char* CommandStreamReplay::read(Tag<const char*>) noexcept {
+    mStrings.push_back(read(Tag<CString>{}));
+    return mStrings.back().c_str();
+}
+
+CString CommandStreamReplay::read(Tag<CString>) noexcept {
+    const uint32_t length = read(Tag<uint32_t>{});
+    if (UTILS_UNLIKELY(mError || length > mEnd - mCurrent)) {
+        mError = true;
+        return {};
+    }
+    CString string(reinterpret_cast<const char*>(mData.data() + mCurrent), length);
+    mCurrent += length;
+    return string;
+}
+
+Driver::TargetBufferInfo CommandStreamReplay::read(Tag<Driver::TargetBufferInfo>) noexcept {
+    Driver::TextureHandle handle = read(Tag<Driver::TextureHandle>{});
+    const uint8_t level = read(Tag<uint8_t>{});
+    const uint16_t layer = read(Tag<uint16_t>{});
+    return { handle, level, layer };
+}
+
+Driver::FaceOffsets CommandStreamReplay::read(Tag<Driver::FaceOffsets>) noexcept {
+    Driver::FaceOffsets offsets;
+    readBytes(offsets.offsets, sizeof(offsets.offsets));
+    return offsets;
+}
+
+static void freeBuffer(void* buffer, size_t, void*) noexcept {
+    ::free(buffer);
+}
+
+Driver::BufferDescriptor CommandStreamReplay::read(Tag<Driver::BufferDescriptor>) noexcept {
+    size_t size;
+    void* const data = readBuffer(&size);
+    return { data, size, &freeBuffer };
+}
+
+Driver::PixelBufferDescriptor CommandStreamReplay::read(
+        Tag<Driver::PixelBufferDescriptor>) noexcept {
+    size_t size;
+    void* const data = readBuffer(&size);
+    const uint32_t left = read(Tag<uint32_t>{});
+    const uint32_t top = read(Tag<uint32_t>{});
+    const auto type = read(Tag<driver::PixelDataType>{});
+    const uint8_t alignment = read(Tag<uint8_t>{});
+    if (type == driver::PixelDataType::COMPRESSED) {
+        const uint32_t imageSize = read(Tag<uint32_t>{});
+        const auto format = read(Tag<driver::CompressedPixelDataType>{});
+        Driver::PixelBufferDescriptor buffer(data, size, format, imageSize, &freeBuffer);
+        buffer.left = left;
+        buffer.top = top;
+        return buffer;
+    }
+    const uint32_t stride = read(Tag<uint32_t>{});
+    const auto format = read(Tag<driver::PixelDataFormat>{});
+    return { data, size, format, type, alignment, left, top, stride, &freeBuffer };
+}
+
+UniformBuffer CommandStreamReplay::read(Tag<UniformBuffer>) noexcept {
+    const size_t offset = read(Tag<size_t>{});
+    const size_t size = read(Tag<size_t>{});
+    if (UTILS_UNLIKELY(mError || size > mEnd - mCurrent)) {
+        mError = true;
+        return {};
+    }
+    UniformBuffer buffer(size, offset);
+    readBytes(buffer.invalidateUniforms(0, size), size);
+    return buffer;
+}
+
+SamplerBuffer CommandStreamReplay::read(Tag<SamplerBuffer>) noexcept {
+    const size_t count = read(Tag<size_t>{});
+    constexpr size_t samplerSize = sizeof(HandleBase::HandleId) + sizeof(driver::SamplerParams);
+    if (UTILS_UNLIKELY(mError || count > (mEnd - mCurrent) / samplerSize)) {
+        mError = true;
+        return {};
+    }
+    SamplerBuffer buffer(count);
+    for (size_t i = 0; i < count; i++) {
+        Handle<HwTexture> t = read(Tag<Handle<HwTexture>>{});
+        driver::SamplerParams s = read(Tag<driver::SamplerParams>{});
+        buffer.setSampler(i, { t, s });
+    }
+    return buffer;
+}
+
+UniformInterfaceBlock CommandStreamReplay::read(Tag<UniformInterfaceBlock>) noexcept {
+    UniformInterfaceBlock::Builder builder;
+    builder.name(read(Tag<CString>{}).c_str());
+    const uint32_t count = read(Tag<uint32_t>{});
+    for (uint32_t i = 0; i < count && !mError; i++) {
+        CString name = read(Tag<CString>{});
+        const uint32_t size = read(Tag<uint32_t>{});
+        const auto type = read(Tag<UniformInterfaceBlock::Type>{});
+        const auto precision = read(Tag<UniformInterfaceBlock::Precision>{});
+        builder.add(name.c_str(), size, type, precision);
+    }
+    return builder.build();
+}
+
+SamplerInterfaceBlock CommandStreamReplay::read(Tag<SamplerInterfaceBlock>) noexcept {
+    SamplerInterfaceBlock::Builder builder;
+    builder.name(read(Tag<CString>{}).c_str());
+    const uint32_t count = read(Tag<uint32_t>{});
+    for (uint32_t i = 0; i < count && !mError; i++) {
+        CString name = read(Tag<CString>{});
+        const auto type = read(Tag<SamplerInterfaceBlock::Type>{});
+        const auto format = read(Tag<SamplerInterfaceBlock::Format>{});
+        const auto precision = read(Tag<SamplerInterfaceBlock::Precision>{});
+        const bool multisample = read(Tag<bool>{});
+        builder.add(name.c_str(), type, format, precision, multisample);
+    }
+    return builder.build();
+}
+
+Program CommandStreamReplay::read(Tag<Program>) noexcept {
+    Program program;
+    CString name = read(Tag<CString>{});
+    const uint8_t variant = read(Tag<uint8_t>{});
+    program.diagnostics(name, variant);
+    program.withVertexShader(read(Tag<CString>{}));
+    program.withFragmentShader(read(Tag<CString>{}));
+    program.withComputeShader(read(Tag<CString>{}));
+    for (size_t i = 0; i < Program::NUM_UNIFORM_BINDINGS; i++) {
+        if (read(Tag<bool>{})) {
+            mUniformBlocks.push_back(read(Tag<UniformInterfaceBlock>{}));
+            program.addUniformBlock(i, &mUniformBlocks.back());
+        }
+    }
+    for (size_t i = 0; i < Program::NUM_SAMPLER_BINDINGS; i++) {
+        if (read(Tag<bool>{})) {
+            mSamplerBlocks.push_back(read(Tag<SamplerInterfaceBlock>{}));
+            program.addSamplerBlock(i, &mSamplerBlocks.back());
+        }
+    }
+    if (read(Tag<bool>{})) {
+        mSamplerBindings.emplace_back();
+        SamplerBindingMap& bindings = mSamplerBindings.back();
+        const uint32_t count = read(Tag<uint32_t>{});
+        for (uint32_t i = 0; i < count && !mError; i++) {
+            bindings.addSampler(read(Tag<SamplerBindingInfo>{}));
+        }
+        program.withSamplerBindings(&bindings);
+    }
+    return program;
+}
+
+} // namespace filament
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_COMMANDSTREAMCAPTURE_H
+#define TNT_FILAMENT_DRIVER_COMMANDSTREAMCAPTURE_H
+
+#include "driver/Driver.h"
+
+#include <utils/compiler.h>
+#include <utils/CString.h>
+
+#include <deque>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace filament {
+
+// Identifies the commands in a capture
+enum class CommandId : uint16_t {
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                     methodName,
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)     methodName,
+#include "driver/DriverAPI.inc"
+    COUNT
+};
+
+/*
+ * CommandStreamCapture serializes the commands executed by a Driver into a file (see
+ * CAPTURE_COMMAND_STREAM in CommandStream.h), so they can be executed again later without an
+ * Engine, with CommandStreamReplay.
+ *
+ * The capture holds the handles creation and the content of all the buffers, programs and
+ * sampler buffers, but:
+ * - the synchronous calls (e.g. createStream(), wait()) and queueCommand() aren't captured,
+ * - native windows, external images and the program cache aren't captured,
+ * - a capture can only be replayed on a platform with the same size_t.
+ *
+ * The file is a header followed by the commands, each one is its CommandId, its size in bytes
+ * and its arguments.
+ */
+class CommandStreamCapture {
+public:
+    // Opens 'path' for writing, nothing is captured if it can't be opened.
+    explicit CommandStreamCapture(const char* path) noexcept;
+    ~CommandStreamCapture() noexcept;
+
+    CommandStreamCapture(CommandStreamCapture const& rhs) = delete;
+    CommandStreamCapture& operator=(CommandStreamCapture const& rhs) = delete;
+
+    // Called by the Dispatcher before executing each command. 'args' are the command's arguments.
+    template<typename... ARGS>
+    void capture(CommandId id, std::tuple<ARGS...> const& args) noexcept {
+        if (mFile) {
+            mData.clear();
+            writeArgs(args, std::index_sequence_for<ARGS...>{});
+            commit(id);
+        }
+    }
+
+    static constexpr uint32_t MAGIC = 0x50414346;  // 'FCAP'
+    static constexpr uint32_t VERSION = 3;
+
+private:
+    template<typename T, size_t... I>
+    void writeArgs(T const& args, std::index_sequence<I...>) noexcept {
+        // the initializer-list guarantees the arguments are written in order
+        UTILS_UNUSED int dummy[] = { 0, (write(std::get<I>(args)), 0)... };
+    }
+
+    template<typename T, typename = std::enable_if_t<
+            std::is_trivially_copyable<T>::value && !std::is_pointer<T>::value>>
+    void write(T const& value) noexcept {
+        writeBytes(&value, sizeof(T));
+    }
+
+    template<typename T>
+    void write(Handle<T> const& handle) noexcept {
+        write(handle.getId());
+    }
+
+    // native windows, external images and the program cache are not captured
+    void write(void*) noexcept { }
+
+    void write(const char* string) noexcept;
+    void write(utils::CString const& string) noexcept;
+    void write(Driver::TargetBufferInfo const& info) noexcept;
+    void write(Driver::FaceOffsets const& offsets) noexcept;
+    void write(Driver::BufferDescriptor const& buffer) noexcept;
+    void write(Driver::PixelBufferDescriptor const& buffer) noexcept;
+    void write(UniformBuffer const& buffer) noexcept;
+    void write(SamplerBuffer const& buffer) noexcept;
+    void write(Program const& program) noexcept;
+    void write(UniformInterfaceBlock const& block) noexcept;
+    void write(SamplerInterfaceBlock const& block) noexcept;
+
+    void writeBytes(void const* data, size_t size) noexcept;
+    void commit(CommandId id) noexcept;
+
+    FILE* mFile = nullptr;
+    std::vector<uint8_t> mData; // arguments of the command being captured
+};
+
+template<typename T>
+struct CommandReplay;
+
+/*
+ * CommandStreamReplay executes the commands of a capture made with CommandStreamCapture on a
+ * Driver, e.g. to measure the cost of the backend alone, frame by frame. It must be used from
+ * the thread owning the driver.
+ *
+ * The handles of the capture are mapped to the ones created by the driver during the replay.
+ */
+class CommandStreamReplay {
+public:
+    // All the swap chains of the capture are created with 'nativeWindow', or are headless swap
+    // chains of width x height if it's null.
+    CommandStreamReplay(Driver& driver, void* nativeWindow,
+            uint32_t width = 1920, uint32_t height = 1080) noexcept;
+    ~CommandStreamReplay() noexcept;
+
+    CommandStreamReplay(CommandStreamReplay const& rhs) = delete;
+    CommandStreamReplay& operator=(CommandStreamReplay const& rhs) = delete;
+
+    // Reads the capture at 'path', returns false if it can't be read.
+    bool open(const char* path) noexcept;
+
+    // Executes the next command, returns false at the end of the capture or if it's invalid.
+    bool replayCommand(CommandId* id = nullptr) noexcept;
+
+    // Executes the commands up to (and including) the next endFrame(), returns false at the end
+    // of the capture or if it's invalid.
+    bool replayFrame() noexcept;
+
+private:
+    template<typename T>
+    friend struct CommandReplay;
+
+    template<typename T>
+    struct Tag { };
+
+    template<typename T, typename = std::enable_if_t<
+            std::is_trivially_copyable<T>::value && !std::is_pointer<T>::value>>
+    T read(Tag<T>) noexcept {
+        T value;
+        readBytes(&value, sizeof(T));
+        return value;
+    }
+
+    template<typename T>
+    Handle<T> read(Tag<Handle<T>>) noexcept {
+        const HandleBase::HandleId id = remap(read(Tag<HandleBase::HandleId>{}));
+        return id == HandleBase::nullid ? Handle<T>{} : Handle<T>{ id };
+    }
+
+    void* read(Tag<void*>) noexcept { return nullptr; }
+    driver::ProgramCache* read(Tag<driver::ProgramCache*>) noexcept { return nullptr; }
+
+    const char* read(Tag<const char*>) noexcept;
+    utils::CString read(Tag<utils::CString>) noexcept;
+    Driver::TargetBufferInfo read(Tag<Driver::TargetBufferInfo>) noexcept;
+    Driver::FaceOffsets read(Tag<Driver::FaceOffsets>) noexcept;
+    Driver::BufferDescriptor read(Tag<Driver::BufferDescriptor>) noexcept;
+    Driver::PixelBufferDescriptor read(Tag<Driver::PixelBufferDescriptor>) noexcept;
+    UniformBuffer read(Tag<UniformBuffer>) noexcept;
+    SamplerBuffer read(Tag<SamplerBuffer>) noexcept;
+    Program read(Tag<Program>) noexcept;
+    UniformInterfaceBlock read(Tag<UniformInterfaceBlock>) noexcept;
+    SamplerInterfaceBlock read(Tag<SamplerInterfaceBlock>) noexcept;
+
+    // the swap chains use the replay's window
+    void patch(std::tuple<Driver::SwapChainHandle, void*, uint64_t>& args) noexcept {
+        std::get<1>(args) = mNativeWindow;
+    }
+
+    template<typename T>
+    void patch(T&) noexcept { }
+
+    void replayHeadlessSwapChain() noexcept;
+    void readBytes(void* data, size_t size) noexcept;
+    void* readBuffer(size_t* size) noexcept;
+    HandleBase::HandleId remap(HandleBase::HandleId id) noexcept;
+
+    Driver& mDriver;
+    void* const mNativeWindow;
+    const uint32_t mWidth;
+    const uint32_t mHeight;
+    std::vector<uint8_t> mData;     // the whole capture
+    size_t mCurrent = 0;            // offset of the next byte to read
+    size_t mEnd = 0;                // end of the current command
+    bool mError = false;
+
+    // handle created for the command being replayed, it replaces the first handle read
+    HandleBase::HandleId mCreatedHandle = HandleBase::nullid;
+    std::unordered_map<HandleBase::HandleId, HandleBase::HandleId> mHandles;
+
+    // programs keep pointers to these
+    std::deque<UniformInterfaceBlock> mUniformBlocks;
+    std::deque<SamplerInterfaceBlock> mSamplerBlocks;
+    std::deque<SamplerBindingMap> mSamplerBindings;
+
+    // strings of the current frame (e.g. markers)
+    std::deque<utils::CString> mStrings;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_COMMANDSTREAMCAPTURE_H
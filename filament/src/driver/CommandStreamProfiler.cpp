@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "driver/CommandStreamProfiler.h"
+
+#include <utils/Systrace.h>
+
+#include <mutex>
+
+namespace filament {
+
+static const char* const sCommandNames[] = {
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                     "driver: " #methodName,
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)     "driver: " #methodName,
+#include "driver/DriverAPI.inc"
+};
+
+static_assert(sizeof(sCommandNames) / sizeof(*sCommandNames) == size_t(CommandId::COUNT),
+        "the names must match the commands");
+
+const char* CommandStreamProfiler::getCommandName(CommandId id) noexcept {
+    return sCommandNames[size_t(id)];
+}
+
+void CommandStreamProfiler::flush() noexcept {
+    SYSTRACE_CONTEXT();
+
+    FrameStats& current = mCurrent;
+    for (size_t i = 0, c = current.size(); i < c; i++) {
+        // commands that weren't used in this frame or the previous one don't show up
+        if (current[i].count || mPublished[i].count) {
+            SYSTRACE_VALUE32(sCommandNames[i], current[i].duration / 1000); // in us
+        }
+    }
+
+    std::lock_guard<utils::Mutex> lock(mLock);
+    mPublished = current;
+    current = {};
+}
+
+CommandStreamProfiler::FrameStats CommandStreamProfiler::getStats() const noexcept {
+    std::lock_guard<utils::Mutex> lock(mLock);
+    return mPublished;
+}
+
+} // namespace filament
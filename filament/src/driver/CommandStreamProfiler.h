@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef TNT_FILAMENT_DRIVER_COMMANDSTREAMPROFILER_H
+#define TNT_FILAMENT_DRIVER_COMMANDSTREAMPROFILER_H
+
+#include "driver/CommandStreamCapture.h"
+
+#include <utils/compiler.h>
+#include <utils/Mutex.h>
+
+#include <array>
+#include <chrono>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * CommandStreamProfiler accumulates the number of calls and the time spent executing each
+ * command of the driver, see PROFILE_COMMAND_STREAM in CommandStream.h.
+ *
+ * The statistics are published after each command buffer executed (typically once per frame),
+ * as Systrace counters and through getStats().
+ */
+class CommandStreamProfiler {
+public:
+    struct Stats {
+        uint64_t duration = 0;      // time spent executing the commands, in nanoseconds
+        uint32_t count = 0;         // number of commands executed
+    };
+
+    using FrameStats = std::array<Stats, size_t(CommandId::COUNT)>;
+
+    // Measures the execution of a command, does nothing if 'profiler' is null.
+    class Scope {
+    public:
+        Scope(CommandStreamProfiler* profiler, CommandId id) noexcept
+                : mProfiler(profiler), mId(id) {
+            if (mProfiler) {
+                mStart = clock::now();
+            }
+        }
+        ~Scope() noexcept {
+            if (mProfiler) {
+                mProfiler->record(mId, uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        clock::now() - mStart).count()));
+            }
+        }
+    private:
+        using clock = std::chrono::steady_clock;
+        CommandStreamProfiler* const mProfiler;
+        const CommandId mId;
+        clock::time_point mStart;
+    };
+
+    // Called by the driver thread for each command executed.
+    void record(CommandId id, uint64_t duration) noexcept {
+        Stats& stats = mCurrent[size_t(id)];
+        stats.duration += duration;
+        stats.count++;
+    }
+
+    // Publishes the statistics of the commands executed since the last call, and emits them
+    // as Systrace counters. Called by the driver thread after each command buffer.
+    void flush() noexcept;
+
+    // Returns the statistics of the last command buffer executed. This can be called from any
+    // thread.
+    FrameStats getStats() const noexcept;
+
+    static const char* getCommandName(CommandId id) noexcept;
+
+private:
+    FrameStats mCurrent;    // only accessed by the driver thread
+    FrameStats mPublished;  // protected by mLock
+    mutable utils::Mutex mLock;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_COMMANDSTREAMPROFILER_H
@@ -18,6 +18,8 @@
 #include "driver/Driver.h"
 #include "driver/CommandStream.h"
 
+#include "details/Texture.h" // for FTexture::getFormatSize
+
 #include <math/half.h>
 #include <math/quat.h>
 #include <math/vec2.h>
@@ -33,6 +35,8 @@ namespace filament {
 
 using namespace driver;
 
+ProgramCache::~ProgramCache() noexcept = default;
+
 DriverBase::DriverBase(Dispatcher* dispatcher) noexcept
         : mDispatcher(dispatcher) {
     // make sure mTextureInfo entries are sorted
@@ -55,6 +59,45 @@ void DriverBase::scheduleDestroySlow(BufferDescriptor&& buffer) noexcept {
     mBufferToPurge.push_back(std::move(buffer));
 }
 
+void DriverBase::publishRenderStats() noexcept {
+    std::lock_guard<std::mutex> lock(mRenderStatsLock);
+    mLastFrameRenderStats = mRenderStats;
+    mRenderStats = {};
+}
+
+void DriverBase::readRenderStats(RenderStats* stats) noexcept {
+    std::lock_guard<std::mutex> lock(mRenderStatsLock);
+    *stats = mLastFrameRenderStats;
+}
+
+void DriverBase::addGpuMemory(GpuMemoryStats::Category category, size_t size) noexcept {
+    // only the driver thread updates the counters, so they don't need to be updated atomically
+    const size_t current = mGpuMemory[category].load(std::memory_order_relaxed) + size;
+    mGpuMemory[category].store(current, std::memory_order_relaxed);
+    if (current > mGpuMemoryPeak[category].load(std::memory_order_relaxed)) {
+        mGpuMemoryPeak[category].store(current, std::memory_order_relaxed);
+    }
+    mGpuMemoryTotal += size;
+    if (mGpuMemoryTotal > mGpuMemoryTotalPeak.load(std::memory_order_relaxed)) {
+        mGpuMemoryTotalPeak.store(mGpuMemoryTotal, std::memory_order_relaxed);
+    }
+}
+
+void DriverBase::removeGpuMemory(GpuMemoryStats::Category category, size_t size) noexcept {
+    const size_t current = mGpuMemory[category].load(std::memory_order_relaxed);
+    assert(size <= current);
+    mGpuMemory[category].store(current - size, std::memory_order_relaxed);
+    mGpuMemoryTotal -= size;
+}
+
+void DriverBase::readGpuMemoryStats(GpuMemoryStats* stats) const noexcept {
+    for (size_t i = 0; i < GpuMemoryStats::COUNT; i++) {
+        stats->size[i] = mGpuMemory[i].load(std::memory_order_relaxed);
+        stats->peak[i] = mGpuMemoryPeak[i].load(std::memory_order_relaxed);
+    }
+    stats->totalPeak = mGpuMemoryTotalPeak.load(std::memory_order_relaxed);
+}
+
 // ------------------------------------------------------------------------------------------------
 // Texture format data...
 // ------------------------------------------------------------------------------------------------
@@ -212,4 +255,19 @@ size_t Driver::getElementTypeSize(ElementType type) noexcept {
     }
 }
 
+size_t Driver::getTextureSize(SamplerType target, uint8_t levels, TextureFormat format,
+        uint8_t samples, uint32_t width, uint32_t height, uint32_t depth) noexcept {
+    if (target == SamplerType::SAMPLER_EXTERNAL) {
+        // the storage belongs to the external image
+        return 0;
+    }
+    const size_t texelSize = std::max(size_t(1), details::FTexture::getFormatSize(format));
+    const size_t faces = target == SamplerType::SAMPLER_CUBEMAP ? 6 : 1;
+    size_t size = 0;
+    for (size_t level = 0; level < std::max(levels, uint8_t(1)); level++) {
+        size += std::max(1u, width >> level) * std::max(1u, height >> level);
+    }
+    return size * depth * faces * texelSize * std::max(samples, uint8_t(1));
+}
+
 } // namespace filament
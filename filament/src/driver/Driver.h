@@ -30,6 +30,8 @@
 #include <filament/driver/BufferDescriptor.h>
 #include <filament/driver/ExternalContext.h>
 #include <filament/driver/DriverEnums.h>
+#include <filament/driver/ProgramCache.h>
+#include <filament/EngineEnums.h>
 
 #include "driver/Handle.h"
 #include "driver/DriverApiForward.h"
@@ -39,6 +41,8 @@
 
 namespace filament {
 
+class CommandStreamCapture;
+class CommandStreamProfiler;
 template<typename T>
 class ConcreteDispatcher;
 class Dispatcher;
@@ -52,6 +56,8 @@ class Driver {
 public:
     // constants
     static constexpr size_t MAX_ATTRIBUTE_BUFFER_COUNT = 8;
+    // storage buffer bindings of a compute program, OpenGL ES 3.1 only guarantees 4
+    static constexpr size_t MAX_STORAGE_BUFFER_BINDINGS = 4;
 
     /*
      * Driver types...
@@ -81,6 +87,7 @@ public:
     using FaceOffsets = driver::FaceOffsets;
     using FenceStatus = driver::FenceStatus;
     using TargetBufferFlags = driver::TargetBufferFlags;
+    using BarrierFlags = driver::BarrierFlags;
     using RenderPassParams = driver::RenderPassParams;
 
     static constexpr uint64_t FENCE_WAIT_FOR_EVER = driver::FENCE_WAIT_FOR_EVER;
@@ -93,11 +100,13 @@ public:
     using ProgramHandle         = Handle<HwProgram>;
     using SamplerBufferHandle   = Handle<HwSamplerBuffer>;
     using UniformBufferHandle   = Handle<HwUniformBuffer>;
+    using StorageBufferHandle   = Handle<HwStorageBuffer>;
     using TextureHandle         = Handle<HwTexture>;
     using RenderTargetHandle    = Handle<HwRenderTarget>;
     using FenceHandle           = Handle<HwFence>;
     using SwapChainHandle       = Handle<HwSwapChain>;
     using StreamHandle          = Handle<HwStream>;
+    using TimerQueryHandle      = Handle<HwTimerQuery>;
 
     struct Attribute {
         uint32_t offset = 0;
@@ -203,10 +212,84 @@ public:
         };
     };
 
+    // The parameters of a material instance that are set at draw time rather than uploaded in
+    // a uniform buffer, laid out as the program's push constant block.
+    struct PushConstants {
+        uint32_t size = 0;
+        uint8_t data[CONFIG_MAX_PUSH_CONSTANTS_SIZE];
+    };
+
+    // The arguments of one draw of drawIndirect(), as read from the storage buffer. This is the
+    // layout of both GL and Vulkan's indexed indirect commands.
+    struct DrawIndirectCommand {
+        uint32_t indexCount;
+        uint32_t instanceCount;     // 0 skips the draw
+        uint32_t firstIndex;        // in indices, not bytes
+        int32_t baseVertex;
+        uint32_t baseInstance;      // must be 0, the shaders rely on it (and GLES requires it)
+    };
+
+    // State changes requested during a frame, by kind. 'filtered' counts the changes skipped
+    // because the state was already set, 'issued' the ones that reached the graphics API.
+    struct StateStats {
+        enum Type : uint8_t {
+            PROGRAM,            // program bindings
+            TEXTURE,            // texture bindings and active texture unit
+            SAMPLER,            // sampler object bindings
+            UNIFORM_BUFFER,     // uniform buffer (range) bindings
+            BUFFER,             // all other buffer bindings
+            FRAMEBUFFER,        // framebuffer bindings
+            VERTEX_ARRAY,       // vertex array bindings and attribute arrays
+            RASTER,             // raster state and enabled capabilities
+            OTHER,              // viewport, scissor, clear values
+            COUNT
+        };
+        uint32_t issued[COUNT] = {};
+        uint32_t filtered[COUNT] = {};
+    };
+
+    // Work done by the driver during a frame, see getRenderStats().
+    struct RenderStats {
+        uint32_t drawCount = 0;         // draw calls, indirect draws count as one each
+        uint64_t triangleCount = 0;     // triangles drawn, of all the instances
+        uint64_t uniformBytes = 0;      // uploaded with updateUniformBuffer()
+        uint64_t bufferBytes = 0;       // uploaded with loadVertexBuffer() and loadIndexBuffer()
+        uint64_t textureBytes = 0;      // uploaded with load2DImage() and loadCubeImage()
+    };
+
+    // GPU memory allocated by the driver, by category, see getGpuMemoryStats().
+    struct GpuMemoryStats {
+        enum Category : uint8_t {
+            TEXTURE,            // textures that are only sampled
+            RENDER_TARGET,      // textures that can be rendered into, and renderbuffers
+            VERTEX_BUFFER,
+            INDEX_BUFFER,
+            UNIFORM_BUFFER,
+            STORAGE_BUFFER,
+            STAGING,            // staging buffers of the uploads
+            COUNT
+        };
+        size_t size[COUNT] = {};    // in use, in bytes
+        size_t peak[COUNT] = {};    // most in use at once, in bytes
+        size_t totalPeak = 0;       // most in use at once by all the categories together
+    };
+
+    // Usage of the arena the handles are allocated from, since the driver was created.
+    struct HandleArenaStats {
+        size_t size = 0;
+        size_t highWatermark = 0;
+        uint32_t allocationCount = 0;
+        uint32_t overflowCount = 0;
+    };
+
     static SamplerFormat getSamplerFormat(TextureFormat format) noexcept;
     static SamplerPrecision getSamplerPrecision(TextureFormat format) noexcept;
     static size_t getElementTypeSize(ElementType type) noexcept;
 
+    // Size of the storage of a texture, compressed formats are counted as 1 byte per texel.
+    static size_t getTextureSize(SamplerType target, uint8_t levels, TextureFormat format,
+            uint8_t samples, uint32_t width, uint32_t height, uint32_t depth) noexcept;
+
     // This is here to be compatible with CommandStream (nice for debugging)
     inline void queueCommand(const std::function<void()>& command) {
         command();
@@ -227,6 +310,20 @@ public:
 
     virtual Dispatcher& getDispatcher() noexcept = 0;
 
+    // Commands executed by this driver are recorded into 'capture' when CAPTURE_COMMAND_STREAM
+    // is set (see CommandStream.h). The capture must outlive the driver, or be reset to nullptr.
+    void setCapture(CommandStreamCapture* capture) noexcept { mCapture = capture; }
+    CommandStreamCapture* getCapture() const noexcept { return mCapture; }
+
+    // Commands executed by this driver are measured by 'profiler' when PROFILE_COMMAND_STREAM is
+    // set (see CommandStream.h). The profiler must outlive the driver, or be reset to nullptr.
+    void setProfiler(CommandStreamProfiler* profiler) noexcept { mProfiler = profiler; }
+    CommandStreamProfiler* getProfiler() const noexcept { return mProfiler; }
+
+    // The raster state of the compact draw commands, it's set by the command preceding them (see
+    // CompactCommand<> in CommandStream.h). Only used by the thread executing the commands.
+    RasterState& getCommandRasterState() noexcept { return mCommandRasterState; }
+
 #ifndef NDEBUG
     virtual void debugCommand(const char* methodName) {}
 #endif
@@ -251,6 +348,11 @@ public:
     void methodName(RetType, paramsDecl) {}
 
 #include "driver/DriverAPI.inc"
+
+private:
+    CommandStreamCapture* mCapture = nullptr;
+    CommandStreamProfiler* mProfiler = nullptr;
+    RasterState mCommandRasterState;
 };
 
 } // namespace filament
@@ -260,6 +362,7 @@ utils::io::ostream& operator<<(utils::io::ostream& out, const filament::Driver::
 utils::io::ostream& operator<<(utils::io::ostream& out, const filament::Driver::FaceOffsets& type);
 utils::io::ostream& operator<<(utils::io::ostream& out, const filament::Driver::RasterState& rs);
 utils::io::ostream& operator<<(utils::io::ostream& out, const filament::Driver::TargetBufferInfo& tbi);
+utils::io::ostream& operator<<(utils::io::ostream& out, const filament::Driver::PushConstants& pc);
 
 utils::io::ostream& operator<<(utils::io::ostream& out, filament::driver::ShaderModel model);
 utils::io::ostream& operator<<(utils::io::ostream& out, filament::driver::PrimitiveType type);
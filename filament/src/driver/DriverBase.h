@@ -17,7 +17,9 @@
 #ifndef TNT_FILAMENT_DRIVER_DRIVERBASE_H
 #define TNT_FILAMENT_DRIVER_DRIVERBASE_H
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <mutex>
 #include <assert.h>
 #include <stdint.h>
@@ -54,6 +56,21 @@ struct HwVertexBuffer : public HwBase {
     uint8_t attributeCount;               //   1
     uint8_t padding[2];                   //   2 -> 56 bytes
 
+    // size of the buffers, in bytes
+    size_t getSize() const noexcept {
+        size_t size = 0;
+        for (size_t buffer = 0; buffer < bufferCount; buffer++) {
+            size_t end = 0;
+            for (auto const& item : attributes) {
+                if (item.buffer == buffer) {
+                    end = std::max(end, size_t(item.offset + vertexCount * item.stride));
+                }
+            }
+            size += end;
+        }
+        return size;
+    }
+
     HwVertexBuffer(
             uint8_t bufferCount,
             uint8_t attributeCount,
@@ -100,8 +117,13 @@ struct HwSamplerBuffer : public HwBase {
 };
 
 struct HwUniformBuffer : public HwBase {
-    explicit HwUniformBuffer(size_t size) noexcept : ub(size) { }
-    UniformBuffer ub;
+    explicit HwUniformBuffer(size_t size) noexcept : size(uint32_t(size)) { }
+    uint32_t size;  // in bytes
+};
+
+struct HwStorageBuffer : public HwBase {
+    explicit HwStorageBuffer(size_t size) noexcept : size(uint32_t(size)) { }
+    uint32_t size;  // in bytes
 };
 
 struct HwTexture : public HwBase {
@@ -115,6 +137,8 @@ struct HwTexture : public HwBase {
     driver::SamplerType target;
     uint8_t levels;
     uint8_t samples;
+    driver::TextureUsage usage = driver::TextureUsage::DEFAULT;
+    size_t size = 0;        // GPU memory, in bytes, see Driver::getTextureSize()
     HwStream* hwStream = nullptr;
 };
 
@@ -123,6 +147,7 @@ struct HwRenderTarget : public HwBase {
     HwRenderTarget(uint32_t w, uint32_t h) : width(w), height(h) {}
     uint32_t width;
     uint32_t height;
+    size_t size = 0;        // GPU memory of the attachments it owns, in bytes
 };
 
 struct HwFence : public HwBase {
@@ -141,6 +166,12 @@ struct HwStream : public HwBase {
     uint32_t height = 0;
 };
 
+struct HwTimerQuery : public HwBase {
+    // elapsed GPU time in nanoseconds, written by the driver thread once the result is
+    // available and consumed by getTimerQueryValue(). 0 means not available.
+    std::atomic<uint64_t> elapsed{ 0 };
+};
+
 /*
  * Base class of all Driver implementations
  */
@@ -173,6 +204,36 @@ protected:
 
     void scheduleDestroySlow(BufferDescriptor&& buffer) noexcept;
 
+    // counts the draw of 'instanceCount' instances of a primitive, see getRenderStats()
+    void countDraw(HwRenderPrimitive const& rp, uint32_t instanceCount = 1) noexcept {
+        mRenderStats.drawCount++;
+        if (rp.type == Driver::PrimitiveType::TRIANGLES) {
+            mRenderStats.triangleCount += uint64_t(rp.count / 3) * instanceCount;
+        }
+    }
+
+    RenderStats mRenderStats;       // current frame, only used on the driver thread
+
+    // makes the current frame's RenderStats those returned by readRenderStats(), this is
+    // called by the drivers at the end of each frame
+    void publishRenderStats() noexcept;
+
+    // returns the RenderStats of the last frame published, this can be called from any thread
+    void readRenderStats(RenderStats* stats) noexcept;
+
+    // GPU memory accounting, updated by the drivers when they create and destroy their
+    // resources (only from the driver thread), see getGpuMemoryStats()
+    void addGpuMemory(GpuMemoryStats::Category category, size_t size) noexcept;
+    void removeGpuMemory(GpuMemoryStats::Category category, size_t size) noexcept;
+
+    // this can be called from any thread
+    void readGpuMemoryStats(GpuMemoryStats* stats) const noexcept;
+
+    static GpuMemoryStats::Category getTextureCategory(TextureUsage usage) noexcept {
+        return usage == TextureUsage::DEFAULT ?
+                GpuMemoryStats::TEXTURE : GpuMemoryStats::RENDER_TARGET;
+    }
+
 private:
     using TF = Driver::TextureFormat;
     using SF = Driver::SamplerFormat;
@@ -194,6 +255,14 @@ private:
 
     std::mutex mPurgeLock;
     std::vector<BufferDescriptor> mBufferToPurge;
+
+    std::mutex mRenderStatsLock;
+    RenderStats mLastFrameRenderStats;  // guarded by mRenderStatsLock
+
+    std::atomic<size_t> mGpuMemory[GpuMemoryStats::COUNT] = {};
+    std::atomic<size_t> mGpuMemoryPeak[GpuMemoryStats::COUNT] = {};
+    std::atomic<size_t> mGpuMemoryTotalPeak = { 0 };
+    size_t mGpuMemoryTotal = 0;         // only used by the driver thread
 };
 
 
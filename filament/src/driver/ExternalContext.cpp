@@ -52,6 +52,8 @@
     #endif
 #endif
 
+#include "driver/noop/ContextManagerNoop.h"
+
 namespace filament {
 namespace driver {
 
@@ -67,6 +69,9 @@ ExternalContext* ExternalContext::create(Backend* backend) noexcept {
     if (*backend == Backend::DEFAULT) {
         *backend = Backend::OPENGL;
     }
+    if (*backend == Backend::NOOP) {
+        return new ContextManagerNoop();
+    }
     if (*backend == Backend::VULKAN) {
         #if defined(FILAMENT_DRIVER_SUPPORTS_VULKAN)
             #if defined(ANDROID)
@@ -21,6 +21,10 @@
 
 #include <math/half.h>
 
+#include <algorithm>
+
+#include <string.h>
+
 namespace filament {
 
 using namespace driver;
@@ -130,7 +134,10 @@ void GPUBuffer::commitSlow(driver::DriverApi& driverApi, void const* begin, void
     const uint32_t w = mWidth;
     for (auto const& range : mDirtyRanges) {
         // we need a new PixelBufferDescriptor for each range (std:move)
-        PixelBufferDescriptor desc(begin, sizeInBytes, format, type);
+        const size_t offset = range.start * mRowSizeInBytes;
+        PixelBufferDescriptor desc(static_cast<uint8_t const*>(begin) + offset,
+                std::min(sizeInBytes - offset, size_t(range.getCount() * mRowSizeInBytes)),
+                format, type);
         driverApi.load2DImage(texture, 0,
                 0, range.start,
                 w, range.getCount(), std::move(desc));
@@ -138,6 +145,22 @@ void GPUBuffer::commitSlow(driver::DriverApi& driverApi, void const* begin, void
     mDirtyRanges.clear();
 }
 
+void GPUBuffer::commitCopySlow(driver::DriverApi& driverApi, void const* data) noexcept {
+    const Handle<HwTexture> texture = mTexture;
+    const driver::PixelDataFormat format = mFormat;
+    const driver::PixelDataType type = mType;
+    const uint32_t w = mWidth;
+    for (auto const& range : mDirtyRanges) {
+        const size_t size = range.getCount() * mRowSizeInBytes;
+        void* const copy = driverApi.allocate(size);
+        memcpy(copy, static_cast<uint8_t const*>(data) + range.start * mRowSizeInBytes, size);
+        driverApi.load2DImage(texture, 0,
+                0, range.start,
+                w, range.getCount(), PixelBufferDescriptor(copy, size, format, type));
+    }
+    mDirtyRanges.clear();
+}
+
 void GPUBuffer::invalidate() noexcept {
     invalidate(0, mHeight);
 }
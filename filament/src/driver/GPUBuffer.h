@@ -81,6 +81,14 @@ public:
         commit(driverApi, data.cbegin(), data.cend());
     }
 
+    // only the dirty rows of 'data' are copied to the command-buffer, so it can be modified
+    // right after this call
+    void commitCopy(driver::DriverApi& driverApi, void const* data) noexcept {
+        if (isDirty()) {
+            commitCopySlow(driverApi, data);
+        }
+    }
+
     void swap(GPUBuffer& rhs) noexcept;
 
 private:
@@ -92,6 +100,7 @@ private:
 
 private:
     void commitSlow(driver::DriverApi& driverApi, void const* begin, void const* end) noexcept;
+    void commitCopySlow(driver::DriverApi& driverApi, void const* data) noexcept;
 
     Handle<HwTexture> mTexture;
     utils::RangeSet<4> mDirtyRanges;
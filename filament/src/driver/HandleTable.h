@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_HANDLETABLE_H
+#define TNT_FILAMENT_DRIVER_HANDLETABLE_H
+
+#include "driver/Handle.h"
+
+#include <utils/Allocator.h>
+#include <utils/compiler.h>
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * A table of the objects of one handle type, e.g. all the textures of a driver.
+ *
+ * The objects are packed in chunks of CHUNK_SIZE, and freed slots are reused first, so the
+ * objects used together tend to be close in memory. A handle id is the index of its slot and a
+ * generation counter, which is bumped when the slot is freed: get() returns nullptr for a handle
+ * to a destroyed object, which is cheap enough to check in release builds. The check misses a
+ * handle whose slot was reused 65536 times since.
+ *
+ * allocate() and getStats() can be called from any thread. The other methods are called by the
+ * thread that owns the objects (usually the driver thread), the handles reach it through the
+ * CommandStream which publishes the chunks they're in.
+ */
+template<typename T>
+class HandleTable {
+public:
+    using HandleId = HandleBase::HandleId;
+    using value_type = T;
+
+    static constexpr uint32_t INDEX_BITS = 16;
+    static constexpr uint32_t CHUNK_SHIFT = 8;
+    static constexpr uint32_t CHUNK_SIZE = 1u << CHUNK_SHIFT;
+    static constexpr uint32_t CHUNK_COUNT = 1u << (INDEX_BITS - CHUNK_SHIFT);
+    // the last index is never used, so that nullid isn't a valid handle
+    static constexpr uint32_t CAPACITY = (1u << INDEX_BITS) - 1;
+
+    struct Stats {
+        size_t count = 0;               // objects allocated
+        size_t peak = 0;                // most objects allocated at once
+        uint32_t allocationCount = 0;
+        uint32_t overflowCount = 0;     // allocations that failed
+    };
+
+    HandleTable() noexcept = default;
+    HandleTable(HandleTable const&) = delete;
+    HandleTable& operator=(HandleTable const&) = delete;
+
+    ~HandleTable() noexcept {
+        for (Chunk* chunk : mChunks) {
+            delete chunk;
+        }
+    }
+
+    // returns nullid if the table is full
+    HandleId allocate() noexcept {
+        std::lock_guard<utils::LockingPolicy::SpinLock> guard(mLock);
+        uint32_t index;
+        if (!mFreeList.empty()) {
+            // the most recently freed slot, which is most likely still in the cache
+            index = mFreeList.back();
+            mFreeList.pop_back();
+        } else if (mSize < CAPACITY) {
+            index = mSize++;
+            Chunk*& chunk = mChunks[index >> CHUNK_SHIFT];
+            if (!chunk) {
+                chunk = new(std::nothrow) Chunk();
+                if (UTILS_UNLIKELY(!chunk)) {
+                    mSize--;
+                    mStats.overflowCount++;
+                    return HandleBase::nullid;
+                }
+            }
+        } else {
+            mStats.overflowCount++;
+            return HandleBase::nullid;
+        }
+        mStats.count++;
+        mStats.peak = std::max(mStats.peak, mStats.count);
+        mStats.allocationCount++;
+        Chunk* const chunk = mChunks[index >> CHUNK_SHIFT];
+        const uint32_t generation = chunk->generations[index & (CHUNK_SIZE - 1)];
+        return HandleId((generation << INDEX_BITS) | index);
+    }
+
+    // the object of a handle, or nullptr if it was destroyed
+    T* get(HandleId id) noexcept {
+        const uint32_t index = id & CAPACITY;
+        Chunk* const chunk = mChunks[index >> CHUNK_SHIFT];
+        const uint32_t slot = index & (CHUNK_SIZE - 1);
+        if (UTILS_UNLIKELY(!chunk || chunk->generations[slot] != (id >> INDEX_BITS))) {
+            return nullptr;
+        }
+        return reinterpret_cast<T*>(&chunk->objects[slot]);
+    }
+
+    template<typename ... ARGS>
+    T* construct(HandleId id, ARGS&& ... args) noexcept {
+        const uint32_t index = id & CAPACITY;
+        Chunk* const chunk = mChunks[index >> CHUNK_SHIFT];
+        T* const p = new(get(id)) T(std::forward<ARGS>(args)...);
+        chunk->alive[index & (CHUNK_SIZE - 1)] = true;
+        return p;
+    }
+
+    // destroys the object and frees its slot, the handle isn't valid anymore
+    void destroy(HandleId id) noexcept {
+        const uint32_t index = id & CAPACITY;
+        Chunk* const chunk = mChunks[index >> CHUNK_SHIFT];
+        const uint32_t slot = index & (CHUNK_SIZE - 1);
+        if (chunk->alive[slot]) {
+            chunk->alive[slot] = false;
+            reinterpret_cast<T*>(&chunk->objects[slot])->~T();
+        }
+        std::lock_guard<utils::LockingPolicy::SpinLock> guard(mLock);
+        chunk->generations[slot]++;
+        mFreeList.push_back(index);
+        mStats.count--;
+    }
+
+    // calls f(T&) for each constructed object
+    template<typename F>
+    void forEach(F f) noexcept {
+        for (Chunk* chunk : mChunks) {
+            if (!chunk) {
+                break;
+            }
+            for (uint32_t i = 0; i < CHUNK_SIZE; i++) {
+                if (chunk->alive[i]) {
+                    f(*reinterpret_cast<T*>(&chunk->objects[i]));
+                }
+            }
+        }
+    }
+
+    // this can be called from any thread
+    Stats getStats() noexcept {
+        std::lock_guard<utils::LockingPolicy::SpinLock> guard(mLock);
+        return mStats;
+    }
+
+private:
+    struct Chunk {
+        // the objects are packed together, the bookkeeping is kept aside
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type objects[CHUNK_SIZE];
+        uint16_t generations[CHUNK_SIZE] = {};
+        bool alive[CHUNK_SIZE] = {};
+    };
+
+    Chunk* mChunks[CHUNK_COUNT] = {};
+    uint32_t mSize = 0;                 // slots used so far, freed or not
+    std::vector<uint32_t> mFreeList;
+    Stats mStats;
+    utils::LockingPolicy::SpinLock mLock;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_HANDLETABLE_H
@@ -45,6 +45,13 @@ Program& Program::withSamplerBindings(const SamplerBindingMap* bindings) {
 
 Program& Program::shader(Program::Shader shader, CString source) {
     std::swap(mShadersSource[size_t(shader)], source);
+    mShadersReference[size_t(shader)] = {};
+    return *this;
+}
+
+Program& Program::shaderReference(Program::Shader shader, const char* data, size_t size) {
+    mShadersSource[size_t(shader)] = CString();
+    mShadersReference[size_t(shader)] = { data, size };
     return *this;
 }
 
@@ -59,6 +66,16 @@ Program& Program::addSamplerBlock(size_t index, const SamplerInterfaceBlock* sb)
     return *this;
 }
 
+Program& Program::withPushConstants(const UniformInterfaceBlock* ib) {
+    mPushConstants = ib;
+    return *this;
+}
+
+Program& Program::specializationConstant(uint32_t id, bool value) {
+    mSpecializationConstants.push_back({ id, value });
+    return *this;
+}
+
 #if !defined(NDEBUG)
 io::ostream& operator<<(io::ostream& out, const Program& builder) {
     // FIXME: maybe do better here!
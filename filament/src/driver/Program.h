@@ -19,6 +19,7 @@
 
 #include <array>
 #include <string>
+#include <vector>
 
 #include <utils/compiler.h>
 #include <utils/CString.h>
@@ -34,13 +35,19 @@ namespace filament {
 class Program {
 public:
 
-    static constexpr size_t NUM_SHADER_TYPES = 2;
+    static constexpr size_t NUM_SHADER_TYPES = 3;
     static constexpr size_t NUM_UNIFORM_BINDINGS = filament::BindingPoints::COUNT;
     static constexpr size_t NUM_SAMPLER_BINDINGS = filament::BindingPoints::COUNT;
 
     enum class Shader : uint8_t {
         VERTEX = 0,
-        FRAGMENT = 1
+        FRAGMENT = 1,
+        COMPUTE = 2     // compute programs only have this shader
+    };
+
+    struct SpecializationConstant {
+        uint32_t id;
+        bool value;
     };
 
     Program() noexcept;
@@ -56,12 +63,24 @@ public:
     // sets one of the program's shader (e.g. vertex, fragment)
     Program& shader(Shader shader, utils::CString source);
 
+    // sets one of the program's shader without copying it, e.g. the SPIR-V of a material package.
+    // The memory must stay valid and unchanged until the driver has created the program. The
+    // OpenGL backend edits the sources, it only reads the ones set with shader().
+    Program& shaderReference(Shader shader, const char* data, size_t size);
+
     // sets a uniform interface block for this program
     Program& addUniformBlock(size_t index, const UniformInterfaceBlock* ib);
 
     // sets a sampler interface block for this program
     Program& addSamplerBlock(size_t index, const SamplerInterfaceBlock* ib);
 
+    // sets the layout of the push constants read by this program, see setPushConstants()
+    Program& withPushConstants(const UniformInterfaceBlock* ib);
+
+    // sets the value of a boolean specialization constant of the fragment shader. This is ignored
+    // by the backends that don't support them, and by the shaders that don't declare this id.
+    Program& specializationConstant(uint32_t id, bool value);
+
     template <typename T>
     Program& withVertexShader(T source) {
         return shader(Shader::VERTEX, std::forward<T>(source));
@@ -72,6 +91,11 @@ public:
         return shader(Shader::FRAGMENT, std::forward<T>(source));
     }
 
+    template <typename T>
+    Program& withComputeShader(T source) {
+        return shader(Shader::COMPUTE, std::forward<T>(source));
+    }
+
     // sets up sampler bindings for this program
     Program& withSamplerBindings(const SamplerBindingMap* bindings);
 
@@ -87,6 +111,18 @@ public:
         return mShadersSource;
     }
 
+    // returns a shader set with either shader() or shaderReference(), size is 0 if there's none
+    const char* getShader(Shader shader, size_t* size) const noexcept {
+        ShaderReference const& reference = mShadersReference[size_t(shader)];
+        if (reference.data) {
+            *size = reference.size;
+            return reference.data;
+        }
+        utils::CString const& source = mShadersSource[size_t(shader)];
+        *size = source.size();
+        return source.c_str();
+    }
+
     std::array<UniformInterfaceBlock const*, NUM_UNIFORM_BINDINGS> const&
     getUniformInterfaceBlocks() const noexcept {
         return mUniformInterfaceBlocks;
@@ -97,6 +133,10 @@ public:
         return mSamplerInterfaceBlocks;
     }
 
+    UniformInterfaceBlock const* getPushConstants() const noexcept {
+        return mPushConstants;
+    }
+
     const SamplerBindingMap* getSamplerBindings() const {
         return mSamplerBindings;
     }
@@ -105,6 +145,10 @@ public:
         return mName;
     }
 
+    std::vector<SpecializationConstant> const& getSpecializationConstants() const noexcept {
+        return mSpecializationConstants;
+    }
+
     uint8_t getVariant() const noexcept {
         return mVariant;
     }
@@ -121,7 +165,15 @@ private:
     std::array<UniformInterfaceBlock const *, NUM_UNIFORM_BINDINGS> mUniformInterfaceBlocks;
     std::array<SamplerInterfaceBlock const *, NUM_SAMPLER_BINDINGS> mSamplerInterfaceBlocks;
     const SamplerBindingMap* mSamplerBindings = nullptr;
+    const UniformInterfaceBlock* mPushConstants = nullptr;
+    struct ShaderReference {
+        const char* data = nullptr;
+        size_t size = 0;
+    };
+
     std::array<utils::CString, NUM_SHADER_TYPES> mShadersSource;
+    std::array<ShaderReference, NUM_SHADER_TYPES> mShadersReference;
+    std::vector<SpecializationConstant> mSpecializationConstants;
     size_t mSamplerCount = 0;
     utils::CString mName;
     uint8_t mVariant;
@@ -96,13 +96,19 @@ static Pool sMemoryPool;
 
 
 UniformBuffer::UniformBuffer(size_t size) noexcept
+    : UniformBuffer(size, 0) {
+    memset(mBuffer, 0, size);
+}
+
+UniformBuffer::UniformBuffer(size_t size, size_t offset) noexcept
     : mBuffer(mStorage),
       mSize(uint32_t(size)),
-      mSomethingDirty(true) {
+      mOffset(uint32_t(offset)),
+      mDirtyBegin(0),
+      mDirtyEnd(uint32_t(size)) {
     if (UTILS_LIKELY(size > sizeof(mStorage))) {
         mBuffer = UniformBuffer::alloc(size);
     }
-    memset(mBuffer, 0, size);
 }
 
 UniformBuffer::UniformBuffer(UniformInterfaceBlock const& uib) noexcept
@@ -112,7 +118,9 @@ UniformBuffer::UniformBuffer(UniformInterfaceBlock const& uib) noexcept
 UniformBuffer::UniformBuffer(const UniformBuffer& rhs)
         : mBuffer(mStorage),
           mSize(rhs.mSize),
-          mSomethingDirty(rhs.mSomethingDirty) {
+          mOffset(rhs.mOffset),
+          mDirtyBegin(rhs.mDirtyBegin),
+          mDirtyEnd(rhs.mDirtyEnd) {
     if (UTILS_LIKELY(mSize > sizeof(mStorage))) {
         mBuffer = UniformBuffer::alloc(rhs.mSize);
     }
@@ -122,7 +130,9 @@ UniformBuffer::UniformBuffer(const UniformBuffer& rhs)
 UniformBuffer::UniformBuffer(UniformBuffer&& rhs) noexcept
         : mBuffer(rhs.mBuffer),
           mSize(rhs.mSize),
-          mSomethingDirty(rhs.mSomethingDirty) {
+          mOffset(rhs.mOffset),
+          mDirtyBegin(rhs.mDirtyBegin),
+          mDirtyEnd(rhs.mDirtyEnd) {
     if (UTILS_LIKELY(rhs.isLocalStorage())) {
         mBuffer = mStorage;
         memcpy(mBuffer, rhs.mBuffer, mSize);
@@ -133,7 +143,9 @@ UniformBuffer::UniformBuffer(UniformBuffer&& rhs) noexcept
 
 UniformBuffer& UniformBuffer::operator=(UniformBuffer&& rhs) noexcept {
     if (this != &rhs) {
-        mSomethingDirty = rhs.mSomethingDirty;
+        mOffset = rhs.mOffset;
+        mDirtyBegin = rhs.mDirtyBegin;
+        mDirtyEnd = rhs.mDirtyEnd;
         if (UTILS_LIKELY(rhs.isLocalStorage())) {
             mBuffer = mStorage;
             mSize = rhs.mSize;
@@ -146,6 +158,13 @@ UniformBuffer& UniformBuffer::operator=(UniformBuffer&& rhs) noexcept {
     return *this;
 }
 
+UniformBuffer UniformBuffer::copyDirtyRange() const noexcept {
+    const size_t size = getDirtySize();
+    UniformBuffer buffer(size, mOffset + mDirtyBegin);
+    memcpy(buffer.mBuffer, static_cast<char const*>(mBuffer) + mDirtyBegin, size);
+    return buffer;
+}
+
 void* UniformBuffer::alloc(size_t size) noexcept {
     return sMemoryPool.get(size);
 }
@@ -156,7 +175,8 @@ void UniformBuffer::free(void* addr, size_t size) noexcept {
 
 #if !defined(NDEBUG)
 utils::io::ostream& operator<<(utils::io::ostream& out, const UniformBuffer& rhs) {
-    return out << "UniformBuffer(data=" << rhs.getBuffer() << ", size=" << rhs.getSize() << ")";
+    return out << "UniformBuffer(data=" << rhs.getBuffer() << ", size=" << rhs.getSize()
+               << ", offset=" << rhs.getOffset() << ")";
 }
 #endif
 } // namespace filament
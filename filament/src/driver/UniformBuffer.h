@@ -38,6 +38,9 @@ public:
 
     // create a uniform buffer of a given size in bytes
     explicit UniformBuffer(size_t size) noexcept;
+
+    // create a uniform buffer holding 'size' bytes at 'offset' in the driver's buffer
+    UniformBuffer(size_t size, size_t offset) noexcept;
     explicit UniformBuffer(UniformInterfaceBlock const& uib) noexcept;
 
     // can be copy-constructed. Needed to create temporary copies.
@@ -64,7 +67,15 @@ public:
     // invalidate a range of uniforms and return a pointer to it. offset and size given in bytes
     void* invalidateUniforms(size_t offset, size_t size) {
         assert(offset + size <= mSize);
-        mSomethingDirty = true;
+        const uint32_t begin = uint32_t(offset);
+        const uint32_t end = uint32_t(offset + size);
+        if (UTILS_LIKELY(isDirty())) {
+            mDirtyBegin = std::min(mDirtyBegin, begin);
+            mDirtyEnd = std::max(mDirtyEnd, end);
+        } else {
+            mDirtyBegin = begin;
+            mDirtyEnd = end;
+        }
         return static_cast<char*>(mBuffer) + offset;
     }
 
@@ -74,11 +85,21 @@ public:
     // size of the uniform buffer in bytes
     size_t getSize() const noexcept { return mSize; }
 
+    // offset of this buffer's content in the driver's buffer, in bytes
+    size_t getOffset() const noexcept { return mOffset; }
+
     // return if any uniform has been changed
-    bool isDirty() const noexcept { return mSomethingDirty; }
+    bool isDirty() const noexcept { return mDirtyEnd > mDirtyBegin; }
+
+    // the range of modified uniforms, in bytes. A single range covers all the modifications.
+    size_t getDirtyOffset() const noexcept { return mDirtyBegin; }
+    size_t getDirtySize() const noexcept { return mDirtyEnd - mDirtyBegin; }
 
     // mark the whole buffer as clean (no modified uniforms)
-    void clean() const noexcept { mSomethingDirty = false; }
+    void clean() const noexcept { mDirtyBegin = mDirtyEnd = 0; }
+
+    // return a copy of the modified range only, to send to the driver instead of the whole buffer
+    UniformBuffer copyDirtyRange() const noexcept;
 
     /*
      * -----------------------------------------------
@@ -157,11 +178,13 @@ private:
 
     // TODO: we need a better to calculate this local storage.
     // Probably the better thing to do would be to use a special allocator.
-    // Local storage is limited by the total size of a handle (128 byte for GL)
+    // Local storage should be kept small, UniformBuffers are copied in the command stream
     char mStorage[96];
     void *mBuffer = nullptr;
     uint32_t mSize = 0;
-    mutable bool mSomethingDirty = false;
+    uint32_t mOffset = 0;
+    mutable uint32_t mDirtyBegin = 0;
+    mutable uint32_t mDirtyEnd = 0;
 };
 
 // specialization for float3 (which has a different alignment)
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_NOOP_CONTEXT_MANAGER_NOOP_H
+#define TNT_FILAMENT_DRIVER_NOOP_CONTEXT_MANAGER_NOOP_H
+
+#include "driver/noop/NoopDriver.h"
+
+#include <filament/driver/ExternalContext.h>
+
+namespace filament {
+
+// The ExternalContext of Backend::NOOP, there is no low-level API to initialize.
+class ContextManagerNoop final : public driver::ExternalContext {
+public:
+    std::unique_ptr<Driver> createDriver(void* const sharedGLContext) noexcept override {
+        return NoopDriver::create();
+    }
+
+    int getOSVersion() const noexcept final override { return 0; }
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_NOOP_CONTEXT_MANAGER_NOOP_H
@@ -32,7 +32,14 @@ public:
     static std::unique_ptr<Driver> create();
 
 private:
-    virtual ShaderModel getShaderModel() const noexcept override final { return ShaderModel::UNKNOWN; }
+    // the materials only need to be accepted, so this is the shader model they target
+    virtual ShaderModel getShaderModel() const noexcept override final {
+#ifdef ANDROID
+        return ShaderModel::GL_ES_30;
+#else
+        return ShaderModel::GL_CORE_41;
+#endif
+    }
 
     /*
      * Driver interface
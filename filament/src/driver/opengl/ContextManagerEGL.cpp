@@ -21,6 +21,7 @@
 #include <assert.h>
 #include <dlfcn.h>
 
+#include <algorithm>
 #include <string>
 #include <unordered_set>
 
@@ -71,11 +72,18 @@ UTILS_PRIVATE PFNEGLCLIENTWAITSYNCKHRPROC eglClientWaitSyncKHR;
 UTILS_PRIVATE PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR;
 UTILS_PRIVATE PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR;
 UTILS_PRIVATE PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC eglGetNativeClientBufferANDROID;
+#ifdef EGL_ANDROID_presentation_time
+UTILS_PRIVATE PFNEGLPRESENTATIONTIMEANDROIDPROC eglPresentationTimeANDROID;
+#endif
+UTILS_PRIVATE PFNEGLSETDAMAGEREGIONKHRPROC eglSetDamageRegionKHR;
+UTILS_PRIVATE PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC eglSwapBuffersWithDamageKHR;
 }
 using namespace glext;
 
 using EGLStream = ExternalContext::Stream;
 
+constexpr ContextManagerEGL::DamageRect ContextManagerEGL::FULL_DAMAGE;
+
 // ---------------------------------------------------------------------------------------------
 // Utilities
 // ---------------------------------------------------------------------------------------------
@@ -524,6 +532,17 @@ std::unique_ptr<Driver> ContextManagerEGL::createDriver(void* const sharedGLCont
     eglCreateImageKHR = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
     eglDestroyImageKHR = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
     eglGetNativeClientBufferANDROID = (PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC) eglGetProcAddress("eglGetNativeClientBufferANDROID");
+#ifdef EGL_ANDROID_presentation_time
+    if (extensions.has("EGL_ANDROID_presentation_time")) {
+        eglPresentationTimeANDROID = (PFNEGLPRESENTATIONTIMEANDROIDPROC) eglGetProcAddress("eglPresentationTimeANDROID");
+    }
+#endif
+    if (extensions.has("EGL_KHR_partial_update")) {
+        eglSetDamageRegionKHR = (PFNEGLSETDAMAGEREGIONKHRPROC) eglGetProcAddress("eglSetDamageRegionKHR");
+    }
+    if (extensions.has("EGL_KHR_swap_buffers_with_damage")) {
+        eglSwapBuffersWithDamageKHR = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC) eglGetProcAddress("eglSwapBuffersWithDamageKHR");
+    }
 
     EGLint configsCount;
     EGLint configAttribs[] = {
@@ -660,6 +679,34 @@ ExternalContext::SwapChain* ContextManagerEGL::createSwapChain(
         logEglError("eglSurfaceAttrib(..., EGL_SWAP_BEHAVIOR, EGL_BUFFER_DESTROYED)");
         // this is not fatal
     }
+
+    // The swap interval belongs to the surface, it's set while the surface is current. EGL has
+    // no mailbox mode, not waiting for vsync is the closest.
+    if (flags & (driver::SWAP_CHAIN_CONFIG_PRESENT_MAILBOX |
+            driver::SWAP_CHAIN_CONFIG_PRESENT_IMMEDIATE)) {
+        EGLSurface current = mCurrentSurface;
+        makeCurrent(sur);
+        if (!eglSwapInterval(mEGLDisplay, 0)) {
+            logEglError("eglSwapInterval");
+        }
+        makeCurrent(current);
+    }
+    return (SwapChain*)sur;
+}
+
+ExternalContext::SwapChain* ContextManagerEGL::createHeadlessSwapChain(
+        uint32_t width, uint32_t height, uint64_t& flags) noexcept {
+    // the transparent config is the one we know supports pbuffers, see the dummy surface
+    EGLint attribs[] = {
+            EGL_WIDTH, EGLint(width),
+            EGL_HEIGHT, EGLint(height),
+            EGL_NONE
+    };
+    EGLSurface sur = eglCreatePbufferSurface(mEGLDisplay, mEGLTransparentConfig, attribs);
+    if (UTILS_UNLIKELY(sur == EGL_NO_SURFACE)) {
+        logEglError("eglCreatePbufferSurface");
+        return nullptr;
+    }
     return (SwapChain*)sur;
 }
 
@@ -668,6 +715,9 @@ void ContextManagerEGL::destroySwapChain(ExternalContext::SwapChain* swapChain)
     if (sur != EGL_NO_SURFACE) {
         makeCurrent(mEGLDummySurface);
         eglDestroySurface(mEGLDisplay, sur);
+        if (sur == mDamageSurface) {
+            mDamageSurface = EGL_NO_SURFACE;
+        }
     }
 }
 
@@ -681,8 +731,86 @@ void ContextManagerEGL::makeCurrent(ExternalContext::SwapChain* swapChain) noexc
 void ContextManagerEGL::commit(ExternalContext::SwapChain* swapChain) noexcept {
     EGLSurface sur = (EGLSurface) swapChain;
     if (sur != EGL_NO_SURFACE) {
-        eglSwapBuffers(mEGLDisplay, sur);
+        if (mHasFrameDamage && eglSwapBuffersWithDamageKHR) {
+            // the damage of this frame lets the compositor only recompose what changed
+            eglSwapBuffersWithDamageKHR(mEGLDisplay, sur, mFrameDamage.data(), 1);
+        } else {
+            eglSwapBuffers(mEGLDisplay, sur);
+        }
+
+        // remember what changed in each of the last frames presented on this surface, so that
+        // the next back buffers know what they missed, see setDamage()
+        if (sur != mDamageSurface) {
+            mDamageSurface = sur;
+            mDamageHistory.fill(FULL_DAMAGE);
+        }
+        std::move_backward(mDamageHistory.begin(), mDamageHistory.end() - 1,
+                mDamageHistory.end());
+        mDamageHistory[0] = mHasFrameDamage ? mFrameDamage : FULL_DAMAGE;
+    }
+    mHasFrameDamage = false;
+}
+
+bool ContextManagerEGL::setDamage(int32_t region[4]) noexcept {
+    EGLSurface sur = mCurrentSurface;
+    if (sur == mEGLDummySurface || sur == EGL_NO_SURFACE ||
+            (!eglSetDamageRegionKHR && !eglSwapBuffersWithDamageKHR)) {
+        return false;
+    }
+
+    mFrameDamage = { region[0], region[1], region[2], region[3] };
+    mHasFrameDamage = true;
+
+    // Without EGL_KHR_partial_update the content of the back buffer is undefined, the damage
+    // is only passed to eglSwapBuffersWithDamageKHR().
+    if (!eglSetDamageRegionKHR || sur != mDamageSurface) {
+        return false;
+    }
+
+    // The back buffer holds the frame presented 'age' frames ago, or nothing if the age is 0,
+    // so it must be brought up to date with the damage of the age - 1 frames presented since.
+    EGLint age = 0;
+    if (!eglQuerySurface(mEGLDisplay, sur, EGL_BUFFER_AGE_KHR, &age) ||
+            age <= 0 || age > EGLint(mDamageHistory.size() + 1)) {
+        return false;
     }
+    DamageRect redraw = mFrameDamage;
+    for (EGLint i = 0; i < age - 1; i++) {
+        DamageRect const& damage = mDamageHistory[i];
+        if (damage[2] < 0) {
+            return false;
+        }
+        if (!damage[2] || !damage[3]) {
+            continue;
+        }
+        if (!redraw[2] || !redraw[3]) {
+            redraw = damage;
+            continue;
+        }
+        const EGLint l = std::min(redraw[0], damage[0]);
+        const EGLint b = std::min(redraw[1], damage[1]);
+        const EGLint r = std::max(redraw[0] + redraw[2], damage[0] + damage[2]);
+        const EGLint t = std::max(redraw[1] + redraw[3], damage[1] + damage[3]);
+        redraw = { l, b, r - l, t - b };
+    }
+
+    // only the damage region is guaranteed to be updated by the next swap, this must be called
+    // before drawing into the back buffer
+    if (!eglSetDamageRegionKHR(mEGLDisplay, sur, redraw.data(), 1)) {
+        logEglError("eglSetDamageRegionKHR");
+        return false;
+    }
+    std::copy(redraw.begin(), redraw.end(), region);
+    return true;
+}
+
+void ContextManagerEGL::setPresentationTime(int64_t presentationTimeInNanosecond) noexcept {
+#ifdef EGL_ANDROID_presentation_time
+    if (eglPresentationTimeANDROID && mCurrentSurface != mEGLDummySurface) {
+        eglPresentationTimeANDROID(mEGLDisplay, mCurrentSurface,
+                (EGLnsecsANDROID)presentationTimeInNanosecond);
+    }
+#endif
 }
 
 ExternalContext::Fence* ContextManagerEGL::createFence() noexcept {
@@ -19,6 +19,8 @@
 
 #include <stdint.h>
 
+#include <array>
+
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 
@@ -42,9 +44,13 @@ public:
     void terminate() noexcept override;
 
     SwapChain* createSwapChain(void* nativewindow, uint64_t& flags) noexcept final;
+    SwapChain* createHeadlessSwapChain(uint32_t width, uint32_t height,
+            uint64_t& flags) noexcept final;
     void destroySwapChain(SwapChain* swapChain) noexcept final;
     void makeCurrent(SwapChain* swapChain) noexcept final;
     void commit(SwapChain* swapChain) noexcept final;
+    void setPresentationTime(int64_t presentationTimeInNanosecond) noexcept final;
+    bool setDamage(int32_t region[4]) noexcept final;
 
     bool canCreateFence() noexcept final { return true; }
     Fence* createFence() noexcept final;
@@ -75,6 +81,15 @@ private:
     EGLConfig mEGLTransparentConfig;
     int mOSVersion;
 
+    // {left, bottom, width, height}, a negative width means the whole surface
+    using DamageRect = std::array<EGLint, 4>;
+    static constexpr DamageRect FULL_DAMAGE = { 0, 0, -1, -1 };
+    DamageRect mFrameDamage = FULL_DAMAGE;  // damage of the frame being drawn
+    bool mHasFrameDamage = false;
+    EGLSurface mDamageSurface = EGL_NO_SURFACE;
+    // damage of the last frames presented on mDamageSurface, the most recent first
+    std::array<DamageRect, 4> mDamageHistory;
+
     ExternalStreamManagerAndroid& mExternalStreamManager;
     ExternalTextureManagerAndroid& mExternalTextureManager;
 };
@@ -25,6 +25,8 @@
 
 #include "driver/opengl/OpenGLDriver.h"
 
+#include <algorithm>
+
 #include <dlfcn.h>
 
 #include <iostream>
@@ -167,7 +169,30 @@ ExternalContext::SwapChain* ContextManagerGLX::createSwapChain(
     return (SwapChain*) nativeWindow;
 }
 
-void ContextManagerGLX::destroySwapChain(ExternalContext::SwapChain* /*swapChain*/) noexcept {
+ExternalContext::SwapChain* ContextManagerGLX::createHeadlessSwapChain(
+        uint32_t width, uint32_t height, uint64_t& flags) noexcept {
+    // Transparent swap chain is not supported
+    flags &= ~driver::SWAP_CHAIN_CONFIG_TRANSPARENT;
+    int pbufferAttribs[] = {
+            GLX_PBUFFER_WIDTH,  int(width),
+            GLX_PBUFFER_HEIGHT, int(height),
+            GL_NONE
+    };
+    GLXPbuffer sur = g_glx.createPbuffer(mGLXDisplay, mGLXConfig[0], pbufferAttribs);
+    if (sur) {
+        mPBuffers.push_back(sur);
+    }
+    return (SwapChain*) sur;
+}
+
+void ContextManagerGLX::destroySwapChain(ExternalContext::SwapChain* swapChain) noexcept {
+    // windows are owned by the application, only the headless swap chains are destroyed
+    auto pos = std::find(mPBuffers.begin(), mPBuffers.end(), (GLXPbuffer) swapChain);
+    if (pos != mPBuffers.end()) {
+        g_glx.setCurrentContext(mGLXDisplay, mDummySurface, mDummySurface, mGLXContext);
+        g_glx.destroyPbuffer(mGLXDisplay, *pos);
+        mPBuffers.erase(pos);
+    }
 }
 
 void ContextManagerGLX::makeCurrent(ExternalContext::SwapChain* swapChain) noexcept {
@@ -17,15 +17,47 @@
 #include "driver/opengl/ContextManagerWebGL.h"
 #include "driver/opengl/OpenGLDriver.h"
 
+#include <utils/Log.h>
+
 namespace filament {
 
 using namespace driver;
+using namespace utils;
 
 std::unique_ptr<Driver> ContextManagerWebGL::createDriver(void* const sharedGLContext) noexcept {
+#if defined(__EMSCRIPTEN_PTHREADS__)
+    // The driver runs on its own web worker, and a WebGL context can only be used by the thread
+    // that created it: the context is created here, on the canvas whose CSS selector is
+    // sharedGLContext ("#canvas" by default). When the browser can't transfer the canvas to the
+    // worker, the context lives on the main thread and the calls are proxied to it.
+    EmscriptenWebGLContextAttributes attributes;
+    emscripten_webgl_init_context_attributes(&attributes);
+    attributes.majorVersion = 2;
+    attributes.minorVersion = 0;
+    attributes.antialias = EM_FALSE;
+    attributes.explicitSwapControl = EM_TRUE;
+    attributes.renderViaOffscreenBackBuffer = EM_TRUE;
+    attributes.proxyContextToMainThread = EMSCRIPTEN_WEBGL_CONTEXT_PROXY_FALLBACK;
+    const char* canvas = sharedGLContext ? static_cast<const char*>(sharedGLContext) : "#canvas";
+    mContext = emscripten_webgl_create_context(canvas, &attributes);
+    if (mContext <= 0 ||
+            emscripten_webgl_make_context_current(mContext) != EMSCRIPTEN_RESULT_SUCCESS) {
+        slog.e << "Can't create a WebGL 2 context on " << canvas << io::endl;
+        return {};
+    }
+    return OpenGLDriver::create(this, nullptr);
+#else
     return OpenGLDriver::create(this, sharedGLContext);
+#endif
 }
 
 void ContextManagerWebGL::terminate() noexcept {
+#if defined(__EMSCRIPTEN_PTHREADS__)
+    if (mContext > 0) {
+        emscripten_webgl_destroy_context(mContext);
+        mContext = 0;
+    }
+#endif
 }
 
 ExternalContext::SwapChain* ContextManagerWebGL::createSwapChain(
@@ -40,6 +72,10 @@ void ContextManagerWebGL::makeCurrent(ExternalContext::SwapChain* swapChain) noe
 }
 
 void ContextManagerWebGL::commit(ExternalContext::SwapChain* swapChain) noexcept {
+#if defined(__EMSCRIPTEN_PTHREADS__)
+    // the driver thread never yields to the browser, the frame must be presented explicitly
+    emscripten_webgl_commit_frame();
+#endif
 }
 
 ExternalContext::Fence* ContextManagerWebGL::createFence() noexcept {
@@ -25,6 +25,8 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 
+#include <emscripten/html5.h>
+
 namespace filament {
 
 class ContextManagerWebGL final : public driver::ContextManagerGL {
@@ -54,6 +56,12 @@ public:
     void destroyExternalTextureStorage(ExternalTexture* ets) noexcept final override { }
 
     int getOSVersion() const noexcept final override { return 0; }
+
+private:
+#if defined(__EMSCRIPTEN_PTHREADS__)
+    // created by the driver thread, which is the only one using it
+    EMSCRIPTEN_WEBGL_CONTEXT_HANDLE mContext = 0;
+#endif
 };
 
 using ContextManager = filament::ContextManagerWebGL;
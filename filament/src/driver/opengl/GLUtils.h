@@ -38,6 +38,16 @@ void checkFramebufferStatus(utils::io::ostream& out, const char* function, size_
 #define CHECK_GL_FRAMEBUFFER_STATUS(out) { GLUtils::checkFramebufferStatus(out, __PRETTY_FUNCTION__, __LINE__); }
 #endif
 
+// 64-bits FNV-1a hash, stable across runs and platforms (used by the program cache keys)
+inline uint64_t hash(void const* data, size_t size, uint64_t seed = 0xcbf29ce484222325ULL) noexcept {
+    uint8_t const* p = static_cast<uint8_t const*>(data);
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
 constexpr inline GLuint getComponentCount(filament::driver::ElementType type) noexcept {
     using ElementType = filament::driver::ElementType;
     switch (type) {
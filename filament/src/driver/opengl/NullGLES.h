@@ -38,6 +38,7 @@ inline void glClearStencil(GLint) { }
 inline void glClearDepthf(GLfloat) { }
 
 inline void glBindBufferBase(GLenum, GLuint, GLuint) { }
+inline void glBindBufferRange(GLenum, GLuint, GLuint, GLintptr, GLsizeiptr) { }
 inline void glBindVertexArray (GLuint) { }
 inline void glBindTexture (GLenum, GLuint)   { }
 inline void glBindBuffer (GLenum, GLuint) { }
@@ -71,6 +72,7 @@ inline void glRenderbufferStorage (GLenum, GLenum, GLsizei, GLsizei) { }
 
 inline void glClear(GLbitfield) { }
 inline void glDrawRangeElements(GLenum, GLuint, GLuint, GLsizei, GLenum, const void *)  { }
+inline void glDrawElementsInstanced(GLenum, GLsizei, GLenum, const void *, GLsizei)  { }
 inline void glBlitFramebuffer (GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLbitfield, GLenum) { }
 inline void glReadPixels (GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void *) { }
 
@@ -96,7 +96,6 @@ std::unique_ptr<Driver> OpenGLDriver::create(
 
 OpenGLDriver::OpenGLDriver(ContextManagerGL* externalContext) noexcept
         : DriverBase(new ConcreteDispatcher<OpenGLDriver>(this)),
-          mHandleArena("Handles", 2U * 1024U * 1024U), // TODO: set the amount in configuration
           mSamplerMap(32),
           mContextManager(*externalContext) {
     state.enables.caps.set(getIndexForCap(GL_DITHER));
@@ -170,6 +169,15 @@ OpenGLDriver::OpenGLDriver(ContextManagerGL* externalContext) noexcept
     };
     mShaderModel = shaderModel;
 
+    if (ext.EXT_disjoint_timer_query) {
+        // some implementations have timer queries but no timestamps (0 bits)
+        GLint bits = 0;
+        glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+        ext.timestamp_queries = bits > 0;
+        // glGetQueryiv() doesn't necessarily accept GL_TIMESTAMP on ES
+        glGetError();
+    }
+
     /*
      * Set our default state
      */
@@ -202,10 +210,33 @@ OpenGLDriver::OpenGLDriver(ContextManagerGL* externalContext) noexcept
     // For the shadow pass
     glPolygonOffset(1.0f, 1.0f);
 
+    // Use the [0, 1] clip-space depth range when we can, like Vulkan. This is needed for
+    // reverse-Z to actually improve the depth precision, see isClipSpaceZeroToOne().
+    if (ext.clip_control) {
+#if defined(GL_ES_VERSION_3_1)
+#ifdef GL_EXT_clip_control
+        glClipControlEXT(GL_LOWER_LEFT_EXT, GL_ZERO_TO_ONE_EXT);
+#endif
+#else
+        glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+#endif
+        CHECK_GL_ERROR(utils::slog.e)
+    }
+
     // On some implementation we need to clear the viewport with a triangle, for performance
     // reasons
     initClearProgram();
 
+    // Program binaries can only be cached if the driver has at least one format. They're only
+    // valid for the exact same GPU and driver, so both are part of the cache keys.
+#if !defined(__EMSCRIPTEN__)
+    GLint programBinaryFormatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &programBinaryFormatCount);
+    mProgramBinarySupported = programBinaryFormatCount > 0;
+#endif
+    mProgramCacheSeed = GLUtils::hash(renderer, strlen(renderer));
+    mProgramCacheSeed = GLUtils::hash(version, strlen(version), mProgramCacheSeed);
+
     // Initialize the blitter only if we have OES_EGL_image_external_essl3
     if (ext.OES_EGL_image_external_essl3) {
         mOpenGLBlitter = new OpenGLBlitter(*this);
@@ -233,6 +264,21 @@ void OpenGLDriver::initExtensionsGLES(GLint major, GLint minor, std::set<StaticS
     ext.OES_EGL_image_external_essl3 = hasExtension(exts, "GL_OES_EGL_image_external_essl3");
     ext.EXT_debug_marker = hasExtension(exts, "GL_EXT_debug_marker");
     ext.EXT_color_buffer_half_float = hasExtension(exts, "GL_EXT_color_buffer_half_float");
+#ifdef GL_EXT_disjoint_timer_query
+    ext.EXT_disjoint_timer_query = hasExtension(exts, "GL_EXT_disjoint_timer_query");
+#endif
+#ifdef GL_EXT_clip_control
+    ext.clip_control = hasExtension(exts, "GL_EXT_clip_control");
+#endif
+    ext.KHR_parallel_shader_compile = hasExtension(exts, "GL_KHR_parallel_shader_compile");
+    ext.texture_storage_multisample = (major == 3 && minor >= 1) || major > 3;
+#ifdef GL_EXT_multisampled_render_to_texture
+    ext.EXT_multisampled_render_to_texture =
+            hasExtension(exts, "GL_EXT_multisampled_render_to_texture");
+#endif
+    ext.EXT_shader_framebuffer_fetch = hasExtension(exts, "GL_EXT_shader_framebuffer_fetch");
+    ext.vertex_attrib_binding = (major == 3 && minor >= 1) || major > 3;
+    ext.compute_shader = (major == 3 && minor >= 1) || major > 3;
 }
 
 void OpenGLDriver::initExtensionsGL(GLint major, GLint minor, std::set<StaticString> const& exts) {
@@ -242,6 +288,22 @@ void OpenGLDriver::initExtensionsGL(GLint major, GLint minor, std::set<StaticStr
     ext.OES_EGL_image_external_essl3 = hasExtension(exts, "GL_OES_EGL_image_external_essl3");
     ext.EXT_debug_marker = hasExtension(exts, "GL_EXT_debug_marker");
     ext.EXT_color_buffer_half_float = true;  // Assumes core profile.
+    ext.EXT_disjoint_timer_query = true;     // Timer queries are core since OpenGL 3.3
+    ext.clip_control = (major == 4 && minor >= 5) || hasExtension(exts, "GL_ARB_clip_control");
+    ext.KHR_parallel_shader_compile = hasExtension(exts, "GL_KHR_parallel_shader_compile");
+    ext.texture_storage_multisample = (major == 4 && minor >= 3) ||
+            hasExtension(exts, "GL_ARB_texture_storage_multisample");
+#if defined(GL_VERSION_4_3) || defined(GL_ARB_vertex_attrib_binding)
+    ext.vertex_attrib_binding = (major == 4 && minor >= 3) ||
+            hasExtension(exts, "GL_ARB_vertex_attrib_binding");
+#endif
+#ifdef GL_ARB_bindless_texture
+    ext.ARB_bindless_texture = hasExtension(exts, "GL_ARB_bindless_texture");
+#endif
+#if defined(GL_VERSION_4_3)
+    // the storage buffers and memory barriers come with the compute shaders
+    ext.compute_shader = (major == 4 && minor >= 3) || major > 4;
+#endif
 }
 
 void OpenGLDriver::terminate() {
@@ -250,6 +312,19 @@ void OpenGLDriver::terminate() {
         glDeleteSamplers(1, &item.second);
     }
     mSamplerMap.clear();
+    while (!mPendingReadPixels.empty()) {
+        updatePendingReadPixels(true);
+    }
+    updatePendingAcquiredImages(true);
+    for (auto const& buffer : mReadPixelsBuffers) {
+        glDeleteBuffers(1, &buffer.pbo);
+    }
+    mReadPixelsBuffers.clear();
+    for (auto const& item : mVertexLayouts) {
+        glDeleteVertexArrays(1, &item.second.gl.vao);
+    }
+    mVertexLayouts.clear();
+    state.vao.p = &mDefaultVAO;
     if (mOpenGLBlitter) {
         mOpenGLBlitter->terminate();
     }
@@ -331,33 +406,42 @@ void OpenGLDriver::terminateClearProgram() noexcept {
 
 void OpenGLDriver::setScissor(GLint left, GLint bottom, GLsizei width, GLsizei height) noexcept {
     vec4gli scissor(left, bottom, width, height);
-    update_state(state.window.scissor, scissor, [&]() {
-        glScissor(left, bottom, width, height);
+    if (UTILS_UNLIKELY(mDamageScissor)) {
+        // the swap chain outside of the frame's damage still holds the previous frame
+        const int64_t l = std::max(int64_t(left), int64_t(mFrameDamage.x));
+        const int64_t b = std::max(int64_t(bottom), int64_t(mFrameDamage.y));
+        const int64_t r = std::min(int64_t(left) + width, int64_t(mFrameDamage.x) + mFrameDamage.z);
+        const int64_t t = std::min(int64_t(bottom) + height, int64_t(mFrameDamage.y) + mFrameDamage.w);
+        scissor = vec4gli(GLint(l), GLint(b),
+                GLsizei(std::max(r - l, int64_t(0))), GLsizei(std::max(t - b, int64_t(0))));
+    }
+    update_state(StateStats::OTHER, state.window.scissor, scissor, [scissor]() {
+        glScissor(scissor.x, scissor.y, scissor.z, scissor.w);
     });
 }
 
 void OpenGLDriver::setViewport(GLint left, GLint bottom, GLsizei width, GLsizei height) noexcept {
     vec4gli viewport(left, bottom, width, height);
-    update_state(state.window.viewport, viewport, [&]() {
+    update_state(StateStats::OTHER, state.window.viewport, viewport, [&]() {
         glViewport(left, bottom, width, height);
     });
 }
 
 void OpenGLDriver::setClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a) noexcept {
     float4 color(r, g, b, a);
-    update_state(state.clears.color, color, [&]() {
+    update_state(StateStats::OTHER, state.clears.color, color, [&]() {
         glClearColor(r, g, b, a);
     });
 }
 
 void OpenGLDriver::setClearDepth(GLfloat depth) noexcept {
-    update_state(state.clears.depth, depth, [&]() {
+    update_state(StateStats::OTHER, state.clears.depth, depth, [&]() {
         glClearDepthf(depth);
     });
 }
 
 void OpenGLDriver::setClearStencil(GLint stencil) noexcept {
-    update_state(state.clears.stencil, stencil, [&]() {
+    update_state(StateStats::OTHER, state.clears.stencil, stencil, [&]() {
         glClearStencil(stencil);
     });
 }
@@ -389,8 +473,10 @@ void OpenGLDriver::bindBuffer(GLenum target, GLuint buffer) noexcept {
         // GL_ELEMENT_ARRAY_BUFFER is a special case, where the currently bound VAO remembers
         // the index buffer, unless there are no VAO bound (see: bindVertexArray)
         assert(state.vao.p);
-        if (state.buffers.targets[targetIndex].genericBinding != buffer
-                || ((state.vao.p != &mDefaultVAO) && (state.vao.p->gl.elementArray != buffer))) {
+        const bool changed = state.buffers.targets[targetIndex].genericBinding != buffer
+                || ((state.vao.p != &mDefaultVAO) && (state.vao.p->gl.elementArray != buffer));
+        countStateChange(StateStats::BUFFER, changed);
+        if (changed) {
             state.buffers.targets[targetIndex].genericBinding = buffer;
             if (state.vao.p != &mDefaultVAO) {
                 state.vao.p->gl.elementArray = buffer;
@@ -398,38 +484,68 @@ void OpenGLDriver::bindBuffer(GLenum target, GLuint buffer) noexcept {
             glBindBuffer(target, buffer);
         }
     } else {
-        update_state(state.buffers.targets[targetIndex].genericBinding, buffer, [&]() {
-            glBindBuffer(target, buffer);
-        });
+        update_state(StateStats::BUFFER, state.buffers.targets[targetIndex].genericBinding, buffer,
+                [&]() { glBindBuffer(target, buffer); });
     }
 }
 
 void OpenGLDriver::bindBufferBase(GLenum target, GLuint index, GLuint buffer) noexcept {
     size_t targetIndex = getIndexForBufferTarget(target);
+    auto& targetState = state.buffers.targets[targetIndex];
     // this ALSO sets the generic binding
-    if (state.buffers.targets[targetIndex].buffers[index] != buffer
-            || state.buffers.targets[targetIndex].genericBinding != buffer) {
-        state.buffers.targets[targetIndex].buffers[index] = buffer;
-        state.buffers.targets[targetIndex].genericBinding = buffer;
+    const bool changed = targetState.buffers[index] != buffer
+            || targetState.sizes[index] != 0
+            || targetState.genericBinding != buffer;
+    countStateChange(target == GL_UNIFORM_BUFFER ?
+            StateStats::UNIFORM_BUFFER : StateStats::BUFFER, changed);
+    if (changed) {
+        targetState.buffers[index] = buffer;
+        targetState.offsets[index] = 0;
+        targetState.sizes[index] = 0;
+        targetState.genericBinding = buffer;
         glBindBufferBase(target, index, buffer);
     }
 }
 
+void OpenGLDriver::bindBufferRange(GLenum target, GLuint index, GLuint buffer,
+        GLintptr offset, GLsizeiptr size) noexcept {
+    size_t targetIndex = getIndexForBufferTarget(target);
+    auto& targetState = state.buffers.targets[targetIndex];
+    // this ALSO sets the generic binding
+    const bool changed = targetState.buffers[index] != buffer
+            || targetState.offsets[index] != offset
+            || targetState.sizes[index] != size
+            || targetState.genericBinding != buffer;
+    countStateChange(target == GL_UNIFORM_BUFFER ?
+            StateStats::UNIFORM_BUFFER : StateStats::BUFFER, changed);
+    if (changed) {
+        targetState.buffers[index] = buffer;
+        targetState.offsets[index] = offset;
+        targetState.sizes[index] = size;
+        targetState.genericBinding = buffer;
+        glBindBufferRange(target, index, buffer, offset, size);
+    }
+}
+
 void OpenGLDriver::bindFramebuffer(GLenum target, GLuint buffer) noexcept {
     switch (target) {
         case GL_FRAMEBUFFER:
+            countStateChange(StateStats::FRAMEBUFFER,
+                    state.draw_fbo != buffer || state.read_fbo != buffer);
             if (state.draw_fbo != buffer || state.read_fbo != buffer) {
                 state.draw_fbo = state.read_fbo = buffer;
                 glBindFramebuffer(target, buffer);
             }
             break;
         case GL_DRAW_FRAMEBUFFER:
+            countStateChange(StateStats::FRAMEBUFFER, state.draw_fbo != buffer);
             if (state.draw_fbo != buffer) {
                 state.draw_fbo = buffer;
                 glBindFramebuffer(target, buffer);
             }
             break;
         case GL_READ_FRAMEBUFFER:
+            countStateChange(StateStats::FRAMEBUFFER, state.read_fbo != buffer);
             if (state.read_fbo != buffer) {
                 state.read_fbo = buffer;
                 glBindFramebuffer(target, buffer);
@@ -441,8 +557,12 @@ void OpenGLDriver::bindFramebuffer(GLenum target, GLuint buffer) noexcept {
 }
 
 void OpenGLDriver::bindVertexArray(GLRenderPrimitive const* p) noexcept {
+    if (UTILS_UNLIKELY(p && p->gl.layout)) {
+        bindVertexLayout(p);
+        return;
+    }
     GLRenderPrimitive* vao = p ? const_cast<GLRenderPrimitive *>(p) : &mDefaultVAO;
-    update_state(state.vao.p, vao, [&]() {
+    update_state(StateStats::VERTEX_ARRAY, state.vao.p, vao, [&]() {
         glBindVertexArray(vao->gl.vao);
         // update GL_ELEMENT_ARRAY_BUFFER, which is updated by glBindVertexArray
         size_t targetIndex = getIndexForBufferTarget(GL_ELEMENT_ARRAY_BUFFER);
@@ -455,17 +575,86 @@ void OpenGLDriver::bindVertexArray(GLRenderPrimitive const* p) noexcept {
     });
 }
 
+void OpenGLDriver::bindVertexLayout(GLRenderPrimitive const* rp) noexcept {
+    // the VAO is shared by all the primitives with this vertex format, only the buffers
+    // need to be bound again when the primitive changes
+    GLVertexLayout* const layout = rp->gl.layout;
+    bindVertexArray(layout);
+    const bool changed = layout->current != rp;
+    countStateChange(StateStats::VERTEX_ARRAY, changed);
+    if (changed) {
+        layout->current = rp;
+#if GLES31_HEADERS || defined(GL_VERSION_4_3) || defined(GL_ARB_vertex_attrib_binding)
+        for (size_t i = 0, n = rp->gl.buffers.size(); i < n; i++) {
+            if (layout->gl.vertexAttribArray[i]) {
+                glBindVertexBuffer(GLuint(i), rp->gl.buffers[i],
+                        rp->gl.offsets[i], rp->gl.strides[i]);
+            }
+        }
+#endif
+        // this records the index buffer into the layout's VAO
+        bindBuffer(GL_ELEMENT_ARRAY_BUFFER, rp->gl.elementArray);
+    }
+}
+
+uint64_t OpenGLDriver::getVertexLayoutKey(Driver::AttributeArray const& attributes,
+        uint32_t enabledAttributes) noexcept {
+    // 6 bits per attribute for its type and normalization, then the enabled attributes
+    static_assert(MAX_ATTRIBUTE_BUFFER_COUNT * 6 + MAX_ATTRIBUTE_BUFFER_COUNT <= 64,
+            "the vertex layout doesn't fit in the key");
+    uint64_t key = 0;
+    for (size_t i = 0, n = attributes.size(); i < n; i++) {
+        if (enabledAttributes & (1U << i)) {
+            const uint64_t format = (uint64_t(attributes[i].type) << 1u) |
+                                    (attributes[i].normalized ? 1u : 0u);
+            key |= (format & 0x3Fu) << (i * 6u);
+        }
+    }
+    const uint64_t enabled = enabledAttributes & ((1u << MAX_ATTRIBUTE_BUFFER_COUNT) - 1u);
+    return key | (enabled << (MAX_ATTRIBUTE_BUFFER_COUNT * 6u));
+}
+
+OpenGLDriver::GLVertexLayout* OpenGLDriver::getVertexLayout(
+        Driver::AttributeArray const& attributes, uint32_t enabledAttributes) noexcept {
+    const uint64_t key = getVertexLayoutKey(attributes, enabledAttributes);
+    auto pos = mVertexLayouts.find(key);
+    if (pos != mVertexLayouts.end()) {
+        return &pos->second;
+    }
+
+    GLVertexLayout* const layout = &mVertexLayouts[key];
+    glGenVertexArrays(1, &layout->gl.vao);
+    bindVertexArray(layout);
+#if GLES31_HEADERS || defined(GL_VERSION_4_3) || defined(GL_ARB_vertex_attrib_binding)
+    for (size_t i = 0, n = attributes.size(); i < n; i++) {
+        if (enabledAttributes & (1U << i)) {
+            // each attribute has its own binding, which holds the offset and stride
+            glVertexAttribFormat(GLuint(i),
+                    getComponentCount(attributes[i].type),
+                    getComponentType(attributes[i].type),
+                    getNormalization(attributes[i].normalized),
+                    0);
+            glVertexAttribBinding(GLuint(i), GLuint(i));
+            enableVertexAttribArray(GLuint(i));
+        }
+    }
+#endif
+    CHECK_GL_ERROR(utils::slog.e)
+    return layout;
+}
+
 void OpenGLDriver::bindTexture(GLuint unit, GLuint target, GLuint texId, size_t targetIndex) noexcept {
     assert(targetIndex == getIndexForTextureTarget(target));
     assert(targetIndex < TEXTURE_TARGET_COUNT);
-    update_state(state.textures.units[unit].targets[targetIndex].texture_id, texId, [&]() {
+    update_state(StateStats::TEXTURE,
+            state.textures.units[unit].targets[targetIndex].texture_id, texId, [&]() {
         activeTexture(unit);
         glBindTexture(target, texId);
     }, (target == GL_TEXTURE_EXTERNAL_OES) && bugs.texture_external_needs_rebind);
 }
 
 void OpenGLDriver::useProgram(GLuint program) noexcept {
-    update_state(state.program.use, program, [&]() {
+    update_state(StateStats::PROGRAM, state.program.use, program, [&]() {
         glUseProgram(program);
     });
 }
@@ -479,6 +668,7 @@ void OpenGLDriver::useProgram(OpenGLProgram* p) noexcept {
 void OpenGLDriver::enableVertexAttribArray(GLuint index) noexcept {
     assert(state.vao.p);
     assert(index < state.vao.p->gl.vertexAttribArray.size());
+    countStateChange(StateStats::VERTEX_ARRAY, !state.vao.p->gl.vertexAttribArray[index]);
     if (UTILS_UNLIKELY(!state.vao.p->gl.vertexAttribArray[index])) {
         state.vao.p->gl.vertexAttribArray.set(index);
         glEnableVertexAttribArray(index);
@@ -488,6 +678,7 @@ void OpenGLDriver::enableVertexAttribArray(GLuint index) noexcept {
 void OpenGLDriver::disableVertexAttribArray(GLuint index) noexcept {
     assert(state.vao.p);
     assert(index < state.vao.p->gl.vertexAttribArray.size());
+    countStateChange(StateStats::VERTEX_ARRAY, state.vao.p->gl.vertexAttribArray[index]);
     if (UTILS_UNLIKELY(state.vao.p->gl.vertexAttribArray[index])) {
         state.vao.p->gl.vertexAttribArray.unset(index);
         glDisableVertexAttribArray(index);
@@ -496,6 +687,7 @@ void OpenGLDriver::disableVertexAttribArray(GLuint index) noexcept {
 
 void OpenGLDriver::enable(GLenum cap) noexcept {
     size_t index = getIndexForCap(cap);
+    countStateChange(StateStats::RASTER, !state.enables.caps[index]);
     if (UTILS_UNLIKELY(!state.enables.caps[index])) {
         state.enables.caps.set(index);
         glEnable(cap);
@@ -504,6 +696,7 @@ void OpenGLDriver::enable(GLenum cap) noexcept {
 
 void OpenGLDriver::disable(GLenum cap) noexcept {
     size_t index = getIndexForCap(cap);
+    countStateChange(StateStats::RASTER, state.enables.caps[index]);
     if (UTILS_UNLIKELY(state.enables.caps[index])) {
         state.enables.caps.unset(index);
         glDisable(cap);
@@ -512,15 +705,17 @@ void OpenGLDriver::disable(GLenum cap) noexcept {
 
 void OpenGLDriver::cullFace(GLenum mode) noexcept {
     // WARNING: don't call this without updating mRasterState
-    update_state(state.raster.cullFace, mode, [&]() {
+    update_state(StateStats::RASTER, state.raster.cullFace, mode, [&]() {
         glCullFace(mode);
     });
 }
 
 void OpenGLDriver::blendEquation(GLenum modeRGB, GLenum modeA) noexcept {
     // WARNING: don't call this without updating mRasterState
-    if (UTILS_UNLIKELY(
-            state.raster.blendEquationRGB != modeRGB || state.raster.blendEquationA != modeA)) {
+    const bool changed =
+            state.raster.blendEquationRGB != modeRGB || state.raster.blendEquationA != modeA;
+    countStateChange(StateStats::RASTER, changed);
+    if (UTILS_UNLIKELY(changed)) {
         state.raster.blendEquationRGB = modeRGB;
         state.raster.blendEquationA   = modeA;
         glBlendEquationSeparate(modeRGB, modeA);
@@ -529,11 +724,13 @@ void OpenGLDriver::blendEquation(GLenum modeRGB, GLenum modeA) noexcept {
 
 void OpenGLDriver::blendFunction(GLenum srcRGB, GLenum srcA, GLenum dstRGB, GLenum dstA) noexcept {
     // WARNING: don't call this without updating mRasterState
-    if (UTILS_UNLIKELY(
+    const bool changed =
             state.raster.blendFunctionSrcRGB != srcRGB ||
             state.raster.blendFunctionSrcA != srcA ||
             state.raster.blendFunctionDstRGB != dstRGB ||
-            state.raster.blendFunctionDstA != dstA)) {
+            state.raster.blendFunctionDstA != dstA;
+    countStateChange(StateStats::RASTER, changed);
+    if (UTILS_UNLIKELY(changed)) {
         state.raster.blendFunctionSrcRGB = srcRGB;
         state.raster.blendFunctionSrcA = srcA;
         state.raster.blendFunctionDstRGB = dstRGB;
@@ -544,20 +741,20 @@ void OpenGLDriver::blendFunction(GLenum srcRGB, GLenum srcA, GLenum dstRGB, GLen
 
 void OpenGLDriver::colorMask(GLboolean flag) noexcept {
     // WARNING: don't call this without updating mRasterState
-    update_state(state.raster.colorMask, flag, [&]() {
+    update_state(StateStats::RASTER, state.raster.colorMask, flag, [&]() {
         glColorMask(flag, flag, flag, flag);
     });
 }
 void OpenGLDriver::depthMask(GLboolean flag) noexcept {
     // WARNING: don't call this without updating mRasterState
-    update_state(state.raster.depthMask, flag, [&]() {
+    update_state(StateStats::RASTER, state.raster.depthMask, flag, [&]() {
         glDepthMask(flag);
     });
 }
 
 void OpenGLDriver::depthFunc(GLenum func) noexcept {
     // WARNING: don't call this without updating mRasterState
-    update_state(state.raster.depthFunc, func, [&]() {
+    update_state(StateStats::RASTER, state.raster.depthFunc, func, [&]() {
         glDepthFunc(func);
     });
 }
@@ -661,6 +858,7 @@ default_case:
 
 // For reference on a 64-bits machine:
 //    GLFence                   :  8
+//    GLUniformBuffer           :  8        many
 //    GLIndexBuffer             : 12        moderate
 //    GLSamplerBuffer           : 16        moderate
 // -- less than 16 bytes
@@ -673,64 +871,21 @@ default_case:
 
 //    GLVertexBuffer            : 80        moderate
 //    GLStream                  : 120       few
-//    GLUniformBuffer           : 128       many
 // -- less than 128 bytes
 
 
-OpenGLDriver::HandleAllocator::HandleAllocator(const utils::HeapArea& area)
-        : mPool0(area.begin(),
-                  pointermath::add(area.begin(), (1 * area.getSize()) / 16)),
-          mPool1( pointermath::add(area.begin(), (1 * area.getSize()) / 16),
-                  pointermath::add(area.begin(), (6 * area.getSize()) / 16)),
-          mPool2( pointermath::add(area.begin(), (6 * area.getSize()) / 16),
-                  area.end()) {
-
-#ifndef NDEBUG
-    slog.d << "HwFence: " << sizeof(HwFence) << io::endl;
-    slog.d << "GLIndexBuffer: " << sizeof(GLIndexBuffer) << io::endl;
-    slog.d << "GLSamplerBuffer: " << sizeof(GLSamplerBuffer) << io::endl;
-    slog.d << "GLRenderPrimitive: " << sizeof(GLRenderPrimitive) << io::endl;
-    slog.d << "GLTexture: " << sizeof(GLTexture) << io::endl;
-    slog.d << "OpenGLProgram: " << sizeof(OpenGLProgram) << io::endl;
-    slog.d << "GLRenderTarget: " << sizeof(GLRenderTarget) << io::endl;
-    slog.d << "GLVertexBuffer: " << sizeof(GLVertexBuffer) << io::endl;
-    slog.d << "GLUniformBuffer: " << sizeof(GLUniformBuffer) << io::endl;
-    slog.d << "GLStream: " << sizeof(GLStream) << io::endl;
-#endif
-}
-
-void* OpenGLDriver::HandleAllocator::alloc(size_t size, size_t alignment, size_t extra) noexcept {
-    assert(size <= mPool2.getSize());
-    if (size <= mPool0.getSize()) return mPool0.alloc(size, 16, extra);
-    if (size <= mPool1.getSize()) return mPool1.alloc(size, 32, extra);
-    if (size <= mPool2.getSize()) return mPool2.alloc(size, 32, extra);
-    return nullptr;
-}
-
-void OpenGLDriver::HandleAllocator::free(void* p, size_t size) noexcept {
-    if (size <= mPool0.getSize()) { mPool0.free(p); return; }
-    if (size <= mPool1.getSize()) { mPool1.free(p); return; }
-    if (size <= mPool2.getSize()) { mPool2.free(p); return; }
-}
-
-
-// This is "NOINLINE" because it ends-up generating more code than we'd like because of
-// the locking (unfortunately, mHandleArena is accessed from 2 threads)
-UTILS_NOINLINE
-HandleBase::HandleId OpenGLDriver::allocateHandle(size_t size) noexcept {
-    void* addr = mHandleArena.alloc(size);
-    char* const base = (char *)mHandleArena.getArea().begin();
-    size_t offset = (char*)addr - base;
-    return HandleBase::HandleId(offset >> HandleAllocator::MIN_ALIGNMENT_SHIFT);
+template<typename B>
+Handle<B> OpenGLDriver::allocateHandle() noexcept {
+    const HandleBase::HandleId id = handleTable((B*)nullptr).allocate();
+    ASSERT_POSTCONDITION(id != HandleBase::nullid, "Too many driver handles of one type");
+    return Handle<B>(id);
 }
 
 template<typename D, typename B, typename ... ARGS>
 typename std::enable_if<std::is_base_of<B, D>::value, D>::type*
 OpenGLDriver::construct(Handle<B> const& handle, ARGS&& ... args) noexcept {
     assert(handle);
-    static_assert(sizeof(D) <= 128, "Handle<> too large");
-    D* addr = handle_cast<D *>(const_cast<Handle<B>&>(handle));
-    new(addr) D(std::forward<ARGS>(args)...);
+    D* addr = handleTable((B*)nullptr).construct(handle.getId(), std::forward<ARGS>(args)...);
 #if !defined(NDEBUG) && UTILS_HAS_RTTI
     addr->typeId = typeid(D).name();
 #endif
@@ -749,57 +904,97 @@ void OpenGLDriver::destruct(Handle<B>& handle, D const* p) noexcept {
         }
         const_cast<D *>(p)->typeId = "(deleted)";
 #endif
-        p->~D();
-        mHandleArena.free(const_cast<D*>(p), sizeof(D));
+        handleTable((B*)nullptr).destroy(handle.getId());
     }
 }
 
+UTILS_NOINLINE
+void OpenGLDriver::logDanglingHandle(HandleBase::HandleId id) noexcept {
+    slog.e << "Using handle " << id << " after it was destroyed" << io::endl;
+}
+
 Handle<HwVertexBuffer> OpenGLDriver::createVertexBufferSynchronous() noexcept {
-    return Handle<HwVertexBuffer>( allocateHandle(sizeof(GLVertexBuffer)) );
+    return allocateHandle<HwVertexBuffer>();
 }
 
 Handle<HwIndexBuffer> OpenGLDriver::createIndexBufferSynchronous() noexcept {
-    return Handle<HwIndexBuffer>( allocateHandle(sizeof(GLIndexBuffer)) );
+    return allocateHandle<HwIndexBuffer>();
 }
 
 Handle<HwRenderPrimitive> OpenGLDriver::createRenderPrimitiveSynchronous() noexcept {
-    return Handle<HwRenderPrimitive>( allocateHandle(sizeof(GLRenderPrimitive)) );
+    return allocateHandle<HwRenderPrimitive>();
 }
 
 Handle<HwProgram> OpenGLDriver::createProgramSynchronous() noexcept {
-    return Handle<HwProgram>( allocateHandle(sizeof(OpenGLProgram)) );
+    return allocateHandle<HwProgram>();
 }
 
 Handle<HwSamplerBuffer> OpenGLDriver::createSamplerBufferSynchronous() noexcept {
-    return Handle<HwSamplerBuffer>( allocateHandle(sizeof(GLSamplerBuffer)) );
+    return allocateHandle<HwSamplerBuffer>();
 }
 
 Handle<HwUniformBuffer> OpenGLDriver::createUniformBufferSynchronous() noexcept {
-    return Handle<HwUniformBuffer>( allocateHandle(sizeof(GLUniformBuffer)) );
+    return allocateHandle<HwUniformBuffer>();
+}
+
+Handle<HwStorageBuffer> OpenGLDriver::createStorageBufferSynchronous() noexcept {
+    return allocateHandle<HwStorageBuffer>();
+}
+
+Handle<HwProgram> OpenGLDriver::createComputeProgramSynchronous() noexcept {
+    return allocateHandle<HwProgram>();
 }
 
 Handle<HwTexture> OpenGLDriver::createTextureSynchronous() noexcept {
-    return Handle<HwTexture>( allocateHandle(sizeof(GLTexture)) );
+    return allocateHandle<HwTexture>();
 }
 
 Handle<HwRenderTarget> OpenGLDriver::createDefaultRenderTargetSynchronous() noexcept {
-    return Handle<HwRenderTarget>( allocateHandle(sizeof(GLRenderTarget)) );
+    return allocateHandle<HwRenderTarget>();
 }
 
 Handle<HwRenderTarget> OpenGLDriver::createRenderTargetSynchronous() noexcept {
-    return Handle<HwRenderTarget>( allocateHandle(sizeof(GLRenderTarget)) );
+    return allocateHandle<HwRenderTarget>();
+}
+
+Handle<HwRenderTarget> OpenGLDriver::createMultipleRenderTargetSynchronous() noexcept {
+    return allocateHandle<HwRenderTarget>();
 }
 
 Handle<HwFence> OpenGLDriver::createFenceSynchronous() noexcept {
-    return Handle<HwFence>( allocateHandle(sizeof(HwFence)) );
+    return allocateHandle<HwFence>();
+}
+
+Handle<HwTimerQuery> OpenGLDriver::createTimerQuerySynchronous() noexcept {
+    return allocateHandle<HwTimerQuery>();
 }
 
 Handle<HwSwapChain> OpenGLDriver::createSwapChainSynchronous() noexcept {
-    return Handle<HwSwapChain>( allocateHandle(sizeof(HwSwapChain)) );
+    return allocateHandle<HwSwapChain>();
+}
+
+Handle<HwSwapChain> OpenGLDriver::createSwapChainHeadlessSynchronous() noexcept {
+    return allocateHandle<HwSwapChain>();
 }
 
 Handle<HwStream> OpenGLDriver::createStreamFromTextureIdSynchronous() noexcept {
-    return Handle<HwStream>( allocateHandle(sizeof(GLStream)) );
+    return allocateHandle<HwStream>();
+}
+
+Handle<HwStream> OpenGLDriver::createStreamAcquiredSynchronous() noexcept {
+    return allocateHandle<HwStream>();
+}
+
+// figure out the size needed for a buffer of a vertex buffer
+static size_t getBufferSize(HwVertexBuffer const* vb, size_t index) noexcept {
+    size_t size = 0;
+    for (auto const& item : vb->attributes) {
+        if (item.buffer == index) {
+            size_t end = item.offset + vb->vertexCount * item.stride;
+            size = std::max(size, end);
+        }
+    }
+    return size;
 }
 
 void OpenGLDriver::createVertexBuffer(
@@ -817,17 +1012,11 @@ void OpenGLDriver::createVertexBuffer(
     glGenBuffers(n, vb->gl.buffers.data());
 
     for (GLsizei i = 0; i < n; i++) {
-        // figure out the size needed for each buffer
-        size_t size = 0;
-        for (auto const& item : attributes) {
-            if (item.buffer == i) {
-                size_t end = item.offset + elementCount * item.stride;
-                size = std::max(size, end);
-            }
-        }
+        size_t size = getBufferSize(vb, size_t(i));
         bindBuffer(GL_ARRAY_BUFFER, vb->gl.buffers[i]);
         glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STATIC_DRAW);
     }
+    addGpuMemory(GpuMemoryStats::VERTEX_BUFFER, vb->getSize());
 
     CHECK_GL_ERROR(utils::slog.e)
 }
@@ -843,6 +1032,7 @@ void OpenGLDriver::createIndexBuffer(Driver::IndexBufferHandle ibh, Driver::Elem
     bindVertexArray(nullptr);
     bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib->gl.buffer);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, nullptr, GL_STATIC_DRAW);
+    addGpuMemory(GpuMemoryStats::INDEX_BUFFER, size_t(size));
     CHECK_GL_ERROR(utils::slog.e)
 }
 
@@ -850,17 +1040,34 @@ void OpenGLDriver::createRenderPrimitive(Driver::RenderPrimitiveHandle rph, int)
     DEBUG_MARKER()
 
     GLRenderPrimitive* rp = construct<GLRenderPrimitive>(rph);
-    glGenVertexArrays(1, &rp->gl.vao);
+    if (!ext.vertex_attrib_binding) {
+        // otherwise the primitive uses the VAO of its vertex layout
+        glGenVertexArrays(1, &rp->gl.vao);
+    }
     CHECK_GL_ERROR(utils::slog.e)
 }
 
 void OpenGLDriver::createProgram(Driver::ProgramHandle ph, Program&& program) {
     DEBUG_MARKER()
 
-    construct<OpenGLProgram>(ph, this, program);
+    construct<OpenGLProgram>(ph, this, std::move(program));
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::createComputeProgram(Driver::ProgramHandle ph, Program&& program) {
+    DEBUG_MARKER()
+
+    assert(ext.compute_shader);
+    construct<OpenGLProgram>(ph, this, std::move(program));
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::setProgramCache(driver::ProgramCache* cache) {
+    DEBUG_MARKER()
+
+    mProgramCache = mProgramBinarySupported ? cache : nullptr;
+}
+
 void OpenGLDriver::createSamplerBuffer(Driver::SamplerBufferHandle sbh, size_t size) {
     DEBUG_MARKER()
 
@@ -874,6 +1081,21 @@ void OpenGLDriver::createUniformBuffer(Driver::UniformBufferHandle ubh, size_t s
     glGenBuffers(1, &ub->gl.ubo);
     bindBuffer(GL_UNIFORM_BUFFER, ub->gl.ubo);
     glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    addGpuMemory(GpuMemoryStats::UNIFORM_BUFFER, size);
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::createStorageBuffer(Driver::StorageBufferHandle sbh, size_t size) {
+    DEBUG_MARKER()
+
+    GLStorageBuffer* sb = construct<GLStorageBuffer>(sbh, size);
+#if GLES31_HEADERS || defined(GL_VERSION_4_3)
+    assert(ext.compute_shader);
+    glGenBuffers(1, &sb->gl.ssbo);
+    bindBuffer(GL_SHADER_STORAGE_BUFFER, sb->gl.ssbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+    addGpuMemory(GpuMemoryStats::STORAGE_BUFFER, size);
+#endif
     CHECK_GL_ERROR(utils::slog.e)
 }
 
@@ -904,8 +1126,15 @@ void OpenGLDriver::textureStorage(OpenGLDriver::GLTexture* t,
             glTexStorage2DMultisample(t->gl.target, t->samples, t->gl.internalFormat,
                     GLsizei(width), GLsizei(height), GL_TRUE);
 #elif GL41_HEADERS
+#   if defined(GL_VERSION_4_3) || defined(GL_ARB_texture_storage_multisample)
+            // immutable storage, from GL 4.3 or with ARB_texture_storage_multisample
+            if (ext.texture_storage_multisample) {
+                glTexStorage2DMultisample(t->gl.target, t->samples, t->gl.internalFormat,
+                        GLsizei(width), GLsizei(height), GL_TRUE);
+                break;
+            }
+#   endif
             // only supported in GL (never in GLES)
-            // TODO: use glTexStorage2DMultisample() on GL 4.3 and above
             glTexImage2DMultisample(t->gl.target, t->samples, t->gl.internalFormat,
                     GLsizei(width), GLsizei(height), GL_TRUE);
 #else
@@ -917,6 +1146,13 @@ void OpenGLDriver::textureStorage(OpenGLDriver::GLTexture* t,
     }
 
     // textureStorage can be used to reallocate the texture at a new size
+    const size_t volume = size_t(t->width) * t->height * t->depth;
+    if (volume && (width != t->width || height != t->height || depth != t->depth)) {
+        const size_t size = size_t(double(t->size) * (double(width) * height * depth / volume));
+        removeGpuMemory(getTextureCategory(t->usage), t->size);
+        addGpuMemory(getTextureCategory(t->usage), size);
+        t->size = size;
+    }
     t->width = width;
     t->height = height;
     t->depth = depth;
@@ -929,6 +1165,9 @@ void OpenGLDriver::createTexture(Driver::TextureHandle th, SamplerType target, u
 
     GLTexture* t = construct<GLTexture>(th, target, levels, samples, w, h, depth);
     glGenTextures(1, &t->gl.texture_id);
+    t->usage = usage;
+    t->size = getTextureSize(target, levels, format, samples, w, h, depth);
+    addGpuMemory(getTextureCategory(usage), t->size);
 
     // below we're using the a = foo(b = C) pattern, this is on purpose, to make sure
     // we don't forget to update targetIndex, and that we do it with the correct value.
@@ -958,6 +1197,14 @@ void OpenGLDriver::createTexture(Driver::TextureHandle th, SamplerType target, u
                 break;
         }
 
+#if GLES31_HEADERS
+        if (UTILS_UNLIKELY(t->samples > 1 && !ext.texture_storage_multisample)) {
+            // multi-sample textures don't exist on GLES 3.0, fallback to a single-sample texture
+            slog.w << "Multisample textures require GLES 3.1, using 1 sample" << io::endl;
+            t->samples = 1;
+        }
+#endif
+
         if (t->samples > 1) {
             // multi-sample texture on GL 3.2 / GLES 3.1 and above
             t->gl.targetIndex = (uint8_t)
@@ -980,6 +1227,13 @@ void OpenGLDriver::framebufferTexture(Driver::TargetBufferInfo& binfo,
     // NOTE: on GL3.2 / GLES3.1 and above multisample is handled when creating the texture
     switch (t->target) {
         case SamplerType::SAMPLER_2D:
+#ifdef GL_EXT_multisampled_render_to_texture
+            if (rt->gl.implicitResolve) {
+                glFramebufferTexture2DMultisampleEXT(GL_FRAMEBUFFER, attachment,
+                        t->gl.target, t->gl.texture_id, binfo.level, rt->gl.samples);
+                break;
+            }
+#endif
             glFramebufferTexture2D(GL_FRAMEBUFFER, attachment,
                     t->gl.target, t->gl.texture_id, binfo.level);
             break;
@@ -998,8 +1252,16 @@ void OpenGLDriver::framebufferTexture(Driver::TargetBufferInfo& binfo,
 }
 
 void OpenGLDriver::renderBufferStorage(GLuint rbo, GLenum internalformat, uint32_t width,
-        uint32_t height, uint8_t samples) const noexcept {
+        uint32_t height, uint8_t samples, bool implicitResolve) const noexcept {
     glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+#ifdef GL_EXT_multisampled_render_to_texture
+    if (implicitResolve) {
+        // the framebuffer is only complete if all its attachments come from the extension
+        glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER, samples, internalformat,
+                width, height);
+        return;
+    }
+#endif
     if (samples > 1) {
         glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, internalformat, width, height);
     } else {
@@ -1008,17 +1270,19 @@ void OpenGLDriver::renderBufferStorage(GLuint rbo, GLenum internalformat, uint32
 }
 
 void OpenGLDriver::framebufferRenderbuffer(GLRenderTarget::GL::RenderBuffer* rb, GLenum attachment,
-        GLenum internalformat, uint32_t width, uint32_t height, uint8_t samples, GLuint fbo) noexcept {
-    rb->id = framebufferRenderbuffer(width, height, samples, attachment, internalformat, fbo);
+        GLenum internalformat, uint32_t width, uint32_t height, uint8_t samples, GLuint fbo,
+        bool implicitResolve) noexcept {
+    rb->id = framebufferRenderbuffer(width, height, samples, attachment, internalformat, fbo,
+            implicitResolve);
     rb->internalFormat = internalformat;
 }
 
 GLuint OpenGLDriver::framebufferRenderbuffer(uint32_t width, uint32_t height, uint8_t samples,
-        GLenum attachment, GLenum internalformat, GLuint fbo) noexcept {
+        GLenum attachment, GLenum internalformat, GLuint fbo, bool implicitResolve) noexcept {
 
     GLuint rbo;
     glGenRenderbuffers(1, &rbo);
-    renderBufferStorage(rbo, internalformat, width, height, samples);
+    renderBufferStorage(rbo, internalformat, width, height, samples, implicitResolve);
 
     bindFramebuffer(GL_FRAMEBUFFER, fbo);
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, rbo);
@@ -1055,6 +1319,19 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
     rt->height = height;
     rt->gl.samples = samples;
 
+    // A single-sample color texture can be rendered with several samples, which are resolved
+    // on-tile into the texture instead of by a later blit. The other attachments then only
+    // exist in the tile memory. The extension only allows a texture as the color attachment.
+    if (samples > 1 && ext.EXT_multisampled_render_to_texture &&
+            color.handle && !depth.handle && !stencil.handle &&
+            handle_cast<GLTexture*>(color.handle)->samples <= 1) {
+        rt->gl.implicitResolve = true;
+    }
+
+    // the renderbuffers are accounted as render targets, the textures already are
+    const size_t renderbufferTexels = rt->gl.implicitResolve ? 0 :
+            size_t(width) * height * std::max(samples, uint8_t(1));
+
     if (targets & TargetBufferFlags::COLOR) {
         // TODO: handle multiple color attachments
         if (color.handle) {
@@ -1063,7 +1340,9 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
         } else {
             GLenum internalFormat = getInternalFormat(format);
             framebufferRenderbuffer(&rt->gl.color, GL_COLOR_ATTACHMENT0, internalFormat,
-                    width, height, samples, rt->gl.fbo);
+                    width, height, samples, rt->gl.fbo, rt->gl.implicitResolve);
+            rt->size += getTextureSize(SamplerType::SAMPLER_2D, 1, format, samples,
+                    width, height, 1);
         }
     }
 
@@ -1073,8 +1352,11 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
         if (!depth.handle && !stencil.handle) {
             // special case: depth & stencil requested, but both not provided
             specialCased = true;
-            framebufferRenderbuffer(&rt->gl.depth, GL_DEPTH_STENCIL_ATTACHMENT, GL_DEPTH24_STENCIL8,
-                    width, height, samples, rt->gl.fbo);
+            // with clip control, use a floating-point depth buffer for reverse-Z
+            framebufferRenderbuffer(&rt->gl.depth, GL_DEPTH_STENCIL_ATTACHMENT,
+                    ext.clip_control ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8,
+                    width, height, samples, rt->gl.fbo, rt->gl.implicitResolve);
+            rt->size += (ext.clip_control ? 8u : 4u) * renderbufferTexels;
 
         } else if (depth.handle == stencil.handle) {
             // special case: depth & stencil requested, and both provided as the same texture
@@ -1090,8 +1372,10 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
                 rt->gl.depth.texture = handle_cast<GLTexture*>(depth.handle);
                 framebufferTexture(depth, rt, GL_DEPTH_ATTACHMENT);
             } else {
-                framebufferRenderbuffer(&rt->gl.depth, GL_DEPTH_ATTACHMENT, GL_DEPTH_COMPONENT24,
-                        width, height, samples, rt->gl.fbo);
+                framebufferRenderbuffer(&rt->gl.depth, GL_DEPTH_ATTACHMENT,
+                        ext.clip_control ? GL_DEPTH_COMPONENT32F : GL_DEPTH_COMPONENT24,
+                        width, height, samples, rt->gl.fbo, rt->gl.implicitResolve);
+                rt->size += 4u * renderbufferTexels;
             }
         }
         if (targets & TargetBufferFlags::STENCIL) {
@@ -1100,7 +1384,8 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
                 framebufferTexture(stencil, rt, GL_STENCIL_ATTACHMENT);
             } else {
                 framebufferRenderbuffer(&rt->gl.stencil, GL_STENCIL_ATTACHMENT, GL_STENCIL_INDEX8,
-                        width, height, samples, rt->gl.fbo);
+                        width, height, samples, rt->gl.fbo, rt->gl.implicitResolve);
+                rt->size += renderbufferTexels;
             }
         }
     }
@@ -1109,6 +1394,35 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
     if (rt->gl.color.id || rt->gl.depth.id || rt->gl.stencil.id) {
         glBindRenderbuffer(GL_RENDERBUFFER, 0);
     }
+    addGpuMemory(GpuMemoryStats::RENDER_TARGET, rt->size);
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::createMultipleRenderTarget(Driver::RenderTargetHandle rth,
+        Driver::TargetBufferFlags targets,
+        uint32_t width,
+        uint32_t height,
+        uint8_t samples,
+        Driver::TargetBufferInfo color,
+        Driver::TargetBufferInfo color1,
+        Driver::TargetBufferInfo depth) {
+    DEBUG_MARKER()
+
+    assert(color.handle && color1.handle);
+
+    // the first color texture and the depth buffer are attached like for any render target
+    // (the format is only used for renderbuffers)
+    createRenderTarget(rth, targets, width, height, samples, TextureFormat::RGBA8,
+            color, depth, {});
+
+    GLRenderTarget* rt = handle_cast<GLRenderTarget*>(rth);
+    rt->gl.color1 = handle_cast<GLTexture*>(color1.handle);
+    framebufferTexture(color1, rt, GL_COLOR_ATTACHMENT1);
+
+    // framebufferTexture() left the framebuffer bound, the draw buffers are part of its state
+    static constexpr GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, buffers);
 
     CHECK_GL_ERROR(utils::slog.e)
 }
@@ -1120,6 +1434,19 @@ void OpenGLDriver::createFence(Driver::FenceHandle fh, int) {
     f->fence = mContextManager.createFence();
 }
 
+void OpenGLDriver::createTimerQuery(Driver::TimerQueryHandle tqh, int) {
+    DEBUG_MARKER()
+
+    GLTimerQuery* tq = construct<GLTimerQuery>(tqh);
+    if (ext.EXT_disjoint_timer_query) {
+        glGenQueries(1, &tq->gl.query);
+        if (ext.timestamp_queries) {
+            glGenQueries(1, &tq->gl.end);
+        }
+    }
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 void OpenGLDriver::createSwapChain(Driver::SwapChainHandle sch, void* nativeWindow, uint64_t flags) {
     DEBUG_MARKER()
 
@@ -1127,6 +1454,14 @@ void OpenGLDriver::createSwapChain(Driver::SwapChainHandle sch, void* nativeWind
     sc->swapChain = mContextManager.createSwapChain(nativeWindow, flags);
 }
 
+void OpenGLDriver::createSwapChainHeadless(Driver::SwapChainHandle sch,
+        uint32_t width, uint32_t height, uint64_t flags) {
+    DEBUG_MARKER()
+
+    HwSwapChain* sc = construct<HwSwapChain>(sch);
+    sc->swapChain = mContextManager.createHeadlessSwapChain(width, height, flags);
+}
+
 void OpenGLDriver::createStreamFromTextureId(Driver::StreamHandle sh,
         intptr_t externalTextureId, uint32_t width, uint32_t height) {
     DEBUG_MARKER()
@@ -1144,6 +1479,15 @@ void OpenGLDriver::createStreamFromTextureId(Driver::StreamHandle sh,
     }
 }
 
+void OpenGLDriver::createStreamAcquired(Driver::StreamHandle sh, int) {
+    DEBUG_MARKER()
+
+    // acquired streams don't own any texture, the images are bound directly to the
+    // textures they're attached to
+    GLStream* s = construct<GLStream>(sh);
+    s->acquired = true;
+}
+
 // ------------------------------------------------------------------------------------------------
 // Destroying driver objects
 // ------------------------------------------------------------------------------------------------
@@ -1155,6 +1499,7 @@ void OpenGLDriver::destroyVertexBuffer(Driver::VertexBufferHandle vbh) {
         GLVertexBuffer const* eb = handle_cast<const GLVertexBuffer*>(vbh);
         GLsizei n = GLsizei(eb->bufferCount);
         glDeleteBuffers(n, eb->gl.buffers.data());
+        removeGpuMemory(GpuMemoryStats::VERTEX_BUFFER, eb->getSize());
         // bindings of bound buffers are reset to 0
         const size_t targetIndex = getIndexForBufferTarget(GL_ARRAY_BUFFER);
         auto& target = state.buffers.targets[targetIndex];
@@ -1173,6 +1518,7 @@ void OpenGLDriver::destroyIndexBuffer(Driver::IndexBufferHandle ibh) {
     if (ibh) {
         GLIndexBuffer const* ib = handle_cast<const GLIndexBuffer*>(ibh);
         glDeleteBuffers(1, &ib->gl.buffer);
+        removeGpuMemory(GpuMemoryStats::INDEX_BUFFER, size_t(ib->elementSize) * ib->count);
         // bindings of bound buffers are reset to 0
         const size_t targetIndex = getIndexForBufferTarget(GL_ELEMENT_ARRAY_BUFFER);
         auto& target = state.buffers.targets[targetIndex];
@@ -1188,6 +1534,9 @@ void OpenGLDriver::destroyRenderPrimitive(Driver::RenderPrimitiveHandle rph) {
 
     if (rph) {
         GLRenderPrimitive const* rp = handle_cast<const GLRenderPrimitive*>(rph);
+        if (rp->gl.layout && rp->gl.layout->current == rp) {
+            rp->gl.layout->current = nullptr;
+        }
         glDeleteVertexArrays(1, &rp->gl.vao);
         // binding of a bound VAO is reset to 0
         if (state.vao.p == rp) {
@@ -1221,6 +1570,7 @@ void OpenGLDriver::destroyUniformBuffer(Driver::UniformBufferHandle ubh) {
     if (ubh) {
         GLUniformBuffer* ub = handle_cast<GLUniformBuffer*>(ubh);
         glDeleteBuffers(1, &ub->gl.ubo);
+        removeGpuMemory(GpuMemoryStats::UNIFORM_BUFFER, ub->size);
         // bindings of bound buffers are reset to 0
         const size_t targetIndex = getIndexForBufferTarget(GL_UNIFORM_BUFFER);
         auto& target = state.buffers.targets[targetIndex];
@@ -1236,6 +1586,35 @@ void OpenGLDriver::destroyUniformBuffer(Driver::UniformBufferHandle ubh) {
     }
 }
 
+void OpenGLDriver::destroyStorageBuffer(Driver::StorageBufferHandle sbh) {
+    DEBUG_MARKER()
+
+    if (sbh) {
+        GLStorageBuffer* sb = handle_cast<GLStorageBuffer*>(sbh);
+#if GLES31_HEADERS || defined(GL_VERSION_4_3)
+        glDeleteBuffers(1, &sb->gl.ssbo);
+        removeGpuMemory(GpuMemoryStats::STORAGE_BUFFER, sb->size);
+        // bindings of bound buffers are reset to 0
+        const size_t targetIndex = getIndexForBufferTarget(GL_SHADER_STORAGE_BUFFER);
+        auto& target = state.buffers.targets[targetIndex];
+        for (auto& buffer : target.buffers) {
+            if (buffer == sb->gl.ssbo) {
+                buffer = 0;
+            }
+        }
+        if (target.genericBinding == sb->gl.ssbo) {
+            target.genericBinding = 0;
+        }
+        // it can also be bound as the source of the indirect draws
+        auto& indirect = state.buffers.targets[getIndexForBufferTarget(GL_DRAW_INDIRECT_BUFFER)];
+        if (indirect.genericBinding == sb->gl.ssbo) {
+            indirect.genericBinding = 0;
+        }
+#endif
+        destruct(sbh, sb);
+    }
+}
+
 void OpenGLDriver::destroyTexture(Driver::TextureHandle th) {
     DEBUG_MARKER()
 
@@ -1249,6 +1628,7 @@ void OpenGLDriver::destroyTexture(Driver::TextureHandle th) {
             glDeleteSync(t->gl.fence);
         }
         glDeleteTextures(1, &t->gl.texture_id);
+        removeGpuMemory(getTextureCategory(t->usage), t->size);
         destruct(th, t);
     }
 }
@@ -1278,6 +1658,7 @@ void OpenGLDriver::destroyRenderTarget(Driver::RenderTargetHandle rth) {
             // finally delete the framebuffer object
             glDeleteFramebuffers(1, &rt->gl.fbo);
         }
+        removeGpuMemory(GpuMemoryStats::RENDER_TARGET, rt->size);
         destruct(rth, rt);
     }
 }
@@ -1307,6 +1688,8 @@ void OpenGLDriver::destroyStream(Driver::StreamHandle sh) {
         }
         if (s->isNativeStream()) {
             mContextManager.destroyStream(s->stream);
+        } else if (s->isAcquiredStream()) {
+            releaseAcquiredImage(s);
         } else {
             glDeleteTextures(GLStream::ROUND_ROBIN_TEXTURE_COUNT, s->user_thread.read);
             glDeleteTextures(GLStream::ROUND_ROBIN_TEXTURE_COUNT, s->user_thread.write);
@@ -1321,13 +1704,35 @@ void OpenGLDriver::destroyStream(Driver::StreamHandle sh) {
     }
 }
 
+void OpenGLDriver::destroyTimerQuery(Driver::TimerQueryHandle tqh) {
+    DEBUG_MARKER()
+
+    if (tqh) {
+        GLTimerQuery* tq = handle_cast<GLTimerQuery*>(tqh);
+        auto& timerQueries = mTimerQueries;
+        timerQueries.erase(std::remove(timerQueries.begin(), timerQueries.end(), tq),
+                timerQueries.end());
+        if (mActiveElapsedQuery == tq) {
+            glEndQuery(GL_TIME_ELAPSED);
+            mActiveElapsedQuery = nullptr;
+        }
+        if (tq->gl.query) {
+            glDeleteQueries(1, &tq->gl.query);
+        }
+        if (tq->gl.end) {
+            glDeleteQueries(1, &tq->gl.end);
+        }
+        destruct(tqh, tq);
+    }
+}
+
 // ------------------------------------------------------------------------------------------------
 // Synchronous APIs
 // These are called on the application's thread
 // ------------------------------------------------------------------------------------------------
 
 Handle<HwStream> OpenGLDriver::createStream(void* nativeStream) {
-    Handle<HwStream> sh( allocateHandle(sizeof(GLStream)) );
+    Handle<HwStream> sh = allocateHandle<HwStream>();
     ExternalContext::Stream* stream = mContextManager.createStream(nativeStream);
     construct<GLStream>(sh, stream);
     return sh;
@@ -1338,7 +1743,8 @@ void OpenGLDriver::updateStreams(driver::DriverApi* driver) {
         OpenGLBlitter::State state;
         for (GLTexture* t : mExternalStreams) {
             assert(t && t->hwStream);
-            if (!static_cast<GLStream*>(t->hwStream)->isNativeStream()) {
+            GLStream const* s = static_cast<GLStream const*>(t->hwStream);
+            if (!s->isNativeStream() && !s->isAcquiredStream()) {
                 state.setup();
                 updateStream(t, driver);
             }
@@ -1440,10 +1846,98 @@ bool OpenGLDriver::isRenderTargetFormatSupported(Driver::TextureFormat format) {
 }
 
 bool OpenGLDriver::isFrameTimeSupported() {
-    // TODO: Measuring the frame time is currently only done using fences
+    // The frame time is measured using fences, the GPU time of a given set of commands can
+    // be measured with timer queries instead, see isTimerQuerySupported().
     return mContextManager.canCreateFence();
 }
 
+bool OpenGLDriver::isTimerQuerySupported() {
+    return ext.EXT_disjoint_timer_query;
+}
+
+bool OpenGLDriver::isClipSpaceZeroToOne() {
+    return ext.clip_control;
+}
+
+bool OpenGLDriver::isBindlessTextureSupported() {
+    return ext.ARB_bindless_texture;
+}
+
+bool OpenGLDriver::isComputeSupported() {
+    return ext.compute_shader;
+}
+
+bool OpenGLDriver::isMultisampledRenderToTextureSupported() {
+    return ext.EXT_multisampled_render_to_texture;
+}
+
+bool OpenGLDriver::isFramebufferFetchSupported() {
+    return ext.EXT_shader_framebuffer_fetch;
+}
+
+bool OpenGLDriver::isMultipleRenderTargetsSupported() {
+    // OpenGL ES 3.0 and OpenGL 4.1 have at least 4 draw buffers
+    return true;
+}
+
+bool OpenGLDriver::getStateStats(Driver::StateStats* stats) {
+    // this is called from the main thread
+    std::lock_guard<utils::Mutex> guard(mStateStatsLock);
+    *stats = mLastFrameStateStats;
+    return true;
+}
+
+bool OpenGLDriver::getRenderStats(Driver::RenderStats* stats) {
+    // this is called from the main thread
+    readRenderStats(stats);
+    return true;
+}
+
+bool OpenGLDriver::getGpuMemoryStats(Driver::GpuMemoryStats* stats) {
+    // this is called from the main thread
+    readGpuMemoryStats(stats);
+    return true;
+}
+
+bool OpenGLDriver::getHandleArenaStats(Driver::HandleArenaStats* stats) {
+    // this is called from the main thread, handles can be allocated from any thread
+    auto add = [stats](auto& table) {
+        using T = typename std::remove_reference_t<decltype(table)>::value_type;
+        auto const tableStats = table.getStats();
+        stats->size += tableStats.count * sizeof(T);
+        stats->highWatermark += tableStats.peak * sizeof(T);
+        stats->allocationCount += tableStats.allocationCount;
+        stats->overflowCount += tableStats.overflowCount;
+    };
+    *stats = {};
+    add(mVertexBuffersTable);
+    add(mIndexBuffersTable);
+    add(mRenderPrimitivesTable);
+    add(mProgramsTable);
+    add(mSamplerBuffersTable);
+    add(mUniformBuffersTable);
+    add(mStorageBuffersTable);
+    add(mTexturesTable);
+    add(mRenderTargetsTable);
+    add(mFencesTable);
+    add(mTimerQueriesTable);
+    add(mSwapChainsTable);
+    add(mStreamsTable);
+    return true;
+}
+
+bool OpenGLDriver::getTimerQueryValue(Driver::TimerQueryHandle tqh, uint64_t* elapsedTime) {
+    if (tqh) {
+        GLTimerQuery* tq = handle_cast<GLTimerQuery*>(tqh);
+        const uint64_t elapsed = tq->elapsed.exchange(0, std::memory_order_relaxed);
+        if (elapsed) {
+            *elapsedTime = elapsed;
+            return true;
+        }
+    }
+    return false;
+}
+
 // ------------------------------------------------------------------------------------------------
 // Swap chains
 // ------------------------------------------------------------------------------------------------
@@ -1456,6 +1950,23 @@ void OpenGLDriver::commit(Driver::SwapChainHandle sch) {
         HwSwapChain* sc = handle_cast<HwSwapChain*>(sch);
         mContextManager.commit(sc->swapChain);
     }
+    mHasFrameDamage = false;
+}
+
+void OpenGLDriver::setPresentationTime(int64_t monotonic_clock_ns) {
+    DEBUG_MARKER()
+
+    mContextManager.setPresentationTime(monotonic_clock_ns);
+}
+
+void OpenGLDriver::setFrameDamage(int32_t left, int32_t bottom, uint32_t width, uint32_t height) {
+    DEBUG_MARKER()
+
+    // the context manager adds the damage of the frames the back buffer missed, if it can
+    // keep the previous frames at all
+    int32_t region[4] = { left, bottom, int32_t(width), int32_t(height) };
+    mHasFrameDamage = mContextManager.setDamage(region);
+    mFrameDamage = vec4gli(region[0], region[1], region[2], region[3]);
 }
 
 void OpenGLDriver::makeCurrent(Driver::SwapChainHandle sch) {
@@ -1483,7 +1994,14 @@ void OpenGLDriver::loadVertexBuffer(
     GLVertexBuffer* eb = handle_cast<GLVertexBuffer *>(vbh);
 
     bindBuffer(GL_ARRAY_BUFFER, eb->gl.buffers[index]);
-    glBufferSubData(GL_ARRAY_BUFFER, byteOffset, byteSize, p.buffer);
+    if (byteOffset == 0 && byteSize == getBufferSize(eb, index)) {
+        // the whole buffer is replaced: give GL new storage rather than having it wait for the
+        // draws still using the old content. The usage hint is kept.
+        glBufferData(GL_ARRAY_BUFFER, byteSize, p.buffer, GL_STATIC_DRAW);
+    } else {
+        glBufferSubData(GL_ARRAY_BUFFER, byteOffset, byteSize, p.buffer);
+    }
+    mRenderStats.bufferBytes += byteSize;
 
     scheduleDestroy(std::move(p));
 
@@ -1501,7 +2019,13 @@ void OpenGLDriver::loadIndexBuffer(
 
     bindVertexArray(nullptr);
     bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib->gl.buffer);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, byteOffset, byteSize, p.buffer);
+    if (byteOffset == 0 && byteSize == ib->elementSize * ib->count) {
+        // see loadVertexBuffer()
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, byteSize, p.buffer, GL_STATIC_DRAW);
+    } else {
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, byteOffset, byteSize, p.buffer);
+    }
+    mRenderStats.bufferBytes += byteSize;
 
     scheduleDestroy(std::move(p));
 
@@ -1523,22 +2047,32 @@ void OpenGLDriver::beginRenderPass(Driver::RenderTargetHandle rth,
     mRenderPassTarget = rth;
     mRenderPassParams = params;
     const TargetBufferFlags clearFlags = (TargetBufferFlags) params.clear;
-    const TargetBufferFlags discardFlags = (TargetBufferFlags) params.discardStart;
+    TargetBufferFlags discardFlags = (TargetBufferFlags) params.discardStart;
 
     GLRenderTarget* rt = handle_cast<GLRenderTarget*>(rth);
+
+    // With a frame damage, only the damaged pixels of the swap chain are drawn and cleared,
+    // the others must keep the previous frame.
+    mDamageScissor = mHasFrameDamage && rt->gl.fbo == 0;
+    if (mDamageScissor) {
+        discardFlags = TargetBufferFlags(discardFlags & ~TargetBufferFlags::COLOR);
+    }
+
+    // the SHADOW bits other than DEPTH select the shadow pass' states, even when the depth
+    // buffer isn't cleared
+    if (clearFlags & (TargetBufferFlags::SHADOW & ~TargetBufferFlags::DEPTH)) {
+        enable(GL_POLYGON_OFFSET_FILL);
+    } else {
+        disable(GL_POLYGON_OFFSET_FILL);
+    }
+
     if (UTILS_UNLIKELY(state.draw_fbo != rt->gl.fbo)) {
         bindFramebuffer(GL_FRAMEBUFFER, rt->gl.fbo);
 
-        if ((clearFlags & TargetBufferFlags::SHADOW) == TargetBufferFlags::SHADOW) {
-            enable(GL_POLYGON_OFFSET_FILL);
-        } else {
-            disable(GL_POLYGON_OFFSET_FILL);
-        }
-
         // glInvalidateFramebuffer appeared on GLES 3.0 and GL4.3, for simplicity we just
         // ignore it on GL (rather than having to do a runtime check).
         if (GLES31_HEADERS) {
-            std::array<GLenum, 3> attachments;
+            std::array<GLenum, 4> attachments;
             GLsizei attachmentCount = getAttachments(attachments, rt, discardFlags);
             if (attachmentCount) {
 #if DEBUG_MARKER_LEVEL == DEBUG_MARKER_SYSTRACE
@@ -1589,7 +2123,7 @@ void OpenGLDriver::beginRenderPass(Driver::RenderTargetHandle rth,
     }
 #endif
 
-    const bool respectScissor = !(clearFlags & RenderPassParams::IGNORE_SCISSOR);
+    const bool respectScissor = !(clearFlags & RenderPassParams::IGNORE_SCISSOR) || mDamageScissor;
     const bool clearColor = clearFlags & TargetBufferFlags::COLOR;
     const bool clearDepth = clearFlags & TargetBufferFlags::DEPTH;
     const bool clearStencil = clearFlags & TargetBufferFlags::STENCIL;
@@ -1624,7 +2158,7 @@ void OpenGLDriver::endRenderPass(int) {
         GLRenderTarget* rt = handle_cast<GLRenderTarget*>(mRenderPassTarget);
         bindFramebuffer(GL_FRAMEBUFFER, rt->gl.fbo);
 
-        std::array<GLenum, 3> attachments;
+        std::array<GLenum, 4> attachments;
         GLsizei attachmentCount = getAttachments(attachments, rt, discardFlags);
         if (attachmentCount) {
 #if DEBUG_MARKER_LEVEL == DEBUG_MARKER_SYSTRACE
@@ -1663,6 +2197,7 @@ void OpenGLDriver::endRenderPass(int) {
         CHECK_GL_ERROR(utils::slog.e)
     }
     mRenderPassTarget.clear();
+    mDamageScissor = false;
 }
 
 void OpenGLDriver::discardSubRenderTargetBuffers(Driver::RenderTargetHandle rth,
@@ -1683,7 +2218,7 @@ void OpenGLDriver::discardSubRenderTargetBuffers(Driver::RenderTargetHandle rth,
         if (left < right && bottom < top) {
             bindFramebuffer(GL_FRAMEBUFFER, rt->gl.fbo);
 
-            std::array<GLenum, 3> attachments;
+            std::array<GLenum, 4> attachments;
             GLsizei attachmentCount = getAttachments(attachments, rt, buffers);
             if (attachmentCount) {
                 glInvalidateSubFramebuffer(GL_FRAMEBUFFER, attachmentCount, attachments.data(),
@@ -1695,13 +2230,16 @@ void OpenGLDriver::discardSubRenderTargetBuffers(Driver::RenderTargetHandle rth,
     }
 }
 
-GLsizei OpenGLDriver::getAttachments(std::array<GLenum, 3>& attachments,
+GLsizei OpenGLDriver::getAttachments(std::array<GLenum, 4>& attachments,
         GLRenderTarget const* rt, uint8_t buffers) const noexcept {
     GLsizei attachmentCount = 0;
     // the default framebuffer uses different constants!!!
     const bool defaultFramebuffer = (rt->gl.fbo == 0);
     if (buffers & TargetBufferFlags::COLOR) {
         attachments[attachmentCount++] = defaultFramebuffer ? GL_COLOR : GL_COLOR_ATTACHMENT0;
+        if (rt->gl.color1) {
+            attachments[attachmentCount++] = GL_COLOR_ATTACHMENT1;
+        }
     }
     if (buffers & TargetBufferFlags::DEPTH) {
         attachments[attachmentCount++] = defaultFramebuffer ? GL_DEPTH : GL_DEPTH_ATTACHMENT;
@@ -1723,15 +2261,21 @@ void OpenGLDriver::resizeRenderTarget(Driver::RenderTargetHandle rth,
 
     if (rt->gl.color.id) {
         // if we have a depth renderbuffer, reallocate it
-        renderBufferStorage(rt->gl.color.id, rt->gl.color.internalFormat, width, height, rt->gl.samples);
+        renderBufferStorage(rt->gl.color.id, rt->gl.color.internalFormat, width, height,
+                rt->gl.samples, rt->gl.implicitResolve);
     } else if (rt->gl.color.texture) {
         // if it was a texture, reallocate the texture and discard content
         textureStorage(rt->gl.color.texture, width, height, rt->gl.color.texture->depth);
     }
 
+    if (rt->gl.color1) {
+        textureStorage(rt->gl.color1, width, height, rt->gl.color1->depth);
+    }
+
     if (rt->gl.depth.id) {
         // if we have a depth renderbuffer, reallocate it
-        renderBufferStorage(rt->gl.depth.id, rt->gl.depth.internalFormat, width, height, rt->gl.samples);
+        renderBufferStorage(rt->gl.depth.id, rt->gl.depth.internalFormat, width, height,
+                rt->gl.samples, rt->gl.implicitResolve);
     } else if (rt->gl.depth.texture) {
         // if it was a texture, reallocate the texture and discard content
         textureStorage(rt->gl.depth.texture, width, height, rt->gl.depth.texture->depth);
@@ -1739,7 +2283,8 @@ void OpenGLDriver::resizeRenderTarget(Driver::RenderTargetHandle rth,
 
     if (rt->gl.stencil.id) {
         // if we have a stencil renderbuffer, reallocate it
-        renderBufferStorage(rt->gl.stencil.id, rt->gl.stencil.internalFormat, width, height, rt->gl.samples);
+        renderBufferStorage(rt->gl.stencil.id, rt->gl.stencil.internalFormat, width, height,
+                rt->gl.samples, rt->gl.implicitResolve);
     } else if (rt->gl.stencil.texture) {
         // if it was a texture, reallocate the texture and discard content
         textureStorage(rt->gl.stencil.texture, width, height, rt->gl.stencil.texture->depth);
@@ -1749,6 +2294,17 @@ void OpenGLDriver::resizeRenderTarget(Driver::RenderTargetHandle rth,
     if (rt->gl.color.id || rt->gl.depth.id || rt->gl.stencil.id) {
         glBindRenderbuffer(GL_RENDERBUFFER, 0);
     }
+
+    // the renderbuffers' size is proportional to their area
+    const size_t area = size_t(rt->width) * rt->height;
+    if (area) {
+        const size_t size = size_t(double(rt->size) * (double(width) * height / area));
+        removeGpuMemory(GpuMemoryStats::RENDER_TARGET, rt->size);
+        addGpuMemory(GpuMemoryStats::RENDER_TARGET, size);
+        rt->size = size;
+    }
+    rt->width = width;
+    rt->height = height;
 }
 
 void OpenGLDriver::setRenderPrimitiveBuffer(Driver::RenderPrimitiveHandle rph,
@@ -1763,11 +2319,35 @@ void OpenGLDriver::setRenderPrimitiveBuffer(Driver::RenderPrimitiveHandle rph,
 
         assert(ib->elementSize == 2 || ib->elementSize == 4);
 
+        rp->gl.indicesType = ib->elementSize == 4 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+        rp->maxVertexCount = eb->vertexCount;
+
+        if (ext.vertex_attrib_binding) {
+            // the format of the attributes goes in the layout's VAO, shared with the other
+            // primitives using the same format, the buffers are bound with the primitive
+            if (rp->gl.layout && rp->gl.layout->current == rp) {
+                rp->gl.layout->current = nullptr;
+            }
+            rp->gl.layout = getVertexLayout(eb->attributes, enabledAttributes);
+            for (size_t i = 0, n = eb->attributes.size(); i < n; i++) {
+                if (enabledAttributes & (1U << i)) {
+                    auto const& attribute = eb->attributes[i];
+                    assert(attribute.buffer != 0xFF);
+                    rp->gl.buffers[i] = eb->gl.buffers[attribute.buffer];
+                    rp->gl.offsets[i] = attribute.offset;
+                    // a stride of zero means the attributes are tightly packed
+                    rp->gl.strides[i] = attribute.stride ? attribute.stride :
+                            uint8_t(Driver::getElementTypeSize(attribute.type));
+                }
+            }
+            rp->gl.elementArray = ib->gl.buffer;
+            CHECK_GL_ERROR(utils::slog.e)
+            return;
+        }
+
         bindVertexArray(rp);
         CHECK_GL_ERROR(utils::slog.e)
 
-        rp->gl.indicesType = ib->elementSize == 4 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
-        rp->maxVertexCount = eb->vertexCount;
         for (size_t i = 0, n = eb->attributes.size(); i < n; i++) {
             if (enabledAttributes & (1U << i)) {
                 uint8_t bi = eb->attributes[i].buffer;
@@ -1831,9 +2411,7 @@ void OpenGLDriver::setViewportScissor(
     // rather than negative values to satisfy OpenGL requirements.
     scissor.z = std::max(0, right - scissor.x);
     scissor.w = std::max(0, top - scissor.y);
-    update_state(state.window.scissor, scissor, [scissor]() {
-        glScissor(scissor.x, scissor.y, scissor.z, scissor.w);
-    });
+    setScissor(scissor.x, scissor.y, scissor.z, scissor.w);
 }
 
 void OpenGLDriver::updateUniformBuffer(Driver::UniformBufferHandle ubh,
@@ -1843,14 +2421,39 @@ void OpenGLDriver::updateUniformBuffer(Driver::UniformBufferHandle ubh,
     GLUniformBuffer* ub = handle_cast<GLUniformBuffer *>(ubh);
     assert(ub);
 
-    if (UTILS_UNLIKELY(uniformBuffer.isDirty())) {
-        // TODO: upload only the dirty parts
+    if (UTILS_LIKELY(uniformBuffer.isDirty())) {
+        // upload only the modified range, in a single call
+        const size_t dirtyOffset = uniformBuffer.getDirtyOffset();
+        const size_t offset = uniformBuffer.getOffset() + dirtyOffset;
+        const size_t size = uniformBuffer.getDirtySize();
+        void const* data = static_cast<char const*>(uniformBuffer.getBuffer()) + dirtyOffset;
+        assert(offset + size <= ub->size);
         assert(ub->gl.ubo);
         bindBuffer(GL_UNIFORM_BUFFER, ub->gl.ubo);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, uniformBuffer.getSize(), uniformBuffer.getBuffer());
+        if (offset == 0 && size == ub->size) {
+            // the whole buffer is replaced, orphan its storage so we don't wait on the GPU
+            glBufferData(GL_UNIFORM_BUFFER, GLsizeiptr(size), data, GL_DYNAMIC_DRAW);
+        } else {
+            glBufferSubData(GL_UNIFORM_BUFFER, GLintptr(offset), GLsizeiptr(size), data);
+        }
+        mRenderStats.uniformBytes += size;
         CHECK_GL_ERROR(utils::slog.e)
     }
-    ub->ub = std::move(uniformBuffer);
+}
+
+void OpenGLDriver::updateStorageBuffer(Driver::StorageBufferHandle sbh,
+        Driver::BufferDescriptor&& p, uint32_t byteOffset) {
+    DEBUG_MARKER()
+
+    GLStorageBuffer* sb = handle_cast<GLStorageBuffer *>(sbh);
+    assert(byteOffset + p.size <= sb->size);
+#if GLES31_HEADERS || defined(GL_VERSION_4_3)
+    bindBuffer(GL_SHADER_STORAGE_BUFFER, sb->gl.ssbo);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, GLintptr(byteOffset), GLsizeiptr(p.size), p.buffer);
+    mRenderStats.bufferBytes += p.size;
+#endif
+    scheduleDestroy(std::move(p));
+    CHECK_GL_ERROR(utils::slog.e)
 }
 
 void OpenGLDriver::load2DImage(Driver::TextureHandle th,
@@ -1859,6 +2462,7 @@ void OpenGLDriver::load2DImage(Driver::TextureHandle th,
     DEBUG_MARKER()
 
     GLTexture* t = handle_cast<GLTexture *>(th);
+    mRenderStats.textureBytes += data.size;
     if (data.type == driver::PixelDataType::COMPRESSED) {
         setCompressedTextureData(t,
                 level, xoffset, yoffset, 0, width, height, 1, std::move(data), nullptr);
@@ -1873,6 +2477,7 @@ void OpenGLDriver::loadCubeImage(Driver::TextureHandle th, uint32_t level,
     DEBUG_MARKER()
 
     GLTexture* t = handle_cast<GLTexture *>(th);
+    mRenderStats.textureBytes += data.size;
     if (data.type == driver::PixelDataType::COMPRESSED) {
         setCompressedTextureData(t, level, 0, 0, 0, 0, 0, 0, std::move(data), &faceOffsets);
     } else {
@@ -1900,6 +2505,21 @@ void OpenGLDriver::generateMipmaps(Driver::TextureHandle th) {
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::setTextureBaseLevel(Driver::TextureHandle th, uint8_t baseLevel) {
+    DEBUG_MARKER()
+
+    GLTexture* t = handle_cast<GLTexture *>(th);
+    if (t->gl.baseLevel != baseLevel) {
+        // uploading a finer level lowers the base level again, see setTextureData()
+        t->gl.baseLevel = baseLevel;
+        bindTexture(MAX_TEXTURE_UNITS - 1, t->gl.target, t, t->gl.targetIndex);
+        activeTexture(MAX_TEXTURE_UNITS - 1);
+        glTexParameteri(t->gl.target, GL_TEXTURE_BASE_LEVEL, t->gl.baseLevel);
+    }
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 void OpenGLDriver::setTextureData(GLTexture* t,
         uint32_t level,
         uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
@@ -1925,6 +2545,8 @@ void OpenGLDriver::setTextureData(GLTexture* t,
     pixelStore(GL_UNPACK_SKIP_PIXELS, p.left);
     pixelStore(GL_UNPACK_SKIP_ROWS, p.top);
 
+    const uintptr_t pixels = beginPixelUpload(p);
+
     switch (t->target) {
         case SamplerType::SAMPLER_EXTERNAL:
             // if we get there, it's because the user is trying to use an external texture
@@ -1937,7 +2559,7 @@ void OpenGLDriver::setTextureData(GLTexture* t,
             activeTexture(MAX_TEXTURE_UNITS - 1);
             glTexSubImage2D(GL_TEXTURE_2D,
                     GLint(level), GLint(xoffset), GLint(yoffset),
-                    width, height, glFormat, glType, p.buffer);
+                    width, height, glFormat, glType, (void const*)pixels);
             break;
         case SamplerType::SAMPLER_CUBEMAP: {
             assert(t->gl.target == GL_TEXTURE_CUBE_MAP);
@@ -1949,12 +2571,14 @@ void OpenGLDriver::setTextureData(GLTexture* t,
                 GLenum target = getCubemapTarget(TextureCubemapFace(face));
                 glTexSubImage2D(target, GLint(level), 0, 0,
                         t->width >> level, t->height >> level, glFormat, glType,
-                        static_cast<uint8_t const*>(p.buffer) + offsets[face]);
+                        (void const*)(pixels + offsets[face]));
             }
             break;
         }
     }
 
+    endPixelUpload();
+
     // update the base/max LOD so we don't access undefined LOD. this allows the app to
     // specify levels as they become available.
 
@@ -1995,6 +2619,8 @@ void OpenGLDriver::setCompressedTextureData(GLTexture* t,
 
     //  TODO: maybe assert the size is right (b/c we can compute it ourselves)
 
+    const uintptr_t pixels = beginPixelUpload(p);
+
     switch (t->target) {
         case SamplerType::SAMPLER_EXTERNAL:
             // if we get there, it's because the user is trying to use an external texture
@@ -2007,7 +2633,7 @@ void OpenGLDriver::setCompressedTextureData(GLTexture* t,
             activeTexture(MAX_TEXTURE_UNITS - 1);
             glCompressedTexSubImage2D(GL_TEXTURE_2D,
                     GLint(level), GLint(xoffset), GLint(yoffset),
-                    width, height, t->gl.internalFormat, imageSize, p.buffer);
+                    width, height, t->gl.internalFormat, imageSize, (void const*)pixels);
             break;
         case SamplerType::SAMPLER_CUBEMAP: {
             assert(faceOffsets);
@@ -2020,12 +2646,14 @@ void OpenGLDriver::setCompressedTextureData(GLTexture* t,
                 GLenum target = getCubemapTarget(TextureCubemapFace(face));
                 glCompressedTexSubImage2D(target, GLint(level), 0, 0,
                         t->width >> level, t->height >> level, t->gl.internalFormat,
-                        imageSize, static_cast<uint8_t const*>(p.buffer) + offsets[face]);
+                        imageSize, (void const*)(pixels + offsets[face]));
             }
             break;
         }
     }
 
+    endPixelUpload();
+
     // update the base/max LOD so we don't access undefined LOD. this allows the app to
     // specify levels as they become available.
 
@@ -2043,6 +2671,28 @@ void OpenGLDriver::setCompressedTextureData(GLTexture* t,
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+uintptr_t OpenGLDriver::beginPixelUpload(PixelBufferDescriptor const& p) noexcept {
+    if (p.size < UNPACK_BUFFER_MIN_SIZE) {
+        return uintptr_t(p.buffer);
+    }
+    // The buffer is deleted right after the upload is issued, GL keeps its storage alive until
+    // the transfer is done. The pixels are then addressed relative to the buffer.
+    GLuint pbo;
+    glGenBuffers(1, &pbo);
+    bindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(p.size), p.buffer, GL_STREAM_DRAW);
+    return 0;
+}
+
+void OpenGLDriver::endPixelUpload() noexcept {
+    const size_t index = getIndexForBufferTarget(GL_PIXEL_UNPACK_BUFFER);
+    GLuint pbo = state.buffers.targets[index].genericBinding;
+    if (pbo) {
+        bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &pbo);
+    }
+}
+
 void OpenGLDriver::setExternalImage(Driver::TextureHandle th, void* image) {
     if (ext.OES_EGL_image_external_essl3) {
         DEBUG_MARKER()
@@ -2061,6 +2711,67 @@ void OpenGLDriver::setExternalImage(Driver::TextureHandle th, void* image) {
     }
 }
 
+void OpenGLDriver::setAcquiredImage(Driver::StreamHandle sh, BufferDescriptor&& image) {
+    DEBUG_MARKER()
+
+    GLStream* s = handle_cast<GLStream*>(sh);
+    assert(s->isAcquiredStream());
+
+    // the previous image can be in use by the commands issued so far, it's released
+    // once they complete (see updatePendingAcquiredImages())
+    releaseAcquiredImage(s);
+    if (image.buffer) {
+        mAcquiredImages[s] = std::move(image);
+    }
+
+    if (ext.OES_EGL_image_external_essl3) {
+        for (GLTexture* t : mExternalStreams) {
+            if (t->hwStream == s) {
+                bindAcquiredImage(t, s);
+            }
+        }
+    }
+}
+
+void OpenGLDriver::bindAcquiredImage(GLTexture* t, GLStream const* s) noexcept {
+    auto pos = mAcquiredImages.find(s);
+    if (pos != mAcquiredImages.end()) {
+        assert(t->gl.target == GL_TEXTURE_EXTERNAL_OES);
+        bindTexture(MAX_TEXTURE_UNITS - 1, GL_TEXTURE_EXTERNAL_OES, t);
+        activeTexture(MAX_TEXTURE_UNITS - 1);
+#ifdef GL_OES_EGL_image
+        glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES,
+                static_cast<GLeglImageOES>(pos->second.buffer));
+#endif
+    }
+}
+
+void OpenGLDriver::releaseAcquiredImage(GLStream* s) noexcept {
+    auto pos = mAcquiredImages.find(s);
+    if (pos != mAcquiredImages.end()) {
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        mPendingAcquiredImages.push_back({ fence, std::move(pos->second) });
+        mAcquiredImages.erase(pos);
+    }
+}
+
+void OpenGLDriver::updatePendingAcquiredImages(bool wait) noexcept {
+    // images are released in order, we stop at the first one that's still in use
+    auto& pendingImages = mPendingAcquiredImages;
+    size_t count = 0;
+    for (auto& pending : pendingImages) {
+        GLenum status = glClientWaitSync(pending.fence,
+                wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        glDeleteSync(pending.fence);
+        scheduleDestroy(std::move(pending.image));
+        count++;
+    }
+    pendingImages.erase(pendingImages.begin(), pendingImages.begin() + count);
+}
+
 void OpenGLDriver::setExternalStream(Driver::TextureHandle th, Driver::StreamHandle sh) {
     if (ext.OES_EGL_image_external_essl3) {
         DEBUG_MARKER()
@@ -2090,6 +2801,9 @@ void OpenGLDriver::attachStream(GLTexture* t, GLStream* hwStream) noexcept {
 
     if (hwStream->isNativeStream()) {
         mContextManager.attach(hwStream->stream, t->gl.texture_id);
+    } else if (hwStream->isAcquiredStream()) {
+        assert(t->target == SamplerType::SAMPLER_EXTERNAL);
+        bindAcquiredImage(t, hwStream);
     } else {
         assert(t->target == SamplerType::SAMPLER_EXTERNAL);
         // The texture doesn't need a texture name anymore, get rid of it
@@ -2112,6 +2826,10 @@ void OpenGLDriver::detachStream(GLTexture* t) noexcept {
     if (s->isNativeStream()) {
         mContextManager.detach(t->hwStream->stream);
         // this deletes the texture id
+    } else if (s->isAcquiredStream()) {
+        // the texture name is still bound to the stream's image, get rid of it
+        unbindTexture(t->gl.target, t->gl.texture_id);
+        glDeleteTextures(1, &t->gl.texture_id);
     }
     glGenTextures(1, &t->gl.texture_id);
     t->hwStream = nullptr;
@@ -2123,11 +2841,18 @@ void OpenGLDriver::replaceStream(GLTexture* t, GLStream* hwStream) noexcept {
     if (s->isNativeStream()) {
         mContextManager.detach(t->hwStream->stream);
         // this deletes the texture id
+    } else if (s->isAcquiredStream()) {
+        unbindTexture(t->gl.target, t->gl.texture_id);
+        glDeleteTextures(1, &t->gl.texture_id);
     }
 
     if (hwStream->isNativeStream()) {
         glGenTextures(1, &t->gl.texture_id);
         mContextManager.attach(hwStream->stream, t->gl.texture_id);
+    } else if (hwStream->isAcquiredStream()) {
+        assert(t->target == SamplerType::SAMPLER_EXTERNAL);
+        glGenTextures(1, &t->gl.texture_id);
+        bindAcquiredImage(t, hwStream);
     } else {
         assert(t->target == SamplerType::SAMPLER_EXTERNAL);
         t->gl.texture_id = hwStream->user_thread.read[hwStream->user_thread.cur];
@@ -2248,14 +2973,6 @@ void OpenGLDriver::readStreamPixels(Driver::StreamHandle sh,
             return;
         }
 
-        GLenum glFormat = getFormat(p.format);
-        GLenum glType = getType(p.type);
-
-        pixelStore(GL_PACK_ROW_LENGTH, p.stride);
-        pixelStore(GL_PACK_ALIGNMENT, p.alignment);
-        pixelStore(GL_PACK_SKIP_PIXELS, p.left);
-        pixelStore(GL_PACK_SKIP_ROWS, p.top);
-
         if (s->gl.fbo == 0) {
             glGenFramebuffers(1, &s->gl.fbo);
         }
@@ -2297,12 +3014,10 @@ void OpenGLDriver::readStreamPixels(Driver::StreamHandle sh,
         // be corrected to match glReadPixels()'s behavior.
         y = (s->height - height) - y;
 
-        // TODO: we could use a PBO to make this asynchronous
-        glReadPixels(GLint(x), GLint(y), GLint(width), GLint(height), glFormat, glType, p.buffer);
+        readPixelsAsync(GLint(x), GLint(y), width, height, std::move(p), false);
         CHECK_GL_ERROR(utils::slog.e)
 
         bindFramebuffer(GL_FRAMEBUFFER, 0);
-        scheduleDestroy(std::move(p));
     }
 }
 
@@ -2334,6 +3049,26 @@ void OpenGLDriver::bindUniforms(size_t index, Driver::UniformBufferHandle ubh) {
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::bindUniformsRange(size_t index, Driver::UniformBufferHandle ubh,
+        size_t offset, size_t size) {
+    DEBUG_MARKER()
+
+    GLUniformBuffer* ub = handle_cast<GLUniformBuffer *>(ubh);
+    bindBufferRange(GL_UNIFORM_BUFFER, GLuint(index), ub->gl.ubo, GLintptr(offset), GLsizeiptr(size));
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::bindStorageBuffer(size_t index, Driver::StorageBufferHandle sbh) {
+    DEBUG_MARKER()
+
+    assert(index < MAX_STORAGE_BUFFER_BINDINGS);
+#if GLES31_HEADERS || defined(GL_VERSION_4_3)
+    GLStorageBuffer* sb = handle_cast<GLStorageBuffer *>(sbh);
+    bindBufferBase(GL_SHADER_STORAGE_BUFFER, GLuint(index), sb->gl.ssbo);
+#endif
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 void OpenGLDriver::bindSamplers(size_t index, Driver::SamplerBufferHandle sbh) {
     DEBUG_MARKER()
 
@@ -2343,6 +3078,37 @@ void OpenGLDriver::bindSamplers(size_t index, Driver::SamplerBufferHandle sbh) {
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::setPushConstants(const Driver::PushConstants& constants) {
+    DEBUG_MARKER()
+
+    mPushConstants.size = constants.size;
+    memcpy(mPushConstants.data, constants.data, constants.size);
+}
+
+void OpenGLDriver::updateBindlessTexture(Driver::UniformBufferHandle ubh, uint32_t index,
+        Driver::TextureHandle th, Driver::SamplerParams params) {
+    DEBUG_MARKER()
+
+#ifdef GL_ARB_bindless_texture
+    assert(ext.ARB_bindless_texture);
+    GLUniformBuffer* ub = handle_cast<GLUniformBuffer *>(ubh);
+    GLTexture const* t = handle_cast<GLTexture const*>(th);
+    assert((index + 1) * 16 <= ub->size);
+
+    // A texture and sampler pair always has the same handle. It stays resident until the
+    // texture is deleted, which also deletes the handle.
+    GLuint64 const handle = glGetTextureSamplerHandleARB(t->gl.texture_id, getSampler(params));
+    if (!glIsTextureHandleResidentARB(handle)) {
+        glMakeTextureHandleResidentARB(handle);
+    }
+
+    // the handle is read as the first two components of a uvec4
+    GLuint64 const data[2] = { handle, 0 };
+    bindBuffer(GL_UNIFORM_BUFFER, ub->gl.ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, GLintptr(index * sizeof(data)), sizeof(data), data);
+    CHECK_GL_ERROR(utils::slog.e)
+#endif
+}
 
 GLuint OpenGLDriver::getSamplerSlow(driver::SamplerParams params) const noexcept {
     assert(mSamplerMap.find(params.u) == mSamplerMap.end());
@@ -2391,6 +3157,99 @@ void OpenGLDriver::popGroupMarker(int) {
 #endif
 }
 
+// ------------------------------------------------------------------------------------------------
+// GPU timers
+// ------------------------------------------------------------------------------------------------
+
+void OpenGLDriver::beginTimerQuery(Driver::TimerQueryHandle tqh) {
+    DEBUG_MARKER()
+
+    GLTimerQuery* tq = handle_cast<GLTimerQuery*>(tqh);
+    if (tq->gl.query) {
+        // a query that's restarted loses its previous result if it wasn't read yet
+        auto& timerQueries = mTimerQueries;
+        timerQueries.erase(std::remove(timerQueries.begin(), timerQueries.end(), tq),
+                timerQueries.end());
+        tq->elapsed.store(0, std::memory_order_relaxed);
+        if (tq->gl.end) {
+            queryCounter(tq->gl.query);
+        } else if (!mActiveElapsedQuery) {
+            glBeginQuery(GL_TIME_ELAPSED, tq->gl.query);
+            mActiveElapsedQuery = tq;
+        }
+        // otherwise this query is nested in another one and won't produce a result
+    }
+}
+
+void OpenGLDriver::endTimerQuery(Driver::TimerQueryHandle tqh) {
+    DEBUG_MARKER()
+
+    GLTimerQuery* tq = handle_cast<GLTimerQuery*>(tqh);
+    if (tq->gl.end) {
+        queryCounter(tq->gl.end);
+        mTimerQueries.push_back(tq);
+    } else if (tq->gl.query && mActiveElapsedQuery == tq) {
+        glEndQuery(GL_TIME_ELAPSED);
+        mActiveElapsedQuery = nullptr;
+        mTimerQueries.push_back(tq);
+    }
+}
+
+void OpenGLDriver::queryCounter(GLuint query) noexcept {
+#if GLES31_HEADERS
+#ifdef GL_EXT_disjoint_timer_query
+    glQueryCounterEXT(query, GL_TIMESTAMP);
+#endif
+#else
+    glQueryCounter(query, GL_TIMESTAMP);
+#endif
+}
+
+void OpenGLDriver::updateTimerQueries() noexcept {
+    auto& timerQueries = mTimerQueries;
+    if (timerQueries.empty()) {
+        return;
+    }
+
+    // A disjoint operation (e.g. a change of the GPU frequency) invalidates all the results
+    // that are pending, we simply drop them.
+    GLint disjoint = GL_FALSE;
+#if defined(GL_GPU_DISJOINT_EXT)
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+#endif
+
+    timerQueries.erase(std::remove_if(timerQueries.begin(), timerQueries.end(),
+            [disjoint](GLTimerQuery* tq) {
+                // the end timestamp is available last
+                GLuint const last = tq->gl.end ? tq->gl.end : tq->gl.query;
+                GLuint available = GL_FALSE;
+                glGetQueryObjectuiv(last, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available) {
+                    return false;
+                }
+                auto getResult = [](GLuint query) {
+                    GLuint64 result = 0;
+#if GLES31_HEADERS
+                    glGetQueryObjectui64vEXT(query, GL_QUERY_RESULT, &result);
+#else
+                    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &result);
+#endif
+                    return result;
+                };
+                GLuint64 elapsed = getResult(tq->gl.query);
+                if (tq->gl.end) {
+                    // the timestamps are in nanoseconds, like GL_TIME_ELAPSED
+                    const GLuint64 end = getResult(tq->gl.end);
+                    elapsed = end > elapsed ? end - elapsed : 0;
+                }
+                if (!disjoint) {
+                    // 0 is reserved for "not available"
+                    tq->elapsed.store(std::max(elapsed, GLuint64(1)), std::memory_order_relaxed);
+                }
+                return true;
+            }), timerQueries.end());
+}
+
 // ------------------------------------------------------------------------------------------------
 // Read-back ops
 // ------------------------------------------------------------------------------------------------
@@ -2400,14 +3259,6 @@ void OpenGLDriver::readPixels(Driver::RenderTargetHandle src,
         PixelBufferDescriptor&& p) {
     DEBUG_MARKER()
 
-    GLenum glFormat = getFormat(p.format);
-    GLenum glType = getType(p.type);
-
-    pixelStore(GL_PACK_ROW_LENGTH, p.stride);
-    pixelStore(GL_PACK_ALIGNMENT, p.alignment);
-    pixelStore(GL_PACK_SKIP_PIXELS, p.left);
-    pixelStore(GL_PACK_SKIP_ROWS, p.top);
-
     /*
      * glReadPixel() operation...
      *
@@ -2436,25 +3287,95 @@ void OpenGLDriver::readPixels(Driver::RenderTargetHandle src,
     GLRenderTarget const* s = handle_cast<GLRenderTarget const*>(src);
     bindFramebuffer(GL_READ_FRAMEBUFFER, s->gl.fbo);
 
-    // TODO: we could use a PBO to make this asynchronous
-    glReadPixels(GLint(x), GLint(y), GLint(width), GLint(height), glFormat, glType, p.buffer);
+    // the rows are flipped vertically to match our API
+    readPixelsAsync(GLint(x), GLint(y), width, height, std::move(p), true);
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::readPixelsAsync(GLint x, GLint y, uint32_t width, uint32_t height,
+        PixelBufferDescriptor&& p, bool flip) noexcept {
+    // Keep a bounded number of reads in flight, if they're all in use, we wait for the oldest.
+    if (mPendingReadPixels.size() >= MAX_PENDING_READ_PIXELS) {
+        updatePendingReadPixels(true);
+    }
+
+    // The pixels are tightly packed in the buffer, they're copied in the layout of the client
+    // buffer once the GPU is done.
+    const size_t size = height *
+            PixelBufferDescriptor::computeDataSize(p.format, p.type, width, 1, p.alignment);
 
-    // now we need to flip the buffer vertically to match our API
-    size_t stride = p.stride ? p.stride : width;
-    size_t bpp = PixelBufferDescriptor::computeDataSize(p.format, p.type, 1, 1, 1);
-    size_t bpr = PixelBufferDescriptor::computeDataSize(p.format, p.type, stride, 1, p.alignment);
-    char* head = (char*)p.buffer + p.left * bpp + bpr * p.top;
-    char* tail = (char*)p.buffer + p.left * bpp + bpr * (p.top + height - 1);
-    // clang vectorizes this loop
-    while (head < tail) {
-        std::swap_ranges(head, head + bpp * width, tail);
-        head += bpr;
-        tail -= bpr;
+    GLReadPixelsBuffer buffer{};
+    if (!mReadPixelsBuffers.empty()) {
+        buffer = mReadPixelsBuffers.back();
+        mReadPixelsBuffers.pop_back();
+    } else {
+        glGenBuffers(1, &buffer.pbo);
     }
 
-    scheduleDestroy(std::move(p));
+    bindBuffer(GL_PIXEL_PACK_BUFFER, buffer.pbo);
+    if (buffer.size < size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(size), nullptr, GL_STREAM_READ);
+        buffer.size = size;
+    }
 
+    pixelStore(GL_PACK_ROW_LENGTH, 0);
+    pixelStore(GL_PACK_ALIGNMENT, p.alignment);
+    pixelStore(GL_PACK_SKIP_PIXELS, 0);
+    pixelStore(GL_PACK_SKIP_ROWS, 0);
+    glReadPixels(x, y, GLint(width), GLint(height), getFormat(p.format), getType(p.type), nullptr);
+    bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mPendingReadPixels.push_back({ buffer, fence, width, height, flip, std::move(p) });
+}
+
+void OpenGLDriver::updatePendingReadPixels(bool wait) noexcept {
+    // reads complete in order, we stop at the first one that's not done
+    auto& pendingReads = mPendingReadPixels;
+    size_t count = 0;
+    for (auto& read : pendingReads) {
+        GLenum status;
+        if (wait && count == 0) {
+            status = glClientWaitSync(read.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        } else {
+            status = glClientWaitSync(read.fence, 0, 0);
+        }
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        completeReadPixels(read);
+        count++;
+    }
+    pendingReads.erase(pendingReads.begin(), pendingReads.begin() + count);
+}
+
+void OpenGLDriver::completeReadPixels(PendingReadPixels& read) noexcept {
+    PixelBufferDescriptor& p = read.data;
+    const size_t width = read.width;
+    const size_t height = read.height;
+    const size_t stride = p.stride ? p.stride : width;
+    const size_t bpp = PixelBufferDescriptor::computeDataSize(p.format, p.type, 1, 1, 1);
+    const size_t srcBpr = PixelBufferDescriptor::computeDataSize(p.format, p.type, width, 1, p.alignment);
+    const size_t dstBpr = PixelBufferDescriptor::computeDataSize(p.format, p.type, stride, 1, p.alignment);
+
+    bindBuffer(GL_PIXEL_PACK_BUFFER, read.buffer.pbo);
+    void const* src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+            GLsizeiptr(srcBpr * height), GL_MAP_READ_BIT);
+    if (src) {
+        char* const dst = (char*)p.buffer + p.left * bpp;
+        for (size_t row = 0; row < height; row++) {
+            const size_t dstRow = read.flip ? (p.top + height - 1 - row) : (p.top + row);
+            memcpy(dst + dstBpr * dstRow, (char const*)src + srcBpr * row, bpp * width);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
     CHECK_GL_ERROR(utils::slog.e)
+
+    glDeleteSync(read.fence);
+    mReadPixelsBuffers.push_back(read.buffer);
+    scheduleDestroy(std::move(p));
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -2483,6 +3404,16 @@ void OpenGLDriver::endFrame(uint32_t frameId) {
     //SYSTRACE_NAME("glFinish");
     //glFinish();
     insertEventMarker("endFrame");
+    updateTimerQueries();
+    updatePendingReadPixels(false);
+    updatePendingAcquiredImages(false);
+
+    publishRenderStats();
+
+    // publish this frame's state changes, see getStateStats()
+    std::lock_guard<utils::Mutex> guard(mStateStatsLock);
+    mLastFrameStateStats = mStateStats;
+    mStateStats = {};
 }
 
 void OpenGLDriver::flush(int) {
@@ -2551,7 +3482,9 @@ void OpenGLDriver::clearWithGeometryPipe(
     if (clearDepth) {
         rs.depthWrite = true;
         useProgram(mClearProgram);
-        glUniform1f(mClearDepthLocation, float(depth) * 2.0f - 1.0f);
+        // the clear triangle is in clip-space, whose depth range depends on clip control
+        const float z = ext.clip_control ? float(depth) : float(depth) * 2.0f - 1.0f;
+        glUniform1f(mClearDepthLocation, z);
         CHECK_GL_ERROR(utils::slog.e)
     }
 
@@ -2591,10 +3524,11 @@ void OpenGLDriver::blit(TargetBufferFlags buffers,
         bindFramebuffer(GL_READ_FRAMEBUFFER, s->gl.fbo);
         bindFramebuffer(GL_DRAW_FRAMEBUFFER, d->gl.fbo);
         disable(GL_SCISSOR_TEST);
+        // depth and stencil can only be copied with GL_NEAREST
         glBlitFramebuffer(
                 srcLeft, srcBottom, srcLeft + srcWidth, srcBottom + srcHeight,
                 dstLeft, dstBottom, dstLeft + dstWidth, dstBottom + dstHeight,
-                mask, GL_LINEAR);
+                mask, (mask & ~GLbitfield(GL_COLOR_BUFFER_BIT)) ? GL_NEAREST : GL_LINEAR);
         enable(GL_SCISSOR_TEST);
         CHECK_GL_ERROR(utils::slog.e)
     }
@@ -2607,6 +3541,10 @@ void OpenGLDriver::draw(
     DEBUG_MARKER()
 
     OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+    if (UTILS_UNLIKELY(!p->isReady(this))) {
+        // the program is still compiling (or failed to), skip the draw rather than waiting
+        return;
+    }
     useProgram(p);
 
     const GLRenderPrimitive* rp = handle_cast<const GLRenderPrimitive *>(rph);
@@ -2616,7 +3554,130 @@ void OpenGLDriver::draw(
 
     glDrawRangeElements(GLenum(rp->type), rp->minIndex, rp->maxIndex, rp->count,
             rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset));
+    countDraw(*rp);
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::drawInstanced(
+        Driver::ProgramHandle ph,
+        Driver::RasterState rs,
+        Driver::RenderPrimitiveHandle rph,
+        uint32_t instanceCount) {
+    DEBUG_MARKER()
+
+    OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+    if (UTILS_UNLIKELY(!p->isReady(this))) {
+        // the program is still compiling (or failed to), skip the draw rather than waiting
+        return;
+    }
+    useProgram(p);
+
+    const GLRenderPrimitive* rp = handle_cast<const GLRenderPrimitive *>(rph);
+    bindVertexArray(rp);
+
+    setRasterState(rs);
+
+    glDrawElementsInstanced(GLenum(rp->type), rp->count,
+            rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset), GLsizei(instanceCount));
+    countDraw(*rp, instanceCount);
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::drawIndirect(
+        Driver::ProgramHandle ph,
+        Driver::RasterState rs,
+        Driver::RenderPrimitiveHandle rph,
+        Driver::StorageBufferHandle indirect,
+        uint32_t offset,
+        uint32_t drawCount,
+        uint32_t stride) {
+    DEBUG_MARKER()
+
+#if GLES31_HEADERS || defined(GL_VERSION_4_3)
+    OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+    if (UTILS_UNLIKELY(!p->isReady(this))) {
+        // the program is still compiling (or failed to), skip the draw rather than waiting
+        return;
+    }
+    useProgram(p);
+
+    const GLRenderPrimitive* rp = handle_cast<const GLRenderPrimitive *>(rph);
+    bindVertexArray(rp);
+
+    setRasterState(rs);
+
+    GLStorageBuffer const* sb = handle_cast<const GLStorageBuffer*>(indirect);
+    bindBuffer(GL_DRAW_INDIRECT_BUFFER, sb->gl.ssbo);
+
+#if defined(GL_VERSION_4_3)
+    glMultiDrawElementsIndirect(GLenum(rp->type), rp->gl.indicesType,
+            reinterpret_cast<const void*>(uintptr_t(offset)), GLsizei(drawCount), GLsizei(stride));
+#else
+    // GLES doesn't have multi-draws
+    for (uint32_t i = 0; i < drawCount; i++) {
+        glDrawElementsIndirect(GLenum(rp->type), rp->gl.indicesType,
+                reinterpret_cast<const void*>(uintptr_t(offset + i * stride)));
+    }
+#endif
+    // the number of triangles is only known by the GPU
+    mRenderStats.drawCount += drawCount;
+#endif
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::dispatchCompute(Driver::ProgramHandle ph,
+        uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+    DEBUG_MARKER()
+
+#if GLES31_HEADERS || defined(GL_VERSION_4_3)
+    OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+    if (UTILS_UNLIKELY(!p->isReady(this))) {
+        // the program is still compiling (or failed to), skip the dispatch rather than waiting
+        return;
+    }
+    useProgram(p);
 
+    glDispatchCompute(groupCountX, groupCountY, groupCountZ);
+#endif
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::memoryBarrier(Driver::BarrierFlags flags) {
+    DEBUG_MARKER()
+
+#if GLES31_HEADERS || defined(GL_VERSION_4_3)
+    GLbitfield barriers = 0;
+    if (flags & BARRIER_STORAGE_BUFFER)     barriers |= GL_SHADER_STORAGE_BARRIER_BIT;
+    if (flags & BARRIER_VERTEX_ATTRIBUTES)  barriers |= GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+                                                        GL_ELEMENT_ARRAY_BARRIER_BIT |
+                                                        GL_BUFFER_UPDATE_BARRIER_BIT;
+    if (flags & BARRIER_INDIRECT_COMMANDS)  barriers |= GL_COMMAND_BARRIER_BIT;
+    if (flags & BARRIER_UNIFORMS)           barriers |= GL_UNIFORM_BARRIER_BIT;
+    if (flags & BARRIER_TEXTURE_FETCH)      barriers |= GL_TEXTURE_FETCH_BARRIER_BIT;
+    if (barriers) {
+        glMemoryBarrier(barriers);
+    }
+#endif
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::copyStorageBufferToVertexBuffer(Driver::StorageBufferHandle sbh,
+        uint32_t srcOffset, Driver::VertexBufferHandle vbh, uint32_t index, uint32_t dstOffset,
+        uint32_t size) {
+    DEBUG_MARKER()
+
+#if GLES31_HEADERS || defined(GL_VERSION_4_3)
+    GLStorageBuffer const* sb = handle_cast<const GLStorageBuffer*>(sbh);
+    GLVertexBuffer const* vb = handle_cast<const GLVertexBuffer*>(vbh);
+    assert(srcOffset + size <= sb->size);
+    bindBuffer(GL_COPY_READ_BUFFER, sb->gl.ssbo);
+    bindBuffer(GL_COPY_WRITE_BUFFER, vb->gl.buffers[index]);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+            GLintptr(srcOffset), GLintptr(dstOffset), GLsizeiptr(size));
+#endif
     CHECK_GL_ERROR(utils::slog.e)
 }
 
@@ -19,16 +19,21 @@
 
 #include "driver/Driver.h"
 #include "driver/DriverBase.h"
+#include "driver/HandleTable.h"
 #include "driver/opengl/GLUtils.h"
 
 #include <utils/compiler.h>
 #include <utils/Allocator.h>
+#include <utils/Mutex.h>
 
 #include <math/vec4.h>
 
 #include <tsl/robin_map.h>
 
+#include <atomic>
 #include <set>
+#include <thread>
+#include <unordered_map>
 
 #include <assert.h>
 
@@ -65,6 +70,8 @@ public:
         } gl;
     };
 
+    struct GLVertexLayout;
+
     struct GLRenderPrimitive : public HwRenderPrimitive {
         using HwRenderPrimitive::HwRenderPrimitive;
         struct {
@@ -72,9 +79,20 @@ public:
             GLenum indicesType = GL_UNSIGNED_INT;
             GLuint elementArray = 0;
             utils::bitset32 vertexAttribArray;
+            // with ext.vertex_attrib_binding, the VAO is shared by all the primitives with the
+            // same vertex format and only the buffer bindings below belong to this primitive
+            GLVertexLayout* layout = nullptr;
+            std::array<GLuint, MAX_ATTRIBUTE_BUFFER_COUNT> buffers = {};
+            std::array<uint32_t, MAX_ATTRIBUTE_BUFFER_COUNT> offsets = {};
+            std::array<uint8_t, MAX_ATTRIBUTE_BUFFER_COUNT> strides = {};
         } gl;
     };
 
+    // the VAO of a vertex format, see bindVertexLayout()
+    struct GLVertexLayout : public GLRenderPrimitive {
+        GLRenderPrimitive const* current = nullptr;     // primitive whose buffers are bound
+    };
+
     struct GLTexture : public HwTexture {
         using HwTexture::HwTexture;
         struct {
@@ -107,7 +125,8 @@ public:
     struct GLStream : public HwStream {
         static constexpr size_t ROUND_ROBIN_TEXTURE_COUNT = 3;      // 3 maximum
         using HwStream::HwStream;
-        bool isNativeStream() const { return gl.externalTextureId == 0; }
+        bool isNativeStream() const { return gl.externalTextureId == 0 && !acquired; }
+        bool isAcquiredStream() const { return acquired; }
         struct Info {
             // storage for the read/write textures below
             driver::ExternalContext::ExternalTexture* ets = nullptr;
@@ -128,6 +147,10 @@ public:
             GLuint fbo = 0;
         } gl;
 
+        // acquired streams sample the client's images directly, see setAcquiredImage().
+        // This fits in the padding before user_thread, GLStream is at the handle size limit.
+        bool acquired = false;
+
         /*
          * The fields below are access from the main application thread
          * (not the GL thread)
@@ -155,6 +178,13 @@ public:
         } gl;
     };
 
+    struct GLStorageBuffer : public HwStorageBuffer {
+        using HwStorageBuffer::HwStorageBuffer;
+        struct {
+            GLuint ssbo = 0;
+        } gl;
+    };
+
     struct GLRenderTarget : public HwRenderTarget {
         struct GL {
             struct RenderBuffer {
@@ -168,9 +198,20 @@ public:
             RenderBuffer color;
             RenderBuffer depth;
             RenderBuffer stencil;
+            GLTexture* color1 = nullptr;    // see createMultipleRenderTarget()
             GLuint fbo = 0;
             uint8_t samples = 1;
             bool useQCOMTiledRendering = false;
+            // the color texture has a single sample, the samples only exist in the tile memory
+            // and are resolved when the tiles are written (EXT_multisampled_render_to_texture)
+            bool implicitResolve = false;
+        } gl;
+    };
+
+    struct GLTimerQuery : public HwTimerQuery {
+        struct {
+            GLuint query = 0;   // GL_TIME_ELAPSED query, or the start timestamp
+            GLuint end = 0;     // the end timestamp, when timestamps are supported
         } gl;
     };
 
@@ -201,30 +242,38 @@ private:
 
     // Memory management...
 
-    class HandleAllocator {
-        utils::PoolAllocator< 16, 16>   mPool0;
-        utils::PoolAllocator< 64, 32>   mPool1;
-        utils::PoolAllocator<128, 32>   mPool2;
-    public:
-        static constexpr size_t MIN_ALIGNMENT_SHIFT = 4;
-        HandleAllocator(const utils::HeapArea& area);
-        void* alloc(size_t size, size_t alignment, size_t extra = 0) noexcept;
-        void free(void* p, size_t size) noexcept;
-    };
-
-    // the arenas for handle allocation needs to be thread-safe
-#ifndef NDEBUG
-    using HandleArena = utils::Arena<HandleAllocator,
-            utils::LockingPolicy::SpinLock,
-            utils::TrackingPolicy::HighWatermark>;
-#else
-    using HandleArena = utils::Arena<HandleAllocator,
-            utils::LockingPolicy::SpinLock>;
-#endif
-
-    HandleArena mHandleArena;
-
-    HandleBase::HandleId allocateHandle(size_t size) noexcept;
+    // The objects of each handle type are in their own table, see HandleTable. handleTable()
+    // finds the table of a handle type, e.g. handleTable((HwTexture*)nullptr).
+    HandleTable<GLVertexBuffer> mVertexBuffersTable;
+    HandleTable<GLIndexBuffer> mIndexBuffersTable;
+    HandleTable<GLRenderPrimitive> mRenderPrimitivesTable;
+    HandleTable<OpenGLProgram> mProgramsTable;
+    HandleTable<GLSamplerBuffer> mSamplerBuffersTable;
+    HandleTable<GLUniformBuffer> mUniformBuffersTable;
+    HandleTable<GLStorageBuffer> mStorageBuffersTable;
+    HandleTable<GLTexture> mTexturesTable;
+    HandleTable<GLRenderTarget> mRenderTargetsTable;
+    HandleTable<HwFence> mFencesTable;
+    HandleTable<GLTimerQuery> mTimerQueriesTable;
+    HandleTable<HwSwapChain> mSwapChainsTable;
+    HandleTable<GLStream> mStreamsTable;
+
+    auto& handleTable(HwVertexBuffer*) noexcept { return mVertexBuffersTable; }
+    auto& handleTable(HwIndexBuffer*) noexcept { return mIndexBuffersTable; }
+    auto& handleTable(HwRenderPrimitive*) noexcept { return mRenderPrimitivesTable; }
+    auto& handleTable(HwProgram*) noexcept { return mProgramsTable; }
+    auto& handleTable(HwSamplerBuffer*) noexcept { return mSamplerBuffersTable; }
+    auto& handleTable(HwUniformBuffer*) noexcept { return mUniformBuffersTable; }
+    auto& handleTable(HwStorageBuffer*) noexcept { return mStorageBuffersTable; }
+    auto& handleTable(HwTexture*) noexcept { return mTexturesTable; }
+    auto& handleTable(HwRenderTarget*) noexcept { return mRenderTargetsTable; }
+    auto& handleTable(HwFence*) noexcept { return mFencesTable; }
+    auto& handleTable(HwTimerQuery*) noexcept { return mTimerQueriesTable; }
+    auto& handleTable(HwSwapChain*) noexcept { return mSwapChainsTable; }
+    auto& handleTable(HwStream*) noexcept { return mStreamsTable; }
+
+    template<typename B>
+    Handle<B> allocateHandle() noexcept;
 
     template<typename D, typename B, typename ... ARGS>
     typename std::enable_if<std::is_base_of<B, D>::value, D>::type*
@@ -234,6 +283,7 @@ private:
             typename = typename std::enable_if<std::is_base_of<B, D>::value, D>::type>
     void destruct(Handle<B>& handle, D const* p) noexcept;
 
+    static void logDanglingHandle(HandleBase::HandleId id) noexcept;
 
     /*
      * handle_cast
@@ -247,9 +297,12 @@ private:
             std::is_pointer<Dp>::value &&
             std::is_base_of<B, typename std::remove_pointer<Dp>::type>::value, Dp>::type
     handle_cast(Handle<B>& handle) noexcept {
-        char* const base = (char *)mHandleArena.getArea().begin();
-        size_t offset = handle.getId() << HandleAllocator::MIN_ALIGNMENT_SHIFT;
-        return static_cast<Dp>(static_cast<void *>(base + offset));
+        auto* const p = handleTable((B*)nullptr).get(handle.getId());
+        if (UTILS_UNLIKELY(!p && handle)) {
+            // the handle's object was destroyed
+            logDanglingHandle(handle.getId());
+        }
+        return static_cast<Dp>(p);
     }
 
 private:
@@ -275,10 +328,11 @@ private:
     void framebufferTexture(Driver::TargetBufferInfo& binfo, GLRenderTarget* rt, GLenum attachment) noexcept;
 
     void framebufferRenderbuffer(GLRenderTarget::GL::RenderBuffer* rb, GLenum attachment,
-            GLenum internalformat, uint32_t width, uint32_t height, uint8_t samples, GLuint fbo) noexcept;
+            GLenum internalformat, uint32_t width, uint32_t height, uint8_t samples, GLuint fbo,
+            bool implicitResolve) noexcept;
 
     GLuint framebufferRenderbuffer(uint32_t width, uint32_t height, uint8_t samples,
-            GLenum attachment, GLenum internalformat, GLuint fbo) noexcept;
+            GLenum attachment, GLenum internalformat, GLuint fbo, bool implicitResolve) noexcept;
 
     void setRasterStateSlow(RasterState rs) noexcept;
     void setRasterState(RasterState rs) noexcept {
@@ -298,8 +352,16 @@ private:
             uint32_t width, uint32_t height, uint32_t depth,
             PixelBufferDescriptor&& data, FaceOffsets const* faceOffsets);
 
+    // Large uploads go through a pixel unpack buffer: the transfer to the texture then
+    // happens asynchronously instead of blocking the driver thread (e.g. while the texture is in
+    // use by the GPU). Returns the base address of the pixels for glTexSubImage2D() and friends.
+    static constexpr size_t UNPACK_BUFFER_MIN_SIZE = 256 * 1024;
+    uintptr_t beginPixelUpload(PixelBufferDescriptor const& data) noexcept;
+    void endPixelUpload() noexcept;
+
+    // 'implicitResolve' must be set for the renderbuffers of the GLRenderTargets that have it
     void renderBufferStorage(GLuint rbo, GLenum internalformat, uint32_t width,
-            uint32_t height, uint8_t samples) const noexcept;
+            uint32_t height, uint8_t samples, bool implicitResolve) const noexcept;
 
     void textureStorage(GLTexture* t,
             uint32_t width, uint32_t height, uint32_t depth) noexcept;
@@ -325,6 +387,8 @@ private:
 
     inline void bindBuffer(GLenum target, GLuint buffer) noexcept;
     inline void bindBufferBase(GLenum target, GLuint index, GLuint buffer) noexcept;
+    inline void bindBufferRange(GLenum target, GLuint index, GLuint buffer,
+            GLintptr offset, GLsizeiptr size) noexcept;
 
     inline void bindFramebuffer(GLenum target, GLuint buffer) noexcept;
 
@@ -361,7 +425,20 @@ private:
         return mSamplerBindings;
     }
 
-    GLsizei getAttachments(std::array<GLenum, 3>& attachments,
+    const Driver::PushConstants& getPushConstants() const noexcept {
+        return mPushConstants;
+    }
+
+    // whether the programs' compilation status can be polled without waiting
+    bool hasParallelShaderCompile() const noexcept { return ext.KHR_parallel_shader_compile; }
+
+    // nullptr when program binaries are not supported, or no cache was set
+    driver::ProgramCache* getProgramCache() const noexcept { return mProgramCache; }
+
+    // identifies the GPU driver in the program cache keys
+    uint64_t getProgramCacheSeed() const noexcept { return mProgramCacheSeed; }
+
+    GLsizei getAttachments(std::array<GLenum, 4>& attachments,
             GLRenderTarget const* rt, uint8_t buffers) const noexcept;
 
     static constexpr const size_t MAX_TEXTURE_UNITS = 16;   // All mobile GPUs as of 2016
@@ -370,9 +447,17 @@ private:
     GLRenderPrimitive mDefaultVAO;
     GLint mMaxRenderBufferSize = 0;
 
+    // counts the state changes of the current frame, see getStateStats()
+    void countStateChange(StateStats::Type type, bool issued) noexcept {
+        (issued ? mStateStats.issued : mStateStats.filtered)[type]++;
+    }
+
     template <typename T, typename F>
-    inline void update_state(T& state, T const& expected, F functor, bool force = false) noexcept {
-        if (UTILS_UNLIKELY(force || state != expected)) {
+    inline void update_state(StateStats::Type type, T& state, T const& expected, F functor,
+            bool force = false) noexcept {
+        const bool issued = force || state != expected;
+        countStateChange(type, issued);
+        if (UTILS_UNLIKELY(issued)) {
             state = expected;
             functor();
         }
@@ -411,6 +496,8 @@ private:
         struct {
             struct {
                 GLuint buffers[MAX_BUFFER_BINDINGS] = { 0 };
+                GLintptr offsets[MAX_BUFFER_BINDINGS] = { 0 };
+                GLsizeiptr sizes[MAX_BUFFER_BINDINGS] = { 0 };  // 0 when the whole buffer is bound
                 GLuint genericBinding = 0;
             } targets[13];
         } buffers;
@@ -457,13 +544,27 @@ private:
 
     Driver::RasterState mRasterState;
 
+    StateStats mStateStats;                 // current frame, only used on the driver thread
+    StateStats mLastFrameStateStats;        // guarded by mStateStatsLock
+    utils::Mutex mStateStatsLock;
+
     GLfloat mMaxAnisotropy = 0.0f;
     ShaderModel mShaderModel;
 
+    // program binaries cache, see setProgramCache()
+    driver::ProgramCache* mProgramCache = nullptr;
+    uint64_t mProgramCacheSeed = 0;
+    bool mProgramBinarySupported = false;
+
     // state required to represent the current render pass
     Driver::RenderTargetHandle mRenderPassTarget;
     Driver::RenderPassParams mRenderPassParams;
 
+    // region of the swap chain redrawn by the current frame, see setFrameDamage()
+    vec4gli mFrameDamage;
+    bool mHasFrameDamage = false;
+    bool mDamageScissor = false;    // the scissor is clipped to mFrameDamage
+
     // state needed for clearing the viewport "by hand", i.e. with a triangle
     GLuint mClearVertexShader;
     GLuint mClearFragmentShader;
@@ -483,9 +584,61 @@ private:
     // sampler buffer binding points (nullptr if not used)
     std::array<HwSamplerBuffer*, Program::NUM_SAMPLER_BINDINGS> mSamplerBindings;   // 8 pointers
 
+    // push constants of the current material instance, see OpenGLProgram::use()
+    Driver::PushConstants mPushConstants;
+
     mutable tsl::robin_map<uint32_t, GLuint> mSamplerMap;
+
+    // VAOs shared by the primitives with the same vertex format (see getVertexLayoutKey()),
+    // node-based because primitives point to them
+    std::unordered_map<uint64_t, GLVertexLayout> mVertexLayouts;
+    static uint64_t getVertexLayoutKey(Driver::AttributeArray const& attributes,
+            uint32_t enabledAttributes) noexcept;
+    GLVertexLayout* getVertexLayout(Driver::AttributeArray const& attributes,
+            uint32_t enabledAttributes) noexcept;
+    void bindVertexLayout(GLRenderPrimitive const* rp) noexcept;
     mutable std::vector<GLTexture*> mExternalStreams;
 
+    // timer queries that have ended but whose result hasn't been read yet
+    std::vector<GLTimerQuery*> mTimerQueries;
+    void updateTimerQueries() noexcept;
+    void queryCounter(GLuint query) noexcept;
+    // GL_TIME_ELAPSED queries can't be nested, this is the one in progress when timestamps
+    // aren't supported
+    GLTimerQuery* mActiveElapsedQuery = nullptr;
+
+    // readPixels() go through pixel pack buffers, the client is called back when the GPU is done
+    static constexpr size_t MAX_PENDING_READ_PIXELS = 4;
+    struct GLReadPixelsBuffer {
+        GLuint pbo;
+        size_t size;
+    };
+    struct PendingReadPixels {
+        GLReadPixelsBuffer buffer;
+        GLsync fence;
+        uint32_t width;
+        uint32_t height;
+        bool flip;          // whether the rows are copied bottom to top
+        PixelBufferDescriptor data;
+    };
+    std::vector<PendingReadPixels> mPendingReadPixels;   // oldest first
+    std::vector<GLReadPixelsBuffer> mReadPixelsBuffers;  // free buffers
+    void readPixelsAsync(GLint x, GLint y, uint32_t width, uint32_t height,
+            PixelBufferDescriptor&& p, bool flip) noexcept;
+    void updatePendingReadPixels(bool wait) noexcept;
+    void completeReadPixels(PendingReadPixels& read) noexcept;
+
+    // images of acquired streams are released once the GPU is done sampling them
+    struct PendingAcquiredImage {
+        GLsync fence;
+        BufferDescriptor image;
+    };
+    std::vector<PendingAcquiredImage> mPendingAcquiredImages;   // oldest first
+    std::unordered_map<GLStream const*, BufferDescriptor> mAcquiredImages;  // current images
+    void bindAcquiredImage(GLTexture* t, GLStream const* s) noexcept;
+    void releaseAcquiredImage(GLStream* s) noexcept;
+    void updatePendingAcquiredImages(bool wait) noexcept;
+
     // supported extensions detected at runtime
     struct {
         bool texture_compression_s3tc = false;
@@ -495,6 +648,16 @@ private:
         bool OES_EGL_image_external_essl3 = false;
         bool EXT_debug_marker = false;
         bool EXT_color_buffer_half_float = false;
+        bool EXT_disjoint_timer_query = false;
+        bool timestamp_queries = false;     // timer queries can use (nestable) timestamps
+        bool clip_control = false;
+        bool KHR_parallel_shader_compile = false;
+        bool texture_storage_multisample = false;
+        bool EXT_multisampled_render_to_texture = false;
+        bool EXT_shader_framebuffer_fetch = false;
+        bool vertex_attrib_binding = false;
+        bool ARB_bindless_texture = false;
+        bool compute_shader = false;        // also the storage buffers and memory barriers
     } ext;
 
     struct {
@@ -588,7 +751,7 @@ constexpr size_t OpenGLDriver::getIndexForBufferTarget(GLenum target) noexcept {
 
 void OpenGLDriver::activeTexture(GLuint unit) noexcept {
     assert(unit < MAX_TEXTURE_UNITS);
-    update_state(state.textures.active, unit, [&]() {
+    update_state(StateStats::TEXTURE, state.textures.active, unit, [&]() {
         glActiveTexture(GL_TEXTURE0 + unit);
     });
 }
@@ -608,7 +771,7 @@ void OpenGLDriver::bindTexture(GLuint unit, GLuint target, GLuint texId) noexcep
 
 void OpenGLDriver::bindSampler(GLuint unit, GLuint sampler) noexcept {
     assert(unit < MAX_TEXTURE_UNITS);
-    update_state(state.textures.units[unit].sampler, sampler, [&]() {
+    update_state(StateStats::SAMPLER, state.textures.units[unit].sampler, sampler, [&]() {
         glBindSampler(unit, sampler);
     });
 }
@@ -17,26 +17,69 @@
 #include "driver/opengl/OpenGLProgram.h"
 
 #include <cctype>
+#include <memory>
 #include <sstream>
 
+#include <string.h>
+
 #include <utils/Log.h>
 #include <utils/compiler.h>
 #include <utils/Panic.h>
 
+#include "driver/opengl/GLUtils.h"
 #include "driver/opengl/OpenGLDriver.h"
 
 namespace filament {
 
 using namespace math;
 using namespace utils;
+using namespace driver;
 
-OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) noexcept
+OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, Program&& programBuilder) noexcept
         :  HwProgram(programBuilder.getName()), mIsValid(false) {
 
-    using Shader = Program::Shader;
-
     const auto& shadersSource = programBuilder.getShadersSource();
 
+    // try the program cache first, this saves compiling and linking entirely
+    ProgramCache* const cache = gl->getProgramCache();
+    uint64_t key = 0;
+    GLuint program = 0;
+    if (cache) {
+        key = GLUtils::hash(shadersSource[0].c_str(), shadersSource[0].size(),
+                gl->getProgramCacheSeed());
+        for (size_t i = 1; i < Program::NUM_SHADER_TYPES; i++) {
+            key = GLUtils::hash(shadersSource[i].c_str(), shadersSource[i].size(), key);
+        }
+        program = loadBinary(cache, key);
+    }
+
+    // The compilation and the link are only issued here, their status is queried when the
+    // program is first needed (see isReady()), so the driver can do the work in the background
+    // and several programs can be compiled in parallel.
+    bool compiled = false;
+    if (!program) {
+        program = compileAndLink(shadersSource, cache != nullptr);
+        compiled = true;
+    }
+
+    if (UTILS_LIKELY(program)) {
+        this->gl.program = program;
+        mLazyInitializationData.reset(new LazyInitializationData{
+                std::move(programBuilder), compiled ? cache : nullptr, key });
+    } else {
+        // failing to compile a program can't be fatal, because this will happen a lot in
+        // the material tools. We need to have a better way to handle these errors and
+        // return to the editor.
+        PANIC_LOG("failed to compile glsl program");
+    }
+}
+
+GLuint OpenGLProgram::compileAndLink(
+        std::array<utils::CString, Program::NUM_SHADER_TYPES> const& shadersSource,
+        bool retrievable) noexcept {
+
+    using Shader = Program::Shader;
+
     // build all shaders
     #pragma nounroll
     for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
@@ -49,149 +92,293 @@ OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) no
             case Shader::FRAGMENT:
                 glShaderType = GL_FRAGMENT_SHADER;
                 break;
+            case Shader::COMPUTE:
+#if GLES31_HEADERS || defined(GL_VERSION_4_3)
+                glShaderType = GL_COMPUTE_SHADER;
+                break;
+#else
+                continue;
+#endif
         }
 
         if (shadersSource[i].length()) {
-            GLint status;
             char const* const source = shadersSource[i].c_str();
-
             GLuint shaderId = glCreateShader(glShaderType);
             glShaderSource(shaderId, 1, &source, nullptr);
             glCompileShader(shaderId);
-
-            glGetShaderiv(shaderId, GL_COMPILE_STATUS, &status);
-            if (UTILS_UNLIKELY(status != GL_TRUE)) {
-                logCompilationError(slog.e, shaderId, source);
-                glDeleteShader(shaderId);
-                return;
-            }
             this->gl.shaders[i] = shaderId;
             mValidShaderSet |= 1U << i;
         }
     }
 
-    // we need at least a vertex and fragment program
+    // we need either a vertex and fragment program, or a compute program alone
     const uint8_t validShaderSet = mValidShaderSet;
     const uint8_t mask = VERTEX_SHADER_BIT | FRAGMENT_SHADER_BIT;
-    if (UTILS_LIKELY((mValidShaderSet & mask) == mask)) {
-        GLint status;
-        GLuint program = glCreateProgram();
-        for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
-            if (validShaderSet & (1U << i)) {
-                glAttachShader(program, this->gl.shaders[i]);
-            }
+    if (UTILS_UNLIKELY((validShaderSet & mask) != mask && validShaderSet != COMPUTE_SHADER_BIT)) {
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
+        if (validShaderSet & (1U << i)) {
+            glAttachShader(program, this->gl.shaders[i]);
+        }
+    }
+#if !defined(__EMSCRIPTEN__)
+    if (retrievable) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+#endif
+    glLinkProgram(program);
+    return program;
+}
+
+bool OpenGLProgram::isReadySlow(OpenGLDriver* gl) noexcept {
+    // with KHR_parallel_shader_compile we can tell whether the link is done without waiting
+    if (gl->hasParallelShaderCompile()) {
+        GLint completed = GL_FALSE;
+        glGetProgramiv(this->gl.program, GL_COMPLETION_STATUS_KHR, &completed);
+        if (completed != GL_TRUE) {
+            return false;
         }
-        glLinkProgram(program);
+    }
+    initialize(gl);
+    return mIsValid;
+}
 
-        glGetProgramiv(program, GL_LINK_STATUS, &status);
-        if (UTILS_UNLIKELY(status != GL_TRUE)) {
-            char error[512];
-            glGetProgramInfoLog(program, sizeof(error), nullptr, error);
+void OpenGLProgram::initialize(OpenGLDriver* gl) noexcept {
+    std::unique_ptr<LazyInitializationData> data(std::move(mLazyInitializationData));
+    Program const& builder = data->program;
+    const GLuint program = this->gl.program;
 
-            slog.e << "LINKING: " << error << io::endl;
-            glDeleteProgram(program);
-            return;
+    GLint status;
+    const uint8_t validShaderSet = mValidShaderSet;
+    for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
+        if (validShaderSet & (1U << i)) {
+            glGetShaderiv(this->gl.shaders[i], GL_COMPILE_STATUS, &status);
+            if (UTILS_UNLIKELY(status != GL_TRUE)) {
+                logCompilationError(slog.e, this->gl.shaders[i],
+                        builder.getShadersSource()[i].c_str());
+                PANIC_LOG("failed to compile glsl program");
+                return;
+            }
         }
-        this->gl.program = program;
+    }
 
-        // Associate each UniformBlock in the program to a known binding.
-        auto const& uniformInterfaceBlocks = programBuilder.getUniformInterfaceBlocks();
-        size_t n = uniformInterfaceBlocks.size();
-        #pragma nounroll
-        for (GLuint binding = 0; binding < n; binding++) {
-            auto const& uib = uniformInterfaceBlocks[binding];
-            if (uib != nullptr) {
-                GLint index = glGetUniformBlockIndex(program, uib->getName().c_str());
-                if (index >= 0) {
-                    glUniformBlockBinding(program, GLuint(index), binding);
-                }
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (UTILS_UNLIKELY(status != GL_TRUE)) {
+        char error[512];
+        glGetProgramInfoLog(program, sizeof(error), nullptr, error);
+        slog.e << "LINKING: " << error << io::endl;
+        PANIC_LOG("failed to compile glsl program");
+        return;
+    }
+
+    if (data->cache) {
+        storeBinary(data->cache, data->key, program);
+    }
+
+    // Associate each UniformBlock in the program to a known binding.
+    auto const& uniformInterfaceBlocks = builder.getUniformInterfaceBlocks();
+    size_t n = uniformInterfaceBlocks.size();
+    #pragma nounroll
+    for (GLuint binding = 0; binding < n; binding++) {
+        auto const& uib = uniformInterfaceBlocks[binding];
+        if (uib != nullptr) {
+            GLint index = glGetUniformBlockIndex(program, uib->getName().c_str());
+            if (index >= 0) {
+                glUniformBlockBinding(program, GLuint(index), binding);
             }
         }
+    }
 
-        if (programBuilder.hasSamplers()) {
-            // if we have samplers, we need to do a bit of extra work
-            // activate this program so we can set all its samplers once and for all (glUniform1i)
-            gl->useProgram(program);
-
-            auto const& samplerInterfaceBlocks = programBuilder.getSamplerInterfaceBlocks();
-            auto& indicesRun = mIndicesRuns;
-            uint8_t numUsedBindings = 0;
-            uint8_t tmu = 0;
-            #pragma nounroll
-            for (size_t i = 0, c = samplerInterfaceBlocks.size(); i < c; i++) {
-                auto const& sib = samplerInterfaceBlocks[i];
-                if (sib != nullptr) {
-                    // Cache the sampler uniform locations for each interface block
-                    auto const& infos(sib->getSamplerInfoList());
-                    if (!infos.empty()) {
-                        BlockInfo& info = mBlockInfos[numUsedBindings];
-                        info.binding = uint8_t(i);
-
-                        // sampler interface block name
-                        std::string sib_name(sib->getName().c_str());
-                        sib_name.front() = char(std::tolower(sib_name.front()));
-
-                        uint8_t count = 0;
-                        for (uint8_t j = 0, m = uint8_t(infos.size()); j < m; ++j) {
-                            // build unique name for this uniform (sampler)
-                            auto const& e = infos[j];
-                            std::string e_name(e.name.c_str());
-                            std::string uniformSamplerName(sib_name + "_" + e_name);
-
-                            // find its location and associate a TMU to it
-                            GLint loc = glGetUniformLocation(program, uniformSamplerName.c_str());
-                            if (loc >= 0) {
-                                glUniform1i(loc, tmu);
-                                indicesRun[tmu] = j;
-                                count++;
-                                tmu++;
-                            } else {
-                                // glGetUniformLocation could fail if the uniform is not used
-                                // in the program. We should just ignore the error in that case.
-                            }
-                        }
+    if (builder.hasSamplers()) {
+        // if we have samplers, we need to do a bit of extra work
+        // activate this program so we can set all its samplers once and for all (glUniform1i)
+        gl->useProgram(program);
 
-                        if (count > 0) {
-                            numUsedBindings++;
-                            info.count = uint8_t(count - 1);
+        auto const& samplerInterfaceBlocks = builder.getSamplerInterfaceBlocks();
+        auto& indicesRun = mIndicesRuns;
+        uint8_t numUsedBindings = 0;
+        uint8_t tmu = 0;
+        #pragma nounroll
+        for (size_t i = 0, c = samplerInterfaceBlocks.size(); i < c; i++) {
+            auto const& sib = samplerInterfaceBlocks[i];
+            if (sib != nullptr) {
+                // Cache the sampler uniform locations for each interface block
+                auto const& infos(sib->getSamplerInfoList());
+                if (!infos.empty()) {
+                    BlockInfo& info = mBlockInfos[numUsedBindings];
+                    info.binding = uint8_t(i);
+
+                    // sampler interface block name
+                    std::string sib_name(sib->getName().c_str());
+                    sib_name.front() = char(std::tolower(sib_name.front()));
+
+                    uint8_t count = 0;
+                    for (uint8_t j = 0, m = uint8_t(infos.size()); j < m; ++j) {
+                        // build unique name for this uniform (sampler)
+                        auto const& e = infos[j];
+                        std::string e_name(e.name.c_str());
+                        std::string uniformSamplerName(sib_name + "_" + e_name);
+
+                        // find its location and associate a TMU to it
+                        GLint loc = glGetUniformLocation(program, uniformSamplerName.c_str());
+                        if (loc >= 0) {
+                            glUniform1i(loc, tmu);
+                            indicesRun[tmu] = j;
+                            count++;
+                            tmu++;
+                        } else {
+                            // glGetUniformLocation could fail if the uniform is not used
+                            // in the program. We should just ignore the error in that case.
                         }
                     }
+
+                    if (count > 0) {
+                        numUsedBindings++;
+                        info.count = uint8_t(count - 1);
+                    }
                 }
             }
-            mUsedBindingsCount = numUsedBindings;
         }
-        mIsValid = true;
+        mUsedBindingsCount = numUsedBindings;
     }
 
-    // failing to compile a program can't be fatal, because this will happen a lot in
-    // the material tools. We need to have a better way to handle these errors and
-    // return to the editor.
-    if (UTILS_UNLIKELY(!isValid())) {
-        PANIC_LOG("failed to compile glsl program");
+    UniformInterfaceBlock const* pushConstants = builder.getPushConstants();
+    if (pushConstants) {
+        // the push constants are the fields of a struct uniform
+        std::string instanceName(pushConstants->getName().c_str());
+        instanceName.front() = char(std::tolower(instanceName.front()));
+        for (auto const& info : pushConstants->getUniformInfoList()) {
+            std::string uniformName(instanceName + "." + info.name.c_str());
+            GLint loc = glGetUniformLocation(program, uniformName.c_str());
+            if (loc >= 0) {
+                mPushConstantInfos.push_back({ loc, uint32_t(info.getBufferOffset()), info.type });
+            }
+        }
+        // the uniforms are initially zero
+        mPushConstants.resize(pushConstants->getSize(), 0);
     }
+    mIsValid = true;
+}
+
+// The cached content is the binary format followed by the program binary.
+
+GLuint OpenGLProgram::loadBinary(ProgramCache* cache, uint64_t key) noexcept {
+#if !defined(__EMSCRIPTEN__)
+    const size_t size = cache->get(key, nullptr, 0);
+    if (size <= sizeof(GLenum)) {
+        return 0;
+    }
+
+    std::vector<uint8_t> data(size);
+    if (cache->get(key, data.data(), size) != size) {
+        return 0;
+    }
+
+    GLenum format;
+    memcpy(&format, data.data(), sizeof(format));
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, data.data() + sizeof(GLenum), GLsizei(size - sizeof(GLenum)));
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (UTILS_UNLIKELY(status != GL_TRUE)) {
+        // The driver doesn't accept this binary anymore (e.g. it was updated), we'll compile
+        // the program and replace it. An unknown format raises GL_INVALID_ENUM, clear it.
+        glGetError();
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+#else
+    return 0;
+#endif
+}
+
+void OpenGLProgram::storeBinary(ProgramCache* cache, uint64_t key, GLuint program) noexcept {
+#if !defined(__EMSCRIPTEN__)
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<uint8_t> data(sizeof(GLenum) + length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, data.data() + sizeof(GLenum));
+    if (written > 0) {
+        memcpy(data.data(), &format, sizeof(format));
+        cache->put(key, data.data(), sizeof(GLenum) + written);
+    }
+#endif
 }
 
 OpenGLProgram::~OpenGLProgram() noexcept {
     const size_t validShaderSet = mValidShaderSet;
-    const bool isValid = mIsValid;
     GLuint program = gl.program;
     if (validShaderSet) {
         #pragma nounroll
         for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
             if (validShaderSet & (1U << i)) {
                 const GLuint shader = gl.shaders[i];
-                if (isValid) {
+                if (program) {
                     glDetachShader(program, shader);
                 }
                 glDeleteShader(shader);
             }
         }
     }
-    if (isValid) {
+    if (program) {
         glDeleteProgram(program);
     }
 }
 
+void OpenGLProgram::updatePushConstants(OpenGLDriver* gl) noexcept {
+    Driver::PushConstants const& constants = gl->getPushConstants();
+    // constants of another size belong to another material, which happens when the previous
+    // material instance bound had no push constants
+    if (UTILS_UNLIKELY(constants.size != mPushConstants.size()) ||
+            !memcmp(mPushConstants.data(), constants.data, constants.size)) {
+        return;
+    }
+    memcpy(mPushConstants.data(), constants.data, constants.size);
+
+    using Type = UniformInterfaceBlock::Type;
+    for (auto const& info : mPushConstantInfos) {
+        const void* p = mPushConstants.data() + info.offset;
+        const GLint loc = info.location;
+        switch (info.type) {
+            case Type::BOOL:
+            case Type::INT:    glUniform1iv(loc, 1, static_cast<const GLint*>(p)); break;
+            case Type::BOOL2:
+            case Type::INT2:   glUniform2iv(loc, 1, static_cast<const GLint*>(p)); break;
+            case Type::BOOL3:
+            case Type::INT3:   glUniform3iv(loc, 1, static_cast<const GLint*>(p)); break;
+            case Type::BOOL4:
+            case Type::INT4:   glUniform4iv(loc, 1, static_cast<const GLint*>(p)); break;
+            case Type::UINT:   glUniform1uiv(loc, 1, static_cast<const GLuint*>(p)); break;
+            case Type::UINT2:  glUniform2uiv(loc, 1, static_cast<const GLuint*>(p)); break;
+            case Type::UINT3:  glUniform3uiv(loc, 1, static_cast<const GLuint*>(p)); break;
+            case Type::UINT4:  glUniform4uiv(loc, 1, static_cast<const GLuint*>(p)); break;
+            case Type::FLOAT:  glUniform1fv(loc, 1, static_cast<const GLfloat*>(p)); break;
+            case Type::FLOAT2: glUniform2fv(loc, 1, static_cast<const GLfloat*>(p)); break;
+            case Type::FLOAT3: glUniform3fv(loc, 1, static_cast<const GLfloat*>(p)); break;
+            case Type::FLOAT4: glUniform4fv(loc, 1, static_cast<const GLfloat*>(p)); break;
+            case Type::MAT4:
+                glUniformMatrix4fv(loc, 1, GL_FALSE, static_cast<const GLfloat*>(p));
+                break;
+            case Type::MAT3:
+                // mat3 push constants are rejected by the material compiler
+                break;
+        }
+    }
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 void OpenGLProgram::updateSamplers(OpenGLDriver* gl) noexcept {
     using GLTexture = OpenGLDriver::GLTexture;
 
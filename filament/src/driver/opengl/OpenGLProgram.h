@@ -20,6 +20,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <memory>
 #include <vector>
 
 #include <utils/compiler.h>
@@ -38,11 +39,22 @@ class Program;
 class OpenGLProgram : public HwProgram {
 public:
 
-    OpenGLProgram(OpenGLDriver* gl, const Program& builder) noexcept;
+    OpenGLProgram(OpenGLDriver* gl, Program&& builder) noexcept;
     ~OpenGLProgram() noexcept;
 
     bool isValid() const noexcept { return mIsValid; }
 
+    // Returns whether the program can be used. The first time it's ready, this checks the
+    // compilation and sets the program up. This only waits for the driver to finish compiling
+    // if KHR_parallel_shader_compile is not supported, otherwise it returns false until then.
+    // Returns false if the program failed to compile.
+    bool isReady(OpenGLDriver* const gl) noexcept {
+        if (UTILS_LIKELY(!mLazyInitializationData)) {
+            return mIsValid;
+        }
+        return isReadySlow(gl);
+    }
+
     void use(OpenGLDriver* const gl) noexcept {
         if (UTILS_UNLIKELY(mUsedBindingsCount)) {
             // We rely on GL state tracking to avoid unnecessary glBindTexture / glBindSampler
@@ -59,12 +71,15 @@ public:
 
             updateSamplers(gl);
         }
+        if (UTILS_UNLIKELY(!mPushConstantInfos.empty())) {
+            updatePushConstants(gl);
+        }
     }
 
     struct {
         GLuint shaders[Program::NUM_SHADER_TYPES];
         GLuint program;
-    } gl; // 12 bytes
+    } gl; // 16 bytes
 
     static void logCompilationError(utils::io::ostream& out, GLuint shaderId, char const* source) noexcept;
 
@@ -72,6 +87,7 @@ private:
     static constexpr uint8_t NUM_TEXTURE_UNITS = OpenGLDriver::MAX_TEXTURE_UNITS;
     static constexpr uint8_t VERTEX_SHADER_BIT   = uint8_t(1) << size_t(Program::Shader::VERTEX);
     static constexpr uint8_t FRAGMENT_SHADER_BIT = uint8_t(1) << size_t(Program::Shader::FRAGMENT);
+    static constexpr uint8_t COMPUTE_SHADER_BIT  = uint8_t(1) << size_t(Program::Shader::COMPUTE);
 
     struct BlockInfo {
         uint8_t binding : 3;    // binding (i.e.: index in mSamplerBindings)
@@ -85,6 +101,22 @@ private:
         static_assert(Program::NUM_SAMPLER_BINDINGS <= 8, "NUM_SAMPLER_BINDINGS must be <= 8");
     };
 
+    // OpenGL has no push constants, they're default-block uniforms of the program instead
+    struct PushConstantInfo {
+        GLint location;
+        uint32_t offset;    // in bytes, in Driver::PushConstants::data
+        UniformInterfaceBlock::Type type;
+    };
+
+    // what we need to finish setting the program up once it's compiled
+    struct LazyInitializationData {
+        Program program;
+        driver::ProgramCache* cache;    // where to store the binary, if not loaded from it
+        uint64_t key;
+    };
+
+    std::unique_ptr<LazyInitializationData> mLazyInitializationData;
+
     uint8_t mUsedBindingsCount = 0;
     uint8_t mValidShaderSet = 0;
     bool mIsValid = false;
@@ -95,7 +127,23 @@ private:
     // runs of indices into SamplerBuffer -- run start index and size given by BlockInfo
     std::array<uint8_t, NUM_TEXTURE_UNITS> mIndicesRuns;    // 16 bytes
 
+    // the push constants that were last set on this program, the GL state of the program
+    std::vector<PushConstantInfo> mPushConstantInfos;
+    std::vector<uint8_t> mPushConstants;
+
     void updateSamplers(OpenGLDriver* gl) noexcept;
+    void updatePushConstants(OpenGLDriver* gl) noexcept;
+
+    bool isReadySlow(OpenGLDriver* gl) noexcept;
+    void initialize(OpenGLDriver* gl) noexcept;
+
+    // issues the compilation and the link, returns 0 if the program is incomplete
+    GLuint compileAndLink(std::array<utils::CString, Program::NUM_SHADER_TYPES> const& shadersSource,
+            bool retrievable) noexcept;
+
+    // returns the program loaded from the cache, or 0 if it's not there or was rejected
+    static GLuint loadBinary(driver::ProgramCache* cache, uint64_t key) noexcept;
+    static void storeBinary(driver::ProgramCache* cache, uint64_t key, GLuint program) noexcept;
 };
 
 
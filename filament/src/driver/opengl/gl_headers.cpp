@@ -33,6 +33,17 @@ PFNGLINSERTEVENTMARKEREXTPROC glInsertEventMarkerEXT;
 PFNGLPUSHGROUPMARKEREXTPROC glPushGroupMarkerEXT;
 PFNGLPOPGROUPMARKEREXTPROC glPopGroupMarkerEXT;
 #endif
+#ifdef GL_EXT_disjoint_timer_query
+PFNGLGETQUERYOBJECTUI64VEXTPROC glGetQueryObjectui64vEXT;
+PFNGLQUERYCOUNTEREXTPROC glQueryCounterEXT;
+#endif
+#ifdef GL_EXT_clip_control
+PFNGLCLIPCONTROLEXTPROC glClipControlEXT;
+#endif
+#ifdef GL_EXT_multisampled_render_to_texture
+PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC glRenderbufferStorageMultisampleEXT;
+PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC glFramebufferTexture2DMultisampleEXT;
+#endif
 };
 
 using namespace glext;
@@ -70,6 +81,32 @@ public:
                 (PFNGLPOPGROUPMARKEREXTPROC)eglGetProcAddress(
                         "glPopGroupMarkerEXT");
 #endif
+
+#ifdef GL_EXT_disjoint_timer_query
+        glGetQueryObjectui64vEXT =
+                (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress(
+                        "glGetQueryObjectui64vEXT");
+
+        glQueryCounterEXT =
+                (PFNGLQUERYCOUNTEREXTPROC)eglGetProcAddress(
+                        "glQueryCounterEXT");
+#endif
+
+#ifdef GL_EXT_clip_control
+        glClipControlEXT =
+                (PFNGLCLIPCONTROLEXTPROC)eglGetProcAddress(
+                        "glClipControlEXT");
+#endif
+
+#ifdef GL_EXT_multisampled_render_to_texture
+        glRenderbufferStorageMultisampleEXT =
+                (PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC)eglGetProcAddress(
+                        "glRenderbufferStorageMultisampleEXT");
+
+        glFramebufferTexture2DMultisampleEXT =
+                (PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC)eglGetProcAddress(
+                        "glFramebufferTexture2DMultisampleEXT");
+#endif
     }
 } instance;
 } // namespace filament
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/vulkan/VulkanBarriers.h"
+
+namespace filament {
+namespace driver {
+
+static constexpr VkAccessFlags WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT |
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+void VulkanBarriers::access(VkImage image, VkImageSubresourceRange const& range,
+        VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access,
+        bool discard) noexcept {
+    std::vector<Level>& levels = mImages[image];
+    const uint32_t end = range.baseMipLevel + range.levelCount;
+    if (levels.size() < end) {
+        levels.resize(end);
+    }
+    const VkAccessFlags writes = access & WRITE_ACCESS;
+
+    // The consecutive levels that were left in the same state share a barrier.
+    VkImageMemoryBarrier* barrier = nullptr;
+    for (uint32_t i = range.baseMipLevel; i < end; i++) {
+        Level& level = levels[i];
+        const bool transition = level.layout != layout;
+        const bool hazard = writes ?
+                (level.writeStages | level.readStages) != 0 :
+                level.writeStages && (stages & ~level.readStages);
+        if (!transition && !hazard) {
+            level.readStages |= stages;
+            if (writes) {
+                level.writeStages = stages;
+                level.writeAccess = writes;
+                level.readStages = 0;
+            }
+            barrier = nullptr;
+            continue;
+        }
+
+        // A read after a read only needs to wait for the last write, everything else waits for
+        // all the accesses since the last write.
+        mSrcStages |= (writes || transition) ?
+                level.writeStages | level.readStages : level.writeStages;
+        mDstStages |= stages;
+        const VkImageLayout oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : level.layout;
+        if (barrier && barrier->oldLayout == oldLayout &&
+                barrier->srcAccessMask == level.writeAccess) {
+            barrier->subresourceRange.levelCount++;
+        } else {
+            mImageBarriers.push_back({
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .srcAccessMask = level.writeAccess,
+                .dstAccessMask = access,
+                .oldLayout = oldLayout,
+                .newLayout = layout,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = image,
+                .subresourceRange = {
+                    range.aspectMask, i, 1, range.baseArrayLayer, range.layerCount
+                }
+            });
+            barrier = &mImageBarriers.back();
+        }
+
+        // A layout transition counts as a write that only the destination stages see.
+        level.layout = layout;
+        level.writeStages = stages;
+        level.writeAccess = writes;
+        level.readStages = writes ? 0 : stages;
+    }
+}
+
+void VulkanBarriers::accessMemory(VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+        VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) noexcept {
+    mSrcStages |= srcStages;
+    mDstStages |= dstStages;
+    mSrcAccess |= srcAccess;
+    mDstAccess |= dstAccess;
+}
+
+void VulkanBarriers::flush(VkCommandBuffer cmdbuffer) noexcept {
+    if (mImageBarriers.empty() && !mSrcAccess && !mDstAccess) {
+        return;
+    }
+    const VkMemoryBarrier memoryBarrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = mSrcAccess,
+        .dstAccessMask = mDstAccess
+    };
+    const bool hasMemoryBarrier = mSrcAccess || mDstAccess;
+    vkCmdPipelineBarrier(cmdbuffer,
+            mSrcStages ? mSrcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            mDstStages ? mDstStages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            hasMemoryBarrier ? 1u : 0u, &memoryBarrier, 0, nullptr,
+            uint32_t(mImageBarriers.size()), mImageBarriers.data());
+    mImageBarriers.clear();
+    mSrcAccess = 0;
+    mDstAccess = 0;
+    mSrcStages = 0;
+    mDstStages = 0;
+}
+
+} // namespace filament
+} // namespace driver
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_VULKANBARRIERS_H
+#define TNT_FILAMENT_DRIVER_VULKANBARRIERS_H
+
+#include <bluevk/BlueVK.h>
+
+#include <tsl/robin_map.h>
+
+#include <vector>
+
+namespace filament {
+namespace driver {
+
+// Tracks the layout and the last accesses of each mip level of the images, and collects the
+// barriers that the next commands need, so that they're all recorded with a single
+// vkCmdPipelineBarrier. The barriers only wait for the stages that actually accessed the levels,
+// and none is needed between reads in the same layout.
+//
+// The accesses must be declared in the order the GPU executes them, i.e. for commands submitted
+// to the same queue.
+class VulkanBarriers {
+public:
+    // Declares that the next commands access the given levels of the image, in the given layout.
+    // The previous content is not preserved when 'discard' is true.
+    void access(VkImage image, VkImageSubresourceRange const& range, VkImageLayout layout,
+            VkPipelineStageFlags stages, VkAccessFlags access, bool discard = false) noexcept;
+
+    // Declares that the next commands access memory written at 'srcStages', this is the global
+    // memory barrier used for buffers.
+    void accessMemory(VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+            VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) noexcept;
+
+    // Records the barriers collected since the last flush, if any.
+    void flush(VkCommandBuffer cmdbuffer) noexcept;
+
+    // Forgets an image that's being destroyed, its handle can be reused.
+    void forget(VkImage image) noexcept { mImages.erase(image); }
+
+private:
+    struct Level {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags writeStages = 0;   // last write, or layout transition
+        VkAccessFlags writeAccess = 0;
+        VkPipelineStageFlags readStages = 0;    // stages that read (and see) the last write
+    };
+
+    tsl::robin_map<VkImage, std::vector<Level>> mImages;
+
+    std::vector<VkImageMemoryBarrier> mImageBarriers;
+    VkAccessFlags mSrcAccess = 0;               // of the memory barrier
+    VkAccessFlags mDstAccess = 0;
+    VkPipelineStageFlags mSrcStages = 0;
+    VkPipelineStageFlags mDstStages = 0;
+};
+
+} // namespace filament
+} // namespace driver
+
+#endif // TNT_FILAMENT_DRIVER_VULKANBARRIERS_H
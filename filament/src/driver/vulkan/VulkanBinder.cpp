@@ -33,12 +33,9 @@ namespace driver {
 // allocator by passing in a null pointer, and we pinpoint the argument by using the VKALLOC macro.
 static constexpr VkAllocationCallbacks* VKALLOC = nullptr;
 
-// Maximum number of descriptor sets that can be allocated by the pool.
-// TODO: Make VulkanBinder robust against a large number of descriptors.
-// There are several approaches we could take to deal with too many descriptors:
-// - Create another pool after hitting the limit of the first pool.
-// - Allow multiple descriptors to bind simultaneously; organize binding points into groups.
-static constexpr uint32_t MAX_NUM_DESCRIPTORS = 1000;
+// Maximum number of descriptor sets that can be allocated by each pool. More pools are created
+// when they're all full.
+static constexpr uint32_t DESCRIPTOR_POOL_SIZE = 1000;
 
 static VulkanBinder::RasterState createDefaultRasterState();
 
@@ -63,20 +60,33 @@ VulkanBinder::~VulkanBinder() {
 }
 
 bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
-        VkPipelineLayout* pipelineLayout, DescriptorUpdateOp** changes) noexcept {
+        VkPipelineLayout* pipelineLayout, const uint32_t** dynamicOffsets,
+        DescriptorUpdateOp** changes) noexcept {
     // If this method has never been called before, we need to create a new layout object.
     if (!mPipelineLayout) {
         createLayoutsAndDescriptors();
     }
 
+    *dynamicOffsets = mDynamicOffsets;
+
     // If no bindings have been dirtied, update the timestamp (most recent access) and return false
-    // to indicate there's no need to re-bind.
+    // to indicate there's no need to re-bind, unless only the offsets of the uniform buffers have
+    // changed.
     if (!mDirtyDescriptor) {
         assert(mCurrentDescriptor && mCurrentDescriptor->bound);
         *descriptor = mCurrentDescriptor->handle;
         mCurrentDescriptor->timestamp = mCurrentTime;
+        if (mDirtyDynamicOffsets) {
+            mDirtyDynamicOffsets = false;
+            *pipelineLayout = mPipelineLayout;
+            if (changes) {
+                *changes = nullptr;
+            }
+            return true;
+        }
         return false;
     }
+    mDirtyDynamicOffsets = false;
 
     // Release the previously bound descriptor and update its time stamp.
     if (mCurrentDescriptor) {
@@ -94,6 +104,7 @@ bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
         mCurrentDescriptor->timestamp = mCurrentTime;
         mCurrentDescriptor->bound = true;
         mDirtyDescriptor = false;
+        mDescriptorStats.hits++;
         *pipelineLayout = mPipelineLayout;
         if (changes) {
             *changes = nullptr;
@@ -102,23 +113,15 @@ bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
     }
 
     // If we reach this point, we need to create and stash a brand new descriptor set.
-    ASSERT_POSTCONDITION(mDescriptorSets.size() < MAX_NUM_DESCRIPTORS, "Too many descriptors.");
-
-    // Allocate descriptor (does not need explicit destruction)
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = mDescriptorPool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &mDescriptorSetLayout;
-    VkResult err = vkAllocateDescriptorSets(mDevice, &allocInfo, descriptor);
-    ASSERT_POSTCONDITION(!err, "Unable to allocate descriptor set.");
+    uint32_t pool;
+    *descriptor = allocateDescriptor(&pool);
     *pipelineLayout = mPipelineLayout;
 
     // Here we construct a DescriptorVal in place, then stash its pointer to allow fast subsequent
     // calls to getOrCreateDescriptor when nothing has been dirtied. Note that the robin_map
     // iterator type proffers a "value" method, which returns a stable reference.
     mCurrentDescriptor = &mDescriptorSets.emplace(std::make_pair(mDescriptorKey, DescriptorVal {
-        *descriptor, mCurrentTime, true })).first.value();
+        *descriptor, mCurrentTime, true, pool })).first.value();
     mDirtyDescriptor = false;
 
     // Mutate the descriptor by setting all non-null bindings.
@@ -130,7 +133,8 @@ bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
             VkDescriptorBufferInfo& bufferInfo = mDescriptorBuffers[binding];
             bufferInfo.buffer = mDescriptorKey.uniformBuffers[binding];
             bufferInfo.offset = 0;
-            bufferInfo.range = VK_WHOLE_SIZE;
+            bufferInfo.range = mDescriptorKey.uniformBufferSizes[binding] ?
+                    mDescriptorKey.uniformBufferSizes[binding] : VK_WHOLE_SIZE;
             VkWriteDescriptorSet& writeInfo = writes[nwrites++];
             writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             writeInfo.pNext = nullptr;
@@ -138,7 +142,7 @@ bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
             writeInfo.dstBinding = binding;
             writeInfo.dstArrayElement = 0;
             writeInfo.descriptorCount = 1;
-            writeInfo.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writeInfo.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             writeInfo.pImageInfo = nullptr;
             writeInfo.pBufferInfo = &bufferInfo;
             writeInfo.pTexelBufferView = nullptr;
@@ -204,6 +208,7 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
     // If we reach this point, we need to create and stash a brand new pipeline object.
     mShaderStages[0].module = mPipelineKey.shaders[0];
     mShaderStages[1].module = mPipelineKey.shaders[1];
+    mShaderStages[1].pSpecializationInfo = mFragmentSpecialization;
 
     // We don't store array sizes to save space, but it's quick to count all non-zero
     // entries because these arrays have a small fixed-size capacity.
@@ -268,8 +273,9 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
             << mShaderStages[0].module << ", " << mShaderStages[1].module << ")" << utils::io::endl;
     #endif
 
-    VkResult err = vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo,
+    VkResult err = vkCreateGraphicsPipelines(mDevice, mPipelineCache, 1, &pipelineCreateInfo,
             VKALLOC, pipeline);
+    mPipelineCreationCount++;
     if (err) {
         utils::slog.e << "vkCreateGraphicsPipelines error " << err << utils::io::endl;
         utils::debug_trap();
@@ -292,6 +298,7 @@ void VulkanBinder::bindProgramBundle(const ProgramBundle& bundle) noexcept {
             mPipelineKey.shaders[ssi] = shaders[ssi];
         }
     }
+    mFragmentSpecialization = bundle.fragmentSpecialization;
 }
 
 void VulkanBinder::bindRasterState(const RasterState& rasterState) noexcept {
@@ -362,6 +369,8 @@ void VulkanBinder::unbindUniformBuffer(VkBuffer uniformBuffer) noexcept {
     for (uint32_t bindingIndex = 0u; bindingIndex < NUM_UBUFFER_BINDINGS; ++bindingIndex) {
         if (mDescriptorKey.uniformBuffers[bindingIndex] == uniformBuffer) {
             mDescriptorKey.uniformBuffers[bindingIndex] = VK_NULL_HANDLE;
+            mDescriptorKey.uniformBufferSizes[bindingIndex] = 0;
+            mDynamicOffsets[bindingIndex] = 0;
             mDirtyDescriptor = true;
         }
     }
@@ -403,7 +412,8 @@ void VulkanBinder::evictDescriptors(std::function<bool(const DescriptorKey&)> fi
         auto& pair = *iter;
         if (filter(pair.first)) {
             auto& cacheEntry = iter->second;
-            mDescriptorGraveyard.push_back({ cacheEntry.handle, cacheEntry.timestamp, false });
+            mDescriptorGraveyard.push_back({ cacheEntry.handle, cacheEntry.timestamp, false,
+                    cacheEntry.pool });
             iter = mDescriptorSets.erase(iter);
         } else {
             ++iter;
@@ -411,12 +421,22 @@ void VulkanBinder::evictDescriptors(std::function<bool(const DescriptorKey&)> fi
     }
 }
 
-void VulkanBinder::bindUniformBuffer(uint32_t bindingIndex, VkBuffer uniformBuffer) noexcept {
+void VulkanBinder::bindUniformBuffer(uint32_t bindingIndex, VkBuffer uniformBuffer,
+        VkDeviceSize offset, VkDeviceSize size) noexcept {
     assert(bindingIndex < NUM_UBUFFER_BINDINGS);
-    if (mDescriptorKey.uniformBuffers[bindingIndex] != uniformBuffer) {
+    // the whole buffer is stored as a size of 0, so that a zero-initialized key is valid
+    size = size == VK_WHOLE_SIZE ? 0 : size;
+    if (mDescriptorKey.uniformBuffers[bindingIndex] != uniformBuffer ||
+            mDescriptorKey.uniformBufferSizes[bindingIndex] != size) {
         mDescriptorKey.uniformBuffers[bindingIndex] = uniformBuffer;
+        mDescriptorKey.uniformBufferSizes[bindingIndex] = size;
         mDirtyDescriptor = true;
     }
+    // moving within the same buffer only needs a new dynamic offset, not a new set
+    if (mDynamicOffsets[bindingIndex] != offset) {
+        mDynamicOffsets[bindingIndex] = (uint32_t) offset;
+        mDirtyDynamicOffsets = true;
+    }
 }
 
 void VulkanBinder::bindSampler(uint32_t bindingIndex, VkDescriptorImageInfo samplerInfo) noexcept {
@@ -463,7 +483,7 @@ void VulkanBinder::gc() noexcept {
             iter != mDescriptorSets.end();) {
         auto& cacheEntry = iter->second;
         if (cacheEntry.timestamp < evictTime && !cacheEntry.bound) {
-            vkFreeDescriptorSets(mDevice, mDescriptorPool, 1, &cacheEntry.handle);
+            freeDescriptor(cacheEntry);
             iter = mDescriptorSets.erase(iter);
         } else {
             ++iter;
@@ -486,14 +506,85 @@ void VulkanBinder::gc() noexcept {
     graveyard.swap(mDescriptorGraveyard);
     for (auto& val : graveyard) {
         if (val.timestamp < evictTime) {
-           vkFreeDescriptorSets(mDevice, mDescriptorPool, 1, &val.handle);
+            freeDescriptor(val);
         } else {
             mDescriptorGraveyard.emplace_back(DescriptorVal {
-                .handle = val.handle,
-                .timestamp = val.timestamp
+                val.handle, val.timestamp, false, val.pool
             });
         }
     }
+    // Keep a single empty pool at the end of the list for the next peak. The indices of the
+    // pools in use must not change, so only the last ones can go.
+    while (mDescriptorPools.size() > 1 && mDescriptorPools.back().count == 0 &&
+            mDescriptorPools[mDescriptorPools.size() - 2].count == 0) {
+        vkDestroyDescriptorPool(mDevice, mDescriptorPools.back().handle, VKALLOC);
+        mDescriptorPools.pop_back();
+        mDescriptorStats.pools--;
+    }
+}
+
+VkDescriptorSet VulkanBinder::allocateDescriptor(uint32_t* pool) noexcept {
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &mDescriptorSetLayout;
+    VkDescriptorSet descriptor = VK_NULL_HANDLE;
+
+    // Use the first pool that isn't full, in case a later pool can be trimmed.
+    for (uint32_t i = 0, n = (uint32_t) mDescriptorPools.size(); i < n; i++) {
+        DescriptorPool& candidate = mDescriptorPools[i];
+        if (candidate.count < DESCRIPTOR_POOL_SIZE) {
+            allocInfo.descriptorPool = candidate.handle;
+            if (vkAllocateDescriptorSets(mDevice, &allocInfo, &descriptor) == VK_SUCCESS) {
+                candidate.count++;
+                mDescriptorStats.allocations++;
+                *pool = i;
+                return descriptor;
+            }
+        }
+    }
+
+    // All the pools are full (or fragmented), add one.
+    createDescriptorPool();
+    DescriptorPool& newPool = mDescriptorPools.back();
+    allocInfo.descriptorPool = newPool.handle;
+    VkResult err = vkAllocateDescriptorSets(mDevice, &allocInfo, &descriptor);
+    ASSERT_POSTCONDITION(!err, "Unable to allocate descriptor set.");
+    newPool.count++;
+    mDescriptorStats.allocations++;
+    *pool = (uint32_t) mDescriptorPools.size() - 1;
+    return descriptor;
+}
+
+void VulkanBinder::freeDescriptor(const DescriptorVal& descriptor) noexcept {
+    DescriptorPool& pool = mDescriptorPools[descriptor.pool];
+    assert(pool.count > 0);
+    vkFreeDescriptorSets(mDevice, pool.handle, 1, &descriptor.handle);
+    mDescriptorStats.evictions++;
+    if (--pool.count == 0) {
+        // this defragments the pool
+        vkResetDescriptorPool(mDevice, pool.handle, 0);
+    }
+}
+
+void VulkanBinder::createDescriptorPool() noexcept {
+    VkDescriptorPoolSize poolSizes[2] = {};
+    VkDescriptorPoolCreateInfo poolInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .poolSizeCount = 2,
+        .pPoolSizes = &poolSizes[0],
+        .maxSets = DESCRIPTOR_POOL_SIZE,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT
+    };
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = poolInfo.maxSets * NUM_UBUFFER_BINDINGS;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = poolInfo.maxSets * NUM_SAMPLER_BINDINGS;
+    VkDescriptorPool pool;
+    VkResult err = vkCreateDescriptorPool(mDevice, &poolInfo, VKALLOC, &pool);
+    ASSERT_POSTCONDITION(!err, "Unable to create descriptor pool.");
+    mDescriptorPools.push_back({ pool, 0 });
+    mDescriptorStats.pools++;
 }
 
 void VulkanBinder::createLayoutsAndDescriptors() noexcept {
@@ -502,8 +593,10 @@ void VulkanBinder::createLayoutsAndDescriptors() noexcept {
     binding.descriptorCount = 1; // NOTE: We never use arrays-of-blocks.
     binding.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS; // NOTE: This is potentially non-optimal.
 
-    // The first range of binding slots is reserved for UBO's.
-    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    // The first range of binding slots is reserved for UBO's. They're all dynamic, which the
+    // spec guarantees up to 8 of.
+    static_assert(NUM_UBUFFER_BINDINGS <= 8, "Too many dynamic uniform buffers.");
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     for (uint32_t i = 0; i < NUM_UBUFFER_BINDINGS; i++) {
         binding.binding = i;
         bindings[i] = binding;
@@ -524,29 +617,23 @@ void VulkanBinder::createLayoutsAndDescriptors() noexcept {
     VkResult err = vkCreateDescriptorSetLayout(mDevice, &dlinfo, VKALLOC, &mDescriptorSetLayout);
     ASSERT_POSTCONDITION(!err, "Unable to create descriptor set layout.");
 
-    // Create the one and only VkPipelineLayout that we'll ever use.
+    // Create the one and only VkPipelineLayout that we'll ever use. Every Vulkan device supports
+    // at least 128 bytes of push constants.
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = PUSH_CONSTANT_STAGES;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = MAX_PUSH_CONSTANTS_SIZE;
     VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo = {};
     pPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pPipelineLayoutCreateInfo.setLayoutCount = 1;
     pPipelineLayoutCreateInfo.pSetLayouts = &mDescriptorSetLayout;
+    pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pPipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
     err = vkCreatePipelineLayout(mDevice, &pPipelineLayoutCreateInfo, VKALLOC, &mPipelineLayout);
     ASSERT_POSTCONDITION(!err, "Unable to create pipeline layout.");
 
-    // Create the VkDescriptorPool.
-    VkDescriptorPoolSize poolSizes[2] = {};
-    VkDescriptorPoolCreateInfo poolInfo {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .poolSizeCount = 2,
-        .pPoolSizes = &poolSizes[0],
-        .maxSets = MAX_NUM_DESCRIPTORS,
-        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT
-    };
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = poolInfo.maxSets * NUM_UBUFFER_BINDINGS;
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = poolInfo.maxSets * NUM_SAMPLER_BINDINGS;
-    err = vkCreateDescriptorPool(mDevice, &poolInfo, VKALLOC, &mDescriptorPool);
-    ASSERT_POSTCONDITION(!err, "Unable to create descriptor pool.");
+    // Create the first VkDescriptorPool, more are added as needed.
+    createDescriptorPool();
 }
 
 void VulkanBinder::destroyLayoutsAndDescriptors() noexcept {
@@ -557,8 +644,10 @@ void VulkanBinder::destroyLayoutsAndDescriptors() noexcept {
     // Our current descriptor set strategy can cause the # of descriptor sets to explode in certain
     // situations, so it's interesting to report the number that get stuffed into the cache.
     #ifndef NDEBUG
-    utils::slog.i << "Destroying " << mDescriptorSets.size() << " descriptor sets."
-            << utils::io::endl;
+    utils::slog.i << "Destroying " << mDescriptorSets.size() << " descriptor sets ("
+            << mDescriptorStats.hits << " hits, " << mDescriptorStats.allocations
+            << " allocations, " << mDescriptorStats.evictions << " evictions, "
+            << mDescriptorStats.pools << " pools)." << utils::io::endl;
     #endif
 
     mDescriptorSets.clear();
@@ -566,8 +655,12 @@ void VulkanBinder::destroyLayoutsAndDescriptors() noexcept {
     mPipelineLayout = VK_NULL_HANDLE;
     vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayout, VKALLOC);
     mDescriptorSetLayout = VK_NULL_HANDLE;
-    vkDestroyDescriptorPool(mDevice, mDescriptorPool, VKALLOC);
-    mDescriptorPool = VK_NULL_HANDLE;
+    for (const DescriptorPool& pool : mDescriptorPools) {
+        vkDestroyDescriptorPool(mDevice, pool.handle, VKALLOC);
+    }
+    mDescriptorPools.clear();
+    mDescriptorStats.pools = 0;
+    mDescriptorGraveyard.clear();
     mCurrentDescriptor = nullptr;
     mDirtyDescriptor = true;
 }
@@ -580,7 +673,8 @@ bool VulkanBinder::PipelineEqual::operator()(const VulkanBinder::PipelineKey& k1
 bool VulkanBinder::DescEqual::operator()(const VulkanBinder::DescriptorKey& k1,
         const VulkanBinder::DescriptorKey& k2) const {
     for (uint32_t i = 0; i < NUM_UBUFFER_BINDINGS; i++) {
-        if (k1.uniformBuffers[i] != k2.uniformBuffers[i]) {
+        if (k1.uniformBuffers[i] != k2.uniformBuffers[i] ||
+            k1.uniformBufferSizes[i] != k2.uniformBufferSizes[i]) {
             return false;
         }
     }
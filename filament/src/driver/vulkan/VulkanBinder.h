@@ -45,8 +45,8 @@ namespace driver {
 //        mBinder.bindPrimitiveTopology(geo.topology);
 //        mBinder.bindVertexArray(geo.varray);
 //        VkDescriptorSet descriptor;
-//        if (mBinder.getOrCreateDescriptor(&descriptor, ...)) {
-//            vkCmdBindDescriptorSets(... descriptor ...);
+//        if (mBinder.getOrCreateDescriptor(&descriptor, &layout, &dynamicOffsets)) {
+//            vkCmdBindDescriptorSets(... descriptor, NUM_UBUFFER_BINDINGS, dynamicOffsets);
 //        }
 //        VkPipeline pipeline;
 //        if (mBinder.getOrCreatePipeline(&pipeline)) {
@@ -61,7 +61,7 @@ namespace driver {
 // modulo some constants and low-level utility functions.
 //
 // In the name of simplicity, VulkanBinder has the following limitations:
-// - Push constants are not supported. (if adding support, see VkPipelineLayoutCreateInfo)
+// - A single push constant range is shared by the vertex and fragment stages.
 // - Only one descriptor set can be bound at a time.
 // - Descriptor sets are never mutated using vkUpdateDescriptorSets, except upon creation.
 // - Assumes that viewport and scissor should be dynamic. (not baked into VkPipeline)
@@ -73,6 +73,9 @@ public:
     static constexpr uint32_t NUM_SAMPLER_BINDINGS = 8;
     static constexpr uint32_t NUM_SHADER_MODULES = 2;
     static constexpr uint32_t MAX_VERTEX_ATTRIBUTES = filament::ATTRIBUTE_INDEX_COUNT;
+    static constexpr uint32_t MAX_PUSH_CONSTANTS_SIZE = filament::CONFIG_MAX_PUSH_CONSTANTS_SIZE;
+    static constexpr VkShaderStageFlags PUSH_CONSTANT_STAGES =
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
     // The VertexArray POD is an array of buffer targets and an array of attributes that refer to
     // those targets. It does not include any references to actual buffers, so you can think of it
@@ -84,9 +87,12 @@ public:
     };
 
     // The ProgramBundle contains weak references to the compiled vertex and fragment shaders.
+    // The specialization constants of the fragment shader are not part of the pipeline key because
+    // each program owns its shader modules, so the modules already identify them.
     struct ProgramBundle {
         VkShaderModule vertex;
         VkShaderModule fragment;
+        const VkSpecializationInfo* fragmentSpecialization;
     };
 
     // The RasterState POD contains standard graphics-related state like blending, culling, etc.
@@ -114,24 +120,40 @@ public:
     ~VulkanBinder();
     void setDevice(VkDevice device) { mDevice = device; }
 
+    // Sets the VkPipelineCache used to create the pipelines, VK_NULL_HANDLE disables it. The
+    // cache is owned by the client.
+    void setPipelineCache(VkPipelineCache cache) { mPipelineCache = cache; }
+
+    // Returns the number of pipelines created so far, which lets the client know when the
+    // pipeline cache has new content.
+    uint32_t getPipelineCreationCount() const { return mPipelineCreationCount; }
+
     // Clients should initialize their copy of the raster state using this method. They can then
     // mutate their copy and pass it back through bindRasterState().
     const RasterState& getDefaultRasterState() const { return mDefaultRasterState; }
 
     // Returns true if vkCmdBindDescriptorSets is required. Additionally, if mutations to the set
     // are required (i.e., vkUpdateDescriptorSets) then "changes" is set to non-null.
+    // The uniform buffers are dynamic descriptors: their offsets aren't part of the set, they're
+    // returned in "dynamicOffsets" (NUM_UBUFFER_BINDINGS of them) for vkCmdBindDescriptorSets,
+    // so the ranges of a large buffer bound for each draw call all share the same set.
     bool getOrCreateDescriptor(VkDescriptorSet* descriptor, VkPipelineLayout* pipelineLayout,
-            DescriptorUpdateOp** changes = nullptr) noexcept;
+            const uint32_t** dynamicOffsets, DescriptorUpdateOp** changes = nullptr) noexcept;
 
     // Returns true if any pipeline bindings have changed. (i.e., vkCmdBindPipeline is required)
     bool getOrCreatePipeline(VkPipeline* pipeline) noexcept;
 
+    // The layout shared by all pipelines, which is needed to push constants. This is valid once
+    // getOrCreateDescriptor has been called.
+    VkPipelineLayout getPipelineLayout() const noexcept { return mPipelineLayout; }
+
     // Each bind method is fast and does not make Vulkan calls.
     void bindProgramBundle(const ProgramBundle& bundle) noexcept;
     void bindRasterState(const RasterState& rasterState) noexcept;
     void bindRenderPass(VkRenderPass renderPass) noexcept;
     void bindPrimitiveTopology(VkPrimitiveTopology topology) noexcept;
-    void bindUniformBuffer(uint32_t bindingIndex, VkBuffer uniformBuffer) noexcept;
+    void bindUniformBuffer(uint32_t bindingIndex, VkBuffer uniformBuffer,
+            VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) noexcept;
     void bindSampler(uint32_t bindingIndex, VkDescriptorImageInfo imageInfo) noexcept;
     void bindVertexArray(const VertexArray& varray) noexcept;
 
@@ -159,6 +181,15 @@ public:
     // Evicts old unused Vulkan objects. Call this once per frame.
     void gc() noexcept;
 
+    // Statistics on the descriptor set cache, since the VkDevice was set.
+    struct DescriptorStats {
+        uint32_t hits;          // dirty bindings resolved with a cached set
+        uint32_t allocations;   // sets allocated because none matched
+        uint32_t evictions;     // sets freed by gc() or because of a destroyed resource
+        uint32_t pools;         // pools currently allocated
+    };
+    const DescriptorStats& getDescriptorStats() const { return mDescriptorStats; }
+
 private:
     // The pipeline key is a POD that represents all currently bound states that form the immutable
     // VkPipeline object. We apply a hash function to its contents only if has been mutated since
@@ -205,11 +236,13 @@ private:
     // the previous call to getOrCreateDescriptor.
     struct alignas(8) DescriptorKey {
         VkBuffer uniformBuffers[NUM_UBUFFER_BINDINGS];
+        VkDeviceSize uniformBufferSizes[NUM_UBUFFER_BINDINGS];  // 0 when the whole buffer is bound
         VkDescriptorImageInfo samplers[NUM_SAMPLER_BINDINGS];
     };
 
     static_assert(sizeof(DescriptorKey) ==
         sizeof(DescriptorKey::uniformBuffers) +
+        sizeof(DescriptorKey::uniformBufferSizes) +
         sizeof(DescriptorKey::samplers),
         "Implicit padding is not allowed for fast hashing");
 
@@ -225,6 +258,7 @@ private:
         VkDescriptorSet handle;
         uint32_t timestamp;
         bool bound;
+        uint32_t pool;  // index in mDescriptorPools
         // move-only (disallow copy) to allow keeping a pointer to the "current" value in the map.
         DescriptorVal(DescriptorVal const&) = delete;
         DescriptorVal& operator=(DescriptorVal const&) = delete;
@@ -232,11 +266,24 @@ private:
         DescriptorVal& operator=(DescriptorVal &&) = default;
     };
 
+    // The descriptor sets are allocated from a list of pools that grows when they're all full.
+    // A pool is reset when its last set is freed, and the empty pools at the end of the list are
+    // destroyed by gc(), except for one.
+    struct DescriptorPool {
+        VkDescriptorPool handle;
+        uint32_t count;     // number of sets allocated from this pool
+    };
+
     void createLayoutsAndDescriptors() noexcept;
     void destroyLayoutsAndDescriptors() noexcept;
+    VkDescriptorSet allocateDescriptor(uint32_t* pool) noexcept;
+    void freeDescriptor(const DescriptorVal& descriptor) noexcept;
+    void createDescriptorPool() noexcept;
     void evictDescriptors(std::function<bool(const DescriptorKey&)> filter) noexcept;
 
     VkDevice mDevice = nullptr;
+    VkPipelineCache mPipelineCache = VK_NULL_HANDLE;
+    uint32_t mPipelineCreationCount = 0;
     const RasterState mDefaultRasterState;
 
     // Info structs used only in a transient way but they are stored for convenience.
@@ -250,6 +297,7 @@ private:
     // (e.g., blending is OFF) and weak references to Vulkan objects (e.g., shader programs and
     // uniform buffers).
     PipelineKey mPipelineKey;
+    const VkSpecializationInfo* mFragmentSpecialization = nullptr;
     DescriptorKey mDescriptorKey;
 
     // Weak references to the currently bound pipeline and descriptor set.
@@ -261,12 +309,17 @@ private:
     bool mDirtyPipeline = true;
     bool mDirtyDescriptor = true;
 
+    // Offsets of the uniform buffers, set with vkCmdBindDescriptorSets.
+    uint32_t mDynamicOffsets[NUM_UBUFFER_BINDINGS] = {};
+    bool mDirtyDynamicOffsets = true;
+
     // Cached Vulkan objects. These objects are owned by the Binder.
     VkDescriptorSetLayout mDescriptorSetLayout = VK_NULL_HANDLE;
     VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
     tsl::robin_map<PipelineKey, PipelineVal, PipelineHashFn, PipelineEqual> mPipelines;
     tsl::robin_map<DescriptorKey, DescriptorVal, DescHashFn, DescEqual> mDescriptorSets;
-    VkDescriptorPool mDescriptorPool;
+    std::vector<DescriptorPool> mDescriptorPools;
+    DescriptorStats mDescriptorStats = {};
     std::vector<DescriptorVal> mDescriptorGraveyard;
 
     // Store the current "time" (really just a frame count) and LRU eviction parameters.
@@ -36,6 +36,7 @@ private:
     VulkanStagePool& mStagePool;
     VmaAllocation mGpuMemory = VK_NULL_HANDLE;
     VkBuffer mGpuBuffer = VK_NULL_HANDLE;
+    const VkBufferUsageFlags mUsage;
 };
 
 } // namespace filament
@@ -21,6 +21,7 @@
 #include "VulkanBuffer.h"
 #include "VulkanHandles.h"
 
+#include <utils/Hash.h>
 #include <utils/Panic.h>
 #include <utils/CString.h>
 #include <utils/trap.h>
@@ -28,6 +29,8 @@
 #include <csignal>
 #include <set>
 
+#include <string.h>
+
 // Vulkan functions often immediately dereference pointers, so it's fine to pass in a pointer
 // to a stack-allocated variable.
 #pragma clang diagnostic push
@@ -42,9 +45,10 @@ namespace driver {
 VulkanDriver::VulkanDriver(ContextManagerVk* externalContext,
         const char* const* ppEnabledExtensions, uint32_t enabledExtensionCount) noexcept :
         DriverBase(new ConcreteDispatcher<VulkanDriver>(this)),
-        mContextManager(*externalContext), mStagePool(mContext), mFramebufferCache(mContext),
-        mSamplerCache(mContext) {
+        mContextManager(*externalContext), mStagePool(mContext), mUploader(mContext, mStagePool),
+        mFramebufferCache(mContext), mSamplerCache(mContext), mRecorder(mContext) {
     mContext.rasterState = mBinder.getDefaultRasterState();
+    mContext.uploader = &mUploader;
 
     // Load Vulkan entry points.
     ASSERT_POSTCONDITION(bluevk::initialize(), "BlueVK is unable to load entry points.");
@@ -147,8 +151,21 @@ VulkanDriver::VulkanDriver(ContextManagerVk* externalContext,
 
     // Initialize device and graphicsQueue.
     createVirtualDevice(mContext);
+    createFrames(mContext);
     mBinder.setDevice(mContext.device);
 
+    // The pipeline cache starts empty, setProgramCache() merges the content saved by the previous
+    // runs into it. It also speeds up re-creating the pipelines evicted by the Binder.
+    VkPipelineCacheCreateInfo pipelineCacheInfo = {};
+    pipelineCacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    if (vkCreatePipelineCache(mContext.device, &pipelineCacheInfo, VKALLOC, &mPipelineCache)
+            == VK_SUCCESS) {
+        mBinder.setPipelineCache(mPipelineCache);
+    }
+    if (PARALLEL_RECORDING) {
+        mRecorder.initialize(mPipelineCache);
+    }
+
     // Choose a depth format that meets our requirements. Take care not to include stencil formats
     // just yet, since that would require a corollary change to the "aspect" flags for the VkImage.
     mContext.depthFormat = findSupportedFormat(mContext,
@@ -179,11 +196,28 @@ void VulkanDriver::terminate() {
         return;
     }
     waitForIdle(mContext);
+    mRecorder.reset();
     mBinder.destroyCache();
+    for (VkDescriptorPool pool : mComputeDescriptorPools) {
+        vkDestroyDescriptorPool(mContext.device, pool, VKALLOC);
+    }
+    mComputeDescriptorPools.clear();
+    vkDestroyPipelineLayout(mContext.device, mComputePipelineLayout, VKALLOC);
+    vkDestroyDescriptorSetLayout(mContext.device, mComputeSetLayouts[0], VKALLOC);
+    vkDestroyDescriptorSetLayout(mContext.device, mComputeSetLayouts[1], VKALLOC);
+    if (mPipelineCache) {
+        savePipelineCache();
+        mBinder.setPipelineCache(VK_NULL_HANDLE);
+        vkDestroyPipelineCache(mContext.device, mPipelineCache, VKALLOC);
+        mPipelineCache = VK_NULL_HANDLE;
+    }
+    mUploader.reset();
+    mContext.uploader = nullptr;
     mStagePool.reset();
     mFramebufferCache.reset();
     mSamplerCache.reset();
     vmaDestroyAllocator(mContext.allocator);
+    destroyFrames(mContext);
     vkDestroyCommandPool(mContext.device, mContext.commandPool, VKALLOC);
     vkDestroyDevice(mContext.device, VKALLOC);
     if (mDebugCallback) {
@@ -220,16 +254,42 @@ void VulkanDriver::beginFrame(uint64_t monotonic_clock_ns, uint32_t frameId) {
     // VulkanDriver, such as reclaiming memory. There are two sets of work queues: one in the
     // global context, and one in the per-cmdbuffer contexts. Crucially, we have begun the frame
     // but not the render pass; we cannot perform arbitrary work during the render pass.
-    performPendingWork(mContext, swapContext, swapContext.cmdbuffer);
+    performPendingWork(mContext, swapContext, mContext.cmdbuffer);
 
-    // Free old unused objects.
+    // The previous frame has been submitted, so the timer queries it ended can be read.
+    updateTimerQueries();
+
+    // Free old unused objects, starting with the stages of the completed uploads.
+    mUploader.gc();
     mStagePool.gc();
     mFramebufferCache.gc();
     mBinder.gc();
+    mRecorder.gc();
+
+    // The staging buffers are only allocated and freed by the driver thread, account for them
+    // once per frame.
+    const size_t stagingSize = mStagePool.getSize();
+    if (stagingSize != mStagingSize) {
+        removeGpuMemory(GpuMemoryStats::STAGING, mStagingSize);
+        addGpuMemory(GpuMemoryStats::STAGING, stagingSize);
+        mStagingSize = stagingSize;
+    }
+
+    // Save the pipeline cache once the new pipelines have stopped coming, rather than after each
+    // one, since vkGetPipelineCacheData serializes the whole cache.
+    const uint32_t pipelineCount = getPipelineCreationCount();
+    if (pipelineCount != mPipelineCount) {
+        mPipelineCount = pipelineCount;
+        mPipelineCacheIdleFrames = 0;
+    } else if (pipelineCount != mSavedPipelineCount &&
+            ++mPipelineCacheIdleFrames >= PIPELINE_CACHE_SAVE_DELAY) {
+        savePipelineCache();
+    }
 }
 
 void VulkanDriver::endFrame(uint32_t frameId) {
-    // Do nothing here; see commit().
+    // The frame is submitted by commit(), this only publishes its counters.
+    publishRenderStats();
 }
 
 void VulkanDriver::flush(int) {
@@ -238,8 +298,9 @@ void VulkanDriver::flush(int) {
 
 void VulkanDriver::createVertexBuffer(Driver::VertexBufferHandle vbh, uint8_t bufferCount,
         uint8_t attributeCount, uint32_t elementCount, Driver::AttributeArray attributes) {
-    construct_handle<VulkanVertexBuffer>(mHandleMap, vbh, mContext, mStagePool, bufferCount,
-            attributeCount, elementCount, attributes);
+    auto vb = construct_handle<VulkanVertexBuffer>(mHandleMap, vbh, mContext, mStagePool,
+            bufferCount, attributeCount, elementCount, attributes);
+    addGpuMemory(GpuMemoryStats::VERTEX_BUFFER, vb->getSize());
 }
 
 void VulkanDriver::createIndexBuffer(Driver::IndexBufferHandle ibh, Driver::ElementType elementType,
@@ -247,13 +308,17 @@ void VulkanDriver::createIndexBuffer(Driver::IndexBufferHandle ibh, Driver::Elem
     auto elementSize = (uint8_t) getElementTypeSize(elementType);
     construct_handle<VulkanIndexBuffer>(mHandleMap, ibh, mContext, mStagePool, elementSize,
             indexCount);
+    addGpuMemory(GpuMemoryStats::INDEX_BUFFER, size_t(elementSize) * indexCount);
 }
 
 void VulkanDriver::createTexture(Driver::TextureHandle th, SamplerType target, uint8_t levels,
         TextureFormat format, uint8_t samples, uint32_t w, uint32_t h, uint32_t depth,
         TextureUsage usage) {
-    construct_handle<VulkanTexture>(mHandleMap, th, mContext, target, levels, format, samples,
-            w, h, depth, usage, mStagePool);
+    auto t = construct_handle<VulkanTexture>(mHandleMap, th, mContext, target, levels, format,
+            samples, w, h, depth, usage, mStagePool);
+    t->usage = usage;
+    t->size = getTextureSize(target, levels, format, samples, w, h, depth);
+    addGpuMemory(getTextureCategory(usage), t->size);
 }
 
 void VulkanDriver::createSamplerBuffer(Driver::SamplerBufferHandle sbh, size_t count) {
@@ -262,6 +327,12 @@ void VulkanDriver::createSamplerBuffer(Driver::SamplerBufferHandle sbh, size_t c
 
 void VulkanDriver::createUniformBuffer(Driver::UniformBufferHandle ubh, size_t size) {
     construct_handle<VulkanUniformBuffer>(mHandleMap, ubh, mContext, mStagePool, size);
+    addGpuMemory(GpuMemoryStats::UNIFORM_BUFFER, size);
+}
+
+void VulkanDriver::createStorageBuffer(Driver::StorageBufferHandle sbh, size_t size) {
+    construct_handle<VulkanStorageBuffer>(mHandleMap, sbh, mContext, mStagePool, size);
+    addGpuMemory(GpuMemoryStats::STORAGE_BUFFER, size);
 }
 
 void VulkanDriver::createRenderPrimitive(Driver::RenderPrimitiveHandle rph, int) {
@@ -272,6 +343,193 @@ void VulkanDriver::createProgram(Driver::ProgramHandle ph, Program&& program) {
     construct_handle<VulkanProgram>(mHandleMap, ph, mContext, program);
 }
 
+void VulkanDriver::createComputeProgram(Driver::ProgramHandle ph, Program&& program) {
+    auto* p = construct_handle<VulkanProgram>(mHandleMap, ph, mContext, program);
+    if (p->compute == VK_NULL_HANDLE) {
+        utils::slog.w << "Missing SPIR-V compute shader: " << program.getName().c_str()
+                << utils::io::endl;
+        return;
+    }
+    if (mComputePipelineLayout == VK_NULL_HANDLE) {
+        createComputeLayout();
+    }
+    VkComputePipelineCreateInfo pipelineInfo {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = p->compute,
+            .pName = "main"
+        },
+        .layout = mComputePipelineLayout
+    };
+    VkResult error = vkCreateComputePipelines(mContext.device, mPipelineCache, 1, &pipelineInfo,
+            VKALLOC, &p->computePipeline);
+    ASSERT_POSTCONDITION(!error, "Unable to create compute pipeline.");
+}
+
+void VulkanDriver::createComputeLayout() noexcept {
+    VkDescriptorSetLayoutBinding uniforms[VulkanBinder::NUM_UBUFFER_BINDINGS] = {};
+    for (uint32_t i = 0; i < VulkanBinder::NUM_UBUFFER_BINDINGS; i++) {
+        uniforms[i] = {
+            .binding = i,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        };
+    }
+    VkDescriptorSetLayoutBinding storage[MAX_STORAGE_BUFFER_BINDINGS] = {};
+    for (uint32_t i = 0; i < MAX_STORAGE_BUFFER_BINDINGS; i++) {
+        storage[i] = {
+            .binding = i,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        };
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfos[2] = {{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = VulkanBinder::NUM_UBUFFER_BINDINGS,
+        .pBindings = uniforms
+    }, {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = MAX_STORAGE_BUFFER_BINDINGS,
+        .pBindings = storage
+    }};
+    for (size_t i = 0; i < 2; i++) {
+        VkResult error = vkCreateDescriptorSetLayout(mContext.device, &layoutInfos[i], VKALLOC,
+                &mComputeSetLayouts[i]);
+        ASSERT_POSTCONDITION(!error, "Unable to create descriptor set layout.");
+    }
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 2,
+        .pSetLayouts = mComputeSetLayouts
+    };
+    VkResult error = vkCreatePipelineLayout(mContext.device, &pipelineLayoutInfo, VKALLOC,
+            &mComputePipelineLayout);
+    ASSERT_POSTCONDITION(!error, "Unable to create pipeline layout.");
+    createComputeDescriptorPool();
+}
+
+void VulkanDriver::createComputeDescriptorPool() noexcept {
+    VkDescriptorPoolSize poolSizes[2] = {{
+        .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        .descriptorCount = COMPUTE_DESCRIPTOR_POOL_SIZE * VulkanBinder::NUM_UBUFFER_BINDINGS
+    }, {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = COMPUTE_DESCRIPTOR_POOL_SIZE * MAX_STORAGE_BUFFER_BINDINGS
+    }};
+    VkDescriptorPoolCreateInfo poolInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+        .maxSets = COMPUTE_DESCRIPTOR_POOL_SIZE * 2,
+        .poolSizeCount = 2,
+        .pPoolSizes = poolSizes
+    };
+    VkDescriptorPool pool;
+    VkResult error = vkCreateDescriptorPool(mContext.device, &poolInfo, VKALLOC, &pool);
+    ASSERT_POSTCONDITION(!error, "Unable to create descriptor pool.");
+    mComputeDescriptorPools.push_back(pool);
+}
+
+bool VulkanDriver::allocateComputeDescriptorSets(VkDescriptorPool pool,
+        VkDescriptorSet* sets) noexcept {
+    VkDescriptorSetAllocateInfo allocInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = pool,
+        .descriptorSetCount = 2,
+        .pSetLayouts = mComputeSetLayouts
+    };
+    return vkAllocateDescriptorSets(mContext.device, &allocInfo, sets) == VK_SUCCESS;
+}
+
+void VulkanDriver::setProgramCache(driver::ProgramCache* cache) {
+    if (cache == mProgramCache) {
+        return;
+    }
+    // keep what was created so far in the previous cache
+    savePipelineCache();
+    mProgramCache = cache;
+    loadPipelineCache();
+}
+
+uint64_t VulkanDriver::getPipelineCacheKey() const noexcept {
+    // One entry per GPU, so the content saved by another driver version gets replaced instead of
+    // piling up. The cache header tells whether the content is still usable.
+    const VkPhysicalDeviceProperties& props = mContext.physicalDeviceProperties;
+    const uint32_t ids[2] = { props.vendorID, props.deviceID };
+    return (uint64_t(0x564b5043) << 32) | utils::hash::murmur3(ids, 2, 0); // 'VKPC'
+}
+
+void VulkanDriver::loadPipelineCache() noexcept {
+    if (!mProgramCache || !mPipelineCache) {
+        return;
+    }
+    const uint64_t key = getPipelineCacheKey();
+    const size_t size = mProgramCache->get(key, nullptr, 0);
+    if (size == 0) {
+        return;
+    }
+    std::vector<uint8_t> data(size);
+    if (mProgramCache->get(key, data.data(), size) != size) {
+        return;
+    }
+
+    // The content is only accepted for the exact same GPU and driver, checking the header
+    // ourselves protects us from drivers that don't validate it.
+    struct Header {
+        uint32_t size;
+        uint32_t version;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t uuid[VK_UUID_SIZE];
+    } header;
+    const VkPhysicalDeviceProperties& props = mContext.physicalDeviceProperties;
+    if (size < sizeof(header)) {
+        return;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.size < sizeof(header) || header.version != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+            header.vendorID != props.vendorID || header.deviceID != props.deviceID ||
+            memcmp(header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        utils::slog.i << "Discarding out of date pipeline cache." << utils::io::endl;
+        return;
+    }
+
+    VkPipelineCacheCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    info.initialDataSize = size;
+    info.pInitialData = data.data();
+    VkPipelineCache loaded;
+    if (vkCreatePipelineCache(mContext.device, &info, VKALLOC, &loaded) == VK_SUCCESS) {
+        vkMergePipelineCaches(mContext.device, mPipelineCache, 1, &loaded);
+        vkDestroyPipelineCache(mContext.device, loaded, VKALLOC);
+    }
+}
+
+void VulkanDriver::savePipelineCache() noexcept {
+    // nothing to do if no pipeline was created since the last save
+    const uint32_t pipelineCount = getPipelineCreationCount();
+    if (!mProgramCache || !mPipelineCache || pipelineCount == mSavedPipelineCount) {
+        return;
+    }
+    mSavedPipelineCount = pipelineCount;
+    size_t size = 0;
+    if (vkGetPipelineCacheData(mContext.device, mPipelineCache, &size, nullptr) != VK_SUCCESS ||
+            size == 0) {
+        return;
+    }
+    std::vector<uint8_t> data(size);
+    if (vkGetPipelineCacheData(mContext.device, mPipelineCache, &size, data.data()) == VK_SUCCESS) {
+        mProgramCache->put(getPipelineCacheKey(), data.data(), size);
+    }
+}
+
+uint32_t VulkanDriver::getPipelineCreationCount() const noexcept {
+    return mBinder.getPipelineCreationCount() + mRecorder.getPipelineCreationCount();
+}
+
 void VulkanDriver::createDefaultRenderTarget(Driver::RenderTargetHandle rth, int) {
     construct_handle<VulkanRenderTarget>(mHandleMap, rth, mContext);
 }
@@ -290,6 +548,8 @@ void VulkanDriver::createRenderTarget(Driver::RenderTargetHandle rth,
         });
     } else if (targets & TargetBufferFlags::COLOR) {
         renderTarget.createColorImage(getVkFormat(format));
+        renderTarget.size += getTextureSize(SamplerType::SAMPLER_2D, 1, format, samples,
+                width, height, 1);
     }
     if (depth.handle) {
         auto depthTexture = handle_cast<VulkanTexture>(mHandleMap, depth.handle);
@@ -299,12 +559,28 @@ void VulkanDriver::createRenderTarget(Driver::RenderTargetHandle rth,
         });
     } else if (targets & TargetBufferFlags::DEPTH) {
         renderTarget.createDepthImage(mContext.depthFormat);
+        renderTarget.size += size_t(width) * height * samples * 4;
     }
+    addGpuMemory(GpuMemoryStats::RENDER_TARGET, renderTarget.size);
+}
+
+void VulkanDriver::createMultipleRenderTarget(Driver::RenderTargetHandle rth,
+        Driver::TargetBufferFlags targets, uint32_t width, uint32_t height, uint8_t samples,
+        Driver::TargetBufferInfo color, Driver::TargetBufferInfo color1,
+        Driver::TargetBufferInfo depth) {
+    // VulkanFboCache creates single color attachment framebuffers, the second color texture
+    // is ignored, see isMultipleRenderTargetsSupported()
+    createRenderTarget(rth, targets, width, height, samples, TextureFormat::RGBA8,
+            color, depth, {});
 }
 
 void VulkanDriver::createFence(Driver::FenceHandle fh, int) {
 }
 
+void VulkanDriver::createTimerQuery(Driver::TimerQueryHandle tqh, int) {
+    construct_handle<VulkanTimerQuery>(mHandleMap, tqh, mContext);
+}
+
 void VulkanDriver::createSwapChain(Driver::SwapChainHandle sch, void* nativeWindow,
         uint64_t flags) {
     auto* swapChain = construct_handle<VulkanSwapChain>(mHandleMap, sch);
@@ -313,8 +589,15 @@ void VulkanDriver::createSwapChain(Driver::SwapChainHandle sch, void* nativeWind
             mContext.instance, &sc.clientSize.width, &sc.clientSize.height);
     getPresentationQueue(mContext, sc);
     getSurfaceCaps(mContext, sc);
+    sc.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    if (flags & SWAP_CHAIN_CONFIG_PRESENT_MAILBOX) {
+        sc.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+    } else if (flags & SWAP_CHAIN_CONFIG_PRESENT_IMMEDIATE) {
+        sc.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    }
+    sc.minImageCount = uint32_t((flags & SWAP_CHAIN_CONFIG_IMAGE_COUNT_MASK) >>
+            SWAP_CHAIN_CONFIG_IMAGE_COUNT_SHIFT);
     createSwapChainAndImages(mContext, sc);
-    createCommandBuffersAndFences(mContext, sc);
 
     // TODO: move the following line into makeCurrent.
     mContext.currentSurface = &sc;
@@ -324,10 +607,18 @@ void VulkanDriver::createSwapChain(Driver::SwapChainHandle sch, void* nativeWind
     }
 }
 
+void VulkanDriver::createSwapChainHeadless(Driver::SwapChainHandle sch,
+        uint32_t width, uint32_t height, uint64_t flags) {
+    // headless swap chains are not supported, FEngine doesn't create them with this backend
+}
+
 void VulkanDriver::createStreamFromTextureId(Driver::StreamHandle sh, intptr_t externalTextureId,
         uint32_t width, uint32_t height) {
 }
 
+void VulkanDriver::createStreamAcquired(Driver::StreamHandle sh, int) {
+}
+
 Handle<HwVertexBuffer> VulkanDriver::createVertexBufferSynchronous() noexcept {
     return alloc_handle<VulkanVertexBuffer, HwVertexBuffer>();
 }
@@ -348,6 +639,10 @@ Handle<HwUniformBuffer> VulkanDriver::createUniformBufferSynchronous() noexcept
     return alloc_handle<VulkanUniformBuffer, HwUniformBuffer>();
 }
 
+Handle<HwStorageBuffer> VulkanDriver::createStorageBufferSynchronous() noexcept {
+    return alloc_handle<VulkanStorageBuffer, HwStorageBuffer>();
+}
+
 Handle<HwRenderPrimitive> VulkanDriver::createRenderPrimitiveSynchronous() noexcept {
     return alloc_handle<VulkanRenderPrimitive, HwRenderPrimitive>();
 }
@@ -356,6 +651,10 @@ Handle<HwProgram> VulkanDriver::createProgramSynchronous() noexcept {
     return alloc_handle<VulkanProgram, HwProgram>();
 }
 
+Handle<HwProgram> VulkanDriver::createComputeProgramSynchronous() noexcept {
+    return alloc_handle<VulkanProgram, HwProgram>();
+}
+
 Handle<HwRenderTarget> VulkanDriver::createDefaultRenderTargetSynchronous() noexcept {
     return alloc_handle<VulkanRenderTarget, HwRenderTarget>();
 }
@@ -364,43 +663,59 @@ Handle<HwRenderTarget> VulkanDriver::createRenderTargetSynchronous() noexcept {
     return alloc_handle<VulkanRenderTarget, HwRenderTarget>();
 }
 
+Handle<HwRenderTarget> VulkanDriver::createMultipleRenderTargetSynchronous() noexcept {
+    return alloc_handle<VulkanRenderTarget, HwRenderTarget>();
+}
+
 Handle<HwFence> VulkanDriver::createFenceSynchronous() noexcept {
     return {};
 }
 
+Handle<HwTimerQuery> VulkanDriver::createTimerQuerySynchronous() noexcept {
+    return alloc_handle<VulkanTimerQuery, HwTimerQuery>();
+}
+
 Handle<HwSwapChain> VulkanDriver::createSwapChainSynchronous() noexcept {
     return alloc_handle<VulkanSwapChain, HwSwapChain>();
 }
 
+Handle<HwSwapChain> VulkanDriver::createSwapChainHeadlessSynchronous() noexcept {
+    return {};
+}
+
 Handle<HwStream> VulkanDriver::createStreamFromTextureIdSynchronous() noexcept {
     return {};
 }
 
+Handle<HwStream> VulkanDriver::createStreamAcquiredSynchronous() noexcept {
+    return {};
+}
+
 void VulkanDriver::destroyVertexBuffer(Driver::VertexBufferHandle vbh) {
     if (vbh) {
-        waitForIdle(mContext);
-        destruct_handle<VulkanVertexBuffer>(mHandleMap, vbh);
+        auto vb = handle_cast<VulkanVertexBuffer>(mHandleMap, vbh);
+        removeGpuMemory(GpuMemoryStats::VERTEX_BUFFER, vb->getSize());
+        destruct_handle_later<VulkanVertexBuffer>(mHandleMap, vbh);
     }
 }
 
 void VulkanDriver::destroyIndexBuffer(Driver::IndexBufferHandle ibh) {
     if (ibh) {
-        waitForIdle(mContext);
-        destruct_handle<VulkanIndexBuffer>(mHandleMap, ibh);
+        auto ib = handle_cast<VulkanIndexBuffer>(mHandleMap, ibh);
+        removeGpuMemory(GpuMemoryStats::INDEX_BUFFER, size_t(ib->elementSize) * ib->count);
+        destruct_handle_later<VulkanIndexBuffer>(mHandleMap, ibh);
     }
 }
 
 void VulkanDriver::destroyRenderPrimitive(Driver::RenderPrimitiveHandle rph) {
     if (rph) {
-        waitForIdle(mContext);
-        destruct_handle<VulkanRenderPrimitive>(mHandleMap, rph);
+        destruct_handle_later<VulkanRenderPrimitive>(mHandleMap, rph);
     }
 }
 
 void VulkanDriver::destroyProgram(Driver::ProgramHandle ph) {
     if (ph) {
-        waitForIdle(mContext);
-        destruct_handle<VulkanProgram>(mHandleMap, ph);
+        destruct_handle_later<VulkanProgram>(mHandleMap, ph);
     }
 }
 
@@ -423,25 +738,53 @@ void VulkanDriver::destroySamplerBuffer(Driver::SamplerBufferHandle sbh) {
 void VulkanDriver::destroyUniformBuffer(Driver::UniformBufferHandle ubh) {
     if (ubh) {
         auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
-        mBinder.unbindUniformBuffer(buffer->getGpuBuffer());
-        waitForIdle(mContext);
-        destruct_handle<VulkanUniformBuffer>(mHandleMap, ubh);
+        const VkBuffer gpuBuffer = buffer->getGpuBuffer();
+        for (VulkanUniformBinding& binding : mUniformBindings) {
+            if (binding.buffer == gpuBuffer) {
+                binding = {};
+            }
+        }
+        mBinder.unbindUniformBuffer(gpuBuffer);
+        mRecorder.unbindUniformBuffer(gpuBuffer);
+        removeGpuMemory(GpuMemoryStats::UNIFORM_BUFFER, buffer->size);
+        destruct_handle_later<VulkanUniformBuffer>(mHandleMap, ubh);
+    }
+}
+
+void VulkanDriver::destroyStorageBuffer(Driver::StorageBufferHandle sbh) {
+    if (sbh) {
+        auto* buffer = handle_cast<VulkanStorageBuffer>(mHandleMap, sbh);
+        const VkBuffer gpuBuffer = buffer->buffer->getGpuBuffer();
+        for (VkDescriptorBufferInfo& binding : mStorageBindings) {
+            if (binding.buffer == gpuBuffer) {
+                binding = {};
+            }
+        }
+        removeGpuMemory(GpuMemoryStats::STORAGE_BUFFER, buffer->size);
+        destruct_handle_later<VulkanStorageBuffer>(mHandleMap, sbh);
     }
 }
 
 void VulkanDriver::destroyTexture(Driver::TextureHandle th) {
     if (th) {
         auto* tex = handle_cast<VulkanTexture>(mHandleMap, th);
+        for (VkDescriptorImageInfo& sampler : mSamplerState) {
+            if (sampler.imageView == tex->imageView) {
+                sampler = { .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+            }
+        }
         mBinder.unbindImageView(tex->imageView);
-        waitForIdle(mContext);
-        destruct_handle<VulkanTexture>(mHandleMap, th);
+        mRecorder.unbindImageView(tex->imageView);
+        removeGpuMemory(getTextureCategory(tex->usage), tex->size);
+        destruct_handle_later<VulkanTexture>(mHandleMap, th);
     }
 }
 
 void VulkanDriver::destroyRenderTarget(Driver::RenderTargetHandle rth) {
     if (rth) {
-        waitForIdle(mContext);
-        destruct_handle<VulkanRenderTarget>(mHandleMap, rth);
+        auto rt = handle_cast<VulkanRenderTarget>(mHandleMap, rth);
+        removeGpuMemory(GpuMemoryStats::RENDER_TARGET, rt->size);
+        destruct_handle_later<VulkanRenderTarget>(mHandleMap, rth);
     }
 }
 
@@ -457,6 +800,15 @@ void VulkanDriver::destroySwapChain(Driver::SwapChainHandle sch) {
 void VulkanDriver::destroyStream(Driver::StreamHandle sh) {
 }
 
+void VulkanDriver::destroyTimerQuery(Driver::TimerQueryHandle tqh) {
+    if (tqh) {
+        VulkanTimerQuery* tq = handle_cast<VulkanTimerQuery>(mHandleMap, tqh);
+        mTimerQueries.erase(std::remove(mTimerQueries.begin(), mTimerQueries.end(), tq),
+                mTimerQueries.end());
+        destruct_handle_later<VulkanTimerQuery>(mHandleMap, tqh);
+    }
+}
+
 Handle<HwStream> VulkanDriver::createStream(void* nativeStream) {
     return {};
 }
@@ -502,10 +854,91 @@ bool VulkanDriver::isFrameTimeSupported() {
     return false;
 }
 
+bool VulkanDriver::isTimerQuerySupported() {
+    return mContext.physicalDeviceProperties.limits.timestampComputeAndGraphics;
+}
+
+bool VulkanDriver::isClipSpaceZeroToOne() {
+    return true;
+}
+
+bool VulkanDriver::isBindlessTextureSupported() {
+    // this would require descriptor indexing and a second pipeline layout, see VulkanBinder
+    return false;
+}
+
+bool VulkanDriver::isComputeSupported() {
+    if (mContext.computeQueue) {
+        return true;
+    }
+    // the spec only guarantees compute on one of the queue families that support graphics
+    uint32_t count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(mContext.physicalDevice, &count, nullptr);
+    std::vector<VkQueueFamilyProperties> families(count);
+    vkGetPhysicalDeviceQueueFamilyProperties(mContext.physicalDevice, &count, families.data());
+    return mContext.graphicsQueueFamilyIndex < count &&
+            (families[mContext.graphicsQueueFamilyIndex].queueFlags & VK_QUEUE_COMPUTE_BIT);
+}
+
+bool VulkanDriver::isMultisampledRenderToTextureSupported() {
+    // the resolve would be a resolve attachment of the subpass, see VulkanRenderTarget
+    return false;
+}
+
+bool VulkanDriver::isFramebufferFetchSupported() {
+    // this would be an input attachment of a second subpass, which VulkanFboCache doesn't create
+    return false;
+}
+
+bool VulkanDriver::isMultipleRenderTargetsSupported() {
+    // VulkanRenderTarget and VulkanFboCache only handle one color attachment
+    return false;
+}
+
+bool VulkanDriver::getStateStats(Driver::StateStats* stats) {
+    // pipeline state is not filtered by this driver
+    return false;
+}
+
+bool VulkanDriver::getRenderStats(Driver::RenderStats* stats) {
+    readRenderStats(stats);
+    return true;
+}
+
+bool VulkanDriver::getGpuMemoryStats(Driver::GpuMemoryStats* stats) {
+    readGpuMemoryStats(stats);
+    return true;
+}
+
+bool VulkanDriver::getHandleArenaStats(Driver::HandleArenaStats* stats) {
+    // handles are allocated from the heap by this driver
+    return false;
+}
+
+bool VulkanDriver::getTimerQueryValue(Driver::TimerQueryHandle tqh, uint64_t* elapsedTime) {
+    if (tqh) {
+        // this is called from the main thread, while the driver thread might update mHandleMap and
+        // might not have created the query yet
+        std::lock_guard<utils::Mutex> guard(mHandleMapLock);
+        auto iter = mHandleMap.find(tqh.getId());
+        if (iter == mHandleMap.end()) {
+            return false;
+        }
+        auto* tq = reinterpret_cast<VulkanTimerQuery*>(iter->second.data());
+        const uint64_t elapsed = tq->elapsed.exchange(0, std::memory_order_relaxed);
+        if (elapsed) {
+            *elapsedTime = elapsed;
+            return true;
+        }
+    }
+    return false;
+}
+
 void VulkanDriver::loadVertexBuffer(Driver::VertexBufferHandle vbh, size_t index,
         BufferDescriptor&& p, uint32_t byteOffset, uint32_t byteSize) {
     auto& vb = *handle_cast<VulkanVertexBuffer>(mHandleMap, vbh);
     vb.buffers[index]->loadFromCpu(p.buffer, byteOffset, byteSize);
+    mRenderStats.bufferBytes += byteSize;
     scheduleDestroy(std::move(p));
 }
 
@@ -513,6 +946,7 @@ void VulkanDriver::loadIndexBuffer(Driver::IndexBufferHandle ibh, BufferDescript
         uint32_t byteOffset, uint32_t byteSize) {
     auto& ib = *handle_cast<VulkanIndexBuffer>(mHandleMap, ibh);
     ib.buffer->loadFromCpu(p.buffer, byteOffset, byteSize);
+    mRenderStats.bufferBytes += byteSize;
     scheduleDestroy(std::move(p));
 }
 
@@ -521,6 +955,7 @@ void VulkanDriver::load2DImage(Driver::TextureHandle th,
         PixelBufferDescriptor&& data) {
     assert(data.type != driver::PixelDataType::COMPRESSED && "Compression not yet supported.");
     assert(xoffset == 0 && yoffset == 0 && "Offsets not yet supported.");
+    mRenderStats.textureBytes += data.size;
     handle_cast<VulkanTexture>(mHandleMap, th)->load2DImage(std::move(data), width, height, level);
     scheduleDestroy(std::move(data));
 }
@@ -528,6 +963,7 @@ void VulkanDriver::load2DImage(Driver::TextureHandle th,
 void VulkanDriver::loadCubeImage(Driver::TextureHandle th, uint32_t level,
         PixelBufferDescriptor&& data, FaceOffsets faceOffsets) {
     assert(data.type != driver::PixelDataType::COMPRESSED && "Compression not yet supported.");
+    mRenderStats.textureBytes += data.size;
     handle_cast<VulkanTexture>(mHandleMap, th)->loadCubeImage(std::move(data), faceOffsets, level);
     scheduleDestroy(std::move(data));
 }
@@ -538,16 +974,30 @@ void VulkanDriver::setExternalImage(Driver::TextureHandle th, void* image) {
 void VulkanDriver::setExternalStream(Driver::TextureHandle th, Driver::StreamHandle sh) {
 }
 
+void VulkanDriver::setAcquiredImage(Driver::StreamHandle sh, Driver::BufferDescriptor&& image) {
+    // external images are not supported yet, release the image right away
+    scheduleDestroy(std::move(image));
+}
+
 void VulkanDriver::generateMipmaps(Driver::TextureHandle th) {
+    handle_cast<VulkanTexture>(mHandleMap, th)->generateMipmaps();
+}
+
+void VulkanDriver::setTextureBaseLevel(Driver::TextureHandle th, uint8_t baseLevel) {
+    // the image views always cover all the levels, the evicted levels are still sampled
 }
 
 void VulkanDriver::updateUniformBuffer(Driver::UniformBufferHandle ubh,
         UniformBuffer&& uniformBuffer) {
     auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
     if (uniformBuffer.isDirty()) {
-        buffer->loadFromCpu(uniformBuffer.getBuffer(), (uint32_t) uniformBuffer.getSize());
+        // upload only the modified range
+        const size_t dirtyOffset = uniformBuffer.getDirtyOffset();
+        buffer->loadFromCpu(static_cast<char const*>(uniformBuffer.getBuffer()) + dirtyOffset,
+                (uint32_t) uniformBuffer.getDirtySize(),
+                (uint32_t) (uniformBuffer.getOffset() + dirtyOffset));
+        mRenderStats.uniformBytes += uniformBuffer.getDirtySize();
     }
-    buffer->ub = std::move(uniformBuffer);
 }
 
 void VulkanDriver::updateSamplerBuffer(Driver::SamplerBufferHandle sbh,
@@ -556,13 +1006,24 @@ void VulkanDriver::updateSamplerBuffer(Driver::SamplerBufferHandle sbh,
     *sb->sb = samplerBuffer;
 }
 
+void VulkanDriver::updateStorageBuffer(Driver::StorageBufferHandle sbh,
+        Driver::BufferDescriptor&& p, uint32_t byteOffset) {
+    auto* sb = handle_cast<VulkanStorageBuffer>(mHandleMap, sbh);
+    sb->buffer->loadFromCpu(p.buffer, byteOffset, (uint32_t) p.size);
+    mRenderStats.bufferBytes += p.size;
+    scheduleDestroy(std::move(p));
+}
+
+void VulkanDriver::updateBindlessTexture(Driver::UniformBufferHandle ubh, uint32_t index,
+        Driver::TextureHandle th, Driver::SamplerParams params) {
+    // not supported, see isBindlessTextureSupported()
+}
+
 void VulkanDriver::beginRenderPass(Driver::RenderTargetHandle rth,
         const Driver::RenderPassParams& params) {
 
     assert(mContext.cmdbuffer);
     assert(mContext.currentSurface);
-    VulkanSurfaceContext& surface = *mContext.currentSurface;
-    const SwapContext& swapContext = surface.swapContexts[surface.currentSwapIndex];
     mCurrentRenderTarget = handle_cast<VulkanRenderTarget>(mHandleMap, rth);
     VulkanRenderTarget* rt = mCurrentRenderTarget;
     const VkExtent2D extent = rt->getExtent();
@@ -612,21 +1073,23 @@ void VulkanDriver::beginRenderPass(Driver::RenderTargetHandle rth,
 
     rt->transformClientRectToPlatform(&renderPassInfo.renderArea);
 
-    VkClearValue clearValues[2] = {};
     if (hasColor) {
-        VkClearValue& clearValue = clearValues[renderPassInfo.clearValueCount++];
+        VkClearValue& clearValue = mClearValues[renderPassInfo.clearValueCount++];
         clearValue.color.float32[0] = params.clearColor.r;
         clearValue.color.float32[1] = params.clearColor.g;
         clearValue.color.float32[2] = params.clearColor.b;
         clearValue.color.float32[3] = params.clearColor.a;
     }
     if (hasDepth) {
-        VkClearValue& clearValue = clearValues[renderPassInfo.clearValueCount++];
+        VkClearValue& clearValue = mClearValues[renderPassInfo.clearValueCount++];
         clearValue.depthStencil = {(float) params.clearDepth, 0};
     }
-    renderPassInfo.pClearValues = &clearValues[0];
+    renderPassInfo.pClearValues = &mClearValues[0];
 
-    vkCmdBeginRenderPass(swapContext.cmdbuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    mDeferredRenderPass = mRecorder.isInitialized();
+    if (!mDeferredRenderPass) {
+        vkCmdBeginRenderPass(mContext.cmdbuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    }
     if (!(params.clear & RenderPassParams::IGNORE_VIEWPORT)) {
         viewport(params.left, params.bottom, params.width, params.height);
     }
@@ -638,6 +1101,9 @@ void VulkanDriver::endRenderPass(int) {
     assert(mContext.cmdbuffer);
     assert(mContext.currentSurface);
     assert(mCurrentRenderTarget);
+    if (mDeferredRenderPass) {
+        recordDeferredRenderPass();
+    }
     vkCmdEndRenderPass(mContext.cmdbuffer);
     mCurrentRenderTarget = VK_NULL_HANDLE;
     mContext.currentRenderPass.renderPass = VK_NULL_HANDLE;
@@ -687,7 +1153,10 @@ void VulkanDriver::setViewportScissor(
     };
 
     mCurrentRenderTarget->transformClientRectToPlatform(&scissor);
-    vkCmdSetScissor(mContext.cmdbuffer, 0, 1, &scissor);
+    mCurrentScissor = scissor;
+    if (!mDeferredRenderPass) {
+        vkCmdSetScissor(mContext.cmdbuffer, 0, 1, &scissor);
+    }
 }
 
 void VulkanDriver::makeCurrent(Driver::SwapChainHandle sch) {
@@ -695,10 +1164,26 @@ void VulkanDriver::makeCurrent(Driver::SwapChainHandle sch) {
     mContext.currentSurface = &sContext;
 }
 
+void VulkanDriver::setPresentationTime(int64_t monotonic_clock_ns) {
+    // presentation times require VK_GOOGLE_display_timing, which is not used yet
+}
+
+void VulkanDriver::setFrameDamage(int32_t left, int32_t bottom, uint32_t width,
+        uint32_t height) {
+    mFrameDamage = {
+        .offset = { std::max(0, left), std::max(0, bottom) },
+        .extent = { width, height },
+        .layer = 0
+    };
+    mHasFrameDamage = true;
+}
+
 void VulkanDriver::commit(Driver::SwapChainHandle sch) {
     // Tell Vulkan we're done appending to the command buffer.
     ASSERT_POSTCONDITION(mContext.cmdbuffer,
             "Vulkan driver requires at least one frame before a commit.");
+    // The uploads must be submitted before the commands using them.
+    mUploader.flush();
     releaseCommandBuffer(mContext);
 
     // Present the backbuffer.
@@ -706,11 +1191,31 @@ void VulkanDriver::commit(Driver::SwapChainHandle sch) {
     VkPresentInfoKHR presentInfo {
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
         .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &surface.renderingFinished,
+        .pWaitSemaphores = &getCurrentFrame(mContext).renderingFinished,
         .swapchainCount = 1,
         .pSwapchains = &surface.swapchain,
         .pImageIndices = &surface.currentSwapIndex,
     };
+    VkPresentRegionKHR presentRegion = { .rectangleCount = 1, .pRectangles = &mFrameDamage };
+    VkPresentRegionsKHR presentRegions = {
+        .sType = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR,
+        .swapchainCount = 1,
+        .pRegions = &presentRegion,
+    };
+    if (mHasFrameDamage && mContext.incrementalPresentSupported) {
+        // the rectangles are in the swap chain's coordinates, with the origin at the top-left
+        const VkExtent2D platformSize = surface.surfaceCapabilities.currentExtent;
+        const VkExtent2D clientSize = surface.clientSize;
+        VkRectLayerKHR& rect = mFrameDamage;
+        rect.offset.x = rect.offset.x * platformSize.width / clientSize.width;
+        rect.offset.y = rect.offset.y * platformSize.height / clientSize.height;
+        rect.extent.width = rect.extent.width * platformSize.width / clientSize.width;
+        rect.extent.height = rect.extent.height * platformSize.height / clientSize.height;
+        rect.offset.y = std::max(0, int32_t(platformSize.height) - rect.offset.y -
+                int32_t(rect.extent.height));
+        presentInfo.pNext = &presentRegions;
+    }
+    mHasFrameDamage = false;
     VkResult result = vkQueuePresentKHR(surface.presentQueue, &presentInfo);
     ASSERT_POSTCONDITION(result != VK_ERROR_OUT_OF_DATE_KHR && result != VK_SUBOPTIMAL_KHR,
             "Stale / resized swap chain not yet supported.");
@@ -733,15 +1238,24 @@ void VulkanDriver::viewport(ssize_t left, ssize_t bottom, size_t width, size_t h
     };
 
     mCurrentRenderTarget->transformClientRectToPlatform(&scissor);
-    vkCmdSetScissor(mContext.cmdbuffer, 0, 1, &scissor);
-
     mCurrentRenderTarget->transformClientRectToPlatform(&viewport);
-    vkCmdSetViewport(mContext.cmdbuffer, 0, 1, &viewport);
+    mCurrentScissor = scissor;
+    mCurrentViewport = viewport;
+    if (!mDeferredRenderPass) {
+        vkCmdSetScissor(mContext.cmdbuffer, 0, 1, &scissor);
+        vkCmdSetViewport(mContext.cmdbuffer, 0, 1, &viewport);
+    }
 }
 
 void VulkanDriver::bindUniforms(size_t index, Driver::UniformBufferHandle ubh) {
     auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
-    mBinder.bindUniformBuffer((uint32_t) index, buffer->getGpuBuffer());
+    mUniformBindings[index] = { buffer->getGpuBuffer(), 0, VK_WHOLE_SIZE };
+}
+
+void VulkanDriver::bindUniformsRange(size_t index, Driver::UniformBufferHandle ubh,
+        size_t offset, size_t size) {
+    auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+    mUniformBindings[index] = { buffer->getGpuBuffer(), offset, size };
 }
 
 void VulkanDriver::bindSamplers(size_t index, Driver::SamplerBufferHandle sbh) {
@@ -749,6 +1263,17 @@ void VulkanDriver::bindSamplers(size_t index, Driver::SamplerBufferHandle sbh) {
     mSamplerBindings[index] = hwsb;
 }
 
+void VulkanDriver::bindStorageBuffer(size_t index, Driver::StorageBufferHandle sbh) {
+    assert(index < MAX_STORAGE_BUFFER_BINDINGS);
+    auto* sb = handle_cast<VulkanStorageBuffer>(mHandleMap, sbh);
+    mStorageBindings[index] = { sb->buffer->getGpuBuffer(), 0, VK_WHOLE_SIZE };
+}
+
+void VulkanDriver::setPushConstants(const Driver::PushConstants& constants) {
+    mPushConstants.size = constants.size;
+    memcpy(mPushConstants.data, constants.data, constants.size);
+}
+
 void VulkanDriver::insertEventMarker(char const* string, size_t len) {
 }
 
@@ -774,10 +1299,160 @@ void VulkanDriver::popGroupMarker(int) {
     }
 }
 
+void VulkanDriver::beginTimerQuery(Driver::TimerQueryHandle tqh) {
+    ASSERT_POSTCONDITION(mContext.cmdbuffer,
+            "Timer queries can only be used within a beginFrame / endFrame.");
+    VulkanTimerQuery* tq = handle_cast<VulkanTimerQuery>(mHandleMap, tqh);
+    if (tq->pool) {
+        // a query that's restarted loses its previous result if it wasn't read yet
+        mTimerQueries.erase(std::remove(mTimerQueries.begin(), mTimerQueries.end(), tq),
+                mTimerQueries.end());
+        tq->elapsed.store(0, std::memory_order_relaxed);
+        vkCmdResetQueryPool(mContext.cmdbuffer, tq->pool, 0, 2);
+        vkCmdWriteTimestamp(mContext.cmdbuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, tq->pool, 0);
+    }
+}
+
+void VulkanDriver::endTimerQuery(Driver::TimerQueryHandle tqh) {
+    ASSERT_POSTCONDITION(mContext.cmdbuffer,
+            "Timer queries can only be used within a beginFrame / endFrame.");
+    VulkanTimerQuery* tq = handle_cast<VulkanTimerQuery>(mHandleMap, tqh);
+    if (tq->pool) {
+        vkCmdWriteTimestamp(mContext.cmdbuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, tq->pool, 1);
+        mTimerQueries.push_back(tq);
+    }
+}
+
+void VulkanDriver::updateTimerQueries() noexcept {
+    // timestamps are in units of timestampPeriod nanoseconds
+    const double period = mContext.physicalDeviceProperties.limits.timestampPeriod;
+    auto& timerQueries = mTimerQueries;
+    timerQueries.erase(std::remove_if(timerQueries.begin(), timerQueries.end(),
+            [this, period](VulkanTimerQuery* tq) {
+                uint64_t timestamps[2];
+                VkResult result = vkGetQueryPoolResults(mContext.device, tq->pool, 0, 2,
+                        sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+                if (result == VK_NOT_READY) {
+                    return false;
+                }
+                if (result == VK_SUCCESS && timestamps[1] >= timestamps[0]) {
+                    // 0 is reserved for "not available"
+                    const uint64_t elapsed = uint64_t((timestamps[1] - timestamps[0]) * period);
+                    tq->elapsed.store(std::max(elapsed, uint64_t(1)), std::memory_order_relaxed);
+                }
+                return true;
+            }), timerQueries.end());
+}
+
 void VulkanDriver::readPixels(Driver::RenderTargetHandle src,
         uint32_t x, uint32_t y, uint32_t width, uint32_t height,
         PixelBufferDescriptor&& p) {
-    scheduleDestroy(std::move(p));
+    VkCommandBuffer cmdbuffer = mContext.cmdbuffer;
+    ASSERT_POSTCONDITION(cmdbuffer && !mCurrentRenderTarget,
+            "readPixels can occur only within a beginFrame / endFrame, outside a render pass.");
+    VulkanRenderTarget const* rt = handle_cast<VulkanRenderTarget>(mHandleMap, src);
+    const VulkanAttachment color = rt->getColor();
+
+    // The pixels are copied as they are in the image, only the 8-bit RGBA and BGRA images can be
+    // read, as RGBA.
+    const bool bgra = color.format == VK_FORMAT_B8G8R8A8_UNORM ||
+            color.format == VK_FORMAT_B8G8R8A8_SRGB;
+    const bool rgba = color.format == VK_FORMAT_R8G8B8A8_UNORM ||
+            color.format == VK_FORMAT_R8G8B8A8_SRGB;
+    const bool readable = rt->isOffscreen() ||
+            (mContext.currentSurface->surfaceCapabilities.supportedUsageFlags &
+                    VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    if (!(bgra || rgba) || p.format != PixelDataFormat::RGBA || p.type != PixelDataType::UBYTE ||
+            !readable) {
+        utils::slog.w << "readPixels: unsupported format " << color.format << utils::io::endl;
+        scheduleDestroy(std::move(p));
+        return;
+    }
+
+    // The image has its origin at the top, so its rows are already in the order of our API.
+    VkRect2D rect { .offset = { int32_t(x), int32_t(y) }, .extent = { width, height } };
+    rt->transformClientRectToPlatform(&rect);
+    width = rect.extent.width;
+    height = rect.extent.height;
+    if (!width || !height) {
+        scheduleDestroy(std::move(p));
+        return;
+    }
+
+    // The render passes leave the image ready to be presented or sampled, it goes back to that
+    // layout after the copy.
+    const VkImageLayout layout = rt->isOffscreen() ?
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    VkImageMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+        .oldLayout = layout,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = color.image,
+        .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+    };
+    vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    const uint32_t numBytes = width * height * 4u;
+    VulkanStage const* stage = mStagePool.acquireStage(numBytes);
+    VkBufferImageCopy region {
+        .bufferOffset = stage->offset,
+        .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+        .imageOffset = { rect.offset.x, rect.offset.y, 0 },
+        .imageExtent = { width, height, 1 }
+    };
+    vkCmdCopyImageToBuffer(cmdbuffer, color.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            stage->buffer, 1, &region);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = layout;
+    VkBufferMemoryBarrier hostBarrier {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = stage->buffer,
+        .offset = stage->offset,
+        .size = numBytes
+    };
+    vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+            VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &hostBarrier, 1, &barrier);
+
+    // The pixels are copied to the client buffer once the frame's fence has signaled, when the
+    // driver reuses the frame's resources, so the driver thread never waits for the GPU. The
+    // stage is persistently mapped and coherent.
+    PixelBufferDescriptor* data = new PixelBufferDescriptor(std::move(p));
+    disposeLater(mContext, [this, data, stage, width, height, bgra]() {
+        PixelBufferDescriptor& p = *data;
+        const size_t stride = p.stride ? p.stride : width;
+        const size_t dstBpr = PixelBufferDescriptor::computeDataSize(p.format, p.type, stride, 1,
+                p.alignment);
+        uint8_t const* src = static_cast<uint8_t const*>(stage->mapped);
+        uint8_t* dst = static_cast<uint8_t*>(p.buffer) + p.top * dstBpr + p.left * 4u;
+        for (uint32_t row = 0; row < height; row++, src += width * 4u, dst += dstBpr) {
+            if (bgra) {
+                for (uint32_t i = 0; i < width * 4u; i += 4u) {
+                    dst[i + 0] = src[i + 2];
+                    dst[i + 1] = src[i + 1];
+                    dst[i + 2] = src[i + 0];
+                    dst[i + 3] = src[i + 3];
+                }
+            } else {
+                memcpy(dst, src, width * 4u);
+            }
+        }
+        mStagePool.releaseStage(stage);
+        scheduleDestroy(std::move(p));
+        delete data;
+    });
 }
 
 void VulkanDriver::readStreamPixels(Driver::StreamHandle sh, uint32_t x, uint32_t y, uint32_t width,
@@ -794,6 +1469,25 @@ void VulkanDriver::blit(TargetBufferFlags buffers,
 
 void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterState,
         Driver::RenderPrimitiveHandle rph) {
+    drawInstanced(ph, rasterState, rph, 1);
+}
+
+void VulkanDriver::drawInstanced(Driver::ProgramHandle ph, Driver::RasterState rasterState,
+        Driver::RenderPrimitiveHandle rph, uint32_t instanceCount) {
+    drawPrimitive(ph, rasterState, rph, instanceCount, nullptr, 0, 0, 0);
+}
+
+void VulkanDriver::drawIndirect(Driver::ProgramHandle ph, Driver::RasterState rasterState,
+        Driver::RenderPrimitiveHandle rph, Driver::StorageBufferHandle indirect,
+        uint32_t offset, uint32_t drawCount, uint32_t stride) {
+    drawPrimitive(ph, rasterState, rph, 0,
+            handle_cast<VulkanStorageBuffer>(mHandleMap, indirect), offset, drawCount, stride);
+}
+
+void VulkanDriver::drawPrimitive(Driver::ProgramHandle ph, Driver::RasterState rasterState,
+        Driver::RenderPrimitiveHandle rph, uint32_t instanceCount,
+        VulkanStorageBuffer const* indirect, uint32_t offset, uint32_t drawCount,
+        uint32_t stride) {
     VkCommandBuffer cmdbuffer = mContext.cmdbuffer;
     ASSERT_POSTCONDITION(cmdbuffer, "Draw calls can occur only within a beginFrame / endFrame.");
     const VulkanRenderPrimitive& prim = *handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
@@ -806,26 +1500,6 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
     }
 #endif
 
-    // Update the VK raster state.
-    mContext.rasterState.depthStencil = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-        .depthTestEnable = VK_TRUE,
-        .depthWriteEnable = (VkBool32) rasterState.depthWrite,
-        .depthCompareOp = getCompareOp(rasterState.depthFunc),
-        .depthBoundsTestEnable = VK_FALSE,
-        .stencilTestEnable = VK_FALSE,
-    };
-    mContext.rasterState.blending = {
-        .blendEnable = rasterState.hasBlending(),
-        .srcColorBlendFactor = getBlendFactor(rasterState.blendFunctionSrcRGB),
-        .dstColorBlendFactor = getBlendFactor(rasterState.blendFunctionDstRGB),
-        .colorBlendOp = (VkBlendOp) rasterState.blendEquationRGB,
-        .srcAlphaBlendFactor = getBlendFactor(rasterState.blendFunctionSrcAlpha),
-        .dstAlphaBlendFactor = getBlendFactor(rasterState.blendFunctionDstAlpha),
-        .alphaBlendOp =  (VkBlendOp) rasterState.blendEquationAlpha,
-        .colorWriteMask = (VkColorComponentFlags) (rasterState.colorWrite ? 0xf : 0x0),
-    };
-
     // Remove the fragment shader from depth-only passes to avoid a validation warning.
     VulkanBinder::ProgramBundle shaderHandles = program->bundle;
     VulkanRenderTarget* rt = mCurrentRenderTarget;
@@ -838,12 +1512,6 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
         shaderHandles.fragment = VK_NULL_HANDLE;
     }
 
-    // Push state changes to the VulkanBinder instance. This is fast and does not make VK calls.
-    mBinder.bindProgramBundle(shaderHandles);
-    mBinder.bindRasterState(mContext.rasterState);
-    mBinder.bindPrimitiveTopology(prim.primitiveTopology);
-    mBinder.bindVertexArray(prim.varray);
-
     // Query the program for the mapping from (SamplerBufferBinding,Offset) to (SamplerBinding),
     // where "SamplerBinding" is the integer in the GLSL, and SamplerBufferBinding is the abstract
     // Filament concept used to form groups of samplers.
@@ -864,53 +1532,248 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
                 const SamplerParams& samplerParams = sampler->s;
                 VkSampler vksampler = mSamplerCache.getSampler(samplerParams);
                 const auto* tex = handle_const_cast<VulkanTexture>(mHandleMap, sampler->t);
-                mBinder.bindSampler(binding, {
+                mSamplerState[binding - VulkanBinder::NUM_UBUFFER_BINDINGS] = {
                     .sampler = vksampler,
                     .imageView = tex->imageView,
                     .imageLayout = samplerParams.depthStencil ?
                             VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL :
                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                });
+                };
             }
         }
     }
 
-    // Bind a new descriptor set if it needs to change.
-    VkDescriptorSet descriptor;
-    VkPipelineLayout pipelineLayout;
-    if (mBinder.getOrCreateDescriptor(&descriptor, &pipelineLayout)) {
-        vkCmdBindDescriptorSets(cmdbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
-                &descriptor, 0, nullptr);
+    // Capture everything the draw call binds. TODO: support subranges
+    VulkanDraw draw;
+    draw.program = shaderHandles;
+    draw.rasterState = rasterState;
+    draw.topology = prim.primitiveTopology;
+    draw.varray = &prim.varray;
+    draw.bufferCount = (uint32_t) prim.buffers.size();
+    draw.buffers = prim.buffers.data();
+    draw.offsets = prim.offsets.data();
+    draw.indexBuffer = prim.indexBuffer->buffer->getGpuBuffer();
+    draw.indexType = prim.indexBuffer->indexType;
+    draw.indexCount = prim.count;
+    draw.firstIndex = prim.offset / prim.indexBuffer->elementSize;
+    draw.instanceCount = instanceCount;
+    draw.indirectBuffer = indirect ? indirect->buffer->getGpuBuffer() : VK_NULL_HANDLE;
+    draw.indirectOffset = offset;
+    draw.indirectDrawCount = drawCount;
+    draw.indirectStride = stride;
+    memcpy(draw.uniforms, mUniformBindings, sizeof(mUniformBindings));
+    memcpy(draw.samplers, mSamplerState, sizeof(mSamplerState));
+    draw.viewport = mCurrentViewport;
+    draw.scissor = mCurrentScissor;
+    draw.pushConstants.size = mPushConstants.size;
+    memcpy(draw.pushConstants.data, mPushConstants.data, mPushConstants.size);
+    if (indirect) {
+        // the number of triangles is only known by the GPU
+        mRenderStats.drawCount += drawCount;
+    } else {
+        countDraw(prim, instanceCount);
     }
 
-    // Bind the pipeline if it changed. This can happen, for example, if the raster state changed.
-    // Creating a new pipeline is slow, so we should consider using pipeline cache objects.
-    VkPipeline pipeline;
-    if (mBinder.getOrCreatePipeline(&pipeline)) {
-        vkCmdBindPipeline(cmdbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    if (mDeferredRenderPass) {
+        mPendingDraws.push_back(draw);
+        return;
     }
 
-    // Next bind the vertex buffers and index buffer. One potential performance improvement is to
-    // avoid rebinding these if they are already bound, but since we do not (yet) support subranges
-    // it would be rare for a client to make consecutive draw calls with the same render primitive.
-    vkCmdBindVertexBuffers(cmdbuffer, 0, (uint32_t) prim.buffers.size(),
-            prim.buffers.data(), prim.offsets.data());
-    vkCmdBindIndexBuffer(cmdbuffer, prim.indexBuffer->buffer->getGpuBuffer(), 0,
-            prim.indexBuffer->indexType);
+    // The viewport and scissor have already been set by viewport() and setViewportScissor().
+    VulkanRecorder::recordDraw(mBinder, cmdbuffer, draw, false);
+}
+
+void VulkanDriver::dispatchCompute(Driver::ProgramHandle ph,
+        uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+    ASSERT_POSTCONDITION(mContext.cmdbuffer && !mCurrentRenderTarget,
+            "Dispatches can occur only within a beginFrame / endFrame, outside a render pass.");
+    auto* program = handle_cast<VulkanProgram>(mHandleMap, ph);
+    if (program->computePipeline == VK_NULL_HANDLE) {
+        return;
+    }
+
+    // With async compute, the dispatches are submitted to the compute queue by the next
+    // memoryBarrier(), or with the frame.
+    VkCommandBuffer cmdbuffer = mContext.computeQueue ?
+            acquireComputeCommandBuffer(mContext) : mContext.cmdbuffer;
+
+    // The sets are only used by this dispatch, so there are no fragmented pools to worry about.
+    VkDescriptorSet sets[2];
+    VkDescriptorPool pool = mComputeDescriptorPools.back();
+    if (!allocateComputeDescriptorSets(pool, sets)) {
+        createComputeDescriptorPool();
+        pool = mComputeDescriptorPools.back();
+        bool allocated = allocateComputeDescriptorSets(pool, sets);
+        ASSERT_POSTCONDITION(allocated, "Unable to allocate descriptor sets.");
+    }
+
+    // Only the bound buffers are written, the shader must not read the others.
+    VkDescriptorBufferInfo uniforms[VulkanBinder::NUM_UBUFFER_BINDINGS];
+    VkWriteDescriptorSet writes[VulkanBinder::NUM_UBUFFER_BINDINGS +
+            MAX_STORAGE_BUFFER_BINDINGS];
+    uint32_t writeCount = 0;
+    for (uint32_t i = 0; i < VulkanBinder::NUM_UBUFFER_BINDINGS; i++) {
+        if (mUniformBindings[i].buffer) {
+            uniforms[i] = { mUniformBindings[i].buffer, mUniformBindings[i].offset,
+                    mUniformBindings[i].size };
+            writes[writeCount++] = {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = sets[0],
+                .dstBinding = i,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                .pBufferInfo = &uniforms[i]
+            };
+        }
+    }
+    for (uint32_t i = 0; i < MAX_STORAGE_BUFFER_BINDINGS; i++) {
+        if (mStorageBindings[i].buffer) {
+            writes[writeCount++] = {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = sets[1],
+                .dstBinding = i,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &mStorageBindings[i]
+            };
+        }
+    }
+    vkUpdateDescriptorSets(mContext.device, writeCount, writes, 0, nullptr);
 
-    // Finally, make the actual draw call. TODO: support subranges
-    const uint32_t indexCount = prim.count;
-    const uint32_t instanceCount = 1;
-    const uint32_t firstIndex = prim.offset / prim.indexBuffer->elementSize;
-    const int32_t vertexOffset = 0;
-    const uint32_t firstInstId = 1;
-    vkCmdDrawIndexed(cmdbuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstId);
+    // The compute bind point is separate from the graphics one, VulkanBinder's state is intact.
+    vkCmdBindPipeline(cmdbuffer, VK_PIPELINE_BIND_POINT_COMPUTE, program->computePipeline);
+    vkCmdBindDescriptorSets(cmdbuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mComputePipelineLayout,
+            0, 2, sets, 0, nullptr);
+    vkCmdDispatch(cmdbuffer, groupCountX, groupCountY, groupCountZ);
+
+    VkDevice device = mContext.device;
+    disposeLater(mContext, [device, pool, sets]() {
+        vkFreeDescriptorSets(device, pool, 2, sets);
+    });
+}
+
+void VulkanDriver::memoryBarrier(Driver::BarrierFlags flags) {
+    VkCommandBuffer cmdbuffer = mContext.cmdbuffer;
+    ASSERT_POSTCONDITION(cmdbuffer && !mCurrentRenderTarget,
+            "Barriers can occur only within a beginFrame / endFrame, outside a render pass.");
+    VkAccessFlags access = 0;
+    VkPipelineStageFlags stages = 0;
+    if (flags & BARRIER_STORAGE_BUFFER) {
+        access |= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        stages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    }
+    if (flags & BARRIER_VERTEX_ATTRIBUTES) {
+        // this also covers copyStorageBufferToVertexBuffer()
+        access |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                VK_ACCESS_TRANSFER_READ_BIT;
+        stages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+    if (flags & BARRIER_INDIRECT_COMMANDS) {
+        access |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        stages |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+    }
+    if (flags & BARRIER_UNIFORMS) {
+        access |= VK_ACCESS_UNIFORM_READ_BIT;
+        stages |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    }
+    if (flags & BARRIER_TEXTURE_FETCH) {
+        access |= VK_ACCESS_SHADER_READ_BIT;
+        stages |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    }
+    if (!stages) {
+        return;
+    }
+    VkMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = access
+    };
+
+    if (mContext.computeQueue) {
+        if (!mContext.computeCmdbuffer) {
+            // nothing was dispatched since the last barrier
+            return;
+        }
+        if (stages & VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) {
+            // for the following dispatches, which are recorded in the same command buffer
+            vkCmdPipelineBarrier(mContext.computeCmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+        const VkPipelineStageFlags graphicsStages = stages & ~VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        if (graphicsStages) {
+            // The graphics commands recorded next wait on a semaphore, which makes all the
+            // writes of the dispatches visible. They go in a new command buffer, so the bindings
+            // must be set again.
+            submitComputeCommands(mContext, graphicsStages);
+            mBinder.resetBindings();
+        }
+        return;
+    }
+
+    vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, stages, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanDriver::copyStorageBufferToVertexBuffer(Driver::StorageBufferHandle sbh,
+        uint32_t srcOffset, Driver::VertexBufferHandle vbh, uint32_t index, uint32_t dstOffset,
+        uint32_t size) {
+    VkCommandBuffer cmdbuffer = mContext.cmdbuffer;
+    ASSERT_POSTCONDITION(cmdbuffer && !mCurrentRenderTarget,
+            "Copies can occur only within a beginFrame / endFrame, outside a render pass.");
+    auto* sb = handle_cast<VulkanStorageBuffer>(mHandleMap, sbh);
+    auto* vb = handle_cast<VulkanVertexBuffer>(mHandleMap, vbh);
+    const VkBuffer dst = vb->buffers[index]->getGpuBuffer();
+    const VkBufferCopy region {
+        .srcOffset = srcOffset,
+        .dstOffset = dstOffset,
+        .size = size
+    };
+    vkCmdCopyBuffer(cmdbuffer, sb->buffer->getGpuBuffer(), dst, 1, &region);
+
+    // the previous draws are done reading the vertices since the render pass ended
+    VkBufferMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = dst,
+        .offset = dstOffset,
+        .size = size
+    };
+    vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void VulkanDriver::recordDeferredRenderPass() noexcept {
+    VkCommandBuffer cmdbuffer = mContext.cmdbuffer;
+    const VkRenderPassBeginInfo& renderPassInfo = mContext.currentRenderPass;
+    const bool parallel = mRecorder.isParallel(mPendingDraws.size());
+    vkCmdBeginRenderPass(cmdbuffer, &renderPassInfo, parallel ?
+            VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+    if (parallel) {
+        mRecorder.record(cmdbuffer, renderPassInfo.renderPass, renderPassInfo.framebuffer,
+                mPendingDraws.data(), mPendingDraws.size());
+        // executing the secondary command buffers leaves the bindings of the primary undefined
+        mBinder.resetBindings();
+    } else {
+        VulkanRecorder::recordDraws(mBinder, cmdbuffer, mPendingDraws.data(),
+                mPendingDraws.size());
+    }
+    mPendingDraws.clear();
+    mDeferredRenderPass = false;
 }
 
 #ifndef NDEBUG
 void VulkanDriver::debugCommand(const char* methodName) {
     static const std::set<utils::StaticString> OUTSIDE_COMMANDS = {
         "updateUniformBuffer",
+        "updateStorageBuffer",
+        "dispatchCompute",
+        "memoryBarrier",
+        "copyStorageBufferToVertexBuffer",
         "loadVertexBuffer",
         "loadIndexBuffer",
         "load2DImage",
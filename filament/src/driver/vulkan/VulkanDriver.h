@@ -20,15 +20,19 @@
 #include "VulkanBinder.h"
 #include "VulkanDriverImpl.h"
 #include "VulkanFboCache.h"
+#include "VulkanRecorder.h"
 #include "VulkanSamplerCache.h"
 #include "VulkanStagePool.h"
+#include "VulkanUploader.h"
 
 #include "driver/Driver.h"
 #include "driver/DriverBase.h"
 
 #include <utils/compiler.h>
 #include <utils/Allocator.h>
+#include <utils/Mutex.h>
 
+#include <atomic>
 #include <unordered_map>
 #include <vector>
 
@@ -37,6 +41,8 @@ namespace driver {
 
 struct VulkanRenderTarget;
 struct VulkanSamplerBuffer;
+struct VulkanStorageBuffer;
+struct VulkanTimerQuery;
 
 class VulkanDriver final : public DriverBase {
 public:
@@ -79,15 +85,18 @@ private:
 
     // For now we're not bothering to store handles in pools, just simple on-demand allocation.
     // We have a little map from integer handles to "blobs" which get replaced with the Hw objects.
+    // Handles are allocated by the threads creating resources, but only reserve an id: the blobs
+    // are added and removed by the driver thread, under mHandleMapLock since a few synchronous
+    // calls (e.g. getTimerQueryValue) look them up from other threads.
     using Blob = std::vector<uint8_t>;
     using HandleMap = std::unordered_map<HandleBase::HandleId, Blob>;
     HandleMap mHandleMap;
-    HandleBase::HandleId mNextId = 1;
+    utils::Mutex mHandleMapLock;
+    std::atomic<HandleBase::HandleId> mNextId = { 1 };
 
     template<typename Dp, typename B>
-    Handle<B> alloc_handle() {
-        mHandleMap[mNextId] = Blob(sizeof(Dp));
-        return Handle<B>(mNextId++);
+    Handle<B> alloc_handle() noexcept {
+        return Handle<B>(mNextId.fetch_add(1, std::memory_order_relaxed));
     }
 
     template<typename Dp, typename B>
@@ -112,12 +121,15 @@ private:
 
     template<typename Dp, typename B, typename ... ARGS>
     Dp* construct_handle(HandleMap& handleMap, Handle<B>& handle, ARGS&& ... args) noexcept {
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
+        assert(handle);
+        // the object is constructed before it's added to the map, so the other threads never see
+        // it half-constructed. Moving the blob into the map doesn't move its data.
+        Blob blob(sizeof(Dp));
         Dp* addr = reinterpret_cast<Dp*>(blob.data());
         new(addr) Dp(std::forward<ARGS>(args)...);
+        std::lock_guard<utils::Mutex> guard(mHandleMapLock);
+        UTILS_UNUSED_IN_RELEASE auto inserted = handleMap.emplace(handle.getId(), std::move(blob));
+        assert(inserted.second);
         return addr;
     }
 
@@ -125,17 +137,93 @@ private:
     void destruct_handle(HandleMap& handleMap, Handle<B>& handle) noexcept {
         // Call the destructor, remove the blob, don't bother reclaiming the integer id.
         handle_cast<Dp>(handleMap, handle)->~Dp();
+        std::lock_guard<utils::Mutex> guard(mHandleMapLock);
         handleMap.erase(handle.getId());
     }
 
+    // Removes the handle right away, but only calls the destructor once the GPU is done with the
+    // commands submitted so far, instead of waiting for it.
+    template<typename Dp, typename B>
+    void destruct_handle_later(HandleMap& handleMap, Handle<B>& handle) noexcept {
+        std::unique_lock<utils::Mutex> guard(mHandleMapLock);
+        auto iter = handleMap.find(handle.getId());
+        assert(iter != handleMap.end());
+        Blob* blob = new Blob(std::move(iter->second));
+        handleMap.erase(iter);
+        guard.unlock();
+        disposeLater(mContext, [blob]() {
+            reinterpret_cast<Dp*>(blob->data())->~Dp();
+            delete blob;
+        });
+    }
+
     VulkanContext mContext = {};
     VulkanBinder mBinder;
     VulkanStagePool mStagePool;
+    VulkanUploader mUploader;
     VulkanFboCache mFramebufferCache;
     VulkanSamplerCache mSamplerCache;
+    VulkanRecorder mRecorder;
     VulkanRenderTarget* mCurrentRenderTarget = nullptr;
     VulkanSamplerBuffer* mSamplerBindings[VulkanBinder::NUM_SAMPLER_BINDINGS] = {};
+
+    // The state bound for the next draw call, the draw calls capture it in a VulkanDraw.
+    VulkanUniformBinding mUniformBindings[VulkanBinder::NUM_UBUFFER_BINDINGS] = {};
+    VkDescriptorImageInfo mSamplerState[VulkanBinder::NUM_SAMPLER_BINDINGS] = {};
+    Driver::PushConstants mPushConstants;
+    VkDescriptorBufferInfo mStorageBindings[Driver::MAX_STORAGE_BUFFER_BINDINGS] = {};
+    VkViewport mCurrentViewport = {};
+    VkRect2D mCurrentScissor = {};
+
+    // The frame damage is only a hint for the presentation engine, the content of the swap
+    // chain images isn't kept from one frame to the next so they're always redrawn entirely.
+    VkRectLayerKHR mFrameDamage = {};
+    bool mHasFrameDamage = false;
+    VkClearValue mClearValues[2] = {};
+
+    // With parallel recording, vkCmdBeginRenderPass and the draw calls are deferred to the end of
+    // the render pass, once we know whether it's worth recording it on several threads.
+    bool mDeferredRenderPass = false;
+    std::vector<VulkanDraw> mPendingDraws;
+    void recordDeferredRenderPass() noexcept;
     VkDebugReportCallbackEXT mDebugCallback = VK_NULL_HANDLE;
+
+    // The compute programs read the uniform buffers from the set 0, at the same bindings as the
+    // graphics pipelines, and the storage buffers from the set 1. These sets are allocated for
+    // each dispatch, and freed once the GPU is done with it. All of this is created with the
+    // first compute program.
+    VkDescriptorSetLayout mComputeSetLayouts[2] = {};
+    VkPipelineLayout mComputePipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorPool> mComputeDescriptorPools;
+    static constexpr uint32_t COMPUTE_DESCRIPTOR_POOL_SIZE = 64; // in dispatches
+    void createComputeLayout() noexcept;
+    void createComputeDescriptorPool() noexcept;
+    bool allocateComputeDescriptorSets(VkDescriptorPool pool, VkDescriptorSet* sets) noexcept;
+
+    // what draw(), drawInstanced() and drawIndirect() have in common, 'indirect' is null
+    // for the direct draws
+    void drawPrimitive(Driver::ProgramHandle ph, Driver::RasterState rasterState,
+            Driver::RenderPrimitiveHandle rph, uint32_t instanceCount,
+            VulkanStorageBuffer const* indirect, uint32_t offset, uint32_t drawCount,
+            uint32_t stride);
+
+    // timer queries that have ended but whose result hasn't been read yet
+    std::vector<VulkanTimerQuery*> mTimerQueries;
+    void updateTimerQueries() noexcept;
+
+    // The pipeline cache is seeded from the ProgramCache set with setProgramCache(), and saved
+    // back into it once no new pipeline was created for a few frames, and at termination.
+    static constexpr uint32_t PIPELINE_CACHE_SAVE_DELAY = 60; // in frames
+    ProgramCache* mProgramCache = nullptr;
+    VkPipelineCache mPipelineCache = VK_NULL_HANDLE;
+    uint32_t mPipelineCount = 0;        // pipelines created as of the last frame
+    uint32_t mSavedPipelineCount = 0;   // pipelines created as of the last save
+    uint32_t mPipelineCacheIdleFrames = 0;
+    size_t mStagingSize = 0;            // size of mStagePool, as accounted in STAGING
+    void loadPipelineCache() noexcept;
+    void savePipelineCache() noexcept;
+    uint64_t getPipelineCacheKey() const noexcept;
+    uint32_t getPipelineCreationCount() const noexcept;
 };
 
 } // namespace driver
@@ -28,11 +28,14 @@
 #pragma clang diagnostic pop
 
 #include "driver/vulkan/VulkanDriverImpl.h"
+#include "driver/vulkan/VulkanUploader.h"
 
 #include <details/Texture.h> // for FTexture::getFormatSize
 
 #include <utils/Panic.h>
 
+#include <algorithm>
+
 namespace filament {
 namespace driver {
 
@@ -67,6 +70,7 @@ void selectPhysicalDevice(VulkanContext& context) {
         vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamiliesCount,
                 queueFamiliesProperties.data());
         context.graphicsQueueFamilyIndex = 0xffff;
+        context.computeQueueFamilyIndex = 0xffff;
         for (uint32_t j = 0; j < queueFamiliesCount; ++j) {
             VkQueueFamilyProperties props = queueFamiliesProperties[j];
             if (props.queueCount == 0) {
@@ -74,9 +78,15 @@ void selectPhysicalDevice(VulkanContext& context) {
             }
             if (props.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
                 context.graphicsQueueFamilyIndex = j;
+            } else if (props.queueFlags & VK_QUEUE_COMPUTE_BIT) {
+                // a dedicated compute family, typically backed by the async compute engines
+                context.computeQueueFamilyIndex = j;
             }
         }
         if (context.graphicsQueueFamilyIndex == 0xffff) continue;
+        if (context.computeQueueFamilyIndex == 0xffff) {
+            context.computeQueueFamilyIndex = context.graphicsQueueFamilyIndex;
+        }
 
         // Does the device support the VK_KHR_swapchain extension?
         uint32_t extensionCount;
@@ -90,6 +100,9 @@ void selectPhysicalDevice(VulkanContext& context) {
         ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkEnumerateDeviceExtensionProperties error.");
         bool supportsSwapchain = false;
         context.debugMarkersSupported = false;
+        context.incrementalPresentSupported = false;
+        bool supportsMemoryRequirements2 = false;
+        bool supportsDedicatedAllocation = false;
         for (uint32_t k = 0; k < extensionCount; ++k) {
             if (!strcmp(extensions[k].extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME)) {
                 supportsSwapchain = true;
@@ -97,7 +110,20 @@ void selectPhysicalDevice(VulkanContext& context) {
             if (!strcmp(extensions[k].extensionName, VK_EXT_DEBUG_MARKER_EXTENSION_NAME)) {
                 context.debugMarkersSupported = true;
             }
+            if (!strcmp(extensions[k].extensionName, VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME)) {
+                context.incrementalPresentSupported = true;
+            }
+            if (!strcmp(extensions[k].extensionName,
+                    VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME)) {
+                supportsMemoryRequirements2 = true;
+            }
+            if (!strcmp(extensions[k].extensionName,
+                    VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME)) {
+                supportsDedicatedAllocation = true;
+            }
         }
+        context.dedicatedAllocationSupported =
+                supportsMemoryRequirements2 && supportsDedicatedAllocation;
         if (!supportsSwapchain) continue;
 
         // Bingo, we finally found a physical device that supports everything we need.
@@ -138,7 +164,7 @@ void selectPhysicalDevice(VulkanContext& context) {
 }
 
 void createVirtualDevice(VulkanContext& context) {
-    VkDeviceQueueCreateInfo deviceQueueCreateInfo[1] = {};
+    VkDeviceQueueCreateInfo deviceQueueCreateInfo[2] = {};
     static const float queuePriority[] = {1.0f};
     VkDeviceCreateInfo deviceCreateInfo = {};
     std::vector<const char*> deviceExtensionNames = {
@@ -147,12 +173,24 @@ void createVirtualDevice(VulkanContext& context) {
     if (context.debugMarkersSupported) {
         deviceExtensionNames.push_back(VK_EXT_DEBUG_MARKER_EXTENSION_NAME);
     }
+    if (context.incrementalPresentSupported) {
+        deviceExtensionNames.push_back(VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME);
+    }
+    if (context.dedicatedAllocationSupported) {
+        deviceExtensionNames.push_back(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME);
+        deviceExtensionNames.push_back(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME);
+    }
     deviceQueueCreateInfo->sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
     deviceQueueCreateInfo->queueFamilyIndex = context.graphicsQueueFamilyIndex;
     deviceQueueCreateInfo->queueCount = 1;
     deviceQueueCreateInfo->pQueuePriorities = &queuePriority[0];
+    const bool asyncCompute = context.computeQueueFamilyIndex != context.graphicsQueueFamilyIndex;
+    if (asyncCompute) {
+        deviceQueueCreateInfo[1] = deviceQueueCreateInfo[0];
+        deviceQueueCreateInfo[1].queueFamilyIndex = context.computeQueueFamilyIndex;
+    }
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceCreateInfo.queueCreateInfoCount = 1;
+    deviceCreateInfo.queueCreateInfoCount = asyncCompute ? 2 : 1;
     deviceCreateInfo.pQueueCreateInfos = deviceQueueCreateInfo;
     deviceCreateInfo.pEnabledFeatures = nullptr;
     deviceCreateInfo.enabledExtensionCount = deviceExtensionNames.size();
@@ -162,6 +200,13 @@ void createVirtualDevice(VulkanContext& context) {
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateDevice error.");
     vkGetDeviceQueue(context.device, context.graphicsQueueFamilyIndex, 0,
             &context.graphicsQueue);
+    context.computeQueue = VK_NULL_HANDLE;
+    if (asyncCompute) {
+        vkGetDeviceQueue(context.device, context.computeQueueFamilyIndex, 0,
+                &context.computeQueue);
+        utils::slog.i << "Using the async compute queue family "
+                << context.computeQueueFamilyIndex << "." << utils::io::endl;
+    }
     VkCommandPoolCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     createInfo.flags =
@@ -188,7 +233,11 @@ void createVirtualDevice(VulkanContext& context) {
         .vkGetBufferMemoryRequirements2KHR = vkGetBufferMemoryRequirements2KHR,
         .vkGetImageMemoryRequirements2KHR = vkGetImageMemoryRequirements2KHR
     };
+    // With VK_KHR_dedicated_allocation, VMA gives their own memory block to the resources for
+    // which the driver prefers (or requires) one.
     const VmaAllocatorCreateInfo allocatorInfo {
+        .flags = context.dedicatedAllocationSupported ?
+                VMA_ALLOCATOR_CREATE_KHR_DEDICATED_ALLOCATION_BIT : 0u,
         .physicalDevice = context.physicalDevice,
         .device = context.device,
         .pVulkanFunctions = &funcs
@@ -249,13 +298,33 @@ void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surf
     // Pick an image count and format.  According to section 30.5 of VK 1.1, maxImageCount of zero
     // apparently means "that there is no limit on the number of images, though there may be limits
     // related to the total amount of memory used by presentable images."
-    uint32_t desiredImageCount = 2;
+    uint32_t desiredImageCount = surfaceContext.minImageCount ? surfaceContext.minImageCount : 2;
     const uint32_t maxImageCount = surfaceContext.surfaceCapabilities.maxImageCount;
-    if (desiredImageCount < surfaceContext.surfaceCapabilities.minImageCount ||
-            (maxImageCount != 0 && desiredImageCount > maxImageCount)) {
-        utils::slog.e << "Swap chain does not support " << desiredImageCount << " images.\n";
+    if (desiredImageCount < surfaceContext.surfaceCapabilities.minImageCount) {
         desiredImageCount = surfaceContext.surfaceCapabilities.minImageCount;
+    } else if (maxImageCount != 0 && desiredImageCount > maxImageCount) {
+        utils::slog.w << "Swap chain does not support " << desiredImageCount << " images.\n";
+        desiredImageCount = maxImageCount;
     }
+
+    // FIFO is the only present mode that's always supported.
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    if (surfaceContext.presentMode != VK_PRESENT_MODE_FIFO_KHR) {
+        uint32_t presentModeCount;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(context.physicalDevice, surfaceContext.surface,
+                &presentModeCount, nullptr);
+        std::vector<VkPresentModeKHR> presentModes(presentModeCount);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(context.physicalDevice, surfaceContext.surface,
+                &presentModeCount, presentModes.data());
+        if (std::find(presentModes.begin(), presentModes.end(), surfaceContext.presentMode) !=
+                presentModes.end()) {
+            presentMode = surfaceContext.presentMode;
+        } else {
+            utils::slog.w << "Present mode " << surfaceContext.presentMode
+                    << " is not supported, using FIFO." << utils::io::endl;
+        }
+    }
+
     surfaceContext.surfaceFormat = surfaceContext.surfaceFormats[0];
     for (const VkSurfaceFormatKHR& format : surfaceContext.surfaceFormats) {
         if (format.format == VK_FORMAT_R8G8B8A8_UNORM) {
@@ -267,8 +336,10 @@ void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surf
     const auto compositeAlpha = (compositionCaps & VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR) ?
             VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR : VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 
-    // Create the low-level swap chain.
+    // Create the low-level swap chain. Its images can be read back when the surface allows it.
     const auto size = surfaceContext.surfaceCapabilities.currentExtent;
+    const VkImageUsageFlags readable = surfaceContext.surfaceCapabilities.supportedUsageFlags &
+            VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     VkSwapchainCreateInfoKHR createInfo {
         .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
         .surface = surfaceContext.surface,
@@ -277,10 +348,11 @@ void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surf
         .imageColorSpace = surfaceContext.surfaceFormat.colorSpace,
         .imageExtent = size,
         .imageArrayLayers = 1,
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                readable,
         .preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
         .compositeAlpha = compositeAlpha,
-        .presentMode = VK_PRESENT_MODE_FIFO_KHR,
+        .presentMode = presentMode,
         .clipped = VK_TRUE
     };
     VkSwapchainKHR swapchain;
@@ -326,9 +398,6 @@ void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surf
         ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateImageView error.");
     }
 
-    createSemaphore(context.device, &surfaceContext.imageAvailable);
-    createSemaphore(context.device, &surfaceContext.renderingFinished);
-
     surfaceContext.depth = {};
 }
 
@@ -346,27 +415,13 @@ void createDepthBuffer(VulkanContext& context, VulkanSurfaceContext& surfaceCont
         .format = depthFormat,
         .mipLevels = 1,
         .arrayLayers = 1,
-        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
         .samples = VK_SAMPLE_COUNT_1_BIT,
     };
-    VkResult error = vkCreateImage(context.device, &imageInfo, VKALLOC, &depthImage);
+    VkResult error = createImage(context, imageInfo, &depthImage, &surfaceContext.depth.memory);
     ASSERT_POSTCONDITION(!error, "Unable to create depth image.");
 
-    // Allocate memory for the VkImage and bind it.
-    VkMemoryRequirements memReqs;
-    vkGetImageMemoryRequirements(context.device, depthImage, &memReqs);
-    VkMemoryAllocateInfo allocInfo {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memReqs.size,
-        .memoryTypeIndex = selectMemoryType(context, memReqs.memoryTypeBits,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
-    };
-    error = vkAllocateMemory(context.device, &allocInfo, nullptr,
-            &surfaceContext.depth.memory);
-    ASSERT_POSTCONDITION(!error, "Unable to allocate depth memory.");
-    error = vkBindImageMemory(context.device, depthImage, surfaceContext.depth.memory, 0);
-    ASSERT_POSTCONDITION(!error, "Unable to bind depth memory.");
-
     // Create a VkImageView so that we can attach depth to the framebuffer.
     VkImageView depthView;
     VkImageViewCreateInfo viewInfo {
@@ -404,18 +459,19 @@ void createDepthBuffer(VulkanContext& context, VulkanSurfaceContext& surfaceCont
 }
 
 void transitionDepthBuffer(VulkanContext& context, VulkanSurfaceContext& sc, VkFormat depthFormat) {
-    // Begin a new command buffer solely for the purpose of transitioning the image layout.
-    SwapContext& swap = getSwapContext(context);
-    VkResult result = vkWaitForFences(context.device, 1, &swap.fence, VK_FALSE, UINT64_MAX);
-    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkWaitForFences error.");
-    result = vkResetFences(context.device, 1, &swap.fence);
-    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkResetFences error.");
-    VkCommandBuffer cmdbuffer = swap.cmdbuffer;
-    result = vkResetCommandBuffer(cmdbuffer, 0);
-    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkResetCommandBuffer error.");
+    // Begin a one-off command buffer solely for the purpose of transitioning the image layout.
+    // This only happens when creating a swap chain, so it's fine to wait for it.
+    VkCommandBuffer cmdbuffer;
+    VkCommandBufferAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocateInfo.commandPool = context.commandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+    VkResult result = vkAllocateCommandBuffers(context.device, &allocateInfo, &cmdbuffer);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkAllocateCommandBuffers error.");
     VkCommandBufferBeginInfo beginInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
     };
     result = vkBeginCommandBuffer(cmdbuffer, &beginInfo);
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkBeginCommandBuffer error.");
@@ -431,53 +487,81 @@ void transitionDepthBuffer(VulkanContext& context, VulkanSurfaceContext& sc, VkF
     VkSubmitInfo submitInfo {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
         .commandBufferCount = 1,
-        .pCommandBuffers = &swap.cmdbuffer,
+        .pCommandBuffers = &cmdbuffer,
     };
-    result = vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, swap.fence);
+    result = vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkQueueSubmit error.");
-    swap.submitted = false;
+    vkQueueWaitIdle(context.graphicsQueue);
+    vkFreeCommandBuffers(context.device, context.commandPool, 1, &cmdbuffer);
 }
 
-void createCommandBuffersAndFences(VulkanContext& context, VulkanSurfaceContext& surfaceContext) {
-    // Allocate command buffers.
-    VkCommandBufferAllocateInfo allocateInfo = {};
-    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocateInfo.commandPool = context.commandPool;
-    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocateInfo.commandBufferCount = (uint32_t) surfaceContext.swapContexts.size();
-    std::vector<VkCommandBuffer> cmdbufs(allocateInfo.commandBufferCount);
-    VkResult result = vkAllocateCommandBuffers(context.device, &allocateInfo, cmdbufs.data());
-    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkAllocateCommandBuffers error.");
-    for (uint32_t i = 0; i < allocateInfo.commandBufferCount; ++i) {
-        surfaceContext.swapContexts[i].cmdbuffer = cmdbufs[i];
-    }
-
-    // Create fences.
+void createFrames(VulkanContext& context) {
+    // Each frame has its own command pool, which is reset as a whole when the frame is reused.
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = context.graphicsQueueFamilyIndex;
     VkFenceCreateInfo fenceCreateInfo = {};
     fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-    for (uint32_t i = 0; i < allocateInfo.commandBufferCount; i++) {
-        result = vkCreateFence(context.device, &fenceCreateInfo, VKALLOC,
-                &surfaceContext.swapContexts[i].fence);
+    for (VulkanFrame& frame : context.frames) {
+        VkResult result = vkCreateCommandPool(context.device, &poolInfo, VKALLOC,
+                &frame.commandPool);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateCommandPool error.");
+        VkCommandBufferAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = frame.commandPool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandBufferCount = 1;
+        result = vkAllocateCommandBuffers(context.device, &allocateInfo, &frame.cmdbuffer);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkAllocateCommandBuffers error.");
+        result = vkCreateFence(context.device, &fenceCreateInfo, VKALLOC, &frame.fence);
         ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateFence error.");
+        createSemaphore(context.device, &frame.imageAvailable);
+        createSemaphore(context.device, &frame.renderingFinished);
+        frame.submitted = false;
+        frame.computeCommandPool = VK_NULL_HANDLE;
+        if (context.computeQueue) {
+            VkCommandPoolCreateInfo computePoolInfo = poolInfo;
+            computePoolInfo.queueFamilyIndex = context.computeQueueFamilyIndex;
+            result = vkCreateCommandPool(context.device, &computePoolInfo, VKALLOC,
+                    &frame.computeCommandPool);
+            ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateCommandPool error.");
+        }
+        frame.computeBatchCount = 0;
+        frame.cmdbufferCount = 0;
+        frame.imageAvailableWaited = false;
+    }
+    context.currentFrame = 0;
+}
+
+void destroyFrames(VulkanContext& context) {
+    for (VulkanFrame& frame : context.frames) {
+        assert(!frame.submitted && frame.disposals.empty());
+        vkDestroyCommandPool(context.device, frame.commandPool, VKALLOC);
+        vkDestroyFence(context.device, frame.fence, VKALLOC);
+        vkDestroySemaphore(context.device, frame.imageAvailable, VKALLOC);
+        vkDestroySemaphore(context.device, frame.renderingFinished, VKALLOC);
+        // the command buffers go with their pools
+        for (VulkanComputeBatch const& batch : frame.computeBatches) {
+            vkDestroySemaphore(context.device, batch.uploaded, VKALLOC);
+            vkDestroySemaphore(context.device, batch.finished, VKALLOC);
+        }
+        if (frame.computeCommandPool) {
+            vkDestroyCommandPool(context.device, frame.computeCommandPool, VKALLOC);
+        }
+        frame = {};
     }
 }
 
 void destroySurfaceContext(VulkanContext& context, VulkanSurfaceContext& surfaceContext) {
     for (SwapContext& swapContext : surfaceContext.swapContexts) {
-        vkFreeCommandBuffers(context.device, context.commandPool, 1, &swapContext.cmdbuffer);
-        vkDestroyFence(context.device, swapContext.fence, VKALLOC);
         vkDestroyImageView(context.device, swapContext.attachment.view, VKALLOC);
-        swapContext.fence = VK_NULL_HANDLE;
         swapContext.attachment.view = VK_NULL_HANDLE;
     }
     vkDestroySwapchainKHR(context.device, surfaceContext.swapchain, VKALLOC);
-    vkDestroySemaphore(context.device, surfaceContext.imageAvailable, VKALLOC);
-    vkDestroySemaphore(context.device, surfaceContext.renderingFinished, VKALLOC);
     vkDestroySurfaceKHR(context.instance, surfaceContext.surface, VKALLOC);
     vkDestroyImageView(context.device, surfaceContext.depth.view, VKALLOC);
-    vkDestroyImage(context.device, surfaceContext.depth.image, VKALLOC);
-    vkFreeMemory(context.device, surfaceContext.depth.memory, VKALLOC);
+    vmaDestroyImage(context.allocator, surfaceContext.depth.image, surfaceContext.depth.memory);
     if (context.currentSurface == &surfaceContext) {
         context.currentSurface = nullptr;
     }
@@ -496,6 +580,27 @@ uint32_t selectMemoryType(VulkanContext& context, uint32_t flags, VkFlags reqs)
     return (uint32_t) ~0ul;
 }
 
+// Images are sub-allocated from VMA's memory blocks, except for the attachments: they are large
+// and often re-created on resize, so they get their own memory to avoid fragmenting the blocks.
+// Transient attachments, whose contents never leave the render pass, do not need to be backed by
+// memory on tiled GPUs, so we prefer a lazily allocated memory type when the device offers one.
+VkResult createImage(VulkanContext& context, const VkImageCreateInfo& imageInfo, VkImage* image,
+        VmaAllocation* memory) {
+    const VkImageUsageFlags attachment = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    VmaAllocationCreateInfo allocInfo {
+        .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    };
+    if (imageInfo.usage & attachment) {
+        allocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    }
+    if (imageInfo.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) {
+        allocInfo.preferredFlags = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    }
+    return vmaCreateImage(context.allocator, &imageInfo, &allocInfo, image, memory, nullptr);
+}
+
 VkFormat getVkFormat(ElementType type, bool normalized) {
     using ElementType = ElementType;
     if (normalized) {
@@ -658,10 +763,39 @@ SwapContext& getSwapContext(VulkanContext& context) {
     return surface.swapContexts[surface.currentSwapIndex];
 }
 
+VulkanFrame& getCurrentFrame(VulkanContext& context) {
+    return context.frames[context.currentFrame];
+}
+
+void disposeLater(VulkanContext& context, VulkanDisposal&& disposal) {
+    // The next frame submitted comes after all the commands that may use the object, including
+    // the pending uploads, so its fence tells when the object can go.
+    context.disposals.push_back(std::move(disposal));
+}
+
+// Waits for the frame to complete, then runs its disposals.
+static void retireFrame(VulkanContext& context, VulkanFrame& frame) {
+    if (frame.submitted) {
+        VkResult result = vkWaitForFences(context.device, 1, &frame.fence, VK_FALSE, UINT64_MAX);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkWaitForFences error.");
+        result = vkResetFences(context.device, 1, &frame.fence);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkResetFences error.");
+        frame.submitted = false;
+    }
+    decltype(frame.disposals) disposals;
+    disposals.swap(frame.disposals);
+    for (auto& disposal : disposals) {
+        disposal();
+    }
+}
+
 bool hasPendingWork(VulkanContext& context) {
     if (context.pendingWork.size() > 0) {
         return true;
     }
+    if (context.uploader && context.uploader->hasPendingWork()) {
+        return true;
+    }
     if (context.currentSurface) {
         for (auto& swapContext : context.currentSurface->swapContexts) {
             if (swapContext.pendingWork.size() > 0) {
@@ -709,24 +843,26 @@ void waitForIdle(VulkanContext& context) {
         return;
     }
 
-    // If there's no surface, then there's no command buffer.
-    if (!context.currentSurface) {
-        return;
+    // Submit the uploads and wait for them, which releases their stages.
+    if (context.uploader) {
+        context.uploader->flush();
+        context.uploader->gc(true);
     }
 
-    // First, wait for submitted command buffer(s) to finish.
-    VkFence fences[2];
-    uint32_t nfences = 0;
-    auto& surfaceContext = *context.currentSurface;
-    for (auto& swapContext : surfaceContext.swapContexts) {
-        assert(nfences < 2);
-        if (swapContext.submitted && swapContext.fence) {
-            fences[nfences++] = swapContext.fence;
-            swapContext.submitted = false;
-        }
+    // First, wait for the frames in flight to finish, and destroy what they were using. The
+    // objects released since the last frame aren't used by the GPU anymore either.
+    for (VulkanFrame& frame : context.frames) {
+        retireFrame(context, frame);
     }
-    if (nfences > 0) {
-        vkWaitForFences(context.device, nfences, fences, VK_FALSE, ~0ull);
+    decltype(context.disposals) disposals;
+    disposals.swap(context.disposals);
+    for (auto& disposal : disposals) {
+        disposal();
+    }
+
+    // If there's no surface, then there's no command buffer.
+    if (!context.currentSurface) {
+        return;
     }
 
     // If we don't have any pending work, we're done.
@@ -783,59 +919,200 @@ void waitForIdle(VulkanContext& context) {
 }
 
 void acquireCommandBuffer(VulkanContext& context) {
+    // Move on to the next frame. This is the only place where the CPU waits for the GPU, when
+    // it's FRAMES_IN_FLIGHT frames ahead.
+    context.currentFrame = (context.currentFrame + 1) % FRAMES_IN_FLIGHT;
+    VulkanFrame& frame = getCurrentFrame(context);
+    retireFrame(context, frame);
+
     // Ask Vulkan for the next image in the swap chain and update the currentSwapIndex.
     VulkanSurfaceContext& surface = *context.currentSurface;
     VkResult result = vkAcquireNextImageKHR(context.device, surface.swapchain,
-            UINT64_MAX, surface.imageAvailable, VK_NULL_HANDLE, &surface.currentSwapIndex);
+            UINT64_MAX, frame.imageAvailable, VK_NULL_HANDLE, &surface.currentSwapIndex);
     ASSERT_POSTCONDITION(result != VK_ERROR_OUT_OF_DATE_KHR,
             "Stale / resized swap chain not yet supported.");
     ASSERT_POSTCONDITION(result == VK_SUBOPTIMAL_KHR || result == VK_SUCCESS,
             "vkAcquireNextImageKHR error.");
-    SwapContext& swap = getSwapContext(context);
 
-    // Ensure that the previous submission of this command buffer has finished.
-    result = vkWaitForFences(context.device, 1, &swap.fence, VK_FALSE, UINT64_MAX);
-    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkWaitForFences error.");
-
-    // Restart the command buffer.
-    result = vkResetFences(context.device, 1, &swap.fence);
-    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkResetFences error.");
-    VkCommandBuffer cmdbuffer = swap.cmdbuffer;
-    VkResult error = vkResetCommandBuffer(cmdbuffer, 0);
-    ASSERT_POSTCONDITION(not error, "vkResetCommandBuffer error.");
+    // Restart the command buffer, resetting the pool recycles all its memory at once.
+    VkResult error = vkResetCommandPool(context.device, frame.commandPool, 0);
+    ASSERT_POSTCONDITION(not error, "vkResetCommandPool error.");
+    if (frame.computeCommandPool) {
+        error = vkResetCommandPool(context.device, frame.computeCommandPool, 0);
+        ASSERT_POSTCONDITION(not error, "vkResetCommandPool error.");
+    }
+    frame.computeBatchCount = 0;
+    frame.cmdbufferCount = 0;
+    frame.imageAvailableWaited = false;
     VkCommandBufferBeginInfo beginInfo {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
     };
-    error = vkBeginCommandBuffer(cmdbuffer, &beginInfo);
+    error = vkBeginCommandBuffer(frame.cmdbuffer, &beginInfo);
     ASSERT_POSTCONDITION(not error, "vkBeginCommandBuffer error.");
-    context.cmdbuffer = cmdbuffer;
-    swap.submitted = false;
+    context.cmdbuffer = frame.cmdbuffer;
 }
 
-void releaseCommandBuffer(VulkanContext& context) {
-    // Finalize the command buffer and set the cmdbuffer pointer to null.
+// Ends and submits the graphics commands recorded so far, after the swap chain image is acquired
+// and the last compute batch is done.
+static void submitGraphicsCommands(VulkanContext& context, VkSemaphore signal, VkFence fence) {
     VkResult result = vkEndCommandBuffer(context.cmdbuffer);
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkEndCommandBuffer error.");
+
+    VulkanFrame& frame = getCurrentFrame(context);
+    VkSemaphore waitSemaphores[2];
+    VkPipelineStageFlags waitDestStageMasks[2];
+    uint32_t waitCount = 0;
+    if (!frame.imageAvailableWaited) {
+        frame.imageAvailableWaited = true;
+        waitSemaphores[waitCount] = frame.imageAvailable;
+        waitDestStageMasks[waitCount++] = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+    if (context.computeFinished) {
+        waitSemaphores[waitCount] = context.computeFinished;
+        waitDestStageMasks[waitCount++] = context.computeWaitStages;
+        context.computeFinished = VK_NULL_HANDLE;
+    }
+    VkSubmitInfo submitInfo {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .waitSemaphoreCount = waitCount,
+        .pWaitSemaphores = waitSemaphores,
+        .pWaitDstStageMask = waitDestStageMasks,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &context.cmdbuffer,
+        .signalSemaphoreCount = signal ? 1u : 0u,
+        .pSignalSemaphores = &signal,
+    };
+    result = vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, fence);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkQueueSubmit error.");
     context.cmdbuffer = nullptr;
+}
 
-    // Submit the command buffer.
-    VkPipelineStageFlags waitDestStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    VulkanSurfaceContext& surfaceContext = *context.currentSurface;
-    SwapContext& swapContext = getSwapContext(context);
+// Submits the pending dispatches, the next graphics submission waits for them at 'dstStages'.
+static void submitComputeBatch(VulkanContext& context, VkPipelineStageFlags dstStages) {
+    VulkanFrame& frame = getCurrentFrame(context);
+    VulkanComputeBatch const& batch = frame.computeBatches[frame.computeBatchCount - 1];
+    assert(batch.cmdbuffer == context.computeCmdbuffer);
+    VkResult result = vkEndCommandBuffer(batch.cmdbuffer);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkEndCommandBuffer error.");
+    context.computeCmdbuffer = VK_NULL_HANDLE;
+
+    // The semaphore signaled after the uploads also orders the dispatches after all the graphics
+    // commands submitted before, e.g. the previous frame's draws reading what they overwrite.
+    context.uploader->flush(batch.uploaded);
+
+    const VkPipelineStageFlags waitDestStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
     VkSubmitInfo submitInfo {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
         .waitSemaphoreCount = 1u,
-        .pWaitSemaphores = &surfaceContext.imageAvailable,
+        .pWaitSemaphores = &batch.uploaded,
         .pWaitDstStageMask = &waitDestStageMask,
         .commandBufferCount = 1,
-        .pCommandBuffers = &swapContext.cmdbuffer,
+        .pCommandBuffers = &batch.cmdbuffer,
         .signalSemaphoreCount = 1u,
-        .pSignalSemaphores = &surfaceContext.renderingFinished,
+        .pSignalSemaphores = &batch.finished,
     };
-    result = vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, swapContext.fence);
+    result = vkQueueSubmit(context.computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkQueueSubmit error.");
-    swapContext.submitted = true;
+
+    // a previous batch is always waited for before this one is submitted
+    assert(!context.computeFinished);
+    context.computeFinished = batch.finished;
+    context.computeWaitStages = dstStages;
+}
+
+VkCommandBuffer acquireComputeCommandBuffer(VulkanContext& context) {
+    assert(context.computeQueue);
+    if (context.computeCmdbuffer) {
+        return context.computeCmdbuffer;
+    }
+    VulkanFrame& frame = getCurrentFrame(context);
+    if (frame.computeBatchCount == frame.computeBatches.size()) {
+        VulkanComputeBatch batch;
+        VkCommandBufferAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = frame.computeCommandPool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandBufferCount = 1;
+        VkResult result = vkAllocateCommandBuffers(context.device, &allocateInfo,
+                &batch.cmdbuffer);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkAllocateCommandBuffers error.");
+        createSemaphore(context.device, &batch.uploaded);
+        createSemaphore(context.device, &batch.finished);
+        frame.computeBatches.push_back(batch);
+    }
+    VkCommandBuffer cmdbuffer = frame.computeBatches[frame.computeBatchCount++].cmdbuffer;
+    VkCommandBufferBeginInfo beginInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VkResult error = vkBeginCommandBuffer(cmdbuffer, &beginInfo);
+    ASSERT_POSTCONDITION(not error, "vkBeginCommandBuffer error.");
+
+    // the previous batches are on the same queue, the semaphores don't order these against them
+    VkMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    };
+    vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    context.computeCmdbuffer = cmdbuffer;
+    return cmdbuffer;
+}
+
+void submitComputeCommands(VulkanContext& context, VkPipelineStageFlags dstStages) {
+    if (!context.computeCmdbuffer) {
+        return;
+    }
+    submitComputeBatch(context, dstStages);
+
+    // The graphics commands recorded so far (e.g. the shadow passes) don't depend on the
+    // dispatches, they're submitted now so that they can overlap with them.
+    submitGraphicsCommands(context, VK_NULL_HANDLE, VK_NULL_HANDLE);
+
+    VulkanFrame& frame = getCurrentFrame(context);
+    if (frame.cmdbufferCount == frame.cmdbuffers.size()) {
+        VkCommandBufferAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = frame.commandPool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandBufferCount = 1;
+        VkCommandBuffer cmdbuffer;
+        VkResult result = vkAllocateCommandBuffers(context.device, &allocateInfo, &cmdbuffer);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkAllocateCommandBuffers error.");
+        frame.cmdbuffers.push_back(cmdbuffer);
+    }
+    VkCommandBuffer cmdbuffer = frame.cmdbuffers[frame.cmdbufferCount++];
+    VkCommandBufferBeginInfo beginInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VkResult error = vkBeginCommandBuffer(cmdbuffer, &beginInfo);
+    ASSERT_POSTCONDITION(not error, "vkBeginCommandBuffer error.");
+    context.cmdbuffer = cmdbuffer;
+}
+
+void releaseCommandBuffer(VulkanContext& context) {
+    // Dispatches may not have been followed by a barrier, nothing waits for them until the end
+    // of the frame in that case.
+    if (context.computeCmdbuffer) {
+        submitComputeBatch(context, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    }
+
+    // Finalize and submit the command buffer, this sets the cmdbuffer pointer to null. Each
+    // compute batch is waited for by the next part of the frame, and the parts complete in order,
+    // so the fence tells when the whole frame is done.
+    VulkanFrame& frame = getCurrentFrame(context);
+    submitGraphicsCommands(context, frame.renderingFinished, frame.fence);
+    frame.submitted = true;
+
+    // The objects released so far can be destroyed once this frame completes.
+    frame.disposals.insert(frame.disposals.end(),
+            std::make_move_iterator(context.disposals.begin()),
+            std::make_move_iterator(context.disposals.end()));
+    context.disposals.clear();
 }
 
 void performPendingWork(VulkanContext& context, SwapContext& swapContext, VkCommandBuffer cmdbuf) {
@@ -858,8 +1135,7 @@ void performPendingWork(VulkanContext& context, SwapContext& swapContext, VkComm
 // Flushes the command buffer and waits for it to finish executing. Useful for diagnosing
 // sychronization issues.
 void flushCommandBuffer(VulkanContext& context) {
-    VulkanSurfaceContext& surface = *context.currentSurface;
-    const SwapContext& sc = surface.swapContexts[surface.currentSwapIndex];
+    const VulkanFrame& frame = getCurrentFrame(context);
 
     // Submit the command buffer.
     VkResult error = vkEndCommandBuffer(context.cmdbuffer);
@@ -871,19 +1147,19 @@ void flushCommandBuffer(VulkanContext& context) {
         .commandBufferCount = 1,
         .pCommandBuffers = &context.cmdbuffer,
     };
-    error = vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, sc.fence);
+    error = vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, frame.fence);
     ASSERT_POSTCONDITION(!error, "vkQueueSubmit error.");
 
     // Restart the command buffer.
-    error = vkWaitForFences(context.device, 1, &sc.fence, VK_FALSE, UINT64_MAX);
+    error = vkWaitForFences(context.device, 1, &frame.fence, VK_FALSE, UINT64_MAX);
     ASSERT_POSTCONDITION(!error, "vkWaitForFences error.");
-    error = vkResetFences(context.device, 1, &sc.fence);
+    error = vkResetFences(context.device, 1, &frame.fence);
     ASSERT_POSTCONDITION(!error, "vkResetFences error.");
-    error = vkResetCommandBuffer(context.cmdbuffer, 0);
-    ASSERT_POSTCONDITION(!error, "vkResetCommandBuffer error.");
+    error = vkResetCommandPool(context.device, frame.commandPool, 0);
+    ASSERT_POSTCONDITION(!error, "vkResetCommandPool error.");
     VkCommandBufferBeginInfo beginInfo {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
     };
     error = vkBeginCommandBuffer(context.cmdbuffer, &beginInfo);
     ASSERT_POSTCONDITION(!error, "vkBeginCommandBuffer error.");
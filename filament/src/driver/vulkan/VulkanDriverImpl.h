@@ -40,7 +40,52 @@ static constexpr VkAllocationCallbacks* VKALLOC = nullptr;
 using VulkanTask = std::function<void(VkCommandBuffer)>;
 using VulkanTaskQueue = std::vector<VulkanTask>;
 
+// Destroys objects that the GPU may still be using, once it's done with them.
+using VulkanDisposal = std::function<void()>;
+using VulkanDisposalQueue = std::vector<VulkanDisposal>;
+
+// Number of frames the driver can submit ahead of the GPU. The driver thread only waits for the
+// GPU when it's about to reuse the resources of the frame submitted that many frames ago. This
+// can't exceed the number of frames VulkanBinder and VulkanFboCache keep their objects unused
+// before destroying them.
+#ifndef FILAMENT_VULKAN_FRAMES_IN_FLIGHT
+#define FILAMENT_VULKAN_FRAMES_IN_FLIGHT 2
+#endif
+static constexpr uint32_t FRAMES_IN_FLIGHT = FILAMENT_VULKAN_FRAMES_IN_FLIGHT;
+static_assert(FRAMES_IN_FLIGHT >= 1 && FRAMES_IN_FLIGHT <= 2,
+        "FILAMENT_VULKAN_FRAMES_IN_FLIGHT must be 1 or 2.");
+
+// The dispatches recorded for the compute queue between two submissions, see
+// submitComputeCommands().
+struct VulkanComputeBatch {
+    VkCommandBuffer cmdbuffer;
+    VkSemaphore uploaded;           // signaled once the uploads they read are done
+    VkSemaphore finished;           // waited for by the next graphics submission
+};
+
+// The resources of a frame in flight, they're reused FRAMES_IN_FLIGHT frames later, once the
+// frame's fence has signaled.
+struct VulkanFrame {
+    VkCommandPool commandPool;
+    VkCommandBuffer cmdbuffer;
+    VkFence fence;
+    VkSemaphore imageAvailable;
+    VkSemaphore renderingFinished;
+    VulkanDisposalQueue disposals;  // run once the fence has signaled
+    bool submitted;
+
+    // With async compute, the frame is submitted in several parts, one after each compute
+    // batch. These are created as needed and reused by the next frames.
+    VkCommandPool computeCommandPool;
+    std::vector<VulkanComputeBatch> computeBatches;
+    std::vector<VkCommandBuffer> cmdbuffers;        // the parts after the first one
+    uint32_t computeBatchCount;                     // used by the frame
+    uint32_t cmdbufferCount;                        // used by the frame
+    bool imageAvailableWaited;                      // by one of the parts already submitted
+};
+
 struct VulkanSurfaceContext;
+class VulkanUploader;
 
 // For now we only support a single-device, single-instance scenario. Our concept of "context" is a
 // bundle of state containing the Device, the Instance, and various globally-useful Vulkan objects.
@@ -54,7 +99,17 @@ struct VulkanContext {
     VkCommandPool commandPool;
     uint32_t graphicsQueueFamilyIndex;
     VkQueue graphicsQueue;
+    // A queue family with compute but no graphics, if the device has one, allows the dispatches
+    // to run concurrently with the graphics commands. computeQueue is VK_NULL_HANDLE otherwise,
+    // and the dispatches are recorded in cmdbuffer.
+    uint32_t computeQueueFamilyIndex;
+    VkQueue computeQueue;
+    VkCommandBuffer computeCmdbuffer;               // dispatches not yet submitted
+    VkSemaphore computeFinished;                    // waited for by the next graphics submission
+    VkPipelineStageFlags computeWaitStages;
     bool debugMarkersSupported;
+    bool incrementalPresentSupported;   // the frame damage can be passed to vkQueuePresentKHR
+    bool dedicatedAllocationSupported;  // VK_KHR_dedicated_allocation and its dependency
     VulkanTaskQueue pendingWork;
     VulkanBinder::RasterState rasterState;
     VkCommandBuffer cmdbuffer;
@@ -63,23 +118,26 @@ struct VulkanContext {
     VkViewport viewport;
     VkFormat depthFormat;
     VmaAllocator allocator;
+    VulkanUploader* uploader;
+    VulkanFrame frames[FRAMES_IN_FLIGHT];
+    uint32_t currentFrame;
+    VulkanDisposalQueue disposals;  // handed to the next frame submitted
 };
 
 struct VulkanAttachment {
     VkFormat format;
     VkImage image;
     VkImageView view;
-    VkDeviceMemory memory;
+    VmaAllocation memory;
 };
 
 // The SwapContext is the set of objects that gets "swapped" at each beginFrame().
-// Typically there are only 2 or 3 instances of the SwapContext per SwapChain.
+// Typically there are only 2 or 3 instances of the SwapContext per SwapChain. The command buffers
+// and fences belong to the VulkanFrame instead, since the swap chain picks the images in any
+// order.
 struct SwapContext {
     VulkanAttachment attachment;
-    VkCommandBuffer cmdbuffer;
-    VkFence fence;
     VulkanTaskQueue pendingWork;
-    bool submitted;
 };
 
 // The SurfaceContext stores various state (including the swap chain) that we tightly associate
@@ -95,8 +153,8 @@ struct VulkanSurfaceContext {
     std::vector<SwapContext> swapContexts;
     uint32_t currentSwapIndex;
     VulkanAttachment depth;
-    VkSemaphore imageAvailable;
-    VkSemaphore renderingFinished;
+    VkPresentModeKHR presentMode;       // requested, FIFO is used if it's not supported
+    uint32_t minImageCount;             // requested, 0 for the default
 };
 
 void selectPhysicalDevice(VulkanContext& context);
@@ -107,14 +165,19 @@ void getSurfaceCaps(VulkanContext& context, VulkanSurfaceContext& sc);
 void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& sc);
 void createDepthBuffer(VulkanContext& context, VulkanSurfaceContext& sc, VkFormat depthFormat);
 void transitionDepthBuffer(VulkanContext& context, VulkanSurfaceContext& sc, VkFormat depthFormat);
-void createCommandBuffersAndFences(VulkanContext& context, VulkanSurfaceContext& sc);
+void createFrames(VulkanContext& context);
+void destroyFrames(VulkanContext& context);
 void destroySurfaceContext(VulkanContext& context, VulkanSurfaceContext& sc);
 uint32_t selectMemoryType(VulkanContext& context, uint32_t flags, VkFlags reqs);
+VkResult createImage(VulkanContext& context, const VkImageCreateInfo& imageInfo, VkImage* image,
+        VmaAllocation* memory);
 VkFormat getVkFormat(ElementType type, bool normalized);
 VkFormat getVkFormat(TextureFormat format);
 uint32_t getBytesPerPixel(TextureFormat format);
 uint32_t computeSize(TextureFormat format, uint32_t w, uint32_t h, uint32_t d);
 SwapContext& getSwapContext(VulkanContext& context);
+VulkanFrame& getCurrentFrame(VulkanContext& context);
+void disposeLater(VulkanContext& context, VulkanDisposal&& disposal);
 bool hasPendingWork(VulkanContext& context);
 VkCompareOp getCompareOp(SamplerCompareFunc func);
 VkBlendFactor getBlendFactor(BlendFunction mode);
@@ -123,6 +186,15 @@ void acquireCommandBuffer(VulkanContext& context);
 void releaseCommandBuffer(VulkanContext& context);
 void performPendingWork(VulkanContext& context, SwapContext& swapContext, VkCommandBuffer cmdbuf);
 void flushCommandBuffer(VulkanContext& context);
+
+// Returns the command buffer the dispatches are recorded in, when there is a compute queue.
+VkCommandBuffer acquireComputeCommandBuffer(VulkanContext& context);
+
+// Submits the dispatches recorded since the last call to the compute queue, they start once the
+// pending uploads are done. The graphics commands recorded so far are submitted too, so that they
+// run concurrently with the dispatches, and the ones recorded next wait at 'dstStages' for the
+// dispatches to finish.
+void submitComputeCommands(VulkanContext& context, VkPipelineStageFlags dstStages);
 VkFormat findSupportedFormat(VulkanContext& context, const std::vector<VkFormat>& candidates,
         VkImageTiling tiling, VkFormatFeatureFlags features);
 
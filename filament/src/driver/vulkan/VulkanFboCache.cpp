@@ -75,6 +75,21 @@ VkFramebuffer VulkanFboCache::getFramebuffer(FboKey config, uint32_t w, uint32_t
     return framebuffer;
 }
 
+static VkAttachmentLoadOp getLoadOp(const VulkanFboCache::RenderPassKey& config,
+        TargetBufferFlags buffer) noexcept {
+    if (config.flags.clear & buffer) {
+        return VK_ATTACHMENT_LOAD_OP_CLEAR;
+    }
+    return (config.flags.discardStart & buffer) ?
+            VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_LOAD;
+}
+
+static VkAttachmentStoreOp getStoreOp(const VulkanFboCache::RenderPassKey& config,
+        TargetBufferFlags buffer) noexcept {
+    return (config.flags.discardEnd & buffer) ?
+            VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+}
+
 VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
     auto iter = mRenderPassCache.find(config);
     if (UTILS_LIKELY(iter != mRenderPassCache.end() && iter->second.handle != VK_NULL_HANDLE)) {
@@ -105,26 +120,34 @@ VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
     };
 
   // The attachment description specifies the layout to transition to at the END of the render pass.
+    // Attachments that are loaded are expected to be in the layout left by the previous pass,
+    // while cleared or discarded attachments start from an undefined layout. Discarded contents
+    // are never stored, which allows tiled GPUs to keep them in tile memory.
+    const VkImageLayout depthLayout = depthOnly ? config.finalLayout :
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    const VkAttachmentLoadOp colorLoadOp = getLoadOp(config, TargetBufferFlags::COLOR);
+    const VkAttachmentLoadOp depthLoadOp = getLoadOp(config, TargetBufferFlags::DEPTH);
     VkAttachmentDescription colorAttachment {
         .format = config.colorFormat,
         .samples = VK_SAMPLE_COUNT_1_BIT,
-        .loadOp = (config.flags.clear & TargetBufferFlags::COLOR) ?
-                VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .loadOp = colorLoadOp,
+        .storeOp = getStoreOp(config, TargetBufferFlags::COLOR),
         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .initialLayout = colorLoadOp == VK_ATTACHMENT_LOAD_OP_LOAD ?
+                config.finalLayout : VK_IMAGE_LAYOUT_UNDEFINED,
         .finalLayout = config.finalLayout
     };
     VkAttachmentDescription depthAttachment {
         .format = config.depthFormat,
         .samples = VK_SAMPLE_COUNT_1_BIT,
-        .loadOp = (config.flags.clear & TargetBufferFlags::DEPTH) ?
-                VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .loadOp = depthLoadOp,
+        .storeOp = getStoreOp(config, TargetBufferFlags::DEPTH),
         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .finalLayout = depthOnly ? config.finalLayout :
-                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+        .initialLayout = depthLoadOp == VK_ATTACHMENT_LOAD_OP_LOAD ?
+                depthLayout : VK_IMAGE_LAYOUT_UNDEFINED,
+        .finalLayout = depthLayout
     };
 
     // We define dependencies only when the framebuffer local hint is applied.
@@ -15,6 +15,7 @@
  */
 
 #include "driver/vulkan/VulkanHandles.h"
+#include "driver/vulkan/VulkanUploader.h"
 
 #include <private/filament/Variant.h>
 
@@ -46,30 +47,55 @@ static void clampToFramebuffer(VkRect2D* rect, uint32_t fbWidth, uint32_t fbHeig
 
 VulkanProgram::VulkanProgram(VulkanContext& context, const Program& builder) noexcept :
         HwProgram(builder.getName()), context(context) {
-    auto const& blobs = builder.getShadersSource();
-    VkShaderModule* modules[2] = { &bundle.vertex, &bundle.fragment };
+    // the SPIR-V usually references the material package, see FMaterial::makeProgram()
+    VkShaderModule* modules[Program::NUM_SHADER_TYPES] = {
+            &bundle.vertex, &bundle.fragment, &compute };
+    size_t computeSize;
+    builder.getShader(Program::Shader::COMPUTE, &computeSize);
+    const bool isCompute = computeSize > 0;
     bool missing = false;
     for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
-        const auto& blob = blobs[i];
+        size_t blobSize;
+        const char* blob = builder.getShader(Program::Shader(i), &blobSize);
         VkShaderModule* module = modules[i];
-        if (blob.empty()) {
-            missing = true;
+        if (blobSize == 0) {
+            // a compute program has neither a vertex nor a fragment shader
+            missing |= !isCompute && i != size_t(Program::Shader::COMPUTE);
             continue;
         }
         VkShaderModuleCreateInfo moduleInfo = {};
         moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        moduleInfo.codeSize = blob.size();
-        moduleInfo.pCode = (uint32_t*) blob.c_str();
+        moduleInfo.codeSize = blobSize;
+        moduleInfo.pCode = (uint32_t const*) blob;
         VkResult result = vkCreateShaderModule(context.device, &moduleInfo, VKALLOC, module);
         ASSERT_POSTCONDITION(result == VK_SUCCESS, "Unable to create shader module.");
     }
 
+    // Boolean specialization constants are 32-bit wide in SPIR-V.
+    bundle.fragmentSpecialization = nullptr;
+    auto const& constants = builder.getSpecializationConstants();
+    if (!constants.empty()) {
+        for (const auto& constant : constants) {
+            specializationEntries.push_back({ constant.id,
+                    uint32_t(specializationData.size() * sizeof(VkBool32)), sizeof(VkBool32) });
+            specializationData.push_back(constant.value ? VK_TRUE : VK_FALSE);
+        }
+        specializationInfo.mapEntryCount = uint32_t(specializationEntries.size());
+        specializationInfo.pMapEntries = specializationEntries.data();
+        specializationInfo.dataSize = specializationData.size() * sizeof(VkBool32);
+        specializationInfo.pData = specializationData.data();
+        bundle.fragmentSpecialization = &specializationInfo;
+    }
+
     // Output a warning because it's okay to encounter empty blobs, but it's not okay to use
     // this program handle in a draw call.
     if (missing) {
         utils::slog.w << "Missing SPIR-V shader: " << builder.getName().c_str() << utils::io::endl;
         return;
     }
+    if (isCompute) {
+        return;
+    }
 
     // Make a copy of the binding map that lives in filament::Material.
     const SamplerBindingMap* pSamplerBindings = builder.getSamplerBindings();
@@ -91,18 +117,18 @@ VulkanProgram::VulkanProgram(VulkanContext& context, const Program& builder) noe
 VulkanProgram::~VulkanProgram() {
     vkDestroyShaderModule(context.device, bundle.vertex, VKALLOC);
     vkDestroyShaderModule(context.device, bundle.fragment, VKALLOC);
+    vkDestroyShaderModule(context.device, compute, VKALLOC);
+    vkDestroyPipeline(context.device, computePipeline, VKALLOC);
 }
 
 VulkanRenderTarget::~VulkanRenderTarget() {
     if (!mSharedColorImage) {
         vkDestroyImageView(mContext.device, mColor.view, VKALLOC);
-        vkDestroyImage(mContext.device, mColor.image, VKALLOC);
-        vkFreeMemory(mContext.device, mColor.memory, VKALLOC);
+        vmaDestroyImage(mContext.allocator, mColor.image, mColor.memory);
     }
     if (!mSharedDepthImage) {
         vkDestroyImageView(mContext.device, mDepth.view, VKALLOC);
-        vkDestroyImage(mContext.device, mDepth.image, VKALLOC);
-        vkFreeMemory(mContext.device, mDepth.memory, VKALLOC);
+        vmaDestroyImage(mContext.allocator, mDepth.image, mDepth.memory);
     }
 }
 
@@ -182,26 +208,12 @@ void VulkanRenderTarget::createColorImage(VkFormat format) {
         .format = mColor.format,
         .mipLevels = 1,
         .arrayLayers = 1,
-        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
         .samples = VK_SAMPLE_COUNT_1_BIT,
     };
-    VkResult error = vkCreateImage(mContext.device, &colorImageInfo, VKALLOC, &mColor.image);
+    VkResult error = createImage(mContext, colorImageInfo, &mColor.image, &mColor.memory);
     ASSERT_POSTCONDITION(!error, "Unable to create color attachment.");
 
-    // Allocate memory for the color image and bind it.
-    VkMemoryRequirements memReqs;
-    vkGetImageMemoryRequirements(mContext.device, mColor.image, &memReqs);
-    VkMemoryAllocateInfo allocInfo {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memReqs.size,
-        .memoryTypeIndex = selectMemoryType(mContext, memReqs.memoryTypeBits,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
-    };
-    error = vkAllocateMemory(mContext.device, &allocInfo, nullptr, &mColor.memory);
-    ASSERT_POSTCONDITION(!error, "Unable to allocate color memory.");
-    error = vkBindImageMemory(mContext.device, mColor.image, mColor.memory, 0);
-    ASSERT_POSTCONDITION(!error, "Unable to bind color memory.");
-
     // Transition the color image into an optimal layout.
     VkImageMemoryBarrier barrier {
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
@@ -235,7 +247,9 @@ void VulkanRenderTarget::createDepthImage(VkFormat format) {
     assert(mOffscreen);
     this->mDepth.format = format;
     mSharedDepthImage = false;
-    // Create an appropriately-sized device-only VkImage for the depth attachment.
+    // Create an appropriately-sized device-only VkImage for the depth attachment. It cannot be
+    // sampled, so it is created as a transient attachment, which lets tiled GPUs skip backing it
+    // with memory when the render passes discard it.
     // TODO: for depth, can we re-use the image associated with the swap chain?
     VkImageCreateInfo depthImageInfo {
         .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
@@ -244,26 +258,13 @@ void VulkanRenderTarget::createDepthImage(VkFormat format) {
         .format = mDepth.format,
         .mipLevels = 1,
         .arrayLayers = 1,
-        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
         .samples = VK_SAMPLE_COUNT_1_BIT,
     };
-    VkResult error = vkCreateImage(mContext.device, &depthImageInfo, VKALLOC, &mDepth.image);
+    VkResult error = createImage(mContext, depthImageInfo, &mDepth.image, &mDepth.memory);
     ASSERT_POSTCONDITION(!error, "Unable to create depth attachment.");
 
-    // Allocate memory for the depth image and bind it.
-    VkMemoryRequirements memReqs;
-    vkGetImageMemoryRequirements(mContext.device, mDepth.image, &memReqs);
-    VkMemoryAllocateInfo depthAllocInfo {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memReqs.size,
-        .memoryTypeIndex = selectMemoryType(mContext, memReqs.memoryTypeBits,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
-    };
-    error = vkAllocateMemory(mContext.device, &depthAllocInfo, nullptr, &mDepth.memory);
-    ASSERT_POSTCONDITION(!error, "Unable to allocate depth memory.");
-    error = vkBindImageMemory(mContext.device, mDepth.image, mDepth.memory, 0);
-    ASSERT_POSTCONDITION(!error, "Unable to bind depth memory.");
-
     // Transition the depth image into an optimal layout and assume there's no need to read from it.
     VkImageMemoryBarrier depthBarrier {
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
@@ -330,71 +331,33 @@ VulkanUniformBuffer::VulkanUniformBuffer(VulkanContext& context, VulkanStagePool
         .size = numBytes,
         .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
     };
+    // The dispatches read uniform buffers too, see VulkanBuffer.
+    const uint32_t queueFamilies[] = {
+            context.graphicsQueueFamilyIndex, context.computeQueueFamilyIndex };
+    if (context.computeQueue) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = 2;
+        bufferInfo.pQueueFamilyIndices = queueFamilies;
+    }
     VmaAllocationCreateInfo allocInfo {
         .usage = VMA_MEMORY_USAGE_GPU_ONLY
     };
     vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &mGpuBuffer, &mGpuMemory, 0);
 }
 
-void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t numBytes) {
-    VkDevice device = mContext.device;
+void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t numBytes, uint32_t offset) {
     VulkanStage const* stage = mStagePool.acquireStage(numBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    memcpy(mapped, cpuData, numBytes);
-    vmaUnmapMemory(mContext.allocator, stage->memory);
-    vmaFlushAllocation(mContext.allocator, stage->memory, 0, numBytes);
-
-    // Create and submit a one-off command buffer to allow uploading outside a frame.
-    VkCommandBuffer cmdbuffer;
-    VkFence fence;
-    VkCommandBufferBeginInfo beginInfo { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
-    VkCommandBufferAllocateInfo allocateInfo {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = mContext.commandPool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1
-    };
-    VkFenceCreateInfo fenceCreateInfo { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-    VkBufferCopy region { .size = numBytes };
-    vkAllocateCommandBuffers(device, &allocateInfo, &cmdbuffer);
-    vkCreateFence(device, &fenceCreateInfo, VKALLOC, &fence);
-    vkBeginCommandBuffer(cmdbuffer, &beginInfo);
-    vkCmdCopyBuffer(cmdbuffer, stage->buffer, mGpuBuffer, 1, &region);
-
-    // Ensure that the copy finishes before the next draw call.
-    VkBufferMemoryBarrier barrier {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .buffer = mGpuBuffer,
-        .size = VK_WHOLE_SIZE
-    };
-    vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
-    vkEndCommandBuffer(cmdbuffer);
-    VkSubmitInfo submitInfo {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &cmdbuffer,
-    };
-    vkQueueSubmit(mContext.graphicsQueue, 1, &submitInfo, fence);
-
-    // Enqueue some work to reclaim the staging area and free the command buffer. The pipeline
-    // barrier we already placed is a GPU-to-GPU sync point, but reclaimation of the staging area
-    // needs GPU-CPU synchronization. That's what the fence is for.
-    mContext.pendingWork.emplace_back([this, fence, device, cmdbuffer, stage] (VkCommandBuffer)  {
-        vkWaitForFences(device, 1, &fence, VK_FALSE, UINT64_MAX);
-        vkFreeCommandBuffers(device, mContext.commandPool, 1, &cmdbuffer);
-        vkDestroyFence(device, fence, VKALLOC);
-        mStagePool.releaseStage(stage);
-    });
+    memcpy(stage->mapped, cpuData, numBytes);
+    mStagePool.flushStage(stage, numBytes);
+
+    // The copy is batched with the other uploads, which allows uploading outside a frame.
+    mContext.uploader->copyToBuffer(stage, mGpuBuffer, offset, numBytes,
+            VK_ACCESS_UNIFORM_READ_BIT,
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 }
 
 VulkanUniformBuffer::~VulkanUniformBuffer() {
-    assert(!hasPendingWork(mContext) && "Buffer destroyed while work is pending.");
     vmaDestroyBuffer(mContext.allocator, mGpuBuffer, mGpuMemory);
 }
 
@@ -424,15 +387,20 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
         imageInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
     }
     if (usage == TextureUsage::COLOR_ATTACHMENT) {
-        imageInfo.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        // the pixels of the render targets can be read back
+        imageInfo.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     } else if (usage == TextureUsage::DEPTH_ATTACHMENT) {
         imageInfo.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
     } else {
         imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     }
-    VkResult error = vkCreateImage(context.device, &imageInfo, VKALLOC, &textureImage);
+    // The mip levels can be generated by blitting each level from the previous one.
+    if (levels > 1 && usage != TextureUsage::DEPTH_ATTACHMENT) {
+        imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+    VkResult error = createImage(context, imageInfo, &textureImage, &textureImageMemory);
     if (error) {
-        utils::slog.d << "vkCreateImage: "
+        utils::slog.d << "vmaCreateImage: "
             << "result = " << error << ", "
             << "extent = " << w << "x" << h << "x"<< depth << ", "
             << "mipLevels = " << levels << ", "
@@ -440,20 +408,6 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
     }
     ASSERT_POSTCONDITION(!error, "Unable to create image.");
 
-    // Allocate memory for the VkImage and bind it.
-    VkMemoryRequirements memReqs = {};
-    vkGetImageMemoryRequirements(context.device, textureImage, &memReqs);
-    VkMemoryAllocateInfo allocInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memReqs.size,
-        .memoryTypeIndex = selectMemoryType(context, memReqs.memoryTypeBits,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
-    };
-    error = vkAllocateMemory(context.device, &allocInfo, nullptr, &textureImageMemory);
-    ASSERT_POSTCONDITION(!error, "Unable to allocate image memory.");
-    error = vkBindImageMemory(context.device, textureImage, textureImageMemory, 0);
-    ASSERT_POSTCONDITION(!error, "Unable to bind image.");
-
     // Create a VkImageView so that shaders can sample from the image.
     VkImageViewCreateInfo viewInfo = {};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -477,10 +431,11 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
 }
 
 VulkanTexture::~VulkanTexture() {
-    assert(!hasPendingWork(mContext) && "Texture destroyed while work is pending.");
-    vkDestroyImage(mContext.device, textureImage, VKALLOC);
+    if (mContext.uploader) {
+        mContext.uploader->forget(textureImage);
+    }
     vkDestroyImageView(mContext.device, imageView, VKALLOC);
-    vkFreeMemory(mContext.device, textureImageMemory, VKALLOC);
+    vmaDestroyImage(mContext.allocator, textureImage, textureImageMemory);
 }
 
 void VulkanTexture::load2DImage(PixelBufferDescriptor&& data, uint32_t width, uint32_t height,
@@ -494,30 +449,14 @@ void VulkanTexture::load2DImage(PixelBufferDescriptor&& data, uint32_t width, ui
 
     // Create and populate the staging buffer.
     VulkanStage const* stage = mStagePool.acquireStage(numBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    memcpy(mapped, cpuData, numBytes);
-    vmaUnmapMemory(mContext.allocator, stage->memory);
-    vmaFlushAllocation(mContext.allocator, stage->memory, 0, numBytes);
-
-    // Create a copy-to-device functor because we might need to defer it.
-    auto copyToDevice = [this, stage, width, height, miplevel] (VkCommandBuffer cmd) {
-        transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_UNDEFINED,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, miplevel);
-        copyBufferToImage(cmd, stage->buffer, textureImage, width, height, nullptr, miplevel);
-        transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, miplevel);
-        getSwapContext(mContext).pendingWork.emplace_back([this, stage] (VkCommandBuffer) {
-            mStagePool.releaseStage(stage);
-        });
-    };
-
-    // If possible, perform the upload immediately, otherwise queue up the work.
-    if (mContext.cmdbuffer) {
-        copyToDevice(mContext.cmdbuffer);
-    } else {
-        mContext.pendingWork.emplace_back(copyToDevice);
-    }
+    memcpy(stage->mapped, cpuData, numBytes);
+    mStagePool.flushStage(stage, numBytes);
+
+    // The copy is batched with the other uploads, which allows uploading outside a frame.
+    VkBufferImageCopy regions[6];
+    const uint32_t regionCount = getCopyRegions(regions, width, height, nullptr, miplevel);
+    mContext.uploader->copyToImage(stage, textureImage, getSubresourceRange(miplevel),
+            regions, regionCount);
 }
 
 void VulkanTexture::loadCubeImage(PixelBufferDescriptor&& data,  const FaceOffsets& faceOffsets,
@@ -527,74 +466,49 @@ void VulkanTexture::loadCubeImage(PixelBufferDescriptor&& data,  const FaceOffse
     assert(this->target == SamplerType::SAMPLER_CUBEMAP);
     // Create and populate the staging buffer.
     VulkanStage const* stage = mStagePool.acquireStage(numBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    memcpy(mapped, cpuData, numBytes);
-    vmaUnmapMemory(mContext.allocator, stage->memory);
-    vmaFlushAllocation(mContext.allocator, stage->memory, 0, numBytes);
-
-    // Create a copy-to-device functor because we might need to defer it.
-    auto copyToDevice = [this, faceOffsets, stage, miplevel] (VkCommandBuffer cmd) {
-        transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_UNDEFINED,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, miplevel);
-        copyBufferToImage(cmd, stage->buffer, textureImage, width, height, &faceOffsets, miplevel);
-        transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, miplevel);
-        getSwapContext(mContext).pendingWork.emplace_back([this, stage] (VkCommandBuffer) {
-            mStagePool.releaseStage(stage);
-        });
-    };
+    memcpy(stage->mapped, cpuData, numBytes);
+    mStagePool.flushStage(stage, numBytes);
+
+    // The copy is batched with the other uploads, which allows uploading outside a frame.
+    VkBufferImageCopy regions[6];
+    const uint32_t regionCount = getCopyRegions(regions, width, height, &faceOffsets, miplevel);
+    mContext.uploader->copyToImage(stage, textureImage, getSubresourceRange(miplevel),
+            regions, regionCount);
+}
 
-    // If possible, perform the upload immediately, otherwise queue up the work.
-    if (mContext.cmdbuffer) {
-        copyToDevice(mContext.cmdbuffer);
-    } else {
-        mContext.pendingWork.emplace_back(copyToDevice);
+void VulkanTexture::generateMipmaps() {
+    // Blitting requires a filterable format that can be both the source and the destination.
+    constexpr VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+            VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(mContext.physicalDevice, format, &props);
+    if ((props.optimalTilingFeatures & requiredFeatures) != requiredFeatures) {
+        utils::slog.w << "Mipmaps cannot be generated for format " << format << utils::io::endl;
+        return;
     }
+
+    // The levels are generated with the upload batch, after the copies to level 0.
+    mContext.uploader->generateMipmaps(textureImage, width, height, levels,
+            getSubresourceRange(0).layerCount);
 }
 
-void VulkanTexture::transitionImageLayout(VkCommandBuffer cmd, VkImage image,
-        VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t miplevel) {
-    VkImageMemoryBarrier barrier = {};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = oldLayout;
-    barrier.newLayout = newLayout;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = image;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel = miplevel;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = this->target == SamplerType::SAMPLER_CUBEMAP ? 6 : 1;
-    VkPipelineStageFlags sourceStage;
-    VkPipelineStageFlags destinationStage;
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
-            newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
-            newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    } else {
-        PANIC_POSTCONDITION("Unsupported layout transition.");
-    }
-    vkCmdPipelineBarrier(cmd, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1,
-            &barrier);
+VkImageSubresourceRange VulkanTexture::getSubresourceRange(uint32_t miplevel) const {
+    return {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = miplevel,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = target == SamplerType::SAMPLER_CUBEMAP ? 6u : 1u,
+    };
 }
 
-void VulkanTexture::copyBufferToImage(VkCommandBuffer cmd, VkBuffer buffer, VkImage image,
-        uint32_t width, uint32_t height, FaceOffsets const* faceOffsets, uint32_t miplevel) {
+uint32_t VulkanTexture::getCopyRegions(VkBufferImageCopy* regions, uint32_t width,
+        uint32_t height, FaceOffsets const* faceOffsets, uint32_t miplevel) const {
     if (target == SamplerType::SAMPLER_CUBEMAP) {
         assert(faceOffsets);
-        VkBufferImageCopy regions[6] = {{}};
         for (size_t face = 0; face < 6; face++) {
             auto& region = regions[face];
+            region = {};
             region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
             region.imageSubresource.baseArrayLayer = face;
             region.imageSubresource.layerCount = 1;
@@ -604,11 +518,10 @@ void VulkanTexture::copyBufferToImage(VkCommandBuffer cmd, VkBuffer buffer, VkIm
             region.imageExtent.depth = 1;
             region.bufferOffset = faceOffsets->offsets[face];
         }
-        vkCmdCopyBufferToImage(cmd, buffer, image,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 6, regions);
-        return;
+        return 6;
     }
-    VkBufferImageCopy region = {};
+    VkBufferImageCopy& region = regions[0];
+    region = {};
     region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     region.imageSubresource.mipLevel = miplevel;
     region.imageSubresource.layerCount = 1;
@@ -617,7 +530,7 @@ void VulkanTexture::copyBufferToImage(VkCommandBuffer cmd, VkBuffer buffer, VkIm
         .height = height >> miplevel,
         .depth = 1,
     };
-    vkCmdCopyBufferToImage(cmd, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    return 1;
 }
 
 void VulkanRenderPrimitive::setPrimitiveType(Driver::PrimitiveType pt) {
@@ -679,5 +592,24 @@ void VulkanRenderPrimitive::setBuffers(VulkanVertexBuffer* vertexBuffer,
     }
 }
 
+VulkanTimerQuery::VulkanTimerQuery(VulkanContext& context) : context(context) {
+    if (!context.physicalDeviceProperties.limits.timestampComputeAndGraphics) {
+        return;
+    }
+    VkQueryPoolCreateInfo info = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = 2
+    };
+    VkResult error = vkCreateQueryPool(context.device, &info, VKALLOC, &pool);
+    ASSERT_POSTCONDITION(!error, "Unable to create query pool.");
+}
+
+VulkanTimerQuery::~VulkanTimerQuery() {
+    if (pool) {
+        vkDestroyQueryPool(context.device, pool, VKALLOC);
+    }
+}
+
 } // namespace filament
 } // namespace driver
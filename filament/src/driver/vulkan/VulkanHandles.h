@@ -24,6 +24,8 @@
 #include <filament/EngineEnums.h>
 #include <filament/SamplerBindingMap.h>
 
+#include <vector>
+
 namespace filament {
 namespace driver {
 
@@ -32,7 +34,13 @@ struct VulkanProgram : public HwProgram {
     ~VulkanProgram();
     VulkanContext& context;
     VulkanBinder::ProgramBundle bundle;
+    // compute programs only have these, the pipeline is created by VulkanDriver
+    VkShaderModule compute = VK_NULL_HANDLE;
+    VkPipeline computePipeline = VK_NULL_HANDLE;
     SamplerBindingMap samplerBindings;
+    VkSpecializationInfo specializationInfo = {};
+    std::vector<VkSpecializationMapEntry> specializationEntries;
+    std::vector<VkBool32> specializationData;
 };
 
 struct VulkanTexture;
@@ -58,6 +66,10 @@ struct VulkanRenderTarget : private HwRenderTarget {
             mOffscreen(false) {}
 
     ~VulkanRenderTarget();
+
+    // GPU memory of the images created by createColorImage() and createDepthImage()
+    using HwRenderTarget::size;
+
     bool isOffscreen() const { return mOffscreen; }
     void transformClientRectToPlatform(VkRect2D* bounds) const;
     void transformClientRectToPlatform(VkViewport* bounds) const;
@@ -101,7 +113,7 @@ struct VulkanIndexBuffer : public HwIndexBuffer {
 struct VulkanUniformBuffer : public HwUniformBuffer {
     VulkanUniformBuffer(VulkanContext& context, VulkanStagePool& stagePool, uint32_t numBytes);
     ~VulkanUniformBuffer();
-    void loadFromCpu(const void* cpuData, uint32_t numBytes);
+    void loadFromCpu(const void* cpuData, uint32_t numBytes, uint32_t offset = 0);
     VkBuffer getGpuBuffer() const { return mGpuBuffer; }
 private:
     VulkanContext& mContext;
@@ -110,6 +122,18 @@ private:
     VmaAllocation mGpuMemory;
 };
 
+// Storage buffers can also be read as vertex, index and indirect buffers, so the results of the
+// compute programs can be drawn without a copy, or be copied into vertex buffers.
+struct VulkanStorageBuffer : public HwStorageBuffer {
+    VulkanStorageBuffer(VulkanContext& context, VulkanStagePool& stagePool, uint32_t numBytes) :
+            HwStorageBuffer(numBytes),
+            buffer(new VulkanBuffer(context, stagePool, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                    VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                    numBytes)) {}
+    const std::unique_ptr<VulkanBuffer> buffer;
+};
+
 struct VulkanSamplerBuffer : public HwSamplerBuffer {
     VulkanSamplerBuffer(VulkanContext& context, uint32_t count) : HwSamplerBuffer(count) {}
 };
@@ -121,15 +145,15 @@ struct VulkanTexture : public HwTexture {
     ~VulkanTexture();
     void load2DImage(PixelBufferDescriptor&& data, uint32_t width, uint32_t height, int miplevel);
     void loadCubeImage(PixelBufferDescriptor&& data, const FaceOffsets& faceOffsets, int miplevel);
+    void generateMipmaps();
     VkFormat format;
     VkImageView imageView = VK_NULL_HANDLE;
     VkImage textureImage = VK_NULL_HANDLE;
-    VkDeviceMemory textureImageMemory = VK_NULL_HANDLE;
+    VmaAllocation textureImageMemory = VK_NULL_HANDLE;
 private:
-    void transitionImageLayout(VkCommandBuffer cmdbuffer, VkImage image,
-            VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t miplevel);
-    void copyBufferToImage(VkCommandBuffer cmdbuffer, VkBuffer buffer, VkImage image,
-            uint32_t width, uint32_t height, FaceOffsets const* faceOffsets, uint32_t miplevel);
+    VkImageSubresourceRange getSubresourceRange(uint32_t miplevel) const;
+    uint32_t getCopyRegions(VkBufferImageCopy* regions, uint32_t width, uint32_t height,
+            FaceOffsets const* faceOffsets, uint32_t miplevel) const;
     VulkanContext& mContext;
     VulkanStagePool& mStagePool;
     uint32_t mByteCount;
@@ -151,6 +175,14 @@ struct VulkanRenderPrimitive : public HwRenderPrimitive {
     std::vector<VkDeviceSize> offsets;
 };
 
+// A timer query is a pair of timestamps, written at the top and at the bottom of the pipe.
+struct VulkanTimerQuery : public HwTimerQuery {
+    explicit VulkanTimerQuery(VulkanContext& context);
+    ~VulkanTimerQuery();
+    VulkanContext& context;
+    VkQueryPool pool = VK_NULL_HANDLE;
+};
+
 } // namespace filament
 } // namespace driver
 
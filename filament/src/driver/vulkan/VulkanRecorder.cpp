@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/vulkan/VulkanRecorder.h"
+
+#include <utils/Panic.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+using namespace utils;
+
+namespace filament {
+namespace driver {
+
+void VulkanRecorder::recordDraw(VulkanBinder& binder, VkCommandBuffer cmdbuffer,
+        const VulkanDraw& draw, bool setDynamicState) noexcept {
+    // Translate the raster state, on top of the defaults for the states that Filament doesn't
+    // control.
+    const Driver::RasterState rs = draw.rasterState;
+    VulkanBinder::RasterState rasterState = binder.getDefaultRasterState();
+    rasterState.depthStencil = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = (VkBool32) rs.depthWrite,
+        .depthCompareOp = getCompareOp(rs.depthFunc),
+        .depthBoundsTestEnable = VK_FALSE,
+        .stencilTestEnable = VK_FALSE,
+    };
+    rasterState.blending = {
+        .blendEnable = rs.hasBlending(),
+        .srcColorBlendFactor = getBlendFactor(rs.blendFunctionSrcRGB),
+        .dstColorBlendFactor = getBlendFactor(rs.blendFunctionDstRGB),
+        .colorBlendOp = (VkBlendOp) rs.blendEquationRGB,
+        .srcAlphaBlendFactor = getBlendFactor(rs.blendFunctionSrcAlpha),
+        .dstAlphaBlendFactor = getBlendFactor(rs.blendFunctionDstAlpha),
+        .alphaBlendOp =  (VkBlendOp) rs.blendEquationAlpha,
+        .colorWriteMask = (VkColorComponentFlags) (rs.colorWrite ? 0xf : 0x0),
+    };
+
+    // Push state changes to the VulkanBinder instance. This is fast and does not make VK calls.
+    binder.bindProgramBundle(draw.program);
+    binder.bindRasterState(rasterState);
+    binder.bindPrimitiveTopology(draw.topology);
+    binder.bindVertexArray(*draw.varray);
+    for (uint32_t i = 0; i < VulkanBinder::NUM_UBUFFER_BINDINGS; i++) {
+        const VulkanUniformBinding& ubo = draw.uniforms[i];
+        binder.bindUniformBuffer(i, ubo.buffer, ubo.offset, ubo.size);
+    }
+    for (uint32_t i = 0; i < VulkanBinder::NUM_SAMPLER_BINDINGS; i++) {
+        binder.bindSampler(VulkanBinder::NUM_UBUFFER_BINDINGS + i, draw.samplers[i]);
+    }
+
+    if (setDynamicState) {
+        vkCmdSetViewport(cmdbuffer, 0, 1, &draw.viewport);
+        vkCmdSetScissor(cmdbuffer, 0, 1, &draw.scissor);
+    }
+
+    // Bind a new descriptor set if it needs to change.
+    VkDescriptorSet descriptor;
+    VkPipelineLayout pipelineLayout;
+    const uint32_t* dynamicOffsets;
+    if (binder.getOrCreateDescriptor(&descriptor, &pipelineLayout, &dynamicOffsets)) {
+        vkCmdBindDescriptorSets(cmdbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+                &descriptor, VulkanBinder::NUM_UBUFFER_BINDINGS, dynamicOffsets);
+    }
+
+    // Bind the pipeline if it changed. This can happen, for example, if the raster state changed.
+    VkPipeline pipeline;
+    if (binder.getOrCreatePipeline(&pipeline)) {
+        vkCmdBindPipeline(cmdbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    }
+
+    // The push constants survive pipeline changes since all the pipelines share their layout.
+    if (draw.pushConstants.size > 0) {
+        vkCmdPushConstants(cmdbuffer, binder.getPipelineLayout(),
+                VulkanBinder::PUSH_CONSTANT_STAGES, 0, draw.pushConstants.size,
+                draw.pushConstants.data);
+    }
+
+    // Next bind the vertex buffers and index buffer. One potential performance improvement is to
+    // avoid rebinding these if they are already bound, but since we do not (yet) support subranges
+    // it would be rare for a client to make consecutive draw calls with the same render primitive.
+    vkCmdBindVertexBuffers(cmdbuffer, 0, draw.bufferCount, draw.buffers, draw.offsets);
+    vkCmdBindIndexBuffer(cmdbuffer, draw.indexBuffer, 0, draw.indexType);
+
+    // Finally, make the actual draw call.
+    // The shaders rely on the first instance having index 0 (see getInstanceIndex()).
+    if (draw.indirectBuffer != VK_NULL_HANDLE) {
+        // the multiDrawIndirect feature isn't enabled, so each draw has its own command
+        for (uint32_t i = 0; i < draw.indirectDrawCount; i++) {
+            vkCmdDrawIndexedIndirect(cmdbuffer, draw.indirectBuffer,
+                    draw.indirectOffset + i * draw.indirectStride, 1, draw.indirectStride);
+        }
+        return;
+    }
+    const int32_t vertexOffset = 0;
+    const uint32_t firstInstId = 0;
+    vkCmdDrawIndexed(cmdbuffer, draw.indexCount, draw.instanceCount, draw.firstIndex,
+            vertexOffset, firstInstId);
+}
+
+void VulkanRecorder::recordDraws(VulkanBinder& binder, VkCommandBuffer cmdbuffer,
+        const VulkanDraw* draws, size_t drawCount) noexcept {
+    for (size_t i = 0; i < drawCount; i++) {
+        const VulkanDraw& draw = draws[i];
+        const bool setDynamicState = i == 0 ||
+                memcmp(&draw.viewport, &draws[i - 1].viewport, sizeof(VkViewport)) != 0 ||
+                memcmp(&draw.scissor, &draws[i - 1].scissor, sizeof(VkRect2D)) != 0;
+        recordDraw(binder, cmdbuffer, draw, setDynamicState);
+    }
+}
+
+void VulkanRecorder::initialize(VkPipelineCache pipelineCache) noexcept {
+    // The driver thread records one of the ranges, so it only needs MAX_RECORDERS - 1 workers.
+    mJobSystem.reset(new JobSystem(MAX_RECORDERS - 1, 1));
+    mJobSystem->adopt();
+
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = mContext.graphicsQueueFamilyIndex;
+    mRecorders.reset(new Recorder[MAX_RECORDERS]);
+    for (uint32_t i = 0; i < MAX_RECORDERS; i++) {
+        Recorder& recorder = mRecorders[i];
+        recorder.binder.setDevice(mContext.device);
+        recorder.binder.setPipelineCache(pipelineCache);
+        for (VkCommandPool& pool : recorder.commandPools) {
+            VkResult result = vkCreateCommandPool(mContext.device, &poolInfo, VKALLOC, &pool);
+            ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateCommandPool error.");
+        }
+    }
+}
+
+void VulkanRecorder::reset() noexcept {
+    if (!mJobSystem) {
+        return;
+    }
+    for (uint32_t i = 0; i < MAX_RECORDERS; i++) {
+        Recorder& recorder = mRecorders[i];
+        recorder.binder.destroyCache();
+        recorder.binder.setPipelineCache(VK_NULL_HANDLE);
+        // destroying the pools frees their command buffers
+        for (VkCommandPool pool : recorder.commandPools) {
+            vkDestroyCommandPool(mContext.device, pool, VKALLOC);
+        }
+    }
+    mRecorders.reset();
+    mJobSystem->emancipate();
+    mJobSystem.reset();
+}
+
+void VulkanRecorder::record(VkCommandBuffer primary, VkRenderPass renderPass,
+        VkFramebuffer framebuffer, const VulkanDraw* draws, size_t drawCount) noexcept {
+    assert(isParallel(drawCount));
+    const size_t count = std::min(size_t(MAX_RECORDERS), drawCount / MIN_DRAWS_PER_RECORDER);
+    const size_t drawsPerRange = (drawCount + count - 1) / count;
+
+    // The command buffers are acquired up front, on this thread, since each recorder's pools are
+    // only ever touched by the job recording with it.
+    VkCommandBuffer cmdbuffers[MAX_RECORDERS];
+    for (size_t i = 0; i < count; i++) {
+        cmdbuffers[i] = acquireCommandBuffer(mRecorders[i]);
+    }
+
+    JobSystem& js = *mJobSystem;
+    JobSystem::Job* parent = js.createJob();
+    for (size_t i = 1; i < count; i++) {
+        const size_t first = i * drawsPerRange;
+        const size_t last = std::min(drawCount, first + drawsPerRange);
+        JobSystem::Job* job = jobs::createJob(js, parent,
+                [this, i, &cmdbuffers, renderPass, framebuffer, draws, first, last]() {
+            recordRange(mRecorders[i], cmdbuffers[i], renderPass, framebuffer,
+                    draws + first, last - first);
+        });
+        js.run(job);
+    }
+    // the first range is recorded by this thread while the workers record the others
+    recordRange(mRecorders[0], cmdbuffers[0], renderPass, framebuffer, draws, drawsPerRange);
+    js.runAndWait(parent);
+
+    vkCmdExecuteCommands(primary, (uint32_t) count, cmdbuffers);
+}
+
+void VulkanRecorder::recordRange(Recorder& recorder, VkCommandBuffer cmdbuffer,
+        VkRenderPass renderPass, VkFramebuffer framebuffer, const VulkanDraw* draws,
+        size_t drawCount) noexcept {
+    VkCommandBufferInheritanceInfo inheritanceInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .renderPass = renderPass,
+        .subpass = 0,
+        .framebuffer = framebuffer,
+    };
+    VkCommandBufferBeginInfo beginInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &inheritanceInfo,
+    };
+    VkResult result = vkBeginCommandBuffer(cmdbuffer, &beginInfo);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkBeginCommandBuffer error.");
+
+    // A secondary command buffer doesn't inherit any binding or dynamic state.
+    VulkanBinder& binder = recorder.binder;
+    binder.bindRenderPass(renderPass);
+    binder.resetBindings();
+    recordDraws(binder, cmdbuffer, draws, drawCount);
+
+    result = vkEndCommandBuffer(cmdbuffer);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkEndCommandBuffer error.");
+}
+
+VkCommandBuffer VulkanRecorder::acquireCommandBuffer(Recorder& recorder) noexcept {
+    std::vector<VkCommandBuffer>& cmdbuffers = recorder.cmdbuffers[mContext.currentFrame];
+    if (recorder.used == cmdbuffers.size()) {
+        VkCommandBufferAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = recorder.commandPools[mContext.currentFrame];
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocateInfo.commandBufferCount = 1;
+        VkCommandBuffer cmdbuffer;
+        VkResult result = vkAllocateCommandBuffers(mContext.device, &allocateInfo, &cmdbuffer);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkAllocateCommandBuffers error.");
+        cmdbuffers.push_back(cmdbuffer);
+    }
+    return cmdbuffers[recorder.used++];
+}
+
+void VulkanRecorder::gc() noexcept {
+    if (!mJobSystem) {
+        return;
+    }
+    // The frame has been retired, so the GPU is done with the command buffers recorded for it
+    // FRAMES_IN_FLIGHT frames ago. Resetting the pool recycles all of them at once.
+    for (uint32_t i = 0; i < MAX_RECORDERS; i++) {
+        Recorder& recorder = mRecorders[i];
+        VkResult result = vkResetCommandPool(mContext.device,
+                recorder.commandPools[mContext.currentFrame], 0);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkResetCommandPool error.");
+        recorder.used = 0;
+        recorder.binder.gc();
+    }
+}
+
+void VulkanRecorder::unbindUniformBuffer(VkBuffer uniformBuffer) noexcept {
+    for (uint32_t i = 0; mRecorders && i < MAX_RECORDERS; i++) {
+        mRecorders[i].binder.unbindUniformBuffer(uniformBuffer);
+    }
+}
+
+void VulkanRecorder::unbindImageView(VkImageView imageView) noexcept {
+    for (uint32_t i = 0; mRecorders && i < MAX_RECORDERS; i++) {
+        mRecorders[i].binder.unbindImageView(imageView);
+    }
+}
+
+uint32_t VulkanRecorder::getPipelineCreationCount() const noexcept {
+    uint32_t count = 0;
+    for (uint32_t i = 0; mRecorders && i < MAX_RECORDERS; i++) {
+        count += mRecorders[i].binder.getPipelineCreationCount();
+    }
+    return count;
+}
+
+} // namespace filament
+} // namespace driver
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_VULKANRECORDER_H
+#define TNT_FILAMENT_DRIVER_VULKANRECORDER_H
+
+#include "VulkanBinder.h"
+#include "VulkanDriverImpl.h"
+
+#include "driver/Driver.h"
+
+#include <utils/JobSystem.h>
+
+#include <memory>
+#include <vector>
+
+namespace filament {
+namespace driver {
+
+// Records render passes on several threads when FILAMENT_VULKAN_PARALLEL_RECORDING is set to 1.
+// The draw calls of a pass are then captured rather than recorded right away, and once the pass
+// ends, large passes are split into ranges that JobSystem workers record into secondary command
+// buffers. Small passes are still recorded into the primary command buffer.
+#ifndef FILAMENT_VULKAN_PARALLEL_RECORDING
+#define FILAMENT_VULKAN_PARALLEL_RECORDING 0
+#endif
+static constexpr bool PARALLEL_RECORDING = FILAMENT_VULKAN_PARALLEL_RECORDING;
+
+// The uniform buffer range bound to a binding point.
+struct VulkanUniformBinding {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+};
+
+// The VulkanDraw POD is everything a draw call binds, resolved on the driver thread, so that the
+// draw can be recorded later with any VulkanBinder. The vertex layout and buffers are weak
+// references to the render primitive, which must outlive the recording.
+struct VulkanDraw {
+    VulkanBinder::ProgramBundle program;
+    Driver::RasterState rasterState;
+    VkPrimitiveTopology topology;
+    const VulkanBinder::VertexArray* varray;
+    uint32_t bufferCount;
+    const VkBuffer* buffers;
+    const VkDeviceSize* offsets;
+    VkBuffer indexBuffer;
+    VkIndexType indexType;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    uint32_t instanceCount;
+    // when set, the arguments of the draws come from this buffer, see drawIndirect()
+    VkBuffer indirectBuffer;
+    VkDeviceSize indirectOffset;
+    uint32_t indirectDrawCount;
+    uint32_t indirectStride;
+    VulkanUniformBinding uniforms[VulkanBinder::NUM_UBUFFER_BINDINGS];
+    VkDescriptorImageInfo samplers[VulkanBinder::NUM_SAMPLER_BINDINGS];
+    VkViewport viewport;
+    VkRect2D scissor;
+    Driver::PushConstants pushConstants;
+};
+
+class VulkanRecorder {
+public:
+    // A pass is split into at most this many ranges, each recorded by its own job with its own
+    // VulkanBinder and command pools, so that the jobs never share Vulkan objects that need
+    // external synchronization.
+    static constexpr uint32_t MAX_RECORDERS = 4;
+
+    // Passes with fewer draw calls per range than this are recorded into the primary command
+    // buffer, recording them on other threads would cost more than it saves.
+    static constexpr uint32_t MIN_DRAWS_PER_RECORDER = 64;
+
+    explicit VulkanRecorder(VulkanContext& context) noexcept : mContext(context) {}
+
+    // Records the draw call with the given binder. The viewport and scissor are set only if
+    // 'setDynamicState' is true, since the caller usually knows they haven't changed.
+    static void recordDraw(VulkanBinder& binder, VkCommandBuffer cmdbuffer,
+            const VulkanDraw& draw, bool setDynamicState) noexcept;
+
+    // Records the draw calls in order with the given binder, starting with a fresh dynamic state.
+    static void recordDraws(VulkanBinder& binder, VkCommandBuffer cmdbuffer,
+            const VulkanDraw* draws, size_t drawCount) noexcept;
+
+    // Creates the job system and the per-recorder objects. This must be called from the driver
+    // thread, which joins the job system, once the device exists.
+    void initialize(VkPipelineCache pipelineCache) noexcept;
+
+    // Destroys everything created by initialize(), the GPU must be idle.
+    void reset() noexcept;
+
+    bool isInitialized() const noexcept { return mJobSystem != nullptr; }
+
+    // Returns true if the given number of draw calls is worth recording in parallel, in which
+    // case the render pass must be begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+    bool isParallel(size_t drawCount) const noexcept {
+        return mJobSystem && drawCount >= 2 * MIN_DRAWS_PER_RECORDER;
+    }
+
+    // Records the draw calls into secondary command buffers from several jobs, and executes them
+    // in the given primary command buffer, within the current render pass. The bindings of the
+    // primary command buffer are undefined afterwards.
+    void record(VkCommandBuffer primary, VkRenderPass renderPass, VkFramebuffer framebuffer,
+            const VulkanDraw* draws, size_t drawCount) noexcept;
+
+    // Makes the command buffers of the current frame reusable and evicts the unused objects of
+    // the binders. Call this once per frame, after acquiring the frame's command buffer.
+    void gc() noexcept;
+
+    // Forwards these to the binders of all recorders, see VulkanBinder.
+    void unbindUniformBuffer(VkBuffer uniformBuffer) noexcept;
+    void unbindImageView(VkImageView imageView) noexcept;
+    uint32_t getPipelineCreationCount() const noexcept;
+
+private:
+    struct Recorder {
+        VulkanBinder binder;
+        VkCommandPool commandPools[FRAMES_IN_FLIGHT] = {};
+        std::vector<VkCommandBuffer> cmdbuffers[FRAMES_IN_FLIGHT];
+        uint32_t used = 0;  // command buffers used in the current frame
+    };
+
+    VkCommandBuffer acquireCommandBuffer(Recorder& recorder) noexcept;
+    void recordRange(Recorder& recorder, VkCommandBuffer cmdbuffer, VkRenderPass renderPass,
+            VkFramebuffer framebuffer, const VulkanDraw* draws, size_t drawCount) noexcept;
+
+    VulkanContext& mContext;
+    std::unique_ptr<utils::JobSystem> mJobSystem;
+    std::unique_ptr<Recorder[]> mRecorders;
+};
+
+} // namespace filament
+} // namespace driver
+
+#endif // TNT_FILAMENT_DRIVER_VULKANRECORDER_H
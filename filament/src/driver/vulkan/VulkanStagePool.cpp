@@ -22,6 +22,13 @@ namespace filament {
 namespace driver {
 
 VulkanStage const* VulkanStagePool::acquireStage(uint32_t numBytes) noexcept {
+    if (numBytes <= MAX_RING_STAGE_SIZE) {
+        VulkanStage const* stage = acquireRingStage(numBytes);
+        if (stage) {
+            return stage;
+        }
+    }
+
     // First check if a stage exists whose capacity is greater than or equal to the requested size.
     auto iter = mFreeStages.lower_bound(numBytes);
     if (iter != mFreeStages.end()) {
@@ -36,22 +43,104 @@ VulkanStage const* VulkanStagePool::acquireStage(uint32_t numBytes) noexcept {
         .buffer = VK_NULL_HANDLE,
         .lastAccessed = mCurrentFrame,
         .capacity = numBytes,
+        .offset = 0,
+        .mapped = nullptr,
     });
     // Create the VkBuffer.
     mUsedStages.insert(stage);
     VkBufferCreateInfo bufferInfo {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         .size = numBytes,
-        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
     };
     VmaAllocationCreateInfo allocInfo {
+        .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
         .usage = VMA_MEMORY_USAGE_CPU_ONLY
     };
-    vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &stage->buffer, &stage->memory, 0);
+    VmaAllocationInfo info;
+    vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &stage->buffer, &stage->memory,
+            &info);
+    stage->mapped = info.pMappedData;
+    mSize += numBytes;
     return stage;
 }
 
+VulkanStage const* VulkanStagePool::acquireRingStage(uint32_t numBytes) noexcept {
+    if (!mRingBuffer) {
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = RING_SIZE;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        VmaAllocationCreateInfo allocInfo = {};
+        allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        allocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+        VmaAllocationInfo info;
+        if (vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &mRingBuffer,
+                &mRingMemory, &info) != VK_SUCCESS) {
+            mRingBuffer = VK_NULL_HANDLE;
+            return nullptr;
+        }
+        mRingMapped = info.pMappedData;
+        mSize += RING_SIZE;
+    }
+
+    // The free space is after the newest stage, and before the oldest one. When the used range
+    // doesn't wrap around, that's [end, RING_SIZE) followed by [0, start).
+    const uint32_t size = (numBytes + RING_ALIGNMENT - 1) / RING_ALIGNMENT * RING_ALIGNMENT;
+    uint32_t offset = 0;
+    if (!mRingStages.empty()) {
+        const uint32_t start = mRingStages.front().stage.offset;
+        const VulkanStage& newest = mRingStages.back().stage;
+        const uint32_t end = newest.offset +
+                (newest.capacity + RING_ALIGNMENT - 1) / RING_ALIGNMENT * RING_ALIGNMENT;
+        if (end > start) {
+            if (RING_SIZE - end >= size) {
+                offset = end;
+            } else if (start >= size) {
+                offset = 0;
+            } else {
+                return nullptr;
+            }
+        } else if (start - end >= size) {
+            offset = end;
+        } else {
+            return nullptr;
+        }
+    }
+
+    VulkanStage stage;
+    stage.memory = mRingMemory;
+    stage.buffer = mRingBuffer;
+    stage.capacity = numBytes;
+    stage.lastAccessed = mCurrentFrame;
+    stage.offset = offset;
+    stage.mapped = static_cast<uint8_t*>(mRingMapped) + offset;
+    mRingStages.push_back({ stage, false });
+    return &mRingStages.back().stage;
+}
+
+void VulkanStagePool::releaseRingStage(VulkanStage const* stage) noexcept {
+    // The uploads complete in order, so this is almost always the oldest stage.
+    for (RingStage& ringStage : mRingStages) {
+        if (&ringStage.stage == stage) {
+            ringStage.released = true;
+            break;
+        }
+    }
+    while (!mRingStages.empty() && mRingStages.front().released) {
+        mRingStages.pop_front();
+    }
+}
+
+void VulkanStagePool::flushStage(VulkanStage const* stage, uint32_t numBytes) noexcept {
+    vmaFlushAllocation(mContext.allocator, stage->memory, stage->offset, numBytes);
+}
+
 void VulkanStagePool::releaseStage(VulkanStage const* stage) noexcept {
+    if (stage->buffer == mRingBuffer) {
+        releaseRingStage(stage);
+        return;
+    }
     auto iter = mUsedStages.find(stage);
     if (iter == mUsedStages.end()) {
         utils::slog.e << "Unknown stage: " << stage->capacity << " bytes" << utils::io::endl;
@@ -70,6 +159,7 @@ void VulkanStagePool::gc() noexcept {
     for (auto pair : stages) {
         if (pair.second->lastAccessed < evictionTime) {
             vmaDestroyBuffer(mContext.allocator, pair.second->buffer, pair.second->memory);
+            mSize -= pair.second->capacity;
         } else {
             mFreeStages.insert(pair);
         }
@@ -78,10 +168,18 @@ void VulkanStagePool::gc() noexcept {
 
 void VulkanStagePool::reset() noexcept {
     assert(mUsedStages.empty());
+    assert(mRingStages.empty());
+    if (mRingBuffer) {
+        vmaDestroyBuffer(mContext.allocator, mRingBuffer, mRingMemory);
+        mRingBuffer = VK_NULL_HANDLE;
+        mRingMemory = VK_NULL_HANDLE;
+        mRingMapped = nullptr;
+    }
     for (auto pair : mFreeStages) {
         vmaDestroyBuffer(mContext.allocator, pair.second->buffer, pair.second->memory);
     }
     mFreeStages.clear();
+    mSize = 0;
 }
 
 } // namespace filament
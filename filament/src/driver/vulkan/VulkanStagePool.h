@@ -19,21 +19,30 @@
 
 #include "VulkanDriverImpl.h"
 
+#include <deque>
 #include <map>
 #include <unordered_set>
 
 namespace filament {
 namespace driver {
 
-// Immutable POD representing a shared CPU-GPU staging area.
+// Immutable POD representing a shared CPU-GPU staging area. The stage is the range
+// [offset, offset + capacity) of the buffer, it is persistently mapped at 'mapped'. Stages are
+// used for uploads, and for reading back pixels.
 struct VulkanStage {
     VmaAllocation memory;
     VkBuffer buffer;
     uint32_t capacity;
     mutable uint64_t lastAccessed;
+    uint32_t offset;
+    void* mapped;
 };
 
 // Manages a pool of stages, periodically releasing stages that have been unused for a while.
+//
+// Small stages are sub-allocated linearly from a persistently mapped ring buffer, they're
+// reclaimed in order as their uploads complete. The larger ones, or all of them when the ring is
+// full, are dedicated buffers recycled by size.
 class VulkanStagePool {
 public:
     explicit VulkanStagePool(VulkanContext& context) noexcept : mContext(context) {}
@@ -41,18 +50,48 @@ public:
     // Finds or creates a stage whose capacity is at least the given number of bytes.
     VulkanStage const* acquireStage(uint32_t numBytes) noexcept;
 
-    // Returns the given stage back to the pool.
+    // Returns the given stage back to the pool. The GPU must be done reading it.
     void releaseStage(VulkanStage const* stage) noexcept;
 
+    // Makes the first 'numBytes' written to the stage's mapping visible to the GPU.
+    void flushStage(VulkanStage const* stage, uint32_t numBytes) noexcept;
+
     // Evicts old unused stages and bumps the current frame number.
     void gc() noexcept;
 
     // Destroys all unused stages and asserts that there are no stages currently in use.
     // This should be called while the context's VkDevice is still alive.
     void reset() noexcept;
+
+    // Size of all the staging buffers currently allocated, in bytes.
+    size_t getSize() const noexcept { return mSize; }
 private:
+    // Room for the uploads of a few frames in flight.
+    static constexpr uint32_t RING_SIZE = 8u * 1024u * 1024u;
+
+    // Larger uploads get their own stage, so that they don't stall the ring.
+    static constexpr uint32_t MAX_RING_STAGE_SIZE = RING_SIZE / 8u;
+
+    // vkCmdCopyBufferToImage needs offsets that are multiples of 4 and of the texel size, 48 is
+    // the least common multiple of all the texel and block sizes up to 16 bytes.
+    static constexpr uint32_t RING_ALIGNMENT = 48u;
+
+    VulkanStage const* acquireRingStage(uint32_t numBytes) noexcept;
+    void releaseRingStage(VulkanStage const* stage) noexcept;
+
     VulkanContext& mContext;
 
+    // The ring buffer, and its stages in use in allocation order. The oldest one marks the start
+    // of the used range, the newest one its end.
+    struct RingStage {
+        VulkanStage stage;
+        bool released;
+    };
+    VkBuffer mRingBuffer = VK_NULL_HANDLE;
+    VmaAllocation mRingMemory = VK_NULL_HANDLE;
+    void* mRingMapped = nullptr;
+    std::deque<RingStage> mRingStages;
+
     // Use an ordered multimap for quick (capacity => stage) lookups using lower_bound().
     std::multimap<uint32_t, VulkanStage const*> mFreeStages;
 
@@ -62,6 +101,7 @@ private:
 
     // Store the current "time" (really just a frame count) and LRU eviction parameters.
     uint64_t mCurrentFrame = 0;
+    size_t mSize = 0;
     static constexpr uint32_t TIME_BEFORE_EVICTION = 2;
 };
 
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/vulkan/VulkanUploader.h"
+
+#include <utils/Panic.h>
+
+#include <algorithm>
+
+namespace filament {
+namespace driver {
+
+void VulkanUploader::copyToBuffer(VulkanStage const* stage, VkBuffer buffer, uint32_t offset,
+        uint32_t numBytes, VkAccessFlags dstAccess, VkPipelineStageFlags dstStages) noexcept {
+    mBufferCopies.push_back({ buffer, stage->buffer, {
+        .srcOffset = stage->offset,
+        .dstOffset = offset,
+        .size = numBytes
+    }});
+    mStages.push_back(stage);
+    mDstAccess |= dstAccess;
+    mDstStages |= dstStages;
+    mBatchSize += numBytes;
+    if (mBatchSize >= MAX_BATCH_SIZE) {
+        flush();
+    }
+}
+
+void VulkanUploader::copyToImage(VulkanStage const* stage, VkImage image,
+        VkImageSubresourceRange const& range,
+        VkBufferImageCopy const* regions, uint32_t regionCount) noexcept {
+    mImageCopies.push_back({ image, stage->buffer, range,
+            uint32_t(mImageRegions.size()), regionCount });
+    mImageRegions.insert(mImageRegions.end(), regions, regions + regionCount);
+    for (uint32_t i = mImageRegions.size() - regionCount; i < mImageRegions.size(); i++) {
+        mImageRegions[i].bufferOffset += stage->offset;
+    }
+    mStages.push_back(stage);
+    mBatchSize += stage->capacity;
+    if (mBatchSize >= MAX_BATCH_SIZE) {
+        flush();
+    }
+}
+
+void VulkanUploader::generateMipmaps(VkImage image, uint32_t width, uint32_t height,
+        uint32_t levels, uint32_t layers) noexcept {
+    if (levels > 1) {
+        mMipmaps.push_back({ image, width, height, levels, layers });
+    }
+}
+
+void VulkanUploader::flush(VkSemaphore signal) noexcept {
+    if (mStages.empty() && mMipmaps.empty()) {
+        if (signal) {
+            // this still orders the signal after the commands submitted before
+            VkSubmitInfo submitInfo {
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .signalSemaphoreCount = 1u,
+                .pSignalSemaphores = &signal,
+            };
+            VkResult result = vkQueueSubmit(mContext.graphicsQueue, 1, &submitInfo,
+                    VK_NULL_HANDLE);
+            ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkQueueSubmit error.");
+        }
+        return;
+    }
+
+    // reuse the command buffer and fence of a completed batch if possible
+    gc();
+    Batch batch;
+    if (!mFreeBatches.empty()) {
+        batch = std::move(mFreeBatches.back());
+        mFreeBatches.pop_back();
+    } else {
+        VkCommandBufferAllocateInfo allocateInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = mContext.commandPool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1
+        };
+        VkFenceCreateInfo fenceCreateInfo { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+        vkAllocateCommandBuffers(mContext.device, &allocateInfo, &batch.cmdbuffer);
+        vkCreateFence(mContext.device, &fenceCreateInfo, VKALLOC, &batch.fence);
+    }
+
+    VkCommandBuffer const cmdbuffer = batch.cmdbuffer;
+    VkCommandBufferBeginInfo beginInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    vkBeginCommandBuffer(cmdbuffer, &beginInfo);
+
+    // All the images are transitioned for the copies with a single barrier.
+    for (ImageCopy const& copy : mImageCopies) {
+        mBarriers.access(copy.image, copy.range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, true);
+    }
+    uint32_t maxLevels = 0;
+    for (MipmapChain const& chain : mMipmaps) {
+        mBarriers.access(chain.image, chain.getRange(1, chain.levels - 1),
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_ACCESS_TRANSFER_WRITE_BIT, true);
+        maxLevels = std::max(maxLevels, chain.levels);
+    }
+    mBarriers.flush(cmdbuffer);
+
+    for (BufferCopy const& copy : mBufferCopies) {
+        vkCmdCopyBuffer(cmdbuffer, copy.stage, copy.buffer, 1, &copy.region);
+    }
+    for (ImageCopy const& copy : mImageCopies) {
+        vkCmdCopyBufferToImage(cmdbuffer, copy.stage, copy.image,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copy.regionCount,
+                mImageRegions.data() + copy.firstRegion);
+    }
+
+    // The mip levels are generated from the content copied above, one level of all the chains
+    // at a time, so that each level needs a single barrier.
+    for (uint32_t level = 1; level < maxLevels; level++) {
+        for (MipmapChain const& chain : mMipmaps) {
+            if (level < chain.levels) {
+                mBarriers.access(chain.image, chain.getRange(level - 1, 1),
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_ACCESS_TRANSFER_READ_BIT);
+            }
+        }
+        mBarriers.flush(cmdbuffer);
+        for (MipmapChain const& chain : mMipmaps) {
+            if (level < chain.levels) {
+                recordBlit(cmdbuffer, chain, level);
+            }
+        }
+    }
+
+    // A single barrier then makes all the copies visible to the commands submitted after this
+    // batch: one global memory barrier for the buffers, and the layout transitions of the images.
+    for (ImageCopy const& copy : mImageCopies) {
+        mBarriers.access(copy.image, copy.range, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+    for (MipmapChain const& chain : mMipmaps) {
+        mBarriers.access(chain.image, chain.getRange(0, chain.levels),
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                VK_ACCESS_SHADER_READ_BIT);
+    }
+    if (!mBufferCopies.empty()) {
+        mBarriers.accessMemory(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                mDstStages, mDstAccess);
+    }
+    mBarriers.flush(cmdbuffer);
+
+    vkEndCommandBuffer(cmdbuffer);
+
+    VkSubmitInfo submitInfo {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmdbuffer,
+        .signalSemaphoreCount = signal ? 1u : 0u,
+        .pSignalSemaphores = &signal,
+    };
+    VkResult result = vkQueueSubmit(mContext.graphicsQueue, 1, &submitInfo, batch.fence);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkQueueSubmit error.");
+
+    // The stages can only be reused once the GPU is done with the copies, see gc().
+    batch.stages.swap(mStages);
+    mBatches.push_back(std::move(batch));
+
+    mBufferCopies.clear();
+    mImageCopies.clear();
+    mImageRegions.clear();
+    mMipmaps.clear();
+    mStages.clear();
+    mDstAccess = 0;
+    mDstStages = 0;
+    mBatchSize = 0;
+}
+
+void VulkanUploader::recordBlit(VkCommandBuffer cmdbuffer, MipmapChain const& chain,
+        uint32_t level) noexcept {
+    const int32_t width = std::max(1u, chain.width >> (level - 1));
+    const int32_t height = std::max(1u, chain.height >> (level - 1));
+    VkImageBlit blit {
+        .srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, chain.layers },
+        .srcOffsets = {{ 0, 0, 0 }, { width, height, 1 }},
+        .dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, chain.layers },
+        .dstOffsets = {{ 0, 0, 0 }, { std::max(1, width / 2), std::max(1, height / 2), 1 }}
+    };
+    vkCmdBlitImage(cmdbuffer, chain.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            chain.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+}
+
+void VulkanUploader::gc(bool wait) noexcept {
+    // batches complete in submission order
+    while (!mBatches.empty()) {
+        Batch& batch = mBatches.front();
+        VkResult result = wait ?
+                vkWaitForFences(mContext.device, 1, &batch.fence, VK_TRUE, UINT64_MAX) :
+                vkGetFenceStatus(mContext.device, batch.fence);
+        if (result != VK_SUCCESS) {
+            break;
+        }
+        recycle(batch);
+        mBatches.pop_front();
+    }
+}
+
+void VulkanUploader::recycle(Batch& batch) noexcept {
+    for (VulkanStage const* stage : batch.stages) {
+        mStagePool.releaseStage(stage);
+    }
+    batch.stages.clear();
+    vkResetFences(mContext.device, 1, &batch.fence);
+    vkResetCommandBuffer(batch.cmdbuffer, 0);
+    mFreeBatches.push_back(std::move(batch));
+}
+
+void VulkanUploader::reset() noexcept {
+    flush();
+    gc(true);
+    for (Batch const& batch : mFreeBatches) {
+        vkFreeCommandBuffers(mContext.device, mContext.commandPool, 1, &batch.cmdbuffer);
+        vkDestroyFence(mContext.device, batch.fence, VKALLOC);
+    }
+    mFreeBatches.clear();
+}
+
+} // namespace filament
+} // namespace driver
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_VULKANUPLOADER_H
+#define TNT_FILAMENT_DRIVER_VULKANUPLOADER_H
+
+#include "VulkanBarriers.h"
+#include "VulkanDriverImpl.h"
+#include "VulkanStagePool.h"
+
+#include <deque>
+#include <vector>
+
+namespace filament {
+namespace driver {
+
+// Batches the copies from staging areas to buffers and images. All the copies recorded between
+// two flushes go into a single command buffer, with one set of barriers and one submission. The
+// stages are released all at once, when the fence of their batch signals.
+class VulkanUploader {
+public:
+    VulkanUploader(VulkanContext& context, VulkanStagePool& stagePool) noexcept
+            : mContext(context), mStagePool(stagePool) {}
+
+    // Records a copy of 'numBytes' from the start of the stage into the buffer at 'offset'. The
+    // content is visible to 'dstAccess' at 'dstStages' once the batch is submitted.
+    void copyToBuffer(VulkanStage const* stage, VkBuffer buffer, uint32_t offset,
+            uint32_t numBytes, VkAccessFlags dstAccess, VkPipelineStageFlags dstStages) noexcept;
+
+    // Records a copy of the stage into the given subresources of the image, which end up in the
+    // SHADER_READ_ONLY layout. The previous content of these subresources is discarded. The
+    // offsets of the regions are relative to the start of the stage.
+    void copyToImage(VulkanStage const* stage, VkImage image,
+            VkImageSubresourceRange const& range,
+            VkBufferImageCopy const* regions, uint32_t regionCount) noexcept;
+
+    // Records the generation of the levels 1 to 'levels - 1' of the image, each one blitted from
+    // the previous one, once the copies of the batch are done. The image must be in the
+    // SHADER_READ_ONLY layout when the batch executes, and ends up in that layout again.
+    void generateMipmaps(VkImage image, uint32_t width, uint32_t height, uint32_t levels,
+            uint32_t layers) noexcept;
+
+    // Submits the copies recorded since the last flush, if any. This must be called before
+    // submitting the commands that use the uploaded data. 'signal' is signaled once the copies
+    // are done, even if there are none, for the commands submitted to another queue.
+    void flush(VkSemaphore signal = VK_NULL_HANDLE) noexcept;
+
+    // Releases the stages and command buffers of the batches that have completed, waits for
+    // all of them if 'wait' is true.
+    void gc(bool wait = false) noexcept;
+
+    // Waits for all the batches and destroys their command buffers and fences.
+    void reset() noexcept;
+
+    // Forgets the layout of an image that's being destroyed.
+    void forget(VkImage image) noexcept { mBarriers.forget(image); }
+
+    bool hasPendingWork() const noexcept {
+        return !mStages.empty() || !mMipmaps.empty() || !mBatches.empty();
+    }
+
+private:
+    struct BufferCopy {
+        VkBuffer buffer;
+        VkBuffer stage;
+        VkBufferCopy region;
+    };
+
+    struct ImageCopy {
+        VkImage image;
+        VkBuffer stage;
+        VkImageSubresourceRange range;
+        uint32_t firstRegion;
+        uint32_t regionCount;
+    };
+
+    struct MipmapChain {
+        VkImage image;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levels;
+        uint32_t layers;
+        VkImageSubresourceRange getRange(uint32_t baseLevel, uint32_t levelCount) const noexcept {
+            return { VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, levelCount, 0, layers };
+        }
+    };
+
+    struct Batch {
+        VkCommandBuffer cmdbuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        std::vector<VulkanStage const*> stages;
+    };
+
+    // submitting more than this in one batch costs more staging memory than it saves
+    static constexpr uint32_t MAX_BATCH_SIZE = 16u * 1024u * 1024u;
+
+    void recycle(Batch& batch) noexcept;
+    static void recordBlit(VkCommandBuffer cmdbuffer, MipmapChain const& chain,
+            uint32_t level) noexcept;
+
+    VulkanContext& mContext;
+    VulkanStagePool& mStagePool;
+
+    // the layouts of the images, which rest in the SHADER_READ_ONLY layout between the batches
+    VulkanBarriers mBarriers;
+
+    // copies recorded since the last flush
+    std::vector<BufferCopy> mBufferCopies;
+    std::vector<ImageCopy> mImageCopies;
+    std::vector<VkBufferImageCopy> mImageRegions;
+    std::vector<MipmapChain> mMipmaps;
+    std::vector<VulkanStage const*> mStages;
+    VkAccessFlags mDstAccess = 0;
+    VkPipelineStageFlags mDstStages = 0;
+    uint32_t mBatchSize = 0;
+
+    std::deque<Batch> mBatches;         // submitted, oldest first
+    std::vector<Batch> mFreeBatches;    // command buffers and fences ready to be reused
+};
+
+} // namespace filament
+} // namespace driver
+
+#endif // TNT_FILAMENT_DRIVER_VULKANUPLOADER_H
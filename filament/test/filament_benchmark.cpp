@@ -16,25 +16,85 @@
 
 #include <filament/Box.h>
 #include <filament/Frustum.h>
+#include <filament/IndexBuffer.h>
+#include <filament/RenderableManager.h>
+#include <filament/VertexBuffer.h>
+
+#include "details/Allocators.h"
+#include "details/Camera.h"
 #include "details/Culler.h"
+#include "details/Engine.h"
+#include "details/Froxelizer.h"
+#include "details/IndexBuffer.h"
+#include "details/Scene.h"
+#include "details/VertexBuffer.h"
+#include "components/RenderableManager.h"
+#include "components/TransformManager.h"
+#include "driver/CommandBufferQueue.h"
+#include "driver/CommandStream.h"
+#include "driver/noop/NoopDriver.h"
+#include "RenderPass.h"
 
+#include <utils/EntityManager.h>
+#include <utils/JobSystem.h>
 #include <utils/Profiler.h>
 #include <utils/compiler.h>
 #include <math/fast.h>
 #include <math/scalar.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <thread>
 #include <vector>
 #include <random>
 
+#include <string.h>
+
 using namespace filament;
 using namespace filament::details;
 using namespace math;
 using namespace utils;
 
+/*
+ * The command line and the JSON output follow Google Benchmark's, so the results can be
+ * compared with its tools (e.g. compare.py):
+ *
+ *  --benchmark_filter=<substring>      only runs the benchmarks whose name contains <substring>
+ *  --benchmark_repetitions=<n>         number of measurements of each benchmark (default 10)
+ *  --benchmark_out=<file>              writes the results to <file> as JSON
+ *
+ * Each repetition runs the benchmark enough times to last about 10ms, the times reported are
+ * per call.
+ */
+
+struct Options {
+    std::string filter;
+    size_t repetitions = 10;
+    std::string out;
+};
+
+struct Result {
+    std::string name;
+    size_t iterations;
+    std::vector<double> realTimes;  // in ns per iteration
+    std::vector<double> cpuTimes;   // in ns per iteration
+};
+
+static Options gOptions;
+static std::vector<Result> gResults;
+
 UTILS_NOINLINE
-void printResults(char const* name, size_t REPEAT, Profiler::Counters const& c) {
+void printResults(std::string const& name, size_t REPEAT, Profiler::Counters const& c,
+        double mean, double median, double stddev) {
     std::cout << name << ":" << std::endl;
+    std::cout << "time:         " << mean << " ns (median " << median << ", stddev " << stddev << ")" << std::endl;
     std::cout << "instructions: " << c.getInstructions() / float(REPEAT) << std::endl;
     std::cout << "cycles:       " << c.getCpuCycles() / float(REPEAT) << std::endl;
     std::cout << "bpu misses:   " << c.getBranchMisses() / float(REPEAT) << " (" << c.getBranchMisses() << "/" << REPEAT << ")" << std::endl;
@@ -42,41 +102,140 @@ void printResults(char const* name, size_t REPEAT, Profiler::Counters const& c)
     std::cout << "" << std::endl;
 }
 
-template <typename T, size_t REPEAT = 2>
-void benchmark(Profiler& p, const char* const name, T f) {
-    Profiler::Counters b;
+static double mean(std::vector<double> const& v) {
+    return std::accumulate(v.begin(), v.end(), 0.0) / v.size();
+}
+
+static double median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    const size_t n = v.size();
+    return n & 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) * 0.5;
+}
+
+static double stddev(std::vector<double> const& v) {
+    if (v.size() < 2) {
+        return 0;
+    }
+    const double m = mean(v);
+    double sum = 0;
+    for (double x : v) {
+        sum += (x - m) * (x - m);
+    }
+    return std::sqrt(sum / (v.size() - 1));
+}
+
+template <typename T>
+void benchmark(Profiler& p, std::string const& name, T f) {
+    using clock = std::chrono::steady_clock;
+    if (name.find(gOptions.filter) == std::string::npos) {
+        return;
+    }
+
+    // warm-up, and find how many iterations last about 10ms
+    auto start = clock::now();
+    f();
+    const double once = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    const size_t REPEAT = size_t(std::min(std::max(10e6 / std::max(once, 1.0), 1.0), 1e6));
+
+    Result result{ name, REPEAT };
     Profiler::Counters c;
     p.start();
-
-#pragma nounroll
-    for (size_t j=0 ; j<2 ; j++) {
-        p.reset();
+    p.reset();
+    for (size_t r = 0; r < gOptions.repetitions; r++) {
+        const std::clock_t cpuStart = std::clock();
+        start = clock::now();
 #pragma nounroll
         for (size_t i = 0; i < REPEAT; i++) {
             f();
         }
+        const double real = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        const double cpu = 1e9 * double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        result.realTimes.push_back(real / REPEAT);
+        result.cpuTimes.push_back(cpu / REPEAT);
     }
-
     p.stop();
     p.readCounters(&c);
-    printResults(name, REPEAT, c);
+
+    printResults(name, REPEAT * gOptions.repetitions, c,
+            mean(result.realTimes), median(result.realTimes), stddev(result.realTimes));
+    gResults.push_back(std::move(result));
 }
 
-// ------------------------------------------------------------------------------------------------
+static void writeJson(std::string const& path, char const* executable) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "couldn't open " << path << std::endl;
+        return;
+    }
 
-int main(void) {
+    char date[64];
+    const std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%FT%T%z", std::localtime(&now));
 
-    std::mt19937 gen;
-    std::uniform_real_distribution<float> rand(-100.0f, 100.0f);
+    out << "{\n";
+    out << "  \"context\": {\n";
+    out << "    \"date\": \"" << date << "\",\n";
+    out << "    \"executable\": \"" << executable << "\",\n";
+    out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+    out << "    \"library_build_type\": \"release\"\n";
+#else
+    out << "    \"library_build_type\": \"debug\"\n";
+#endif
+    out << "  },\n";
+    out << "  \"benchmarks\": [";
 
-    size_t batch = 512;
-    Frustum frustum(mat4f::perspective(45.0f, 1.0f, 0.1f, 100.0f));
+    const char* separator = "\n";
+    auto entry = [&](Result const& result, std::string const& name, char const* runType,
+            char const* aggregate, size_t index, double real, double cpu) {
+        out << separator;
+        separator = ",\n";
+        out << "    {\n";
+        out << "      \"name\": \"" << name << "\",\n";
+        out << "      \"run_name\": \"" << result.name << "\",\n";
+        out << "      \"run_type\": \"" << runType << "\",\n";
+        out << "      \"repetitions\": " << result.realTimes.size() << ",\n";
+        if (aggregate) {
+            out << "      \"aggregate_name\": \"" << aggregate << "\",\n";
+        } else {
+            out << "      \"repetition_index\": " << index << ",\n";
+        }
+        out << "      \"threads\": 1,\n";
+        out << "      \"iterations\": " << result.iterations << ",\n";
+        out << "      \"real_time\": " << real << ",\n";
+        out << "      \"cpu_time\": " << cpu << ",\n";
+        out << "      \"time_unit\": \"ns\"\n";
+        out << "    }";
+    };
+
+    for (Result const& result : gResults) {
+        for (size_t i = 0; i < result.realTimes.size(); i++) {
+            entry(result, result.name, "iteration", nullptr, i,
+                    result.realTimes[i], result.cpuTimes[i]);
+        }
+        entry(result, result.name + "_mean", "aggregate", "mean", 0,
+                mean(result.realTimes), mean(result.cpuTimes));
+        entry(result, result.name + "_median", "aggregate", "median", 0,
+                median(result.realTimes), median(result.cpuTimes));
+        entry(result, result.name + "_stddev", "aggregate", "stddev", 0,
+                stddev(result.realTimes), stddev(result.cpuTimes));
+    }
+    out << "\n  ]\n}\n";
+}
 
+static std::string sized(char const* name, size_t size) {
+    return std::string(name) + "/" + std::to_string(size);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+static void benchmarkCulling(Profiler& p, std::mt19937& gen, size_t batch) {
+    std::uniform_real_distribution<float> rand(-100.0f, 100.0f);
+    Frustum frustum(mat4f::perspective(45.0f, 1.0f, 0.1f, 100.0f));
 
     std::vector<float3> boxesCenter(batch);
     std::vector<float3> boxesExtent(batch);
     std::vector<float4> spheres(batch);
-    std::vector<half4> spheresHalf(batch);
     for (size_t i=0 ; i<batch ; i++) {
         float4& sphere = spheres[i];
         float z = std::fabs(rand(gen));
@@ -96,69 +255,56 @@ int main(void) {
     Culler::result_type * __restrict__ visibles = nullptr;
     posix_memalign((void**)&visibles, 32, batch * sizeof(*visibles));
 
-    Profiler::Counters c;
-    Profiler& p = Profiler::get();
-    p.resetEvents(
-            Profiler::EV_CPU_CYCLES |
-            Profiler::EV_BPU_MISSES
-    );
-
-    benchmark(p, "Box Culling Direct", [&]() {
+    benchmark(p, sized("Culler::intersects boxes", batch), [&]() {
         Culler::Test::intersects(visibles, frustum, boxesCenter.data(), boxesExtent.data(), batch);
     });
 
-    size_t vb = 0;
-    for (size_t i = 0; i < batch; i++) {
-        vb = vb + (visibles[i] ? 1 : 0);
-    }
-
-    benchmark(p, "Sphere Culling Direct", [&]() {
+    benchmark(p, sized("Culler::intersects spheres", batch), [&]() {
         Culler::Test::intersects(visibles, frustum, spheres.data(), batch);
     });
 
-    size_t vs = 0;
-    for (size_t i = 0; i < batch; i++) {
-        vs = vs + (visibles[i] ? 1 : 0);
-    }
-
-    std::cout << "visible boxes: " << vb << std::endl;
-    std::cout << "visible spheres: " << vs << std::endl;
-    std::cout << std::endl;
-
     free(visibles);
+}
 
+static void benchmarkMath(Profiler& p, std::mt19937& gen, size_t batch) {
+    std::uniform_real_distribution<float> rand(0.1f, 100.0f);
+    std::vector<float4> spheres(batch);
+    std::vector<half4> spheresHalf(batch);
+    for (size_t i = 0; i < batch; i++) {
+        spheres[i] = float4{ rand(gen), rand(gen), rand(gen), rand(gen) };
+    }
 
-    benchmark(p, "cos", [&]() {
+    benchmark(p, sized("cos", batch), [&]() {
         for (size_t i = 0; i < batch; i++) {
             spheres[i].x = std::cos(spheres[i].x);
         }
     });
 
-    benchmark(p, "fast::cos", [&]() {
+    benchmark(p, sized("fast::cos", batch), [&]() {
         for (size_t i = 0; i < batch; i++) {
             spheres[i].x = math::fast::cos<float>(spheres[i].x);
         }
     });
-    
-    benchmark(p, "rsqrt", [&]() {
+
+    benchmark(p, sized("rsqrt", batch), [&]() {
         for (size_t i = 0; i < batch; i++) {
-            spheres[i].x = 1.0f / std::sqrt(spheres[i].x);
+            spheres[i].y = 1.0f / std::sqrt(spheres[i].y);
         }
     });
 
-    benchmark(p, "fast::rsqrt", [&]() {
+    benchmark(p, sized("fast::rsqrt", batch), [&]() {
         for (size_t i = 0; i < batch; i++) {
-            spheres[i].x = math::fast::isqrt(spheres[i].x);
+            spheres[i].z = math::fast::isqrt(spheres[i].z);
         }
     });
 
-    benchmark(p, "half4", [&]() {
+    benchmark(p, sized("half4", batch), [&]() {
         for (size_t i = 0; i < batch; i++) {
             spheresHalf[i] = half4(spheres[i]);
         }
     });
 
-    benchmark(p, "half x 4", [&]() {
+    benchmark(p, sized("half x 4", batch), [&]() {
         for (size_t i = 0; i < batch; i++) {
             spheresHalf[i] = half4(
                     spheres[i].x,
@@ -168,6 +314,344 @@ int main(void) {
             );
         }
     });
+}
+
+static void benchmarkSort(Profiler& p, std::mt19937& gen, JobSystem& js, size_t count) {
+    using Command = RenderPass::Command;
+
+    LinearAllocatorArena arena("benchmark", 2 * FEngine::CONFIG_PER_FRAME_COMMANDS_SIZE);
+    filament::details::ArenaScope scope(arena);
+
+    // color commands (without depth prepass)
+    std::uniform_int_distribution<uint32_t> material(0, 63);
+    std::uniform_int_distribution<uint32_t> zbucket(0, 1023);
+    std::vector<Command> source(count);
+    for (size_t i = 0; i < count - 1; i++) {
+        source[i].key = uint64_t(RenderPass::Pass::COLOR) |
+                RenderPass::makeField(zbucket(gen), RenderPass::Z_BUCKET_MASK, RenderPass::Z_BUCKET_SHIFT) |
+                RenderPass::makeMaterialSortingKey(material(gen), material(gen));
+    }
+    source[count - 1].key = uint64_t(RenderPass::Pass::SENTINEL);
+    std::vector<Command> commands(count);
+
+    benchmark(p, sized("std::sort commands", count), [&]() {
+        std::copy(source.begin(), source.end(), commands.begin());
+        std::sort(commands.begin(), commands.end());
+    });
+
+    benchmark(p, sized("RenderPass::sortCommands", count), [&]() {
+        std::copy(source.begin(), source.end(), commands.begin());
+        RenderPass::sortCommands(js, scope, { commands.data(), uint32_t(commands.size()) });
+    });
+}
+
+static void benchmarkTransforms(Profiler& p, JobSystem& js, size_t count) {
+    FTransformManager tcm;
+    tcm.setJobSystem(&js);
+    EntityManager& em = EntityManager::get();
+
+    // chains of 8 nodes
+    constexpr size_t DEPTH = 8;
+    std::vector<Entity> entities(count);
+    em.create(entities.size(), entities.data());
+    tcm.openLocalTransformTransaction();
+    for (size_t i = 0; i < count; i++) {
+        TransformManager::Instance parent = i % DEPTH ? tcm.getInstance(entities[i - 1]) :
+                TransformManager::Instance{};
+        tcm.create(entities[i], parent, mat4f::translate(float4{ 1, 0, 0, 1 }));
+    }
+    tcm.commitLocalTransformTransaction();
+
+    // every node is modified, so the whole hierarchy is committed
+    float x = 0;
+    benchmark(p, sized("FTransformManager::commitLocalTransformTransaction", count), [&]() {
+        x += 1.0f;
+        tcm.openLocalTransformTransaction();
+        for (Entity e : entities) {
+            tcm.setTransform(tcm.getInstance(e), mat4f::translate(float4{ x, 0, 0, 1 }));
+        }
+        tcm.commitLocalTransformTransaction();
+    });
+
+    for (Entity e : entities) {
+        tcm.destroy(e);
+    }
+    em.destroy(entities.size(), entities.data());
+}
+
+static void benchmarkIdleSpinning(Profiler& p, JobSystem& js, uint32_t spinTime) {
+    // bursts of small jobs separated by short idle periods, like culling a couple thousand
+    // objects, the workers either still spin or already sleep when the next burst comes.
+    std::vector<uint32_t> data(2048);
+    js.setIdleSpinTime(spinTime);
+    benchmark(p, sized("JobSystem::runAndWait burst, idle spin (us)", spinTime), [&]() {
+        auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(data.size()),
+                [&data](uint32_t start, uint32_t count) {
+                    for (uint32_t i = start; i < start + count; i++) {
+                        data[i]++;
+                    }
+                }, jobs::CountSplitter<64>());
+        js.runAndWait(job);
+        // some other work on this thread, shorter than the spin time
+        const auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < std::chrono::microseconds(10)) {
+        }
+    });
+}
+
+static void benchmarkCommandStream(Profiler& p, size_t count) {
+    std::unique_ptr<Driver> driver(NoopDriver::create());
+    CommandBufferQueue queue(FEngine::CONFIG_MIN_COMMAND_BUFFERS_SIZE,
+            FEngine::CONFIG_COMMAND_BUFFERS_SIZE);
+    CommandStream stream(*driver, queue.getCircularBuffer());
+    Handle<HwRenderPrimitive> rph(1);
+
+    benchmark(p, sized("CommandStream encode", count), [&]() {
+        for (size_t i = 0; i < count; i++) {
+            stream.setRenderPrimitiveRange(rph, driver::PrimitiveType::TRIANGLES, uint32_t(i), 0, 3, 3);
+        }
+        // the commands are discarded
+        queue.flush();
+        for (auto const& item : queue.waitForCommands()) {
+            queue.releaseBuffer(item);
+        }
+    });
+
+    benchmark(p, sized("CommandStream encode+execute", count), [&]() {
+        for (size_t i = 0; i < count; i++) {
+            stream.setRenderPrimitiveRange(rph, driver::PrimitiveType::TRIANGLES, uint32_t(i), 0, 3, 3);
+        }
+        queue.flush();
+        for (auto const& item : queue.waitForCommands()) {
+            if (item.begin) {
+                stream.execute(item.begin);
+            }
+            queue.releaseBuffer(item);
+        }
+    });
+}
+
+// These need an Engine, for the renderables' primitives and the lights
+static void benchmarkScene(Profiler& p, std::mt19937& gen, FEngine& engine, size_t count) {
+    using Command = RenderPass::Command;
+
+    std::uniform_real_distribution<float> rand(-100.0f, 100.0f);
+    EntityManager& em = engine.getEntityManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    FRenderableManager& rcm = engine.getRenderableManager();
+    JobSystem& js = engine.getJobSystem();
+
+    VertexBuffer* vb = VertexBuffer::Builder()
+            .vertexCount(3)
+            .bufferCount(1)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+            .build(engine);
+    IndexBuffer* ib = IndexBuffer::Builder()
+            .indexCount(3)
+            .bufferType(IndexBuffer::IndexType::USHORT)
+            .build(engine);
+
+    FScene* scene = engine.createScene();
+    std::vector<Entity> entities(count);
+    em.create(entities.size(), entities.data());
+    for (Entity e : entities) {
+        const float3 position{ rand(gen), rand(gen), rand(gen) };
+        tcm.create(e, {}, mat4f::translate(float4{ position, 1 }));
+        RenderableManager::Builder(1)
+                .boundingBox({ {}, { 1, 1, 1 } })
+                .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vb, ib)
+                .build(engine, e);
+        scene->addEntity(e);
+    }
+
+    benchmark(p, sized("FScene::prepare", count), [&]() {
+        scene->prepare(mat4f{});
+    });
+
+    { // everything is visible
+        FScene::RenderableSoa& soa = scene->getRenderableData();
+        for (size_t i = 0, c = soa.size(); i < c; i++) {
+            soa.elementAt<FScene::VISIBLE_MASK>(i) = 1;
+            soa.elementAt<FScene::PRIMITIVES>(i) =
+                    rcm.getRenderPrimitives(soa.elementAt<FScene::RENDERABLE_INSTANCE>(i));
+        }
+
+        LinearAllocatorArena arena("benchmark", 2 * FEngine::CONFIG_PER_FRAME_COMMANDS_SIZE);
+        filament::details::ArenaScope scope(arena);
+        const size_t capacity = FEngine::CONFIG_PER_FRAME_COMMANDS_SIZE / sizeof(Command);
+        Command* const storage = scope.allocate<Command>(capacity, CACHELINE_SIZE);
+        const RenderPass::RenderFlags renderFlags =
+                RenderPass::RenderFlags(1u << RenderPass::VISIBLE_MASK_SHIFT);
+
+        benchmark(p, sized("RenderPass::generateSortedCommands", count), [&]() {
+            GrowingSlice<Command> commands(storage, capacity);
+            RenderPass::generateSortedCommands(js, scope, soa, { 0, uint32_t(soa.size()) },
+                    RenderPass::CommandTypeFlags::DEPTH_AND_COLOR, renderFlags,
+                    {}, { 0, 0, -1 }, commands);
+        });
+    }
+
+    { // lights in front of the camera
+        std::vector<Entity> lights(count);
+        em.create(lights.size(), lights.data());
+
+        FScene::LightSoa lightData;
+        lightData.push_back({}, {}, {}, {}, {}, {}, {});    // first one is always skipped
+        for (Entity e : lights) {
+            LightManager::Builder(LightManager::Type::POINT).falloff(5).build(engine, e);
+            const FLightManager::Instance instance = engine.getLightManager().getInstance(e);
+            const float z = -std::abs(rand(gen));
+            lightData.push_back(float4{ rand(gen) * 0.5f, rand(gen) * 0.5f, z, 5 },
+                    {}, instance, 1, {}, {}, {});
+        }
+
+        LinearAllocatorArena arena("benchmark", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+        filament::details::ArenaScope scope(arena);
+        const mat4f projection = mat4f::perspective(90, 1.0f, 0.1, 100, mat4f::Fov::HORIZONTAL);
+        Froxelizer froxelizer(engine);
+        froxelizer.prepare(engine.getDriverApi(), scope, Viewport(0, 0, 1280, 720),
+                projection, 0.1f, 100.0f);
+
+        benchmark(p, sized("Froxelizer::froxelizeLights", count), [&]() {
+            froxelizer.froxelizeLights(engine, {}, lightData);
+        });
+
+        froxelizer.terminate(engine.getDriverApi());
+        for (Entity e : lights) {
+            engine.getLightManager().destroy(e);
+        }
+        em.destroy(lights.size(), lights.data());
+    }
+
+    for (Entity e : entities) {
+        rcm.destroy(e);
+        tcm.destroy(e);
+    }
+    em.destroy(entities.size(), entities.data());
+    engine.destroy(scene);
+    engine.destroy(upcast(vb));
+    engine.destroy(upcast(ib));
+}
+
+// Compares testing the froxel planes 4 at a time and one at a time, with the lights in front of
+// the camera, half of them spot lights.
+static void benchmarkFroxelizer(Profiler& p, std::mt19937& gen, FEngine& engine, size_t count) {
+    std::uniform_real_distribution<float> rand(-50.0f, 50.0f);
+    EntityManager& em = engine.getEntityManager();
+    FLightManager& lcm = engine.getLightManager();
+
+    std::vector<Entity> lights(count);
+    em.create(lights.size(), lights.data());
+
+    FScene::LightSoa lightData;
+    lightData.push_back({}, {}, {}, {}, {}, {}, {});    // first one is always skipped
+    for (size_t i = 0; i < count; i++) {
+        const bool spot = i & 1;
+        LightManager::Builder(spot ? LightManager::Type::SPOT : LightManager::Type::POINT)
+                .falloff(5)
+                .spotLightCone(float(M_PI_4), float(M_PI_4))
+                .build(engine, lights[i]);
+        // cos(outer)^2 and 1/sin(outer), or the values of a point light
+        const float2 cone = spot ? float2{ 0.5f, float(M_SQRT2) } :
+                float2{ 1, std::numeric_limits<float>::infinity() };
+        const float z = -std::abs(rand(gen));
+        lightData.push_back(float4{ rand(gen) * 0.5f, rand(gen) * 0.5f, z, 5 },
+                float3{ 0, 0, -1 }, lcm.getInstance(lights[i]), 1, {}, {}, cone);
+    }
+
+    LinearAllocatorArena arena("benchmark", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    filament::details::ArenaScope scope(arena);
+    const mat4f projection = mat4f::perspective(90, 1.0f, 0.1, 100, mat4f::Fov::HORIZONTAL);
+    Froxelizer froxelizer(engine);
+    froxelizer.prepare(engine.getDriverApi(), scope, Viewport(0, 0, 1280, 720),
+            projection, 0.1f, 100.0f);
+
+    // the camera moves at each call, so that all the lights are froxelized again
+    CameraInfo cameras[2] = {};
+    cameras[1].view = mat4f::translate(float4{ 0, 0, 1e-3f, 1 });
+    size_t frame = 0;
+
+    for (bool vectorized : { false, true }) {
+        froxelizer.setVectorizedPlaneTests(vectorized);
+        benchmark(p, sized(vectorized ? "Froxelizer::froxelizeLights SIMD" :
+                "Froxelizer::froxelizeLights scalar", count), [&]() {
+            froxelizer.froxelizeLights(engine, cameras[frame++ & 1], lightData);
+        });
+    }
+
+    froxelizer.terminate(engine.getDriverApi());
+    for (Entity e : lights) {
+        lcm.destroy(e);
+    }
+    em.destroy(lights.size(), lights.data());
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (!strncmp(arg, "--benchmark_filter=", 19)) {
+            gOptions.filter = arg + 19;
+        } else if (!strncmp(arg, "--benchmark_repetitions=", 24)) {
+            gOptions.repetitions = std::max(1, atoi(arg + 24));
+        } else if (!strncmp(arg, "--benchmark_out=", 16)) {
+            gOptions.out = arg + 16;
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--benchmark_filter=<substring>]"
+                    " [--benchmark_repetitions=<n>] [--benchmark_out=<file>]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::mt19937 gen;
+
+    Profiler& p = Profiler::get();
+    p.resetEvents(
+            Profiler::EV_CPU_CYCLES |
+            Profiler::EV_BPU_MISSES
+    );
+
+    for (size_t size : { 512, 4096, 32768 }) {
+        benchmarkCulling(p, gen, size);
+    }
+
+    benchmarkMath(p, gen, 512);
+
+    {
+        JobSystem js;
+        js.adopt();
+        for (size_t size : { 1024, 16384, 131072 }) {
+            benchmarkSort(p, gen, js, size);
+        }
+        for (size_t size : { 512, 4096, 32768 }) {
+            benchmarkTransforms(p, js, size);
+        }
+        for (uint32_t spinTime : { 0u, 30u }) {
+            benchmarkIdleSpinning(p, js, spinTime);
+        }
+        js.emancipate();
+    }
+
+    for (size_t size : { 512, 4096, 16384 }) {
+        benchmarkCommandStream(p, size);
+    }
+
+    FEngine* engine = FEngine::create();
+    if (engine) {
+        for (size_t size : { 512, 4096, 16384 }) {
+            benchmarkScene(p, gen, *engine, size);
+        }
+        for (size_t count : { 64, 128, 255 }) {
+            benchmarkFroxelizer(p, gen, *engine, count);
+        }
+        engine->shutdown();
+        delete engine;
+    } else {
+        std::cerr << "couldn't create an Engine, skipping the scene benchmarks" << std::endl;
+    }
+
+    if (!gOptions.out.empty()) {
+        writeJson(gOptions.out, argv[0]);
+    }
 
     return 0;
 }
@@ -177,4 +661,4 @@ int main(void) {
 // Running benchmarks on Android
 //
 // make -j4 && adb push filament/filament/test/benchmark_filament /data/local/tmp
-// adb shell /data/local/tmp/filament_benchmark
+// adb shell /data/local/tmp/filament_benchmark --benchmark_out=/data/local/tmp/filament_benchmark.json
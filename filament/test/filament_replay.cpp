@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a capture made with CAPTURE_COMMAND_STREAM (see CommandStream.h) on a backend, without
+ * an Engine, and prints the time spent in each frame. The swap chains are headless.
+ */
+
+#include <filament/driver/ExternalContext.h>
+
+#include "driver/CommandStreamCapture.h"
+#include "driver/Driver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace filament;
+using namespace filament::driver;
+
+int main(int argc, char** argv) {
+    Backend backend = Backend::DEFAULT;
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (!strcmp(arg, "--backend=noop")) {
+            backend = Backend::NOOP;
+        } else if (!strcmp(arg, "--backend=opengl")) {
+            backend = Backend::OPENGL;
+        } else if (!strcmp(arg, "--backend=vulkan")) {
+            backend = Backend::VULKAN;
+        } else if (!strncmp(arg, "--width=", 8)) {
+            width = uint32_t(std::max(1, atoi(arg + 8)));
+        } else if (!strncmp(arg, "--height=", 9)) {
+            height = uint32_t(std::max(1, atoi(arg + 9)));
+        } else if (arg[0] != '-' && !path) {
+            path = arg;
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (!path) {
+        std::cerr << "usage: " << argv[0] << " [--backend=noop|opengl|vulkan]"
+                " [--width=<pixels>] [--height=<pixels>] <capture.fcap>" << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<ExternalContext> context(ExternalContext::create(&backend));
+    std::unique_ptr<Driver> driver(context ? context->createDriver(nullptr) : nullptr);
+    if (!driver) {
+        std::cerr << "Couldn't create the driver" << std::endl;
+        return 1;
+    }
+
+    std::vector<double> times;
+    {
+        CommandStreamReplay replay(*driver, nullptr, width, height);
+        if (!replay.open(path)) {
+            return 1;
+        }
+        while (true) {
+            auto start = std::chrono::steady_clock::now();
+            if (!replay.replayFrame()) {
+                break;
+            }
+            std::chrono::duration<double, std::milli> duration =
+                    std::chrono::steady_clock::now() - start;
+            times.push_back(duration.count());
+        }
+    }
+    driver->terminate();
+
+    for (size_t i = 0; i < times.size(); i++) {
+        std::cout << "frame " << i << ": " << times[i] << " ms" << std::endl;
+    }
+    if (!times.empty()) {
+        std::sort(times.begin(), times.end());
+        std::cout << times.size() << " frames, median " << times[times.size() / 2]
+                << " ms, max " << times.back() << " ms" << std::endl;
+    }
+    return 0;
+}
@@ -14,7 +14,10 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <iostream>
+#include <random>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -25,17 +28,39 @@
 #include <filament/Camera.h>
 #include <filament/Color.h>
 #include <filament/Frustum.h>
+#include <filament/IndexBuffer.h>
 #include <filament/Material.h>
+#include <filament/MaterialInstance.h>
 #include <filament/Engine.h>
+#include <filament/RenderableManager.h>
+#include <filament/Renderer.h>
+#include <filament/Scene.h>
+#include <filament/VertexBuffer.h>
+#include <filament/View.h>
 
+#include <filamat/MaterialBuilder.h>
+
+#include "driver/CommandStreamCapture.h"
+#include "driver/HandleTable.h"
 #include "driver/UniformBuffer.h"
+#include "driver/noop/NoopDriver.h"
 #include <filament/UniformInterfaceBlock.h>
 
 #include "details/Allocators.h"
+#include "details/BVH.h"
+#include "details/Culler.h"
 #include "details/Material.h"
 #include "details/Camera.h"
 #include "details/Froxelizer.h"
+#include "details/OcclusionCuller.h"
+#include "details/ReflectionProbes.h"
+#include "details/Texture.h"
+#include "details/VertexBuffer.h"
+#include "FrameGraph.h"
+#include "FrameInfo.h"
+#include "RenderPass.h"
 #include "details/Engine.h"
+#include "components/RenderableManager.h"
 #include "components/TransformManager.h"
 #include "utils/RangeSet.h"
 
@@ -59,6 +84,11 @@ static bool vec3eq(math::float3 a, math::float3 b) {
             almostEqualUlps(a.z, b.z, 1);
 }
 
+// transforms are stored as affine transforms, so their last row is always (0, 0, 0, 1)
+static mat4f affineScale(float s) {
+    return mat4f{ float4{ s, s, s, 1 }};
+}
+
 TEST(FilamentTest, TransformManager) {
     filament::details::FTransformManager tcm;
     EntityManager& em = EntityManager::get();
@@ -78,36 +108,36 @@ TEST(FilamentTest, TransformManager) {
     EXPECT_TRUE(bool(child));
 
     // test default values
-    EXPECT_EQ(tcm.getTransform(parent), mat4f{ float4{ 1 }});
-    EXPECT_EQ(tcm.getWorldTransform(parent), mat4f{ float4{ 1 }});
-    EXPECT_EQ(tcm.getTransform(child), mat4f{ float4{ 1 }});
-    EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 1 }});
+    EXPECT_EQ(tcm.getTransform(parent), affineScale(1));
+    EXPECT_EQ(tcm.getWorldTransform(parent), affineScale(1));
+    EXPECT_EQ(tcm.getTransform(child), affineScale(1));
+    EXPECT_EQ(tcm.getWorldTransform(child), affineScale(1));
 
     // test setting a transform
-    tcm.setTransform(parent, mat4f{ float4{ 2 }});
+    tcm.setTransform(parent, affineScale(2));
 
     // test local and world transform propagation
-    EXPECT_EQ(tcm.getTransform(parent), mat4f{ float4{ 2 }});
-    EXPECT_EQ(tcm.getWorldTransform(parent), mat4f{ float4{ 2 }});
-    EXPECT_EQ(tcm.getTransform(child), mat4f{ float4{ 1 }});
-    EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 2 }});
+    EXPECT_EQ(tcm.getTransform(parent), affineScale(2));
+    EXPECT_EQ(tcm.getWorldTransform(parent), affineScale(2));
+    EXPECT_EQ(tcm.getTransform(child), affineScale(1));
+    EXPECT_EQ(tcm.getWorldTransform(child), affineScale(2));
 
     // test local transaction
     tcm.openLocalTransformTransaction();
-    tcm.setTransform(parent, mat4f{ float4{ 4 }});
+    tcm.setTransform(parent, affineScale(4));
 
     // check the transfroms ARE NOT propagated
-    EXPECT_EQ(tcm.getTransform(parent), mat4f{ float4{ 4 }});
-    EXPECT_EQ(tcm.getWorldTransform(parent), mat4f{ float4{ 2 }});
-    EXPECT_EQ(tcm.getTransform(child), mat4f{ float4{ 1 }});
-    EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 2 }});
+    EXPECT_EQ(tcm.getTransform(parent), affineScale(4));
+    EXPECT_EQ(tcm.getWorldTransform(parent), affineScale(2));
+    EXPECT_EQ(tcm.getTransform(child), affineScale(1));
+    EXPECT_EQ(tcm.getWorldTransform(child), affineScale(2));
 
     tcm.commitLocalTransformTransaction();
     // test propagation after closing the transaction
-    EXPECT_EQ(tcm.getTransform(parent), mat4f{ float4{ 4 }});
-    EXPECT_EQ(tcm.getWorldTransform(parent), mat4f{ float4{ 4 }});
-    EXPECT_EQ(tcm.getTransform(child), mat4f{ float4{ 1 }});
-    EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 4 }});
+    EXPECT_EQ(tcm.getTransform(parent), affineScale(4));
+    EXPECT_EQ(tcm.getWorldTransform(parent), affineScale(4));
+    EXPECT_EQ(tcm.getTransform(child), affineScale(1));
+    EXPECT_EQ(tcm.getWorldTransform(child), affineScale(4));
 
     //
     // test out-of-order parent/child
@@ -126,7 +156,7 @@ TEST(FilamentTest, TransformManager) {
 
     // local transaction reprders parent/child
     tcm.openLocalTransformTransaction();
-    tcm.setTransform(newParent, mat4f{ float4{ 8 }});
+    tcm.setTransform(newParent, affineScale(8));
     tcm.commitLocalTransformTransaction();
 
     // local transaction invalidates Instances
@@ -138,10 +168,120 @@ TEST(FilamentTest, TransformManager) {
     EXPECT_GT(child, newParent);
 
     // check transform propagation
-    EXPECT_EQ(tcm.getTransform(newParent), mat4f{ float4{ 8 }});
-    EXPECT_EQ(tcm.getWorldTransform(newParent), mat4f{ float4{ 8 }});
-    EXPECT_EQ(tcm.getTransform(child), mat4f{ float4{ 1 }});
-    EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 8 }});
+    EXPECT_EQ(tcm.getTransform(newParent), affineScale(8));
+    EXPECT_EQ(tcm.getWorldTransform(newParent), affineScale(8));
+    EXPECT_EQ(tcm.getTransform(child), affineScale(1));
+    EXPECT_EQ(tcm.getWorldTransform(child), affineScale(8));
+}
+
+TEST(FilamentTest, TransformManagerParallelCommit) {
+    JobSystem js;
+    js.adopt();
+
+    filament::details::FTransformManager tcm;
+    tcm.setJobSystem(&js);
+    EntityManager& em = EntityManager::get();
+
+    // 300 chains of 8 nodes, enough for each level to be committed in parallel
+    constexpr size_t CHAINS = 300;
+    constexpr size_t DEPTH = 8;
+    std::vector<Entity> entities(CHAINS * DEPTH);
+    em.create(entities.size(), entities.data());
+
+    tcm.openLocalTransformTransaction();
+    for (size_t c = 0; c < CHAINS; c++) {
+        TransformManager::Instance parent = {};
+        for (size_t d = 0; d < DEPTH; d++) {
+            Entity e = entities[c * DEPTH + d];
+            const float x = d ? 1.0f : float(c);
+            tcm.create(e, parent, mat4f::translate(float4{ x, 0, 0, 1 }));
+            parent = tcm.getInstance(e);
+        }
+    }
+    tcm.commitLocalTransformTransaction();
+
+    for (size_t c = 0; c < CHAINS; c++) {
+        for (size_t d = 0; d < DEPTH; d++) {
+            TransformManager::Instance i = tcm.getInstance(entities[c * DEPTH + d]);
+            EXPECT_EQ(float(c + d), tcm.getWorldTransform(i)[3].x);
+        }
+    }
+
+    // only the subtree of the modified node is updated
+    const uint32_t version = tcm.getVersion();
+    tcm.openLocalTransformTransaction();
+    tcm.setTransform(tcm.getInstance(entities[DEPTH + 3]), mat4f::translate(float4{ 3, 0, 0, 1 }));
+    tcm.commitLocalTransformTransaction();
+    for (size_t c = 0; c < CHAINS; c++) {
+        for (size_t d = 0; d < DEPTH; d++) {
+            TransformManager::Instance i = tcm.getInstance(entities[c * DEPTH + d]);
+            const bool dirty = c == 1 && d >= 3;
+            EXPECT_EQ(float(c + d + (dirty ? 2 : 0)), tcm.getWorldTransform(i)[3].x);
+            EXPECT_EQ(dirty, tcm.getVersion(i) > version);
+        }
+    }
+
+    for (Entity e : entities) {
+        tcm.destroy(e);
+    }
+    em.destroy(entities.size(), entities.data());
+    js.emancipate();
+}
+
+TEST(FilamentTest, TransformManagerLazyUpdates) {
+    filament::details::FTransformManager tcm;
+    tcm.setLazyUpdatesEnabled(true);
+    EXPECT_TRUE(tcm.isLazyUpdatesEnabled());
+    EntityManager& em = EntityManager::get();
+
+    // a chain of 4 nodes, each translating by 1
+    constexpr size_t DEPTH = 4;
+    Entity entities[DEPTH];
+    em.create(DEPTH, entities);
+    TransformManager::Instance parent = {};
+    for (Entity e : entities) {
+        tcm.create(e, parent, mat4f::translate(float4{ 1, 0, 0, 1 }));
+        parent = tcm.getInstance(e);
+    }
+
+    // all nodes are resolved in a single pass, when first read
+    const uint32_t version = tcm.getVersion();
+    EXPECT_EQ(float(DEPTH), tcm.getWorldTransform(tcm.getInstance(entities[DEPTH - 1]))[3].x);
+    EXPECT_EQ(version + 1, tcm.getVersion());
+
+    // setting the same subtree many times only updates it once
+    for (size_t k = 0; k < 10; k++) {
+        tcm.setTransform(tcm.getInstance(entities[1]), mat4f::translate(float4{ 2, 0, 0, 1 }));
+    }
+    EXPECT_EQ(version + 1, tcm.getVersion());
+    tcm.resolvePendingTransforms();
+    EXPECT_EQ(version + 2, tcm.getVersion());
+    for (size_t d = 0; d < DEPTH; d++) {
+        TransformManager::Instance i = tcm.getInstance(entities[d]);
+        EXPECT_EQ(float(d + (d ? 2 : 1)), tcm.getWorldTransform(i)[3].x);
+        EXPECT_EQ(d ? version + 2 : version + 1, tcm.getVersion(i));
+    }
+
+    // re-parenting to a node created later reorders the nodes when resolving
+    Entity root = em.create();
+    tcm.create(root, {}, mat4f::translate(float4{ 10, 0, 0, 1 }));
+    tcm.setParent(tcm.getInstance(entities[0]), tcm.getInstance(root));
+    EXPECT_EQ(float(DEPTH + 11), tcm.getWorldTransform(tcm.getInstance(entities[DEPTH - 1]))[3].x);
+
+    // disabling lazy updates resolves the pending transforms
+    tcm.setTransform(tcm.getInstance(root), mat4f{});
+    tcm.setLazyUpdatesEnabled(false);
+    // note: the slice starts at the first instance
+    auto worldTransforms = tcm.getWorldTransforms();
+    TransformManager::Instance leaf = tcm.getInstance(entities[DEPTH - 1]);
+    EXPECT_EQ(float(DEPTH + 1), worldTransforms[leaf - 1][3].x);
+
+    for (Entity e : entities) {
+        tcm.destroy(e);
+    }
+    tcm.destroy(root);
+    em.destroy(DEPTH, entities);
+    em.destroy(root);
 }
 
 TEST(FilamentTest, UniformInterfaceBlock) {
@@ -211,6 +351,42 @@ TEST(FilamentTest, UniformInterfaceBlock) {
     EXPECT_EQ(3, info[14].size);
 }
 
+TEST(FilamentTest, PerInstanceUniformInterfaceBlock) {
+    using filament::details::FEngine;
+
+    // instanced draws copy the per-renderable uniforms, so the layouts must match FEngine's
+    UniformInterfaceBlock const& uib = FEngine::PerInstanceUib::getUib();
+    EXPECT_EQ(sizeof(FEngine::PerInstanceUib), uib.getSize());
+    EXPECT_EQ(ssize_t(offsetof(FEngine::PerInstanceUib, worldFromModelMatrix)),
+            uib.getUniformOffset("worldFromModelMatrix", 0));
+    EXPECT_EQ(ssize_t(offsetof(FEngine::PerInstanceUib, worldFromModelMatrix) + sizeof(mat4f)),
+            uib.getUniformOffset("worldFromModelMatrix", 1));
+    EXPECT_EQ(ssize_t(offsetof(FEngine::PerInstanceUib, worldFromModelNormalMatrix)),
+            uib.getUniformOffset("worldFromModelNormalMatrix", 0));
+    EXPECT_EQ(ssize_t(offsetof(FEngine::PerInstanceUib, worldFromModelNormalMatrix) + 3 * sizeof(float4)),
+            uib.getUniformOffset("worldFromModelNormalMatrix", 1));
+}
+
+TEST(FilamentTest, PerRenderableUniformInterfaceBlock) {
+    using filament::details::FEngine;
+
+    // the uniforms are written with offsetof(), so the layouts must match FEngine's
+    UniformInterfaceBlock const& uib = FEngine::PerRenderableUib::getUib();
+    EXPECT_EQ(sizeof(FEngine::PerRenderableUib), uib.getSize());
+    EXPECT_EQ(ssize_t(offsetof(FEngine::PerRenderableUib, worldFromModelNormalMatrix)),
+            uib.getUniformOffset("worldFromModelNormalMatrix", 0));
+    EXPECT_EQ(ssize_t(offsetof(FEngine::PerRenderableUib, skinningDualQuaternion)),
+            uib.getUniformOffset("skinningDualQuaternion", 0));
+    EXPECT_EQ(ssize_t(offsetof(FEngine::PerRenderableUib, morphTargetCount)),
+            uib.getUniformOffset("morphTargetCount", 0));
+    EXPECT_EQ(ssize_t(offsetof(FEngine::PerRenderableUib, reflectionProbe)),
+            uib.getUniformOffset("reflectionProbe", 0));
+    EXPECT_EQ(ssize_t(offsetof(FEngine::PerRenderableUib, morphWeights)),
+            uib.getUniformOffset("morphWeights", 0));
+    EXPECT_EQ(ssize_t(offsetof(FEngine::PerRenderableUib, morphWeights) + sizeof(float4)),
+            uib.getUniformOffset("morphWeights", 1));
+}
+
 TEST(FilamentTest, UniformBuffer) {
 
     struct ubo {
@@ -328,6 +504,41 @@ TEST(FilamentTest, UniformBuffer) {
     //buffer.log(std::cout, ib);
 }
 
+TEST(FilamentTest, UniformBufferDirtyRange) {
+    UniformBuffer buffer(256);
+    EXPECT_TRUE(buffer.isDirty());
+    EXPECT_EQ(0, buffer.getDirtyOffset());
+    EXPECT_EQ(256, buffer.getDirtySize());
+
+    buffer.clean();
+    EXPECT_FALSE(buffer.isDirty());
+    EXPECT_EQ(0, buffer.copyDirtyRange().getSize());
+
+    // the modifications are merged in a single range
+    buffer.setUniform(64, 1.0f);
+    EXPECT_EQ(64, buffer.getDirtyOffset());
+    EXPECT_EQ(sizeof(float), buffer.getDirtySize());
+    buffer.setUniform(128, float4{ 2, 3, 4, 5 });
+    buffer.setUniform(96, 6.0f);
+    EXPECT_EQ(64, buffer.getDirtyOffset());
+    EXPECT_EQ(128 + sizeof(float4) - 64, buffer.getDirtySize());
+
+    // the copy only holds the modified range, at the same offset in the driver's buffer
+    UniformBuffer copy(buffer.copyDirtyRange());
+    EXPECT_EQ(64, copy.getOffset());
+    EXPECT_EQ(128 + sizeof(float4) - 64, copy.getSize());
+    EXPECT_TRUE(copy.isDirty());
+    EXPECT_EQ(0, copy.getDirtyOffset());
+    EXPECT_EQ(copy.getSize(), copy.getDirtySize());
+    EXPECT_EQ(1.0f, copy.getUniform<float>(0));
+    EXPECT_EQ(6.0f, copy.getUniform<float>(96 - 64));
+    EXPECT_EQ((float4{ 2, 3, 4, 5 }), copy.getUniform<float4>(128 - 64));
+
+    UniformBuffer moved(std::move(copy));
+    EXPECT_EQ(64, moved.getOffset());
+    EXPECT_EQ(moved.getSize(), moved.getDirtySize());
+}
+
 TEST(FilamentTest, BoxCulling) {
     Frustum frustum(mat4f::frustum(-1, 1, -1, 1, 1, 100));
 
@@ -408,6 +619,179 @@ TEST(FilamentTest, SphereCulling) {
     EXPECT_TRUE(frustum.intersects({ 0, 200 }));
 }
 
+TEST(FilamentTest, BVHCulling) {
+    using namespace filament::details;
+
+    Frustum frustum(mat4f::perspective(60, 1, 1, 100));
+
+    // a grid of boxes, partially visible
+    std::vector<float3> center;
+    std::vector<float3> extent;
+    for (int z = 0; z < 32; z++) {
+        for (int y = -16; y < 16; y++) {
+            for (int x = -16; x < 16; x++) {
+                center.push_back({ x * 4, y * 4, -z * 4 });
+                extent.push_back({ 0.5f + (x & 1), 0.5f, 0.5f + (z & 1) });
+            }
+        }
+    }
+    const size_t count = center.size();
+    ASSERT_GE(count, 2 * BVH::JOB_SIZE);
+
+    JobSystem js;
+    js.adopt();
+
+    auto check = [&](BVH const& bvh) {
+        std::vector<Culler::result_type> expected(Culler::round(count));
+        std::vector<Culler::result_type> results(count);
+        std::vector<Culler::result_type> parallelResults(count);
+        Culler::intersects(expected.data(), frustum, center.data(), extent.data(), count, 1);
+        bvh.cull(results.data(), frustum, center.data(), extent.data(), 1);
+        bvh.cull(js, parallelResults.data(), frustum, center.data(), extent.data(), 1);
+        size_t visibleCount = 0;
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(expected[i], results[i]);
+            EXPECT_EQ(expected[i], parallelResults[i]);
+            visibleCount += results[i] ? 1 : 0;
+        }
+        EXPECT_GT(visibleCount, 0);
+        EXPECT_LT(visibleCount, count);
+    };
+
+    BVH bvh;
+    bvh.build(center.data(), extent.data(), count);
+    EXPECT_EQ(count, bvh.getCount());
+    check(bvh);
+
+    // reorder the boxes and move some of them
+    std::vector<uint32_t> slots(count);
+    for (uint32_t i = 0; i < count; i++) {
+        slots[i] = i;
+    }
+    for (size_t i = 0; i < count / 2; i++) {
+        std::swap(center[i], center[count - 1 - i * 3 % count]);
+        std::swap(extent[i], extent[count - 1 - i * 3 % count]);
+        std::swap(slots[i], slots[count - 1 - i * 3 % count]);
+    }
+    for (size_t i = 0; i < count; i += 7) {
+        center[i].x += 10;
+    }
+    bvh.setRows(slots.data(), count);
+    bvh.refit(center.data(), extent.data());
+    check(bvh);
+
+    js.emancipate();
+}
+
+TEST(FilamentTest, OcclusionCulling) {
+    using namespace filament::details;
+
+    const mat4f clipFromWorld = mat4f::perspective(90, 2, 1, 100);
+
+    OcclusionCuller occlusionCuller;
+    occlusionCuller.prepare(clipFromWorld);
+    EXPECT_FALSE(occlusionCuller.isOccluded({ 0, 0, -20 }, 1));
+
+    // a wall in front of the camera
+    occlusionCuller.rasterize({ 0, 0, -10 }, { 5, 5, 0.5f });
+    occlusionCuller.buildHierarchy();
+    EXPECT_TRUE(occlusionCuller.hasOccluders());
+
+    // boxes behind the wall
+    EXPECT_TRUE( occlusionCuller.isOccluded({ 0, 0, -20 }, 1));
+    EXPECT_TRUE( occlusionCuller.isOccluded({ 2, 2, -40 }, 1));
+
+    // boxes in front of the wall, or not entirely behind it
+    EXPECT_FALSE(occlusionCuller.isOccluded({ 0, 0, -5 }, 1));
+    EXPECT_FALSE(occlusionCuller.isOccluded({ 0, 0, -10 }, 1));
+    EXPECT_FALSE(occlusionCuller.isOccluded({ 9, 0, -20 }, 1));
+
+    // boxes beside the wall
+    EXPECT_FALSE(occlusionCuller.isOccluded({ 10, 0, -20 }, 1));
+    EXPECT_FALSE(occlusionCuller.isOccluded({ 0, -10, -20 }, 1));
+
+    // boxes crossing the camera plane are never occluded
+    EXPECT_FALSE(occlusionCuller.isOccluded({ 0, 0, 0 }, 1));
+
+    Culler::result_type results[4] = { 1, 1, 1, 0 };
+    float3 center[4] = { { 0, 0, -20 }, { 10, 0, -20 }, { 0, 0, -5 }, { 0, 0, -20 } };
+    float3 extent[4] = { 1, 1, 1, 1 };
+    occlusionCuller.cull(results, center, extent, 4, 0);
+    EXPECT_EQ(0, results[0]);
+    EXPECT_EQ(1, results[1]);
+    EXPECT_EQ(1, results[2]);
+    EXPECT_EQ(0, results[3]);
+
+    // a rotated wall only hides what's behind it, not what's behind its world AABB
+    occlusionCuller.prepare(clipFromWorld);
+    occlusionCuller.rasterize(mat4f::translate(float4{ 0, 0, -10, 1 }) *
+            mat4f::rotate(float(M_PI / 4), float3{ 0, 0, 1 }), { 0, 0, 0 }, { 5, 5, 0.5f });
+    occlusionCuller.buildHierarchy();
+    EXPECT_TRUE( occlusionCuller.isOccluded({ 0, 0, -20 }, 1));
+    EXPECT_FALSE(occlusionCuller.isOccluded({ 9, 9, -20 }, 1));
+}
+
+TEST(FilamentTest, SortCommands) {
+    using namespace filament::details;
+    using Command = RenderPass::Command;
+
+    JobSystem js;
+    js.adopt();
+
+    LinearAllocatorArena arena("test", 4 * 1024 * 1024);
+    filament::details::ArenaScope scope(arena);
+
+    auto check = [&](size_t count, uint64_t keyMask) {
+        std::mt19937_64 gen;
+        std::vector<Command> commands(count);
+        for (size_t i = 0; i < count; i++) {
+            // use the primitive's batchedUniforms byte to remember the original order
+            commands[i].key = (i % 17) ? gen() & keyMask : uint64_t(RenderPass::Pass::SENTINEL);
+            memcpy(&commands[i].primitive.batchedUniforms, &i, sizeof(commands[i].primitive.batchedUniforms));
+        }
+
+        std::vector<Command> expected(commands);
+        std::stable_sort(expected.begin(), expected.end());
+
+        RenderPass::sortCommands(js, scope, { commands.data(), uint32_t(commands.size()) });
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(expected[i].key, commands[i].key);
+            if (expected[i].key != uint64_t(RenderPass::Pass::SENTINEL)) {
+                // the sort must be stable
+                EXPECT_EQ(expected[i].primitive.batchedUniforms,
+                        commands[i].primitive.batchedUniforms);
+            }
+        }
+    };
+
+    check(100, RenderPass::MATERIAL_MASK);                              // std::sort() path
+    check(20000, RenderPass::MATERIAL_MASK | RenderPass::Z_BUCKET_MASK);
+    check(20000, RenderPass::PASS_MASK & 0x0100000000000000llu);       // only one bit changes
+    check(20000, 0);                                                    // all keys are the same
+    check(20000, ~RenderPass::PASS_MASK);
+
+    js.emancipate();
+}
+
+TEST(FilamentTest, MaterialStateSortingKey) {
+    using namespace filament::details;
+
+    // the program (material and variant) bits are the same in both keys
+    EXPECT_EQ(RenderPass::makeMaterialSortingKey(3, 0) & RenderPass::MATERIAL_ID_MASK,
+            RenderPass::makeMaterialStateSortingKey(3, 0xA5, 0x1234) & RenderPass::MATERIAL_ID_MASK);
+
+    // instances using the same textures are next to each other, regardless of their id
+    auto a = RenderPass::makeMaterialStateSortingKey(3, 0x01, 0x00FF);
+    auto b = RenderPass::makeMaterialStateSortingKey(3, 0x02, 0x0000);
+    auto c = RenderPass::makeMaterialStateSortingKey(3, 0x01, 0x0100);
+    EXPECT_LT(a, b);
+    EXPECT_LT(c, b);
+
+    // but the material still comes first
+    EXPECT_LT(RenderPass::makeMaterialStateSortingKey(3, 0xFF, 0xFF),
+            RenderPass::makeMaterialStateSortingKey(4, 0x00, 0x00));
+}
+
 TEST(FilamentTest, ColorConversion) {
     // Linear to Gamma
     // 0.0 stays 0.0
@@ -517,8 +901,8 @@ TEST(FilamentTest, FroxelData) {
     LightManager::Instance instance = engine->getLightManager().getInstance(e);
 
     FScene::LightSoa lights;
-    lights.push_back({}, {}, {}, {}, {});   // first one is always skipped
-    lights.push_back(float4{ 0, 0, -5, 1 }, {}, instance, 1, {});
+    lights.push_back({}, {}, {}, {}, {}, {}, {});   // first one is always skipped
+    lights.push_back(float4{ 0, 0, -5, 1 }, {}, instance, 1, {}, {}, {});
 
     {
         froxelData.froxelizeLights(*engine, {}, lights);
@@ -806,6 +1190,948 @@ TEST(FilamentTest, RangeSet) {
     EXPECT_EQ(250, b[2].end);
 }
 
+TEST(FilamentTest, FrameGraph) {
+    using namespace filament;
+    using namespace filament::details;
+    using namespace filament::driver;
+
+    FEngine* engine = FEngine::create();
+    RenderTargetPool& rtp = engine->getRenderTargetPool();
+    DriverApi& driver = engine->getDriverApi();
+
+    struct PassData {
+        FrameGraphResource input;
+        FrameGraphResource output;
+    };
+
+    FrameGraph::TargetDescriptor desc;
+    desc.width = 16;
+    desc.height = 16;
+
+    { // passes which results are not used are culled
+        FrameGraph fg(rtp);
+        auto const& a = fg.addPass<PassData>("a",
+                [&](FrameGraph::Builder& builder, PassData& data) {
+                    data.output = builder.write(builder.create("a", desc));
+                },
+                [](FrameGraph::Resources const&, PassData const&, DriverApi&) { });
+        auto const& b = fg.addPass<PassData>("b",
+                [&](FrameGraph::Builder& builder, PassData& data) {
+                    data.input = builder.read(a.output);
+                    data.output = builder.write(builder.create("b", desc));
+                },
+                [](FrameGraph::Resources const&, PassData const&, DriverApi&) { });
+        fg.addPass<PassData>("c",
+                [&](FrameGraph::Builder& builder, PassData& data) {
+                    data.input = builder.read(b.output);
+                },
+                [](FrameGraph::Resources const&, PassData const&, DriverApi&) { });
+        fg.addPass<PassData>("side effect",
+                [&](FrameGraph::Builder& builder, PassData&) { builder.sideEffect(); },
+                [](FrameGraph::Resources const&, PassData const&, DriverApi&) { });
+        fg.compile();
+        EXPECT_TRUE(fg.isCulled(0));
+        EXPECT_TRUE(fg.isCulled(1));
+        EXPECT_TRUE(fg.isCulled(2));
+        EXPECT_FALSE(fg.isCulled(3));
+    }
+
+    { // discard flags and aliasing of transient targets
+        FrameGraph fg(rtp);
+        FrameGraphResource output = fg.import("output", desc, {}, TargetBufferFlags::NONE);
+
+        RenderPassParams params[4] = {};
+        RenderTargetPool::Target const* targets[4] = {};
+        auto record = [&params, &targets](uint32_t i) {
+            return [&params, &targets, i](FrameGraph::Resources const& resources,
+                    PassData const& data, DriverApi&) {
+                params[i] = resources.getRenderPassParams(data.output);
+                targets[i] = &resources.getTarget(data.output);
+            };
+        };
+
+        FrameGraphResource previous;
+        for (uint32_t i = 0; i < 4; i++) {
+            previous = fg.addPass<PassData>("pass",
+                    [&](FrameGraph::Builder& builder, PassData& data) {
+                        if (previous.isValid()) {
+                            data.input = builder.read(previous);
+                        }
+                        data.output = builder.write(i < 3 ? builder.create("t", desc) : output);
+                    }, record(i)).output;
+        }
+        fg.compile();
+        fg.execute(driver);
+
+        // the content of the transient targets is never needed before they're written
+        EXPECT_EQ(TargetBufferFlags::ALL, params[0].discardStart);
+        EXPECT_EQ(TargetBufferFlags::ALL, params[1].discardStart);
+        EXPECT_EQ(TargetBufferFlags::NONE, params[3].discardStart);
+
+        // the color buffers are kept for the next pass, which read them
+        EXPECT_EQ(TargetBufferFlags::DEPTH_AND_STENCIL, params[0].discardEnd);
+        EXPECT_EQ(TargetBufferFlags::DEPTH_AND_STENCIL, params[3].discardEnd);
+
+        // the first target isn't used anymore when the third one is needed
+        EXPECT_NE(targets[0], targets[1]);
+        EXPECT_EQ(targets[0], targets[2]);
+    }
+
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, RenderTargetPool) {
+    using namespace filament;
+    using namespace filament::details;
+    using namespace filament::driver;
+
+    FEngine* engine = FEngine::create();
+    RenderTargetPool& rtp = engine->getRenderTargetPool();
+    RenderTargetPool::Statistics const& stats = rtp.getStatistics();
+    const int hits = stats.hits;
+    const int misses = stats.misses;
+
+    // sizes are rounded up to the size class
+    auto a = rtp.get(TargetBufferFlags::COLOR, 100, 90, 1, TextureFormat::RGBA8);
+    EXPECT_EQ(128u, a->w);
+    EXPECT_EQ(128u, a->h);
+    EXPECT_EQ(misses + 1, stats.misses);
+    rtp.put(a);
+
+    // a slightly different size reuses the same target
+    auto b = rtp.get(TargetBufferFlags::COLOR, 120, 70, 1, TextureFormat::RGBA8);
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(hits + 1, stats.hits);
+
+    // a target in use or with a different format can't be reused
+    auto c = rtp.get(TargetBufferFlags::COLOR, 120, 70, 1, TextureFormat::RGBA8);
+    auto d = rtp.get(TargetBufferFlags::COLOR, 120, 70, 1, TextureFormat::RGBA16F);
+    EXPECT_NE(b, c);
+    EXPECT_NE(b, d);
+    EXPECT_EQ(misses + 3, stats.misses);
+
+    // a much larger target isn't reused
+    rtp.put(b);
+    auto e = rtp.get(TargetBufferFlags::COLOR, 32, 32, 1, TextureFormat::RGBA8);
+    EXPECT_NE(b, e);
+    rtp.put(c);
+    rtp.put(d);
+    rtp.put(e);
+
+    // targets over the budget are evicted, but not the ones used during this frame
+    rtp.setMemoryBudget(0);
+    rtp.gc();
+    EXPECT_EQ(0, stats.evictions);
+    rtp.gc();
+    EXPECT_EQ(4, stats.evictions);
+    EXPECT_EQ(0, stats.sizeKB);
+
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, RenderTargetPoolExactSize) {
+    using namespace filament;
+    using namespace filament::details;
+    using namespace filament::driver;
+
+    FEngine* engine = FEngine::create();
+    RenderTargetPool& rtp = engine->getRenderTargetPool();
+    constexpr uint8_t EXACT_SIZE = RenderTargetPool::Target::EXACT_SIZE;
+
+    // shadow maps are depth textures, their size isn't rounded
+    auto a = rtp.get(TargetBufferFlags::SHADOW, 1024, 512, 1, TextureFormat::DEPTH16, EXACT_SIZE);
+    EXPECT_EQ(1024u, a->w);
+    EXPECT_EQ(512u, a->h);
+    EXPECT_TRUE(bool(a->texture));
+    rtp.put(a);
+
+    // only a target of the same size is reused
+    auto b = rtp.get(TargetBufferFlags::SHADOW, 1000, 512, 1, TextureFormat::DEPTH16, EXACT_SIZE);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(1000u, b->w);
+    auto c = rtp.get(TargetBufferFlags::SHADOW, 1024, 512, 1, TextureFormat::DEPTH16, EXACT_SIZE);
+    EXPECT_EQ(a, c);
+    rtp.put(b);
+    rtp.put(c);
+
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, LevelOfDetail) {
+    using namespace filament::details;
+
+    // level 1 below 50% of the viewport height, level 2 below 10%
+    FRenderableManager::LevelsOfDetail lods;
+    lods.count = 3;
+    lods.screenCoverage[1] = 0.5f;
+    lods.screenCoverage[2] = 0.1f;
+
+    EXPECT_EQ(0, FRenderableManager::selectLevel(lods, 1.00f, 0));
+    EXPECT_EQ(1, FRenderableManager::selectLevel(lods, 0.30f, 0));
+    EXPECT_EQ(2, FRenderableManager::selectLevel(lods, 0.05f, 0));
+    EXPECT_EQ(0, FRenderableManager::selectLevel(lods, 1.00f, 2));
+
+    // close to a threshold, the current level is kept
+    EXPECT_EQ(0, FRenderableManager::selectLevel(lods, 0.48f, 0));
+    EXPECT_EQ(1, FRenderableManager::selectLevel(lods, 0.52f, 1));
+    EXPECT_EQ(1, FRenderableManager::selectLevel(lods, 0.095f, 1));
+    EXPECT_EQ(2, FRenderableManager::selectLevel(lods, 0.105f, 2));
+
+    // levels that don't exist anymore are clamped
+    lods.count = 2;
+    EXPECT_EQ(1, FRenderableManager::selectLevel(lods, 0.05f, 2));
+}
+
+TEST(FilamentTest, DeferredDestroy) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    FTransformManager& tcm = engine->getTransformManager();
+    EntityManager& em = EntityManager::get();
+    std::vector<Entity> entities(200);
+    em.create(entities.size(), entities.data());
+    for (Entity e : entities) {
+        tcm.create(e);
+    }
+
+    // nothing is destroyed until the next frame
+    engine->destroyDeferred(entities.data(), entities.size());
+    EXPECT_EQ(entities.size(), engine->getDeferredDestroyCount());
+    EXPECT_TRUE(tcm.hasComponent(entities.front()));
+
+    // with no budget, a single batch is destroyed each frame
+    engine->setDeferredDestroyBudget(0);
+    engine->prepare();
+    EXPECT_FALSE(tcm.hasComponent(entities.front()));
+    EXPECT_TRUE(tcm.hasComponent(entities.back()));
+    const size_t remaining = engine->getDeferredDestroyCount();
+    EXPECT_LT(remaining, entities.size());
+    EXPECT_GT(remaining, 0u);
+
+    // a large budget destroys all of them
+    engine->setDeferredDestroyBudget(uint64_t(1e10));
+    engine->prepare();
+    EXPECT_EQ(0u, engine->getDeferredDestroyCount());
+    EXPECT_FALSE(tcm.hasComponent(entities.back()));
+
+    em.destroy(entities.size(), entities.data());
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, VertexBufferResidency) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    FVertexBuffer* vb = upcast(VertexBuffer::Builder()
+            .vertexCount(100)
+            .bufferCount(1)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+            .streaming(true)
+            .build(*engine));
+
+    // nothing is resident initially
+    EXPECT_FALSE(vb->isResident(0, 1));
+
+    const uint32_t version = engine->getResidencyVersion();
+    vb->makeResident(*engine, 10, 10);
+    vb->makeResident(*engine, 30, 10);
+    EXPECT_NE(version, engine->getResidencyVersion());
+    EXPECT_TRUE(vb->isResident(10, 10));
+    EXPECT_TRUE(vb->isResident(30, 10));
+    EXPECT_FALSE(vb->isResident(10, 30));
+    EXPECT_FALSE(vb->isResident(5, 10));
+
+    // the ranges are merged
+    vb->makeResident(*engine, 20, 10);
+    EXPECT_TRUE(vb->isResident(10, 30));
+
+    // and split
+    vb->evict(*engine, 15, 10);
+    EXPECT_TRUE(vb->isResident(10, 5));
+    EXPECT_TRUE(vb->isResident(25, 15));
+    EXPECT_FALSE(vb->isResident(14, 2));
+    EXPECT_FALSE(vb->isResident(24, 2));
+
+    vb->evict(*engine, 0, 100);
+    EXPECT_FALSE(vb->isResident(10, 1));
+    EXPECT_FALSE(vb->isResident(30, 1));
+
+    // buffers that are not streaming are always resident
+    FVertexBuffer* resident = upcast(VertexBuffer::Builder()
+            .vertexCount(100)
+            .bufferCount(1)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+            .build(*engine));
+    EXPECT_TRUE(resident->isResident(0, 100));
+
+    engine->destroy(vb);
+    engine->destroy(resident);
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, FrameStats) {
+    using namespace filament;
+
+    std::vector<Renderer::FrameStats> delivered;
+    FrameStatsManager manager;
+    manager.setCallback([](Renderer::FrameStats const& stats, void* user) {
+        static_cast<std::vector<Renderer::FrameStats>*>(user)->push_back(stats);
+    }, &delivered);
+
+    // each frame is delivered LATENCY frames after it began, with the timings added meanwhile
+    for (uint32_t frameId = 1; frameId <= 100; frameId++) {
+        manager.beginFrame(frameId);
+        manager.add(frameId, FrameStatsManager::MAIN_THREAD, frameId);
+        if (frameId > 1) {
+            manager.add(frameId - 1, FrameStatsManager::GPU, 2.0);
+            manager.add(frameId - 1, FrameStatsManager::GPU_COLOR, 1.5);
+        }
+    }
+    ASSERT_EQ(100 - FrameStatsManager::LATENCY, delivered.size());
+    EXPECT_EQ(1u, delivered.front().frameId);
+    EXPECT_FLOAT_EQ(1.0f, delivered.front().mainThread);
+    EXPECT_FLOAT_EQ(2.0f, delivered.front().gpu);
+    EXPECT_FLOAT_EQ(1.5f, delivered.front().gpuColor);
+    EXPECT_FLOAT_EQ(0.0f, delivered.front().gpuShadows);
+
+    // timings of a frame that's been overwritten are dropped
+    manager.add(1, FrameStatsManager::GPU, 1.0);
+    manager.beginFrame(101);
+    EXPECT_EQ(100 - FrameStatsManager::LATENCY + 1, delivered.size());
+    EXPECT_FLOAT_EQ(2.0f, delivered.back().gpu);
+
+    // the percentiles are computed over the last 64 frames: 34 to 97
+    Renderer::FrameStats const& last = delivered.back();
+    EXPECT_EQ(97u, last.frameId);
+    EXPECT_FLOAT_EQ(66.0f, last.mainThreadPercentiles[0]);
+    EXPECT_FLOAT_EQ(91.0f, last.mainThreadPercentiles[1]);
+    EXPECT_FLOAT_EQ(97.0f, last.mainThreadPercentiles[2]);
+}
+
+TEST(FilamentTest, FrameStatsCounters) {
+    using namespace filament;
+
+    std::vector<Renderer::FrameStats> delivered;
+    FrameStatsManager manager;
+    manager.setCallback([](Renderer::FrameStats const& stats, void* user) {
+        static_cast<std::vector<Renderer::FrameStats>*>(user)->push_back(stats);
+    }, &delivered);
+
+    volatile uint32_t sum = 0;
+    auto work = [&sum]() {
+        for (uint32_t i = 0; i < 100000; i++) {
+            sum = sum + i;
+        }
+    };
+
+    // the counters are disabled by default
+    manager.beginFrame(1);
+    {
+        FrameStatsManager::CountersScope counters(&manager, 1, FrameStatsManager::PHASE_PREPARE);
+        work();
+    }
+
+    manager.setCountersEnabled(true);
+    manager.beginFrame(2);
+    {
+        FrameStatsManager::CountersScope counters(&manager, 2, FrameStatsManager::PHASE_CULLING);
+        work();
+        counters.end();
+        // this is not counted anymore
+        work();
+    }
+    manager.add(2, FrameStatsManager::PHASE_COMMANDS, utils::Profiler::Counters());
+
+    for (uint32_t frameId = 3; frameId <= 2 + FrameStatsManager::LATENCY; frameId++) {
+        manager.beginFrame(frameId);
+    }
+    ASSERT_EQ(2u, delivered.size());
+    EXPECT_EQ(0u, delivered[0].prepareCounters.instructions);
+    EXPECT_EQ(0u, delivered[1].commandsCounters.instructions);
+    EXPECT_EQ(0.0f, delivered[1].commandsCounters.cpi);
+
+    // the counters might not be available, e.g. in a container
+    if (utils::Profiler::getForCurrentThread().isValid()) {
+        EXPECT_LT(100000u, delivered[1].cullingCounters.instructions);
+        EXPECT_GT(1000000u, delivered[1].cullingCounters.instructions);
+    } else {
+        EXPECT_EQ(0u, delivered[1].cullingCounters.instructions);
+    }
+}
+
+TEST(FilamentTest, SharedJobSystem) {
+    using namespace filament;
+    using namespace filament::details;
+
+    utils::JobSystem js;
+    FEngine* e0 = FEngine::create(Engine::Backend::DEFAULT, nullptr, nullptr, nullptr,
+            Engine::ThreadPolicy::DEFAULT, &js);
+    FEngine* e1 = FEngine::create(Engine::Backend::DEFAULT, nullptr, nullptr, nullptr,
+            Engine::ThreadPolicy::DEFAULT, &js);
+    EXPECT_EQ(&js, &e0->getJobSystem());
+    EXPECT_EQ(&js, &e1->getJobSystem());
+
+    // the JobSystem outlives both engines and can still run jobs from this thread
+    e0->shutdown();
+    delete e0;
+    auto job = js.createJob();
+    js.runAndWait(job);
+    e1->shutdown();
+    delete e1;
+
+    // the engines don't emancipate a shared JobSystem
+    js.emancipate();
+}
+
+TEST(FilamentTest, TextureStreaming) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    TextureStreamer& streamer = engine->getTextureStreamer();
+    auto createTexture = [engine](uint32_t size) {
+        return upcast(Texture::Builder()
+                .width(size).height(size).levels(0xff)
+                .format(Texture::InternalFormat::RGBA8)
+                .streaming(true)
+                .build(*engine));
+    };
+
+    FTexture* a = createTexture(1024);
+    EXPECT_EQ(a, streamer.find(a->getHwHandle()));
+
+    // nothing is resident and only the coarsest level is requested initially
+    EXPECT_EQ(11, a->getLevels());
+    EXPECT_EQ(11, a->getResidentLevel());
+    EXPECT_EQ(10, a->getRequestedLevel());
+
+    // the finest level needed is the first one larger than the size on screen
+    a->requestSize(300.0f);
+    a->requestSize(100.0f);
+    streamer.update(*engine);
+    EXPECT_EQ(1, a->getRequestedLevel());
+    a->makeResident(*engine, 1);
+    EXPECT_EQ(1, a->getResidentLevel());
+
+    // the request doesn't change when the texture isn't drawn
+    streamer.update(*engine);
+    EXPECT_EQ(1, a->getRequestedLevel());
+
+    // the least recently drawn textures are given coarser levels first
+    FTexture* b = createTexture(1024);
+    b->requestSize(2000.0f);
+    a->requestSize(2000.0f);
+    streamer.update(*engine);
+    EXPECT_EQ(0, a->getRequestedLevel());
+    EXPECT_EQ(0, b->getRequestedLevel());
+
+    streamer.setBudget(a->getLevelsSize(0) + b->getLevelsSize(2));
+    b->requestSize(2000.0f);
+    streamer.update(*engine);
+    EXPECT_EQ(2, a->getRequestedLevel());
+    EXPECT_EQ(0, b->getRequestedLevel());
+
+    // and their finer levels are evicted
+    EXPECT_EQ(2, a->getResidentLevel());
+
+    engine->destroy(a);
+    engine->destroy(b);
+    EXPECT_TRUE(streamer.empty());
+
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, ReflectionProbes) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    FTexture* environment = upcast(Texture::Builder()
+            .width(16).height(16).levels(5)
+            .sampler(Texture::Sampler::SAMPLER_CUBEMAP)
+            .format(Texture::InternalFormat::RGBA16F)
+            .build(*engine));
+
+    ReflectionProbes probes;
+    probes.set(0, environment, float3(0), Box{ float3(0), float3(10) });
+    probes.set(1, environment, float3(2), Box{ float3(2), float3(1) });
+    probes.update({}, false, mat4f());
+
+    // the probes are used once all their levels are prefiltered, one per call
+    EXPECT_EQ(0u, probes.select(float3(2)));
+    size_t passes = 0;
+    while (probes.prefilter(*engine)) {
+        passes++;
+    }
+    EXPECT_EQ(size_t(2 * CONFIG_REFLECTION_PROBE_LEVELS), passes);
+    EXPECT_FALSE(probes.isPrefilterPending());
+    EXPECT_TRUE(probes.hasProbes());
+
+    // a renderable uses the smallest box around it
+    EXPECT_EQ(2u, probes.select(float3(2.5f)));
+    EXPECT_EQ(1u, probes.select(float3(-5)));
+    EXPECT_EQ(0u, probes.select(float3(20)));
+
+    // the world origin doesn't apply to the probes
+    const mat4f worldOrigin = mat4f::translate(float4(100, 0, 0, 1));
+    probes.update({}, false, worldOrigin);
+    EXPECT_EQ(2u, probes.select(float3(102.5f, 2.5f, 2.5f)));
+    EXPECT_EQ(0u, probes.select(float3(2.5f)));
+
+    // the probes whose box changed are stale
+    EXPECT_EQ(0u, probes.getStaleProbes());
+    probes.update({ float3(105), float3(106) }, false, worldOrigin);
+    EXPECT_EQ(0u, probes.getStaleProbes());
+    probes.update({ float3(105, 5, 5), float3(106, 6, 6) }, false, worldOrigin);
+    EXPECT_EQ(1u, probes.getStaleProbes());
+    probes.update({}, true, mat4f());
+    EXPECT_EQ(3u, probes.getStaleProbes());
+
+    // a probe captured again keeps its reflections until they're prefiltered again
+    probes.invalidate(0);
+    EXPECT_EQ(2u, probes.getStaleProbes());
+    EXPECT_TRUE(probes.isPrefilterPending());
+    EXPECT_EQ(1u, probes.select(float3(-5)));
+
+    probes.remove(1);
+    EXPECT_EQ(0u, probes.getStaleProbes());
+    EXPECT_EQ(1u, probes.select(float3(2.5f)));
+
+    probes.terminate(engine->getDriverApi());
+    engine->destroy(environment);
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, RenderStats) {
+    using namespace filament;
+
+    Engine* engine = Engine::create(Engine::Backend::NOOP);
+    SwapChain* swapChain = engine->createSwapChain(64, 64);
+    Renderer* renderer = engine->createRenderer();
+    Camera* camera = engine->createCamera();
+    Scene* scene = engine->createScene();
+    View* view = engine->createView();
+    view->setCamera(camera);
+    view->setScene(scene);
+    view->setViewport({ 0, 0, 64, 64 });
+
+    // nothing is counted until a frame ends
+    EXPECT_EQ(0u, renderer->getRenderStats().frameId);
+
+    for (uint32_t i = 0; i < 2; i++) {
+        if (renderer->beginFrame(swapChain)) {
+            renderer->render(view);
+            renderer->endFrame();
+        }
+    }
+
+    // the frame in progress doesn't change the last frame's counters
+    Renderer::RenderStats stats = renderer->getRenderStats();
+    EXPECT_LT(0u, stats.frameId);
+    EXPECT_EQ(0u, stats.visibleRenderables);
+    EXPECT_EQ(0u, stats.culledRenderables);
+    EXPECT_LT(0u, stats.commandStreamSize);
+    if (renderer->beginFrame(swapChain)) {
+        EXPECT_EQ(stats.frameId, renderer->getRenderStats().frameId);
+        renderer->endFrame();
+    }
+
+    // the noop backend doesn't count its work
+    EXPECT_EQ(0u, stats.drawCount);
+
+    engine->destroy(view);
+    engine->destroy(scene);
+    engine->destroy(camera);
+    engine->destroy(renderer);
+    engine->destroy(swapChain);
+    Engine::destroy(&engine);
+}
+
+TEST(FilamentTest, FrameCapture) {
+    using namespace filament;
+
+    Engine* engine = Engine::create(Engine::Backend::NOOP);
+    SwapChain* swapChain = engine->createSwapChain(64, 64);
+    Renderer* renderer = engine->createRenderer();
+    Camera* camera = engine->createCamera();
+    Scene* scene = engine->createScene();
+    View* view = engine->createView();
+    view->setName("captured");
+    view->setCamera(camera);
+    view->setScene(scene);
+    view->setViewport({ 0, 0, 64, 64 });
+
+    const char* path = "filament_test_capture.txt";
+    renderer->captureFrame(path);
+    if (renderer->beginFrame(swapChain)) {
+        renderer->render(view);
+        renderer->endFrame();
+    }
+
+    // the capture is written by render(), it starts with its version and the view
+    FILE* file = fopen(path, "r");
+    ASSERT_NE(nullptr, file);
+    char line[256] = {};
+    EXPECT_NE(nullptr, fgets(line, sizeof(line), file));
+    EXPECT_STREQ("filament-frame-capture 1\n", line);
+    EXPECT_NE(nullptr, fgets(line, sizeof(line), file));
+    EXPECT_EQ(0, strncmp("view ", line, 5));
+    EXPECT_NE(nullptr, strstr(line, " 64 64 64 64 captured"));
+    fclose(file);
+    remove(path);
+
+    engine->destroy(view);
+    engine->destroy(scene);
+    engine->destroy(camera);
+    engine->destroy(renderer);
+    engine->destroy(swapChain);
+    Engine::destroy(&engine);
+}
+
+TEST(FilamentTest, HandleTable) {
+    using namespace filament;
+
+    struct Object {
+        explicit Object(int* alive) noexcept : alive(alive) { (*alive)++; }
+        ~Object() noexcept { (*alive)--; }
+        int* alive;
+    };
+
+    int alive = 0;
+    HandleTable<Object> table;
+    using HandleId = HandleTable<Object>::HandleId;
+    EXPECT_EQ(nullptr, table.get(HandleBase::nullid));
+
+    // allocate and free
+    const HandleId a = table.allocate();
+    const HandleId b = table.allocate();
+    ASSERT_NE(HandleId(HandleBase::nullid), a);
+    ASSERT_NE(HandleId(HandleBase::nullid), b);
+    EXPECT_NE(a, b);
+    Object* pa = table.construct(a, &alive);
+    Object* pb = table.construct(b, &alive);
+    EXPECT_EQ(pa, table.get(a));
+    EXPECT_EQ(pb, table.get(b));
+    EXPECT_EQ(2, alive);
+    EXPECT_EQ(2, table.getStats().count);
+
+    table.destroy(a);
+    EXPECT_EQ(1, alive);
+    EXPECT_EQ(nullptr, table.get(a));
+    EXPECT_EQ(pb, table.get(b));
+    EXPECT_EQ(1, table.getStats().count);
+    EXPECT_EQ(2, table.getStats().peak);
+
+    // the freed slot is reused first, with a new handle
+    const HandleId c = table.allocate();
+    EXPECT_EQ(a & HandleTable<Object>::CAPACITY, c & HandleTable<Object>::CAPACITY);
+    EXPECT_NE(a, c);
+    Object* pc = table.construct(c, &alive);
+    EXPECT_EQ(pa, pc);
+
+    // the handle of the destroyed object stays invalid after its slot is reused
+    EXPECT_EQ(nullptr, table.get(a));
+    EXPECT_EQ(pc, table.get(c));
+
+    size_t count = 0;
+    table.forEach([&count](Object&) { count++; });
+    EXPECT_EQ(2, count);
+
+    table.destroy(b);
+    table.destroy(c);
+    EXPECT_EQ(0, alive);
+    EXPECT_EQ(0, table.getStats().count);
+    EXPECT_EQ(3, table.getStats().allocationCount);
+}
+
+TEST(FilamentTest, CommandStreamReplay) {
+    using namespace filament;
+
+    // capture two frames, the commands are captured as the Dispatcher does
+    const char* path = "filament_test_capture.fcap";
+    static const uint16_t indices[] = { 0, 1, 2 };
+    const Driver::SwapChainHandle sch(1);
+    const Driver::IndexBufferHandle ibh(2);
+    {
+        CommandStreamCapture capture(path);
+        capture.capture(CommandId::createSwapChain,
+                std::make_tuple(sch, (void*)nullptr, uint64_t(0)));
+        capture.capture(CommandId::createIndexBuffer,
+                std::make_tuple(ibh, Driver::ElementType::USHORT, uint32_t(3)));
+        for (uint32_t frame = 0; frame < 2; frame++) {
+            capture.capture(CommandId::beginFrame, std::make_tuple(uint64_t(0), frame));
+            capture.capture(CommandId::makeCurrent, std::make_tuple(sch));
+            capture.capture(CommandId::loadIndexBuffer, std::make_tuple(ibh,
+                    Driver::BufferDescriptor(indices, sizeof(indices)),
+                    uint32_t(0), uint32_t(sizeof(indices))));
+            capture.capture(CommandId::endFrame, std::make_tuple(frame));
+        }
+        capture.capture(CommandId::destroyIndexBuffer, std::make_tuple(ibh));
+    }
+
+    // replay it on the NOOP backend, without a window the swap chain is headless
+    std::unique_ptr<Driver> driver = NoopDriver::create();
+    {
+        CommandStreamReplay replay(*driver, nullptr, 64, 64);
+        ASSERT_TRUE(replay.open(path));
+        CommandId id = CommandId::COUNT;
+        EXPECT_TRUE(replay.replayCommand(&id));
+        EXPECT_EQ(CommandId::createSwapChain, id);
+        EXPECT_TRUE(replay.replayCommand(&id));
+        EXPECT_EQ(CommandId::createIndexBuffer, id);
+        EXPECT_TRUE(replay.replayFrame());
+        EXPECT_TRUE(replay.replayFrame());
+        EXPECT_TRUE(replay.replayCommand(&id));
+        EXPECT_EQ(CommandId::destroyIndexBuffer, id);
+        EXPECT_FALSE(replay.replayCommand());
+        EXPECT_FALSE(replay.replayFrame());
+    }
+
+    // a truncated capture stops at its last complete command
+    FILE* file = fopen(path, "rb");
+    ASSERT_NE(nullptr, file);
+    std::vector<char> data(4096);
+    data.resize(fread(data.data(), 1, data.size(), file));
+    fclose(file);
+    file = fopen(path, "wb");
+    ASSERT_NE(nullptr, file);
+    fwrite(data.data(), 1, data.size() - 1, file);
+    fclose(file);
+    {
+        CommandStreamReplay replay(*driver, nullptr);
+        ASSERT_TRUE(replay.open(path));
+        size_t count = 0;
+        while (replay.replayCommand()) {
+            count++;
+        }
+        EXPECT_EQ(2 + 2 * 4, count);
+    }
+
+    // anything else isn't a capture
+    file = fopen(path, "wb");
+    ASSERT_NE(nullptr, file);
+    fwrite(indices, 1, sizeof(indices), file);
+    fclose(file);
+    {
+        CommandStreamReplay replay(*driver, nullptr);
+        EXPECT_FALSE(replay.open(path));
+        EXPECT_FALSE(replay.replayFrame());
+    }
+    remove(path);
+}
+
+TEST(FilamentTest, PushConstantsParallelCommands) {
+    using namespace filament;
+
+    Engine* engine = Engine::create(Engine::Backend::NOOP);
+    SwapChain* swapChain = engine->createSwapChain(64, 64);
+    Renderer* renderer = engine->createRenderer();
+    Camera* camera = engine->createCamera();
+    camera->setProjection(45.0, 1.0, 0.1, 100.0);
+    Scene* scene = engine->createScene();
+    View* view = engine->createView();
+    view->setCamera(camera);
+    view->setScene(scene);
+    view->setViewport({ 0, 0, 64, 64 });
+
+    filamat::Package package = filamat::MaterialBuilder()
+            .name("pushConstants")
+            .shading(Shading::UNLIT)
+            .pushConstant(driver::UniformType::FLOAT4, "color")
+            .material("void material(inout MaterialInputs material) {\n"
+                      "    prepareMaterial(material);\n"
+                      "    material.baseColor = materialConstants.color;\n"
+                      "}\n")
+            .build();
+    ASSERT_TRUE(package.isValid());
+    Material* material = Material::Builder()
+            .package(package.getData(), package.getSize())
+            .build(*engine);
+    ASSERT_NE(nullptr, material);
+
+    static const float3 positions[] = { { -1, -1, 0 }, { 1, -1, 0 }, { 0, 1, 0 } };
+    static const uint16_t indices[] = { 0, 1, 2 };
+    VertexBuffer* vb = VertexBuffer::Builder()
+            .vertexCount(3)
+            .bufferCount(1)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+            .build(*engine);
+    vb->setBufferAt(*engine, 0, { positions, sizeof(positions) });
+    IndexBuffer* ib = IndexBuffer::Builder()
+            .indexCount(3)
+            .bufferType(IndexBuffer::IndexType::USHORT)
+            .build(*engine);
+    ib->setBuffer(*engine, { indices, sizeof(indices) });
+
+    // Each renderable has its own instance, so each of their commands sends the push constants.
+    // There are enough of them to be recorded by several jobs, each in its own slice of the
+    // command stream, which must have room for the push constants.
+    std::vector<MaterialInstance*> instances(1200);
+    std::vector<Entity> entities(instances.size());
+    EntityManager::get().create(entities.size(), entities.data());
+    for (size_t i = 0; i < instances.size(); i++) {
+        instances[i] = material->createInstance();
+        instances[i]->setParameter("color", float4{ float(i) / instances.size(), 0, 0, 1 });
+        RenderableManager::Builder(1)
+                .boundingBox({{ 0, 0, -5 }, { 1, 1, 1 }})
+                .material(0, instances[i])
+                .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vb, ib)
+                .culling(false)
+                .build(*engine, entities[i]);
+        scene->addEntity(entities[i]);
+    }
+
+    // the commands are recorded while render() runs, and after it returns with pipelining
+    for (bool pipelining : { false, true }) {
+        renderer->setFramePipelining(pipelining);
+        for (uint32_t i = 0; i < 2; i++) {
+            if (renderer->beginFrame(swapChain)) {
+                renderer->render(view);
+                renderer->endFrame();
+            }
+        }
+        EXPECT_EQ(instances.size(), renderer->getRenderStats().visibleRenderables);
+    }
+    renderer->setFramePipelining(false);
+
+    for (size_t i = 0; i < instances.size(); i++) {
+        engine->destroy(entities[i]);
+        engine->destroy(instances[i]);
+    }
+    EntityManager::get().destroy(entities.size(), entities.data());
+    engine->destroy(ib);
+    engine->destroy(vb);
+    engine->destroy(material);
+    engine->destroy(view);
+    engine->destroy(scene);
+    engine->destroy(camera);
+    engine->destroy(renderer);
+    engine->destroy(swapChain);
+    Engine::destroy(&engine);
+}
+
+TEST(FilamentTest, SharedRenderPrimitives) {
+    using namespace filament;
+    using filament::details::FEngine;
+
+    Engine* engine = Engine::create(Engine::Backend::NOOP);
+    FEngine* fengine = filament::details::upcast(engine);
+    SwapChain* swapChain = engine->createSwapChain(64, 64);
+    Renderer* renderer = engine->createRenderer();
+    Camera* camera = engine->createCamera();
+    camera->setProjection(45.0, 1.0, 0.1, 100.0);
+    Scene* scene = engine->createScene();
+    View* view = engine->createView();
+    view->setCamera(camera);
+    view->setScene(scene);
+    view->setViewport({ 0, 0, 64, 64 });
+
+    static const float3 positions[] = { { -1, -1, 0 }, { 1, -1, 0 }, { 0, 1, 0 } };
+    static const uint16_t indices[] = { 0, 1, 2, 0, 2, 1 };
+    VertexBuffer* vb = VertexBuffer::Builder()
+            .vertexCount(3)
+            .bufferCount(1)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+            .build(*engine);
+    vb->setBufferAt(*engine, 0, { positions, sizeof(positions) });
+    IndexBuffer* ib = IndexBuffer::Builder()
+            .indexCount(6)
+            .bufferType(IndexBuffer::IndexType::USHORT)
+            .build(*engine);
+    ib->setBuffer(*engine, { indices, sizeof(indices) });
+
+    // the renderables drawing the same range of the same buffers share their HwRenderPrimitive
+    const size_t initialCount = fengine->getRenderPrimitiveCount();
+    MaterialInstance* mi = engine->getDefaultMaterial()->createInstance();
+    std::vector<Entity> entities(16);
+    EntityManager::get().create(entities.size(), entities.data());
+    for (Entity entity : entities) {
+        RenderableManager::Builder(1)
+                .boundingBox({{ 0, 0, -5 }, { 1, 1, 1 }})
+                .material(0, mi)
+                .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vb, ib, 0, 3)
+                .culling(false)
+                .build(*engine, entity);
+        scene->addEntity(entity);
+    }
+    EXPECT_EQ(initialCount + 1, fengine->getRenderPrimitiveCount());
+
+    // so their commands are drawn as instances of each other
+    if (renderer->beginFrame(swapChain)) {
+        renderer->render(view);
+        renderer->endFrame();
+    }
+    EXPECT_EQ(entities.size(), renderer->getRenderStats().visibleRenderables);
+    EXPECT_LT(0u, renderer->getRenderStats().instancedDraws);
+
+    // another range needs its own, which is destroyed with its last user
+    RenderableManager& rcm = engine->getRenderableManager();
+    rcm.setGeometryAt(rcm.getInstance(entities[0]), 0,
+            RenderableManager::PrimitiveType::TRIANGLES, 3, 3);
+    EXPECT_EQ(initialCount + 2, fengine->getRenderPrimitiveCount());
+    rcm.setGeometryAt(rcm.getInstance(entities[0]), 0,
+            RenderableManager::PrimitiveType::TRIANGLES, 0, 3);
+    EXPECT_EQ(initialCount + 1, fengine->getRenderPrimitiveCount());
+
+    for (Entity entity : entities) {
+        engine->destroy(entity);
+    }
+    EXPECT_EQ(initialCount, fengine->getRenderPrimitiveCount());
+
+    EntityManager::get().destroy(entities.size(), entities.data());
+    engine->destroy(mi);
+    engine->destroy(ib);
+    engine->destroy(vb);
+    engine->destroy(view);
+    engine->destroy(scene);
+    engine->destroy(camera);
+    engine->destroy(renderer);
+    engine->destroy(swapChain);
+    Engine::destroy(&engine);
+}
+
+TEST(FilamentTest, GpuMemoryStats) {
+    using namespace filament;
+    using namespace filament::details;
+    using namespace filament::driver;
+
+    // the mip levels are counted down to 1x1, for each face of the cubemaps
+    EXPECT_EQ(64u, Driver::getTextureSize(SamplerType::SAMPLER_2D, 1, TextureFormat::RGBA8,
+            1, 4, 4, 1));
+    EXPECT_EQ(88u, Driver::getTextureSize(SamplerType::SAMPLER_2D, 3, TextureFormat::RGBA8,
+            1, 4, 4, 1));
+    EXPECT_EQ(6u * 88u, Driver::getTextureSize(SamplerType::SAMPLER_CUBEMAP, 3,
+            TextureFormat::RGBA8, 1, 4, 4, 1));
+    EXPECT_EQ(4u * 64u, Driver::getTextureSize(SamplerType::SAMPLER_2D, 1, TextureFormat::RGBA8,
+            4, 4, 4, 1));
+    EXPECT_EQ(0u, Driver::getTextureSize(SamplerType::SAMPLER_EXTERNAL, 1, TextureFormat::RGBA8,
+            1, 4, 4, 1));
+
+    // the noop backend doesn't account its memory, but the pool of render targets peaks
+    FEngine* engine = FEngine::create(Engine::Backend::NOOP);
+    RenderTargetPool& rtp = engine->getRenderTargetPool();
+    auto target = rtp.get(TargetBufferFlags::COLOR, 64, 64, 1, TextureFormat::RGBA8);
+    rtp.put(target);
+    rtp.setMemoryBudget(0);
+    rtp.gc();
+    rtp.gc();
+    Engine::MemoryStats stats = engine->getMemoryStats();
+    EXPECT_EQ(0u, stats.gpu.total);
+    EXPECT_EQ(0u, stats.gpu.renderTargetPool.size);
+    EXPECT_LE(64u * 64u * 4u, stats.gpu.renderTargetPool.peak);
+
+    engine->shutdown();
+    delete engine;
+}
 
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
@@ -42,8 +42,10 @@ namespace BindingPoints {
     constexpr uint8_t PER_RENDERABLE_BONES    = 2;    // bones data, per renderable
     constexpr uint8_t LIGHTS                  = 3;    // lights data array
     constexpr uint8_t POST_PROCESS            = 4;    // samplers for the post process pass
-    constexpr uint8_t PER_MATERIAL_INSTANCE   = 5;    // uniforms/samplers updates per material
-    constexpr uint8_t COUNT                   = 6;
+    constexpr uint8_t PER_INSTANCE            = 5;    // uniforms of instanced draws
+    constexpr uint8_t BINDLESS_TEXTURES       = 6;    // handles of the bindless textures
+    constexpr uint8_t PER_MATERIAL_INSTANCE   = 7;    // uniforms/samplers updates per material
+    constexpr uint8_t COUNT                   = 8;
 }
 
 static_assert(BindingPoints::PER_MATERIAL_INSTANCE == BindingPoints::COUNT - 1,
@@ -60,6 +62,33 @@ constexpr size_t CONFIG_MAX_LIGHT_INDEX = CONFIG_MAX_LIGHT_COUNT - 1;
 // 256 is enough, but we could use 512 if needed
 constexpr size_t CONFIG_MAX_BONE_COUNT = 256;
 
+// Maximum number of morph targets blended on a renderable, must be a multiple of 4.
+// Their weights are stored in the per-renderable uniforms, 4 per float4.
+constexpr size_t CONFIG_MAX_MORPH_TARGET_COUNT = 16;
+
+// Maximum number of instances of an instanced draw, this is also limited by UBO size.
+// Each instance takes 112 bytes.
+constexpr size_t CONFIG_MAX_INSTANCE_COUNT = 64;
+
+// Maximum number of shadow cascades of the directional light.
+// Each cascade takes a light-space matrix in the per-view uniforms.
+constexpr size_t CONFIG_MAX_SHADOW_CASCADES = 4;
+
+// Maximum number of spot lights casting shadows in a view, their shadow maps share an atlas.
+// Each one takes a light-space matrix in the per-view uniforms.
+constexpr size_t CONFIG_MAX_SHADOW_CASTING_SPOTS = 16;
+
+// Maximum number of local reflection probes of a scene, their reflections share an atlas.
+// Each one takes 3 float4 in the per-view uniforms.
+constexpr size_t CONFIG_MAX_REFLECTION_PROBES = 8;
+
+// Maximum size of the push constants of a material, in bytes. Vulkan guarantees 128 bytes.
+constexpr size_t CONFIG_MAX_PUSH_CONSTANTS_SIZE = 128;
+
+// Size of the table of bindless textures shared by all the materials.
+// Each texture takes 16 bytes of a UBO, OpenGL only guarantees 16 KiB.
+constexpr size_t CONFIG_MAX_BINDLESS_TEXTURES = 1024;
+
 // can't really use std::underlying_type<AttributeIndex>::type because the driver takes a uint32_t
 using AttributeBitset = utils::bitset32;
 
@@ -67,6 +96,12 @@ using AttributeBitset = utils::bitset32;
 static constexpr bool   CONFIG_IBL_RGBM  = true;
 static constexpr size_t CONFIG_IBL_SIZE  = 256;
 
+// The reflections of the probes are octahedral maps of this size, tiled in a
+// CONFIG_REFLECTION_PROBE_ATLAS_COLUMNS wide atlas with CONFIG_REFLECTION_PROBE_LEVELS levels.
+static constexpr size_t CONFIG_REFLECTION_PROBE_SIZE          = 128;
+static constexpr size_t CONFIG_REFLECTION_PROBE_LEVELS        = 6;
+static constexpr size_t CONFIG_REFLECTION_PROBE_ATLAS_COLUMNS = 4;
+
 } // namespace filament
 
 #endif // TNT_FILAMENT_driver/EngineEnums.h
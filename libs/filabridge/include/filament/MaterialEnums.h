@@ -84,12 +84,24 @@ namespace filament {
         // when adding more entries, make sure to update VERTEX_DOMAIN_COUNT
     };
 
-    static constexpr size_t POST_PROCESS_STAGES_COUNT = 4;
+    static constexpr size_t POST_PROCESS_STAGES_COUNT = 15;
     enum class PostProcessStage : uint8_t {
-        TONE_MAPPING_OPAQUE,           // Tone mapping post-process
-        TONE_MAPPING_TRANSLUCENT,      // Tone mapping post-process
-        ANTI_ALIASING_OPAQUE,          // Anti-aliasing stage
-        ANTI_ALIASING_TRANSLUCENT,     // Anti-aliasing stage
+        TONE_MAPPING_OPAQUE,                        // Tone mapping post-process
+        TONE_MAPPING_TRANSLUCENT,                   // Tone mapping post-process
+        ANTI_ALIASING_OPAQUE,                       // Anti-aliasing stage
+        ANTI_ALIASING_TRANSLUCENT,                  // Anti-aliasing stage
+        TONE_MAPPING_ANTI_ALIASING_OPAQUE,          // Tone mapping and anti-aliasing in one pass
+        TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT,     // Tone mapping and anti-aliasing in one pass
+        TEMPORAL_UPSCALING,                         // Temporal reconstruction and upscaling
+        IBL_ROUGHNESS_PREFILTER,                    // GGX prefilter of a cubemap face
+        IBL_IRRADIANCE_SH,                          // Irradiance SH of a cubemap, 3 bands
+        IBL_DFG,                                    // DFG LUT
+        DEBUG_HEATMAP,                              // Heatmap of the debug views
+        TONE_MAPPING_FRAMEBUFFER_FETCH_OPAQUE,      // Tone mapping in place, on-tile
+        TONE_MAPPING_FRAMEBUFFER_FETCH_TRANSLUCENT, // Tone mapping in place, on-tile
+        ACCUMULATED_TRANSPARENCY,                   // Composites the accumulated transparency
+        IBL_PROBE_PREFILTER,                        // GGX prefilter of a reflection probe
+        // when adding more entries, make sure to update POST_PROCESS_STAGES_COUNT
     };
 
     static constexpr size_t MATERIAL_VARIABLES_COUNT = 4;
@@ -42,6 +42,7 @@ enum class Backend : uint8_t {
     DEFAULT = 0,  //!< Automatically selects an appropriate driver for the platform.
     OPENGL = 1,   //!< Selects the OpenGL driver (which supports OpenGL ES as well).
     VULKAN = 2,   //!< Selects the Vulkan driver if the platform supports it.
+    NOOP = 3,     //!< Selects the no-op driver, which ignores all commands (e.g. to measure the CPU cost of the engine).
 };
 
 /**
@@ -507,14 +508,36 @@ enum class BlendFunction : uint8_t {
     SRC_ALPHA_SATURATE
 };
 
-static constexpr size_t PIPELINE_STAGE_COUNT= 2;
+static constexpr size_t PIPELINE_STAGE_COUNT= 3;
 enum ShaderType : uint8_t {
     VERTEX = 0,
-    FRAGMENT = 1
+    FRAGMENT = 1,
+    COMPUTE = 2
+};
+
+/**
+ * Bitmask of the reads that must see the writes of the compute programs dispatched before a
+ * memory barrier.
+ */
+enum BarrierFlags : uint8_t {
+    BARRIER_STORAGE_BUFFER = 0x1,       //!< storage buffers read by compute programs
+    BARRIER_VERTEX_ATTRIBUTES = 0x2,    //!< storage buffers used or copied as vertex buffers
+    BARRIER_INDIRECT_COMMANDS = 0x4,    //!< storage buffers used as indirect draw arguments
+    BARRIER_UNIFORMS = 0x8,             //!< storage buffers used as uniform buffers
+    BARRIER_TEXTURE_FETCH = 0x10,       //!< textures sampled after being written
+    BARRIER_ALL = 0x1F
 };
 
 static constexpr uint64_t SWAP_CHAIN_CONFIG_TRANSPARENT = 0x1;
 
+// The frames are presented in order at vsync (FIFO) unless one of these is set.
+static constexpr uint64_t SWAP_CHAIN_CONFIG_PRESENT_MAILBOX = 0x2;
+static constexpr uint64_t SWAP_CHAIN_CONFIG_PRESENT_IMMEDIATE = 0x4;
+
+// Minimum number of images of the swap chain, 0 lets the backend choose.
+static constexpr uint64_t SWAP_CHAIN_CONFIG_IMAGE_COUNT_SHIFT = 8;
+static constexpr uint64_t SWAP_CHAIN_CONFIG_IMAGE_COUNT_MASK = 0xF00;
+
 } // namespace driver
 } // namespace filament
 
@@ -25,6 +25,7 @@ class SibGenerator {
 public:
     static SamplerInterfaceBlock& getPerViewSib() noexcept;
     static SamplerInterfaceBlock& getPostProcessSib() noexcept;
+    static SamplerInterfaceBlock& getPerRenderableSib() noexcept;
     static SamplerInterfaceBlock* getSib(uint8_t bindingPoint) noexcept;
 };
 
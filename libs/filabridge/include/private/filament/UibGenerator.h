@@ -28,6 +28,8 @@ public:
     static UniformInterfaceBlock& getLightsUib() noexcept;
     static UniformInterfaceBlock& getPostProcessingUib() noexcept;
     static UniformInterfaceBlock& getPerRenderableBonesUib() noexcept;
+    static UniformInterfaceBlock& getPerInstanceUib() noexcept;
+    static UniformInterfaceBlock& getBindlessTexturesUib() noexcept;
 };
 
 }
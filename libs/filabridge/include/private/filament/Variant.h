@@ -21,7 +21,7 @@
 #include <cstddef>
 
 namespace filament {
-    static constexpr size_t VARIANT_COUNT = 16;
+    static constexpr size_t VARIANT_COUNT = 32;
 
     // IMPORTANT: update filterVariant() when adding more variants
     struct Variant {
@@ -33,17 +33,18 @@ namespace filament {
         // DYL: Dynamic Lighting
         // SRE: Shadow Receiver
         // SKN: Skinning
+        // MRP: Morphing
         //
-        //                    ...-----+-----+-----+-----+-----+
-        // Variant                 0  | SKN | SRE | DYN | DIR |
-        //                    ...-----+-----+-----+-----+-----+
+        //                    ...-----+-----+-----+-----+-----+-----+
+        // Variant                 0  | MRP | SKN | SRE | DYN | DIR |
+        //                    ...-----+-----+-----+-----+-----+-----+
         // Reserved variants:
-        //       Depth shader            X     1     0     0
-        //           Reserved            X     1     1     0
+        //       Depth shader            X     X     1     0     0
+        //           Reserved            X     X     1     1     0
         //
         // Standard variants:
-        //      Vertex shader            X     X     0     X
-        //    Fragment shader            0     X     X     X
+        //      Vertex shader            X     X     X     0     X
+        //    Fragment shader            0     0     X     X     X
 
         uint8_t key = 0;
 
@@ -53,10 +54,12 @@ namespace filament {
         static constexpr uint8_t DYNAMIC_LIGHTING       = 0x02; // point, spot or area present, per frame/world position
         static constexpr uint8_t SHADOW_RECEIVER        = 0x04; // receives shadows, per renderable
         static constexpr uint8_t SKINNING               = 0x08; // GPU skinning
+        static constexpr uint8_t MORPHING               = 0x10; // GPU morph targets
 
         static constexpr uint8_t VERTEX_MASK = DIRECTIONAL_LIGHTING |
                                                SHADOW_RECEIVER |
-                                               SKINNING;
+                                               SKINNING |
+                                               MORPHING;
 
         static constexpr uint8_t FRAGMENT_MASK = DIRECTIONAL_LIGHTING |
                                                  DYNAMIC_LIGHTING |
@@ -71,17 +74,27 @@ namespace filament {
         static constexpr uint8_t DEPTH_VARIANT = SHADOW_RECEIVER;
 
         // this mask filters out the lighting variants
-        static constexpr uint8_t UNLIT_MASK    = SKINNING;
+        static constexpr uint8_t UNLIT_MASK    = SKINNING | MORPHING;
+
+        // the variants that change the vertex positions, they must match between two programs
+        // used in place of one another
+        static constexpr uint8_t GEOMETRY_MASK = SKINNING | MORPHING;
+
+        // Vulkan fragment shaders can be built once for both values of DYNAMIC_LIGHTING, in which
+        // case that bit is passed in as a boolean specialization constant with this id.
+        static constexpr uint32_t DYNAMIC_LIGHTING_CONSTANT_ID = 0;
 
         static_assert((VERTEX_MASK | FRAGMENT_MASK) == VARIANT_COUNT - 1,
                 "inconsistency between vertex/fragment masks and variant count");
 
         inline bool hasSkinning() const noexcept { return key & SKINNING; }
+        inline bool hasMorphing() const noexcept { return key & MORPHING; }
         inline bool hasDirectionalLighting() const noexcept { return key & DIRECTIONAL_LIGHTING; }
         inline bool hasDynamicLighting() const noexcept { return key & DYNAMIC_LIGHTING; }
         inline bool hasShadowReceiver() const noexcept { return key & SHADOW_RECEIVER; }
 
         inline void setSkinning(bool v) noexcept { set(v, SKINNING); }
+        inline void setMorphing(bool v) noexcept { set(v, MORPHING); }
         inline void setDirectionalLighting(bool v) noexcept { set(v, DIRECTIONAL_LIGHTING); }
         inline void setDynamicLighting(bool v) noexcept { set(v, DYNAMIC_LIGHTING); }
         inline void setShadowReceiver(bool v) noexcept { set(v, SHADOW_RECEIVER); }
@@ -102,8 +115,8 @@ namespace filament {
         }
 
         static constexpr uint8_t filterVariantFragment(uint8_t variantKey) noexcept {
-            // filter out fragment variants that are not needed. For e.g. skinning doesn't
-            // affect the fragment shader.
+            // filter out fragment variants that are not needed. For e.g. skinning and morphing
+            // don't affect the fragment shader.
             return variantKey & FRAGMENT_MASK;
         }
 
@@ -31,6 +31,8 @@ SamplerInterfaceBlock& SibGenerator::getPerViewSib() noexcept {
             .add("froxels",       Type::SAMPLER_2D,      Format::UINT,  Precision::MEDIUM)
             .add("iblDFG",        Type::SAMPLER_2D,      Format::FLOAT, Precision::MEDIUM)
             .add("iblSpecular",   Type::SAMPLER_CUBEMAP, Format::FLOAT, Precision::MEDIUM)
+            .add("spotShadowMap", Type::SAMPLER_2D,      Format::SHADOW,Precision::LOW)
+            .add("reflectionProbes", Type::SAMPLER_2D,   Format::FLOAT, Precision::MEDIUM)
             .build();
     return sib;
 }
@@ -42,6 +44,21 @@ SamplerInterfaceBlock& SibGenerator::getPostProcessSib() noexcept {
     static SamplerInterfaceBlock sib = SamplerInterfaceBlock::Builder()
             .name("PostProcess")
             .add("colorBuffer", Type::SAMPLER_2D, Format::FLOAT, Precision::MEDIUM, false)
+            .add("history",     Type::SAMPLER_2D, Format::FLOAT, Precision::MEDIUM, false)
+            .add("environment", Type::SAMPLER_CUBEMAP, Format::FLOAT, Precision::MEDIUM, false)
+            .build();
+    return sib;
+}
+
+SamplerInterfaceBlock& SibGenerator::getPerRenderableSib() noexcept {
+    using Type = SamplerInterfaceBlock::Type;
+    using Format = SamplerInterfaceBlock::Format;
+    using Precision = SamplerInterfaceBlock::Precision;
+    // only used by the vertex shaders of the morphing variants
+    static SamplerInterfaceBlock sib = SamplerInterfaceBlock::Builder()
+            .name("MorphTargetBuffer")
+            .add("positions", Type::SAMPLER_2D, Format::FLOAT, Precision::HIGH)
+            .add("normals",   Type::SAMPLER_2D, Format::FLOAT, Precision::HIGH)
             .build();
     return sib;
 }
@@ -51,7 +68,7 @@ SamplerInterfaceBlock* SibGenerator::getSib(uint8_t bindingPoint) noexcept {
         case BindingPoints::PER_VIEW:
             return &getPerViewSib();
         case BindingPoints::PER_RENDERABLE:
-            return nullptr;
+            return &getPerRenderableSib();
         case BindingPoints::LIGHTS:
             return nullptr;
         case BindingPoints::POST_PROCESS:
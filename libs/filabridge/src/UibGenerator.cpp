@@ -32,7 +32,8 @@ UniformInterfaceBlock& UibGenerator::getPerViewUib() noexcept  {
             .add("clipFromViewMatrix",      1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("viewFromClipMatrix",      1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("clipFromWorldMatrix",     1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
-            .add("lightFromWorldMatrix",    1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("lightFromWorldMatrix",    CONFIG_MAX_SHADOW_CASCADES, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("spotLightFromWorldMatrix", CONFIG_MAX_SHADOW_CASTING_SPOTS, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             // view
             .add("resolution",              1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
             // camera
@@ -44,8 +45,8 @@ UniformInterfaceBlock& UibGenerator::getPerViewUib() noexcept  {
             .add("sun",                     1, UniformInterfaceBlock::Type::FLOAT4)
             .add("lightDirection",          1, UniformInterfaceBlock::Type::FLOAT3)
             .add("fParamsX",                1, UniformInterfaceBlock::Type::UINT)
-            // shadow
-            .add("shadowBias",              1, UniformInterfaceBlock::Type::FLOAT3)
+            .add("padding0",                1, UniformInterfaceBlock::Type::FLOAT2)
+            .add("orderIndependentTransparency", 1, UniformInterfaceBlock::Type::FLOAT)
             .add("oneOverFroxelDimensionY", 1, UniformInterfaceBlock::Type::FLOAT)
             // froxels
             .add("zParams",                 1, UniformInterfaceBlock::Type::FLOAT4)
@@ -58,8 +59,14 @@ UniformInterfaceBlock& UibGenerator::getPerViewUib() noexcept  {
             // camera
             .add("exposure",                1, UniformInterfaceBlock::Type::FLOAT)
             .add("ev100",                   1, UniformInterfaceBlock::Type::FLOAT)
+            // shadow
+            .add("cascadeSplits",           1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
+            .add("shadowNormalBias",        1, UniformInterfaceBlock::Type::FLOAT4)
             // ibl
             .add("iblSH",                   9, UniformInterfaceBlock::Type::FLOAT3)
+            // reflection probes
+            .add("reflectionProbesFromWorldMatrix", 1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("reflectionProbes", CONFIG_MAX_REFLECTION_PROBES * 3, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
             .build();
     return uib;
 }
@@ -69,6 +76,10 @@ UniformInterfaceBlock& UibGenerator::getPerRenderableUib() noexcept {
             .name("ObjectUniforms")
             .add("worldFromModelMatrix",       1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("worldFromModelNormalMatrix", 1, UniformInterfaceBlock::Type::MAT3, Precision::HIGH)
+            .add("skinningDualQuaternion",     1, UniformInterfaceBlock::Type::UINT)
+            .add("morphTargetCount",           1, UniformInterfaceBlock::Type::UINT)
+            .add("reflectionProbe",            1, UniformInterfaceBlock::Type::UINT)
+            .add("morphWeights", CONFIG_MAX_MORPH_TARGET_COUNT / 4, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
             .build();
     return uib;
 }
@@ -87,6 +98,14 @@ UniformInterfaceBlock& UibGenerator::getPostProcessingUib() noexcept {
             .add("uvScale", 1, UniformInterfaceBlock::Type::FLOAT2)
             .add("time",    1, UniformInterfaceBlock::Type::FLOAT)
             .add("yOffset", 1, UniformInterfaceBlock::Type::FLOAT)
+            .add("jitter",        1, UniformInterfaceBlock::Type::FLOAT2)
+            .add("historyScale",  1, UniformInterfaceBlock::Type::FLOAT2)
+            .add("historyWeight", 1, UniformInterfaceBlock::Type::FLOAT)
+            .add("iblFace",           1, UniformInterfaceBlock::Type::FLOAT)
+            .add("iblRoughness",      1, UniformInterfaceBlock::Type::FLOAT)
+            .add("iblSampleCount",    1, UniformInterfaceBlock::Type::FLOAT)
+            .add("iblSourceSize",     1, UniformInterfaceBlock::Type::FLOAT)
+            .add("iblSourceMaxLevel", 1, UniformInterfaceBlock::Type::FLOAT)
             .build();
     return uib;
 }
@@ -99,4 +118,22 @@ UniformInterfaceBlock& UibGenerator::getPerRenderableBonesUib() noexcept {
     return uib;
 }
 
+UniformInterfaceBlock& UibGenerator::getPerInstanceUib() noexcept {
+    static UniformInterfaceBlock uib = UniformInterfaceBlock::Builder()
+            .name("InstanceUniforms")
+            .add("worldFromModelMatrix",       CONFIG_MAX_INSTANCE_COUNT, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("worldFromModelNormalMatrix", CONFIG_MAX_INSTANCE_COUNT, UniformInterfaceBlock::Type::MAT3, Precision::HIGH)
+            .build();
+    return uib;
+}
+
+UniformInterfaceBlock& UibGenerator::getBindlessTexturesUib() noexcept {
+    // each handle is a 64-bit value in the first two components
+    static UniformInterfaceBlock uib = UniformInterfaceBlock::Builder()
+            .name("BindlessTextures")
+            .add("handles", CONFIG_MAX_BINDLESS_TEXTURES, UniformInterfaceBlock::Type::UINT4, Precision::HIGH)
+            .build();
+    return uib;
+}
+
 } // namespace filament
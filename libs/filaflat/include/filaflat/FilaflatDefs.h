@@ -53,8 +53,10 @@ enum UTILS_PUBLIC ChunkType : uint64_t {
     Unknown  = charTo64bitNum("UNKNOWN "),
     MaterialUib = charTo64bitNum("MAT_UIB "),
     MaterialSib = charTo64bitNum("MAT_SIB "),
+    MaterialPushConstants = charTo64bitNum("MAT_PUSH"),
     MaterialGlsl = charTo64bitNum("MAT_GLSL"),
     MaterialSpirv = charTo64bitNum("MAT_SPIR"),
+    MaterialMetal = charTo64bitNum("MAT_METL"),
     MaterialShaderModels = charTo64bitNum("MAT_SMDL"),
     MaterialSamplerBindings = charTo64bitNum("MAT_SAMP"),
 
@@ -65,6 +67,7 @@ enum UTILS_PUBLIC ChunkType : uint64_t {
     MaterialTransparencyMode = charTo64bitNum("MAT_TRMD"),
     MaterialMaskThreshold = charTo64bitNum("MAT_THRS"),
     MaterialShadowMultiplier = charTo64bitNum("MAT_SHML"),
+    MaterialBindlessSamplers = charTo64bitNum("MAT_BNDL"),
 
     MaterialRequiredAttributes = charTo64bitNum("MAT_REQA"),
     MaterialDepthWriteSet = charTo64bitNum("MAT_DEWS"),
@@ -85,6 +88,10 @@ enum UTILS_PUBLIC ChunkType : uint64_t {
 
     DictionaryGlsl = charTo64bitNum("DIC_GLSL"),
     DictionarySpirv = charTo64bitNum("DIC_SPIR"),
+
+    // the dictionaries above, compressed
+    DictionaryGlslCompressed = charTo64bitNum("DIC_GLLZ"),
+    DictionarySpirvCompressed = charTo64bitNum("DIC_SPLZ"),
 };
 
 } // namespace filamat
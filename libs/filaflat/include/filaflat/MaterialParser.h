@@ -42,7 +42,14 @@ struct MaterialParserDetails;
 
 class UTILS_PUBLIC MaterialParser {
 public:
+    // The parser makes a copy of the package
     MaterialParser(filament::driver::Backend backend, const void* data, size_t size);
+
+    // The parser references the package, which must outlive it (e.g. a memory-mapped file).
+    // Only the chunk index is read here, the dictionaries and shaders are read when needed.
+    struct ReferencePackage {};
+    MaterialParser(filament::driver::Backend backend, const void* data, size_t size,
+            ReferencePackage) noexcept;
     ~MaterialParser();
 
     MaterialParser(MaterialParser const& rhs) noexcept = delete;
@@ -56,6 +63,8 @@ public:
     bool getName(utils::CString*) const noexcept;
     bool getUIB(filament::UniformInterfaceBlock* uib) const noexcept;
     bool getSIB(filament::SamplerInterfaceBlock* sib) const noexcept;
+    // returns false if the material has no push constants
+    bool getPushConstants(filament::UniformInterfaceBlock* pushConstants) const noexcept;
     bool getSamplerBindingMap(filament::SamplerBindingMap*) const noexcept;
     bool getShaderModels(uint32_t* value) const noexcept;
 
@@ -74,9 +83,12 @@ public:
     bool getBlendingMode(filament::BlendingMode*) const noexcept;
     bool getMaskThreshold(float*) const noexcept;
     bool hasShadowMultiplier(bool*) const noexcept;
+    bool hasBindlessSamplers(bool*) const noexcept;
     bool getRequiredAttributes(filament::AttributeBitset*) const noexcept;
     bool hasCustomDepthShader(bool* value) const noexcept;
 
+    // The SPIR-V shaders aren't copied when the parser owns the memory they're in, the builder
+    // then references it (see ShaderBuilder::isReference()) and is valid as long as the parser.
     bool getShader(
             filament::driver::ShaderModel shaderModel, uint8_t variant,
             filament::driver::ShaderType st,
@@ -35,16 +35,29 @@ public:
     // Append a data blob to the shader. Returns true if successful.
     bool appendPart(const char* data, size_t size);
 
+    // Makes the shader a view of memory owned by someone else instead of a copy, until the next
+    // reset(). getShader() then returns that memory.
+    void reference(const char* data, size_t size) {
+        mReference = data;
+        mReferenceSize = size;
+    }
+
+    bool isReference() const {
+        return mReference != nullptr;
+    }
+
     const char* getShader() const {
-        return mShader;
+        return mReference ? mReference : mShader;
     }
 
-    size_t size() const { return mCursor; }
+    size_t size() const { return mReference ? mReferenceSize : mCursor; }
 
 private:
     size_t mCapacity;
     size_t mCursor;
     char* mShader;
+    const char* mReference = nullptr;
+    size_t mReferenceSize = 0;
 };
 
 } // namespace filaflat
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "CompressedChunkReader.h"
+
+#include <filaflat/Unflattener.h>
+
+#include <string.h>
+
+namespace filaflat {
+
+// see filamat's CompressedChunk for the format
+static constexpr uint32_t COMPRESSION_LZ = 1;
+static constexpr size_t MIN_MATCH = 4;
+
+static inline bool readCount(const uint8_t*& src, const uint8_t* end, size_t& count) noexcept {
+    uint8_t b;
+    do {
+        if (src == end) {
+            return false;
+        }
+        b = *src++;
+        count += b;
+    } while (b == 255);
+    return true;
+}
+
+static bool decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize) noexcept {
+    const uint8_t* const end = src + size;
+    uint8_t* const dstStart = dst;
+    uint8_t* const dstEnd = dst + dstSize;
+    while (src < end) {
+        const uint8_t token = *src++;
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !readCount(src, end, literalCount)) {
+            return false;
+        }
+        if (literalCount > size_t(end - src) || literalCount > size_t(dstEnd - dst)) {
+            return false;
+        }
+        memcpy(dst, src, literalCount);
+        src += literalCount;
+        dst += literalCount;
+        if (src == end) {
+            // the last sequence has no match
+            break;
+        }
+
+        if (end - src < 2) {
+            return false;
+        }
+        const size_t offset = size_t(src[0]) | (size_t(src[1]) << 8);
+        src += 2;
+        size_t matchLength = token & 0xF;
+        if (matchLength == 15 && !readCount(src, end, matchLength)) {
+            return false;
+        }
+        matchLength += MIN_MATCH;
+        if (offset == 0 || offset > size_t(dst - dstStart) || matchLength > size_t(dstEnd - dst)) {
+            return false;
+        }
+        // the match can overlap the bytes it produces
+        const uint8_t* match = dst - offset;
+        for (size_t i = 0; i < matchLength; i++) {
+            dst[i] = match[i];
+        }
+        dst += matchLength;
+    }
+    return dst == dstEnd;
+}
+
+bool CompressedChunkReader::unflatten(ChunkContainer const& container, filamat::ChunkType type,
+        std::vector<uint8_t>& content) {
+    Unflattener unflattener(container, type);
+    uint32_t compressionScheme;
+    uint32_t contentSize;
+    const char* compressed;
+    size_t compressedSize;
+    if (!unflattener.read(&compressionScheme) || compressionScheme != COMPRESSION_LZ ||
+            !unflattener.read(&contentSize) || !unflattener.read(&compressed, &compressedSize)) {
+        return false;
+    }
+    content.resize(contentSize);
+    return decompress(reinterpret_cast<const uint8_t*>(compressed), compressedSize,
+            content.data(), content.size());
+}
+
+} // namespace filaflat
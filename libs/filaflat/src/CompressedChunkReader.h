@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef TNT_FILAFLAT_COMPRESSED_CHUNK_READER_H
+#define TNT_FILAFLAT_COMPRESSED_CHUNK_READER_H
+
+#include <filaflat/ChunkContainer.h>
+#include <filaflat/FilaflatDefs.h>
+
+#include <vector>
+
+#include <stdint.h>
+
+namespace filaflat {
+
+// Reads the chunks written by filamat's CompressedChunk
+struct CompressedChunkReader {
+    // Decompresses the content of the chunk, as it would be if it wasn't compressed
+    static bool unflatten(ChunkContainer const& container, filamat::ChunkType type,
+            std::vector<uint8_t>& content);
+};
+
+} // namespace filaflat
+
+#endif // TNT_FILAFLAT_COMPRESSED_CHUNK_READER_H
@@ -138,7 +138,8 @@ bool MaterialChunk::getTextShader(Unflattener unflattener, BlobDictionary& dicti
 
 
 bool MaterialChunk::getSpirvShader(Unflattener unflattener, BlobDictionary& dictionary,
-        ShaderBuilder& builder, ShaderModel shaderModel, uint8_t variant, ShaderType stage) {
+        ShaderBuilder& builder, ShaderModel shaderModel, uint8_t variant, ShaderType stage,
+        bool reference) {
     if (mBase == nullptr ) {
         if (!readIndex(unflattener)) {
             return false;
@@ -154,6 +155,10 @@ bool MaterialChunk::getSpirvShader(Unflattener unflattener, BlobDictionary& dict
     size_t shaderSize;
     const char* shaderContent = dictionary.getBlob(index, &shaderSize);
     builder.reset();
+    if (reference) {
+        builder.reference(shaderContent, shaderSize);
+        return true;
+    }
     builder.announce(shaderSize);
     builder.appendPart(shaderContent, shaderSize);
     return true;
@@ -38,10 +38,12 @@ public:
             filament::driver::ShaderModel shaderModel, uint8_t variant,
             filament::driver::ShaderType stage);
 
+    // the shader builder references the blob of the dictionary rather than copying it when
+    // 'reference' is true
     bool getSpirvShader(
             Unflattener unflattener, BlobDictionary& dictionary, ShaderBuilder& shaderBuilder,
             filament::driver::ShaderModel shaderModel, uint8_t variant,
-            filament::driver::ShaderType stage);
+            filament::driver::ShaderType stage, bool reference);
 
 private:
     bool readIndex(Unflattener& unflattener);
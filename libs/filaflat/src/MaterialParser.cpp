@@ -22,6 +22,7 @@
 
 #include "BlobDictionary.h"
 #include "ChunkInterfaceBlock.h"
+#include "CompressedChunkReader.h"
 #include "MaterialChunk.h"
 #include "TextDictionaryReader.h"
 #include "SpirvDictionaryReader.h"
@@ -35,6 +36,7 @@
 #include <cstdlib>
 
 #include <string>
+#include <vector>
 
 using namespace utils;
 using namespace filament;
@@ -42,22 +44,30 @@ using namespace filamat;
 
 namespace filaflat {
 
-// Make a copy of content and own the allocated memory.
+// Make a copy of content and own the allocated memory, or reference content owned by the caller.
 class ManagedBuffer  {
     void* mStart = nullptr;
     size_t mSize = 0;
+    bool mOwned = true;
 public:
     explicit ManagedBuffer(const void* start, size_t size)
             : mStart(malloc(size)), mSize(size) {
         memcpy(mStart, start, size);
     }
 
+    ManagedBuffer(const void* start, size_t size, MaterialParser::ReferencePackage) noexcept
+            : mStart(const_cast<void*>(start)), mSize(size), mOwned(false) {
+    }
+
     void* begin() const noexcept { return mStart; }
+    bool isOwned() const noexcept { return mOwned; }
     void* end() const noexcept { return (uint8_t*)mStart + mSize; }
     size_t size() const noexcept { return mSize; }
 
     ~ManagedBuffer() noexcept {
-        free(mStart);
+        if (mOwned) {
+            free(mStart);
+        }
     }
 };
 
@@ -67,6 +77,12 @@ struct MaterialParserDetails {
               mChunkContainer(mUnflattenable.begin(), mUnflattenable.size()),
               mBackend(backend) {
     }
+    MaterialParserDetails(filament::driver::Backend backend, const void* data, size_t size,
+            MaterialParser::ReferencePackage reference) noexcept
+            : mUnflattenable(data, size, reference),
+              mChunkContainer(mUnflattenable.begin(), mUnflattenable.size()),
+              mBackend(backend) {
+    }
     ManagedBuffer mUnflattenable;
     ChunkContainer mChunkContainer;
 
@@ -74,6 +90,11 @@ struct MaterialParserDetails {
     filament::driver::Backend mBackend;
     MaterialChunk mMaterialChunk;
     BlobDictionary mBlobDictionary;
+    // the decompressed dictionary, when it's compressed in the package
+    std::vector<uint8_t> mDictionaryContent;
+
+    template<typename DictionaryReader>
+    bool readDictionary(filamat::ChunkType type, filamat::ChunkType compressedType) noexcept;
 
     template<typename T>
     bool getFromSimpleChunk(filamat::ChunkType type, T* value) const noexcept;
@@ -96,10 +117,35 @@ bool MaterialParserDetails::getFromSimpleChunk(filamat::ChunkType type, T* value
     return unflattener.read(value);
 }
 
+template<typename DictionaryReader>
+bool MaterialParserDetails::readDictionary(filamat::ChunkType type,
+        filamat::ChunkType compressedType) noexcept {
+    // Read the dictionary only if it has not been read yet.
+    if (UTILS_LIKELY(!mBlobDictionary.isEmpty())) {
+        return true;
+    }
+    ChunkContainer const& container = mChunkContainer;
+    if (container.hasChunk(compressedType)) {
+        // the blobs of the dictionary point into the decompressed content
+        if (!CompressedChunkReader::unflatten(container, compressedType, mDictionaryContent)) {
+            return false;
+        }
+        Unflattener unflattener(mDictionaryContent.data(),
+                mDictionaryContent.data() + mDictionaryContent.size());
+        return DictionaryReader().unflatten(unflattener, mBlobDictionary);
+    }
+    return container.hasChunk(type) && DictionaryReader::unflatten(container, mBlobDictionary);
+}
+
 MaterialParser::MaterialParser(filament::driver::Backend backend, const void* data, size_t size)
         : mImpl(new MaterialParserDetails(backend, data, size)) {
 }
 
+MaterialParser::MaterialParser(filament::driver::Backend backend, const void* data, size_t size,
+        ReferencePackage reference) noexcept
+        : mImpl(new MaterialParserDetails(backend, data, size, reference)) {
+}
+
 MaterialParser::~MaterialParser() {
     delete mImpl;
 }
@@ -123,15 +169,18 @@ bool MaterialParser::isShadingMaterial() const noexcept {
            cc.hasChunk(MaterialVersion) &&
            cc.hasChunk(MaterialUib) &&
            cc.hasChunk(MaterialSib) &&
-           (cc.hasChunk(MaterialGlsl) || cc.hasChunk(MaterialSpirv)) &&
+           (cc.hasChunk(MaterialGlsl) || cc.hasChunk(MaterialSpirv) ||
+                   cc.hasChunk(MaterialMetal)) &&
            cc.hasChunk(MaterialShaderModels);
 }
 
 bool MaterialParser::isPostProcessMaterial() const noexcept {
     ChunkContainer const& cc = getChunkContainer();
     return cc.hasChunk(PostProcessVersion) &&
-           ((cc.hasChunk(MaterialSpirv) && cc.hasChunk(DictionarySpirv)) ||
-            (cc.hasChunk(MaterialGlsl) && cc.hasChunk(DictionaryGlsl)));
+           ((cc.hasChunk(MaterialSpirv) &&
+                   (cc.hasChunk(DictionarySpirv) || cc.hasChunk(DictionarySpirvCompressed))) ||
+            ((cc.hasChunk(MaterialGlsl) || cc.hasChunk(MaterialMetal)) &&
+                   (cc.hasChunk(DictionaryGlsl) || cc.hasChunk(DictionaryGlslCompressed))));
 }
 
 // Accessors
@@ -172,6 +221,20 @@ bool MaterialParser::getSIB(filament::SamplerInterfaceBlock* sib) const noexcept
     return ChunkSamplerInterfaceBlock().unflatten(unflattener, sib);
 }
 
+bool MaterialParser::getPushConstants(filament::UniformInterfaceBlock* pushConstants) const noexcept {
+    auto type = MaterialPushConstants;
+
+    if (!mImpl->mChunkContainer.hasChunk(type)) {
+        return false;
+    }
+
+    const uint8_t* start = mImpl->mChunkContainer.getChunkStart(type);
+    const uint8_t* end = mImpl->mChunkContainer.getChunkEnd(type);
+    Unflattener unflattener(start, end);
+
+    return ChunkUniformInterfaceBlock().unflatten(unflattener, pushConstants);
+}
+
 bool MaterialParser::getSamplerBindingMap(filament::SamplerBindingMap* bindings) const noexcept {
     auto type = MaterialSamplerBindings;
 
@@ -248,6 +311,10 @@ bool MaterialParser::hasShadowMultiplier(bool* value) const noexcept {
     return mImpl->getFromSimpleChunk(ChunkType::MaterialShadowMultiplier, value);
 }
 
+bool MaterialParser::hasBindlessSamplers(bool* value) const noexcept {
+    return mImpl->getFromSimpleChunk(ChunkType::MaterialBindlessSamplers, value);
+}
+
 bool MaterialParser::getShading(Shading* value) const noexcept {
     assert(sizeof(Shading) == sizeof(uint8_t));
     return mImpl->getFromSimpleChunk(ChunkType::MaterialShading, reinterpret_cast<uint8_t*>(value));
@@ -282,18 +349,18 @@ bool MaterialParserDetails::getVkShader(filament::driver::ShaderModel shaderMode
 
     ChunkContainer const& container = mChunkContainer;
     if (!container.hasChunk(ChunkType::MaterialSpirv) ||
-        !container.hasChunk(ChunkType::DictionarySpirv)) {
+        !readDictionary<SpirvDictionaryReader>(ChunkType::DictionarySpirv,
+                ChunkType::DictionarySpirvCompressed)) {
         return false;
     }
 
-    if (UTILS_UNLIKELY(mBlobDictionary.isEmpty())) {
-        if (!SpirvDictionaryReader::unflatten(container, mBlobDictionary)) {
-            return false;
-        }
-    }
+    // the blobs can be referenced when they're in memory that we own, the package or the
+    // decompressed dictionary
+    const bool reference = mUnflattenable.isOwned() || !mDictionaryContent.empty();
 
     Unflattener unflattener(container, ChunkType::MaterialSpirv);
-    return mMaterialChunk.getSpirvShader(unflattener, mBlobDictionary, shader, shaderModel, variant, st);
+    return mMaterialChunk.getSpirvShader(unflattener, mBlobDictionary, shader, shaderModel, variant,
+            st, reference);
 }
 
 bool MaterialParserDetails::getGlShader(filament::driver::ShaderModel shaderModel, uint8_t variant,
@@ -301,17 +368,11 @@ bool MaterialParserDetails::getGlShader(filament::driver::ShaderModel shaderMode
 
     ChunkContainer const& container = mChunkContainer;
     if (!container.hasChunk(ChunkType::MaterialGlsl) ||
-        !container.hasChunk(ChunkType::DictionaryGlsl)) {
+        !readDictionary<TextDictionaryReader>(ChunkType::DictionaryGlsl,
+                ChunkType::DictionaryGlslCompressed)) {
         return false;
     }
 
-    // Read the dictionary only if it has not been read yet.
-    if (UTILS_UNLIKELY(mBlobDictionary.isEmpty())) {
-        if (!TextDictionaryReader::unflatten(container, mBlobDictionary)) {
-            return false;
-        }
-    }
-
     Unflattener unflattener(container, ChunkType::MaterialGlsl);
     return mMaterialChunk.getTextShader(unflattener, mBlobDictionary, shader, shaderModel, variant, st);
 }
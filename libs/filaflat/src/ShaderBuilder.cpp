@@ -33,6 +33,8 @@ ShaderBuilder::~ShaderBuilder() {
 }
 
 void ShaderBuilder::reset() {
+    mReference = nullptr;
+    mReferenceSize = 0;
     mCursor = 0;
     mShader[mCursor] = '\0';
 }
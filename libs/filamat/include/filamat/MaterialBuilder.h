@@ -37,13 +37,14 @@ namespace filamat {
 
 // Shader postprocessor, called after generation of a shader but before writing it to the package.
 // Must return false if an error occured while postProcessing the shader and true if everything was
-// ok.
+// ok. Only the outputs needed by the target API are non-null, outputMsl is set for Metal.
 using PostProcessCallBack = std::function<bool(
         const std::string& /* inputShader */,
         filament::driver::ShaderType,
         filament::driver::ShaderModel,
         std::string* /* outputGlsl */,
-        std::vector<uint32_t>* /* outputSpirv */ )>;
+        std::vector<uint32_t>* /* outputSpirv */,
+        std::string* /* outputMsl */ )>;
 
 struct MaterialInfo;
 
@@ -57,10 +58,13 @@ public:
         ALL
     };
 
+    // ALL is OPENGL and VULKAN. METAL is translated to MSL from the SPIR-V of the Vulkan
+    // shaders, it requires a post-processor.
     enum class TargetApi {
         ALL,
         OPENGL,
         VULKAN,
+        METAL,
     };
 
 protected:
@@ -97,6 +101,7 @@ public:
     using SamplerType = filament::driver::SamplerType;
     using SamplerFormat = filament::driver::SamplerFormat;
     using SamplerPrecision = filament::driver::Precision;
+    using ParameterPrecision = filament::driver::Precision;
     using CullingMode = filament::driver::CullingMode;
 
     // Each shader generated while building the package content can be post-processed via this
@@ -121,6 +126,20 @@ public:
     // add a parameter array to this material
     MaterialBuilder& parameter(UniformType type, size_t size, const char* name) noexcept;
 
+    // add a parameter with an explicit precision. By default the parameters are mediump on
+    // mobile, which suits colors, normals and roughness; positions, large distances or texture
+    // coordinates of large textures need ParameterPrecision::HIGH.
+    MaterialBuilder& parameter(UniformType type, ParameterPrecision precision,
+            const char* name) noexcept;
+    MaterialBuilder& parameter(UniformType type, size_t size, ParameterPrecision precision,
+            const char* name) noexcept;
+
+    // add a parameter that is set at draw time instead of being uploaded in a uniform buffer,
+    // for small parameters that change often. The materials access it as materialConstants.name.
+    // These are push constants on Vulkan and plain uniforms on OpenGL, they can't be arrays or
+    // mat3 and together they can't exceed CONFIG_MAX_PUSH_CONSTANTS_SIZE bytes.
+    MaterialBuilder& pushConstant(UniformType type, const char* name) noexcept;
+
     // add a sampler parameter to this material
     // When SamplerType::SAMPLER_EXTERNAL is specifed, format and precision are ignored
     MaterialBuilder& parameter(SamplerType samplerType, SamplerFormat format,
@@ -134,6 +153,12 @@ public:
     // custom variables (all float4)
     MaterialBuilder& variable(Variable v, const char* name) noexcept;
 
+    // custom variable with an explicit precision in the fragment shader. The variables are highp
+    // by default, since they often carry positions or texture coordinates, the ones that carry
+    // colors or directions can be mediump.
+    MaterialBuilder& variable(Variable v, const char* name,
+            ParameterPrecision precision) noexcept;
+
     // require a specified attribute, position is always required and normal
     // depends on the shading model
     MaterialBuilder& require(filament::VertexAttribute attribute) noexcept;
@@ -147,6 +172,11 @@ public:
     // must declare a function "void materialVertex(inout MaterialVertexInputs material)"
     MaterialBuilder& materialVertex(const char* code, size_t line = 0) noexcept;
 
+    // set the compute shader of this material, which is dispatched instead of drawn
+    // must declare the work group size and "void main()", with the storage buffers declared as
+    // "LAYOUT_STORAGE(binding) buffer", the parameters of the material can be read as uniforms
+    MaterialBuilder& compute(const char* code, size_t line = 0) noexcept;
+
     // set blending mode for this material
     MaterialBuilder& blending(BlendingMode blending) noexcept;
 
@@ -182,7 +212,7 @@ public:
     // (used to generate code) and final output representations (spirv and/or text).
     MaterialBuilder& platform(Platform platform) noexcept;
 
-    // specifies vulkan vs opengl; works in concert with Platform to determine the shader models
+    // specifies opengl, vulkan or metal; works in concert with Platform to determine the shader models
     // (used to generate code) and final output representations (spirv and/or text).
     MaterialBuilder& targetApi(TargetApi targetApi) noexcept;
 
@@ -194,6 +224,25 @@ public:
     // specifies a list of variants that should be filtered out during code generation.
     MaterialBuilder& variantFilter(uint8_t variantFilter) noexcept;
 
+    // number of threads used to generate and post-process the shaders, the post-processor
+    // must be thread-safe if it's more than 1. The package doesn't depend on it.
+    MaterialBuilder& threadCount(size_t count) noexcept;
+
+    // compresses the shader dictionaries of the package. The packages are smaller but can only
+    // be read by filaflat versions that support compressed dictionaries.
+    MaterialBuilder& compressDictionaries(bool compress) noexcept;
+
+    // on Vulkan, generates a single fragment shader for both values of the dynamic lighting
+    // variant, which is selected with a specialization constant when the pipeline is created.
+    // This halves the number of fragment shaders of lit materials.
+    MaterialBuilder& specializeDynamicLighting(bool specialize) noexcept;
+
+    // on desktop OpenGL, reads the textures of the samplers through ARB_bindless_texture handles
+    // taken from a table shared by all the materials, the material instances only set indices in
+    // their uniforms. The other targets are not affected. External samplers are never bindless.
+    // Because the post-processor doesn't support this extension, these shaders aren't optimized.
+    MaterialBuilder& bindlessSamplers(bool bindless) noexcept;
+
     // build the material
     Package build() noexcept;
 
@@ -204,8 +253,10 @@ public:
         Parameter(const char* paramName, SamplerType t, SamplerFormat f, SamplerPrecision p)
                 : name(paramName), size(1), samplerType(t), samplerFormat(f), samplerPrecision(p),
                 isSampler(true) { }
-        Parameter(const char* paramName, UniformType t, size_t typeSize)
-                : name(paramName), size(typeSize), uniformType(t), isSampler(false) { }
+        Parameter(const char* paramName, UniformType t, size_t typeSize,
+                ParameterPrecision p = ParameterPrecision::DEFAULT, bool pushConstant = false)
+                : name(paramName), size(typeSize), uniformType(t), isSampler(false),
+                isPushConstant(pushConstant), uniformPrecision(p) { }
         utils::CString name;
         size_t size;
         union {
@@ -217,19 +268,23 @@ public:
             };
         };
         bool isSampler;
+        bool isPushConstant = false;
+        ParameterPrecision uniformPrecision = ParameterPrecision::DEFAULT;
     };
 
     // Preview the first shader that would generated in the MaterialPackage.
     // This is used to run Static Code Analysis before generating a package.
-    // Outputs the chosen shader model in the model parameter
+    // Outputs the chosen shader model and code generation target API in the model and
+    // codeGenTargetApi parameters
     const std::string peek(filament::driver::ShaderType type,
-            filament::driver::ShaderModel& model) noexcept;
+            filament::driver::ShaderModel& model, TargetApi& codeGenTargetApi) noexcept;
 
     // Returns true if any of the parameter samplers is of type samplerExternal
     bool hasExternalSampler() const noexcept;
 
     using PropertyList = bool[filament::MATERIAL_PROPERTIES_COUNT];
     using VariableList = utils::CString[filament::MATERIAL_VARIABLES_COUNT];
+    using VariablePrecisionList = ParameterPrecision[filament::MATERIAL_VARIABLES_COUNT];
 
     static constexpr size_t MAX_PARAMETERS_COUNT = 32;
     using ParameterList = Parameter[MAX_PARAMETERS_COUNT];
@@ -257,10 +312,13 @@ private:
     utils::CString mMaterialVertexCode;
     size_t mMaterialLineOffset = 0;
     size_t mMaterialVertexLineOffset = 0;
+    utils::CString mComputeCode;
+    size_t mComputeLineOffset = 0;
 
     PropertyList mProperties;
     ParameterList mParameters;
     VariableList mVariables;
+    VariablePrecisionList mVariablePrecisions;
 
     BlendingMode mBlendingMode = BlendingMode::OPAQUE;
     CullingMode mCullingMode = CullingMode::BACK;
@@ -282,6 +340,10 @@ private:
     bool mDepthTest = true;
     bool mDepthWrite = true;
     bool mDepthWriteSet = false;
+    bool mCompressDictionaries = false;
+    bool mSpecializeDynamicLighting = false;
+    bool mBindlessSamplers = false;
+    size_t mThreadCount = 1;
 
     PostProcessCallBack mPostprocessorCallback = nullptr;
 };
@@ -16,8 +16,11 @@
 
 #include "filamat/MaterialBuilder.h"
 
+#include <algorithm>
+#include <string>
 #include <vector>
 
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 #include <utils/Log.h>
 
@@ -35,6 +38,7 @@
 #include "eiff/MaterialGlslChunk.h"
 #include "eiff/MaterialSpirvChunk.h"
 #include "eiff/ChunkContainer.h"
+#include "eiff/CompressedChunk.h"
 #include "eiff/SimpleFieldChunk.h"
 #include "eiff/DictionaryGlslChunk.h"
 #include "eiff/DictionarySpirvChunk.h"
@@ -78,12 +82,18 @@ void MaterialBuilderBase::prepare() {
             case TargetApi::VULKAN:
                 mCodeGenPermutations.push_back({i, TargetApi::VULKAN, TargetApi::VULKAN});
                 break;
+            case TargetApi::METAL:
+                // the MSL is translated from SPIR-V, which needs the Vulkan bindings
+                mCodeGenPermutations.push_back({i, TargetApi::METAL, TargetApi::VULKAN});
+                break;
         }
     }
 }
 
 MaterialBuilder::MaterialBuilder() : mMaterialName("Unnamed") {
     std::fill_n(mProperties, filament::MATERIAL_PROPERTIES_COUNT, false);
+    std::fill_n(mVariablePrecisions, filament::MATERIAL_VARIABLES_COUNT,
+            ParameterPrecision::DEFAULT);
     mShaderModels.reset();
 }
 
@@ -104,6 +114,12 @@ MaterialBuilder& MaterialBuilder::materialVertex(const char* code, size_t line)
     return *this;
 }
 
+MaterialBuilder& MaterialBuilder::compute(const char* code, size_t line) noexcept {
+    mComputeCode = CString(code);
+    mComputeLineOffset = line;
+    return *this;
+}
+
 MaterialBuilder& MaterialBuilder::shading(Shading shading) noexcept {
     mShading = shading;
     return *this;
@@ -141,6 +157,11 @@ MaterialBuilder& MaterialBuilder::set(Property p) noexcept {
 }
 
 MaterialBuilder& MaterialBuilder::variable(Variable v, const char* name) noexcept {
+    return variable(v, name, ParameterPrecision::DEFAULT);
+}
+
+MaterialBuilder& MaterialBuilder::variable(Variable v, const char* name,
+        ParameterPrecision precision) noexcept {
     switch (v) {
         case Variable::CUSTOM0:
         case Variable::CUSTOM1:
@@ -148,6 +169,7 @@ MaterialBuilder& MaterialBuilder::variable(Variable v, const char* name) noexcep
         case Variable::CUSTOM3:
             assert(size_t(v) < filament::MATERIAL_VARIABLES_COUNT);
             mVariables[size_t(v)] = CString(name);
+            mVariablePrecisions[size_t(v)] = precision;
             break;
     }
     return *this;
@@ -165,6 +187,25 @@ MaterialBuilder& MaterialBuilder::parameter(UniformType type, size_t size, const
     return *this;
 }
 
+MaterialBuilder& MaterialBuilder::parameter(UniformType type, ParameterPrecision precision,
+        const char* name) noexcept {
+    return parameter(type, 1, precision, name);
+}
+
+MaterialBuilder& MaterialBuilder::parameter(UniformType type, size_t size,
+        ParameterPrecision precision, const char* name) noexcept {
+    ASSERT_POSTCONDITION(mParameterCount < MAX_PARAMETERS_COUNT, "Too many parameters");
+    mParameters[mParameterCount++] = { name, type, size, precision };
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::pushConstant(UniformType type, const char* name) noexcept {
+    ASSERT_POSTCONDITION(mParameterCount < MAX_PARAMETERS_COUNT, "Too many parameters");
+    ASSERT_PRECONDITION(type != UniformType::MAT3, "mat3 push constants are not supported");
+    mParameters[mParameterCount++] = { name, type, 1, ParameterPrecision::DEFAULT, true };
+    return *this;
+}
+
 MaterialBuilder& MaterialBuilder::parameter(
         SamplerType samplerType, SamplerFormat format, SamplerPrecision precision, const char* name) noexcept {
     ASSERT_POSTCONDITION(mParameterCount < MAX_PARAMETERS_COUNT, "Too many parameters");
@@ -265,6 +306,26 @@ MaterialBuilder& MaterialBuilder::variantFilter(uint8_t variantFilter) noexcept
     return *this;
 }
 
+MaterialBuilder& MaterialBuilder::threadCount(size_t count) noexcept {
+    mThreadCount = count;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::compressDictionaries(bool compress) noexcept {
+    mCompressDictionaries = compress;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::specializeDynamicLighting(bool specialize) noexcept {
+    mSpecializeDynamicLighting = specialize;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::bindlessSamplers(bool bindless) noexcept {
+    mBindlessSamplers = bindless;
+    return *this;
+}
+
 bool MaterialBuilder::hasExternalSampler() const noexcept {
     for (size_t i = 0, c = mParameterCount; i < c; i++) {
         auto const& param = mParameters[i];
@@ -281,14 +342,24 @@ void MaterialBuilder::prepareToBuild(MaterialInfo& info) noexcept {
     // Build the per-material sampler block and uniform block.
     filament::SamplerInterfaceBlock::Builder sbb;
     filament::UniformInterfaceBlock::Builder ibb;
+    filament::UniformInterfaceBlock::Builder pbb;
+    bool hasBindlessSamplers = false;
     for (size_t i = 0, c = mParameterCount; i < c; i++) {
         auto const& param = mParameters[i];
         CString const& uniformName = param.name;
         if (param.isSampler) {
             sbb.add(uniformName.c_str(), param.samplerType, param.samplerFormat,
                     param.samplerPrecision);
+            if (mBindlessSamplers && param.samplerType != SamplerType::SAMPLER_EXTERNAL) {
+                // index of the texture in the table of bindless textures
+                std::string indexName(std::string(uniformName.c_str()) + "BindlessIndex");
+                ibb.add(indexName.c_str(), 1, UniformType::UINT);
+                hasBindlessSamplers = true;
+            }
+        } else if (param.isPushConstant) {
+            pbb.add(uniformName.c_str(), param.size, param.uniformType, param.uniformPrecision);
         } else {
-            ibb.add(uniformName.c_str(), param.size, param.uniformType);
+            ibb.add(uniformName.c_str(), param.size, param.uniformType, param.uniformPrecision);
         }
     }
 
@@ -303,6 +374,7 @@ void MaterialBuilder::prepareToBuild(MaterialInfo& info) noexcept {
 
     info.sib = sbb.name("MaterialParams").build();
     info.uib = ibb.name("MaterialParams").build();
+    info.pushConstants = pbb.name("MaterialConstants").build();
 
     info.isLit = isLit();
     info.isDoubleSided = mDoubleSided;
@@ -311,6 +383,7 @@ void MaterialBuilder::prepareToBuild(MaterialInfo& info) noexcept {
     info.blendingMode = mBlendingMode;
     info.shading = mShading;
     info.hasShadowMultiplier = mShadowMultiplier;
+    info.hasBindlessSamplers = hasBindlessSamplers;
     info.samplerBindings.populate(&info.sib);
 }
 
@@ -322,10 +395,12 @@ static void showErrorMessage(const char* materialName, uint8_t variant,
     utils::slog.e
             << "Error in \"" << materialName << "\""
             << ", Variant 0x" << io::hex << (int) variant
-            << (targetApi == TargetApi::VULKAN ? ", Vulkan.\n" : ", OpenGL.\n")
+            << (targetApi == TargetApi::VULKAN ? ", Vulkan.\n" :
+                targetApi == TargetApi::METAL ? ", Metal.\n" : ", OpenGL.\n")
             << "=========================\n"
             << "Generated "
-            << (shaderType == ShaderType::VERTEX ? "Vertex Shader\n" : "Fragment Shader\n")
+            << (shaderType == ShaderType::VERTEX ? "Vertex Shader\n" :
+                shaderType == ShaderType::COMPUTE ? "Compute Shader\n" : "Fragment Shader\n")
             << "=========================\n"
             << shaderCode;
 }
@@ -334,6 +409,15 @@ Package MaterialBuilder::build() noexcept {
     MaterialInfo info;
     prepareToBuild(info);
 
+    if (info.pushConstants.getSize() > filament::CONFIG_MAX_PUSH_CONSTANTS_SIZE) {
+        utils::slog.e << "Error in \"" << mMaterialName.c_str_safe() << "\": the push constants "
+                << "take " << info.pushConstants.getSize() << " bytes, the maximum is "
+                << filament::CONFIG_MAX_PUSH_CONSTANTS_SIZE << "." << io::endl;
+        Package package;
+        package.setValid(false);
+        return package;
+    }
+
     // Create chunk tree.
     ChunkContainer container;
 
@@ -360,6 +444,12 @@ Package MaterialBuilder::build() noexcept {
         container.addChild(&matShadowMultiplier);
     }
 
+    SimpleFieldChunk<bool> matBindlessSamplers(ChunkType::MaterialBindlessSamplers,
+            info.hasBindlessSamplers);
+    if (info.hasBindlessSamplers) {
+        container.addChild(&matBindlessSamplers);
+    }
+
     SimpleFieldChunk<uint8_t> matTransparency(ChunkType::MaterialTransparencyMode,
             static_cast<uint8_t>(mTransparencyMode));
     container.addChild(&matTransparency);
@@ -372,12 +462,19 @@ Package MaterialBuilder::build() noexcept {
     MaterialUniformInterfaceBlockChunk matUib = MaterialUniformInterfaceBlockChunk(info.uib);
     container.addChild(&matUib);
 
+    // Push constants
+    MaterialUniformInterfaceBlockChunk matPushConstants = MaterialUniformInterfaceBlockChunk(
+            info.pushConstants, ChunkType::MaterialPushConstants);
+    if (!info.pushConstants.isEmpty()) {
+        container.addChild(&matPushConstants);
+    }
+
     // SIB
     MaterialSamplerInterfaceBlockChunk matSib = MaterialSamplerInterfaceBlockChunk(info.sib);
     container.addChild(&matSib);
 
     MaterialSamplerBindingsChunk matSb = MaterialSamplerBindingsChunk(info.samplerBindings);
-    if (mTargetApi == TargetApi::VULKAN || mTargetApi == TargetApi::ALL) {
+    if (mTargetApi != TargetApi::OPENGL) {
         container.addChild(&matSb);
     }
 
@@ -411,9 +508,11 @@ Package MaterialBuilder::build() noexcept {
             static_cast<uint8_t>(mInterpolation));
     container.addChild(&matInterpolation);
 
-    // In order to generate SPIR-V, we must run the GLSL through the post-processor.
-    if (mCodeGenTargetApi != TargetApi::OPENGL && mPostprocessorCallback == nullptr) {
-        utils::slog.e << "SPIR-V requested for " << mMaterialName.c_str()
+    // In order to generate SPIR-V or MSL, we must run the GLSL through the post-processor.
+    if ((mCodeGenTargetApi != TargetApi::OPENGL || mTargetApi == TargetApi::METAL) &&
+            mPostprocessorCallback == nullptr) {
+        utils::slog.e << (mTargetApi == TargetApi::METAL ? "MSL" : "SPIR-V")
+                << " requested for " << mMaterialName.c_str()
                 << " but there is no post-processor." << utils::io::endl;
     }
 
@@ -423,12 +522,12 @@ Package MaterialBuilder::build() noexcept {
 
     // Generate all shaders.
     std::vector<GlslEntry> glslEntries;
+    std::vector<GlslEntry> mslEntries;
     std::vector<SpirvEntry> spirvEntries;
     LineDictionary glslDictionary;
     BlobDictionary spirvDictionary;
-    std::vector<uint32_t> spirv;
 
-    ShaderGenerator sg(mProperties, mVariables,
+    ShaderGenerator sg(mProperties, mVariables, mVariablePrecisions,
             mMaterialCode, mMaterialLineOffset, mMaterialVertexCode, mMaterialVertexLineOffset);
 
     bool emptyVertexCode = mMaterialVertexCode.empty();
@@ -437,21 +536,26 @@ Package MaterialBuilder::build() noexcept {
     SimpleFieldChunk<bool> hasCustomDepth(ChunkType::MaterialHasCustomDepthShader, customDepth);
     container.addChild(&hasCustomDepth);
 
-    bool errorOccured = false;
+    // The shaders are generated (and post-processed, which is the expensive part) in parallel,
+    // and added to the dictionaries afterwards, in the same order as they're listed, so the
+    // package doesn't depend on the number of threads.
+    struct ShaderJob {
+        CodeGenParams const* params;
+        uint8_t variant;
+        filament::driver::ShaderType stage;
+        std::string shader;
+        std::vector<uint32_t> spirv;
+        bool ok;
+        // the shader is the one of the variant without dynamic lighting, specialized at runtime
+        bool specialized;
+    };
+    std::vector<ShaderJob> shaderJobs;
     for (const auto& params : mCodeGenPermutations) {
-        const ShaderModel shaderModel = ShaderModel(params.shaderModel);
-        const TargetApi targetApi = params.targetApi;
-        const TargetApi codeGenTargetApi = params.codeGenTargetApi;
-        std::vector<uint32_t>* pSpirv = (targetApi == TargetApi::VULKAN) ? &spirv : nullptr;
-
-        GlslEntry glslEntry;
-        SpirvEntry spirvEntry;
-
-        glslEntry.shaderModel = static_cast<uint8_t>(params.shaderModel);
-        spirvEntry.shaderModel = static_cast<uint8_t>(params.shaderModel);
-
         // apply custom variants filters
         uint8_t variantMask = ~mVariantFilter;
+        const bool specialize = mSpecializeDynamicLighting &&
+                params.targetApi == TargetApi::VULKAN &&
+                (variantMask & filament::Variant::DYNAMIC_LIGHTING);
 
         for (uint8_t k = 0; k < filament::VARIANT_COUNT; k++) {
 
@@ -459,90 +563,150 @@ Package MaterialBuilder::build() noexcept {
                 continue;
             }
 
-            glslEntry.variant = k;
-            spirvEntry.variant = k;
-
             // Remove variants for unlit materials
             uint8_t v = filament::Variant::filterVariant(k & variantMask, isLit() || mShadowMultiplier);
 
             if (filament::Variant::filterVariantVertex(v) == k) {
-                // Vertex Shader
-                std::string vs = sg.createVertexProgram(
-                        shaderModel, targetApi, codeGenTargetApi, info, k,
-                        mInterpolation, mVertexDomain);
-                if (mPostprocessorCallback != nullptr) {
-                    bool ok = mPostprocessorCallback(vs, filament::driver::ShaderType::VERTEX,
-                            shaderModel, &vs, pSpirv);
-                    if (!ok) {
-                        showErrorMessage(mMaterialName.c_str_safe(), k, targetApi,
-                                filament::driver::ShaderType::VERTEX, vs);
-                        errorOccured = true;
-                        break;
-                    }
-                }
-                if (targetApi == TargetApi::OPENGL) {
-                    glslEntry.stage = filament::driver::ShaderType::VERTEX;
-                    glslEntry.shaderSize = vs.size();
-                    glslEntry.shader = (char*)malloc(glslEntry.shaderSize + 1);
-                    strcpy(glslEntry.shader, vs.c_str());
-                    glslDictionary.addText(glslEntry.shader);
-                    glslEntries.push_back(glslEntry);
-                }
-                if (targetApi == TargetApi::VULKAN) {
-                    assert(spirv.size() > 0);
-                    spirvEntry.stage = filament::driver::ShaderType::VERTEX;
-                    spirvEntry.dictionaryIndex = spirvDictionary.addBlob(spirv);
-                    spirv.clear();
-                    spirvEntries.push_back(spirvEntry);
-                }
+                shaderJobs.push_back({ &params, k, filament::driver::ShaderType::VERTEX });
             }
-
             if (filament::Variant::filterVariantFragment(v) == k) {
-                // Fragment Shader
-                std::string fs = sg.createFragmentProgram(
-                        shaderModel, targetApi, codeGenTargetApi, info, k, mInterpolation);
-                if (mPostprocessorCallback != nullptr) {
-                    bool ok = mPostprocessorCallback(fs, filament::driver::ShaderType::FRAGMENT,
-                            shaderModel, &fs, pSpirv);
-                    if (!ok) {
-                        showErrorMessage(mMaterialName.c_str_safe(), k, targetApi,
-                                filament::driver::ShaderType::FRAGMENT, fs);
-                        errorOccured = true;
-                        break;
-                    }
-                }
-                if (targetApi == TargetApi::OPENGL) {
-                    glslEntry.stage = filament::driver::ShaderType::FRAGMENT;
-                    glslEntry.shaderSize = fs.size();
-                    glslEntry.shader = (char*)malloc(glslEntry.shaderSize + 1);
-                    strcpy(glslEntry.shader, fs.c_str());
-                    glslDictionary.addText(glslEntry.shader);
-                    glslEntries.push_back(glslEntry);
-                }
-                if (targetApi == TargetApi::VULKAN) {
-                    assert(spirv.size() > 0);
-                    spirvEntry.stage = filament::driver::ShaderType::FRAGMENT;
-                    spirvEntry.dictionaryIndex = spirvDictionary.addBlob(spirv);
-                    spirv.clear();
-                    spirvEntries.push_back(spirvEntry);
-                }
+                shaderJobs.push_back({ &params, k, filament::driver::ShaderType::FRAGMENT });
+                shaderJobs.back().specialized =
+                        specialize && filament::Variant(k).hasDynamicLighting();
+            }
+        }
+
+        // the compute shader has no variants
+        if (!mComputeCode.empty()) {
+            shaderJobs.push_back({ &params, 0, filament::driver::ShaderType::COMPUTE });
+        }
+    }
+
+    auto generate = [this, &sg, &info](ShaderJob& job) {
+        if (job.specialized) {
+            job.ok = true;
+            return;
+        }
+        const ShaderModel shaderModel = ShaderModel(job.params->shaderModel);
+        const TargetApi targetApi = job.params->targetApi;
+        // The bindless shaders can't go through the post-processor's intermediate representation,
+        // they are generated for OpenGL directly.
+        const bool bindless = info.hasBindlessSamplers && targetApi == TargetApi::OPENGL &&
+                shaderModel == ShaderModel::GL_CORE_41;
+        const TargetApi codeGenTargetApi = bindless ? TargetApi::OPENGL :
+                job.params->codeGenTargetApi;
+        std::vector<uint32_t>* pSpirv = (targetApi == TargetApi::VULKAN) ? &job.spirv : nullptr;
+        std::string* pMsl = (targetApi == TargetApi::METAL) ? &job.shader : nullptr;
+        if (job.stage == filament::driver::ShaderType::VERTEX) {
+            job.shader = sg.createVertexProgram(shaderModel, targetApi, codeGenTargetApi, info,
+                    job.variant, mInterpolation, mVertexDomain);
+        } else if (job.stage == filament::driver::ShaderType::COMPUTE) {
+            job.shader = ShaderGenerator::createComputeProgram(shaderModel, targetApi,
+                    job.params->codeGenTargetApi, info, mComputeCode, mComputeLineOffset);
+        } else {
+            job.shader = sg.createFragmentProgram(shaderModel, targetApi, codeGenTargetApi, info,
+                    job.variant, mInterpolation, mSpecializeDynamicLighting &&
+                    !(mVariantFilter & filament::Variant::DYNAMIC_LIGHTING));
+        }
+        job.ok = true;
+        if (mPostprocessorCallback != nullptr && !bindless) {
+            job.ok = mPostprocessorCallback(job.shader, job.stage, shaderModel,
+                    pMsl ? nullptr : &job.shader, pSpirv, pMsl);
+        }
+    };
+
+    if (mThreadCount > 1 && shaderJobs.size() > 1) {
+        utils::JobSystem js(mThreadCount - 1);
+        js.adopt();
+        auto work = [&generate, &shaderJobs](uint32_t start, uint32_t count) {
+            for (uint32_t i = start; i < start + count; i++) {
+                generate(shaderJobs[i]);
+            }
+        };
+        js.runAndWait(utils::jobs::parallel_for(js, nullptr, 0, uint32_t(shaderJobs.size()),
+                std::cref(work), utils::jobs::CountSplitter<1>()));
+        js.emancipate();
+    } else {
+        for (ShaderJob& job : shaderJobs) {
+            generate(job);
+        }
+    }
+
+    bool errorOccured = false;
+    CodeGenParams const* failedParams = nullptr;
+    for (ShaderJob& job : shaderJobs) {
+        const TargetApi targetApi = job.params->targetApi;
+        if (job.params == failedParams) {
+            // after an error, the other shaders of this shader model are dropped
+            continue;
+        }
+        if (!job.ok) {
+            showErrorMessage(mMaterialName.c_str_safe(), job.variant, targetApi, job.stage,
+                    job.shader);
+            errorOccured = true;
+            failedParams = job.params;
+            continue;
+        }
+        if (targetApi == TargetApi::OPENGL || targetApi == TargetApi::METAL) {
+            // the MSL shares the text dictionary of the GLSL
+            GlslEntry glslEntry;
+            glslEntry.shaderModel = static_cast<uint8_t>(job.params->shaderModel);
+            glslEntry.variant = job.variant;
+            glslEntry.stage = job.stage;
+            glslEntry.shaderSize = job.shader.size();
+            glslEntry.shader = (char*)malloc(glslEntry.shaderSize + 1);
+            strcpy(glslEntry.shader, job.shader.c_str());
+            glslDictionary.addText(glslEntry.shader);
+            (targetApi == TargetApi::METAL ? mslEntries : glslEntries).push_back(glslEntry);
+        }
+        if (targetApi == TargetApi::VULKAN) {
+            SpirvEntry spirvEntry;
+            spirvEntry.shaderModel = static_cast<uint8_t>(job.params->shaderModel);
+            spirvEntry.variant = job.variant;
+            spirvEntry.stage = job.stage;
+            if (job.specialized) {
+                // the variant without dynamic lighting always comes first
+                const uint8_t base = job.variant & uint8_t(~filament::Variant::DYNAMIC_LIGHTING);
+                auto pos = std::find_if(spirvEntries.rbegin(), spirvEntries.rend(),
+                        [&](SpirvEntry const& entry) {
+                            return entry.shaderModel == spirvEntry.shaderModel &&
+                                    entry.stage == job.stage && entry.variant == base;
+                        });
+                assert(pos != spirvEntries.rend());
+                spirvEntry.dictionaryIndex = pos->dictionaryIndex;
+            } else {
+                assert(job.spirv.size() > 0);
+                spirvEntry.dictionaryIndex = spirvDictionary.addBlob(job.spirv);
             }
+            spirvEntries.push_back(spirvEntry);
         }
     }
 
     // Emit GLSL chunks (TextDictionaryReader and MaterialGlslChunk).
     filamat::DictionaryGlslChunk dicGlslChunk(glslDictionary);
+    filamat::CompressedChunk compressedDicGlslChunk(ChunkType::DictionaryGlslCompressed,
+            dicGlslChunk);
     MaterialGlslChunk glslChunk(glslEntries, glslDictionary);
+    MaterialGlslChunk mslChunk(mslEntries, glslDictionary, ChunkType::MaterialMetal);
+    if (!glslEntries.empty() || !mslEntries.empty()) {
+        container.addChild(mCompressDictionaries ?
+                static_cast<Chunk*>(&compressedDicGlslChunk) : &dicGlslChunk);
+    }
     if (!glslEntries.empty()) {
-        container.addChild(&dicGlslChunk);
         container.addChild(&glslChunk);
     }
+    if (!mslEntries.empty()) {
+        container.addChild(&mslChunk);
+    }
 
     // Emit SPIRV chunks (SpirvDictionaryReader and MaterialSpirvChunk).
     filamat::DictionarySpirvChunk dicSpirvChunk(spirvDictionary);
+    filamat::CompressedChunk compressedDicSpirvChunk(ChunkType::DictionarySpirvCompressed,
+            dicSpirvChunk);
     MaterialSpirvChunk spirvChunk(spirvEntries);
     if (!spirvEntries.empty()) {
-        container.addChild(&dicSpirvChunk);
+        container.addChild(mCompressDictionaries ?
+                static_cast<Chunk*>(&compressedDicSpirvChunk) : &dicSpirvChunk);
         container.addChild(&spirvChunk);
     }
 
@@ -557,6 +721,9 @@ Package MaterialBuilder::build() noexcept {
     for (GlslEntry entry : glslEntries) {
         free(entry.shader);
     }
+    for (GlslEntry entry : mslEntries) {
+        free(entry.shader);
+    }
     return package;
 }
 
@@ -566,9 +733,9 @@ MaterialBuilder& MaterialBuilder::postProcessor(PostProcessCallBack callback) {
 }
 
 const std::string MaterialBuilder::peek(filament::driver::ShaderType type,
-        filament::driver::ShaderModel& model) noexcept {
+        filament::driver::ShaderModel& model, TargetApi& codeGenTargetApi) noexcept {
 
-    ShaderGenerator sg(mProperties, mVariables,
+    ShaderGenerator sg(mProperties, mVariables, mVariablePrecisions,
             mMaterialCode, mMaterialLineOffset, mMaterialVertexCode, mMaterialVertexLineOffset);
 
     MaterialInfo info;
@@ -577,7 +744,7 @@ const std::string MaterialBuilder::peek(filament::driver::ShaderType type,
     for (const auto& params : mCodeGenPermutations) {
         model = ShaderModel(params.shaderModel);
         const TargetApi targetApi = params.targetApi;
-        const TargetApi codeGenTargetApi = params.codeGenTargetApi;
+        codeGenTargetApi = params.codeGenTargetApi;
         if (type == filament::driver::ShaderType::VERTEX) {
             return sg.createVertexProgram(model, targetApi, codeGenTargetApi,
                     info, 0, mInterpolation, mVertexDomain);
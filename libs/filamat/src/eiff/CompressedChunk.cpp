@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "CompressedChunk.h"
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace filamat {
+
+// The content is a series of sequences made of a token (high nibble: literal count, low nibble:
+// match length - MIN_MATCH; 15 means the count continues in the following bytes, each adding up
+// to 255), the literals, and a 16-bit offset to the match in the bytes already decoded. The last
+// sequence only has literals.
+static constexpr size_t MIN_MATCH = 4;
+static constexpr size_t MAX_OFFSET = 0xFFFF;
+static constexpr size_t HASH_BITS = 16;
+
+static inline uint32_t read32(const uint8_t* p) noexcept {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void writeCount(std::vector<uint8_t>& dst, size_t count) {
+    for ( ; count >= 255; count -= 255) {
+        dst.push_back(255);
+    }
+    dst.push_back(uint8_t(count));
+}
+
+static void writeSequence(std::vector<uint8_t>& dst, const uint8_t* literals, size_t literalCount,
+        size_t offset, size_t matchLength) {
+    const size_t matchCount = matchLength ? matchLength - MIN_MATCH : 0;
+    dst.push_back(uint8_t((std::min(literalCount, size_t(15)) << 4) |
+            std::min(matchCount, size_t(15))));
+    if (literalCount >= 15) {
+        writeCount(dst, literalCount - 15);
+    }
+    dst.insert(dst.end(), literals, literals + literalCount);
+    if (matchLength) {
+        dst.push_back(uint8_t(offset & 0xFF));
+        dst.push_back(uint8_t(offset >> 8));
+        if (matchCount >= 15) {
+            writeCount(dst, matchCount - 15);
+        }
+    }
+}
+
+static void compress(std::vector<uint8_t>& dst, const uint8_t* src, size_t size) {
+    // the last position where each hash of 4 bytes was seen, + 1
+    std::vector<uint32_t> positions(1u << HASH_BITS, 0);
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + MIN_MATCH <= size) {
+        const uint32_t sequence = read32(src + i);
+        const uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+        const size_t candidate = positions[hash];
+        positions[hash] = uint32_t(i + 1);
+        if (candidate && i - (candidate - 1) <= MAX_OFFSET &&
+                read32(src + candidate - 1) == sequence) {
+            const size_t match = candidate - 1;
+            size_t length = MIN_MATCH;
+            while (i + length < size && src[match + length] == src[i + length]) {
+                length++;
+            }
+            writeSequence(dst, src + anchor, i - anchor, i - match, length);
+            i += length;
+            anchor = i;
+        } else {
+            i++;
+        }
+    }
+    writeSequence(dst, src + anchor, size - anchor, 0, 0);
+}
+
+CompressedChunk::CompressedChunk(ChunkType type, Chunk& chunk) : Chunk(type), mChunk(chunk) {
+}
+
+void CompressedChunk::flatten(Flattener& f) {
+    // the container flattens its chunks twice (to get the size first), compress only once
+    if (mCompressed.empty()) {
+        Flattener dryRunner(nullptr);
+        mChunk.flatten(dryRunner);
+        std::vector<uint8_t> content(dryRunner.getBytesWritten());
+        Flattener flattener(content.data());
+        mChunk.flatten(flattener);
+        compress(mCompressed, content.data(), content.size());
+        mContentSize = uint32_t(content.size());
+    }
+    f.writeUint32(COMPRESSION_LZ);
+    f.writeUint32(mContentSize);
+    f.writeBlob(reinterpret_cast<const char*>(mCompressed.data()), mCompressed.size());
+}
+
+} // namespace filamat
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef TNT_FILAMAT_COMPRESSED_CHUNK_H
+#define TNT_FILAMAT_COMPRESSED_CHUNK_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "Chunk.h"
+#include "Flattener.h"
+
+namespace filamat {
+
+// Stores the content of another chunk compressed, under its own type. The layout is:
+//     uint32 compression scheme (1: LZ blocks, see filaflat's CompressedChunkReader)
+//     uint32 size of the content once decompressed
+//     blob   compressed content
+class CompressedChunk : public Chunk {
+public:
+    static constexpr uint32_t COMPRESSION_LZ = 1;
+
+    CompressedChunk(ChunkType type, Chunk& chunk);
+    ~CompressedChunk() = default;
+
+    void flatten(Flattener& f) override;
+
+private:
+    Chunk& mChunk;
+    uint32_t mContentSize = 0;
+    std::vector<uint8_t> mCompressed;
+};
+
+} // namespace filamat
+
+#endif // TNT_FILAMAT_COMPRESSED_CHUNK_H
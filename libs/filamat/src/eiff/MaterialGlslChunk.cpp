@@ -19,8 +19,8 @@
 namespace filamat {
 
 MaterialGlslChunk::MaterialGlslChunk(const std::vector<GlslEntry> &entries,
-                                     LineDictionary &dictionary) :
-    GlslChunk(ChunkType::MaterialGlsl, entries, dictionary) {
+                                     LineDictionary &dictionary, ChunkType type) :
+    GlslChunk(type, entries, dictionary) {
 }
 
 void MaterialGlslChunk::writeEntryAttributes(size_t entryIndex, Flattener& f) {
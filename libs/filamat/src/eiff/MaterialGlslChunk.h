@@ -28,7 +28,9 @@ namespace filamat {
 
 class MaterialGlslChunk final : public GlslChunk<GlslEntry> {
 public:
-    MaterialGlslChunk(const std::vector<GlslEntry> &entries, LineDictionary &dictionary);
+    // the MSL shaders use the same chunk layout, with the type ChunkType::MaterialMetal
+    MaterialGlslChunk(const std::vector<GlslEntry> &entries, LineDictionary &dictionary,
+            ChunkType type = ChunkType::MaterialGlsl);
     ~MaterialGlslChunk() = default;
 protected:
     virtual const char* getShaderText(size_t entryIndex) const override;
@@ -21,8 +21,9 @@ using namespace filament;
 
 namespace filamat {
 
-MaterialUniformInterfaceBlockChunk::MaterialUniformInterfaceBlockChunk(UniformInterfaceBlock& uib) :
-        Chunk(ChunkType::MaterialUib),
+MaterialUniformInterfaceBlockChunk::MaterialUniformInterfaceBlockChunk(UniformInterfaceBlock& uib,
+        ChunkType type) :
+        Chunk(type),
         mUib(uib){
 }
 
@@ -28,7 +28,8 @@ namespace filamat {
 
 class MaterialUniformInterfaceBlockChunk : public Chunk {
 public:
-    MaterialUniformInterfaceBlockChunk(filament::UniformInterfaceBlock& uib);
+    MaterialUniformInterfaceBlockChunk(filament::UniformInterfaceBlock& uib,
+            ChunkType type = ChunkType::MaterialUib);
     virtual ~MaterialUniformInterfaceBlockChunk() = default;
 
     virtual void flatten(Flattener &) override;
@@ -34,14 +34,14 @@ std::ostream& CodeGenerator::generateSeparator(std::ostream& out) const {
 }
 
 std::ostream& CodeGenerator::generateProlog(std::ostream& out, ShaderType type,
-        bool hasExternalSamplers) const {
+        bool hasExternalSamplers, bool hasBindlessSamplers, bool hasFramebufferFetch) const {
     assert(mShaderModel != ShaderModel::UNKNOWN);
     switch (mShaderModel) {
         case ShaderModel::UNKNOWN:
             break;
         case ShaderModel::GL_ES_30:
-            // Vulkan requires version 310 or higher
-            if (mCodeGenTargetApi == TargetApi::VULKAN) {
+            // Vulkan requires version 310 or higher, and so do the compute shaders
+            if (mCodeGenTargetApi == TargetApi::VULKAN || type == ShaderType::COMPUTE) {
                 // Vulkan requires layout locations on ins and outs, which were not supported
                 // in the OpenGL 4.1 GLSL profile.
                 out << "#version 310 es\n\n";
@@ -51,6 +51,12 @@ std::ostream& CodeGenerator::generateProlog(std::ostream& out, ShaderType type,
             if (hasExternalSamplers) {
                 out << "#extension GL_OES_EGL_image_external_essl3 : require\n\n";
             }
+            if (hasFramebufferFetch && mCodeGenTargetApi == TargetApi::OPENGL) {
+                // the shader falls back to sampling when the extension isn't there
+                out << "#ifdef GL_EXT_shader_framebuffer_fetch\n";
+                out << "#extension GL_EXT_shader_framebuffer_fetch : enable\n";
+                out << "#endif\n\n";
+            }
             out << "#define TARGET_MOBILE\n";
             break;
         case ShaderModel::GL_CORE_41:
@@ -58,8 +64,14 @@ std::ostream& CodeGenerator::generateProlog(std::ostream& out, ShaderType type,
                 // Vulkan requires binding specifiers on uniforms and samplers, which were not
                 // supported in the OpenGL 4.1 GLSL profile.
                 out << "#version 450 core\n\n";
+            } else if (type == ShaderType::COMPUTE) {
+                // the compute shaders require OpenGL 4.3
+                out << "#version 430 core\n\n";
             } else {
                 out << "#version 410 core\n\n";
+                if (hasBindlessSamplers) {
+                    out << "#extension GL_ARB_bindless_texture : require\n\n";
+                }
             }
             break;
     }
@@ -67,6 +79,9 @@ std::ostream& CodeGenerator::generateProlog(std::ostream& out, ShaderType type,
     if (mTargetApi == TargetApi::VULKAN) {
         out << "#define TARGET_VULKAN_ENVIRONMENT\n";
     }
+    if (mTargetApi == TargetApi::METAL) {
+        out << "#define TARGET_METAL_ENVIRONMENT\n";
+    }
     if (mCodeGenTargetApi == TargetApi::VULKAN) {
         out << "#define CODEGEN_TARGET_VULKAN_ENVIRONMENT\n";
     }
@@ -81,6 +96,16 @@ std::ostream& CodeGenerator::generateProlog(std::ostream& out, ShaderType type,
         out << "invariant gl_Position;\n";
     }
 
+    // Vulkan reads the storage buffers from their own descriptor set, see VulkanDriver
+    if (type == ShaderType::COMPUTE) {
+        out << "\n";
+        if (mCodeGenTargetApi == TargetApi::VULKAN) {
+            out << "#define LAYOUT_STORAGE(x) layout(std430, set = 1, binding = x)\n";
+        } else {
+            out << "#define LAYOUT_STORAGE(x) layout(std430, binding = x)\n";
+        }
+    }
+
     out << filament::shaders::common_types_fs;
 
     out << "\n";
@@ -131,6 +156,8 @@ std::ostream& CodeGenerator::generatePostProcessMain(std::ostream& out,
         switch (variant) {
             case PostProcessStage::TONE_MAPPING_OPAQUE:
             case PostProcessStage::TONE_MAPPING_TRANSLUCENT:
+            case PostProcessStage::TONE_MAPPING_FRAMEBUFFER_FETCH_OPAQUE:
+            case PostProcessStage::TONE_MAPPING_FRAMEBUFFER_FETCH_TRANSLUCENT:
                 out << filament::shaders::tone_mapping_fs;
                 out << filament::shaders::conversion_functions_fs;
                 out << filament::shaders::dithering_fs;
@@ -139,6 +166,25 @@ std::ostream& CodeGenerator::generatePostProcessMain(std::ostream& out,
             case PostProcessStage::ANTI_ALIASING_TRANSLUCENT:
                 out << filament::shaders::fxaa_fs;
                 break;
+            case PostProcessStage::TONE_MAPPING_ANTI_ALIASING_OPAQUE:
+            case PostProcessStage::TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT:
+                // fxaa_fs tone maps its taps using the functions above
+                out << filament::shaders::tone_mapping_fs;
+                out << filament::shaders::conversion_functions_fs;
+                out << filament::shaders::dithering_fs;
+                out << filament::shaders::fxaa_fs;
+                break;
+            case PostProcessStage::TEMPORAL_UPSCALING:
+                break;
+            case PostProcessStage::IBL_ROUGHNESS_PREFILTER:
+            case PostProcessStage::IBL_IRRADIANCE_SH:
+            case PostProcessStage::IBL_DFG:
+            case PostProcessStage::IBL_PROBE_PREFILTER:
+                out << filament::shaders::ibl_prefilter_fs;
+                break;
+            case PostProcessStage::DEBUG_HEATMAP:
+            case PostProcessStage::ACCUMULATED_TRANSPARENCY:
+                break;
         }
         out << filament::shaders::post_process_fs;
     }
@@ -146,7 +192,7 @@ std::ostream& CodeGenerator::generatePostProcessMain(std::ostream& out,
 }
 
 std::ostream& CodeGenerator::generateVariable(std::ostream& out, ShaderType type,
-        const CString& name, size_t index) const {
+        const CString& name, Precision precision, size_t index) const {
 
     if (!name.empty()) {
         if (type == ShaderType::VERTEX) {
@@ -154,7 +200,13 @@ std::ostream& CodeGenerator::generateVariable(std::ostream& out, ShaderType type
             out << "\n#define VARIABLE_CUSTOM_AT" << index << " variable_" << name.c_str() << "\n";
             out << "LAYOUT_LOCATION(" << index << ") out vec4 variable_" << name.c_str() << ";\n";
         } else if (type == ShaderType::FRAGMENT) {
-            out << "\nLAYOUT_LOCATION(" << index << ") in highp vec4 variable_" << name.c_str() << ";\n";
+            // the vertex outputs keep the default highp, GLSL ES lets the precisions differ
+            if (precision == Precision::DEFAULT) {
+                precision = Precision::HIGH;
+            }
+            out << "\nLAYOUT_LOCATION(" << index << ") in "
+                << getPrecisionQualifier(precision, Precision::DEFAULT)
+                << " vec4 variable_" << name.c_str() << ";\n";
         }
     }
     return out;
@@ -244,16 +296,50 @@ std::ostream& CodeGenerator::generateUniforms(std::ostream& out, ShaderType shad
     std::string instanceName(uib.getName().c_str());
     instanceName.front() = char(std::tolower((unsigned char)instanceName.front()));
 
-    Precision uniformPrecision = getDefaultUniformPrecision();
-    Precision defaultPrecision = getDefaultPrecision(shaderType);
-
     out << "\nlayout(";
     if (mCodeGenTargetApi == TargetApi::VULKAN) {
         uint32_t bindingIndex = (uint32_t) binding; // avoid char output
         out << "binding = " << bindingIndex << ", ";
     }
     out << "std140) uniform " << blockName.c_str() << " {\n";
-    for (auto const& info : infos) {
+    generateUniformFields(out, shaderType, uib);
+    out << "} " << instanceName << ";\n";
+
+    return out;
+}
+
+std::ostream& CodeGenerator::generatePushConstants(std::ostream& out, ShaderType shaderType,
+        const UniformInterfaceBlock& uib) const {
+    if (uib.isEmpty()) {
+        return out;
+    }
+
+    const CString& blockName = uib.getName();
+    std::string instanceName(uib.getName().c_str());
+    instanceName.front() = char(std::tolower((unsigned char)instanceName.front()));
+
+    // OpenGL has no push constants, they're a struct of default-block uniforms instead, which
+    // is also what SPIR-V cross-compilers make of them.
+    if (mCodeGenTargetApi == TargetApi::VULKAN) {
+        out << "\nlayout(push_constant) uniform " << blockName.c_str() << " {\n";
+        generateUniformFields(out, shaderType, uib);
+        out << "} " << instanceName << ";\n";
+    } else {
+        out << "\nstruct " << blockName.c_str() << " {\n";
+        generateUniformFields(out, shaderType, uib);
+        out << "};\n";
+        out << "uniform " << blockName.c_str() << " " << instanceName << ";\n";
+    }
+
+    return out;
+}
+
+void CodeGenerator::generateUniformFields(std::ostream& out, ShaderType shaderType,
+        const UniformInterfaceBlock& uib) const {
+    Precision uniformPrecision = getDefaultUniformPrecision();
+    Precision defaultPrecision = getDefaultPrecision(shaderType);
+
+    for (auto const& info : uib.getUniformInfoList()) {
         char const* const type = getUniformTypeName(info.type);
         char const* const precision = getUniformPrecisionQualifier(info.type, info.precision,
                 uniformPrecision, defaultPrecision);
@@ -265,13 +351,11 @@ std::ostream& CodeGenerator::generateUniforms(std::ostream& out, ShaderType shad
         }
         out << ";\n";
     }
-    out << "} " << instanceName << ";\n";
-
-    return out;
 }
 
 std::ostream& CodeGenerator::generateSamplers(
-        std::ostream& out, uint8_t firstBinding, const SamplerInterfaceBlock& sib) const {
+        std::ostream& out, uint8_t firstBinding, const SamplerInterfaceBlock& sib,
+        bool bindless) const {
     auto const& infos = sib.getSamplerInfoList();
     if (infos.empty()) {
         return out;
@@ -289,6 +373,13 @@ std::ostream& CodeGenerator::generateSamplers(
             type = SamplerType::SAMPLER_2D;
         }
         char const* const typeName = getSamplerTypeName(type, info.format, info.multisample);
+        if (bindless && info.type != SamplerType::SAMPLER_EXTERNAL) {
+            // the sampler is made from its 64-bit handle
+            out << "#define " << instanceName << "_" << info.name.c_str() << " " << typeName <<
+                    "(bindlessTextures.handles[" << instanceName << "." << info.name.c_str() <<
+                    "BindlessIndex].xy)\n";
+            continue;
+        }
         char const* const precision = getPrecisionQualifier(info.precision, Precision::DEFAULT);
         if (mCodeGenTargetApi == TargetApi::VULKAN) {
             const uint32_t bindingIndex = (uint32_t) firstBinding + info.offset;
@@ -325,6 +416,14 @@ std::ostream& CodeGenerator::generateDefine(std::ostream& out, const char* name,
     return out;
 }
 
+std::ostream& CodeGenerator::generateSpecializationConstant(std::ostream& out, const char* name,
+        uint32_t id, bool value) const {
+    assert(mTargetApi == TargetApi::VULKAN);
+    out << "layout (constant_id = " << id << ") const bool " << name << " = "
+            << (value ? "true" : "false") << ";\n";
+    return out;
+}
+
 std::ostream& CodeGenerator::generateFunction(std::ostream& out, const char* returnType,
         const char* name, const char* body) const {
     out << "\n" << returnType << " " << name << "()";
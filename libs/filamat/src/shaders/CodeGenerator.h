@@ -50,11 +50,19 @@ public:
 
     filament::driver::ShaderModel getShaderModel() const noexcept { return mShaderModel; }
 
+    // bindless samplers are only generated for desktop OpenGL (ARB_bindless_texture)
+    bool supportsBindlessSamplers() const noexcept {
+        return mShaderModel == filament::driver::ShaderModel::GL_CORE_41 &&
+                mTargetApi == TargetApi::OPENGL && mCodeGenTargetApi == TargetApi::OPENGL;
+    }
+
     // insert a separator (can be a new line)
     std::ostream& generateSeparator(std::ostream& out) const;
 
-    // generate prolog for the given shader
-    std::ostream& generateProlog(std::ostream& out, ShaderType type, bool hasExternalSamplers) const;
+    // generate prolog for the given shader, 'hasFramebufferFetch' enables
+    // EXT_shader_framebuffer_fetch when the device has it
+    std::ostream& generateProlog(std::ostream& out, ShaderType type, bool hasExternalSamplers,
+            bool hasBindlessSamplers = false, bool hasFramebufferFetch = false) const;
 
     std::ostream& generateEpilog(std::ostream& out) const;
 
@@ -75,9 +83,10 @@ public:
     std::ostream& generateShaderUnlit(std::ostream& out, ShaderType type,
             filament::Variant variant, bool hasShadowMultiplier) const;
 
-    // generate in/out variable
+    // generate in/out variable, the precision only applies to the fragment shader's input
     std::ostream& generateVariable(std::ostream& out, ShaderType type,
-            const utils::CString& name, size_t index) const;
+            const utils::CString& name, filament::driver::Precision precision,
+            size_t index) const;
 
     // generate in/out variables
     std::ostream& generateVariables(std::ostream& out, ShaderType type,
@@ -90,9 +99,15 @@ public:
     std::ostream& generateUniforms(std::ostream& out, ShaderType type, uint8_t binding,
             const filament::UniformInterfaceBlock& uib) const;
 
-    // generate samplers
+    // generate the parameters set at draw time (push constants on Vulkan)
+    std::ostream& generatePushConstants(std::ostream& out, ShaderType type,
+            const filament::UniformInterfaceBlock& uib) const;
+
+    // generate samplers, the bindless samplers are read from the BindlessTextures uniforms with
+    // the indices set in the uniforms of the same block
     std::ostream& generateSamplers(
-        std::ostream& out, uint8_t firstBinding, const filament::SamplerInterfaceBlock& sib) const;
+        std::ostream& out, uint8_t firstBinding, const filament::SamplerInterfaceBlock& sib,
+        bool bindless = false) const;
 
     // generate material properties getters
     std::ostream& generateMaterialProperty(std::ostream& out,
@@ -106,10 +121,17 @@ public:
     std::ostream& generateDefine(std::ostream& out, const char* name, uint32_t value) const;
     std::ostream& generateDefine(std::ostream& out, const char* name, const char* string) const;
 
+    // declares a boolean specialization constant (Vulkan only)
+    std::ostream& generateSpecializationConstant(std::ostream& out, const char* name,
+            uint32_t id, bool value) const;
+
     std::ostream& generateGetters(std::ostream& out, ShaderType type) const;
     std::ostream& generateParameters(std::ostream& out, ShaderType type) const;
 
 private:
+    void generateUniformFields(std::ostream& out, ShaderType type,
+            const filament::UniformInterfaceBlock& uib) const;
+
     filament::driver::Precision getDefaultPrecision(ShaderType type) const;
     filament::driver::Precision getDefaultUniformPrecision() const;
 
@@ -37,10 +37,12 @@ struct UTILS_PUBLIC MaterialInfo {
     bool isDoubleSided;
     bool hasExternalSamplers;
     bool hasShadowMultiplier;
+    bool hasBindlessSamplers;
     filament::AttributeBitset requiredAttributes;
     filament::BlendingMode blendingMode;
     filament::Shading shading;
     filament::UniformInterfaceBlock uib;
+    filament::UniformInterfaceBlock pushConstants;
     filament::SamplerInterfaceBlock sib;
     filament::SamplerBindingMap samplerBindings;
 };
@@ -119,11 +119,14 @@ static void appendShader(std::stringstream& ss,
 ShaderGenerator::ShaderGenerator(
         MaterialBuilder::PropertyList const& properties,
         MaterialBuilder::VariableList const& variables,
+        MaterialBuilder::VariablePrecisionList const& variablePrecisions,
         utils::CString const& materialCode, size_t lineOffset,
         utils::CString const& materialVertexCode, size_t vertexLineOffset) noexcept {
 
     std::copy(std::begin(properties), std::end(properties), std::begin(mProperties));
     std::copy(std::begin(variables), std::end(variables), std::begin(mVariables));
+    std::copy(std::begin(variablePrecisions), std::end(variablePrecisions),
+            std::begin(mVariablePrecisions));
 
     mMaterialCode = materialCode;
     mMaterialVertexCode = materialVertexCode;
@@ -150,7 +153,14 @@ const std::string ShaderGenerator::createVertexProgram(filament::driver::ShaderM
     const bool lit = material.isLit;
     const filament::Variant variant(variantKey);
 
-    cg.generateProlog(vs, ShaderType::VERTEX, material.hasExternalSamplers);
+    const bool bindless = material.hasBindlessSamplers && cg.supportsBindlessSamplers();
+    cg.generateProlog(vs, ShaderType::VERTEX, material.hasExternalSamplers, bindless);
+
+    // these variants are special and are treated as DEPTH variants. Filament will never
+    // request that variant for the color pass.
+    const bool depthMain = variant.isDepthPass() &&
+            (material.blendingMode != BlendingMode::MASKED) &&
+            !hasCustomDepthShader();
 
     if (cg.getShaderModel() >= filament::driver::ShaderModel::GL_CORE_41) {
         // TODO: find a better way to set this, esp. on mobile
@@ -161,6 +171,9 @@ const std::string ShaderGenerator::createVertexProgram(filament::driver::ShaderM
     cg.generateDefine(vs, "HAS_DIRECTIONAL_LIGHTING", litVariants && variant.hasDirectionalLighting());
     cg.generateDefine(vs, "HAS_SHADOWING", litVariants && variant.hasShadowReceiver());
     cg.generateDefine(vs, "HAS_SKINNING", variant.hasSkinning());
+    // the depth shaders only skin the position, which is cheaper without blending the bones
+    cg.generateDefine(vs, "HAS_SKINNING_TRANSFORM", variant.hasSkinning() && !depthMain);
+    cg.generateDefine(vs, "HAS_MORPHING", variant.hasMorphing());
     cg.generateDefine(vs, getShadingDefine(material.shading), true);
     generateMaterialDefines(vs, cg, mProperties);
 
@@ -174,7 +187,9 @@ const std::string ShaderGenerator::createVertexProgram(filament::driver::ShaderM
     // custom material variables
     size_t variableIndex = 0;
     for (const auto& variable : mVariables) {
-        cg.generateVariable(vs, ShaderType::VERTEX, variable, variableIndex++);
+        cg.generateVariable(vs, ShaderType::VERTEX, variable,
+                mVariablePrecisions[variableIndex], variableIndex);
+        variableIndex++;
     }
 
     // materials defines
@@ -185,6 +200,8 @@ const std::string ShaderGenerator::createVertexProgram(filament::driver::ShaderM
             BindingPoints::PER_VIEW, UibGenerator::getPerViewUib());
     cg.generateUniforms(vs, ShaderType::VERTEX,
             BindingPoints::PER_RENDERABLE, UibGenerator::getPerRenderableUib());
+    cg.generateUniforms(vs, ShaderType::VERTEX,
+            BindingPoints::PER_INSTANCE, UibGenerator::getPerInstanceUib());
     if (variant.hasSkinning()) {
         cg.generateUniforms(vs, ShaderType::VERTEX,
                 BindingPoints::PER_RENDERABLE_BONES,
@@ -192,22 +209,28 @@ const std::string ShaderGenerator::createVertexProgram(filament::driver::ShaderM
     }
     cg.generateUniforms(vs, ShaderType::VERTEX,
             BindingPoints::PER_MATERIAL_INSTANCE, material.uib);
+    if (bindless) {
+        cg.generateUniforms(vs, ShaderType::VERTEX,
+                BindingPoints::BINDLESS_TEXTURES, UibGenerator::getBindlessTexturesUib());
+    }
+    cg.generatePushConstants(vs, ShaderType::VERTEX, material.pushConstants);
     cg.generateSeparator(vs);
     // TODO: should we generate per-view SIB in the vertex shader?
+    if (variant.hasMorphing()) {
+        cg.generateSamplers(vs,
+                material.samplerBindings.getBlockOffset(BindingPoints::PER_RENDERABLE),
+                SibGenerator::getPerRenderableSib());
+    }
     cg.generateSamplers(vs,
             material.samplerBindings.getBlockOffset(BindingPoints::PER_MATERIAL_INSTANCE),
-            material.sib);
+            material.sib, bindless);
 
     // shader code
     cg.generateCommon(vs, ShaderType::VERTEX);
     cg.generateGetters(vs, ShaderType::VERTEX);
     cg.generateCommonMaterial(vs, ShaderType::VERTEX);
 
-    if (variant.isDepthPass() &&
-        (material.blendingMode != BlendingMode::MASKED) &&
-        !hasCustomDepthShader()) {
-        // these variants are special and are treated as DEPTH variants. Filament will never
-        // request that variant for the color pass.
+    if (depthMain) {
         cg.generateDepthShaderMain(vs, ShaderType::VERTEX);
     } else {
         // main entry point
@@ -220,6 +243,27 @@ const std::string ShaderGenerator::createVertexProgram(filament::driver::ShaderM
     return vs.str();
 }
 
+const std::string ShaderGenerator::createComputeProgram(filament::driver::ShaderModel shaderModel,
+        MaterialBuilder::TargetApi targetApi, MaterialBuilder::TargetApi codeGenTargetApi,
+        MaterialInfo const& material,
+        utils::CString const& computeCode, size_t lineOffset) noexcept {
+    const CodeGenerator cg(shaderModel, targetApi, codeGenTargetApi);
+    std::stringstream cs;
+    cg.generateProlog(cs, ShaderType::COMPUTE, false);
+
+    // the samplers would need a descriptor set of their own on Vulkan, only the uniforms are
+    // available for now
+    cg.generateUniforms(cs, ShaderType::COMPUTE,
+            BindingPoints::PER_VIEW, UibGenerator::getPerViewUib());
+    cg.generateUniforms(cs, ShaderType::COMPUTE,
+            BindingPoints::PER_MATERIAL_INSTANCE, material.uib);
+    cg.generateSeparator(cs);
+
+    appendShader(cs, computeCode, lineOffset);
+    cg.generateEpilog(cs);
+    return cs.str();
+}
+
 bool ShaderGenerator::hasCustomDepthShader() const noexcept {
     for (const auto& variable : mVariables) {
         if (!variable.empty()) {
@@ -232,26 +276,50 @@ bool ShaderGenerator::hasCustomDepthShader() const noexcept {
 const std::string ShaderGenerator::createFragmentProgram(filament::driver::ShaderModel shaderModel,
         MaterialBuilder::TargetApi targetApi, MaterialBuilder::TargetApi codeGenTargetApi,
         MaterialInfo const& material, uint8_t variantKey,
-        filament::Interpolation interpolation) const noexcept {
+        filament::Interpolation interpolation, bool dynamicLightingConstant) const noexcept {
 
     const CodeGenerator cg(shaderModel, targetApi, codeGenTargetApi);
     const bool lit = material.isLit;
+
+    // When the dynamic lighting is a specialization constant, the shader is generated as if
+    // dynamic lighting was enabled and the constant skips it at runtime.
+    bool litVariants = lit || (!lit && material.hasShadowMultiplier);
+    dynamicLightingConstant = dynamicLightingConstant && litVariants &&
+            targetApi == MaterialBuilder::TargetApi::VULKAN &&
+            !filament::Variant(variantKey).isDepthPass();
+    if (dynamicLightingConstant) {
+        variantKey |= filament::Variant::DYNAMIC_LIGHTING;
+    }
     const filament::Variant variant(variantKey);
 
+    const bool bindless = material.hasBindlessSamplers && cg.supportsBindlessSamplers();
+
     std::stringstream fs;
-    cg.generateProlog(fs, ShaderType::FRAGMENT, material.hasExternalSamplers);
+    cg.generateProlog(fs, ShaderType::FRAGMENT, material.hasExternalSamplers, bindless);
 
     cg.generateDefine(fs, "IBL_USE_RGBM", filament::CONFIG_IBL_RGBM);
     cg.generateDefine(fs, "IBL_MAX_MIP_LEVEL", std::log2f(filament::CONFIG_IBL_SIZE));
+    cg.generateDefine(fs, "REFLECTION_PROBE_SIZE", float(filament::CONFIG_REFLECTION_PROBE_SIZE));
+    cg.generateDefine(fs, "REFLECTION_PROBE_MAX_MIP_LEVEL",
+            float(filament::CONFIG_REFLECTION_PROBE_LEVELS - 1));
+    cg.generateDefine(fs, "REFLECTION_PROBE_ATLAS_COLUMNS",
+            uint32_t(filament::CONFIG_REFLECTION_PROBE_ATLAS_COLUMNS));
+    cg.generateDefine(fs, "REFLECTION_PROBE_ATLAS_ROWS",
+            uint32_t(filament::CONFIG_MAX_REFLECTION_PROBES /
+                    filament::CONFIG_REFLECTION_PROBE_ATLAS_COLUMNS));
 
     // this should probably be a code generation option
     cg.generateDefine(fs, "USE_MULTIPLE_SCATTERING_COMPENSATION", true);
 
     // lighting variants
-    bool litVariants = lit || (!lit && material.hasShadowMultiplier);
     cg.generateDefine(fs, "HAS_DIRECTIONAL_LIGHTING", litVariants && variant.hasDirectionalLighting());
     cg.generateDefine(fs, "HAS_DYNAMIC_LIGHTING", litVariants && variant.hasDynamicLighting());
     cg.generateDefine(fs, "HAS_SHADOWING", litVariants && variant.hasShadowReceiver());
+    if (dynamicLightingConstant) {
+        cg.generateDefine(fs, "HAS_DYNAMIC_LIGHTING_CONSTANT", true);
+        cg.generateSpecializationConstant(fs, "dynamicLightingEnabled",
+                filament::Variant::DYNAMIC_LIGHTING_CONSTANT_ID, false);
+    }
 
     // material defines
     cg.generateDefine(fs, "MATERIAL_IS_DOUBLE_SIDED", material.isDoubleSided);
@@ -282,23 +350,33 @@ const std::string ShaderGenerator::createFragmentProgram(filament::driver::Shade
     // custom material variables
     size_t variableIndex = 0;
     for (const auto& variable : mVariables) {
-        cg.generateVariable(fs, ShaderType::FRAGMENT, variable, variableIndex++);
+        cg.generateVariable(fs, ShaderType::FRAGMENT, variable,
+                mVariablePrecisions[variableIndex], variableIndex);
+        variableIndex++;
     }
 
     // uniforms and samplers
     cg.generateUniforms(fs, ShaderType::FRAGMENT,
             BindingPoints::PER_VIEW, UibGenerator::getPerViewUib());
+    // the reflection probe of the renderable
+    cg.generateUniforms(fs, ShaderType::FRAGMENT,
+            BindingPoints::PER_RENDERABLE, UibGenerator::getPerRenderableUib());
     cg.generateUniforms(fs, ShaderType::FRAGMENT,
             BindingPoints::LIGHTS, UibGenerator::getLightsUib());
     cg.generateUniforms(fs, ShaderType::FRAGMENT,
             BindingPoints::PER_MATERIAL_INSTANCE, material.uib);
+    if (bindless) {
+        cg.generateUniforms(fs, ShaderType::FRAGMENT,
+                BindingPoints::BINDLESS_TEXTURES, UibGenerator::getBindlessTexturesUib());
+    }
+    cg.generatePushConstants(fs, ShaderType::FRAGMENT, material.pushConstants);
     cg.generateSeparator(fs);
     cg.generateSamplers(fs,
             material.samplerBindings.getBlockOffset(BindingPoints::PER_VIEW),
             SibGenerator::getPerViewSib());
     cg.generateSamplers(fs,
             material.samplerBindings.getBlockOffset(BindingPoints::PER_MATERIAL_INSTANCE),
-            material.sib);
+            material.sib, bindless);
 
     // shading code
     cg.generateCommon(fs, ShaderType::FRAGMENT);
@@ -364,7 +442,7 @@ const std::string ShaderPostProcessGenerator::createPostProcessFragmentProgram(
         uint8_t firstSampler) noexcept {
     const CodeGenerator cg(sm, targetApi, codeGenTargetApi);
     std::stringstream fs;
-    cg.generateProlog(fs, ShaderType::FRAGMENT, false);
+    cg.generateProlog(fs, ShaderType::FRAGMENT, false, false, usesFramebufferFetch(variant));
     generatePostProcessStageDefines(fs, cg, variant);
 
     cg.generateUniforms(fs, ShaderType::FRAGMENT,
@@ -390,6 +468,28 @@ void ShaderPostProcessGenerator::generatePostProcessStageDefines(std::stringstre
             uint32_t(PostProcessStage::ANTI_ALIASING_OPAQUE));
     cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING_TRANSLUCENT",
             uint32_t(PostProcessStage::ANTI_ALIASING_TRANSLUCENT));
+    cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING_ANTI_ALIASING_OPAQUE",
+            uint32_t(PostProcessStage::TONE_MAPPING_ANTI_ALIASING_OPAQUE));
+    cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT",
+            uint32_t(PostProcessStage::TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT));
+    cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSCALING_STAGE",
+            uint32_t(PostProcessStage::TEMPORAL_UPSCALING));
+    cg.generateDefine(vs, "POST_PROCESS_IBL_ROUGHNESS_PREFILTER",
+            uint32_t(PostProcessStage::IBL_ROUGHNESS_PREFILTER));
+    cg.generateDefine(vs, "POST_PROCESS_IBL_IRRADIANCE_SH",
+            uint32_t(PostProcessStage::IBL_IRRADIANCE_SH));
+    cg.generateDefine(vs, "POST_PROCESS_IBL_DFG",
+            uint32_t(PostProcessStage::IBL_DFG));
+    cg.generateDefine(vs, "POST_PROCESS_DEBUG_HEATMAP",
+            uint32_t(PostProcessStage::DEBUG_HEATMAP));
+    cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING_FRAMEBUFFER_FETCH_OPAQUE",
+            uint32_t(PostProcessStage::TONE_MAPPING_FRAMEBUFFER_FETCH_OPAQUE));
+    cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING_FRAMEBUFFER_FETCH_TRANSLUCENT",
+            uint32_t(PostProcessStage::TONE_MAPPING_FRAMEBUFFER_FETCH_TRANSLUCENT));
+    cg.generateDefine(vs, "POST_PROCESS_ACCUMULATED_TRANSPARENCY",
+            uint32_t(PostProcessStage::ACCUMULATED_TRANSPARENCY));
+    cg.generateDefine(vs, "POST_PROCESS_IBL_PROBE_PREFILTER",
+            uint32_t(PostProcessStage::IBL_PROBE_PREFILTER));
     switch (variant) {
         case PostProcessStage::TONE_MAPPING_OPAQUE:
             cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_TONE_MAPPING_OPAQUE");
@@ -415,7 +515,87 @@ void ShaderPostProcessGenerator::generatePostProcessStageDefines(std::stringstre
             cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 1u);
             cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
             break;
+        case PostProcessStage::TONE_MAPPING_ANTI_ALIASING_OPAQUE:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE",
+                    "POST_PROCESS_TONE_MAPPING_ANTI_ALIASING_OPAQUE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  1u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 1u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        1u);
+            break;
+        case PostProcessStage::TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE",
+                    "POST_PROCESS_TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  1u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 1u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            break;
+        case PostProcessStage::TEMPORAL_UPSCALING:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_TEMPORAL_UPSCALING_STAGE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            break;
+        case PostProcessStage::IBL_ROUGHNESS_PREFILTER:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_IBL_ROUGHNESS_PREFILTER");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            break;
+        case PostProcessStage::IBL_IRRADIANCE_SH:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_IBL_IRRADIANCE_SH");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            break;
+        case PostProcessStage::IBL_DFG:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_IBL_DFG");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            break;
+        case PostProcessStage::DEBUG_HEATMAP:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_DEBUG_HEATMAP");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        1u);
+            break;
+        case PostProcessStage::TONE_MAPPING_FRAMEBUFFER_FETCH_OPAQUE:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE",
+                    "POST_PROCESS_TONE_MAPPING_FRAMEBUFFER_FETCH_OPAQUE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  1u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        1u);
+            break;
+        case PostProcessStage::TONE_MAPPING_FRAMEBUFFER_FETCH_TRANSLUCENT:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE",
+                    "POST_PROCESS_TONE_MAPPING_FRAMEBUFFER_FETCH_TRANSLUCENT");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  1u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            break;
+        case PostProcessStage::ACCUMULATED_TRANSPARENCY:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_ACCUMULATED_TRANSPARENCY");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            break;
+        case PostProcessStage::IBL_PROBE_PREFILTER:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_IBL_PROBE_PREFILTER");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            break;
     }
+    cg.generateDefine(vs, "POST_PROCESS_FRAMEBUFFER_FETCH",
+            usesFramebufferFetch(variant) ? 1u : 0u);
+    cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSCALING",
+            variant == PostProcessStage::TEMPORAL_UPSCALING ? 1u : 0u);
+    cg.generateDefine(vs, "POST_PROCESS_IBL",
+            variant == PostProcessStage::IBL_ROUGHNESS_PREFILTER ||
+            variant == PostProcessStage::IBL_IRRADIANCE_SH ||
+            variant == PostProcessStage::IBL_DFG ||
+            variant == PostProcessStage::IBL_PROBE_PREFILTER ? 1u : 0u);
+    cg.generateDefine(vs, "IBL_USE_RGBM", filament::CONFIG_IBL_RGBM);
 }
 
 } // namespace filament
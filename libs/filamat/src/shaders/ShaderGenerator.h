@@ -37,6 +37,7 @@ public:
     ShaderGenerator(
             MaterialBuilder::PropertyList const& properties,
             MaterialBuilder::VariableList const& variables,
+            MaterialBuilder::VariablePrecisionList const& variablePrecisions,
             utils::CString const& materialCode,
             size_t lineOffset,
             utils::CString const& materialVertexCode,
@@ -50,12 +51,18 @@ public:
     const std::string createFragmentProgram(filament::driver::ShaderModel sm,
             MaterialBuilder::TargetApi targetApi, MaterialBuilder::TargetApi codeGenTargetApi,
             MaterialInfo const& material, uint8_t variantKey,
-            filament::Interpolation interpolation) const noexcept;
+            filament::Interpolation interpolation,
+            bool dynamicLightingConstant = false) const noexcept;
+    static const std::string createComputeProgram(filament::driver::ShaderModel sm,
+            MaterialBuilder::TargetApi targetApi, MaterialBuilder::TargetApi codeGenTargetApi,
+            MaterialInfo const& material,
+            utils::CString const& computeCode, size_t lineOffset) noexcept;
     bool hasCustomDepthShader() const noexcept;
 
 private:
     MaterialBuilder::PropertyList mProperties;
     MaterialBuilder::VariableList mVariables;
+    MaterialBuilder::VariablePrecisionList mVariablePrecisions;
     utils::CString mMaterialCode;
     utils::CString mMaterialVertexCode;
     size_t mMaterialLineOffset;
@@ -71,6 +78,13 @@ struct ShaderPostProcessGenerator {
             filament::PostProcessStage variant, uint8_t firstSampler) noexcept;
     static void generatePostProcessStageDefines(std::stringstream& vs, CodeGenerator const& cg,
             filament::PostProcessStage variant) noexcept;
+
+    // These stages read the pixel they write with EXT_shader_framebuffer_fetch. Their GLSL can't
+    // be optimized, glslang doesn't know the extension.
+    static bool usesFramebufferFetch(filament::PostProcessStage variant) noexcept {
+        return variant == filament::PostProcessStage::TONE_MAPPING_FRAMEBUFFER_FETCH_OPAQUE ||
+                variant == filament::PostProcessStage::TONE_MAPPING_FRAMEBUFFER_FETCH_TRANSLUCENT;
+    }
 };
 
 } // namespace filament
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GEOMETRY_STATICBATCHER_H
+#define GEOMETRY_STATICBATCHER_H
+
+#include <math/mat4.h>
+#include <math/vec2.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <utils/Entity.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace filament {
+class Engine;
+class IndexBuffer;
+class MaterialInstance;
+class VertexBuffer;
+} // namespace filament
+
+namespace geometry {
+
+/**
+ * Merges static meshes into a few renderables when they're loaded.
+ *
+ * The meshes sharing a material instance (and the same attributes) are transformed to world
+ * space and concatenated in one VertexBuffer and IndexBuffer, so each batch is a single
+ * renderable drawn with a single draw call. Scenes made of many small props then cost a few
+ * renderables instead of one per prop. To keep the batches culled, the meshes are grouped by
+ * cells of a grid, and each batch has the bounding box of its meshes.
+ *
+ * The batched meshes can't be moved or removed individually afterwards. The StaticBatcher owns
+ * the renderables and buffers it builds, they're destroyed with it. The renderables must be
+ * removed from their scenes before that.
+ */
+class StaticBatcher {
+public:
+    // A mesh made of triangles, its data is copied by add()
+    struct Mesh {
+        math::float3 const* positions = nullptr;    // required
+        math::float3 const* normals = nullptr;      // optional, needed by the lit materials
+        math::float4 const* tangents = nullptr;     // optional, w is the sign of the bitangent
+        math::float2 const* uv0 = nullptr;          // optional
+        uint32_t vertexCount = 0;
+        uint32_t const* indices = nullptr;
+        uint32_t indexCount = 0;
+        math::mat4f transform;                      // from the mesh to the world
+        filament::MaterialInstance const* material = nullptr;
+    };
+
+    struct Options {
+        // size of the cells of the grid, in world units, 0 puts all the meshes in one cell
+        float cellSize = 0.0f;
+        // vertices of a batch, above this a new batch is started. With 65536 or less, the
+        // indices are 16-bits. A mesh with more vertices is never split.
+        uint32_t maxVertexCount = 65536;
+        bool castShadows = true;
+        bool receiveShadows = true;
+    };
+
+    explicit StaticBatcher(filament::Engine& engine, Options const& options = {});
+    ~StaticBatcher();
+
+    StaticBatcher(StaticBatcher const&) = delete;
+    StaticBatcher& operator=(StaticBatcher const&) = delete;
+
+    // Adds a mesh to the batch of its material and cell, ignored if it has no position,
+    // index or material.
+    void add(Mesh const& mesh);
+
+    // Creates the renderables of the meshes added since the last call, and returns them
+    // (they're also added to getRenderables()).
+    std::vector<utils::Entity> build();
+
+    std::vector<utils::Entity> const& getRenderables() const noexcept { return mRenderables; }
+
+private:
+    struct Batch;
+
+    // the meshes that can share a batch
+    struct Key {
+        filament::MaterialInstance const* material;
+        bool tangents;
+        bool uv0;
+        math::int3 cell;
+        bool operator<(Key const& rhs) const noexcept;
+    };
+
+    filament::Engine& mEngine;
+    const Options mOptions;
+    std::map<Key, std::unique_ptr<Batch>> mOpenBatches;    // being filled
+    std::vector<std::unique_ptr<Batch>> mFullBatches;       // built by the next build()
+
+    std::vector<utils::Entity> mRenderables;
+    std::vector<filament::VertexBuffer*> mVertexBuffers;
+    std::vector<filament::IndexBuffer*> mIndexBuffers;
+};
+
+} // namespace geometry
+
+#endif // GEOMETRY_STATICBATCHER_H
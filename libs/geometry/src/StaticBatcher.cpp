@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <geometry/StaticBatcher.h>
+
+#include <filament/Box.h>
+#include <filament/Engine.h>
+#include <filament/IndexBuffer.h>
+#include <filament/RenderableManager.h>
+#include <filament/VertexBuffer.h>
+
+#include <math/mat3.h>
+#include <math/norm.h>
+#include <math/quat.h>
+
+#include <utils/EntityManager.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <tuple>
+
+using namespace filament;
+using namespace math;
+using namespace utils;
+
+namespace geometry {
+
+struct StaticBatcher::Batch {
+    Key key;
+    std::vector<float3> positions;
+    std::vector<short4> tangents;       // packed tangent frames, see mat3f::packTangentFrame()
+    std::vector<float2> uv0;
+    std::vector<uint32_t> indices;
+    float3 min = std::numeric_limits<float>::max();
+    float3 max = std::numeric_limits<float>::lowest();
+};
+
+// the vertex data are freed when they've been uploaded
+template<typename T>
+struct State {
+    std::vector<T> data;
+    explicit State(std::vector<T>&& data) noexcept : data(std::move(data)) { }
+    size_t size() const noexcept { return data.size() * sizeof(T); }
+    static void free(void* buffer, size_t size, void* user) {
+        delete static_cast<State*>(user);
+    }
+};
+
+template<typename T>
+static driver::BufferDescriptor makeBuffer(std::vector<T>&& data) {
+    State<T>* state = new State<T>(std::move(data));
+    return driver::BufferDescriptor(state->data.data(), state->size(), State<T>::free, state);
+}
+
+bool StaticBatcher::Key::operator<(Key const& rhs) const noexcept {
+    return std::tie(material, tangents, uv0, cell.x, cell.y, cell.z) <
+           std::tie(rhs.material, rhs.tangents, rhs.uv0, rhs.cell.x, rhs.cell.y, rhs.cell.z);
+}
+
+StaticBatcher::StaticBatcher(Engine& engine, Options const& options)
+        : mEngine(engine), mOptions(options) {
+}
+
+StaticBatcher::~StaticBatcher() {
+    for (Entity renderable : mRenderables) {
+        mEngine.destroy(renderable);
+    }
+    EntityManager::get().destroy(mRenderables.size(), mRenderables.data());
+    for (VertexBuffer* vb : mVertexBuffers) {
+        mEngine.destroy(vb);
+    }
+    for (IndexBuffer* ib : mIndexBuffers) {
+        mEngine.destroy(ib);
+    }
+}
+
+void StaticBatcher::add(Mesh const& mesh) {
+    if (!mesh.positions || !mesh.vertexCount || !mesh.indices || !mesh.indexCount ||
+            !mesh.material) {
+        return;
+    }
+
+    const mat4f& m = mesh.transform;
+    const mat3f upperLeft = m.upperLeft();
+    const mat3f normalMatrix = transpose(inverse(upperLeft));
+
+    // the world positions, and their bounds, decide of the cell of the mesh
+    std::vector<float3> positions(mesh.vertexCount);
+    float3 lo = std::numeric_limits<float>::max();
+    float3 hi = std::numeric_limits<float>::lowest();
+    for (size_t i = 0; i < mesh.vertexCount; i++) {
+        const float4 p = m * float4{ mesh.positions[i], 1.0f };
+        positions[i] = p.xyz / p.w;
+        lo = min(lo, positions[i]);
+        hi = max(hi, positions[i]);
+    }
+
+    Key key{ mesh.material, mesh.normals != nullptr, mesh.uv0 != nullptr, int3{} };
+    if (mOptions.cellSize > 0.0f) {
+        const float3 cell = floor((lo + hi) * 0.5f / mOptions.cellSize);
+        key.cell = int3{ int32_t(cell.x), int32_t(cell.y), int32_t(cell.z) };
+    }
+
+    // start a new batch when this mesh doesn't fit in the current one
+    std::unique_ptr<Batch>& batch = mOpenBatches[key];
+    if (batch && batch->positions.size() + mesh.vertexCount > mOptions.maxVertexCount) {
+        mFullBatches.push_back(std::move(batch));
+    }
+    if (!batch) {
+        batch.reset(new Batch());
+        batch->key = key;
+    }
+
+    const uint32_t base = uint32_t(batch->positions.size());
+    batch->positions.insert(batch->positions.end(), positions.begin(), positions.end());
+    batch->min = min(batch->min, lo);
+    batch->max = max(batch->max, hi);
+
+    if (key.tangents) {
+        for (size_t i = 0; i < mesh.vertexCount; i++) {
+            const float3 n = normalize(normalMatrix * mesh.normals[i]);
+            float3 t;
+            float sign = 1.0f;
+            if (mesh.tangents) {
+                t = upperLeft * mesh.tangents[i].xyz;
+                sign = mesh.tangents[i].w < 0.0f ? -1.0f : 1.0f;
+            } else {
+                // any direction orthogonal to the normal
+                t = std::abs(n.x) < 0.9f ? float3{ 1, 0, 0 } : float3{ 0, 1, 0 };
+            }
+            t = normalize(t - dot(t, n) * n);
+            const float3 b = cross(n, t) * sign;
+            const quatf q = mat3f::packTangentFrame({ t, b, n });
+            batch->tangents.push_back(packSnorm16(q.xyzw));
+        }
+    }
+
+    if (key.uv0) {
+        batch->uv0.insert(batch->uv0.end(), mesh.uv0, mesh.uv0 + mesh.vertexCount);
+    }
+
+    // a mirroring transform reverses the winding of the triangles
+    const bool flip = dot(cross(upperLeft[0], upperLeft[1]), upperLeft[2]) < 0.0f;
+    batch->indices.reserve(batch->indices.size() + mesh.indexCount);
+    for (size_t i = 0; i + 2 < mesh.indexCount; i += 3) {
+        batch->indices.push_back(base + mesh.indices[i]);
+        batch->indices.push_back(base + mesh.indices[i + (flip ? 2 : 1)]);
+        batch->indices.push_back(base + mesh.indices[i + (flip ? 1 : 2)]);
+    }
+}
+
+std::vector<Entity> StaticBatcher::build() {
+    for (auto& entry : mOpenBatches) {
+        mFullBatches.push_back(std::move(entry.second));
+    }
+    mOpenBatches.clear();
+
+    std::vector<Entity> renderables;
+    renderables.reserve(mFullBatches.size());
+    for (std::unique_ptr<Batch>& batch : mFullBatches) {
+        const Key& key = batch->key;
+        const uint32_t vertexCount = uint32_t(batch->positions.size());
+        const uint32_t indexCount = uint32_t(batch->indices.size());
+
+        uint8_t bufferCount = 1;
+        VertexBuffer::Builder vbb;
+        vbb.vertexCount(vertexCount)
+                .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3);
+        if (key.tangents) {
+            vbb.attribute(VertexAttribute::TANGENTS, bufferCount++,
+                    VertexBuffer::AttributeType::SHORT4);
+            vbb.normalized(VertexAttribute::TANGENTS);
+        }
+        if (key.uv0) {
+            vbb.attribute(VertexAttribute::UV0, bufferCount++,
+                    VertexBuffer::AttributeType::FLOAT2);
+        }
+        VertexBuffer* vb = vbb.bufferCount(bufferCount).build(mEngine);
+
+        uint8_t buffer = 0;
+        vb->setBufferAt(mEngine, buffer++, makeBuffer(std::move(batch->positions)));
+        if (key.tangents) {
+            vb->setBufferAt(mEngine, buffer++, makeBuffer(std::move(batch->tangents)));
+        }
+        if (key.uv0) {
+            vb->setBufferAt(mEngine, buffer++, makeBuffer(std::move(batch->uv0)));
+        }
+
+        // 16-bits indices when they fit, which halves the index buffer
+        IndexBuffer* ib;
+        if (vertexCount <= 65536) {
+            std::vector<uint16_t> indices(batch->indices.begin(), batch->indices.end());
+            ib = IndexBuffer::Builder()
+                    .indexCount(indexCount)
+                    .bufferType(IndexBuffer::IndexType::USHORT)
+                    .build(mEngine);
+            ib->setBuffer(mEngine, makeBuffer(std::move(indices)));
+        } else {
+            ib = IndexBuffer::Builder()
+                    .indexCount(indexCount)
+                    .bufferType(IndexBuffer::IndexType::UINT)
+                    .build(mEngine);
+            ib->setBuffer(mEngine, makeBuffer(std::move(batch->indices)));
+        }
+
+        Entity renderable = EntityManager::get().create();
+        RenderableManager::Builder(1)
+                .boundingBox(Box().set(batch->min, batch->max))
+                .material(0, key.material)
+                .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vb, ib)
+                .castShadows(mOptions.castShadows)
+                .receiveShadows(mOptions.receiveShadows)
+                .build(mEngine, renderable);
+
+        mVertexBuffers.push_back(vb);
+        mIndexBuffers.push_back(ib);
+        renderables.push_back(renderable);
+    }
+    mFullBatches.clear();
+
+    mRenderables.insert(mRenderables.end(), renderables.begin(), renderables.end());
+    return renderables;
+}
+
+} // namespace geometry
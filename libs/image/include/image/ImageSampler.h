@@ -19,6 +19,10 @@
 
 #include <image/LinearImage.h>
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace image {
 
 /**
@@ -86,6 +90,9 @@ struct Boundary {
 
 /**
  * Configuration for the resampleImage function. Provides reasonable defaults.
+ *
+ * If a job system is provided, the rows of each pass are split across its threads. The calling
+ * thread must have been adopted by the job system (see JobSystem::adopt).
  */
 struct ImageSampler {
     Filter horizontalFilter = Filter::DEFAULT;
@@ -96,6 +103,7 @@ struct ImageSampler {
     Boundary north;
     Boundary west;
     Boundary south;
+    utils::JobSystem* jobSystem = nullptr;
 };
 
 /**
@@ -108,7 +116,41 @@ LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t he
  * Resizes the given linear image using a simplified API that takes target dimensions and filter.
  */
 LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t height,
-        Filter filter = Filter::DEFAULT);
+        Filter filter = Filter::DEFAULT, utils::JobSystem* jobSystem = nullptr);
+
+/**
+ * Resizes or blurs a linear image that is provided a strip of rows at a time, from top to bottom.
+ * This produces the same result as resampleImage, but only keeps in memory the window of source
+ * rows needed by the next target rows, regardless of the size of the image. For example:
+ *
+ *     StripResampler resampler(decoder->getWidth(), decoder->getHeight(), 3, width, height);
+ *     for (LinearImage strip; (strip = decoder->decodeStrip(64)).isValid(); ) {
+ *         LinearImage rows = resampler.resample(strip);
+ *         if (rows.isValid()) encoder->encodeStrip(rows);
+ *     }
+ *
+ * The strips can have any number of rows, the returned images hold the target rows that could be
+ * completed, or are invalid if there are none. Once all the source rows have been provided, all the
+ * target rows have been returned.
+ */
+class StripResampler {
+public:
+    StripResampler(uint32_t sourceWidth, uint32_t sourceHeight, uint32_t channels,
+            uint32_t width, uint32_t height, const ImageSampler& sampler = {});
+    ~StripResampler();
+
+    StripResampler(const StripResampler&) = delete;
+    StripResampler& operator=(const StripResampler&) = delete;
+
+    /**
+     * Consumes the next rows of the source image, and returns the next rows of the target image.
+     */
+    LinearImage resample(const LinearImage& strip);
+
+private:
+    struct Impl;
+    Impl* mImpl;
+};
 
 /**
  * Computes a single sample for the given texture coordinate and writes the resulting color
@@ -136,8 +178,11 @@ void computeSingleSample(const LinearImage& source, float x, float y, SingleSamp
  * Source image need not be power-of-two. In the result vector, the half-size image is returned at
  * index 0, the quarter-size image is at index 1, etc. Please note that the original-sized image is
  * not included.
+ *
+ * The optional job system is used as in ImageSampler.
  */
-void generateMipmaps(const LinearImage& source, Filter, LinearImage* result, uint32_t mipCount);
+void generateMipmaps(const LinearImage& source, Filter, LinearImage* result, uint32_t mipCount,
+        utils::JobSystem* jobSystem = nullptr);
 
 /**
  * Returns the number of miplevels it would take to downsample the given image down to 1x1. This
@@ -145,6 +190,12 @@ void generateMipmaps(const LinearImage& source, Filter, LinearImage* result, uin
  */
 uint32_t getMipmapCount(const LinearImage& source);
 
+/**
+ * Returns the number of miplevels it would take to downsample an image of the given size down to
+ * 1x1, for images that aren't held in a single LinearImage (see StripResampler).
+ */
+uint32_t getMipmapCount(uint32_t width, uint32_t height);
+
 /**
  * Given the string name of a filter, converts it to uppercase and returns the corresponding
  * enum value. If no corresponding enumerant exists, returns DEFAULT.
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_IRRADIANCEPROJECTOR_H
+#define IMAGE_IRRADIANCEPROJECTOR_H
+
+#include <image/LinearImage.h>
+
+#include <math/vec3.h>
+
+#include <memory>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
+namespace image {
+
+/**
+ * Projects cubemaps onto 3 bands of spherical harmonics, convolved by the truncated cosine and
+ * pre-scaled for the shader. The result can be passed as is to IndirectLight::Builder::irradiance
+ * and matches cmgen's CubemapSH::computeIrradianceSH3Bands, in single precision.
+ *
+ * The solid angle weighted basis of every texel is computed once, for a given face resolution, so
+ * projecting a cubemap only costs a few dot products per row. This makes it suitable for
+ * environments captured at runtime, a 64x64 cubemap takes a small fraction of a millisecond.
+ *
+ * The faces are given in the order of filament's TextureCubemapFace (+X, -X, +Y, -Y, +Z, -Z), with
+ * the orientation of cmgen's output. They must be dim x dim and have at least 3 channels, only the
+ * first 3 are used.
+ *
+ * If a job system is provided, the rows of all faces are split across its threads. The calling
+ * thread must have been adopted by the job system (see JobSystem::adopt). The result does not
+ * depend on the number of threads.
+ */
+class IrradianceProjector {
+public:
+    explicit IrradianceProjector(uint32_t dim);
+
+    uint32_t getDimensions() const { return mDim; }
+
+    void project(LinearImage const faces[6], math::float3 sh[9],
+            utils::JobSystem* jobSystem = nullptr) const;
+
+private:
+    uint32_t mDim;
+    std::unique_ptr<float[]> mBasis;
+};
+
+} // namespace image
+
+#endif /* IMAGE_IRRADIANCEPROJECTOR_H */
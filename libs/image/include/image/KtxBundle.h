@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_KTXBUNDLE_H
+#define IMAGE_KTXBUNDLE_H
+
+#include <cstdint>
+#include <memory>
+
+namespace image {
+
+// The header fields of a KTX 1.1 file, see the Khronos specification for their meaning. The
+// number of array elements, faces and mip levels are owned by KtxBundle.
+struct KtxInfo {
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+};
+
+// Identifies a single 2D image (or cubemap face) within a KtxBundle.
+struct KtxBlobIndex {
+    uint32_t mipLevel;
+    uint32_t arrayIndex;
+    uint32_t cubeFace;
+};
+
+// Reads KTX 1.1 and KTX 2.0 containers, and writes KTX 1.1 containers. A bundle is a set of blobs,
+// one per mip level, array element and cubemap face, along with the header describing their
+// format. Blobs are opaque, which lets a bundle carry block compressed data such as ETC2 or S3TC
+// as well as raw pixels. Key/value metadata is skipped when reading and never written, KTX 2.0
+// files are described with the GL enumerants of their vkFormat and can be supercompressed with
+// zlib (see getSupercompressedLevel()).
+class KtxBundle {
+public:
+    // Endianness tag of a KTX file written on a little endian machine.
+    static constexpr uint32_t ENDIAN_DEFAULT = 0x04030201;
+
+    // The supercompression schemes of KTX 2.0 files that can be read.
+    enum class Supercompression : uint32_t {
+        NONE = 0,
+        ZLIB = 3,
+    };
+
+    // GL enumerants used in the KTX header, compressed textures have a zero glType, glTypeSize and
+    // glFormat.
+    enum : uint32_t {
+        // glType, glFormat and glBaseInternalFormat values
+        UNSIGNED_BYTE = 0x1401,
+        RED = 0x1903,
+        RG = 0x8227,
+        RGB = 0x1907,
+        RGBA = 0x1908,
+
+        // glInternalFormat values
+        RGB8 = 0x8051,
+        RGBA8 = 0x8058,
+        SRGB8 = 0x8C41,
+        SRGB8_ALPHA8 = 0x8C43,
+        RGB_S3TC_DXT1 = 0x83F0,
+        RGBA_S3TC_DXT1 = 0x83F1,
+        RGBA_S3TC_DXT3 = 0x83F2,
+        RGBA_S3TC_DXT5 = 0x83F3,
+        SRGB_S3TC_DXT1 = 0x8C4C,
+        SRGB_ALPHA_S3TC_DXT1 = 0x8C4D,
+        SRGB_ALPHA_S3TC_DXT3 = 0x8C4E,
+        SRGB_ALPHA_S3TC_DXT5 = 0x8C4F,
+        R11_EAC = 0x9270,
+        SIGNED_R11_EAC = 0x9271,
+        RG11_EAC = 0x9272,
+        SIGNED_RG11_EAC = 0x9273,
+        RGB8_ETC2 = 0x9274,
+        SRGB8_ETC2 = 0x9275,
+        RGB8_ALPHA1_ETC2 = 0x9276,
+        SRGB8_ALPHA1_ETC2 = 0x9277,
+        RGBA8_ETC2_EAC = 0x9278,
+        SRGB8_ALPHA8_ETC2_EAC = 0x9279,
+    };
+
+    // Creates an empty bundle, blobs must then be supplied with setBlob(). Faces and array
+    // elements of a level all have the same size.
+    KtxBundle(uint32_t numMipLevels, uint32_t arrayLength, bool isCubemap);
+
+    // Parses the given KTX file contents. Throws std::runtime_error if the data is not a well
+    // formed KTX file, or if it uses a format or feature that is not supported.
+    // The contents are copied unless copyContents is false, in which case the blobs reference
+    // the given memory, which must then outlive the bundle (or at least its last setBlob()).
+    KtxBundle(uint8_t const* bytes, uint32_t nbytes, bool copyContents = true);
+
+    ~KtxBundle();
+
+    KtxBundle(const KtxBundle&) = delete;
+    KtxBundle& operator=(const KtxBundle&) = delete;
+
+    // Returns the number of bytes needed to serialize the bundle.
+    uint32_t getSerializedLength() const;
+
+    // Writes the bundle in the KTX 1.1 format, returns false if the destination is too small.
+    bool serialize(uint8_t* destination, uint32_t numBytes) const;
+
+    KtxInfo& info() { return mInfo; }
+    KtxInfo const& getInfo() const { return mInfo; }
+
+    Supercompression getSupercompression() const { return mSupercompression; }
+
+    uint32_t getNumMipLevels() const { return mNumMipLevels; }
+    uint32_t getArrayLength() const { return mArrayLength; }
+    bool isCubemap() const { return mNumCubeFaces > 1; }
+
+    // Gets a blob of the bundle, returns false if the index is out of range or its level has not
+    // been set yet. The blobs of a level are laid out in memory in the order of their index.
+    // Supercompressed bundles have no blobs, see getSupercompressedLevel().
+    bool getBlob(KtxBlobIndex index, uint8_t const** data, uint32_t* size) const;
+
+    // Gets the supercompressed data of a whole level, along with the size it inflates to (all
+    // of its blobs, tightly packed). Returns false if the bundle is not supercompressed or the
+    // level is out of range.
+    bool getSupercompressedLevel(uint32_t level, uint8_t const** data, uint32_t* size,
+            uint32_t* uncompressedSize) const;
+
+    // Copies the given data into the bundle, replacing any previous blob at this index. All the
+    // blobs of a level must have the same size, returns false if the index is out of range or the
+    // size does not match the level. A level that references external memory is copied first.
+    // Supercompressed bundles cannot be modified, nor serialized.
+    bool setBlob(KtxBlobIndex index, uint8_t const* data, uint32_t size);
+
+private:
+    struct Level {
+        uint32_t blobSize = 0;
+        uint32_t blobStride = 0;
+        uint32_t uncompressedSize = 0;  // of the whole level, when supercompressed
+        uint8_t const* data = nullptr;
+        std::unique_ptr<uint8_t[]> storage;
+    };
+
+    void parseKtx1(uint8_t const* bytes, uint32_t nbytes, bool copyContents);
+    void parseKtx2(uint8_t const* bytes, uint32_t nbytes, bool copyContents);
+    void setLevel(uint32_t level, uint8_t const* data, uint32_t blobSize, uint32_t blobStride,
+            bool copyContents);
+
+    uint32_t getBlobCount() const { return mArrayLength * mNumCubeFaces; }
+    bool isSupercompressed() const { return mSupercompression != Supercompression::NONE; }
+    uint32_t getBlobOffset(KtxBlobIndex index) const;
+    bool isValid(KtxBlobIndex index) const;
+
+    KtxInfo mInfo = {};
+    Supercompression mSupercompression = Supercompression::NONE;
+    uint32_t mNumMipLevels;
+    uint32_t mArrayLength;
+    uint32_t mNumCubeFaces;
+    std::unique_ptr<Level[]> mLevels;
+};
+
+} // namespace image
+
+#endif /* IMAGE_KTXBUNDLE_H */
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_KTXUTILITY_H
+#define IMAGE_KTXUTILITY_H
+
+#include <filament/Engine.h>
+#include <filament/Texture.h>
+
+#include <image/KtxBundle.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+namespace image {
+
+// Header-only helpers that create filament textures from KTX bundles. Clients that use these
+// must link against filament, the image library itself does not.
+namespace ktx {
+
+using Texture = filament::Texture;
+using Engine = filament::Engine;
+
+using TextureFormat = Texture::InternalFormat;
+using CompressedPixelDataType = filament::driver::CompressedPixelDataType;
+using PixelDataType = filament::driver::PixelDataType;
+using PixelDataFormat = filament::driver::PixelDataFormat;
+
+// Returns true if the bundle holds block compressed data.
+inline bool isCompressed(const KtxInfo& info) {
+    return info.glFormat == 0;
+}
+
+// Returns the filament format for the bundle's glInternalFormat, or RGBA8 if it is not supported.
+// Uncompressed RGBA8 bundles can hold RGBM data (see cmgen), which filament needs to know about.
+inline TextureFormat toTextureFormat(const KtxInfo& info, bool rgbm = false) {
+    if (rgbm && info.glInternalFormat == KtxBundle::RGBA8) {
+        return TextureFormat::RGBM;
+    }
+    switch (info.glInternalFormat) {
+        case KtxBundle::RGB8: return TextureFormat::RGB8;
+        case KtxBundle::RGBA8: return TextureFormat::RGBA8;
+        case KtxBundle::SRGB8: return TextureFormat::SRGB8;
+        case KtxBundle::SRGB8_ALPHA8: return TextureFormat::SRGB8_A8;
+        case KtxBundle::R11_EAC: return TextureFormat::EAC_R11;
+        case KtxBundle::SIGNED_R11_EAC: return TextureFormat::EAC_R11_SIGNED;
+        case KtxBundle::RG11_EAC: return TextureFormat::EAC_RG11;
+        case KtxBundle::SIGNED_RG11_EAC: return TextureFormat::EAC_RG11_SIGNED;
+        case KtxBundle::RGB8_ETC2: return TextureFormat::ETC2_RGB8;
+        case KtxBundle::SRGB8_ETC2: return TextureFormat::ETC2_SRGB8;
+        case KtxBundle::RGB8_ALPHA1_ETC2: return TextureFormat::ETC2_RGB8_A1;
+        case KtxBundle::SRGB8_ALPHA1_ETC2: return TextureFormat::ETC2_SRGB8_A1;
+        case KtxBundle::RGBA8_ETC2_EAC: return TextureFormat::ETC2_EAC_RGBA8;
+        case KtxBundle::SRGB8_ALPHA8_ETC2_EAC: return TextureFormat::ETC2_EAC_SRGBA8;
+        case KtxBundle::RGB_S3TC_DXT1:
+        case KtxBundle::SRGB_S3TC_DXT1: return TextureFormat::DXT1_RGB;
+        case KtxBundle::RGBA_S3TC_DXT1:
+        case KtxBundle::SRGB_ALPHA_S3TC_DXT1: return TextureFormat::DXT1_RGBA;
+        case KtxBundle::RGBA_S3TC_DXT3:
+        case KtxBundle::SRGB_ALPHA_S3TC_DXT3: return TextureFormat::DXT3_RGBA;
+        case KtxBundle::RGBA_S3TC_DXT5:
+        case KtxBundle::SRGB_ALPHA_S3TC_DXT5: return TextureFormat::DXT5_RGBA;
+    }
+    return TextureFormat::RGBA8;
+}
+
+// Returns the filament compressed type for the bundle's glInternalFormat. The driver has no sRGB
+// S3TC formats, these are uploaded as their linear counterparts (see toTextureFormat).
+inline CompressedPixelDataType toCompressedPixelDataType(const KtxInfo& info) {
+    switch (info.glInternalFormat) {
+        case KtxBundle::R11_EAC: return CompressedPixelDataType::EAC_R11;
+        case KtxBundle::SIGNED_R11_EAC: return CompressedPixelDataType::EAC_R11_SIGNED;
+        case KtxBundle::RG11_EAC: return CompressedPixelDataType::EAC_RG11;
+        case KtxBundle::SIGNED_RG11_EAC: return CompressedPixelDataType::EAC_RG11_SIGNED;
+        case KtxBundle::RGB8_ETC2: return CompressedPixelDataType::ETC2_RGB8;
+        case KtxBundle::SRGB8_ETC2: return CompressedPixelDataType::ETC2_SRGB8;
+        case KtxBundle::RGB8_ALPHA1_ETC2: return CompressedPixelDataType::ETC2_RGB8_A1;
+        case KtxBundle::SRGB8_ALPHA1_ETC2: return CompressedPixelDataType::ETC2_SRGB8_A1;
+        case KtxBundle::RGBA8_ETC2_EAC: return CompressedPixelDataType::ETC2_EAC_RGBA8;
+        case KtxBundle::SRGB8_ALPHA8_ETC2_EAC: return CompressedPixelDataType::ETC2_EAC_SRGBA8;
+        case KtxBundle::RGB_S3TC_DXT1:
+        case KtxBundle::SRGB_S3TC_DXT1: return CompressedPixelDataType::DXT1_RGB;
+        case KtxBundle::RGBA_S3TC_DXT1:
+        case KtxBundle::SRGB_ALPHA_S3TC_DXT1: return CompressedPixelDataType::DXT1_RGBA;
+        case KtxBundle::RGBA_S3TC_DXT3:
+        case KtxBundle::SRGB_ALPHA_S3TC_DXT3: return CompressedPixelDataType::DXT3_RGBA;
+        case KtxBundle::RGBA_S3TC_DXT5:
+        case KtxBundle::SRGB_ALPHA_S3TC_DXT5: return CompressedPixelDataType::DXT5_RGBA;
+    }
+    return CompressedPixelDataType::ETC2_RGB8;
+}
+
+namespace details {
+
+using Callback = Texture::PixelBufferDescriptor::Callback;
+
+struct Upload {
+    void const* buffer;
+    Callback callback;
+    void* user;
+};
+
+// Creates the texture and uploads each of its levels from the buffer returned by
+// retain(data, size), the faces of a cubemap level are uploaded at once.
+template<typename RETAIN>
+inline Texture* createTexture(Engine* engine, const KtxBundle& ktx, bool rgbm, RETAIN retain) {
+    const KtxInfo& info = ktx.getInfo();
+    const uint32_t nmips = ktx.getNumMipLevels();
+    if (ktx.getArrayLength() > 1) {
+        return nullptr;
+    }
+
+    Texture* texture = Texture::Builder()
+            .width(info.pixelWidth)
+            .height(info.pixelHeight)
+            .levels(uint8_t(nmips))
+            .sampler(ktx.isCubemap() ? Texture::Sampler::SAMPLER_CUBEMAP :
+                    Texture::Sampler::SAMPLER_2D)
+            .format(toTextureFormat(info, rgbm))
+            .build(*engine);
+
+    const uint32_t nfaces = ktx.isCubemap() ? 6 : 1;
+    for (uint32_t level = 0; level < nmips; level++) {
+        uint8_t const* data;
+        uint8_t const* last;
+        uint32_t size;
+        if (!ktx.getBlob({ level, 0, 0 }, &data, &size) ||
+                !ktx.getBlob({ level, 0, nfaces - 1 }, &last, &size)) {
+            engine->destroy(texture);
+            return nullptr;
+        }
+
+        const size_t levelSize = size_t(last - data) + size;
+        const Upload upload = retain(data, levelSize);
+        Texture::PixelBufferDescriptor pbd = isCompressed(info) ?
+                Texture::PixelBufferDescriptor(upload.buffer, levelSize,
+                        toCompressedPixelDataType(info), size, upload.callback, upload.user) :
+                Texture::PixelBufferDescriptor(upload.buffer, levelSize,
+                        info.glFormat == KtxBundle::RGB ? PixelDataFormat::RGB :
+                                rgbm ? PixelDataFormat::RGBM : PixelDataFormat::RGBA,
+                        PixelDataType::UBYTE, 4, 0, 0, 0, upload.callback, upload.user);
+
+        if (ktx.isCubemap()) {
+            Texture::FaceOffsets offsets;
+            for (uint32_t face = 0; face < 6; face++) {
+                uint8_t const* blob;
+                ktx.getBlob({ level, 0, face }, &blob, &size);
+                offsets[face] = size_t(blob - data);
+            }
+            texture->setImage(*engine, level, std::move(pbd), offsets);
+        } else {
+            texture->setImage(*engine, level, std::move(pbd));
+        }
+    }
+    return texture;
+}
+
+} // namespace details
+
+// Creates a 2D or cubemap texture from the bundle and uploads all of its levels, compressed
+// blobs are handed to the driver as they are. Returns nullptr if the bundle is incomplete or an
+// array texture. The levels are copied, so the bundle can be destroyed as soon as this returns.
+// Set rgbm if an uncompressed RGBA8 bundle holds RGBM data.
+inline Texture* createTexture(Engine* engine, const KtxBundle& ktx, bool rgbm = false) {
+    return details::createTexture(engine, ktx, rgbm, [](uint8_t const* data, size_t size) {
+        void* buffer = malloc(size);
+        memcpy(buffer, data, size);
+        return details::Upload {
+            buffer, [](void* buffer, size_t, void*) { free(buffer); }, nullptr
+        };
+    });
+}
+
+// Same as above, except that no copy is made: the driver reads the levels straight from the
+// memory of the bundle, which may be a mapped file (see imageio/KtxLoader.h). The bundle is kept
+// alive until the driver is done with all of its levels.
+inline Texture* createTexture(Engine* engine, std::shared_ptr<const KtxBundle> ktx,
+        bool rgbm = false) {
+    return details::createTexture(engine, *ktx, rgbm, [&ktx](uint8_t const* data, size_t) {
+        return details::Upload {
+            data, [](void*, size_t, void* user) {
+                delete static_cast<std::shared_ptr<const KtxBundle>*>(user);
+            }, new std::shared_ptr<const KtxBundle>(ktx)
+        };
+    });
+}
+
+} // namespace ktx
+} // namespace image
+
+#endif /* IMAGE_KTXUTILITY_H */
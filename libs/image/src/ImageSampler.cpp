@@ -18,9 +18,14 @@
 #include <image/ImageOps.h>
 
 #include <math/vec3.h>
-#include <utils/Panic.h>
+#include <utils/compiler.h>
 #include <utils/CString.h>
+#include <utils/JobSystem.h>
+#include <utils/Panic.h>
 
+#include <algorithm>
+#include <functional>
+#include <limits>
 #include <memory>
 #include <vector>
 #include <unordered_map>
@@ -129,7 +134,7 @@ void generateMadProgram(uint32_t ntarget, uint32_t nsource, float left, float ri
     // the [0,1] domain. If this were a huge number, the filtered results would look the same, but
     // the filter would perform very poorly because it would be iterating over a lot more samples
     // than necessary.
-    const float filterBounds = domainScale * std::abs(filter.boundingRadius);
+    const float filterBounds = std::abs(filter.boundingRadius) / domainScale;
 
     // Iterate through target samples. "xtarget" points to the center of each target pixel.
     float xtarget = dtarget / 2.0f;
@@ -140,9 +145,12 @@ void generateMadProgram(uint32_t ntarget, uint32_t nsource, float left, float ri
         uint32_t count = 0;
         float sum = 0;
 
-        // Iterate through source samples that lie within the bounded region.
-        const auto isource_lower = int32_t((xtarget - filterBounds) * nsource);
-        const auto isource_upper = int32_t(std::ceil((xtarget + filterBounds) * nsource));
+        // Iterate through source samples that lie within the bounded region, which is expressed
+        // relative to the source range.
+        const float xlower = left + (xtarget - filterBounds) * (right - left);
+        const float xupper = left + (xtarget + filterBounds) * (right - left);
+        const auto isource_lower = int32_t(std::floor(xlower * nsource));
+        const auto isource_upper = int32_t(std::ceil(xupper * nsource));
         for (int32_t isource = isource_lower; isource <= isource_upper; ++isource) {
             const float xsource = (((isource + 0.5f) / nsource) - left) / (right - left);
             const bool outside_image = isource < 0 || isource >= int32_t(nsource);
@@ -169,24 +177,6 @@ void generateMadProgram(uint32_t ntarget, uint32_t nsource, float left, float ri
     }
 }
 
-// Transforms a MAD program intended for single-channel data into a program intended for
-// multi-channel data.
-void expandMadProgram(uint32_t nchannels, MadProgram* program) {
-    if (nchannels == 1) {
-        return;
-    }
-    MadProgram result;
-    result.reserve(program->size() * nchannels);
-    for (auto mad : *program) {
-        mad.sourceIndex *= nchannels;
-        mad.targetIndex *= nchannels;
-        for (uint32_t j = 0; j < nchannels; ++j, ++mad.sourceIndex, ++mad.targetIndex) {
-            result.push_back(mad);
-        }
-    }
-    program->swap(result);
-}
-
 FilterFunction createFilterFunction(Filter ftype) {
     FilterFunction fn;
     switch (ftype) {
@@ -204,65 +194,198 @@ FilterFunction createFilterFunction(Filter ftype) {
     return fn;
 }
 
-void normalize(LinearImage& image) {
-    ASSERT_PRECONDITION(image.getChannels() == 3, "Must be a 3-channel image.");
-    const uint32_t width = image.getWidth(), height = image.getHeight();
-    auto vecs = (math::float3*) image.getPixelRef();
-    for (uint32_t n = 0; n < width * height; ++n) {
+// The MAD program of a 1D pass, along with the index of the first instruction of each target
+// sample. The instructions are generated in target order, so the instructions of the target sample
+// i are in [first[i], first[i + 1]). This lets a pass split its target samples across threads.
+struct ResamplePass {
+    MadProgram program;
+    std::vector<uint32_t> first;
+    Filter filter;
+
+    void prepare(uint32_t ntarget, uint32_t nsource, Filter ftype, float left, float right,
+            float radiusMultiplier) {
+        const bool mag = ntarget > nsource;
+        if (ftype == Filter::DEFAULT) ftype = mag ? Filter::MITCHELL : Filter::LANCZOS;
+        filter = ftype;
+        program.clear();
+        generateMadProgram(ntarget, nsource, left, right, createFilterFunction(ftype),
+                radiusMultiplier, &program);
+        first.assign(ntarget + 1, 0);
+        for (auto mad : program) {
+            ++first[mad.targetIndex + 1];
+        }
+        for (uint32_t i = 0; i < ntarget; ++i) {
+            first[i + 1] += first[i];
+        }
+    }
+};
+
+void normalize(float* data, size_t count) {
+    auto vecs = (math::float3*) data;
+    for (size_t n = 0; n < count; ++n) {
         vecs[n] = normalize(vecs[n]);
     }
 }
 
-LinearImage resampleImage1D(const LinearImage& source, MadProgram* program,
-        uint32_t twidth, Filter filter, float left, float right, float filterRadiusMultiplier) {
-    const uint32_t swidth = source.getWidth();
-    const uint32_t sheight = source.getHeight();
-    const uint32_t nchan = source.getChannels();
-    const bool mag = twidth > swidth;
-    if (filter == Filter::DEFAULT) filter = mag ? Filter::MITCHELL : Filter::LANCZOS;
-    const FilterFunction hfn = createFilterFunction(filter);
-
-    // Generate a flat list of multiply-add (MAD) instructions.
-    program->clear();
-    generateMadProgram(twidth, swidth, left, right, hfn, filterRadiusMultiplier, program);
-    expandMadProgram(nchan, program);
-
-    // Allocate the target image.
-    LinearImage result(twidth, sheight, nchan);
-    float const* sourceRow = source.getPixelRef();
-    float* targetRow = result.getPixelRef();
-
-    // The MIN filter is special because it starts with non-zero values and ignores filter weights.
-    if (filter == Filter::MINIMUM) {
-        for (uint32_t n = 0; n < twidth * sheight * nchan; ++n) {
-            targetRow[n] = std::numeric_limits<float>::max();
-        }
-        for (uint32_t row = 0; row < sheight; ++row) {
-            for (auto mad : *program) {
-                const float a = sourceRow[mad.sourceIndex];
-                const float b = targetRow[mad.targetIndex];
-                targetRow[mad.targetIndex] = std::min(a, b);
+// Resizes the rows [row0, row0 + nrows) horizontally by executing the MAD instructions of each
+// target pixel over its channels. When N is not zero, it must be equal to nchan; this allows the
+// compiler to unroll the innermost loop.
+// The MIN filter is special because it starts with non-zero values and ignores filter weights.
+template<uint32_t N, bool MINIMUM>
+void resampleRowsN(float const* UTILS_RESTRICT source, float* UTILS_RESTRICT target,
+        uint32_t swidth, uint32_t twidth, uint32_t nchan, uint32_t row0, uint32_t nrows,
+        const ResamplePass& pass) {
+    const uint32_t n = N ? N : nchan;
+    MadInstruction const* program = pass.program.data();
+    uint32_t const* first = pass.first.data();
+    for (uint32_t row = row0; row < row0 + nrows; ++row) {
+        float const* UTILS_RESTRICT sourceRow = source + size_t(row) * swidth * n;
+        float* UTILS_RESTRICT targetRow = target + size_t(row) * twidth * n;
+        for (uint32_t x = 0; x < twidth; ++x, targetRow += n) {
+            for (uint32_t c = 0; c < n; ++c) {
+                targetRow[c] = MINIMUM ? std::numeric_limits<float>::max() : 0.0f;
+            }
+            for (uint32_t i = first[x], e = first[x + 1]; i < e; ++i) {
+                const MadInstruction mad = program[i];
+                float const* UTILS_RESTRICT s = sourceRow + mad.sourceIndex * int32_t(n);
+                for (uint32_t c = 0; c < n; ++c) {
+                    targetRow[c] = MINIMUM ? std::min(targetRow[c], s[c]) :
+                            targetRow[c] + s[c] * mad.weight;
+                }
             }
-            targetRow += twidth * nchan;
-            sourceRow += swidth * nchan;
         }
-        return result;
     }
+}
+
+// Dispatches to a version of resampleRowsN() specialized for the common channel counts.
+template<bool MINIMUM>
+void resampleRows(float const* source, float* target, uint32_t swidth, uint32_t twidth,
+        uint32_t nchan, uint32_t row0, uint32_t nrows, const ResamplePass& pass) {
+    switch (nchan) {
+        case 1: resampleRowsN<1, MINIMUM>(source, target, swidth, twidth, 1, row0, nrows, pass);
+            break;
+        case 3: resampleRowsN<3, MINIMUM>(source, target, swidth, twidth, 3, row0, nrows, pass);
+            break;
+        case 4: resampleRowsN<4, MINIMUM>(source, target, swidth, twidth, 4, row0, nrows, pass);
+            break;
+        default:
+            resampleRowsN<0, MINIMUM>(source, target, swidth, twidth, nchan, row0, nrows, pass);
+    }
+}
 
-    // Resize the image horizontally by executing the MAD instructions over each row.
-    for (uint32_t row = 0; row < sheight; ++row) {
-        for (auto mad : *program) {
-            targetRow[mad.targetIndex] += sourceRow[mad.sourceIndex] * mad.weight;
+// Resizes the rows [row0, row0 + nrows) of the target vertically. Each MAD instruction applies to
+// an entire row of the source, which gets vectorized. The source starts at row sourceRow0 and the
+// target at row row0, which lets a pass run over a window of the source.
+template<bool MINIMUM>
+void resampleColumns(float const* UTILS_RESTRICT source, uint32_t sourceRow0,
+        float* UTILS_RESTRICT target, size_t rowSize, uint32_t row0, uint32_t nrows,
+        const ResamplePass& pass) {
+    MadInstruction const* program = pass.program.data();
+    uint32_t const* first = pass.first.data();
+    for (uint32_t row = row0; row < row0 + nrows; ++row, target += rowSize) {
+        float* UTILS_RESTRICT targetRow = target;
+        std::fill_n(targetRow, rowSize, MINIMUM ? std::numeric_limits<float>::max() : 0.0f);
+        for (uint32_t i = first[row], e = first[row + 1]; i < e; ++i) {
+            const MadInstruction mad = program[i];
+            float const* UTILS_RESTRICT sourceRow =
+                    source + (mad.sourceIndex - sourceRow0) * rowSize;
+            const float w = mad.weight;
+            // no early exit, this gets vectorized
+            for (size_t k = 0; k < rowSize; ++k) {
+                targetRow[k] = MINIMUM ? std::min(targetRow[k], sourceRow[k]) :
+                        targetRow[k] + sourceRow[k] * w;
+            }
         }
-        targetRow += twidth * nchan;
-        sourceRow += swidth * nchan;
     }
+}
 
-    // Perform post processing for the current pass.
-    if (filter == Filter::GAUSSIAN_NORMALS) {
-        normalize(result);
+// Calls functor(start, count) over [0, count), split across the job system if there is one.
+// The calling thread must be adopted by the job system.
+template<typename F>
+void parallelRows(utils::JobSystem* js, uint32_t count, F functor) {
+    if (!js || count < 2) {
+        functor(0u, count);
+        return;
     }
-    return result;
+    auto job = utils::jobs::parallel_for(*js, nullptr, 0, count, std::ref(functor),
+            utils::jobs::CountSplitter<8>());
+    js->runAndWait(job);
+}
+
+// Resamples an image with a horizontal pass followed by a vertical pass. The intermediate image and
+// the MAD programs are kept around so they can be reused by subsequent calls.
+class Resampler {
+public:
+    void resample(const LinearImage& source, LinearImage& result, const ImageSampler& sampler);
+
+private:
+    float* getScratch(size_t size) {
+        if (size > mScratchSize) {
+            mScratch.reset(new float[size]);
+            mScratchSize = size;
+        }
+        return mScratch.get();
+    }
+
+    ResamplePass mHorizontal;
+    ResamplePass mVertical;
+    std::unique_ptr<float[]> mScratch;
+    size_t mScratchSize = 0;
+};
+
+void Resampler::resample(const LinearImage& source, LinearImage& result,
+        const ImageSampler& sampler) {
+    ASSERT_PRECONDITION(
+        sampler.east.mode == Boundary::EXCLUDE &&
+        sampler.north.mode == Boundary::EXCLUDE &&
+        sampler.west.mode == Boundary::EXCLUDE &&
+        sampler.south.mode == Boundary::EXCLUDE, "Not yet implemented.");
+    const uint32_t swidth = source.getWidth();
+    const uint32_t sheight = source.getHeight();
+    const uint32_t twidth = result.getWidth();
+    const uint32_t theight = result.getHeight();
+    const uint32_t nchan = source.getChannels();
+    const float radius = sampler.filterRadiusMultiplier;
+    const Region& region = sampler.sourceRegion;
+    utils::JobSystem* js = sampler.jobSystem;
+
+    mHorizontal.prepare(twidth, swidth, sampler.horizontalFilter, region.left, region.right,
+            radius);
+    mVertical.prepare(theight, sheight, sampler.verticalFilter, region.top, region.bottom,
+            radius);
+    ASSERT_PRECONDITION(nchan == 3 || (mHorizontal.filter != Filter::GAUSSIAN_NORMALS &&
+            mVertical.filter != Filter::GAUSSIAN_NORMALS), "Must be a 3-channel image.");
+
+    // Resize the image horizontally into the intermediate image, one band of rows per job.
+    float const* src = source.getPixelRef();
+    float* tmp = getScratch(size_t(twidth) * sheight * nchan);
+    const ResamplePass& hpass = mHorizontal;
+    parallelRows(js, sheight, [=, &hpass](uint32_t row0, uint32_t nrows) {
+        if (hpass.filter == Filter::MINIMUM) {
+            resampleRows<true>(src, tmp, swidth, twidth, nchan, row0, nrows, hpass);
+        } else {
+            resampleRows<false>(src, tmp, swidth, twidth, nchan, row0, nrows, hpass);
+        }
+        if (hpass.filter == Filter::GAUSSIAN_NORMALS) {
+            normalize(tmp + size_t(row0) * twidth * 3, size_t(nrows) * twidth);
+        }
+    });
+
+    // Resize the intermediate image vertically into the result, one band of rows per job.
+    float* dst = result.getPixelRef();
+    const size_t rowSize = size_t(twidth) * nchan;
+    const ResamplePass& vpass = mVertical;
+    parallelRows(js, theight, [=, &vpass](uint32_t row0, uint32_t nrows) {
+        float* target = dst + row0 * rowSize;
+        if (vpass.filter == Filter::MINIMUM) {
+            resampleColumns<true>(tmp, 0, target, rowSize, row0, nrows, vpass);
+        } else {
+            resampleColumns<false>(tmp, 0, target, rowSize, row0, nrows, vpass);
+        }
+        if (vpass.filter == Filter::GAUSSIAN_NORMALS) {
+            normalize(target, size_t(nrows) * twidth);
+        }
+    });
 }
 
 } // anonymous namespace
@@ -275,30 +398,17 @@ SingleSample::~SingleSample() {
 
 LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t height,
         const ImageSampler& sampler) {
-    ASSERT_PRECONDITION(
-        sampler.east.mode == Boundary::EXCLUDE &&
-        sampler.north.mode == Boundary::EXCLUDE &&
-        sampler.west.mode == Boundary::EXCLUDE &&
-        sampler.south.mode == Boundary::EXCLUDE, "Not yet implemented.");
-    const auto hfilter = sampler.horizontalFilter;
-    const auto vfilter = sampler.verticalFilter;
-    const float radius = sampler.filterRadiusMultiplier;
-    const float left = sampler.sourceRegion.left;
-    const float top = sampler.sourceRegion.top;
-    const float right = sampler.sourceRegion.right;
-    const float bottom = sampler.sourceRegion.bottom;
-    MadProgram program;
-    LinearImage result;
-    result = transpose(resampleImage1D(source, &program, width, hfilter, left, right, radius));
-    result = transpose(resampleImage1D(result, &program, height, vfilter, top, bottom, radius));
+    LinearImage result(width, height, source.getChannels());
+    Resampler().resample(source, result, sampler);
     return result;
 }
 
 LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t height,
-        Filter filter) {
+        Filter filter, utils::JobSystem* jobSystem) {
     return resampleImage(source, width, height, ImageSampler {
         .horizontalFilter = filter,
-        .verticalFilter = filter
+        .verticalFilter = filter,
+        .jobSystem = jobSystem
     });
 }
 
@@ -309,35 +419,181 @@ void computeSingleSample(const LinearImage& source, float x, float y, SingleSamp
     const float top = y - radius / source.getHeight();
     const float right = x + radius / source.getWidth();
     const float bottom = y + radius / source.getHeight();
-    MadProgram program;
-    LinearImage row = transpose(resampleImage1D(source, &program, 1, filter, left, right, radius));
-    row = resampleImage1D(row, &program, 1, filter, top, bottom, radius);
+    LinearImage pixel = resampleImage(source, 1, 1, ImageSampler {
+        .horizontalFilter = filter,
+        .verticalFilter = filter,
+        .sourceRegion = { left, top, right, bottom },
+        .filterRadiusMultiplier = radius
+    });
     if (!result->data) {
         result->data = new float[source.getChannels()];
     }
     float* dst = result->data;
-    float const* src = row.getPixelRef();
+    float const* src = pixel.getPixelRef();
     for (uint32_t c = 0; c < source.getChannels(); ++c) {
         dst[c] = src[c];
     }
 }
 
 // Unlike traditional mipmap generation, our implementation generates all levels from the original
-// image, under the premise that this produces a higher quality result.
-void generateMipmaps(const LinearImage& source, Filter filter, LinearImage* result, uint32_t mips) {
+// image, under the premise that this produces a higher quality result. The intermediate image of
+// the first level is the largest, and it is reused by all the subsequent levels.
+void generateMipmaps(const LinearImage& source, Filter filter, LinearImage* result, uint32_t mips,
+        utils::JobSystem* jobSystem) {
     mips = std::min(mips, getMipmapCount(source));
+    const ImageSampler sampler {
+        .horizontalFilter = filter,
+        .verticalFilter = filter,
+        .jobSystem = jobSystem
+    };
+    Resampler resampler;
     uint32_t width = source.getWidth();
     uint32_t height = source.getHeight();
     for (uint32_t n = 0; n < mips; ++n) {
        width = std::max(width >> 1, 1u);
        height = std::max(height >> 1, 1u);
-       result[n] = resampleImage(source, width, height, filter);
+       result[n] = LinearImage(width, height, source.getChannels());
+       resampler.resample(source, result[n], sampler);
+    }
+}
+
+// The horizontal pass runs as soon as a strip comes in, and its output is appended to a window of
+// intermediate rows. A target row is resampled vertically once the window holds the last source row
+// it reads; the rows that no target row reads anymore are dropped from the front of the window.
+struct StripResampler::Impl {
+    ResamplePass horizontal;
+    ResamplePass vertical;
+    std::vector<float> window;
+    uint32_t windowRow0 = 0;
+    uint32_t sourceWidth;
+    uint32_t sourceHeight;
+    uint32_t channels;
+    uint32_t width;
+    uint32_t height;
+    uint32_t receivedRows = 0;
+    uint32_t nextRow = 0;
+    utils::JobSystem* jobSystem;
+
+    // Returns true if the window holds all the source rows read by the given target row.
+    bool isReady(uint32_t row) const {
+        const uint32_t begin = vertical.first[row];
+        const uint32_t end = vertical.first[row + 1];
+        return begin == end || uint32_t(vertical.program[end - 1].sourceIndex) < receivedRows;
+    }
+
+    // Returns the first source row read by the given target row or any of the following ones.
+    uint32_t getFirstSourceRow(uint32_t row) const {
+        for (; row < height; ++row) {
+            const uint32_t begin = vertical.first[row];
+            if (begin != vertical.first[row + 1]) {
+                return uint32_t(vertical.program[begin].sourceIndex);
+            }
+        }
+        return receivedRows;
+    }
+};
+
+StripResampler::StripResampler(uint32_t sourceWidth, uint32_t sourceHeight, uint32_t channels,
+        uint32_t width, uint32_t height, const ImageSampler& sampler) : mImpl(new Impl) {
+    ASSERT_PRECONDITION(
+        sampler.east.mode == Boundary::EXCLUDE &&
+        sampler.north.mode == Boundary::EXCLUDE &&
+        sampler.west.mode == Boundary::EXCLUDE &&
+        sampler.south.mode == Boundary::EXCLUDE, "Not yet implemented.");
+    const float radius = sampler.filterRadiusMultiplier;
+    const Region& region = sampler.sourceRegion;
+    mImpl->horizontal.prepare(width, sourceWidth, sampler.horizontalFilter, region.left,
+            region.right, radius);
+    mImpl->vertical.prepare(height, sourceHeight, sampler.verticalFilter, region.top,
+            region.bottom, radius);
+    ASSERT_PRECONDITION(channels == 3 ||
+            (mImpl->horizontal.filter != Filter::GAUSSIAN_NORMALS &&
+            mImpl->vertical.filter != Filter::GAUSSIAN_NORMALS), "Must be a 3-channel image.");
+    mImpl->sourceWidth = sourceWidth;
+    mImpl->sourceHeight = sourceHeight;
+    mImpl->channels = channels;
+    mImpl->width = width;
+    mImpl->height = height;
+    mImpl->jobSystem = sampler.jobSystem;
+}
+
+StripResampler::~StripResampler() {
+    delete mImpl;
+}
+
+LinearImage StripResampler::resample(const LinearImage& strip) {
+    Impl& impl = *mImpl;
+    const uint32_t swidth = impl.sourceWidth;
+    const uint32_t twidth = impl.width;
+    const uint32_t nchan = impl.channels;
+    const uint32_t nrows = strip.getHeight();
+    ASSERT_PRECONDITION(strip.getWidth() == swidth && strip.getChannels() == nchan,
+            "The strip doesn't match the source image.");
+    ASSERT_PRECONDITION(impl.receivedRows + nrows <= impl.sourceHeight,
+            "Too many rows for the source image.");
+
+    // Append the strip, resized horizontally, to the window.
+    const size_t rowSize = size_t(twidth) * nchan;
+    const size_t windowSize = (impl.receivedRows - impl.windowRow0) * rowSize;
+    impl.window.resize(windowSize + nrows * rowSize);
+    float const* src = strip.getPixelRef();
+    float* tmp = impl.window.data() + windowSize;
+    const ResamplePass& hpass = impl.horizontal;
+    parallelRows(impl.jobSystem, nrows, [=, &hpass](uint32_t row0, uint32_t count) {
+        if (hpass.filter == Filter::MINIMUM) {
+            resampleRows<true>(src, tmp, swidth, twidth, nchan, row0, count, hpass);
+        } else {
+            resampleRows<false>(src, tmp, swidth, twidth, nchan, row0, count, hpass);
+        }
+        if (hpass.filter == Filter::GAUSSIAN_NORMALS) {
+            normalize(tmp + size_t(row0) * rowSize, size_t(count) * twidth);
+        }
+    });
+    impl.receivedRows += nrows;
+
+    // Resize vertically all the target rows that can be completed with the window.
+    uint32_t rowCount = 0;
+    while (impl.nextRow + rowCount < impl.height && impl.isReady(impl.nextRow + rowCount)) {
+        ++rowCount;
     }
+    if (rowCount == 0) {
+        return LinearImage();
+    }
+    LinearImage result(twidth, rowCount, nchan);
+    float const* window = impl.window.data();
+    const uint32_t windowRow0 = impl.windowRow0;
+    const uint32_t firstRow = impl.nextRow;
+    float* dst = result.getPixelRef();
+    const ResamplePass& vpass = impl.vertical;
+    parallelRows(impl.jobSystem, rowCount, [=, &vpass](uint32_t row0, uint32_t count) {
+        float* target = dst + row0 * rowSize;
+        if (vpass.filter == Filter::MINIMUM) {
+            resampleColumns<true>(window, windowRow0, target, rowSize, firstRow + row0, count,
+                    vpass);
+        } else {
+            resampleColumns<false>(window, windowRow0, target, rowSize, firstRow + row0, count,
+                    vpass);
+        }
+        if (vpass.filter == Filter::GAUSSIAN_NORMALS) {
+            normalize(target, size_t(count) * twidth);
+        }
+    });
+    impl.nextRow += rowCount;
+
+    // Drop the rows that won't be read anymore.
+    const uint32_t row0 = std::min(impl.receivedRows,
+            std::max(impl.windowRow0, impl.getFirstSourceRow(impl.nextRow)));
+    impl.window.erase(impl.window.begin(),
+            impl.window.begin() + (row0 - impl.windowRow0) * rowSize);
+    impl.windowRow0 = row0;
+    return result;
 }
 
 uint32_t getMipmapCount(const LinearImage& source) {
-    uint32_t width = source.getWidth();
-    uint32_t height = source.getHeight();
+    return getMipmapCount(source.getWidth(), source.getHeight());
+}
+
+uint32_t getMipmapCount(uint32_t width, uint32_t height) {
     uint32_t count = 0;
     while (width > 1 || height > 1) {
         ++count;
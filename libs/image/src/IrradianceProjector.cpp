@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <image/IrradianceProjector.h>
+
+#include <utils/compiler.h>
+#include <utils/JobSystem.h>
+#include <utils/Panic.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+using namespace math;
+
+namespace image {
+
+namespace {
+
+// Within a face, the direction of a texel is a signed permutation of (u, v, w), where (u, v) are
+// its normalized coordinates on the face and w the normalized distance to the face. The SH basis
+// up to band 2 only needs the monomials of degree 2 of the direction, stored in this order.
+enum Monomial {
+    ONE, U, V, W, UU, VV, WW, UV, UW, VW, MONOMIAL_COUNT
+};
+
+constexpr size_t linear(size_t i) { return U + i; }
+constexpr size_t quadratic(size_t i, size_t j) { return i == j ? UU + i : UV + i + j - 1; }
+
+struct Axis {
+    uint8_t index;  // 0: u, 1: v, 2: w
+    double sign;
+};
+
+// x, y and z of the direction in terms of (u, v, w) for each face, see Cubemap::getDirectionFor
+constexpr Axis FACE_AXES[6][3] = {
+    { { 2,  1 }, { 1,  1 }, { 0, -1 } },  // +X
+    { { 2, -1 }, { 1,  1 }, { 0,  1 } },  // -X
+    { { 0,  1 }, { 2,  1 }, { 1, -1 } },  // +Y
+    { { 0,  1 }, { 2, -1 }, { 1,  1 } },  // -Y
+    { { 0,  1 }, { 1,  1 }, { 2,  1 } },  // +Z
+    { { 0, -1 }, { 1,  1 }, { 2, -1 } },  // -Z
+};
+
+// Spherical area of the (-1,-1)-(x,y) quadrant of a face, see CubemapUtils::solidAngle
+double sphereQuadrantArea(double x, double y) {
+    return std::atan2(x * y, std::sqrt(x * x + y * y + 1));
+}
+
+double solidAngle(uint32_t dim, uint32_t u, uint32_t v) {
+    const double iDim = 1.0 / dim;
+    const double s = ((u + 0.5) * 2 * iDim) - 1;
+    const double t = ((v + 0.5) * 2 * iDim) - 1;
+    const double x0 = s - iDim;
+    const double y0 = t - iDim;
+    const double x1 = s + iDim;
+    const double y1 = t + iDim;
+    return sphereQuadrantArea(x0, y0) - sphereQuadrantArea(x0, y1) -
+           sphereQuadrantArea(x1, y0) + sphereQuadrantArea(x1, y1);
+}
+
+// The independent lanes let the compiler vectorize the loop without reassociating the sum.
+float dot(float const* UTILS_RESTRICT a, float const* UTILS_RESTRICT b, size_t count) {
+    constexpr size_t LANES = 8;
+    float lanes[LANES] = {};
+    size_t i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        for (size_t l = 0; l < LANES; l++) {
+            lanes[l] += a[i + l] * b[i + l];
+        }
+    }
+    float result = 0;
+    for (; i < count; i++) {
+        result += a[i] * b[i];
+    }
+    for (size_t l = 0; l < LANES; l++) {
+        result += lanes[l];
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+IrradianceProjector::IrradianceProjector(uint32_t dim) : mDim(dim) {
+    ASSERT_PRECONDITION(dim > 0, "Cubemap faces must not be empty.");
+    const size_t texels = size_t(dim) * dim;
+    mBasis.reset(new float[MONOMIAL_COUNT * texels]);
+    float* basis = mBasis.get();
+    for (uint32_t y = 0; y < dim; y++) {
+        for (uint32_t x = 0; x < dim; x++) {
+            const size_t i = y * dim + x;
+            const double cx = (x + 0.5) * 2.0 / dim - 1;
+            const double cy = 1 - (y + 0.5) * 2.0 / dim;
+            const double w = 1 / std::sqrt(cx * cx + cy * cy + 1);
+            const double u = cx * w;
+            const double v = cy * w;
+            const double sa = solidAngle(dim, x, y);
+            basis[ONE * texels + i] = float(sa);
+            basis[U   * texels + i] = float(sa * u);
+            basis[V   * texels + i] = float(sa * v);
+            basis[W   * texels + i] = float(sa * w);
+            basis[UU  * texels + i] = float(sa * u * u);
+            basis[VV  * texels + i] = float(sa * v * v);
+            basis[WW  * texels + i] = float(sa * w * w);
+            basis[UV  * texels + i] = float(sa * u * v);
+            basis[UW  * texels + i] = float(sa * u * w);
+            basis[VW  * texels + i] = float(sa * v * w);
+        }
+    }
+}
+
+void IrradianceProjector::project(LinearImage const faces[6], float3 sh[9],
+        utils::JobSystem* js) const {
+    const uint32_t dim = mDim;
+    for (size_t f = 0; f < 6; f++) {
+        ASSERT_PRECONDITION(faces[f].getWidth() == dim && faces[f].getHeight() == dim,
+                "Cubemap faces must be %u x %u.", dim, dim);
+        ASSERT_PRECONDITION(faces[f].getChannels() >= 3, "Cubemap faces must be RGB.");
+    }
+
+    // The monomials are integrated over every row into their own slot, so that the rows can be
+    // processed in any order and the sums reduced deterministically afterwards.
+    const size_t texels = size_t(dim) * dim;
+    const uint32_t rowCount = 6 * dim;
+    std::vector<float> rowSums(rowCount * MONOMIAL_COUNT * 3);
+    float const* basis = mBasis.get();
+
+    auto projectRows = [&](uint32_t start, uint32_t count) {
+        std::vector<float> rgb(dim * 3);
+        float* channels[3] = { rgb.data(), rgb.data() + dim, rgb.data() + 2 * dim };
+        for (uint32_t row = start; row < start + count; row++) {
+            const LinearImage& face = faces[row / dim];
+            const uint32_t y = row % dim;
+            const uint32_t n = face.getChannels();
+            float const* src = face.getPixelRef(0, y);
+            for (uint32_t x = 0; x < dim; x++, src += n) {
+                channels[0][x] = src[0];
+                channels[1][x] = src[1];
+                channels[2][x] = src[2];
+            }
+            float* sums = rowSums.data() + row * MONOMIAL_COUNT * 3;
+            for (size_t k = 0; k < MONOMIAL_COUNT; k++) {
+                float const* b = basis + k * texels + y * dim;
+                for (size_t c = 0; c < 3; c++) {
+                    sums[k * 3 + c] = dot(b, channels[c], dim);
+                }
+            }
+        }
+    };
+
+    if (js && rowCount > 1) {
+        auto job = utils::jobs::parallel_for(*js, nullptr, 0, rowCount, std::ref(projectRows),
+                utils::jobs::CountSplitter<16>());
+        js->runAndWait(job);
+    } else {
+        projectRows(0, rowCount);
+    }
+
+    // Convolution by the truncated cosine and SH normalization, see computeIrradianceSH3Bands
+    constexpr double A[9] = {
+        0.25, 0.5, 0.5, 0.5, 0.9375, 0.9375, 0.078125, 0.9375, 0.234375
+    };
+
+    double3 result[9] = {};
+    for (size_t f = 0; f < 6; f++) {
+        double3 m[MONOMIAL_COUNT] = {};
+        for (uint32_t y = 0; y < dim; y++) {
+            float const* sums = rowSums.data() + (f * dim + y) * MONOMIAL_COUNT * 3;
+            for (size_t k = 0; k < MONOMIAL_COUNT; k++) {
+                m[k] += double3(sums[k * 3], sums[k * 3 + 1], sums[k * 3 + 2]);
+            }
+        }
+
+        const Axis* axes = FACE_AXES[f];
+        auto S = [&](size_t i) { return m[linear(axes[i].index)] * axes[i].sign; };
+        auto SS = [&](size_t i, size_t j) {
+            return m[quadratic(std::min(axes[i].index, axes[j].index),
+                    std::max(axes[i].index, axes[j].index))] * (axes[i].sign * axes[j].sign);
+        };
+
+        result[0] += m[ONE]                    * A[0];
+        result[1] += S(1)                      * A[1];
+        result[2] += S(2)                      * A[2];
+        result[3] += S(0)                      * A[3];
+        result[4] += SS(1, 0)                  * A[4];
+        result[5] += SS(1, 2)                  * A[5];
+        result[6] += (SS(2, 2) * 3.0 - m[ONE])   * A[6];
+        result[7] += SS(2, 0)                  * A[7];
+        result[8] += (SS(0, 0) - SS(1, 1))     * A[8];
+    }
+
+    for (size_t i = 0; i < 9; i++) {
+        sh[i] = float3(result[i]);
+    }
+}
+
+} // namespace image
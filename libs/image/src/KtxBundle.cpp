@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <image/KtxBundle.h>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+const uint8_t KTX_IDENTIFIER[12] = {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+const uint8_t KTX2_IDENTIFIER[12] = {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+// The header as it is laid out in the file, right after the identifier.
+struct SerializedHeader {
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+static_assert(sizeof(SerializedHeader) == 13 * sizeof(uint32_t), "Unexpected header size.");
+
+// The KTX 2.0 header and index, right after the identifier, followed by one LevelIndex per level.
+struct SerializedHeader2 {
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint32_t sgdByteOffset[2];
+    uint32_t sgdByteLength[2];
+};
+
+struct LevelIndex {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+static_assert(sizeof(SerializedHeader2) == 17 * sizeof(uint32_t), "Unexpected header size.");
+static_assert(sizeof(LevelIndex) == 3 * sizeof(uint64_t), "Unexpected level index size.");
+
+using image::KtxBundle;
+
+// The vkFormats of KTX 2.0 files that have a GL equivalent in KtxBundle.
+const struct {
+    uint32_t vkFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    bool compressed;
+} VK_FORMATS[] = {
+    {  23, KtxBundle::RGB8,                  KtxBundle::RGB,  false },
+    {  29, KtxBundle::SRGB8,                 KtxBundle::RGB,  false },
+    {  37, KtxBundle::RGBA8,                 KtxBundle::RGBA, false },
+    {  43, KtxBundle::SRGB8_ALPHA8,          KtxBundle::RGBA, false },
+    { 131, KtxBundle::RGB_S3TC_DXT1,         KtxBundle::RGB,  true  },
+    { 132, KtxBundle::SRGB_S3TC_DXT1,        KtxBundle::RGB,  true  },
+    { 133, KtxBundle::RGBA_S3TC_DXT1,        KtxBundle::RGBA, true  },
+    { 134, KtxBundle::SRGB_ALPHA_S3TC_DXT1,  KtxBundle::RGBA, true  },
+    { 135, KtxBundle::RGBA_S3TC_DXT3,        KtxBundle::RGBA, true  },
+    { 136, KtxBundle::SRGB_ALPHA_S3TC_DXT3,  KtxBundle::RGBA, true  },
+    { 137, KtxBundle::RGBA_S3TC_DXT5,        KtxBundle::RGBA, true  },
+    { 138, KtxBundle::SRGB_ALPHA_S3TC_DXT5,  KtxBundle::RGBA, true  },
+    { 147, KtxBundle::RGB8_ETC2,             KtxBundle::RGB,  true  },
+    { 148, KtxBundle::SRGB8_ETC2,            KtxBundle::RGB,  true  },
+    { 149, KtxBundle::RGB8_ALPHA1_ETC2,      KtxBundle::RGBA, true  },
+    { 150, KtxBundle::SRGB8_ALPHA1_ETC2,     KtxBundle::RGBA, true  },
+    { 151, KtxBundle::RGBA8_ETC2_EAC,        KtxBundle::RGBA, true  },
+    { 152, KtxBundle::SRGB8_ALPHA8_ETC2_EAC, KtxBundle::RGBA, true  },
+    { 153, KtxBundle::R11_EAC,               KtxBundle::RED,  true  },
+    { 154, KtxBundle::SIGNED_R11_EAC,        KtxBundle::RED,  true  },
+    { 155, KtxBundle::RG11_EAC,              KtxBundle::RG,   true  },
+    { 156, KtxBundle::SIGNED_RG11_EAC,       KtxBundle::RG,   true  },
+};
+
+inline uint32_t align4(uint32_t size) {
+    return (size + 3u) & ~3u;
+}
+
+} // anonymous namespace
+
+namespace image {
+
+KtxBundle::KtxBundle(uint32_t numMipLevels, uint32_t arrayLength, bool isCubemap) :
+        mNumMipLevels(numMipLevels ? numMipLevels : 1),
+        mArrayLength(arrayLength ? arrayLength : 1),
+        mNumCubeFaces(isCubemap ? 6 : 1),
+        mLevels(new Level[mNumMipLevels]) {
+    mInfo.endianness = ENDIAN_DEFAULT;
+}
+
+KtxBundle::KtxBundle(uint8_t const* bytes, uint32_t nbytes, bool copyContents) {
+    if (nbytes >= sizeof(KTX_IDENTIFIER) + sizeof(SerializedHeader) &&
+            memcmp(bytes, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) == 0) {
+        parseKtx1(bytes, nbytes, copyContents);
+    } else if (nbytes >= sizeof(KTX2_IDENTIFIER) + sizeof(SerializedHeader2) &&
+            memcmp(bytes, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0) {
+        parseKtx2(bytes, nbytes, copyContents);
+    } else {
+        throw std::runtime_error("Not a KTX file.");
+    }
+}
+
+void KtxBundle::parseKtx1(uint8_t const* bytes, uint32_t nbytes, bool copyContents) {
+    SerializedHeader header;
+    memcpy(&header, bytes + sizeof(KTX_IDENTIFIER), sizeof(header));
+    if (header.endianness != ENDIAN_DEFAULT) {
+        throw std::runtime_error("Big endian KTX files are not supported.");
+    }
+    mInfo = {
+        header.endianness,
+        header.glType,
+        header.glTypeSize,
+        header.glFormat,
+        header.glInternalFormat,
+        header.glBaseInternalFormat,
+        header.pixelWidth,
+        header.pixelHeight,
+        header.pixelDepth,
+    };
+    mNumMipLevels = header.numberOfMipmapLevels ? header.numberOfMipmapLevels : 1;
+    mArrayLength = header.numberOfArrayElements ? header.numberOfArrayElements : 1;
+    mNumCubeFaces = header.numberOfFaces;
+    if (mNumCubeFaces != 1 && mNumCubeFaces != 6) {
+        throw std::runtime_error("Invalid number of KTX faces.");
+    }
+    mLevels.reset(new Level[mNumMipLevels]);
+
+    // Faces of non-array cubemaps are listed with their own size and padding, the other kinds of
+    // textures store the size of the whole level.
+    const bool perFace = mNumCubeFaces == 6 && mArrayLength == 1;
+    const uint32_t blobCount = getBlobCount();
+    uint64_t offset = sizeof(KTX_IDENTIFIER) + sizeof(SerializedHeader);
+    offset += header.bytesOfKeyValueData;
+    for (uint32_t level = 0; level < mNumMipLevels; level++) {
+        uint32_t imageSize;
+        if (offset + sizeof(imageSize) > nbytes) {
+            throw std::runtime_error("Truncated KTX file.");
+        }
+        memcpy(&imageSize, bytes + offset, sizeof(imageSize));
+        offset += sizeof(imageSize);
+
+        const uint32_t blobSize = perFace ? imageSize : imageSize / blobCount;
+        const uint32_t stride = perFace ? align4(blobSize) : blobSize;
+        if (offset + uint64_t(stride) * blobCount > nbytes) {
+            throw std::runtime_error("Truncated KTX file.");
+        }
+        setLevel(level, bytes + offset, blobSize, stride, copyContents);
+        offset += align4(stride * blobCount);
+    }
+}
+
+void KtxBundle::parseKtx2(uint8_t const* bytes, uint32_t nbytes, bool copyContents) {
+    SerializedHeader2 header;
+    memcpy(&header, bytes + sizeof(KTX2_IDENTIFIER), sizeof(header));
+    if (header.supercompressionScheme != uint32_t(Supercompression::NONE) &&
+            header.supercompressionScheme != uint32_t(Supercompression::ZLIB)) {
+        throw std::runtime_error("Unsupported KTX supercompression scheme.");
+    }
+    mSupercompression = Supercompression(header.supercompressionScheme);
+
+    mInfo = {};
+    mInfo.endianness = ENDIAN_DEFAULT;
+    mInfo.glTypeSize = 1;
+    for (const auto& format : VK_FORMATS) {
+        if (format.vkFormat == header.vkFormat) {
+            // the uncompressed formats all have 8 bits components
+            mInfo.glType = format.compressed ? 0 : UNSIGNED_BYTE;
+            mInfo.glFormat = format.compressed ? 0 : format.glBaseInternalFormat;
+            mInfo.glInternalFormat = format.glInternalFormat;
+            mInfo.glBaseInternalFormat = format.glBaseInternalFormat;
+        }
+    }
+    if (!mInfo.glInternalFormat) {
+        throw std::runtime_error("Unsupported KTX vkFormat.");
+    }
+    mInfo.pixelWidth = header.pixelWidth;
+    mInfo.pixelHeight = header.pixelHeight;
+    mInfo.pixelDepth = header.pixelDepth;
+
+    mNumMipLevels = header.levelCount ? header.levelCount : 1;
+    mArrayLength = header.layerCount ? header.layerCount : 1;
+    mNumCubeFaces = header.faceCount;
+    if (mNumCubeFaces != 1 && mNumCubeFaces != 6) {
+        throw std::runtime_error("Invalid number of KTX faces.");
+    }
+    const uint64_t indexOffset = sizeof(KTX2_IDENTIFIER) + sizeof(header);
+    if (indexOffset + uint64_t(mNumMipLevels) * sizeof(LevelIndex) > nbytes) {
+        throw std::runtime_error("Truncated KTX file.");
+    }
+    mLevels.reset(new Level[mNumMipLevels]);
+
+    // the blobs of a level are tightly packed, layers first, then faces, a supercompressed
+    // level is kept whole
+    const uint32_t blobCount = isSupercompressed() ? 1 : getBlobCount();
+    for (uint32_t level = 0; level < mNumMipLevels; level++) {
+        LevelIndex index;
+        memcpy(&index, bytes + indexOffset + level * sizeof(LevelIndex), sizeof(index));
+        if (index.byteOffset + index.byteLength > nbytes) {
+            throw std::runtime_error("Truncated KTX file.");
+        }
+        const uint32_t blobSize = uint32_t(index.byteLength / blobCount);
+        setLevel(level, bytes + index.byteOffset, blobSize, blobSize, copyContents);
+        mLevels[level].uncompressedSize = uint32_t(index.uncompressedByteLength);
+    }
+}
+
+void KtxBundle::setLevel(uint32_t level, uint8_t const* data, uint32_t blobSize,
+        uint32_t blobStride, bool copyContents) {
+    Level& dst = mLevels[level];
+    dst.blobSize = blobSize;
+    if (!copyContents) {
+        dst.blobStride = blobStride;
+        dst.data = data;
+        return;
+    }
+    const uint32_t blobCount = isSupercompressed() ? 1 : getBlobCount();
+    dst.blobStride = blobSize;
+    dst.storage.reset(new uint8_t[blobSize * blobCount]);
+    for (uint32_t blob = 0; blob < blobCount; blob++) {
+        memcpy(dst.storage.get() + blob * blobSize, data + blob * blobStride, blobSize);
+    }
+    dst.data = dst.storage.get();
+}
+
+KtxBundle::~KtxBundle() = default;
+
+uint32_t KtxBundle::getSerializedLength() const {
+    const bool perFace = mNumCubeFaces == 6 && mArrayLength == 1;
+    const uint32_t blobCount = getBlobCount();
+    uint32_t total = sizeof(KTX_IDENTIFIER) + sizeof(SerializedHeader);
+    for (uint32_t level = 0; level < mNumMipLevels; level++) {
+        const uint32_t blobSize = mLevels[level].blobSize;
+        const uint32_t stride = perFace ? align4(blobSize) : blobSize;
+        total += sizeof(uint32_t) + align4(stride * blobCount);
+    }
+    return total;
+}
+
+bool KtxBundle::serialize(uint8_t* destination, uint32_t numBytes) const {
+    if (isSupercompressed() || numBytes < getSerializedLength()) {
+        return false;
+    }
+    const SerializedHeader header = {
+        mInfo.endianness,
+        mInfo.glType,
+        mInfo.glTypeSize,
+        mInfo.glFormat,
+        mInfo.glInternalFormat,
+        mInfo.glBaseInternalFormat,
+        mInfo.pixelWidth,
+        mInfo.pixelHeight,
+        mInfo.pixelDepth,
+        mArrayLength > 1 ? mArrayLength : 0,
+        mNumCubeFaces,
+        mNumMipLevels,
+        0,
+    };
+    memcpy(destination, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+    memcpy(destination + sizeof(KTX_IDENTIFIER), &header, sizeof(header));
+
+    const bool perFace = mNumCubeFaces == 6 && mArrayLength == 1;
+    const uint32_t blobCount = getBlobCount();
+    uint8_t* dst = destination + sizeof(KTX_IDENTIFIER) + sizeof(header);
+    for (uint32_t level = 0; level < mNumMipLevels; level++) {
+        Level const& src = mLevels[level];
+        const uint32_t stride = perFace ? align4(src.blobSize) : src.blobSize;
+        const uint32_t imageSize = perFace ? src.blobSize : src.blobSize * blobCount;
+        const uint32_t levelSize = align4(stride * blobCount);
+        memcpy(dst, &imageSize, sizeof(imageSize));
+        dst += sizeof(imageSize);
+        memset(dst, 0, levelSize);
+        if (src.data) {
+            for (uint32_t blob = 0; blob < blobCount; blob++) {
+                memcpy(dst + blob * stride, src.data + blob * src.blobStride, src.blobSize);
+            }
+        }
+        dst += levelSize;
+    }
+    return true;
+}
+
+bool KtxBundle::isValid(KtxBlobIndex index) const {
+    return index.mipLevel < mNumMipLevels && index.arrayIndex < mArrayLength &&
+            index.cubeFace < mNumCubeFaces;
+}
+
+uint32_t KtxBundle::getBlobOffset(KtxBlobIndex index) const {
+    const uint32_t blob = index.arrayIndex * mNumCubeFaces + index.cubeFace;
+    return blob * mLevels[index.mipLevel].blobStride;
+}
+
+bool KtxBundle::getBlob(KtxBlobIndex index, uint8_t const** data, uint32_t* size) const {
+    if (isSupercompressed() || !isValid(index) || !mLevels[index.mipLevel].data) {
+        return false;
+    }
+    *data = mLevels[index.mipLevel].data + getBlobOffset(index);
+    *size = mLevels[index.mipLevel].blobSize;
+    return true;
+}
+
+bool KtxBundle::getSupercompressedLevel(uint32_t level, uint8_t const** data, uint32_t* size,
+        uint32_t* uncompressedSize) const {
+    if (!isSupercompressed() || level >= mNumMipLevels) {
+        return false;
+    }
+    *data = mLevels[level].data;
+    *size = mLevels[level].blobSize;
+    *uncompressedSize = mLevels[level].uncompressedSize;
+    return true;
+}
+
+bool KtxBundle::setBlob(KtxBlobIndex index, uint8_t const* data, uint32_t size) {
+    if (isSupercompressed() || !isValid(index)) {
+        return false;
+    }
+    Level& level = mLevels[index.mipLevel];
+    if (!level.data) {
+        level.blobSize = size;
+        level.blobStride = size;
+        level.storage.reset(new uint8_t[size * getBlobCount()]());
+        level.data = level.storage.get();
+    } else if (level.blobSize != size) {
+        return false;
+    } else if (!level.storage) {
+        setLevel(index.mipLevel, level.data, level.blobSize, level.blobStride, true);
+    }
+    memcpy(level.storage.get() + getBlobOffset(index), data, size);
+    return true;
+}
+
+} // namespace image
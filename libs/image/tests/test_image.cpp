@@ -17,23 +17,32 @@
 #include <image/ColorTransform.h>
 #include <image/ImageOps.h>
 #include <image/ImageSampler.h>
+#include <image/IrradianceProjector.h>
+#include <image/KtxBundle.h>
 #include <image/LinearImage.h>
 
+#include <imageio/BlockCompression.h>
 #include <imageio/ImageDecoder.h>
 #include <imageio/ImageDiffer.h>
 #include <imageio/ImageEncoder.h>
+#include <imageio/KtxTranscoder.h>
 
 #include <gtest/gtest.h>
 
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 #include <utils/Path.h>
 
+#include <math/half.h>
 #include <math/vec3.h>
 #include <math/vec4.h>
 
+#include <zlib.h>
+
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <vector>
 
 using std::istringstream;
 using std::string;
@@ -307,6 +316,340 @@ TEST_F(ImageTest, Mipmaps) { // NOLINT
     }
 }
 
+TEST_F(ImageTest, ParallelMipmaps) { // NOLINT
+    // Splitting the passes across threads must not change the result.
+    utils::JobSystem js;
+    js.adopt();
+    LinearImage src = resampleImage(createNormalMap(64), 300, 200, Filter::GAUSSIAN_NORMALS);
+    for (Filter filter : { Filter::DEFAULT, Filter::MINIMUM, Filter::GAUSSIAN_NORMALS }) {
+        uint32_t count = getMipmapCount(src);
+        std::vector<LinearImage> expected(count);
+        std::vector<LinearImage> mips(count);
+        generateMipmaps(src, filter, expected.data(), count);
+        generateMipmaps(src, filter, mips.data(), count, &js);
+        for (uint32_t index = 0; index < count; ++index) {
+            const size_t size = mips[index].getWidth() * mips[index].getHeight() * 3;
+            ASSERT_EQ(memcmp(mips[index].getPixelRef(), expected[index].getPixelRef(),
+                    size * sizeof(float)), 0);
+        }
+    }
+    js.emancipate();
+}
+
+TEST_F(ImageTest, StripResampler) { // NOLINT
+    // Resampling strip by strip must produce the same rows as resampling the whole image.
+    LinearImage src = resampleImage(createNormalMap(64), 300, 200, Filter::GAUSSIAN_NORMALS);
+    const ImageSampler sampler {
+        .horizontalFilter = Filter::LANCZOS,
+        .verticalFilter = Filter::MITCHELL,
+        .sourceRegion = { 0.1f, 0.2f, 0.9f, 0.7f }
+    };
+    for (uint32_t height : { 17u, 100u, 250u }) {
+        for (uint32_t stripHeight : { 1u, 7u, 200u }) {
+            LinearImage expected = resampleImage(src, 120, height, sampler);
+            StripResampler resampler(300, 200, 3, 120, height, sampler);
+            uint32_t row = 0;
+            for (uint32_t y = 0; y < 200; y += stripHeight) {
+                const uint32_t bottom = std::min(y + stripHeight, 200u);
+                LinearImage rows = resampler.resample(cropRegion(src, 0, y, 300, bottom));
+                if (rows.isValid()) {
+                    ASSERT_LE(row + rows.getHeight(), height);
+                    const size_t size = rows.getWidth() * rows.getHeight() * 3;
+                    ASSERT_EQ(memcmp(rows.getPixelRef(), expected.getPixelRef(0, row),
+                            size * sizeof(float)), 0);
+                    row += rows.getHeight();
+                }
+            }
+            ASSERT_EQ(row, height);
+        }
+    }
+}
+
+TEST_F(ImageTest, PixelDecoder) { // NOLINT
+    // Native pixels must match the float images of decode(), whether the rows are converted in
+    // parallel or not.
+    LinearImage image = resampleImage(createNormalMap(64), 30, 20, Filter::GAUSSIAN_NORMALS);
+    utils::JobSystem js;
+    js.adopt();
+    for (auto format : { ImageEncoder::Format::PNG_LINEAR, ImageEncoder::Format::HDR }) {
+        std::stringstream stream;
+        ImageEncoder::encode(stream, format, image, "", "");
+        LinearImage expected = ImageDecoder::decode(stream, "", ImageDecoder::ColorSpace::LINEAR);
+        ASSERT_TRUE(expected.isValid());
+
+        for (utils::JobSystem* jobSystem : { (utils::JobSystem*) nullptr, &js }) {
+            stream.clear();
+            stream.seekg(0);
+            auto decoder = ImageDecoder::decodePixels(stream);
+            ASSERT_NE(decoder, nullptr);
+            ASSERT_EQ(decoder->getWidth(), 30);
+            ASSERT_EQ(decoder->getHeight(), 20);
+
+            // rows with some padding
+            const size_t stride = decoder->getWidth() * decoder->getBytesPerPixel() + 8;
+            std::vector<uint8_t> pixels(decoder->getBufferSize(stride));
+            ASSERT_TRUE(decoder->decodePixels(pixels.data(), stride, jobSystem));
+            for (uint32_t y = 0; y < 20; y++) {
+                for (uint32_t x = 0; x < 30; x++) {
+                    const float3 color = *expected.get<float3>(x, y);
+                    if (format == ImageEncoder::Format::HDR) {
+                        ASSERT_EQ(decoder->getPixelFormat(), ImageDecoder::PixelFormat::RGB16F);
+                        math::half const* p = reinterpret_cast<math::half const*>(
+                                &pixels[y * stride + x * 6]);
+                        for (int i = 0; i < 3; i++) {
+                            ASSERT_NEAR(float(p[i]), color[i], color[i] / 512.0f);
+                        }
+                    } else {
+                        ASSERT_EQ(decoder->getPixelFormat(), ImageDecoder::PixelFormat::RGBA8);
+                        uint8_t const* p = &pixels[y * stride + x * 4];
+                        for (int i = 0; i < 3; i++) {
+                            ASSERT_NEAR(p[i] / 255.0f, color[i], 1e-3f);
+                        }
+                        ASSERT_EQ(p[3], 255);
+                    }
+                }
+            }
+        }
+    }
+    js.emancipate();
+}
+
+TEST_F(ImageTest, KtxBundle) { // NOLINT
+    KtxBundle cubemap(2, 1, true);
+    cubemap.info().pixelWidth = 4;
+    cubemap.info().pixelHeight = 4;
+    cubemap.info().glInternalFormat = KtxBundle::RGB8_ETC2;
+
+    // 7 bytes blobs exercise the padding of the cubemap faces
+    uint8_t blob[7];
+    for (uint32_t level = 0; level < 2; ++level) {
+        for (uint32_t face = 0; face < 6; ++face) {
+            memset(blob, int(level * 6 + face), sizeof(blob));
+            ASSERT_TRUE(cubemap.setBlob({ level, 0, face }, blob, level ? 3 : 7));
+        }
+    }
+    ASSERT_FALSE(cubemap.setBlob({ 0, 0, 0 }, blob, 5));
+    ASSERT_FALSE(cubemap.setBlob({ 2, 0, 0 }, blob, 7));
+
+    std::vector<uint8_t> contents(cubemap.getSerializedLength());
+    ASSERT_FALSE(cubemap.serialize(contents.data(), uint32_t(contents.size() - 1)));
+    ASSERT_TRUE(cubemap.serialize(contents.data(), uint32_t(contents.size())));
+
+    KtxBundle parsed(contents.data(), uint32_t(contents.size()));
+    ASSERT_TRUE(parsed.isCubemap());
+    ASSERT_EQ(parsed.getNumMipLevels(), 2);
+    ASSERT_EQ(parsed.getInfo().glInternalFormat, KtxBundle::RGB8_ETC2);
+    for (uint32_t level = 0; level < 2; ++level) {
+        for (uint32_t face = 0; face < 6; ++face) {
+            uint8_t const* data;
+            uint32_t size;
+            ASSERT_TRUE(parsed.getBlob({ level, 0, face }, &data, &size));
+            ASSERT_EQ(size, level ? 3 : 7);
+            ASSERT_EQ(data[size - 1], level * 6 + face);
+        }
+    }
+
+    // Referenced blobs point into the file, and are only copied once modified.
+    KtxBundle referenced(contents.data(), uint32_t(contents.size()), false);
+    uint8_t const* data;
+    uint32_t size;
+    ASSERT_TRUE(referenced.getBlob({ 1, 0, 2 }, &data, &size));
+    ASSERT_GE(data, contents.data());
+    ASSERT_LT(data, contents.data() + contents.size());
+    ASSERT_TRUE(referenced.setBlob({ 1, 0, 2 }, blob, 3));
+    ASSERT_TRUE(referenced.getBlob({ 1, 0, 3 }, &data, &size));
+    ASSERT_FALSE(data >= contents.data() && data < contents.data() + contents.size());
+    ASSERT_EQ(data[0], 9);
+
+    contents[0] = 0;
+    EXPECT_THROW(KtxBundle(contents.data(), uint32_t(contents.size())), std::runtime_error);
+}
+
+TEST_F(ImageTest, Ktx2Bundle) { // NOLINT
+    // A 8x4 ETC2 RGB8 texture with 2 levels, its level index is followed by the level data.
+    const uint32_t header[17] = { 147, 1, 8, 4, 0, 0, 1, 2, 0 };
+    const uint64_t levels[2][3] = { { 128, 16, 16 }, { 144, 8, 8 } };
+    std::vector<uint8_t> contents(152);
+    const uint8_t identifier[12] = {
+        0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+    };
+    memcpy(contents.data(), identifier, sizeof(identifier));
+    memcpy(contents.data() + 12, header, sizeof(header));
+    memcpy(contents.data() + 80, levels, sizeof(levels));
+    for (uint32_t i = 128; i < 152; i++) {
+        contents[i] = uint8_t(i);
+    }
+
+    KtxBundle ktx(contents.data(), uint32_t(contents.size()), false);
+    ASSERT_FALSE(ktx.isCubemap());
+    ASSERT_EQ(ktx.getNumMipLevels(), 2);
+    ASSERT_EQ(ktx.getInfo().glInternalFormat, KtxBundle::RGB8_ETC2);
+    ASSERT_EQ(ktx.getInfo().glFormat, 0);
+    ASSERT_EQ(ktx.getInfo().pixelWidth, 8);
+    uint8_t const* data;
+    uint32_t size;
+    ASSERT_TRUE(ktx.getBlob({ 1, 0, 0 }, &data, &size));
+    ASSERT_EQ(data, contents.data() + 144);
+    ASSERT_EQ(size, 8);
+
+    // BasisLZ supercompression is not supported
+    contents[12 + 8 * 4] = 1;
+    EXPECT_THROW(KtxBundle(contents.data(), uint32_t(contents.size())), std::runtime_error);
+}
+
+TEST_F(ImageTest, KtxTranscoder) { // NOLINT
+    // A zlib supercompressed 8x8 RGB8 texture with 2 levels.
+    std::vector<uint8_t> pixels[2];
+    std::vector<uint8_t> deflated[2];
+    for (uint32_t level = 0; level < 2; level++) {
+        pixels[level].resize((8u >> level) * (8u >> level) * 3);
+        for (size_t i = 0; i < pixels[level].size(); i++) {
+            pixels[level][i] = uint8_t(i * 7 + level * 50);
+        }
+        uLongf size = compressBound(uLong(pixels[level].size()));
+        deflated[level].resize(size);
+        ASSERT_EQ(compress(deflated[level].data(), &size, pixels[level].data(),
+                uLong(pixels[level].size())), Z_OK);
+        deflated[level].resize(size);
+    }
+    const uint32_t header[17] = { 23, 1, 8, 8, 0, 0, 1, 2, 3 };
+    const uint64_t levels[2][3] = {
+        { 128, deflated[0].size(), pixels[0].size() },
+        { 128 + deflated[0].size(), deflated[1].size(), pixels[1].size() }
+    };
+    const uint8_t identifier[12] = {
+        0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+    };
+    std::vector<uint8_t> contents(128);
+    memcpy(contents.data(), identifier, sizeof(identifier));
+    memcpy(contents.data() + 12, header, sizeof(header));
+    memcpy(contents.data() + 80, levels, sizeof(levels));
+    contents.insert(contents.end(), deflated[0].begin(), deflated[0].end());
+    contents.insert(contents.end(), deflated[1].begin(), deflated[1].end());
+
+    auto ktx = std::make_shared<const KtxBundle>(contents.data(), uint32_t(contents.size()));
+    ASSERT_EQ(ktx->getSupercompression(), KtxBundle::Supercompression::ZLIB);
+    uint8_t const* data;
+    uint32_t size;
+    ASSERT_FALSE(ktx->getBlob({ 0, 0, 0 }, &data, &size));
+    ASSERT_TRUE(KtxTranscoder::canTranscode(*ktx, KtxTranscoder::Target::ETC2));
+    ASSERT_TRUE(KtxTranscoder::canTranscode(*ktx, KtxTranscoder::Target::S3TC));
+
+    utils::JobSystem js;
+    js.adopt();
+    {
+        // The levels are inflated as they are.
+        KtxTranscoder transcoder(ktx, KtxTranscoder::Target::SOURCE, js);
+        transcoder.wait();
+        ASSERT_TRUE(transcoder.isDone());
+        ASSERT_FALSE(transcoder.hasFailed());
+        std::vector<KtxTranscoder::Level> result = transcoder.takeLevels();
+        ASSERT_EQ(result.size(), 2);
+        for (const auto& level : result) {
+            ASSERT_EQ(level.glInternalFormat, KtxBundle::RGB8);
+            ASSERT_EQ(level.size, pixels[level.index].size());
+            ASSERT_EQ(memcmp(level.data.get(), pixels[level.index].data(), level.size), 0);
+        }
+        ASSERT_TRUE(transcoder.takeLevels().empty());
+    }
+    {
+        // The levels are compressed like compressTexture() does.
+        KtxTranscoder transcoder(ktx, KtxTranscoder::Target::ETC2, js);
+        transcoder.wait();
+        std::vector<KtxTranscoder::Level> result = transcoder.takeLevels();
+        ASSERT_EQ(result.size(), 2);
+        for (const auto& level : result) {
+            const uint32_t dim = 8u >> level.index;
+            LinearImage image(dim, dim, 3);
+            for (size_t i = 0; i < pixels[level.index].size(); i++) {
+                image.getPixelRef()[i] = pixels[level.index][i] / 255.0f;
+            }
+            CompressedTexture expected = compressTexture(image, CompressedFormat::ETC2_RGB8);
+            ASSERT_EQ(level.glInternalFormat, KtxBundle::RGB8_ETC2);
+            ASSERT_EQ(level.size, expected.size);
+            ASSERT_EQ(memcmp(level.data.get(), expected.data.get(), level.size), 0);
+        }
+    }
+    {
+        // A corrupt level is never returned.
+        contents[128] ^= 0xFF;
+        auto corrupt = std::make_shared<const KtxBundle>(contents.data(),
+                uint32_t(contents.size()));
+        KtxTranscoder transcoder(corrupt, KtxTranscoder::Target::SOURCE, js);
+        transcoder.wait();
+        ASSERT_TRUE(transcoder.hasFailed());
+        ASSERT_EQ(transcoder.takeLevels().size(), 1);
+    }
+    js.emancipate();
+}
+
+TEST_F(ImageTest, BlockCompression) { // NOLINT
+    // Compressing rows of blocks in parallel must produce the same data as compressing serially.
+    LinearImage image = resampleImage(createNormalMap(64), 10, 6);
+    utils::JobSystem js;
+    js.adopt();
+    for (auto format : { CompressedFormat::ETC2_RGB8, CompressedFormat::ETC2_SRGB8,
+            CompressedFormat::DXT1_RGB, CompressedFormat::DXT1_SRGB }) {
+        CompressedTexture texture = compressTexture(image, format, &js);
+        ASSERT_EQ(texture.size, 3 * 2 * 8);
+        CompressedTexture serial = compressTexture(image, format);
+        ASSERT_EQ(memcmp(texture.data.get(), serial.data.get(), texture.size), 0);
+    }
+    js.emancipate();
+
+    CompressedFormat format;
+    ASSERT_TRUE(parseCompressedFormat("etc_srgb8", &format));
+    ASSERT_EQ(compressTexture(image, format).glInternalFormat, KtxBundle::SRGB8_ETC2);
+    ASSERT_FALSE(parseCompressedFormat("astc_4x4", &format));
+}
+
+TEST_F(ImageTest, IrradianceProjector) { // NOLINT
+    // Project an environment whose SH are known: (s.z, s.x, 1 + s.x * s.y). Each face is filled
+    // with the directions of cmgen's Cubemap::getDirectionFor.
+    const uint32_t dim = 16;
+    LinearImage faces[6];
+    for (uint32_t f = 0; f < 6; f++) {
+        faces[f] = LinearImage(dim, dim, 3);
+        for (uint32_t y = 0; y < dim; y++) {
+            for (uint32_t x = 0; x < dim; x++) {
+                float cx = (x + 0.5f) * 2.0f / dim - 1;
+                float cy = 1 - (y + 0.5f) * 2.0f / dim;
+                float3 dirs[6] = {
+                    { 1, cy, -cx }, { -1, cy, cx }, { cx, 1, -cy },
+                    { cx, -1, cy }, { cx, cy, 1 }, { -cx, cy, -1 },
+                };
+                float3 s = normalize(dirs[f]);
+                float3* texel = (float3*) faces[f].getPixelRef(x, y);
+                *texel = { s.z, s.x, 1 + s.x * s.y };
+            }
+        }
+    }
+
+    float3 sh[9];
+    IrradianceProjector projector(dim);
+    projector.project(faces, sh);
+
+    const float pi = float(M_PI);
+    // 0.5 * (4 pi / 3) for the linear terms, 0.25 * 4 pi and 0.9375 * (4 pi / 15) for the others
+    const float expected[9][3] = {
+        { 0, 0, pi }, { 0, 0, 0 }, { 2 * pi / 3, 0, 0 }, { 0, 2 * pi / 3, 0 },
+        { 0, 0, pi / 4 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+    };
+    for (size_t i = 0; i < 9; i++) {
+        for (size_t c = 0; c < 3; c++) {
+            ASSERT_NEAR(sh[i][c], expected[i][c], 1e-2f);
+        }
+    }
+
+    // Splitting the rows across threads must not change the result.
+    utils::JobSystem js;
+    js.adopt();
+    float3 parallel[9];
+    projector.project(faces, parallel, &js);
+    js.emancipate();
+    ASSERT_EQ(memcmp(sh, parallel, sizeof(sh)), 0);
+}
+
 static void printUsage(const char* name) {
     string exec_name(utils::Path(name).getName());
     string usage(
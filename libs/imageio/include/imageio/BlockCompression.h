@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_BLOCKCOMPRESSION_H_
+#define IMAGE_BLOCKCOMPRESSION_H_
+
+#include <image/LinearImage.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
+namespace image {
+
+// GPU block compressed formats that can be generated. ETC2 is mandatory in GLES 3.0, S3TC is
+// available on desktop.
+enum class CompressedFormat : uint8_t {
+    ETC2_RGB8,          // linear RGB, 4 bits per pixel
+    ETC2_SRGB8,         // sRGB, 4 bits per pixel
+    ETC2_EAC_RGBA8,     // linear RGBA, 8 bits per pixel
+    ETC2_EAC_SRGBA8,    // sRGB with linear alpha, 8 bits per pixel
+    DXT1_RGB,           // linear RGB, 4 bits per pixel
+    DXT1_SRGB,          // sRGB, 4 bits per pixel
+    DXT5_RGBA,          // linear RGBA, 8 bits per pixel
+    DXT5_SRGBA,         // sRGB with linear alpha, 8 bits per pixel
+};
+
+struct CompressedTexture {
+    uint32_t glInternalFormat;
+    std::unique_ptr<uint8_t[]> data;
+    uint32_t size;
+};
+
+// Parses a compression name as given on the command line of the tools: etc_rgb8, etc_srgb8,
+// etc_rgba8, etc_srgba8, s3tc_rgb_dxt1, s3tc_srgb_dxt1, s3tc_rgba_dxt5 or s3tc_srgba_dxt5.
+// Returns false if the name is unknown.
+bool parseCompressedFormat(const std::string& name, CompressedFormat* format);
+
+// Returns true if the format stores an alpha channel.
+bool hasAlpha(CompressedFormat format);
+
+// Compresses an image with 1, 3 or 4 channels in [0, 1]. The sRGB formats apply the sRGB transfer
+// function to the color channels, the other formats store the values as they are (for instance
+// RGBM data). Images without alpha are opaque. Sizes that are not a multiple of 4 are padded by
+// repeating the last row and column. Rows of blocks are spread across the job system if one is
+// given, otherwise the compression happens on the calling thread.
+CompressedTexture compressTexture(const LinearImage& image, CompressedFormat format,
+        utils::JobSystem* jobSystem = nullptr);
+
+} // namespace image
+
+#endif /* IMAGE_BLOCKCOMPRESSION_H_ */
@@ -17,11 +17,18 @@
 #ifndef IMAGE_IMAGEDECODER_H_
 #define IMAGE_IMAGEDECODER_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <iosfwd>
+#include <memory>
 #include <string>
 
 #include <image/LinearImage.h>
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace image {
 
 class ImageDecoder {
@@ -51,6 +58,92 @@ public:
         ColorSpace mColorSpace = ColorSpace::SRGB;
     };
 
+    /**
+     * Decodes an image progressively, a strip of rows at a time from top to bottom, so that the
+     * whole image never needs to be in memory.
+     */
+    class StripDecoder {
+    public:
+        virtual ~StripDecoder() = default;
+
+        uint32_t getWidth() const noexcept { return mWidth; }
+        uint32_t getHeight() const noexcept { return mHeight; }
+        uint32_t getChannels() const noexcept { return mChannels; }
+
+        /**
+         * Returns the next rows of the image, at most rowCount of them. The returned image is
+         * invalid once all the rows have been decoded, or if an error occurred.
+         */
+        virtual LinearImage decodeStrip(uint32_t rowCount) = 0;
+
+    protected:
+        uint32_t mWidth = 0;
+        uint32_t mHeight = 0;
+        uint32_t mChannels = 0;
+    };
+
+    /**
+     * Reads the header of an image and returns a decoder for its rows, or nullptr if the image
+     * can't be decoded. Non-interlaced PNG and HDR images are decoded as the strips are requested,
+     * the other images are decoded in full by this function.
+     */
+    static std::unique_ptr<StripDecoder> decodeStrips(std::istream& stream,
+            const std::string& sourceName, ColorSpace sourceSpace = ColorSpace::SRGB);
+
+    /**
+     * The native pixel formats of PixelDecoder, which can be uploaded to a texture as they are.
+     */
+    enum class PixelFormat : uint8_t {
+        RGBA8,      // 8 bits per channel, with the values of the source (usually sRGB)
+        RGB16F      // linear half floats
+    };
+
+    /**
+     * Decodes an image straight into a buffer of the caller, in its native pixel format, without
+     * the intermediate float image of decode().
+     */
+    class PixelDecoder {
+    public:
+        virtual ~PixelDecoder() = default;
+
+        uint32_t getWidth() const noexcept { return mWidth; }
+        uint32_t getHeight() const noexcept { return mHeight; }
+        PixelFormat getPixelFormat() const noexcept { return mFormat; }
+
+        size_t getBytesPerPixel() const noexcept {
+            return mFormat == PixelFormat::RGBA8 ? 4 : 6;
+        }
+
+        /**
+         * Returns the size of the buffer that decodePixels() needs, given the number of bytes
+         * between the start of two rows, 0 if they are tightly packed.
+         */
+        size_t getBufferSize(size_t stride = 0) const noexcept {
+            return (stride ? stride : mWidth * getBytesPerPixel()) * mHeight;
+        }
+
+        /**
+         * Decodes all the rows of the image into buffer, stride bytes apart (0 if they are
+         * tightly packed). Reading the stream is serial, but the rows are converted to the pixel
+         * format in parallel when a job system is given, in which case the calling thread must
+         * be adopted by it. Returns false if an error occurred.
+         */
+        virtual bool decodePixels(void* buffer, size_t stride = 0,
+                utils::JobSystem* js = nullptr) = 0;
+
+    protected:
+        uint32_t mWidth = 0;
+        uint32_t mHeight = 0;
+        PixelFormat mFormat = PixelFormat::RGBA8;
+    };
+
+    /**
+     * Reads the header of an image and returns a decoder for its pixels, or nullptr if the image
+     * can't be decoded this way. PNG images are decoded to RGBA8, their 16 bit channels reduced
+     * to 8 bits and opaque images given an alpha of 1. HDR and PSD images are decoded to RGB16F.
+     */
+    static std::unique_ptr<PixelDecoder> decodePixels(std::istream& stream);
+
 private:
     enum class Format {
         NONE,
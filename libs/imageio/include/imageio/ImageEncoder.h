@@ -18,6 +18,7 @@
 #define IMAGE_IMAGEENCODER_H_
 
 #include <iosfwd>
+#include <memory>
 #include <string>
 
 #include <image/LinearImage.h>
@@ -54,6 +55,31 @@ public:
         virtual void encode(const LinearImage& image) = 0;
         virtual ~Encoder() = default;
     };
+
+    /**
+     * Encodes an image progressively, a strip of rows at a time from top to bottom, so that the
+     * whole image never needs to be in memory. The image is complete once all its rows have been
+     * encoded.
+     */
+    class StripEncoder {
+    public:
+        virtual ~StripEncoder() = default;
+
+        /**
+         * Encodes the next rows of the image. The strip must have the width and the number of
+         * channels given to encodeStrips.
+         */
+        virtual void encodeStrip(const LinearImage& strip) = 0;
+    };
+
+    /**
+     * Writes the header of an image and returns an encoder for its rows, or nullptr if the image
+     * can't be encoded. PNG, PNG_LINEAR, RGBM and HDR images are written as the strips come in,
+     * the other formats are accumulated in memory and written after the last strip.
+     */
+    static std::unique_ptr<StripEncoder> encodeStrips(std::ostream& stream, Format format,
+            uint32_t width, uint32_t height, uint32_t channels, const std::string& compression,
+            const std::string& destName);
 };
 
 } // namespace image
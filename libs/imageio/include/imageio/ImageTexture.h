@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_IMAGETEXTURE_H_
+#define IMAGE_IMAGETEXTURE_H_
+
+#include <filament/Engine.h>
+#include <filament/Texture.h>
+
+#include <imageio/ImageDecoder.h>
+
+#include <cstdlib>
+#include <istream>
+
+namespace image {
+
+// Header-only helper that creates a filament texture from a PNG, HDR or PSD image, clients that
+// use it must link against filament. The image is decoded with ImageDecoder::decodePixels()
+// straight into the buffer handed to Texture::setImage(), which the driver frees once uploaded.
+// PNG images become RGBA8 textures, SRGB8_A8 if their values are sRGB, the others RGB16F
+// textures. Only the first level is uploaded, the others can be generated with
+// Texture::generateMipmaps(). Returns nullptr if the image can't be decoded.
+// The conversion of the rows is spread across the job system if one is given, the calling thread
+// must then be adopted by it, e.g. the thread that created the engine with its job system.
+inline filament::Texture* decodeTexture(filament::Engine& engine, std::istream& stream,
+        ImageDecoder::ColorSpace sourceSpace = ImageDecoder::ColorSpace::SRGB,
+        uint8_t levels = 1, utils::JobSystem* js = nullptr) {
+    using filament::Texture;
+    using filament::driver::PixelDataFormat;
+    using filament::driver::PixelDataType;
+
+    std::unique_ptr<ImageDecoder::PixelDecoder> decoder = ImageDecoder::decodePixels(stream);
+    if (!decoder) {
+        return nullptr;
+    }
+    const size_t size = decoder->getBufferSize();
+    void* buffer = malloc(size);
+    if (!decoder->decodePixels(buffer, 0, js)) {
+        free(buffer);
+        return nullptr;
+    }
+
+    const bool rgba8 = decoder->getPixelFormat() == ImageDecoder::PixelFormat::RGBA8;
+    Texture* texture = Texture::Builder()
+            .width(decoder->getWidth())
+            .height(decoder->getHeight())
+            .levels(levels)
+            .sampler(Texture::Sampler::SAMPLER_2D)
+            .format(!rgba8 ? Texture::InternalFormat::RGB16F :
+                    sourceSpace == ImageDecoder::ColorSpace::SRGB ?
+                            Texture::InternalFormat::SRGB8_A8 : Texture::InternalFormat::RGBA8)
+            .build(engine);
+
+    texture->setImage(engine, 0, Texture::PixelBufferDescriptor(buffer, size,
+            rgba8 ? PixelDataFormat::RGBA : PixelDataFormat::RGB,
+            rgba8 ? PixelDataType::UBYTE : PixelDataType::HALF, 1, 0, 0, 0,
+            [](void* buffer, size_t, void*) { free(buffer); }));
+    return texture;
+}
+
+} // namespace image
+
+#endif /* IMAGE_IMAGETEXTURE_H_ */
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_KTXLOADER_H_
+#define IMAGE_KTXLOADER_H_
+
+#include <image/KtxBundle.h>
+
+#include <memory>
+#include <string>
+
+namespace image {
+
+// Loads a KTX 1.1 or 2.0 file. The file is mapped in memory and the blobs of the returned bundle
+// reference the mapping, which is released along with the bundle: passing the bundle to
+// ktx::createTexture() (see image/KtxUtility.h) uploads the levels without any copy. Platforms
+// without mmap read the whole file in memory instead.
+// Returns nullptr if the file cannot be read or is not a supported KTX file.
+std::shared_ptr<const KtxBundle> loadKtx(const std::string& path);
+
+} // namespace image
+
+#endif /* IMAGE_KTXLOADER_H_ */
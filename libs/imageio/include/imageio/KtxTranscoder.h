@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_KTXTRANSCODER_H_
+#define IMAGE_KTXTRANSCODER_H_
+
+#include <image/KtxBundle.h>
+
+#include <utils/JobSystem.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace image {
+
+// Transcodes the levels of a zlib supercompressed KTX 2.0 bundle in the background, which lets a
+// single asset be shipped for all the GPUs: the levels are stored as 8 bit RGB(A) pixels, and are
+// block compressed at load time to the format the GPU supports. Each level is inflated and
+// compressed by its own job, from the coarsest to the finest, and can be uploaded as soon as it's
+// done (see imageio/TranscodedTexture.h). Levels that are block compressed in the bundle are only
+// inflated. Only 2D textures are supported.
+class KtxTranscoder {
+public:
+    // The formats the uncompressed levels are transcoded to. SOURCE keeps the format of the
+    // bundle. The driver has no sRGB S3TC formats, so sRGB levels can't be transcoded to S3TC.
+    enum class Target : uint8_t {
+        SOURCE,
+        ETC2,
+        S3TC,
+    };
+
+    struct Level {
+        uint32_t index;
+        uint32_t glInternalFormat;
+        std::unique_ptr<uint8_t[]> data;
+        uint32_t size;
+    };
+
+    // Returns true if the bundle is a zlib supercompressed 2D texture whose levels can be
+    // transcoded to the target.
+    static bool canTranscode(const KtxBundle& ktx, Target target);
+
+    // Returns the glInternalFormat of the levels transcoded to the target.
+    static uint32_t getInternalFormat(const KtxInfo& info, Target target);
+
+    // Schedules the jobs that transcode all the levels, which must be run from a thread adopted
+    // by the job system. The bundle must satisfy canTranscode().
+    KtxTranscoder(std::shared_ptr<const KtxBundle> ktx, Target target, utils::JobSystem& js);
+
+    // Waits for the jobs, must be called from a thread adopted by the job system.
+    ~KtxTranscoder();
+
+    KtxTranscoder(const KtxTranscoder&) = delete;
+    KtxTranscoder& operator=(const KtxTranscoder&) = delete;
+
+    // Returns the levels transcoded since the previous call, in no particular order.
+    std::vector<Level> takeLevels();
+
+    // Returns true once all the jobs have run, the remaining levels can still be taken.
+    bool isDone() const;
+
+    // Waits for all the jobs, helping with the remaining levels. Must be called from a thread
+    // adopted by the job system.
+    void wait();
+
+    // Returns true if a level could not be inflated, it's never returned by takeLevels().
+    bool hasFailed() const;
+
+    uint32_t getInternalFormat() const { return mInternalFormat; }
+
+private:
+    void transcode(uint32_t level);
+
+    std::shared_ptr<const KtxBundle> mKtx;
+    const Target mTarget;
+    const uint32_t mInternalFormat;
+    utils::JobSystem& mJobSystem;
+    utils::JobSystem::Job* mParent = nullptr;
+
+    mutable std::mutex mLock;
+    std::vector<Level> mLevels;
+    uint32_t mPendingCount;
+    bool mFailed = false;
+};
+
+} // namespace image
+
+#endif /* IMAGE_KTXTRANSCODER_H_ */
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_TRANSCODEDTEXTURE_H_
+#define IMAGE_TRANSCODEDTEXTURE_H_
+
+#include <image/KtxUtility.h>
+
+#include <imageio/KtxTranscoder.h>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace image {
+namespace ktx {
+
+// Header-only helper that streams a filament texture from a zlib supercompressed KTX 2.0 bundle,
+// clients that use it must link against filament. The levels are transcoded on the Engine's job
+// system to the best format the GPU supports, S3TC on desktop and ETC2 on mobile, and update()
+// uploads them as they become ready, the coarsest first. The texture is a streaming texture
+// (see Texture::Builder::streaming()) that's drawn as soon as its coarsest level is resident.
+//
+//  ktx::TranscodedTexture albedo(*engine, image::loadKtx("albedo.ktx2"));
+//  materialInstance->setParameter("albedo", albedo.getTexture(), sampler);
+//
+//  // each frame, on the thread that created the Engine
+//  albedo.update();
+class TranscodedTexture {
+public:
+    using Target = KtxTranscoder::Target;
+
+    // Returns the target that transcodes the bundle to a compressed format the GPU supports, or
+    // SOURCE if there's none.
+    static Target pickTarget(Engine& engine, const KtxBundle& ktx) {
+        const Target targets[] = { Target::S3TC, Target::ETC2 };
+        for (Target target : targets) {
+            if (KtxTranscoder::canTranscode(ktx, target) &&
+                    Texture::isTextureFormatSupported(engine, getTextureFormat(ktx, target))) {
+                return target;
+            }
+        }
+        return Target::SOURCE;
+    }
+
+    // Creates the texture and starts transcoding its levels, the bundle must satisfy
+    // KtxTranscoder::canTranscode(). Must be called on the thread that created the Engine.
+    TranscodedTexture(Engine& engine, std::shared_ptr<const KtxBundle> ktx)
+            : mEngine(engine), mInfo(ktx->getInfo()), mResidentLevel(ktx->getNumMipLevels()),
+              mUploaded(ktx->getNumMipLevels(), false) {
+        const Target target = pickTarget(engine, *ktx);
+        const uint32_t format = KtxTranscoder::getInternalFormat(mInfo, target);
+        if (format != mInfo.glInternalFormat) {
+            mInfo.glInternalFormat = format;
+            mInfo.glType = mInfo.glTypeSize = mInfo.glFormat = 0;
+        }
+        mTexture = Texture::Builder()
+                .width(mInfo.pixelWidth)
+                .height(mInfo.pixelHeight)
+                .levels(uint8_t(ktx->getNumMipLevels()))
+                .sampler(Texture::Sampler::SAMPLER_2D)
+                .format(toTextureFormat(mInfo))
+                .streaming(true)
+                .build(engine);
+        mTranscoder.reset(new KtxTranscoder(std::move(ktx), target, engine.getJobSystem()));
+    }
+
+    // Waits for the transcoding jobs, the texture itself is owned by the caller, who must
+    // destroy it with the Engine. Must be called on the thread that created the Engine.
+    ~TranscodedTexture() = default;
+
+    TranscodedTexture(const TranscodedTexture&) = delete;
+    TranscodedTexture& operator=(const TranscodedTexture&) = delete;
+
+    Texture* getTexture() const { return mTexture; }
+
+    // Uploads the levels transcoded since the previous call, and makes resident the levels
+    // uploaded from the coarsest one on. Returns true once all the levels are resident.
+    bool update() {
+        for (KtxTranscoder::Level& level : mTranscoder->takeLevels()) {
+            const size_t size = level.size;
+            uint8_t* data = level.data.release();
+            auto release = [](void* buffer, size_t, void*) {
+                delete[] static_cast<uint8_t*>(buffer);
+            };
+            mTexture->setImage(mEngine, level.index, isCompressed(mInfo) ?
+                    Texture::PixelBufferDescriptor(data, size, toCompressedPixelDataType(mInfo),
+                            uint32_t(size), release) :
+                    Texture::PixelBufferDescriptor(data, size,
+                            mInfo.glFormat == KtxBundle::RGB ? PixelDataFormat::RGB :
+                                    PixelDataFormat::RGBA,
+                            PixelDataType::UBYTE, 1, 0, 0, 0, release));
+            mUploaded[level.index] = true;
+        }
+
+        size_t baseLevel = mResidentLevel;
+        while (baseLevel > 0 && mUploaded[baseLevel - 1]) {
+            baseLevel--;
+        }
+        if (baseLevel < mResidentLevel) {
+            mResidentLevel = baseLevel;
+            mTexture->makeResident(mEngine, baseLevel);
+        }
+        return mResidentLevel == 0;
+    }
+
+    // Returns true if a level of the bundle is corrupt, the texture then never gets all of its
+    // levels resident.
+    bool hasFailed() const { return mTranscoder->hasFailed(); }
+
+private:
+    static TextureFormat getTextureFormat(const KtxBundle& ktx, Target target) {
+        KtxInfo info = ktx.getInfo();
+        info.glInternalFormat = KtxTranscoder::getInternalFormat(info, target);
+        return toTextureFormat(info);
+    }
+
+    Engine& mEngine;
+    KtxInfo mInfo;  // of the transcoded levels
+    Texture* mTexture = nullptr;
+    std::unique_ptr<KtxTranscoder> mTranscoder;
+    size_t mResidentLevel;
+    std::vector<bool> mUploaded;
+};
+
+} // namespace ktx
+} // namespace image
+
+#endif /* IMAGE_TRANSCODEDTEXTURE_H_ */
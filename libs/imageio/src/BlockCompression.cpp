@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <imageio/BlockCompression.h>
+
+#include <image/ColorTransform.h>
+#include <image/KtxBundle.h>
+
+#include <math/scalar.h>
+
+#include <utils/JobSystem.h>
+#include <utils/Panic.h>
+
+#include <algorithm>
+#include <functional>
+
+#define STB_DXT_IMPLEMENTATION
+#include <stb_dxt.h>
+
+namespace image {
+
+namespace {
+
+// 4x4 RGBA8 pixels in row-major order.
+struct Block {
+    uint8_t rgba[16][4];
+};
+
+// ETC1 intensity modifiers, the pixel indices 0 to 3 select +a, +b, -a and -b.
+const int ETC_MODIFIERS[8][2] = {
+    {  2,   8 }, {  5,  17 }, {  9,  29 }, { 13,  42 },
+    { 18,  60 }, { 24,  80 }, { 33, 106 }, { 47, 183 },
+};
+
+// EAC modifiers, scaled by the multiplier of the block.
+const int EAC_MODIFIERS[16][8] = {
+    { -3, -6,  -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 },
+    { -2, -5,  -8, -13, 1, 4, 7, 12 }, { -2, -4,  -6, -13, 1, 3, 5, 12 },
+    { -3, -6,  -8, -12, 2, 5, 7, 11 }, { -3, -7,  -9, -11, 2, 6, 8, 10 },
+    { -4, -7,  -8, -11, 3, 6, 7, 10 }, { -3, -5,  -8, -11, 2, 4, 7, 10 },
+    { -2, -6,  -8, -10, 1, 5, 7,  9 }, { -2, -5,  -8, -10, 1, 4, 7,  9 },
+    { -2, -4,  -8, -10, 1, 3, 7,  9 }, { -2, -5,  -7, -10, 1, 4, 6,  9 },
+    { -3, -4,  -7, -10, 2, 3, 6,  9 }, { -1, -2,  -3, -10, 0, 1, 2,  9 },
+    { -4, -6,  -8,  -9, 3, 5, 7,  8 }, { -3, -5,  -7,  -9, 2, 4, 6,  8 },
+};
+
+// ETC pixels are numbered column by column, these are the pixels of each subblock when the block
+// is split vertically (flip = 0) or horizontally (flip = 1).
+const uint8_t ETC_SUBBLOCKS[2][2][8] = {
+    { { 0, 1, 2, 3, 4, 5, 6, 7 }, { 8, 9, 10, 11, 12, 13, 14, 15 } },
+    { { 0, 1, 4, 5, 8, 9, 12, 13 }, { 2, 3, 6, 7, 10, 11, 14, 15 } },
+};
+
+inline uint8_t const* etcPixel(const Block& block, uint32_t index) {
+    return block.rgba[(index % 4) * 4 + index / 4];
+}
+
+inline int clamp255(int v) {
+    return std::min(255, std::max(0, v));
+}
+
+inline void storeBigEndian(uint64_t word, uint8_t* dst) {
+    for (int i = 0; i < 8; i++) {
+        dst[i] = uint8_t(word >> (56 - 8 * i));
+    }
+}
+
+struct SubblockFit {
+    uint32_t error;
+    uint32_t table;
+    uint8_t indices[8];
+};
+
+// Picks the modifier table and the pixel indices that best fit a subblock of the given base color.
+SubblockFit fitSubblock(const Block& block, uint8_t const* pixels, const int base[3]) {
+    SubblockFit best = { ~0u, 0, {} };
+    for (uint32_t table = 0; table < 8; table++) {
+        const int modifiers[4] = {
+            ETC_MODIFIERS[table][0], ETC_MODIFIERS[table][1],
+            -ETC_MODIFIERS[table][0], -ETC_MODIFIERS[table][1]
+        };
+        SubblockFit fit = { 0, table, {} };
+        for (uint32_t i = 0; i < 8 && fit.error < best.error; i++) {
+            uint8_t const* rgb = etcPixel(block, pixels[i]);
+            uint32_t pixelError = ~0u;
+            for (uint8_t m = 0; m < 4; m++) {
+                uint32_t e = 0;
+                for (uint32_t c = 0; c < 3; c++) {
+                    const int d = clamp255(base[c] + modifiers[m]) - rgb[c];
+                    e += uint32_t(d * d);
+                }
+                if (e < pixelError) {
+                    pixelError = e;
+                    fit.indices[i] = m;
+                }
+            }
+            fit.error += pixelError;
+        }
+        if (fit.error < best.error) {
+            best = fit;
+        }
+    }
+    return best;
+}
+
+// Encodes the color of a block in the ETC1 individual or differential modes, these blocks are
+// also valid ETC2 blocks since the differential mode never overflows.
+void encodeEtcColor(const Block& block, uint8_t* dst) {
+    uint64_t bestWord = 0;
+    uint32_t bestError = ~0u;
+    for (uint32_t flip = 0; flip < 2; flip++) {
+        int average[2][3];
+        for (uint32_t s = 0; s < 2; s++) {
+            for (uint32_t c = 0; c < 3; c++) {
+                int sum = 0;
+                for (uint32_t i = 0; i < 8; i++) {
+                    sum += etcPixel(block, ETC_SUBBLOCKS[flip][s][i])[c];
+                }
+                average[s][c] = sum;
+            }
+        }
+
+        // differential mode: 5 bits base colors, the second one is a 3 bits signed delta
+        int q5[2][3];
+        bool differential = true;
+        for (uint32_t s = 0; s < 2; s++) {
+            for (uint32_t c = 0; c < 3; c++) {
+                q5[s][c] = (average[s][c] * 31 + 255 * 4) / (255 * 8);
+            }
+        }
+        for (uint32_t c = 0; c < 3; c++) {
+            const int delta = q5[1][c] - q5[0][c];
+            differential = differential && delta >= -4 && delta <= 3;
+        }
+
+        // individual mode: 4 bits base colors
+        int q4[2][3];
+        for (uint32_t s = 0; s < 2; s++) {
+            for (uint32_t c = 0; c < 3; c++) {
+                q4[s][c] = (average[s][c] * 15 + 255 * 4) / (255 * 8);
+            }
+        }
+
+        for (uint32_t mode = differential ? 0 : 1; mode < 2; mode++) {
+            SubblockFit fits[2];
+            for (uint32_t s = 0; s < 2; s++) {
+                int base[3];
+                for (uint32_t c = 0; c < 3; c++) {
+                    base[c] = mode == 0 ? (q5[s][c] << 3) | (q5[s][c] >> 2) :
+                              (q4[s][c] << 4) | q4[s][c];
+                }
+                fits[s] = fitSubblock(block, ETC_SUBBLOCKS[flip][s], base);
+            }
+            const uint32_t error = fits[0].error + fits[1].error;
+            if (error >= bestError) {
+                continue;
+            }
+            bestError = error;
+
+            uint64_t word = 0;
+            for (uint32_t c = 0; c < 3; c++) {
+                const uint32_t shift = 59 - 8 * c;
+                if (mode == 0) {
+                    word |= uint64_t(q5[0][c]) << shift;
+                    word |= uint64_t((q5[1][c] - q5[0][c]) & 7) << (shift - 3);
+                } else {
+                    word |= uint64_t(q4[0][c]) << (shift + 1);
+                    word |= uint64_t(q4[1][c]) << (shift - 3);
+                }
+            }
+            word |= uint64_t(fits[0].table) << 37;
+            word |= uint64_t(fits[1].table) << 34;
+            word |= uint64_t(mode == 0 ? 1 : 0) << 33;
+            word |= uint64_t(flip) << 32;
+            for (uint32_t s = 0; s < 2; s++) {
+                for (uint32_t i = 0; i < 8; i++) {
+                    const uint32_t pixel = ETC_SUBBLOCKS[flip][s][i];
+                    const uint32_t index = fits[s].indices[i];
+                    word |= uint64_t(index >> 1) << (16 + pixel);
+                    word |= uint64_t(index & 1) << pixel;
+                }
+            }
+            bestWord = word;
+        }
+    }
+    storeBigEndian(bestWord, dst);
+}
+
+// Encodes the alpha channel of a block as an EAC block, searching the multiplier and base value
+// around the ones that map the alpha range onto each modifier table.
+void encodeEacAlpha(const Block& block, uint8_t* dst) {
+    int amin = 255;
+    int amax = 0;
+    for (uint32_t i = 0; i < 16; i++) {
+        amin = std::min(amin, int(block.rgba[i][3]));
+        amax = std::max(amax, int(block.rgba[i][3]));
+    }
+
+    // table 13 has a zero modifier, which encodes uniform blocks exactly
+    uint64_t bestWord = uint64_t(amin) << 56 | uint64_t(1) << 52 | uint64_t(13) << 48;
+    for (uint32_t i = 0; i < 16; i++) {
+        bestWord |= uint64_t(4) << (45 - 3 * i);
+    }
+    uint32_t bestError = amin == amax ? 0 : ~0u;
+
+    for (uint32_t table = 0; table < 16 && bestError; table++) {
+        const int* modifiers = EAC_MODIFIERS[table];
+        const int span = modifiers[7] - modifiers[3];
+        const int m0 = (amax - amin + span / 2) / span;
+        for (int multiplier = std::max(1, m0 - 1); multiplier <= std::min(15, m0 + 1); multiplier++) {
+            const int b0 = (amin + amax - multiplier * (modifiers[3] + modifiers[7])) / 2;
+            for (int base = clamp255(b0 - 1); base <= clamp255(b0 + 1); base++) {
+                uint64_t word = uint64_t(base) << 56 | uint64_t(multiplier) << 52 |
+                        uint64_t(table) << 48;
+                uint32_t error = 0;
+                for (uint32_t i = 0; i < 16; i++) {
+                    const int alpha = etcPixel(block, i)[3];
+                    uint32_t pixelError = ~0u;
+                    uint32_t index = 0;
+                    for (uint32_t m = 0; m < 8; m++) {
+                        const int d = clamp255(base + modifiers[m] * multiplier) - alpha;
+                        if (uint32_t(d * d) < pixelError) {
+                            pixelError = uint32_t(d * d);
+                            index = m;
+                        }
+                    }
+                    error += pixelError;
+                    word |= uint64_t(index) << (45 - 3 * i);
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    bestWord = word;
+                }
+            }
+        }
+    }
+    storeBigEndian(bestWord, dst);
+}
+
+bool isSRGB(CompressedFormat format) {
+    return format == CompressedFormat::ETC2_SRGB8 || format == CompressedFormat::ETC2_EAC_SRGBA8 ||
+            format == CompressedFormat::DXT1_SRGB || format == CompressedFormat::DXT5_SRGBA;
+}
+
+uint32_t getBlockSize(CompressedFormat format) {
+    return hasAlpha(format) ? 16 : 8;
+}
+
+uint32_t getInternalFormat(CompressedFormat format) {
+    switch (format) {
+        case CompressedFormat::ETC2_RGB8: return KtxBundle::RGB8_ETC2;
+        case CompressedFormat::ETC2_SRGB8: return KtxBundle::SRGB8_ETC2;
+        case CompressedFormat::ETC2_EAC_RGBA8: return KtxBundle::RGBA8_ETC2_EAC;
+        case CompressedFormat::ETC2_EAC_SRGBA8: return KtxBundle::SRGB8_ALPHA8_ETC2_EAC;
+        case CompressedFormat::DXT1_RGB: return KtxBundle::RGB_S3TC_DXT1;
+        case CompressedFormat::DXT1_SRGB: return KtxBundle::SRGB_S3TC_DXT1;
+        case CompressedFormat::DXT5_RGBA: return KtxBundle::RGBA_S3TC_DXT5;
+        case CompressedFormat::DXT5_SRGBA: return KtxBundle::SRGB_ALPHA_S3TC_DXT5;
+    }
+    return 0;
+}
+
+// Fetches a 4x4 block as RGBA8, clamping coordinates to the edges of the image.
+void fetchBlock(const LinearImage& image, uint32_t bx, uint32_t by, bool srgb, Block& block) {
+    const uint32_t width = image.getWidth();
+    const uint32_t height = image.getHeight();
+    const uint32_t channels = image.getChannels();
+    for (uint32_t y = 0; y < 4; y++) {
+        for (uint32_t x = 0; x < 4; x++) {
+            float const* src = image.getPixelRef(std::min(bx * 4 + x, width - 1),
+                    std::min(by * 4 + y, height - 1));
+            float rgba[4] = { src[0], src[0], src[0], 1.0f };
+            if (channels >= 3) {
+                rgba[1] = src[1];
+                rgba[2] = src[2];
+            }
+            if (channels == 4) {
+                rgba[3] = src[3];
+            }
+            uint8_t* dst = block.rgba[y * 4 + x];
+            for (uint32_t c = 0; c < 4; c++) {
+                const float v = srgb && c < 3 ? linearTosRGB(math::saturate(rgba[c])) : rgba[c];
+                dst[c] = uint8_t(math::saturate(v) * 255.0f + 0.5f);
+            }
+        }
+    }
+}
+
+void compressBlock(const Block& block, CompressedFormat format, uint8_t* dst) {
+    switch (format) {
+        case CompressedFormat::ETC2_RGB8:
+        case CompressedFormat::ETC2_SRGB8:
+            encodeEtcColor(block, dst);
+            break;
+        case CompressedFormat::ETC2_EAC_RGBA8:
+        case CompressedFormat::ETC2_EAC_SRGBA8:
+            encodeEacAlpha(block, dst);
+            encodeEtcColor(block, dst + 8);
+            break;
+        case CompressedFormat::DXT1_RGB:
+        case CompressedFormat::DXT1_SRGB:
+            stb_compress_dxt_block(dst, block.rgba[0], 0, STB_DXT_HIGHQUAL);
+            break;
+        case CompressedFormat::DXT5_RGBA:
+        case CompressedFormat::DXT5_SRGBA:
+            stb_compress_dxt_block(dst, block.rgba[0], 1, STB_DXT_HIGHQUAL);
+            break;
+    }
+}
+
+} // anonymous namespace
+
+bool parseCompressedFormat(const std::string& name, CompressedFormat* format) {
+    static const struct {
+        const char* name;
+        CompressedFormat format;
+    } FORMATS[] = {
+        { "etc_rgb8",        CompressedFormat::ETC2_RGB8 },
+        { "etc_srgb8",       CompressedFormat::ETC2_SRGB8 },
+        { "etc_rgba8",       CompressedFormat::ETC2_EAC_RGBA8 },
+        { "etc_srgba8",      CompressedFormat::ETC2_EAC_SRGBA8 },
+        { "s3tc_rgb_dxt1",   CompressedFormat::DXT1_RGB },
+        { "s3tc_srgb_dxt1",  CompressedFormat::DXT1_SRGB },
+        { "s3tc_rgba_dxt5",  CompressedFormat::DXT5_RGBA },
+        { "s3tc_srgba_dxt5", CompressedFormat::DXT5_SRGBA },
+    };
+    for (const auto& entry : FORMATS) {
+        if (name == entry.name) {
+            *format = entry.format;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool hasAlpha(CompressedFormat format) {
+    return format == CompressedFormat::ETC2_EAC_RGBA8 ||
+            format == CompressedFormat::ETC2_EAC_SRGBA8 ||
+            format == CompressedFormat::DXT5_RGBA || format == CompressedFormat::DXT5_SRGBA;
+}
+
+CompressedTexture compressTexture(const LinearImage& image, CompressedFormat format,
+        utils::JobSystem* jobSystem) {
+    const uint32_t channels = image.getChannels();
+    ASSERT_PRECONDITION(channels == 1 || channels == 3 || channels == 4,
+            "Compressed textures must have 1, 3 or 4 channels.");
+
+    const uint32_t blocksX = (image.getWidth() + 3) / 4;
+    const uint32_t blocksY = (image.getHeight() + 3) / 4;
+    const uint32_t blockSize = getBlockSize(format);
+    const uint32_t size = blocksX * blocksY * blockSize;
+    CompressedTexture result = { getInternalFormat(format), std::unique_ptr<uint8_t[]>(
+            new uint8_t[size]), size };
+
+    // stb_dxt lazily builds its tables on first use, do it here before going wide.
+    Block empty = {};
+    uint8_t scratch[16];
+    stb_compress_dxt_block(scratch, empty.rgba[0], 1, STB_DXT_NORMAL);
+
+    const bool srgb = isSRGB(format);
+    uint8_t* data = result.data.get();
+    auto compressRows = [&](uint32_t row0, uint32_t nrows) {
+        Block block;
+        for (uint32_t by = row0; by < row0 + nrows; by++) {
+            uint8_t* dst = data + by * blocksX * blockSize;
+            for (uint32_t bx = 0; bx < blocksX; bx++, dst += blockSize) {
+                fetchBlock(image, bx, by, srgb, block);
+                compressBlock(block, format, dst);
+            }
+        }
+    };
+
+    if (!jobSystem || blocksY < 2) {
+        compressRows(0, blocksY);
+    } else {
+        auto job = utils::jobs::parallel_for(*jobSystem, nullptr, 0, blocksY,
+                std::ref(compressRows), utils::jobs::CountSplitter<4>());
+        jobSystem->runAndWait(job);
+    }
+    return result;
+}
+
+} // namespace image
@@ -18,6 +18,7 @@
 
 #include <imageio/ImageDecoder.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring> // for memcmp
 #include <istream>
@@ -34,6 +35,7 @@
 #    include <arpa/inet.h>
 #endif
 
+#include <math/half.h>
 #include <math/vec3.h>
 #include <math/vec4.h>
 
@@ -44,9 +46,13 @@
 #include <image/ColorTransform.h>
 #include <image/ImageOps.h>
 
+#include <utils/JobSystem.h>
+
 namespace image {
 
-class PNGDecoder : public ImageDecoder::Decoder {
+class PNGDecoder : public ImageDecoder::Decoder, public ImageDecoder::StripDecoder {
+    friend class ImageDecoder;
+    friend class PNGPixelDecoder;
 public:
     static PNGDecoder* create(std::istream& stream);
     static bool checkSignature(char const* buf);
@@ -63,6 +69,14 @@ private:
     // ImageDecoder::Decoder interface
     virtual LinearImage decode() override;
 
+    // ImageDecoder::StripDecoder interface
+    virtual LinearImage decodeStrip(uint32_t rowCount) override;
+
+    // native requests 8 bit RGBA rows, see PNGPixelDecoder
+    bool decodeHeader(bool native = false);
+    bool isInterlaced() const;
+    LinearImage toLinearImage(uint32_t height, std::unique_ptr<uint8_t[]> const& data) const;
+
     static void cb_error(png_structp, png_const_charp);
     static void cb_stream(png_structp png, png_bytep buffer, png_size_t size);
 
@@ -73,12 +87,16 @@ private:
     png_infop mInfo = nullptr;
     std::istream& mStream;
     std::streampos mStreamStartPos;
+    int mColorType = 0;
+    size_t mRowBytes = 0;
+    uint32_t mRow = 0;
 };
 
 // -----------------------------------------------------------------------------------------------
 
-class HDRDecoder : public ImageDecoder::Decoder {
+class HDRDecoder : public ImageDecoder::Decoder, public ImageDecoder::StripDecoder {
     friend class ImageDecoder;
+    friend class HDRPixelDecoder;
     static HDRDecoder* create(std::istream& stream);
     static bool checkSignature(char const* buf);
 
@@ -92,16 +110,27 @@ private:
     // ImageDecoder::Decoder interface
     virtual LinearImage decode() override;
 
+    // ImageDecoder::StripDecoder interface
+    virtual LinearImage decodeStrip(uint32_t rowCount) override;
+
+    bool decodeHeader();
+    void decodeScanline(math::float3* pixels);
+    // reads the R, G, B and E planes of a scanline, width bytes each
+    void readScanline(uint8_t* rgbe);
+
     static const char sigRadiance[];
     static const char sigRGBE[];
     std::istream& mStream;
     std::streampos mStreamStartPos;
+    std::unique_ptr<uint8_t[]> mRGBE;
+    uint32_t mRow = 0;
 };
 
 // -----------------------------------------------------------------------------------------------
 
 class PSDDecoder : public ImageDecoder::Decoder {
     friend class ImageDecoder;
+    friend class PSDPixelDecoder;
     static PSDDecoder* create(std::istream& stream);
     static bool checkSignature(char const* buf);
 
@@ -115,9 +144,15 @@ private:
     // ImageDecoder::Decoder interface
     virtual LinearImage decode() override;
 
+    // reads everything up to the planes of the image, throws std::runtime_error
+    void decodeHeader();
+
     static const char sig[];
     std::istream& mStream;
     std::streampos mStreamStartPos;
+    uint32_t mWidth = 0;
+    uint32_t mHeight = 0;
+    uint16_t mDepth = 0;
 };
 
 // -----------------------------------------------------------------------------------------------
@@ -145,6 +180,108 @@ private:
 
 // -----------------------------------------------------------------------------------------------
 
+// Serves the strips of an image that was decoded in full.
+class FullStripDecoder : public ImageDecoder::StripDecoder {
+public:
+    explicit FullStripDecoder(const LinearImage& image) : mImage(image) {
+        mWidth = image.getWidth();
+        mHeight = image.getHeight();
+        mChannels = image.getChannels();
+    }
+
+    // ImageDecoder::StripDecoder interface
+    virtual LinearImage decodeStrip(uint32_t rowCount) override {
+        rowCount = std::min(rowCount, mHeight - mRow);
+        if (rowCount == 0) {
+            mImage.reset();
+            return LinearImage();
+        }
+        LinearImage strip = cropRegion(mImage, 0, mRow, mWidth, mRow + rowCount);
+        mRow += rowCount;
+        return strip;
+    }
+
+private:
+    LinearImage mImage;
+    uint32_t mRow = 0;
+};
+
+// -----------------------------------------------------------------------------------------------
+
+// Calls functor(row0, count) over [0, count), split across the job system if there is one.
+template<typename F>
+static void parallelRows(utils::JobSystem* js, uint32_t count, F functor) {
+    if (!js || count < 2) {
+        functor(0u, count);
+        return;
+    }
+    auto job = utils::jobs::parallel_for(*js, nullptr, 0, count, std::ref(functor),
+            utils::jobs::CountSplitter<16>());
+    js->runAndWait(job);
+}
+
+// libpng converts the rows to RGBA8 as it decodes them, which can't be parallelized.
+class PNGPixelDecoder : public ImageDecoder::PixelDecoder {
+public:
+    explicit PNGPixelDecoder(PNGDecoder* decoder) : mDecoder(decoder) {
+        mWidth = decoder->getWidth();
+        mHeight = decoder->getHeight();
+        mFormat = ImageDecoder::PixelFormat::RGBA8;
+    }
+
+    ~PNGPixelDecoder() override {
+        delete mDecoder;
+    }
+
+    // ImageDecoder::PixelDecoder interface
+    virtual bool decodePixels(void* buffer, size_t stride, utils::JobSystem*) override;
+
+private:
+    PNGDecoder* mDecoder;
+};
+
+// The scanlines are run length encoded, so only their conversion from RGBE is parallel.
+class HDRPixelDecoder : public ImageDecoder::PixelDecoder {
+public:
+    explicit HDRPixelDecoder(HDRDecoder* decoder) : mDecoder(decoder) {
+        mWidth = decoder->getWidth();
+        mHeight = decoder->getHeight();
+        mFormat = ImageDecoder::PixelFormat::RGB16F;
+    }
+
+    ~HDRPixelDecoder() override {
+        delete mDecoder;
+    }
+
+    // ImageDecoder::PixelDecoder interface
+    virtual bool decodePixels(void* buffer, size_t stride, utils::JobSystem* js) override;
+
+private:
+    HDRDecoder* mDecoder;
+};
+
+// The planes are read at once, then interleaved and converted in parallel.
+class PSDPixelDecoder : public ImageDecoder::PixelDecoder {
+public:
+    explicit PSDPixelDecoder(PSDDecoder* decoder) : mDecoder(decoder) {
+        mWidth = decoder->mWidth;
+        mHeight = decoder->mHeight;
+        mFormat = ImageDecoder::PixelFormat::RGB16F;
+    }
+
+    ~PSDPixelDecoder() override {
+        delete mDecoder;
+    }
+
+    // ImageDecoder::PixelDecoder interface
+    virtual bool decodePixels(void* buffer, size_t stride, utils::JobSystem* js) override;
+
+private:
+    PSDDecoder* mDecoder;
+};
+
+// -----------------------------------------------------------------------------------------------
+
 LinearImage ImageDecoder::decode(std::istream& stream, const std::string& sourceName,
         ColorSpace sourceSpace) {
 
@@ -191,6 +328,77 @@ LinearImage ImageDecoder::decode(std::istream& stream, const std::string& source
     return decoder->decode();
 }
 
+std::unique_ptr<ImageDecoder::StripDecoder> ImageDecoder::decodeStrips(std::istream& stream,
+        const std::string& sourceName, ColorSpace sourceSpace) {
+
+    std::streampos pos = stream.tellg();
+    char buf[16];
+    stream.read(buf, sizeof(buf));
+    const bool png = PNGDecoder::checkSignature(buf);
+    const bool hdr = HDRDecoder::checkSignature(buf);
+    stream.seekg(pos);
+
+    if (png) {
+        PNGDecoder* decoder = PNGDecoder::create(stream);
+        std::unique_ptr<StripDecoder> stripDecoder(decoder);
+        decoder->setColorSpace(sourceSpace);
+        if (decoder->decodeHeader() && !decoder->isInterlaced()) {
+            return stripDecoder;
+        }
+        // interlaced images can only be decoded in full
+        stream.seekg(pos);
+    } else if (hdr) {
+        HDRDecoder* decoder = HDRDecoder::create(stream);
+        std::unique_ptr<StripDecoder> stripDecoder(decoder);
+        decoder->setColorSpace(ColorSpace::LINEAR);
+        if (decoder->decodeHeader()) {
+            return stripDecoder;
+        }
+        return nullptr;
+    }
+
+    LinearImage image = decode(stream, sourceName, sourceSpace);
+    if (!image.isValid()) {
+        return nullptr;
+    }
+    return std::unique_ptr<StripDecoder>(new FullStripDecoder(image));
+}
+
+std::unique_ptr<ImageDecoder::PixelDecoder> ImageDecoder::decodePixels(std::istream& stream) {
+    std::streampos pos = stream.tellg();
+    char buf[16];
+    stream.read(buf, sizeof(buf));
+    stream.seekg(pos);
+
+    if (PNGDecoder::checkSignature(buf)) {
+        PNGDecoder* decoder = PNGDecoder::create(stream);
+        std::unique_ptr<Decoder> owner(decoder);
+        if (decoder->decodeHeader(true)) {
+            owner.release();
+            return std::unique_ptr<PixelDecoder>(new PNGPixelDecoder(decoder));
+        }
+    } else if (HDRDecoder::checkSignature(buf)) {
+        HDRDecoder* decoder = HDRDecoder::create(stream);
+        std::unique_ptr<Decoder> owner(decoder);
+        if (decoder->decodeHeader()) {
+            owner.release();
+            return std::unique_ptr<PixelDecoder>(new HDRPixelDecoder(decoder));
+        }
+    } else if (PSDDecoder::checkSignature(buf)) {
+        PSDDecoder* decoder = PSDDecoder::create(stream);
+        std::unique_ptr<Decoder> owner(decoder);
+        try {
+            decoder->decodeHeader();
+            owner.release();
+            return std::unique_ptr<PixelDecoder>(new PSDPixelDecoder(decoder));
+        } catch(std::runtime_error& e) {
+            std::cerr << "Runtime error while decoding PSD: " << e.what() << std::endl;
+            stream.seekg(pos);
+        }
+    }
+    return nullptr;
+}
+
 // -----------------------------------------------------------------------------------------------
 
 static inline float read32(std::istream& istream) {
@@ -232,19 +440,37 @@ PNGDecoder::~PNGDecoder() {
     png_destroy_read_struct(&mPNG, &mInfo, NULL);
 }
 
-LinearImage PNGDecoder::decode() {
-    std::unique_ptr<uint8_t[]> imageData;
+bool PNGDecoder::decodeHeader(bool native) {
     try {
         mInfo = png_create_info_struct(mPNG);
         png_read_info(mPNG, mInfo);
 
-        int colorType = png_get_color_type(mPNG, mInfo);
+        mColorType = png_get_color_type(mPNG, mInfo);
         int bitDepth = png_get_bit_depth(mPNG, mInfo);
 
-        if (colorType == PNG_COLOR_TYPE_PALETTE) {
+        if (native) {
+            // the values are kept as they are, whatever the color space
+            png_set_expand(mPNG);
+            if (!(mColorType & PNG_COLOR_MASK_COLOR)) {
+                png_set_gray_to_rgb(mPNG);
+            }
+            if (bitDepth == 16) {
+                png_set_scale_16(mPNG);
+            }
+            png_set_add_alpha(mPNG, 0xFF, PNG_FILLER_AFTER);
+            png_set_interlace_handling(mPNG);
+            png_read_update_info(mPNG, mInfo);
+            mWidth  = png_get_image_width(mPNG, mInfo);
+            mHeight = png_get_image_height(mPNG, mInfo);
+            mChannels = 4;
+            mRowBytes = png_get_rowbytes(mPNG, mInfo);
+            return true;
+        }
+
+        if (mColorType == PNG_COLOR_TYPE_PALETTE) {
             png_set_palette_to_rgb(mPNG);
         }
-        if (colorType == PNG_COLOR_TYPE_GRAY) {
+        if (mColorType == PNG_COLOR_TYPE_GRAY) {
             png_set_gray_to_rgb(mPNG);
         }
         if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
@@ -257,40 +483,63 @@ LinearImage PNGDecoder::decode() {
         }
 
         png_read_update_info(mPNG, mInfo);
-        uint32_t width  = png_get_image_width(mPNG, mInfo);
-        uint32_t height = png_get_image_height(mPNG, mInfo);
-        size_t rowBytes = png_get_rowbytes(mPNG, mInfo);
-
-        imageData = std::make_unique<uint8_t[]>(height * rowBytes);
-        std::unique_ptr<png_bytep[]> rowPointers(new png_bytep[height]);
-        for (size_t y = 0 ; y < height ; y++) {
-            rowPointers[y] = &imageData[y * rowBytes];
-        }
-        png_read_image(mPNG, rowPointers.get());
-        png_read_end(mPNG, mInfo);
+        mWidth  = png_get_image_width(mPNG, mInfo);
+        mHeight = png_get_image_height(mPNG, mInfo);
+        mChannels = mColorType == PNG_COLOR_TYPE_RGBA ? 4 : 3;
+        mRowBytes = png_get_rowbytes(mPNG, mInfo);
+        return true;
+    } catch(std::runtime_error& e) {
+        // reset the stream, like we found it
+        std::cerr << "Runtime error while decoding PNG: " << e.what() << std::endl;
+        mStream.seekg(mStreamStartPos);
+    }
+    return false;
+}
 
-        if (colorType == PNG_COLOR_TYPE_RGBA) {
-            if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
-                return toLinearWithAlpha<uint16_t>(width, height, rowBytes, imageData,
-                        [ ](uint16_t v) -> uint16_t { return ntohs(v); },
-                        sRGBToLinear<math::float4>);
-            } else {
-                return toLinearWithAlpha<uint16_t>(width, height, rowBytes, imageData,
-                        [ ](uint16_t v) -> uint16_t { return ntohs(v); },
-                        [ ](const math::float4& color) -> math::float4 { return color; });
-            }
+bool PNGDecoder::isInterlaced() const {
+    return png_get_interlace_type(mPNG, mInfo) != PNG_INTERLACE_NONE;
+}
+
+LinearImage PNGDecoder::toLinearImage(uint32_t height,
+        std::unique_ptr<uint8_t[]> const& data) const {
+    if (mColorType == PNG_COLOR_TYPE_RGBA) {
+        if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
+            return toLinearWithAlpha<uint16_t>(mWidth, height, mRowBytes, data,
+                    [ ](uint16_t v) -> uint16_t { return ntohs(v); },
+                    sRGBToLinear<math::float4>);
         } else {
-            // Convert to linear float (PNG 16 stores data in network order (big endian).
-            if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
-                return toLinear<uint16_t>(width, height, rowBytes, imageData,
-                        [ ](uint16_t v) -> uint16_t { return ntohs(v); },
-                        sRGBToLinear<math::float3>);
-            } else {
-                return toLinear<uint16_t>(width, height, rowBytes, imageData,
-                        [ ](uint16_t v) -> uint16_t { return ntohs(v); },
-                        [ ](const math::float3& color) -> math::float3 { return color; });
-            }
+            return toLinearWithAlpha<uint16_t>(mWidth, height, mRowBytes, data,
+                    [ ](uint16_t v) -> uint16_t { return ntohs(v); },
+                    [ ](const math::float4& color) -> math::float4 { return color; });
+        }
+    } else {
+        // Convert to linear float (PNG 16 stores data in network order (big endian).
+        if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
+            return toLinear<uint16_t>(mWidth, height, mRowBytes, data,
+                    [ ](uint16_t v) -> uint16_t { return ntohs(v); },
+                    sRGBToLinear<math::float3>);
+        } else {
+            return toLinear<uint16_t>(mWidth, height, mRowBytes, data,
+                    [ ](uint16_t v) -> uint16_t { return ntohs(v); },
+                    [ ](const math::float3& color) -> math::float3 { return color; });
         }
+    }
+}
+
+LinearImage PNGDecoder::decode() {
+    if (!decodeHeader()) {
+        return LinearImage();
+    }
+    std::unique_ptr<uint8_t[]> imageData;
+    try {
+        imageData = std::make_unique<uint8_t[]>(mHeight * mRowBytes);
+        std::unique_ptr<png_bytep[]> rowPointers(new png_bytep[mHeight]);
+        for (size_t y = 0 ; y < mHeight ; y++) {
+            rowPointers[y] = &imageData[y * mRowBytes];
+        }
+        png_read_image(mPNG, rowPointers.get());
+        png_read_end(mPNG, mInfo);
+        return toLinearImage(mHeight, imageData);
     } catch(std::runtime_error& e) {
         // reset the stream, like we found it
         std::cerr << "Runtime error while decoding PNG: " << e.what() << std::endl;
@@ -300,6 +549,46 @@ LinearImage PNGDecoder::decode() {
     return LinearImage();
 }
 
+LinearImage PNGDecoder::decodeStrip(uint32_t rowCount) {
+    rowCount = std::min(rowCount, mHeight - mRow);
+    if (rowCount == 0) {
+        return LinearImage();
+    }
+    try {
+        std::unique_ptr<uint8_t[]> stripData = std::make_unique<uint8_t[]>(rowCount * mRowBytes);
+        std::unique_ptr<png_bytep[]> rowPointers(new png_bytep[rowCount]);
+        for (size_t y = 0 ; y < rowCount ; y++) {
+            rowPointers[y] = &stripData[y * mRowBytes];
+        }
+        png_read_rows(mPNG, rowPointers.get(), nullptr, rowCount);
+        mRow += rowCount;
+        if (mRow == mHeight) {
+            png_read_end(mPNG, mInfo);
+        }
+        return toLinearImage(rowCount, stripData);
+    } catch(std::runtime_error& e) {
+        std::cerr << "Runtime error while decoding PNG: " << e.what() << std::endl;
+        mRow = mHeight;
+    }
+    return LinearImage();
+}
+
+bool PNGPixelDecoder::decodePixels(void* buffer, size_t stride, utils::JobSystem*) {
+    stride = stride ? stride : mWidth * getBytesPerPixel();
+    try {
+        std::unique_ptr<png_bytep[]> rowPointers(new png_bytep[mHeight]);
+        for (size_t y = 0 ; y < mHeight ; y++) {
+            rowPointers[y] = static_cast<png_bytep>(buffer) + y * stride;
+        }
+        png_read_image(mDecoder->mPNG, rowPointers.get());
+        png_read_end(mDecoder->mPNG, mDecoder->mInfo);
+        return true;
+    } catch(std::runtime_error& e) {
+        std::cerr << "Runtime error while decoding PNG: " << e.what() << std::endl;
+    }
+    return false;
+}
+
 void PNGDecoder::cb_stream(png_structp png, png_bytep buffer, png_size_t size) {
     PNGDecoder* that = static_cast<PNGDecoder*>(png_get_io_ptr(png));
     that->stream(buffer, size);
@@ -342,85 +631,105 @@ HDRDecoder::HDRDecoder(std::istream& stream)
 
 HDRDecoder::~HDRDecoder() = default;
 
-LinearImage HDRDecoder::decode() {
+bool HDRDecoder::decodeHeader() {
     try {
         float gamma;
         float exposure;
         char sy, sx;
         unsigned int height, width;
 
-        {
-            char buf[1024];
-            do {
-                char format[128];
-                mStream.getline(buf, sizeof(buf), 0xa);
-                if (buf[0] == '#') continue;
-                sscanf(buf, "FORMAT=%127s", format);
-                sscanf(buf, "GAMMA=%f", &gamma);
-                sscanf(buf, "EXPOSURE=%f", &exposure);
-                if ((sscanf(buf, "%cY %u %cX %u", &sy, &height, &sx, &width) == 4)||
-                    (sscanf(buf, "%cX %u %cY %u", &sx, &width, &sy, &height) == 4)) {
-                    break;
-                }
-            } while (true);
-        }
-
-        LinearImage image(width, height, 3);
-
-        uint32_t flags = 0;
-        if (sx == '-') image = horizontalFlip(image);
-        if (sy == '+') image = verticalFlip(image);
-
-        uint16_t w;
-        uint16_t magic;
-        std::unique_ptr<uint8_t[]> rgbe(new uint8_t[width*4]);
-        for (size_t y=0 ; y<height ; y++) {
-            //std::cout << "line: " << y << std::endl;
-            mStream.read((char*)&magic, 2);
-            if (magic != 0x0202) {
-                throw std::runtime_error("invalid scanline (magic)");
+        char buf[1024];
+        do {
+            char format[128];
+            mStream.getline(buf, sizeof(buf), 0xa);
+            if (!mStream.good()) {
+                throw std::runtime_error("invalid header");
             }
-            mStream.read((char*)&w, 2);
-            if (ntohs(w) != width) {
-                throw std::runtime_error("invalid scanline (width)");
+            if (buf[0] == '#') continue;
+            sscanf(buf, "FORMAT=%127s", format);
+            sscanf(buf, "GAMMA=%f", &gamma);
+            sscanf(buf, "EXPOSURE=%f", &exposure);
+            if ((sscanf(buf, "%cY %u %cX %u", &sy, &height, &sx, &width) == 4)||
+                (sscanf(buf, "%cX %u %cY %u", &sx, &width, &sy, &height) == 4)) {
+                break;
             }
+        } while (true);
 
-            char *d = (char *)rgbe.get();
-            for (size_t p=0 ; p<4 ; p++) {
-                size_t num_bytes = 0;
-                while (num_bytes < width) {
-                    uint8_t rle_count;
-                    mStream.read((char*)&rle_count, 1);
-                    if (rle_count > 128) {
-                        char v;
-                        mStream.read(&v, 1);
-                        memset(d, v, size_t(rle_count - 128));
-                        d += rle_count - 128;
-                        num_bytes += rle_count - 128;
-                    } else {
-                        if (rle_count == 0) {
-                            throw std::runtime_error("run length is zero");
-                        }
-                        mStream.read(d, rle_count);
-                        d += rle_count;
-                        num_bytes += rle_count;
-                    }
+        mWidth = width;
+        mHeight = height;
+        mChannels = 3;
+        mRGBE.reset(new uint8_t[width*4]);
+        return true;
+    } catch(std::runtime_error& e) {
+        // reset the stream, like we found it
+        std::cerr << "Runtime error while decoding HDR: " << e.what() << std::endl;
+        mStream.seekg(mStreamStartPos);
+    }
+    return false;
+}
+
+void HDRDecoder::decodeScanline(math::float3* pixels) {
+    const uint32_t width = mWidth;
+    readScanline(mRGBE.get());
+
+    uint8_t const* r = &mRGBE[0];
+    uint8_t const* g = &mRGBE[width];
+    uint8_t const* b = &mRGBE[2*width];
+    uint8_t const* e = &mRGBE[3*width];
+    // (rgb/256) * 2^(e-128)
+    for (size_t x=0 ; x<width ; x++, r++, g++, b++, e++) {
+        math::float3 v(r[0], g[0], b[0]);
+        pixels[x] = v * std::ldexp(1.0f, e[0]-(128+8));
+    }
+}
+
+void HDRDecoder::readScanline(uint8_t* rgbe) {
+    const uint32_t width = mWidth;
+    uint16_t w;
+    uint16_t magic;
+    mStream.read((char*)&magic, 2);
+    if (magic != 0x0202) {
+        throw std::runtime_error("invalid scanline (magic)");
+    }
+    mStream.read((char*)&w, 2);
+    if (ntohs(w) != width) {
+        throw std::runtime_error("invalid scanline (width)");
+    }
+
+    char *d = (char *)rgbe;
+    for (size_t p=0 ; p<4 ; p++) {
+        size_t num_bytes = 0;
+        while (num_bytes < width) {
+            uint8_t rle_count;
+            mStream.read((char*)&rle_count, 1);
+            if (rle_count > 128) {
+                char v;
+                mStream.read(&v, 1);
+                memset(d, v, size_t(rle_count - 128));
+                d += rle_count - 128;
+                num_bytes += rle_count - 128;
+            } else {
+                if (rle_count == 0) {
+                    throw std::runtime_error("run length is zero");
                 }
+                mStream.read(d, rle_count);
+                d += rle_count;
+                num_bytes += rle_count;
             }
+        }
+    }
+}
 
-            uint8_t const* r = &rgbe[0];
-            uint8_t const* g = &rgbe[width];
-            uint8_t const* b = &rgbe[2*width];
-            uint8_t const* e = &rgbe[3*width];
-            math::float3* i = reinterpret_cast<math::float3*>(image.getPixelRef(0, y));
-            // (rgb/256) * 2^(e-128)
-            for (size_t x=0 ; x<width ; x++, r++, g++, b++, e++) {
-                math::float3 v(r[0], g[0], b[0]);
-                i[x] = v * std::ldexp(1.0f, e[0]-(128+8));
-            }
+LinearImage HDRDecoder::decode() {
+    if (!decodeHeader()) {
+        return LinearImage();
+    }
+    try {
+        LinearImage image(mWidth, mHeight, 3);
+        for (size_t y=0 ; y<mHeight ; y++) {
+            decodeScanline(reinterpret_cast<math::float3*>(image.getPixelRef(0, y)));
         }
         return image;
-
     } catch(std::runtime_error& e) {
         // reset the stream, like we found it
         std::cerr << "Runtime error while decoding HDR: " << e.what() << std::endl;
@@ -429,6 +738,57 @@ LinearImage HDRDecoder::decode() {
     return LinearImage();
 }
 
+LinearImage HDRDecoder::decodeStrip(uint32_t rowCount) {
+    rowCount = std::min(rowCount, mHeight - mRow);
+    if (rowCount == 0) {
+        return LinearImage();
+    }
+    try {
+        LinearImage strip(mWidth, rowCount, 3);
+        for (size_t y=0 ; y<rowCount ; y++) {
+            decodeScanline(reinterpret_cast<math::float3*>(strip.getPixelRef(0, y)));
+        }
+        mRow += rowCount;
+        return strip;
+    } catch(std::runtime_error& e) {
+        std::cerr << "Runtime error while decoding HDR: " << e.what() << std::endl;
+        mRow = mHeight;
+    }
+    return LinearImage();
+}
+
+bool HDRPixelDecoder::decodePixels(void* buffer, size_t stride, utils::JobSystem* js) {
+    const uint32_t width = mWidth;
+    stride = stride ? stride : width * getBytesPerPixel();
+    try {
+        std::unique_ptr<uint8_t[]> rgbe(new uint8_t[size_t(width) * mHeight * 4]);
+        for (size_t y = 0; y < mHeight; y++) {
+            mDecoder->readScanline(&rgbe[y * width * 4]);
+        }
+        parallelRows(js, mHeight, [&](uint32_t row0, uint32_t count) {
+            for (uint32_t y = row0; y < row0 + count; y++) {
+                uint8_t const* r = &rgbe[y * width * 4];
+                uint8_t const* g = r + width;
+                uint8_t const* b = g + width;
+                uint8_t const* e = b + width;
+                math::half* dst = reinterpret_cast<math::half*>(
+                        static_cast<uint8_t*>(buffer) + y * stride);
+                for (size_t x = 0; x < width; x++, dst += 3) {
+                    // (rgb/256) * 2^(e-128)
+                    const float scale = std::ldexp(1.0f, e[x] - (128 + 8));
+                    dst[0] = math::half(r[x] * scale);
+                    dst[1] = math::half(g[x] * scale);
+                    dst[2] = math::half(b[x] * scale);
+                }
+            }
+        });
+        return true;
+    } catch(std::runtime_error& e) {
+        std::cerr << "Runtime error while decoding HDR: " << e.what() << std::endl;
+    }
+    return false;
+}
+
 // -----------------------------------------------------------------------------------------------
 
 const char PSDDecoder::sig[] = { '8', 'B', 'P', 'S', 0x0, 0x1, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0 };
@@ -448,7 +808,7 @@ PSDDecoder::PSDDecoder(std::istream& stream)
 
 PSDDecoder::~PSDDecoder() = default;
 
-LinearImage PSDDecoder::decode() {
+void PSDDecoder::decodeHeader() {
     #pragma pack(push, 1)
     // IMPORTANT NOTE: PSD files use big endian storage
     struct Header {
@@ -466,50 +826,57 @@ LinearImage PSDDecoder::decode() {
     static const uint16_t kColorModeRGB = 3;
     static const uint16_t kCompressionRAW = 0;
 
-    try {
-        Header h;
-        mStream.read(reinterpret_cast<char*>(&h), sizeof(Header));
+    Header h;
+    mStream.read(reinterpret_cast<char*>(&h), sizeof(Header));
 
-        if (ntohs(h.channels) != 3) {
-            throw std::runtime_error("the image must have 3 channels only");
-        }
+    if (ntohs(h.channels) != 3) {
+        throw std::runtime_error("the image must have 3 channels only");
+    }
 
-        uint16_t depth = ntohs(h.depth);
-        if (depth != 16 && depth != 32) {
-            throw std::runtime_error("the image depth must be 16 or 32 bits per pixel");
-        }
+    uint16_t depth = ntohs(h.depth);
+    if (depth != 16 && depth != 32) {
+        throw std::runtime_error("the image depth must be 16 or 32 bits per pixel");
+    }
 
-        if (ntohs(h.mode) != kColorModeRGB) {
-            throw std::runtime_error("the image must be RGB");
-        }
+    if (ntohs(h.mode) != kColorModeRGB) {
+        throw std::runtime_error("the image must be RGB");
+    }
 
-        uint32_t width = ntohl(h.width);
-        uint32_t height = ntohl(h.height);
+    mWidth = ntohl(h.width);
+    mHeight = ntohl(h.height);
+    mDepth = depth;
 
-        uint32_t length;
+    uint32_t length;
 
-        // color mode data section
-        mStream.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
-        mStream.seekg(ntohl(length), std::istream::cur);
+    // color mode data section
+    mStream.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
+    mStream.seekg(ntohl(length), std::istream::cur);
 
-        // image resources
-        mStream.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
-        mStream.seekg(ntohl(length), std::istream::cur);
+    // image resources
+    mStream.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
+    mStream.seekg(ntohl(length), std::istream::cur);
 
-        // layer and mask info section
-        mStream.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
-        mStream.seekg(ntohl(length), std::istream::cur);
+    // layer and mask info section
+    mStream.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
+    mStream.seekg(ntohl(length), std::istream::cur);
 
-        // compression format
-        uint16_t compression;
-        mStream.read(reinterpret_cast<char*>(&compression), sizeof(uint16_t));
-        if (ntohs(compression) != kCompressionRAW) {
-            throw std::runtime_error("compressed images are not supported");
-        }
+    // compression format
+    uint16_t compression;
+    mStream.read(reinterpret_cast<char*>(&compression), sizeof(uint16_t));
+    if (ntohs(compression) != kCompressionRAW) {
+        throw std::runtime_error("compressed images are not supported");
+    }
+}
 
+LinearImage PSDDecoder::decode() {
+    try {
+        decodeHeader();
+
+        const uint32_t width = mWidth;
+        const uint32_t height = mHeight;
         LinearImage image(width, height, 3);
 
-        if (depth == 32) {
+        if (mDepth == 32) {
             for (size_t i = 0; i < 3; i++) {
                 for (size_t y = 0; y < height; y++) {
                     for (size_t x = 0; x < width; x++) {
@@ -539,6 +906,48 @@ LinearImage PSDDecoder::decode() {
     return LinearImage();
 }
 
+bool PSDPixelDecoder::decodePixels(void* buffer, size_t stride, utils::JobSystem* js) {
+    const uint32_t width = mWidth;
+    const uint32_t height = mHeight;
+    const size_t bytesPerChannel = mDecoder->mDepth / 8u;
+    const size_t planeSize = size_t(width) * height * bytesPerChannel;
+    stride = stride ? stride : width * getBytesPerPixel();
+
+    std::unique_ptr<uint8_t[]> planes(new uint8_t[planeSize * 3]);
+    std::istream& stream = mDecoder->mStream;
+    stream.read(reinterpret_cast<char*>(planes.get()), planeSize * 3);
+    if (!stream.good()) {
+        std::cerr << "Runtime error while decoding PSD: truncated image" << std::endl;
+        return false;
+    }
+
+    parallelRows(js, height, [&](uint32_t row0, uint32_t count) {
+        for (uint32_t y = row0; y < row0 + count; y++) {
+            math::half* dst = reinterpret_cast<math::half*>(
+                    static_cast<uint8_t*>(buffer) + y * stride);
+            for (size_t x = 0; x < width; x++) {
+                for (size_t i = 0; i < 3; i++) {
+                    uint8_t const* src = &planes[i * planeSize +
+                            (size_t(y) * width + x) * bytesPerChannel];
+                    float value;
+                    if (bytesPerChannel == 4) {
+                        uint32_t bits;
+                        memcpy(&bits, src, sizeof(bits));
+                        bits = ntohl(bits);
+                        memcpy(&value, &bits, sizeof(value));
+                    } else {
+                        uint16_t bits;
+                        memcpy(&bits, src, sizeof(bits));
+                        value = float(ntohs(bits)) / std::numeric_limits<uint16_t>::max();
+                    }
+                    *dst++ = math::half(value);
+                }
+            }
+        }
+    });
+    return true;
+}
+
 // -----------------------------------------------------------------------------------------------
 
 const char EXRDecoder::sig[] = { 0x76, 0x2f, 0x31, 0x01 };
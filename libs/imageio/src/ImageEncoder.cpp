@@ -23,6 +23,7 @@
 #include <limits>
 #include <memory>
 #include <ostream>
+#include <vector>
 
 #if defined(WIN32)
     #include <Winsock2.h>
@@ -45,7 +46,8 @@ using namespace math;
 
 namespace image {
 
-class PNGEncoder : public ImageEncoder::Encoder {
+class PNGEncoder : public ImageEncoder::Encoder, public ImageEncoder::StripEncoder {
+    friend class ImageEncoder;
 public:
     enum class PixelFormat {
         sRGB,       // 8-bits sRGB
@@ -67,7 +69,11 @@ private:
     // ImageEncoder::Encoder interface
     virtual void encode(const LinearImage& image) override;
 
-    int chooseColorType(const LinearImage& image) const;
+    // ImageEncoder::StripEncoder interface
+    virtual void encodeStrip(const LinearImage& strip) override;
+
+    bool encodeHeader(uint32_t width, uint32_t height, uint32_t channels);
+    int chooseColorType(uint32_t channels) const;
     uint32_t getChannelsCount() const;
 
     static void cb_error(png_structp png, png_const_charp error);
@@ -82,11 +88,14 @@ private:
     std::streampos mStreamStartPos;
 
     PixelFormat mFormat;
+    uint32_t mHeight = 0;
+    uint32_t mRow = 0;
 };
 
 // ------------------------------------------------------------------------------------------------
 
-class HDREncoder : public ImageEncoder::Encoder {
+class HDREncoder : public ImageEncoder::Encoder, public ImageEncoder::StripEncoder {
+    friend class ImageEncoder;
 public:
     static HDREncoder* create(std::ostream& stream);
 
@@ -100,6 +109,11 @@ private:
     // ImageEncoder::Encoder interface
     virtual void encode(const LinearImage& image) override;
 
+    // ImageEncoder::StripEncoder interface
+    virtual void encodeStrip(const LinearImage& strip) override;
+
+    bool encodeHeader(uint32_t width, uint32_t height, uint32_t channels);
+
     static void float2rgbe(uint8_t rgbe[4], const math::float3& color);
     static size_t countRepeats(uint8_t const* data, size_t length);
     static size_t countNonRepeats(uint8_t const* data, size_t length);
@@ -107,6 +121,10 @@ private:
 
     std::ostream& mStream;
     std::streampos mStreamStartPos;
+    std::unique_ptr<uint8_t[]> mRGBE;
+    uint32_t mWidth = 0;
+    uint32_t mHeight = 0;
+    uint32_t mRow = 0;
 };
 
 // ------------------------------------------------------------------------------------------------
@@ -217,6 +235,71 @@ void ImageEncoder::encode(std::ostream& stream, Format format, const LinearImage
     return encoder->encode(image);
 }
 
+// Accumulates the strips of an image for the formats that can only be encoded in full.
+class BufferedStripEncoder : public ImageEncoder::StripEncoder {
+public:
+    BufferedStripEncoder(std::ostream& stream, ImageEncoder::Format format, uint32_t width,
+            uint32_t height, uint32_t channels, const std::string& compression,
+            const std::string& destName)
+            : mStream(stream), mFormat(format), mImage(width, height, channels),
+              mCompression(compression), mDestName(destName) {
+    }
+
+    // ImageEncoder::StripEncoder interface
+    virtual void encodeStrip(const LinearImage& strip) override {
+        const uint32_t rowCount = std::min(strip.getHeight(), mImage.getHeight() - mRow);
+        if (!mImage.isValid() || rowCount == 0) {
+            return;
+        }
+        memcpy(mImage.getPixelRef(0, mRow), strip.getPixelRef(),
+                rowCount * mImage.getWidth() * mImage.getChannels() * sizeof(float));
+        mRow += rowCount;
+        if (mRow == mImage.getHeight()) {
+            ImageEncoder::encode(mStream, mFormat, mImage, mCompression, mDestName);
+            mImage.reset();
+        }
+    }
+
+private:
+    std::ostream& mStream;
+    ImageEncoder::Format mFormat;
+    LinearImage mImage;
+    std::string mCompression;
+    std::string mDestName;
+    uint32_t mRow = 0;
+};
+
+std::unique_ptr<ImageEncoder::StripEncoder> ImageEncoder::encodeStrips(std::ostream& stream,
+        Format format, uint32_t width, uint32_t height, uint32_t channels,
+        const std::string& compression, const std::string& destName) {
+    switch (format) {
+        case Format::PNG:
+        case Format::PNG_LINEAR:
+        case Format::RGBM: {
+            PNGEncoder* encoder = PNGEncoder::create(stream,
+                    format == Format::PNG_LINEAR ? PNGEncoder::PixelFormat::LINEAR_RGB :
+                    format == Format::RGBM ? PNGEncoder::PixelFormat::RGBM :
+                    PNGEncoder::PixelFormat::sRGB);
+            std::unique_ptr<StripEncoder> stripEncoder(encoder);
+            if (!encoder->encodeHeader(width, height, channels)) {
+                return nullptr;
+            }
+            return stripEncoder;
+        }
+        case Format::HDR: {
+            HDREncoder* encoder = HDREncoder::create(stream);
+            std::unique_ptr<StripEncoder> stripEncoder(encoder);
+            if (!encoder->encodeHeader(width, height, channels)) {
+                return nullptr;
+            }
+            return stripEncoder;
+        }
+        default:
+            return std::unique_ptr<StripEncoder>(new BufferedStripEncoder(stream, format,
+                    width, height, channels, compression, destName));
+    }
+}
+
 ImageEncoder::Format ImageEncoder::chooseFormat(const std::string& name, bool forceLinear) {
     std::string ext;
     size_t index = name.rfind(".");
@@ -283,8 +366,7 @@ void PNGEncoder::init() {
     png_set_write_fn(mPNG, this, cb_stream, NULL);
 }
 
-int PNGEncoder::chooseColorType(const LinearImage& image) const {
-    size_t channels = image.getChannels();
+int PNGEncoder::chooseColorType(uint32_t channels) const {
     switch (channels) {
         case 1:
             return PNG_COLOR_TYPE_GRAY;
@@ -309,22 +391,19 @@ uint32_t PNGEncoder::getChannelsCount() const {
     }
 }
 
-void PNGEncoder::encode(const LinearImage& image) {
-    size_t srcChannels = image.getChannels();
+bool PNGEncoder::encodeHeader(uint32_t width, uint32_t height, uint32_t srcChannels) {
     if ((mFormat == PixelFormat::RGBM && srcChannels != 3) ||
             (srcChannels != 1 && srcChannels != 3)) {
         std::cerr << "Cannot encode PNG: " << srcChannels << " channels." << std::endl;
-        return;
+        return false;
     }
 
     try {
         mInfo = png_create_info_struct(mPNG);
 
         // Write header (8 bit colour depth)
-        size_t width = image.getWidth();
-        size_t height = image.getHeight();
         png_set_IHDR(mPNG, mInfo, width, height,
-              8, chooseColorType(image), PNG_INTERLACE_NONE,
+              8, chooseColorType(srcChannels), PNG_INTERLACE_NONE,
               PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
 
         if (mFormat == PixelFormat::LINEAR_RGB) {
@@ -334,23 +413,46 @@ void PNGEncoder::encode(const LinearImage& image) {
         }
 
         png_write_info(mPNG, mInfo);
+        mHeight = height;
+        return true;
+    } catch (std::runtime_error& e) {
+        // reset the stream, like we found it
+        std::cerr << "Runtime error while encoding PNG: " << e.what() << std::endl;
+        mStream.seekp(mStreamStartPos);
+    }
+    return false;
+}
+
+void PNGEncoder::encode(const LinearImage& image) {
+    if (encodeHeader(image.getWidth(), image.getHeight(), image.getChannels())) {
+        encodeStrip(image);
+    }
+}
 
+void PNGEncoder::encodeStrip(const LinearImage& strip) {
+    const size_t width = strip.getWidth();
+    const size_t height = std::min(strip.getHeight(), mHeight - mRow);
+    if (height == 0) {
+        return;
+    }
+
+    try {
         std::unique_ptr<png_bytep[]> row_pointers(new png_bytep[height]);
         std::unique_ptr<uint8_t[]> data;
 
         uint32_t dstChannels;
-        if (srcChannels == 1) {
+        if (strip.getChannels() == 1) {
             dstChannels = 1;
-            data = fromLinearToGrayscale<uint8_t>(image);
+            data = fromLinearToGrayscale<uint8_t>(strip);
         } else {
             dstChannels = getChannelsCount();
             switch (mFormat) {
                 case PixelFormat::RGBM:
-                    data = fromLinearToRGBM<uint8_t>(image);
+                    data = fromLinearToRGBM<uint8_t>(strip);
                     break;
                 case PixelFormat::sRGB:
                 case PixelFormat::LINEAR_RGB:
-                    data = fromLinearToRGB<uint8_t>(image);
+                    data = fromLinearToRGB<uint8_t>(strip);
                     break;
             }
         }
@@ -360,13 +462,17 @@ void PNGEncoder::encode(const LinearImage& image) {
                     sizeof(uint8_t)]);
         }
 
-        png_write_image(mPNG, row_pointers.get());
-        png_write_end(mPNG, mInfo);
-        mStream.flush();
+        png_write_rows(mPNG, row_pointers.get(), uint32_t(height));
+        mRow += height;
+        if (mRow == mHeight) {
+            png_write_end(mPNG, mInfo);
+            mStream.flush();
+        }
     } catch (std::runtime_error& e) {
         // reset the stream, like we found it
         std::cerr << "Runtime error while encoding PNG: " << e.what() << std::endl;
         mStream.seekp(mStreamStartPos);
+        mRow = mHeight;
     }
 }
 
@@ -473,16 +579,13 @@ void HDREncoder::rle(std::ostream& out, uint8_t const* data, size_t length) {
     }
 }
 
-void HDREncoder::encode(const LinearImage& image) {
-    if (image.getChannels() != 3) {
-        return;
+bool HDREncoder::encodeHeader(uint32_t width, uint32_t height, uint32_t channels) {
+    if (channels != 3) {
+        return false;
     }
 
     try {
         // Write header (8 bit color depth)
-        size_t width = image.getWidth();
-        size_t height = image.getHeight();
-
         mStream << "#?RADIANCE" << std::endl;
         mStream << "# cmgen" << std::endl;
         mStream << "FORMAT=32-bit_rle_rgbe" << std::endl;
@@ -492,18 +595,43 @@ void HDREncoder::encode(const LinearImage& image) {
         mStream << "-Y " << std::to_string(height) << " "
                 << "+X " << std::to_string(width) << std::endl;
 
-        std::unique_ptr<uint8_t[]> rgbe(new uint8_t[width*4]);
-        uint8_t* const r = &rgbe[0];
-        uint8_t* const g = &rgbe[width];
-        uint8_t* const b = &rgbe[2*width];
-        uint8_t* const e = &rgbe[3*width];
+        mRGBE.reset(new uint8_t[width*4]);
+        mWidth = width;
+        mHeight = height;
+        return true;
+    } catch(std::runtime_error& e) {
+        // reset the stream, like we found it
+        std::cerr << "Runtime error while encoding HDR: " << e.what() << std::endl;
+        mStream.seekp(mStreamStartPos);
+    }
+    return false;
+}
+
+void HDREncoder::encode(const LinearImage& image) {
+    if (encodeHeader(image.getWidth(), image.getHeight(), image.getChannels())) {
+        encodeStrip(image);
+    }
+}
+
+void HDREncoder::encodeStrip(const LinearImage& strip) {
+    const size_t width = mWidth;
+    const size_t height = std::min(strip.getHeight(), mHeight - mRow);
+    if (height == 0) {
+        return;
+    }
+
+    try {
+        uint8_t* const r = &mRGBE[0];
+        uint8_t* const g = &mRGBE[width];
+        uint8_t* const b = &mRGBE[2*width];
+        uint8_t* const e = &mRGBE[3*width];
         uint16_t magic = 0x0202;
         uint16_t widthNetwork = htons(width);
 
         for (size_t y=0 ; y<height ; y++) {
             // convert one scanline to RGBE
             uint8_t p[4];
-            auto data = image.get<float3>(0, y);
+            auto data = strip.get<float3>(0, y);
             for (size_t x=0 ; x<width ; ++x, ++data) {
                 float2rgbe(p, *data);
                 r[x] = p[0];
@@ -519,11 +647,15 @@ void HDREncoder::encode(const LinearImage& image) {
             rle(mStream, b, width);
             rle(mStream, e, width);
         }
-        mStream.flush();
+        mRow += height;
+        if (mRow == mHeight) {
+            mStream.flush();
+        }
     } catch(std::runtime_error& e) {
         // reset the stream, like we found it
         std::cerr << "Runtime error while encoding HDR: " << e.what() << std::endl;
         mStream.seekp(mStreamStartPos);
+        mRow = mHeight;
     }
 }
 
@@ -755,10 +887,19 @@ void EXREncoder::encode(const LinearImage& image) {
             }
         }
 
-        float* imageData[3];
-        imageData[0] = &b[0];
-        imageData[1] = &g[0];
-        imageData[2] = &r[0];
+        // the channels are stored as half-floats, converted here in bulk rather than one by one
+        // by tinyexr
+        std::unique_ptr<half[]> rh(new half[width * height]);
+        std::unique_ptr<half[]> gh(new half[width * height]);
+        std::unique_ptr<half[]> bh(new half[width * height]);
+        floatToHalf(&r[0], &rh[0], width * height);
+        floatToHalf(&g[0], &gh[0], width * height);
+        floatToHalf(&b[0], &bh[0], width * height);
+
+        half* imageData[3];
+        imageData[0] = &bh[0];
+        imageData[1] = &gh[0];
+        imageData[2] = &rh[0];
 
         exrImage.images = (unsigned char**) imageData;
 
@@ -776,7 +917,7 @@ void EXREncoder::encode(const LinearImage& image) {
         header.pixel_types = (int*) malloc(sizeof(int) * header.num_channels);
         header.requested_pixel_types = (int*) malloc(sizeof(int) * header.num_channels);
         for (i = 0; i < header.num_channels; i++) {
-            header.pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
+            header.pixel_types[i] = TINYEXR_PIXELTYPE_HALF;
             header.requested_pixel_types[i] = TINYEXR_PIXELTYPE_HALF;
         }
 
@@ -976,13 +1117,11 @@ void DDSEncoder::encode(const LinearImage& image) {
                 break;
             }
             case DXGI_FORMAT_R16_FLOAT: {
+                std::vector<half> row(width);
                 for (size_t y = 0; y < height; y++) {
                     const float* data = image.getPixelRef(0, y);
-                    for (size_t x = 0; x < width; x++) {
-                        math::half p = math::half(*data);
-                        mStream.write((const char*) &p, 2);
-                        data++;
-                    }
+                    floatToHalf(data, row.data(), width);
+                    mStream.write((const char*) row.data(), width * sizeof(half));
                 }
                 break;
             }
@@ -1025,13 +1164,11 @@ void DDSEncoder::encode(const LinearImage& image) {
                 break;
             }
             case DXGI_FORMAT_R16G16_FLOAT: {
+                std::vector<half2> row(width);
                 for (size_t y = 0; y < height; y++) {
-                    const float2* data = reinterpret_cast<float2 const*>(image.getPixelRef(0, y));
-                    for (size_t x = 0; x < width; x++) {
-                        half2 p = half2(*data);
-                        mStream.write((const char*) &p, sizeof(p));
-                        data++;
-                    }
+                    const float* data = image.getPixelRef(0, y);
+                    floatToHalf(data, &row[0].x, width * 2);
+                    mStream.write((const char*) row.data(), width * sizeof(half2));
                 }
                 break;
             }
@@ -1075,13 +1212,16 @@ void DDSEncoder::encode(const LinearImage& image) {
                 break;
             }
             case DXGI_FORMAT_R16G16B16A16_FLOAT: {
+                // the row is converted at once, then padded with an opaque alpha
+                std::vector<half3> rgb(width);
+                std::vector<half4> row(width);
                 for (size_t y = 0; y < height; y++) {
-                    auto data = image.get<float3>(0, y);
+                    const float* data = image.getPixelRef(0, y);
+                    floatToHalf(data, &rgb[0].x, width * 3);
                     for (size_t x = 0; x < width; x++) {
-                        half4 p = half4(half3(*data), 1);
-                        mStream.write((const char*) &p, sizeof(ushort4));
-                        data++;
+                        row[x] = half4(rgb[x], 1.0_h);
                     }
+                    mStream.write((const char*) row.data(), width * sizeof(half4));
                 }
                 break;
             }
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <imageio/KtxLoader.h>
+
+#if !defined(WIN32) && !defined(__EMSCRIPTEN__)
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#    define HAS_MMAP 1
+#else
+#    define HAS_MMAP 0
+#endif
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace image {
+
+#if HAS_MMAP
+
+std::shared_ptr<const KtxBundle> loadKtx(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Unable to open KTX file: " << path << std::endl;
+        return nullptr;
+    }
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // the mapping stays valid after the file is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "Unable to map KTX file: " << path << std::endl;
+        return nullptr;
+    }
+
+    const size_t size = size_t(st.st_size);
+    try {
+        constexpr bool copyContents = false;
+        KtxBundle* bundle = new KtxBundle(static_cast<uint8_t const*>(data), uint32_t(size),
+                copyContents);
+        return std::shared_ptr<const KtxBundle>(bundle, [data, size](KtxBundle const* bundle) {
+            delete bundle;
+            munmap(data, size);
+        });
+    } catch (std::runtime_error& e) {
+        std::cerr << "Runtime error while loading KTX file " << path << ": " << e.what()
+                << std::endl;
+        munmap(data, size);
+        return nullptr;
+    }
+}
+
+#else
+
+std::shared_ptr<const KtxBundle> loadKtx(const std::string& path) {
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream) {
+        std::cerr << "Unable to open KTX file: " << path << std::endl;
+        return nullptr;
+    }
+    const size_t size = size_t(stream.tellg());
+    std::unique_ptr<uint8_t[]> contents(new uint8_t[size]);
+    stream.seekg(0);
+    if (!stream.read(reinterpret_cast<char*>(contents.get()), size)) {
+        std::cerr << "Unable to read KTX file: " << path << std::endl;
+        return nullptr;
+    }
+
+    try {
+        // the bundle takes over the file contents rather than copying them again
+        constexpr bool copyContents = false;
+        KtxBundle* bundle = new KtxBundle(contents.get(), uint32_t(size), copyContents);
+        uint8_t* data = contents.release();
+        return std::shared_ptr<const KtxBundle>(bundle, [data](KtxBundle const* bundle) {
+            delete bundle;
+            delete[] data;
+        });
+    } catch (std::runtime_error& e) {
+        std::cerr << "Runtime error while loading KTX file " << path << ": " << e.what()
+                << std::endl;
+        return nullptr;
+    }
+}
+
+#endif
+
+} // namespace image
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <imageio/KtxTranscoder.h>
+
+#include <imageio/BlockCompression.h>
+
+#include <image/ColorTransform.h>
+#include <image/LinearImage.h>
+
+#include <utils/Panic.h>
+
+#include <zlib.h>
+
+#include <algorithm>
+
+using namespace utils;
+
+namespace image {
+
+namespace {
+
+bool isSRGB(const KtxInfo& info) {
+    return info.glInternalFormat == KtxBundle::SRGB8 ||
+            info.glInternalFormat == KtxBundle::SRGB8_ALPHA8;
+}
+
+bool isUncompressed(const KtxInfo& info) {
+    return info.glFormat != 0;
+}
+
+bool toCompressedFormat(const KtxInfo& info, KtxTranscoder::Target target,
+        CompressedFormat* format) {
+    const bool alpha = info.glFormat == KtxBundle::RGBA;
+    const bool srgb = isSRGB(info);
+    switch (target) {
+        case KtxTranscoder::Target::SOURCE:
+            return false;
+        case KtxTranscoder::Target::ETC2:
+            *format = alpha ?
+                    (srgb ? CompressedFormat::ETC2_EAC_SRGBA8 : CompressedFormat::ETC2_EAC_RGBA8) :
+                    (srgb ? CompressedFormat::ETC2_SRGB8 : CompressedFormat::ETC2_RGB8);
+            return true;
+        case KtxTranscoder::Target::S3TC:
+            *format = alpha ? CompressedFormat::DXT5_RGBA : CompressedFormat::DXT1_RGB;
+            return !srgb;
+    }
+    return false;
+}
+
+// The sRGB levels are decoded to linear values, compressTexture() encodes them back.
+LinearImage toLinearImage(uint8_t const* data, uint32_t width, uint32_t height,
+        uint32_t channels, bool srgb) {
+    static const struct Table {
+        float linear[256];
+        Table() {
+            for (int i = 0; i < 256; i++) {
+                linear[i] = sRGBToLinear(math::float3(i / 255.0f)).x;
+            }
+        }
+    } table;
+
+    LinearImage image(width, height, channels);
+    float* dst = image.getPixelRef();
+    const size_t count = size_t(width) * height * channels;
+    for (size_t i = 0; i < count; i++) {
+        const bool color = !srgb || channels < 4 || (i % 4) != 3;
+        dst[i] = srgb && color ? table.linear[data[i]] : data[i] / 255.0f;
+    }
+    return image;
+}
+
+} // anonymous namespace
+
+bool KtxTranscoder::canTranscode(const KtxBundle& ktx, Target target) {
+    const KtxInfo& info = ktx.getInfo();
+    if (ktx.getSupercompression() != KtxBundle::Supercompression::ZLIB ||
+            ktx.isCubemap() || ktx.getArrayLength() > 1 || info.pixelDepth > 1) {
+        return false;
+    }
+    CompressedFormat format;
+    if (target == Target::SOURCE || !isUncompressed(info)) {
+        return true;
+    }
+    return info.glType == KtxBundle::UNSIGNED_BYTE &&
+            (info.glFormat == KtxBundle::RGB || info.glFormat == KtxBundle::RGBA) &&
+            toCompressedFormat(info, target, &format);
+}
+
+uint32_t KtxTranscoder::getInternalFormat(const KtxInfo& info, Target target) {
+    CompressedFormat format;
+    if (!isUncompressed(info) || !toCompressedFormat(info, target, &format)) {
+        return info.glInternalFormat;
+    }
+    switch (format) {
+        case CompressedFormat::ETC2_RGB8: return KtxBundle::RGB8_ETC2;
+        case CompressedFormat::ETC2_SRGB8: return KtxBundle::SRGB8_ETC2;
+        case CompressedFormat::ETC2_EAC_RGBA8: return KtxBundle::RGBA8_ETC2_EAC;
+        case CompressedFormat::ETC2_EAC_SRGBA8: return KtxBundle::SRGB8_ALPHA8_ETC2_EAC;
+        case CompressedFormat::DXT1_RGB: return KtxBundle::RGB_S3TC_DXT1;
+        case CompressedFormat::DXT1_SRGB: return KtxBundle::SRGB_S3TC_DXT1;
+        case CompressedFormat::DXT5_RGBA: return KtxBundle::RGBA_S3TC_DXT5;
+        case CompressedFormat::DXT5_SRGBA: return KtxBundle::SRGB_ALPHA_S3TC_DXT5;
+    }
+    return info.glInternalFormat;
+}
+
+KtxTranscoder::KtxTranscoder(std::shared_ptr<const KtxBundle> ktx, Target target, JobSystem& js)
+        : mKtx(std::move(ktx)), mTarget(target),
+          mInternalFormat(getInternalFormat(mKtx->getInfo(), target)), mJobSystem(js),
+          mPendingCount(mKtx->getNumMipLevels()) {
+    ASSERT_PRECONDITION(canTranscode(*mKtx, target), "The KTX bundle cannot be transcoded.");
+
+    // the coarsest levels are the quickest to transcode and the first ones to be uploaded, so
+    // they are scheduled first
+    mParent = js.createJob();
+    for (uint32_t level = mKtx->getNumMipLevels(); level-- > 0;) {
+        js.run(jobs::createJob(js, mParent, &KtxTranscoder::transcode, this, level),
+                JobSystem::LOW_PRIORITY);
+    }
+}
+
+KtxTranscoder::~KtxTranscoder() {
+    wait();
+}
+
+void KtxTranscoder::wait() {
+    if (mParent) {
+        // the thread waiting on a low priority job helps with the remaining levels
+        mJobSystem.run(mParent, JobSystem::LOW_PRIORITY);
+        mJobSystem.wait(mParent);
+        mParent = nullptr;
+    }
+}
+
+void KtxTranscoder::transcode(uint32_t level) {
+    const KtxInfo& info = mKtx->getInfo();
+    uint8_t const* data;
+    uint32_t size;
+    uint32_t uncompressedSize;
+    mKtx->getSupercompressedLevel(level, &data, &size, &uncompressedSize);
+
+    std::unique_ptr<uint8_t[]> pixels(new uint8_t[uncompressedSize]);
+    uLongf inflatedSize = uncompressedSize;
+    const bool inflated = uncompress(pixels.get(), &inflatedSize, data, size) == Z_OK &&
+            inflatedSize == uncompressedSize;
+
+    Level result { level, mInternalFormat, std::move(pixels), uncompressedSize };
+    CompressedFormat format;
+    if (inflated && isUncompressed(info) && toCompressedFormat(info, mTarget, &format)) {
+        const uint32_t width = std::max(1u, info.pixelWidth >> level);
+        const uint32_t height = std::max(1u, info.pixelHeight >> level);
+        const uint32_t channels = info.glFormat == KtxBundle::RGBA ? 4 : 3;
+        if (uncompressedSize == width * height * channels) {
+            LinearImage image = toLinearImage(result.data.get(), width, height, channels,
+                    isSRGB(info));
+            CompressedTexture texture = compressTexture(image, format);
+            result.data = std::move(texture.data);
+            result.size = texture.size;
+        } else {
+            result.data.reset();
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(mLock);
+    mPendingCount--;
+    if (inflated && result.data) {
+        mLevels.push_back(std::move(result));
+    } else {
+        mFailed = true;
+    }
+}
+
+std::vector<KtxTranscoder::Level> KtxTranscoder::takeLevels() {
+    std::lock_guard<std::mutex> guard(mLock);
+    std::vector<Level> levels;
+    levels.swap(mLevels);
+    return levels;
+}
+
+bool KtxTranscoder::isDone() const {
+    std::lock_guard<std::mutex> guard(mLock);
+    return mPendingCount == 0;
+}
+
+bool KtxTranscoder::hasFailed() const {
+    std::lock_guard<std::mutex> guard(mLock);
+    return mFailed;
+}
+
+} // namespace image
@@ -17,10 +17,28 @@
 #ifndef TNT_MATH_HALF_H
 #define TNT_MATH_HALF_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include <limits>
 #include <type_traits>
 
+#if defined(__ARM_NEON)
+#   if defined(__aarch64__) || (defined(__ARM_FP) && (__ARM_FP & 2))
+#       define MATH_HALF_NEON 1
+#       include <arm_neon.h>
+#   endif
+#elif defined(__F16C__)
+#   define MATH_HALF_F16C 1
+#   include <immintrin.h>
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    // F16C isn't enabled for the whole build, it's used when the CPU has it
+#   define MATH_HALF_F16C 1
+#   define MATH_HALF_F16C_DISPATCH 1
+#   include <cpuid.h>
+#   include <immintrin.h>
+#endif
+
 #ifdef __cplusplus
 #   define LIKELY( exp )    (__builtin_expect( !!(exp), true ))
 #   define UNLIKELY( exp )  (__builtin_expect( !!(exp), false ))
@@ -150,6 +168,130 @@ constexpr float half::htof(half::fp16 in) noexcept {
 
 #endif // __ARM_NEON
 
+namespace details {
+
+// The same conversion as half(float), but rounding to nearest even as the GPUs and the
+// conversion instructions do.
+inline uint16_t floatToHalfBits(float f) noexcept {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    const uint32_t sign = (bits >> 16u) & 0x8000u;
+    uint32_t a = bits & 0x7FFFFFFFu;
+    if (UNLIKELY(a >= 0x7F800000u)) { // inf or nan, which stays quiet
+        return uint16_t(sign | 0x7C00u | (a > 0x7F800000u ? 0x200u | ((a >> 13u) & 0x3FFu) : 0u));
+    }
+    if (UNLIKELY(a >= 0x477FF000u)) { // rounds to inf
+        return uint16_t(sign | 0x7C00u);
+    }
+    if (UNLIKELY(a < 0x38800000u)) {
+        // denormal or zero: adding 0.5 aligns the mantissa to the steps of 2^-24 and lets the
+        // FPU do the rounding
+        float t;
+        memcpy(&t, &a, sizeof(t));
+        t += 0.5f;
+        memcpy(&a, &t, sizeof(a));
+        return uint16_t(sign | (a - 0x3F000000u));
+    }
+    // rebias the exponent and round, ties go to the even mantissa
+    a += 0xC8000FFFu + ((a >> 13u) & 1u);
+    return uint16_t(sign | (a >> 13u));
+}
+
+#if defined(MATH_HALF_F16C_DISPATCH)
+
+inline bool hasF16C() noexcept {
+    static const bool f16c = []() {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            return false;
+        }
+        // F16C is VEX encoded, the OS must also save the AVX registers
+        const unsigned int osxsave = 1u << 27u;
+        const unsigned int avx = 1u << 28u;
+        const unsigned int f16c = 1u << 29u;
+        if ((ecx & (osxsave | avx | f16c)) != (osxsave | avx | f16c)) {
+            return false;
+        }
+        unsigned int xcr0, xcr0hi;
+        __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0hi) : "c"(0));
+        return (xcr0 & 6u) == 6u;
+    }();
+    return f16c;
+}
+
+#   define MATH_HALF_F16C_TARGET __attribute__((target("f16c")))
+#elif defined(MATH_HALF_F16C)
+inline constexpr bool hasF16C() noexcept { return true; }
+#   define MATH_HALF_F16C_TARGET
+#endif
+
+#if defined(MATH_HALF_F16C)
+
+MATH_HALF_F16C_TARGET
+inline size_t floatToHalfF16C(float const* in, uint16_t* out, size_t count) noexcept {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), h);
+    }
+    return i;
+}
+
+MATH_HALF_F16C_TARGET
+inline size_t halfToFloatF16C(uint16_t const* in, float* out, size_t count) noexcept {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i h = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+    }
+    return i;
+}
+
+#   undef MATH_HALF_F16C_TARGET
+#endif
+
+} // namespace details
+
+/*
+ * Converts count floats to half-floats, rounding to nearest even. This uses F16C on x86 when the
+ * CPU has it, and the NEON conversions on ARM, which makes the conversion memory-bound.
+ */
+inline void floatToHalf(float const* in, half* out, size_t count) noexcept {
+    static_assert(sizeof(half) == sizeof(uint16_t), "half must be 16 bits");
+    size_t i = 0;
+#if defined(MATH_HALF_NEON)
+    for (; i + 4 <= count; i += 4) {
+        vst1_f16(reinterpret_cast<__fp16*>(out + i), vcvt_f16_f32(vld1q_f32(in + i)));
+    }
+#elif defined(MATH_HALF_F16C)
+    if (details::hasF16C()) {
+        i = details::floatToHalfF16C(in, reinterpret_cast<uint16_t*>(out), count);
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = makeHalf(details::floatToHalfBits(in[i]));
+    }
+}
+
+/*
+ * Converts count half-floats to floats, which is exact.
+ */
+inline void halfToFloat(half const* in, float* out, size_t count) noexcept {
+    size_t i = 0;
+#if defined(MATH_HALF_NEON)
+    for (; i + 4 <= count; i += 4) {
+        vst1q_f32(out + i, vcvt_f32_f16(vld1_f16(reinterpret_cast<__fp16 const*>(in + i))));
+    }
+#elif defined(MATH_HALF_F16C)
+    if (details::hasF16C()) {
+        i = details::halfToFloatF16C(reinterpret_cast<uint16_t const*>(in), out, count);
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = float(in[i]);
+    }
+}
+
 inline constexpr math::half operator"" _h(long double v) {
     return math::half(v);
 }
@@ -206,5 +348,8 @@ public:
 #undef LIKELY
 #undef UNLIKELY
 #undef MAKE_CONSTEXPR
+#undef MATH_HALF_NEON
+#undef MATH_HALF_F16C
+#undef MATH_HALF_F16C_DISPATCH
 
 #endif // TNT_MATH_HALF_H
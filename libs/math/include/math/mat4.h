@@ -19,6 +19,7 @@
 
 #include <math/mat3.h>
 #include <math/quat.h>
+#include <math/simd.h>
 #include <math/TMatHelpers.h>
 #include <math/vec3.h>
 #include <math/vec4.h>
@@ -571,6 +572,128 @@ constexpr typename TMat44<T>::col_type PURE diag(const TMat44<T>& m) {
     return matrix::diag(m);
 }
 
+// ----------------------------------------------------------------------------------------
+// SIMD specializations for float, see math/simd.h. The compilers often fail to vectorize the
+// generic loops above. These aren't constexpr.
+// ----------------------------------------------------------------------------------------
+
+#if MATH_SIMD
+
+// the columns c0..c3 by the lanes of v, i.e. a matrix * column-vector product
+inline simd::float4_t MATH_PURE transformSimd(simd::float4_t c0, simd::float4_t c1,
+        simd::float4_t c2, simd::float4_t c3, simd::float4_t v) noexcept {
+    simd::float4_t r = simd::mul(c0, simd::lane<0>(v));
+    r = simd::madd(c1, simd::lane<1>(v), r);
+    r = simd::madd(c2, simd::lane<2>(v), r);
+    r = simd::madd(c3, simd::lane<3>(v), r);
+    return r;
+}
+
+template <>
+inline TVec4<float> PURE operator *<float, float>(
+        const TMat44<float>& lhs, const TVec4<float>& rhs) {
+    TVec4<float> result;
+    simd::store(&result[0], transformSimd(
+            simd::load(&lhs[0][0]), simd::load(&lhs[1][0]),
+            simd::load(&lhs[2][0]), simd::load(&lhs[3][0]), simd::load(&rhs[0])));
+    return result;
+}
+
+namespace matrix {
+
+template<>
+inline TMat44<float> MATH_PURE multiply<TMat44<float>, TMat44<float>, TMat44<float>>(
+        const TMat44<float>& lhs, const TMat44<float>& rhs) {
+    const simd::float4_t c0 = simd::load(&lhs[0][0]);
+    const simd::float4_t c1 = simd::load(&lhs[1][0]);
+    const simd::float4_t c2 = simd::load(&lhs[2][0]);
+    const simd::float4_t c3 = simd::load(&lhs[3][0]);
+    TMat44<float> res(TMat44<float>::NO_INIT);
+    for (size_t col = 0; col < TMat44<float>::NUM_COLS; ++col) {
+        simd::store(&res[col][0], transformSimd(c0, c1, c2, c3, simd::load(&rhs[col][0])));
+    }
+    return res;
+}
+
+/*
+ * The inverse computed with 2x2 blocks: a matrix | A B | is inverted from the adjugates and
+ * determinants of A, B, C and D.    | C D |
+ * Each 2x2 block is held by a float4 as { m00, m01, m10, m11 }. The blocks are taken from the
+ * columns (i.e. we invert the transpose), which directly gives the columns of the inverse.
+ * Unlike gaussJordanInverse(), this doesn't pivot, the result is as accurate for the well
+ * conditioned matrices we use (transforms and projections).
+ */
+template<>
+inline TMat44<float> MATH_PURE inverse<TMat44<float>>(const TMat44<float>& m) {
+    using namespace simd;
+
+    // 2x2 products A * B, A# * B and A * B#, where # is the adjugate
+    auto mul2 = [](float4_t a, float4_t b) {
+        return add(mul(a, swizzle<0, 3, 0, 3>(b)),
+                   mul(swizzle<1, 0, 3, 2>(a), swizzle<2, 1, 2, 1>(b)));
+    };
+    auto adjMul2 = [](float4_t a, float4_t b) {
+        return sub(mul(swizzle<3, 3, 0, 0>(a), b),
+                   mul(swizzle<1, 1, 2, 2>(a), swizzle<2, 3, 0, 1>(b)));
+    };
+    auto mulAdj2 = [](float4_t a, float4_t b) {
+        return sub(mul(a, swizzle<3, 0, 3, 0>(b)),
+                   mul(swizzle<1, 0, 3, 2>(a), swizzle<2, 1, 2, 1>(b)));
+    };
+
+    const float4_t c0 = load(&m[0][0]);
+    const float4_t c1 = load(&m[1][0]);
+    const float4_t c2 = load(&m[2][0]);
+    const float4_t c3 = load(&m[3][0]);
+
+    const float4_t A = shuffle<0, 1, 0, 1>(c0, c1);
+    const float4_t B = shuffle<2, 3, 2, 3>(c0, c1);
+    const float4_t C = shuffle<0, 1, 0, 1>(c2, c3);
+    const float4_t D = shuffle<2, 3, 2, 3>(c2, c3);
+
+    // { |A|, |B|, |C|, |D| }
+    const float4_t dets = sub(
+            mul(shuffle<0, 2, 0, 2>(c0, c2), shuffle<1, 3, 1, 3>(c1, c3)),
+            mul(shuffle<1, 3, 1, 3>(c0, c2), shuffle<0, 2, 0, 2>(c1, c3)));
+    const float4_t detA = lane<0>(dets);
+    const float4_t detB = lane<1>(dets);
+    const float4_t detC = lane<2>(dets);
+    const float4_t detD = lane<3>(dets);
+
+    const float4_t DC = adjMul2(D, C);
+    const float4_t AB = adjMul2(A, B);
+
+    // the adjugates of the blocks of the inverse, scaled by the determinant
+    float4_t X = sub(mul(detD, A), mul2(B, DC));
+    float4_t W = sub(mul(detA, D), mul2(C, AB));
+    float4_t Y = sub(mul(detB, C), mulAdj2(D, AB));
+    float4_t Z = sub(mul(detC, B), mulAdj2(A, DC));
+
+    // |M| = |A| |D| + |B| |C| - tr((A# B) (D# C))
+    float4_t tr = mul(AB, swizzle<0, 2, 1, 3>(DC));
+    tr = add(tr, swizzle<1, 0, 3, 2>(tr));
+    tr = add(tr, swizzle<2, 3, 0, 1>(tr));
+    const float4_t det = sub(add(mul(detA, detD), mul(detB, detC)), tr);
+
+    const float4_t rcp = div(set(1.0f, -1.0f, -1.0f, 1.0f), det);
+    X = mul(X, rcp);
+    Y = mul(Y, rcp);
+    Z = mul(Z, rcp);
+    W = mul(W, rcp);
+
+    // the adjugates back to the blocks, and the blocks to the columns
+    TMat44<float> res(TMat44<float>::NO_INIT);
+    store(&res[0][0], shuffle<3, 1, 3, 1>(X, Y));
+    store(&res[1][0], shuffle<2, 0, 2, 0>(X, Y));
+    store(&res[2][0], shuffle<3, 1, 3, 1>(Z, W));
+    store(&res[3][0], shuffle<2, 0, 2, 0>(Z, W));
+    return res;
+}
+
+} // namespace matrix
+
+#endif // MATH_SIMD
+
 } // namespace details
 
 // ----------------------------------------------------------------------------------------
@@ -578,6 +701,91 @@ constexpr typename TMat44<T>::col_type PURE diag(const TMat44<T>& m) {
 typedef details::TMat44<double> mat4;
 typedef details::TMat44<float> mat4f;
 
+// ----------------------------------------------------------------------------------------
+// Batch transforms of arrays by the same matrix, these use SIMD when it's available.
+// 'in' and 'out' can be the same array.
+// ----------------------------------------------------------------------------------------
+
+// out[i] = m * in[i]
+inline void transform(mat4f const& m,
+        float4 const* in, float4* out, size_t count) noexcept {
+#if MATH_SIMD
+    const simd::float4_t c0 = simd::load(&m[0][0]);
+    const simd::float4_t c1 = simd::load(&m[1][0]);
+    const simd::float4_t c2 = simd::load(&m[2][0]);
+    const simd::float4_t c3 = simd::load(&m[3][0]);
+    for (size_t i = 0; i < count; i++) {
+        simd::store(&out[i][0], details::transformSimd(c0, c1, c2, c3, simd::load(&in[i][0])));
+    }
+#else
+    for (size_t i = 0; i < count; i++) {
+        out[i] = m * in[i];
+    }
+#endif
+}
+
+// out[i] = (m * float4{ in[i], 1 }).xyz, i.e. the points transformed by an affine transform
+inline void transformPoints(mat4f const& m,
+        float3 const* in, float3* out, size_t count) noexcept {
+#if MATH_SIMD
+    const simd::float4_t c0 = simd::load(&m[0][0]);
+    const simd::float4_t c1 = simd::load(&m[1][0]);
+    const simd::float4_t c2 = simd::load(&m[2][0]);
+    const simd::float4_t c3 = simd::load(&m[3][0]);
+    for (size_t i = 0; i < count; i++) {
+        simd::float4_t p = simd::madd(c0, simd::splat(in[i].x), c3);
+        p = simd::madd(c1, simd::splat(in[i].y), p);
+        p = simd::madd(c2, simd::splat(in[i].z), p);
+        // float3 isn't padded, don't write past it
+        float4 r;
+        simd::store(&r[0], p);
+        out[i] = r.xyz;
+    }
+#else
+    for (size_t i = 0; i < count; i++) {
+        out[i] = m[0].xyz * in[i].x + m[1].xyz * in[i].y + m[2].xyz * in[i].z + m[3].xyz;
+    }
+#endif
+}
+
+// The bounding boxes of boxes transformed by an affine transform, the boxes are given by their
+// centers and half extents. This is filament's rigidTransform(Box, mat4f) for arrays of boxes.
+inline void transformBoxes(mat4f const& m,
+        float3 const* centers, float3 const* halfExtents,
+        float3* outCenters, float3* outHalfExtents, size_t count) noexcept {
+#if MATH_SIMD
+    const simd::float4_t c0 = simd::load(&m[0][0]);
+    const simd::float4_t c1 = simd::load(&m[1][0]);
+    const simd::float4_t c2 = simd::load(&m[2][0]);
+    const simd::float4_t c3 = simd::load(&m[3][0]);
+    const simd::float4_t a0 = simd::abs(c0);
+    const simd::float4_t a1 = simd::abs(c1);
+    const simd::float4_t a2 = simd::abs(c2);
+    for (size_t i = 0; i < count; i++) {
+        simd::float4_t c = simd::madd(c0, simd::splat(centers[i].x), c3);
+        c = simd::madd(c1, simd::splat(centers[i].y), c);
+        c = simd::madd(c2, simd::splat(centers[i].z), c);
+        simd::float4_t e = simd::mul(a0, simd::splat(halfExtents[i].x));
+        e = simd::madd(a1, simd::splat(halfExtents[i].y), e);
+        e = simd::madd(a2, simd::splat(halfExtents[i].z), e);
+        float4 rc, re;
+        simd::store(&rc[0], c);
+        simd::store(&re[0], e);
+        outCenters[i] = rc.xyz;
+        outHalfExtents[i] = re.xyz;
+    }
+#else
+    const mat3f u(m.upperLeft());
+    const mat3f au(abs(u));
+    for (size_t i = 0; i < count; i++) {
+        const float3 c = centers[i];
+        const float3 e = halfExtents[i];
+        outCenters[i] = u * c + m[3].xyz;
+        outHalfExtents[i] = au * e;
+    }
+#endif
+}
+
 // ----------------------------------------------------------------------------------------
 }  // namespace math
 
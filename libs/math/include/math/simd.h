@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_MATH_SIMD_H
+#define TNT_MATH_SIMD_H
+
+/*
+ * A thin wrapper over the 4 x float SIMD registers of SSE and NEON, used by the float
+ * specializations of mat4. MATH_SIMD is 0 when neither is available, in which case nothing is
+ * declared and the generic code is used.
+ */
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#   define MATH_SIMD_SSE 1
+#   if defined(__FMA__)
+#       include <immintrin.h>
+#   else
+#       include <xmmintrin.h>
+#   endif
+#elif defined(__ARM_NEON)
+#   define MATH_SIMD_NEON 1
+#   include <arm_neon.h>
+#endif
+
+#if defined(MATH_SIMD_SSE) || defined(MATH_SIMD_NEON)
+#   define MATH_SIMD 1
+#else
+#   define MATH_SIMD 0
+#endif
+
+#if MATH_SIMD
+
+namespace math {
+namespace simd {
+
+#if defined(MATH_SIMD_SSE)
+
+using float4_t = __m128;
+
+inline float4_t load(float const* p) noexcept { return _mm_loadu_ps(p); }
+inline void store(float* p, float4_t v) noexcept { _mm_storeu_ps(p, v); }
+inline float4_t splat(float v) noexcept { return _mm_set1_ps(v); }
+inline float4_t set(float x, float y, float z, float w) noexcept { return _mm_setr_ps(x, y, z, w); }
+
+inline float4_t add(float4_t a, float4_t b) noexcept { return _mm_add_ps(a, b); }
+inline float4_t sub(float4_t a, float4_t b) noexcept { return _mm_sub_ps(a, b); }
+inline float4_t mul(float4_t a, float4_t b) noexcept { return _mm_mul_ps(a, b); }
+inline float4_t div(float4_t a, float4_t b) noexcept { return _mm_div_ps(a, b); }
+inline float4_t abs(float4_t v) noexcept { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+
+// a * b + c
+inline float4_t madd(float4_t a, float4_t b, float4_t c) noexcept {
+#if defined(__FMA__)
+    return _mm_fmadd_ps(a, b, c);
+#else
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+// { a[X], a[Y], b[Z], b[W] }
+template<int X, int Y, int Z, int W>
+inline float4_t shuffle(float4_t a, float4_t b) noexcept {
+    return _mm_shuffle_ps(a, b, _MM_SHUFFLE(W, Z, Y, X));
+}
+
+#elif defined(MATH_SIMD_NEON)
+
+using float4_t = float32x4_t;
+
+inline float4_t load(float const* p) noexcept { return vld1q_f32(p); }
+inline void store(float* p, float4_t v) noexcept { vst1q_f32(p, v); }
+inline float4_t splat(float v) noexcept { return vdupq_n_f32(v); }
+inline float4_t set(float x, float y, float z, float w) noexcept {
+    const float v[4] = { x, y, z, w };
+    return vld1q_f32(v);
+}
+
+inline float4_t add(float4_t a, float4_t b) noexcept { return vaddq_f32(a, b); }
+inline float4_t sub(float4_t a, float4_t b) noexcept { return vsubq_f32(a, b); }
+inline float4_t mul(float4_t a, float4_t b) noexcept { return vmulq_f32(a, b); }
+inline float4_t abs(float4_t v) noexcept { return vabsq_f32(v); }
+
+inline float4_t div(float4_t a, float4_t b) noexcept {
+#if defined(__aarch64__)
+    return vdivq_f32(a, b);
+#else
+    // ARMv7 has no division, refine the reciprocal estimate to full precision
+    float4_t r = vrecpeq_f32(b);
+    r = vmulq_f32(vrecpsq_f32(b, r), r);
+    r = vmulq_f32(vrecpsq_f32(b, r), r);
+    return vmulq_f32(a, r);
+#endif
+}
+
+// a * b + c
+inline float4_t madd(float4_t a, float4_t b, float4_t c) noexcept {
+#if defined(__aarch64__)
+    return vfmaq_f32(c, a, b);
+#else
+    return vmlaq_f32(c, a, b);
+#endif
+}
+
+// { a[X], a[Y], b[Z], b[W] }
+template<int X, int Y, int Z, int W>
+inline float4_t shuffle(float4_t a, float4_t b) noexcept {
+#if defined(__clang__)
+    return __builtin_shufflevector(a, b, X, Y, Z + 4, W + 4);
+#else
+    return __builtin_shuffle(a, b, (uint32x4_t){ X, Y, Z + 4, W + 4 });
+#endif
+}
+
+#endif
+
+// { v[X], v[Y], v[Z], v[W] }
+template<int X, int Y, int Z, int W>
+inline float4_t swizzle(float4_t v) noexcept {
+    return shuffle<X, Y, Z, W>(v, v);
+}
+
+// v[I] in all the lanes
+template<int I>
+inline float4_t lane(float4_t v) noexcept {
+    return shuffle<I, I, I, I>(v, v);
+}
+
+} // namespace simd
+} // namespace math
+
+#endif // MATH_SIMD
+
+#endif // TNT_MATH_SIMD_H
@@ -16,6 +16,9 @@
 
 #include <math.h>
 
+#include <cmath>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include <math/half.h>
@@ -90,3 +93,59 @@ TEST_F(HalfTest, Vec) {
     EXPECT_EQ(f4.xyz, h3);
     EXPECT_EQ(f4.xy, h2);
 }
+
+TEST_F(HalfTest, Bulk) {
+    // a few values of each kind, and enough of them to use the vector loops and their tails
+    std::vector<float> floats = {
+            0.0f, -0.0f, 1.0f, -2.0f, 1.0f / 3, 65504.0f, 65519.0f, 65520.0f, 1e10f,
+            6.10352e-5f, 6.09756e-5f, 5.96046e-8f, 2.98023e-8f, 2.98024e-8f, 1e-10f,
+            1.00048828125f,     // halfway between two halfs, rounds to the even one
+            1.00146484375f,     // halfway too, rounds up this time
+            std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+            NAN };
+    for (int i = -2048; i <= 2048; i += 7) {
+        floats.push_back(i * 1.2345f);
+    }
+
+    std::vector<half> halfs(floats.size());
+    floatToHalf(floats.data(), halfs.data(), floats.size());
+
+    EXPECT_EQ(0x0000, getBits(halfs[0]));
+    EXPECT_EQ(0x8000, getBits(halfs[1]));
+    EXPECT_EQ(0x3C00, getBits(halfs[2]));
+    EXPECT_EQ(0xC000, getBits(halfs[3]));
+    EXPECT_EQ(0x3555, getBits(halfs[4]));
+    EXPECT_EQ(0x7BFF, getBits(halfs[5]));
+    EXPECT_EQ(0x7BFF, getBits(halfs[6]));
+    EXPECT_EQ(0x7C00, getBits(halfs[7]));
+    EXPECT_EQ(0x7C00, getBits(halfs[8]));
+    EXPECT_EQ(0x0400, getBits(halfs[9]));
+    EXPECT_EQ(0x03FF, getBits(halfs[10]));
+    EXPECT_EQ(0x0001, getBits(halfs[11]));
+    EXPECT_EQ(0x0000, getBits(halfs[12]));
+    EXPECT_EQ(0x0001, getBits(halfs[13]));
+    EXPECT_EQ(0x0000, getBits(halfs[14]));
+    EXPECT_EQ(0x3C00, getBits(halfs[15]));
+    EXPECT_EQ(0x3C02, getBits(halfs[16]));
+    EXPECT_EQ(0x7C00, getBits(halfs[17]));
+    EXPECT_EQ(0xFC00, getBits(halfs[18]));
+    EXPECT_EQ(0x7E00, getBits(halfs[19]));
+
+    // the vector loops and the scalar tail must agree, whatever the count
+    for (size_t count = 0; count < 20; count++) {
+        std::vector<half> h(count);
+        floatToHalf(floats.data() + 20, h.data(), count);
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(getBits(halfs[20 + i]), getBits(h[i]));
+        }
+    }
+
+    // half to float is exact
+    std::vector<float> back(halfs.size());
+    halfToFloat(halfs.data(), back.data(), halfs.size());
+    for (size_t i = 20; i < floats.size(); i++) {
+        EXPECT_EQ(float(halfs[i]), back[i]);
+        EXPECT_NEAR(floats[i], back[i], std::abs(floats[i]) / 1024.0f);
+    }
+    EXPECT_TRUE(std::isnan(back[19]));
+}
@@ -685,4 +685,93 @@ TYPED_TEST(MatTestT, ToQuaternionPointTransformation44) {
     }
 }
 
+//------------------------------------------------------------------------------
+// The float matrices have SIMD specializations, check them against the double ones.
+
+static mat4f randomTransform(std::function<double()>& rand_gen) {
+    return mat4f::translate(float4{ rand_gen(), rand_gen(), rand_gen(), 1 }) *
+           mat4f::rotate(rand_gen(), normalize(float3{ rand_gen(), rand_gen(), rand_gen() })) *
+           mat4f::scale(float4{ 0.5 + std::abs(rand_gen()), 0.5 + std::abs(rand_gen()),
+                                0.5 + std::abs(rand_gen()), 1 });
+}
+
+TEST_F(MatTest, SimdFloat) {
+    std::default_random_engine generator(171717);
+    std::uniform_real_distribution<double> distribution(-10.0, 10.0);
+    std::function<double()> rand_gen = std::bind(distribution, generator);
+
+    for (size_t i = 0; i < 100; ++i) {
+        const mat4f a = randomTransform(rand_gen);
+        const mat4f b = randomTransform(rand_gen) *
+                mat4f::perspective(45, 1.5f, 0.1f, 100.0f);
+        const float4 v{ rand_gen(), rand_gen(), rand_gen(), rand_gen() };
+
+        const mat4 ab = mat4(a) * mat4(b);
+        const mat4f r = a * b;
+        const double4 av = mat4(a) * double4(v);
+        const float4 rv = a * v;
+        for (size_t col = 0; col < 4; ++col) {
+            for (size_t row = 0; row < 4; ++row) {
+                EXPECT_NEAR(r[col][row], ab[col][row], std::abs(ab[col][row]) * 1e-5 + 1e-4);
+            }
+            EXPECT_NEAR(rv[col], av[col], std::abs(av[col]) * 1e-5 + 1e-4);
+        }
+
+        const mat4 ia = inverse(mat4(a));
+        const mat4f ra = inverse(a);
+        for (size_t col = 0; col < 4; ++col) {
+            for (size_t row = 0; row < 4; ++row) {
+                EXPECT_NEAR(ra[col][row], ia[col][row], std::abs(ia[col][row]) * 1e-4 + 1e-5);
+            }
+        }
+    }
+}
+
+TEST_F(MatTest, TransformBatches) {
+    std::default_random_engine generator(272727);
+    std::uniform_real_distribution<double> distribution(-10.0, 10.0);
+    std::function<double()> rand_gen = std::bind(distribution, generator);
+
+    const mat4f m = randomTransform(rand_gen);
+    const mat3f u = m.upperLeft();
+    constexpr size_t COUNT = 33;
+    float4 vectors[COUNT];
+    float3 points[COUNT];
+    float3 extents[COUNT];
+    for (size_t i = 0; i < COUNT; ++i) {
+        vectors[i] = { rand_gen(), rand_gen(), rand_gen(), rand_gen() };
+        points[i] = { rand_gen(), rand_gen(), rand_gen() };
+        extents[i] = abs(float3{ rand_gen(), rand_gen(), rand_gen() });
+    }
+
+    float4 outVectors[COUNT];
+    float3 outPoints[COUNT];
+    float3 outCenters[COUNT];
+    float3 outExtents[COUNT];
+    transform(m, vectors, outVectors, COUNT);
+    transformPoints(m, points, outPoints, COUNT);
+    transformBoxes(m, points, extents, outCenters, outExtents, COUNT);
+
+    for (size_t i = 0; i < COUNT; ++i) {
+        const double4 v = mat4(m) * double4(vectors[i]);
+        const float3 p = u * points[i] + m[3].xyz;
+        const float3 e = abs(u) * extents[i];
+        for (size_t j = 0; j < 3; ++j) {
+            EXPECT_NEAR(outVectors[i][j], v[j], 1e-4);
+            EXPECT_NEAR(outPoints[i][j], p[j], 1e-4);
+            EXPECT_NEAR(outCenters[i][j], p[j], 1e-4);
+            EXPECT_NEAR(outExtents[i][j], e[j], 1e-4);
+        }
+        EXPECT_NEAR(outVectors[i][3], v[3], 1e-4);
+    }
+
+    // in place
+    transformPoints(m, points, points, COUNT);
+    for (size_t i = 0; i < COUNT; ++i) {
+        for (size_t j = 0; j < 3; ++j) {
+            EXPECT_NEAR(points[i][j], outPoints[i][j], 1e-6);
+        }
+    }
+}
+
 #undef TEST_MATRIX_INVERSE
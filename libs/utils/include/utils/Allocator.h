@@ -22,8 +22,10 @@
 #include <stddef.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <atomic>
 #include <mutex>
+#include <type_traits>
 
 #include <utils/compiler.h>
 #include <utils/memalign.h>
@@ -130,6 +132,121 @@ private:
     void* mCurrent = nullptr;
 };
 
+/* ------------------------------------------------------------------------------------------------
+ * AtomicChunkAllocator
+ *
+ * + hands out chunks of its area to any thread, lock-free, by bumping an atomic chunk index
+ * + allocations larger than a chunk use as many contiguous chunks as needed
+ * + doesn't free anything, everything is freed at once with reset()
+ * + meant to feed a ScratchAllocator per job or thread (see below)
+ * ------------------------------------------------------------------------------------------------
+ */
+class AtomicChunkAllocator {
+public:
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 16 * 1024;
+
+    // use memory area provided, chunkSize must be a power of two
+    AtomicChunkAllocator(void* begin, void* end, size_t chunkSize = DEFAULT_CHUNK_SIZE) noexcept;
+
+    template <typename AREA>
+    explicit AtomicChunkAllocator(const AREA& area, size_t chunkSize = DEFAULT_CHUNK_SIZE)
+            : AtomicChunkAllocator(area.begin(), area.end(), chunkSize) { }
+
+    // Allocators can't be copied or moved
+    AtomicChunkAllocator(const AtomicChunkAllocator& rhs) = delete;
+    AtomicChunkAllocator& operator=(const AtomicChunkAllocator& rhs) = delete;
+
+    ~AtomicChunkAllocator() noexcept = default;
+
+    // our allocator concept, alignment must not exceed the chunk size
+    void* alloc(size_t size, size_t alignment = alignof(std::max_align_t), size_t extra = 0) noexcept {
+        assert(alignment <= mChunkSize);
+        // chunks are aligned to the chunk size, so only 'extra' can push the data further
+        const size_t padding = extra ? ((extra + alignment - 1) & ~(alignment - 1)) : 0;
+        const size_t count = (padding + size + mChunkSize - 1) >> mChunkShift;
+        const size_t index = mChunkIndex.fetch_add(count, std::memory_order_relaxed);
+        if (UTILS_UNLIKELY(index + count > mChunkCount)) {
+            // the index stays past the end, so all later allocations fail too
+            return nullptr;
+        }
+        return pointermath::add(mBegin, (index << mChunkShift) + padding);
+    }
+
+    // API specific to this allocator
+
+    size_t getChunkSize() const noexcept { return mChunkSize; }
+
+    size_t allocated() const noexcept {
+        return std::min(mChunkIndex.load(std::memory_order_relaxed), mChunkCount) << mChunkShift;
+    }
+
+    // frees all chunks, no other thread must be allocating
+    void reset() noexcept {
+        mChunkIndex.store(0, std::memory_order_relaxed);
+    }
+
+    // AtomicChunkAllocator shouldn't have a free() method
+    // it's only needed to be compatible with STLAllocator<> below
+    void free(void*) noexcept { }
+
+private:
+    void* mBegin = nullptr;
+    size_t mChunkSize = 0;
+    size_t mChunkShift = 0;
+    size_t mChunkCount = 0;
+    std::atomic<size_t> mChunkIndex = { 0 };
+};
+
+/* ------------------------------------------------------------------------------------------------
+ * ScratchAllocator
+ *
+ * + a linear allocator that refills itself with chunks of an AtomicChunkAllocator
+ * + allocations larger than half a chunk are forwarded to the AtomicChunkAllocator
+ * + must be used by a single thread at a time, but any number of them can share the same
+ *   AtomicChunkAllocator
+ * + the memory stays valid until the AtomicChunkAllocator is reset
+ * ------------------------------------------------------------------------------------------------
+ */
+class ScratchAllocator {
+public:
+    explicit ScratchAllocator(AtomicChunkAllocator& chunks) noexcept : mChunks(chunks) { }
+
+    // Allocators can't be copied
+    ScratchAllocator(const ScratchAllocator& rhs) = delete;
+    ScratchAllocator& operator=(const ScratchAllocator& rhs) = delete;
+
+    ~ScratchAllocator() noexcept = default;
+
+    // our allocator concept
+    void* alloc(size_t size, size_t alignment = alignof(std::max_align_t), size_t extra = 0) noexcept {
+        void* const p = pointermath::align(mCurrent, alignment, extra);
+        void* const c = pointermath::add(p, size);
+        if (UTILS_LIKELY(mCurrent && c <= mEnd)) {
+            mCurrent = c;
+            return p;
+        }
+        return refill(size, alignment, extra);
+    }
+
+    // Allocate an array of trivially destructible objects
+    template <typename T,
+            typename = typename std::enable_if<std::is_trivially_destructible<T>::value>::type>
+    T* alloc(size_t count, size_t alignment = alignof(T), size_t extra = 0) noexcept {
+        return (T*)alloc(count * sizeof(T), alignment, extra);
+    }
+
+    // ScratchAllocator shouldn't have a free() method
+    // it's only needed to be compatible with STLAllocator<> below
+    void free(void*) noexcept { }
+
+private:
+    void* refill(size_t size, size_t alignment, size_t extra) noexcept;
+
+    AtomicChunkAllocator& mChunks;
+    void* mCurrent = nullptr;
+    void* mEnd = nullptr;
+};
+
 /* ------------------------------------------------------------------------------------------------
  * HeapAllocator
  *
@@ -249,7 +366,7 @@ public:
     }
 
 private:
-    std::atomic<Node*> mHead;
+    std::atomic<Node*> mHead = { nullptr };
 };
 
 // ------------------------------------------------------------------------------------------------
@@ -422,29 +539,55 @@ struct Untracked {
     void onRewind(void* addr) noexcept { }
 };
 
-// This high watermark tracker works only with allocator that either implement
-// free(void*, size_t), or reset() / rewind()
+// This tracker records the peak usage of an arena, its number of allocations and of failed
+// allocations. It only costs a few additions per allocation, so it can be used in release builds.
+// It works only with allocator that either implement free(void*, size_t), or reset() / rewind()
 
-struct HighWatermark {
-    HighWatermark() noexcept = default;
-    HighWatermark(const char* name, size_t size) noexcept
-            : mName(name), mSize(uint32_t(size)) { }
-    ~HighWatermark() noexcept;
+struct Statistics {
+    Statistics() noexcept = default;
+    Statistics(const char* name, size_t size) noexcept : mSize(uint32_t(size)) { }
     void onAlloc(void* p, size_t size, size_t alignment, size_t extra) noexcept {
+        if (UTILS_UNLIKELY(!p)) {
+            mOverflowCount++;
+            return;
+        }
         if (!mBase) { mBase = p; }
+        mAllocationCount++;
         mCurrent += uint32_t(size);
         mHighWaterMark = mCurrent > mHighWaterMark ? mCurrent : mHighWaterMark;
     }
-    void onFree(void* p, size_t size) noexcept { mCurrent -= uint32_t(size); }
+    void onFree(void* p, size_t size = 0) noexcept { mCurrent -= uint32_t(size); }
     void onReset() noexcept {  mCurrent = 0; }
-    void onRewind(void const* addr) noexcept { mCurrent = uint32_t(uintptr_t(addr) - uintptr_t(mBase)); }
+    void onRewind(void const* addr) noexcept {
+        // the first allocation may have been aligned past the rewind point
+        mCurrent = addr > mBase ? uint32_t(uintptr_t(addr) - uintptr_t(mBase)) : 0;
+    }
+
+    size_t getSize() const noexcept { return mSize; }
+    size_t getCurrent() const noexcept { return mCurrent; }
+    size_t getHighWatermark() const noexcept { return mHighWaterMark; }
+    uint32_t getAllocationCount() const noexcept { return mAllocationCount; }
+    uint32_t getOverflowCount() const noexcept { return mOverflowCount; }
 
 private:
-    const char* mName = nullptr;
     void* mBase = nullptr;
     uint32_t mSize = 0;
     uint32_t mCurrent = 0;
     uint32_t mHighWaterMark = 0;
+    uint32_t mAllocationCount = 0;
+    uint32_t mOverflowCount = 0;
+};
+
+// Same as Statistics, the high watermark is also logged when the arena is destroyed
+
+struct HighWatermark : public Statistics {
+    HighWatermark() noexcept = default;
+    HighWatermark(const char* name, size_t size) noexcept
+            : Statistics(name, size), mName(name) { }
+    ~HighWatermark() noexcept;
+
+private:
+    const char* mName = nullptr;
 };
 
 } // namespace TrackingPolicy
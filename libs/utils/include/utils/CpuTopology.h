@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef UTILS_CPUTOPOLOGY_H
+#define UTILS_CPUTOPOLOGY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/compiler.h>
+
+namespace utils {
+
+/**
+ * CpuTopology groups the CPUs of the system in clusters of identical maximum frequency, which
+ * is how big.LITTLE (and similar) designs show up on Linux and Android.
+ *
+ * The topology is read from sysfs (cpu<N>/cpufreq/cpuinfo_max_freq). When it's not available
+ * (e.g. other platforms, or frequencies not exposed), all CPUs are put in a single cluster.
+ *
+ * @see JobSystem::setThreadAffinity()
+ */
+class CpuTopology {
+public:
+    // masks are 32 bits, like JobSystem::setThreadAffinity()
+    static constexpr size_t MAX_CPU_COUNT = 32;
+
+    struct Cluster {
+        uint32_t mask;          // CPUs in this cluster
+        uint32_t maxFrequency;  // in kHz, 0 if unknown
+    };
+
+    /**
+     * Probes the topology of the system.
+     */
+    CpuTopology() noexcept;
+
+    /**
+     * Probes the topology from a sysfs-like directory, for 'cpuCount' CPUs.
+     * @param sysfsPath directory containing the cpu<N> directories
+     * @param cpuCount number of CPUs to probe, at most MAX_CPU_COUNT
+     */
+    CpuTopology(const char* sysfsPath, size_t cpuCount) noexcept;
+
+    /**
+     * Returns the topology of the system, probed on first use.
+     */
+    static CpuTopology const& get() noexcept;
+
+    size_t getCpuCount() const noexcept { return mCpuCount; }
+
+    size_t getClusterCount() const noexcept { return mClusterCount; }
+
+    /**
+     * Returns a cluster, they're sorted from the fastest to the slowest.
+     */
+    Cluster const& getCluster(size_t index) const noexcept { return mClusters[index]; }
+
+    /**
+     * Returns whether the CPUs have different maximum frequencies.
+     */
+    bool isHeterogeneous() const noexcept { return mClusterCount > 1; }
+
+    // mask of the fastest CPUs
+    uint32_t getBigCoresMask() const noexcept { return mClusters[0].mask; }
+
+    // mask of the slowest CPUs, same as getBigCoresMask() if the CPUs are all the same
+    uint32_t getLittleCoresMask() const noexcept { return mClusters[mClusterCount - 1].mask; }
+
+    // mask of all the CPUs
+    uint32_t getAllCoresMask() const noexcept {
+        return mCpuCount >= 32 ? 0xFFFFFFFFu : (1u << mCpuCount) - 1u;
+    }
+
+private:
+    void probe(const char* sysfsPath, size_t cpuCount) noexcept;
+
+    Cluster mClusters[MAX_CPU_COUNT] = {};
+    size_t mClusterCount = 0;
+    size_t mCpuCount = 0;
+};
+
+} // namespace utils
+
+#endif // UTILS_CPUTOPOLOGY_H
@@ -47,7 +47,7 @@ public:
         return RAW_INDEX_COUNT - 1;
     }
 
-    // create n entities. Thread safe.
+    // create n entities. Thread safe, and lock-free as long as few entities have been destroyed.
     void create(size_t n, Entity* entities);
 
     // destroys n entities. Thread safe.
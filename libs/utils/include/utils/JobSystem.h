@@ -21,7 +21,9 @@
 
 #include <atomic>
 #include <functional>
+#include <new>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
 #include <utils/Allocator.h>
@@ -45,9 +47,16 @@
 namespace utils {
 
 class JobSystem {
-    static constexpr size_t MAX_JOB_COUNT = 4096;
-    static_assert(MAX_JOB_COUNT <= 0x7FFE, "MAX_JOB_COUNT must be <= 0x7FFE");
-    using WorkQueue = WorkStealingDequeue<uint16_t, MAX_JOB_COUNT>;
+    // Jobs are allocated by blocks, which are added as the number of jobs in flight grows.
+    static constexpr size_t JOB_BLOCK_SIZE = 4096;
+    static constexpr size_t MAX_JOB_BLOCKS = 15;
+    static constexpr size_t MAX_JOB_COUNT = JOB_BLOCK_SIZE * MAX_JOB_BLOCKS;
+    static_assert(MAX_JOB_COUNT <= 0xFFFE, "MAX_JOB_COUNT must be <= 0xFFFE");
+    static constexpr uint16_t NO_PARENT = 0xFFFF;
+
+    // A job that doesn't fit in its thread's queue is executed right away, see run()
+    static constexpr size_t WORK_QUEUE_SIZE = 16384;
+    using WorkQueue = WorkStealingDequeue<uint16_t, WORK_QUEUE_SIZE>;
 
 public:
     class Job;
@@ -67,7 +76,9 @@ public:
         JobFunc function;
         uint16_t parent;
         std::atomic<uint16_t> runningJobCount = { 0 };
-        // on 64-bits systems, there is an extra 32-bits lost here
+        uint8_t priority;
+        uint16_t index;     // position in the job pool, never changes
+        // on 64-bits systems, there is an extra 8-bits lost here
         void* padding[JOB_PADDING];
     };
 
@@ -76,7 +87,14 @@ public:
             (CACHELINE_SIZE % sizeof(Job) == 0),
             "A Job must be N cache-lines long or N Jobs must fit in a cache line exactly.");
 
-    explicit JobSystem(size_t threadCount = 0, size_t adoptableThreadsCount = 1) noexcept;
+    /**
+     * @param threadCount number of worker threads, 0 for a system dependant default
+     * @param adoptableThreadsCount number of threads that can be adopted
+     * @param affinityMask CPUs the worker threads are allowed to run on, 0 for any
+     *                     (see setThreadAffinity())
+     */
+    explicit JobSystem(size_t threadCount = 0, size_t adoptableThreadsCount = 1,
+            uint32_t affinityMask = 0) noexcept;
 
     ~JobSystem();
 
@@ -220,10 +238,18 @@ public:
 
     // Add job to this thread's execution queue.
     // Current thread must be owned by JobSystem's thread pool. See adopt().
-    enum runFlags { DONT_SIGNAL = 0x1 };
+    //
+    // Jobs have the priority of their parent, unless they're run with LOW_PRIORITY. Threads
+    // always pick high priority jobs before low priority ones, which is meant for background
+    // work (e.g. decoding textures) that must not delay the frame's jobs. A low priority job
+    // still occupies its thread until it returns, so long tasks should be split.
+    enum runFlags { DONT_SIGNAL = 0x1, LOW_PRIORITY = 0x2 };
     void run(Job* job, uint32_t flags = 0) noexcept;
 
     // Wait on a job.
+    // While waiting, the current thread executes other jobs. A thread waiting on a high priority
+    // job doesn't start low priority jobs, which means a high priority job must not wait on low
+    // priority jobs.
     // Current thread must be owned by JobSystem's thread pool. See adopt().
     void wait(Job const* job) noexcept;
 
@@ -258,6 +284,20 @@ public:
         return mParallelSplitCount;
     }
 
+    // Returns how many times a job couldn't be created because the job pool was full, or had to
+    // be executed when it was run because the thread's queue was full. This should stay at 0.
+    uint32_t getJobOverflowCount() const noexcept {
+        return mJobOverflowCount.load(std::memory_order_relaxed);
+    }
+
+    // Sets how long an idle worker thread spins, waiting for new jobs, before going to sleep.
+    // This saves the latency of waking threads up between bursts of small jobs, at the cost of
+    // some CPU time. The time actually spent spinning shrinks when it doesn't pay off.
+    // 0 disables spinning, which is the default when there are more threads than CPUs.
+    void setIdleSpinTime(uint32_t microseconds) noexcept {
+        mIdleSpinTime.store(microseconds, std::memory_order_relaxed);
+    }
+
 private:
     // this is just to avoid using std::default_random_engine, since we're in a public header.
     class default_random_engine {
@@ -272,9 +312,12 @@ private:
         }
     };
 
+    // One work queue per priority, highest priority first
+    enum : uint8_t { PRIORITY_HIGH, PRIORITY_LOW, PRIORITY_COUNT };
+
     struct alignas(CACHELINE_SIZE) ThreadState {    // this causes 40-bytes padding
         // make sure storage is cache-line aligned
-        WorkQueue workQueue;
+        WorkQueue workQueues[PRIORITY_COUNT];
 
         // these are not accessed by the worker threads
         alignas(CACHELINE_SIZE)     // this causes 56-bytes padding
@@ -282,6 +325,7 @@ private:
         std::thread thread;
         default_random_engine rndGen;
         uint32_t mask;
+        uint32_t spinTime;  // in microseconds, adapted in spin()
     };
 
     static_assert(sizeof(ThreadState) % CACHELINE_SIZE == 0,
@@ -291,6 +335,7 @@ private:
 
     Job* create(Job* parent, JobFunc func) noexcept;
     Job* allocateJob() noexcept;
+    bool growJobPool() noexcept;
     JobSystem::ThreadState& getStateToStealFrom(JobSystem::ThreadState& state) noexcept;
     bool hasJobCompleted(Job const* job) noexcept;
 
@@ -298,31 +343,39 @@ private:
     bool exitRequested() const noexcept;
 
     void loop(ThreadState* threadState) noexcept;
-    bool execute(JobSystem::ThreadState& state) noexcept;
+    bool spin(ThreadState& state) noexcept;
+    bool execute(JobSystem::ThreadState& state, uint8_t lowestPriority) noexcept;
+
+    Job* getJob(size_t index) const noexcept {
+        assert(index < MAX_JOB_COUNT);
+        Job* const block = mJobBlocks[index / JOB_BLOCK_SIZE].load(std::memory_order_acquire);
+        assert(block);
+        return block + index % JOB_BLOCK_SIZE;
+    }
 
     void put(WorkQueue& workQueue, Job* job) noexcept {
-        size_t index = job - mJobStorageBase;
-        assert(index >= 0 && index < MAX_JOB_COUNT);
-        workQueue.push(uint16_t(index + 1));
+        assert(job->index < MAX_JOB_COUNT);
+        workQueue.push(uint16_t(job->index + 1));
     }
 
     Job* pop(WorkQueue& workQueue) noexcept {
         size_t index = workQueue.pop();
         assert(index <= MAX_JOB_COUNT);
-        return !index ? nullptr : (mJobStorageBase - 1) + index;
+        return !index ? nullptr : getJob(index - 1);
     }
 
     Job* steal(WorkQueue& workQueue) noexcept {
         size_t index = workQueue.steal();
         assert(index <= MAX_JOB_COUNT);
-        return !index ? nullptr : (mJobStorageBase - 1) + index;
+        return !index ? nullptr : getJob(index - 1);
     }
 
     // these have thread contention, keep them together
     utils::Mutex mLock;
     utils::Condition mCondition;
     std::atomic<uint32_t> mActiveJobs = { 0 };
-    utils::Arena<utils::ThreadSafeObjectPoolAllocator<Job>, LockingPolicy::NoLock> mJobPool;
+    std::atomic<uint32_t> mSpinningThreads = { 0 };
+    utils::AtomicFreeList mFreeJobs;
 
     template <typename T>
     using aligned_vector = std::vector<T, utils::STLAlignedAllocator<T>>;
@@ -337,9 +390,14 @@ private:
     aligned_vector<ThreadState> mThreadStates;          // actual data is stored offline
     std::atomic<bool> mExitRequested = { 0 };           // this one is almost never written
     std::atomic<uint16_t> mAdoptedThreads = { 0 };      // this one is almost never written
-    Job* const mJobStorageBase;                         // Base for conversion to indices
+    std::atomic<Job*> mJobBlocks[MAX_JOB_BLOCKS] = {};  // job pool, indices are contiguous
+    std::atomic<uint32_t> mJobBlockCount = { 0 };       // only written with mJobPoolLock held
+    std::atomic<uint32_t> mJobOverflowCount = { 0 };    // see getJobOverflowCount()
+    utils::Mutex mJobPoolLock;
     uint16_t mThreadCount = 0;                          // total # of threads in the pool
     uint8_t mParallelSplitCount = 0;                    // # of split allowable in parallel_for
+    uint32_t mAffinityMask = 0;                         // CPUs of the worker threads, 0 for any
+    std::atomic<uint32_t> mIdleSpinTime = { 30 };       // max spin before sleeping, in us
     Job* mMasterJob = nullptr;
 
     static UTILS_DECLARE_TLS(ThreadState *) sThreadState;
@@ -413,7 +471,7 @@ struct ParallelForJobData {
         }
 
         if (splitter.split(splits, count)) {
-            const size_type lc = count / 2;
+            const size_type lc = splitter.left(start, count);
             JobData ld(start, lc, splits + uint8_t(1), functor, splitter);
             JobSystem::Job* l = js.createJob<JobData, &JobData::parallelWithJobs>(parent, std::move(ld));
 
@@ -450,7 +508,7 @@ struct ParallelForJobData {
         // here we split the data ona single thread, and launch jobs once we're completely
         // done splitting
         if (splitter.split(splits, count)) {
-            auto lc = count / 2;
+            auto lc = splitter.left(start, count);
             auto rc = count - lc;
             auto rd = start + lc;
             auto s  = ++splits;
@@ -488,6 +546,20 @@ struct ParallelForJobData {
     SplitterType splitter;      // 1
 };
 
+// records where the splitter cuts [start, start + count), up to maxSplits times
+template<typename S>
+void splitRange(uint32_t start, uint32_t count, uint8_t splits, uint8_t maxSplits,
+        const S& splitter, uint32_t* bounds, size_t& chunkCount) noexcept {
+    if (splits < maxSplits && splitter.split(splits, count)) {
+        const uint32_t lc = splitter.left(start, count);
+        splitRange(start, lc, uint8_t(splits + 1), maxSplits, splitter, bounds, chunkCount);
+        splitRange(start + lc, count - lc, uint8_t(splits + 1), maxSplits, splitter,
+                bounds, chunkCount);
+    } else {
+        bounds[chunkCount++] = start;
+    }
+}
+
 } // namespace details
 
 
@@ -565,8 +637,80 @@ public:
     bool split(size_t splits, size_t count) const noexcept {
         return (splits < MAX_SPLITS && count >= COUNT * 2);
     }
+
+    // size of the first half of a split of [start, start + count)
+    uint32_t left(uint32_t, uint32_t count) const noexcept {
+        return count / 2;
+    }
 };
 
+// Splits like CountSplitter, but only at indices multiple of ALIGNMENT, a power of two. This is
+// useful when chunks are processed by groups of elements, e.g. Culler::MODULO, or to keep jobs
+// writing into a StructureOfArrays from sharing cache lines (see getCacheLineElementCount()).
+template <size_t COUNT, size_t ALIGNMENT, size_t MAX_SPLITS = 12>
+class AlignedSplitter {
+    static_assert(ALIGNMENT && !(ALIGNMENT & (ALIGNMENT - 1)), "ALIGNMENT must be a power of two");
+    static constexpr size_t MIN_COUNT = COUNT > ALIGNMENT ? COUNT : ALIGNMENT;
+public:
+    bool split(size_t splits, size_t count) const noexcept {
+        return (splits < MAX_SPLITS && count >= MIN_COUNT * 2);
+    }
+
+    // the multiple of ALIGNMENT closest to the middle, which is always inside the range
+    uint32_t left(uint32_t start, uint32_t count) const noexcept {
+        const uint32_t middle = (start + count / 2 + uint32_t(ALIGNMENT / 2)) &
+                ~uint32_t(ALIGNMENT - 1);
+        return middle - start;
+    }
+};
+
+// Calls functor(start, count, T& partial) on chunks of [start, start + count) split according to
+// the splitter, with each partial result initialized to identity, and returns the partial results
+// combined in order with reduce(T& result, T const& partial). The order doesn't depend on which
+// threads ran the chunks, so neither does the result.
+// The range is cut in at most 64 chunks. Unlike parallel_for, this runs the jobs and waits for
+// them, the current thread must be owned by the JobSystem.
+template<typename T, typename S, typename F, typename R>
+T parallel_reduce(JobSystem& js, JobSystem::Job* parent,
+        uint32_t start, uint32_t count, T const& identity,
+        F functor, R reduce, const S& splitter) noexcept {
+    constexpr uint8_t MAX_SPLITS = 6;
+    constexpr size_t MAX_CHUNKS = 1u << MAX_SPLITS;
+
+    // the chunk boundaries only depend on the splitter
+    uint32_t bounds[MAX_CHUNKS + 1];
+    size_t chunkCount = 0;
+    details::splitRange(start, count, 0, MAX_SPLITS, splitter, bounds, chunkCount);
+    bounds[chunkCount] = start + count;
+
+    T result(identity);
+    if (chunkCount == 1) {
+        // no need for jobs
+        functor(start, count, result);
+        return result;
+    }
+
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage[MAX_CHUNKS];
+    T* const partials = reinterpret_cast<T*>(storage);
+    for (size_t i = 0; i < chunkCount; i++) {
+        new(partials + i) T(identity);
+    }
+
+    auto chunks = [&functor, &bounds, partials](uint32_t s, uint32_t c) {
+        for (uint32_t i = s; i < s + c; i++) {
+            functor(bounds[i], bounds[i + 1] - bounds[i], partials[i]);
+        }
+    };
+    js.runAndWait(parallel_for(js, parent, 0, uint32_t(chunkCount), std::ref(chunks),
+            CountSplitter<1, MAX_SPLITS>()));
+
+    for (size_t i = 0; i < chunkCount; i++) {
+        reduce(result, partials[i]);
+        partials[i].~T();
+    }
+    return result;
+}
+
 } // namespace jobs
 } // namespace utils
 
@@ -31,6 +31,9 @@
 
 namespace utils {
 
+template <typename T>
+class ThreadLocal;
+
 class Profiler {
     enum {
         INSTRUCTIONS    = 0,   // must be zero
@@ -62,7 +65,10 @@ public:
         EV_BPU_RATES = EV_BPU_REFS | EV_BPU_MISSES,
     };
 
+    // The counters only count the events of the thread that created the profiler, i.e. the
+    // first thread calling get(). getForCurrentThread() returns one profiler per thread.
     static Profiler& get() noexcept;
+    static Profiler& getForCurrentThread() noexcept;
 
 
     Profiler(const Profiler& rhs) = delete;
@@ -215,6 +221,9 @@ public:
     }
 
 private:
+    template <typename T>
+    friend class ThreadLocal;
+
     Profiler() noexcept;
     ~Profiler() noexcept;
 
@@ -27,12 +27,51 @@
 #include <utils/compiler.h>
 #include <utils/Entity.h>
 #include <utils/EntityManager.h>
+#include <utils/Mutex.h>
 #include <utils/StructureOfArrays.h>
 
+#include <mutex>
+#include <vector>
+
 namespace utils {
 
 class EntityManager;
 
+namespace details {
+
+// Collects the entities destroyed on any thread, until a component manager's gc() handles them.
+class DestroyedEntityQueue final : public EntityManager::Listener {
+public:
+    void onEntitiesDestroyed(size_t n, Entity const* entities) noexcept override {
+        std::lock_guard<Mutex> lock(mLock);
+        mEntities.insert(mEntities.end(), entities, entities + n);
+    }
+
+    void onAllEntitiesDestroyed() noexcept override {
+        std::lock_guard<Mutex> lock(mLock);
+        mEntities.clear();
+        mAllEntitiesDestroyed = true;
+    }
+
+    // Replaces the content of entities with the entities destroyed since the last call, returns
+    // true if all entities were destroyed in the meantime.
+    bool collect(std::vector<Entity>& entities) noexcept {
+        entities.clear();
+        std::lock_guard<Mutex> lock(mLock);
+        std::swap(entities, mEntities);
+        bool allEntitiesDestroyed = mAllEntitiesDestroyed;
+        mAllEntitiesDestroyed = false;
+        return allEntitiesDestroyed;
+    }
+
+private:
+    Mutex mLock;
+    std::vector<Entity> mEntities;
+    bool mAllEntitiesDestroyed = false;
+};
+
+} // namespace details
+
 /*
  * Helper class to create single instance component managers.
  *
@@ -74,7 +113,11 @@ public:
 
     SingleInstanceComponentManager(SingleInstanceComponentManager&& rhs) noexcept {/* = default */}
     SingleInstanceComponentManager& operator=(SingleInstanceComponentManager&& rhs) noexcept {/* = default */}
-    ~SingleInstanceComponentManager() noexcept = default;
+    ~SingleInstanceComponentManager() noexcept {
+        if (mTrackedEntityManager) {
+            mTrackedEntityManager->unregisterListener(&mDestroyedEntities);
+        }
+    }
 
     // not copyable
     SingleInstanceComponentManager(SingleInstanceComponentManager const& rhs) = delete;
@@ -125,8 +168,18 @@ public:
     // This invalidates all pointers components.
     inline Instance removeComponent(Entity e);
 
+    // Listens to the entities destroyed by em, so that gc() removes exactly their components
+    // instead of probing random components. gc() then costs O(destroyed entities).
+    // This must be called before any component is added.
+    void trackDestroyedEntities(EntityManager& em) noexcept {
+        assert(!mTrackedEntityManager);
+        mTrackedEntityManager = &em;
+        em.registerListener(&mDestroyedEntities);
+    }
+
     // trigger one round of garbage collection. this is intended to be called on a regular
-    // basis. This gc gives up after it cannot randomly free 'ratio' component in a row.
+    // basis. Unless destroyed entities are tracked, this gc gives up after it cannot randomly
+    // free 'ratio' component in a row.
     void gc(const EntityManager& em, size_t ratio = 4) noexcept {
         gc(em, ratio, [this](Entity e) {
                     removeComponent(e);
@@ -234,6 +287,22 @@ protected:
     template<typename REMOVE>
     void gc(const EntityManager& em, size_t ratio,
             REMOVE removeComponent) noexcept {
+        if (mTrackedEntityManager) {
+            std::vector<Entity>& destroyed = mDestroyedEntitiesScratch;
+            if (UTILS_UNLIKELY(mDestroyedEntities.collect(destroyed))) {
+                // all entities were destroyed
+                while (!empty()) {
+                    removeComponent(getEntity(getComponentCount()));
+                }
+            }
+            for (Entity e : destroyed) {
+                if (hasComponent(e)) {
+                    removeComponent(e);
+                }
+            }
+            return;
+        }
+
         Entity const* entities = getEntities();
         size_t count = getComponentCount();
         size_t aliveInARow = 0;
@@ -259,6 +328,11 @@ private:
     // maps an entity to an instance index
     tsl::robin_map<Entity, Instance> mInstanceMap;
     default_random_engine mRng;
+
+    EntityManager* mTrackedEntityManager = nullptr;
+    details::DestroyedEntityQueue mDestroyedEntities;
+    // kept around to avoid reallocations
+    std::vector<Entity> mDestroyedEntitiesScratch;
 };
 
 // Keep these outside of the class because CLion has trouble parsing them
@@ -17,6 +17,7 @@
 #ifndef TNT_UTILS_STRUCTUREOFARRAYS_H
 #define TNT_UTILS_STRUCTUREOFARRAYS_H
 
+#include <algorithm>
 #include <array>        // note: this is safe, see how std::array is used below (inline / private)
 #include <cstddef>
 #include <functional>
@@ -27,6 +28,7 @@
 #include <stdlib.h>
 
 #include <utils/Allocator.h>
+#include <utils/architecture.h>
 #include <utils/compiler.h>
 #include <utils/EntityInstance.h>
 #include <utils/Slice.h>
@@ -53,6 +55,13 @@ public:
         return getOffset(kArrayCount - 1, size) + sizeof(TypeAt<kArrayCount - 1>) * size;
     }
 
+    // Smallest number of elements, a power of two, that spans whole cache lines in every array.
+    // Each array starts on a cache line, so jobs working on ranges aligned to this count never
+    // write into the same cache lines (see AlignedSplitter).
+    static constexpr size_t getCacheLineElementCount() noexcept {
+        return std::max({ cacheLineElementCount(sizeof(Elements))... });
+    }
+
     // --------------------------------------------------------------------------------------------
 
     class Structure;
@@ -269,7 +278,7 @@ public:
         // capacity cannot change when optional storage is specified
         if (capacity >= mSize) {
             const size_t sizeNeeded = getNeededSize(capacity);
-            void* buffer = mAllocator.alloc(sizeNeeded);
+            void* buffer = mAllocator.alloc(sizeNeeded, CACHELINE_SIZE);
 
             // move all the items (one array at a time) from the old allocation to the new
             // this also update the array pointers
@@ -284,6 +293,25 @@ public:
         }
     }
 
+    // Capacities set with setPaddedCapacity() are a multiple of this number of elements, itself a
+    // multiple of the SIMD width and of getCacheLineElementCount(). Loops can then process whole
+    // batches up to getPaddedSize(size()) without a remainder loop, the padding elements are
+    // allocated but not constructed.
+    static constexpr size_t getPaddingElementCount() noexcept {
+        return SIMD_ELEMENT_COUNT > getCacheLineElementCount() ?
+               SIMD_ELEMENT_COUNT : getCacheLineElementCount();
+    }
+
+    // size rounded up to a multiple of getPaddingElementCount()
+    static constexpr size_t getPaddedSize(size_t size) noexcept {
+        return (size + getPaddingElementCount() - 1) & ~(getPaddingElementCount() - 1);
+    }
+
+    // same as setCapacity(), with the capacity rounded up to a multiple of getPaddingElementCount()
+    void setPaddedCapacity(size_t capacity) {
+        setCapacity(getPaddedSize(capacity));
+    }
+
     void ensureCapacity(size_t needed) {
         if (UTILS_UNLIKELY(needed > mCapacity)) {
             // not enough space, increase the capacity
@@ -364,6 +392,40 @@ public:
                 (f(getArray<Elements>(i), std::forward<ARGS>(args)...), i++, 0)... };
     }
 
+    // Assigns value to the elements [start, start + count) of the ElementIndex'th array. Jobs can
+    // fill disjoint ranges concurrently, they don't share cache lines when the ranges are aligned
+    // to getCacheLineElementCount() (see jobs::AlignedSplitter).
+    template<size_t ElementIndex>
+    void fill(TypeAt<ElementIndex> const& value, size_t start, size_t count) noexcept {
+        std::fill_n(data<ElementIndex>() + start, count, value);
+    }
+
+    // Copies the elements of the ElementIndex'th array at the given indices to out, in order.
+    template<size_t ElementIndex>
+    void gather(TypeAt<ElementIndex>* UTILS_RESTRICT out,
+            uint32_t const* UTILS_RESTRICT indices, size_t count) const noexcept {
+        TypeAt<ElementIndex> const* UTILS_RESTRICT const in = data<ElementIndex>();
+        for (size_t i = 0; i < count; i++) {
+            out[i] = in[indices[i]];
+        }
+    }
+
+    // Stream compaction: writes the indices of the elements of [start, start + count) of the
+    // ElementIndex'th array that have any bit of mask set, in order, and returns how many were
+    // written. indices must have room for count entries. The loop doesn't branch on the data,
+    // every index is written and only the selected ones are kept.
+    template<size_t ElementIndex>
+    size_t compact(uint32_t* UTILS_RESTRICT indices, TypeAt<ElementIndex> mask,
+            size_t start, size_t count) const noexcept {
+        TypeAt<ElementIndex> const* UTILS_RESTRICT const in = data<ElementIndex>();
+        size_t n = 0;
+        for (size_t i = start, e = start + count; i < e; i++) {
+            indices[n] = uint32_t(i);
+            n += bool(in[i] & mask);
+        }
+        return n;
+    }
+
     // return a pointer to the first element of the ElementIndex]th array
     template<size_t ElementIndex>
     constexpr TypeAt<ElementIndex>* data() noexcept {
@@ -485,6 +547,9 @@ public:
     };
 
 private:
+    // the widest vectorized loops over SoAs process 16 bytes at a time
+    static constexpr size_t SIMD_ELEMENT_COUNT = 16;
+
     template<typename T>
     constexpr T const* getArray(size_t arrayIndex) const {
         return static_cast<T const*>(mArrayOffset[arrayIndex]);
@@ -508,6 +573,12 @@ private:
         mSize = needed;
     }
 
+    // number of elements of the given size needed to fill whole cache lines
+    static constexpr size_t cacheLineElementCount(size_t elementSize) noexcept {
+        // elementSize & -elementSize is the largest power of two dividing elementSize
+        return CACHELINE_SIZE / std::min(CACHELINE_SIZE, elementSize & (~elementSize + 1));
+    }
+
     // this calculate the offset adjusted for all data alignment of a given array
     static inline constexpr size_t getOffset(size_t index, size_t capacity) noexcept {
         auto offsets = getOffsets(capacity);
@@ -518,8 +589,8 @@ private:
         // compute the required size of each array
         const size_t sizes[] = { (sizeof(Elements) * capacity)... };
 
-        // we align each array to the same alignment guaranteed by malloc
-        const size_t align = alignof(std::max_align_t);
+        // we align each array to a cache line, see getCacheLineElementCount()
+        const size_t align = CACHELINE_SIZE;
 
         // hopefully most of this gets unrolled and inlined
         std::array<size_t, kArrayCount> offsets;
@@ -222,15 +222,44 @@ private:
 #else // !ANDROID
 // ------------------------------------------------------------------------------------------------
 
+#include <utils/TraceRecorder.h>
+
+/*
+ * On other platforms, the SYSTRACE_ macros record into the TraceRecorder, which is controlled
+ * with TraceRecorder::start() and TraceRecorder::stop() instead of SYSTRACE_ENABLE().
+ */
+
+#ifndef SYSTRACE_TAG
+#define SYSTRACE_TAG (SYSTRACE_TAG_ALWAYS)
+#endif
+
 #define SYSTRACE_ENABLE()
 #define SYSTRACE_DISABLE()
 #define SYSTRACE_CONTEXT()
-#define SYSTRACE_NAME(name)
-#define SYSTRACE_CALL()
-#define SYSTRACE_ASYNC_BEGIN(name, cookie)
-#define SYSTRACE_ASYNC_END(name, cookie)
-#define SYSTRACE_VALUE32(name, val)
-#define SYSTRACE_VALUE64(name, val)
+
+#define SYSTRACE_NAME(name) utils::TraceRecorder::Scope ___tracer(SYSTRACE_TAG, name)
+
+#define SYSTRACE_CALL() SYSTRACE_NAME(__FUNCTION__)
+
+#define SYSTRACE_ASYNC_BEGIN(name, cookie) do { \
+        if (utils::TraceRecorder::isRecording(SYSTRACE_TAG)) { \
+            utils::TraceRecorder::asyncBegin(name, int32_t(cookie)); \
+        } } while (false)
+
+#define SYSTRACE_ASYNC_END(name, cookie) do { \
+        if (utils::TraceRecorder::isRecording(SYSTRACE_TAG)) { \
+            utils::TraceRecorder::asyncEnd(name, int32_t(cookie)); \
+        } } while (false)
+
+#define SYSTRACE_VALUE32(name, val) do { \
+        if (utils::TraceRecorder::isRecording(SYSTRACE_TAG)) { \
+            utils::TraceRecorder::value(name, int32_t(val)); \
+        } } while (false)
+
+#define SYSTRACE_VALUE64(name, val) do { \
+        if (utils::TraceRecorder::isRecording(SYSTRACE_TAG)) { \
+            utils::TraceRecorder::value(name, int64_t(val)); \
+        } } while (false)
 
 #endif // ANDROID
 
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_UTILS_TRACERECORDER_H
+#define TNT_UTILS_TRACERECORDER_H
+
+#include <utils/compiler.h>
+
+#include <atomic>
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+
+/**
+ * TraceRecorder records trace events in memory and exports them in the Chrome trace event
+ * format (JSON), which can be loaded in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * On platforms other than Android, the SYSTRACE_ macros record into the TraceRecorder. The
+ * JobSystem also records the execution of every job and the names of its threads.
+ *
+ * Each thread records into its own ring buffer of EVENTS_PER_THREAD events, so only the most
+ * recent events are kept. Recording an event doesn't take any lock, and is a single atomic
+ * load when the recorder is stopped.
+ *
+ * Typical use:
+ *
+ *      TraceRecorder::start();
+ *      // ... render a few frames ...
+ *      TraceRecorder::stop();
+ *      TraceRecorder::writeChromeTrace("filament.json");
+ */
+class UTILS_PUBLIC TraceRecorder {
+public:
+    static constexpr size_t EVENTS_PER_THREAD = 16384;
+
+    // names longer than this are truncated
+    static constexpr size_t MAX_NAME_LENGTH = 46;
+
+    // discards all recorded events and starts recording
+    static void start() noexcept;
+
+    // stops recording, recorded events are kept until the next start()
+    static void stop() noexcept;
+
+    static bool isRecording() noexcept {
+        return sRecording.load(std::memory_order_relaxed);
+    }
+
+    static bool isRecording(uint32_t tag) noexcept {
+        return tag && UTILS_UNLIKELY(isRecording());
+    }
+
+    // begin() and end() must be balanced on a given thread
+    static void begin(const char* name) noexcept;
+    static void end() noexcept;
+
+    // asynchronous events don't need to be nested, they're matched by name and cookie
+    static void asyncBegin(const char* name, int32_t cookie) noexcept;
+    static void asyncEnd(const char* name, int32_t cookie) noexcept;
+
+    // records the value of a counter
+    static void value(const char* name, int64_t value) noexcept;
+
+    // names the calling thread in exported traces, this doesn't require recording to be started
+    static void setThreadName(const char* name) noexcept;
+
+    /*
+     * Exports the recorded events in the Chrome trace event format. This should be called
+     * after stop(), events recorded concurrently might be missing or corrupted.
+     */
+    static std::string getChromeTrace();
+    static bool writeChromeTrace(const char* path) noexcept;
+
+    // records the beginning and the end of a scope, used by SYSTRACE_NAME
+    class Scope {
+    public:
+        Scope(uint32_t tag, const char* name) noexcept : mRecording(isRecording(tag)) {
+            if (UTILS_UNLIKELY(mRecording)) {
+                begin(name);
+            }
+        }
+
+        ~Scope() noexcept {
+            if (UTILS_UNLIKELY(mRecording)) {
+                end();
+            }
+        }
+
+        Scope(Scope const&) = delete;
+        Scope& operator=(Scope const&) = delete;
+
+    private:
+        const bool mRecording;
+    };
+
+private:
+    static std::atomic<bool> sRecording;
+};
+
+} // namespace utils
+
+#endif // TNT_UTILS_TRACERECORDER_H
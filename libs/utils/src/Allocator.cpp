@@ -51,6 +51,43 @@ void LinearAllocator::swap(LinearAllocator& rhs) noexcept {
     std::swap(mCurrent, rhs.mCurrent);
 }
 
+// ------------------------------------------------------------------------------------------------
+// AtomicChunkAllocator
+// ------------------------------------------------------------------------------------------------
+
+AtomicChunkAllocator::AtomicChunkAllocator(void* begin, void* end, size_t chunkSize) noexcept
+    : mChunkSize(chunkSize) {
+    assert(chunkSize && !(chunkSize & (chunkSize - 1)));
+    while ((size_t(1) << mChunkShift) < chunkSize) {
+        mChunkShift++;
+    }
+    mBegin = pointermath::align(begin, chunkSize);
+    if (mBegin < end) {
+        mChunkCount = (uintptr_t(end) - uintptr_t(mBegin)) >> mChunkShift;
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// ScratchAllocator
+// ------------------------------------------------------------------------------------------------
+
+void* ScratchAllocator::refill(size_t size, size_t alignment, size_t extra) noexcept {
+    const size_t chunkSize = mChunks.getChunkSize();
+    if (size + extra + alignment > chunkSize / 2) {
+        // large allocations get their own chunks, so we keep what's left of the current one
+        return mChunks.alloc(size, alignment, extra);
+    }
+    void* const chunk = mChunks.alloc(chunkSize, 1);
+    if (UTILS_UNLIKELY(!chunk)) {
+        return nullptr;
+    }
+    mCurrent = chunk;
+    mEnd = pointermath::add(chunk, chunkSize);
+    void* const p = pointermath::align(mCurrent, alignment, extra);
+    mCurrent = pointermath::add(p, size);
+    return p;
+}
+
 // ------------------------------------------------------------------------------------------------
 // FreeList
 // ------------------------------------------------------------------------------------------------
@@ -97,8 +134,8 @@ AtomicFreeList::AtomicFreeList(void* begin, void* end,
 }
 
 TrackingPolicy::HighWatermark::~HighWatermark() noexcept {
-    size_t wm = mHighWaterMark;
-    size_t wmpct = wm / (mSize / 100);
+    size_t wm = getHighWatermark();
+    size_t wmpct = wm / (getSize() / 100);
     slog.d << mName << " arena: High watermark "
            << wm / 1024 << " KiB (" << wmpct << "%)" << io::endl;
 }
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/CpuTopology.h>
+
+#include <algorithm>
+#include <thread>
+
+#include <stdio.h>
+
+namespace utils {
+
+static uint32_t readMaxFrequency(const char* sysfsPath, size_t cpu) noexcept {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/cpu%u/cpufreq/cpuinfo_max_freq", sysfsPath, unsigned(cpu));
+    uint32_t frequency = 0;
+    FILE* file = fopen(path, "r");
+    if (file) {
+        if (fscanf(file, "%u", &frequency) != 1) {
+            frequency = 0;
+        }
+        fclose(file);
+    }
+    return frequency;
+}
+
+CpuTopology::CpuTopology() noexcept {
+    probe("/sys/devices/system/cpu", std::thread::hardware_concurrency());
+}
+
+CpuTopology::CpuTopology(const char* sysfsPath, size_t cpuCount) noexcept {
+    probe(sysfsPath, cpuCount);
+}
+
+CpuTopology const& CpuTopology::get() noexcept {
+    static const CpuTopology sTopology;
+    return sTopology;
+}
+
+void CpuTopology::probe(const char* sysfsPath, size_t cpuCount) noexcept {
+    mCpuCount = std::max(size_t(1), std::min(cpuCount, size_t(MAX_CPU_COUNT)));
+
+    bool known = true;
+    uint32_t frequencies[MAX_CPU_COUNT];
+    for (size_t i = 0; i < mCpuCount; i++) {
+        frequencies[i] = readMaxFrequency(sysfsPath, i);
+        known = known && frequencies[i] != 0;
+    }
+
+    if (!known) {
+        // we can't tell the CPUs apart, assume they're all the same
+        mClusters[0] = { getAllCoresMask(), 0 };
+        mClusterCount = 1;
+        return;
+    }
+
+    mClusterCount = 0;
+    for (size_t i = 0; i < mCpuCount; i++) {
+        Cluster* const first = mClusters;
+        Cluster* const last = mClusters + mClusterCount;
+        Cluster* cluster = std::find_if(first, last,
+                [f = frequencies[i]](Cluster const& c) { return c.maxFrequency == f; });
+        if (cluster == last) {
+            *cluster = { 0, frequencies[i] };
+            mClusterCount++;
+        }
+        cluster->mask |= 1u << i;
+    }
+
+    std::sort(mClusters, mClusters + mClusterCount, [](Cluster const& lhs, Cluster const& rhs) {
+        return lhs.maxFrequency > rhs.maxFrequency;
+    });
+}
+
+} // namespace utils
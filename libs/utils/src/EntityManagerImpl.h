@@ -19,6 +19,7 @@
 
 #include <utils/EntityManager.h>
 
+#include <atomic>
 #include <deque>
 #include <mutex>
 #include <set>
@@ -43,18 +44,32 @@ public:
     using EntityManager::destroy;
 
     void create(size_t n, Entity* entities) {
-        Entity::Type index;
-        auto& freeList = mFreeList;
         uint8_t* const gens = mGens;
 
-        // this must be thread-safe, acquire the free-list mutex
+        // In the common case, the free-list is short and there are indices that were never used.
+        // A whole batch of them is then reserved at once without taking the lock. This works only
+        // until all indices have been used once, at which point we're always in the slower case
+        // below. The idea is that we have enough indices that it doesn't happen in practice.
+        Entity::Type first;
+        if (UTILS_LIKELY(mFreeListSize.load(std::memory_order_relaxed) < MIN_FREE_INDICES &&
+                allocateIndices(n, first))) {
+            for (size_t i = 0; i < n; i++) {
+                const Entity::Type index = Entity::Type(first + i);
+                entities[i] = Entity{ makeIdentity(gens[index], index) };
+            }
+            return;
+        }
+
+        auto& freeList = mFreeList;
+
+        // the free-list must be accessed under the lock
         std::lock_guard<Mutex> lock(mFreeListLock);
-        Entity::Type currentIndex = mCurrentIndex;
         for (size_t i = 0; i < n; i++) {
             // If we have more than a certain number of freed indices, get one from the list.
             // this is a trade-off between how often we recycle indices and how large the free list
             // can grow.
-            if (UTILS_UNLIKELY(currentIndex >= RAW_INDEX_COUNT || freeList.size() >= MIN_FREE_INDICES)) {
+            Entity::Type index;
+            if (freeList.size() >= MIN_FREE_INDICES || !allocateIndices(1, index)) {
 
                 // this could only happen if we had gone through all the indices at least once
                 if (UTILS_UNLIKELY(freeList.empty())) {
@@ -65,16 +80,10 @@ public:
 
                 index = freeList.front();
                 freeList.pop_front();
-            } else {
-                // In the common case, we just grab the next index.
-                // This works only until all indices have been used once, at which point
-                // we're always in the slower case above. The idea is that we have enough indices
-                // that it doesn't happen in practice.
-                index = currentIndex++;
             }
             entities[i] = Entity{ makeIdentity(gens[index], index) };
         }
-        mCurrentIndex = currentIndex;
+        mFreeListSize.store(freeList.size(), std::memory_order_relaxed);
     }
 
     void destroy(size_t n, Entity* entities) noexcept {
@@ -105,6 +114,7 @@ public:
                 gens[index]++;
             }
         }
+        mFreeListSize.store(freeList.size(), std::memory_order_relaxed);
         lock.unlock();
 
         // notify our listeners that some entities are being destroyed
@@ -121,14 +131,15 @@ public:
         std::unique_lock<Mutex> lock(mFreeListLock);
 
         // make all indices that were ever used invalid
-        for (size_t i = 0, c = mCurrentIndex; i < c; i++) {
+        for (size_t i = 0, c = mCurrentIndex.load(std::memory_order_relaxed); i < c; i++) {
             gens[i]++;
         }
 
         // clear the free-list entirely.
-        mCurrentIndex = 1;
+        mCurrentIndex.store(1, std::memory_order_relaxed);
         mFreeList.clear();
         mFreeList.shrink_to_fit();
+        mFreeListSize.store(0, std::memory_order_relaxed);
         lock.unlock();
 
         // notify our listeners that all entities are being destroyed
@@ -154,11 +165,29 @@ public:
     }
 
 private:
-    uint32_t mCurrentIndex = 1;
+    // reserves n consecutive indices that were never used, returns false if there aren't enough
+    bool allocateIndices(size_t n, Entity::Type& first) noexcept {
+        Entity::Type index = mCurrentIndex.load(std::memory_order_relaxed);
+        while (index + n <= RAW_INDEX_COUNT) {
+            // the generations of these indices haven't changed since clear(), which is
+            // not expected to run concurrently, so no ordering is needed.
+            if (mCurrentIndex.compare_exchange_weak(index, Entity::Type(index + n),
+                    std::memory_order_relaxed)) {
+                first = index;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // first index that was never used
+    std::atomic<Entity::Type> mCurrentIndex = { 1 };
 
     // stores indices that got freed
     mutable Mutex mFreeListLock;
     std::deque<Entity::Type> mFreeList;
+    // size of mFreeList, readable without the lock
+    std::atomic<size_t> mFreeListSize = { 0 };
 
     mutable Mutex mListenerLock;
     std::set<Listener*> mListeners;
@@ -24,13 +24,17 @@
 
 #include <utils/JobSystem.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <limits>
 #include <random>
 
 #include <utils/compiler.h>
 #include <utils/memalign.h>
 #include <utils/Panic.h>
 #include <utils/Systrace.h>
+#include <utils/TraceRecorder.h>
 
 #if !defined(WIN32)
 #    include <pthread.h>
@@ -60,6 +64,7 @@ namespace utils {
 UTILS_DEFINE_TLS(JobSystem::ThreadState *) JobSystem::sThreadState(nullptr);
 
 void JobSystem::setThreadName(const char* name) noexcept {
+    TraceRecorder::setThreadName(name);
 #if defined(__linux__)
     pthread_setname_np(pthread_self(), name);
 #elif defined(__APPLE__)
@@ -103,28 +108,36 @@ void JobSystem::setThreadAffinity(uint32_t mask) noexcept {
 #endif
 }
 
-JobSystem::JobSystem(size_t threadCount, size_t adoptableThreadsCount) noexcept
-    : mJobPool("JobSystem Job pool", MAX_JOB_COUNT * sizeof(Job)),
-      mJobStorageBase(static_cast<Job *>(mJobPool.getAllocator().getCurrent()))
+JobSystem::JobSystem(size_t threadCount, size_t adoptableThreadsCount,
+        uint32_t affinityMask) noexcept
 {
     SYSTRACE_ENABLE();
 
+    // allocate the first block of jobs upfront, it's enough for most uses
+    growJobPool();
+
+    const size_t hwThreads = std::max(1u, std::thread::hardware_concurrency());
     if (threadCount == 0) {
         // default value, system dependant
-        size_t hwThreads = std::thread::hardware_concurrency();
         if (UTILS_HAS_HYPER_THREADING) {
             // For now we avoid using HT, this simplifies profiling.
             // TODO: figure-out what to do with Hyper-threading
-            threadCount = hwThreads / 2 - 1;
+            threadCount = std::max(size_t(2), hwThreads) / 2 - 1;
         } else {
             threadCount = hwThreads - 1;
         }
     }
     threadCount = std::min(size_t(32), threadCount);
 
+    // spinning threads would take CPU time away from the ones doing actual work
+    if (threadCount + adoptableThreadsCount > hwThreads) {
+        mIdleSpinTime.store(0, std::memory_order_relaxed);
+    }
+
     mThreadStates = aligned_vector<ThreadState>(threadCount + adoptableThreadsCount);
     mThreadCount = uint16_t(threadCount);
     mParallelSplitCount = (uint8_t)std::ceil((std::log2f(threadCount + adoptableThreadsCount)));
+    mAffinityMask = affinityMask;
 
     // this is pitty these are not compile-time checks (C++17 supports it apparently)
     assert(mExitRequested.is_lock_free());
@@ -139,6 +152,7 @@ JobSystem::JobSystem(size_t threadCount, size_t adoptableThreadsCount) noexcept
         auto& state = states[i];
         state.rndGen = default_random_engine(rd());
         state.mask = uint32_t(1UL << i);
+        state.spinTime = std::numeric_limits<uint32_t>::max();
         state.js = this;
         if (i < hardwareThreadCount) {
             // don't start a thread of adoptable thread slots
@@ -157,6 +171,10 @@ JobSystem::~JobSystem() {
             state.thread.join();
         }
     }
+
+    for (auto& block : mJobBlocks) {
+        aligned_free(block.load(std::memory_order_relaxed));
+    }
 }
 
 JobSystem* JobSystem::getJobSystem() noexcept {
@@ -191,7 +209,50 @@ inline JobSystem::ThreadState& JobSystem::getState() noexcept {
 }
 
 JobSystem::Job* JobSystem::allocateJob() noexcept {
-    return mJobPool.make<Job>();
+    // Free jobs are kept constructed, the free list only overwrites their first field.
+    void* job;
+    while (UTILS_UNLIKELY(!(job = mFreeJobs.get()))) {
+        if (!growJobPool()) {
+            mJobOverflowCount.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+    }
+    return static_cast<Job*>(job);
+}
+
+bool JobSystem::growJobPool() noexcept {
+    std::lock_guard<Mutex> lock(mJobPoolLock);
+
+    // another thread may have added a block while we were waiting
+    if (mFreeJobs.getCurrent()) {
+        return true;
+    }
+
+    const uint32_t blockCount = mJobBlockCount.load(std::memory_order_relaxed);
+    if (blockCount == MAX_JOB_BLOCKS) {
+        return false;
+    }
+
+    SYSTRACE_CALL();
+
+    Job* const block = static_cast<Job*>(aligned_alloc(JOB_BLOCK_SIZE * sizeof(Job), alignof(Job)));
+    if (UTILS_UNLIKELY(!block)) {
+        return false;
+    }
+    for (size_t i = 0; i < JOB_BLOCK_SIZE; i++) {
+        Job* const job = new(block + i) Job();
+        job->index = uint16_t(blockCount * JOB_BLOCK_SIZE + i);
+    }
+
+    // publish the block before any of its jobs can be reached through an index
+    mJobBlocks[blockCount].store(block, std::memory_order_release);
+    mJobBlockCount.store(blockCount + 1, std::memory_order_relaxed);
+
+    // push in reverse order, so that jobs are handed out in memory order
+    for (size_t i = JOB_BLOCK_SIZE; i > 0; i--) {
+        mFreeJobs.put(block + i - 1);
+    }
+    return true;
 }
 
 inline JobSystem::ThreadState& JobSystem::getStateToStealFrom(JobSystem::ThreadState& state) noexcept {
@@ -202,16 +263,19 @@ inline JobSystem::ThreadState& JobSystem::getStateToStealFrom(JobSystem::ThreadS
     return mThreadStates[index];
 }
 
-bool JobSystem::execute(JobSystem::ThreadState& state) noexcept {
-
-    Job* job = pop(state.workQueue);
-    if (job == nullptr) {
-        // our queue is empty, try to steal a job
-        ThreadState& stateToStealFrom = getStateToStealFrom(state);
-        if (&stateToStealFrom != &state) {
-            // don't steal from our own queue
-            job = steal(stateToStealFrom.workQueue);
-            // nullptr -> nothing to steal in that queue either
+bool JobSystem::execute(JobSystem::ThreadState& state, uint8_t lowestPriority) noexcept {
+
+    Job* job = nullptr;
+    for (uint8_t priority = 0; !job && priority <= lowestPriority; priority++) {
+        job = pop(state.workQueues[priority]);
+        if (job == nullptr) {
+            // our queue is empty, try to steal a job of the same priority
+            ThreadState& stateToStealFrom = getStateToStealFrom(state);
+            if (&stateToStealFrom != &state) {
+                // don't steal from our own queue
+                job = steal(stateToStealFrom.workQueues[priority]);
+                // nullptr -> nothing to steal in that queue either
+            }
         }
     }
 
@@ -225,6 +289,8 @@ bool JobSystem::execute(JobSystem::ThreadState& state) noexcept {
 
         if (UTILS_LIKELY(job->function)) {
             SYSTRACE_NAME("job->function");
+            // jobs are always visible in recorded traces, regardless of SYSTRACE_TAG
+            TraceRecorder::Scope jobTrace(SYSTRACE_TAG_ALWAYS, "job");
             job->function(job->padding, *this, job);
         }
         finish(job);
@@ -235,21 +301,52 @@ bool JobSystem::execute(JobSystem::ThreadState& state) noexcept {
 void JobSystem::loop(ThreadState* threadState) noexcept {
     setThreadName("JobSystem::loop");
     setThreadPriority(Priority::DISPLAY);
+    if (mAffinityMask) {
+        setThreadAffinity(mAffinityMask);
+    }
 
     // record our work queue to thread-local storage
     sThreadState = threadState;
 
     // run our main loop...
     do {
-        if (!execute(*threadState)) {
+        if (!execute(*threadState, PRIORITY_LOW) && !spin(*threadState)) {
             std::unique_lock<Mutex> lock(mLock);
-            while (!exitRequested() && !(mActiveJobs.load(std::memory_order_relaxed))) {
+            // seq_cst, with the decrement of mSpinningThreads in spin(), pairs with run()
+            while (!exitRequested() && !(mActiveJobs.load(std::memory_order_seq_cst))) {
                 mCondition.wait(lock);
             }
         }
     } while (!exitRequested());
 }
 
+bool JobSystem::spin(ThreadState& state) noexcept {
+    // The spin budget is reset after it paid off, and halved every time we end up sleeping
+    // anyways, so that threads don't keep burning CPU through long idle periods.
+    const uint32_t maxSpinTime = mIdleSpinTime.load(std::memory_order_relaxed);
+    const uint32_t budget = std::min(state.spinTime, maxSpinTime);
+    if (!budget) {
+        return false;
+    }
+
+    using clock = std::chrono::steady_clock;
+    const clock::time_point deadline = clock::now() + std::chrono::microseconds(budget);
+
+    mSpinningThreads.fetch_add(1, std::memory_order_seq_cst);
+    bool found = false;
+    do {
+        // don't look at the clock too often
+        for (size_t i = 0; i < 32 && !found; i++) {
+            UTILS_PAUSE();
+            found = mActiveJobs.load(std::memory_order_relaxed) || exitRequested();
+        }
+    } while (!found && clock::now() < deadline);
+    mSpinningThreads.fetch_sub(1, std::memory_order_seq_cst);
+
+    state.spinTime = found ? maxSpinTime : std::max(budget / 2, 1u);
+    return found;
+}
+
 // -----------------------------------------------------------------------------------------------
 // public API...
 
@@ -258,17 +355,18 @@ JobSystem::Job* JobSystem::create(JobSystem::Job* parent, JobFunc func) noexcept
     parent = (parent == nullptr) ? mMasterJob : parent;
     Job* const job = allocateJob();
     if (UTILS_LIKELY(job)) {
-        size_t index = 0x7FFF;
+        uint16_t index = NO_PARENT;
         if (parent) {
             // can't create a child job of a terminated parent
             assert(parent->runningJobCount.load(std::memory_order_relaxed) > 0);
 
             parent->runningJobCount.fetch_add(1, std::memory_order_relaxed);
-            index = parent - mJobStorageBase;
+            index = parent->index;
             assert(index < MAX_JOB_COUNT);
         }
         job->function = func;
-        job->parent = uint16_t(index);
+        job->parent = index;
+        job->priority = parent ? parent->priority : uint8_t(PRIORITY_HIGH);
         job->runningJobCount.store(1, std::memory_order_relaxed);
     }
     return job;
@@ -278,8 +376,6 @@ void JobSystem::finish(Job* job) noexcept {
     SYSTRACE_CALL();
 
     // terminate this job and notify its parent
-    auto& jobPool = mJobPool;
-    Job* const storage = mJobStorageBase;
     do {
         // std::memory_order_release here is needed to synchronize with JobSystem::wait()
         // which needs to "see" all changes that happened before the job terminated.
@@ -289,9 +385,9 @@ void JobSystem::finish(Job* job) noexcept {
             // there is still work (e.g.: children), we're done.
             break;
         }
-        Job* const parent = job->parent == 0x7FFF ? nullptr : &storage[job->parent];
+        Job* const parent = job->parent == NO_PARENT ? nullptr : getJob(job->parent);
         // destroy this job...
-        jobPool.destroy(job);
+        mFreeJobs.put(job);
         // ... and check the parent
         job = parent;
     } while (job);
@@ -310,20 +406,41 @@ void JobSystem::run(JobSystem::Job* job, uint32_t flags) noexcept {
 
     ThreadState& state(getState());
 
+    if (flags & LOW_PRIORITY) {
+        job->priority = PRIORITY_LOW;
+    }
+
+    WorkQueue& workQueue = state.workQueues[job->priority];
+    if (UTILS_UNLIKELY(workQueue.getCount() >= int32_t(workQueue.getSize()))) {
+        // Our queue is full, execute the job right away. This is allowed since jobs can run any
+        // time after run() is called, and the count can only be lower because of steals.
+        mJobOverflowCount.fetch_add(1, std::memory_order_relaxed);
+        if (UTILS_LIKELY(job->function)) {
+            job->function(job->padding, *this, job);
+        }
+        finish(job);
+        return;
+    }
+
     // increase the active job count before we add the job to the queue, because otherwise
     // the job could run and finish before the counter is incremented, which would trigger
     // an assert() in execute(). Either way, it's not "wrong", but the assert() is useful.
-    uint32_t activeJobs = mActiveJobs.fetch_add(1, std::memory_order_relaxed);
+    uint32_t activeJobs = mActiveJobs.fetch_add(1, std::memory_order_seq_cst);
 
-    put(state.workQueue, job);
+    put(workQueue, job);
 
     SYSTRACE_CONTEXT();
     SYSTRACE_VALUE32("JobSystem::activeJobs", activeJobs + 1);
 
     // wake-up a thread if needed...
     if (!(flags & DONT_SIGNAL)) {
-        // if it was busy before, try to wake-up another sleeping thread
-        if (activeJobs) {
+        // if it was busy before, try to wake-up another sleeping thread, unless a thread is
+        // spinning already, it will pick up the job without going through the kernel.
+        // This reads mSpinningThreads after incrementing mActiveJobs, while a thread that
+        // stops spinning decrements the former before reading the latter in loop(). All of
+        // these are seq_cst so that at least one side sees the other's write, otherwise the
+        // thread could go to sleep without anyone waking it up for this job.
+        if (activeJobs && !mSpinningThreads.load(std::memory_order_seq_cst)) {
             // wake-up a queue
             { std::lock_guard<Mutex> lock(mLock); }
             mCondition.notify_one();
@@ -336,8 +453,12 @@ void JobSystem::wait(JobSystem::Job const* job) noexcept {
 
     assert(job);
     ThreadState& state(getState());
+
+    // Don't start a low priority job, which could take a while, when waiting on a high priority
+    // one, unless there are no worker threads to execute them.
+    const uint8_t lowestPriority = mThreadCount ? job->priority : uint8_t(PRIORITY_LOW);
     do {
-        if (!execute(state)) {
+        if (!execute(state, lowestPriority)) {
             // we're a waiter so we spin!!!
             UTILS_WAIT_FOR_EVENT();
         }
@@ -383,7 +504,9 @@ void JobSystem::emancipate() {
 
 io::ostream& operator<<(io::ostream& out, JobSystem const& js) {
     for (auto const& item : js.mThreadStates) {
-        out << size_t(std::log2f(item.mask)) << ": " << item.workQueue.getCount() << io::endl;
+        out << size_t(std::log2f(item.mask)) << ": "
+            << item.workQueues[JobSystem::PRIORITY_HIGH].getCount() << " + "
+            << item.workQueues[JobSystem::PRIORITY_LOW].getCount() << " low priority" << io::endl;
     }
     return out;
 }
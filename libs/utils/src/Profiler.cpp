@@ -16,6 +16,8 @@
 
 #include <utils/Profiler.h>
 
+#include <utils/ThreadLocal.h>
+
 #include <stdlib.h>
 #include <string.h>
 #if !defined(WIN32)
@@ -57,6 +59,11 @@ Profiler& Profiler::get() noexcept {
     return sProfiler;
 }
 
+Profiler& Profiler::getForCurrentThread() noexcept {
+    static UTILS_DECLARE_TLS(Profiler) sProfiler;
+    return sProfiler;
+}
+
 Profiler::Profiler() noexcept {
     std::uninitialized_fill(std::begin(mCountersFd), std::end(mCountersFd), -1);
     Profiler::resetEvents(EV_CPU_CYCLES | EV_L1D_RATES | EV_BPU_RATES);
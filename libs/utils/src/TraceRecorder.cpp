@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/TraceRecorder.h>
+
+#include <utils/Mutex.h>
+#include <utils/ThreadLocal.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace utils {
+
+namespace {
+
+enum class EventType : uint8_t {
+    BEGIN, END, ASYNC_BEGIN, ASYNC_END, COUNTER
+};
+
+struct Event {
+    int64_t time;       // in ns, relative to the last start()
+    int64_t value;      // counter value or async cookie
+    EventType type;
+    char name[TraceRecorder::MAX_NAME_LENGTH + 1];
+};
+
+static_assert(sizeof(Event) == 64, "Event should fit in a cache line");
+static_assert((TraceRecorder::EVENTS_PER_THREAD & (TraceRecorder::EVENTS_PER_THREAD - 1)) == 0,
+        "EVENTS_PER_THREAD must be a power of two");
+
+struct ThreadBuffer {
+    explicit ThreadBuffer(uint32_t tid) noexcept : tid(tid) { }
+    const uint32_t tid;
+    char name[32] = {};
+    // only written by the owning thread, read when exporting
+    std::unique_ptr<Event[]> events;
+    std::atomic<uint64_t> head = { 0 };
+};
+
+using clock = std::chrono::steady_clock;
+
+// ThreadBuffers are never destroyed, so the events of terminated threads can still be exported
+Mutex sLock;
+std::vector<ThreadBuffer*> sBuffers;
+clock::time_point sEpoch;
+
+UTILS_DEFINE_TLS(ThreadBuffer*) sThreadBuffer(nullptr);
+
+ThreadBuffer* getThreadBuffer() noexcept {
+    ThreadBuffer* buffer = sThreadBuffer;
+    if (UTILS_UNLIKELY(!buffer)) {
+        std::lock_guard<Mutex> guard(sLock);
+        buffer = new ThreadBuffer(uint32_t(sBuffers.size() + 1));
+        sBuffers.push_back(buffer);
+        sThreadBuffer = buffer;
+    }
+    return buffer;
+}
+
+void record(EventType type, const char* name, int64_t value) noexcept {
+    ThreadBuffer* const buffer = getThreadBuffer();
+    if (UTILS_UNLIKELY(!buffer->events)) {
+        buffer->events.reset(new Event[TraceRecorder::EVENTS_PER_THREAD]);
+    }
+    const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    Event& e = buffer->events[head & (TraceRecorder::EVENTS_PER_THREAD - 1)];
+    e.time = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - sEpoch).count();
+    e.value = value;
+    e.type = type;
+    if (name) {
+        strncpy(e.name, name, TraceRecorder::MAX_NAME_LENGTH);
+        e.name[TraceRecorder::MAX_NAME_LENGTH] = 0;
+    } else {
+        e.name[0] = 0;
+    }
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void appendString(std::string& out, const char* s) {
+    out += '"';
+    for (; *s; s++) {
+        const char c = *s;
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (uint8_t(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+void appendEvent(std::string& out, uint32_t tid, Event const& e) {
+    static const char* const PHASES[] = { "B", "E", "b", "e", "C" };
+    char header[96];
+    snprintf(header, sizeof(header), "{\"ph\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%lld.%03lld",
+            PHASES[size_t(e.type)], tid, (long long)(e.time / 1000), (long long)(e.time % 1000));
+    out += header;
+    if (e.type != EventType::END) {
+        out += ",\"name\":";
+        appendString(out, e.name);
+    }
+    if (e.type == EventType::ASYNC_BEGIN || e.type == EventType::ASYNC_END) {
+        char id[48];
+        snprintf(id, sizeof(id), ",\"cat\":\"async\",\"id\":%lld", (long long)e.value);
+        out += id;
+    } else if (e.type == EventType::COUNTER) {
+        char args[48];
+        snprintf(args, sizeof(args), ",\"args\":{\"value\":%lld}", (long long)e.value);
+        out += args;
+    }
+    out += '}';
+}
+
+} // anonymous namespace
+
+constexpr size_t TraceRecorder::EVENTS_PER_THREAD;
+constexpr size_t TraceRecorder::MAX_NAME_LENGTH;
+
+std::atomic<bool> TraceRecorder::sRecording = { false };
+
+void TraceRecorder::start() noexcept {
+    std::lock_guard<Mutex> guard(sLock);
+    sRecording.store(false, std::memory_order_relaxed);
+    for (ThreadBuffer* buffer : sBuffers) {
+        buffer->head.store(0, std::memory_order_relaxed);
+    }
+    sEpoch = clock::now();
+    sRecording.store(true, std::memory_order_release);
+}
+
+void TraceRecorder::stop() noexcept {
+    sRecording.store(false, std::memory_order_release);
+}
+
+void TraceRecorder::begin(const char* name) noexcept {
+    record(EventType::BEGIN, name, 0);
+}
+
+void TraceRecorder::end() noexcept {
+    // the matching begin() might have been recorded before stop()
+    if (isRecording()) {
+        record(EventType::END, nullptr, 0);
+    }
+}
+
+void TraceRecorder::asyncBegin(const char* name, int32_t cookie) noexcept {
+    record(EventType::ASYNC_BEGIN, name, cookie);
+}
+
+void TraceRecorder::asyncEnd(const char* name, int32_t cookie) noexcept {
+    record(EventType::ASYNC_END, name, cookie);
+}
+
+void TraceRecorder::value(const char* name, int64_t value) noexcept {
+    record(EventType::COUNTER, name, value);
+}
+
+void TraceRecorder::setThreadName(const char* name) noexcept {
+    ThreadBuffer* const buffer = getThreadBuffer();
+    std::lock_guard<Mutex> guard(sLock);
+    strncpy(buffer->name, name, sizeof(buffer->name) - 1);
+}
+
+std::string TraceRecorder::getChromeTrace() {
+    std::lock_guard<Mutex> guard(sLock);
+    std::string out("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool first = true;
+    auto separator = [&]() {
+        if (!first) out += ",\n";
+        first = false;
+    };
+    for (ThreadBuffer const* buffer : sBuffers) {
+        if (buffer->name[0]) {
+            separator();
+            char header[96];
+            snprintf(header, sizeof(header),
+                    "{\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                    "\"name\":\"thread_name\",\"args\":{\"name\":",
+                    buffer->tid);
+            out += header;
+            appendString(out, buffer->name);
+            out += "}}";
+        }
+        if (buffer->events) {
+            const uint64_t head = buffer->head.load(std::memory_order_acquire);
+            const uint64_t count = std::min(head, uint64_t(EVENTS_PER_THREAD));
+            for (uint64_t i = head - count; i < head; i++) {
+                separator();
+                appendEvent(out, buffer->tid, buffer->events[i & (EVENTS_PER_THREAD - 1)]);
+            }
+        }
+    }
+    out += "]}\n";
+    return out;
+}
+
+bool TraceRecorder::writeChromeTrace(const char* path) noexcept {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+    std::string trace(getChromeTrace());
+    bool success = fwrite(trace.data(), 1, trace.size(), file) == trace.size();
+    return (fclose(file) == 0) && success;
+}
+
+} // namespace utils
@@ -18,6 +18,7 @@
 #include <algorithm>
 #include <functional>
 #include <bitset>
+#include <thread>
 
 #include <gtest/gtest.h>
 
@@ -282,6 +283,68 @@ TEST(AllocatorTest, ScopedStackArena) {
     allocator.getAllocator().reset();
 }
 
+TEST(AllocatorTest, ScratchAllocator) {
+    constexpr size_t CHUNK_SIZE = 1024;
+    constexpr size_t CHUNK_COUNT = 64;
+    using Allocator = Arena<AtomicChunkAllocator, LockingPolicy::NoLock>;
+    // one extra chunk, for the alignment of the area
+    Allocator arena("ScratchAllocator", (CHUNK_COUNT + 1) * CHUNK_SIZE, CHUNK_SIZE);
+    AtomicChunkAllocator& chunks = arena.getAllocator();
+
+    // chunks are aligned to their size, large allocations take contiguous chunks
+    void* p = chunks.alloc(CHUNK_SIZE + 1, 16);
+    EXPECT_EQ(0u, uintptr_t(p) % CHUNK_SIZE);
+    EXPECT_EQ(2 * CHUNK_SIZE, chunks.allocated());
+
+    // 'extra' bytes are reserved before the allocation
+    void* q = chunks.alloc(8, 16, 4);
+    EXPECT_EQ(uintptr_t(p) + 2 * CHUNK_SIZE + 16, uintptr_t(q));
+    chunks.reset();
+    EXPECT_EQ(0u, chunks.allocated());
+
+    // small allocations of a ScratchAllocator are packed in a chunk
+    ScratchAllocator scratch(chunks);
+    char* a = (char*)scratch.alloc(100, 4);
+    char* b = (char*)scratch.alloc(100, 4);
+    EXPECT_EQ(a + 100, b);
+    EXPECT_EQ(CHUNK_SIZE, chunks.allocated());
+
+    // each thread gets its own chunks
+    constexpr size_t THREAD_COUNT = 4;
+    constexpr size_t ALLOC_COUNT = 256;
+    std::vector<uint32_t*> allocations[THREAD_COUNT];
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < THREAD_COUNT; t++) {
+        threads.emplace_back([&chunks, &allocations, t]() {
+            ScratchAllocator scratch(chunks);
+            for (size_t i = 0; i < ALLOC_COUNT; i++) {
+                uint32_t* p = scratch.alloc<uint32_t>(8);
+                if (p) {
+                    std::fill_n(p, 8, uint32_t(t * ALLOC_COUNT + i));
+                    allocations[t].push_back(p);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (size_t t = 0; t < THREAD_COUNT; t++) {
+        // 32 bytes per allocation, so this all fits in the area
+        ASSERT_EQ(ALLOC_COUNT, allocations[t].size());
+        for (size_t i = 0; i < ALLOC_COUNT; i++) {
+            EXPECT_EQ(uint32_t(t * ALLOC_COUNT + i), allocations[t][i][0]);
+            EXPECT_EQ(uint32_t(t * ALLOC_COUNT + i), allocations[t][i][7]);
+        }
+    }
+
+    // we fail when the area is exhausted, until it is reset
+    EXPECT_EQ(nullptr, chunks.alloc(CHUNK_COUNT * CHUNK_SIZE));
+    EXPECT_EQ(nullptr, scratch.alloc(CHUNK_SIZE, 4));
+    arena.reset();
+    EXPECT_NE(nullptr, chunks.alloc(CHUNK_COUNT * CHUNK_SIZE));
+}
+
 TEST(AllocatorTest, STLAllocator) {
     struct Tracking {
         Tracking() noexcept { }
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <utils/CpuTopology.h>
+#include <utils/Path.h>
+
+#include <initializer_list>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace utils;
+
+class CpuTopologyTest : public testing::Test {
+protected:
+    void SetUp() override {
+        char name[] = "/tmp/filament_cpu_topology_XXXXXX";
+        ASSERT_NE(nullptr, mkdtemp(name));
+        mRoot = name;
+    }
+
+    void TearDown() override {
+        remove(mRoot);
+    }
+
+    // creates a fake sysfs cpu directory with the given maximum frequencies
+    Path makeSysfs(std::initializer_list<uint32_t> frequencies) const {
+        size_t cpu = 0;
+        for (uint32_t frequency : frequencies) {
+            Path dir = mRoot.concat("cpu" + std::to_string(cpu++)).concat("cpufreq");
+            dir.mkdirRecursive();
+            FILE* file = fopen(dir.concat("cpuinfo_max_freq").c_str(), "w");
+            fprintf(file, "%u\n", frequency);
+            fclose(file);
+        }
+        return mRoot;
+    }
+
+private:
+    static void remove(Path path) {
+        if (path.isDirectory()) {
+            for (const Path& child : path.listContents()) {
+                remove(child);
+            }
+            rmdir(path.c_str());
+        } else {
+            path.unlinkFile();
+        }
+    }
+
+    Path mRoot;
+};
+
+TEST_F(CpuTopologyTest, BigLittle) {
+    Path root = makeSysfs({ 1900800, 1900800, 1900800, 1900800,
+                            2457600, 2457600, 2457600, 2457600 });
+    CpuTopology topology(root.c_str(), 8);
+    EXPECT_EQ(8, topology.getCpuCount());
+    EXPECT_EQ(2, topology.getClusterCount());
+    EXPECT_TRUE(topology.isHeterogeneous());
+    EXPECT_EQ(0xF0, topology.getBigCoresMask());
+    EXPECT_EQ(0x0F, topology.getLittleCoresMask());
+    EXPECT_EQ(2457600, topology.getCluster(0).maxFrequency);
+    EXPECT_EQ(0xFF, topology.getAllCoresMask());
+}
+
+TEST_F(CpuTopologyTest, ThreeClusters) {
+    Path root = makeSysfs({ 1800000, 1800000, 2400000, 2400000, 2800000 });
+    CpuTopology topology(root.c_str(), 5);
+    EXPECT_EQ(3, topology.getClusterCount());
+    EXPECT_EQ(0x10, topology.getBigCoresMask());
+    EXPECT_EQ(0x0C, topology.getCluster(1).mask);
+    EXPECT_EQ(0x03, topology.getLittleCoresMask());
+}
+
+TEST_F(CpuTopologyTest, Homogeneous) {
+    Path root = makeSysfs({ 2000000, 2000000, 2000000, 2000000 });
+    CpuTopology topology(root.c_str(), 4);
+    EXPECT_EQ(1, topology.getClusterCount());
+    EXPECT_FALSE(topology.isHeterogeneous());
+    EXPECT_EQ(0x0F, topology.getBigCoresMask());
+    EXPECT_EQ(0x0F, topology.getLittleCoresMask());
+}
+
+TEST_F(CpuTopologyTest, Unknown) {
+    // no frequencies available: a single cluster with all the CPUs
+    CpuTopology topology("/this/path/does/not/exist", 6);
+    EXPECT_EQ(6, topology.getCpuCount());
+    EXPECT_EQ(1, topology.getClusterCount());
+    EXPECT_EQ(0x3F, topology.getBigCoresMask());
+    EXPECT_EQ(0, topology.getCluster(0).maxFrequency);
+}
@@ -176,3 +176,60 @@ TEST(EntityTest, NameComponent) {
 
     cm.gc(em);
 }
+
+TEST(EntityTest, BatchCreate) {
+    EntityManagerImpl em;
+    Entity entities[4096];
+
+    // batches of fresh indices are contiguous
+    em.create(4096, entities);
+    for (size_t i = 0; i < 4096; i++) {
+        EXPECT_EQ(EntityManagerImpl::makeIdentity(0, i + 1), entities[i].getId());
+    }
+
+    // indices are reused while the free-list is long enough, then fresh ones are used again
+    em.destroy(4096, entities);
+    em.create(4096, entities);
+    for (size_t i = 0; i < 4096; i++) {
+        EXPECT_TRUE(em.isAlive(entities[i]));
+        EXPECT_EQ(i <= 4096 - MIN_FREE_INDICES ? 1 : 0,
+                EntityManagerImpl::getGeneration(entities[i]));
+    }
+    em.destroy(4096, entities);
+}
+
+TEST(EntityTest, TrackedGc) {
+    struct Manager : public SingleInstanceComponentManager<int> {
+        using SingleInstanceComponentManager::addComponent;
+        using SingleInstanceComponentManager::getComponentCount;
+        using SingleInstanceComponentManager::gc;
+        using SingleInstanceComponentManager::hasComponent;
+        using SingleInstanceComponentManager::trackDestroyedEntities;
+    };
+
+    EntityManagerImpl em;
+    Manager cm;
+    cm.trackDestroyedEntities(em);
+
+    Entity entities[1000];
+    em.create(1000, entities);
+    for (size_t i = 0; i < 1000; i += 2) {
+        cm.addComponent(entities[i]);
+    }
+    EXPECT_EQ(500, cm.getComponentCount());
+
+    // every destroyed entity is collected in one gc, the others are untouched
+    em.destroy(500, entities);
+    cm.gc(em);
+    EXPECT_EQ(250, cm.getComponentCount());
+    for (size_t i = 0; i < 1000; i += 2) {
+        EXPECT_EQ(i >= 500, cm.hasComponent(entities[i]));
+    }
+
+    cm.gc(em);
+    EXPECT_EQ(250, cm.getComponentCount());
+
+    em.clear();
+    cm.gc(em);
+    EXPECT_EQ(0, cm.getComponentCount());
+}
@@ -22,8 +22,11 @@
 #include <math/vec3.h>
 #include <math/mat3.h>
 
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <thread>
+#include <vector>
 #include <utils/Allocator.h>
 
 using namespace utils;
@@ -341,5 +344,182 @@ TEST(JobSystem, JobSystemDelegates) {
     EXPECT_EQ(4, functor.result);
 
 
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemPriorities) {
+    JobSystem js;
+    js.adopt();
+
+    // This thread must pick all its high priority jobs before any low priority one. Worker
+    // threads may steal some of either, but can't make a high priority job appear later.
+    struct User {
+        std::thread::id thread;
+        std::vector<bool>* order;
+        bool high;
+        void func(JobSystem&, JobSystem::Job*) {
+            if (std::this_thread::get_id() == thread) {
+                order->push_back(high);
+            }
+        };
+    };
+
+    std::vector<bool> order;
+    std::vector<User> users(128);
+    JobSystem::Job* root = js.createJob();
+    for (size_t i = 0; i < users.size(); i++) {
+        users[i] = { std::this_thread::get_id(), &order, i >= 64 };
+        JobSystem::Job* job = js.createJob<User, &User::func>(root, &users[i]);
+        js.run(job, users[i].high ? 0 : JobSystem::LOW_PRIORITY);
+    }
+    js.run(root, JobSystem::LOW_PRIORITY);
+    js.wait(root);
+
+    EXPECT_TRUE(std::is_sorted(order.begin(), order.end(), std::greater<bool>()));
+
+    // children created by a low priority job inherit its priority
+    std::atomic_int count = { 0 };
+    JobSystem::Job* background = jobs::createJob(js, nullptr, [&js, &count]() {
+        auto job = jobs::parallel_for(js, nullptr, 0, 1024,
+                [&count](uint32_t, uint32_t n) { count += n; }, jobs::CountSplitter<16>());
+        js.runAndWait(job);
+    });
+    js.run(background, JobSystem::LOW_PRIORITY);
+    js.wait(background);
+    EXPECT_EQ(1024, count.load());
+
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemJobPoolGrowth) {
+    JobSystem js;
+    js.adopt();
+
+    // create jobs until the pool is exhausted, this takes several blocks
+    std::atomic_int calls = { 0 };
+    JobSystem::Job* root = js.createJob();
+    std::vector<JobSystem::Job*> children;
+    while (children.size() < 100000) {
+        JobSystem::Job* job = js.createJob(root, [&calls](JobSystem&, JobSystem::Job*) {
+            calls++;
+        });
+        if (!job) {
+            break;
+        }
+        children.push_back(job);
+    }
+    EXPECT_GT(children.size(), 4096u);
+    EXPECT_LT(children.size(), 100000u);
+    EXPECT_EQ(1u, js.getJobOverflowCount());
+
+    // this overflows this thread's queue, the extra jobs are executed right away
+    for (JobSystem::Job* job : children) {
+        js.run(job);
+    }
+    js.runAndWait(root);
+    EXPECT_EQ(children.size(), size_t(calls.load()));
+    EXPECT_GT(js.getJobOverflowCount(), 1u);
+
+    // all jobs are available again
+    root = js.createJob();
+    for (size_t i = 0; i < children.size() - 1; i++) {
+        JobSystem::Job* job = js.createJob(root);
+        ASSERT_NE(nullptr, job);
+        js.run(job, JobSystem::DONT_SIGNAL);
+    }
+    js.runAndWait(root);
+
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemIdleSpinning) {
+    // Bursts of small jobs must complete whether the workers are still spinning when they're
+    // submitted, or have already gone to sleep (see filament_benchmark for the latency).
+    JobSystem js;
+    js.adopt();
+
+    std::vector<uint32_t> data(2048);
+    auto burst = [&js, &data]() {
+        auto job = parallel_for(js, nullptr, 0, uint32_t(data.size()),
+                [&data](uint32_t start, uint32_t count) {
+                    for (uint32_t i = start; i < start + count; i++) {
+                        data[i]++;
+                    }
+                }, CountSplitter<64>());
+        js.runAndWait(job);
+    };
+
+    uint32_t bursts = 0;
+
+    // back to back, the workers are still spinning when the next burst is submitted
+    js.setIdleSpinTime(100000);
+    for (size_t i = 0; i < 100; i++, bursts++) {
+        burst();
+    }
+
+    // idle for longer than the spin time, the workers are asleep
+    js.setIdleSpinTime(50);
+    for (size_t i = 0; i < 10; i++, bursts++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        burst();
+    }
+
+    // without spinning, the workers go to sleep right away
+    js.setIdleSpinTime(0);
+    for (size_t i = 0; i < 100; i++, bursts++) {
+        burst();
+    }
+
+    for (uint32_t value : data) {
+        EXPECT_EQ(bursts, value);
+    }
+
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemParallelReduce) {
+    JobSystem js;
+    js.adopt();
+
+    std::vector<uint32_t> data(100000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = uint32_t(i);
+    }
+
+    // chunks are reduced in order, so the last one always comes last
+    struct Sum {
+        uint64_t sum = 0;
+        uint32_t end = 0;
+    };
+    auto sum = parallel_reduce(js, nullptr, 0, uint32_t(data.size()), Sum{},
+            [&data](uint32_t start, uint32_t count, Sum& partial) {
+                for (uint32_t i = start; i < start + count; i++) {
+                    partial.sum += data[i];
+                }
+                partial.end = start + count;
+            },
+            [](Sum& result, Sum const& partial) {
+                EXPECT_LT(result.end, partial.end);
+                result.sum += partial.sum;
+                result.end = partial.end;
+            }, CountSplitter<64>());
+    EXPECT_EQ(uint64_t(data.size()) * (data.size() - 1) / 2, sum.sum);
+    EXPECT_EQ(data.size(), sum.end);
+
+    // small ranges don't create jobs
+    auto small = parallel_reduce(js, nullptr, 10, 20, 0u,
+            [](uint32_t start, uint32_t count, uint32_t& partial) { partial += count; },
+            [](uint32_t& result, uint32_t partial) { result += partial; }, CountSplitter<64>());
+    EXPECT_EQ(20u, small);
+
+    // aligned chunks start at multiples of the alignment, except the first one
+    auto aligned = parallel_reduce(js, nullptr, 3, 10000, true,
+            [](uint32_t start, uint32_t count, bool& partial) {
+                partial = start == 3 || (start % 64) == 0;
+            },
+            [](bool& result, bool partial) { result = result && partial; },
+            AlignedSplitter<8, 64>());
+    EXPECT_TRUE(aligned);
+
     js.emancipate();
 }
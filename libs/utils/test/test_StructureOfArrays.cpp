@@ -170,3 +170,54 @@ TEST(StructureOfArraysTest, Simple) {
     soa.push_back(0.0f, 1.0, std::move(destroyedFloat4));
 }
 
+
+TEST(StructureOfArraysTest, CacheLines) {
+    using CacheLineSoA = utils::StructureOfArrays<uint8_t, float3, float4>;
+    EXPECT_EQ(CACHELINE_SIZE, CacheLineSoA::getCacheLineElementCount());
+    EXPECT_EQ(CACHELINE_SIZE / 4, SoA::getCacheLineElementCount());
+
+    CacheLineSoA soa;
+    soa.setCapacity(13);
+    EXPECT_EQ(0u, uintptr_t(soa.data<0>()) % CACHELINE_SIZE);
+    EXPECT_EQ(0u, uintptr_t(soa.data<1>()) % CACHELINE_SIZE);
+    EXPECT_EQ(0u, uintptr_t(soa.data<2>()) % CACHELINE_SIZE);
+}
+
+TEST(StructureOfArraysTest, BulkOperations) {
+    using MaskSoA = utils::StructureOfArrays<uint8_t, uint32_t>;
+    EXPECT_EQ(CACHELINE_SIZE, MaskSoA::getPaddingElementCount());
+    EXPECT_EQ(16u, SoA::getPaddingElementCount());
+    EXPECT_EQ(0u, MaskSoA::getPaddedSize(0));
+    EXPECT_EQ(CACHELINE_SIZE, MaskSoA::getPaddedSize(1));
+    EXPECT_EQ(32u, SoA::getPaddedSize(17));
+
+    MaskSoA soa;
+    soa.setPaddedCapacity(100);
+    EXPECT_EQ(MaskSoA::getPaddedSize(100), soa.capacity());
+
+    soa.resize(100);
+    soa.fill<0>(0, 0, 100);
+    soa.fill<0>(3, 10, 20);
+    for (size_t i = 0; i < soa.size(); i++) {
+        soa.elementAt<1>(i) = uint32_t(i * 2);
+        EXPECT_EQ((i >= 10 && i < 30) ? 3 : 0, soa.elementAt<0>(i));
+    }
+    soa.elementAt<0>(50) = 2;
+    soa.elementAt<0>(99) = 4;
+
+    uint32_t indices[100];
+    EXPECT_EQ(21u, soa.compact<0>(indices, 2, 0, 100));
+    EXPECT_EQ(10u, indices[0]);
+    EXPECT_EQ(29u, indices[19]);
+    EXPECT_EQ(50u, indices[20]);
+    EXPECT_EQ(1u, soa.compact<0>(indices, 4, 60, 40));
+    EXPECT_EQ(99u, indices[0]);
+    EXPECT_EQ(0u, soa.compact<0>(indices, 0xF0, 0, 100));
+
+    uint32_t values[21];
+    size_t count = soa.compact<0>(indices, 2, 0, 100);
+    soa.gather<1>(values, indices, count);
+    EXPECT_EQ(20u, values[0]);
+    EXPECT_EQ(58u, values[19]);
+    EXPECT_EQ(100u, values[20]);
+}
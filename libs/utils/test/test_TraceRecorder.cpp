@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <utils/JobSystem.h>
+#include <utils/TraceRecorder.h>
+
+#include <string>
+
+using namespace utils;
+
+static size_t count(std::string const& s, const char* pattern) {
+    size_t n = 0;
+    for (size_t i = s.find(pattern); i != std::string::npos; i = s.find(pattern, i + 1)) {
+        n++;
+    }
+    return n;
+}
+
+TEST(TraceRecorderTest, ChromeTrace) {
+    TraceRecorder::begin("before start");
+    TraceRecorder::stop();
+
+    TraceRecorder::start();
+    EXPECT_TRUE(TraceRecorder::isRecording());
+    EXPECT_FALSE(TraceRecorder::isRecording(0));
+    TraceRecorder::setThreadName("test \"thread\"");
+    {
+        TraceRecorder::Scope scope(1, "scope");
+        TraceRecorder::value("counter", 42);
+        TraceRecorder::asyncBegin("async", 7);
+    }
+    {
+        TraceRecorder::Scope scope(0, "never");
+    }
+    TraceRecorder::asyncEnd("async", 7);
+    TraceRecorder::stop();
+    TraceRecorder::Scope afterStop(1, "after stop");
+
+    std::string trace = TraceRecorder::getChromeTrace();
+    EXPECT_EQ(0, trace.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+    EXPECT_EQ(0, count(trace, "before start"));
+    EXPECT_EQ(0, count(trace, "never"));
+    EXPECT_EQ(0, count(trace, "after stop"));
+    EXPECT_EQ(1, count(trace, "\"name\":\"test \\\"thread\\\"\""));
+    EXPECT_EQ(1, count(trace, "\"ph\":\"B\""));
+    EXPECT_EQ(1, count(trace, "\"ph\":\"E\""));
+    EXPECT_EQ(1, count(trace, "\"name\":\"counter\",\"args\":{\"value\":42}"));
+    EXPECT_EQ(1, count(trace, "\"ph\":\"b\""));
+    EXPECT_EQ(1, count(trace, "\"ph\":\"e\""));
+    EXPECT_EQ(2, count(trace, "\"cat\":\"async\",\"id\":7"));
+}
+
+TEST(TraceRecorderTest, RingBuffer) {
+    TraceRecorder::start();
+    for (size_t i = 0; i < TraceRecorder::EVENTS_PER_THREAD + 10; i++) {
+        TraceRecorder::value(i < 10 ? "old" : "new", int64_t(i));
+    }
+    TraceRecorder::stop();
+
+    std::string trace = TraceRecorder::getChromeTrace();
+    EXPECT_EQ(0, count(trace, "\"name\":\"old\""));
+    EXPECT_EQ(TraceRecorder::EVENTS_PER_THREAD, count(trace, "\"name\":\"new\""));
+}
+
+TEST(TraceRecorderTest, JobSystem) {
+    JobSystem js(4);
+    js.adopt();
+
+    TraceRecorder::start();
+    JobSystem::Job* root = js.createJob();
+    for (size_t i = 0; i < 16; i++) {
+        js.run(jobs::createJob(js, root, []() { }));
+    }
+    js.runAndWait(root);
+    TraceRecorder::stop();
+
+    std::string trace = TraceRecorder::getChromeTrace();
+    EXPECT_EQ(16, count(trace, "\"name\":\"job\""));
+
+    js.emancipate();
+}
@@ -25,6 +25,9 @@
 #include <filament/Texture.h>
 #include <filament/Skybox.h>
 
+#include <image/KtxUtility.h>
+#include <imageio/KtxLoader.h>
+
 #include <stb_image.h>
 
 #include <utils/Path.h>
@@ -61,6 +64,42 @@ bool IBL::loadFromDirectory(const utils::Path& path) {
         return false;
     }
 
+    // Prefer the KTX cubemaps written by cmgen --format=ktx, they are uploaded without copies
+    if (!loadFromKtx(path)) {
+        if (!loadFromImages(path)) return false;
+    }
+
+    mIndirectLight = IndirectLight::Builder()
+            .reflections(mTexture)
+            .irradiance(3, mBands)
+            .intensity(30000.0f)
+            .build(mEngine);
+
+    mSkybox = Skybox::Builder().environment(mSkyboxTexture).showSun(true).build(mEngine);
+
+    return true;
+}
+
+bool IBL::loadFromKtx(const utils::Path& path) {
+    Path iblPath(Path::concat(path, "ibl.ktx"));
+    Path skyPath(Path::concat(path, "skybox.ktx"));
+    if (!iblPath.exists() || !skyPath.exists()) {
+        return false;
+    }
+
+    auto ibl = image::loadKtx(iblPath.getAbsolutePath());
+    auto sky = image::loadKtx(skyPath.getAbsolutePath());
+    if (!ibl || !sky || !ibl->isCubemap() || !sky->isCubemap()) {
+        return false;
+    }
+
+    // uncompressed cmgen cubemaps are RGBM encoded
+    mTexture = image::ktx::createTexture(&mEngine, ibl, true);
+    mSkyboxTexture = image::ktx::createTexture(&mEngine, sky, true);
+    return true;
+}
+
+bool IBL::loadFromImages(const utils::Path& path) {
     // Read mip-mapped cubemap
     if (!loadCubemapLevel(&mTexture, path, 0, "m0_")) return false;
     size_t numLevels = mTexture->getLevels();
@@ -72,14 +111,6 @@ bool IBL::loadFromDirectory(const utils::Path& path) {
 
     if (!loadCubemapLevel(&mSkyboxTexture, path)) return false;
 
-    mIndirectLight = IndirectLight::Builder()
-            .reflections(mTexture)
-            .irradiance(3, mBands)
-            .intensity(30000.0f)
-            .build(mEngine);
-
-    mSkybox = Skybox::Builder().environment(mSkyboxTexture).showSun(true).build(mEngine);
-
     return true;
 }
 
@@ -50,6 +50,9 @@ public:
     }
 
 private:
+    bool loadFromKtx(const utils::Path& path);
+    bool loadFromImages(const utils::Path& path);
+
     bool loadCubemapLevel(filament::Texture** texture, const utils::Path& path,
             size_t level = 0, std::string const& levelPrefix = "") const;
 
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Impostor.h"
+
+#include <algorithm>
+
+#include <filament/Camera.h>
+#include <filament/Color.h>
+#include <filament/Engine.h>
+#include <filament/IndexBuffer.h>
+#include <filament/Material.h>
+#include <filament/MaterialInstance.h>
+#include <filament/Renderer.h>
+#include <filament/Scene.h>
+#include <filament/Texture.h>
+#include <filament/TextureSampler.h>
+#include <filament/TransformManager.h>
+#include <filament/VertexBuffer.h>
+#include <filament/View.h>
+#include <filament/Viewport.h>
+
+#include <math/mat4.h>
+#include <math/vec2.h>
+#include <math/vec3.h>
+
+using namespace filament;
+using namespace math;
+
+// the quad, turned towards the camera by the material
+static const float3 QUAD_VERTICES[] = {
+        { -1, -1, 0 }, {  1, -1, 0 }, { -1,  1, 0 }, {  1,  1, 0 } };
+static const uint16_t QUAD_INDICES[] = { 0, 1, 2, 2, 1, 3 };
+
+// The octahedral mapping of the directions, with y as the pole axis. This must match
+// materials/impostor.mat.
+static float2 signNotZero(float2 v) {
+    return { v.x >= 0 ? 1.0f : -1.0f, v.y >= 0 ? 1.0f : -1.0f };
+}
+
+static float3 octahedralDecode(float2 p) {
+    float3 n = { p.x, 1.0f - std::abs(p.x) - std::abs(p.y), p.y };
+    if (n.y < 0) {
+        const float2 s = signNotZero({ n.x, n.z });
+        const float2 a = { std::abs(n.z), std::abs(n.x) };
+        n.x = (1.0f - a.x) * s.x;
+        n.z = (1.0f - a.y) * s.y;
+    }
+    return normalize(n);
+}
+
+Impostor::Impostor(Engine& engine, Material const* material, Box const& bounds,
+        size_t gridSize, size_t frameSize)
+        : mEngine(engine), mBounds(bounds), mGridSize(gridSize), mFrameSize(frameSize) {
+
+    mVertexBuffer = VertexBuffer::Builder()
+            .vertexCount(4)
+            .bufferCount(1)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+            .build(engine);
+    mVertexBuffer->setBufferAt(engine, 0,
+            VertexBuffer::BufferDescriptor(QUAD_VERTICES, sizeof(QUAD_VERTICES)));
+
+    mIndexBuffer = IndexBuffer::Builder()
+            .indexCount(6)
+            .bufferType(IndexBuffer::IndexType::USHORT)
+            .build(engine);
+    mIndexBuffer->setBuffer(engine,
+            IndexBuffer::BufferDescriptor(QUAD_INDICES, sizeof(QUAD_INDICES)));
+
+    // no mipmaps, they would blend neighbouring pictures
+    const size_t size = mGridSize * mFrameSize;
+    mAtlas = Texture::Builder()
+            .width(uint32_t(size))
+            .height(uint32_t(size))
+            .levels(1)
+            .format(Texture::InternalFormat::RGBA8)
+            .build(engine);
+
+    mMaterialInstance = material->createInstance();
+    mMaterialInstance->setParameter("atlas", mAtlas,
+            TextureSampler(TextureSampler::MagFilter::LINEAR));
+    mMaterialInstance->setParameter("center", bounds.center);
+    mMaterialInstance->setParameter("radius", length(bounds.halfExtent));
+    mMaterialInstance->setParameter("gridSize", float(mGridSize));
+}
+
+Impostor::~Impostor() {
+    mEngine.destroy(mVertexBuffer);
+    mEngine.destroy(mIndexBuffer);
+    mEngine.destroy(mMaterialInstance);
+    mEngine.destroy(mAtlas);
+    delete[] mPixels;
+}
+
+void Impostor::addLevel(RenderableManager::Builder& builder, size_t index, uint8_t level,
+        float screenCoverage) const {
+    builder.geometry(index, RenderableManager::PrimitiveType::TRIANGLES,
+                    mVertexBuffer, mIndexBuffer)
+            .material(index, mMaterialInstance)
+            .levelOfDetail(level, index, screenCoverage);
+}
+
+void Impostor::capture(Renderer* renderer, Scene* scene, utils::Entity entity) {
+    if (mCaptured) {
+        return;
+    }
+    mCaptured = true;
+
+    auto& tcm = mEngine.getTransformManager();
+    const mat4f transform = tcm.getWorldTransform(tcm.getInstance(entity));
+    const mat3f m = transform.upperLeft();
+    const float3 center = (transform * float4{ mBounds.center, 1 }).xyz;
+    const float scale = std::max({ length(m[0]), length(m[1]), length(m[2]) });
+    const float radius = length(mBounds.halfExtent) * scale;
+
+    Camera* camera = mEngine.createCamera();
+    camera->setProjection(Camera::Projection::ORTHO,
+            -radius, radius, -radius, radius, 0.5f * radius, 3.5f * radius);
+
+    View* view = mEngine.createView();
+    view->setName("impostor");
+    view->setScene(scene);
+    view->setCamera(camera);
+    view->setViewport({ 0, 0, uint32_t(mFrameSize), uint32_t(mFrameSize) });
+    view->setClearColor({ 0, 0, 0, 0 });
+    // the pictures are tone-mapped when the impostor is rendered
+    view->setPostProcessingEnabled(false);
+
+    const size_t n = mGridSize;
+    const size_t atlasSize = n * mFrameSize;
+    mPixels = new uint8_t[atlasSize * atlasSize * 4];
+    mPendingFrames = n * n;
+
+    for (size_t j = 0; j < n; j++) {
+        for (size_t i = 0; i < n; i++) {
+            // the direction of the picture (i, j) and the basis of its camera, in model space
+            const float2 p = (float2{ float(i), float(j) } + 0.5f) / float(n) * 2.0f - 1.0f;
+            const float3 f = octahedralDecode(p);
+            const float3 up = std::abs(f.y) > 0.999f ? float3{ 0, 0, -1 } : float3{ 0, 1, 0 };
+            const float3 eye = center + normalize(m * f) * (2.0f * radius);
+            camera->lookAt(eye, center, normalize(m * up));
+
+            renderer->render(view);
+
+            // the pictures are read in the atlas directly, with top-down rows
+            renderer->readPixels(0, 0, uint32_t(mFrameSize), uint32_t(mFrameSize),
+                    driver::PixelBufferDescriptor(mPixels, atlasSize * atlasSize * 4,
+                            driver::PixelDataFormat::RGBA, driver::PixelDataType::UBYTE, 1,
+                            uint32_t(i * mFrameSize), uint32_t(j * mFrameSize),
+                            uint32_t(atlasSize), &Impostor::onFrameCaptured, this));
+        }
+    }
+
+    mEngine.destroy(view);
+    mEngine.destroy(camera);
+}
+
+void Impostor::onFrameCaptured(void*, size_t, void* user) {
+    // this is called by the driver, the atlas is uploaded by update()
+    Impostor* impostor = static_cast<Impostor*>(user);
+    impostor->mPendingFrames--;
+}
+
+bool Impostor::update() {
+    if (!mReady && mCaptured && mPendingFrames.load() == 0) {
+        const size_t size = mGridSize * mFrameSize;
+        mAtlas->setImage(mEngine, 0, Texture::PixelBufferDescriptor(
+                mPixels, size * size * 4,
+                Texture::Format::RGBA, Texture::Type::UBYTE,
+                [](void* buffer, size_t, void*) { delete[] static_cast<uint8_t*>(buffer); }));
+        mPixels = nullptr;
+        mReady = true;
+    }
+    return mReady;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_SAMPLE_IMPOSTOR_H
+#define TNT_FILAMENT_SAMPLE_IMPOSTOR_H
+
+#include <atomic>
+
+#include <filament/Box.h>
+#include <filament/RenderableManager.h>
+
+#include <utils/Entity.h>
+
+namespace filament {
+class Camera;
+class Engine;
+class IndexBuffer;
+class Material;
+class MaterialInstance;
+class Renderer;
+class Scene;
+class Texture;
+class VertexBuffer;
+class View;
+} // namespace filament
+
+/*
+ * An octahedral impostor replaces a renderable seen from far away by a single quad, which shows
+ * a picture of the renderable taken from the nearest of gridSize x gridSize directions spread
+ * over the sphere. The pictures are stored in an atlas, where the direction of a picture is the
+ * octahedral mapping of its position.
+ *
+ * The quad is added as the last level of detail of the renderable with addLevel(), and the
+ * atlas is captured at runtime from the renderable itself with capture(). The quad is rendered
+ * with materials/impostor.mat, which turns it towards the camera in its vertex shader.
+ *
+ * Typical use:
+ *
+ *  Impostor impostor(*engine, impostorMaterial, aabb);
+ *  RenderableManager::Builder builder(count + 1);
+ *  // ... the primitives [0, count) of the renderable
+ *  impostor.addLevel(builder, count, 1, 0.05f);
+ *  builder.build(*engine, entity);
+ *
+ *  // once, e.g. in the post-render callback, with a scene holding the entity and its lights
+ *  impostor.capture(renderer, captureScene, entity);
+ *
+ *  // each frame, on the main thread
+ *  impostor.update();
+ */
+class Impostor {
+public:
+    // bounds is the bounding box of the renderable in model space. The impostor must not be
+    // destroyed before update() returned true, once capture() was called.
+    Impostor(filament::Engine& engine, filament::Material const* material,
+            filament::Box const& bounds, size_t gridSize = 8, size_t frameSize = 128);
+    ~Impostor();
+
+    Impostor(Impostor const&) = delete;
+    Impostor& operator=(Impostor const&) = delete;
+
+    // Adds the impostor quad as the primitive 'index' of the builder, and makes it the level of
+    // detail 'level', used below 'screenCoverage' (see RenderableManager::Builder).
+    void addLevel(filament::RenderableManager::Builder& builder, size_t index, uint8_t level,
+            float screenCoverage) const;
+
+    // Renders the pictures of the entity in the atlas, with the given scene and the current
+    // world transform of the entity. This must be called once, between Renderer::beginFrame()
+    // and Renderer::endFrame() and after the views of the frame were rendered: the pictures are
+    // rendered in the bottom-left corner of the swap chain, which must be at least frameSize
+    // large.
+    void capture(filament::Renderer* renderer, filament::Scene* scene, utils::Entity entity);
+
+    // Uploads the atlas once all the pictures were read back, returns true when the atlas is
+    // ready. This must be called on the engine's thread.
+    bool update();
+
+    filament::MaterialInstance* getMaterialInstance() const noexcept { return mMaterialInstance; }
+    filament::Texture* getAtlas() const noexcept { return mAtlas; }
+
+private:
+    static void onFrameCaptured(void* buffer, size_t size, void* user);
+
+    filament::Engine& mEngine;
+    filament::Box mBounds;
+    size_t mGridSize;
+    size_t mFrameSize;
+
+    filament::VertexBuffer* mVertexBuffer = nullptr;
+    filament::IndexBuffer* mIndexBuffer = nullptr;
+    filament::MaterialInstance* mMaterialInstance = nullptr;
+    filament::Texture* mAtlas = nullptr;
+
+    // the atlas being read back, RGBA8 with top-down rows
+    uint8_t* mPixels = nullptr;
+    std::atomic<size_t> mPendingFrames = { 0 };
+    bool mCaptured = false;
+    bool mReady = false;
+};
+
+#endif // TNT_FILAMENT_SAMPLE_IMPOSTOR_H
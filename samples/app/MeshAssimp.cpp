@@ -16,7 +16,20 @@
 
 #include "MeshAssimp.h"
 
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include <fcntl.h>
 #include <string.h>
+#if !defined(WIN32)
+#    include <sys/mman.h>
+#    include <unistd.h>
+#else
+#    include <io.h>
+#endif
 
 #include <filament/Color.h>
 #include <filament/VertexBuffer.h>
@@ -30,6 +43,9 @@
 
 #include <math/norm.h>
 
+#include <utils/Hash.h>
+#include <utils/JobSystem.h>
+
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/cimport.h>
@@ -66,7 +82,7 @@ MeshAssimp::~MeshAssimp() {
 template<typename T>
 struct State {
     std::vector<T> state;
-    State(std::vector<T>&& state) : state(state) { }
+    State(std::vector<T>&& state) : state(std::move(state)) { }
     static void free(void* buffer, size_t size, void* user) {
         auto* const that = (State<T>*)user;
         delete that;
@@ -75,13 +91,105 @@ struct State {
     T const * data() const { return state.data(); }
 };
 
+template<typename T>
+static driver::BufferDescriptor makeBuffer(std::vector<T>&& data) {
+    auto* const s = new State<T>(std::move(data));
+    return driver::BufferDescriptor(s->data(), s->size(), s->free, s);
+}
+
+// The content of a whole file, mapped in memory where the platform allows it.
+class FileData {
+public:
+    explicit FileData(const Path& path) noexcept {
+#if !defined(WIN32)
+        int fd = open(path.c_str(), O_RDONLY);
+#else
+        int fd = open(path.c_str(), O_RDONLY | O_BINARY);
+#endif
+        if (fd < 0) {
+            return;
+        }
+        const off_t size = lseek(fd, 0, SEEK_END);
+        lseek(fd, 0, SEEK_SET);
+        if (size > 0) {
+#if !defined(WIN32)
+            void* data = mmap(nullptr, size_t(size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                mData = static_cast<uint8_t const*>(data);
+                mSize = size_t(size);
+            }
+#else
+            uint8_t* data = (uint8_t*) malloc(size_t(size));
+            if (data && read(fd, data, unsigned(size)) == size) {
+                mData = data;
+                mSize = size_t(size);
+            } else {
+                free(data);
+            }
+#endif
+        }
+        close(fd);
+    }
+
+    ~FileData() noexcept {
+#if !defined(WIN32)
+        if (mData) {
+            munmap(const_cast<uint8_t*>(mData), mSize);
+        }
+#else
+        free(const_cast<uint8_t*>(mData));
+#endif
+    }
+
+    FileData(FileData const&) = delete;
+    FileData& operator=(FileData const&) = delete;
+
+    uint8_t const* data() const noexcept { return mData; }
+    size_t size() const noexcept { return mSize; }
+
+private:
+    uint8_t const* mData = nullptr;
+    size_t mSize = 0;
+};
+
+// The buffers uploaded from a cache file point into it, it's released with the last of them.
+struct SharedFileData {
+    FileData file;
+    std::atomic<uint32_t> users;
+    SharedFileData(const Path& path, uint32_t users) : file(path), users(users) { }
+    static void release(void* buffer, size_t size, void* user) {
+        auto* const that = (SharedFileData*)user;
+        if (that->users.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete that;
+        }
+    }
+};
+
+// The size of the file in the upper 32 bits and its murmur3 hash in the lower bits, 0 when the
+// file can't be read.
+static uint64_t hashFile(const Path& path) {
+    FileData file(path);
+    const size_t wordCount = file.size() / 4;
+    if (!wordCount) {
+        return 0;
+    }
+    uint32_t hash = hash::murmur3((uint32_t const*) file.data(), wordCount, 0);
+    uint32_t tail = 0;
+    memcpy(&tail, file.data() + wordCount * 4, file.size() - wordCount * 4);
+    hash = hash::murmur3(&tail, 1, hash);
+    return (uint64_t(file.size()) << 32) | hash;
+}
+
 void MeshAssimp::addFromFile(const Path& path,
         std::map<std::string, MaterialInstance*>& materials, bool overrideMaterial) {
 
     std::vector<Mesh> meshes;
     std::vector<int> parents;
 
-    { // This scope to make sure we're not using std::move()'d objects later
+    const Path cachePath(path.getPath() + ".meshcache");
+    const uint64_t sourceHash = hashFile(path);
+
+    if (!sourceHash || !loadFromCache(cachePath, sourceHash, meshes, parents)) {
         std::vector<uint32_t> indices;
         std::vector<half4> positions;
         std::vector<short4> tangents;
@@ -95,32 +203,16 @@ void MeshAssimp::addFromFile(const Path& path,
             return;
         }
 
-        mVertexBuffer = VertexBuffer::Builder()
-                .vertexCount((uint32_t)positions.size())
-                .bufferCount(3)
-                .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::HALF4)
-                .attribute(VertexAttribute::TANGENTS, 1, VertexBuffer::AttributeType::SHORT4)
-                .attribute(VertexAttribute::UV0,      2, VertexBuffer::AttributeType::HALF2)
-                .normalized(VertexAttribute::TANGENTS)
-                .build(mEngine);
-
-        auto ps = new State<half4>(std::move(positions));
-        auto ns = new State<short4>(std::move(tangents));
-        auto ts = new State<half2>(std::move(texCoords));
-        auto is = new State<uint32_t>(std::move(indices));
-
-        mVertexBuffer->setBufferAt(mEngine, 0,
-                VertexBuffer::BufferDescriptor(ps->data(), ps->size(), ps->free, ps));
-
-        mVertexBuffer->setBufferAt(mEngine, 1,
-                VertexBuffer::BufferDescriptor(ns->data(), ns->size(), ns->free, ns));
-
-        mVertexBuffer->setBufferAt(mEngine, 2,
-                VertexBuffer::BufferDescriptor(ts->data(), ts->size(), ts->free, ts));
+        if (sourceHash) {
+            saveToCache(cachePath, sourceHash,
+                    indices, positions, tangents, texCoords, meshes, parents);
+        }
 
-        mIndexBuffer = IndexBuffer::Builder().indexCount(uint32_t(indices.size())).build(mEngine);
-        mIndexBuffer->setBuffer(mEngine,
-                IndexBuffer::BufferDescriptor(is->data(), is->size(), is->free, is));
+        const size_t vertexCount = positions.size();
+        const size_t indexCount = indices.size();
+        createBuffers(vertexCount, indexCount,
+                makeBuffer(std::move(positions)), makeBuffer(std::move(tangents)),
+                makeBuffer(std::move(texCoords)), makeBuffer(std::move(indices)));
     }
 
     mDefaultColorMaterial = Material::Builder()
@@ -200,6 +292,208 @@ void MeshAssimp::addFromFile(const Path& path,
     }
 }
 
+void MeshAssimp::createBuffers(size_t vertexCount, size_t indexCount,
+        driver::BufferDescriptor&& positions,
+        driver::BufferDescriptor&& tangents,
+        driver::BufferDescriptor&& texCoords,
+        driver::BufferDescriptor&& indices) {
+    mVertexBuffer = VertexBuffer::Builder()
+            .vertexCount(uint32_t(vertexCount))
+            .bufferCount(3)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::HALF4)
+            .attribute(VertexAttribute::TANGENTS, 1, VertexBuffer::AttributeType::SHORT4)
+            .attribute(VertexAttribute::UV0,      2, VertexBuffer::AttributeType::HALF2)
+            .normalized(VertexAttribute::TANGENTS)
+            .build(mEngine);
+
+    mVertexBuffer->setBufferAt(mEngine, 0, std::move(positions));
+    mVertexBuffer->setBufferAt(mEngine, 1, std::move(tangents));
+    mVertexBuffer->setBufferAt(mEngine, 2, std::move(texCoords));
+
+    mIndexBuffer = IndexBuffer::Builder().indexCount(uint32_t(indexCount)).build(mEngine);
+    mIndexBuffer->setBuffer(mEngine, std::move(indices));
+}
+
+// A cache file is a CacheHeader, the positions, tangents, uvs and indices as they're uploaded,
+// then a MeshRecord per mesh, each followed by a PartRecord and the material name (padded to
+// 4 bytes) of each of its parts. It's only read by the machine that wrote it.
+static constexpr char CACHE_MAGIC[8] = { 'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H' };
+static constexpr uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t meshCount;
+    uint64_t sourceHash;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+};
+
+struct MeshRecord {
+    uint32_t offset;
+    uint32_t count;
+    uint32_t partCount;
+    int32_t parent;
+    Box aabb;
+    mat4f transform;
+};
+
+struct PartRecord {
+    uint32_t offset;
+    uint32_t count;
+    sRGBColor baseColor;
+    float opacity;
+    float metallic;
+    float roughness;
+    float reflectance;
+    uint32_t nameLength;
+};
+
+bool MeshAssimp::loadFromCache(const Path& cache, uint64_t sourceHash,
+        std::vector<Mesh>& outMeshes, std::vector<int>& outParents) {
+    // the 4 buffers are uploaded straight from the file
+    std::unique_ptr<SharedFileData> shared(new SharedFileData(cache, 4));
+    uint8_t const* const data = shared->file.data();
+    const size_t size = shared->file.size();
+
+    size_t offset = 0;
+    auto read = [data, size, &offset](void* out, size_t bytes) {
+        if (size - offset < bytes) {
+            return false;
+        }
+        memcpy(out, data + offset, bytes);
+        offset += bytes;
+        return true;
+    };
+
+    CacheHeader header;
+    if (!read(&header, sizeof(header)) || memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) ||
+            header.version != CACHE_VERSION || header.sourceHash != sourceHash) {
+        return false;
+    }
+
+    const size_t vertexCount = header.vertexCount;
+    const size_t indexCount = header.indexCount;
+    const size_t positionsOffset = offset;
+    const size_t tangentsOffset = positionsOffset + vertexCount * sizeof(half4);
+    const size_t texCoordsOffset = tangentsOffset + vertexCount * sizeof(short4);
+    const size_t indicesOffset = texCoordsOffset + vertexCount * sizeof(half2);
+    offset = indicesOffset + indexCount * sizeof(uint32_t);
+    if (offset > size || header.meshCount > (size - offset) / sizeof(MeshRecord)) {
+        return false;
+    }
+
+    std::vector<Mesh> meshes(header.meshCount);
+    std::vector<int> parents(header.meshCount);
+    for (size_t i = 0; i < meshes.size(); i++) {
+        MeshRecord record;
+        if (!read(&record, sizeof(record)) ||
+                record.partCount > (size - offset) / sizeof(PartRecord)) {
+            return false;
+        }
+        Mesh& mesh = meshes[i];
+        mesh.offset = record.offset;
+        mesh.count = record.count;
+        mesh.aabb = record.aabb;
+        mesh.transform = record.transform;
+        parents[i] = record.parent;
+
+        mesh.parts.resize(record.partCount);
+        for (Part& part : mesh.parts) {
+            PartRecord partRecord;
+            if (!read(&partRecord, sizeof(partRecord))) {
+                return false;
+            }
+            const size_t nameSize = (partRecord.nameLength + 3u) & ~3u;
+            if (size - offset < nameSize) {
+                return false;
+            }
+            part = {
+                    partRecord.offset, partRecord.count,
+                    std::string((char const*) data + offset, partRecord.nameLength),
+                    partRecord.baseColor, partRecord.opacity, partRecord.metallic,
+                    partRecord.roughness, partRecord.reflectance
+            };
+            offset += nameSize;
+        }
+    }
+
+    outMeshes = std::move(meshes);
+    outParents = std::move(parents);
+
+    SharedFileData* const user = shared.release();
+    createBuffers(vertexCount, indexCount,
+            driver::BufferDescriptor(data + positionsOffset, vertexCount * sizeof(half4),
+                    SharedFileData::release, user),
+            driver::BufferDescriptor(data + tangentsOffset, vertexCount * sizeof(short4),
+                    SharedFileData::release, user),
+            driver::BufferDescriptor(data + texCoordsOffset, vertexCount * sizeof(half2),
+                    SharedFileData::release, user),
+            driver::BufferDescriptor(data + indicesOffset, indexCount * sizeof(uint32_t),
+                    SharedFileData::release, user));
+    return true;
+}
+
+void MeshAssimp::saveToCache(const Path& cache, uint64_t sourceHash,
+        std::vector<uint32_t> const& indices,
+        std::vector<half4> const&    positions,
+        std::vector<short4> const&   tangents,
+        std::vector<half2> const&    texCoords,
+        std::vector<Mesh> const&     meshes,
+        std::vector<int> const&      parents) {
+    // the cache is written aside and renamed, so that a cache file still mapped by the buffers
+    // of a previous load is never truncated
+    const std::string temp = cache.getPath() + ".tmp";
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        // e.g. a read-only directory, the file is simply imported again next time
+        return;
+    }
+
+    CacheHeader header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.meshCount = uint32_t(meshes.size());
+    header.sourceHash = sourceHash;
+    header.vertexCount = uint32_t(positions.size());
+    header.indexCount = uint32_t(indices.size());
+    out.write((char const*) &header, sizeof(header));
+    out.write((char const*) positions.data(), positions.size() * sizeof(half4));
+    out.write((char const*) tangents.data(), tangents.size() * sizeof(short4));
+    out.write((char const*) texCoords.data(), texCoords.size() * sizeof(half2));
+    out.write((char const*) indices.data(), indices.size() * sizeof(uint32_t));
+
+    for (size_t i = 0; i < meshes.size(); i++) {
+        Mesh const& mesh = meshes[i];
+        const MeshRecord record = {
+                uint32_t(mesh.offset), uint32_t(mesh.count), uint32_t(mesh.parts.size()),
+                parents[i], mesh.aabb, mesh.transform
+        };
+        out.write((char const*) &record, sizeof(record));
+        for (Part const& part : mesh.parts) {
+            const uint32_t nameLength = uint32_t(part.material.size());
+            const PartRecord partRecord = {
+                    uint32_t(part.offset), uint32_t(part.count), part.baseColor, part.opacity,
+                    part.metallic, part.roughness, part.reflectance, nameLength
+            };
+            const char padding[4] = {};
+            out.write((char const*) &partRecord, sizeof(partRecord));
+            out.write(part.material.data(), nameLength);
+            out.write(padding, ((nameLength + 3u) & ~3u) - nameLength);
+        }
+    }
+
+    out.close();
+    if (!out) {
+        std::remove(temp.c_str());
+        return;
+    }
+#if defined(WIN32)
+    std::remove(cache.c_str());
+#endif
+    std::rename(temp.c_str(), cache.c_str());
+}
+
 using Assimp::Importer;
 
 bool MeshAssimp::setFromFile(const Path& file,
@@ -234,29 +528,23 @@ bool MeshAssimp::setFromFile(const Path& file,
     //      aiProcess_OptimizeGraph
     //      aiProcess_PreTransformVertices
 
-    const std::function<void(aiNode const* node, size_t& totalVertexCount, size_t& totalIndexCount)>
-            countVertices = [scene, &countVertices]
-            (aiNode const* node, size_t& totalVertexCount, size_t& totalIndexCount) {
-        for (size_t i = 0; i < node->mNumMeshes; i++) {
-            aiMesh const* mesh = scene->mMeshes[node->mMeshes[i]];
-            totalVertexCount += mesh->mNumVertices;
-
-            const aiFace* faces = mesh->mFaces;
-            const size_t numFaces = mesh->mNumFaces;
-            totalIndexCount += numFaces * faces[0].mNumIndices;
-        }
-
-        for (size_t i = 0; i < node->mNumChildren; i++) {
-            countVertices(node->mChildren[i], totalVertexCount, totalIndexCount);
-        }
+    // The node graph is walked first, to assign each mesh the slices of the vertex and index
+    // arrays that it's converted into, in parallel, afterwards.
+    struct Conversion {
+        aiMesh const* mesh;
+        size_t vertexOffset;
+        size_t indexOffset;
     };
+    std::vector<Conversion> conversions;
+    size_t vertexCount = outPositions.size();
+    size_t indexCount = outIndices.size();
 
     size_t deep = 0;
     size_t depth = 0;
 
     const std::function<void(aiNode const* node, int parentIndex)> processNode =
             [scene, &processNode, &outParents, &deep, &depth,
-                    &outIndices, &outPositions, &outTangents, &outTexCoords, &outMeshes]
+                    &conversions, &vertexCount, &indexCount, &outMeshes]
             (aiNode const* node, int parentIndex) {
 
         mat4f const& current = transpose(*reinterpret_cast<mat4f const*>(&node->mTransformation));
@@ -264,48 +552,26 @@ bool MeshAssimp::setFromFile(const Path& file,
         size_t totalIndices = 0;
         outParents.push_back(parentIndex);
         outMeshes.push_back(Mesh{});
-        outMeshes.back().offset = outIndices.size();
+        outMeshes.back().offset = indexCount;
         outMeshes.back().transform = current;
 
-        // Bias and scale factor when storing tangent frames in normalized short4
-        const float bias = 1.0f / 32767.0f;
-        const float factor = (float) (sqrt(1.0 - (double) bias * (double) bias));
-
         for (size_t i = 0; i < node->mNumMeshes; i++) {
             aiMesh const* mesh = scene->mMeshes[node->mMeshes[i]];
 
-            float3 const* positions  = reinterpret_cast<float3 const*>(mesh->mVertices);
-            float3 const* tangents   = reinterpret_cast<float3 const*>(mesh->mTangents);
-            float3 const* bitangents = reinterpret_cast<float3 const*>(mesh->mBitangents);
-            float3 const* normals    = reinterpret_cast<float3 const*>(mesh->mNormals);
-            float3 const* texCoords  = reinterpret_cast<const float3*>(mesh->mTextureCoords[0]);
-
             const size_t numVertices = mesh->mNumVertices;
             if (numVertices > 0) {
                 const aiFace* faces = mesh->mFaces;
                 const size_t numFaces = mesh->mNumFaces;
 
                 if (numFaces > 0) {
-                    size_t indicesOffset = outPositions.size();
-
-                    for (size_t j = 0; j < numVertices; j++) {
-                        quatf q = mat3f::packTangentFrame({tangents[j], bitangents[j], normals[j]});
-                        outTangents.push_back(packSnorm16(q.xyzw));
-                        outTexCoords.push_back(half2(texCoords[j].xy));
-                        outPositions.push_back(half4(positions[j], 1.0_h));
-                    }
-
                     // all faces should be triangles since we configure assimp to triangulate faces
                     size_t indicesCount = numFaces * faces[0].mNumIndices;
-                    size_t indexBufferOffset = outIndices.size();
+                    size_t indexBufferOffset = indexCount;
                     totalIndices += indicesCount;
 
-                    for (size_t j = 0; j < numFaces; ++j) {
-                        const aiFace& face = faces[j];
-                        for (size_t k = 0; k < face.mNumIndices; ++k) {
-                            outIndices.push_back(uint32_t(face.mIndices[k] + indicesOffset));
-                        }
-                    }
+                    conversions.push_back({ mesh, vertexCount, indexCount });
+                    vertexCount += numVertices;
+                    indexCount += indicesCount;
 
                     uint32_t materialId = mesh->mMaterialIndex;
                     aiMaterial const* material = scene->mMaterials[materialId];
@@ -380,30 +646,74 @@ bool MeshAssimp::setFromFile(const Path& file,
         }
     };
 
-    if (scene) {
-        aiNode const* node = scene->mRootNode;
+    auto convert = [&conversions, &outIndices, &outPositions, &outTangents, &outTexCoords]
+            (uint32_t start, uint32_t count) {
+        for (uint32_t c = start; c < start + count; c++) {
+            aiMesh const* mesh = conversions[c].mesh;
+            const size_t vertexOffset = conversions[c].vertexOffset;
+            const size_t numVertices = mesh->mNumVertices;
+
+            float3 const* positions  = reinterpret_cast<float3 const*>(mesh->mVertices);
+            float3 const* tangents   = reinterpret_cast<float3 const*>(mesh->mTangents);
+            float3 const* bitangents = reinterpret_cast<float3 const*>(mesh->mBitangents);
+            float3 const* normals    = reinterpret_cast<float3 const*>(mesh->mNormals);
+            float3 const* texCoords  = reinterpret_cast<const float3*>(mesh->mTextureCoords[0]);
 
-        size_t totalVertexCount = 0;
-        size_t totalIndexCount = 0;
+            // the positions and uvs are laid out like their half vectors, then converted at once
+            std::vector<float4> positions4(numVertices);
+            std::vector<float2> texCoords2(numVertices);
+            for (size_t j = 0; j < numVertices; j++) {
+                quatf q = mat3f::packTangentFrame({tangents[j], bitangents[j], normals[j]});
+                outTangents[vertexOffset + j] = packSnorm16(q.xyzw);
+                texCoords2[j] = texCoords[j].xy;
+                positions4[j] = float4(positions[j], 1.0f);
+            }
+            floatToHalf(&texCoords2[0].x, &outTexCoords[vertexOffset].x, numVertices * 2);
+            floatToHalf(&positions4[0].x, &outPositions[vertexOffset].x, numVertices * 4);
+
+            uint32_t* indices = outIndices.data() + conversions[c].indexOffset;
+            for (size_t j = 0; j < mesh->mNumFaces; ++j) {
+                const aiFace& face = mesh->mFaces[j];
+                for (size_t k = 0; k < face.mNumIndices; ++k) {
+                    *indices++ = uint32_t(face.mIndices[k] + vertexOffset);
+                }
+            }
+        }
+    };
 
-        countVertices(node, totalVertexCount, totalIndexCount);
+    // compute the aabb
+    auto computeBounds = [&outMeshes, &outPositions, &outIndices](uint32_t start, uint32_t count) {
+        for (uint32_t i = start; i < start + count; i++) {
+            Mesh& mesh = outMeshes[i];
+            mesh.aabb = RenderableManager::computeAABB(
+                    outPositions.data(),
+                    outIndices.data() + mesh.offset,
+                    mesh.count);
+        }
+    };
 
-        outPositions.reserve(outPositions.size() + totalVertexCount);
-        outTangents.reserve(outTangents.size() + totalVertexCount);
-        outTexCoords.reserve(outTexCoords.size() + totalVertexCount);
-        outIndices.reserve(outIndices.size() + totalIndexCount);
+    if (scene) {
+        aiNode const* node = scene->mRootNode;
 
+        const size_t firstMesh = outMeshes.size();
         processNode(node, -1);
 
         std::cout << "Hierarchy depth = " << depth << std::endl;
 
-        // compute the aabb
-        for (auto& mesh : outMeshes) {
-            mesh.aabb = RenderableManager::computeAABB(
-                    outPositions.data(),
-                    outIndices.data() + mesh.offset,
-                    mesh.count);
+        outPositions.resize(vertexCount);
+        outTangents.resize(vertexCount);
+        outTexCoords.resize(vertexCount);
+        outIndices.resize(indexCount);
+
+        // the meshes are converted, then bounded, on the engine's worker threads
+        JobSystem& js = mEngine.getJobSystem();
+        if (!conversions.empty()) {
+            js.runAndWait(jobs::parallel_for(js, nullptr, 0, uint32_t(conversions.size()),
+                    std::cref(convert), jobs::CountSplitter<1>()));
         }
+        js.runAndWait(jobs::parallel_for(js, nullptr, uint32_t(firstMesh),
+                uint32_t(outMeshes.size() - firstMesh),
+                std::cref(computeBounds), jobs::CountSplitter<1>()));
 
         return true;
     }
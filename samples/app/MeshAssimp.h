@@ -39,6 +39,7 @@ namespace filament {
 #include <filamat/MaterialBuilder.h>
 #include <filament/Color.h>
 #include <filament/Box.h>
+#include <filament/driver/BufferDescriptor.h>
 
 class MeshAssimp {
 public:
@@ -85,6 +86,25 @@ private:
             std::vector<Mesh>&     outMeshes,
             std::vector<int>&      outParents);
 
+    void createBuffers(size_t vertexCount, size_t indexCount,
+            filament::driver::BufferDescriptor&& positions,
+            filament::driver::BufferDescriptor&& tangents,
+            filament::driver::BufferDescriptor&& texCoords,
+            filament::driver::BufferDescriptor&& indices);
+
+    // The converted meshes are cached next to their source file, tagged with its hash.
+    bool loadFromCache(const utils::Path& cache, uint64_t sourceHash,
+            std::vector<Mesh>& outMeshes,
+            std::vector<int>&  outParents);
+
+    static void saveToCache(const utils::Path& cache, uint64_t sourceHash,
+            std::vector<uint32_t> const& indices,
+            std::vector<half4> const&    positions,
+            std::vector<short4> const&   tangents,
+            std::vector<half2> const&    texCoords,
+            std::vector<Mesh> const&     meshes,
+            std::vector<int> const&      parents);
+
     filament::Engine& mEngine;
     filament::VertexBuffer* mVertexBuffer = nullptr;
     filament::IndexBuffer* mIndexBuffer = nullptr;
@@ -21,6 +21,7 @@
 #include <vector>
 
 #include <fcntl.h>
+#include <stddef.h>
 #if !defined(WIN32)
 #    include <unistd.h>
 #else
@@ -71,8 +72,12 @@ struct Header {
     uint32_t indexType;
     uint32_t indexCount;
     uint32_t indexSize;
+    uint32_t flags;         // since version 2
 };
 
+// Header::flags
+static const uint32_t FLAG_QUANTIZED_POSITIONS = 0x1;
+
 struct Vertex {
     half4  position;
     short4 tangents;
@@ -110,7 +115,10 @@ MeshIO::Mesh MeshIO::loadMeshFromFile(filament::Engine* engine, const utils::Pat
 
         if (!strcmp("FILAMESH", magic)) {
             Header* header = (Header*) p;
-            p += sizeof(Header);
+            const bool hasFlags = header->version >= 2;
+            const uint32_t flags = hasFlags ? header->flags : 0;
+            p += hasFlags ? sizeof(Header) : offsetof(Header, flags);
+            const bool quantized = bool(flags & FLAG_QUANTIZED_POSITIONS);
 
             char* vertexData = p;
             p += header->vertexSize;
@@ -149,7 +157,8 @@ MeshIO::Mesh MeshIO::loadMeshFromFile(filament::Engine* engine, const utils::Pat
                 .bufferCount(1)
                 .normalized(VertexAttribute::TANGENTS)
                 .normalized(VertexAttribute::COLOR)
-                .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::HALF4,
+                .attribute(VertexAttribute::POSITION, 0, quantized ?
+                        VertexBuffer::AttributeType::SHORT4 : VertexBuffer::AttributeType::HALF4,
                         header->offsetPosition, uint8_t(header->stridePosition))
                 .attribute(VertexAttribute::TANGENTS, 0, VertexBuffer::AttributeType::SHORT4,
                         header->offsetTangents, uint8_t(header->strideTangents))
@@ -164,6 +173,10 @@ MeshIO::Mesh MeshIO::loadMeshFromFile(filament::Engine* engine, const utils::Pat
                         header->offsetUV1, uint8_t(header->strideUV1));
             }
 
+            if (quantized) {
+                vbb.normalized(VertexAttribute::POSITION);
+            }
+
             mesh.vertexBuffer = vbb.build(*engine);
 
             VertexBuffer::BufferDescriptor buffer(vertexData, header->vertexSize);
@@ -171,6 +184,10 @@ MeshIO::Mesh MeshIO::loadMeshFromFile(filament::Engine* engine, const utils::Pat
 
             RenderableManager::Builder builder(header->parts);
             builder.boundingBox(header->aabb);
+            if (quantized) {
+                // the positions are relative to the bounding box of the whole mesh
+                builder.quantizedPositions(header->aabb);
+            }
 
 
             for (size_t i = 0; i < header->parts; i++) {
@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <getopt/getopt.h>
+
+#include <utils/EntityManager.h>
+#include <utils/Path.h>
+
+#include <filament/Camera.h>
+#include <filament/Engine.h>
+#include <filament/IndexBuffer.h>
+#include <filament/LightManager.h>
+#include <filament/Material.h>
+#include <filament/MaterialInstance.h>
+#include <filament/RenderableManager.h>
+#include <filament/Renderer.h>
+#include <filament/Scene.h>
+#include <filament/TransformManager.h>
+#include <filament/VertexBuffer.h>
+#include <filament/View.h>
+
+#include <math/mat4.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+using namespace math;
+using namespace filament;
+using namespace utils;
+
+/*
+ * Renders procedurally generated scenes with the no-op driver, which measures the CPU cost of
+ * the engine alone (the driver thread only decodes the commands). The timings come from
+ * Renderer::setFrameStatsCallback().
+ */
+
+static constexpr uint8_t MATERIAL_LIT_PACKAGE[] = {
+    #include "generated/material/sandboxLit.inc"
+};
+
+struct Config {
+    size_t renderables = 1000;
+    size_t materials = 8;
+    size_t pointLights = 32;
+    size_t spotLights = 32;
+    size_t shadowCasters = 100;
+    size_t frames = 200;
+    size_t warmupFrames = 20;
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+    bool pipelining = false;
+    std::string capture;
+};
+
+static Config g_config;
+
+static void printUsage(char* name) {
+    std::string exec_name(Path(name).getName());
+    std::string usage(
+            "FRAME_BENCHMARK measures the CPU cost of rendering procedural scenes\n"
+            "Usage:\n"
+            "    FRAME_BENCHMARK [options]\n"
+            "Options:\n"
+            "   --help, -h\n"
+            "       Prints this message\n\n"
+            "   --renderables=<count>, -n <count>\n"
+            "       Number of renderables (default 1000)\n\n"
+            "   --materials=<count>, -m <count>\n"
+            "       Number of materials, shared by the renderables (default 8)\n\n"
+            "   --point-lights=<count>, -p <count>\n"
+            "       Number of point lights (default 32)\n\n"
+            "   --spot-lights=<count>, -s <count>\n"
+            "       Number of spot lights (default 32)\n\n"
+            "   --shadow-casters=<count>, -c <count>\n"
+            "       Number of renderables casting shadows (default 100)\n\n"
+            "   --frames=<count>, -f <count>\n"
+            "       Number of frames measured (default 200)\n\n"
+            "   --pipelining, -l\n"
+            "       Enables frame pipelining\n\n"
+            "   --capture=<path>, -x <path>\n"
+            "       Captures the last frame, see frame_capture_viewer\n\n"
+    );
+    const std::string from("FRAME_BENCHMARK");
+    for (size_t pos = usage.find(from); pos != std::string::npos; pos = usage.find(from, pos)) {
+        usage.replace(pos, from.length(), exec_name);
+    }
+    std::cout << usage;
+}
+
+static size_t toCount(std::string const& arg, size_t value) {
+    try {
+        return size_t(std::stoul(arg));
+    } catch (std::invalid_argument& e) {
+        return value;
+    } catch (std::out_of_range& e) {
+        return value;
+    }
+}
+
+static int handleCommandLineArgments(int argc, char* argv[], Config* config) {
+    static constexpr const char* OPTSTR = "hn:m:p:s:c:f:lx:";
+    static const struct option OPTIONS[] = {
+            { "help",           no_argument,       0, 'h' },
+            { "renderables",    required_argument, 0, 'n' },
+            { "materials",      required_argument, 0, 'm' },
+            { "point-lights",   required_argument, 0, 'p' },
+            { "spot-lights",    required_argument, 0, 's' },
+            { "shadow-casters", required_argument, 0, 'c' },
+            { "frames",         required_argument, 0, 'f' },
+            { "pipelining",     no_argument,       0, 'l' },
+            { "capture",        required_argument, 0, 'x' },
+            { 0, 0, 0, 0 }  // termination of the option list
+    };
+    int opt;
+    int option_index = 0;
+    while ((opt = getopt_long(argc, argv, OPTSTR, OPTIONS, &option_index)) >= 0) {
+        std::string arg(optarg ? optarg : "");
+        switch (opt) {
+            default:
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
+            case 'n':
+                config->renderables = toCount(arg, config->renderables);
+                break;
+            case 'm':
+                config->materials = std::max(size_t(1), toCount(arg, config->materials));
+                break;
+            case 'p':
+                config->pointLights = toCount(arg, config->pointLights);
+                break;
+            case 's':
+                config->spotLights = toCount(arg, config->spotLights);
+                break;
+            case 'c':
+                config->shadowCasters = toCount(arg, config->shadowCasters);
+                break;
+            case 'f':
+                config->frames = std::max(size_t(1), toCount(arg, config->frames));
+                break;
+            case 'l':
+                config->pipelining = true;
+                break;
+            case 'x':
+                config->capture = arg;
+                break;
+        }
+    }
+
+    return optind;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+static const float3 CUBE_VERTICES[] = {
+        { -1, -1,  1 }, {  1, -1,  1 }, { -1,  1,  1 }, {  1,  1,  1 },
+        { -1, -1, -1 }, {  1, -1, -1 }, { -1,  1, -1 }, {  1,  1, -1 }
+};
+
+// the orientation of the tangent frames doesn't matter here
+static const short4 CUBE_TANGENTS[] = {
+        { 0, 0, 0, 32767 }, { 0, 0, 0, 32767 }, { 0, 0, 0, 32767 }, { 0, 0, 0, 32767 },
+        { 0, 0, 0, 32767 }, { 0, 0, 0, 32767 }, { 0, 0, 0, 32767 }, { 0, 0, 0, 32767 }
+};
+
+static const uint16_t CUBE_INDICES[] = {
+        2,0,1, 2,1,3,  6,4,5, 6,5,7,  2,0,4, 2,4,6,
+        3,1,5, 3,5,7,  0,4,5, 0,5,1,  2,6,7, 2,7,3
+};
+
+struct BenchmarkScene {
+    filament::Scene* scene = nullptr;
+    VertexBuffer* vertexBuffer = nullptr;
+    IndexBuffer* indexBuffer = nullptr;
+    std::vector<Material*> materials;
+    std::vector<MaterialInstance*> instances;
+    std::vector<Entity> entities;
+};
+
+static void createScene(Engine& engine, Config const& config, BenchmarkScene& s) {
+    std::mt19937 gen;
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    EntityManager& em = EntityManager::get();
+    TransformManager& tcm = engine.getTransformManager();
+
+    s.scene = engine.createScene();
+
+    s.vertexBuffer = VertexBuffer::Builder()
+            .vertexCount(8)
+            .bufferCount(2)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+            .attribute(VertexAttribute::TANGENTS, 1, VertexBuffer::AttributeType::SHORT4)
+            .normalized(VertexAttribute::TANGENTS)
+            .build(engine);
+    s.vertexBuffer->setBufferAt(engine, 0,
+            VertexBuffer::BufferDescriptor(CUBE_VERTICES, sizeof(CUBE_VERTICES)));
+    s.vertexBuffer->setBufferAt(engine, 1,
+            VertexBuffer::BufferDescriptor(CUBE_TANGENTS, sizeof(CUBE_TANGENTS)));
+
+    s.indexBuffer = IndexBuffer::Builder()
+            .indexCount(36)
+            .bufferType(IndexBuffer::IndexType::USHORT)
+            .build(engine);
+    s.indexBuffer->setBuffer(engine,
+            IndexBuffer::BufferDescriptor(CUBE_INDICES, sizeof(CUBE_INDICES)));
+
+    // each material is a separate copy of the same package, so they have their own programs
+    for (size_t i = 0; i < config.materials; i++) {
+        Material* material = Material::Builder()
+                .package((void*) MATERIAL_LIT_PACKAGE, sizeof(MATERIAL_LIT_PACKAGE))
+                .build(engine);
+        MaterialInstance* mi = material->createInstance();
+        mi->setParameter("baseColor", RgbType::LINEAR, float3{ unit(gen), unit(gen), unit(gen) });
+        mi->setParameter("roughness", unit(gen));
+        mi->setParameter("metallic", 0.0f);
+        mi->setParameter("reflectance", 0.5f);
+        mi->setParameter("clearCoat", 0.0f);
+        mi->setParameter("clearCoatRoughness", 0.0f);
+        mi->setParameter("anisotropy", 0.0f);
+        s.materials.push_back(material);
+        s.instances.push_back(mi);
+    }
+
+    // the cubes are laid out on a grid, in front of the camera
+    const size_t side = size_t(std::ceil(std::cbrt(double(std::max(config.renderables, size_t(1))))));
+    const float spacing = 4.0f;
+    const float extent = side * spacing;
+    for (size_t i = 0; i < config.renderables; i++) {
+        Entity e = em.create();
+        const float3 position{
+                (i % side) * spacing - extent * 0.5f,
+                ((i / side) % side) * spacing - extent * 0.5f,
+                -float(i / (side * side)) * spacing - 10.0f };
+        RenderableManager::Builder(1)
+                .boundingBox({ {}, { 1, 1, 1 } })
+                .material(0, s.instances[i % s.instances.size()])
+                .geometry(0, RenderableManager::PrimitiveType::TRIANGLES,
+                        s.vertexBuffer, s.indexBuffer)
+                .castShadows(i < config.shadowCasters)
+                .receiveShadows(true)
+                .build(engine, e);
+        tcm.create(e, {}, mat4f::translate(float4{ position, 1 }));
+        s.scene->addEntity(e);
+        s.entities.push_back(e);
+    }
+
+    // a shadow casting sun
+    Entity sun = em.create();
+    LightManager::Builder(LightManager::Type::SUN)
+            .direction({ 0.3f, -1.0f, -0.5f })
+            .intensity(100000.0f)
+            .castShadows(true)
+            .build(engine, sun);
+    s.scene->addEntity(sun);
+    s.entities.push_back(sun);
+
+    std::uniform_real_distribution<float> x(-extent * 0.5f, extent * 0.5f);
+    std::uniform_real_distribution<float> z(-extent - 10.0f, -10.0f);
+    for (size_t i = 0; i < config.pointLights + config.spotLights; i++) {
+        const bool spot = i >= config.pointLights;
+        Entity e = em.create();
+        LightManager::Builder(spot ? LightManager::Type::SPOT : LightManager::Type::POINT)
+                .position({ x(gen), x(gen), z(gen) })
+                .direction({ 0, -1, 0 })
+                .spotLightCone(0.5f, 0.7f)
+                .color({ unit(gen), unit(gen), unit(gen) })
+                .intensity(10000.0f)
+                .falloff(spacing * 3.0f)
+                .build(engine, e);
+        s.scene->addEntity(e);
+        s.entities.push_back(e);
+    }
+}
+
+static void destroyScene(Engine& engine, BenchmarkScene& s) {
+    EntityManager& em = EntityManager::get();
+    engine.destroy(s.entities.data(), s.entities.size());
+    em.destroy(s.entities.size(), s.entities.data());
+    for (MaterialInstance* mi : s.instances) {
+        engine.destroy(mi);
+    }
+    for (Material* material : s.materials) {
+        engine.destroy(material);
+    }
+    engine.destroy(s.vertexBuffer);
+    engine.destroy(s.indexBuffer);
+    engine.destroy(s.scene);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+struct Timings {
+    size_t warmupFrames = 0;
+    std::vector<Renderer::FrameStats> frames;
+};
+
+static void onFrameStats(Renderer::FrameStats const& stats, void* user) {
+    Timings* timings = static_cast<Timings*>(user);
+    if (stats.frameId > timings->warmupFrames) {
+        timings->frames.push_back(stats);
+    }
+}
+
+static void printPhase(char const* name, std::vector<Renderer::FrameStats> const& frames,
+        float Renderer::FrameStats::*phase) {
+    std::vector<float> values;
+    for (auto const& stats : frames) {
+        values.push_back(stats.*phase);
+    }
+    std::sort(values.begin(), values.end());
+    const size_t n = values.size();
+    double mean = 0;
+    for (float v : values) {
+        mean += v;
+    }
+    mean /= n;
+    std::cout << std::left << std::setw(16) << name << std::right << std::fixed
+              << std::setprecision(3)
+              << std::setw(10) << mean
+              << std::setw(10) << values[n / 2]
+              << std::setw(10) << values[std::min(n - 1, n * 9 / 10)]
+              << std::setw(10) << values[n - 1] << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    handleCommandLineArgments(argc, argv, &g_config);
+    Config const& config = g_config;
+
+    Engine* engine = Engine::create(Engine::Backend::NOOP);
+    if (!engine) {
+        std::cerr << "couldn't create the Engine" << std::endl;
+        return 1;
+    }
+
+    SwapChain* swapChain = engine->createSwapChain(config.width, config.height);
+    Renderer* renderer = engine->createRenderer();
+    Camera* camera = engine->createCamera();
+    View* view = engine->createView();
+
+    BenchmarkScene scene;
+    createScene(*engine, config, scene);
+
+    camera->setProjection(60, double(config.width) / config.height, 0.1, 1000,
+            Camera::Fov::VERTICAL);
+    camera->lookAt({ 0, 0, 10 }, { 0, 0, -10 });
+    view->setCamera(camera);
+    view->setScene(scene.scene);
+    view->setViewport({ 0, 0, config.width, config.height });
+
+    Timings timings;
+    timings.warmupFrames = config.warmupFrames;
+    renderer->setFrameStatsCallback(&onFrameStats, &timings);
+    renderer->setFramePipelining(config.pipelining);
+
+    // the last frames' timings are delivered by the next few frames
+    const size_t totalFrames = config.warmupFrames + config.frames;
+    for (size_t i = 0; timings.frames.size() < config.frames && i < totalFrames * 2; i++) {
+        if (!config.capture.empty() && i + 1 == totalFrames) {
+            renderer->captureFrame(config.capture.c_str());
+        }
+        if (renderer->beginFrame(swapChain)) {
+            renderer->render(view);
+            renderer->endFrame();
+        }
+    }
+
+    std::cout << config.renderables << " renderables, " << config.materials << " materials, "
+              << config.pointLights << " point lights, " << config.spotLights << " spot lights, "
+              << config.shadowCasters << " shadow casters, " << timings.frames.size()
+              << " frames" << std::endl << std::endl;
+
+    if (!timings.frames.empty()) {
+        using FrameStats = Renderer::FrameStats;
+        std::cout << std::left << std::setw(16) << "phase (ms)" << std::right
+                  << std::setw(10) << "mean" << std::setw(10) << "median"
+                  << std::setw(10) << "90th" << std::setw(10) << "max" << std::endl;
+        printPhase("prepare", timings.frames, &FrameStats::prepare);
+        printPhase("culling", timings.frames, &FrameStats::culling);
+        printPhase("froxelization", timings.frames, &FrameStats::froxelization);
+        printPhase("commands", timings.frames, &FrameStats::commands);
+        printPhase("main thread", timings.frames, &FrameStats::mainThread);
+        printPhase("driver thread", timings.frames, &FrameStats::driverThread);
+    }
+
+    Renderer::RenderStats const stats = renderer->getRenderStats();
+    std::cout << std::endl << "last frame: " << stats.visibleRenderables << " visible, "
+              << stats.culledRenderables << " culled, " << stats.shadowCasters
+              << " shadow casters, " << stats.commandCount << " commands, "
+              << stats.commandStreamSize << " bytes of backend commands" << std::endl;
+
+    renderer->setFrameStatsCallback(nullptr);
+    destroyScene(*engine, scene);
+    engine->destroy(view);
+    engine->destroy(camera);
+    engine->destroy(renderer);
+    engine->destroy(swapChain);
+    Engine::destroy(&engine);
+
+    return 0;
+}
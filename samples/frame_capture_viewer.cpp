@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cfloat>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <imgui.h>
+
+#include <filament/Engine.h>
+#include <filament/View.h>
+#include <filament/Scene.h>
+
+#include "app/Config.h"
+#include "app/FilamentApp.h"
+
+/*
+ * Displays a capture written by Renderer::captureFrame() (see filament/src/FrameCapture.h for
+ * the format), to find why a frame is expensive: how the command keys are distributed, where
+ * the sorted commands break the batches, and how many lights overlap in the froxels.
+ */
+
+// Command key fields, see filament/src/RenderPass.h
+static constexpr uint64_t PASS_SHIFT = 56;
+static constexpr uint64_t BLENDED_PASS = 2;
+static constexpr uint64_t PRIORITY_MASK = 0x001C000000000000llu;
+static constexpr uint64_t PRIORITY_SHIFT = 50;
+static constexpr uint64_t MATERIAL_INSTANCE_ID_MASK = 0x0000FFFFllu;
+
+struct Renderable {
+    uint32_t instance = 0;
+    uint32_t visibleMask = 0;
+    uint32_t layers = 0;
+    uint32_t primitiveCount = 0;
+};
+
+struct Primitive {
+    uint32_t renderable = 0;
+    uint32_t materialId = 0;
+    uint32_t vertexCount = 0;
+};
+
+struct Command {
+    std::string pass;
+    uint64_t key = 0;
+    uint32_t renderable = 0;
+    uint32_t materialId = 0;
+    uint32_t variant = 0;
+};
+
+struct Froxel {
+    uint32_t x, y, z;
+    uint32_t pointLights;
+    uint32_t spotLights;
+};
+
+struct Capture {
+    std::string viewName;
+    uint32_t frameId = 0;
+    uint32_t width = 0, height = 0;
+    uint32_t scaledWidth = 0, scaledHeight = 0;
+    std::vector<std::pair<std::string, float>> timings;
+    std::vector<std::pair<std::string, uint64_t>> stats;
+    std::vector<Renderable> renderables;
+    std::vector<Primitive> primitives;
+    std::map<uint32_t, std::string> materials;
+    std::vector<Command> commands;
+    uint32_t froxelCount[3] = {};
+    std::vector<Froxel> froxels;
+};
+
+// analysis of the sorted commands
+struct CommandSummary {
+    size_t passes[3] = {};          // depth, color and blended commands
+    size_t programChanges = 0;      // material or variant changed from the previous command
+    size_t instanceChanges = 0;     // material instance changed, with the same program
+    std::vector<std::pair<uint32_t, size_t>> commandsPerMaterial;
+};
+
+static std::string readName(std::istringstream& line) {
+    std::string name;
+    std::getline(line >> std::ws, name);
+    return name;
+}
+
+static bool loadCapture(const char* path, Capture* capture) {
+    std::ifstream in(path);
+    std::string header;
+    uint32_t version = 0;
+    if (!(in >> header >> version) || header != "filament-frame-capture" || version != 1) {
+        std::cerr << path << " isn't a frame capture" << std::endl;
+        return false;
+    }
+    std::string text;
+    while (std::getline(in, text)) {
+        std::istringstream line(text);
+        std::string record;
+        line >> record;
+        if (record == "view") {
+            line >> capture->frameId >> capture->width >> capture->height
+                 >> capture->scaledWidth >> capture->scaledHeight;
+            capture->viewName = readName(line);
+        } else if (record == "timing") {
+            std::string name;
+            float ms = 0;
+            line >> name >> ms;
+            capture->timings.emplace_back(name, ms);
+        } else if (record == "stat") {
+            std::string name;
+            uint64_t value = 0;
+            line >> name >> value;
+            capture->stats.emplace_back(name, value);
+        } else if (record == "renderable") {
+            Renderable r;
+            line >> r.instance >> r.visibleMask >> r.layers >> r.primitiveCount;
+            capture->renderables.push_back(r);
+        } else if (record == "primitive") {
+            Primitive p;
+            uint32_t index, type;
+            line >> p.renderable >> index >> p.materialId >> type >> p.vertexCount;
+            capture->materials[p.materialId] = readName(line);
+            capture->primitives.push_back(p);
+        } else if (record == "command") {
+            Command c;
+            line >> c.pass >> std::hex >> c.key >> std::dec
+                 >> c.renderable >> c.materialId >> c.variant;
+            capture->commands.push_back(c);
+        } else if (record == "froxels") {
+            line >> capture->froxelCount[0] >> capture->froxelCount[1] >> capture->froxelCount[2];
+        } else if (record == "froxel") {
+            Froxel f;
+            line >> f.x >> f.y >> f.z >> f.pointLights >> f.spotLights;
+            capture->froxels.push_back(f);
+        }
+    }
+    return true;
+}
+
+static CommandSummary summarizeCommands(Capture const& capture) {
+    CommandSummary summary;
+    std::map<uint32_t, size_t> perMaterial;
+    Command const* previous = nullptr;
+    for (Command const& command : capture.commands) {
+        summary.passes[std::min(command.key >> PASS_SHIFT, BLENDED_PASS)]++;
+        perMaterial[command.materialId]++;
+        if (previous) {
+            if (previous->materialId != command.materialId ||
+                    previous->variant != command.variant) {
+                summary.programChanges++;
+            } else if ((previous->key & MATERIAL_INSTANCE_ID_MASK) !=
+                    (command.key & MATERIAL_INSTANCE_ID_MASK)) {
+                summary.instanceChanges++;
+            }
+        }
+        previous = &command;
+    }
+    summary.commandsPerMaterial.assign(perMaterial.begin(), perMaterial.end());
+    std::sort(summary.commandsPerMaterial.begin(), summary.commandsPerMaterial.end(),
+            [](auto const& lhs, auto const& rhs) { return lhs.second > rhs.second; });
+    return summary;
+}
+
+static void showFrame(Capture const& capture) {
+    ImGui::Begin("Frame");
+    ImGui::Text("View \"%s\", frame %u", capture.viewName.c_str(), capture.frameId);
+    ImGui::Text("%u x %u, rendered at %u x %u", capture.width, capture.height,
+            capture.scaledWidth, capture.scaledHeight);
+    if (ImGui::CollapsingHeader("Timings (ms)", ImGuiTreeNodeFlags_DefaultOpen)) {
+        for (auto const& timing : capture.timings) {
+            ImGui::Text("%-16s %8.3f", timing.first.c_str(), timing.second);
+        }
+    }
+    if (ImGui::CollapsingHeader("Render stats", ImGuiTreeNodeFlags_DefaultOpen)) {
+        for (auto const& stat : capture.stats) {
+            ImGui::Text("%-24s %10llu", stat.first.c_str(), (unsigned long long) stat.second);
+        }
+    }
+    ImGui::End();
+}
+
+static void showCommands(Capture const& capture, CommandSummary const& summary) {
+    ImGui::Begin("Commands");
+    ImGui::Text("%zu commands: %zu depth, %zu color, %zu blended", capture.commands.size(),
+            summary.passes[0], summary.passes[1], summary.passes[2]);
+    ImGui::Text("%zu program changes, %zu material instance changes",
+            summary.programChanges, summary.instanceChanges);
+
+    if (ImGui::CollapsingHeader("Commands per material", ImGuiTreeNodeFlags_DefaultOpen)) {
+        std::vector<float> counts;
+        for (auto const& entry : summary.commandsPerMaterial) {
+            counts.push_back(float(entry.second));
+        }
+        ImGui::PlotHistogram("##materials", counts.data(), int(counts.size()), 0, nullptr,
+                0.0f, FLT_MAX, ImVec2(0, 80));
+        for (auto const& entry : summary.commandsPerMaterial) {
+            auto name = capture.materials.find(entry.first);
+            ImGui::Text("%6zu  %4u %s", entry.second, entry.first,
+                    name != capture.materials.end() ? name->second.c_str() : "");
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Sorted commands")) {
+        ImGui::Text("%-6s %-7s %-16s %4s %10s %8s %7s", "#", "pass", "key", "pri",
+                "renderable", "material", "variant");
+        ImGui::BeginChild("##commands", ImVec2(0, 300));
+        ImGuiListClipper clipper(int(capture.commands.size()));
+        while (clipper.Step()) {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+                Command const& c = capture.commands[i];
+                // the batches break where the program changes
+                const bool programChange = i > 0 &&
+                        (capture.commands[i - 1].materialId != c.materialId ||
+                         capture.commands[i - 1].variant != c.variant);
+                ImGui::TextColored(programChange ? ImVec4(1, 0.6f, 0.2f, 1) : ImVec4(1, 1, 1, 1),
+                        "%-6d %-7s %016llx %4u %10u %8u %7u", i, c.pass.c_str(),
+                        (unsigned long long) c.key,
+                        unsigned((c.key & PRIORITY_MASK) >> PRIORITY_SHIFT),
+                        c.renderable, c.materialId, c.variant);
+            }
+        }
+        ImGui::EndChild();
+    }
+    ImGui::End();
+}
+
+static void showRenderables(Capture const& capture) {
+    ImGui::Begin("Renderables");
+    size_t visible = 0;
+    for (Renderable const& r : capture.renderables) {
+        visible += r.visibleMask ? 1 : 0;
+    }
+    size_t vertices = 0;
+    for (Primitive const& p : capture.primitives) {
+        vertices += p.vertexCount;
+    }
+    ImGui::Text("%zu renderables, %zu visible in a pass, %zu culled",
+            capture.renderables.size(), visible, capture.renderables.size() - visible);
+    ImGui::Text("%zu primitives, %zu vertices", capture.primitives.size(), vertices);
+    ImGui::BeginChild("##renderables");
+    ImGuiListClipper clipper(int(capture.renderables.size()));
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            Renderable const& r = capture.renderables[i];
+            ImGui::Text("instance %6u  visibility 0x%02x  layers 0x%02x  %u primitives",
+                    r.instance, r.visibleMask, r.layers, r.primitiveCount);
+        }
+    }
+    ImGui::EndChild();
+    ImGui::End();
+}
+
+static void showFroxels(Capture const& capture, int* slice) {
+    ImGui::Begin("Froxels");
+    const uint32_t countX = capture.froxelCount[0];
+    const uint32_t countY = capture.froxelCount[1];
+    const uint32_t countZ = capture.froxelCount[2];
+    uint32_t maxLights = 0;
+    size_t records = 0;
+    for (Froxel const& f : capture.froxels) {
+        maxLights = std::max(maxLights, f.pointLights + f.spotLights);
+        records += f.pointLights + f.spotLights;
+    }
+    ImGui::Text("%u x %u x %u froxels, %zu with lights, %zu light records",
+            countX, countY, countZ, capture.froxels.size(), records);
+    ImGui::Text("at most %u lights in a froxel", maxLights);
+    if (!countZ) {
+        ImGui::End();
+        return;
+    }
+
+    // the light count of each froxel of a slice, brighter with more lights
+    ImGui::SliderInt("slice", slice, 0, int(countZ) - 1);
+    std::vector<uint32_t> lights(countX * countY);
+    for (Froxel const& f : capture.froxels) {
+        if (f.z == uint32_t(*slice) && f.x < countX && f.y < countY) {
+            lights[f.y * countX + f.x] = f.pointLights + f.spotLights;
+        }
+    }
+    const float cell = 12.0f;
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    for (uint32_t y = 0; y < countY; y++) {
+        for (uint32_t x = 0; x < countX; x++) {
+            const float intensity = maxLights ? float(lights[y * countX + x]) / maxLights : 0.0f;
+            // y goes up in the froxel grid
+            const ImVec2 min(origin.x + x * cell, origin.y + (countY - 1 - y) * cell);
+            drawList->AddRectFilled(min, ImVec2(min.x + cell - 1, min.y + cell - 1),
+                    ImGui::GetColorU32(ImVec4(intensity, intensity * 0.5f, 0.1f, 1.0f)));
+        }
+    }
+    ImGui::Dummy(ImVec2(countX * cell, countY * cell));
+    ImGui::End();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <capture>" << std::endl;
+        return 1;
+    }
+
+    Capture capture;
+    if (!loadCapture(argv[1], &capture)) {
+        return 1;
+    }
+    const CommandSummary summary = summarizeCommands(capture);
+
+    int slice = 0;
+    auto imgui = [&capture, &summary, &slice](filament::Engine*, filament::View*) {
+        showFrame(capture);
+        showCommands(capture, summary);
+        showRenderables(capture);
+        showFroxels(capture, &slice);
+    };
+
+    Config config;
+    config.title = "Frame Capture";
+    auto nop = [](filament::Engine*, filament::View*, filament::Scene*) {};
+    FilamentApp::get().run(config, nop, nop, imgui);
+
+    return 0;
+}
@@ -51,3 +51,33 @@ float getExposure() {
 float getEV100() {
     return frameUniforms.ev100;
 }
+
+//------------------------------------------------------------------------------
+// Shadowing
+//------------------------------------------------------------------------------
+
+#if defined(HAS_SHADOWING) && defined(HAS_DIRECTIONAL_LIGHTING)
+mat4 getLightFromWorldMatrix(const uint cascade) {
+    return frameUniforms.lightFromWorldMatrix[cascade];
+}
+
+/**
+ * Computes the light space position of the specified world space point, in the
+ * shadow map of the specified cascade. The returned point contains a bias to
+ * attempt to eliminate common shadowing artifacts such as "acne". To achieve
+ * this, the world space normal at the point must also be passed to this function.
+ */
+HIGHP vec4 computeLightSpacePosition(const HIGHP vec3 p, const vec3 n, const uint cascade) {
+    float NoL = saturate(dot(n, frameUniforms.lightDirection));
+
+#ifdef TARGET_MOBILE
+    float normalBias = 1.0 - NoL * NoL;
+#else
+    float normalBias = sqrt(1.0 - NoL * NoL);
+#endif
+
+    // the constant bias is part of the light space matrix
+    HIGHP vec3 offsetPosition = p + n * (normalBias * frameUniforms.shadowNormalBias[cascade]);
+    return getLightFromWorldMatrix(cascade) * vec4(offsetPosition, 1.0);
+}
+#endif
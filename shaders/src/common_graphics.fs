@@ -69,6 +69,17 @@ vec3 decodeRGBM(vec4 c) {
     return c.rgb * c.rgb;
 }
 
+/**
+ * Encodes the specified linear HDR RGB value to RGBM, this is the inverse of decodeRGBM().
+ */
+vec4 encodeRGBM(vec3 c) {
+    c = sqrt(c) * (1.0 / 16.0);
+    // don't let M go below 1 in the [0..16] range
+    float m = clamp(max(max(c.r, c.g), max(c.b, 1e-6)), 1.0 / 16.0, 1.0);
+    m = ceil(m * 255.0) / 255.0;
+    return vec4(saturate(c / m), m);
+}
+
 //------------------------------------------------------------------------------
 // Common debug
 //------------------------------------------------------------------------------
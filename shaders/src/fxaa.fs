@@ -1,7 +1,7 @@
 // ES 3.0/3.1 gives us the ARB_gpu_shader5 bits we need
 #define gpu_shader5        1
 // ES 3.0 does not have gather though
-#if defined(TARGET_VULKAN_ENVIRONMENT) || !defined(TARGET_MOBILE)
+#if defined(TARGET_VULKAN_ENVIRONMENT) || defined(TARGET_METAL_ENVIRONMENT) || !defined(TARGET_MOBILE)
 #define FXAA_GATHER4_ALPHA 1
 #else
 #define FXAA_GATHER4_ALPHA 0
@@ -430,6 +430,29 @@ NOTE the other tuning knobs are now in the shader function inputs!
 /*--------------------------------------------------------------------------*/
 
 
+/*============================================================================
+                    FUSED TONE MAPPING SUPPORT FUNCTION
+============================================================================*/
+// When tone mapping and anti-aliasing are done in a single pass, FXAA reads the HDR color
+// buffer directly and each tap is tone mapped, computing the luma the tone mapping pass would
+// have stored in alpha. Note that bilinear filtering happens before tone mapping.
+#if POST_PROCESS_TONE_MAPPING
+vec4 FxaaToneMap(vec4 color) {
+#if POST_PROCESS_OPAQUE
+    color.rgb = OECF(tonemap(color.rgb));
+    color.a   = luminance(color.rgb);
+#else
+    color.rgb /= color.a + FLT_EPS;
+    color.rgb  = OECF(tonemap(color.rgb));
+    color.rgb *= color.a + FLT_EPS;
+#endif
+    return color;
+}
+    #undef FxaaTexTop
+    #define FxaaTexTop(t, p) FxaaToneMap(textureLod(t, p, 0.0))
+#endif
+/*--------------------------------------------------------------------------*/
+
 /*============================================================================
                    GREEN AS LUMA OPTION SUPPORT FUNCTION
 ============================================================================*/
@@ -24,7 +24,23 @@ vec2 getUV1() {
 #endif
 
 #if defined(HAS_SHADOWING) && defined(HAS_DIRECTIONAL_LIGHTING)
+/**
+ * Returns the index of the shadow cascade covering the current fragment, i.e. the
+ * number of cascades ending in front of it. The last cascade never ends.
+ */
+uint getShadowCascade() {
+    HIGHP float z = -(frameUniforms.viewFromWorldMatrix * vec4(vertex_worldPosition, 1.0)).z;
+    bvec4 greaterZ = greaterThan(vec4(z), frameUniforms.cascadeSplits);
+    return uint(dot(vec4(greaterZ), vec4(1.0)));
+}
+
 HIGHP vec3 getLightSpacePosition() {
-    return vertex_lightSpacePosition.xyz * (1.0 / vertex_lightSpacePosition.w);
+    HIGHP vec4 p = vertex_lightSpacePosition;
+    uint cascade = getShadowCascade();
+    if (cascade != 0u) {
+        // the vertex shader only computes the position in the first cascade
+        p = computeLightSpacePosition(vertex_worldPosition, normalize(vertex_worldNormal), cascade);
+    }
+    return p.xyz * (1.0 / p.w);
 }
 #endif
@@ -2,18 +2,37 @@
 // Uniforms access
 //------------------------------------------------------------------------------
 
-mat4 getLightFromWorldMatrix() {
-    return frameUniforms.lightFromWorldMatrix;
+int getInstanceIndex() {
+#if defined(CODEGEN_TARGET_VULKAN_ENVIRONMENT)
+    return gl_InstanceIndex;
+#else
+    return gl_InstanceID;
+#endif
 }
 
+int getVertexIndex() {
+#if defined(CODEGEN_TARGET_VULKAN_ENVIRONMENT)
+    return gl_VertexIndex;
+#else
+    return gl_VertexID;
+#endif
+}
+
+// The first instance of an instanced draw (or the only instance of a regular draw) uses the
+// per-renderable uniforms, the other instances use the per-instance uniforms.
+
 /** @public-api */
 mat4 getWorldFromModelMatrix() {
-    return objectUniforms.worldFromModelMatrix;
+    int index = getInstanceIndex();
+    return index == 0 ? objectUniforms.worldFromModelMatrix
+            : instanceUniforms.worldFromModelMatrix[index];
 }
 
 /** @public-api */
 mat3 getWorldFromModelNormalMatrix() {
-    return objectUniforms.worldFromModelNormalMatrix;
+    int index = getInstanceIndex();
+    return index == 0 ? objectUniforms.worldFromModelNormalMatrix
+            : instanceUniforms.worldFromModelNormalMatrix[index];
 }
 
 //------------------------------------------------------------------------------
@@ -21,15 +40,35 @@ mat3 getWorldFromModelNormalMatrix() {
 //------------------------------------------------------------------------------
 
 #if defined(HAS_SKINNING)
-void skinNormal(inout vec3 n, const uvec4 ids, const vec4 weights) {
-    // this assumes that the sum of the weight is 1.0
-    n += (halfPartialTransformVertexUnitQ(n, bonesUniforms.bones[ids.x * 2u]) * weights.x
-        + halfPartialTransformVertexUnitQ(n, bonesUniforms.bones[ids.y * 2u]) * weights.y
-        + halfPartialTransformVertexUnitQ(n, bonesUniforms.bones[ids.z * 2u]) * weights.z
-        + halfPartialTransformVertexUnitQ(n, bonesUniforms.bones[ids.w * 2u]) * weights.w) * 2.0f;
+// When dual-quaternion skinning is enabled, each bone holds its rotation as a unit quaternion
+// followed by the dual part of its unit dual quaternion (instead of its translation)
+void blendDualQuaternions(out vec4 real, out vec4 dual, const uvec4 ids, const vec4 weights) {
+    vec4 q0 = bonesUniforms.bones[ids.x * 2u];
+    vec4 q1 = bonesUniforms.bones[ids.y * 2u];
+    vec4 q2 = bonesUniforms.bones[ids.z * 2u];
+    vec4 q3 = bonesUniforms.bones[ids.w * 2u];
+    // blend in the same hemisphere as the first bone to take the shortest path
+    vec4 w = weights * (step(0.0, vec4(1.0, dot(q0, q1), dot(q0, q2), dot(q0, q3))) * 2.0 - 1.0);
+    real = q0 * w.x + q1 * w.y + q2 * w.z + q3 * w.w;
+    dual = bonesUniforms.bones[ids.x * 2u + 1u] * w.x
+         + bonesUniforms.bones[ids.y * 2u + 1u] * w.y
+         + bonesUniforms.bones[ids.z * 2u + 1u] * w.z
+         + bonesUniforms.bones[ids.w * 2u + 1u] * w.w;
+    float invLength = inversesqrt(dot(real, real));
+    real *= invLength;
+    dual *= invLength;
 }
 
 void skinPosition(inout vec3 p, const uvec4 ids, const vec4 weights) {
+    if (objectUniforms.skinningDualQuaternion != 0u) {
+        vec4 real;
+        vec4 dual;
+        blendDualQuaternions(real, dual, ids, weights);
+        // the translation is 2 * dual * conjugate(real)
+        p = transformVertexUnitQ(p, real)
+                + 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+        return;
+    }
     // this assumes that the sum of the weight is 1.0
     p +=  partialTransformVertexUnitQT(p, bonesUniforms.bones[ids.x * 2u], bonesUniforms.bones[ids.x * 2u + 1u].xyz) * weights.x
         + partialTransformVertexUnitQT(p, bonesUniforms.bones[ids.y * 2u], bonesUniforms.bones[ids.y * 2u + 1u].xyz) * weights.y
@@ -38,6 +77,88 @@ void skinPosition(inout vec3 p, const uvec4 ids, const vec4 weights) {
 }
 #endif
 
+#if defined(HAS_SKINNING_TRANSFORM)
+mat3 unitQuaternionToMat3(const vec4 q) {
+    vec3 q2 = q.xyz * 2.0;
+    vec3 qq = q.xyz * q2;
+    vec3 w = q.w * q2;
+    float xy = q.x * q2.y;
+    float xz = q.x * q2.z;
+    float yz = q.y * q2.z;
+    return mat3(1.0 - qq.y - qq.z, xy + w.z, xz - w.y,
+                xy - w.z, 1.0 - qq.x - qq.z, yz + w.x,
+                xz + w.y, yz - w.x, 1.0 - qq.x - qq.y);
+}
+
+// The blended bones of the current vertex. It's computed once at the beginning of main() and
+// applied to the position, normal and tangent, instead of skinning each of them separately.
+struct SkinningTransform {
+    mat3 rotation;
+    vec3 translation;
+};
+
+SkinningTransform skinningTransform;
+
+SkinningTransform getSkinningTransform(const uvec4 ids, const vec4 weights) {
+    SkinningTransform t;
+    if (objectUniforms.skinningDualQuaternion != 0u) {
+        vec4 real;
+        vec4 dual;
+        blendDualQuaternions(real, dual, ids, weights);
+        t.rotation = unitQuaternionToMat3(real);
+        t.translation = 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+        return t;
+    }
+    // this assumes that the sum of the weight is 1.0
+    t.rotation = unitQuaternionToMat3(bonesUniforms.bones[ids.x * 2u]) * weights.x
+               + unitQuaternionToMat3(bonesUniforms.bones[ids.y * 2u]) * weights.y
+               + unitQuaternionToMat3(bonesUniforms.bones[ids.z * 2u]) * weights.z
+               + unitQuaternionToMat3(bonesUniforms.bones[ids.w * 2u]) * weights.w;
+    t.translation = bonesUniforms.bones[ids.x * 2u + 1u].xyz * weights.x
+                  + bonesUniforms.bones[ids.y * 2u + 1u].xyz * weights.y
+                  + bonesUniforms.bones[ids.z * 2u + 1u].xyz * weights.z
+                  + bonesUniforms.bones[ids.w * 2u + 1u].xyz * weights.w;
+    return t;
+}
+#endif
+
+#if defined(HAS_MORPHING)
+// The deltas of each morph target take consecutive rows of the morph target buffer, see
+// FMorphTargetBuffer. Returns the texel of the current vertex in the first target, and the
+// number of rows taken by each target.
+ivec3 getMorphTargetTexel() {
+    ivec2 size = textureSize(morphTargetBuffer_positions, 0);
+    int vertex = getVertexIndex();
+    return ivec3(vertex % size.x, vertex / size.x, size.y / int(objectUniforms.morphTargetCount));
+}
+
+float getMorphWeight(uint target) {
+    return objectUniforms.morphWeights[target >> 2u][target & 3u];
+}
+
+void morphPosition(inout vec4 p) {
+    ivec3 texel = getMorphTargetTexel();
+    for (uint i = 0u; i < objectUniforms.morphTargetCount; i++) {
+        float weight = getMorphWeight(i);
+        if (weight != 0.0) {
+            ivec2 uv = ivec2(texel.x, texel.y + int(i) * texel.z);
+            p.xyz += weight * texelFetch(morphTargetBuffer_positions, uv, 0).xyz;
+        }
+    }
+}
+
+void morphNormal(inout vec3 n) {
+    ivec3 texel = getMorphTargetTexel();
+    for (uint i = 0u; i < objectUniforms.morphTargetCount; i++) {
+        float weight = getMorphWeight(i);
+        if (weight != 0.0) {
+            ivec2 uv = ivec2(texel.x, texel.y + int(i) * texel.z);
+            n += weight * texelFetch(morphTargetBuffer_normals, uv, 0).xyz;
+        }
+    }
+}
+#endif
+
 /** @public-api */
 vec4 getPosition() {
     return mesh_position;
@@ -45,7 +166,13 @@ vec4 getPosition() {
 
 vec4 getSkinnedPosition() {
     vec4 pos = getPosition();
-#if defined(HAS_SKINNING)
+#if defined(HAS_MORPHING)
+    // morph targets are applied before skinning
+    morphPosition(pos);
+#endif
+#if defined(HAS_SKINNING_TRANSFORM)
+    pos.xyz = skinningTransform.rotation * pos.xyz + skinningTransform.translation;
+#elif defined(HAS_SKINNING)
     skinPosition(pos.xyz, mesh_bone_indices, mesh_bone_weights);
 #endif
     return pos;
@@ -0,0 +1,209 @@
+//------------------------------------------------------------------------------
+// IBL prefiltering
+//
+// These are the GPU versions of cmgen's CubemapIBL::roughnessFilter(),
+// CubemapSH::computeIrradianceSH3Bands() and CubemapIBL::DFG(), refer to
+// these for details. The environment is postProcess_environment.
+//------------------------------------------------------------------------------
+
+/**
+ * Returns the direction of the cubemap texel at uv in [0, 1], the faces are
+ * numbered like TextureCubemapFace.
+ */
+HIGHP vec3 iblDirection(const int face, const HIGHP vec2 uv) {
+    HIGHP vec2 p = uv * 2.0 - 1.0;
+    HIGHP vec3 d;
+    if (face == 0) {
+        d = vec3( 1.0, -p.y, -p.x);
+    } else if (face == 1) {
+        d = vec3(-1.0, -p.y,  p.x);
+    } else if (face == 2) {
+        d = vec3( p.x,  1.0,  p.y);
+    } else if (face == 3) {
+        d = vec3( p.x, -1.0, -p.y);
+    } else if (face == 4) {
+        d = vec3( p.x, -p.y,  1.0);
+    } else {
+        d = vec3(-p.x, -p.y, -1.0);
+    }
+    return normalize(d);
+}
+
+/**
+ * Returns the direction of the texel at uv in [0, 1] of an octahedral map, the
+ * inverse of reflectionProbeUv() in light_indirect.fs.
+ */
+HIGHP vec3 iblOctahedralDirection(const HIGHP vec2 uv) {
+    HIGHP vec2 p = uv * 2.0 - 1.0;
+    HIGHP vec3 d = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    if (d.z < 0.0) {
+        d.xy = (1.0 - abs(d.yx)) * vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(d);
+}
+
+HIGHP vec2 iblHammersley(const uint index, const HIGHP float invNumSamples) {
+    uint bits = index;
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return vec2(float(index) * invNumSamples, float(bits) * 2.3283064365386963e-10);
+}
+
+/**
+ * Importance sampling of GGX, returns the half vector in tangent space.
+ */
+HIGHP vec3 iblImportanceSampleGGX(const HIGHP vec2 u, const HIGHP float a) {
+    HIGHP float phi = 2.0 * PI * u.x;
+    // NOTE: (aa-1) == (a-1)(a+1) produces better fp accuracy
+    HIGHP float cosTheta2 = (1.0 - u.y) / (1.0 + (a + 1.0) * ((a - 1.0) * u.y));
+    HIGHP float cosTheta = sqrt(cosTheta2);
+    HIGHP float sinTheta = sqrt(1.0 - cosTheta2);
+    return vec3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
+}
+
+HIGHP float iblDistributionGGX(const HIGHP float NoH, const HIGHP float a) {
+    HIGHP float f = (a - 1.0) * ((a + 1.0) * (NoH * NoH)) + 1.0;
+    return (a * a) / (PI * f * f);
+}
+
+HIGHP float iblVisibility(const HIGHP float NoV, const HIGHP float NoL, const HIGHP float a) {
+    // Heitz 2014, "Understanding the Masking-Shadowing Function in Microfacet-Based BRDFs"
+    HIGHP float a2 = a * a;
+    HIGHP float GGXL = NoV * sqrt((NoL - NoL * a2) * NoL + a2);
+    HIGHP float GGXV = NoL * sqrt((NoV - NoV * a2) * NoV + a2);
+    return 0.5 / (GGXV + GGXL);
+}
+
+//------------------------------------------------------------------------------
+// Roughness prefilter
+//------------------------------------------------------------------------------
+
+vec3 iblRoughnessPrefilter(const HIGHP vec3 N) {
+    HIGHP float a = postProcessUniforms.iblRoughness;
+    if (a == 0.0) {
+        return textureLod(postProcess_environment, N, 0.0).rgb;
+    }
+
+    uint sampleCount = uint(postProcessUniforms.iblSampleCount);
+    HIGHP float numSamples = float(sampleCount);
+    HIGHP float size = postProcessUniforms.iblSourceSize;
+    HIGHP float maxLevel = postProcessUniforms.iblSourceMaxLevel;
+    HIGHP float omegaP = (4.0 * PI) / (6.0 * size * size);
+
+    // center the cone around the normal (handle case of normal close to up)
+    HIGHP vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    HIGHP vec3 T = normalize(cross(up, N));
+    HIGHP vec3 B = cross(N, T);
+
+    HIGHP vec3 Li = vec3(0.0);
+    HIGHP float weight = 0.0;
+    for (uint i = 0u; i < sampleCount; i++) {
+        HIGHP vec3 H = iblImportanceSampleGGX(iblHammersley(i, 1.0 / numSamples), a);
+        HIGHP float NoH = H.z;
+        HIGHP float NoL = 2.0 * NoH * NoH - 1.0;
+        HIGHP vec3 L = vec3(2.0 * NoH * H.x, 2.0 * NoH * H.y, NoL);
+        if (NoL > 0.0) {
+            // pre-filtered importance sampling, the LOD is given by:
+            // max[ log4(Os/Op) + log4(K), 0 ], with K = 4
+            HIGHP float pdf = iblDistributionGGX(NoH, a) / 4.0;
+            HIGHP float omegaS = 1.0 / (numSamples * pdf);
+            HIGHP float lod = clamp(0.5 * log2(omegaS / omegaP) + 1.0, 0.0, maxLevel);
+
+            HIGHP float LoH = dot(L, H);
+            HIGHP float brdf_NoL = (1.0 - pow5(1.0 - LoH)) * iblVisibility(1.0, NoL, a) * NoL;
+
+            HIGHP vec3 dir = T * L.x + B * L.y + N * L.z;
+            Li += textureLod(postProcess_environment, dir, lod).rgb * brdf_NoL;
+            weight += brdf_NoL;
+        }
+    }
+    return Li / weight;
+}
+
+vec3 iblRoughnessPrefilter(const int face, const HIGHP vec2 uv) {
+    return iblRoughnessPrefilter(iblDirection(face, uv));
+}
+
+//------------------------------------------------------------------------------
+// Irradiance SH, 3 bands, pre-scaled for the shader (see light_indirect.fs)
+//------------------------------------------------------------------------------
+
+HIGHP float iblSphereQuadrantArea(const HIGHP float x, const HIGHP float y) {
+    return atan(x * y, sqrt(x * x + y * y + 1.0));
+}
+
+HIGHP float iblSolidAngle(const HIGHP float dim, const HIGHP vec2 texel) {
+    HIGHP float iDim = 1.0 / dim;
+    HIGHP vec2 st = (texel + 0.5) * 2.0 * iDim - 1.0;
+    HIGHP vec2 p0 = st - iDim;
+    HIGHP vec2 p1 = st + iDim;
+    return iblSphereQuadrantArea(p0.x, p0.y) - iblSphereQuadrantArea(p0.x, p1.y) -
+           iblSphereQuadrantArea(p1.x, p0.y) + iblSphereQuadrantArea(p1.x, p1.y);
+}
+
+HIGHP float iblIrradianceShBasis(const int index, const HIGHP vec3 s) {
+    // the constants fold the SH normalization and the truncated cosine convolution
+    if (index == 0) return 0.25;
+    if (index == 1) return 0.5 * s.y;
+    if (index == 2) return 0.5 * s.z;
+    if (index == 3) return 0.5 * s.x;
+    if (index == 4) return 0.9375 * s.y * s.x;
+    if (index == 5) return 0.9375 * s.y * s.z;
+    if (index == 6) return 0.078125 * (3.0 * s.z * s.z - 1.0);
+    if (index == 7) return 0.9375 * s.z * s.x;
+    return 0.234375 * (s.x * s.x - s.y * s.y);
+}
+
+vec3 iblIrradianceSH(const int index) {
+    // integrate over a level of at most 64x64 texels per face, this is plenty for 3 bands
+    HIGHP float size = postProcessUniforms.iblSourceSize;
+    HIGHP float level = min(max(0.0, log2(size) - 6.0), postProcessUniforms.iblSourceMaxLevel);
+    HIGHP float dim = max(1.0, floor(size / exp2(level)));
+    int count = int(dim);
+
+    HIGHP vec3 sh = vec3(0.0);
+    for (int face = 0; face < 6; face++) {
+        for (int y = 0; y < count; y++) {
+            for (int x = 0; x < count; x++) {
+                HIGHP vec2 texel = vec2(float(x), float(y));
+                HIGHP vec3 s = iblDirection(face, (texel + 0.5) / dim);
+                HIGHP vec3 color = textureLod(postProcess_environment, s, level).rgb;
+                sh += color * (iblSolidAngle(dim, texel) * iblIrradianceShBasis(index, s));
+            }
+        }
+    }
+    return sh;
+}
+
+//------------------------------------------------------------------------------
+// DFG LUT, multi-scattering formulation (see light_indirect.fs)
+//------------------------------------------------------------------------------
+
+vec2 iblDFG(const HIGHP vec2 uv) {
+    HIGHP float NoV = uv.x;
+    HIGHP float a = uv.y * uv.y;
+    HIGHP vec3 V = vec3(sqrt(1.0 - NoV * NoV), 0.0, NoV);
+
+    uint sampleCount = uint(postProcessUniforms.iblSampleCount);
+    HIGHP float numSamples = float(sampleCount);
+
+    HIGHP vec2 r = vec2(0.0);
+    for (uint i = 0u; i < sampleCount; i++) {
+        HIGHP vec3 H = iblImportanceSampleGGX(iblHammersley(i, 1.0 / numSamples), a);
+        HIGHP vec3 L = 2.0 * dot(V, H) * H - V;
+        HIGHP float VoH = saturate(dot(V, H));
+        HIGHP float NoL = saturate(L.z);
+        HIGHP float NoH = saturate(H.z);
+        if (NoL > 0.0) {
+            // Note: remember VoH == LoH  (H is half vector)
+            HIGHP float v = iblVisibility(NoV, NoL, a) * NoL * (VoH / NoH);
+            HIGHP float Fc = pow5(1.0 - VoH);
+            r.x += v * Fc;
+            r.y += v;
+        }
+    }
+    return r * (4.0 / numSamples);
+}
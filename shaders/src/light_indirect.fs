@@ -150,7 +150,59 @@ vec3 diffuseIrradiance(const vec3 n) {
 // IBL specular
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+// Reflection probes
+//------------------------------------------------------------------------------
+
+/**
+ * Returns the uv in [0, 1] of the direction d in an octahedral map, the inverse
+ * of iblOctahedralDirection() in ibl_prefilter.fs.
+ */
+vec2 reflectionProbeUv(const highp vec3 d) {
+    highp vec2 p = d.xy / (abs(d.x) + abs(d.y) + abs(d.z));
+    if (d.z < 0.0) {
+        p = (1.0 - abs(p.yx)) * vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return p * 0.5 + 0.5;
+}
+
+/**
+ * Samples the reflections of a probe (1 + its index) in the direction r. The
+ * direction is corrected for the probe's box, so that the reflections appear at
+ * the walls of the box rather than infinitely far away.
+ */
+vec3 reflectionProbeIrradiance(const uint probe, const vec3 r, float lod) {
+    int index = int(probe) - 1;
+    highp vec3 boxMin = frameUniforms.reflectionProbes[index * 3].xyz;
+    highp vec3 boxMax = frameUniforms.reflectionProbes[index * 3 + 1].xyz;
+    highp vec3 position = frameUniforms.reflectionProbes[index * 3 + 2].xyz;
+
+    // the probes are in the space of the application, without the world origin
+    highp mat4 probesFromWorld = frameUniforms.reflectionProbesFromWorldMatrix;
+    highp vec3 p = (probesFromWorld * vec4(shading_position, 1.0)).xyz;
+    highp vec3 d = mat3(probesFromWorld) * r;
+
+    // distance along d to the box, seen from the inside
+    highp vec3 t = max((boxMax - p) / d, (boxMin - p) / d);
+    highp float hit = max(0.0, min(t.x, min(t.y, t.z)));
+    highp vec3 direction = p + d * hit - position;
+
+    // the uv stay half a texel of the coarser level inside the tile, for the bilinear filter
+    lod = min(lod, REFLECTION_PROBE_MAX_MIP_LEVEL);
+    float margin = 0.5 * exp2(ceil(lod)) / REFLECTION_PROBE_SIZE;
+    vec2 uv = clamp(reflectionProbeUv(direction), margin, 1.0 - margin);
+    vec2 tile = vec2(float(index % REFLECTION_PROBE_ATLAS_COLUMNS),
+            float(index / REFLECTION_PROBE_ATLAS_COLUMNS));
+    vec2 tiles = vec2(float(REFLECTION_PROBE_ATLAS_COLUMNS), float(REFLECTION_PROBE_ATLAS_ROWS));
+    uv = (tile + uv) / tiles;
+    return decodeDataForIBL(textureLod(light_reflectionProbes, uv, lod));
+}
+
 vec3 specularIrradiance(const vec3 r, float roughness) {
+    uint probe = objectUniforms.reflectionProbe;
+    if (probe != 0u) {
+        return reflectionProbeIrradiance(probe, r, REFLECTION_PROBE_MAX_MIP_LEVEL * roughness);
+    }
     // lod = nb_mips * sqrt(linear_roughness)
     // where linear_roughness = roughness^2
     // using all the mip levels requires seamless cubemap sampling
@@ -159,6 +211,11 @@ vec3 specularIrradiance(const vec3 r, float roughness) {
 }
 
 vec3 specularIrradiance(const vec3 r, float roughness, float offset) {
+    uint probe = objectUniforms.reflectionProbe;
+    if (probe != 0u) {
+        return reflectionProbeIrradiance(probe, r,
+                REFLECTION_PROBE_MAX_MIP_LEVEL * roughness + offset);
+    }
     float lod = IBL_MAX_MIP_LEVEL * roughness;
     return decodeDataForIBL(textureLod(light_iblSpecular, r, lod + offset));
 }
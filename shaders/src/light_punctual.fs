@@ -112,6 +112,26 @@ void setupPunctualLight(inout Light light, const HIGHP vec4 positionFalloff) {
     light.attenuation = getDistanceAttenuation(posToLight, positionFalloff.w);
 }
 
+#if defined(HAS_SHADOWING)
+/**
+ * Returns the visibility of the specified spot light at the current fragment,
+ * from the light's shadow map in the spot shadow atlas. The normal bias is
+ * expressed per unit of distance to the light since the size of the shadow
+ * map's texels grows with the distance.
+ */
+float getSpotLightVisibility(const vec3 l, const HIGHP vec3 posToLight, const vec2 shadowParams) {
+    vec3 n = normalize(vertex_worldNormal);
+    float NoL = saturate(dot(n, l));
+    float normalBias = sqrt(1.0 - NoL * NoL) * shadowParams.y * length(posToLight);
+
+    // the constant bias is part of the light space matrix
+    HIGHP vec3 offsetPosition = vertex_worldPosition + n * normalBias;
+    HIGHP vec4 p = frameUniforms.spotLightFromWorldMatrix[uint(shadowParams.x)] *
+            vec4(offsetPosition, 1.0);
+    return shadow(light_spotShadowMap, p.xyz * (1.0 / p.w));
+}
+#endif
+
 /**
  * Returns a Light structure (see common_lighting.fs) describing a spot light.
  * The colorIntensity field will store the *pre-exposed* intensity of the light
@@ -137,6 +157,15 @@ Light getSpotLight(uint index) {
 
     light.attenuation *= getAngleAttenuation(-directionIES.xyz, light.l, scaleOffset);
 
+#if defined(HAS_SHADOWING)
+    // x is the index of the light's shadow map, or -1 if it doesn't have one
+    vec2 shadowParams = lightsUniforms.lights[lightIndex][3].zw;
+    if (shadowParams.x >= 0.0) {
+        light.attenuation *= getSpotLightVisibility(light.l,
+                positionFalloff.xyz - vertex_worldPosition, shadowParams);
+    }
+#endif
+
     return light;
 }
 
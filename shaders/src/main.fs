@@ -11,4 +11,15 @@ void main() {
     material(inputs);
 
     fragColor = evaluateMaterial(inputs);
+
+#if defined(BLEND_MODE_TRANSPARENT) && !defined(BLEND_MODE_FADE)
+    if (frameUniforms.orderIndependentTransparency > 0.0) {
+        // Weighted blended order-independent transparency (McGuire and Bavoil 2013), the
+        // weight favors the surfaces close to the camera and the more opaque ones
+        float d = 1.0 / gl_FragCoord.w;
+        float w = clamp(10.0 / (1e-5 + pow(d / 5.0, 2.0) + pow(d / 200.0, 6.0)), 1e-2, 3e3);
+        fragColor.rgb *= w;
+        fragTransparencyWeight = fragColor.a * w;
+    }
+#endif
 }
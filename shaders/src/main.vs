@@ -1,4 +1,8 @@
 void main() {
+#if defined(HAS_SKINNING_TRANSFORM)
+    skinningTransform = getSkinningTransform(mesh_bone_indices, mesh_bone_weights);
+#endif
+
     // Initialize the inputs to sensible default values, see common_material.vs
     MaterialVertexInputs material;
     initMaterialVertex(material);
@@ -10,11 +14,14 @@ void main() {
         // Extract the normal and tangent in world space from the input quaternion
         // We encode the orthonormal basis as a quaternion to save space in the attributes
         toTangentFrame(normalize(mesh_tangents), material.worldNormal, vertex_worldTangent);
-        vertex_worldTangent = objectUniforms.worldFromModelNormalMatrix * vertex_worldTangent;
-        material.worldNormal = objectUniforms.worldFromModelNormalMatrix * material.worldNormal;
-        #if defined(HAS_SKINNING)
-            skinNormal(material.worldNormal, mesh_bone_indices, mesh_bone_weights);
-            skinNormal(vertex_worldTangent, mesh_bone_indices, mesh_bone_weights);
+        #if defined(HAS_MORPHING)
+            morphNormal(material.worldNormal);
+        #endif
+        vertex_worldTangent = getWorldFromModelNormalMatrix() * vertex_worldTangent;
+        material.worldNormal = getWorldFromModelNormalMatrix() * material.worldNormal;
+        #if defined(HAS_SKINNING_TRANSFORM)
+            material.worldNormal = skinningTransform.rotation * material.worldNormal;
+            vertex_worldTangent = skinningTransform.rotation * vertex_worldTangent;
         #endif
         // Reconstruct the bitangent from the normal and tangent. We don't bother with
         // normalization here since we'll do it after interpolation in the fragment stage
@@ -22,9 +29,12 @@ void main() {
     #else // MATERIAL_HAS_ANISOTROPY || MATERIAL_HAS_NORMAL
         // Without anisotropy or normal mapping we only need the normal vector
         toTangentFrame(normalize(mesh_tangents), material.worldNormal);
-        material.worldNormal = objectUniforms.worldFromModelNormalMatrix * material.worldNormal;
-        #if defined(HAS_SKINNING)
-            skinNormal(material.worldNormal, mesh_bone_indices, mesh_bone_weights);
+        #if defined(HAS_MORPHING)
+            morphNormal(material.worldNormal);
+        #endif
+        material.worldNormal = getWorldFromModelNormalMatrix() * material.worldNormal;
+        #if defined(HAS_SKINNING_TRANSFORM)
+            material.worldNormal = skinningTransform.rotation * material.worldNormal;
         #endif
     #endif // MATERIAL_HAS_ANISOTROPY || MATERIAL_HAS_NORMAL
 
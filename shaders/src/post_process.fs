@@ -1,14 +1,33 @@
 LAYOUT_LOCATION(0) in HIGHP vec2 vertex_uv;
 
+#if POST_PROCESS_FRAMEBUFFER_FETCH && defined(GL_EXT_shader_framebuffer_fetch)
+#define FRAMEBUFFER_FETCH 1
+#else
+#define FRAMEBUFFER_FETCH 0
+#endif
+
+#if FRAMEBUFFER_FETCH
+// the pass renders into its source, each fragment reads the pixel it replaces from the tile
+LAYOUT_LOCATION(0) inout vec4 fragColor;
+#else
 LAYOUT_LOCATION(0) out vec4 fragColor;
+#endif
 
 #if POST_PROCESS_TONE_MAPPING
 vec3 resolveFragment(const ivec2 uv) {
+#if FRAMEBUFFER_FETCH
+    return fragColor.rgb;
+#else
     return texelFetch(postProcess_colorBuffer, uv, 0).rgb;
+#endif
 }
 
 vec4 resolveAlphaFragment(const ivec2 uv) {
+#if FRAMEBUFFER_FETCH
+    return fragColor;
+#else
     return texelFetch(postProcess_colorBuffer, uv, 0);
+#endif
 }
 
 vec4 resolve() {
@@ -60,11 +79,116 @@ vec4 PostProcess_AntiAliasing() {
 }
 #endif
 
+#if POST_PROCESS_TEMPORAL_UPSCALING
+vec4 PostProcess_TemporalUpscaling() {
+    // size of a texel of the current frame, in texture coordinates
+    HIGHP vec2 texelSize = postProcessUniforms.uvScale * frameUniforms.resolution.zw;
+
+    // the current frame was rendered with a sub-pixel jitter, its content at this pixel is
+    // shifted accordingly
+    HIGHP vec2 uv = vertex_uv + postProcessUniforms.jitter * texelSize;
+    vec4 current = textureLod(postProcess_colorBuffer, uv, 0.0);
+
+    // the history is clamped to the neighborhood of the current frame, which rejects most
+    // of the history that's not valid anymore (disocclusions, moving objects)
+    vec4 n = textureLod(postProcess_colorBuffer, uv + vec2( 0.0,  texelSize.y), 0.0);
+    vec4 s = textureLod(postProcess_colorBuffer, uv + vec2( 0.0, -texelSize.y), 0.0);
+    vec4 e = textureLod(postProcess_colorBuffer, uv + vec2( texelSize.x, 0.0), 0.0);
+    vec4 w = textureLod(postProcess_colorBuffer, uv + vec2(-texelSize.x, 0.0), 0.0);
+    vec4 boxMin = min(current, min(min(n, s), min(e, w)));
+    vec4 boxMax = max(current, max(max(n, s), max(e, w)));
+
+    HIGHP vec2 historyUv = vertex_uv / postProcessUniforms.uvScale * postProcessUniforms.historyScale;
+    vec4 history = textureLod(postProcess_history, historyUv, 0.0);
+    history = clamp(history, boxMin, boxMax);
+
+    return mix(current, history, postProcessUniforms.historyWeight);
+}
+#endif
+
+#if POST_PROCESS_IBL
+// the source for these passes is postProcess_environment, see ibl_prefilter.fs
+vec4 PostProcess_IblRoughnessPrefilter() {
+    vec3 color = iblRoughnessPrefilter(int(postProcessUniforms.iblFace), vertex_uv);
+#if defined(IBL_USE_RGBM)
+    // the reflections are encoded the way light_indirect.fs decodes them
+    return encodeRGBM(color);
+#else
+    return vec4(color, 1.0);
+#endif
+}
+
+vec4 PostProcess_IblProbePrefilter() {
+    // the viewport is the probe's tile of the atlas, an octahedral map
+    vec3 color = iblRoughnessPrefilter(iblOctahedralDirection(vertex_uv));
+#if defined(IBL_USE_RGBM)
+    return encodeRGBM(color);
+#else
+    return vec4(color, 1.0);
+#endif
+}
+
+vec4 PostProcess_IblIrradianceSH() {
+    // the target is 9x1, one texel per coefficient
+    return vec4(iblIrradianceSH(int(vertex_uv.x * 9.0)), 1.0);
+}
+
+vec4 PostProcess_IblDFG() {
+    return vec4(iblDFG(vertex_uv), 0.0, 1.0);
+}
+#endif
+
+#if POST_PROCESS_STAGE == POST_PROCESS_DEBUG_HEATMAP
+// The debug views (see FEngine::getDebugView()) write a value in [0, 1] in the red channel, it's
+// shown from blue (low) to green and red (high). Black means zero and white is past the range.
+vec4 PostProcess_DebugHeatmap() {
+    float v = texelFetch(postProcess_colorBuffer, ivec2(vertex_uv), 0).r;
+    if (v <= 0.0) {
+        return vec4(0.0, 0.0, 0.0, 1.0);
+    }
+    if (v > 1.0) {
+        return vec4(1.0);
+    }
+    float x = 4.0 * v - 2.0;
+    return vec4(clamp(vec3(x, 2.0 - abs(x), -x), 0.0, 1.0), 1.0);
+}
+#endif
+
+#if POST_PROCESS_STAGE == POST_PROCESS_ACCUMULATED_TRANSPARENCY
+// The color buffer holds the sum of the weighted premultiplied colors of the transparent surfaces
+// and, in alpha, the product of their (1 - alpha). The history holds the sum of their weights.
+// The result is their weighted average, premultiplied by their total coverage.
+vec4 PostProcess_AccumulatedTransparency() {
+    ivec2 uv = ivec2(vertex_uv);
+    vec4 accumulated = texelFetch(postProcess_colorBuffer, uv, 0);
+    float weights = texelFetch(postProcess_history, uv, 0).r;
+    float coverage = 1.0 - accumulated.a;
+    return vec4(accumulated.rgb / max(weights, 1e-5) * coverage, coverage);
+}
+#endif
+
 vec4 postProcess() {
-#if POST_PROCESS_TONE_MAPPING
+#if POST_PROCESS_TONE_MAPPING && POST_PROCESS_ANTI_ALIASING
+    // the taps of FXAA are tone mapped, see fxaa.fs
+    return dither(PostProcess_AntiAliasing());
+#elif POST_PROCESS_TONE_MAPPING
     return PostProcess_ToneMapping();
 #elif POST_PROCESS_ANTI_ALIASING
     return PostProcess_AntiAliasing();
+#elif POST_PROCESS_TEMPORAL_UPSCALING
+    return PostProcess_TemporalUpscaling();
+#elif POST_PROCESS_STAGE == POST_PROCESS_IBL_ROUGHNESS_PREFILTER
+    return PostProcess_IblRoughnessPrefilter();
+#elif POST_PROCESS_STAGE == POST_PROCESS_IBL_PROBE_PREFILTER
+    return PostProcess_IblProbePrefilter();
+#elif POST_PROCESS_STAGE == POST_PROCESS_IBL_IRRADIANCE_SH
+    return PostProcess_IblIrradianceSH();
+#elif POST_PROCESS_STAGE == POST_PROCESS_IBL_DFG
+    return PostProcess_IblDFG();
+#elif POST_PROCESS_STAGE == POST_PROCESS_DEBUG_HEATMAP
+    return PostProcess_DebugHeatmap();
+#elif POST_PROCESS_STAGE == POST_PROCESS_ACCUMULATED_TRANSPARENCY
+    return PostProcess_AccumulatedTransparency();
 #endif
 }
 
@@ -4,10 +4,14 @@ LAYOUT_LOCATION(LOCATION_POSITION) in vec4 position;
 LAYOUT_LOCATION(0) out vec2 vertex_uv;
 
 void main() {
+#if POST_PROCESS_IBL
+    // the IBL passes don't depend on a view, they work in normalized coordinates
+    vertex_uv = position.xy * 0.5 + 0.5;
+#else
     vertex_uv = (position.xy * 0.5 + 0.5) * frameUniforms.resolution.xy;
 
-#if defined(TARGET_VULKAN_ENVIRONMENT)
-    // In Vulkan, drawing the top row of pixels occurs when position.y = -1.0, but we're
+#if defined(TARGET_VULKAN_ENVIRONMENT) || defined(TARGET_METAL_ENVIRONMENT)
+    // In Vulkan (and Metal), drawing the top row of pixels occurs when position.y = -1.0, but we're
     // sampling from a rectangle the sits in the lower-left corner of the texture. Therefore
     // we need to apply an offset to get the correct texture coordinate.
     //
@@ -16,11 +20,16 @@ void main() {
     vertex_uv.y += postProcessUniforms.yOffset;
 #endif
 
-#if POST_PROCESS_ANTI_ALIASING
+#if (POST_PROCESS_ANTI_ALIASING && POST_PROCESS_TONE_MAPPING) || POST_PROCESS_TEMPORAL_UPSCALING
+    // Account for the texture actual size. These passes can also upscale their source, so the
+    // coordinates are not snapped to the source's texel centers.
+    vertex_uv *= postProcessUniforms.uvScale * frameUniforms.resolution.zw;
+#elif POST_PROCESS_ANTI_ALIASING
     // Account for the texture actual size
     vertex_uv *= postProcessUniforms.uvScale;
     // Compute texel center
     vertex_uv = (floor(vertex_uv) + vec2(0.5, 0.5)) * frameUniforms.resolution.zw;
+#endif
 #endif
     gl_Position = position;
 }
@@ -142,6 +142,9 @@ vec4 evaluateLights(const MaterialInputs material) {
 #endif
 
 #if defined(HAS_DYNAMIC_LIGHTING)
+#if defined(HAS_DYNAMIC_LIGHTING_CONSTANT)
+    if (dynamicLightingEnabled)
+#endif
     evaluatePunctualLights(pixel, color);
 #endif
 
@@ -33,6 +33,7 @@ void Cubemap::resetDimensions(size_t dim) {
     mDimensions = dim;
     mScale = 2.0 / dim;
     mUpperBound = std::nextafter(mDimensions, 0);
+    mUpperBoundf = std::nextafter(float(mDimensions), 0.0f);
     for (size_t i=0 ; i<6 ; i++) {
         mFaces[i].reset();
     }
@@ -42,42 +43,43 @@ void Cubemap::setImageForFace(Face face, const Image& image) {
     mFaces[size_t(face)].set(image);
 }
 
-Cubemap::Address Cubemap::getAddressFor(const double3& r) {
-    Cubemap::Address addr;
-    double sc, tc, ma;
-    const double rx = std::abs(r.x);
-    const double ry = std::abs(r.y);
-    const double rz = std::abs(r.z);
+template<typename ADDRESS, typename T>
+static ADDRESS getAddressForDirection(const details::TVec3<T>& r) {
+    ADDRESS addr;
+    T sc, tc, ma;
+    const T rx = std::abs(r.x);
+    const T ry = std::abs(r.y);
+    const T rz = std::abs(r.z);
     if (rx >= ry && rx >= rz) {
         ma = rx;
         if (r.x >= 0) {
-            addr.face = Face::PX;
+            addr.face = Cubemap::Face::PX;
             sc = -r.z;
             tc = -r.y;
         } else {
-            addr.face = Face::NX;
+            addr.face = Cubemap::Face::NX;
             sc =  r.z;
             tc = -r.y;
         }
     } else if (ry >= rx && ry >= rz) {
         ma = ry;
         if (r.y >= 0) {
-            addr.face = Face::PY;
+            addr.face = Cubemap::Face::PY;
             sc =  r.x;
             tc =  r.z;
         } else {
-            addr.face = Face::NY;
+            addr.face = Cubemap::Face::NY;
             sc =  r.x;
             tc = -r.z;
         }
     } else {
         ma = rz;
         if (r.z >= 0) {
-            addr.face = Face::PZ;
+            addr.face = Cubemap::Face::PZ;
             sc =  r.x;
             tc = -r.y;
         } else {
-            addr.face = Face::NZ;
+            addr.face = Cubemap::Face::NZ;
             sc = -r.x;
             tc = -r.y;
         }
@@ -87,6 +89,15 @@ Cubemap::Address Cubemap::getAddressFor(const double3& r) {
     addr.t = (tc / ma + 1) * 0.5f;
     return addr;
 }
+
+Cubemap::Address Cubemap::getAddressFor(const double3& r) {
+    return getAddressForDirection<Address>(r);
+}
+
+Cubemap::AddressF Cubemap::getAddressFor(const float3& r) {
+    return getAddressForDirection<AddressF>(r);
+}
+
 /*
  * We handle "seamless" cubemaps by duplicating a row to the bottom, or column to the right
  * of each faces that don't have an adjacent face in the image (the duplicate is taken from the
@@ -179,3 +190,37 @@ Cubemap::Texel Cubemap::trilinearFilterAt(const Cubemap& l0, const Cubemap& l1,
     }
     return c0;
 }
+
+Cubemap::Texel Cubemap::filterAt(const Image& image, float x, float y) {
+    const size_t x0 = size_t(x);
+    const size_t y0 = size_t(y);
+    // see filterAt() above, reading past the width/height of the Image is valid
+    size_t x1 = x0 + 1;
+    size_t y1 = y0 + 1;
+    const float u = x - x0;
+    const float v = y - y0;
+    const float one_minus_u = 1 - u;
+    const float one_minus_v = 1 - v;
+    const Texel& c0 = sampleAt(image.getPixelRef(x0, y0));
+    const Texel& c1 = sampleAt(image.getPixelRef(x1, y0));
+    const Texel& c2 = sampleAt(image.getPixelRef(x0, y1));
+    const Texel& c3 = sampleAt(image.getPixelRef(x1, y1));
+    return (one_minus_u*one_minus_v)*c0 + (u*one_minus_v)*c1 + (one_minus_u*v)*c2 + (u*v)*c3;
+}
+
+Cubemap::Texel Cubemap::trilinearFilterAt(const Cubemap& l0, const Cubemap& l1, float lerp,
+        const float3& L)
+{
+    Cubemap::AddressF addr(getAddressFor(L));
+    const Image& i0 = l0.getImageForFace(addr.face);
+    float x0 = std::min(addr.s * l0.mDimensions, l0.mUpperBoundf);
+    float y0 = std::min(addr.t * l0.mDimensions, l0.mUpperBoundf);
+    float3 c0(filterAt(i0, x0, y0));
+    if (&l0 != &l1) {
+        const Image& i1 = l1.getImageForFace(addr.face);
+        float x1 = std::min(addr.s * l1.mDimensions, l1.mUpperBoundf);
+        float y1 = std::min(addr.t * l1.mDimensions, l1.mUpperBoundf);
+        c0 += lerp * (filterAt(i1, x1, y1) - c0);
+    }
+    return c0;
+}
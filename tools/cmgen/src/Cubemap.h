@@ -67,6 +67,12 @@ public:
     static Texel trilinearFilterAt(const Cubemap& c0, const Cubemap& c1, double lerp,
             const math::double3& direction);
 
+    // single precision versions of the above, used by the fast IBL prefilter
+    static Texel filterAt(const Image& image, float x, float y);
+
+    static Texel trilinearFilterAt(const Cubemap& c0, const Cubemap& c1, float lerp,
+            const math::float3& direction);
+
     inline static const Texel& sampleAt(void const* data) {
         return *static_cast<Texel const *>(data);
     }
@@ -92,13 +98,21 @@ private:
         double t = 0;
     };
 
+    struct AddressF {
+        Face face;
+        float s = 0;
+        float t = 0;
+    };
+
     // Note: this doesn't apply the Image's flips
     // (this is why this is private)
     static Address getAddressFor(const math::double3& direction);
+    static AddressF getAddressFor(const math::float3& direction);
 
     size_t mDimensions = 0;
     double mScale = 1;
     double mUpperBound = 0;
+    float mUpperBoundf = 0;
     Image mFaces[6];
     Geometry mGeometry = Geometry::HORIZONTAL_CROSS;
 };
@@ -98,7 +98,8 @@ static double __UNUSED VisibilityAshikhmin(double NoV, double NoL, double a) {
 }
 
 void CubemapIBL::roughnessFilter(Cubemap& dst,
-        const std::vector<Cubemap>& levels, double linearRoughness, size_t maxNumSamples)
+        const std::vector<Cubemap>& levels, double linearRoughness, size_t maxNumSamples,
+        bool reference)
 {
     const float numSamples = maxNumSamples;
     const float inumSamples = 1.0f / numSamples;
@@ -111,6 +112,7 @@ void CubemapIBL::roughnessFilter(Cubemap& dst,
     // be careful w/ the size of this structure, the smaller the better
     struct CacheEntry {
         double3 L;
+        float3 Lf;
         float brdf_NoL;
         float lerp;
         uint8_t l0;
@@ -199,7 +201,7 @@ void CubemapIBL::roughnessFilter(Cubemap& dst,
             uint8_t l1 = uint8_t(std::min(maxLevel, size_t(l0 + 1)));
             float lerp = mipLevel - l0;
 
-            cache.push_back({ L, brdf_NoL, lerp, l0, l1 });
+            cache.push_back({ L, float3(L), brdf_NoL, lerp, l0, l1 });
 
             sample++;
         }
@@ -242,26 +244,91 @@ void CubemapIBL::roughnessFilter(Cubemap& dst,
 
         mat3 R;
         const size_t numSamples = cache.size();
-        for (size_t x=0 ; x<dim ; ++x, ++data) {
-            const double2 p(dst.center(x, y));
-            const double3 N(dst.getDirectionFor(f, p.x, p.y));
 
-            // center the cone around the normal (handle case of normal close to up)
-            const double3 up = std::abs(N.z)<0.999 ? double3(0,0,1) : double3(1,0,0);
-            R[0] = normalize(cross(up, N));
-            R[1] = cross(N, R[0]);
-            R[2] = N;
+        if (reference) {
+            for (size_t x=0 ; x<dim ; ++x, ++data) {
+                const double2 p(dst.center(x, y));
+                const double3 N(dst.getDirectionFor(f, p.x, p.y));
 
-            float3 Li = 0;
+                // center the cone around the normal (handle case of normal close to up)
+                const double3 up = std::abs(N.z)<0.999 ? double3(0,0,1) : double3(1,0,0);
+                R[0] = normalize(cross(up, N));
+                R[1] = cross(N, R[0]);
+                R[2] = N;
+
+                float3 Li = 0;
+                for (size_t sample = 0; sample < numSamples; sample++) {
+                    const CacheEntry& e = cache[sample];
+                    const double3 L(R * e.L);
+                    const Cubemap& cmBase = levels[e.l0];
+                    const Cubemap& next = levels[e.l1];
+                    const float3 c0 = Cubemap::trilinearFilterAt(cmBase, next, double(e.lerp), L);
+                    Li += c0 * e.brdf_NoL;
+                }
+                Cubemap::writeAt(data, Cubemap::Texel(Li));
+            }
+            return;
+        }
+
+        // The row is processed in runs of neighboring texels, each sample is applied to the
+        // whole run before moving to the next one, so that the fetches of a run hit the same
+        // area of the same mip levels. The per-texel frames and accumulators are stored as
+        // structures of arrays so that the rotation and accumulation loops get vectorized.
+        constexpr size_t RUN_SIZE = 8;
+        for (size_t x0 = 0; x0 < dim; x0 += RUN_SIZE) {
+            const size_t count = std::min(RUN_SIZE, dim - x0);
+
+            float Rx[3][RUN_SIZE], Ry[3][RUN_SIZE], Rz[3][RUN_SIZE];
+            for (size_t i = 0; i < RUN_SIZE; i++) {
+                // the last run is padded with copies of the last texel of the row
+                const size_t x = x0 + std::min(i, count - 1);
+                const double2 p(dst.center(x, y));
+                const double3 N(dst.getDirectionFor(f, p.x, p.y));
+                const double3 up = std::abs(N.z)<0.999 ? double3(0,0,1) : double3(1,0,0);
+                R[0] = normalize(cross(up, N));
+                R[1] = cross(N, R[0]);
+                R[2] = N;
+                for (size_t c = 0; c < 3; c++) {
+                    Rx[c][i] = float(R[c].x);
+                    Ry[c][i] = float(R[c].y);
+                    Rz[c][i] = float(R[c].z);
+                }
+            }
+
+            float Lir[RUN_SIZE] = {}, Lig[RUN_SIZE] = {}, Lib[RUN_SIZE] = {};
             for (size_t sample = 0; sample < numSamples; sample++) {
                 const CacheEntry& e = cache[sample];
-                const double3 L(R * e.L);
                 const Cubemap& cmBase = levels[e.l0];
                 const Cubemap& next = levels[e.l1];
-                const float3 c0 = Cubemap::trilinearFilterAt(cmBase, next, e.lerp, L);
-                Li += c0 * e.brdf_NoL;
+
+                // no early exit, this gets vectorized
+                float Lx[RUN_SIZE], Ly[RUN_SIZE], Lz[RUN_SIZE];
+                for (size_t i = 0; i < RUN_SIZE; i++) {
+                    Lx[i] = Rx[0][i] * e.Lf.x + Rx[1][i] * e.Lf.y + Rx[2][i] * e.Lf.z;
+                    Ly[i] = Ry[0][i] * e.Lf.x + Ry[1][i] * e.Lf.y + Ry[2][i] * e.Lf.z;
+                    Lz[i] = Rz[0][i] * e.Lf.x + Rz[1][i] * e.Lf.y + Rz[2][i] * e.Lf.z;
+                }
+
+                float Cr[RUN_SIZE], Cg[RUN_SIZE], Cb[RUN_SIZE];
+                for (size_t i = 0; i < RUN_SIZE; i++) {
+                    const float3 c = Cubemap::trilinearFilterAt(cmBase, next, e.lerp,
+                            float3{ Lx[i], Ly[i], Lz[i] });
+                    Cr[i] = c.r;
+                    Cg[i] = c.g;
+                    Cb[i] = c.b;
+                }
+
+                // no early exit, this gets vectorized
+                for (size_t i = 0; i < RUN_SIZE; i++) {
+                    Lir[i] += Cr[i] * e.brdf_NoL;
+                    Lig[i] += Cg[i] * e.brdf_NoL;
+                    Lib[i] += Cb[i] * e.brdf_NoL;
+                }
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                Cubemap::writeAt(data + x0 + i, Cubemap::Texel{ Lir[i], Lig[i], Lib[i] });
             }
-            Cubemap::writeAt(data, Cubemap::Texel(Li));
         }
     });
 
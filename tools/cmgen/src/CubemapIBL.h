@@ -29,9 +29,12 @@ class CubemapIBL {
 public:
     /*
      * Compute roughness LOD using importance sampling GGX
+     * By default the integration is done in single precision, several texels at a time.
+     * The reference mode uses double precision, one texel at a time.
      */
     static void roughnessFilter(Cubemap& dst,
-            const std::vector<Cubemap>& levels, double linearRoughness, size_t maxNumSamples = 1024);
+            const std::vector<Cubemap>& levels, double linearRoughness, size_t maxNumSamples = 1024,
+            bool reference = false);
 
     static void DFG(Image& dst, bool multiscatter = false);
 
@@ -19,6 +19,10 @@
 
 #include <utils/JobSystem.h>
 
+#include <algorithm>
+#include <thread>
+#include <vector>
+
 #include "Cubemap.h"
 #include "Image.h"
 
@@ -92,41 +96,61 @@ void CubemapUtils::process( const Cubemap& cm,
 
     const size_t dim = cm.getDimensions();
 
-    // multithread only on large-ish cubemaps
-    STATE states[6];
+    // A STATE can't be shared by rows processed concurrently. Stateless passes are split freely
+    // with parallel_for(), otherwise each face is cut in bands of rows (about one per core), each
+    // band accumulating into its own copy of the prototype. All states are reduced at the end,
+    // always in the same order, so the result doesn't depend on scheduling.
+    constexpr bool stateless = std::is_same<STATE, CubemapUtils::EmptyState>::value;
+    const size_t bandCount = stateless ? 1 :
+            std::max(size_t(1), std::min(dim, size_t(std::thread::hardware_concurrency())));
+    const size_t bandHeight = (dim + bandCount - 1) / bandCount;
+
+    std::vector<STATE> states(6 * bandCount);
     for (STATE& s : states) {
         s = prototype;
     }
 
+    auto processRows = [&cm, &proc, dim](STATE& s, Cubemap::Face f, size_t y0, size_t c) {
+        const Image& image(cm.getImageForFace(f));
+        for (size_t y = y0; y < y0 + c; y++) {
+            Cubemap::Texel* data = static_cast<Cubemap::Texel*>(image.getPixelRef(0, y));
+            proc(s, y, f, data, dim);
+        }
+    };
+
     JobSystem::Job* parent = js.createJob();
     for (size_t faceIndex = 0; faceIndex < 6; faceIndex++) {
         const Cubemap::Face f = (Cubemap::Face)faceIndex;
-        JobSystem::Job* face = jobs::createJob(js, parent,
-                [ faceIndex, &states, f, &cm, &dim, &proc ]
-                        (utils::JobSystem& js, utils::JobSystem::Job* parent) {
-                    STATE& s = states[faceIndex];
-                    const Image& image(cm.getImageForFace(f));
-
-                    auto parallelJobTask = [ &image, &proc, &s, dim, f ](size_t y0, size_t c) {
-                        for (size_t y = y0; y < y0 + c; y++) {
-                            Cubemap::Texel* data =
-                                    static_cast<Cubemap::Texel*>(image.getPixelRef(0, y));
-                            proc(s, y, f, data, dim);
-                        }
-                    };
-
-                    if (std::is_same<STATE, CubemapUtils::EmptyState>::value) {
+        if (stateless) {
+            JobSystem::Job* face = jobs::createJob(js, parent,
+                    [ faceIndex, &states, f, dim, &processRows ]
+                            (utils::JobSystem& js, utils::JobSystem::Job* parent) {
+                        STATE& s = states[faceIndex];
+                        auto parallelJobTask = [ &processRows, &s, f ](size_t y0, size_t c) {
+                            processRows(s, f, y0, c);
+                        };
                         auto job = jobs::parallel_for(js, parent, 0, uint32_t(dim),
                                 std::ref(parallelJobTask), jobs::CountSplitter<1, 8>());
 
                         // we need to wait here because parallelJobTask is passed by reference
                         js.runAndWait(job);
-                    } else {
-                        // if we have a per-thread STATE, we can't parallel_for()
-                        parallelJobTask(0, dim);
-                    }
-                }, std::ref(js), parent);
-        js.run(face);
+                    }, std::ref(js), parent);
+            js.run(face);
+        } else {
+            for (size_t band = 0; band < bandCount; band++) {
+                const size_t y0 = band * bandHeight;
+                if (y0 >= dim) {
+                    break;
+                }
+                const size_t c = std::min(bandHeight, dim - y0);
+                STATE& s = states[faceIndex * bandCount + band];
+                JobSystem::Job* job = jobs::createJob(js, parent,
+                        [ &processRows, &s, f, y0, c ]() {
+                            processRows(s, f, y0, c);
+                        });
+                js.run(job);
+            }
+        }
     }
     // wait for all our threads to finish
     js.runAndWait(parent);
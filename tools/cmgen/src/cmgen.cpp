@@ -24,6 +24,11 @@
 #include <math/scalar.h>
 #include <math/vec4.h>
 
+#include <image/ColorTransform.h>
+#include <image/ImageSampler.h>
+#include <image/KtxBundle.h>
+
+#include <imageio/BlockCompression.h>
 #include <imageio/ImageDecoder.h>
 #include <imageio/ImageEncoder.h>
 
@@ -47,6 +52,9 @@ enum class ShFile {
 };
 static image::ImageEncoder::Format g_format = image::ImageEncoder::Format::PNG;
 static std::string g_compression;
+static bool g_ktx = false;
+static bool g_ktx_compressed = false;
+static image::CompressedFormat g_ktx_format;
 static bool g_extract_faces = false;
 static double g_extract_blur = 0.0;
 static utils::Path g_extract_dir;
@@ -75,6 +83,7 @@ static bool g_deploy = false;
 static utils::Path g_deploy_dir;
 
 static size_t g_num_samples = 1024;
+static bool g_ibl_reference = false;
 
 static bool g_mirror = false;
 
@@ -93,6 +102,9 @@ static void outputSpectrum(std::ostream& out, const std::unique_ptr<math::double
         size_t numBands);
 static void saveImage(const std::string& path, ImageEncoder::Format format, const Image& image,
         const std::string& compression);
+static void initKtx(KtxBundle& ktx, size_t dim);
+static void addKtxLevel(KtxBundle& ktx, size_t level, const Cubemap& cm);
+static void saveKtx(const std::string& path, const KtxBundle& ktx);
 
 // -----------------------------------------------------------------------------------------------
 
@@ -122,8 +134,9 @@ static void printUsage(char* name) {
             "       Print copyright and license information\n\n"
             "   --quiet, -q\n"
             "       Quiet mode. Suppress all non-error output\n\n"
-            "   --format=[exr|hdr|psd|rgbm|png|dds], -f [exr|hdr|psd|rgbm|png|dds]\n"
-            "       specify output file format\n\n"
+            "   --format=[exr|hdr|psd|rgbm|png|dds|ktx], -f [exr|hdr|psd|rgbm|png|dds|ktx]\n"
+            "       specify output file format, ktx stores all the faces and levels of a cubemap\n"
+            "       in a single file\n\n"
             "   --compression=COMPRESSION, -c COMPRESSION\n"
             "       format specific compression:\n"
             "           PNG: Ignored\n"
@@ -131,7 +144,9 @@ static void printUsage(char* name) {
             "           Radiance: Ignored\n"
             "           Photoshop: 16 (default), 32\n"
             "           OpenEXR: RAW, RLE, ZIPS, ZIP, PIZ (default)\n"
-            "           DDS: 8, 16 (default), 32\n\n"
+            "           DDS: 8, 16 (default), 32\n"
+            "           KTX: uncompressed RGBM (default), etc_rgba8 and s3tc_rgba_dxt5 for\n"
+            "                RGBM, etc_rgb8, etc_srgb8, s3tc_rgb_dxt1 and s3tc_srgb_dxt1 for LDR\n\n"
             "   --size=power-of-two, -s power-of-two\n"
             "       size of the output cubemaps (base level), 256 by default\n\n"
             "   --deploy=dir, -x dir\n"
@@ -154,6 +169,8 @@ static void printUsage(char* name) {
             "       Generates mipmap for pre-filtered importance sampling\n\n"
             "   --ibl-ld=dir\n"
             "       Roughness prefilter into <dir>\n\n"
+            "   --ibl-reference\n"
+            "       Use the slower, double precision, reference roughness prefilter\n\n"
             "   --sh=bands\n"
             "       SH decomposition of input cubemap\n\n"
             "   --sh-output=filename.[exr|hdr|psd|rgbm|png|dds|txt]\n"
@@ -198,6 +215,7 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
             { "ibl-dfg",              required_argument, nullptr, 'a' },
             { "ibl-dfg-multiscatter",       no_argument, nullptr, 'u' },
             { "ibl-samples",          required_argument, nullptr, 'k' },
+            { "ibl-reference",              no_argument, nullptr, 'g' },
             { "deploy",               required_argument, nullptr, 'x' },
             { "mirror",                     no_argument, nullptr, 'm' },
             { "debug",                      no_argument, nullptr, 'd' },
@@ -247,6 +265,10 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
                     g_format = ImageEncoder::Format::DDS_LINEAR;
                     format_specified = true;
                 }
+                if (arg == "ktx") {
+                    g_ktx = true;
+                    format_specified = true;
+                }
                 break;
             case 'c':
                 g_compression = arg;
@@ -315,6 +337,9 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
             case 'k':
                 g_num_samples = (size_t)std::stoi(arg);
                 break;
+            case 'g':
+                g_ibl_reference = true;
+                break;
             case 'x':
                 g_deploy = true;
                 g_deploy_dir = arg;
@@ -332,6 +357,16 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
         g_format = ImageEncoder::Format::RGBM;
     }
 
+    if (g_ktx && !g_compression.empty()) {
+        g_ktx_compressed = parseCompressedFormat(g_compression, &g_ktx_format);
+        // RGBM already is a non-linear encoding, sRGB formats with alpha make no sense for it
+        if (!g_ktx_compressed || g_ktx_format == CompressedFormat::ETC2_EAC_SRGBA8 ||
+                g_ktx_format == CompressedFormat::DXT5_SRGBA) {
+            std::cerr << "unsupported KTX compression: " << g_compression << std::endl;
+            exit(1);
+        }
+    }
+
     if (num_sh_bands && g_sh_compute) {
         g_sh_compute = (size_t) num_sh_bands;
     }
@@ -396,23 +431,58 @@ int main(int argc, char* argv[]) {
             std::cout << "Decoding image..." << std::endl;
         }
         std::ifstream input_stream(iname.getPath(), std::ios::binary);
-        LinearImage linputImage = ImageDecoder::decode(input_stream, iname.getPath());
-        if (!linputImage.isValid()) {
+        std::unique_ptr<ImageDecoder::StripDecoder> decoder =
+                ImageDecoder::decodeStrips(input_stream, iname.getPath());
+        if (!decoder) {
             std::cerr << "Unable to open image: " << iname.getPath() << std::endl;
             exit(1);
         }
-        if (linputImage.getChannels() != 3) {
+        if (decoder->getChannels() != 3) {
             std::cerr << "Input image must be RGB (3 channels)! This image has "
-                      << linputImage.getChannels() << " channels." << std::endl;
+                      << decoder->getChannels() << " channels." << std::endl;
             exit(1);
         }
 
+        // Equirectangular images much larger than the cubemap are reduced while they are decoded,
+        // to twice the resolution of the cubemap. This bounds the memory used by cmgen regardless
+        // of the size of the input. The box filter averages the radiance without ringing.
+        size_t width = decoder->getWidth(), height = decoder->getHeight();
+        const size_t equirectDim = g_output_size ? g_output_size : 256;
+        std::unique_ptr<StripResampler> resampler;
+        if (width == 2 * height && width > 8 * equirectDim) {
+            resampler.reset(new StripResampler(uint32_t(width), uint32_t(height), 3,
+                    uint32_t(8 * equirectDim), uint32_t(4 * equirectDim), ImageSampler {
+                        .horizontalFilter = Filter::BOX,
+                        .verticalFilter = Filter::BOX,
+                        .jobSystem = &CubemapUtils::getJobSystem()
+                    }));
+            width = 8 * equirectDim;
+            height = 4 * equirectDim;
+        }
+
         // Convert from LinearImage to the deprecated Image object which is used throughout cmgen.
-        std::unique_ptr<uint8_t[]> buf(new uint8_t[
-                linputImage.getWidth() * linputImage.getHeight() * sizeof(float3)]);
-        const size_t width = linputImage.getWidth(), height = linputImage.getHeight();
         const size_t bpp = sizeof(float) * 3, bpr = bpp * width;
-        memcpy(buf.get(), linputImage.getPixelRef(), height * bpr);
+        std::unique_ptr<uint8_t[]> buf(new uint8_t[height * bpr]);
+        size_t row = 0;
+        for (LinearImage strip; (strip = decoder->decodeStrip(64)).isValid(); ) {
+            if (resampler) {
+                // clamp before filtering, like CubemapUtils::clamp() below
+                float* data = strip.getPixelRef();
+                for (size_t i = 0, n = strip.getWidth() * strip.getHeight() * 3; i < n; i++) {
+                    data[i] = std::min(data[i], 256.0f);
+                }
+                strip = resampler->resample(strip);
+                if (!strip.isValid()) {
+                    continue;
+                }
+            }
+            memcpy(buf.get() + row * bpr, strip.getPixelRef(), strip.getHeight() * bpr);
+            row += strip.getHeight();
+        }
+        if (row != height) {
+            std::cerr << "Unable to decode image: " << iname.getPath() << std::endl;
+            exit(1);
+        }
         Image inputImage(std::move(buf), width, height, bpr, bpp);
 
         CubemapUtils::clamp(inputImage);
@@ -534,7 +604,8 @@ int main(int argc, char* argv[]) {
             const size_t dim = g_output_size ? g_output_size : cm.getDimensions();
             Image image;
             Cubemap blurred = CubemapUtils::create(image, dim);
-            CubemapIBL::roughnessFilter(blurred, levels, linear_roughness, g_num_samples);
+            CubemapIBL::roughnessFilter(blurred, levels, linear_roughness, g_num_samples,
+                    g_ibl_reference);
             if (!g_quiet) {
                 std::cout << "Extract faces..." << std::endl;
             }
@@ -671,6 +742,8 @@ void iblMipmapPrefilter(const utils::Path& iname,
     }
 
     const size_t numLevels = levels.size();
+    KtxBundle ktx(uint32_t(numLevels), 1, true);
+    initKtx(ktx, levels[0].getDimensions());
     for (size_t level=0 ; level<numLevels ; level++) {
         Cubemap const& dst(levels[level]);
         Image const& img(images[level]);
@@ -682,6 +755,11 @@ void iblMipmapPrefilter(const utils::Path& iname,
             saveImage(filePath, debug_format, img, g_compression);
         }
 
+        if (g_ktx) {
+            addKtxLevel(ktx, level, dst);
+            continue;
+        }
+
         std::string ext = ImageEncoder::chooseExtension(g_format);
         for (size_t i = 0; i < 6; i++) {
             Cubemap::Face face = (Cubemap::Face)i;
@@ -690,6 +768,9 @@ void iblMipmapPrefilter(const utils::Path& iname,
             saveImage(filename, g_format, dst.getImageForFace(face), g_compression);
         }
     }
+    if (g_ktx) {
+        saveKtx(outputDir + "is.ktx", ktx);
+    }
 }
 
 void iblRoughnessPrefilter(const utils::Path& iname,
@@ -707,6 +788,8 @@ void iblRoughnessPrefilter(const utils::Path& iname,
     const size_t baseExp = __builtin_ctz(g_output_size ? g_output_size : 256);
     size_t numSamples = g_num_samples;
     const size_t numLevels = baseExp + 1;
+    KtxBundle ktx(uint32_t(DEBUG_FULL_RESOLUTION ? 1 : numLevels), 1, true);
+    initKtx(ktx, 1U << baseExp);
     for (ssize_t i=baseExp ; i>=0 ; --i) {
         const size_t dim = 1U << (DEBUG_FULL_RESOLUTION ? baseExp : i);
         const size_t level = baseExp - i;
@@ -727,7 +810,7 @@ void iblRoughnessPrefilter(const utils::Path& iname,
         }
         Image image;
         Cubemap dst = CubemapUtils::create(image, dim);
-        CubemapIBL::roughnessFilter(dst, levels, linear_roughness, numSamples);
+        CubemapIBL::roughnessFilter(dst, levels, linear_roughness, numSamples, g_ibl_reference);
 
         if (g_debug) {
             ImageEncoder::Format debug_format = ImageEncoder::Format::PNG;
@@ -737,6 +820,13 @@ void iblRoughnessPrefilter(const utils::Path& iname,
             saveImage(filePath, debug_format, image, g_compression);
         }
 
+        if (g_ktx) {
+            if (!DEBUG_FULL_RESOLUTION) {
+                addKtxLevel(ktx, level, dst);
+            }
+            continue;
+        }
+
         std::string ext = ImageEncoder::chooseExtension(g_format);
         for (size_t j = 0; j < 6; j++) {
             Cubemap::Face face = (Cubemap::Face) j;
@@ -745,6 +835,9 @@ void iblRoughnessPrefilter(const utils::Path& iname,
             saveImage(filename, g_format, dst.getImageForFace(face), g_compression);
         }
     }
+    if (g_ktx && !DEBUG_FULL_RESOLUTION) {
+        saveKtx(outputDir + "ibl.ktx", ktx);
+    }
 }
 
 static bool isTextFile(const utils::Path& filename) {
@@ -806,6 +899,13 @@ void extractCubemapFaces(const utils::Path& iname, const Cubemap& cm, const util
     if (!outputDir.exists()) {
         outputDir.mkdirRecursive();
     }
+    if (g_ktx) {
+        KtxBundle ktx(1, 1, true);
+        initKtx(ktx, cm.getDimensions());
+        addKtxLevel(ktx, 0, cm);
+        saveKtx(outputDir + "skybox.ktx", ktx);
+        return;
+    }
     std::string ext = ImageEncoder::chooseExtension(g_format);
     for (size_t i=0 ; i<6 ; i++) {
         Cubemap::Face face = (Cubemap::Face)i;
@@ -814,9 +914,7 @@ void extractCubemapFaces(const utils::Path& iname, const Cubemap& cm, const util
     }
 }
 
-static void saveImage(const std::string& path, ImageEncoder::Format format, const Image& image,
-        const std::string& compression) {
-    std::ofstream outputStream(path, std::ios::binary | std::ios::trunc);
+static LinearImage toLinearImage(const Image& image) {
     LinearImage linearImage(image.getWidth(), image.getHeight(), 3);
 
     // Copy row by row since the image has padding.
@@ -827,6 +925,75 @@ static void saveImage(const std::string& path, ImageEncoder::Format format, cons
         float const* src = static_cast<float const*>(image.getPixelRef(0, row));
         memcpy(dst, src, w * 12);
     }
+    return linearImage;
+}
+
+static void saveImage(const std::string& path, ImageEncoder::Format format, const Image& image,
+        const std::string& compression) {
+    std::ofstream outputStream(path, std::ios::binary | std::ios::trunc);
+    ImageEncoder::encode(outputStream, format, toLinearImage(image), compression, path);
+}
+
+static void initKtx(KtxBundle& ktx, size_t dim) {
+    KtxInfo& info = ktx.info();
+    info.pixelWidth = uint32_t(dim);
+    info.pixelHeight = uint32_t(dim);
+    info.pixelDepth = 0;
+    info.glTypeSize = 1;
+    if (g_ktx_compressed) {
+        info.glType = 0;
+        info.glFormat = 0;
+        info.glBaseInternalFormat = hasAlpha(g_ktx_format) ? KtxBundle::RGBA : KtxBundle::RGB;
+    } else {
+        info.glType = KtxBundle::UNSIGNED_BYTE;
+        info.glFormat = KtxBundle::RGBA;
+        info.glInternalFormat = KtxBundle::RGBA8;
+        info.glBaseInternalFormat = KtxBundle::RGBA;
+    }
+}
+
+// Stores the faces of a cubemap as one level of the bundle. The uncompressed and the RGBA
+// compressed formats hold RGBM data, the RGB compressed formats hold clamped colors.
+static void addKtxLevel(KtxBundle& ktx, size_t level, const Cubemap& cm) {
+    // KTX faces are ordered +X, -X, +Y, -Y, +Z, -Z
+    static const Cubemap::Face KTX_FACES[6] = {
+            Cubemap::Face::PX, Cubemap::Face::NX, Cubemap::Face::PY,
+            Cubemap::Face::NY, Cubemap::Face::PZ, Cubemap::Face::NZ };
+
+    const bool rgbm = !g_ktx_compressed || hasAlpha(g_ktx_format);
+    for (uint32_t face = 0; face < 6; face++) {
+        LinearImage image = toLinearImage(cm.getImageForFace(KTX_FACES[face]));
+        const uint32_t count = image.getWidth() * image.getHeight();
+        if (rgbm) {
+            LinearImage encoded(image.getWidth(), image.getHeight(), 4);
+            float3 const* src = image.get<float3>();
+            float4* dst = encoded.get<float4>();
+            for (uint32_t i = 0; i < count; i++) {
+                dst[i] = linearToRGBM(src[i]);
+            }
+            image = encoded;
+        }
+
+        const KtxBlobIndex index = { uint32_t(level), 0, face };
+        if (g_ktx_compressed) {
+            CompressedTexture texture = compressTexture(image, g_ktx_format,
+                    &CubemapUtils::getJobSystem());
+            ktx.info().glInternalFormat = texture.glInternalFormat;
+            ktx.setBlob(index, texture.data.get(), texture.size);
+        } else {
+            std::unique_ptr<uint8_t[]> data(new uint8_t[count * 4]);
+            float const* src = image.getPixelRef();
+            for (uint32_t i = 0; i < count * 4; i++) {
+                data[i] = uint8_t(saturate(src[i]) * 255.0f + 0.5f);
+            }
+            ktx.setBlob(index, data.get(), count * 4);
+        }
+    }
+}
 
-    ImageEncoder::encode(outputStream, format, linearImage, compression, path);
+static void saveKtx(const std::string& path, const KtxBundle& ktx) {
+    std::vector<uint8_t> contents(ktx.getSerializedLength());
+    ktx.serialize(contents.data(), uint32_t(contents.size()));
+    std::ofstream outputStream(path, std::ios::binary | std::ios::trunc);
+    outputStream.write(reinterpret_cast<const char*>(contents.data()), contents.size());
 }
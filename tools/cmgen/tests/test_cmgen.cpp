@@ -30,6 +30,7 @@
 
 #include <math/vec3.h>
 
+#include <chrono>
 #include <cstdlib>
 #include <fstream>
 #include <regex>
@@ -85,6 +86,19 @@ static void launchTool(string inputPath,
     ASSERT_EQ(std::system(cmdline.c_str()), 0);
 }
 
+// Reads an RGBM image generated by cmgen and converts it to linear
+static void readRgbmImage(const string& path, LinearImage& image) {
+    std::cout << "Reading result image from " << path << std::endl;
+    checkFileExistence(path);
+    std::ifstream stream(path.c_str(), std::ios::binary);
+    LinearImage rgbmImage = ImageDecoder::decode(stream, path);
+    ASSERT_EQ(rgbmImage.isValid(), true);
+    ASSERT_EQ(rgbmImage.getChannels(), 4);
+    image = toLinearFromRGBM(
+            reinterpret_cast<math::float4 const*>(rgbmImage.getPixelRef()),
+            rgbmImage.getWidth(), rgbmImage.getHeight());
+}
+
 // This spawns cmgen, telling it to process the environment map located at "inputPath". It creates
 // an output folder in the same location as the test executable, which lets us avoid polluting our
 // local source tree with output files. The given "resultPath" points the specific newly-generated
@@ -97,20 +111,21 @@ static void processEnvMap(string inputPath, string resultPath, string goldenPath
 
     launchTool(std::move(inputPath), "-x " + executableFolder);
 
-    std::cout << "Reading result image from " << resultPath << std::endl;
-    checkFileExistence(resultPath);
-    std::ifstream resultStream(resultPath.c_str(), std::ios::binary);
-    LinearImage resultImage = ImageDecoder::decode(resultStream, resultPath);
-    ASSERT_EQ(resultImage.isValid(), true);
-    ASSERT_EQ(resultImage.getChannels(), 4);
-    LinearImage resultLImage = toLinearFromRGBM(
-            reinterpret_cast<math::float4 const*>(resultImage.getPixelRef()),
-            resultImage.getWidth(), resultImage.getHeight());
+    LinearImage resultLImage;
+    readRgbmImage(resultPath, resultLImage);
 
     std::cout << "Golden image is at " << goldenPath << std::endl;
     updateOrCompare(resultLImage, goldenPath, g_comparisonMode, 0.01f);
 }
 
+// Spawns cmgen like launchTool() and returns how long it took to run, in seconds.
+static double timeTool(string inputPath, const string& parameters) {
+    auto start = std::chrono::steady_clock::now();
+    launchTool(std::move(inputPath), parameters);
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    return duration.count();
+}
+
 static void compareSh(const string& content, const string& regex,
         const float3& match, float epsilon = 1e-7f) {
     std::smatch smatch;
@@ -153,6 +168,27 @@ TEST_F(CmgenTest, LdrCrossCube) { // NOLINT
     processEnvMap(inputPath, resultPath, goldenPath);
 }
 
+TEST_F(CmgenTest, FastRoughnessFilter) { // NOLINT
+    // The reference (double precision) prefilter is the golden for the fast one
+    const string inputPath = "tools/cmgen/tests/Footballfield/Footballfield.png";
+    const string executableFolder = Path::getCurrentExecutable().getParent();
+    const string referenceFolder = executableFolder + "reference/";
+    const string fastFolder = executableFolder + "fast/";
+
+    const double referenceTime = timeTool(inputPath, "--ibl-reference -x " + referenceFolder);
+    const double fastTime = timeTool(inputPath, "-x " + fastFolder);
+    std::cout << "Reference prefilter: " << referenceTime << "s" << std::endl;
+    std::cout << "Fast prefilter:      " << fastTime << "s" << std::endl;
+
+    for (const char* level : { "m1_px.rgbm", "m3_nx.rgbm", "m5_pz.rgbm" }) {
+        LinearImage fastImage;
+        LinearImage referenceImage;
+        readRgbmImage(fastFolder + "Footballfield/" + level, fastImage);
+        readRgbmImage(referenceFolder + "Footballfield/" + level, referenceImage);
+        EXPECT_EQ(compare(fastImage, referenceImage, 0.01f), 0);
+    }
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     if (argc != 2) {
@@ -15,8 +15,12 @@
  */
 
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <vector>
+
+#include <string.h>
 
 #include <math/half.h>
 #include <math/mat3.h>
@@ -38,7 +42,10 @@ using namespace utils;
 #include <assimp/cimport.h>
 #include <assimp/scene.h>
 
-static const uint32_t VERSION = 1;
+static const uint32_t VERSION = 2;
+
+// Header::flags
+static const uint32_t FLAG_QUANTIZED_POSITIONS = 0x1;
 
 using Assimp::Importer;
 
@@ -62,6 +69,7 @@ struct Header {
     uint32_t indexType;
     uint32_t indexCount;
     uint32_t indexSize;
+    uint32_t flags;         // since version 2
 };
 
 struct Vertex {
@@ -72,12 +80,15 @@ struct Vertex {
             uv0(uv0.xy) {
     }
 
+    // with --quantize, holds the snorm16 position in the mesh's bounding box instead
     half4  position;
     short4 tangents;
     ubyte4 color;
     half2  uv0;
 };
 
+static_assert(sizeof(half4) == sizeof(short4), "quantized positions must match half4's size");
+
 struct Mesh {
     Mesh(uint32_t offset, uint32_t count, uint32_t minIndex, uint32_t maxIndex,
             uint32_t material, const Box& aabb):
@@ -99,9 +110,13 @@ struct Mesh {
 
 // configuration
 bool g_interleaved = false;
+bool g_quantized = false;
+bool g_optimizeOverdraw = false;
 
 uint32_t g_vertexCount = 0;
 std::vector<uint32_t> g_indices;
+// source positions, they're quantized once the bounding box of the whole mesh is known
+std::vector<float3> g_sourcePositions;
 // interleaved
 std::vector<Vertex> g_vertices;
 // de-interleaved
@@ -121,21 +136,117 @@ void write(std::ofstream& out, const T* data, uint32_t count) {
     out.write((const char*) data, sizeof(T) * count);
 }
 
-template<typename VECTOR, typename INDEX>
-static Box computeAABB(VECTOR const* positions, INDEX const* indices,
-        size_t count, size_t stride) noexcept {
+template<typename INDEX>
+static Box computeAABB(float3 const* positions, INDEX const* indices, size_t count) noexcept {
     math::float3 bmin(std::numeric_limits<float>::max());
     math::float3 bmax(std::numeric_limits<float>::lowest());
     for (size_t i = 0; i < count; ++i) {
-        VECTOR const* p = reinterpret_cast<VECTOR const *>(
-                (char const*) positions + indices[i] * stride);
-        const math::float3 v(p->x, p->y, p->z);
+        const math::float3 v(positions[indices[i]]);
         bmin = min(bmin, v);
         bmax = max(bmax, v);
     }
     return Box().set(bmin, bmax);
 }
 
+/*
+ * Reorders the triangles of a part to reduce overdraw, without losing much of the vertex cache
+ * locality obtained with assimp's aiProcess_ImproveCacheLocality (Tipsify). The triangles are
+ * split in clusters where the simulated cache restarts from scratch (all the vertices of a
+ * triangle miss), and the clusters facing outwards are drawn first since they're more likely to
+ * occlude the others, as in "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+ * (Sander, Nehab and Barczak, 2007).
+ */
+static void optimizeOverdraw(uint32_t* indices, size_t indexCount,
+        float3 const* positions) noexcept {
+    // assimp's default post-transform cache size
+    constexpr size_t CACHE_SIZE = 12;
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2) {
+        return;
+    }
+
+    // FIFO cache simulation, the entries are the time at which a vertex was last loaded
+    std::vector<size_t> loadTime;
+    size_t time = CACHE_SIZE + 1;
+    auto cached = [&](uint32_t v) -> bool {
+        if (v >= loadTime.size()) {
+            loadTime.resize(v + 1, 0);
+        }
+        if (time - loadTime[v] <= CACHE_SIZE) {
+            return true;
+        }
+        loadTime[v] = time++;
+        return false;
+    };
+
+    std::vector<size_t> clusters; // index of the first triangle of each cluster
+    for (size_t t = 0; t < triangleCount; t++) {
+        const uint32_t* tri = indices + t * 3;
+        const bool hit = cached(tri[0]) | cached(tri[1]) | cached(tri[2]);
+        if (!hit || t == 0) {
+            clusters.push_back(t);
+        }
+    }
+    if (clusters.size() < 2) {
+        return;
+    }
+    clusters.push_back(triangleCount);
+
+    float3 meshCentroid = {};
+    for (size_t i = 0; i < indexCount; i++) {
+        meshCentroid += positions[indices[i]];
+    }
+    meshCentroid /= float(indexCount);
+
+    // sort key of each cluster: how much it faces outwards
+    struct Cluster {
+        size_t first;
+        size_t count;
+        float sortKey;
+    };
+    std::vector<Cluster> sorted;
+    sorted.reserve(clusters.size() - 1);
+    for (size_t c = 0; c < clusters.size() - 1; c++) {
+        float3 centroid = {};
+        float3 normal = {}; // area weighted
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+            const float3 p0 = positions[indices[t * 3 + 0]];
+            const float3 p1 = positions[indices[t * 3 + 1]];
+            const float3 p2 = positions[indices[t * 3 + 2]];
+            centroid += p0 + p1 + p2;
+            normal += cross(p1 - p0, p2 - p0);
+        }
+        const size_t count = clusters[c + 1] - clusters[c];
+        centroid /= float(count * 3);
+        sorted.push_back({ clusters[c], count, dot(centroid - meshCentroid, normal) });
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](Cluster const& lhs, Cluster const& rhs) {
+        return lhs.sortKey > rhs.sortKey;
+    });
+
+    std::vector<uint32_t> reordered;
+    reordered.reserve(triangleCount * 3);
+    for (Cluster const& cluster : sorted) {
+        reordered.insert(reordered.end(),
+                indices + cluster.first * 3, indices + (cluster.first + cluster.count) * 3);
+    }
+    std::copy(reordered.begin(), reordered.end(), indices);
+}
+
+// replaces the half float positions by snorm16 positions relative to the given box
+static void quantizePositions(const Box& aabb) noexcept {
+    // flat meshes have a 0 extent along one axis
+    const float3 extent = aabb.halfExtent;
+    const float3 scale = 1.0f / float3{ extent.x > 0 ? extent.x : 1.0f,
+            extent.y > 0 ? extent.y : 1.0f, extent.z > 0 ? extent.z : 1.0f };
+    for (size_t i = 0; i < g_sourcePositions.size(); i++) {
+        const float3 p = (g_sourcePositions[i] - aabb.center) * scale;
+        const short4 q = packSnorm16(float4{ p, 1.0f });
+        half4& position = g_interleaved ? g_vertices[i].position : g_positions[i];
+        memcpy(&position, &q, sizeof(q));
+    }
+}
+
 template<bool INTERLEAVED>
 void processNode(const aiScene* scene, const aiNode* node, std::vector<Mesh>& meshes) {
     for (size_t i = 0; i < node->mNumMeshes; ++i) {
@@ -177,6 +288,8 @@ void processNode(const aiScene* scene, const aiNode* node, std::vector<Mesh>& me
                     g_tangents.reserve(g_vertexCount);
                     g_uv0.reserve(g_vertexCount);
                 }
+                g_sourcePositions.insert(g_sourcePositions.end(),
+                        vertices, vertices + numVertices);
 
                 for (size_t j = 0; j < numVertices; j++) {
                     quatf q = mat3f::packTangentFrame({tangents[j], bitangents[j], normals[j]});
@@ -209,11 +322,13 @@ void processNode(const aiScene* scene, const aiNode* node, std::vector<Mesh>& me
                     }
                 }
 
-                size_t stride = INTERLEAVED ? sizeof(Vertex) : sizeof(Vertex::position);
-                const decltype(Vertex::position)* positions =
-                        INTERLEAVED ? &g_vertices.data()->position : g_positions.data();
-                const Box aabb(computeAABB(positions,
-                        g_indices.data() + indexBufferOffset, indicesCount, stride));
+                if (g_optimizeOverdraw) {
+                    optimizeOverdraw(g_indices.data() + indexBufferOffset, indicesCount,
+                            g_sourcePositions.data());
+                }
+
+                const Box aabb(computeAABB(g_sourcePositions.data(),
+                        g_indices.data() + indexBufferOffset, indicesCount));
 
                 meshes.emplace_back(indexBufferOffset, indicesCount, indicesOffset,
                         indicesOffset + indicesCount - 1, mesh->mMaterialIndex, aabb);
@@ -245,6 +360,12 @@ static void printUsage(const char* name) {
                     "       Print copyright and license information\n\n"
                     "   --interleaved, -i\n"
                     "       interleaves mesh attributes\n\n"
+                    "   --optimize-overdraw, -o\n"
+                    "       reorders the triangles of each part to reduce overdraw, while\n"
+                    "       preserving most of their vertex cache locality\n\n"
+                    "   --quantize, -q\n"
+                    "       stores the positions as 16 bit integers relative to the bounding box,\n"
+                    "       more precise than the default half floats for the same size\n\n"
     );
 
     const std::string from("FILAMESH");
@@ -261,11 +382,13 @@ static void license() {
 }
 
 static int handleArguments(int argc, char* argv[]) {
-    static constexpr const char* OPTSTR = "hil";
+    static constexpr const char* OPTSTR = "hiloq";
     static const struct option OPTIONS[] = {
             { "help",        no_argument, 0, 'h' },
             { "license",     no_argument, 0, 'l' },
             { "interleaved", no_argument, 0, 'i' },
+            { "optimize-overdraw", no_argument, 0, 'o' },
+            { "quantize",    no_argument, 0, 'q' },
             { 0, 0, 0, 0 }  // termination of the option list
     };
 
@@ -287,6 +410,12 @@ static int handleArguments(int argc, char* argv[]) {
             case 'i':
                 g_interleaved = true;
                 break;
+            case 'o':
+                g_optimizeOverdraw = true;
+                break;
+            case 'q':
+                g_quantized = true;
+                break;
         }
     }
 
@@ -360,6 +489,10 @@ int main(int argc, char* argv[]) {
         aabb.unionSelf(meshes.at(i).aabb);
     }
 
+    if (g_quantized) {
+        quantizePositions(aabb);
+    }
+
     write(out, "FILAMESH", 8 * sizeof(char));
 
     Header header;
@@ -397,9 +530,13 @@ int main(int argc, char* argv[]) {
     }
     header.vertexCount = g_vertexCount;
     header.vertexSize = g_vertexCount * sizeof(Vertex);
+    if (hasUV1 && !g_interleaved) {
+        header.vertexSize += g_vertexCount * sizeof(Vertex::uv0);
+    }
     header.indexType = uint32_t(hasIndex16 ? 1 : 0);
     header.indexCount = g_indices.size();
     header.indexSize = g_indices.size() * (hasIndex16 ? sizeof(uint16_t) : sizeof(uint32_t));
+    header.flags = g_quantized ? FLAG_QUANTIZED_POSITIONS : 0;
 
     write(out, header);
 
@@ -22,9 +22,13 @@
 
 #include <utils/Path.h>
 
+#include <algorithm>
 #include <istream>
 #include <sstream>
 #include <string>
+#include <thread>
+
+#include <stdlib.h>
 
 using namespace utils;
 
@@ -56,12 +60,25 @@ static void usage(char* name) {
             "   --preprocessor-only, -E\n"
             "       Optimize by running only the preprocessor\n\n"
             "   --api, -a\n"
-            "       Specify the target API: opengl (default), vulkan or all\n\n"
+            "       Specify the target API: opengl (default), vulkan, metal or all\n"
+            "       (all is opengl and vulkan)\n\n"
             "   --reflect, -r\n"
             "       Reflect the specified metadata as JSON: parameters\n\n"
+            "   --jobs=<count>, -j <count>\n"
+            "       Number of threads generating the shaders, 0 for one per core (default: 1)\n\n"
+            "   --cache=<directory>, -c <directory>\n"
+            "       Reuse the shaders post-processed by previous runs, stored in this directory\n\n"
+            "   --compress, -z\n"
+            "       Compress the shader dictionaries, for runtimes that support it\n\n"
+            "   --specialize, -s\n"
+            "       Select the dynamic lighting of Vulkan shaders with a specialization constant\n"
+            "       instead of generating separate variants, for runtimes that support it\n\n"
+            "   --bindless, -b\n"
+            "       Read the textures of desktop OpenGL shaders through ARB_bindless_texture\n"
+            "       handles, these shaders are not optimized\n\n"
             "   --variant-filter=<filter>, -v <filter>\n"
             "       Filter out specified comma-separated variants:\n"
-            "           directionalLighting, dynamicLighting, shadowReceiver, skinning\n"
+            "           directionalLighting, dynamicLighting, shadowReceiver, skinning, morphing\n"
             "       This variant filter is merged the filter from the material, if any\n\n"
             "Internal use only:\n"
             "   --output-format, -f\n"
@@ -91,7 +108,7 @@ CommandlineConfig::CommandlineConfig(int argc, char** argv) : Config(), mArgc(ar
 }
 
 bool CommandlineConfig::parse() {
-    static constexpr const char* OPTSTR = "hxo:f:dm:a:p:OSEr:v:";
+    static constexpr const char* OPTSTR = "hxo:f:dm:a:p:OSEr:v:zsbj:c:";
     static const struct option OPTIONS[] = {
             { "help",                    no_argument, nullptr, 'h' },
             { "license",                 no_argument, nullptr, 'l' },
@@ -108,6 +125,11 @@ bool CommandlineConfig::parse() {
             { "api",               required_argument, nullptr, 'a' },
             { "reflect",           required_argument, nullptr, 'r' },
             { "print",                   no_argument, nullptr, 't' },
+            { "compress",                no_argument, nullptr, 'z' },
+            { "specialize",              no_argument, nullptr, 's' },
+            { "bindless",                no_argument, nullptr, 'b' },
+            { "jobs",              required_argument, nullptr, 'j' },
+            { "cache",             required_argument, nullptr, 'c' },
             { 0, 0, 0, 0 }  // termination of the option list
     };
 
@@ -175,10 +197,12 @@ bool CommandlineConfig::parse() {
                     mTargetApi = TargetApi::OPENGL;
                 } else if (arg == "vulkan") {
                     mTargetApi = TargetApi::VULKAN;
+                } else if (arg == "metal") {
+                    mTargetApi = TargetApi::METAL;
                 } else if (arg == "all") {
                     mTargetApi = TargetApi::ALL;
                 } else {
-                    std::cerr << "Unrecognized target API. Must be 'opengl'|'vulkan'|'all'."
+                    std::cerr << "Unrecognized target API. Must be 'opengl'|'vulkan'|'metal'|'all'."
                             << std::endl;
                     return false;
                 }
@@ -196,6 +220,8 @@ bool CommandlineConfig::parse() {
                         variantFilter |= filament::Variant::SHADOW_RECEIVER;
                     } else if (item == "skinning") {
                         variantFilter |= filament::Variant::SKINNING;
+                    } else if (item == "morphing") {
+                        variantFilter |= filament::Variant::MORPHING;
                     }
                 }
                 mVariantFilter = variantFilter;
@@ -217,6 +243,24 @@ bool CommandlineConfig::parse() {
             case 't':
                 mPrintShaders = true;
                 break;
+            case 'z':
+                mCompressDictionaries = true;
+                break;
+            case 's':
+                mSpecializeDynamicLighting = true;
+                break;
+            case 'b':
+                mBindlessSamplers = true;
+                break;
+            case 'c':
+                mCacheDirectory = arg;
+                break;
+            case 'j': {
+                const long count = strtol(arg.c_str(), nullptr, 10);
+                mThreadCount = count > 0 ? size_t(count) :
+                        std::max(1u, std::thread::hardware_concurrency());
+                break;
+            }
         }
     }
 
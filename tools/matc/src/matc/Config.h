@@ -24,6 +24,7 @@
 
 #include <memory>
 #include <ostream>
+#include <string>
 
 #include <utils/compiler.h>
 
@@ -123,8 +124,10 @@ public:
      */
     TargetApi getCodeGenTargetApi() const noexcept {
         // When optimizing OpenGL we use SPIRV as an intermediate representation so we must force
-        // the target API to be Vulkan for the generated shaders to compile
-        return mOptimizationLevel > Optimization::PREPROCESSOR && mTargetApi != TargetApi::VULKAN ?
+        // the target API to be Vulkan for the generated shaders to compile. The MSL is always
+        // translated from SPIRV.
+        return (mOptimizationLevel > Optimization::PREPROCESSOR &&
+                mTargetApi != TargetApi::VULKAN) || mTargetApi == TargetApi::METAL ?
                 TargetApi::VULKAN : mTargetApi;
     }
 
@@ -136,10 +139,35 @@ public:
         return mVariantFilter;
     }
 
+    const std::string& getCacheDirectory() const noexcept {
+        return mCacheDirectory;
+    }
+
+    size_t getThreadCount() const noexcept {
+        return mThreadCount;
+    }
+
+    bool compressDictionaries() const noexcept {
+        return mCompressDictionaries;
+    }
+
+    bool specializeDynamicLighting() const noexcept {
+        return mSpecializeDynamicLighting;
+    }
+
+    bool bindlessSamplers() const noexcept {
+        return mBindlessSamplers;
+    }
+
 protected:
     bool mDebug = false;
     bool mIsValid = true;
     bool mPrintShaders = false;
+    bool mCompressDictionaries = false;
+    bool mSpecializeDynamicLighting = false;
+    bool mBindlessSamplers = false;
+    size_t mThreadCount = 1;
+    std::string mCacheDirectory;
     Optimization mOptimizationLevel = Optimization::NONE;
     Metadata mReflectionTarget = Metadata::NONE;
     Mode mMode = Mode::MATERIAL;
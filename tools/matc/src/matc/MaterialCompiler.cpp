@@ -28,18 +28,19 @@
 #include "JsonishLexer.h"
 #include "JsonishParser.h"
 #include "ParametersProcessor.h"
+#include "ShaderCache.h"
 #include "sca/GLSLTools.h"
 #include "sca/GLSLPostProcessor.h"
 
 using namespace utils;
 using namespace filamat;
-using namespace std::placeholders;
 
 namespace matc {
 
 static constexpr const char* CONFIG_KEY_MATERIAL= "material";
 static constexpr const char* CONFIG_KEY_VERTEX_SHADER = "vertex";
 static constexpr const char* CONFIG_KEY_FRAGMENT_SHADER = "fragment";
+static constexpr const char* CONFIG_KEY_COMPUTE_SHADER = "compute";
 static constexpr const char* CONFIG_KEY_TOOL = "tool";
 
 MaterialCompiler::MaterialCompiler() {
@@ -48,11 +49,13 @@ MaterialCompiler::MaterialCompiler() {
     mConfigProcessor[CONFIG_KEY_MATERIAL] = &MaterialCompiler::processMaterial;
     mConfigProcessor[CONFIG_KEY_VERTEX_SHADER] = &MaterialCompiler::processVertexShader;
     mConfigProcessor[CONFIG_KEY_FRAGMENT_SHADER] = &MaterialCompiler::processFragmentShader;
+    mConfigProcessor[CONFIG_KEY_COMPUTE_SHADER] = &MaterialCompiler::processComputeShader;
     mConfigProcessor[CONFIG_KEY_TOOL] = &MaterialCompiler::ignoreLexeme;
 
     mConfigProcessorJSON[CONFIG_KEY_MATERIAL] = &MaterialCompiler::processMaterialJSON;
     mConfigProcessorJSON[CONFIG_KEY_VERTEX_SHADER] = &MaterialCompiler::processVertexShaderJSON;
     mConfigProcessorJSON[CONFIG_KEY_FRAGMENT_SHADER] = &MaterialCompiler::processFragmentShaderJSON;
+    mConfigProcessorJSON[CONFIG_KEY_COMPUTE_SHADER] = &MaterialCompiler::processComputeShaderJSON;
     mConfigProcessorJSON[CONFIG_KEY_TOOL] = &MaterialCompiler::ignoreLexemeJSON;
 }
 
@@ -104,6 +107,16 @@ bool MaterialCompiler::processFragmentShader(const MaterialLexeme& lexeme,
     return true;
 }
 
+bool MaterialCompiler::processComputeShader(const MaterialLexeme& lexeme,
+        MaterialBuilder& builder) const noexcept {
+
+    MaterialLexeme trimedLexeme = lexeme.trimBlockMarkers();
+    std::string shaderStr = trimedLexeme.getStringValue();
+
+    builder.compute(shaderStr.c_str(), trimedLexeme.getLine() + 1);
+    return true;
+}
+
 bool MaterialCompiler::ignoreLexeme(const MaterialLexeme& lexeme,
         MaterialBuilder& builder) const noexcept {
     return true;
@@ -175,6 +188,26 @@ bool MaterialCompiler::processFragmentShaderJSON(const JsonishValue* value,
     return true;
 }
 
+bool MaterialCompiler::processComputeShaderJSON(const JsonishValue* value,
+        filamat::MaterialBuilder& builder) const noexcept {
+
+    if (!value) {
+        std::cerr << "'compute' block does not have a value, one is required." << std::endl;
+        return false;
+    }
+
+    if (value->getType() != JsonishValue::STRING) {
+        std::cerr << "'compute' block has an invalid type: "
+                << JsonishValue::typeToString(value->getType())
+                << ", should be STRING."
+                << std::endl;
+        return false;
+    }
+
+    builder.compute(value->toJsonString()->getString().c_str());
+    return true;
+}
+
 bool MaterialCompiler::ignoreLexemeJSON(const JsonishValue* value,
         filamat::MaterialBuilder& builder) const noexcept {
     return true;
@@ -200,7 +233,9 @@ static bool reflectParameters(const MaterialBuilder& builder) {
         } else {
             std::cout << "      \"type\": \"" <<
                       Enums::toString(parameter.uniformType) << "\"," << std::endl;
-            std::cout << "      \"size\": \"" << parameter.size << "\"" << std::endl;
+            std::cout << "      \"size\": \"" << parameter.size << "\"," << std::endl;
+            std::cout << "      \"precision\": \"" <<
+                      Enums::toString(parameter.uniformPrecision) << "\"" << std::endl;
         }
         std::cout << "    }";
         if (i < count - 1) std::cout << ",";
@@ -291,7 +326,12 @@ bool MaterialCompiler::run(const Config& config) {
         .platform(config.getPlatform())
         .targetApi(config.getTargetApi())
         .codeGenTargetApi(config.getCodeGenTargetApi())
-        .variantFilter(config.getVariantFilter() | builder.getVariantFilter());
+        .variantFilter(config.getVariantFilter() | builder.getVariantFilter())
+        .compressDictionaries(config.compressDictionaries())
+        .specializeDynamicLighting(config.specializeDynamicLighting())
+        .bindlessSamplers(config.bindlessSamplers())
+        // printing the shaders from several threads would interleave them
+        .threadCount(config.printShaders() ? 1 : config.getThreadCount());
 
     // At this point the builder may be able to generate valid shaders if the user populated the
     // properties section in the config file properly. If she hasn't, guess them.
@@ -301,10 +341,46 @@ bool MaterialCompiler::run(const Config& config) {
         return false;
     }
 
-    // Install postprocessor (to optimize/strip GLSL).
-    GLSLPostProcessor postProcessor(config);
+    std::unique_ptr<ShaderCache> cache;
+    if (!config.getCacheDirectory().empty()) {
+        cache.reset(new ShaderCache(config.getCacheDirectory()));
+        if (!cache->isValid()) {
+            std::cerr << "Warning: could not create the cache directory "
+                    << config.getCacheDirectory() << ", the cache is disabled." << std::endl;
+            cache.reset();
+        }
+    }
 
-    builder.postProcessor(std::bind(&GLSLPostProcessor::process, postProcessor, _1, _2, _3, _4, _5));
+    // Install postprocessor (to optimize/strip GLSL). It can be called from several threads at
+    // once, each call uses its own GLSLPostProcessor.
+    builder.postProcessor([&config, &cache](const std::string& inputShader,
+            filament::driver::ShaderType shaderType, filament::driver::ShaderModel shaderModel,
+            std::string* outputGlsl, GLSLPostProcessor::SpirvBlob* outputSpirv,
+            std::string* outputMsl) {
+        // without optimizations, the GLSL is used as is and there is nothing worth caching
+        const bool useCache = cache && (outputSpirv || outputMsl ||
+                config.getOptimizationLevel() != Config::Optimization::NONE);
+        // the GLSL and the MSL are never requested together, the cache stores either as text
+        std::string* outputText = outputMsl ? outputMsl : outputGlsl;
+        std::string key;
+        if (useCache) {
+            key = ShaderCache::makeKey(config, inputShader, shaderType, shaderModel,
+                    outputSpirv != nullptr, outputMsl != nullptr);
+            if (cache->get(key, outputText, outputSpirv)) {
+                if (config.printShaders() && outputText) {
+                    std::cout << *outputText << std::endl;
+                }
+                return true;
+            }
+        }
+        GLSLPostProcessor postProcessor(config);
+        bool ok = postProcessor.process(inputShader, shaderType, shaderModel,
+                outputGlsl, outputSpirv, outputMsl);
+        if (ok && useCache) {
+            cache->put(key, outputText, outputSpirv);
+        }
+        return ok;
+    });
 
     // Write builder.build() to output.
     Package package = builder.build();
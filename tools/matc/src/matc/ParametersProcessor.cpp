@@ -125,6 +125,7 @@ ParametersProcessor::ParametersProcessor() {
     mStringToVariant["dynamicLighting"] = filament::Variant::DYNAMIC_LIGHTING;
     mStringToVariant["shadowReceiver"] = filament::Variant::SHADOW_RECEIVER;
     mStringToVariant["skinning"] = filament::Variant::SKINNING;
+    mStringToVariant["morphing"] = filament::Variant::MORPHING;
 }
 
 bool ParametersProcessor::process(filamat::MaterialBuilder& builder, const JsonishObject& jsonObject) {
@@ -289,6 +290,13 @@ bool ParametersProcessor::processParameter(filamat::MaterialBuilder& builder,
         }
     }
 
+    const JsonishValue* pushConstantValue = jsonObject.getValue("pushConstant");
+    if (pushConstantValue && pushConstantValue->getType() != JsonishValue::BOOL) {
+        std::cerr << PARAM_KEY_PARAMETERS << ": pushConstant must be a BOOL." << std::endl;
+        return false;
+    }
+    const bool pushConstant = pushConstantValue && pushConstantValue->toJsonBool()->getBool();
+
     auto typeString = typeValue->toJsonString()->getString();
     auto nameString = nameValue->toJsonString()->getString();
 
@@ -296,12 +304,30 @@ bool ParametersProcessor::processParameter(filamat::MaterialBuilder& builder,
 
     if (Enums::isValid<UniformType>(typeString)) {
         MaterialBuilder::UniformType type = Enums::toEnum<UniformType>(typeString);
-        if (arraySize == 0) {
-            builder.parameter(type, nameString.c_str());
+        auto precision = MaterialBuilder::ParameterPrecision::DEFAULT;
+        if (precisionValue) {
+            precision =
+                    Enums::toEnum<SamplerPrecision>(precisionValue->toJsonString()->getString());
+        }
+        if (pushConstant) {
+            if (arraySize > 0 || type == MaterialBuilder::UniformType::MAT3) {
+                std::cerr << PARAM_KEY_PARAMETERS << ": the parameter with name '" << nameString
+                        << "' can't be a push constant, arrays and mat3 are not supported."
+                        << std::endl;
+                return false;
+            }
+            builder.pushConstant(type, nameString.c_str());
+        } else if (arraySize == 0) {
+            builder.parameter(type, precision, nameString.c_str());
         } else {
-            builder.parameter(type, arraySize, nameString.c_str());
+            builder.parameter(type, arraySize, precision, nameString.c_str());
         }
     } else if (Enums::isValid<SamplerType>(typeString)) {
+        if (pushConstant) {
+            std::cerr << PARAM_KEY_PARAMETERS << ": the parameter with name '" << nameString
+                    << "' is a sampler, samplers can't be push constants." << std::endl;
+            return false;
+        }
         if (arraySize > 0) {
             std::cerr << PARAM_KEY_PARAMETERS << ": the parameter with name '" << nameString << "'"
                     << " is an array of samplers of size " << arraySize << ". Arrays of samplers"
@@ -346,12 +372,39 @@ bool ParametersProcessor::processVariables(filamat::MaterialBuilder& builder,
     for (size_t i = 0; i < jsonArray->getElements().size(); i++) {
         auto elementValue = jsonArray->getElements()[i];
         filamat::MaterialBuilder::Variable v = intToVariable(i);
-        if (elementValue->getType() != JsonishValue::Type::STRING) {
-            std::cerr << PARAM_KEY_VARIABLES << ": array index " << i << " is not a STRING. found:" <<
-                    JsonishValue::typeToString(elementValue->getType()) << std::endl;
+        if (elementValue->getType() == JsonishValue::Type::STRING) {
+            builder.variable(v, elementValue->toJsonString()->getString().c_str());
+            continue;
+        }
+        // or an object with a name and a precision
+        if (elementValue->getType() != JsonishValue::Type::OBJECT) {
+            std::cerr << PARAM_KEY_VARIABLES << ": array index " << i << " is not a STRING or "
+                    "an OBJECT. found:" << JsonishValue::typeToString(elementValue->getType())
+                    << std::endl;
             return false;
         }
-        builder.variable(v, elementValue->toJsonString()->getString().c_str());
+        const JsonishObject& jsonObject = *elementValue->toJsonObject();
+        const JsonishValue* nameValue = jsonObject.getValue("name");
+        if (!nameValue || nameValue->getType() != JsonishValue::STRING) {
+            std::cerr << PARAM_KEY_VARIABLES << ": array index " << i << " needs a STRING 'name'."
+                    << std::endl;
+            return false;
+        }
+        auto precision = MaterialBuilder::ParameterPrecision::DEFAULT;
+        const JsonishValue* precisionValue = jsonObject.getValue("precision");
+        if (precisionValue) {
+            if (precisionValue->getType() != JsonishValue::STRING) {
+                std::cerr << PARAM_KEY_VARIABLES << ": precision must be a STRING." << std::endl;
+                return false;
+            }
+            auto precisionString = precisionValue->toJsonString();
+            if (!Enums::isValid<SamplerPrecision>(precisionString->getString())) {
+                return logEnumIssue(PARAM_KEY_VARIABLES,
+                        *precisionString, Enums::map<SamplerPrecision>());
+            }
+            precision = Enums::toEnum<SamplerPrecision>(precisionString->getString());
+        }
+        builder.variable(v, nameValue->toJsonString()->getString().c_str(), precision);
     }
     return true;
 }
@@ -47,6 +47,7 @@ Package PostprocessMaterialBuilder::build() {
     container.addChild(&version);
 
     std::vector<GlslEntry> glslEntries;
+    std::vector<GlslEntry> mslEntries;
     std::vector<SpirvEntry> spirvEntries;
     LineDictionary glslDictionary;
     BlobDictionary spirvDictionary;
@@ -64,6 +65,7 @@ Package PostprocessMaterialBuilder::build() {
         const TargetApi targetApi = params.targetApi;
         const TargetApi codeGenTargetApi = params.codeGenTargetApi;
         std::vector<uint32_t>* pSpirv = (targetApi == TargetApi::VULKAN) ? &spirv : nullptr;
+        const bool msl = targetApi == TargetApi::METAL;
 
         GlslEntry glslEntry;
         SpirvEntry spirvEntry;
@@ -75,14 +77,22 @@ Package PostprocessMaterialBuilder::build() {
             glslEntry.variant = static_cast<uint8_t>(k);
             spirvEntry.variant = static_cast<uint8_t>(k);
 
+            // The framebuffer fetch is only resolved by the device's compiler, these shaders
+            // can't go through the post-processor's intermediate representation and are
+            // generated for OpenGL directly.
+            // See ShaderPostProcessGenerator::usesFramebufferFetch().
+            const bool keepGlsl = targetApi == TargetApi::OPENGL &&
+                    ShaderPostProcessGenerator::usesFramebufferFetch(filament::PostProcessStage(k));
+            const TargetApi stageCodeGenTargetApi = keepGlsl ? TargetApi::OPENGL : codeGenTargetApi;
+
             // Vertex Shader
             std::string vs = ShaderPostProcessGenerator::createPostProcessVertexProgram(
-                    shaderModel, targetApi, codeGenTargetApi,
+                    shaderModel, targetApi, stageCodeGenTargetApi,
                     filament::PostProcessStage(k), firstSampler);
 
-            if (mPostprocessorCallback != nullptr) {
+            if (mPostprocessorCallback != nullptr && !keepGlsl) {
                 bool ok = mPostprocessorCallback(vs, filament::driver::ShaderType::VERTEX,
-                        shaderModel, &vs, pSpirv);
+                        shaderModel, msl ? nullptr : &vs, pSpirv, msl ? &vs : nullptr);
                 if (!ok) {
                     // An error occured while postProcessing, aborting.
                     errorOccured = true;
@@ -90,13 +100,13 @@ Package PostprocessMaterialBuilder::build() {
                 }
             }
 
-            if (targetApi == TargetApi::OPENGL) {
+            if (targetApi == TargetApi::OPENGL || msl) {
                 glslEntry.stage = filament::driver::ShaderType::VERTEX;
                 glslEntry.shaderSize = vs.size();
                 glslEntry.shader = (char*)malloc(glslEntry.shaderSize + 1);
                 strcpy(glslEntry.shader, vs.c_str());
                 glslDictionary.addText(glslEntry.shader);
-                glslEntries.push_back(glslEntry);
+                (msl ? mslEntries : glslEntries).push_back(glslEntry);
             }
             if (targetApi == TargetApi::VULKAN) {
                 spirvEntry.stage = filament::driver::ShaderType::VERTEX;
@@ -107,24 +117,24 @@ Package PostprocessMaterialBuilder::build() {
 
             // Fragment Shader
             std::string fs = ShaderPostProcessGenerator::createPostProcessFragmentProgram(
-                    shaderModel, targetApi, codeGenTargetApi,
+                    shaderModel, targetApi, stageCodeGenTargetApi,
                     filament::PostProcessStage(k), firstSampler);
-            if (mPostprocessorCallback != nullptr) {
+            if (mPostprocessorCallback != nullptr && !keepGlsl) {
                 bool ok = mPostprocessorCallback(fs, filament::driver::ShaderType::FRAGMENT,
-                        shaderModel, &fs, pSpirv);
+                        shaderModel, msl ? nullptr : &fs, pSpirv, msl ? &fs : nullptr);
                 if (!ok) {
                     // An error occured while postProcessing, aborting.
                     errorOccured = true;
                     break;
                 }
             }
-            if (targetApi == TargetApi::OPENGL) {
+            if (targetApi == TargetApi::OPENGL || msl) {
                 glslEntry.stage = filament::driver::ShaderType::FRAGMENT;
                 glslEntry.shaderSize = fs.size();
                 glslEntry.shader = (char*)malloc(glslEntry.shaderSize + 1);
                 strcpy(glslEntry.shader, fs.c_str());
                 glslDictionary.addText(glslEntry.shader);
-                glslEntries.push_back(glslEntry);
+                (msl ? mslEntries : glslEntries).push_back(glslEntry);
             }
             if (targetApi == TargetApi::VULKAN) {
                 spirvEntry.stage = filament::driver::ShaderType::FRAGMENT;
@@ -138,10 +148,16 @@ Package PostprocessMaterialBuilder::build() {
     // Emit GLSL chunks
     DictionaryGlslChunk dicGlslChunk(glslDictionary);
     MaterialGlslChunk glslChunk(glslEntries, glslDictionary);
-    if (!glslEntries.empty()) {
+    MaterialGlslChunk mslChunk(mslEntries, glslDictionary, ChunkType::MaterialMetal);
+    if (!glslEntries.empty() || !mslEntries.empty()) {
         container.addChild(&dicGlslChunk);
+    }
+    if (!glslEntries.empty()) {
         container.addChild(&glslChunk);
     }
+    if (!mslEntries.empty()) {
+        container.addChild(&mslChunk);
+    }
 
     // Emit SPIRV chunks
     DictionarySpirvChunk dicSpirvChunk(spirvDictionary);
@@ -162,6 +178,9 @@ Package PostprocessMaterialBuilder::build() {
     for (GlslEntry entry : glslEntries) {
         free(entry.shader);
     }
+    for (GlslEntry entry : mslEntries) {
+        free(entry.shader);
+    }
     return package;
 }
 
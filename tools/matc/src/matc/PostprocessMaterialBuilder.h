@@ -42,7 +42,7 @@ public:
         return *this;
     }
 
-    // specifies vulkan vs opengl; works in concert with Platform to determine the shader models
+    // specifies opengl, vulkan or metal; works in concert with Platform to determine the shader models
     // (used to generate code) and final output representations (spirv and/or text).
     PostprocessMaterialBuilder& targetApi(TargetApi targetApi) noexcept {
         mTargetApi = targetApi;
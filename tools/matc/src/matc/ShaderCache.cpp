@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ShaderCache.h"
+
+#include <atomic>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include <stdio.h>
+
+namespace matc {
+
+// An entry is the key, followed by the GLSL and SPIR-V outputs, each prefixed by its size.
+// The key is stored to detect the (unlikely) collisions of the 64-bit hash naming the entry.
+static constexpr uint32_t ENTRY_VERSION = 1;
+
+static uint64_t fnv1a(const std::string& s) noexcept {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : s) {
+        hash = (hash ^ uint8_t(c)) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+template<typename T>
+static void write(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static bool read(std::istream& in, T* value) {
+    return bool(in.read(reinterpret_cast<char*>(value), sizeof(T)));
+}
+
+static void writeBytes(std::ostream& out, const void* data, uint64_t size) {
+    write(out, size);
+    out.write(static_cast<const char*>(data), size);
+}
+
+template<typename T>
+static bool readBytes(std::istream& in, std::vector<T>* data) {
+    uint64_t size;
+    if (!read(in, &size) || size % sizeof(T)) {
+        return false;
+    }
+    data->resize(size / sizeof(T));
+    return bool(in.read(reinterpret_cast<char*>(data->data()), size));
+}
+
+ShaderCache::ShaderCache(const std::string& directory) : mDirectory(directory) {
+    mIsValid = mDirectory.mkdirRecursive();
+}
+
+std::string ShaderCache::makeKey(const Config& config, const std::string& inputShader,
+        filament::driver::ShaderType shaderType, filament::driver::ShaderModel shaderModel,
+        bool spirv, bool msl) {
+    std::ostringstream key;
+    key << "version=" << ENTRY_VERSION
+        << " type=" << int(shaderType)
+        << " model=" << int(shaderModel)
+        << " optimization=" << int(config.getOptimizationLevel())
+        << " spirv=" << spirv
+        << " msl=" << msl << '\n'
+        << inputShader;
+    return key.str();
+}
+
+utils::Path ShaderCache::getEntryPath(const std::string& key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.shader", (unsigned long long) fnv1a(key));
+    return mDirectory.concat(name);
+}
+
+bool ShaderCache::get(const std::string& key, std::string* outputGlsl,
+        SpirvBlob* outputSpirv) const {
+    std::ifstream in(getEntryPath(key).getPath(), std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::vector<char> storedKey;
+    std::vector<char> glsl;
+    SpirvBlob spirv;
+    if (!readBytes(in, &storedKey) || !readBytes(in, &glsl) || !readBytes(in, &spirv) ||
+            std::string(storedKey.begin(), storedKey.end()) != key ||
+            (outputSpirv && spirv.empty())) {
+        return false;
+    }
+    if (outputGlsl) {
+        outputGlsl->assign(glsl.begin(), glsl.end());
+    }
+    if (outputSpirv) {
+        *outputSpirv = std::move(spirv);
+    }
+    return true;
+}
+
+void ShaderCache::put(const std::string& key, const std::string* outputGlsl,
+        const SpirvBlob* outputSpirv) const {
+    // The entry is written next to its final name and renamed once complete, so other threads
+    // or processes never read part of an entry.
+    static const uint32_t sProcessId = std::random_device()();
+    static std::atomic<uint32_t> sTemporaryId = { 0 };
+    const utils::Path path = getEntryPath(key);
+    const std::string temporary = path.getPath() + ".tmp" + std::to_string(sProcessId) + "." +
+            std::to_string(sTemporaryId++);
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        writeBytes(out, key.data(), key.size());
+        writeBytes(out, outputGlsl ? outputGlsl->data() : nullptr,
+                outputGlsl ? outputGlsl->size() : 0);
+        writeBytes(out, outputSpirv ? outputSpirv->data() : nullptr,
+                outputSpirv ? outputSpirv->size() * sizeof(uint32_t) : 0);
+        if (!out) {
+            remove(temporary.c_str());
+            return;
+        }
+    }
+    if (rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+    }
+}
+
+} // namespace matc
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef TNT_SHADERCACHE_H
+#define TNT_SHADERCACHE_H
+
+#include <string>
+#include <vector>
+
+#include <filament/driver/DriverEnums.h>
+
+#include <matc/Config.h>
+
+#include <utils/Path.h>
+
+namespace matc {
+
+// Stores the results of the GLSL post-processor on disk, keyed by everything they depend on, so
+// the shaders that didn't change are not processed again by the next runs. Several threads can
+// use the cache at once.
+class ShaderCache {
+public:
+    using SpirvBlob = std::vector<uint32_t>;
+
+    explicit ShaderCache(const std::string& directory);
+
+    bool isValid() const noexcept { return mIsValid; }
+
+    // The key of the outputs produced from this shader, with this config
+    static std::string makeKey(const Config& config, const std::string& inputShader,
+            filament::driver::ShaderType shaderType, filament::driver::ShaderModel shaderModel,
+            bool spirv, bool msl);
+
+    // Returns true and the outputs if the shader of this key was processed before
+    bool get(const std::string& key, std::string* outputGlsl, SpirvBlob* outputSpirv) const;
+
+    void put(const std::string& key, const std::string* outputGlsl,
+            const SpirvBlob* outputSpirv) const;
+
+private:
+    utils::Path getEntryPath(const std::string& key) const;
+
+    utils::Path mDirectory;
+    bool mIsValid = false;
+};
+
+} // namespace matc
+
+#endif // TNT_SHADERCACHE_H
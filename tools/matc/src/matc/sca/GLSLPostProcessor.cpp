@@ -16,6 +16,7 @@
 
 #include "GLSLPostProcessor.h"
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -25,6 +26,7 @@
 #include <localintermediate.h>
 
 #include <spirv_glsl.hpp>
+#include <spirv_msl.hpp>
 
 #include "builtinResource.h"
 #include "GLSLTools.h"
@@ -124,13 +126,57 @@ static std::string shrinkString(const std::string& s) {
     return r;
 }
 
+/**
+ * Removes the debug names of the functions, their parameters and variables, and of the
+ * temporaries, so that SPIRV-Cross gives them short generated names (_42), which makes less
+ * GLSL for the drivers to parse. The names of the types, members, constants and global variables
+ * are kept: the drivers find the uniforms, samplers and varyings by name.
+ */
+static void stripLocalNames(std::vector<uint32_t>& spirv) {
+    constexpr size_t HEADER_SIZE = 5;
+    if (spirv.size() <= HEADER_SIZE) {
+        return;
+    }
+
+    std::vector<bool> keep(spirv[3]); // the id bound
+    for (size_t i = HEADER_SIZE; i < spirv.size();) {
+        const uint32_t op = spirv[i] & 0xFFFFu;
+        const uint32_t count = spirv[i] >> 16u;
+        if (count == 0 || i + count > spirv.size()) {
+            return; // malformed, leave it alone
+        }
+        if (op >= spv::OpTypeVoid && op <= spv::OpTypeForwardPointer) {
+            keep[spirv[i + 1]] = true;
+        } else if (op >= spv::OpConstantTrue && op <= spv::OpSpecConstantOp) {
+            keep[spirv[i + 2]] = true;
+        } else if (op == spv::OpVariable && spirv[i + 3] != spv::StorageClassFunction) {
+            keep[spirv[i + 2]] = true;
+        }
+        i += count;
+    }
+
+    size_t out = HEADER_SIZE;
+    for (size_t i = HEADER_SIZE; i < spirv.size();) {
+        const uint32_t op = spirv[i] & 0xFFFFu;
+        const uint32_t count = spirv[i] >> 16u;
+        if (op != spv::OpName || keep[spirv[i + 1]]) {
+            std::copy(spirv.begin() + i, spirv.begin() + i + count, spirv.begin() + out);
+            out += count;
+        }
+        i += count;
+    }
+    spirv.resize(out);
+}
+
 bool GLSLPostProcessor::process(const std::string& inputShader,
         filament::driver::ShaderType shaderType, filament::driver::ShaderModel shaderModel,
-        std::string* outputGlsl, SpirvBlob* outputSpirv) {
+        std::string* outputGlsl, SpirvBlob* outputSpirv, std::string* outputMsl) {
 
-    // If TargetApi is Vulkan, then we need post-processing even if there's no optimization.
+    // If TargetApi is Vulkan or Metal, then we need post-processing even if there's no
+    // optimization.
     using TargetApi = Config::TargetApi;
-    const TargetApi targetApi = outputSpirv ? TargetApi::VULKAN : TargetApi::OPENGL;
+    const TargetApi targetApi = outputMsl ? TargetApi::METAL :
+            outputSpirv ? TargetApi::VULKAN : TargetApi::OPENGL;
     if (targetApi == TargetApi::OPENGL &&
             mConfig.getOptimizationLevel() == Config::Optimization::NONE) {
         *outputGlsl = inputShader;
@@ -140,11 +186,16 @@ bool GLSLPostProcessor::process(const std::string& inputShader,
         return true;
     }
 
+    // the MSL is translated from the SPIR-V
+    SpirvBlob spirv;
     mGlslOutput = outputGlsl;
-    mSpirvOutput = outputSpirv;
+    mSpirvOutput = (outputMsl && !outputSpirv) ? &spirv : outputSpirv;
+    mMslOutput = outputMsl;
 
     if (shaderType == filament::driver::VERTEX) {
         mShLang = EShLangVertex;
+    } else if (shaderType == filament::driver::COMPUTE) {
+        mShLang = EShLangCompute;
     } else {
         mShLang = EShLangFragment;
     }
@@ -190,9 +241,63 @@ bool GLSLPostProcessor::process(const std::string& inputShader,
             std::cout << *mGlslOutput << std::endl;
         }
     }
+
+    if (mMslOutput) {
+        if (mSpirvOutput->empty()) {
+            return false;
+        }
+        translateToMsl(*mSpirvOutput, shaderType, shaderModel);
+        if (mConfig.printShaders()) {
+            std::cout << *mMslOutput << std::endl;
+        }
+    }
     return true;
 }
 
+void GLSLPostProcessor::translateToMsl(SpirvBlob spirv, filament::driver::ShaderType shaderType,
+        const filament::driver::ShaderModel shaderModel) const {
+    const spv::ExecutionModel stage =
+            shaderType == filament::driver::VERTEX ? spv::ExecutionModelVertex :
+            shaderType == filament::driver::COMPUTE ? spv::ExecutionModelGLCompute :
+            spv::ExecutionModelFragment;
+
+    // Pin the Metal indices of the resources to their Vulkan bindings, so the driver knows
+    // where to bind them without reflecting the MSL.
+    std::vector<MSLResourceBinding> bindings;
+    {
+        Compiler reflection(spirv);
+        ShaderResources resources = reflection.get_shader_resources();
+        auto add = [&](Resource const& resource, uint32_t bufferOffset) {
+            MSLResourceBinding binding;
+            binding.stage = stage;
+            binding.desc_set = reflection.get_decoration(resource.id, spv::DecorationDescriptorSet);
+            binding.binding = reflection.get_decoration(resource.id, spv::DecorationBinding);
+            binding.msl_buffer = bufferOffset + binding.binding;
+            binding.msl_texture = binding.binding;
+            binding.msl_sampler = binding.binding;
+            bindings.push_back(binding);
+        };
+        for (Resource const& resource : resources.uniform_buffers) {
+            add(resource, 0);
+        }
+        for (Resource const& resource : resources.storage_buffers) {
+            add(resource, MSL_STORAGE_BUFFER_OFFSET);
+        }
+        for (Resource const& resource : resources.sampled_images) {
+            add(resource, 0);
+        }
+    }
+
+    CompilerMSL mslCompiler(move(spirv), nullptr, &bindings);
+    CompilerMSL::Options mslOptions;
+    mslOptions.platform = shaderModel == filament::driver::ShaderModel::GL_ES_30 ?
+            CompilerMSL::Options::iOS : CompilerMSL::Options::macOS;
+    mslOptions.set_msl_version(2, 0);
+    mslCompiler.set_msl_options(mslOptions);
+
+    *mMslOutput = mslCompiler.compile();
+}
+
 void GLSLPostProcessor::preprocessOptimization(glslang::TShader& tShader,
         const filament::driver::ShaderModel shaderModel) const {
     using TargetApi = Config::TargetApi;
@@ -275,6 +380,10 @@ void GLSLPostProcessor::fullOptimization(const TShader& tShader,
         glslOptions.fragment.default_int_precision = glslOptions.es ?
                 CompilerGLSL::Options::Precision::Mediump : CompilerGLSL::Options::Precision::Highp;
 
+        if (optimizationLevel == Config::Optimization::SIZE) {
+            stripLocalNames(spirv);
+        }
+
         CompilerGLSL glslCompiler(move(spirv));
         glslCompiler.set_common_options(glslOptions);
 
@@ -38,11 +38,19 @@ public:
 
     using SpirvBlob = std::vector<uint32_t>;
 
+    // outputMsl is set to translate the shader to MSL, the uniform buffers are then bound at
+    // [[buffer(binding)]], the storage buffers at [[buffer(MSL_STORAGE_BUFFER_OFFSET + binding)]]
+    // and the samplers at [[texture(binding)]] and [[sampler(binding)]].
     bool process(const std::string& inputShader, filament::driver::ShaderType shaderType,
             filament::driver::ShaderModel shaderModel, std::string* outputGlsl,
-            SpirvBlob* outputSpirv);
+            SpirvBlob* outputSpirv, std::string* outputMsl);
+
+    static constexpr uint32_t MSL_STORAGE_BUFFER_OFFSET = 16;
 
 private:
+    void translateToMsl(SpirvBlob spirv, filament::driver::ShaderType shaderType,
+            const filament::driver::ShaderModel shaderModel) const;
+
     void fullOptimization(const glslang::TShader& tShader,
             const filament::driver::ShaderModel shaderModel) const;
     void preprocessOptimization(glslang::TShader& tShader,
@@ -54,6 +62,7 @@ private:
     const Config& mConfig;
     std::string* mGlslOutput = nullptr;
     SpirvBlob* mSpirvOutput = nullptr;
+    std::string* mMslOutput = nullptr;
     EShLanguage mShLang = EShLangFragment;
     int mLangVersion = 0;
 };
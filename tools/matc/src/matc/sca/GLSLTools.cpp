@@ -144,14 +144,17 @@ bool GLSLTools::process(MaterialBuilder& builder) const noexcept {
     }
 
     // At this point the shader is syntactically correct. Perform semantic analysis now.
+    // The shaders are parsed with the rules of the API they're generated for, OpenGL shaders are
+    // generated for Vulkan when they're optimized.
     ShaderModel model;
+    MaterialBuilder::TargetApi codeGenTargetApi;
 
-    std::string shaderCode = builder.peek(ShaderType::VERTEX, model);
-    bool result = analyzeVertexShader(shaderCode, model, builder.getTargetApi());
+    std::string shaderCode = builder.peek(ShaderType::VERTEX, model, codeGenTargetApi);
+    bool result = analyzeVertexShader(shaderCode, model, codeGenTargetApi);
     if (!result) return result;
 
-    shaderCode = builder.peek(ShaderType::FRAGMENT, model);
-    result = analyzeFragmentShader(shaderCode, model, builder.getTargetApi());
+    shaderCode = builder.peek(ShaderType::FRAGMENT, model, codeGenTargetApi);
+    result = analyzeFragmentShader(shaderCode, model, codeGenTargetApi);
     return result;
 }
 
@@ -175,7 +178,8 @@ bool GLSLTools::findProperties(const filamat::MaterialBuilder& builderIn, Proper
     }
 
     ShaderModel model;
-    std::string shaderCode = builder.peek(ShaderType::FRAGMENT, model);
+    MaterialBuilder::TargetApi codeGenTargetApi;
+    std::string shaderCode = builder.peek(ShaderType::FRAGMENT, model, codeGenTargetApi);
     const char* shaderCString = shaderCode.c_str();
 
     TShader tShader(EShLanguage::EShLangFragment);
@@ -183,7 +187,7 @@ bool GLSLTools::findProperties(const filamat::MaterialBuilder& builderIn, Proper
 
     GLSLangCleaner cleaner;
     int version = glslangVersionFromShaderModel(model);
-    EShMessages msg = glslangFlagsFromTargetApi(builderIn.getTargetApi());
+    EShMessages msg = glslangFlagsFromTargetApi(codeGenTargetApi);
     const TBuiltInResource* builtins = &DefaultTBuiltInResource;
     bool ok = tShader.parse(builtins, version, false, msg);
     if (!ok) {
@@ -320,7 +324,9 @@ int GLSLTools::glslangVersionFromShaderModel(ShaderModel model) {
 
 EShMessages GLSLTools::glslangFlagsFromTargetApi(MaterialBuilder::TargetApi targetApi) {
     EShMessages msg = EShMessages::EShMsgDefault;
-    if (targetApi == MaterialBuilder::TargetApi::VULKAN) {
+    // the Metal shaders are generated for Vulkan, then translated
+    if (targetApi == MaterialBuilder::TargetApi::VULKAN ||
+            targetApi == MaterialBuilder::TargetApi::METAL) {
         msg = (EShMessages) (EShMessages::EShMsgVulkanRules | EShMessages::EShMsgSpvRules);
     }
     return msg;
@@ -33,10 +33,20 @@
 #include <spirv_glsl.hpp>
 #include <spirv-tools/libspirv.h>
 
+#include <glslang/Public/ShaderLang.h>
+#include <SPIRV/GlslangToSpv.h>
+#include <SPIRV/spirv.hpp>
+
+// must be included after the glslang headers
+#include <matc/sca/builtinResource.h>
+
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 
+#include <stdio.h>
+#include <stdlib.h>
+
 using namespace filaflat;
 using namespace utils;
 
@@ -47,6 +57,8 @@ struct Config {
     bool printSPIRV = false;
     bool transpile = false;
     bool binary = false;
+    bool printCost = false;
+    bool malioc = false;
     uint64_t shaderIndex;
 };
 
@@ -75,6 +87,11 @@ static void printUsage(const char* name) {
                     "       Print the nth Vulkan shader transpiled into GLSL\n\n"
                     "   --dump-binary=[index], -b\n"
                     "       Dump binary SPIRV for the nth Vulkan shader to 'out.spv'\n\n"
+                    "   --print-cost, -c\n"
+                    "       Print an estimate of the cost of every shader, from its SPIR-V\n\n"
+                    "   --print-malioc=[index], -m\n"
+                    "       Run the Mali offline compiler (malioc) on the nth GLSL shader,\n"
+                    "       malioc must be in the PATH and only supports the gles30 shaders\n\n"
                     "   --license\n"
                     "       Print copyright and license information\n\n"
     );
@@ -93,7 +110,7 @@ static void license() {
 }
 
 static int handleArguments(int argc, char* argv[], Config* config) {
-    static constexpr const char* OPTSTR = "hlg:s:v:b:";
+    static constexpr const char* OPTSTR = "hlg:s:v:b:cm:";
     static const struct option OPTIONS[] = {
             { "help",         no_argument,       0, 'h' },
             { "license",      no_argument,       0, 'l' },
@@ -101,6 +118,8 @@ static int handleArguments(int argc, char* argv[], Config* config) {
             { "print-spirv",  required_argument, 0, 's' },
             { "print-vkglsl", required_argument, 0, 'v' },
             { "dump-binary",  required_argument, 0, 'b' },
+            { "print-cost",   no_argument,       0, 'c' },
+            { "print-malioc", required_argument, 0, 'm' },
             { 0, 0, 0, 0 }  // termination of the option list
     };
 
@@ -135,6 +154,14 @@ static int handleArguments(int argc, char* argv[], Config* config) {
                 config->shaderIndex = static_cast<uint64_t>(std::stoi(arg));
                 config->binary = true;
                 break;
+            case 'c':
+                config->printCost = true;
+                break;
+            case 'm':
+                config->printGLSL = true;
+                config->shaderIndex = static_cast<uint64_t>(std::stoi(arg));
+                config->malioc = true;
+                break;
         }
     }
 
@@ -241,6 +268,7 @@ const char* toString(filament::driver::ShaderType stage) {
     switch (stage) {
         case filament::driver::ShaderType::VERTEX: return "vs";
         case filament::driver::ShaderType::FRAGMENT: return "fs";
+        case filament::driver::ShaderType::COMPUTE: return "cs";
         default: break;
     }
     return "--";
@@ -728,6 +756,209 @@ static void dumpSpirvBinary(const std::vector<uint32_t>& spirv, std::string file
     std::cout << "Binary SPIR-V dumped to " << filename << std::endl;
 }
 
+// Static instruction counts of a SPIR-V module, used as a rough estimate of the cost of a shader.
+// They don't account for loops or for what the GPU driver's compiler does with the code, but are
+// good enough to compare the variants of a material or two versions of the same material.
+struct ShaderCost {
+    size_t size = 0;            // size of the shader in the material, in bytes
+    uint32_t instructions = 0;  // instructions inside the functions
+    uint32_t alu = 0;           // arithmetic, conversion, logical, bit, derivative and extended ops
+    uint32_t texture = 0;       // image sampling, fetching, gathering and reading
+    uint32_t memory = 0;        // loads, stores and access chains
+    uint32_t branches = 0;      // conditional branches, switches, kills and function calls
+    uint32_t ids = 0;           // the module's id bound, a proxy for the register pressure
+    uint32_t locals = 0;        // variables of the function storage class
+};
+
+static bool isTextureOp(uint32_t op) {
+    return (op >= spv::OpImageSampleImplicitLod && op <= spv::OpImageRead) ||
+           (op >= spv::OpImageSparseSampleImplicitLod && op <= spv::OpImageSparseRead);
+}
+
+static bool isAluOp(uint32_t op) {
+    return op == spv::OpExtInst ||
+           (op >= spv::OpConvertFToU && op <= spv::OpBitcast) ||
+           (op >= spv::OpSNegate && op <= spv::OpSMulExtended) ||
+           (op >= spv::OpAny && op <= spv::OpFUnordGreaterThanEqual) ||
+           (op >= spv::OpShiftRightLogical && op <= spv::OpBitCount) ||
+           (op >= spv::OpDPdx && op <= spv::OpFwidthCoarse);
+}
+
+static ShaderCost analyzeSpirv(const std::vector<uint32_t>& spirv) {
+    ShaderCost cost;
+    cost.size = spirv.size() * 4;
+    if (spirv.size() < 5) {
+        return cost;
+    }
+    cost.ids = spirv[3];
+
+    bool inFunction = false;
+    for (size_t i = 5; i < spirv.size(); ) {
+        const uint32_t op = spirv[i] & 0xFFFFu;
+        const uint32_t wordCount = spirv[i] >> 16u;
+        if (wordCount == 0 || i + wordCount > spirv.size()) {
+            break;
+        }
+        if (op == spv::OpFunction) {
+            inFunction = true;
+        } else if (op == spv::OpFunctionEnd) {
+            inFunction = false;
+        } else if (inFunction) {
+            cost.instructions++;
+            if (isAluOp(op)) {
+                cost.alu++;
+            } else if (isTextureOp(op)) {
+                cost.texture++;
+            } else if (op == spv::OpLoad || op == spv::OpStore || op == spv::OpAccessChain) {
+                cost.memory++;
+            } else if (op == spv::OpBranchConditional || op == spv::OpSwitch ||
+                    op == spv::OpKill || op == spv::OpFunctionCall) {
+                cost.branches++;
+            } else if (op == spv::OpVariable && wordCount > 3 &&
+                    spirv[i + 3] == spv::StorageClassFunction) {
+                cost.locals++;
+            }
+        }
+        i += wordCount;
+    }
+    return cost;
+}
+
+// Compiles a GLSL shader to SPIR-V. The shaders are parsed with the OpenGL rules they were
+// generated for: the resulting SPIR-V is only meant to be analyzed, not to be used by a driver.
+static bool compileGlsl(const std::string& source, filament::driver::ShaderModel model,
+        filament::driver::ShaderType stage, std::vector<uint32_t>* spirv) {
+    using namespace glslang;
+
+    const EShLanguage language = stage == filament::driver::ShaderType::VERTEX ? EShLangVertex :
+            stage == filament::driver::ShaderType::COMPUTE ? EShLangCompute : EShLangFragment;
+    const int version = model == filament::driver::ShaderModel::GL_ES_30 ? 100 : 110;
+    const char* shaderString = source.c_str();
+
+    TShader shader(language);
+    shader.setStrings(&shaderString, 1);
+    if (!shader.parse(&DefaultTBuiltInResource, version, false, EShMsgDefault)) {
+        std::cerr << shader.getInfoLog() << std::endl;
+        return false;
+    }
+
+    GlslangToSpv(*shader.getIntermediate(), *spirv);
+    return true;
+}
+
+// The weights are a rough average of the relative throughput of mobile GPUs.
+static uint32_t getCostEstimate(const ShaderCost& cost) {
+    return cost.alu + 4 * cost.texture + cost.memory / 2 + 2 * cost.branches;
+}
+
+static void printCostHeader(const char* title) {
+    std::cout << title << std::endl;
+    std::cout << "    " << std::setw(5) << std::left << "#";
+    std::cout << std::setw(7) << "Model" << std::setw(3) << "St" << std::setw(5) << "Var";
+    std::cout << std::right;
+    std::cout << std::setw(8) << "Size" << std::setw(8) << "Instr" << std::setw(7) << "ALU";
+    std::cout << std::setw(5) << "Tex" << std::setw(7) << "Memory" << std::setw(7) << "Branch";
+    std::cout << std::setw(7) << "Ids" << std::setw(7) << "Locals" << std::setw(7) << "Cost";
+    std::cout << std::left << std::endl;
+}
+
+static void printCost(uint64_t index, const ShaderInfo& item, const ShaderCost& cost) {
+    std::cout << "    #";
+    std::cout << std::setw(4) << std::left << index;
+    std::cout << std::setw(7) << toString(item.shaderModel);
+    std::cout << std::setw(3) << toString(item.pipelineStage);
+    std::cout << "0x" << std::hex << std::setfill('0') << std::setw(2) << std::right
+              << (int) item.variant << std::setfill(' ') << std::dec << " ";
+    std::cout << std::setw(8) << cost.size << std::setw(8) << cost.instructions;
+    std::cout << std::setw(7) << cost.alu << std::setw(5) << cost.texture;
+    std::cout << std::setw(7) << cost.memory << std::setw(7) << cost.branches;
+    std::cout << std::setw(7) << cost.ids << std::setw(7) << cost.locals;
+    std::cout << std::setw(7) << getCostEstimate(cost);
+    std::cout << std::left << std::endl;
+}
+
+static bool printCostInfo(void* data, size_t size, const ChunkContainer& container) {
+    filaflat::ShaderBuilder builder;
+    std::vector<ShaderInfo> info;
+
+    if (container.hasChunk(filamat::ChunkType::MaterialGlsl)) {
+        MaterialParser parser(filament::driver::Backend::OPENGL, data, size);
+        if (!parser.parse() || !getGlShaderInfo(container, &info)) {
+            std::cerr << "Failed to parse GLSL chunk." << std::endl;
+            return false;
+        }
+
+        glslang::InitializeProcess();
+        printCostHeader("GLSL shaders (compiled to SPIR-V):");
+        for (uint64_t i = 0; i < info.size(); ++i) {
+            const auto& item = info[i];
+            parser.getShader(item.shaderModel, item.variant, item.pipelineStage, builder);
+            const std::string source(builder.getShader());
+
+            std::vector<uint32_t> spirv;
+            if (!compileGlsl(source, item.shaderModel, item.pipelineStage, &spirv)) {
+                std::cerr << "Failed to compile GLSL shader #" << i << "." << std::endl;
+                continue;
+            }
+            ShaderCost cost = analyzeSpirv(spirv);
+            cost.size = source.size();
+            printCost(i, item, cost);
+        }
+        glslang::FinalizeProcess();
+        std::cout << std::endl;
+    }
+
+    if (container.hasChunk(filamat::ChunkType::MaterialSpirv)) {
+        MaterialParser parser(filament::driver::Backend::VULKAN, data, size);
+        if (!parser.parse() || !getVkShaderInfo(container, &info)) {
+            std::cerr << "Failed to parse SPIRV chunk." << std::endl;
+            return false;
+        }
+
+        printCostHeader("Vulkan shaders:");
+        for (uint64_t i = 0; i < info.size(); ++i) {
+            const auto& item = info[i];
+            parser.getShader(item.shaderModel, item.variant, item.pipelineStage, builder);
+            uint32_t const* words = reinterpret_cast<uint32_t const*>(builder.getShader());
+            const std::vector<uint32_t> spirv(words, words + builder.size() / 4);
+            printCost(i, item, analyzeSpirv(spirv));
+        }
+        std::cout << std::endl;
+    }
+
+    std::cout << "Cost = ALU + 4 x Tex + Memory / 2 + 2 x Branch, static counts" << std::endl;
+    return true;
+}
+
+// Runs the Mali offline compiler on a GLSL shader, it needs to be in a file whose extension
+// gives the stage.
+static bool runMaliOfflineCompiler(const std::string& source, const ShaderInfo& item) {
+    if (item.shaderModel != filament::driver::ShaderModel::GL_ES_30) {
+        std::cerr << "malioc only supports the gles30 shaders." << std::endl;
+        return false;
+    }
+
+    const char* tmp = getenv("TMPDIR");
+    Path path = Path::concat(tmp ? tmp : "/tmp",
+            item.pipelineStage == filament::driver::ShaderType::VERTEX ? "matinfo.vert" :
+            item.pipelineStage == filament::driver::ShaderType::COMPUTE ? "matinfo.comp" :
+                    "matinfo.frag");
+
+    std::ofstream out(path.c_str());
+    out << source;
+    out.close();
+
+    const std::string command = "malioc \"" + path.getPath() + "\"";
+    const int result = system(command.c_str());
+    path.unlinkFile();
+
+    if (result != 0) {
+        std::cerr << "malioc failed, is it installed and in the PATH?" << std::endl;
+        return false;
+    }
+    return true;
+}
+
 static bool parseChunks(Config config, void* data, size_t size) {
     ChunkContainer container(data, size);
     if (!container.parse()) {
@@ -756,6 +987,9 @@ static bool parseChunks(Config config, void* data, size_t size) {
 
             const auto& item = info[config.shaderIndex];
             parser.getShader(item.shaderModel, item.variant, item.pipelineStage, builder);
+            if (config.malioc) {
+                return runMaliOfflineCompiler(builder.getShader(), item);
+            }
             std::cout << builder.getShader();
 
             return true;
@@ -798,6 +1032,10 @@ static bool parseChunks(Config config, void* data, size_t size) {
         }
     }
 
+    if (config.printCost) {
+        return printCostInfo(data, size, container);
+    }
+
     if (!printMaterialInfo(container)) {
         std::cerr << "The source material is invalid." << std::endl;
         return false;
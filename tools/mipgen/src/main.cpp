@@ -15,17 +15,24 @@
  */
 
 #include <image/ImageSampler.h>
+#include <image/KtxBundle.h>
 #include <image/LinearImage.h>
 
+#include <imageio/BlockCompression.h>
 #include <imageio/ImageDecoder.h>
 #include <imageio/ImageEncoder.h>
 
+#include <utils/JobSystem.h>
 #include <utils/Path.h>
 
 #include <getopt/getopt.h>
 
+#include <math/scalar.h>
+
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 using namespace image;
 using namespace std;
@@ -33,9 +40,11 @@ using namespace utils;
 
 static ImageEncoder::Format g_format = ImageEncoder::Format::PNG_LINEAR;
 static bool g_formatSpecified = false;
+static bool g_ktx = false;
 static bool g_createGallery = false;
 static string g_compression = "";
 static Filter g_filter = Filter::DEFAULT;
+static uint32_t g_stripHeight = 0;
 
 static const char* USAGE = R"TXT(
 MIPGEN generates mipmaps for an image down to the 1x1 level.
@@ -44,6 +53,9 @@ Output filenames are generated using the specified printf pattern.
 For example, "mip%2d.png" would generate mip01.png, mip02.png, etc.
 Note that miplevel 0 is not generated since it is the original image.
 
+The KTX format is the exception: the output is a single file that contains all the
+miplevels, including the original image, ready to be uploaded by Texture::setImage().
+
 Usage:
     MIPGEN [options] <input_file> <output_pattern>
 
@@ -54,7 +66,7 @@ Options:
        print copyright and license information
    --gallery, -g
        generate HTML gallery for review purposes (mipmap.html)
-   --format=[exr|hdr|rgbm|psd|png|dds], -f [exr|hdr|rgbm|psd|png|dds]
+   --format=[exr|hdr|rgbm|psd|png|dds|ktx], -f [exr|hdr|rgbm|psd|png|dds|ktx]
        specify output file format, inferred from output pattern if omitted
    --kernel=[box|nearest|hermite|gaussian|normals|mitchell|lanczos|min], -k [filter]
        specify filter kernel type (defaults to LANCZOS)
@@ -65,9 +77,16 @@ Options:
            Photoshop: 16 (default), 32
            OpenEXR: RAW, RLE, ZIPS, ZIP, PIZ (default)
            DDS: 8, 16 (default), 32
+           KTX: uncompressed RGBA8 (default), etc_rgb8, etc_srgb8, etc_rgba8, etc_srgba8,
+                s3tc_rgb_dxt1, s3tc_srgb_dxt1, s3tc_rgba_dxt5, s3tc_srgba_dxt5
+   --strips=ROWS, -s ROWS
+       decode, resample and encode the image ROWS rows at a time, this bounds the memory
+       used for very large images (the EXR, PSD and DDS outputs are still kept in memory,
+       the option is ignored for KTX)
 
-Example:
+Examples:
     MIPGEN -g --kernel=hermite grassland.png mip_%03d.png
+    MIPGEN --compression=etc_srgb8 grassland.png grassland.ktx
 )TXT";
 
 static const char* HTML_PREFIX = R"HTML(<!DOCTYPE html>
@@ -106,7 +125,7 @@ static void license() {
 }
 
 static int handleArguments(int argc, char* argv[]) {
-    static constexpr const char* OPTSTR = "hlgf:c:k:";
+    static constexpr const char* OPTSTR = "hlgf:c:k:s:";
     static const struct option OPTIONS[] = {
             { "help",                 no_argument, 0, 'h' },
             { "license",              no_argument, 0, 'l' },
@@ -114,6 +133,7 @@ static int handleArguments(int argc, char* argv[]) {
             { "format",         required_argument, 0, 'f' },
             { "compression",    required_argument, 0, 'c' },
             { "kernel",         required_argument, 0, 'k' },
+            { "strips",         required_argument, 0, 's' },
             { 0, 0, 0, 0 }  // termination of the option list
     };
 
@@ -166,16 +186,144 @@ static int handleArguments(int argc, char* argv[]) {
                     g_format = ImageEncoder::Format::DDS_LINEAR;
                     g_formatSpecified = true;
                 }
+                if (arg == "ktx") {
+                    g_ktx = true;
+                    g_formatSpecified = true;
+                }
                 break;
             case 'c':
                 g_compression = arg;
                 break;
+            case 's':
+                g_stripHeight = uint32_t(std::max(0, std::stoi(arg)));
+                break;
         }
     }
 
     return optind;
 }
 
+// Decodes, resamples and encodes the image a strip of rows at a time. All the miplevels are
+// resampled from the same strips, so that the source image is decoded only once.
+static void generateMipmapsInStrips(ImageDecoder::StripDecoder& decoder,
+        const string& outputPattern, uint32_t count, JobSystem& js) {
+    const uint32_t sourceWidth = decoder.getWidth();
+    const uint32_t sourceHeight = decoder.getHeight();
+    const uint32_t channels = decoder.getChannels();
+    const ImageSampler sampler {
+        .horizontalFilter = g_filter,
+        .verticalFilter = g_filter,
+        .jobSystem = &js
+    };
+
+    vector<unique_ptr<ofstream>> outputStreams;
+    vector<unique_ptr<ImageEncoder::StripEncoder>> encoders;
+    vector<unique_ptr<StripResampler>> resamplers;
+    char path[256];
+    uint32_t width = sourceWidth;
+    uint32_t height = sourceHeight;
+    for (uint32_t mip = 1; mip <= count; ++mip) {
+        width = std::max(width >> 1, 1u);
+        height = std::max(height >> 1, 1u);
+        int result = snprintf(path, sizeof(path), outputPattern.c_str(), mip);
+        if (result < 0 || result >= sizeof(path)) {
+            cerr << "Output pattern is too long." << endl;
+            exit(1);
+        }
+        outputStreams.emplace_back(new ofstream(path, ios::binary | ios::trunc));
+        if (!*outputStreams.back()) {
+            cerr << "The output file cannot be opened: " << path << endl;
+            exit(1);
+        }
+        encoders.push_back(ImageEncoder::encodeStrips(*outputStreams.back(), g_format,
+                width, height, channels, g_compression, path));
+        if (!encoders.back()) {
+            cerr << "The output file cannot be encoded: " << path << endl;
+            exit(1);
+        }
+        resamplers.emplace_back(new StripResampler(sourceWidth, sourceHeight, channels,
+                width, height, sampler));
+    }
+
+    for (LinearImage strip; (strip = decoder.decodeStrip(g_stripHeight)).isValid(); ) {
+        for (uint32_t level = 0; level < count; ++level) {
+            LinearImage rows = resamplers[level]->resample(strip);
+            if (rows.isValid()) {
+                encoders[level]->encodeStrip(rows);
+            }
+        }
+    }
+
+    for (auto& outputStream : outputStreams) {
+        outputStream->close();
+        if (!*outputStream) {
+            cerr << "An error occurred while writing the output files." << endl;
+        }
+    }
+}
+
+// Writes the source image and its miplevels into a single KTX file, block compressed if a
+// compression was specified.
+static void writeKtx(const string& path, const LinearImage& source,
+        const vector<LinearImage>& miplevels, JobSystem& js) {
+    CompressedFormat format;
+    const bool compressed = !g_compression.empty();
+    if (compressed && !parseCompressedFormat(g_compression, &format)) {
+        cerr << "Unrecognized KTX compression: " << g_compression << endl;
+        exit(1);
+    }
+
+    KtxBundle ktx(uint32_t(miplevels.size() + 1), 1, false);
+    KtxInfo& info = ktx.info();
+    info.pixelWidth = source.getWidth();
+    info.pixelHeight = source.getHeight();
+    info.pixelDepth = 0;
+    info.glTypeSize = 1;
+    if (compressed) {
+        info.glType = 0;
+        info.glFormat = 0;
+        info.glBaseInternalFormat = hasAlpha(format) ? KtxBundle::RGBA : KtxBundle::RGB;
+    } else {
+        info.glType = KtxBundle::UNSIGNED_BYTE;
+        info.glFormat = KtxBundle::RGBA;
+        info.glInternalFormat = KtxBundle::RGBA8;
+        info.glBaseInternalFormat = KtxBundle::RGBA;
+    }
+
+    for (uint32_t level = 0; level <= miplevels.size(); ++level) {
+        const LinearImage& image = level ? miplevels[level - 1] : source;
+        if (compressed) {
+            CompressedTexture texture = compressTexture(image, format, &js);
+            info.glInternalFormat = texture.glInternalFormat;
+            ktx.setBlob({ level, 0, 0 }, texture.data.get(), texture.size);
+            continue;
+        }
+        // RGBA8 rows are always 4 bytes aligned, as required by KTX
+        const uint32_t channels = image.getChannels();
+        const uint32_t count = image.getWidth() * image.getHeight();
+        vector<uint8_t> pixels(count * 4, 255);
+        float const* src = image.getPixelRef();
+        for (uint32_t i = 0; i < count; ++i, src += channels) {
+            for (uint32_t c = 0; c < std::min(channels, 4u); ++c) {
+                pixels[i * 4 + c] = uint8_t(math::saturate(src[c]) * 255.0f + 0.5f);
+            }
+            if (channels == 1) {
+                pixels[i * 4 + 1] = pixels[i * 4 + 2] = pixels[i * 4];
+            }
+        }
+        ktx.setBlob({ level, 0, 0 }, pixels.data(), uint32_t(pixels.size()));
+    }
+
+    vector<uint8_t> contents(ktx.getSerializedLength());
+    ktx.serialize(contents.data(), uint32_t(contents.size()));
+    ofstream outputStream(path, ios::binary | ios::trunc);
+    outputStream.write(reinterpret_cast<const char*>(contents.data()), contents.size());
+    outputStream.close();
+    if (!outputStream) {
+        cerr << "An error occurred while writing the output file: " << path << endl;
+    }
+}
+
 int main(int argc, char* argv[]) {
     int optionIndex = handleArguments(argc, argv);
     int numArgs = argc - optionIndex;
@@ -187,50 +335,78 @@ int main(int argc, char* argv[]) {
     string outputPattern(argv[optionIndex]);
     if (!g_formatSpecified) {
         constexpr bool forceLinear = true;
+        g_ktx = Path(outputPattern).getExtension() == "ktx";
         g_format = ImageEncoder::chooseFormat(outputPattern, forceLinear);
     }
 
     puts("Reading image...");
     ifstream inputStream(inputPath.getPath(), ios::binary);
-    LinearImage sourceImage = ImageDecoder::decode(inputStream, inputPath.getPath());
-    if (!sourceImage.isValid()) {
-        cerr << "Unable to open image: " << inputPath.getPath() << endl;
-        exit(1);
-    }
+    JobSystem js;
+    js.adopt();
 
-    puts("Generating miplevels...");
-    uint32_t count = getMipmapCount(sourceImage);
-    vector<LinearImage> miplevels(count);
-    generateMipmaps(sourceImage, g_filter, miplevels.data(), count);
+    uint32_t width;
+    uint32_t height;
+    uint32_t count;
+    if (g_stripHeight && !g_ktx) {
+        unique_ptr<ImageDecoder::StripDecoder> decoder =
+                ImageDecoder::decodeStrips(inputStream, inputPath.getPath());
+        if (!decoder) {
+            cerr << "Unable to open image: " << inputPath.getPath() << endl;
+            exit(1);
+        }
+        width = decoder->getWidth();
+        height = decoder->getHeight();
+        count = getMipmapCount(width, height);
 
-    puts("Writing image files to disk...");
-    char path[256];
-    uint32_t mip = 1; // start at 1 because 0 is the original image
-    for (auto image: miplevels) {
-        int result = snprintf(path, sizeof(path), outputPattern.c_str(), mip++);
-        if (result < 0 || result >= sizeof(path)) {
-            cerr << "Output pattern is too long." << endl;
+        puts("Generating and writing miplevels...");
+        generateMipmapsInStrips(*decoder, outputPattern, count, js);
+    } else {
+        LinearImage sourceImage = ImageDecoder::decode(inputStream, inputPath.getPath());
+        if (!sourceImage.isValid()) {
+            cerr << "Unable to open image: " << inputPath.getPath() << endl;
             exit(1);
         }
-        ofstream outputStream(path, ios::binary | ios::trunc);
-        if (!outputStream) {
-            cerr << "The output file cannot be opened: " << path << endl;
+        width = sourceImage.getWidth();
+        height = sourceImage.getHeight();
+
+        puts("Generating miplevels...");
+        count = getMipmapCount(sourceImage);
+        vector<LinearImage> miplevels(count);
+        generateMipmaps(sourceImage, g_filter, miplevels.data(), count, &js);
+
+        if (g_ktx) {
+            puts("Writing KTX file to disk...");
+            writeKtx(outputPattern, sourceImage, miplevels, js);
         } else {
-            ImageEncoder::encode(outputStream, g_format, image, g_compression, path);
-            outputStream.close();
-            if (!outputStream) {
-                cerr << "An error occurred while writing the output file: " << path << endl;
+            puts("Writing image files to disk...");
+            char path[256];
+            uint32_t mip = 1; // start at 1 because 0 is the original image
+            for (auto image: miplevels) {
+                int result = snprintf(path, sizeof(path), outputPattern.c_str(), mip++);
+                if (result < 0 || result >= sizeof(path)) {
+                    cerr << "Output pattern is too long." << endl;
+                    exit(1);
+                }
+                ofstream outputStream(path, ios::binary | ios::trunc);
+                if (!outputStream) {
+                    cerr << "The output file cannot be opened: " << path << endl;
+                } else {
+                    ImageEncoder::encode(outputStream, g_format, image, g_compression, path);
+                    outputStream.close();
+                    if (!outputStream) {
+                        cerr << "An error occurred while writing the output file: " << path << endl;
+                    }
+                }
             }
         }
     }
+    js.emancipate();
 
-    if (g_createGallery) {
+    if (g_createGallery && !g_ktx) {
         puts("Generating mipmaps.html...");
+        char path[256];
         char tag[256];
-        mip = 1;
         const char* pattern = R"(<image src="%s" width="%dpx" height="%dpx">)";
-        const uint32_t width = sourceImage.getWidth();
-        const uint32_t height = sourceImage.getHeight();
         ofstream html("mipmaps.html", ios::trunc);
         html << HTML_PREFIX;
         int result = snprintf(tag, sizeof(tag), pattern, inputPath.c_str(), width, height);
@@ -239,8 +415,8 @@ int main(int argc, char* argv[]) {
             exit(1);
         }
         html << tag << std::endl;
-        for (auto image: miplevels) {
-            snprintf(path, sizeof(path), outputPattern.c_str(), mip++);
+        for (uint32_t mip = 1; mip <= count; ++mip) {
+            snprintf(path, sizeof(path), outputPattern.c_str(), mip);
             result = snprintf(tag, sizeof(tag), pattern, path, width, height);
             if (result < 0 || result >= sizeof(tag)) {
                 cerr << "Output pattern is too long." << endl;
@@ -0,0 +1,437 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/Hash.h>
+#include <utils/JobSystem.h>
+#include <utils/Path.h>
+
+#include <getopt/getopt.h>
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+using namespace std;
+using namespace utils;
+
+static size_t g_threadCount = 0;
+static bool g_useHashes = false;
+static bool g_force = false;
+static bool g_dryRun = false;
+
+static const char* USAGE = R"TXT(
+TEXBATCH runs the asset tools (mipgen, cmgen, skygen, roughness-prefilter, normal-blending,
+specular-color, ...) over a whole project, as many at once as there are cores, and skips
+the jobs whose outputs are up to date.
+
+Usage:
+    TEXBATCH [options] <manifest>
+
+The manifest lists one job per line, as its outputs, its inputs and the command that makes
+the outputs from the inputs, separated by standalone colons:
+
+    # comment
+    <output> [<output> ...] : [<input> ...] : <command>
+
+For instance:
+
+    sky.hdr            :         : skygen sky.hdr
+    sky_ibl            : sky.hdr : cmgen -x sky_ibl sky.hdr
+    albedo.ktx         : albedo.png : mipgen -f ktx albedo.png albedo.ktx
+
+The commands are run by the shell, from the current directory. A job whose inputs are the
+outputs of other jobs runs after them.
+
+Options:
+   --help, -h
+       print this message
+   --license
+       print copyright and license information
+   --jobs=N, -j N
+       run N jobs at once, defaults to the number of cores
+   --hash
+       a job is up to date when its outputs exist and neither its inputs nor its command changed
+       since it last ran, the hashes are kept in <manifest>.stamps. By default a job is up to
+       date when its outputs are newer than its inputs
+   --force, -f
+       run all the jobs
+   --dry-run, -n
+       print the jobs that would run, without running them
+)TXT";
+
+static void printUsage(const char* name) {
+    std::string execName(utils::Path(name).getName());
+    const std::string from("TEXBATCH");
+    std::string usage(USAGE);
+    for (size_t pos = usage.find(from); pos != std::string::npos; pos = usage.find(from, pos)) {
+        usage.replace(pos, from.length(), execName);
+    }
+    puts(usage.c_str());
+}
+
+static void license() {
+    std::cout <<
+    #include "licenses/licenses.inc"
+    ;
+}
+
+static int handleArguments(int argc, char* argv[]) {
+    static constexpr const char* OPTSTR = "hj:fn";
+    static const struct option OPTIONS[] = {
+            { "help",          no_argument, 0, 'h' },
+            { "license",       no_argument, 0, 'l' },
+            { "jobs",    required_argument, 0, 'j' },
+            { "hash",          no_argument, 0, 's' },
+            { "force",         no_argument, 0, 'f' },
+            { "dry-run",       no_argument, 0, 'n' },
+            { 0, 0, 0, 0 }  // termination of the option list
+    };
+
+    int opt;
+    int optionIndex = 0;
+
+    while ((opt = getopt_long(argc, argv, OPTSTR, OPTIONS, &optionIndex)) >= 0) {
+        std::string arg(optarg ? optarg : "");
+        switch (opt) {
+            default:
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
+            case 'l':
+                license();
+                exit(0);
+            case 'j':
+                g_threadCount = size_t(std::max(1, atoi(arg.c_str())));
+                break;
+            case 's':
+                g_useHashes = true;
+                break;
+            case 'f':
+                g_force = true;
+                break;
+            case 'n':
+                g_dryRun = true;
+                break;
+        }
+    }
+
+    return optind;
+}
+
+struct Job {
+    std::vector<std::string> outputs;
+    std::vector<std::string> inputs;
+    std::string command;
+    size_t line = 0;
+    size_t level = 0;           // the jobs of a level only depend on the previous levels
+    uint32_t key = 0;           // hash of the command, identifies the job in the stamps
+    uint32_t stamp = 0;         // hash of the command and the inputs, with --hash
+    enum class Status { SKIPPED, DONE, FAILED } status = Status::SKIPPED;
+};
+
+static uint32_t hashString(std::string const& s, uint32_t seed) {
+    std::vector<uint32_t> words((s.size() + 4) / 4, 0);
+    memcpy(words.data(), s.data(), s.size());
+    return utils::hash::murmur3(words.data(), words.size(), seed);
+}
+
+// directories are only identified by their path
+static uint32_t hashFile(std::string const& path, uint32_t seed) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in || Path(path).isDirectory()) {
+        return hashString(path, seed);
+    }
+    std::vector<uint32_t> words(1 << 16);
+    uint32_t hash = seed;
+    do {
+        std::fill(words.begin(), words.end(), 0);
+        in.read((char*) words.data(), words.size() * sizeof(uint32_t));
+        const size_t count = (size_t(in.gcount()) + 3) / 4;
+        if (count) {
+            hash = utils::hash::murmur3(words.data(), count, hash);
+        }
+    } while (in);
+    return hash;
+}
+
+static bool modificationTime(std::string const& path, time_t* time) {
+    struct stat s;
+    if (stat(path.c_str(), &s) != 0) {
+        return false;
+    }
+    *time = s.st_mtime;
+    return true;
+}
+
+static bool parseManifest(Path const& path, std::vector<Job>& jobs) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Could not open the manifest " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    for (size_t lineNumber = 1; std::getline(in, line); lineNumber++) {
+        std::istringstream tokens(line);
+        std::string token;
+        if (!(tokens >> token) || token[0] == '#') {
+            continue;
+        }
+
+        Job job;
+        job.line = lineNumber;
+        std::vector<std::string>* list = &job.outputs;
+        do {
+            if (token == ":") {
+                if (list == &job.inputs) {
+                    break;
+                }
+                list = &job.inputs;
+            } else {
+                list->push_back(token);
+            }
+        } while (tokens >> token);
+
+        if (token == ":" && list == &job.inputs) {
+            std::getline(tokens, job.command);
+            job.command.erase(0, job.command.find_first_not_of(" \t"));
+        }
+        if (job.outputs.empty() || job.command.empty()) {
+            std::cerr << path << ":" << lineNumber
+                      << ": expected <outputs> : <inputs> : <command>" << std::endl;
+            return false;
+        }
+        job.key = hashString(job.command, 0);
+        jobs.push_back(std::move(job));
+    }
+    return true;
+}
+
+// Puts each job one level after the jobs making its inputs.
+static bool sortJobs(Path const& manifest, std::vector<Job>& jobs) {
+    std::map<std::string, size_t> producers;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        for (std::string const& output : jobs[i].outputs) {
+            if (!producers.emplace(output, i).second) {
+                std::cerr << manifest << ":" << jobs[i].line << ": " << output
+                          << " is already made by line " << jobs[producers[output]].line
+                          << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // a level can't exceed the number of jobs, unless there is a cycle
+    bool changed = true;
+    for (size_t pass = 0; changed; pass++) {
+        if (pass > jobs.size()) {
+            std::cerr << manifest << ": the jobs depend on each other in a cycle" << std::endl;
+            return false;
+        }
+        changed = false;
+        for (Job& job : jobs) {
+            for (std::string const& input : job.inputs) {
+                auto pos = producers.find(input);
+                if (pos != producers.end() && job.level <= jobs[pos->second].level) {
+                    job.level = jobs[pos->second].level + 1;
+                    changed = true;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static std::map<uint32_t, uint32_t> readStamps(std::string const& path) {
+    std::map<uint32_t, uint32_t> stamps;
+    std::ifstream in(path);
+    uint32_t key, stamp;
+    while (in >> std::hex >> key >> stamp) {
+        stamps[key] = stamp;
+    }
+    return stamps;
+}
+
+static void writeStamps(std::string const& path, std::map<uint32_t, uint32_t> const& stamps) {
+    std::ofstream out(path, std::ios::trunc);
+    for (auto const& stamp : stamps) {
+        char line[32];
+        snprintf(line, sizeof(line), "%08x %08x\n", stamp.first, stamp.second);
+        out << line;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int optionIndex = handleArguments(argc, argv);
+
+    int numArgs = argc - optionIndex;
+    if (numArgs < 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const Path manifest(argv[optionIndex]);
+    std::vector<Job> jobs;
+    if (!parseManifest(manifest, jobs) || !sortJobs(manifest, jobs)) {
+        return 1;
+    }
+
+    const std::string stampsPath = manifest.getPath() + ".stamps";
+    std::map<uint32_t, uint32_t> stamps;
+    if (g_useHashes) {
+        stamps = readStamps(stampsPath);
+    }
+
+    std::mutex lock;
+    std::set<std::string> failedOutputs;    // of the jobs that failed
+    std::set<std::string> staleOutputs;     // of the jobs that would run, with --dry-run
+
+    // This runs on the worker threads, once all the jobs of the previous levels are done.
+    auto run = [&](Job& job) {
+        auto fail = [&](std::string const& reason) {
+            std::lock_guard<std::mutex> guard(lock);
+            std::cerr << manifest << ":" << job.line << ": " << reason << std::endl;
+            job.status = Job::Status::FAILED;
+            failedOutputs.insert(job.outputs.begin(), job.outputs.end());
+        };
+
+        bool upToDate = !g_force;
+        time_t newestInput = 0;
+        for (std::string const& input : job.inputs) {
+            bool failed, stale;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                failed = failedOutputs.count(input) != 0;
+                stale = staleOutputs.count(input) != 0;
+            }
+            if (failed) {
+                fail("not run, " + input + " could not be made");
+                return;
+            }
+            if (stale) {
+                upToDate = false;
+                continue;
+            }
+            time_t time;
+            if (!modificationTime(input, &time)) {
+                fail("missing input " + input);
+                return;
+            }
+            newestInput = std::max(newestInput, time);
+        }
+
+        if (g_useHashes) {
+            job.stamp = job.key;
+            for (std::string const& input : job.inputs) {
+                job.stamp = hashFile(input, job.stamp);
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            auto pos = stamps.find(job.key);
+            upToDate = upToDate && pos != stamps.end() && pos->second == job.stamp;
+        }
+        for (std::string const& output : job.outputs) {
+            time_t time;
+            upToDate = upToDate && modificationTime(output, &time) &&
+                    (g_useHashes || time >= newestInput);
+        }
+        if (upToDate) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            std::cout << job.command << std::endl;
+            if (g_dryRun) {
+                staleOutputs.insert(job.outputs.begin(), job.outputs.end());
+                job.status = Job::Status::DONE;
+                return;
+            }
+        }
+
+        const int result = std::system(job.command.c_str());
+        if (result != 0) {
+            fail("failed (" + std::to_string(result) + "): " + job.command);
+            return;
+        }
+        for (std::string const& output : job.outputs) {
+            time_t time;
+            if (!modificationTime(output, &time)) {
+                fail("did not make " + output);
+                return;
+            }
+        }
+        job.status = Job::Status::DONE;
+    };
+
+    // The jobs of each level are spread over all the cores. The tools themselves have threads,
+    // but they're mostly idle while loading, encoding or compressing a single image.
+    JobSystem js(g_threadCount ? g_threadCount - 1 : 0);
+    js.adopt();
+    const size_t levelCount = jobs.empty() ? 0 : std::max_element(jobs.begin(), jobs.end(),
+            [](Job const& lhs, Job const& rhs) { return lhs.level < rhs.level; })->level + 1;
+    for (size_t level = 0; level < levelCount; level++) {
+        std::vector<Job*> batch;
+        for (Job& job : jobs) {
+            if (job.level == level) {
+                batch.push_back(&job);
+            }
+        }
+        if (g_threadCount == 1) {
+            for (Job* job : batch) {
+                run(*job);
+            }
+            continue;
+        }
+        auto runJobs = [&batch, &run](uint32_t start, uint32_t count) {
+            for (uint32_t i = start; i < start + count; i++) {
+                run(*batch[i]);
+            }
+        };
+        js.runAndWait(jobs::parallel_for(js, nullptr, 0, uint32_t(batch.size()),
+                std::cref(runJobs), jobs::CountSplitter<1>()));
+    }
+    js.emancipate();
+
+    size_t done = 0, skipped = 0, failed = 0;
+    for (Job const& job : jobs) {
+        switch (job.status) {
+            case Job::Status::SKIPPED: skipped++; break;
+            case Job::Status::DONE:    done++;    break;
+            case Job::Status::FAILED:  failed++;  break;
+        }
+        if (g_useHashes && !g_dryRun && job.status == Job::Status::DONE) {
+            stamps[job.key] = job.stamp;
+        }
+    }
+    if (g_useHashes && !g_dryRun) {
+        writeStamps(stampsPath, stamps);
+    }
+
+    std::cout << (g_dryRun ? "would run " : "ran ") << done << " jobs, " << skipped
+              << " up to date, " << failed << " failed" << std::endl;
+    return failed ? 1 : 0;
+}
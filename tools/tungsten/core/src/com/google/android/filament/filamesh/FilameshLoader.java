@@ -62,6 +62,7 @@ public class FilameshLoader {
         int indices16Bit;       // 0 if indices are stored as int, 1 if stored as uint16
         int totalIndices;
         int indicesSizeInBytes;
+        int flags;              // since version 2, 0x1 if the positions are quantized
     };
 
     private static boolean readMagicNumber(InputStream in) throws IOException {
@@ -99,6 +100,9 @@ public class FilameshLoader {
         header.indices16Bit = IOUtils.readIntLE(in);
         header.totalIndices = IOUtils.readIntLE(in);
         header.indicesSizeInBytes = IOUtils.readIntLE(in);
+        if (header.versionNumber >= 2) {
+            header.flags = IOUtils.readIntLE(in);
+        }
         return header;
     }
 
@@ -106,6 +110,11 @@ public class FilameshLoader {
         try {
             FilameshHeader header = readHeader(in);
 
+            if ((header.flags & 0x1) != 0) {
+                System.err.println("Mesh " + name + " has quantized positions, which are not supported.");
+                return null;
+            }
+
             if (header.numberOfParts > 1) {
                System.out.println("Mesh " + name + " has " + header.numberOfParts + " parts.");
                System.out.println("Currently, only 1 part supported.");